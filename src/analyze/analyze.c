@@ -40,6 +40,7 @@
 #include "strxcpyx.h"
 #include "time-util.h"
 #include "terminal-util.h"
+#include "unit-cache.h"
 #include "unit-name.h"
 #include "util.h"
 #include "verbs.h"
@@ -115,6 +116,17 @@ struct boot_times {
         usec_t reverse_offset;
 };
 
+/* One sample of the boot trace, see BootTraceIntervalSec= */
+struct trace_sample {
+        usec_t timestamp;
+        nsec_t cpu_usage_nsec;
+        uint64_t memory_current;
+        uint64_t io_read_bytes;
+        uint64_t io_write_bytes;
+        usec_t cpu_pressure_usec;
+        usec_t io_pressure_usec;
+};
+
 struct unit_times {
         bool has_data;
         char *name;
@@ -123,6 +135,12 @@ struct unit_times {
         usec_t deactivated;
         usec_t deactivating;
         usec_t time;
+
+        /* The boot trace samples bracketing the activation, if there are any */
+        bool has_trace;
+        struct trace_sample trace_begin;
+        struct trace_sample trace_end;
+        uint64_t trace_memory_peak;
 };
 
 struct host_info {
@@ -327,6 +345,182 @@ static void free_host_info(struct host_info *hi) {
 
 DEFINE_TRIVIAL_CLEANUP_FUNC(struct host_info*, free_host_info);
 
+static int acquire_boot_trace(sd_bus *bus, struct unit_times *unit_times, usec_t reverse_offset) {
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
+        _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
+        _cleanup_hashmap_free_ Hashmap *h = NULL;
+        struct unit_times *t;
+        const char *name;
+        int r;
+
+        r = sd_bus_call_method(
+                        bus,
+                        "org.freedesktop.systemd1",
+                        "/org/freedesktop/systemd1",
+                        "org.freedesktop.systemd1.Manager",
+                        "GetBootTrace",
+                        &error, &reply,
+                        NULL);
+        if (r < 0) {
+                /* Older managers don't know the boot trace, that's fine */
+                if (sd_bus_error_has_name(&error, SD_BUS_ERROR_UNKNOWN_METHOD))
+                        return 0;
+
+                return log_error_errno(r, "Failed to get boot trace: %s", bus_error_message(&error, r));
+        }
+
+        h = hashmap_new(&string_hash_ops);
+        if (!h)
+                return log_oom();
+
+        for (t = unit_times; t->has_data; t++) {
+                r = hashmap_put(h, t->name, t);
+                if (r < 0)
+                        return log_oom();
+        }
+
+        r = sd_bus_message_enter_container(reply, SD_BUS_TYPE_ARRAY, "(sttttttt)");
+        if (r < 0)
+                return bus_log_parse_error(r);
+
+        for (;;) {
+                struct trace_sample s;
+                usec_t end;
+
+                r = sd_bus_message_read(reply, "(sttttttt)",
+                                        &name,
+                                        &s.timestamp,
+                                        &s.cpu_usage_nsec,
+                                        &s.memory_current,
+                                        &s.io_read_bytes,
+                                        &s.io_write_bytes,
+                                        &s.cpu_pressure_usec,
+                                        &s.io_pressure_usec);
+                if (r < 0)
+                        return bus_log_parse_error(r);
+                if (r == 0)
+                        break;
+
+                t = hashmap_get(h, name);
+                if (!t)
+                        continue;
+
+                subtract_timestamp(&s.timestamp, reverse_offset);
+
+                /* The samples are in chronological order. Until the first sample in the activation window we just
+                 * remember the last one before it, if any; all counters start from zero when the unit's cgroup is
+                 * created otherwise. */
+                end = t->activating + t->time;
+                if (s.timestamp <= t->activating) {
+                        t->trace_begin = s;
+                        continue;
+                }
+                if (s.timestamp > end)
+                        continue;
+
+                if (!t->has_trace && t->trace_begin.timestamp == 0)
+                        t->trace_begin.timestamp = t->activating;
+
+                t->trace_end = s;
+                if (s.memory_current != UINT64_MAX)
+                        t->trace_memory_peak = MAX(t->trace_memory_peak, s.memory_current);
+                t->has_trace = true;
+        }
+
+        r = sd_bus_message_exit_container(reply);
+        if (r < 0)
+                return bus_log_parse_error(r);
+
+        return 0;
+}
+
+static uint64_t trace_delta(uint64_t begin, uint64_t end) {
+        if (begin == UINT64_MAX || end == UINT64_MAX || end < begin)
+                return UINT64_MAX;
+
+        return end - begin;
+}
+
+static int unit_times_trace_string(const struct unit_times *t, char **ret) {
+        _cleanup_strv_free_ char **l = NULL;
+        uint64_t cpu, cpu_wait, io_wait, io_read, io_write, most = 0;
+        const char *bottleneck = NULL;
+        char buf[FORMAT_BYTES_MAX];
+        usec_t duration;
+        char *s;
+
+        assert(t);
+        assert(ret);
+
+        /* Summarizes what a unit spent its activation time on, and what it was most likely held up by */
+
+        duration = t->trace_end.timestamp - t->trace_begin.timestamp;
+        if (!t->has_trace || duration <= 0) {
+                *ret = NULL;
+                return 0;
+        }
+
+        cpu = trace_delta(t->trace_begin.cpu_usage_nsec, t->trace_end.cpu_usage_nsec);
+        cpu_wait = trace_delta(t->trace_begin.cpu_pressure_usec, t->trace_end.cpu_pressure_usec);
+        io_wait = trace_delta(t->trace_begin.io_pressure_usec, t->trace_end.io_pressure_usec);
+        io_read = trace_delta(t->trace_begin.io_read_bytes, t->trace_end.io_read_bytes);
+        io_write = trace_delta(t->trace_begin.io_write_bytes, t->trace_end.io_write_bytes);
+
+        if (cpu != UINT64_MAX) {
+                cpu /= NSEC_PER_USEC;
+                if (strv_extendf(&l, "cpu %" PRIu64 "%%", cpu * 100 / duration) < 0)
+                        return -ENOMEM;
+                if (cpu > most) {
+                        most = cpu;
+                        bottleneck = "on-CPU";
+                }
+        }
+        if (cpu_wait != UINT64_MAX) {
+                if (strv_extendf(&l, "cpu wait %" PRIu64 "%%", cpu_wait * 100 / duration) < 0)
+                        return -ENOMEM;
+                if (cpu_wait > most) {
+                        most = cpu_wait;
+                        bottleneck = "waiting for CPU";
+                }
+        }
+        if (io_wait != UINT64_MAX) {
+                if (strv_extendf(&l, "io wait %" PRIu64 "%%", io_wait * 100 / duration) < 0)
+                        return -ENOMEM;
+                if (io_wait > most) {
+                        most = io_wait;
+                        bottleneck = "waiting for I/O";
+                }
+        }
+        if (io_read != UINT64_MAX && io_write != UINT64_MAX)
+                if (strv_extendf(&l, "io %s", format_bytes(buf, sizeof(buf), io_read + io_write)) < 0)
+                        return -ENOMEM;
+        if (t->trace_memory_peak > 0)
+                if (strv_extendf(&l, "mem %s", format_bytes(buf, sizeof(buf), t->trace_memory_peak)) < 0)
+                        return -ENOMEM;
+
+        if (strv_isempty(l)) {
+                *ret = NULL;
+                return 0;
+        }
+
+        s = strv_join(l, ", ");
+        if (!s)
+                return -ENOMEM;
+
+        /* If nothing we sample accounts for at least a quarter of the time, the unit was most likely waiting for
+         * something else, e.g. another unit or the network */
+        if (!bottleneck || most * 4 < duration)
+                bottleneck = "waiting for something else";
+
+        if (!strextend(&s, "; ", bottleneck, NULL)) {
+                free(s);
+                return -ENOMEM;
+        }
+
+        *ret = s;
+        return 1;
+}
+
 static int acquire_time_data(sd_bus *bus, struct unit_times **out) {
         static const struct bus_properties_map property_map[] = {
                 { "InactiveExitTimestampMonotonic",  "t", NULL, offsetof(struct unit_times, activating)   },
@@ -370,7 +564,7 @@ static int acquire_time_data(sd_bus *bus, struct unit_times **out) {
 
                 unit_times[c+1].has_data = false;
                 t = &unit_times[c];
-                t->name = NULL;
+                *t = (struct unit_times) {};
 
                 assert_cc(sizeof(usec_t) == sizeof(uint64_t));
 
@@ -411,6 +605,12 @@ static int acquire_time_data(sd_bus *bus, struct unit_times **out) {
         if (r < 0)
                 return bus_log_parse_error(r);
 
+        if (c > 0) {
+                r = acquire_boot_trace(bus, unit_times, boot_times->reverse_offset);
+                if (r < 0)
+                        return r;
+        }
+
         *out = TAKE_PTR(unit_times);
         return c;
 }
@@ -580,6 +780,7 @@ static void svg_graph_box(double height, double begin, double end) {
 }
 
 static int plot_unit_times(struct unit_times *u, double width, int y) {
+        _cleanup_free_ char *trace = NULL;
         char ts[FORMAT_TIMESPAN_MAX];
         bool b;
 
@@ -592,9 +793,13 @@ static int plot_unit_times(struct unit_times *u, double width, int y) {
 
         /* place the text on the left if we have passed the half of the svg width */
         b = u->activating * SCALE_X < width / 2;
+        /* Overlay what the unit was busy with while activating, if we have a boot trace */
+        (void) unit_times_trace_string(u, &trace);
+
         if (u->time)
-                svg_text(b, u->activating, y, "%s (%s)",
-                         u->name, format_timespan(ts, sizeof(ts), u->time, USEC_PER_MSEC));
+                svg_text(b, u->activating, y, "%s (%s%s%s)",
+                         u->name, format_timespan(ts, sizeof(ts), u->time, USEC_PER_MSEC),
+                         trace ? ", " : "", strempty(trace));
         else
                 svg_text(b, u->activating, y, "%s", u->name);
 
@@ -819,6 +1024,7 @@ static int analyze_plot(int argc, char *argv[], void *userdata) {
 
 static int list_dependencies_print(const char *name, unsigned level, unsigned branches,
                                    bool last, struct unit_times *times, struct boot_times *boot) {
+        _cleanup_free_ char *trace = NULL;
         unsigned i;
         char ts[FORMAT_TIMESPAN_MAX], ts2[FORMAT_TIMESPAN_MAX];
 
@@ -836,6 +1042,11 @@ static int list_dependencies_print(const char *name, unsigned level, unsigned br
                         printf("%s @%s", name, format_timespan(ts, sizeof(ts), times->activated - boot->userspace_time, USEC_PER_MSEC));
                 else
                         printf("%s", name);
+
+                if (unit_times_trace_string(times, &trace) < 0)
+                        return log_oom();
+                if (trace)
+                        printf(" (%s)", trace);
         } else
                 printf("%s", name);
         printf("\n");
@@ -1504,6 +1715,89 @@ static int dump_unit_paths(int argc, char *argv[], void *userdata) {
         return 0;
 }
 
+static int get_manager_unit_path(char ***ret) {
+        _cleanup_(lookup_paths_free) LookupPaths paths = {};
+        _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
+        _cleanup_(sd_bus_flush_close_unrefp) sd_bus *bus = NULL;
+        char **l;
+        int r;
+
+        /* The unit cache is only used if it was built for the exact search path of the service manager, hence ask
+         * it for it. If it is not running, predict what it would use. */
+
+        r = acquire_bus(&bus, NULL);
+        if (r >= 0) {
+                r = sd_bus_get_property_strv(
+                                bus,
+                                "org.freedesktop.systemd1",
+                                "/org/freedesktop/systemd1",
+                                "org.freedesktop.systemd1.Manager",
+                                "UnitPath",
+                                &error,
+                                ret);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to get unit path of service manager: %s", bus_error_message(&error, r));
+
+                return 0;
+        }
+
+        log_debug_errno(r, "Failed to connect to service manager, using default unit path: %m");
+
+        r = lookup_paths_init(&paths, UNIT_FILE_SYSTEM, 0, NULL);
+        if (r < 0)
+                return log_error_errno(r, "lookup_paths_init() failed: %m");
+
+        r = lookup_paths_reduce(&paths);
+        if (r < 0)
+                return log_error_errno(r, "lookup_paths_reduce() failed: %m");
+
+        l = strv_copy(paths.search_path);
+        if (!l)
+                return log_oom();
+
+        *ret = l;
+        return 0;
+}
+
+static int update_unit_cache(int argc, char *argv[], void *userdata) {
+        _cleanup_strv_free_ char **search_path = NULL;
+        const char *path;
+        int r;
+
+        if (arg_scope != UNIT_FILE_SYSTEM) {
+                log_error("The unit cache is only supported for the system service manager.");
+                return -EOPNOTSUPP;
+        }
+
+        path = argc > 1 ? argv[1] : unit_cache_path();
+
+        r = get_manager_unit_path(&search_path);
+        if (r < 0)
+                return r;
+
+        r = unit_cache_write(path, search_path);
+        if (r < 0)
+                return log_error_errno(r, "Failed to write unit cache %s: %m", path);
+
+        return 0;
+}
+
+static int dump_unit_cache(int argc, char *argv[], void *userdata) {
+        _cleanup_(unit_cache_freep) UnitCache *c = NULL;
+        const char *path;
+        int r;
+
+        path = argc > 1 ? argv[1] : unit_cache_path();
+
+        r = unit_cache_open(path, NULL, &c);
+        if (r < 0)
+                return log_error_errno(r, "Failed to open unit cache %s: %m", path);
+
+        (void) pager_open(arg_pager_flags);
+
+        return unit_cache_dump(c, stdout);
+}
+
 #if HAVE_SECCOMP
 
 static int load_kernel_syscalls(Set **ret) {
@@ -1837,6 +2131,8 @@ static int help(int argc, char *argv[], void *userdata) {
                "  dump                     Output state serialization of service manager\n"
                "  cat-config               Show configuration file and drop-ins\n"
                "  unit-paths               List load directories for units\n"
+               "  update-unit-cache [PATH] Build the precompiled unit database\n"
+               "  unit-cache [PATH]        Show the precompiled unit database\n"
                "  syscall-filter [NAME...] Print list of syscalls in seccomp filter\n"
                "  verify FILE...           Check unit files for correctness\n"
                "  calendar SPEC...         Validate repetitive calendar time events\n"
@@ -2025,6 +2321,8 @@ static int run(int argc, char *argv[]) {
                 { "dump",              VERB_ANY, 1,        0,            dump                   },
                 { "cat-config",        2,        VERB_ANY, 0,            cat_config             },
                 { "unit-paths",        1,        1,        0,            dump_unit_paths        },
+                { "update-unit-cache", VERB_ANY, 2,        0,            update_unit_cache      },
+                { "unit-cache",        VERB_ANY, 2,        0,            dump_unit_cache        },
                 { "syscall-filter",    VERB_ANY, VERB_ANY, 0,            dump_syscall_filters   },
                 { "verify",            2,        VERB_ANY, 0,            do_verify              },
                 { "calendar",          2,        VERB_ANY, 0,            test_calendar          },
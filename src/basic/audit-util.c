@@ -15,7 +15,7 @@
 #include "user-util.h"
 
 int audit_session_from_pid(pid_t pid, uint32_t *id) {
-        _cleanup_free_ char *s = NULL;
+        char s[DECIMAL_STR_MAX(uint32_t) + 1];
         const char *p;
         uint32_t u;
         int r;
@@ -29,7 +29,7 @@ int audit_session_from_pid(pid_t pid, uint32_t *id) {
 
         p = procfs_file_alloca(pid, "sessionid");
 
-        r = read_one_line_file(p, &s);
+        r = read_one_line_file_buf(p, s, sizeof(s));
         if (r < 0)
                 return r;
 
@@ -45,7 +45,7 @@ int audit_session_from_pid(pid_t pid, uint32_t *id) {
 }
 
 int audit_loginuid_from_pid(pid_t pid, uid_t *uid) {
-        _cleanup_free_ char *s = NULL;
+        char s[DECIMAL_STR_MAX(uid_t) + 1];
         const char *p;
         uid_t u;
         int r;
@@ -54,7 +54,7 @@ int audit_loginuid_from_pid(pid_t pid, uid_t *uid) {
 
         p = procfs_file_alloca(pid, "loginuid");
 
-        r = read_one_line_file(p, &s);
+        r = read_one_line_file_buf(p, s, sizeof(s));
         if (r < 0)
                 return r;
 
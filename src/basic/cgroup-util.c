@@ -88,6 +88,60 @@ int cg_read_pid(FILE *f, pid_t *_pid) {
         return 1;
 }
 
+int cg_read_pids(const char *controller, const char *path, pid_t **ret_pids, size_t *ret_n) {
+        _cleanup_free_ char *fs = NULL, *contents = NULL;
+        _cleanup_free_ pid_t *pids = NULL;
+        size_t size, n = 0;
+        const char *p;
+        int r;
+
+        /* Like cg_enumerate_processes() plus cg_read_pid() in a loop, but reads all of cgroup.procs in one go
+         * and parses it from that buffer, which is a lot cheaper for cgroups with many processes. As above,
+         * the array might contain duplicates. */
+
+        assert(ret_pids);
+        assert(ret_n);
+
+        r = cg_get_path(controller, path, "cgroup.procs", &fs);
+        if (r < 0)
+                return r;
+
+        r = read_full_file(fs, &contents, &size);
+        if (r < 0)
+                return r;
+
+        /* Each PID takes up at least one digit and one separator */
+        pids = new(pid_t, size / 2 + 1);
+        if (!pids)
+                return -ENOMEM;
+
+        p = contents + strspn(contents, WHITESPACE);
+        while (*p != 0) {
+                unsigned long ul = 0;
+
+                for (; *p >= '0' && *p <= '9'; p++) {
+                        ul = ul * 10 + (*p - '0');
+                        if (ul > INT_MAX)
+                                return -EIO;
+                }
+
+                if (ul <= 0)
+                        return -EIO;
+
+                if (*p != 0 && !strchr(WHITESPACE, *p))
+                        return -EIO;
+
+                assert(n < size / 2 + 1);
+                pids[n++] = (pid_t) ul;
+
+                p += strspn(p, WHITESPACE);
+        }
+
+        *ret_pids = TAKE_PTR(pids);
+        *ret_n = n;
+        return 0;
+}
+
 int cg_read_event(
                 const char *controller,
                 const char *path,
@@ -246,11 +300,11 @@ int cg_kill(
         my_pid = getpid_cached();
 
         do {
-                _cleanup_fclose_ FILE *f = NULL;
-                pid_t pid = 0;
+                _cleanup_free_ pid_t *pids = NULL;
+                size_t n, i;
                 done = true;
 
-                r = cg_enumerate_processes(controller, path, &f);
+                r = cg_read_pids(controller, path, &pids, &n);
                 if (r < 0) {
                         if (ret >= 0 && r != -ENOENT)
                                 return r;
@@ -258,7 +312,8 @@ int cg_kill(
                         return ret;
                 }
 
-                while ((r = cg_read_pid(f, &pid)) > 0) {
+                for (i = 0; i < n; i++) {
+                        pid_t pid = pids[i];
 
                         if ((flags & CGROUP_IGNORE_SELF) && pid == my_pid)
                                 continue;
@@ -293,13 +348,6 @@ int cg_kill(
                         }
                 }
 
-                if (r < 0) {
-                        if (ret >= 0)
-                                return r;
-
-                        return ret;
-                }
-
                 /* To avoid racing against processes which fork
                  * quicker than we can kill them we repeat this until
                  * no new pids need to be killed. */
@@ -390,11 +438,11 @@ int cg_migrate(
         my_pid = getpid_cached();
 
         do {
-                _cleanup_fclose_ FILE *f = NULL;
-                pid_t pid = 0;
+                _cleanup_free_ pid_t *pids = NULL;
+                size_t n, i;
                 done = true;
 
-                r = cg_enumerate_processes(cfrom, pfrom, &f);
+                r = cg_read_pids(cfrom, pfrom, &pids, &n);
                 if (r < 0) {
                         if (ret >= 0 && r != -ENOENT)
                                 return r;
@@ -402,7 +450,8 @@ int cg_migrate(
                         return ret;
                 }
 
-                while ((r = cg_read_pid(f, &pid)) > 0) {
+                for (i = 0; i < n; i++) {
+                        pid_t pid = pids[i];
 
                         /* This might do weird stuff if we aren't a
                          * single-threaded program. However, we
@@ -438,13 +487,6 @@ int cg_migrate(
                                 return ret;
                         }
                 }
-
-                if (r < 0) {
-                        if (ret >= 0)
-                                return r;
-
-                        return ret;
-                }
         } while (!done);
 
         return ret;
@@ -2026,6 +2068,24 @@ int cg_get_attribute(const char *controller, const char *path, const char *attri
         return read_one_line_file(p, ret);
 }
 
+int cg_get_attribute_as_uint64(const char *controller, const char *path, const char *attribute, uint64_t *ret) {
+        char buf[DECIMAL_STR_MAX(uint64_t) + 1];
+        _cleanup_free_ char *p = NULL;
+        int r;
+
+        assert(ret);
+
+        r = cg_get_path(controller, path, attribute, &p);
+        if (r < 0)
+                return r;
+
+        r = read_one_line_file_buf(p, buf, sizeof(buf));
+        if (r < 0)
+                return r;
+
+        return safe_atou64(buf, ret);
+}
+
 int cg_get_keyed_attribute(
                 const char *controller,
                 const char *path,
@@ -7,6 +7,7 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "alloc-util.h"
 #include "conf-files.h"
 #include "def.h"
 #include "dirent-util.h"
@@ -21,114 +22,277 @@
 #include "string-util.h"
 #include "strv.h"
 #include "terminal-util.h"
+#include "time-util.h"
 #include "util.h"
 
-static int files_add(
-                Hashmap *h,
-                Set *masked,
-                const char *suffix,
-                const char *root,
-                unsigned flags,
-                const char *path) {
+/* Directory listings are cached for the flags that need nothing but the file names, which is what drop-in
+ * directories and most .d/ directories are enumerated with. A listing is validated against the inode and the
+ * modification time of the directory. Since the latter is not updated at a fine enough granularity to notice all
+ * changes, listings of directories modified shortly before they were read are not trusted. */
+#define CACHE_MTIME_GRACE_USEC (1 * USEC_PER_SEC)
+
+typedef struct CachedDirectory {
+        char *path;
+        dev_t st_dev;
+        ino_t st_ino;
+        struct timespec st_mtim;
+        bool trusted;
+        char **names;
+} CachedDirectory;
+
+static bool cache_enabled = false;
+static Hashmap *cache = NULL;
+
+static CachedDirectory *cached_directory_free(CachedDirectory *c) {
+        if (!c)
+                return NULL;
+
+        free(c->path);
+        strv_free(c->names);
+        return mfree(c);
+}
 
+static bool cached_directory_is_valid(const CachedDirectory *c, const struct stat *st) {
+        return c->trusted &&
+                c->st_dev == st->st_dev &&
+                c->st_ino == st->st_ino &&
+                c->st_mtim.tv_sec == st->st_mtim.tv_sec &&
+                c->st_mtim.tv_nsec == st->st_mtim.tv_nsec;
+}
+
+static int cached_directory_get(const char *dirpath, char ***ret) {
         _cleanup_closedir_ DIR *dir = NULL;
-        const char *dirpath;
+        _cleanup_strv_free_ char **names = NULL;
+        CachedDirectory *c;
         struct dirent *de;
+        struct stat st;
+        size_t n = 0, allocated = 0;
         int r;
 
-        assert(h);
-        assert((flags & CONF_FILES_FILTER_MASKED) == 0 || masked);
-        assert(path);
+        assert(dirpath);
+        assert(ret);
 
-        dirpath = prefix_roota(root, path);
+        if (stat(dirpath, &st) < 0)
+                return -errno;
+
+        c = hashmap_get(cache, dirpath);
+        if (c && cached_directory_is_valid(c, &st)) {
+                *ret = c->names;
+                return 0;
+        }
 
         dir = opendir(dirpath);
-        if (!dir) {
-                if (errno == ENOENT)
-                        return 0;
+        if (!dir)
+                return -errno;
 
-                return log_debug_errno(errno, "Failed to open directory '%s': %m", dirpath);
+        FOREACH_DIRENT(de, dir, return -errno) {
+                if (!GREEDY_REALLOC(names, allocated, n + 2))
+                        return -ENOMEM;
+
+                names[n] = strdup(de->d_name);
+                if (!names[n])
+                        return -ENOMEM;
+
+                names[++n] = NULL;
         }
 
-        FOREACH_DIRENT(de, dir, return -errno) {
-                struct stat st;
-                char *p, *key;
+        if (!names) {
+                names = new0(char*, 1);
+                if (!names)
+                        return -ENOMEM;
+        }
 
-                /* Does this match the suffix? */
-                if (suffix && !endswith(de->d_name, suffix))
-                        continue;
+        if (!c) {
+                r = hashmap_ensure_allocated(&cache, &path_hash_ops);
+                if (r < 0)
+                        return r;
+
+                c = new0(CachedDirectory, 1);
+                if (!c)
+                        return -ENOMEM;
 
-                /* Has this file already been found in an earlier directory? */
-                if (hashmap_contains(h, de->d_name)) {
-                        log_debug("Skipping overridden file '%s/%s'.", dirpath, de->d_name);
-                        continue;
+                c->path = strdup(dirpath);
+                if (!c->path) {
+                        free(c);
+                        return -ENOMEM;
                 }
 
-                /* Has this been masked in an earlier directory? */
-                if ((flags & CONF_FILES_FILTER_MASKED) && set_contains(masked, de->d_name)) {
-                        log_debug("File '%s/%s' is masked by previous entry.", dirpath, de->d_name);
-                        continue;
+                r = hashmap_put(cache, c->path, c);
+                if (r < 0) {
+                        cached_directory_free(c);
+                        return r;
                 }
+        }
 
-                /* Read file metadata if we shall validate the check for file masks, for node types or whether the node is marked executable. */
-                if (flags & (CONF_FILES_FILTER_MASKED|CONF_FILES_REGULAR|CONF_FILES_DIRECTORY|CONF_FILES_EXECUTABLE))
-                        if (fstatat(dirfd(dir), de->d_name, &st, 0) < 0) {
-                                log_debug_errno(errno, "Failed to stat '%s/%s', ignoring: %m", dirpath, de->d_name);
-                                continue;
-                        }
+        c->st_dev = st.st_dev;
+        c->st_ino = st.st_ino;
+        c->st_mtim = st.st_mtim;
+        c->trusted = usec_add(timespec_load(&st.st_mtim), CACHE_MTIME_GRACE_USEC) < now(CLOCK_REALTIME);
+        strv_free_and_replace(c->names, names);
 
-                /* Is this a masking entry? */
-                if ((flags & CONF_FILES_FILTER_MASKED))
-                        if (null_or_empty(&st)) {
-                                /* Mark this one as masked */
-                                r = set_put_strdup(masked, de->d_name);
-                                if (r < 0)
-                                        return r;
+        *ret = c->names;
+        return 0;
+}
 
-                                log_debug("File '%s/%s' is a mask.", dirpath, de->d_name);
-                                continue;
-                        }
+void conf_files_cache_flush(void) {
+        CachedDirectory *c;
 
-                /* Does this node have the right type? */
-                if (flags & (CONF_FILES_REGULAR|CONF_FILES_DIRECTORY))
-                        if (!((flags & CONF_FILES_DIRECTORY) && S_ISDIR(st.st_mode)) &&
-                            !((flags & CONF_FILES_REGULAR) && S_ISREG(st.st_mode))) {
-                                log_debug("Ignoring '%s/%s', as it is not a of the right type.", dirpath, de->d_name);
-                                continue;
-                        }
+        while ((c = hashmap_steal_first(cache)))
+                cached_directory_free(c);
 
-                /* Does this node have the executable bit set? */
-                if (flags & CONF_FILES_EXECUTABLE)
-                        /* As requested: check if the file is marked exectuable. Note that we don't check access(X_OK)
-                         * here, as we care about whether the file is marked executable at all, and not whether it is
-                         * executable for us, because if so, such errors are stuff we should log about. */
+        cache = hashmap_free(cache);
+}
 
-                        if ((st.st_mode & 0111) == 0) { /* not executable */
-                                log_debug("Ignoring '%s/%s', as it is not marked executable.", dirpath, de->d_name);
-                                continue;
-                        }
+void conf_files_cache_set_enabled(bool b) {
+        /* The cache is not thread-safe, hence only enable this in processes which enumerate configuration
+         * directories from a single thread. */
 
-                if (flags & CONF_FILES_BASENAME) {
-                        p = strdup(de->d_name);
-                        if (!p)
-                                return -ENOMEM;
+        cache_enabled = b;
+        if (!b)
+                conf_files_cache_flush();
+}
 
-                        key = p;
-                } else {
-                        p = strjoin(dirpath, "/", de->d_name);
-                        if (!p)
-                                return -ENOMEM;
+static int files_add_one(
+                Hashmap *h,
+                Set *masked,
+                const char *suffix,
+                unsigned flags,
+                const char *dirpath,
+                int dir_fd,
+                const char *name) {
+
+        struct stat st;
+        char *p, *key;
+        int r;
+
+        /* Does this match the suffix? */
+        if (suffix && !endswith(name, suffix))
+                return 0;
 
-                        key = basename(p);
+        /* Has this file already been found in an earlier directory? */
+        if (hashmap_contains(h, name)) {
+                log_debug("Skipping overridden file '%s/%s'.", dirpath, name);
+                return 0;
+        }
+
+        /* Has this been masked in an earlier directory? */
+        if ((flags & CONF_FILES_FILTER_MASKED) && set_contains(masked, name)) {
+                log_debug("File '%s/%s' is masked by previous entry.", dirpath, name);
+                return 0;
+        }
+
+        /* Read file metadata if we shall validate the check for file masks, for node types or whether the node is marked executable. */
+        if (flags & (CONF_FILES_FILTER_MASKED|CONF_FILES_REGULAR|CONF_FILES_DIRECTORY|CONF_FILES_EXECUTABLE))
+                if (fstatat(dir_fd, name, &st, 0) < 0) {
+                        log_debug_errno(errno, "Failed to stat '%s/%s', ignoring: %m", dirpath, name);
+                        return 0;
                 }
 
-                r = hashmap_put(h, key, p);
-                if (r < 0) {
-                        free(p);
-                        return log_debug_errno(r, "Failed to add item to hashmap: %m");
+        /* Is this a masking entry? */
+        if ((flags & CONF_FILES_FILTER_MASKED))
+                if (null_or_empty(&st)) {
+                        /* Mark this one as masked */
+                        r = set_put_strdup(masked, name);
+                        if (r < 0)
+                                return r;
+
+                        log_debug("File '%s/%s' is a mask.", dirpath, name);
+                        return 0;
+                }
+
+        /* Does this node have the right type? */
+        if (flags & (CONF_FILES_REGULAR|CONF_FILES_DIRECTORY))
+                if (!((flags & CONF_FILES_DIRECTORY) && S_ISDIR(st.st_mode)) &&
+                    !((flags & CONF_FILES_REGULAR) && S_ISREG(st.st_mode))) {
+                        log_debug("Ignoring '%s/%s', as it is not a of the right type.", dirpath, name);
+                        return 0;
+                }
+
+        /* Does this node have the executable bit set? */
+        if (flags & CONF_FILES_EXECUTABLE)
+                /* As requested: check if the file is marked exectuable. Note that we don't check access(X_OK)
+                 * here, as we care about whether the file is marked executable at all, and not whether it is
+                 * executable for us, because if so, such errors are stuff we should log about. */
+
+                if ((st.st_mode & 0111) == 0) { /* not executable */
+                        log_debug("Ignoring '%s/%s', as it is not marked executable.", dirpath, name);
+                        return 0;
                 }
 
-                assert(r > 0);
+        if (flags & CONF_FILES_BASENAME) {
+                p = strdup(name);
+                if (!p)
+                        return -ENOMEM;
+
+                key = p;
+        } else {
+                p = strjoin(dirpath, "/", name);
+                if (!p)
+                        return -ENOMEM;
+
+                key = basename(p);
+        }
+
+        r = hashmap_put(h, key, p);
+        if (r < 0) {
+                free(p);
+                return log_debug_errno(r, "Failed to add item to hashmap: %m");
+        }
+
+        assert(r > 0);
+        return 0;
+}
+
+static int files_add(
+                Hashmap *h,
+                Set *masked,
+                const char *suffix,
+                const char *root,
+                unsigned flags,
+                const char *path) {
+
+        _cleanup_closedir_ DIR *dir = NULL;
+        const char *dirpath;
+        struct dirent *de;
+        int r;
+
+        assert(h);
+        assert((flags & CONF_FILES_FILTER_MASKED) == 0 || masked);
+        assert(path);
+
+        dirpath = prefix_roota(root, path);
+
+        if (cache_enabled &&
+            !(flags & (CONF_FILES_FILTER_MASKED|CONF_FILES_REGULAR|CONF_FILES_DIRECTORY|CONF_FILES_EXECUTABLE))) {
+                char **names, **name;
+
+                r = cached_directory_get(dirpath, &names);
+                if (r == -ENOENT)
+                        return 0;
+                if (r < 0)
+                        return log_debug_errno(r, "Failed to open directory '%s': %m", dirpath);
+
+                STRV_FOREACH(name, names) {
+                        r = files_add_one(h, masked, suffix, flags, dirpath, -1, *name);
+                        if (r < 0)
+                                return r;
+                }
+
+                return 0;
+        }
+
+        dir = opendir(dirpath);
+        if (!dir) {
+                if (errno == ENOENT)
+                        return 0;
+
+                return log_debug_errno(errno, "Failed to open directory '%s': %m", dirpath);
+        }
+
+        FOREACH_DIRENT(de, dir, return -errno) {
+                r = files_add_one(h, masked, suffix, flags, dirpath, dirfd(dir), de->d_name);
+                if (r < 0)
+                        return r;
         }
 
         return 0;
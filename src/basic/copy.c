@@ -370,7 +370,7 @@ static int fd_copy_regular(
                 const char *to,
                 uid_t override_uid,
                 gid_t override_gid,
-                CopyFlags copy_flags,
+                CopyFlags *copy_flags,
                 copy_progress_bytes_t progress,
                 void *userdata) {
 
@@ -381,6 +381,7 @@ static int fd_copy_regular(
         assert(from);
         assert(st);
         assert(to);
+        assert(copy_flags);
 
         fdf = openat(df, from, O_RDONLY|O_CLOEXEC|O_NOCTTY|O_NOFOLLOW);
         if (fdf < 0)
@@ -390,10 +391,27 @@ static int fd_copy_regular(
         if (fdt < 0)
                 return -errno;
 
-        r = copy_bytes_full(fdf, fdt, (uint64_t) -1, copy_flags, NULL, NULL, progress, userdata);
+        /* Try a whole-file reflink first. The btrfs clone ioctl is the generic FICLONE, hence this works on XFS
+         * and other file systems supporting shared extents, too. If the file system pair doesn't support this at
+         * all, stop trying for the remaining files of this directory, instead of failing the ioctl for each. */
+        r = -EOPNOTSUPP;
+        if (*copy_flags & COPY_REFLINK) {
+                r = btrfs_reflink(fdf, fdt);
+                if (IN_SET(r, -EOPNOTSUPP, -ENOTTY, -EXDEV))
+                        *copy_flags &= ~COPY_REFLINK;
+        }
         if (r < 0) {
-                (void) unlinkat(dt, to, 0);
-                return r;
+                r = copy_bytes_full(fdf, fdt, (uint64_t) -1, *copy_flags & ~COPY_REFLINK, NULL, NULL, progress, userdata);
+                if (r < 0) {
+                        (void) unlinkat(dt, to, 0);
+                        return r;
+                }
+        } else if (progress) {
+                r = progress(st->st_size, userdata);
+                if (r < 0) {
+                        (void) unlinkat(dt, to, 0);
+                        return r;
+                }
         }
 
         if (fchown(fdt,
@@ -500,6 +518,7 @@ static int fd_copy_directory(
 
         _cleanup_close_ int fdf = -1, fdt = -1;
         _cleanup_closedir_ DIR *d = NULL;
+        CopyFlags regular_flags = copy_flags;
         struct dirent *de;
         bool created;
         int r;
@@ -594,7 +613,7 @@ static int fd_copy_directory(
 
                         q = fd_copy_directory(dirfd(d), de->d_name, &buf, fdt, de->d_name, original_device, depth_left-1, override_uid, override_gid, copy_flags, child_display_path, progress_path, progress_bytes, userdata);
                 } else if (S_ISREG(buf.st_mode))
-                        q = fd_copy_regular(dirfd(d), de->d_name, &buf, fdt, de->d_name, override_uid, override_gid, copy_flags, progress_bytes, userdata);
+                        q = fd_copy_regular(dirfd(d), de->d_name, &buf, fdt, de->d_name, override_uid, override_gid, &regular_flags, progress_bytes, userdata);
                 else if (S_ISLNK(buf.st_mode))
                         q = fd_copy_symlink(dirfd(d), de->d_name, &buf, fdt, de->d_name, override_uid, override_gid, copy_flags);
                 else if (S_ISFIFO(buf.st_mode))
@@ -653,7 +672,7 @@ int copy_tree_at_full(
                 return -errno;
 
         if (S_ISREG(st.st_mode))
-                return fd_copy_regular(fdf, from, &st, fdt, to, override_uid, override_gid, copy_flags, progress_bytes, userdata);
+                return fd_copy_regular(fdf, from, &st, fdt, to, override_uid, override_gid, &copy_flags, progress_bytes, userdata);
         else if (S_ISDIR(st.st_mode))
                 return fd_copy_directory(fdf, from, &st, fdt, to, st.st_dev, COPY_DEPTH_MAX, override_uid, override_gid, copy_flags, NULL, progress_path, progress_bytes, userdata);
         else if (S_ISLNK(st.st_mode))
@@ -11,8 +11,11 @@
 #include "env-util.h"
 #include "escape.h"
 #include "extract-word.h"
+#include "hashmap.h"
 #include "macro.h"
 #include "parse-util.h"
+#include "set.h"
+#include "siphash24.h"
 #include "string-util.h"
 #include "strv.h"
 #include "utf8.h"
@@ -148,7 +151,42 @@ bool strv_env_name_or_assignment_is_valid(char **l) {
         return true;
 }
 
-static int env_append(char **r, char ***k, char **a) {
+/* The part of an entry that identifies it when merging: the name including the "=", or the whole entry if
+ * there's none */
+static size_t env_key_length(const char *e) {
+        size_t n;
+
+        n = strcspn(e, "=");
+        if (e[n] == '=')
+                n++;
+
+        return n;
+}
+
+static void env_key_hash_func(const char *e, struct siphash *state) {
+        siphash24_compress(e, env_key_length(e), state);
+}
+
+static int env_key_compare_func(const char *a, const char *b) {
+        size_t m, n;
+        int r;
+
+        m = env_key_length(a);
+        n = env_key_length(b);
+
+        r = CMP(m, n);
+        if (r != 0)
+                return r;
+
+        return memcmp(a, b, m);
+}
+
+DEFINE_PRIVATE_HASH_OPS(env_key_hash_ops, char, env_key_hash_func, env_key_compare_func);
+
+/* Up to this many entries comparing each of them with all others is cheaper than setting up a hash table */
+#define ENV_INDEX_MIN 128U
+
+static int env_append(char **r, char ***k, Hashmap *index, char **a) {
         assert(r);
         assert(k);
         assert(*k >= r);
@@ -157,7 +195,8 @@ static int env_append(char **r, char ***k, char **a) {
                 return 0;
 
         /* Expects the following arguments: 'r' shall point to the beginning of an strv we are going to append to, 'k'
-         * to a pointer pointing to the NULL entry at the end of the same array. 'a' shall point to another strv.
+         * to a pointer pointing to the NULL entry at the end of the same array. 'index' shall map the entries of 'r'
+         * to their slots in it, or be NULL. 'a' shall point to another strv.
          *
          * This call adds every entry of 'a' to 'r', either overriding an existing matching entry, or appending to it.
          *
@@ -166,14 +205,17 @@ static int env_append(char **r, char ***k, char **a) {
         for (; *a; a++) {
                 char **j, *c;
                 size_t n;
+                int q;
 
-                n = strcspn(*a, "=");
-                if ((*a)[n] == '=')
-                        n++;
+                n = env_key_length(*a);
 
-                for (j = r; j < *k; j++)
-                        if (strneq(*j, *a, n))
-                                break;
+                if (index && n > 0 && (*a)[n-1] == '=')
+                        j = hashmap_get(index, *a) ?: *k;
+                else
+                        /* Entries without "=" override everything they are a prefix of, hence look at all */
+                        for (j = r; j < *k; j++)
+                                if (strneq(*j, *a, n))
+                                        break;
 
                 c = strdup(*a);
                 if (!c)
@@ -183,14 +225,23 @@ static int env_append(char **r, char ***k, char **a) {
                         (*k)[0] = c;
                         (*k)[1] = NULL;
                         (*k)++;
-                } else
-                        free_and_replace(*j, c); /* Override existing item */
+                } else { /* Override existing item */
+                        (void) hashmap_remove(index, *j);
+                        free_and_replace(*j, c);
+                }
+
+                if (index) {
+                        q = hashmap_replace(index, *j, j);
+                        if (q < 0)
+                                return q;
+                }
         }
 
         return 0;
 }
 
 char **strv_env_merge(size_t n_lists, ...) {
+        _cleanup_hashmap_free_ Hashmap *index = NULL;
         _cleanup_strv_free_ char **ret = NULL;
         size_t n = 0, i;
         char **l, **k;
@@ -212,10 +263,17 @@ char **strv_env_merge(size_t n_lists, ...) {
         *ret = NULL;
         k = ret;
 
+        /* Environments can be large, let's not compare every entry with all others then */
+        if (n > ENV_INDEX_MIN) {
+                index = hashmap_new(&env_key_hash_ops);
+                if (!index)
+                        return NULL;
+        }
+
         va_start(ap, n_lists);
         for (i = 0; i < n_lists; i++) {
                 l = va_arg(ap, char**);
-                if (env_append(ret, &k, l) < 0) {
+                if (env_append(ret, &k, index, l) < 0) {
                         va_end(ap);
                         return NULL;
                 }
@@ -409,6 +467,7 @@ int strv_env_replace(char ***l, char *p) {
 
 char **strv_env_set(char **x, const char *p) {
 
+        _cleanup_hashmap_free_ Hashmap *index = NULL;
         _cleanup_strv_free_ char **ret = NULL;
         size_t n, m;
         char **k;
@@ -427,10 +486,16 @@ char **strv_env_set(char **x, const char *p) {
         *ret = NULL;
         k = ret;
 
-        if (env_append(ret, &k, x) < 0)
+        if (n > ENV_INDEX_MIN) {
+                index = hashmap_new(&env_key_hash_ops);
+                if (!index)
+                        return NULL;
+        }
+
+        if (env_append(ret, &k, index, x) < 0)
                 return NULL;
 
-        if (env_append(ret, &k, STRV_MAKE(p)) < 0)
+        if (env_append(ret, &k, index, STRV_MAKE(p)) < 0)
                 return NULL;
 
         return TAKE_PTR(ret);
@@ -466,37 +531,58 @@ char *strv_env_get(char **l, const char *name) {
 }
 
 char **strv_env_clean_with_callback(char **e, void (*invalid_callback)(const char *p, void *userdata), void *userdata) {
-        char **p, **q;
-        int k = 0;
+        _cleanup_set_free_ Set *seen = NULL;
+        size_t n, i, k = 0;
 
-        STRV_FOREACH(p, e) {
-                size_t n;
+        n = strv_length(e);
+        if (n == 0)
+                return e;
+
+        /* Only the last assignment of each variable is kept. Hence, first go backwards, remember the names seen so
+         * far, and drop all entries overridden later on. For short lists, or if we cannot allocate the set, look
+         * through the rest of the list for each entry instead. */
+        if (n > ENV_INDEX_MIN)
+                seen = set_new(&env_key_hash_ops);
+
+        for (i = n; i > 0; i--) {
+                char *p = e[i-1];
                 bool duplicate = false;
 
-                if (!env_assignment_is_valid(*p)) {
-                        if (invalid_callback)
-                                invalid_callback(*p, userdata);
-                        free(*p);
+                if (seen)
+                        duplicate = set_contains(seen, p);
+                else {
+                        size_t l, j;
+
+                        l = strcspn(p, "=");
+                        for (j = i; j < n && !duplicate; j++)
+                                duplicate = e[j] && strneq(p, e[j], l) && e[j][l] == '=';
+                }
+
+                /* Invalid entries are dropped below, with the callback invoked for them */
+                if (duplicate && env_assignment_is_valid(p)) {
+                        e[i-1] = mfree(p);
                         continue;
                 }
 
-                n = strcspn(*p, "=");
-                STRV_FOREACH(q, p + 1)
-                        if (strneq(*p, *q, n) && (*q)[n] == '=') {
-                                duplicate = true;
-                                break;
-                        }
+                if (seen && strchr(p, '=') && set_put(seen, p) < 0)
+                        seen = set_free(seen);
+        }
 
-                if (duplicate) {
-                        free(*p);
+        for (i = 0; i < n; i++) {
+                if (!e[i])
+                        continue;
+
+                if (!env_assignment_is_valid(e[i])) {
+                        if (invalid_callback)
+                                invalid_callback(e[i], userdata);
+                        free(e[i]);
                         continue;
                 }
 
-                e[k++] = *p;
+                e[k++] = e[i];
         }
 
-        if (e)
-                e[k] = NULL;
+        e[k] = NULL;
 
         return e;
 }
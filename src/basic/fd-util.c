@@ -5,6 +5,7 @@
 #include <sys/resource.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
 #include <unistd.h>
 
 #include "alloc-util.h"
@@ -189,43 +190,48 @@ _pure_ static bool fd_in_set(int fd, const int fdset[], size_t n_fdset) {
         return false;
 }
 
-int close_all_fds(const int except[], size_t n_except) {
-        _cleanup_closedir_ DIR *d = NULL;
-        struct dirent *de;
-        int r = 0;
+static int close_all_fds_frugal(const int except[], size_t n_except) {
+        struct rlimit rl;
+        int fd, max_fd, r = 0;
 
         assert(n_except == 0 || except);
 
-        d = opendir("/proc/self/fd");
-        if (!d) {
-                struct rlimit rl;
-                int fd, max_fd;
+        /* When /proc isn't available (for example in chroots) the fallback is brute forcing through the fd
+         * table */
 
-                /* When /proc isn't available (for example in chroots) the fallback is brute forcing through the fd
-                 * table */
+        assert_se(getrlimit(RLIMIT_NOFILE, &rl) >= 0);
 
-                assert_se(getrlimit(RLIMIT_NOFILE, &rl) >= 0);
+        if (rl.rlim_max == 0)
+                return -EINVAL;
 
-                if (rl.rlim_max == 0)
-                        return -EINVAL;
+        /* Let's take special care if the resource limit is set to unlimited, or actually larger than the range
+         * of 'int'. Let's avoid implicit overflows. */
+        max_fd = (rl.rlim_max == RLIM_INFINITY || rl.rlim_max > INT_MAX) ? INT_MAX : (int) (rl.rlim_max - 1);
 
-                /* Let's take special care if the resource limit is set to unlimited, or actually larger than the range
-                 * of 'int'. Let's avoid implicit overflows. */
-                max_fd = (rl.rlim_max == RLIM_INFINITY || rl.rlim_max > INT_MAX) ? INT_MAX : (int) (rl.rlim_max - 1);
+        for (fd = 3; fd >= 0; fd = fd < max_fd ? fd + 1 : -1) {
+                int q;
 
-                for (fd = 3; fd >= 0; fd = fd < max_fd ? fd + 1 : -1) {
-                        int q;
+                if (fd_in_set(fd, except, n_except))
+                        continue;
 
-                        if (fd_in_set(fd, except, n_except))
-                                continue;
+                q = close_nointr(fd);
+                if (q < 0 && q != -EBADF && r >= 0)
+                        r = q;
+        }
 
-                        q = close_nointr(fd);
-                        if (q < 0 && q != -EBADF && r >= 0)
-                                r = q;
-                }
+        return r;
+}
 
-                return r;
-        }
+int close_all_fds(const int except[], size_t n_except) {
+        _cleanup_closedir_ DIR *d = NULL;
+        struct dirent *de;
+        int r = 0;
+
+        assert(n_except == 0 || except);
+
+        d = opendir("/proc/self/fd");
+        if (!d)
+                return close_all_fds_frugal(except, n_except);
 
         FOREACH_DIRENT(de, d, return -errno) {
                 int fd = -1, q;
@@ -251,6 +257,62 @@ int close_all_fds(const int except[], size_t n_except) {
         return r;
 }
 
+int close_all_fds_without_malloc(const int except[], size_t n_except) {
+        union {
+                struct dirent64 de;
+                uint8_t space[2048];
+        } buffer;
+        _cleanup_close_ int dir_fd = -1;
+        int r = 0;
+
+        assert(n_except == 0 || except);
+
+        /* Same as close_all_fds(), but reads the directory with getdents64() into a buffer on the stack instead of
+         * going through opendir(), which allocates memory. This is suitable for processes that share the memory of
+         * their parent, i.e. that have been created with CLONE_VM, where neither malloc() nor any locks may be
+         * touched. */
+
+        dir_fd = open("/proc/self/fd", O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+        if (dir_fd < 0)
+                return close_all_fds_frugal(except, n_except);
+
+        for (;;) {
+                ssize_t n;
+                size_t k;
+
+                n = syscall(__NR_getdents64, dir_fd, &buffer, sizeof(buffer));
+                if (n < 0)
+                        return -errno;
+                if (n == 0)
+                        break;
+
+                for (k = 0; k < (size_t) n; ) {
+                        struct dirent64 *de = (struct dirent64*) (buffer.space + k);
+                        int fd = -1, q;
+
+                        k += de->d_reclen;
+
+                        if (safe_atoi(de->d_name, &fd) < 0)
+                                continue;
+
+                        if (fd < 3)
+                                continue;
+
+                        if (fd == dir_fd)
+                                continue;
+
+                        if (fd_in_set(fd, except, n_except))
+                                continue;
+
+                        q = close_nointr(fd);
+                        if (q < 0 && q != -EBADF && r >= 0)
+                                r = q;
+                }
+        }
+
+        return r;
+}
+
 int same_fd(int a, int b) {
         struct stat sta, stb;
         pid_t pid;
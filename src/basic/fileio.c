@@ -227,6 +227,63 @@ int read_one_line_file(const char *fn, char **line) {
         return r < 0 ? r : 0;
 }
 
+int read_full_file_buf(const char *fn, char *buf, size_t size, size_t *ret_size) {
+        _cleanup_close_ int fd = -1;
+        size_t l = 0;
+
+        assert(fn);
+        assert(buf);
+        assert(size > 0);
+
+        /* Reads a small file, such as an attribute in /proc or /sys, into the specified buffer and NUL terminates
+         * it. Unlike read_full_file() this needs no FILE object, no heap allocation and no fstat(), which matters
+         * for the attributes we poll all the time. Returns -ENOBUFS if the file doesn't fit into the buffer,
+         * including the trailing NUL byte. */
+
+        fd = open(fn, O_RDONLY|O_CLOEXEC|O_NOCTTY);
+        if (fd < 0)
+                return -errno;
+
+        for (;;) {
+                ssize_t n;
+
+                n = read(fd, buf + l, size - l);
+                if (n < 0) {
+                        if (errno == EINTR)
+                                continue;
+
+                        return -errno;
+                }
+                if (n == 0)
+                        break;
+
+                l += n;
+                if (l >= size)
+                        return -ENOBUFS;
+        }
+
+        buf[l] = 0;
+
+        if (ret_size)
+                *ret_size = l;
+
+        return 0;
+}
+
+int read_one_line_file_buf(const char *fn, char *buf, size_t size) {
+        int r;
+
+        /* Like read_one_line_file(), but reads into the specified buffer, see above. Note that the whole file has to
+         * fit into it, not just the first line. */
+
+        r = read_full_file_buf(fn, buf, size, NULL);
+        if (r < 0)
+                return r;
+
+        buf[strcspn(buf, "\n")] = 0;
+        return 0;
+}
+
 int verify_file(const char *fn, const char *blob, bool accept_extra_nl) {
         _cleanup_fclose_ FILE *f = NULL;
         _cleanup_free_ char *buf = NULL;
@@ -42,6 +42,9 @@ int read_one_line_file(const char *fn, char **line);
 int read_full_file(const char *fn, char **contents, size_t *size);
 int read_full_stream(FILE *f, char **contents, size_t *size);
 
+int read_full_file_buf(const char *fn, char *buf, size_t size, size_t *ret_size);
+int read_one_line_file_buf(const char *fn, char *buf, size_t size);
+
 int verify_file(const char *fn, const char *blob, bool accept_extra_nl);
 
 int executable_is_script(const char *path, char **interpreter);
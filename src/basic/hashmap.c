@@ -10,6 +10,7 @@
 #include "hashmap.h"
 #include "macro.h"
 #include "mempool.h"
+#include "parse-util.h"
 #include "process-util.h"
 #include "random-util.h"
 #include "set.h"
@@ -493,12 +494,14 @@ static void bucket_move_entry(HashmapBase *h, struct swap_entries *swap,
         }
 }
 
+/* These are called for every bucket that is probed, hence avoid the division a modulo would need */
 static unsigned next_idx(HashmapBase *h, unsigned idx) {
-        return (idx + 1U) % n_buckets(h);
+        idx++;
+        return idx < n_buckets(h) ? idx : 0;
 }
 
 static unsigned prev_idx(HashmapBase *h, unsigned idx) {
-        return (n_buckets(h) + idx - 1U) % n_buckets(h);
+        return idx > 0 ? idx - 1 : n_buckets(h) - 1;
 }
 
 static void *entry_value(HashmapBase *h, struct hashmap_base_entry *e) {
@@ -1543,6 +1546,67 @@ unsigned internal_hashmap_buckets(HashmapBase *h) {
         return n_buckets(h);
 }
 
+size_t internal_hashmap_memory_usage(HashmapBase *h) {
+        const struct hashmap_type_info *hi;
+
+        if (!h)
+                return 0;
+
+        hi = &hashmap_type_info[h->type];
+
+        /* Direct storage is part of the head, indirect storage is allocated separately */
+        return hi->head_size +
+                (h->has_indirect ? (size_t) h->indirect.n_buckets * (hi->entry_size + sizeof(dib_raw_t)) : 0);
+}
+
+void internal_hashmap_get_stats(HashmapBase *h, HashmapStats *ret) {
+        uint64_t sum_dib = 0;
+        unsigned idx, n;
+        dib_raw_t *dibs;
+
+        assert(ret);
+
+        *ret = (HashmapStats) {
+                .n_entries = internal_hashmap_size(h),
+                .n_buckets = internal_hashmap_buckets(h),
+                .memory = internal_hashmap_memory_usage(h),
+        };
+
+        if (!h)
+                return;
+
+        /* This goes through all buckets, hence is meant for dumping the state, not for regular use */
+        n = n_buckets(h);
+        dibs = dib_raw_ptr(h);
+        for (idx = 0; idx < n; idx++) {
+                unsigned dib;
+
+                if (dibs[idx] == DIB_RAW_FREE)
+                        continue;
+
+                dib = bucket_calculate_dib(h, idx, dibs[idx]);
+                ret->max_dib = MAX(ret->max_dib, dib);
+                sum_dib += dib;
+        }
+
+        if (ret->n_entries > 0)
+                ret->mean_dib = (double) sum_dib / ret->n_entries;
+}
+
+void internal_hashmap_dump_stats(HashmapBase *h, FILE *f, const char *prefix, const char *name) {
+        char buf[FORMAT_BYTES_MAX];
+        HashmapStats stats;
+
+        assert(f);
+        assert(name);
+
+        internal_hashmap_get_stats(h, &stats);
+
+        fprintf(f, "%sHashmap %s: %u entries, %u buckets, max DIB %u, mean DIB %.2f, memory %s\n",
+                strempty(prefix), name, stats.n_entries, stats.n_buckets, stats.max_dib, stats.mean_dib,
+                format_bytes(buf, sizeof(buf), stats.memory));
+}
+
 int internal_hashmap_merge(Hashmap *h, Hashmap *other) {
         Iterator i;
         unsigned idx;
@@ -4,6 +4,7 @@
 #include <limits.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdio.h>
 
 #include "hash-funcs.h"
 #include "macro.h"
@@ -260,6 +261,35 @@ static inline unsigned ordered_hashmap_buckets(OrderedHashmap *h) {
         return internal_hashmap_buckets(HASHMAP_BASE(h));
 }
 
+size_t internal_hashmap_memory_usage(HashmapBase *h) _pure_;
+static inline size_t hashmap_memory_usage(Hashmap *h) {
+        return internal_hashmap_memory_usage(HASHMAP_BASE(h));
+}
+
+typedef struct HashmapStats {
+        unsigned n_entries;
+        unsigned n_buckets;
+        unsigned max_dib;  /* the largest distance of an entry from the bucket its hash points to */
+        double mean_dib;
+        size_t memory;     /* as returned by internal_hashmap_memory_usage() */
+} HashmapStats;
+
+void internal_hashmap_get_stats(HashmapBase *h, HashmapStats *ret);
+static inline void hashmap_get_stats(Hashmap *h, HashmapStats *ret) {
+        internal_hashmap_get_stats(HASHMAP_BASE(h), ret);
+}
+static inline void ordered_hashmap_get_stats(OrderedHashmap *h, HashmapStats *ret) {
+        internal_hashmap_get_stats(HASHMAP_BASE(h), ret);
+}
+
+void internal_hashmap_dump_stats(HashmapBase *h, FILE *f, const char *prefix, const char *name);
+static inline void hashmap_dump_stats(Hashmap *h, FILE *f, const char *prefix, const char *name) {
+        internal_hashmap_dump_stats(HASHMAP_BASE(h), f, prefix, name);
+}
+static inline void ordered_hashmap_dump_stats(OrderedHashmap *h, FILE *f, const char *prefix, const char *name) {
+        internal_hashmap_dump_stats(HASHMAP_BASE(h), f, prefix, name);
+}
+
 bool internal_hashmap_iterate(HashmapBase *h, Iterator *i, void **value, const void **key);
 static inline bool hashmap_iterate(Hashmap *h, Iterator *i, void **value, const void **key) {
         return internal_hashmap_iterate(HASHMAP_BASE(h), i, value, key);
@@ -0,0 +1,134 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <errno.h>
+#include <stdio.h>
+
+#include "alloc-util.h"
+#include "extract-word.h"
+#include "histogram.h"
+#include "parse-util.h"
+#include "stdio-util.h"
+#include "string-util.h"
+#include "util.h"
+
+unsigned histogram_bucket(usec_t t) {
+        if (t == 0)
+                return 0;
+
+        return MIN(u64log2(t) + 1, HISTOGRAM_BUCKETS - 1);
+}
+
+usec_t histogram_bucket_max(unsigned i) {
+        assert(i < HISTOGRAM_BUCKETS);
+
+        /* Returns the exclusive upper bound of the durations counted in the specified bucket */
+
+        if (i >= HISTOGRAM_BUCKETS - 1)
+                return USEC_INFINITY;
+
+        return UINT64_C(1) << i;
+}
+
+int histogram_add(Histogram **h, usec_t t) {
+        assert(h);
+
+        if (!*h) {
+                *h = new0(Histogram, 1);
+                if (!*h)
+                        return -ENOMEM;
+        }
+
+        (*h)->n++;
+        (*h)->sum = usec_add((*h)->sum, t);
+        (*h)->max = MAX((*h)->max, t);
+        (*h)->buckets[histogram_bucket(t)]++;
+
+        return 0;
+}
+
+int histogram_to_string(const Histogram *h, char **ret) {
+        _cleanup_free_ char *s = NULL;
+        unsigned i;
+
+        assert(ret);
+
+        /* Formats the histogram as "N SUM MAX", followed by "BUCKET:COUNT" for each non-empty bucket */
+
+        if (asprintf(&s, "%" PRIu64 " " USEC_FMT " " USEC_FMT,
+                     h ? h->n : 0, h ? h->sum : 0, h ? h->max : 0) < 0)
+                return -ENOMEM;
+
+        for (i = 0; h && i < HISTOGRAM_BUCKETS; i++) {
+                char buf[DECIMAL_STR_MAX(unsigned) + DECIMAL_STR_MAX(uint64_t) + 2];
+
+                if (h->buckets[i] == 0)
+                        continue;
+
+                xsprintf(buf, " %u:%" PRIu64, i, h->buckets[i]);
+                if (!strextend(&s, buf, NULL))
+                        return -ENOMEM;
+        }
+
+        *ret = TAKE_PTR(s);
+        return 0;
+}
+
+int histogram_from_string(const char *s, Histogram **ret) {
+        _cleanup_free_ Histogram *h = NULL;
+        uint64_t *fields[3], total = 0;
+        unsigned i;
+        int r;
+
+        assert(s);
+        assert(ret);
+
+        h = new0(Histogram, 1);
+        if (!h)
+                return -ENOMEM;
+
+        fields[0] = &h->n;
+        fields[1] = &h->sum;
+        fields[2] = &h->max;
+
+        for (i = 0;; i++) {
+                _cleanup_free_ char *word = NULL;
+                char *colon;
+                unsigned b;
+
+                r = extract_first_word(&s, &word, NULL, 0);
+                if (r < 0)
+                        return r;
+                if (r == 0)
+                        break;
+
+                if (i < ELEMENTSOF(fields)) {
+                        r = safe_atou64(word, fields[i]);
+                        if (r < 0)
+                                return r;
+                        continue;
+                }
+
+                colon = strchr(word, ':');
+                if (!colon)
+                        return -EINVAL;
+
+                *colon = 0;
+                r = safe_atou(word, &b);
+                if (r < 0)
+                        return r;
+                if (b >= HISTOGRAM_BUCKETS)
+                        return -ERANGE;
+
+                r = safe_atou64(colon + 1, h->buckets + b);
+                if (r < 0)
+                        return r;
+
+                total += h->buckets[b];
+        }
+
+        if (i < ELEMENTSOF(fields) || total != h->n)
+                return -EINVAL;
+
+        *ret = TAKE_PTR(h);
+        return 0;
+}
@@ -0,0 +1,35 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+#pragma once
+
+#include <inttypes.h>
+
+#include "alloc-util.h"
+#include "macro.h"
+#include "time-util.h"
+
+/* A histogram of durations, with logarithmic buckets: bucket 0 counts durations of 0µs, bucket i durations in
+ * [2^(i-1)µs, 2^iµs), and the last one everything longer than that. This is coarse, but cheap to update and small
+ * enough to keep one for every unit. Like for Hashmap, a NULL pointer is a valid empty histogram, and
+ * histogram_add() allocates it as needed. */
+
+#define HISTOGRAM_BUCKETS 40U
+
+typedef struct Histogram {
+        uint64_t n;
+        usec_t sum;
+        usec_t max;
+        uint64_t buckets[HISTOGRAM_BUCKETS];
+} Histogram;
+
+unsigned histogram_bucket(usec_t t) _const_;
+usec_t histogram_bucket_max(unsigned i) _const_;
+
+int histogram_add(Histogram **h, usec_t t);
+
+static inline Histogram *histogram_free(Histogram *h) {
+        return mfree(h);
+}
+DEFINE_TRIVIAL_CLEANUP_FUNC(Histogram*, histogram_free);
+
+int histogram_to_string(const Histogram *h, char **ret);
+int histogram_from_string(const char *s, Histogram **ret);
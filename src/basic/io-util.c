@@ -4,6 +4,7 @@
 #include <limits.h>
 #include <poll.h>
 #include <stdio.h>
+#include <string.h>
 #include <time.h>
 #include <unistd.h>
 
@@ -238,8 +239,13 @@ ssize_t sparse_write(int fd, const void *p, size_t sz, size_t run_length) {
                         w = q;
                 } else if (n > 0)
                         q += n;
-                else
-                        q++;
+                else {
+                        const uint8_t *z;
+
+                        /* Not a NUL byte, skip right to the next one */
+                        z = memchr(q, 0, e - q);
+                        q = z ?: e;
+                }
         }
 
         if (q > w) {
@@ -65,6 +65,21 @@ static bool prohibit_ipc = false;
  * use here. */
 static char *log_abort_msg = NULL;
 
+/* With log_set_buffered(), messages for the journal that can't be sent right away, because its socket buffer is
+ * full, are queued here, and sent later by log_flush_buffered(), so that we never block on a slow journal. */
+#define LOG_BUFFER_MAX 1024U
+#define LOG_FLUSH_BATCH 64U
+
+typedef struct LogBufferEntry {
+        void *data;
+        size_t size;
+} LogBufferEntry;
+
+static LogBufferEntry *log_buffer = NULL;
+static size_t log_buffer_first = 0, log_buffer_n = 0;
+static unsigned log_buffer_dropped = 0;
+static pid_t log_buffer_pid = 0;
+
 /* An assert to use in logging functions that does not call recursively
  * into our logging functions (since that might lead to a loop). */
 #define assert_raw(expr)                                                \
@@ -186,6 +201,155 @@ fail:
         return r;
 }
 
+static bool log_buffered(void) {
+        /* Child processes get a copy of the queue, but must not send it */
+        return log_buffer && log_buffer_pid == getpid_cached();
+}
+
+static void log_buffer_pop(bool dropped) {
+        LogBufferEntry *e;
+
+        assert(log_buffer_n > 0);
+
+        e = log_buffer + log_buffer_first;
+        e->data = mfree(e->data);
+
+        log_buffer_first = (log_buffer_first + 1) % LOG_BUFFER_MAX;
+        log_buffer_n--;
+
+        if (dropped)
+                log_buffer_dropped++;
+}
+
+static void log_buffer_push(const struct msghdr *mh) {
+        LogBufferEntry *e;
+        size_t size = 0, i;
+        uint8_t *p;
+
+        assert(mh);
+
+        if (log_buffer_n >= LOG_BUFFER_MAX) {
+                log_buffer_dropped++;
+                return;
+        }
+
+        for (i = 0; i < mh->msg_iovlen; i++)
+                size += mh->msg_iov[i].iov_len;
+
+        e = log_buffer + (log_buffer_first + log_buffer_n) % LOG_BUFFER_MAX;
+        e->data = malloc(size);
+        if (!e->data) {
+                log_buffer_dropped++;
+                return;
+        }
+
+        for (p = e->data, i = 0; i < mh->msg_iovlen; i++)
+                p = mempcpy(p, mh->msg_iov[i].iov_base, mh->msg_iov[i].iov_len);
+        e->size = size;
+
+        log_buffer_n++;
+}
+
+int log_flush_buffered(void) {
+        struct mmsghdr mmsg[LOG_FLUSH_BATCH];
+        struct iovec iovec[LOG_FLUSH_BATCH];
+
+        /* Sends as many of the queued messages as the journal takes without blocking, in batches. Returns > 0 if
+         * some remain queued. Once the queue is empty, reports the number of messages we dropped before, if any. */
+
+        if (!log_buffered())
+                return 0;
+
+        while (log_buffer_n > 0 && journal_fd >= 0) {
+                size_t n, i;
+                int k;
+
+                n = MIN(log_buffer_n, LOG_FLUSH_BATCH);
+                for (i = 0; i < n; i++) {
+                        LogBufferEntry *e = log_buffer + (log_buffer_first + i) % LOG_BUFFER_MAX;
+
+                        iovec[i] = IOVEC_MAKE(e->data, e->size);
+                        mmsg[i] = (struct mmsghdr) {
+                                .msg_hdr.msg_iov = iovec + i,
+                                .msg_hdr.msg_iovlen = 1,
+                        };
+                }
+
+                k = sendmmsg(journal_fd, mmsg, n, MSG_DONTWAIT|MSG_NOSIGNAL);
+                if (k < 0) {
+                        if (errno == EAGAIN)
+                                break;
+
+                        /* The first message in the batch failed for good, drop it and carry on with the rest */
+                        log_buffer_pop(true);
+                        continue;
+                }
+
+                for (i = 0; i < (size_t) k; i++)
+                        log_buffer_pop(false);
+        }
+
+        if (log_buffer_n > 0)
+                return 1;
+
+        if (log_buffer_dropped > 0) {
+                unsigned n = log_buffer_dropped;
+
+                /* Reset the counter first, as this is logged through the queue, too */
+                log_buffer_dropped = 0;
+                log_warning("Dropped %u log messages, as the journal didn't keep up.", n);
+        }
+
+        return log_buffer_n > 0;
+}
+
+void log_set_buffered(bool b) {
+
+        /* Do not call from library code. */
+
+        if (b) {
+                if (!log_buffer) {
+                        log_buffer = new0(LogBufferEntry, LOG_BUFFER_MAX);
+                        if (!log_buffer)
+                                return;
+                }
+
+                log_buffer_pid = getpid_cached();
+                return;
+        }
+
+        if (!log_buffer)
+                return;
+
+        /* Send out what we can, and give up on the rest */
+        (void) log_flush_buffered();
+
+        while (log_buffer_n > 0)
+                log_buffer_pop(true);
+
+        log_buffer = mfree(log_buffer);
+        log_buffer_first = 0;
+        log_buffer_dropped = 0;
+}
+
+static int journal_sendmsg(const struct msghdr *mh) {
+        assert(mh);
+
+        if (!log_buffered())
+                return sendmsg(journal_fd, mh, MSG_NOSIGNAL) < 0 ? -errno : 0;
+
+        /* Only send right away if nothing is queued before us, so that the order is kept */
+        if (log_flush_buffered() == 0) {
+                if (sendmsg(journal_fd, mh, MSG_DONTWAIT|MSG_NOSIGNAL) >= 0)
+                        return 0;
+                if (errno != EAGAIN)
+                        return -errno;
+        }
+
+        log_buffer_push(mh);
+        return 0;
+}
+
 static void log_close_journal(void) {
         journal_fd = safe_close(journal_fd);
 }
@@ -303,6 +467,8 @@ void log_set_target(LogTarget target) {
 void log_close(void) {
         /* Do not call from library code. */
 
+        (void) log_flush_buffered();
+
         log_close_journal();
         log_close_syslog();
         log_close_kmsg();
@@ -537,6 +703,7 @@ static int write_to_journal(
         char header[LINE_MAX];
         struct iovec iovec[4] = {};
         struct msghdr mh = {};
+        int r;
 
         if (journal_fd < 0)
                 return 0;
@@ -551,8 +718,9 @@ static int write_to_journal(
         mh.msg_iov = iovec;
         mh.msg_iovlen = ELEMENTSOF(iovec);
 
-        if (sendmsg(journal_fd, &mh, MSG_NOSIGNAL) < 0)
-                return -errno;
+        r = journal_sendmsg(&mh);
+        if (r < 0)
+                return r;
 
         return 1;
 }
@@ -917,7 +1085,7 @@ int log_struct_internal(
                                 fallback = true;
                         else {
                                 mh.msg_iovlen = n;
-                                (void) sendmsg(journal_fd, &mh, MSG_NOSIGNAL);
+                                (void) journal_sendmsg(&mh);
                         }
 
                         va_end(ap);
@@ -1007,7 +1175,7 @@ int log_struct_iovec_internal(
                         iovec[1+i*2+1] = IOVEC_MAKE_STRING("\n");
                 }
 
-                if (sendmsg(journal_fd, &mh, MSG_NOSIGNAL) >= 0)
+                if (journal_sendmsg(&mh) >= 0)
                         return -ERRNO_VALUE(error);
         }
 
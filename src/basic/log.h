@@ -77,6 +77,9 @@ int log_open(void);
 void log_close(void);
 void log_forget_fds(void);
 
+void log_set_buffered(bool b);
+int log_flush_buffered(void);
+
 void log_parse_environment_realm(LogRealm realm);
 #define log_parse_environment() \
         log_parse_environment_realm(LOG_REALM)
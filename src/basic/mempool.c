@@ -29,6 +29,7 @@ void* mempool_alloc_tile(struct mempool *mp) {
 
                 r = mp->freelist;
                 mp->freelist = * (void**) mp->freelist;
+                mp->n_tiles_used++;
                 return r;
         }
 
@@ -54,6 +55,7 @@ void* mempool_alloc_tile(struct mempool *mp) {
         }
 
         i = mp->first_pool->n_used++;
+        mp->n_tiles_used++;
 
         return ((uint8_t*) mp->first_pool) + ALIGN(sizeof(struct pool)) + i*mp->tile_size;
 }
@@ -70,6 +72,26 @@ void* mempool_alloc0_tile(struct mempool *mp) {
 void mempool_free_tile(struct mempool *mp, void *p) {
         * (void**) p = mp->freelist;
         mp->freelist = p;
+
+        assert(mp->n_tiles_used > 0);
+        mp->n_tiles_used--;
+}
+
+void mempool_get_stats(const struct mempool *mp, size_t *ret_used, size_t *ret_allocated) {
+        struct pool *p;
+        size_t n = 0;
+
+        assert(mp);
+
+        /* Tiles which were freed stay in the pools, hence the difference is memory that is kept around to be
+         * reused */
+        for (p = mp->first_pool; p; p = p->next)
+                n += p->n_used;
+
+        if (ret_used)
+                *ret_used = mp->n_tiles_used;
+        if (ret_allocated)
+                *ret_allocated = n;
 }
 
 bool mempool_enabled(void) {
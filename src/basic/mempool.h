@@ -11,11 +11,13 @@ struct mempool {
         void *freelist;
         size_t tile_size;
         unsigned at_least;
+        size_t n_tiles_used; /* handed out and not freed yet */
 };
 
 void* mempool_alloc_tile(struct mempool *mp);
 void* mempool_alloc0_tile(struct mempool *mp);
 void mempool_free_tile(struct mempool *mp, void *p);
+void mempool_get_stats(const struct mempool *mp, size_t *ret_used, size_t *ret_allocated);
 
 #define DEFINE_MEMPOOL(pool_name, tile_type, alloc_at_least) \
 static struct mempool pool_name = { \
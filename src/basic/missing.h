@@ -9,6 +9,7 @@
 #include <linux/audit.h>
 #include <linux/capability.h>
 #include <linux/falloc.h>
+#include <linux/fanotify.h>
 #include <linux/input.h>
 #include <linux/oom.h>
 #include <net/ethernet.h>
@@ -607,6 +608,10 @@ struct btrfs_ioctl_quota_ctl_args {
 #  define SO_REUSEPORT 15
 #endif
 
+#ifndef SO_ATTACH_REUSEPORT_CBPF
+#  define SO_ATTACH_REUSEPORT_CBPF 51
+#endif
+
 #ifndef SO_PEERGROUPS
 #  define SO_PEERGROUPS 59
 #endif
@@ -895,6 +900,44 @@ struct statx {
 #define AT_STATX_DONT_SYNC 0x4000
 #endif
 
+#ifndef FAN_MARK_FILESYSTEM
+#define FAN_MARK_FILESYSTEM 0x00000100
+#endif
+
+#ifndef FAN_ATTRIB
+#define FAN_ATTRIB 0x00000004
+#define FAN_MOVED_FROM 0x00000040
+#define FAN_MOVED_TO 0x00000080
+#define FAN_CREATE 0x00000100
+#define FAN_DELETE 0x00000200
+#define FAN_DELETE_SELF 0x00000400
+#define FAN_MOVE_SELF 0x00000800
+#endif
+
+#ifndef FAN_REPORT_DIR_FID
+#define FAN_REPORT_DIR_FID 0x00000400
+#endif
+
+#ifndef FAN_EVENT_INFO_TYPE_FID
+#define FAN_EVENT_INFO_TYPE_FID 1
+
+struct fanotify_event_info_header {
+        uint8_t info_type;
+        uint8_t pad;
+        uint16_t len;
+};
+
+struct fanotify_event_info_fid {
+        struct fanotify_event_info_header hdr;
+        __kernel_fsid_t fsid;
+        unsigned char handle[0];
+};
+#endif
+
+#ifndef FAN_EVENT_INFO_TYPE_DFID
+#define FAN_EVENT_INFO_TYPE_DFID 3
+#endif
+
 /* The maximum thread/process name length including trailing NUL byte. This mimics the kernel definition of the same
  * name, which we need in userspace at various places but is not defined in userspace currently, neither under this
  * name nor any other. */
@@ -64,6 +64,28 @@ int prioq_ensure_allocated(Prioq **q, compare_func_t compare_func) {
         return 0;
 }
 
+int prioq_reserve(Prioq *q, unsigned n) {
+        struct prioq_item *j;
+
+        assert(q);
+
+        /* Makes sure that up to n items may be put into the queue without allocating memory, so that callers can
+         * move items out of the queue and back in without having to handle failures. */
+
+        if (n <= q->n_allocated)
+                return 0;
+
+        n = MAX(n * 2, 16u);
+        j = reallocarray(q->items, n, sizeof(struct prioq_item));
+        if (!j)
+                return -ENOMEM;
+
+        q->items = j;
+        q->n_allocated = n;
+
+        return 0;
+}
+
 static void swap(Prioq *q, unsigned j, unsigned k) {
         assert(q);
         assert(j < q->n_items);
@@ -179,6 +201,9 @@ static void remove_item(Prioq *q, struct prioq_item *i) {
         assert(q);
         assert(i);
 
+        if (i->idx)
+                *i->idx = PRIOQ_IDX_NULL;
+
         l = q->items + q->n_items - 1;
 
         if (i == l)
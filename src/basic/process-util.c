@@ -72,7 +72,8 @@ int get_process_state(pid_t pid) {
 }
 
 int get_process_comm(pid_t pid, char **ret) {
-        _cleanup_free_ char *escaped = NULL, *comm = NULL;
+        _cleanup_free_ char *escaped = NULL;
+        char comm[LINE_MAX];
         const char *p;
         int r;
 
@@ -85,7 +86,7 @@ int get_process_comm(pid_t pid, char **ret) {
 
         p = procfs_file_alloca(pid, "comm");
 
-        r = read_one_line_file(p, &comm);
+        r = read_one_line_file_buf(p, comm, sizeof(comm));
         if (r == -ENOENT)
                 return -ESRCH;
         if (r < 0)
@@ -462,22 +463,6 @@ int is_kernel_thread(pid_t pid) {
         return !!(flags & PF_KTHREAD);
 }
 
-int get_process_capeff(pid_t pid, char **capeff) {
-        const char *p;
-        int r;
-
-        assert(capeff);
-        assert(pid >= 0);
-
-        p = procfs_file_alloca(pid, "status");
-
-        r = get_proc_field(p, "CapEff", WHITESPACE, capeff);
-        if (r == -ENOENT)
-                return -ESRCH;
-
-        return r;
-}
-
 static int get_process_link_contents(const char *proc_file, char **name) {
         int r;
 
@@ -512,50 +497,79 @@ int get_process_exe(pid_t pid, char **name) {
         return 0;
 }
 
-static int get_process_id(pid_t pid, const char *field, uid_t *uid) {
-        _cleanup_fclose_ FILE *f = NULL;
-        const char *p;
+int get_process_status(pid_t pid, uid_t *ret_uid, gid_t *ret_gid, char **ret_capeff) {
+        _cleanup_free_ char *allocated = NULL, *capeff = NULL;
+        uid_t uid = UID_INVALID;
+        gid_t gid = GID_INVALID;
+        char buf[4096];
+        const char *p, *status = buf;
         int r;
 
-        assert(field);
-        assert(uid);
+        /* Reads the requested fields from /proc/$PID/status. The kernel generates all of the file whenever it is
+         * read, hence callers which need more than one of these fields should ask for them in a single call. */
 
         if (pid < 0)
                 return -EINVAL;
 
+        /* The file fits into the buffer, unless the process has a very long list of supplementary groups */
         p = procfs_file_alloca(pid, "status");
-        f = fopen(p, "re");
-        if (!f) {
-                if (errno == ENOENT)
-                        return -ESRCH;
-                return -errno;
+        r = read_full_file_buf(p, buf, sizeof(buf), NULL);
+        if (r == -ENOBUFS) {
+                r = read_full_file(p, &allocated, NULL);
+                status = allocated;
         }
+        if (r == -ENOENT)
+                return -ESRCH;
+        if (r < 0)
+                return r;
 
-        (void) __fsetlocking(f, FSETLOCKING_BYCALLER);
-
-        for (;;) {
-                _cleanup_free_ char *line = NULL;
-                char *l;
+        for (p = status; *p; p += strspn(p, NEWLINE)) {
+                const char *v;
+                size_t l;
 
-                r = read_line(f, LONG_LINE_MAX, &line);
-                if (r < 0)
-                        return r;
-                if (r == 0)
-                        break;
+                if (ret_uid && !uid_is_valid(uid) && (v = startswith(p, "Uid:"))) {
+                        v += strspn(v, WHITESPACE);
+                        r = parse_uid(strndupa(v, strcspn(v, WHITESPACE)), &uid);
+                        if (r < 0)
+                                return r;
 
-                l = strstrip(line);
+                } else if (ret_gid && !gid_is_valid(gid) && (v = startswith(p, "Gid:"))) {
+                        v += strspn(v, WHITESPACE);
+                        r = parse_gid(strndupa(v, strcspn(v, WHITESPACE)), &gid);
+                        if (r < 0)
+                                return r;
 
-                if (startswith(l, field)) {
-                        l += strlen(field);
-                        l += strspn(l, WHITESPACE);
+                } else if (ret_capeff && !capeff && (v = startswith(p, "CapEff:"))) {
+                        v += strspn(v, " \t");
 
-                        l[strcspn(l, WHITESPACE)] = 0;
+                        /* Skip the leading zeros, so that the same capability set always maps to the same
+                         * string, irrespective of the size of the total capability set. */
+                        l = strspn(v, "0");
+                        if (l > 0 && (!v[l] || isspace(v[l])))
+                                l--;
+                        v += l;
 
-                        return parse_uid(l, uid);
+                        capeff = strndup(v, strcspn(v, WHITESPACE));
+                        if (!capeff)
+                                return -ENOMEM;
                 }
+
+                p += strcspn(p, NEWLINE);
         }
 
-        return -EIO;
+        if ((ret_uid && !uid_is_valid(uid)) ||
+            (ret_gid && !gid_is_valid(gid)) ||
+            (ret_capeff && !capeff))
+                return -EIO;
+
+        if (ret_uid)
+                *ret_uid = uid;
+        if (ret_gid)
+                *ret_gid = gid;
+        if (ret_capeff)
+                *ret_capeff = TAKE_PTR(capeff);
+
+        return 0;
 }
 
 int get_process_uid(pid_t pid, uid_t *uid) {
@@ -565,7 +579,7 @@ int get_process_uid(pid_t pid, uid_t *uid) {
                 return 0;
         }
 
-        return get_process_id(pid, "Uid:", uid);
+        return get_process_status(pid, uid, NULL, NULL);
 }
 
 int get_process_gid(pid_t pid, gid_t *gid) {
@@ -575,8 +589,14 @@ int get_process_gid(pid_t pid, gid_t *gid) {
                 return 0;
         }
 
-        assert_cc(sizeof(uid_t) == sizeof(gid_t));
-        return get_process_id(pid, "Gid:", gid);
+        return get_process_status(pid, NULL, gid, NULL);
+}
+
+int get_process_capeff(pid_t pid, char **capeff) {
+        assert(capeff);
+        assert(pid >= 0);
+
+        return get_process_status(pid, NULL, NULL, capeff);
 }
 
 int get_process_cwd(pid_t pid, char **cwd) {
@@ -139,6 +139,30 @@ int procfs_tasks_get_current(uint64_t *ret) {
         return safe_atou64(nr, ret);
 }
 
+int procfs_tasks_get_runnable(uint64_t *ret) {
+        _cleanup_free_ char *value = NULL;
+        const char *p, *nr;
+        int r;
+
+        assert(ret);
+
+        r = read_one_line_file("/proc/loadavg", &value);
+        if (r < 0)
+                return r;
+
+        /* Look for the first part of the fourth field, i.e. the number of tasks that are running or ready to run
+         * right now, which is followed by a slash. */
+        p = strchr(value, '/');
+        if (!p)
+                return -EINVAL;
+
+        nr = p;
+        while (nr > value && strchr(DIGITS, nr[-1]))
+                nr--;
+
+        return safe_atou64(strndupa(nr, p - nr), ret);
+}
+
 static uint64_t calc_gcd64(uint64_t a, uint64_t b) {
 
         while (b > 0) {
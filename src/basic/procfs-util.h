@@ -8,6 +8,7 @@
 int procfs_tasks_get_limit(uint64_t *ret);
 int procfs_tasks_set_limit(uint64_t limit);
 int procfs_tasks_get_current(uint64_t *ret);
+int procfs_tasks_get_runnable(uint64_t *ret);
 
 int procfs_cpu_get_usage(nsec_t *ret);
 
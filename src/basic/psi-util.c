@@ -0,0 +1,77 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <errno.h>
+
+#include "alloc-util.h"
+#include "extract-word.h"
+#include "fileio.h"
+#include "parse-util.h"
+#include "psi-util.h"
+#include "string-util.h"
+
+int read_pressure_totals(const char *path, usec_t ret[static _PRESSURE_TYPE_MAX]) {
+        _cleanup_free_ char *contents = NULL;
+        usec_t totals[_PRESSURE_TYPE_MAX] = { USEC_INFINITY, USEC_INFINITY };
+        const char *p;
+        int r;
+
+        assert(path);
+        assert(ret);
+
+        /* Reads the total stall times from a pressure stall information (PSI) file, i.e. /proc/pressure/<resource> or
+         * <resource>.pressure of a cgroup, which look like this:
+         *
+         *     some avg10=0.00 avg60=0.00 avg300=0.00 total=12345
+         *     full avg10=0.00 avg60=0.00 avg300=0.00 total=6789
+         *
+         * Types the file doesn't have a line for are returned as USEC_INFINITY. */
+
+        r = read_full_file(path, &contents, NULL);
+        if (r < 0)
+                return r;
+
+        for (p = contents; *p; p += strspn(p, NEWLINE)) {
+                _cleanup_free_ char *line = NULL, *word = NULL;
+                PressureType type;
+                const char *q;
+
+                line = strndup(p, strcspn(p, NEWLINE));
+                if (!line)
+                        return -ENOMEM;
+                p += strlen(line);
+
+                q = line;
+                r = extract_first_word(&q, &word, NULL, 0);
+                if (r < 0)
+                        return r;
+                if (streq_ptr(word, "some"))
+                        type = PRESSURE_TYPE_SOME;
+                else if (streq_ptr(word, "full"))
+                        type = PRESSURE_TYPE_FULL;
+                else
+                        continue;
+
+                for (;;) {
+                        _cleanup_free_ char *field = NULL;
+                        const char *v;
+
+                        r = extract_first_word(&q, &field, NULL, 0);
+                        if (r < 0)
+                                return r;
+                        if (r == 0)
+                                return -EBADMSG; /* No total= field? */
+
+                        v = startswith(field, "total=");
+                        if (!v)
+                                continue;
+
+                        r = safe_atou64(v, &totals[type]);
+                        if (r < 0)
+                                return r;
+                        break;
+                }
+        }
+
+        memcpy(ret, totals, sizeof(totals));
+        return 0;
+}
@@ -0,0 +1,14 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+#pragma once
+
+#include "macro.h"
+#include "time-util.h"
+
+typedef enum PressureType {
+        PRESSURE_TYPE_SOME,
+        PRESSURE_TYPE_FULL,
+        _PRESSURE_TYPE_MAX,
+        _PRESSURE_TYPE_INVALID = -1,
+} PressureType;
+
+int read_pressure_totals(const char *path, usec_t ret[static _PRESSURE_TYPE_MAX]);
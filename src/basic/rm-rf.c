@@ -25,10 +25,31 @@ static bool is_physical_fs(const struct statfs *sfs) {
         return !is_temporary_fs(sfs) && !is_cgroup_fs(sfs);
 }
 
+static int is_mount_point_cached(int fd, const char *filename, int *parent_mnt_id) {
+        int mnt_id;
+
+        assert(parent_mnt_id);
+
+        /* fd_is_mount_point() determines the mount ID of the directory itself again for every entry. When
+         * name_to_handle_at() works here, do that only once per directory, and compare the mount ID of each
+         * subdirectory with it. Since the entry is never "." or "..", it cannot be the root directory, hence this
+         * is all there is to check. Otherwise use the full logic with all its fallbacks. */
+
+        if (*parent_mnt_id == -1 &&
+            name_to_handle_at_loop(fd, "", NULL, parent_mnt_id, AT_EMPTY_PATH) < 0)
+                *parent_mnt_id = -2; /* Don't try again */
+
+        if (*parent_mnt_id >= 0 &&
+            name_to_handle_at_loop(fd, filename, NULL, &mnt_id, 0) >= 0)
+                return mnt_id != *parent_mnt_id;
+
+        return fd_is_mount_point(fd, filename, 0);
+}
+
 int rm_rf_children(int fd, RemoveFlags flags, struct stat *root_dev) {
         _cleanup_closedir_ DIR *d = NULL;
+        int ret = 0, r, mnt_id = -1;
         struct dirent *de;
-        int ret = 0, r;
         struct statfs sfs;
 
         assert(fd >= 0);
@@ -99,7 +120,7 @@ int rm_rf_children(int fd, RemoveFlags flags, struct stat *root_dev) {
                         }
 
                         /* Stop at mount points */
-                        r = fd_is_mount_point(fd, de->d_name, 0);
+                        r = is_mount_point_cached(fd, de->d_name, &mnt_id);
                         if (r < 0) {
                                 if (ret == 0 && r != -ENOENT)
                                         ret = r;
@@ -71,6 +71,14 @@ static inline unsigned set_buckets(Set *s) {
         return internal_hashmap_buckets(HASHMAP_BASE(s));
 }
 
+static inline void set_get_stats(Set *s, HashmapStats *ret) {
+        internal_hashmap_get_stats(HASHMAP_BASE(s), ret);
+}
+
+static inline void set_dump_stats(Set *s, FILE *f, const char *prefix, const char *name) {
+        internal_hashmap_dump_stats(HASHMAP_BASE(s), f, prefix, name);
+}
+
 bool set_iterate(Set *s, Iterator *i, void **value);
 
 static inline void set_clear(Set *s) {
@@ -0,0 +1,99 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <errno.h>
+#include <string.h>
+
+#include "alloc-util.h"
+#include "string-pool.h"
+
+typedef struct PoolString {
+        unsigned n_ref;
+        char s[];
+} PoolString;
+
+struct StringPool {
+        Hashmap *strings; /* The key points into the PoolString that is the value */
+};
+
+static PoolString *pool_string_from_string(const char *s) {
+        return (PoolString*) (s - offsetof(PoolString, s));
+}
+
+StringPool *string_pool_free(StringPool *p) {
+        if (!p)
+                return NULL;
+
+        /* Strings still referenced are freed too, the pool owns them after all */
+        hashmap_free_free(p->strings);
+        return mfree(p);
+}
+
+int string_pool_intern(StringPool **p, const char *s, const char **ret) {
+        PoolString *e;
+        size_t l;
+        int r;
+
+        assert(p);
+        assert(s);
+        assert(ret);
+
+        if (*p) {
+                e = hashmap_get((*p)->strings, s);
+                if (e) {
+                        assert(e->n_ref > 0);
+                        e->n_ref++;
+
+                        *ret = e->s;
+                        return 0;
+                }
+        } else {
+                *p = new0(StringPool, 1);
+                if (!*p)
+                        return -ENOMEM;
+        }
+
+        r = hashmap_ensure_allocated(&(*p)->strings, &string_hash_ops);
+        if (r < 0)
+                return r;
+
+        l = strlen(s);
+        e = malloc(offsetof(PoolString, s) + l + 1);
+        if (!e)
+                return -ENOMEM;
+
+        e->n_ref = 1;
+        memcpy(e->s, s, l + 1);
+
+        r = hashmap_put((*p)->strings, e->s, e);
+        if (r < 0) {
+                free(e);
+                return r;
+        }
+
+        *ret = e->s;
+        return 1;
+}
+
+const char *string_pool_unref(StringPool *p, const char *s) {
+        PoolString *e;
+
+        if (!s)
+                return NULL;
+
+        assert(p);
+
+        e = pool_string_from_string(s);
+        assert(hashmap_get(p->strings, s) == e);
+        assert(e->n_ref > 0);
+
+        if (--e->n_ref == 0) {
+                (void) hashmap_remove(p->strings, s);
+                free(e);
+        }
+
+        return NULL;
+}
+
+unsigned string_pool_size(StringPool *p) {
+        return p ? hashmap_size(p->strings) : 0;
+}
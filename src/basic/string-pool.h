@@ -0,0 +1,20 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+#pragma once
+
+#include "hashmap.h"
+#include "macro.h"
+
+/* A pool of reference counted, immutable strings. Interning the same string twice returns the same pointer, hence
+ * each distinct string is stored only once, and interned strings may be compared by pointer. Unlike struct strbuf
+ * strings may be released again individually. Like for Hashmap, a NULL pointer is a valid empty pool, and
+ * string_pool_intern() allocates it as needed. */
+
+typedef struct StringPool StringPool;
+
+StringPool *string_pool_free(StringPool *p);
+DEFINE_TRIVIAL_CLEANUP_FUNC(StringPool*, string_pool_free);
+
+int string_pool_intern(StringPool **p, const char *s, const char **ret);
+const char *string_pool_unref(StringPool *p, const char *s);
+
+unsigned string_pool_size(StringPool *p) _pure_;
@@ -2,6 +2,16 @@
 
 #include "string-table.h"
 #include "string-util.h"
+#include "util.h"
+
+/* Tables with fewer entries than this are searched linearly, an index doesn't pay off for them */
+#define STRING_TABLE_INDEX_MIN 8U
+
+enum {
+        STRING_TABLE_INDEX_UNSET,
+        STRING_TABLE_INDEX_BUILDING,
+        STRING_TABLE_INDEX_READY,
+};
 
 ssize_t string_table_lookup(const char * const *table, size_t len, const char *key) {
         size_t i;
@@ -15,3 +25,64 @@ ssize_t string_table_lookup(const char * const *table, size_t len, const char *k
 
         return -1;
 }
+
+static int string_table_index_compare(const size_t *a, const size_t *b, void *userdata) {
+        const char * const *table = userdata;
+        int r;
+
+        r = strcmp(table[*a], table[*b]);
+        if (r != 0)
+                return r;
+
+        return CMP(*a, *b);
+}
+
+static void string_table_index_build(const char * const *table, size_t len, StringTableIndex *index) {
+        size_t i, n = 0;
+
+        for (i = 0; i < len; i++)
+                if (table[i])
+                        index->entries[n++] = i;
+
+        typesafe_qsort_r(index->entries, n, string_table_index_compare, (void*) table);
+        index->n_entries = n;
+}
+
+ssize_t string_table_lookup_indexed(const char * const *table, size_t len, StringTableIndex *index, const char *key) {
+        size_t lo = 0, hi;
+
+        assert(index);
+
+        if (!key)
+                return -1;
+
+        if (len < STRING_TABLE_INDEX_MIN)
+                return string_table_lookup(table, len, key);
+
+        /* The tables are constant, hence the index is built only once, by whoever gets here first. Lookups
+         * racing with that in other threads simply search linearly in the meantime. */
+        if (__atomic_load_n(&index->state, __ATOMIC_ACQUIRE) != STRING_TABLE_INDEX_READY) {
+                if (!__sync_bool_compare_and_swap(&index->state, STRING_TABLE_INDEX_UNSET, STRING_TABLE_INDEX_BUILDING))
+                        return string_table_lookup(table, len, key);
+
+                string_table_index_build(table, len, index);
+                __atomic_store_n(&index->state, STRING_TABLE_INDEX_READY, __ATOMIC_RELEASE);
+        }
+
+        /* Look for the first matching entry, so that the lowest index is returned if a string is listed more than
+         * once, like the linear search does. */
+        hi = index->n_entries;
+        while (lo < hi) {
+                size_t m = lo + (hi - lo) / 2;
+
+                if (strcmp(table[index->entries[m]], key) < 0)
+                        lo = m + 1;
+                else
+                        hi = m;
+        }
+
+        if (lo < index->n_entries && streq(table[index->entries[lo]], key))
+                return (ssize_t) index->entries[lo];
+
+        return -1;
+}
@@ -14,6 +14,22 @@
 
 ssize_t string_table_lookup(const char * const *table, size_t len, const char *key);
 
+/* The entries of a table sorted by their strings, built on the first lookup */
+typedef struct StringTableIndex {
+        unsigned state;
+        size_t n_entries;
+        size_t *entries;
+} StringTableIndex;
+
+ssize_t string_table_lookup_indexed(const char * const *table, size_t len, StringTableIndex *index, const char *key);
+
+#define _STRING_TABLE_LOOKUP(name,s)                                    \
+        ({                                                              \
+                static size_t _entries[ELEMENTSOF(name##_table)];       \
+                static StringTableIndex _index = { .entries = _entries }; \
+                string_table_lookup_indexed(name##_table, ELEMENTSOF(name##_table), &_index, (s)); \
+        })
+
 /* For basic lookup tables with strictly enumerated entries */
 #define _DEFINE_STRING_TABLE_LOOKUP_TO_STRING(name,type,scope)          \
         scope const char *name##_to_string(type i) {                    \
@@ -24,7 +40,7 @@ ssize_t string_table_lookup(const char * const *table, size_t len, const char *k
 
 #define _DEFINE_STRING_TABLE_LOOKUP_FROM_STRING(name,type,scope)        \
         scope type name##_from_string(const char *s) {                  \
-                return (type) string_table_lookup(name##_table, ELEMENTSOF(name##_table), s); \
+                return (type) _STRING_TABLE_LOOKUP(name, s);            \
         }
 
 #define _DEFINE_STRING_TABLE_LOOKUP_FROM_STRING_WITH_BOOLEAN(name,type,yes,scope) \
@@ -37,7 +53,7 @@ ssize_t string_table_lookup(const char * const *table, size_t len, const char *k
                         return (type) 0;                                \
                 else if (b > 0)                                         \
                         return yes;                                     \
-                return (type) string_table_lookup(name##_table, ELEMENTSOF(name##_table), s); \
+                return (type) _STRING_TABLE_LOOKUP(name, s);            \
         }
 
 #define _DEFINE_STRING_TABLE_LOOKUP_TO_STRING_FALLBACK(name,type,max,scope) \
@@ -59,13 +75,13 @@ ssize_t string_table_lookup(const char * const *table, size_t len, const char *k
 
 #define _DEFINE_STRING_TABLE_LOOKUP_FROM_STRING_FALLBACK(name,type,max,scope) \
         scope type name##_from_string(const char *s) {                  \
-                type i;                                                 \
+                ssize_t i;                                              \
                 unsigned u = 0;                                         \
                 if (!s)                                                 \
                         return (type) -1;                               \
-                for (i = 0; i < (type) ELEMENTSOF(name##_table); i++)   \
-                        if (streq_ptr(name##_table[i], s))              \
-                                return i;                               \
+                i = _STRING_TABLE_LOOKUP(name, s);                      \
+                if (i >= 0)                                             \
+                        return (type) i;                                \
                 if (safe_atou(s, &u) >= 0 && u <= max)                  \
                         return (type) u;                                \
                 return (type) -1;                                       \
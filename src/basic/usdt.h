@@ -0,0 +1,29 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+#pragma once
+
+/* Statically defined tracepoints, in the format of systemtap's sys/sdt.h, which bpftrace, perf, systemtap and
+ * friends understand. With -Dsdt=true every probe is a single nop plus a note in the ELF file, the arguments are
+ * only fetched by the tracer when a probe is attached. Without it, probes compile to nothing. Arguments should be
+ * plain values or pointers that are already at hand: don't add probes that require computing anything.
+ *
+ * The probes that exist, grouped by provider:
+ *
+ *   journald:  message_accept(priority, n_iovec, pid), message_append(uid, n_iovec, priority),
+ *              entries_write(n_entries)
+ *   sd_bus:    message_send(bus, type, cookie, path, interface, member),
+ *              message_receive(bus, type, cookie, path, interface, member),
+ *              message_dispatch(bus, type, cookie, path, interface, member), message_dispatched(bus, cookie, r)
+ *   sd_event:  source_dispatch(source, type, description), source_dispatched(source, type, r)
+ *   systemd:   job_start(id, unit, type), job_finish(id, unit, type, result), unit_state(unit, old, new)
+ *   udevd:     event_start(device, seqnum), event_finish(device, r)
+ *   resolved:  query_start(query, flags), query_complete(query, state), cache_hit(transaction_id, type, rcode),
+ *              transaction_complete(transaction_id, state, answer_source)
+ */
+
+#if ENABLE_SDT
+#include <sys/sdt.h>
+
+#define USDT_PROBE(provider, name, ...) STAP_PROBEV(provider, name, ##__VA_ARGS__)
+#else
+#define USDT_PROBE(provider, name, ...) do {} while (false)
+#endif
@@ -25,6 +25,7 @@
 
 #include <errno.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -128,6 +129,18 @@ int utf8_encoded_to_unichar(const char *str, char32_t *ret_unichar) {
         return 0;
 }
 
+#define BYTES_ONES ((uint64_t) 0x0101010101010101ULL)
+
+/* Returns true if all eight bytes are printable ASCII, i.e. in the range ' '…'~'. Log messages and most other strings
+ * that are validated consist of nothing else, hence test a word at a time before looking at single characters. */
+static bool word_is_printable_ascii(uint64_t w) {
+        uint64_t del = w ^ (BYTES_ONES * 0x7F);
+
+        return ((w & (BYTES_ONES * 0x80)) |                        /* not ASCII */
+                ((w - BYTES_ONES * ' ') & ~w & (BYTES_ONES * 0x80)) | /* below ' ' */
+                ((del - BYTES_ONES) & ~del & (BYTES_ONES * 0x80))) == 0; /* DEL */
+}
+
 bool utf8_is_printable_newline(const char* str, size_t length, bool newline) {
         const char *p;
 
@@ -137,6 +150,26 @@ bool utf8_is_printable_newline(const char* str, size_t length, bool newline) {
                 int encoded_len, r;
                 char32_t val;
 
+                if (length >= sizeof(uint64_t)) {
+                        uint64_t w;
+
+                        memcpy(&w, p, sizeof(w));
+                        if (word_is_printable_ascii(w)) {
+                                length -= sizeof(w);
+                                p += sizeof(w);
+                                continue;
+                        }
+                }
+
+                if ((unsigned char) *p < 0x80) {
+                        if (unichar_is_control(*p) || (!newline && *p == '\n'))
+                                return false;
+
+                        length--;
+                        p++;
+                        continue;
+                }
+
                 encoded_len = utf8_encoded_valid_unichar(p);
                 if (encoded_len < 0 ||
                     (size_t) encoded_len > length)
@@ -144,8 +177,7 @@ bool utf8_is_printable_newline(const char* str, size_t length, bool newline) {
 
                 r = utf8_encoded_to_unichar(p, &val);
                 if (r < 0 ||
-                    unichar_is_control(val) ||
-                    (!newline && val == '\n'))
+                    unichar_is_control(val))
                         return false;
 
                 length -= encoded_len;
@@ -164,6 +196,12 @@ char *utf8_is_valid(const char *str) {
         while (*p) {
                 int len;
 
+                /* ASCII is always valid, no need to decode it */
+                if ((unsigned char) *p < 0x80) {
+                        p++;
+                        continue;
+                }
+
                 len = utf8_encoded_valid_unichar(p);
                 if (len < 0)
                         return NULL;
@@ -520,6 +558,13 @@ size_t utf8_console_width(const char *str) {
         while (*str != 0) {
                 char32_t c;
 
+                /* Plain ASCII characters take up one cell each, no need to decode them */
+                if ((unsigned char) *str < 0x80) {
+                        str++;
+                        n++;
+                        continue;
+                }
+
                 if (utf8_encoded_to_unichar(str, &c) < 0)
                         return (size_t) -1;
 
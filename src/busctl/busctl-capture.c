@@ -0,0 +1,245 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <endian.h>
+
+#include "alloc-util.h"
+#include "bus-dump.h"
+#include "bus-internal.h"
+#include "bus-message.h"
+#include "bus-protocol.h"
+#include "busctl-capture.h"
+#include "fileio.h"
+#include "io-util.h"
+
+struct CaptureRing {
+        uint8_t *buffer;
+        size_t size;
+
+        /* Offset of the oldest record, and the number of bytes used from there on, wrapping around at the end */
+        size_t head;
+        size_t used;
+
+        usec_t window;
+        size_t snaplen;
+
+        uint64_t n_captured;
+        uint64_t n_dropped;
+};
+
+int capture_ring_new(size_t size, usec_t window, size_t snaplen, CaptureRing **ret) {
+        _cleanup_(capture_ring_freep) CaptureRing *r = NULL;
+
+        assert(snaplen > 0);
+        assert(ret);
+
+        /* Every record must fit in on its own */
+        if (size < sizeof(pcaprec_hdr_t) + snaplen)
+                return -EINVAL;
+
+        r = new(CaptureRing, 1);
+        if (!r)
+                return -ENOMEM;
+
+        *r = (CaptureRing) {
+                .size = size,
+                .window = window,
+                .snaplen = snaplen,
+        };
+
+        r->buffer = malloc(size);
+        if (!r->buffer)
+                return -ENOMEM;
+
+        *ret = TAKE_PTR(r);
+        return 0;
+}
+
+CaptureRing* capture_ring_free(CaptureRing *r) {
+        if (!r)
+                return NULL;
+
+        free(r->buffer);
+        return mfree(r);
+}
+
+static void ring_copy_in(CaptureRing *r, size_t offset, const void *data, size_t n) {
+        size_t k;
+
+        offset %= r->size;
+        k = MIN(n, r->size - offset);
+
+        memcpy(r->buffer + offset, data, k);
+        memcpy_safe(r->buffer, (const uint8_t*) data + k, n - k);
+}
+
+static void ring_copy_out(CaptureRing *r, size_t offset, void *data, size_t n) {
+        size_t k;
+
+        offset %= r->size;
+        k = MIN(n, r->size - offset);
+
+        memcpy(data, r->buffer + offset, k);
+        memcpy_safe((uint8_t*) data + k, r->buffer, n - k);
+}
+
+static usec_t oldest_timestamp(CaptureRing *r, size_t *ret_size) {
+        pcaprec_hdr_t hdr;
+
+        assert(r->used >= sizeof(hdr));
+
+        ring_copy_out(r, r->head, &hdr, sizeof(hdr));
+
+        if (ret_size)
+                *ret_size = sizeof(hdr) + hdr.incl_len;
+
+        return (usec_t) hdr.ts_sec * USEC_PER_SEC + hdr.ts_usec;
+}
+
+static void drop_oldest(CaptureRing *r) {
+        size_t size;
+
+        (void) oldest_timestamp(r, &size);
+
+        r->head = (r->head + size) % r->size;
+        r->used -= size;
+        r->n_dropped++;
+}
+
+static void drop_expired(CaptureRing *r, usec_t until) {
+        if (r->window == 0 || until < r->window)
+                return;
+
+        while (r->used > 0 && oldest_timestamp(r, NULL) < until - r->window)
+                drop_oldest(r);
+}
+
+int capture_ring_add(CaptureRing *r, usec_t timestamp, const struct iovec *iovec, size_t n_iovec) {
+        pcaprec_hdr_t hdr;
+        size_t i, orig = 0, incl, offset;
+
+        assert(r);
+        assert(iovec || n_iovec == 0);
+
+        for (i = 0; i < n_iovec; i++)
+                orig += iovec[i].iov_len;
+
+        if ((size_t) (uint32_t) orig != orig)
+                return -E2BIG;
+
+        incl = MIN(orig, r->snaplen);
+
+        drop_expired(r, timestamp);
+
+        while (r->size - r->used < sizeof(hdr) + incl)
+                drop_oldest(r);
+
+        hdr = (pcaprec_hdr_t) {
+                .ts_sec = timestamp / USEC_PER_SEC,
+                .ts_usec = timestamp % USEC_PER_SEC,
+                .incl_len = incl,
+                .orig_len = orig,
+        };
+
+        offset = r->head + r->used;
+        ring_copy_in(r, offset, &hdr, sizeof(hdr));
+        offset += sizeof(hdr);
+
+        for (i = 0; i < n_iovec && incl > 0; i++) {
+                size_t k;
+
+                k = MIN(iovec[i].iov_len, incl);
+                ring_copy_in(r, offset, iovec[i].iov_base, k);
+                offset += k;
+                incl -= k;
+        }
+
+        r->used = offset - r->head;
+        r->n_captured++;
+
+        return 0;
+}
+
+int capture_ring_add_message(CaptureRing *r, sd_bus_message *m) {
+        struct bus_body_part *part;
+        struct iovec *iovec;
+        unsigned i;
+        size_t n = 0;
+
+        assert(r);
+        assert(m);
+
+        iovec = newa(struct iovec, 1 + m->n_body_parts);
+
+        iovec[n++] = IOVEC_MAKE(m->header, BUS_MESSAGE_BODY_BEGIN(m));
+
+        MESSAGE_FOREACH_PART(part, i, m)
+                if (part->size > 0)
+                        iovec[n++] = IOVEC_MAKE(part->data, part->size);
+
+        return capture_ring_add(r, m->realtime != 0 ? m->realtime : now(CLOCK_REALTIME), iovec, n);
+}
+
+int capture_ring_flush(CaptureRing *r, usec_t until, FILE *f) {
+        size_t k;
+
+        assert(r);
+        assert(f);
+
+        /* Writes out all records that are still within the window before 'until', and empties the ring */
+
+        drop_expired(r, until);
+
+        k = MIN(r->used, r->size - r->head);
+        fwrite(r->buffer + r->head, 1, k, f);
+        fwrite(r->buffer, 1, r->used - k, f);
+
+        r->head = r->used = 0;
+
+        return fflush_and_check(f);
+}
+
+uint64_t capture_ring_get_n_captured(CaptureRing *r) {
+        assert(r);
+
+        return r->n_captured;
+}
+
+uint64_t capture_ring_get_n_dropped(CaptureRing *r) {
+        assert(r);
+
+        return r->n_dropped;
+}
+
+int capture_frame_size(const void *p, size_t n, size_t *ret) {
+        const struct bus_header *h = p;
+        uint32_t body_size, fields_size;
+        uint64_t sum;
+
+        assert(p || n == 0);
+        assert(ret);
+
+        /* Determines the size of the dbus1 message starting at p. Returns 0 if more data is needed for that. */
+
+        if (n < sizeof(struct bus_header))
+                return 0;
+
+        if (h->endian == BUS_LITTLE_ENDIAN) {
+                body_size = le32toh(h->dbus1.body_size);
+                fields_size = le32toh(h->dbus1.fields_size);
+        } else if (h->endian == BUS_BIG_ENDIAN) {
+                body_size = be32toh(h->dbus1.body_size);
+                fields_size = be32toh(h->dbus1.fields_size);
+        } else
+                return -EBADMSG;
+
+        /* A body that is passed in a memfd is only negotiated between peers directly, never with the broker */
+        if (h->version != 1 || (h->flags & BUS_MESSAGE_BODY_MEMFD))
+                return -EBADMSG;
+
+        sum = (uint64_t) sizeof(struct bus_header) + ALIGN8((uint64_t) fields_size) + body_size;
+        if (sum >= BUS_MESSAGE_SIZE_MAX)
+                return -EBADMSG;
+
+        *ret = (size_t) sum;
+        return 1;
+}
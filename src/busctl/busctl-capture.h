@@ -0,0 +1,35 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+#pragma once
+
+#include <stdio.h>
+#include <sys/uio.h>
+
+#include "sd-bus.h"
+
+#include "macro.h"
+#include "time-util.h"
+
+/* Keeps the most recently captured messages in memory, already formatted as pcap records, so that a capture may be
+ * left running for a long time at little cost, and is only written out when requested. When the ring is full, the
+ * oldest records are dropped. */
+
+/* The ring size used if only a time window is specified */
+#define CAPTURE_RING_SIZE_DEFAULT (64U*1024U*1024U)
+
+/* How much to read from the bus socket at once */
+#define CAPTURE_READ_SIZE (256U*1024U)
+
+typedef struct CaptureRing CaptureRing;
+
+int capture_ring_new(size_t size, usec_t window, size_t snaplen, CaptureRing **ret);
+CaptureRing* capture_ring_free(CaptureRing *r);
+DEFINE_TRIVIAL_CLEANUP_FUNC(CaptureRing*, capture_ring_free);
+
+int capture_ring_add(CaptureRing *r, usec_t timestamp, const struct iovec *iovec, size_t n_iovec);
+int capture_ring_add_message(CaptureRing *r, sd_bus_message *m);
+int capture_ring_flush(CaptureRing *r, usec_t until, FILE *f);
+
+uint64_t capture_ring_get_n_captured(CaptureRing *r);
+uint64_t capture_ring_get_n_dropped(CaptureRing *r);
+
+int capture_frame_size(const void *p, size_t n, size_t *ret);
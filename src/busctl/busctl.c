@@ -4,6 +4,7 @@
 #include <stdio_ext.h>
 
 #include "sd-bus.h"
+#include "sd-event.h"
 
 #include "alloc-util.h"
 #include "bus-dump.h"
@@ -12,10 +13,12 @@
 #include "bus-signature.h"
 #include "bus-type.h"
 #include "bus-util.h"
+#include "busctl-capture.h"
 #include "busctl-introspect.h"
 #include "escape.h"
 #include "fd-util.h"
 #include "fileio.h"
+#include "io-util.h"
 #include "json.h"
 #include "locale-util.h"
 #include "log.h"
@@ -27,6 +30,7 @@
 #include "set.h"
 #include "strv.h"
 #include "terminal-util.h"
+#include "signal-util.h"
 #include "user-util.h"
 #include "util.h"
 #include "verbs.h"
@@ -48,6 +52,8 @@ static BusTransport arg_transport = BUS_TRANSPORT_LOCAL;
 static const char *arg_host = NULL;
 static bool arg_user = false;
 static size_t arg_snaplen = 4096;
+static size_t arg_ring_size = 0;
+static usec_t arg_ring_time = 0;
 static bool arg_list = false;
 static bool arg_quiet = false;
 static bool arg_verbose = false;
@@ -1169,14 +1175,13 @@ static int message_json(sd_bus_message *m, FILE *f) {
         return 0;
 }
 
-static int monitor(int argc, char **argv, int (*dump)(sd_bus_message *m, FILE *f)) {
+static int become_monitor(int argc, char **argv, sd_bus **ret) {
         _cleanup_(sd_bus_flush_close_unrefp) sd_bus *bus = NULL;
         _cleanup_(sd_bus_message_unrefp) sd_bus_message *message = NULL;
         _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
         char **i;
         uint32_t flags = 0;
         const char *unique_name;
-        bool is_monitor = false;
         int r;
 
         r = acquire_bus(true, &bus);
@@ -1240,32 +1245,58 @@ static int monitor(int argc, char **argv, int (*dump)(sd_bus_message *m, FILE *f
         if (r < 0)
                 return log_error_errno(r, "Failed to get unique name: %m");
 
-        log_info("Monitoring bus message stream.");
-
         for (;;) {
                 _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
+                const char *name;
 
                 r = sd_bus_process(bus, &m);
                 if (r < 0)
                         return log_error_errno(r, "Failed to process bus: %m");
 
-                if (!is_monitor) {
-                        const char *name;
-
-                        /* wait until we lose our unique name */
-                        if (sd_bus_message_is_signal(m, "org.freedesktop.DBus", "NameLost") <= 0)
+                if (!m) {
+                        if (r > 0)
                                 continue;
 
-                        r = sd_bus_message_read(m, "s", &name);
+                        r = sd_bus_wait(bus, (uint64_t) -1);
                         if (r < 0)
-                                return log_error_errno(r, "Failed to read lost name: %m");
-
-                        if (streq(name, unique_name))
-                                is_monitor = true;
+                                return log_error_errno(r, "Failed to wait for bus: %m");
 
                         continue;
                 }
 
+                /* wait until we lose our unique name */
+                if (sd_bus_message_is_signal(m, "org.freedesktop.DBus", "NameLost") <= 0)
+                        continue;
+
+                r = sd_bus_message_read(m, "s", &name);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to read lost name: %m");
+
+                if (streq(name, unique_name))
+                        break;
+        }
+
+        *ret = TAKE_PTR(bus);
+        return 0;
+}
+
+static int monitor(int argc, char **argv, int (*dump)(sd_bus_message *m, FILE *f)) {
+        _cleanup_(sd_bus_flush_close_unrefp) sd_bus *bus = NULL;
+        int r;
+
+        r = become_monitor(argc, argv, &bus);
+        if (r < 0)
+                return r;
+
+        log_info("Monitoring bus message stream.");
+
+        for (;;) {
+                _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
+
+                r = sd_bus_process(bus, &m);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to process bus: %m");
+
                 if (m) {
                         dump(m, stdout);
                         fflush(stdout);
@@ -1291,6 +1322,200 @@ static int verb_monitor(int argc, char **argv, void *userdata) {
         return monitor(argc, argv, arg_json != JSON_OFF ? message_json : message_dump);
 }
 
+typedef struct CaptureContext {
+        CaptureRing *ring;
+
+        /* Raw message stream read from the bus socket, not yet split into messages */
+        uint8_t *buffer;
+        size_t allocated;
+        size_t filled;
+} CaptureContext;
+
+static void capture_context_done(CaptureContext *c) {
+        c->ring = capture_ring_free(c->ring);
+        c->buffer = mfree(c->buffer);
+}
+
+static int capture_write(CaptureContext *c) {
+        int r;
+
+        r = capture_ring_flush(c->ring, now(CLOCK_REALTIME), stdout);
+        if (r < 0)
+                return log_error_errno(r, "Couldn't write capture file: %m");
+
+        return 0;
+}
+
+static int capture_read(CaptureContext *c, int fd) {
+        union {
+                struct cmsghdr cmsghdr;
+                uint8_t buf[CMSG_SPACE(sizeof(int) * BUS_FDS_MAX)];
+        } control;
+        struct msghdr mh = {
+                .msg_control = &control,
+                .msg_controllen = sizeof(control),
+        };
+        struct cmsghdr *cmsg;
+        struct iovec iov;
+        size_t need = 0, p = 0;
+        usec_t ts;
+        ssize_t k;
+        int r;
+
+        /* Reads as much as is available, and copies all complete messages into the ring. Returns 1 at the end of
+         * the stream. */
+
+        /* Make sure the message we are in the middle of fits into the buffer */
+        r = capture_frame_size(c->buffer, c->filled, &need);
+        if (r < 0)
+                return log_error_errno(r, "Received invalid message: %m");
+
+        if (!GREEDY_REALLOC(c->buffer, c->allocated, MAX(need, CAPTURE_READ_SIZE)))
+                return log_oom();
+
+        iov = IOVEC_MAKE(c->buffer + c->filled, c->allocated - c->filled);
+        mh.msg_iov = &iov;
+        mh.msg_iovlen = 1;
+
+        k = recvmsg(fd, &mh, MSG_DONTWAIT|MSG_CMSG_CLOEXEC);
+        if (k < 0) {
+                if (IN_SET(errno, EAGAIN, EINTR))
+                        return 0;
+                if (errno == ECONNRESET)
+                        return 1;
+
+                return log_error_errno(errno, "Failed to read from bus: %m");
+        }
+
+        /* Only the messages themselves are captured, not the file descriptors passed along */
+        CMSG_FOREACH(cmsg, &mh)
+                if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+                        close_many((int*) CMSG_DATA(cmsg), (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+
+        if (k == 0)
+                return 1;
+
+        c->filled += k;
+        ts = now(CLOCK_REALTIME);
+
+        for (;;) {
+                r = capture_frame_size(c->buffer + p, c->filled - p, &need);
+                if (r < 0)
+                        return log_error_errno(r, "Received invalid message: %m");
+                if (r == 0 || need > c->filled - p)
+                        break;
+
+                r = capture_ring_add(c->ring, ts, &IOVEC_MAKE(c->buffer + p, need), 1);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to capture message: %m");
+
+                p += need;
+        }
+
+        if (p > 0) {
+                memmove(c->buffer, c->buffer + p, c->filled - p);
+                c->filled -= p;
+        }
+
+        return 0;
+}
+
+static int capture_on_io(sd_event_source *s, int fd, uint32_t revents, void *userdata) {
+        CaptureContext *c = userdata;
+        int r;
+
+        r = capture_read(c, fd);
+        if (r == 0)
+                return 0;
+        if (r > 0)
+                log_info("Connection terminated, exiting.");
+
+        return sd_event_exit(sd_event_source_get_event(s), MIN(r, 0));
+}
+
+static int capture_on_sigusr1(sd_event_source *s, const struct signalfd_siginfo *si, void *userdata) {
+        CaptureContext *c = userdata;
+
+        log_debug("Writing out captured messages.");
+
+        return capture_write(c);
+}
+
+static int capture_ring(int argc, char **argv) {
+        _cleanup_(sd_bus_flush_close_unrefp) sd_bus *bus = NULL;
+        _cleanup_(sd_event_unrefp) sd_event *event = NULL;
+        _cleanup_(capture_context_done) CaptureContext c = {};
+        int r, q;
+
+        r = capture_ring_new(arg_ring_size, arg_ring_time, arg_snaplen, &c.ring);
+        if (r == -EINVAL)
+                return log_error_errno(r, "Ring size must be larger than the maximum length of captured packets.");
+        if (r < 0)
+                return log_error_errno(r, "Failed to allocate capture ring: %m");
+
+        assert_se(sigprocmask_many(SIG_BLOCK, NULL, SIGINT, SIGTERM, SIGUSR1, -1) >= 0);
+
+        r = sd_event_default(&event);
+        if (r < 0)
+                return log_error_errno(r, "Failed to allocate event loop: %m");
+
+        r = sd_event_add_signal(event, NULL, SIGINT, NULL, NULL);
+        if (r >= 0)
+                r = sd_event_add_signal(event, NULL, SIGTERM, NULL, NULL);
+        if (r >= 0)
+                r = sd_event_add_signal(event, NULL, SIGUSR1, capture_on_sigusr1, &c);
+        if (r < 0)
+                return log_error_errno(r, "Failed to install signal handlers: %m");
+
+        r = become_monitor(argc, argv, &bus);
+        if (r < 0)
+                return r;
+
+        /* Messages sd-bus already read are parsed anyway. All later ones are copied straight from the socket into
+         * the ring, without parsing them. */
+        for (;;) {
+                _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
+
+                r = sd_bus_process(bus, &m);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to process bus: %m");
+
+                if (m) {
+                        if (sd_bus_message_is_signal(m, "org.freedesktop.DBus.Local", "Disconnected") > 0) {
+                                log_info("Connection terminated, exiting.");
+                                return capture_write(&c);
+                        }
+
+                        r = capture_ring_add_message(c.ring, m);
+                        if (r < 0)
+                                return log_error_errno(r, "Failed to capture message: %m");
+                }
+
+                if (r == 0)
+                        break;
+        }
+
+        /* Take over what sd-bus already read of the next message */
+        c.buffer = TAKE_PTR(bus->rbuffer);
+        c.allocated = c.filled = bus->rbuffer_size;
+        bus->rbuffer_size = 0;
+
+        r = sd_event_add_io(event, NULL, sd_bus_get_fd(bus), EPOLLIN, capture_on_io, &c);
+        if (r < 0)
+                return log_error_errno(r, "Failed to watch bus connection: %m");
+
+        log_info("Capturing bus message stream into memory, send SIGUSR1 to write it out.");
+
+        r = sd_event_loop(event);
+
+        q = capture_write(&c);
+
+        log_info("Captured %" PRIu64 " messages, dropped %" PRIu64 " older ones.",
+                 capture_ring_get_n_captured(c.ring), capture_ring_get_n_dropped(c.ring));
+
+        return r < 0 ? r : q;
+}
+
 static int verb_capture(int argc, char **argv, void *userdata) {
         int r;
 
@@ -1300,7 +1525,10 @@ static int verb_capture(int argc, char **argv, void *userdata) {
 
         bus_pcap_header(arg_snaplen, stdout);
 
-        r = monitor(argc, argv, message_pcap);
+        if (arg_ring_size > 0)
+                r = capture_ring(argc, argv);
+        else
+                r = monitor(argc, argv, message_pcap);
         if (r < 0)
                 return r;
 
@@ -2169,6 +2397,8 @@ static int help(void) {
                "     --activatable        Only show activatable names\n"
                "     --match=MATCH        Only show matching messages\n"
                "     --size=SIZE          Maximum length of captured packet\n"
+               "     --ring-size=SIZE     Keep captured packets in memory until SIGUSR1\n"
+               "     --ring-time=SECS     Only keep captured packets of the last SECS\n"
                "     --list               Don't show tree, but simple object path list\n"
                "  -q --quiet              Don't show method call reply\n"
                "     --verbose            Show result values in long format\n"
@@ -2223,6 +2453,8 @@ static int parse_argv(int argc, char *argv[]) {
                 ARG_ACQUIRED,
                 ARG_ACTIVATABLE,
                 ARG_SIZE,
+                ARG_RING_SIZE,
+                ARG_RING_TIME,
                 ARG_LIST,
                 ARG_VERBOSE,
                 ARG_EXPECT_REPLY,
@@ -2250,6 +2482,8 @@ static int parse_argv(int argc, char *argv[]) {
                 { "host",                            required_argument, NULL, 'H'                                 },
                 { "machine",                         required_argument, NULL, 'M'                                 },
                 { "size",                            required_argument, NULL, ARG_SIZE                            },
+                { "ring-size",                       required_argument, NULL, ARG_RING_SIZE                       },
+                { "ring-time",                       required_argument, NULL, ARG_RING_TIME                       },
                 { "list",                            no_argument,       NULL, ARG_LIST                            },
                 { "quiet",                           no_argument,       NULL, 'q'                                 },
                 { "verbose",                         no_argument,       NULL, ARG_VERBOSE                         },
@@ -2334,6 +2568,30 @@ static int parse_argv(int argc, char *argv[]) {
                         break;
                 }
 
+                case ARG_RING_SIZE: {
+                        uint64_t sz;
+
+                        r = parse_size(optarg, 1024, &sz);
+                        if (r < 0)
+                                return log_error_errno(r, "Failed to parse ring size '%s': %m", optarg);
+
+                        if ((uint64_t) (size_t) sz != sz)
+                                return log_error_errno(SYNTHETIC_ERRNO(E2BIG),
+                                                       "Ring size out of range.");
+
+                        arg_ring_size = (size_t) sz;
+                        break;
+                }
+
+                case ARG_RING_TIME:
+                        r = parse_sec(optarg, &arg_ring_time);
+                        if (r < 0)
+                                return log_error_errno(r, "Failed to parse ring time '%s': %m", optarg);
+
+                        if (arg_ring_time > 0 && arg_ring_size == 0)
+                                arg_ring_size = CAPTURE_RING_SIZE_DEFAULT;
+                        break;
+
                 case ARG_LIST:
                         arg_list = true;
                         break;
@@ -175,19 +175,19 @@ static int process(
 
         if (streq(controller, SYSTEMD_CGROUP_CONTROLLER) &&
             IN_SET(arg_count, COUNT_ALL_PROCESSES, COUNT_USERSPACE_PROCESSES)) {
-                _cleanup_fclose_ FILE *f = NULL;
-                pid_t pid;
+                _cleanup_free_ pid_t *pids = NULL;
+                size_t n, i;
 
-                r = cg_enumerate_processes(controller, path, &f);
+                r = cg_read_pids(controller, path, &pids, &n);
                 if (r == -ENOENT)
                         return 0;
                 if (r < 0)
                         return r;
 
                 g->n_tasks = 0;
-                while (cg_read_pid(f, &pid) > 0) {
+                for (i = 0; i < n; i++) {
 
-                        if (arg_count == COUNT_USERSPACE_PROCESSES && is_kernel_thread(pid) > 0)
+                        if (arg_count == COUNT_USERSPACE_PROCESSES && is_kernel_thread(pids[i]) > 0)
                                 continue;
 
                         g->n_tasks++;
@@ -203,28 +203,17 @@ static int process(
                         if (r < 0)
                                 return r;
                 } else {
-                        _cleanup_free_ char *p = NULL, *v = NULL;
-
-                        r = cg_get_path(controller, path, "pids.current", &p);
-                        if (r < 0)
-                                return r;
-
-                        r = read_one_line_file(p, &v);
+                        r = cg_get_attribute_as_uint64(controller, path, "pids.current", &g->n_tasks);
                         if (r == -ENOENT)
                                 return 0;
                         if (r < 0)
                                 return r;
-
-                        r = safe_atou64(v, &g->n_tasks);
-                        if (r < 0)
-                                return r;
                 }
 
                 if (g->n_tasks > 0)
                         g->n_tasks_valid = true;
 
         } else if (STR_IN_SET(controller, "cpu", "cpuacct") || cpu_accounting_is_cheap()) {
-                _cleanup_free_ char *p = NULL, *v = NULL;
                 uint64_t new_usage;
                 nsec_t timestamp;
 
@@ -253,19 +242,11 @@ static int process(
                         if (!streq(controller, "cpuacct"))
                                 return 0;
 
-                        r = cg_get_path(controller, path, "cpuacct.usage", &p);
-                        if (r < 0)
-                                return r;
-
-                        r = read_one_line_file(p, &v);
+                        r = cg_get_attribute_as_uint64(controller, path, "cpuacct.usage", &new_usage);
                         if (r == -ENOENT)
                                 return 0;
                         if (r < 0)
                                 return r;
-
-                        r = safe_atou64(v, &new_usage);
-                        if (r < 0)
-                                return r;
                 }
 
                 timestamp = now_nsec(CLOCK_MONOTONIC);
@@ -295,24 +276,13 @@ static int process(
                         if (r < 0)
                                 return r;
                 } else {
-                        _cleanup_free_ char *p = NULL, *v = NULL;
-
-                        if (all_unified)
-                                r = cg_get_path(controller, path, "memory.current", &p);
-                        else
-                                r = cg_get_path(controller, path, "memory.usage_in_bytes", &p);
-                        if (r < 0)
-                                return r;
-
-                        r = read_one_line_file(p, &v);
+                        r = cg_get_attribute_as_uint64(controller, path,
+                                                       all_unified ? "memory.current" : "memory.usage_in_bytes",
+                                                       &g->memory);
                         if (r == -ENOENT)
                                 return 0;
                         if (r < 0)
                                 return r;
-
-                        r = safe_atou64(v, &g->memory);
-                        if (r < 0)
-                                return r;
                 }
 
                 if (g->memory > 0)
@@ -420,7 +390,7 @@ static int process(
 }
 
 static int refresh_one(
-                const char *controller,
+                char **controllers,
                 const char *path,
                 Hashmap *a,
                 Hashmap *b,
@@ -430,20 +400,28 @@ static int refresh_one(
 
         _cleanup_closedir_ DIR *d = NULL;
         Group *ours = NULL;
+        char **c;
         int r;
 
-        assert(controller);
+        assert(!strv_isempty(controllers));
         assert(path);
         assert(a);
 
         if (depth > arg_depth)
                 return 0;
 
-        r = process(controller, path, a, b, iteration, &ours);
-        if (r < 0)
-                return r;
+        STRV_FOREACH(c, controllers) {
+                Group *g = NULL;
 
-        r = cg_enumerate_subgroups(controller, path, &d);
+                r = process(*c, path, a, b, iteration, &g);
+                if (r < 0)
+                        return r;
+
+                if (g)
+                        ours = g;
+        }
+
+        r = cg_enumerate_subgroups(controllers[0], path, &d);
         if (r == -ENOENT)
                 return 0;
         if (r < 0)
@@ -465,7 +443,7 @@ static int refresh_one(
 
                 path_simplify(p, false);
 
-                r = refresh_one(controller, p, a, b, iteration, depth + 1, &child);
+                r = refresh_one(controllers, p, a, b, iteration, depth + 1, &child);
                 if (r < 0)
                         return r;
 
@@ -473,7 +451,7 @@ static int refresh_one(
                     IN_SET(arg_count, COUNT_ALL_PROCESSES, COUNT_USERSPACE_PROCESSES) &&
                     child &&
                     child->n_tasks_valid &&
-                    streq(controller, SYSTEMD_CGROUP_CONTROLLER)) {
+                    strv_contains(controllers, SYSTEMD_CGROUP_CONTROLLER)) {
 
                         /* Recursively sum up processes */
 
@@ -493,11 +471,22 @@ static int refresh_one(
 }
 
 static int refresh(const char *root, Hashmap *a, Hashmap *b, unsigned iteration) {
-        const char *c;
+        char **controllers = STRV_MAKE(SYSTEMD_CGROUP_CONTROLLER, "cpu", "cpuacct", "memory", "io", "blkio", "pids");
+        char **c;
         int r;
 
-        FOREACH_STRING(c, SYSTEMD_CGROUP_CONTROLLER, "cpu", "cpuacct", "memory", "io", "blkio", "pids") {
-                r = refresh_one(c, root, a, b, iteration, 0, NULL);
+        r = cg_all_unified();
+        if (r < 0)
+                return r;
+        if (r > 0) {
+                /* On the unified hierarchy all controllers share the same tree, hence walk it only once, and look
+                 * at all controllers for each cgroup we find. */
+                r = refresh_one(controllers, root, a, b, iteration, 0, NULL);
+                return r < 0 ? r : 0;
+        }
+
+        STRV_FOREACH(c, controllers) {
+                r = refresh_one(STRV_MAKE(*c), root, a, b, iteration, 0, NULL);
                 if (r < 0)
                         return r;
         }
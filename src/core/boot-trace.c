@@ -0,0 +1,179 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include "alloc-util.h"
+#include "boot-trace.h"
+#include "cgroup.h"
+#include "manager.h"
+#include "string-pool.h"
+#include "unit.h"
+
+static bool unit_want_boot_trace(Unit *u) {
+        assert(u);
+
+        /* Slices only aggregate their children, and the root cgroup covers everything, neither says anything about
+         * a specific unit */
+        if (u->type == UNIT_SLICE)
+                return false;
+
+        if (!u->cgroup_path || !u->cgroup_realized || unit_has_host_root_cgroup(u))
+                return false;
+
+        return !UNIT_IS_INACTIVE_OR_FAILED(unit_active_state(u));
+}
+
+static int boot_trace_add_sample(Manager *m, Unit *u, usec_t ts) {
+        usec_t pressure[_PRESSURE_TYPE_MAX];
+        BootTraceSample *s;
+        int r;
+
+        assert(m);
+        assert(u);
+
+        if (!GREEDY_REALLOC(m->boot_trace, m->n_boot_trace_allocated, m->n_boot_trace + 1))
+                return -ENOMEM;
+
+        s = m->boot_trace + m->n_boot_trace;
+        *s = (BootTraceSample) {
+                .timestamp = ts,
+                .cpu_usage_nsec = (uint64_t) -1,
+                .memory_current = (uint64_t) -1,
+                .io_read_bytes = (uint64_t) -1,
+                .io_write_bytes = (uint64_t) -1,
+                .cpu_pressure_usec = (uint64_t) -1,
+                .io_pressure_usec = (uint64_t) -1,
+        };
+
+        r = string_pool_intern(&m->string_pool, u->id, &s->unit);
+        if (r < 0)
+                return r;
+
+        /* Read the cgroup attributes directly rather than through unit_get_cgroup_stat(), as its cache is likely
+         * coarser than the sampling interval. Failures only leave the respective counter unset. */
+        (void) unit_get_cpu_usage(u, &s->cpu_usage_nsec);
+        (void) unit_get_memory_current(u, &s->memory_current);
+        if (unit_get_io_bytes(u, &s->io_read_bytes, &s->io_write_bytes) < 0)
+                s->io_read_bytes = s->io_write_bytes = (uint64_t) -1;
+
+        if (unit_get_pressure(u, "cpu", pressure) >= 0)
+                s->cpu_pressure_usec = pressure[PRESSURE_TYPE_SOME];
+        if (unit_get_pressure(u, "io", pressure) >= 0)
+                s->io_pressure_usec = pressure[PRESSURE_TYPE_SOME];
+
+        m->n_boot_trace++;
+        return 0;
+}
+
+static int boot_trace_sample_all(Manager *m) {
+        const char *k;
+        Iterator i;
+        usec_t ts;
+        Unit *u;
+        int r;
+
+        assert(m);
+
+        ts = now(CLOCK_MONOTONIC);
+
+        HASHMAP_FOREACH_KEY(u, k, m->units, i) {
+                /* Skip aliases */
+                if (u->id != k)
+                        continue;
+
+                if (!unit_want_boot_trace(u))
+                        continue;
+
+                if (m->n_boot_trace >= BOOT_TRACE_SAMPLES_MAX) {
+                        log_notice("Boot trace reached the maximum of %u samples, not sampling any further.", BOOT_TRACE_SAMPLES_MAX);
+                        return -ENOBUFS;
+                }
+
+                r = boot_trace_add_sample(m, u, ts);
+                if (r < 0)
+                        return log_warning_errno(r, "Failed to sample resource use of %s, not sampling any further: %m", u->id);
+        }
+
+        return 0;
+}
+
+static int manager_dispatch_boot_trace(sd_event_source *source, usec_t usec, void *userdata) {
+        Manager *m = userdata;
+        int r;
+
+        assert(source);
+        assert(m);
+
+        r = boot_trace_sample_all(m);
+        if (r < 0)
+                goto fail;
+
+        r = sd_event_source_set_time(source, usec + m->boot_trace_interval_usec);
+        if (r < 0)
+                goto fail;
+
+        r = sd_event_source_set_enabled(source, SD_EVENT_ONESHOT);
+        if (r < 0)
+                goto fail;
+
+        return 0;
+
+fail:
+        m->boot_trace_event_source = sd_event_source_unref(m->boot_trace_event_source);
+        return 0;
+}
+
+int manager_start_boot_trace(Manager *m) {
+        char ts[FORMAT_TIMESPAN_MAX];
+        int r;
+
+        assert(m);
+
+        if (m->boot_trace_interval_usec <= 0 || m->boot_trace_interval_usec == USEC_INFINITY)
+                return 0;
+
+        if (m->boot_trace_event_source)
+                return 0;
+
+        /* Use a precise timer, the default accuracy of 250ms would distort short intervals considerably */
+        r = sd_event_add_time(
+                        m->event,
+                        &m->boot_trace_event_source,
+                        CLOCK_MONOTONIC,
+                        usec_add(now(CLOCK_MONOTONIC), m->boot_trace_interval_usec), 1,
+                        manager_dispatch_boot_trace, m);
+        if (r < 0)
+                return log_warning_errno(r, "Failed to set up boot trace timer, not tracing: %m");
+
+        (void) sd_event_source_set_description(m->boot_trace_event_source, "manager-boot-trace");
+
+        log_debug("Sampling resource use of units every %s until startup finished.",
+                  format_timespan(ts, sizeof(ts), m->boot_trace_interval_usec, 0));
+        return 1;
+}
+
+void manager_stop_boot_trace(Manager *m) {
+        assert(m);
+
+        if (!m->boot_trace_event_source)
+                return;
+
+        /* Take a last sample, so that units still activating when startup finished have an end point too */
+        (void) boot_trace_sample_all(m);
+
+        m->boot_trace_event_source = sd_event_source_unref(m->boot_trace_event_source);
+
+        log_debug("Boot trace finished, %zu samples recorded.", m->n_boot_trace);
+}
+
+void manager_free_boot_trace(Manager *m) {
+        size_t i;
+
+        assert(m);
+
+        m->boot_trace_event_source = sd_event_source_unref(m->boot_trace_event_source);
+
+        for (i = 0; i < m->n_boot_trace; i++)
+                string_pool_unref(m->string_pool, m->boot_trace[i].unit);
+
+        m->boot_trace = mfree(m->boot_trace);
+        m->n_boot_trace = m->n_boot_trace_allocated = 0;
+}
@@ -0,0 +1,29 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+#pragma once
+
+#include "time-util.h"
+
+typedef struct Manager Manager;
+
+/* While starting up, the manager may sample the resource use of the cgroup of each unit in regular intervals, so
+ * that systemd-analyze can tell which units were on-CPU or waiting for I/O, see BootTraceIntervalSec=. The samples
+ * are kept until the manager exits. All counters are (uint64_t) -1 if not available, e.g. because the respective
+ * accounting is turned off for the unit, or the kernel doesn't provide them. */
+
+typedef struct BootTraceSample {
+        const char *unit;               /* Interned in Manager.string_pool, so that it outlives the unit */
+        usec_t timestamp;               /* CLOCK_MONOTONIC */
+        nsec_t cpu_usage_nsec;
+        uint64_t memory_current;
+        uint64_t io_read_bytes;
+        uint64_t io_write_bytes;
+        usec_t cpu_pressure_usec;       /* The "some" totals, i.e. how long tasks were waiting for the resource */
+        usec_t io_pressure_usec;
+} BootTraceSample;
+
+/* Don't let the trace grow without bounds if startup never finishes */
+#define BOOT_TRACE_SAMPLES_MAX (64U*1024U)
+
+int manager_start_boot_trace(Manager *m);
+void manager_stop_boot_trace(Manager *m);
+void manager_free_boot_trace(Manager *m);
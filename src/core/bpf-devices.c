@@ -3,6 +3,7 @@
 
 #include "bpf-devices.h"
 #include "bpf-program.h"
+#include "path-util.h"
 
 #define PASS_JUMP_OFF 4096
 
@@ -202,6 +203,18 @@ int cgroup_apply_device_bpf(Unit *u, BPFProgram *prog, CGroupDevicePolicy policy
         if (r < 0)
                 return log_error_errno(r, "Failed to determine cgroup path: %m");
 
+        /* If the program already in place does the same on the same cgroup, keep it. That way we neither have to
+         * load the new one, nor have both of them attached for a moment. */
+        if (u->bpf_device_control_installed &&
+            path_equal_ptr(u->bpf_device_control_installed->attached_path, path) &&
+            bpf_program_equal(u->bpf_device_control_installed, prog))
+                return 0;
+
+        /* Many units use the same device policy, hence share the kernel object among all that end up with the
+         * same program. */
+        r = bpf_program_load_kernel_shared(prog, &u->manager->bpf_programs);
+        if (r < 0)
+                return log_error_errno(r, "Loading device control BPF program failed: %m");
 
         r = bpf_program_cgroup_attach(prog, BPF_CGROUP_DEVICE, path, BPF_F_ALLOW_MULTI);
         if (r < 0)
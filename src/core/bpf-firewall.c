@@ -19,7 +19,11 @@
 #include "bpf-firewall.h"
 #include "bpf-program.h"
 #include "fd-util.h"
+#include "in-addr-util.h"
 #include "ip-address-access.h"
+#include "path-util.h"
+#include "stdio-util.h"
+#include "string-util.h"
 #include "unit.h"
 
 enum {
@@ -180,11 +184,7 @@ static int bpf_firewall_compile_bpf(
                 u->ip_accounting_ingress_map_fd :
                 u->ip_accounting_egress_map_fd;
 
-        access_enabled =
-                u->ipv4_allow_map_fd >= 0 ||
-                u->ipv6_allow_map_fd >= 0 ||
-                u->ipv4_deny_map_fd >= 0 ||
-                u->ipv6_deny_map_fd >= 0;
+        access_enabled = u->ip_allow_maps || u->ip_deny_maps;
 
         if (accounting_map_fd < 0 && !access_enabled) {
                 *ret = NULL;
@@ -208,26 +208,26 @@ static int bpf_firewall_compile_bpf(
                  * - Otherwise, access will be granted
                  */
 
-                if (u->ipv4_deny_map_fd >= 0) {
-                        r = add_lookup_instructions(p, u->ipv4_deny_map_fd, ETH_P_IP, is_ingress, ACCESS_DENIED);
+                if (u->ip_deny_maps && u->ip_deny_maps->ipv4_map_fd >= 0) {
+                        r = add_lookup_instructions(p, u->ip_deny_maps->ipv4_map_fd, ETH_P_IP, is_ingress, ACCESS_DENIED);
                         if (r < 0)
                                 return r;
                 }
 
-                if (u->ipv6_deny_map_fd >= 0) {
-                        r = add_lookup_instructions(p, u->ipv6_deny_map_fd, ETH_P_IPV6, is_ingress, ACCESS_DENIED);
+                if (u->ip_deny_maps && u->ip_deny_maps->ipv6_map_fd >= 0) {
+                        r = add_lookup_instructions(p, u->ip_deny_maps->ipv6_map_fd, ETH_P_IPV6, is_ingress, ACCESS_DENIED);
                         if (r < 0)
                                 return r;
                 }
 
-                if (u->ipv4_allow_map_fd >= 0) {
-                        r = add_lookup_instructions(p, u->ipv4_allow_map_fd, ETH_P_IP, is_ingress, ACCESS_ALLOWED);
+                if (u->ip_allow_maps && u->ip_allow_maps->ipv4_map_fd >= 0) {
+                        r = add_lookup_instructions(p, u->ip_allow_maps->ipv4_map_fd, ETH_P_IP, is_ingress, ACCESS_ALLOWED);
                         if (r < 0)
                                 return r;
                 }
 
-                if (u->ipv6_allow_map_fd >= 0) {
-                        r = add_lookup_instructions(p, u->ipv6_allow_map_fd, ETH_P_IPV6, is_ingress, ACCESS_ALLOWED);
+                if (u->ip_allow_maps && u->ip_allow_maps->ipv6_map_fd >= 0) {
+                        r = add_lookup_instructions(p, u->ip_allow_maps->ipv6_map_fd, ETH_P_IPV6, is_ingress, ACCESS_ALLOWED);
                         if (r < 0)
                                 return r;
                 }
@@ -368,19 +368,105 @@ static int bpf_firewall_add_access_items(
         return 0;
 }
 
+static BPFAccessMaps *bpf_access_maps_free(BPFAccessMaps *m) {
+        assert(m);
+
+        if (m->cache)
+                (void) hashmap_remove_value(m->cache, m->key, m);
+
+        safe_close(m->ipv4_map_fd);
+        safe_close(m->ipv6_map_fd);
+        free(m->key);
+
+        return mfree(m);
+}
+
+DEFINE_TRIVIAL_REF_UNREF_FUNC(BPFAccessMaps, bpf_access_maps, bpf_access_maps_free);
+
+static int bpf_firewall_access_maps_key(Unit *u, int verdict, char **ret) {
+        _cleanup_free_ char *key = NULL;
+        unsigned n = 0;
+        Unit *p;
+        int r;
+
+        assert(u);
+        assert(ret);
+
+        /* Describes the contents of the maps for one verdict, i.e. the addresses on the list of the unit and all its
+         * slices. Returns the number of addresses. */
+
+        key = strdup(verdict == ACCESS_ALLOWED ? "allow" : "deny");
+        if (!key)
+                return -ENOMEM;
+
+        for (p = u; p; p = UNIT_DEREF(p->slice)) {
+                IPAddressAccessItem *a;
+                CGroupContext *cc;
+
+                cc = unit_get_cgroup_context(p);
+                if (!cc)
+                        continue;
+
+                LIST_FOREACH(items, a, verdict == ACCESS_ALLOWED ? cc->ip_address_allow : cc->ip_address_deny) {
+                        char prefixlen[DECIMAL_STR_MAX(unsigned)];
+                        _cleanup_free_ char *s = NULL;
+
+                        r = in_addr_to_string(a->family, &a->address, &s);
+                        if (r < 0)
+                                return r;
+
+                        xsprintf(prefixlen, "%u", a->prefixlen);
+
+                        if (!strextend(&key, " ", s, "/", prefixlen, NULL))
+                                return -ENOMEM;
+
+                        n++;
+                }
+        }
+
+        *ret = TAKE_PTR(key);
+        return n;
+}
+
 static int bpf_firewall_prepare_access_maps(
                 Unit *u,
                 int verdict,
-                int *ret_ipv4_map_fd,
-                int *ret_ipv6_map_fd) {
+                BPFAccessMaps **ret) {
 
-        _cleanup_close_ int ipv4_map_fd = -1, ipv6_map_fd = -1;
+        _cleanup_(bpf_access_maps_unrefp) BPFAccessMaps *m = NULL;
+        _cleanup_free_ char *key = NULL;
         size_t n_ipv4 = 0, n_ipv6 = 0;
         Unit *p;
         int r;
 
-        assert(ret_ipv4_map_fd);
-        assert(ret_ipv6_map_fd);
+        assert(u);
+        assert(ret);
+
+        r = bpf_firewall_access_maps_key(u, verdict, &key);
+        if (r < 0)
+                return r;
+        if (r == 0) {
+                *ret = NULL;
+                return 0;
+        }
+
+        /* Most units with access lists inherit them from the same slices, or use the same ones anyway, hence share
+         * the maps among all units that end up with the same addresses. */
+        m = bpf_access_maps_ref(hashmap_get(u->manager->bpf_access_maps, key));
+        if (m) {
+                *ret = TAKE_PTR(m);
+                return 0;
+        }
+
+        m = new(BPFAccessMaps, 1);
+        if (!m)
+                return -ENOMEM;
+
+        *m = (BPFAccessMaps) {
+                .n_ref = 1,
+                .ipv4_map_fd = -1,
+                .ipv6_map_fd = -1,
+        };
 
         for (p = u; p; p = UNIT_DEREF(p->slice)) {
                 CGroupContext *cc;
@@ -393,25 +479,25 @@ static int bpf_firewall_prepare_access_maps(
         }
 
         if (n_ipv4 > 0) {
-                ipv4_map_fd = bpf_map_new(
+                m->ipv4_map_fd = bpf_map_new(
                                 BPF_MAP_TYPE_LPM_TRIE,
                                 offsetof(struct bpf_lpm_trie_key, data) + sizeof(uint32_t),
                                 sizeof(uint64_t),
                                 n_ipv4,
                                 BPF_F_NO_PREALLOC);
-                if (ipv4_map_fd < 0)
-                        return ipv4_map_fd;
+                if (m->ipv4_map_fd < 0)
+                        return m->ipv4_map_fd;
         }
 
         if (n_ipv6 > 0) {
-                ipv6_map_fd = bpf_map_new(
+                m->ipv6_map_fd = bpf_map_new(
                                 BPF_MAP_TYPE_LPM_TRIE,
                                 offsetof(struct bpf_lpm_trie_key, data) + sizeof(uint32_t)*4,
                                 sizeof(uint64_t),
                                 n_ipv6,
                                 BPF_F_NO_PREALLOC);
-                if (ipv6_map_fd < 0)
-                        return ipv6_map_fd;
+                if (m->ipv6_map_fd < 0)
+                        return m->ipv6_map_fd;
         }
 
         for (p = u; p; p = UNIT_DEREF(p->slice)) {
@@ -422,15 +508,23 @@ static int bpf_firewall_prepare_access_maps(
                         continue;
 
                 r = bpf_firewall_add_access_items(verdict == ACCESS_ALLOWED ? cc->ip_address_allow : cc->ip_address_deny,
-                                                  ipv4_map_fd, ipv6_map_fd, verdict);
+                                                  m->ipv4_map_fd, m->ipv6_map_fd, verdict);
                 if (r < 0)
                         return r;
         }
 
-        *ret_ipv4_map_fd = ipv4_map_fd;
-        *ret_ipv6_map_fd = ipv6_map_fd;
+        r = hashmap_ensure_allocated(&u->manager->bpf_access_maps, &string_hash_ops);
+        if (r < 0)
+                return r;
+
+        r = hashmap_put(u->manager->bpf_access_maps, key, m);
+        if (r < 0)
+                return r;
 
-        ipv4_map_fd = ipv6_map_fd = -1;
+        m->key = TAKE_PTR(key);
+        m->cache = u->manager->bpf_access_maps;
+
+        *ret = TAKE_PTR(m);
         return 0;
 }
 
@@ -470,8 +564,9 @@ static int bpf_firewall_prepare_accounting_maps(Unit *u, bool enabled, int *fd_i
 }
 
 int bpf_firewall_compile(Unit *u) {
+        _cleanup_(bpf_access_maps_unrefp) BPFAccessMaps *allow = NULL, *deny = NULL;
+        int r, supported, ingress_fd, egress_fd;
         CGroupContext *cc;
-        int r, supported;
 
         assert(u);
 
@@ -496,19 +591,6 @@ int bpf_firewall_compile(Unit *u) {
                 return -EOPNOTSUPP;
         }
 
-        /* Note that when we compile a new firewall we first flush out the access maps and the BPF programs themselves,
-         * but we reuse the the accounting maps. That way the firewall in effect always maps to the actual
-         * configuration, but we don't flush out the accounting unnecessarily */
-
-        u->ip_bpf_ingress = bpf_program_unref(u->ip_bpf_ingress);
-        u->ip_bpf_egress = bpf_program_unref(u->ip_bpf_egress);
-
-        u->ipv4_allow_map_fd = safe_close(u->ipv4_allow_map_fd);
-        u->ipv4_deny_map_fd = safe_close(u->ipv4_deny_map_fd);
-
-        u->ipv6_allow_map_fd = safe_close(u->ipv6_allow_map_fd);
-        u->ipv6_deny_map_fd = safe_close(u->ipv6_deny_map_fd);
-
         if (u->type != UNIT_SLICE) {
                 /* In inner nodes we only do accounting, we do not actually bother with access control. However, leaf
                  * nodes will incorporate all IP access rules set on all their parent nodes. This has the benefit that
@@ -516,30 +598,65 @@ int bpf_firewall_compile(Unit *u) {
                  * means that all configure IP access rules *will* take effect on processes, even though we never
                  * compile them for inner nodes. */
 
-                r = bpf_firewall_prepare_access_maps(u, ACCESS_ALLOWED, &u->ipv4_allow_map_fd, &u->ipv6_allow_map_fd);
+                r = bpf_firewall_prepare_access_maps(u, ACCESS_ALLOWED, &allow);
                 if (r < 0)
                         return log_unit_error_errno(u, r, "Preparation of eBPF allow maps failed: %m");
 
-                r = bpf_firewall_prepare_access_maps(u, ACCESS_DENIED, &u->ipv4_deny_map_fd, &u->ipv6_deny_map_fd);
+                r = bpf_firewall_prepare_access_maps(u, ACCESS_DENIED, &deny);
                 if (r < 0)
                         return log_unit_error_errno(u, r, "Preparation of eBPF deny maps failed: %m");
         }
 
+        /* Note that we reuse the accounting maps, so that we don't flush out the accounting unnecessarily */
+
+        ingress_fd = u->ip_accounting_ingress_map_fd;
+        egress_fd = u->ip_accounting_egress_map_fd;
+
         r = bpf_firewall_prepare_accounting_maps(u, cc->ip_accounting, &u->ip_accounting_ingress_map_fd, &u->ip_accounting_egress_map_fd);
         if (r < 0)
                 return log_unit_error_errno(u, r, "Preparation of eBPF accounting maps failed: %m");
 
+        /* As the access maps are shared by their contents, the configuration didn't change since the last time we
+         * compiled the programs if we got the same maps again. In that case keep the programs, so that they don't
+         * have to be loaded and attached anew. */
+        if (allow == u->ip_allow_maps && deny == u->ip_deny_maps &&
+            ingress_fd == u->ip_accounting_ingress_map_fd && egress_fd == u->ip_accounting_egress_map_fd &&
+            (u->ip_bpf_ingress || (!allow && !deny && ingress_fd < 0)) &&
+            (u->ip_bpf_egress || (!allow && !deny && egress_fd < 0)))
+                return 0;
+
+        /* Otherwise the firewall in effect always maps to the actual configuration */
+
+        u->ip_bpf_ingress = bpf_program_unref(u->ip_bpf_ingress);
+        u->ip_bpf_egress = bpf_program_unref(u->ip_bpf_egress);
+
+        bpf_access_maps_unref(u->ip_allow_maps);
+        u->ip_allow_maps = TAKE_PTR(allow);
+        bpf_access_maps_unref(u->ip_deny_maps);
+        u->ip_deny_maps = TAKE_PTR(deny);
+
         r = bpf_firewall_compile_bpf(u, true, &u->ip_bpf_ingress);
         if (r < 0)
                 return log_unit_error_errno(u, r, "Compilation for ingress BPF program failed: %m");
 
         r = bpf_firewall_compile_bpf(u, false, &u->ip_bpf_egress);
-        if (r < 0)
+        if (r < 0) {
+                u->ip_bpf_ingress = bpf_program_unref(u->ip_bpf_ingress);
                 return log_unit_error_errno(u, r, "Compilation for egress BPF program failed: %m");
+        }
 
         return 0;
 }
 
+static bool bpf_firewall_installed(BPFProgram *installed, BPFProgram *p, const char *path, uint32_t flags) {
+        if (installed != p)
+                return false;
+        if (!p)
+                return true;
+
+        return path_equal_ptr(p->attached_path, path) && p->attached_flags == flags;
+}
+
 int bpf_firewall_install(Unit *u) {
         _cleanup_free_ char *path = NULL;
         CGroupContext *cc;
@@ -575,6 +692,11 @@ int bpf_firewall_install(Unit *u) {
         flags = (supported == BPF_FIREWALL_SUPPORTED_WITH_MULTI &&
                  (u->type == UNIT_SLICE || unit_cgroup_delegate(u))) ? BPF_F_ALLOW_MULTI : 0;
 
+        /* Nothing to do if the programs in place are still the ones compiled last, see bpf_firewall_compile() */
+        if (bpf_firewall_installed(u->ip_bpf_egress_installed, u->ip_bpf_egress, path, flags) &&
+            bpf_firewall_installed(u->ip_bpf_ingress_installed, u->ip_bpf_ingress, path, flags))
+                return 0;
+
         /* Unref the old BPF program (which will implicitly detach it) right before attaching the new program, to
          * minimize the time window when we don't account for IP traffic. */
         u->ip_bpf_egress_installed = bpf_program_unref(u->ip_bpf_egress_installed);
@@ -601,12 +723,28 @@ int bpf_firewall_install(Unit *u) {
 }
 
 int bpf_firewall_read_accounting(int map_fd, uint64_t *ret_bytes, uint64_t *ret_packets) {
-        uint64_t key, packets;
+        uint64_t key, packets, values[2];
+        uint32_t keys[2];
+        size_t n = 2;
         int r;
 
         if (map_fd < 0)
                 return -EBADF;
 
+        /* Both counters are usually needed together, hence try to read them with a single system call first. Older
+         * kernels don't know how to do that, in which case look them up one by one. */
+        r = bpf_map_lookup_batch(map_fd, keys, values, &n);
+        if (r >= 0 && n == 2 && keys[0] == MAP_KEY_PACKETS && keys[1] == MAP_KEY_BYTES) {
+                if (ret_bytes)
+                        *ret_bytes = values[MAP_KEY_BYTES];
+                if (ret_packets)
+                        *ret_packets = values[MAP_KEY_PACKETS];
+
+                return 0;
+        }
+        if (r < 0 && r != -EINVAL)
+                return r;
+
         if (ret_packets) {
                 key = MAP_KEY_PACKETS;
                 r = bpf_map_lookup_element(map_fd, &key, &packets);
@@ -11,6 +11,20 @@ enum {
         BPF_FIREWALL_SUPPORTED_WITH_MULTI = 2,
 };
 
+/* The LPM maps for one list of addresses, i.e. either the allowed or the denied addresses of a unit, including the
+ * ones of its slices. Units with the same lists share them, see bpf_firewall_compile(). */
+struct BPFAccessMaps {
+        unsigned n_ref;
+        Hashmap *cache;
+        char *key;
+        int ipv4_map_fd;
+        int ipv6_map_fd;
+};
+
+BPFAccessMaps *bpf_access_maps_ref(BPFAccessMaps *m);
+BPFAccessMaps *bpf_access_maps_unref(BPFAccessMaps *m);
+DEFINE_TRIVIAL_CLEANUP_FUNC(BPFAccessMaps*, bpf_access_maps_unref);
+
 int bpf_firewall_supported(void);
 
 int bpf_firewall_compile(Unit *u);
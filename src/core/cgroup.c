@@ -11,6 +11,7 @@
 #include "bus-error.h"
 #include "cgroup-util.h"
 #include "cgroup.h"
+#include "extract-word.h"
 #include "fd-util.h"
 #include "fileio.h"
 #include "fs-util.h"
@@ -18,6 +19,7 @@
 #include "path-util.h"
 #include "process-util.h"
 #include "procfs-util.h"
+#include "psi-util.h"
 #include "special.h"
 #include "stat-util.h"
 #include "stdio-util.h"
@@ -61,14 +63,109 @@ bool unit_has_host_root_cgroup(Unit *u) {
         return unit_has_name(u, SPECIAL_ROOT_SLICE);
 }
 
+/* For how long to serve the cgroup statistics queried via the bus from the cache, see unit_get_cgroup_stat() */
+#define CGROUP_STATS_CACHE_USEC (1 * USEC_PER_SEC)
+
+/* Attributes that take one line per device. The kernel keeps them per device, hence so do we in the cache of the
+ * values we wrote. */
+#define CGROUP_KEYED_ATTRIBUTES                 \
+        "io.weight\0"                           \
+        "io.max\0"                              \
+        "io.latency\0"                          \
+        "blkio.weight_device\0"                 \
+        "blkio.throttle.read_bps_device\0"      \
+        "blkio.throttle.write_bps_device\0"
+
+static void unit_forget_cgroup_attribute(Unit *u, const char *key) {
+        char *k = NULL;
+
+        free(hashmap_remove2(u->cgroup_attributes, key, (void**) &k));
+        free(k);
+}
+
+static void unit_remember_cgroup_attribute(Unit *u, char *key, const char *value) {
+        _cleanup_free_ char *k = key, *v = NULL;
+
+        unit_forget_cgroup_attribute(u, k);
+
+        v = strdup(value);
+        if (!v)
+                return;
+
+        if (hashmap_ensure_allocated(&u->cgroup_attributes, &string_hash_ops) < 0)
+                return;
+
+        if (hashmap_put(u->cgroup_attributes, k, v) < 0)
+                return;
+
+        k = v = NULL;
+}
+
+static bool cgroup_attribute_in_mask(const char *key, CGroupMask mask) {
+        CGroupController c;
+
+        for (c = 0; c < _CGROUP_CONTROLLER_MAX; c++) {
+                const char *p;
+
+                if (!(mask & CGROUP_CONTROLLER_TO_MASK(c)))
+                        continue;
+
+                p = startswith(key, cgroup_controller_to_string(c));
+                if (p && *p == '.')
+                        return true;
+        }
+
+        return false;
+}
+
+static void unit_flush_cgroup_attributes(Unit *u, CGroupMask mask) {
+        Iterator i;
+        char *k, *v;
+
+        assert(u);
+
+        /* Forgets the values we wrote to the attributes of the specified controllers, for example because the cgroup
+         * was created anew or the controllers were turned off in the meantime, and hence the kernel reset them. */
+
+        if (mask == 0)
+                return;
+
+        HASHMAP_FOREACH_KEY(v, k, u->cgroup_attributes, i) {
+                if (!cgroup_attribute_in_mask(k, mask))
+                        continue;
+
+                (void) hashmap_remove(u->cgroup_attributes, k);
+                free(k);
+                free(v);
+        }
+}
+
 static int set_attribute_and_warn(Unit *u, const char *controller, const char *attribute, const char *value) {
+        _cleanup_free_ char *key = NULL;
         int r;
 
+        /* We apply all attributes of a controller whenever any of them changes, and those of all members of a slice
+         * whenever their masks change. Skip writing values the attribute already has, as far as we know. */
+        if (nulstr_contains(CGROUP_KEYED_ATTRIBUTES, attribute))
+                key = strjoin(attribute, " ", strndupa(value, strcspn(value, WHITESPACE)));
+        else
+                key = strdup(attribute);
+        if (key && streq_ptr(hashmap_get(u->cgroup_attributes, key), value))
+                return 0;
+
         r = cg_set_attribute(controller, u->cgroup_path, attribute, value);
-        if (r < 0)
+        if (r < 0) {
                 log_unit_full(u, LOG_LEVEL_CGROUP_WRITE(r), r, "Failed to set '%s' attribute on '%s' to '%.*s': %m",
                               strna(attribute), isempty(u->cgroup_path) ? "/" : u->cgroup_path, (int) strcspn(value, NEWLINE), value);
 
+                if (key)
+                        unit_forget_cgroup_attribute(u, key);
+                return r;
+        }
+
+        if (key)
+                unit_remember_cgroup_attribute(u, TAKE_PTR(key), value);
+
         return r;
 }
 
@@ -1367,7 +1464,7 @@ CGroupMask unit_get_members_mask(Unit *u) {
                 Unit *member;
                 Iterator i;
 
-                HASHMAP_FOREACH_KEY(v, member, u->dependencies[UNIT_BEFORE], i) {
+                DEPENDENCY_SET_FOREACH(v, member, u->dependencies[UNIT_BEFORE], i) {
 
                         if (member == u)
                                 continue;
@@ -1618,6 +1715,13 @@ static int unit_create_cgroup(
                 return log_unit_error_errno(u, r, "Failed to create cgroup %s: %m", u->cgroup_path);
         created = r;
 
+        /* The attributes of a new cgroup, and of controllers it didn't have before, start out with the kernel's
+         * defaults */
+        if (created || !u->cgroup_realized)
+                unit_flush_cgroup_attributes(u, _CGROUP_MASK_ALL);
+        else
+                unit_flush_cgroup_attributes(u, target_mask & ~u->cgroup_realized_mask);
+
         /* Start watching it */
         (void) unit_watch_cgroup(u);
 
@@ -1956,7 +2060,7 @@ static void unit_add_siblings_to_cgroup_realize_queue(Unit *u) {
                 Unit *m;
                 void *v;
 
-                HASHMAP_FOREACH_KEY(v, m, u->dependencies[UNIT_BEFORE], i) {
+                DEPENDENCY_SET_FOREACH(v, m, u->dependencies[UNIT_BEFORE], i) {
                         if (m == u)
                                 continue;
 
@@ -2027,6 +2131,9 @@ void unit_release_cgroup(Unit *u) {
                 (void) hashmap_remove(u->manager->cgroup_inotify_wd_unit, INT_TO_PTR(u->cgroup_inotify_wd));
                 u->cgroup_inotify_wd = -1;
         }
+
+        u->cgroup_attributes = hashmap_free_free_free(u->cgroup_attributes);
+        zero(u->cgroup_stats_timestamp);
 }
 
 void unit_prune_cgroup(Unit *u) {
@@ -2060,6 +2167,14 @@ void unit_prune_cgroup(Unit *u) {
         u->cgroup_enabled_mask = 0;
 
         u->bpf_device_control_installed = bpf_program_unref(u->bpf_device_control_installed);
+
+        /* The firewall programs went away with the cgroup, too. Also drop the compiled ones, as they still remember
+         * the cgroup they were attached to, so that they are compiled and attached anew if the unit is started
+         * again, and its cgroup is created again at the same path. */
+        u->ip_bpf_ingress_installed = bpf_program_unref(u->ip_bpf_ingress_installed);
+        u->ip_bpf_egress_installed = bpf_program_unref(u->ip_bpf_egress_installed);
+        u->ip_bpf_ingress = bpf_program_unref(u->ip_bpf_ingress);
+        u->ip_bpf_egress = bpf_program_unref(u->ip_bpf_egress);
 }
 
 int unit_search_main_pid(Unit *u, pid_t *ret) {
@@ -2104,28 +2219,23 @@ int unit_search_main_pid(Unit *u, pid_t *ret) {
 
 static int unit_watch_pids_in_path(Unit *u, const char *path) {
         _cleanup_closedir_ DIR *d = NULL;
-        _cleanup_fclose_ FILE *f = NULL;
+        _cleanup_free_ pid_t *pids = NULL;
         int ret = 0, r;
+        size_t n, i;
 
         assert(u);
         assert(path);
 
-        r = cg_enumerate_processes(SYSTEMD_CGROUP_CONTROLLER, path, &f);
+        r = cg_read_pids(SYSTEMD_CGROUP_CONTROLLER, path, &pids, &n);
         if (r < 0)
                 ret = r;
-        else {
-                pid_t pid;
-
-                while ((r = cg_read_pid(f, &pid)) > 0) {
-                        r = unit_watch_pid(u, pid);
+        else
+                for (i = 0; i < n; i++) {
+                        r = unit_watch_pid(u, pids[i]);
                         if (r < 0 && ret >= 0)
                                 ret = r;
                 }
 
-                if (r < 0 && ret >= 0)
-                        ret = r;
-        }
-
         r = cg_enumerate_subgroups(SYSTEMD_CGROUP_CONTROLLER, path, &d);
         if (r < 0) {
                 if (ret >= 0)
@@ -2603,7 +2713,6 @@ int manager_notify_cgroup_empty(Manager *m, const char *cgroup) {
 }
 
 int unit_get_memory_current(Unit *u, uint64_t *ret) {
-        _cleanup_free_ char *v = NULL;
         int r;
 
         assert(u);
@@ -2626,19 +2735,16 @@ int unit_get_memory_current(Unit *u, uint64_t *ret) {
         if (r < 0)
                 return r;
         if (r > 0)
-                r = cg_get_attribute("memory", u->cgroup_path, "memory.current", &v);
+                r = cg_get_attribute_as_uint64("memory", u->cgroup_path, "memory.current", ret);
         else
-                r = cg_get_attribute("memory", u->cgroup_path, "memory.usage_in_bytes", &v);
+                r = cg_get_attribute_as_uint64("memory", u->cgroup_path, "memory.usage_in_bytes", ret);
         if (r == -ENOENT)
                 return -ENODATA;
-        if (r < 0)
-                return r;
 
-        return safe_atou64(v, ret);
+        return r;
 }
 
 int unit_get_tasks_current(Unit *u, uint64_t *ret) {
-        _cleanup_free_ char *v = NULL;
         int r;
 
         assert(u);
@@ -2657,17 +2763,14 @@ int unit_get_tasks_current(Unit *u, uint64_t *ret) {
         if ((u->cgroup_realized_mask & CGROUP_MASK_PIDS) == 0)
                 return -ENODATA;
 
-        r = cg_get_attribute("pids", u->cgroup_path, "pids.current", &v);
+        r = cg_get_attribute_as_uint64("pids", u->cgroup_path, "pids.current", ret);
         if (r == -ENOENT)
                 return -ENODATA;
-        if (r < 0)
-                return r;
 
-        return safe_atou64(v, ret);
+        return r;
 }
 
 static int unit_get_cpu_usage_raw(Unit *u, nsec_t *ret) {
-        _cleanup_free_ char *v = NULL;
         uint64_t ns;
         int r;
 
@@ -2705,15 +2808,11 @@ static int unit_get_cpu_usage_raw(Unit *u, nsec_t *ret) {
 
                 ns = us * NSEC_PER_USEC;
         } else {
-                r = cg_get_attribute("cpuacct", u->cgroup_path, "cpuacct.usage", &v);
+                r = cg_get_attribute_as_uint64("cpuacct", u->cgroup_path, "cpuacct.usage", &ns);
                 if (r == -ENOENT)
                         return -ENODATA;
                 if (r < 0)
                         return r;
-
-                r = safe_atou64(v, &ns);
-                if (r < 0)
-                        return r;
         }
 
         *ret = ns;
@@ -2795,6 +2894,178 @@ int unit_get_ip_accounting(
         return r;
 }
 
+int unit_get_pressure(Unit *u, const char *resource, usec_t ret[static _PRESSURE_TYPE_MAX]) {
+        _cleanup_free_ char *path = NULL;
+        int r;
+
+        assert(u);
+        assert(resource);
+
+        if (!u->cgroup_path)
+                return -ENODATA;
+
+        /* The root cgroup doesn't expose this information, let's get it from /proc instead */
+        if (unit_has_host_root_cgroup(u)) {
+                path = strjoin("/proc/pressure/", resource);
+                if (!path)
+                        return -ENOMEM;
+        } else {
+                const char *attribute;
+
+                /* Pressure stall information is only available on the unified hierarchy */
+                r = cg_all_unified();
+                if (r < 0)
+                        return r;
+                if (r == 0)
+                        return -ENODATA;
+
+                attribute = strjoina(resource, ".pressure");
+                r = cg_get_path(SYSTEMD_CGROUP_CONTROLLER, u->cgroup_path, attribute, &path);
+                if (r < 0)
+                        return r;
+        }
+
+        r = read_pressure_totals(path, ret);
+        if (IN_SET(r, -ENOENT, -EOPNOTSUPP)) /* Kernel without CONFIG_PSI, or it is turned off */
+                return -ENODATA;
+
+        return r;
+}
+
+int unit_get_io_bytes(Unit *u, uint64_t *ret_read, uint64_t *ret_write) {
+        _cleanup_free_ char *contents = NULL;
+        uint64_t rbytes = 0, wbytes = 0;
+        const char *p;
+        int r;
+
+        assert(u);
+        assert(ret_read);
+        assert(ret_write);
+
+        /* Returns the number of bytes read and written by the unit's processes, summed up over all devices. Only
+         * available on the unified hierarchy, where io.stat has lines like "8:0 rbytes=… wbytes=… rios=…". */
+
+        if (!u->cgroup_path)
+                return -ENODATA;
+
+        if ((u->cgroup_realized_mask & CGROUP_MASK_IO) == 0)
+                return -ENODATA;
+
+        r = cg_all_unified();
+        if (r < 0)
+                return r;
+        if (r == 0)
+                return -ENODATA;
+
+        r = cg_get_attribute("io", u->cgroup_path, "io.stat", &contents);
+        if (r == -ENOENT)
+                return -ENODATA;
+        if (r < 0)
+                return r;
+
+        for (p = contents;;) {
+                _cleanup_free_ char *word = NULL;
+                uint64_t v;
+                const char *e;
+
+                r = extract_first_word(&p, &word, NULL, 0);
+                if (r < 0)
+                        return r;
+                if (r == 0)
+                        break;
+
+                if ((e = startswith(word, "rbytes="))) {
+                        r = safe_atou64(e, &v);
+                        if (r < 0)
+                                return r;
+                        rbytes += v;
+                } else if ((e = startswith(word, "wbytes="))) {
+                        r = safe_atou64(e, &v);
+                        if (r < 0)
+                                return r;
+                        wbytes += v;
+                }
+        }
+
+        *ret_read = rbytes;
+        *ret_write = wbytes;
+        return 0;
+}
+
+int unit_get_cgroup_stat(Unit *u, CGroupStat stat, uint64_t *ret) {
+        static const char *const pressure_resource[] = { "cpu", "io", "memory" };
+        usec_t n;
+        int r;
+
+        assert(u);
+        assert(stat >= 0);
+        assert(stat < _CGROUP_STAT_MAX);
+        assert(ret);
+
+        /* Monitoring tools tend to query these for all units, and repeatedly. Let's not read the cgroup attributes
+         * every single time, but serve them from a cache for up to CGROUP_STATS_CACHE_USEC. Only successful reads
+         * are cached, everything else is cheap to determine again. */
+
+        n = now(CLOCK_MONOTONIC);
+        if (u->cgroup_stats_timestamp[stat] > 0 &&
+            n < usec_add(u->cgroup_stats_timestamp[stat], CGROUP_STATS_CACHE_USEC)) {
+
+                if (u->cgroup_stats[stat] == (uint64_t) -1) /* The kernel doesn't know this particular one */
+                        return -ENODATA;
+
+                *ret = u->cgroup_stats[stat];
+                return 0;
+        }
+
+        switch (stat) {
+
+        case CGROUP_STAT_MEMORY_CURRENT:
+                r = unit_get_memory_current(u, u->cgroup_stats + stat);
+                break;
+
+        case CGROUP_STAT_TASKS_CURRENT:
+                r = unit_get_tasks_current(u, u->cgroup_stats + stat);
+                break;
+
+        case CGROUP_STAT_CPU_USAGE:
+                r = unit_get_cpu_usage(u, u->cgroup_stats + stat);
+                break;
+
+        default: {
+                usec_t totals[_PRESSURE_TYPE_MAX];
+                CGroupStat some;
+                unsigned k;
+
+                /* The pressure statistics come in pairs of "some" and "full" per resource. Both are read from the
+                 * same file, hence cache both. */
+                assert_cc(CGROUP_STAT_CPU_PRESSURE_SOME + ELEMENTSOF(pressure_resource) * _PRESSURE_TYPE_MAX == _CGROUP_STAT_MAX);
+                assert(stat >= CGROUP_STAT_CPU_PRESSURE_SOME);
+
+                k = (stat - CGROUP_STAT_CPU_PRESSURE_SOME) / _PRESSURE_TYPE_MAX;
+                some = CGROUP_STAT_CPU_PRESSURE_SOME + k * _PRESSURE_TYPE_MAX;
+
+                r = unit_get_pressure(u, pressure_resource[k], totals);
+                if (r < 0)
+                        return r;
+
+                u->cgroup_stats[some + PRESSURE_TYPE_SOME] = totals[PRESSURE_TYPE_SOME];
+                u->cgroup_stats[some + PRESSURE_TYPE_FULL] = totals[PRESSURE_TYPE_FULL];
+                u->cgroup_stats_timestamp[some + PRESSURE_TYPE_SOME] = u->cgroup_stats_timestamp[some + PRESSURE_TYPE_FULL] = n;
+
+                if (u->cgroup_stats[stat] == (uint64_t) -1)
+                        return -ENODATA;
+
+                *ret = u->cgroup_stats[stat];
+                return 0;
+        }}
+        if (r < 0)
+                return r;
+
+        u->cgroup_stats_timestamp[stat] = n;
+        *ret = u->cgroup_stats[stat];
+        return 0;
+}
+
 int unit_reset_cpu_accounting(Unit *u) {
         nsec_t ns;
         int r;
@@ -2802,6 +3073,7 @@ int unit_reset_cpu_accounting(Unit *u) {
         assert(u);
 
         u->cpu_usage_last = NSEC_INFINITY;
+        u->cgroup_stats_timestamp[CGROUP_STAT_CPU_USAGE] = 0;
 
         r = unit_get_cpu_usage_raw(u, &ns);
         if (r < 0) {
@@ -2871,7 +3143,7 @@ void unit_invalidate_cgroup_bpf(Unit *u) {
                 Iterator i;
                 void *v;
 
-                HASHMAP_FOREACH_KEY(v, member, u->dependencies[UNIT_BEFORE], i) {
+                DEPENDENCY_SET_FOREACH(v, member, u->dependencies[UNIT_BEFORE], i) {
                         if (member == u)
                                 continue;
 
@@ -6,6 +6,7 @@
 #include "cgroup-util.h"
 #include "ip-address-access.h"
 #include "list.h"
+#include "psi-util.h"
 #include "time-util.h"
 
 typedef struct CGroupContext CGroupContext;
@@ -130,6 +131,21 @@ typedef enum CGroupIPAccountingMetric {
         _CGROUP_IP_ACCOUNTING_METRIC_INVALID = -1,
 } CGroupIPAccountingMetric;
 
+/* Statistics of the cgroup, which are cached for a short while when queried via the bus */
+typedef enum CGroupStat {
+        CGROUP_STAT_MEMORY_CURRENT,
+        CGROUP_STAT_TASKS_CURRENT,
+        CGROUP_STAT_CPU_USAGE,
+        CGROUP_STAT_CPU_PRESSURE_SOME,
+        CGROUP_STAT_CPU_PRESSURE_FULL,
+        CGROUP_STAT_IO_PRESSURE_SOME,
+        CGROUP_STAT_IO_PRESSURE_FULL,
+        CGROUP_STAT_MEMORY_PRESSURE_SOME,
+        CGROUP_STAT_MEMORY_PRESSURE_FULL,
+        _CGROUP_STAT_MAX,
+        _CGROUP_STAT_INVALID = -1,
+} CGroupStat;
+
 typedef struct Unit Unit;
 typedef struct Manager Manager;
 
@@ -190,6 +206,9 @@ int unit_get_memory_current(Unit *u, uint64_t *ret);
 int unit_get_tasks_current(Unit *u, uint64_t *ret);
 int unit_get_cpu_usage(Unit *u, nsec_t *ret);
 int unit_get_ip_accounting(Unit *u, CGroupIPAccountingMetric metric, uint64_t *ret);
+int unit_get_io_bytes(Unit *u, uint64_t *ret_read, uint64_t *ret_write);
+int unit_get_pressure(Unit *u, const char *resource, usec_t ret[static _PRESSURE_TYPE_MAX]);
+int unit_get_cgroup_stat(Unit *u, CGroupStat stat, uint64_t *ret);
 
 int unit_reset_cpu_accounting(Unit *u);
 int unit_reset_ip_accounting(Unit *u);
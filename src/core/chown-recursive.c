@@ -10,9 +10,42 @@
 #include "fd-util.h"
 #include "macro.h"
 #include "stdio-util.h"
+#include "string-util.h"
 #include "strv.h"
 #include "user-util.h"
 
+/* Set on the top-level directory once the whole tree has been chowned, and contains "UID:GID". It lives in the
+ * trusted.* namespace so that the (unprivileged) owner of the tree cannot forge it. */
+#define CHOWN_MARKER_XATTR "trusted.systemd.chown"
+#define CHOWN_MARKER_MAX (DECIMAL_STR_MAX(uid_t) + 1 + DECIMAL_STR_MAX(gid_t))
+
+static bool stat_owned_by(const struct stat *st, uid_t uid, gid_t gid) {
+        assert(st);
+
+        return (!uid_is_valid(uid) || st->st_uid == uid) &&
+               (!gid_is_valid(gid) || st->st_gid == gid);
+}
+
+static int chown_marker_matches(int fd, const char *marker) {
+        char buf[CHOWN_MARKER_MAX];
+        ssize_t l;
+
+        assert(fd >= 0);
+        assert(marker);
+
+        l = fgetxattr(fd, CHOWN_MARKER_XATTR, buf, sizeof(buf));
+        if (l < 0) {
+                if (IN_SET(errno, ENODATA, ERANGE))
+                        return false;
+                if (IN_SET(errno, EOPNOTSUPP, ENOSYS, ENOTTY))
+                        return -EOPNOTSUPP;
+
+                return -errno;
+        }
+
+        return (size_t) l == strlen(marker) && memcmp(buf, marker, l) == 0;
+}
+
 static int chown_one(int fd, const struct stat *st, uid_t uid, gid_t gid) {
         char procfs_path[STRLEN("/proc/self/fd/") + DECIMAL_STR_MAX(int) + 1];
         const char *n;
@@ -20,8 +53,7 @@ static int chown_one(int fd, const struct stat *st, uid_t uid, gid_t gid) {
         assert(fd >= 0);
         assert(st);
 
-        if ((!uid_is_valid(uid) || st->st_uid == uid) &&
-            (!gid_is_valid(gid) || st->st_gid == gid))
+        if (stat_owned_by(st, uid, gid))
                 return 0;
 
         /* We change ownership through the /proc/self/fd/%i path, so that we have a stable reference that works with
@@ -70,6 +102,14 @@ static int chown_recursive_internal(int fd, const struct stat *st, uid_t uid, gi
                 if (dot_or_dot_dot(de->d_name))
                         continue;
 
+                /* Most entries usually need no change, hence check them with a single system call first, and only
+                 * open what we need to descend into or fix. */
+                if (fstatat(dirfd(d), de->d_name, &fst, AT_SYMLINK_NOFOLLOW) < 0)
+                        return -errno;
+
+                if (!S_ISDIR(fst.st_mode) && stat_owned_by(&fst, uid, gid))
+                        continue;
+
                 /* Let's pin the child inode we want to fix now with an O_PATH fd, so that it cannot be swapped out
                  * while we manipulate it. */
                 path_fd = openat(dirfd(d), de->d_name, O_PATH|O_CLOEXEC|O_NOFOLLOW);
@@ -109,8 +149,10 @@ static int chown_recursive_internal(int fd, const struct stat *st, uid_t uid, gi
 }
 
 int path_chown_recursive(const char *path, uid_t uid, gid_t gid) {
-        _cleanup_close_ int fd = -1;
+        _cleanup_close_ int fd = -1, dir_fd = -1;
+        char marker[CHOWN_MARKER_MAX];
         struct stat st;
+        int r, q;
 
         fd = open(path, O_RDONLY|O_DIRECTORY|O_CLOEXEC|O_NOFOLLOW|O_NOATIME);
         if (fd < 0)
@@ -122,12 +164,34 @@ int path_chown_recursive(const char *path, uid_t uid, gid_t gid) {
         if (fstat(fd, &st) < 0)
                 return -errno;
 
-        /* Let's take a shortcut: if the top-level directory is properly owned, we don't descend into the whole tree,
-         * under the assumption that all is OK anyway. */
+        /* Let's take a shortcut: if the top-level directory is properly owned, and the marker says that we previously
+         * chowned the whole tree to the same owner, we don't descend into it. On file systems without extended
+         * attributes we have to assume that all is OK anyway if the top-level directory is properly owned. */
+
+        xsprintf(marker, UID_FMT ":" GID_FMT, uid, gid);
 
-        if ((!uid_is_valid(uid) || st.st_uid == uid) &&
-            (!gid_is_valid(gid) || st.st_gid == gid))
+        q = chown_marker_matches(fd, marker);
+        if (q == -EOPNOTSUPP) {
+                if (stat_owned_by(&st, uid, gid))
+                        return 0;
+        } else if (q < 0)
+                return q;
+        else if (q > 0 && stat_owned_by(&st, uid, gid))
                 return 0;
+        else if (fremovexattr(fd, CHOWN_MARKER_XATTR) < 0 && errno != ENODATA)
+                /* Make sure an interrupted run is never mistaken for a complete one */
+                return -errno;
+
+        dir_fd = fcntl(fd, F_DUPFD_CLOEXEC, 3);
+        if (dir_fd < 0)
+                return -errno;
+
+        r = chown_recursive_internal(TAKE_FD(dir_fd), &st, uid, gid); /* we donate the fd to the call, regardless if it succeeded or failed */
+        if (r < 0)
+                return r;
+
+        if (q != -EOPNOTSUPP)
+                (void) fsetxattr(fd, CHOWN_MARKER_XATTR, marker, strlen(marker), 0);
 
-        return chown_recursive_internal(TAKE_FD(fd), &st, uid, gid); /* we donate the fd to the call, regardless if it succeeded or failed */
+        return r;
 }
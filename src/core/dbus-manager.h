@@ -5,6 +5,11 @@
 
 #include "manager.h"
 
+typedef enum SubscribeFlags {
+        SUBSCRIBE_SETTLED = 1 << 0, /* Only send unit change signals once the unit reached a settled state */
+        _SUBSCRIBE_FLAGS_ALL = SUBSCRIBE_SETTLED,
+} SubscribeFlags;
+
 extern const sd_bus_vtable bus_manager_vtable[];
 
 void bus_manager_send_finished(Manager *m, usec_t firmware_usec, usec_t loader_usec, usec_t kernel_usec, usec_t initrd_usec, usec_t userspace_usec, usec_t total_usec);
@@ -47,6 +47,7 @@ const sd_bus_vtable bus_path_vtable[] = {
         SD_BUS_PROPERTY("Unit", "s", bus_property_get_triggered_unit, 0, SD_BUS_VTABLE_PROPERTY_CONST),
         SD_BUS_PROPERTY("Paths", "a(ss)", property_get_paths, 0, SD_BUS_VTABLE_PROPERTY_CONST),
         SD_BUS_PROPERTY("MakeDirectory", "b", bus_property_get_bool, offsetof(Path, make_directory), SD_BUS_VTABLE_PROPERTY_CONST),
+        SD_BUS_PROPERTY("WatchSubtree", "b", bus_property_get_bool, offsetof(Path, watch_subtree), SD_BUS_VTABLE_PROPERTY_CONST),
         SD_BUS_PROPERTY("DirectoryMode", "u", bus_property_get_mode, offsetof(Path, directory_mode), SD_BUS_VTABLE_PROPERTY_CONST),
         SD_BUS_PROPERTY("Result", "s", property_get_result, offsetof(Path, result), SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE),
         SD_BUS_VTABLE_END
@@ -71,6 +72,9 @@ static int bus_path_set_transient_property(
         if (streq(name, "MakeDirectory"))
                 return bus_set_transient_bool(u, name, &p->make_directory, message, flags, error);
 
+        if (streq(name, "WatchSubtree"))
+                return bus_set_transient_bool(u, name, &p->watch_subtree, message, flags, error);
+
         if (streq(name, "DirectoryMode"))
                 return bus_set_transient_mode_t(u, name, &p->directory_mode, message, flags, error);
 
@@ -113,6 +117,7 @@ static int bus_path_set_transient_property(
                                 s->path = TAKE_PTR(k);
                                 s->type = t;
                                 s->inotify_fd = -1;
+                                s->subtree_fd = -1;
 
                                 LIST_PREPEND(spec, p->specs, s);
 
@@ -1,5 +1,6 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 
+#include "bus-util.h"
 #include "dbus-cgroup.h"
 #include "dbus-slice.h"
 #include "slice.h"
@@ -7,6 +8,7 @@
 
 const sd_bus_vtable bus_slice_vtable[] = {
         SD_BUS_VTABLE_START(0),
+        SD_BUS_PROPERTY("StartConcurrency", "u", bus_property_get_unsigned, offsetof(Slice, start_concurrency), SD_BUS_VTABLE_PROPERTY_CONST),
         SD_BUS_VTABLE_END
 };
 
@@ -109,10 +109,14 @@ const sd_bus_vtable bus_socket_vtable[] = {
         SD_BUS_PROPERTY("Mark", "i", bus_property_get_int, offsetof(Socket, mark), SD_BUS_VTABLE_PROPERTY_CONST),
         SD_BUS_PROPERTY("MaxConnections", "u", bus_property_get_unsigned, offsetof(Socket, max_connections), SD_BUS_VTABLE_PROPERTY_CONST),
         SD_BUS_PROPERTY("MaxConnectionsPerSource", "u", bus_property_get_unsigned, offsetof(Socket, max_connections_per_source), SD_BUS_VTABLE_PROPERTY_CONST),
+        SD_BUS_PROPERTY("AcceptPoolSize", "u", bus_property_get_unsigned, offsetof(Socket, accept_pool_size), SD_BUS_VTABLE_PROPERTY_CONST),
+        SD_BUS_PROPERTY("AcceptPoolIdleUSec", "t", bus_property_get_usec, offsetof(Socket, accept_pool_idle_usec), SD_BUS_VTABLE_PROPERTY_CONST),
         SD_BUS_PROPERTY("MessageQueueMaxMessages", "x", bus_property_get_long, offsetof(Socket, mq_maxmsg), SD_BUS_VTABLE_PROPERTY_CONST),
         SD_BUS_PROPERTY("MessageQueueMessageSize", "x", bus_property_get_long, offsetof(Socket, mq_msgsize), SD_BUS_VTABLE_PROPERTY_CONST),
         SD_BUS_PROPERTY("TCPCongestion", "s", NULL, offsetof(Socket, tcp_congestion), SD_BUS_VTABLE_PROPERTY_CONST),
         SD_BUS_PROPERTY("ReusePort", "b",  bus_property_get_bool, offsetof(Socket, reuse_port), SD_BUS_VTABLE_PROPERTY_CONST),
+        SD_BUS_PROPERTY("ReusePortInstances", "u", bus_property_get_unsigned, offsetof(Socket, reuse_port_instances), SD_BUS_VTABLE_PROPERTY_CONST),
+        SD_BUS_PROPERTY("ReusePortCPUSteering", "b", bus_property_get_bool, offsetof(Socket, reuse_port_cpu_steering), SD_BUS_VTABLE_PROPERTY_CONST),
         SD_BUS_PROPERTY("SmackLabel", "s", NULL, offsetof(Socket, smack), SD_BUS_VTABLE_PROPERTY_CONST),
         SD_BUS_PROPERTY("SmackLabelIPIn", "s", NULL, offsetof(Socket, smack_ip_in), SD_BUS_VTABLE_PROPERTY_CONST),
         SD_BUS_PROPERTY("SmackLabelIPOut", "s", NULL, offsetof(Socket, smack_ip_out), SD_BUS_VTABLE_PROPERTY_CONST),
@@ -204,6 +208,12 @@ static int bus_socket_set_transient_property(
         if (streq(name, "ReusePort"))
                 return bus_set_transient_bool(u, name, &s->reuse_port, message, flags, error);
 
+        if (streq(name, "ReusePortCPUSteering"))
+                return bus_set_transient_bool(u, name, &s->reuse_port_cpu_steering, message, flags, error);
+
+        if (streq(name, "ReusePortInstances"))
+                return bus_set_transient_unsigned(u, name, &s->reuse_port_instances, message, flags, error);
+
         if (streq(name, "RemoveOnStop"))
                 return bus_set_transient_bool(u, name, &s->remove_on_stop, message, flags, error);
 
@@ -228,6 +238,9 @@ static int bus_socket_set_transient_property(
         if (streq(name, "MaxConnectionsPerSource"))
                 return bus_set_transient_unsigned(u, name, &s->max_connections_per_source, message, flags, error);
 
+        if (streq(name, "AcceptPoolSize"))
+                return bus_set_transient_unsigned(u, name, &s->accept_pool_size, message, flags, error);
+
         if (streq(name, "KeepAliveProbes"))
                 return bus_set_transient_unsigned(u, name, &s->keep_alive_cnt, message, flags, error);
 
@@ -258,6 +271,9 @@ static int bus_socket_set_transient_property(
         if (streq(name, "DeferAcceptUSec"))
                 return bus_set_transient_usec(u, name, &s->defer_accept, message, flags, error);
 
+        if (streq(name, "AcceptPoolIdleUSec"))
+                return bus_set_transient_usec(u, name, &s->accept_pool_idle_usec, message, flags, error);
+
         if (streq(name, "TriggerLimitIntervalUSec"))
                 return bus_set_transient_usec(u, name, &s->trigger_limit.interval, message, flags, error);
 
@@ -110,7 +110,7 @@ static int property_get_dependencies(
                 void *userdata,
                 sd_bus_error *error) {
 
-        Hashmap **h = userdata;
+        DependencySet **h = userdata;
         Iterator j;
         Unit *u;
         void *v;
@@ -124,7 +124,7 @@ static int property_get_dependencies(
         if (r < 0)
                 return r;
 
-        HASHMAP_FOREACH_KEY(v, u, *h, j) {
+        DEPENDENCY_SET_FOREACH(v, u, *h, j) {
                 r = sd_bus_message_append(reply, "s", u->id);
                 if (r < 0)
                         return r;
@@ -479,6 +479,35 @@ int bus_unit_method_reset_failed(sd_bus_message *message, void *userdata, sd_bus
         return sd_bus_reply_method_return(message, NULL);
 }
 
+int bus_unit_method_reset_latency(sd_bus_message *message, void *userdata, sd_bus_error *error) {
+        Unit *u = userdata;
+        int r;
+
+        assert(message);
+        assert(u);
+
+        r = mac_selinux_unit_access_check(u, message, "reload", error);
+        if (r < 0)
+                return r;
+
+        r = bus_verify_manage_units_async_full(
+                        u,
+                        "reset-latency",
+                        CAP_SYS_ADMIN,
+                        N_("Authentication is required to reset the latency statistics of '$(unit)'."),
+                        true,
+                        message,
+                        error);
+        if (r < 0)
+                return r;
+        if (r == 0)
+                return 1; /* No authorization for now, but the async polkit stuff will call us again when it has it */
+
+        unit_reset_latency(u);
+
+        return sd_bus_reply_method_return(message, NULL);
+}
+
 int bus_unit_method_set_properties(sd_bus_message *message, void *userdata, sd_bus_error *error) {
         Unit *u = userdata;
         int runtime, r;
@@ -656,6 +685,7 @@ const sd_bus_vtable bus_unit_vtable[] = {
         SD_BUS_PROPERTY("NeedDaemonReload", "b", property_get_need_daemon_reload, 0, SD_BUS_VTABLE_PROPERTY_CONST),
         SD_BUS_PROPERTY("JobTimeoutUSec", "t", bus_property_get_usec, offsetof(Unit, job_timeout), SD_BUS_VTABLE_PROPERTY_CONST),
         SD_BUS_PROPERTY("JobRunningTimeoutUSec", "t", bus_property_get_usec, offsetof(Unit, job_running_timeout), SD_BUS_VTABLE_PROPERTY_CONST),
+        SD_BUS_PROPERTY("StartPriority", "i", bus_property_get_int, offsetof(Unit, start_priority), SD_BUS_VTABLE_PROPERTY_CONST),
         SD_BUS_PROPERTY("JobTimeoutAction", "s", property_get_emergency_action, offsetof(Unit, job_timeout_action), SD_BUS_VTABLE_PROPERTY_CONST),
         SD_BUS_PROPERTY("JobTimeoutRebootArgument", "s", NULL, offsetof(Unit, job_timeout_reboot_arg), SD_BUS_VTABLE_PROPERTY_CONST),
         SD_BUS_PROPERTY("ConditionResult", "b", bus_property_get_bool, offsetof(Unit, condition_result), SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE),
@@ -678,6 +708,9 @@ const sd_bus_vtable bus_unit_vtable[] = {
         SD_BUS_PROPERTY("InvocationID", "ay", bus_property_get_id128, offsetof(Unit, invocation_id), 0),
         SD_BUS_PROPERTY("CollectMode", "s", property_get_collect_mode, offsetof(Unit, collect_mode), 0),
         SD_BUS_PROPERTY("Refs", "as", property_get_refs, 0, 0),
+        SD_BUS_PROPERTY("JobWaitLatencyHistogram", "(ttta(tt))", bus_property_get_histogram, offsetof(Unit, latency[UNIT_LATENCY_JOB_WAIT]), 0),
+        SD_BUS_PROPERTY("SpawnLatencyHistogram", "(ttta(tt))", bus_property_get_histogram, offsetof(Unit, latency[UNIT_LATENCY_SPAWN]), 0),
+        SD_BUS_PROPERTY("ActivationLatencyHistogram", "(ttta(tt))", bus_property_get_histogram, offsetof(Unit, latency[UNIT_LATENCY_ACTIVATION]), 0),
 
         SD_BUS_METHOD("Start", "s", "o", method_start, SD_BUS_VTABLE_UNPRIVILEGED),
         SD_BUS_METHOD("Stop", "s", "o", method_stop, SD_BUS_VTABLE_UNPRIVILEGED),
@@ -688,6 +721,7 @@ const sd_bus_vtable bus_unit_vtable[] = {
         SD_BUS_METHOD("ReloadOrTryRestart", "s", "o", method_reload_or_try_restart, SD_BUS_VTABLE_UNPRIVILEGED),
         SD_BUS_METHOD("Kill", "si", NULL, bus_unit_method_kill, SD_BUS_VTABLE_UNPRIVILEGED),
         SD_BUS_METHOD("ResetFailed", NULL, NULL, bus_unit_method_reset_failed, SD_BUS_VTABLE_UNPRIVILEGED),
+        SD_BUS_METHOD("ResetLatencyHistograms", NULL, NULL, bus_unit_method_reset_latency, SD_BUS_VTABLE_UNPRIVILEGED),
         SD_BUS_METHOD("SetProperties", "ba(sv)", NULL, bus_unit_method_set_properties, SD_BUS_VTABLE_UNPRIVILEGED),
         SD_BUS_METHOD("Ref", NULL, NULL, bus_unit_method_ref, SD_BUS_VTABLE_UNPRIVILEGED),
         SD_BUS_METHOD("Unref", NULL, NULL, bus_unit_method_unref, SD_BUS_VTABLE_UNPRIVILEGED),
@@ -738,7 +772,7 @@ static int property_get_current_memory(
         assert(reply);
         assert(u);
 
-        r = unit_get_memory_current(u, &sz);
+        r = unit_get_cgroup_stat(u, CGROUP_STAT_MEMORY_CURRENT, &sz);
         if (r < 0 && r != -ENODATA)
                 log_unit_warning_errno(u, r, "Failed to get memory.usage_in_bytes attribute: %m");
 
@@ -762,7 +796,7 @@ static int property_get_current_tasks(
         assert(reply);
         assert(u);
 
-        r = unit_get_tasks_current(u, &cn);
+        r = unit_get_cgroup_stat(u, CGROUP_STAT_TASKS_CURRENT, &cn);
         if (r < 0 && r != -ENODATA)
                 log_unit_warning_errno(u, r, "Failed to get pids.current attribute: %m");
 
@@ -786,7 +820,7 @@ static int property_get_cpu_usage(
         assert(reply);
         assert(u);
 
-        r = unit_get_cpu_usage(u, &ns);
+        r = unit_get_cgroup_stat(u, CGROUP_STAT_CPU_USAGE, &ns);
         if (r < 0 && r != -ENODATA)
                 log_unit_warning_errno(u, r, "Failed to get cpuacct.usage attribute: %m");
 
@@ -997,6 +1031,46 @@ static int property_get_ip_counter(
         return sd_bus_message_append(reply, "t", value);
 }
 
+static int property_get_pressure(
+                sd_bus *bus,
+                const char *path,
+                const char *interface,
+                const char *property,
+                sd_bus_message *reply,
+                void *userdata,
+                sd_bus_error *error) {
+
+        static const char *const table[] = {
+                [CGROUP_STAT_CPU_PRESSURE_SOME]    = "CPUPressureSomeUSec",
+                [CGROUP_STAT_CPU_PRESSURE_FULL]    = "CPUPressureFullUSec",
+                [CGROUP_STAT_IO_PRESSURE_SOME]     = "IOPressureSomeUSec",
+                [CGROUP_STAT_IO_PRESSURE_FULL]     = "IOPressureFullUSec",
+                [CGROUP_STAT_MEMORY_PRESSURE_SOME] = "MemoryPressureSomeUSec",
+                [CGROUP_STAT_MEMORY_PRESSURE_FULL] = "MemoryPressureFullUSec",
+        };
+
+        uint64_t value = (uint64_t) -1;
+        Unit *u = userdata;
+        CGroupStat stat;
+        int r;
+
+        assert(bus);
+        assert(reply);
+        assert(property);
+        assert(u);
+
+        for (stat = CGROUP_STAT_CPU_PRESSURE_SOME; stat < _CGROUP_STAT_MAX; stat++)
+                if (streq(property, table[stat]))
+                        break;
+        assert(stat < _CGROUP_STAT_MAX);
+
+        r = unit_get_cgroup_stat(u, stat, &value);
+        if (r < 0 && r != -ENODATA)
+                log_unit_warning_errno(u, r, "Failed to get pressure stall information: %m");
+
+        return sd_bus_message_append(reply, "t", value);
+}
+
 int bus_unit_method_attach_processes(sd_bus_message *message, void *userdata, sd_bus_error *error) {
 
         _cleanup_(sd_bus_creds_unrefp) sd_bus_creds *creds = NULL;
@@ -1120,6 +1194,12 @@ const sd_bus_vtable bus_unit_cgroup_vtable[] = {
         SD_BUS_PROPERTY("IPIngressPackets", "t", property_get_ip_counter, 0, 0),
         SD_BUS_PROPERTY("IPEgressBytes", "t", property_get_ip_counter, 0, 0),
         SD_BUS_PROPERTY("IPEgressPackets", "t", property_get_ip_counter, 0, 0),
+        SD_BUS_PROPERTY("CPUPressureSomeUSec", "t", property_get_pressure, 0, 0),
+        SD_BUS_PROPERTY("CPUPressureFullUSec", "t", property_get_pressure, 0, 0),
+        SD_BUS_PROPERTY("IOPressureSomeUSec", "t", property_get_pressure, 0, 0),
+        SD_BUS_PROPERTY("IOPressureFullUSec", "t", property_get_pressure, 0, 0),
+        SD_BUS_PROPERTY("MemoryPressureSomeUSec", "t", property_get_pressure, 0, 0),
+        SD_BUS_PROPERTY("MemoryPressureFullUSec", "t", property_get_pressure, 0, 0),
         SD_BUS_METHOD("GetProcesses", NULL, "a(sus)", bus_unit_method_get_processes, SD_BUS_VTABLE_UNPRIVILEGED),
         SD_BUS_METHOD("AttachProcesses", "sau", NULL, bus_unit_method_attach_processes, SD_BUS_VTABLE_UNPRIVILEGED),
         SD_BUS_VTABLE_END
@@ -1183,23 +1263,31 @@ static int send_changed_signal(sd_bus *bus, void *userdata) {
                         NULL);
 }
 
+static bool unit_is_settled(Unit *u) {
+        assert(u);
+
+        return !u->job &&
+                !IN_SET(unit_active_state(u), UNIT_ACTIVATING, UNIT_DEACTIVATING, UNIT_RELOADING);
+}
+
 void bus_unit_send_change_signal(Unit *u) {
         int r;
         assert(u);
 
-        if (u->in_dbus_queue) {
-                LIST_REMOVE(dbus_queue, u->manager->dbus_unit_queue, u);
-                u->in_dbus_queue = false;
-        }
+        unit_remove_from_dbus_queue(u);
 
         if (!u->id)
                 return;
 
-        r = bus_foreach_bus(u->manager, u->bus_track, u->sent_dbus_new_signal ? send_changed_signal : send_new_signal, u);
+        /* Clients that subscribed with SUBSCRIBE_SETTLED are not interested in the intermediate states */
+        r = bus_foreach_bus_full(u->manager, u->bus_track,
+                                 !u->sent_dbus_new_signal || unit_is_settled(u),
+                                 u->sent_dbus_new_signal ? send_changed_signal : send_new_signal, u);
         if (r < 0)
                 log_unit_debug_errno(u, r, "Failed to send unit change signal for %s: %m", u->id);
 
         u->sent_dbus_new_signal = true;
+        u->dbus_signal_timestamp = now(CLOCK_MONOTONIC);
 }
 
 static int send_removed_signal(sd_bus *bus, void *userdata) {
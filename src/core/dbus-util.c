@@ -28,6 +28,56 @@ int bus_property_get_triggered_unit(
         return sd_bus_message_append(reply, "s", trigger ? trigger->id : NULL);
 }
 
+int bus_property_get_histogram(
+                sd_bus *bus,
+                const char *path,
+                const char *interface,
+                const char *property,
+                sd_bus_message *reply,
+                void *userdata,
+                sd_bus_error *error) {
+
+        Histogram *h = *(Histogram**) userdata;
+        unsigned i;
+        int r;
+
+        assert(bus);
+        assert(reply);
+
+        /* Returns the number of recorded durations, their sum and maximum, followed by the exclusive upper bound
+         * and count of each non-empty bucket */
+
+        r = sd_bus_message_open_container(reply, 'r', "ttta(tt)");
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_append(reply, "ttt",
+                                  h ? h->n : 0,
+                                  h ? h->sum : 0,
+                                  h ? h->max : 0);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_open_container(reply, 'a', "(tt)");
+        if (r < 0)
+                return r;
+
+        for (i = 0; h && i < HISTOGRAM_BUCKETS; i++) {
+                if (h->buckets[i] == 0)
+                        continue;
+
+                r = sd_bus_message_append(reply, "(tt)", histogram_bucket_max(i), h->buckets[i]);
+                if (r < 0)
+                        return r;
+        }
+
+        r = sd_bus_message_close_container(reply);
+        if (r < 0)
+                return r;
+
+        return sd_bus_message_close_container(reply);
+}
+
 BUS_DEFINE_SET_TRANSIENT(mode_t, "u", uint32_t, mode_t, "%040o");
 BUS_DEFINE_SET_TRANSIENT(unsigned, "u", uint32_t, unsigned, "%" PRIu32);
 BUS_DEFINE_SET_TRANSIENT_STRING_WITH_CHECK(user, valid_user_group_name_or_id);
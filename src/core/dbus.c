@@ -676,6 +676,13 @@ static int bus_on_connection(sd_event_source *s, int fd, uint32_t revents, void
                 return 0;
         }
 
+        /* Our clients are systemctl and friends, let them map large replies such as dumps */
+        r = sd_bus_negotiate_memfd(bus, true);
+        if (r < 0) {
+                log_warning_errno(r, "Failed to enable memfd passing for new connection: %m");
+                return 0;
+        }
+
         r = sd_bus_set_sender(bus, "org.freedesktop.systemd1");
         if (r < 0) {
                 log_warning_errno(r, "Failed to set direct connection sender: %m");
@@ -1061,6 +1068,8 @@ static void destroy_bus(Manager *m, sd_bus **bus) {
         /* Get rid of tracked clients on this bus */
         if (m->subscribed && sd_bus_track_get_bus(m->subscribed) == *bus)
                 m->subscribed = sd_bus_track_unref(m->subscribed);
+        if (m->subscribed_settled && sd_bus_track_get_bus(m->subscribed_settled) == *bus)
+                m->subscribed_settled = sd_bus_track_unref(m->subscribed_settled);
 
         HASHMAP_FOREACH(j, m->jobs, i)
                 if (j->bus_track && sd_bus_track_get_bus(j->bus_track) == *bus)
@@ -1114,8 +1123,10 @@ void bus_done(Manager *m) {
         bus_done_private(m);
 
         assert(!m->subscribed);
+        assert(!m->subscribed_settled);
 
         m->deserialized_subscribed = strv_free(m->deserialized_subscribed);
+        m->deserialized_subscribed_settled = strv_free(m->deserialized_subscribed_settled);
         bus_verify_polkit_async_registry_free(m->polkit_registry);
 }
 
@@ -1159,9 +1170,10 @@ int bus_fdset_add_all(Manager *m, FDSet *fds) {
         return 0;
 }
 
-int bus_foreach_bus(
+int bus_foreach_bus_full(
                 Manager *m,
                 sd_bus_track *subscribed2,
+                bool settled,
                 int (*send_message)(sd_bus *bus, void *userdata),
                 void *userdata) {
 
@@ -1181,10 +1193,13 @@ int bus_foreach_bus(
                         ret = r;
         }
 
-        /* Send to API bus, but only if somebody is subscribed */
+        /* Send to API bus, but only if somebody is subscribed. Clients that only want to know about settled states
+         * are only considered if this is about one. Note that they will get the signal nonetheless if somebody
+         * else is interested, as signals on the API bus are broadcast. */
         if (m->api_bus &&
             (sd_bus_track_count(m->subscribed) > 0 ||
-             sd_bus_track_count(subscribed2) > 0)) {
+             sd_bus_track_count(subscribed2) > 0 ||
+             (settled && sd_bus_track_count(m->subscribed_settled) > 0))) {
                 r = send_message(m->api_bus, userdata);
                 if (r < 0)
                         ret = r;
@@ -0,0 +1,308 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <errno.h>
+
+#include "alloc-util.h"
+#include "dependency-set.h"
+
+DependencySet *dependency_set_free(DependencySet *s) {
+        if (!s)
+                return NULL;
+
+        hashmap_free(s->hashmap);
+        return mfree(s);
+}
+
+static DependencyEntry *dependency_set_find(DependencySet *s, Unit *u) {
+        unsigned k;
+
+        assert(s);
+        assert(!s->hashmap);
+
+        for (k = 0; k < s->n_entries; k++)
+                if (s->entries[k].unit == u)
+                        return s->entries + k;
+
+        return NULL;
+}
+
+void *dependency_set_get(DependencySet *s, Unit *u) {
+        DependencyEntry *e;
+
+        if (!s)
+                return NULL;
+
+        if (s->hashmap)
+                return hashmap_get(s->hashmap, u);
+
+        e = dependency_set_find(s, u);
+        return e ? e->data : NULL;
+}
+
+unsigned dependency_set_size(DependencySet *s) {
+        if (!s)
+                return 0;
+
+        if (s->hashmap)
+                return hashmap_size(s->hashmap);
+
+        return s->n_entries;
+}
+
+Unit *dependency_set_first_key(DependencySet *s) {
+        if (!s)
+                return NULL;
+
+        if (s->hashmap)
+                return hashmap_first_key(s->hashmap);
+
+        return s->n_entries > 0 ? s->entries[0].unit : NULL;
+}
+
+static int dependency_set_promote(DependencySet **s, unsigned entries_add) {
+        _cleanup_hashmap_free_ Hashmap *h = NULL;
+        DependencySet *n;
+        unsigned k;
+        int r;
+
+        assert(s);
+        assert(*s);
+        assert(!(*s)->hashmap);
+
+        /* Moves the entries from the array into a newly allocated hashmap, and drops the array */
+
+        h = hashmap_new(NULL);
+        if (!h)
+                return -ENOMEM;
+
+        r = hashmap_reserve(h, (*s)->n_entries + entries_add);
+        if (r < 0)
+                return r;
+
+        for (k = 0; k < (*s)->n_entries; k++)
+                assert_se(hashmap_put(h, (*s)->entries[k].unit, (*s)->entries[k].data) > 0);
+
+        (*s)->hashmap = TAKE_PTR(h);
+        (*s)->n_entries = (*s)->n_allocated = 0;
+
+        /* Return the memory of the array, if we can */
+        n = realloc(*s, sizeof(DependencySet));
+        if (n)
+                *s = n;
+
+        return 0;
+}
+
+int dependency_set_reserve(DependencySet **s, unsigned entries_add) {
+        DependencySet *n;
+        unsigned need;
+
+        assert(s);
+
+        if (*s && (*s)->hashmap)
+                return hashmap_reserve((*s)->hashmap, entries_add);
+
+        need = (*s ? (*s)->n_entries : 0) + entries_add;
+        if (*s && need <= (*s)->n_allocated)
+                return 0;
+
+        if (need > DEPENDENCY_SET_ARRAY_MAX) {
+                if (!*s) {
+                        *s = new0(DependencySet, 1);
+                        if (!*s)
+                                return -ENOMEM;
+                }
+
+                return dependency_set_promote(s, entries_add);
+        }
+
+        /* Grow the array in powers of two, so that adding entries one by one does not reallocate every time */
+        need = MIN(MAX(need, *s ? (*s)->n_allocated * 2 : 1), DEPENDENCY_SET_ARRAY_MAX);
+
+        n = realloc(*s, offsetof(DependencySet, entries) + need * sizeof(DependencyEntry));
+        if (!n)
+                return -ENOMEM;
+
+        if (!*s)
+                *n = (DependencySet) {};
+
+        n->n_allocated = need;
+        *s = n;
+
+        return 0;
+}
+
+int dependency_set_put(DependencySet **s, Unit *u, void *data) {
+        void *old;
+        int r;
+
+        assert(s);
+        assert(u);
+
+        old = dependency_set_get(*s, u);
+        if (old)
+                return old == data ? 0 : -EEXIST;
+
+        r = dependency_set_reserve(s, 1);
+        if (r < 0)
+                return r;
+
+        if ((*s)->hashmap)
+                return hashmap_put((*s)->hashmap, u, data);
+
+        (*s)->entries[(*s)->n_entries++] = (DependencyEntry) {
+                .unit = u,
+                .data = data,
+        };
+
+        return 1;
+}
+
+int dependency_set_update(DependencySet *s, Unit *u, void *data) {
+        DependencyEntry *e;
+
+        if (!s)
+                return -ENOENT;
+
+        if (s->hashmap)
+                return hashmap_update(s->hashmap, u, data);
+
+        e = dependency_set_find(s, u);
+        if (!e)
+                return -ENOENT;
+
+        e->data = data;
+        return 0;
+}
+
+void *dependency_set_remove(DependencySet *s, Unit *u) {
+        DependencyEntry *e;
+        void *data;
+
+        if (!s)
+                return NULL;
+
+        if (s->hashmap)
+                return hashmap_remove(s->hashmap, u);
+
+        e = dependency_set_find(s, u);
+        if (!e)
+                return NULL;
+
+        data = e->data;
+
+        /* Keep the order of the remaining entries, so that iterators continue with the right one, see below */
+        memmove(e, e + 1, (s->entries + s->n_entries - (e + 1)) * sizeof(DependencyEntry));
+        s->n_entries--;
+
+        return data;
+}
+
+int dependency_set_remove_and_replace(DependencySet *s, Unit *old_key, Unit *new_key, void *data) {
+        DependencyEntry *e;
+
+        if (!s)
+                return -ENOENT;
+
+        if (s->hashmap)
+                return hashmap_remove_and_replace(s->hashmap, old_key, new_key, data);
+
+        e = dependency_set_find(s, old_key);
+        if (!e)
+                return -ENOENT;
+
+        if (old_key != new_key) {
+                /* Drop any existing entry for the new key first, so that the set remains a set. This never
+                 * needs more space. */
+                (void) dependency_set_remove(s, new_key);
+                e = dependency_set_find(s, old_key);
+        }
+
+        e->unit = new_key;
+        e->data = data;
+
+        return 0;
+}
+
+int dependency_set_complete_move(DependencySet **s, DependencySet **other) {
+        Iterator i;
+        Unit *u;
+        void *v;
+        int r;
+
+        assert(s);
+        assert(other);
+
+        /* Moves all entries of 'other' into 's', except those which 's' already has. If 's' is empty, 'other' is
+         * simply taken over as a whole. */
+
+        if (!*other)
+                return 0;
+
+        if (!*s) {
+                *s = TAKE_PTR(*other);
+                return 0;
+        }
+
+        if ((*s)->hashmap && (*other)->hashmap)
+                return hashmap_move((*s)->hashmap, (*other)->hashmap);
+
+        DEPENDENCY_SET_FOREACH(v, u, *other, i) {
+                if (dependency_set_get(*s, u))
+                        continue;
+
+                r = dependency_set_put(s, u, v);
+                if (r < 0)
+                        return r;
+
+                assert_se(dependency_set_remove(*other, u));
+        }
+
+        return 0;
+}
+
+size_t dependency_set_memory_usage(DependencySet *s) {
+        if (!s)
+                return 0;
+
+        return offsetof(DependencySet, entries) + s->n_allocated * sizeof(DependencyEntry) +
+                hashmap_memory_usage(s->hashmap);
+}
+
+bool dependency_set_iterate(DependencySet *s, Iterator *i, void **value, Unit **key) {
+        assert(i);
+
+        if (!s)
+                goto finish;
+
+        if (s->hashmap)
+                return hashmap_iterate(s->hashmap, i, value, (const void**) key);
+
+        /* The iterator's index points to the entry returned last, and its key is remembered. If that entry has
+         * been removed since, the remaining entries moved down by one, and the index already points to the next
+         * one. */
+        if (i->idx == _IDX_ITERATOR_FIRST)
+                i->idx = 0;
+        else if (i->idx < s->n_entries && s->entries[i->idx].unit == i->next_key)
+                i->idx++;
+
+        if (i->idx >= s->n_entries)
+                goto finish;
+
+        i->next_key = s->entries[i->idx].unit;
+
+        if (value)
+                *value = s->entries[i->idx].data;
+        if (key)
+                *key = s->entries[i->idx].unit;
+
+        return true;
+
+finish:
+        if (value)
+                *value = NULL;
+        if (key)
+                *key = NULL;
+
+        return false;
+}
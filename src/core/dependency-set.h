@@ -0,0 +1,57 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+#pragma once
+
+#include <stdbool.h>
+
+#include "hashmap.h"
+#include "macro.h"
+
+typedef struct Unit Unit;
+
+/* A map from Unit* to a pointer-sized value, used for the dependencies of a unit. Most units only have a handful of
+ * dependencies of each type, hence small sets are kept in a plain array that is searched linearly, stored in the same
+ * allocation as the header. Only sets that outgrow it are promoted to a real Hashmap. Like for Hashmap, a NULL
+ * pointer is a valid empty set, and the functions that add entries allocate it as needed. */
+
+#define DEPENDENCY_SET_ARRAY_MAX 8U
+
+typedef struct DependencyEntry {
+        Unit *unit;
+        void *data;
+} DependencyEntry;
+
+typedef struct DependencySet {
+        Hashmap *hashmap;       /* Once promoted, all entries are kept here, and the array is unused */
+        unsigned n_entries;
+        unsigned n_allocated;
+        DependencyEntry entries[];
+} DependencySet;
+
+DependencySet *dependency_set_free(DependencySet *s);
+
+void *dependency_set_get(DependencySet *s, Unit *u);
+static inline bool dependency_set_contains(DependencySet *s, Unit *u) {
+        return dependency_set_get(s, u);
+}
+
+unsigned dependency_set_size(DependencySet *s) _pure_;
+static inline bool dependency_set_isempty(DependencySet *s) {
+        return dependency_set_size(s) == 0;
+}
+
+Unit *dependency_set_first_key(DependencySet *s);
+
+int dependency_set_put(DependencySet **s, Unit *u, void *data);
+int dependency_set_update(DependencySet *s, Unit *u, void *data);
+void *dependency_set_remove(DependencySet *s, Unit *u);
+int dependency_set_remove_and_replace(DependencySet *s, Unit *old_key, Unit *new_key, void *data);
+
+int dependency_set_reserve(DependencySet **s, unsigned entries_add);
+int dependency_set_complete_move(DependencySet **s, DependencySet **other);
+
+size_t dependency_set_memory_usage(DependencySet *s) _pure_;
+
+bool dependency_set_iterate(DependencySet *s, Iterator *i, void **value, Unit **key);
+
+#define DEPENDENCY_SET_FOREACH(e, k, s, i) \
+        for ((i) = ITERATOR_FIRST; dependency_set_iterate((s), &(i), (void**)&(e), (Unit**) &(k)); )
@@ -449,7 +449,7 @@ static void device_upgrade_mount_deps(Unit *u) {
 
         /* Let's upgrade Requires= to BindsTo= on us. (Used when SYSTEMD_MOUNT_DEVICE_BOUND is set) */
 
-        HASHMAP_FOREACH_KEY(v, other, u->dependencies[UNIT_REQUIRED_BY], i) {
+        DEPENDENCY_SET_FOREACH(v, other, u->dependencies[UNIT_REQUIRED_BY], i) {
                 if (other->type != UNIT_MOUNT)
                         continue;
 
@@ -551,9 +551,142 @@ fail:
         return r;
 }
 
+static int device_index_put(Manager *m, const char *path, const char *sysfs) {
+        _cleanup_free_ char *p = NULL, *s = NULL;
+        char *old;
+        int r;
+
+        assert(m);
+        assert(path);
+        assert(sysfs);
+
+        old = hashmap_get(m->device_index, path);
+        if (old && path_equal(old, sysfs))
+                return 0;
+
+        s = strdup(sysfs);
+        if (!s)
+                return -ENOMEM;
+
+        if (old) {
+                /* Another device took over the name, e.g. a symlink in /dev/disk/by-label/ */
+                r = hashmap_update(m->device_index, path, s);
+                if (r < 0)
+                        return r;
+
+                free(old);
+                s = NULL;
+                return 0;
+        }
+
+        r = hashmap_ensure_allocated(&m->device_index, &path_hash_ops);
+        if (r < 0)
+                return r;
+
+        p = strdup(path);
+        if (!p)
+                return -ENOMEM;
+
+        r = hashmap_put(m->device_index, p, s);
+        if (r < 0)
+                return r;
+
+        p = s = NULL;
+        return 0;
+}
+
+static void device_index_remove(Manager *m, const char *path, const char *sysfs) {
+        char *key, *value;
+
+        assert(m);
+        assert(path);
+        assert(sysfs);
+
+        /* Only drop the entry if the name still refers to this device */
+        value = hashmap_get2(m->device_index, path, (void**) &key);
+        if (!value || !path_equal(value, sysfs))
+                return;
+
+        assert_se(hashmap_remove(m->device_index, path) == value);
+        free(key);
+        free(value);
+}
+
+static bool device_wants_unit(Manager *m, sd_device *dev) {
+        const char *v;
+
+        assert(m);
+        assert(dev);
+
+        if (!m->lazy_device_units)
+                return true;
+
+        /* Devices that pull in other units, or that have aliases configured, are always set up right-away, since
+         * nobody else would ask for their units. */
+        if (sd_device_get_property_value(dev, MANAGER_IS_USER(m) ? "SYSTEMD_USER_WANTS" : "SYSTEMD_WANTS", &v) >= 0)
+                return true;
+
+        return sd_device_get_property_value(dev, "SYSTEMD_ALIAS", &v) >= 0;
+}
+
+static int device_setup_unit_or_index(Manager *m, sd_device *dev, const char *path, bool main, bool eager) {
+        _cleanup_free_ char *e = NULL;
+        const char *sysfs;
+        int r;
+
+        assert(m);
+        assert(dev);
+        assert(path);
+
+        r = sd_device_get_syspath(dev, &sysfs);
+        if (r < 0)
+                return 0;
+
+        if (!eager) {
+                r = unit_name_from_path(path, ".device", &e);
+                if (r < 0)
+                        return log_device_error_errno(dev, r, "Failed to generate unit name from device path: %m");
+
+                /* If nobody asked for the unit yet, just remember which device it would refer to */
+                if (!manager_get_unit(m, e)) {
+                        r = device_index_put(m, path, sysfs);
+                        if (r < 0)
+                                return log_oom();
+
+                        return 0;
+                }
+        }
+
+        device_index_remove(m, path, sysfs);
+
+        return device_setup_unit(m, dev, path, main);
+}
+
+static void device_unindex(Manager *m, sd_device *dev) {
+        const char *sysfs, *dn, *p;
+
+        assert(m);
+        assert(dev);
+
+        if (hashmap_isempty(m->device_index))
+                return;
+
+        if (sd_device_get_syspath(dev, &sysfs) < 0)
+                return;
+
+        device_index_remove(m, sysfs, sysfs);
+
+        if (sd_device_get_devname(dev, &dn) >= 0)
+                device_index_remove(m, dn, sysfs);
+
+        FOREACH_DEVICE_DEVLINK(dev, p)
+                device_index_remove(m, p, sysfs);
+}
+
 static int device_process_new(Manager *m, sd_device *dev) {
         const char *sysfs, *dn, *alias;
         dev_t devnum;
+        bool eager;
         int r;
 
         assert(m);
@@ -561,14 +694,16 @@ static int device_process_new(Manager *m, sd_device *dev) {
         if (sd_device_get_syspath(dev, &sysfs) < 0)
                 return 0;
 
+        eager = device_wants_unit(m, dev);
+
         /* Add the main unit named after the sysfs path */
-        r = device_setup_unit(m, dev, sysfs, true);
+        r = device_setup_unit_or_index(m, dev, sysfs, true, eager);
         if (r < 0)
                 return r;
 
         /* Add an additional unit for the device node */
         if (sd_device_get_devname(dev, &dn) >= 0)
-                (void) device_setup_unit(m, dev, dn, false);
+                (void) device_setup_unit_or_index(m, dev, dn, false, eager);
 
         /* Add additional units for all symlinks */
         if (sd_device_get_devnum(dev, &devnum) >= 0) {
@@ -592,7 +727,7 @@ static int device_process_new(Manager *m, sd_device *dev) {
                              st.st_rdev != devnum))
                                 continue;
 
-                        (void) device_setup_unit(m, dev, p, false);
+                        (void) device_setup_unit_or_index(m, dev, p, false, eager);
                 }
         }
 
@@ -770,11 +905,64 @@ static int device_following_set(Unit *u, Set **_set) {
         return 1;
 }
 
+static int device_load(Unit *u) {
+        _cleanup_(sd_device_unrefp) sd_device *dev = NULL;
+        _cleanup_free_ char *path = NULL;
+        Device *d = DEVICE(u);
+        Manager *m = u->manager;
+        const char *sysfs;
+        int r;
+
+        assert(d);
+
+        r = unit_load_fragment_and_dropin_optional(u);
+        if (r < 0)
+                return r;
+
+        /* If device units are created lazily, and the device this unit refers to is around already, set the unit up
+         * now, as if we had seen the device just now. */
+        if (d->sysfs || hashmap_isempty(m->device_index))
+                return 0;
+
+        if (unit_name_to_path(u->id, &path) < 0)
+                return 0;
+
+        sysfs = hashmap_get(m->device_index, path);
+        if (!sysfs)
+                return 0;
+
+        r = sd_device_new_from_syspath(&dev, sysfs);
+        if (r < 0) {
+                log_unit_debug_errno(u, r, "Failed to open device %s, ignoring: %m", sysfs);
+                device_index_remove(m, path, sysfs); /* The device went away in the meantime */
+                return 0;
+        }
+
+        if (!device_is_ready(dev))
+                return 0;
+
+        r = device_setup_unit_or_index(m, dev, path, path_equal(path, sysfs), true);
+        if (r < 0)
+                return 0;
+
+        if (MANAGER_IS_RUNNING(m)) {
+                /* We are in the middle of loading the unit, hence don't dispatch a state change, but initialize it
+                 * as if it had been plugged all along */
+                d->found = DEVICE_FOUND_UDEV;
+                d->state = DEVICE_PLUGGED;
+                (void) unit_acquire_invocation_id(u);
+        } else
+                device_update_found_one(d, DEVICE_FOUND_UDEV, DEVICE_FOUND_UDEV);
+
+        return 0;
+}
+
 static void device_shutdown(Manager *m) {
         assert(m);
 
         m->device_monitor = sd_device_monitor_unref(m->device_monitor);
         m->devices_by_sysfs = hashmap_free(m->devices_by_sysfs);
+        m->device_index = hashmap_free_free_free(m->device_index);
 }
 
 static void device_enumerate(Manager *m) {
@@ -901,6 +1089,8 @@ static int device_dispatch_io(sd_device_monitor *monitor, sd_device *dev, void *
                  * found bits */
                 device_update_found_by_sysfs(m, sysfs, 0, DEVICE_FOUND_UDEV|DEVICE_FOUND_MOUNT|DEVICE_FOUND_SWAP);
 
+                device_unindex(m, dev);
+
         } else if (device_is_ready(dev)) {
 
                 (void) device_process_new(m, dev);
@@ -1037,7 +1227,7 @@ const UnitVTable device_vtable = {
 
         .init = device_init,
         .done = device_done,
-        .load = unit_load_fragment_and_dropin_optional,
+        .load = device_load,
 
         .coldplug = device_coldplug,
         .catchup = device_catchup,
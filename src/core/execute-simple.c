@@ -0,0 +1,673 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/prctl.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include "alloc-util.h"
+#include "def.h"
+#include "execute-simple.h"
+#include "exit-status.h"
+#include "fd-util.h"
+#include "missing.h"
+#include "rlimit-util.h"
+#include "signal-util.h"
+#include "strv.h"
+
+int shift_fds(int fds[], size_t n_fds) {
+        int start, restart_from;
+
+        if (n_fds <= 0)
+                return 0;
+
+        /* Modifies the fds array! (sorts it) */
+
+        assert(fds);
+
+        start = 0;
+        for (;;) {
+                int i;
+
+                restart_from = -1;
+
+                for (i = start; i < (int) n_fds; i++) {
+                        int nfd;
+
+                        /* Already at right index? */
+                        if (fds[i] == i+3)
+                                continue;
+
+                        nfd = fcntl(fds[i], F_DUPFD, i + 3);
+                        if (nfd < 0)
+                                return -errno;
+
+                        safe_close(fds[i]);
+                        fds[i] = nfd;
+
+                        /* Hmm, the fd we wanted isn't free? Then
+                         * let's remember that and try again from here */
+                        if (nfd != i+3 && restart_from < 0)
+                                restart_from = i;
+                }
+
+                if (restart_from < 0)
+                        break;
+
+                start = restart_from;
+        }
+
+        return 0;
+}
+
+int flags_fds(const int fds[], size_t n_socket_fds, size_t n_storage_fds, bool nonblock) {
+        size_t i, n_fds;
+        int r;
+
+        n_fds = n_socket_fds + n_storage_fds;
+        if (n_fds <= 0)
+                return 0;
+
+        assert(fds);
+
+        /* Drops/Sets O_NONBLOCK and FD_CLOEXEC from the file flags.
+         * O_NONBLOCK only applies to socket activation though. */
+
+        for (i = 0; i < n_fds; i++) {
+
+                if (i < n_socket_fds) {
+                        r = fd_nonblock(fds[i], nonblock);
+                        if (r < 0)
+                                return r;
+                }
+
+                /* We unconditionally drop FD_CLOEXEC from the fds,
+                 * since after all we want to pass these fds to our
+                 * children */
+
+                r = fd_cloexec(fds[i], false);
+                if (r < 0)
+                        return r;
+        }
+
+        return 0;
+}
+
+static void format_pid(char *buf, pid_t pid) {
+        char tmp[DECIMAL_STR_MAX(pid_t)];
+        size_t n = 0;
+
+        /* Like snprintf(buf, …, PID_FMT, pid), but without touching anything of libc */
+
+        assert(pid > 0);
+
+        do {
+                tmp[n++] = '0' + pid % 10;
+                pid /= 10;
+        } while (pid > 0);
+
+        while (n > 0)
+                *(buf++) = tmp[--n];
+
+        *buf = 0;
+}
+
+static int exec_simple_fail(ExecSimple *c, int error, int exit_status) {
+        c->error = error;
+        c->exit_status = exit_status;
+
+        return error;
+}
+
+int exec_simple_child(ExecSimple *c) {
+        static const struct sigaction sa_default = {
+                .sa_handler = SIG_DFL,
+                .sa_flags = SA_RESTART,
+        };
+        size_t n_fds;
+        int sig, fd, r;
+
+        /* May run in the memory of the manager, on its own stack. Don't call anything here that allocates memory
+         * or might take a lock, and don't modify anything but *c. Returns only on failure, with the error and exit
+         * status stored in *c. If the executable is missing and that shall be ignored, the exit status is
+         * EXIT_SUCCESS. */
+
+        assert(c);
+
+        /* Signal handlers of the manager must never run here, they would operate on the manager's state. All
+         * signals are blocked by the parent, and we reset all handlers before unblocking them. Handlers that ignore
+         * a signal are reset only if exec_child() would, too. */
+        for (sig = 1; sig < _NSIG; sig++) {
+                struct sigaction sa;
+
+                if (IN_SET(sig, SIGKILL, SIGSTOP))
+                        continue;
+
+                if (sigaction(sig, NULL, &sa) < 0)
+                        continue;
+
+                if (sa.sa_handler != SIG_DFL && sa.sa_handler != SIG_IGN)
+                        (void) sigaction(sig, &sa_default, NULL);
+        }
+
+        (void) default_signals(SIGNALS_CRASH_HANDLER,
+                               SIGNALS_IGNORE, -1);
+
+        if (c->ignore_sigpipe)
+                (void) ignore_signals(SIGPIPE, -1);
+
+        r = reset_signal_mask();
+        if (r < 0)
+                return exec_simple_fail(c, r, EXIT_SIGNAL_MASK);
+
+        if (!c->same_pgrp && setsid() < 0)
+                return exec_simple_fail(c, -errno, EXIT_SETSID);
+
+        if (c->socket_fd >= 0)
+                (void) fd_nonblock(c->socket_fd, false);
+
+        for (fd = 0; fd < 3; fd++)
+                if (c->stdio[fd] >= 0 && c->stdio[fd] != fd)
+                        if (dup2(c->stdio[fd], fd) < 0)
+                                return exec_simple_fail(c, -errno, fd == STDIN_FILENO ? EXIT_STDIN :
+                                                        fd == STDOUT_FILENO ? EXIT_STDOUT : EXIT_STDERR);
+
+        if (c->cgroup_fd >= 0)
+                if (write(c->cgroup_fd, "0\n", 2) < 0)
+                        return exec_simple_fail(c, -errno, EXIT_CGROUP);
+
+        if (c->nice_set)
+                if (setpriority(PRIO_PROCESS, 0, c->nice) < 0)
+                        return exec_simple_fail(c, -errno, EXIT_NICE);
+
+        (void) umask(c->umask);
+
+        if (c->new_keyring) {
+                key_serial_t key;
+
+                /* Mirrors setup_keyring(), for the case where no user change is involved */
+
+                if (keyctl(KEYCTL_JOIN_SESSION_KEYRING, 0, 0, 0, 0) == -1) {
+                        if (!IN_SET(errno, ENOSYS, EACCES, EPERM, EDQUOT))
+                                return exec_simple_fail(c, -errno, EXIT_KEYRING);
+                } else {
+                        if (c->link_user_keyring &&
+                            keyctl(KEYCTL_LINK, KEY_SPEC_USER_KEYRING, KEY_SPEC_SESSION_KEYRING, 0, 0) < 0)
+                                return exec_simple_fail(c, -errno, EXIT_KEYRING);
+
+                        if (!sd_id128_is_null(c->invocation_id)) {
+                                key = add_key("user", "invocation_id", &c->invocation_id, sizeof(c->invocation_id), KEY_SPEC_SESSION_KEYRING);
+                                if (key != -1 &&
+                                    keyctl(KEYCTL_SETPERM, key,
+                                           KEY_POS_VIEW|KEY_POS_READ|KEY_POS_SEARCH|
+                                           KEY_USR_VIEW|KEY_USR_READ|KEY_USR_SEARCH, 0, 0) < 0)
+                                        return exec_simple_fail(c, -errno, EXIT_KEYRING);
+                        }
+                }
+        }
+
+        n_fds = c->n_socket_fds + c->n_storage_fds;
+
+        if (c->exec_fd >= 0 && c->exec_fd < 3 + (int) n_fds) {
+                fd = fcntl(c->exec_fd, F_DUPFD_CLOEXEC, 3 + (int) n_fds);
+                if (fd < 0)
+                        return exec_simple_fail(c, -errno, EXIT_FDS);
+
+                c->exec_fd = fd;
+        } else if (c->exec_fd >= 0) {
+                r = fd_cloexec(c->exec_fd, true);
+                if (r < 0)
+                        return exec_simple_fail(c, r, EXIT_FDS);
+        }
+
+        {
+                int dont_close[n_fds + 1];
+
+                memcpy_safe(dont_close, c->fds, n_fds * sizeof(int));
+                if (c->exec_fd >= 0)
+                        dont_close[n_fds] = c->exec_fd;
+
+                r = close_all_fds_without_malloc(dont_close, n_fds + (c->exec_fd >= 0));
+        }
+        if (r >= 0)
+                r = shift_fds(c->fds, n_fds);
+        if (r >= 0)
+                r = flags_fds(c->fds, c->n_socket_fds, c->n_storage_fds, c->non_blocking);
+        if (r < 0)
+                return exec_simple_fail(c, r, EXIT_FDS);
+
+        if (c->rlimit) {
+                r = setrlimit_closest_all(c->rlimit, NULL);
+                if (r < 0)
+                        return exec_simple_fail(c, r, EXIT_LIMITS);
+        }
+
+        if (c->apply_secure_bits && prctl(PR_GET_SECUREBITS) != c->secure_bits)
+                if (prctl(PR_SET_SECUREBITS, c->secure_bits) < 0)
+                        return exec_simple_fail(c, -errno, EXIT_SECUREBITS);
+
+        if (c->no_new_privileges)
+                if (prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0) < 0)
+                        return exec_simple_fail(c, -errno, EXIT_NO_NEW_PRIVILEGES);
+
+        if (chdir(c->working_directory) < 0 && !c->working_directory_missing_ok)
+                return exec_simple_fail(c, -errno, EXIT_CHDIR);
+
+        if (c->listen_pid)
+                format_pid(c->listen_pid, raw_getpid());
+        if (c->watchdog_pid)
+                format_pid(c->watchdog_pid, raw_getpid());
+
+        if (c->exec_fd >= 0) {
+                uint8_t hot = 1;
+
+                if (write(c->exec_fd, &hot, sizeof(hot)) < 0)
+                        return exec_simple_fail(c, -errno, EXIT_EXEC);
+        }
+
+        execve(c->path, c->argv, c->envp);
+        r = -errno;
+
+        if (c->exec_fd >= 0) {
+                uint8_t hot = 0;
+
+                if (write(c->exec_fd, &hot, sizeof(hot)) < 0)
+                        return exec_simple_fail(c, -errno, EXIT_EXEC);
+        }
+
+        return exec_simple_fail(c, r, r == -ENOENT && c->ignore_enoent ? EXIT_SUCCESS : EXIT_EXEC);
+}
+
+
+/* The requests sent to systemd-executor consist of this header, followed by a number of NUL terminated strings:
+ * the path, the working directory, the three log fields, then the argument and environment lists. All fds are
+ * passed along with SCM_RIGHTS, the header refers to them by their index. The manager and systemd-executor are
+ * always of the same build, hence this doesn't need to be stable. */
+
+#define EXEC_SIMPLE_FD_STANDARD(fd) (-2 - (fd))
+
+enum {
+        EXEC_SIMPLE_NON_BLOCKING                = 1U << 0,
+        EXEC_SIMPLE_SAME_PGRP                   = 1U << 1,
+        EXEC_SIMPLE_IGNORE_SIGPIPE              = 1U << 2,
+        EXEC_SIMPLE_NICE                        = 1U << 3,
+        EXEC_SIMPLE_NEW_KEYRING                 = 1U << 4,
+        EXEC_SIMPLE_LINK_USER_KEYRING           = 1U << 5,
+        EXEC_SIMPLE_SECURE_BITS                 = 1U << 6,
+        EXEC_SIMPLE_NO_NEW_PRIVILEGES           = 1U << 7,
+        EXEC_SIMPLE_WORKING_DIRECTORY_MISSING_OK = 1U << 8,
+        EXEC_SIMPLE_IGNORE_ENOENT               = 1U << 9,
+};
+
+typedef struct ExecSimpleHeader {
+        uint32_t flags;
+        int32_t nice;
+        uint32_t umask;
+        int32_t secure_bits;
+        sd_id128_t invocation_id;
+
+        int32_t stdio[3];
+        int32_t socket_fd;
+        int32_t exec_fd;
+        int32_t cgroup_fd;
+        uint32_t n_socket_fds;          /* The socket and storage fds come first in the passed fds */
+        uint32_t n_storage_fds;
+        uint32_t n_fds;
+
+        int32_t listen_pid;             /* Indexes into the environment list, or -1 */
+        int32_t watchdog_pid;
+        uint32_t n_argv;
+        uint32_t n_envp;
+
+        uint32_t rlimit_set;
+        struct {
+                uint64_t cur;
+                uint64_t max;
+        } rlimit[_RLIMIT_MAX];
+} ExecSimpleHeader;
+
+static int32_t serialize_fd(int fd, int *fds, size_t *n_fds) {
+        if (fd < 0)
+                return -1;
+
+        if (fd < 3)
+                return EXEC_SIMPLE_FD_STANDARD(fd);
+
+        fds[*n_fds] = fd;
+        return (int32_t) (*n_fds)++;
+}
+
+static int32_t serialize_env_index(char **envp, const char *p) {
+        char **e;
+
+        if (!p)
+                return -1;
+
+        STRV_FOREACH(e, envp)
+                if (p >= *e && p <= *e + strlen(*e))
+                        return (int32_t) (e - envp);
+
+        return -1;
+}
+
+int exec_simple_serialize(const ExecSimple *c, void **ret, size_t *ret_size, int **ret_fds, size_t *ret_n_fds) {
+        _cleanup_free_ int *fds = NULL;
+        _cleanup_free_ void *buf = NULL;
+        ExecSimpleHeader *h;
+        size_t n_fds, n = 0, size, i;
+        char **s;
+        char *p;
+
+        assert(c);
+        assert(ret);
+        assert(ret_size);
+        assert(ret_fds);
+        assert(ret_n_fds);
+
+        n_fds = c->n_socket_fds + c->n_storage_fds;
+        if (n_fds + 6 > EXEC_SIMPLE_FDS_MAX)
+                return -E2BIG;
+
+        fds = new(int, n_fds + 6);
+        if (!fds)
+                return -ENOMEM;
+
+        size = sizeof(ExecSimpleHeader) +
+                strlen(c->path) + 1 +
+                strlen(c->working_directory) + 1 +
+                strlen_ptr(c->unit_id) + 1 +
+                strlen_ptr(c->unit_log_field) + 1 +
+                strlen_ptr(c->invocation_log_field) + 1;
+        STRV_FOREACH(s, c->argv)
+                size += strlen(*s) + 1;
+        STRV_FOREACH(s, c->envp)
+                size += strlen(*s) + 1;
+
+        buf = malloc0(size);
+        if (!buf)
+                return -ENOMEM;
+
+        h = buf;
+        *h = (ExecSimpleHeader) {
+                .flags = (c->non_blocking ? EXEC_SIMPLE_NON_BLOCKING : 0) |
+                         (c->same_pgrp ? EXEC_SIMPLE_SAME_PGRP : 0) |
+                         (c->ignore_sigpipe ? EXEC_SIMPLE_IGNORE_SIGPIPE : 0) |
+                         (c->nice_set ? EXEC_SIMPLE_NICE : 0) |
+                         (c->new_keyring ? EXEC_SIMPLE_NEW_KEYRING : 0) |
+                         (c->link_user_keyring ? EXEC_SIMPLE_LINK_USER_KEYRING : 0) |
+                         (c->apply_secure_bits ? EXEC_SIMPLE_SECURE_BITS : 0) |
+                         (c->no_new_privileges ? EXEC_SIMPLE_NO_NEW_PRIVILEGES : 0) |
+                         (c->working_directory_missing_ok ? EXEC_SIMPLE_WORKING_DIRECTORY_MISSING_OK : 0) |
+                         (c->ignore_enoent ? EXEC_SIMPLE_IGNORE_ENOENT : 0),
+                .nice = c->nice,
+                .umask = c->umask,
+                .secure_bits = c->secure_bits,
+                .invocation_id = c->invocation_id,
+                .n_socket_fds = c->n_socket_fds,
+                .n_storage_fds = c->n_storage_fds,
+                .listen_pid = serialize_env_index(c->envp, c->listen_pid),
+                .watchdog_pid = serialize_env_index(c->envp, c->watchdog_pid),
+                .n_argv = strv_length(c->argv),
+                .n_envp = strv_length(c->envp),
+        };
+
+        memcpy_safe(fds, c->fds, n_fds * sizeof(int));
+        n = n_fds;
+
+        for (i = 0; i < 3; i++)
+                h->stdio[i] = serialize_fd(c->stdio[i], fds, &n);
+        h->socket_fd = serialize_fd(c->socket_fd, fds, &n);
+        h->exec_fd = serialize_fd(c->exec_fd, fds, &n);
+        h->cgroup_fd = serialize_fd(c->cgroup_fd, fds, &n);
+        h->n_fds = n;
+
+        if (c->rlimit)
+                for (i = 0; i < _RLIMIT_MAX; i++) {
+                        if (!c->rlimit[i])
+                                continue;
+
+                        h->rlimit_set |= 1U << i;
+                        h->rlimit[i].cur = c->rlimit[i]->rlim_cur;
+                        h->rlimit[i].max = c->rlimit[i]->rlim_max;
+                }
+
+        p = (char*) buf + sizeof(ExecSimpleHeader);
+        p = stpcpy(p, c->path) + 1;
+        p = stpcpy(p, c->working_directory) + 1;
+        p = stpcpy(p, strempty(c->unit_id)) + 1;
+        p = stpcpy(p, strempty(c->unit_log_field)) + 1;
+        p = stpcpy(p, strempty(c->invocation_log_field)) + 1;
+        STRV_FOREACH(s, c->argv)
+                p = stpcpy(p, *s) + 1;
+        STRV_FOREACH(s, c->envp)
+                p = stpcpy(p, *s) + 1;
+
+        assert((size_t) (p - (char*) buf) == size);
+
+        *ret = TAKE_PTR(buf);
+        *ret_size = size;
+        *ret_fds = TAKE_PTR(fds);
+        *ret_n_fds = n;
+
+        return 0;
+}
+
+static int deserialize_fd(int32_t i, const int *fds, size_t n_fds, int *ret) {
+        if (i == -1) {
+                *ret = -1;
+                return 0;
+        }
+
+        if (i < 0) {
+                if (i < EXEC_SIMPLE_FD_STANDARD(2))
+                        return -EBADMSG;
+
+                *ret = -2 - i;
+                return 0;
+        }
+
+        if ((size_t) i >= n_fds)
+                return -EBADMSG;
+
+        *ret = fds[i];
+        return 0;
+}
+
+static int deserialize_strings(const char **p, const char *e, size_t n, char ***ret) {
+        _cleanup_strv_free_ char **l = NULL;
+        size_t i;
+
+        l = new0(char*, n + 1);
+        if (!l)
+                return -ENOMEM;
+
+        for (i = 0; i < n; i++) {
+                const char *z;
+
+                z = memchr(*p, 0, e - *p);
+                if (!z)
+                        return -EBADMSG;
+
+                l[i] = strdup(*p);
+                if (!l[i])
+                        return -ENOMEM;
+
+                *p = z + 1;
+        }
+
+        *ret = TAKE_PTR(l);
+        return 0;
+}
+
+static int deserialize_pid_placeholder(char **envp, size_t n_envp, int32_t i, char **ret) {
+        char *x, *eq;
+        size_t l;
+
+        if (i < 0) {
+                *ret = NULL;
+                return 0;
+        }
+
+        if ((size_t) i >= n_envp)
+                return -EBADMSG;
+
+        eq = strchr(envp[i], '=');
+        if (!eq)
+                return -EBADMSG;
+
+        /* Make room for the PID of the child, which it fills in itself */
+        l = eq - envp[i] + 1;
+        x = malloc(l + DECIMAL_STR_MAX(pid_t));
+        if (!x)
+                return -ENOMEM;
+
+        memcpy(x, envp[i], l);
+        x[l] = 0;
+        free_and_replace(envp[i], x);
+
+        *ret = envp[i] + l;
+        return 0;
+}
+
+int exec_simple_deserialize(const void *data, size_t size, int *fds, size_t n_fds, ExecSimple *ret) {
+        _cleanup_(exec_simple_done) ExecSimple c = {};
+        _cleanup_strv_free_ char **strings = NULL;
+        const ExecSimpleHeader *h = data;
+        const char *p, *e;
+        struct rlimit **rl;
+        size_t i;
+        int r;
+
+        assert(data || size == 0);
+        assert(fds || n_fds == 0);
+        assert(ret);
+
+        /* Note that the returned object refers to the passed fds, but doesn't own them */
+
+        if (size < sizeof(ExecSimpleHeader))
+                return -EBADMSG;
+        if (h->n_fds != n_fds || (size_t) h->n_socket_fds + h->n_storage_fds > n_fds)
+                return -EBADMSG;
+
+        c = (ExecSimple) {
+                .non_blocking = h->flags & EXEC_SIMPLE_NON_BLOCKING,
+                .same_pgrp = h->flags & EXEC_SIMPLE_SAME_PGRP,
+                .ignore_sigpipe = h->flags & EXEC_SIMPLE_IGNORE_SIGPIPE,
+                .nice_set = h->flags & EXEC_SIMPLE_NICE,
+                .nice = h->nice,
+                .umask = h->umask,
+                .new_keyring = h->flags & EXEC_SIMPLE_NEW_KEYRING,
+                .link_user_keyring = h->flags & EXEC_SIMPLE_LINK_USER_KEYRING,
+                .invocation_id = h->invocation_id,
+                .apply_secure_bits = h->flags & EXEC_SIMPLE_SECURE_BITS,
+                .secure_bits = h->secure_bits,
+                .no_new_privileges = h->flags & EXEC_SIMPLE_NO_NEW_PRIVILEGES,
+                .working_directory_missing_ok = h->flags & EXEC_SIMPLE_WORKING_DIRECTORY_MISSING_OK,
+                .ignore_enoent = h->flags & EXEC_SIMPLE_IGNORE_ENOENT,
+                .n_socket_fds = h->n_socket_fds,
+                .n_storage_fds = h->n_storage_fds,
+        };
+
+        for (i = 0; i < 3; i++) {
+                r = deserialize_fd(h->stdio[i], fds, n_fds, c.stdio + i);
+                if (r < 0)
+                        return r;
+        }
+        r = deserialize_fd(h->socket_fd, fds, n_fds, &c.socket_fd);
+        if (r < 0)
+                return r;
+        r = deserialize_fd(h->exec_fd, fds, n_fds, &c.exec_fd);
+        if (r < 0)
+                return r;
+        r = deserialize_fd(h->cgroup_fd, fds, n_fds, &c.cgroup_fd);
+        if (r < 0)
+                return r;
+
+        if (c.n_socket_fds + c.n_storage_fds > 0) {
+                c.fds = newdup(int, fds, c.n_socket_fds + c.n_storage_fds);
+                if (!c.fds)
+                        return -ENOMEM;
+        }
+
+        p = (const char*) data + sizeof(ExecSimpleHeader);
+        e = (const char*) data + size;
+
+        r = deserialize_strings(&p, e, 5, &strings);
+        if (r < 0)
+                return r;
+        r = deserialize_strings(&p, e, h->n_argv, &c.argv);
+        if (r < 0)
+                return r;
+        r = deserialize_strings(&p, e, h->n_envp, &c.envp);
+        if (r < 0)
+                return r;
+        if (p != e)
+                return -EBADMSG;
+
+        if (isempty(strings[0]) || isempty(strings[1]) || strv_isempty(c.argv))
+                return -EBADMSG;
+
+        c.path = TAKE_PTR(strings[0]);
+        c.working_directory = TAKE_PTR(strings[1]);
+        c.unit_id = TAKE_PTR(strings[2]);
+        c.unit_log_field = TAKE_PTR(strings[3]);
+        c.invocation_log_field = TAKE_PTR(strings[4]);
+
+        r = deserialize_pid_placeholder(c.envp, h->n_envp, h->listen_pid, &c.listen_pid);
+        if (r < 0)
+                return r;
+        r = deserialize_pid_placeholder(c.envp, h->n_envp, h->watchdog_pid, &c.watchdog_pid);
+        if (r < 0)
+                return r;
+
+        if (h->rlimit_set != 0) {
+                rl = new0(struct rlimit*, _RLIMIT_MAX);
+                if (!rl)
+                        return -ENOMEM;
+                c.rlimit = (const struct rlimit* const *) rl;
+
+                for (i = 0; i < _RLIMIT_MAX; i++) {
+                        if (!(h->rlimit_set & (1U << i)))
+                                continue;
+
+                        rl[i] = new(struct rlimit, 1);
+                        if (!rl[i])
+                                return -ENOMEM;
+
+                        *rl[i] = (struct rlimit) {
+                                .rlim_cur = h->rlimit[i].cur,
+                                .rlim_max = h->rlimit[i].max,
+                        };
+                }
+        }
+
+        *ret = c;
+        c = (ExecSimple) {};
+
+        return 0;
+}
+
+void exec_simple_done(ExecSimple *c) {
+        assert(c);
+
+        /* Releases what exec_simple_deserialize() allocated. The ExecSimple objects the manager initializes
+         * itself only borrow their data, and are not to be passed here. */
+
+        free((char*) c->path);
+        free((char*) c->working_directory);
+        free((char*) c->unit_id);
+        free((char*) c->unit_log_field);
+        free((char*) c->invocation_log_field);
+        strv_free(c->argv);
+        strv_free(c->envp);
+        free(c->fds);
+
+        if (c->rlimit) {
+                rlimit_free_all((struct rlimit**) c->rlimit);
+                free((struct rlimit**) c->rlimit);
+        }
+
+        *c = (ExecSimple) {};
+}
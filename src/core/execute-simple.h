@@ -0,0 +1,82 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+#pragma once
+
+#include <stdbool.h>
+#include <sys/resource.h>
+#include <sys/types.h>
+
+#include "sd-id128.h"
+
+#include "macro.h"
+#include "missing.h"
+
+/* A process to spawn, with all its execution settings fully resolved. This covers only what can be done with a
+ * handful of system calls in the child, without allocating memory or taking locks, see exec_spawn_may_vfork(). The
+ * same description is used both for spawning processes directly from the manager with CLONE_VM|CLONE_VFORK, and
+ * for handing them off to systemd-executor. */
+
+/* The special values of ExecSimple.stdio[] */
+#define EXEC_SIMPLE_FD_KEEP (-1)
+
+/* The maximum number of fds passed to systemd-executor in one request */
+#define EXEC_SIMPLE_FDS_MAX 253U
+
+typedef struct ExecSimple {
+        const char *path;
+        char **argv;
+        char **envp;
+        char *listen_pid;       /* Where to write our PID to into $LISTEN_PID and $WATCHDOG_PID, if set */
+        char *watchdog_pid;
+
+        int stdio[3];           /* The fds to install as stdin/stdout/stderr, or EXEC_SIMPLE_FD_KEEP to keep the
+                                 * inherited ones. May refer to a lower standard fd, to duplicate that. */
+        int socket_fd;
+        int *fds;
+        size_t n_socket_fds;
+        size_t n_storage_fds;
+        bool non_blocking;
+        int exec_fd;
+        int cgroup_fd;
+
+        bool same_pgrp;
+        bool ignore_sigpipe;
+        bool nice_set;
+        int nice;
+        mode_t umask;
+
+        bool new_keyring;
+        bool link_user_keyring;
+        sd_id128_t invocation_id;
+
+        const struct rlimit* const *rlimit;
+        bool apply_secure_bits;
+        int secure_bits;
+        bool no_new_privileges;
+
+        const char *working_directory;
+        bool working_directory_missing_ok;
+        bool ignore_enoent;
+
+        /* Log fields identifying the unit, for the log messages of systemd-executor's children */
+        const char *unit_id;
+        const char *unit_log_field;
+        const char *invocation_log_field;
+
+        /* Filled in by the child, if it fails */
+        int error;
+        int exit_status;
+} ExecSimple;
+
+int shift_fds(int fds[], size_t n_fds);
+int flags_fds(const int fds[], size_t n_socket_fds, size_t n_storage_fds, bool nonblock);
+
+int exec_simple_child(ExecSimple *c);
+
+int exec_simple_serialize(const ExecSimple *c, void **ret, size_t *ret_size, int **ret_fds, size_t *ret_n_fds);
+int exec_simple_deserialize(const void *data, size_t size, int *fds, size_t n_fds, ExecSimple *ret);
+void exec_simple_done(ExecSimple *c);
+
+typedef struct ExecSimpleReply {
+        int32_t error;          /* A negative errno, if the process couldn't be spawned */
+        int32_t pid;
+} ExecSimpleReply;
@@ -5,7 +5,9 @@
 #include <glob.h>
 #include <grp.h>
 #include <poll.h>
+#include <sched.h>
 #include <signal.h>
+#include <stdio_ext.h>
 #include <string.h>
 #include <sys/capability.h>
 #include <sys/eventfd.h>
@@ -53,9 +55,11 @@
 #include "env-file.h"
 #include "env-util.h"
 #include "errno-list.h"
+#include "execute-simple.h"
 #include "execute.h"
 #include "exit-status.h"
 #include "fd-util.h"
+#include "fileio.h"
 #include "format-util.h"
 #include "fs-util.h"
 #include "glob-util.h"
@@ -75,15 +79,19 @@
 #include "rm-rf.h"
 #if HAVE_SECCOMP
 #include "seccomp-util.h"
+#else
+typedef struct SeccompCompiledFilter SeccompCompiledFilter;
 #endif
 #include "securebits.h"
 #include "securebits-util.h"
 #include "selinux-util.h"
+#include "serialize.h"
 #include "signal-util.h"
 #include "smack-util.h"
 #include "socket-util.h"
 #include "special.h"
 #include "stat-util.h"
+#include "stdio-util.h"
 #include "string-table.h"
 #include "string-util.h"
 #include "strv.h"
@@ -103,84 +111,6 @@
 
 #define SNDBUF_SIZE (8*1024*1024)
 
-static int shift_fds(int fds[], size_t n_fds) {
-        int start, restart_from;
-
-        if (n_fds <= 0)
-                return 0;
-
-        /* Modifies the fds array! (sorts it) */
-
-        assert(fds);
-
-        start = 0;
-        for (;;) {
-                int i;
-
-                restart_from = -1;
-
-                for (i = start; i < (int) n_fds; i++) {
-                        int nfd;
-
-                        /* Already at right index? */
-                        if (fds[i] == i+3)
-                                continue;
-
-                        nfd = fcntl(fds[i], F_DUPFD, i + 3);
-                        if (nfd < 0)
-                                return -errno;
-
-                        safe_close(fds[i]);
-                        fds[i] = nfd;
-
-                        /* Hmm, the fd we wanted isn't free? Then
-                         * let's remember that and try again from here */
-                        if (nfd != i+3 && restart_from < 0)
-                                restart_from = i;
-                }
-
-                if (restart_from < 0)
-                        break;
-
-                start = restart_from;
-        }
-
-        return 0;
-}
-
-static int flags_fds(const int fds[], size_t n_socket_fds, size_t n_storage_fds, bool nonblock) {
-        size_t i, n_fds;
-        int r;
-
-        n_fds = n_socket_fds + n_storage_fds;
-        if (n_fds <= 0)
-                return 0;
-
-        assert(fds);
-
-        /* Drops/Sets O_NONBLOCK and FD_CLOEXEC from the file flags.
-         * O_NONBLOCK only applies to socket activation though. */
-
-        for (i = 0; i < n_fds; i++) {
-
-                if (i < n_socket_fds) {
-                        r = fd_nonblock(fds[i], nonblock);
-                        if (r < 0)
-                                return r;
-                }
-
-                /* We unconditionally drop FD_CLOEXEC from the fds,
-                 * since after all we want to pass these fds to our
-                 * children */
-
-                r = fd_cloexec(fds[i], false);
-                if (r < 0)
-                        return r;
-        }
-
-        return 0;
-}
-
 static const char *exec_context_tty_path(const ExecContext *context) {
         assert(context);
 
@@ -314,15 +244,15 @@ static int connect_journal_socket(int fd, uid_t uid, gid_t gid) {
         return r;
 }
 
-static int connect_logger_as(
+static int open_logger(
                 const Unit *unit,
                 const ExecContext *context,
                 const ExecParameters *params,
                 ExecOutput output,
                 const char *ident,
-                int nfd,
                 uid_t uid,
-                gid_t gid) {
+                gid_t gid,
+                int socket_flags) {
 
         _cleanup_close_ int fd = -1;
         int r;
@@ -331,9 +261,8 @@ static int connect_logger_as(
         assert(params);
         assert(output < _EXEC_OUTPUT_MAX);
         assert(ident);
-        assert(nfd >= 0);
 
-        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        fd = socket(AF_UNIX, SOCK_STREAM|socket_flags, 0);
         if (fd < 0)
                 return -errno;
 
@@ -363,7 +292,28 @@ static int connect_logger_as(
                 is_terminal_output(output)) < 0)
                 return -errno;
 
-        return move_fd(TAKE_FD(fd), nfd, false);
+        return TAKE_FD(fd);
+}
+
+static int connect_logger_as(
+                const Unit *unit,
+                const ExecContext *context,
+                const ExecParameters *params,
+                ExecOutput output,
+                const char *ident,
+                int nfd,
+                uid_t uid,
+                gid_t gid) {
+
+        int fd;
+
+        assert(nfd >= 0);
+
+        fd = open_logger(unit, context, params, output, ident, uid, gid, 0);
+        if (fd < 0)
+                return fd;
+
+        return move_fd(fd, nfd, false);
 }
 
 static int open_terminal_as(const char *path, int flags, int nfd) {
@@ -1392,16 +1342,9 @@ static bool context_has_syscall_filters(const ExecContext *c) {
                 !hashmap_isempty(c->syscall_filter);
 }
 
-static bool context_has_no_new_privileges(const ExecContext *c) {
+static bool context_has_seccomp(const ExecContext *c) {
         assert(c);
 
-        if (c->no_new_privileges)
-                return true;
-
-        if (have_effective_cap(CAP_SYS_ADMIN)) /* if we are privileged, we don't need NNP */
-                return false;
-
-        /* We need NNP if we have any form of seccomp and are unprivileged */
         return context_has_address_families(c) ||
                 c->memory_deny_write_execute ||
                 c->restrict_realtime ||
@@ -1414,6 +1357,19 @@ static bool context_has_no_new_privileges(const ExecContext *c) {
                 c->lock_personality;
 }
 
+static bool context_has_no_new_privileges(const ExecContext *c) {
+        assert(c);
+
+        if (c->no_new_privileges)
+                return true;
+
+        if (have_effective_cap(CAP_SYS_ADMIN)) /* if we are privileged, we don't need NNP */
+                return false;
+
+        /* We need NNP if we have any form of seccomp and are unprivileged */
+        return context_has_seccomp(c);
+}
+
 #if HAVE_SECCOMP
 
 static bool skip_seccomp_unavailable(const Unit* u, const char* msg) {
@@ -1425,8 +1381,26 @@ static bool skip_seccomp_unavailable(const Unit* u, const char* msg) {
         return true;
 }
 
-static int apply_syscall_filter(const Unit* u, const ExecContext *c, bool needs_ambient_hack) {
-        uint32_t negative_action, default_action, action;
+static void syscall_filter_actions(const ExecContext *c, uint32_t *ret_default_action, uint32_t *ret_action) {
+        uint32_t negative_action;
+
+        assert(c);
+        assert(ret_default_action);
+        assert(ret_action);
+
+        negative_action = c->syscall_errno == 0 ? SCMP_ACT_KILL : SCMP_ACT_ERRNO(c->syscall_errno);
+
+        if (c->syscall_whitelist) {
+                *ret_default_action = negative_action;
+                *ret_action = SCMP_ACT_ALLOW;
+        } else {
+                *ret_default_action = SCMP_ACT_ALLOW;
+                *ret_action = negative_action;
+        }
+}
+
+static int apply_syscall_filter(const Unit* u, const ExecContext *c, bool needs_ambient_hack, const SeccompCompiledFilter *compiled) {
+        uint32_t default_action, action;
         int r;
 
         assert(u);
@@ -1438,15 +1412,11 @@ static int apply_syscall_filter(const Unit* u, const ExecContext *c, bool needs_
         if (skip_seccomp_unavailable(u, "SystemCallFilter="))
                 return 0;
 
-        negative_action = c->syscall_errno == 0 ? SCMP_ACT_KILL : SCMP_ACT_ERRNO(c->syscall_errno);
+        /* If the manager compiled the filter for us already, let's just load that */
+        if (compiled)
+                return seccomp_load_compiled_filter(compiled);
 
-        if (c->syscall_whitelist) {
-                default_action = negative_action;
-                action = SCMP_ACT_ALLOW;
-        } else {
-                default_action = SCMP_ACT_ALLOW;
-                action = negative_action;
-        }
+        syscall_filter_actions(c, &default_action, &action);
 
         if (needs_ambient_hack) {
                 r = seccomp_filter_set_add(c->syscall_filter, c->syscall_whitelist, syscall_filter_sets + SYSCALL_FILTER_SET_SETUID);
@@ -1457,6 +1427,123 @@ static int apply_syscall_filter(const Unit* u, const ExecContext *c, bool needs_
         return seccomp_load_syscall_filter_set_raw(default_action, c->syscall_filter, action, false);
 }
 
+/* The maximum number of compiled system call filters the manager keeps around */
+#define SECCOMP_FILTER_CACHE_MAX 64U
+
+static int syscall_filter_entry_compare(const uint64_t *a, const uint64_t *b) {
+        return CMP(*a, *b);
+}
+
+static int syscall_filter_cache_key(Hashmap *filter, uint32_t default_action, uint32_t action, char **ret) {
+        _cleanup_free_ uint64_t *entries = NULL;
+        _cleanup_fclose_ FILE *f = NULL;
+        _cleanup_free_ char *key = NULL;
+        size_t n = 0, k, size = 0;
+        void *id, *val;
+        Iterator i;
+
+        assert(ret);
+
+        /* Builds a key describing the filter completely, in a canonical order, since the order of the hashmap
+         * depends on the history of insertions and removals */
+
+        entries = new(uint64_t, hashmap_size(filter));
+        if (!entries && !hashmap_isempty(filter))
+                return -ENOMEM;
+
+        HASHMAP_FOREACH_KEY(val, id, filter, i)
+                entries[n++] = (uint64_t) PTR_TO_UINT32(id) << 32 | (uint32_t) PTR_TO_INT(val);
+
+        typesafe_qsort(entries, n, syscall_filter_entry_compare);
+
+        f = open_memstream(&key, &size);
+        if (!f)
+                return -ENOMEM;
+
+        (void) __fsetlocking(f, FSETLOCKING_BYCALLER);
+
+        fprintf(f, "%" PRIx32 " %" PRIx32, default_action, action);
+        for (k = 0; k < n; k++)
+                fprintf(f, " %" PRIx64, entries[k]);
+
+        if (fflush_and_check(f) < 0)
+                return -ENOMEM;
+
+        f = safe_fclose(f);
+
+        *ret = TAKE_PTR(key);
+        return 0;
+}
+
+static int exec_context_compile_syscall_filter(
+                Unit *u,
+                const ExecContext *c,
+                bool needs_ambient_hack,
+                const SeccompCompiledFilter **ret) {
+
+        _cleanup_(seccomp_compiled_filter_freep) SeccompCompiledFilter *compiled = NULL;
+        _cleanup_hashmap_free_ Hashmap *copy = NULL;
+        _cleanup_free_ char *key = NULL;
+        uint32_t default_action, action;
+        Manager *m = u->manager;
+        Hashmap *filter;
+        int r;
+
+        assert(u);
+        assert(c);
+        assert(ret);
+
+        /* Compiling a large system call filter with libseccomp takes a while, and would otherwise be done again in
+         * every forked off child. Hence compile it here in the manager instead, and keep the result around for all
+         * units and invocations with the same filter. */
+
+        if (!context_has_syscall_filters(c) || !is_seccomp_available())
+                return 0;
+
+        syscall_filter_actions(c, &default_action, &action);
+
+        filter = c->syscall_filter;
+        if (needs_ambient_hack) {
+                copy = hashmap_copy(filter);
+                if (!copy && filter)
+                        return -ENOMEM;
+
+                r = seccomp_filter_set_add(copy, c->syscall_whitelist, syscall_filter_sets + SYSCALL_FILTER_SET_SETUID);
+                if (r < 0)
+                        return r;
+
+                filter = copy;
+        }
+
+        r = syscall_filter_cache_key(filter, default_action, action, &key);
+        if (r < 0)
+                return r;
+
+        *ret = hashmap_get(m->seccomp_filter_cache, key);
+        if (*ret)
+                return 1;
+
+        r = seccomp_compile_syscall_filter_set_raw(default_action, filter, action, false, &compiled);
+        if (r < 0)
+                return r;
+
+        /* Units with distinct filters are rare, hence simply start over when there are too many */
+        if (hashmap_size(m->seccomp_filter_cache) >= SECCOMP_FILTER_CACHE_MAX)
+                m->seccomp_filter_cache = exec_seccomp_filter_cache_free(m->seccomp_filter_cache);
+
+        r = hashmap_ensure_allocated(&m->seccomp_filter_cache, &string_hash_ops);
+        if (r < 0)
+                return r;
+
+        r = hashmap_put(m->seccomp_filter_cache, key, compiled);
+        if (r < 0)
+                return r;
+
+        key = NULL;
+        *ret = TAKE_PTR(compiled);
+        return 1;
+}
+
 static int apply_syscall_archs(const Unit *u, const ExecContext *c) {
         assert(u);
         assert(c);
@@ -2370,14 +2457,38 @@ static int apply_mount_namespace(
         _cleanup_strv_free_ char **empty_directories = NULL;
         char *tmp = NULL, *var = NULL;
         const char *root_dir = NULL, *root_image = NULL;
+        _cleanup_close_ int ns_dir_fd = -1;
         NamespaceInfo ns_info;
-        bool needs_sandboxing;
+        bool needs_sandboxing, reuse = false;
         BindMount *bind_mounts = NULL;
         size_t n_bind_mounts = 0;
         int r;
 
+        assert(u);
         assert(context);
 
+        needs_sandboxing = (params->flags & EXEC_APPLY_SANDBOXING) && !(command->flags & EXEC_COMMAND_FULLY_PRIVILEGED);
+
+        /* With ReuseMountNamespace=, join the namespace set up for an earlier process of the unit if there is one,
+         * and otherwise store the one we set up below for the later ones. This is only done for the processes that
+         * get the full set of mounts, all others get a namespace of their own as usual. */
+        if (context->reuse_mount_namespace && u->mount_ns_storage_socket[0] >= 0 &&
+            needs_sandboxing && (params->flags & EXEC_APPLY_CHROOT)) {
+
+                r = mntns_storage_join(u->mount_ns_storage_socket);
+                if (r > 0)
+                        return 0;
+                if (r < 0)
+                        log_unit_debug_errno(u, r, "Failed to join stored mount namespace, setting up a new one: %m");
+                else {
+                        reuse = true;
+
+                        ns_dir_fd = open("/proc/self/ns", O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+                        if (ns_dir_fd < 0)
+                                log_unit_debug_errno(u, errno, "Failed to open /proc/self/ns/, not storing mount namespace: %m");
+                }
+        }
+
         /* The runtime struct only contains the parent of the private /tmp,
          * which is non-accessible to world users. Inside of it there's a /tmp
          * that is sticky, and that's the one we want to use here. */
@@ -2397,10 +2508,12 @@ static int apply_mount_namespace(
         }
 
         r = compile_bind_mounts(context, params, &bind_mounts, &n_bind_mounts, &empty_directories);
-        if (r < 0)
+        if (r < 0) {
+                if (reuse)
+                        (void) mntns_storage_store(u->mount_ns_storage_socket, -1);
                 return r;
+        }
 
-        needs_sandboxing = (params->flags & EXEC_APPLY_SANDBOXING) && !(command->flags & EXEC_COMMAND_FULLY_PRIVILEGED);
         if (needs_sandboxing)
                 ns_info = (NamespaceInfo) {
                         .ignore_protect_paths = false,
@@ -2441,6 +2554,14 @@ static int apply_mount_namespace(
 
         bind_mount_free_many(bind_mounts, n_bind_mounts);
 
+        if (reuse) {
+                int q;
+
+                q = mntns_storage_store(u->mount_ns_storage_socket, r >= 0 ? ns_dir_fd : -1);
+                if (q < 0)
+                        log_unit_debug_errno(u, q, "Failed to store mount namespace, ignoring: %m");
+        }
+
         /* If we couldn't set up the namespace this is probably due to a missing capability. setup_namespace() reports
          * that with a special, recognizable error ENOANO. In this case, silently proceeed, but only if exclusively
          * sandboxing options were used, i.e. nothing such as RootDirectory= or BindMount= that would result in a
@@ -2638,6 +2759,7 @@ static void append_socket_pair(int *array, size_t *n, const int pair[2]) {
 static int close_remaining_fds(
                 const ExecParameters *params,
                 const ExecRuntime *runtime,
+                const int mount_ns_storage_socket[2],
                 const DynamicCreds *dcreds,
                 int user_lookup_fd,
                 int socket_fd,
@@ -2645,7 +2767,7 @@ static int close_remaining_fds(
                 int *fds, size_t n_fds) {
 
         size_t n_dont_close = 0;
-        int dont_close[n_fds + 12];
+        int dont_close[n_fds + 14];
 
         assert(params);
 
@@ -2668,6 +2790,8 @@ static int close_remaining_fds(
         if (runtime)
                 append_socket_pair(dont_close, &n_dont_close, runtime->netns_storage_socket);
 
+        append_socket_pair(dont_close, &n_dont_close, mount_ns_storage_socket);
+
         if (dcreds) {
                 if (dcreds->user)
                         append_socket_pair(dont_close, &n_dont_close, dcreds->user->storage_socket);
@@ -2830,6 +2954,7 @@ static int exec_child(
                 size_t n_storage_fds,
                 char **files_env,
                 int user_lookup_fd,
+                const SeccompCompiledFilter *compiled_syscall_filter,
                 int *exit_status) {
 
         _cleanup_strv_free_ char **our_env = NULL, **pass_env = NULL, **accum_env = NULL, **final_argv = NULL;
@@ -2900,7 +3025,7 @@ static int exec_child(
         closelog();
 
         n_fds = n_socket_fds + n_storage_fds;
-        r = close_remaining_fds(params, runtime, dcreds, user_lookup_fd, socket_fd, params->exec_fd, fds, n_fds);
+        r = close_remaining_fds(params, runtime, unit->mount_ns_storage_socket, dcreds, user_lookup_fd, socket_fd, params->exec_fd, fds, n_fds);
         if (r < 0) {
                 *exit_status = EXIT_FDS;
                 return log_unit_error_errno(unit, r, "Failed to close unwanted file descriptors: %m");
@@ -3539,7 +3664,7 @@ static int exec_child(
 
                 /* This really should remain the last step before the execve(), to make sure our own code is unaffected
                  * by the filter as little as possible. */
-                r = apply_syscall_filter(unit, context, needs_ambient_hack);
+                r = apply_syscall_filter(unit, context, needs_ambient_hack, compiled_syscall_filter);
                 if (r < 0) {
                         *exit_status = EXIT_SECCOMP;
                         return log_unit_error_errno(unit, r, "Failed to apply system call filters: %m");
@@ -3622,70 +3747,601 @@ static int exec_child(
 static int exec_context_load_environment(const Unit *unit, const ExecContext *c, char ***l);
 static int exec_context_named_iofds(const ExecContext *c, const ExecParameters *p, int named_iofds[3]);
 
-int exec_spawn(Unit *unit,
-               ExecCommand *command,
-               const ExecContext *context,
-               const ExecParameters *params,
-               ExecRuntime *runtime,
-               DynamicCreds *dcreds,
-               pid_t *ret) {
+/* The fast path below spawns processes with CLONE_VM|CLONE_VFORK on a small separate stack, instead of fork()ing
+ * the manager. This avoids copying the page tables of the manager (which may be large), and the copy-on-write
+ * faults afterwards, both of which add up when many processes are spawned at once. The child shares the memory of
+ * the manager until it execve()s, hence it must not allocate memory, take locks or change any state of the
+ * manager. Everything is hence prepared by the parent beforehand, and the child only issues a small number of
+ * system calls. This is only supported for simple execution contexts: anything that needs user lookups, PAM,
+ * namespacing, MAC, seccomp or a terminal goes through exec_child() after a regular fork(). */
 
-        int socket_fd, r, named_iofds[3] = { -1, -1, -1 }, *fds = NULL;
-        _cleanup_free_ char *subcgroup_path = NULL;
-        _cleanup_strv_free_ char **files_env = NULL;
-        size_t n_storage_fds = 0, n_socket_fds = 0;
-        _cleanup_free_ char *line = NULL;
-        pid_t pid;
+#define VFORK_STACK_SIZE (64U*1024U)
+
+#define EXECUTOR_TIMEOUT_USEC (5*USEC_PER_SEC)
+
+static void *vfork_stack = NULL;
+
+static bool exec_spawn_may_vfork(
+                Unit *unit,
+                const ExecCommand *command,
+                const ExecContext *context,
+                const ExecParameters *params,
+                const ExecRuntime *runtime,
+                int socket_fd) {
+
+        ExecDirectoryType t;
+        ExecOutput o, e;
+        ExecInput i;
+        int r;
 
         assert(unit);
         assert(command);
         assert(context);
-        assert(ret);
         assert(params);
-        assert(params->fds || (params->n_socket_fds + params->n_storage_fds <= 0));
 
-        if (context->std_input == EXEC_INPUT_SOCKET ||
-            context->std_output == EXEC_OUTPUT_SOCKET ||
-            context->std_error == EXEC_OUTPUT_SOCKET) {
+        r = getenv_bool("SYSTEMD_EXEC_VFORK");
+        if (r == 0)
+                return false;
+        if (r < 0 && r != -ENXIO)
+                log_debug_errno(r, "Failed to parse $SYSTEMD_EXEC_VFORK, ignoring: %m");
 
-                if (params->n_socket_fds > 1) {
-                        log_unit_error(unit, "Got more than one socket.");
-                        return -EINVAL;
-                }
+        if (context->user || context->group || context->dynamic_user ||
+            !strv_isempty(context->supplementary_groups) || context->pam_name)
+                return false;
 
-                if (params->n_socket_fds == 0) {
-                        log_unit_error(unit, "Got no socket.");
-                        return -EINVAL;
-                }
+        if (params->idle_pipe || unit_shall_confirm_spawn(unit))
+                return false;
 
-                socket_fd = params->fds[0];
-        } else {
-                socket_fd = -1;
-                fds = params->fds;
-                n_socket_fds = params->n_socket_fds;
-                n_storage_fds = params->n_storage_fds;
-        }
+        if (params->stdin_fd >= 0 || params->stdout_fd >= 0 || params->stderr_fd >= 0)
+                return false;
 
-        r = exec_context_named_iofds(context, params, named_iofds);
-        if (r < 0)
-                return log_unit_error_errno(unit, r, "Failed to load a named file descriptor: %m");
+        if (is_terminal_input(context->std_input) || context->tty_path ||
+            context->tty_reset || context->tty_vhangup || context->tty_vt_disallocate || context->utmp_id)
+                return false;
 
-        r = exec_context_load_environment(unit, context, &files_env);
-        if (r < 0)
-                return log_unit_error_errno(unit, r, "Failed to load environment files: %m");
+        i = fixup_input(context, socket_fd, params->flags & EXEC_APPLY_TTY_STDIN);
+        if (!IN_SET(i, EXEC_INPUT_NULL, EXEC_INPUT_SOCKET))
+                return false;
 
-        line = exec_command_line(command->argv);
-        if (!line)
-                return log_oom();
+        o = fixup_output(context->std_output, socket_fd);
+        e = fixup_output(context->std_error, socket_fd);
+        if (!IN_SET(o, EXEC_OUTPUT_INHERIT, EXEC_OUTPUT_NULL, EXEC_OUTPUT_SOCKET,
+                    EXEC_OUTPUT_SYSLOG, EXEC_OUTPUT_KMSG, EXEC_OUTPUT_JOURNAL) ||
+            !IN_SET(e, EXEC_OUTPUT_INHERIT, EXEC_OUTPUT_NULL, EXEC_OUTPUT_SOCKET,
+                    EXEC_OUTPUT_SYSLOG, EXEC_OUTPUT_KMSG, EXEC_OUTPUT_JOURNAL))
+                return false;
 
-        log_struct(LOG_DEBUG,
-                   LOG_UNIT_MESSAGE(unit, "About to execute: %s", line),
-                   "EXECUTABLE=%s", command->path,
-                   LOG_UNIT_ID(unit),
-                   LOG_UNIT_INVOCATION_ID(unit));
+        if (context->oom_score_adjust_set || context->cpu_sched_set || context->cpuset || context->ioprio_set ||
+            context->timer_slack_nsec != NSEC_INFINITY || context->personality != PERSONALITY_INVALID)
+                return false;
 
-        if (params->cgroup_path) {
-                r = exec_parameters_get_cgroup_path(params, &subcgroup_path);
+        if (context->root_directory || context->working_directory_home)
+                return false;
+
+        for (t = 0; t < _EXEC_DIRECTORY_TYPE_MAX; t++)
+                if (!strv_isempty(context->directories[t].paths))
+                        return false;
+
+        if (context->private_network || context->private_users ||
+            exec_needs_mount_namespace(context, params, runtime))
+                return false;
+
+        if (command->flags & EXEC_COMMAND_AMBIENT_MAGIC)
+                return false;
+
+        if ((params->flags & EXEC_APPLY_SANDBOXING) && !(command->flags & EXEC_COMMAND_FULLY_PRIVILEGED)) {
+                if (context_has_seccomp(context))
+                        return false;
+
+                if (!cap_test_all(context->capability_bounding_set) || context->capability_ambient_set != 0)
+                        return false;
+
+                if (context->selinux_context || context->apparmor_profile || context->smack_process_label ||
+                    (params->selinux_context_net && socket_fd >= 0))
+                        return false;
+
+#if ENABLE_SMACK
+                if (mac_smack_use())
+                        return false;
+#endif
+        }
+
+        /* On the legacy hierarchies we would have to attach the process to each controller hierarchy */
+        if (params->cgroup_path && cg_all_unified() <= 0)
+                return false;
+
+        return true;
+}
+
+static int prepare_output_vfork(
+                const Unit *unit,
+                const ExecContext *context,
+                const ExecParameters *params,
+                int fileno,
+                ExecOutput o,
+                const char *ident,
+                int socket_fd,
+                int *null_fd,
+                int *logger_fd,
+                dev_t *journal_stream_dev,
+                ino_t *journal_stream_ino) {
+
+        struct stat st;
+        int r;
+
+        assert(null_fd);
+        assert(logger_fd);
+
+        /* Returns the fd the child shall install as the specified stdout or stderr fd */
+
+        switch (o) {
+
+        case EXEC_OUTPUT_SOCKET:
+                assert(socket_fd >= 0);
+                return socket_fd;
+
+        case EXEC_OUTPUT_SYSLOG:
+        case EXEC_OUTPUT_KMSG:
+        case EXEC_OUTPUT_JOURNAL:
+                r = open_logger(unit, context, params, o, ident, UID_INVALID, GID_INVALID, SOCK_CLOEXEC);
+                if (r < 0) {
+                        log_unit_warning_errno(unit, r, "Failed to connect %s to the journal socket, ignoring: %m", fileno == STDOUT_FILENO ? "stdout" : "stderr");
+                        break;
+                }
+
+                *logger_fd = r;
+
+                if (fstat(*logger_fd, &st) >= 0 &&
+                    (*journal_stream_ino == 0 || fileno == STDERR_FILENO)) {
+                        *journal_stream_dev = st.st_dev;
+                        *journal_stream_ino = st.st_ino;
+                }
+
+                return *logger_fd;
+
+        default:
+                assert(IN_SET(o, EXEC_OUTPUT_NULL, EXEC_OUTPUT_INHERIT));
+                break;
+        }
+
+        if (*null_fd < 0) {
+                *null_fd = open("/dev/null", O_WRONLY|O_NOCTTY|O_CLOEXEC);
+                if (*null_fd < 0)
+                        return -errno;
+        }
+
+        return *null_fd;
+}
+
+static int patch_pid_vfork(char **env, const char *prefix, char **ret) {
+        char **e;
+
+        assert(prefix);
+        assert(ret);
+
+        /* build_environment() filled in our own PID, but the child has a different one. Make room for the child's
+         * PID, which it writes in before the execve(). If the variable was overridden by the unit, leave it alone. */
+
+        STRV_FOREACH(e, env) {
+                const char *v;
+                pid_t pid;
+                char *x;
+
+                v = startswith(*e, prefix);
+                if (!v)
+                        continue;
+
+                if (parse_pid(v, &pid) < 0 || pid != getpid_cached())
+                        return 0;
+
+                x = malloc(strlen(prefix) + DECIMAL_STR_MAX(pid_t));
+                if (!x)
+                        return -ENOMEM;
+
+                strcpy(x, prefix);
+                free_and_replace(*e, x);
+
+                *ret = *e + strlen(prefix);
+                return 1;
+        }
+
+        return 0;
+}
+
+static int executor_spawn(int fd, const ExecSimple *c, pid_t *ret) {
+        union {
+                struct cmsghdr cmsghdr;
+                uint8_t buf[CMSG_SPACE(sizeof(int) * EXEC_SIMPLE_FDS_MAX)];
+        } control = {};
+        struct msghdr mh = {};
+        _cleanup_free_ void *buf = NULL;
+        _cleanup_free_ int *fds = NULL;
+        ExecSimpleReply reply;
+        struct iovec iov;
+        size_t size, n_fds;
+        ssize_t n;
+        int r;
+
+        assert(fd >= 0);
+        assert(c);
+        assert(ret);
+
+        r = exec_simple_serialize(c, &buf, &size, &fds, &n_fds);
+        if (r < 0)
+                return r;
+
+        iov = IOVEC_MAKE(buf, size);
+        mh.msg_iov = &iov;
+        mh.msg_iovlen = 1;
+
+        if (n_fds > 0) {
+                struct cmsghdr *cmsg;
+
+                mh.msg_control = &control;
+                mh.msg_controllen = CMSG_SPACE(sizeof(int) * n_fds);
+
+                cmsg = CMSG_FIRSTHDR(&mh);
+                cmsg->cmsg_level = SOL_SOCKET;
+                cmsg->cmsg_type = SCM_RIGHTS;
+                cmsg->cmsg_len = CMSG_LEN(sizeof(int) * n_fds);
+                memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * n_fds);
+        }
+
+        if (sendmsg(fd, &mh, MSG_NOSIGNAL) < 0)
+                return -errno;
+
+        /* systemd-executor only forks off the child from its own small address space, and replies right away */
+        r = fd_wait_for_event(fd, POLLIN, EXECUTOR_TIMEOUT_USEC);
+        if (r < 0)
+                return r;
+        if (r == 0)
+                return -ETIMEDOUT;
+
+        n = recv(fd, &reply, sizeof(reply), 0);
+        if (n < 0)
+                return -errno;
+        if (n == 0)
+                return -ECONNRESET;
+        if (n != sizeof(reply))
+                return -EIO;
+
+        if (reply.error < 0)
+                return reply.error;
+        if (reply.pid <= 0)
+                return -EIO;
+
+        *ret = reply.pid;
+        return 0;
+}
+
+static int exec_vfork_child(void *userdata) {
+        ExecSimple *c = userdata;
+
+        (void) exec_simple_child(c);
+        _exit(c->exit_status);
+}
+
+static int exec_spawn_vfork(
+                Unit *unit,
+                ExecCommand *command,
+                const ExecContext *context,
+                const ExecParameters *params,
+                int socket_fd,
+                int *fds,
+                size_t n_socket_fds,
+                size_t n_storage_fds,
+                char **files_env,
+                const char *cgroup_path,
+                pid_t *ret) {
+
+        _cleanup_strv_free_ char **our_env = NULL, **pass_env = NULL, **accum_env = NULL, **final_argv = NULL;
+        _cleanup_close_ int null_in = -1, null_out = -1, stdout_logger = -1, stderr_logger = -1, cgroup_fd = -1;
+        dev_t journal_stream_dev = 0;
+        ino_t journal_stream_ino = 0;
+        sigset_t ss, saved_ss;
+        const char *ident;
+        ExecSimple c;
+        ExecOutput o, e;
+        ExecInput i;
+        size_t n_fds;
+        pid_t pid;
+        char **a;
+        int r;
+
+        assert(unit);
+        assert(command);
+        assert(context);
+        assert(params);
+        assert(ret);
+
+        n_fds = n_socket_fds + n_storage_fds;
+
+        c = (ExecSimple) {
+                .path = command->path,
+                .stdio = { -1, -1, -1 },
+                .socket_fd = socket_fd,
+                /* The child rearranges the fds in the array, but must not modify ours */
+                .fds = n_fds > 0 ? newa(int, n_fds) : NULL,
+                .n_socket_fds = n_socket_fds,
+                .n_storage_fds = n_storage_fds,
+                .non_blocking = context->non_blocking,
+                .exec_fd = params->exec_fd,
+                .cgroup_fd = -1,
+                .same_pgrp = context->same_pgrp,
+                .ignore_sigpipe = context->ignore_sigpipe,
+                .nice_set = context->nice_set,
+                .nice = context->nice,
+                .umask = context->umask,
+                .new_keyring = (params->flags & EXEC_NEW_KEYRING) && context->keyring_mode != EXEC_KEYRING_INHERIT,
+                .link_user_keyring = context->keyring_mode == EXEC_KEYRING_SHARED,
+                .invocation_id = unit->invocation_id,
+                .working_directory = context->working_directory ?: "/",
+                .working_directory_missing_ok = context->working_directory_missing_ok,
+                .ignore_enoent = command->flags & EXEC_COMMAND_IGNORE_FAILURE,
+        };
+        memcpy_safe(c.fds, fds, n_fds * sizeof(int));
+
+        if ((params->flags & EXEC_APPLY_SANDBOXING) && !(command->flags & EXEC_COMMAND_FULLY_PRIVILEGED)) {
+                c.rlimit = (const struct rlimit* const *) context->rlimit;
+                c.apply_secure_bits = true;
+                c.secure_bits = context->secure_bits;
+                c.no_new_privileges = context_has_no_new_privileges(context);
+        }
+
+        /* Set up the standard fds the same way setup_input() and setup_output() would */
+        i = fixup_input(context, socket_fd, params->flags & EXEC_APPLY_TTY_STDIN);
+        o = fixup_output(context->std_output, socket_fd);
+        e = fixup_output(context->std_error, socket_fd);
+        ident = basename(command->path);
+
+        if (i == EXEC_INPUT_SOCKET)
+                c.stdio[STDIN_FILENO] = socket_fd;
+        else {
+                null_in = open("/dev/null", O_RDONLY|O_NOCTTY|O_CLOEXEC);
+                if (null_in < 0)
+                        return log_unit_error_errno(unit, errno, "Failed to open /dev/null: %m");
+
+                c.stdio[STDIN_FILENO] = null_in;
+        }
+
+        if (o == EXEC_OUTPUT_INHERIT && i == EXEC_INPUT_SOCKET)
+                c.stdio[STDOUT_FILENO] = socket_fd;
+        else if (o != EXEC_OUTPUT_INHERIT || getpid_cached() == 1) {
+                r = prepare_output_vfork(unit, context, params, STDOUT_FILENO, o, ident, socket_fd,
+                                         &null_out, &stdout_logger, &journal_stream_dev, &journal_stream_ino);
+                if (r < 0)
+                        return log_unit_error_errno(unit, r, "Failed to set up standard output: %m");
+
+                c.stdio[STDOUT_FILENO] = r;
+        }
+
+        if (e == EXEC_OUTPUT_INHERIT && o == EXEC_OUTPUT_INHERIT && i == EXEC_INPUT_NULL && getpid_cached() != 1)
+                ; /* Keep the stderr of the manager */
+        else if (can_inherit_stderr_from_stdout(context, o, e))
+                c.stdio[STDERR_FILENO] = STDOUT_FILENO;
+        else {
+                r = prepare_output_vfork(unit, context, params, STDERR_FILENO, e, ident, socket_fd,
+                                         &null_out, &stderr_logger, &journal_stream_dev, &journal_stream_ino);
+                if (r < 0)
+                        return log_unit_error_errno(unit, r, "Failed to set up standard error output: %m");
+
+                c.stdio[STDERR_FILENO] = r;
+        }
+
+        if (cgroup_path) {
+                _cleanup_free_ char *fn = NULL;
+
+                r = cg_get_path(SYSTEMD_CGROUP_CONTROLLER, cgroup_path, "cgroup.procs", &fn);
+                if (r < 0)
+                        return log_unit_error_errno(unit, r, "Failed to determine path of control group '%s': %m", cgroup_path);
+
+                cgroup_fd = open(fn, O_WRONLY|O_CLOEXEC|O_NOCTTY);
+                if (cgroup_fd < 0)
+                        return log_unit_error_errno(unit, errno, "Failed to open %s: %m", fn);
+
+                c.cgroup_fd = cgroup_fd;
+        }
+
+        r = build_environment(unit, context, params, n_fds, NULL, NULL, NULL,
+                              journal_stream_dev, journal_stream_ino, &our_env);
+        if (r < 0)
+                return log_oom();
+
+        r = build_pass_environment(context, &pass_env);
+        if (r < 0)
+                return log_oom();
+
+        accum_env = strv_env_merge(5,
+                                   params->environment,
+                                   our_env,
+                                   pass_env,
+                                   context->environment,
+                                   files_env,
+                                   NULL);
+        if (!accum_env)
+                return log_oom();
+        accum_env = strv_env_clean(accum_env);
+
+        if (!strv_isempty(context->unset_environment)) {
+                char **ee;
+
+                ee = strv_env_delete(accum_env, 1, context->unset_environment);
+                if (!ee)
+                        return log_oom();
+
+                strv_free_and_replace(accum_env, ee);
+        }
+
+        r = patch_pid_vfork(accum_env, "LISTEN_PID=", &c.listen_pid);
+        if (r >= 0)
+                r = patch_pid_vfork(accum_env, "WATCHDOG_PID=", &c.watchdog_pid);
+        if (r < 0)
+                return log_oom();
+
+        /* The command line would be expanded with our own PID otherwise */
+        if (c.listen_pid || c.watchdog_pid)
+                STRV_FOREACH(a, command->argv)
+                        if (strstr(*a, "LISTEN_PID") || strstr(*a, "WATCHDOG_PID"))
+                                return -EOPNOTSUPP;
+
+        final_argv = replace_env_argv(command->argv, accum_env);
+        if (!final_argv)
+                return log_oom();
+
+        if (DEBUG_LOGGING) {
+                _cleanup_free_ char *line;
+
+                line = exec_command_line(final_argv);
+                if (line)
+                        log_struct(LOG_DEBUG,
+                                   "EXECUTABLE=%s", command->path,
+                                   LOG_UNIT_MESSAGE(unit, "Executing: %s", line),
+                                   LOG_UNIT_ID(unit),
+                                   LOG_UNIT_INVOCATION_ID(unit));
+        }
+
+        c.argv = final_argv;
+        c.envp = accum_env;
+
+        if (manager_get_executor(unit->manager) >= 0) {
+                c.unit_id = unit->id;
+                c.unit_log_field = strjoina(unit->manager->unit_log_field, unit->id);
+                c.invocation_log_field = strjoina(unit->manager->invocation_log_field, unit->invocation_id_string);
+
+                r = executor_spawn(unit->manager->executor_fd, &c, &pid);
+                if (r >= 0) {
+                        log_unit_debug(unit, "Spawned %s as "PID_FMT" via systemd-executor", command->path, pid);
+
+                        *ret = pid;
+                        return 0;
+                }
+                if (IN_SET(r, -E2BIG, -EMSGSIZE))
+                        log_unit_debug_errno(unit, r, "Request to spawn %s is too large for systemd-executor, spawning directly: %m", command->path);
+                else {
+                        log_unit_warning_errno(unit, r, "Failed to spawn %s via systemd-executor, no longer using it: %m", command->path);
+                        manager_drop_executor(unit->manager);
+                }
+        }
+
+        /* The stack is only used while we wait for the child, hence a single one suffices, and we keep it around
+         * for the next time */
+        if (!vfork_stack) {
+                void *p;
+
+                p = mmap(NULL, VFORK_STACK_SIZE, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_STACK, -1, 0);
+                if (p == MAP_FAILED)
+                        return log_unit_error_errno(unit, errno, "Failed to allocate stack for child process: %m");
+
+                /* Turn the lowest page into a guard page */
+                (void) mprotect(p, page_size(), PROT_NONE);
+
+                vfork_stack = p;
+        }
+
+        assert_se(sigfillset(&ss) >= 0);
+        assert_se(sigprocmask(SIG_SETMASK, &ss, &saved_ss) >= 0);
+
+        /* With CLONE_VFORK this returns only after the child called execve() or exited */
+        pid = clone(exec_vfork_child, (uint8_t*) vfork_stack + VFORK_STACK_SIZE, CLONE_VM|CLONE_VFORK|SIGCHLD, &c);
+        r = pid < 0 ? -errno : 0;
+
+        assert_se(sigprocmask(SIG_SETMASK, &saved_ss, NULL) >= 0);
+
+        if (r < 0)
+                return log_unit_error_errno(unit, r, "Failed to clone: %m");
+
+        if (c.error == -ENOENT && c.exit_status == EXIT_SUCCESS)
+                log_struct_errno(LOG_INFO, c.error,
+                                 "MESSAGE_ID=" SD_MESSAGE_SPAWN_FAILED_STR,
+                                 LOG_UNIT_ID(unit),
+                                 LOG_UNIT_INVOCATION_ID(unit),
+                                 LOG_UNIT_MESSAGE(unit, "Executable %s missing, skipping: %m",
+                                                  command->path),
+                                 "EXECUTABLE=%s", command->path);
+        else if (c.error < 0)
+                log_struct_errno(LOG_ERR, c.error,
+                                 "MESSAGE_ID=" SD_MESSAGE_SPAWN_FAILED_STR,
+                                 LOG_UNIT_ID(unit),
+                                 LOG_UNIT_INVOCATION_ID(unit),
+                                 LOG_UNIT_MESSAGE(unit, "Failed at step %s spawning %s: %m",
+                                                  exit_status_to_string(c.exit_status, EXIT_STATUS_SYSTEMD),
+                                                  command->path),
+                                 "EXECUTABLE=%s", command->path);
+
+        log_unit_debug(unit, "Spawned %s as "PID_FMT" without forking", command->path, pid);
+
+        *ret = pid;
+        return 0;
+}
+
+int exec_spawn(Unit *unit,
+               ExecCommand *command,
+               const ExecContext *context,
+               const ExecParameters *params,
+               ExecRuntime *runtime,
+               DynamicCreds *dcreds,
+               pid_t *ret) {
+
+        int socket_fd, r, named_iofds[3] = { -1, -1, -1 }, *fds = NULL;
+        _cleanup_free_ char *subcgroup_path = NULL;
+        _cleanup_strv_free_ char **files_env = NULL;
+        size_t n_storage_fds = 0, n_socket_fds = 0;
+        const SeccompCompiledFilter *compiled_syscall_filter = NULL;
+        _cleanup_free_ char *line = NULL;
+        usec_t begin;
+        pid_t pid;
+
+        assert(unit);
+        assert(command);
+        assert(context);
+        assert(ret);
+        assert(params);
+        assert(params->fds || (params->n_socket_fds + params->n_storage_fds <= 0));
+
+        begin = now(CLOCK_MONOTONIC);
+
+        if (context->std_input == EXEC_INPUT_SOCKET ||
+            context->std_output == EXEC_OUTPUT_SOCKET ||
+            context->std_error == EXEC_OUTPUT_SOCKET) {
+
+                if (params->n_socket_fds > 1) {
+                        log_unit_error(unit, "Got more than one socket.");
+                        return -EINVAL;
+                }
+
+                if (params->n_socket_fds == 0) {
+                        log_unit_error(unit, "Got no socket.");
+                        return -EINVAL;
+                }
+
+                socket_fd = params->fds[0];
+        } else {
+                socket_fd = -1;
+                fds = params->fds;
+                n_socket_fds = params->n_socket_fds;
+                n_storage_fds = params->n_storage_fds;
+        }
+
+        r = exec_context_named_iofds(context, params, named_iofds);
+        if (r < 0)
+                return log_unit_error_errno(unit, r, "Failed to load a named file descriptor: %m");
+
+        r = exec_context_load_environment(unit, context, &files_env);
+        if (r < 0)
+                return log_unit_error_errno(unit, r, "Failed to load environment files: %m");
+
+        line = exec_command_line(command->argv);
+        if (!line)
+                return log_oom();
+
+        log_struct(LOG_DEBUG,
+                   LOG_UNIT_MESSAGE(unit, "About to execute: %s", line),
+                   "EXECUTABLE=%s", command->path,
+                   LOG_UNIT_ID(unit),
+                   LOG_UNIT_INVOCATION_ID(unit));
+
+        if (params->cgroup_path) {
+                r = exec_parameters_get_cgroup_path(params, &subcgroup_path);
                 if (r < 0)
                         return log_unit_error_errno(unit, r, "Failed to acquire subcgroup path: %m");
                 if (r > 0) { /* We are using a child cgroup */
@@ -3695,6 +4351,25 @@ int exec_spawn(Unit *unit,
                 }
         }
 
+        if (exec_spawn_may_vfork(unit, command, context, params, runtime, socket_fd)) {
+                r = exec_spawn_vfork(unit, command, context, params, socket_fd, fds, n_socket_fds, n_storage_fds,
+                                     files_env, subcgroup_path, &pid);
+                if (r >= 0)
+                        goto finish;
+                if (r != -EOPNOTSUPP)
+                        return r;
+        }
+
+#if HAVE_SECCOMP
+        if ((params->flags & EXEC_APPLY_SANDBOXING) && !(command->flags & EXEC_COMMAND_FULLY_PRIVILEGED)) {
+                r = exec_context_compile_syscall_filter(unit, context,
+                                                        (command->flags & EXEC_COMMAND_AMBIENT_MAGIC) && !ambient_capabilities_supported(),
+                                                        &compiled_syscall_filter);
+                if (r < 0) /* The child will compile it on its own then */
+                        log_unit_debug_errno(unit, r, "Failed to compile system call filter, ignoring: %m");
+        }
+#endif
+
         pid = fork();
         if (pid < 0)
                 return log_unit_error_errno(unit, errno, "Failed to fork: %m");
@@ -3715,6 +4390,7 @@ int exec_spawn(Unit *unit,
                                n_storage_fds,
                                files_env,
                                unit->manager->user_lookup_fds[1],
+                               compiled_syscall_filter,
                                &exit_status);
 
                 if (r < 0)
@@ -3732,6 +4408,7 @@ int exec_spawn(Unit *unit,
 
         log_unit_debug(unit, "Forked %s as "PID_FMT, command->path, pid);
 
+finish:
         /* We add the new process to the cgroup both in the child (so that we can be sure that no user code is ever
          * executed outside of the cgroup) and in the parent (so that we can be sure that when we kill the cgroup the
          * process will be killed too). */
@@ -3740,10 +4417,26 @@ int exec_spawn(Unit *unit,
 
         exec_status_start(&command->exec_status, pid);
 
+        unit_add_latency(unit, UNIT_LATENCY_SPAWN, usec_sub_unsigned(now(CLOCK_MONOTONIC), begin));
+
         *ret = pid;
         return 0;
 }
 
+Hashmap *exec_seccomp_filter_cache_free(Hashmap *cache) {
+#if HAVE_SECCOMP
+        SeccompCompiledFilter *f;
+        void *key;
+
+        while ((f = hashmap_steal_first_key_and_value(cache, &key))) {
+                seccomp_compiled_filter_free(f);
+                free(key);
+        }
+#endif
+
+        return hashmap_free(cache);
+}
+
 void exec_context_init(ExecContext *c) {
         ExecDirectoryType i;
 
@@ -3776,6 +4469,10 @@ void exec_context_done(ExecContext *c) {
         c->pass_environment = strv_free(c->pass_environment);
         c->unset_environment = strv_free(c->unset_environment);
 
+        for (l = 0; l < _RLIMIT_MAX; l++)
+                if (exec_context_rlimit_is_shared(c, l))
+                        c->rlimit[l] = NULL;
+        c->shared_rlimits = exec_shared_rlimits_unref(c->shared_rlimits);
         rlimit_free_all(c->rlimit);
 
         for (l = 0; l < 3; l++) {
@@ -4137,6 +4834,7 @@ void exec_context_dump(const ExecContext *c, FILE* f, const char *prefix) {
                 "%sProtectHome: %s\n"
                 "%sProtectSystem: %s\n"
                 "%sMountAPIVFS: %s\n"
+                "%sReuseMountNamespace: %s\n"
                 "%sIgnoreSIGPIPE: %s\n"
                 "%sMemoryDenyWriteExecute: %s\n"
                 "%sRestrictRealtime: %s\n"
@@ -4155,6 +4853,7 @@ void exec_context_dump(const ExecContext *c, FILE* f, const char *prefix) {
                 prefix, protect_home_to_string(c->protect_home),
                 prefix, protect_system_to_string(c->protect_system),
                 prefix, yes_no(c->mount_apivfs),
+                prefix, yes_no(c->reuse_mount_namespace),
                 prefix, yes_no(c->ignore_sigpipe),
                 prefix, yes_no(c->memory_deny_write_execute),
                 prefix, yes_no(c->restrict_realtime),
@@ -4563,6 +5262,61 @@ void exec_context_free_log_extra_fields(ExecContext *c) {
         c->n_log_extra_fields = 0;
 }
 
+ExecSharedRlimits *exec_shared_rlimits_new(struct rlimit *const *rlimit) {
+        ExecSharedRlimits *s;
+        int i;
+
+        assert(rlimit);
+
+        s = new0(ExecSharedRlimits, 1);
+        if (!s)
+                return NULL;
+
+        s->n_ref = 1;
+
+        for (i = 0; i < _RLIMIT_MAX; i++)
+                if (rlimit[i])
+                        s->rlimit[i] = *rlimit[i];
+
+        return s;
+}
+
+DEFINE_TRIVIAL_REF_UNREF_FUNC(ExecSharedRlimits, exec_shared_rlimits, mfree);
+
+int exec_context_unshare_rlimit(ExecContext *c, int resource) {
+        struct rlimit *rl;
+
+        assert(c);
+        assert(resource >= 0 && resource < _RLIMIT_MAX);
+
+        /* Gives the context its own copy of the limit, so that it may be modified */
+
+        if (!exec_context_rlimit_is_shared(c, resource))
+                return 0;
+
+        rl = newdup(struct rlimit, c->rlimit[resource], 1);
+        if (!rl)
+                return -ENOMEM;
+
+        c->rlimit[resource] = rl;
+        return 1;
+}
+
+size_t exec_context_rlimit_memory_usage(const ExecContext *c) {
+        size_t sum = 0;
+        int i;
+
+        assert(c);
+
+        /* Returns the memory used by the limits that are not shared with the manager's defaults */
+
+        for (i = 0; i < _RLIMIT_MAX; i++)
+                if (c->rlimit[i] && !exec_context_rlimit_is_shared(c, i))
+                        sum += sizeof(struct rlimit);
+
+        return sum;
+}
+
 void exec_status_start(ExecStatus *s, pid_t pid) {
         assert(s);
 
@@ -4943,6 +5697,16 @@ ref:
         return 1;
 }
 
+ExecRuntime *exec_runtime_ref(ExecRuntime *rt) {
+        if (!rt)
+                return NULL;
+
+        assert(rt->n_ref > 0);
+        rt->n_ref++;
+
+        return rt;
+}
+
 ExecRuntime *exec_runtime_unref(ExecRuntime *rt, bool destroy) {
         if (!rt)
                 return NULL;
@@ -4965,35 +5729,44 @@ int exec_runtime_serialize(const Manager *m, FILE *f, FDSet *fds) {
         assert(fds);
 
         HASHMAP_FOREACH(rt, m->exec_runtime_by_id, i) {
-                fprintf(f, "exec-runtime=%s", rt->id);
+                _cleanup_free_ char *v = NULL;
+                int copy;
 
-                if (rt->tmp_dir)
-                        fprintf(f, " tmp-dir=%s", rt->tmp_dir);
+                v = strdup(rt->id);
+                if (!v)
+                        return log_oom();
 
-                if (rt->var_tmp_dir)
-                        fprintf(f, " var-tmp-dir=%s", rt->var_tmp_dir);
+                if (rt->tmp_dir && !strextend(&v, " tmp-dir=", rt->tmp_dir, NULL))
+                        return log_oom();
+
+                if (rt->var_tmp_dir && !strextend(&v, " var-tmp-dir=", rt->var_tmp_dir, NULL))
+                        return log_oom();
 
                 if (rt->netns_storage_socket[0] >= 0) {
-                        int copy;
+                        char buf[DECIMAL_STR_MAX(int)];
 
                         copy = fdset_put_dup(fds, rt->netns_storage_socket[0]);
                         if (copy < 0)
                                 return copy;
 
-                        fprintf(f, " netns-socket-0=%i", copy);
+                        xsprintf(buf, "%i", copy);
+                        if (!strextend(&v, " netns-socket-0=", buf, NULL))
+                                return log_oom();
                 }
 
                 if (rt->netns_storage_socket[1] >= 0) {
-                        int copy;
+                        char buf[DECIMAL_STR_MAX(int)];
 
                         copy = fdset_put_dup(fds, rt->netns_storage_socket[1]);
                         if (copy < 0)
                                 return copy;
 
-                        fprintf(f, " netns-socket-1=%i", copy);
+                        xsprintf(buf, "%i", copy);
+                        if (!strextend(&v, " netns-socket-1=", buf, NULL))
+                                return log_oom();
                 }
 
-                fputc('\n', f);
+                (void) serialize_item(f, "exec-runtime", v);
         }
 
         return 0;
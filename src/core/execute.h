@@ -136,6 +136,18 @@ typedef struct ExecDirectory {
         mode_t mode;
 } ExecDirectory;
 
+/* The default resource limits of the manager, in a block that the execution contexts of all units that don't
+ * override a limit point into, instead of each getting their own copy. Immutable once allocated, a new block is
+ * allocated when the defaults change. Only the entries that are set in the manager's defaults are initialized. */
+typedef struct ExecSharedRlimits {
+        unsigned n_ref;
+        struct rlimit rlimit[_RLIMIT_MAX];
+} ExecSharedRlimits;
+
+ExecSharedRlimits *exec_shared_rlimits_new(struct rlimit *const *rlimit);
+ExecSharedRlimits *exec_shared_rlimits_ref(ExecSharedRlimits *s);
+ExecSharedRlimits *exec_shared_rlimits_unref(ExecSharedRlimits *s);
+
 /* Encodes configuration parameters applied to invoked commands. Does not carry runtime data, but only configuration
  * changes sourced from unit files and suchlike. ExecContext objects are usually embedded into Unit objects, and do not
  * change after being loaded. */
@@ -146,6 +158,7 @@ struct ExecContext {
         char **unset_environment;
 
         struct rlimit *rlimit[_RLIMIT_MAX];
+        ExecSharedRlimits *shared_rlimits; /* The entries of rlimit[] pointing into this are not ours */
         char *working_directory, *root_directory, *root_image;
         bool working_directory_missing_ok;
         bool working_directory_home;
@@ -235,6 +248,7 @@ struct ExecContext {
         bool private_devices;
         bool private_users;
         bool private_mounts;
+        bool reuse_mount_namespace;
         ProtectSystem protect_system;
         ProtectHome protect_home;
         bool protect_kernel_tunables;
@@ -279,6 +293,12 @@ struct ExecContext {
         bool cpu_sched_set:1;
 };
 
+static inline bool exec_context_rlimit_is_shared(const ExecContext *c, int resource) {
+        assert(c);
+
+        return c->shared_rlimits && c->rlimit[resource] == c->shared_rlimits->rlimit + resource;
+}
+
 static inline bool exec_context_restrict_namespaces_set(const ExecContext *c) {
         assert(c);
 
@@ -371,12 +391,18 @@ int exec_context_get_effective_ioprio(const ExecContext *c);
 
 void exec_context_free_log_extra_fields(ExecContext *c);
 
+Hashmap *exec_seccomp_filter_cache_free(Hashmap *cache);
+
+int exec_context_unshare_rlimit(ExecContext *c, int resource);
+size_t exec_context_rlimit_memory_usage(const ExecContext *c) _pure_;
+
 void exec_status_start(ExecStatus *s, pid_t pid);
 void exec_status_exit(ExecStatus *s, const ExecContext *context, pid_t pid, int code, int status);
 void exec_status_dump(const ExecStatus *s, FILE *f, const char *prefix);
 void exec_status_reset(ExecStatus *s);
 
 int exec_runtime_acquire(Manager *m, const ExecContext *c, const char *name, bool create, ExecRuntime **ret);
+ExecRuntime *exec_runtime_ref(ExecRuntime *r);
 ExecRuntime *exec_runtime_unref(ExecRuntime *r, bool destroy);
 
 int exec_runtime_serialize(const Manager *m, FILE *f, FDSet *fds);
@@ -0,0 +1,152 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+/* A small helper process that the service manager hands off the spawning of processes with simple execution
+ * settings to, see exec_spawn(). It receives ExecSimple objects on the socket passed in as fd 3, and spawns each of
+ * them as a child of the manager, so that the manager doesn't have to fork() its own, much larger, address
+ * space. It exits as soon as the manager closes its end of the socket. */
+
+#include <errno.h>
+#include <sched.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "sd-daemon.h"
+#include "sd-messages.h"
+
+#include "alloc-util.h"
+#include "execute-simple.h"
+#include "exit-status.h"
+#include "fd-util.h"
+#include "io-util.h"
+#include "log.h"
+#include "process-util.h"
+#include "raw-clone.h"
+#include "socket-util.h"
+
+static int spawn_one(ExecSimple *c, pid_t *ret) {
+        pid_t pid;
+
+        assert(c);
+        assert(ret);
+
+        /* Make the child a child of the manager, so that the manager gets its SIGCHLD and reaps it, just like the
+         * ones it forks off itself. */
+        pid = raw_clone(SIGCHLD|CLONE_PARENT);
+        if (pid < 0)
+                return -errno;
+        if (pid == 0) {
+                reset_cached_pid();
+
+                (void) exec_simple_child(c);
+
+                if (c->error == -ENOENT && c->exit_status == EXIT_SUCCESS)
+                        log_struct_errno(LOG_INFO, c->error,
+                                         "MESSAGE_ID=" SD_MESSAGE_SPAWN_FAILED_STR,
+                                         "%s", c->unit_log_field,
+                                         "%s", c->invocation_log_field,
+                                         "MESSAGE=%s: Executable %s missing, skipping: %m", c->unit_id, c->path,
+                                         "EXECUTABLE=%s", c->path);
+                else
+                        log_struct_errno(LOG_ERR, c->error,
+                                         "MESSAGE_ID=" SD_MESSAGE_SPAWN_FAILED_STR,
+                                         "%s", c->unit_log_field,
+                                         "%s", c->invocation_log_field,
+                                         "MESSAGE=%s: Failed at step %s spawning %s: %m", c->unit_id,
+                                         exit_status_to_string(c->exit_status, EXIT_STATUS_SYSTEMD), c->path,
+                                         "EXECUTABLE=%s", c->path);
+
+                _exit(c->exit_status);
+        }
+
+        *ret = pid;
+        return 0;
+}
+
+static int process_one(int fd) {
+        union {
+                struct cmsghdr cmsghdr;
+                uint8_t buf[CMSG_SPACE(sizeof(int) * EXEC_SIMPLE_FDS_MAX)];
+        } control = {};
+        struct msghdr mh = {
+                .msg_control = &control,
+                .msg_controllen = sizeof(control),
+        };
+        _cleanup_(exec_simple_done) ExecSimple c = {};
+        ExecSimpleReply reply;
+        _cleanup_free_ void *buf = NULL;
+        struct cmsghdr *cmsg;
+        struct iovec iov;
+        int *fds = NULL;
+        size_t n_fds = 0;
+        pid_t pid = 0;
+        ssize_t n;
+        int r;
+
+        n = next_datagram_size_fd(fd);
+        if (n < 0)
+                return log_error_errno(n, "Failed to determine size of next request: %m");
+        if (n == 0) /* The manager closed its end */
+                return 0;
+
+        buf = malloc(n);
+        if (!buf)
+                return log_oom();
+
+        iov = IOVEC_MAKE(buf, n);
+        mh.msg_iov = &iov;
+        mh.msg_iovlen = 1;
+
+        n = recvmsg(fd, &mh, MSG_CMSG_CLOEXEC);
+        if (n < 0)
+                return log_error_errno(errno, "Failed to receive request: %m");
+
+        CMSG_FOREACH(cmsg, &mh)
+                if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+                        assert(!fds);
+                        fds = (int*) CMSG_DATA(cmsg);
+                        n_fds = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+                }
+
+        if (mh.msg_flags & (MSG_TRUNC|MSG_CTRUNC))
+                r = -EMSGSIZE;
+        else
+                r = exec_simple_deserialize(buf, n, fds, n_fds, &c);
+        if (r < 0)
+                log_error_errno(r, "Failed to parse request: %m");
+        else {
+                r = spawn_one(&c, &pid);
+                if (r < 0)
+                        log_error_errno(r, "Failed to spawn %s: %m", c.path);
+        }
+
+        close_many(fds, n_fds);
+
+        reply = (ExecSimpleReply) {
+                .error = MIN(r, 0),
+                .pid = r < 0 ? 0 : pid,
+        };
+
+        if (send(fd, &reply, sizeof(reply), MSG_NOSIGNAL) < 0)
+                return log_error_errno(errno, "Failed to send reply: %m");
+
+        return 1;
+}
+
+int main(int argc, char *argv[]) {
+        int r;
+
+        log_set_target(LOG_TARGET_AUTO);
+        log_parse_environment();
+        log_open();
+
+        if (argc != 1) {
+                log_error("This program takes no arguments.");
+                return EXIT_FAILURE;
+        }
+
+        do
+                r = process_one(SD_LISTEN_FDS_START);
+        while (r > 0);
+
+        return r < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,150 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+
+#include "alloc-util.h"
+#include "conf-files.h"
+#include "env-util.h"
+#include "fd-util.h"
+#include "fileio.h"
+#include "generator-cache.h"
+#include "log.h"
+#include "proc-cmdline.h"
+#include "siphash24.h"
+#include "string-util.h"
+#include "strv.h"
+
+/* The digest is only compared within the same process, hence any fixed key will do */
+static const uint8_t generator_digest_key[16] = {
+        0x63, 0x14, 0x9a, 0x2d, 0x5e, 0xb0, 0x47, 0x81,
+        0xc6, 0x3f, 0x72, 0xe9, 0x08, 0xd5, 0x1b, 0xa4,
+};
+
+static void digest_string(struct siphash *state, const char *s) {
+        /* Include the NUL byte, or a marker for NULL, so that consecutive strings can't be shifted into each other */
+        if (s)
+                siphash24_compress(s, strlen(s) + 1, state);
+        else
+                siphash24_compress_byte(0xff, state);
+}
+
+static void digest_stat(struct siphash *state, const char *path) {
+        struct stat st;
+
+        digest_string(state, path);
+
+        if (stat(path, &st) < 0) {
+                /* Distinguish a missing file from an inaccessible one, but otherwise just record the error */
+                siphash24_compress(&errno, sizeof(errno), state);
+                return;
+        }
+
+        siphash24_compress(&st.st_dev, sizeof(st.st_dev), state);
+        siphash24_compress(&st.st_ino, sizeof(st.st_ino), state);
+        siphash24_compress(&st.st_mode, sizeof(st.st_mode), state);
+        siphash24_compress(&st.st_size, sizeof(st.st_size), state);
+        siphash24_compress(&st.st_mtim, sizeof(st.st_mtim), state);
+        siphash24_compress(&st.st_ctim, sizeof(st.st_ctim), state);
+}
+
+static int digest_manifest(struct siphash *state, const char *generator, char **environment) {
+        _cleanup_fclose_ FILE *f = NULL;
+        _cleanup_free_ char *manifest = NULL;
+        int r;
+
+        manifest = strappend(generator, ".inputs");
+        if (!manifest)
+                return -ENOMEM;
+
+        f = fopen(manifest, "re");
+        if (!f) {
+                if (errno == ENOENT) {
+                        log_debug("Generator %s declares no inputs, its output can't be reused.", generator);
+                        return 0;
+                }
+
+                return log_debug_errno(errno, "Failed to open %s: %m", manifest);
+        }
+
+        /* The manifest itself is an input too, if it changes the inputs do */
+        digest_stat(state, manifest);
+
+        for (;;) {
+                _cleanup_free_ char *line = NULL, *value = NULL;
+                const char *l, *arg;
+
+                r = read_line(f, LONG_LINE_MAX, &line);
+                if (r < 0)
+                        return log_debug_errno(r, "Failed to read %s: %m", manifest);
+                if (r == 0)
+                        break;
+
+                l = strstrip(line);
+                if (isempty(l) || *l == '#')
+                        continue;
+
+                if ((arg = startswith(l, "file ")))
+                        digest_stat(state, skip_leading_chars(arg, WHITESPACE));
+
+                else if ((arg = startswith(l, "cmdline "))) {
+                        arg = skip_leading_chars(arg, WHITESPACE);
+
+                        r = proc_cmdline_get_key(arg, PROC_CMDLINE_VALUE_OPTIONAL, &value);
+                        if (r < 0)
+                                return log_debug_errno(r, "Failed to read kernel command line: %m");
+
+                        digest_string(state, arg);
+                        siphash24_compress_byte(r > 0, state);
+                        digest_string(state, value);
+
+                } else if ((arg = startswith(l, "env "))) {
+                        const char *e;
+
+                        /* The generators are run with the manager's environment, with the specified one on top */
+                        arg = skip_leading_chars(arg, WHITESPACE);
+                        e = strv_env_get(environment, arg) ?: getenv(arg);
+
+                        digest_string(state, arg);
+                        digest_string(state, e);
+
+                } else {
+                        log_debug("Unknown input '%s' declared in %s, the output of %s can't be reused.", l, manifest, generator);
+                        return 0;
+                }
+        }
+
+        return 1;
+}
+
+int generator_inputs_digest(char **directories, char **environment, uint64_t *ret) {
+        _cleanup_strv_free_ char **generators = NULL;
+        struct siphash state;
+        char **g;
+        int r;
+
+        assert(ret);
+
+        /* Returns > 0 and the digest of the inputs of all generators found in the specified directories, if all of them
+         * declared their inputs. Returns 0 if some did not. */
+
+        r = conf_files_list_strv(&generators, NULL, NULL, CONF_FILES_EXECUTABLE|CONF_FILES_REGULAR|CONF_FILES_FILTER_MASKED,
+                                 (const char* const*) directories);
+        if (r < 0)
+                return r;
+
+        siphash24_init(&state, generator_digest_key);
+
+        STRV_FOREACH(g, generators) {
+                digest_stat(&state, *g);
+
+                r = digest_manifest(&state, *g, environment);
+                if (r <= 0)
+                        return r;
+        }
+
+        *ret = siphash24_finalize(&state);
+        return 1;
+}
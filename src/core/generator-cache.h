@@ -0,0 +1,16 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+#pragma once
+
+#include <stdint.h>
+
+/* Generators may declare their inputs in a manifest, a non-executable file next to the generator binary, named after
+ * it with an ".inputs" suffix. Each line lists one input:
+ *
+ *   file PATH        the file or directory PATH (its inode, size, mode and timestamps are compared, not the contents)
+ *   cmdline KEY      the kernel command line option KEY, with or without a value
+ *   env NAME         the environment variable NAME
+ *
+ * Empty lines and lines starting with "#" are ignored. If all generators declared their inputs, their output only
+ * needs to be regenerated once any of them changed. */
+
+int generator_inputs_digest(char **directories, char **environment, uint64_t *ret);
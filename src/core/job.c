@@ -14,9 +14,11 @@
 #include "job.h"
 #include "log.h"
 #include "macro.h"
+#include "mempool.h"
 #include "parse-util.h"
 #include "serialize.h"
 #include "set.h"
+#include "slice.h"
 #include "special.h"
 #include "stdio-util.h"
 #include "string-table.h"
@@ -24,16 +26,25 @@
 #include "strv.h"
 #include "terminal-util.h"
 #include "unit.h"
+#include "usdt.h"
 #include "virt.h"
 
+/* Every transaction allocates jobs and dependencies between them, most of which are freed again right away when
+ * the transaction is reduced, hence keep them in pools */
+DEFINE_MEMPOOL(job_pool, Job, 64);
+DEFINE_MEMPOOL(job_dependency_pool, JobDependency, 256);
+
 Job* job_new_raw(Unit *unit) {
         Job *j;
+        bool up;
 
         /* used for deserialization */
 
         assert(unit);
 
-        j = new(Job, 1);
+        up = mempool_enabled();
+
+        j = up ? mempool_alloc_tile(&job_pool) : new(Job, 1);
         if (!j)
                 return NULL;
 
@@ -41,6 +52,7 @@ Job* job_new_raw(Unit *unit) {
                 .manager = unit->manager,
                 .unit = unit,
                 .type = _JOB_TYPE_INVALID,
+                .from_pool = up,
         };
 
         return j;
@@ -76,6 +88,11 @@ void job_unlink(Job *j) {
                 j->in_run_queue = false;
         }
 
+        if (j->in_start_queue) {
+                LIST_REMOVE(start_queue, j->manager->start_queue, j);
+                j->in_start_queue = false;
+        }
+
         if (j->in_dbus_queue) {
                 LIST_REMOVE(dbus_queue, j->manager->dbus_job_queue, j);
                 j->in_dbus_queue = false;
@@ -102,7 +119,63 @@ void job_free(Job *j) {
         sd_bus_track_unref(j->bus_track);
         strv_free(j->deserialized_clients);
 
-        free(j);
+        if (j->from_pool)
+                mempool_free_tile(&job_pool, j);
+        else
+                free(j);
+}
+
+static bool job_needs_start_slot(Job *j) {
+        assert(j);
+
+        /* Only start jobs of units that fork processes are subject to the start concurrency limits, everything else
+         * completes quickly anyway. */
+
+        return j->type == JOB_START && UNIT_HAS_EXEC_CONTEXT(j->unit);
+}
+
+static void job_acquire_start_slot(Job *j) {
+        Unit *s;
+
+        assert(j);
+        assert(!j->holds_start_slot);
+
+        j->unit->manager->n_running_start_jobs++;
+
+        for (s = UNIT_DEREF(j->unit->slice); s; s = UNIT_DEREF(s->slice))
+                SLICE(s)->n_running_start_jobs++;
+
+        j->holds_start_slot = true;
+}
+
+static void job_release_start_slot(Job *j) {
+        Manager *m;
+        Unit *s;
+        int r;
+
+        assert(j);
+
+        if (!j->holds_start_slot)
+                return;
+
+        m = j->unit->manager;
+
+        assert(m->n_running_start_jobs > 0);
+        m->n_running_start_jobs--;
+
+        /* The slice of a unit cannot change while it is activating, but let's be careful anyway */
+        for (s = UNIT_DEREF(j->unit->slice); s; s = UNIT_DEREF(s->slice))
+                if (SLICE(s)->n_running_start_jobs > 0)
+                        SLICE(s)->n_running_start_jobs--;
+
+        j->holds_start_slot = false;
+
+        /* A slot became available, let's see if a queued job can take it */
+        if (m->start_queue) {
+                r = sd_event_source_set_enabled(m->run_queue_event_source, SD_EVENT_ONESHOT);
+                if (r < 0)
+                        log_warning_errno(r, "Failed to enable job run queue event source, ignoring: %m");
+        }
 }
 
 static void job_set_state(Job *j, JobState state) {
@@ -118,9 +191,12 @@ static void job_set_state(Job *j, JobState state) {
         if (!j->installed)
                 return;
 
-        if (j->state == JOB_RUNNING)
+        if (j->state == JOB_RUNNING) {
                 j->unit->manager->n_running_jobs++;
-        else {
+
+                if (job_needs_start_slot(j))
+                        job_acquire_start_slot(j);
+        } else {
                 assert(j->state == JOB_WAITING);
                 assert(j->unit->manager->n_running_jobs > 0);
 
@@ -128,6 +204,8 @@ static void job_set_state(Job *j, JobState state) {
 
                 if (j->unit->manager->n_running_jobs <= 0)
                         j->unit->manager->jobs_in_progress_event_source = sd_event_source_unref(j->unit->manager->jobs_in_progress_event_source);
+
+                job_release_start_slot(j);
         }
 }
 
@@ -259,9 +337,13 @@ int job_install_deserialized(Job *j) {
         j->installed = true;
         j->reloaded = true;
 
-        if (j->state == JOB_RUNNING)
+        if (j->state == JOB_RUNNING) {
                 j->unit->manager->n_running_jobs++;
 
+                if (job_needs_start_slot(j))
+                        job_acquire_start_slot(j);
+        }
+
         log_unit_debug(j->unit,
                        "Reinstalled deserialized job %s/%s as %u",
                        j->unit->id, job_type_to_string(j->type), (unsigned) j->id);
@@ -270,6 +352,7 @@ int job_install_deserialized(Job *j) {
 
 JobDependency* job_dependency_new(Job *subject, Job *object, bool matters, bool conflicts) {
         JobDependency *l;
+        bool up;
 
         assert(object);
 
@@ -278,14 +361,19 @@ JobDependency* job_dependency_new(Job *subject, Job *object, bool matters, bool
          * this means the 'anchor' job (i.e. the one the user
          * explicitly asked for) is the requester. */
 
-        l = new0(JobDependency, 1);
+        up = mempool_enabled();
+
+        l = up ? mempool_alloc_tile(&job_dependency_pool) : new(JobDependency, 1);
         if (!l)
                 return NULL;
 
-        l->subject = subject;
-        l->object = object;
-        l->matters = matters;
-        l->conflicts = conflicts;
+        *l = (JobDependency) {
+                .subject = subject,
+                .object = object,
+                .matters = matters,
+                .conflicts = conflicts,
+                .from_pool = up,
+        };
 
         if (subject)
                 LIST_PREPEND(subject, subject->subject_list, l);
@@ -303,7 +391,22 @@ void job_dependency_free(JobDependency *l) {
 
         LIST_REMOVE(object, l->object->object_list, l);
 
-        free(l);
+        if (l->from_pool)
+                mempool_free_tile(&job_dependency_pool, l);
+        else
+                free(l);
+}
+
+void job_dump_pool_stats(FILE *f, const char *prefix) {
+        size_t used, allocated;
+
+        assert(f);
+
+        mempool_get_stats(&job_pool, &used, &allocated);
+        fprintf(f, "%sJob pool: %zu used, %zu allocated\n", strempty(prefix), used, allocated);
+
+        mempool_get_stats(&job_dependency_pool, &used, &allocated);
+        fprintf(f, "%sJob dependency pool: %zu used, %zu allocated\n", strempty(prefix), used, allocated);
 }
 
 void job_dump(Job *j, FILE*f, const char *prefix) {
@@ -471,7 +574,7 @@ static bool job_is_runnable(Job *j) {
                  * dependencies, regardless whether they are
                  * starting or stopping something. */
 
-                HASHMAP_FOREACH_KEY(v, other, j->unit->dependencies[UNIT_AFTER], i)
+                DEPENDENCY_SET_FOREACH(v, other, j->unit->dependencies[UNIT_AFTER], i)
                         if (other->job)
                                 return false;
         }
@@ -479,7 +582,7 @@ static bool job_is_runnable(Job *j) {
         /* Also, if something else is being stopped and we should
          * change state after it, then let's wait. */
 
-        HASHMAP_FOREACH_KEY(v, other, j->unit->dependencies[UNIT_BEFORE], i)
+        DEPENDENCY_SET_FOREACH(v, other, j->unit->dependencies[UNIT_BEFORE], i)
                 if (other->job &&
                     IN_SET(other->job->type, JOB_STOP, JOB_RESTART))
                         return false;
@@ -649,27 +752,21 @@ static int job_perform_on_unit(Job **j) {
         return r;
 }
 
-int job_run_and_invalidate(Job *j) {
+static int job_perform(Job *j) {
         int r;
 
         assert(j);
-        assert(j->installed);
-        assert(j->type < _JOB_TYPE_MAX_IN_TRANSACTION);
-        assert(j->in_run_queue);
-
-        LIST_REMOVE(run_queue, j->manager->run_queue, j);
-        j->in_run_queue = false;
-
-        if (j->state != JOB_WAITING)
-                return 0;
-
-        if (!job_is_runnable(j))
-                return -EAGAIN;
+        assert(j->state == JOB_WAITING);
 
         job_start_timer(j, true);
+        if (j->begin_usec > 0)
+                unit_add_latency(j->unit, UNIT_LATENCY_JOB_WAIT, usec_sub_unsigned(j->begin_running_usec, j->begin_usec));
+
         job_set_state(j, JOB_RUNNING);
         job_add_to_dbus_queue(j);
 
+        USDT_PROBE(systemd, job_start, j->id, j->unit->id, j->type);
+
         switch (j->type) {
 
                 case JOB_VERIFY_ACTIVE: {
@@ -733,6 +830,154 @@ int job_run_and_invalidate(Job *j) {
         return r;
 }
 
+static bool job_is_start_limited(Job *j) {
+        Unit *s;
+
+        assert(j);
+
+        if (!job_needs_start_slot(j))
+                return false;
+
+        if (j->unit->manager->default_start_concurrency > 0)
+                return true;
+
+        for (s = UNIT_DEREF(j->unit->slice); s; s = UNIT_DEREF(s->slice))
+                if (SLICE(s)->start_concurrency > 0)
+                        return true;
+
+        return false;
+}
+
+static bool job_start_slot_available(Job *j) {
+        Manager *m;
+        Unit *s;
+
+        assert(j);
+
+        m = j->unit->manager;
+
+        if (m->default_start_concurrency > 0 && m->n_running_start_jobs >= m->default_start_concurrency)
+                return false;
+
+        for (s = UNIT_DEREF(j->unit->slice); s; s = UNIT_DEREF(s->slice))
+                if (SLICE(s)->start_concurrency > 0 &&
+                    SLICE(s)->n_running_start_jobs >= SLICE(s)->start_concurrency)
+                        return false;
+
+        return true;
+}
+
+static int job_compare_start_order(Job *a, Job *b) {
+        int r;
+
+        assert(a);
+        assert(b);
+
+        /* Jobs that the job originally requested requires (e.g. everything default.target needs during boot) go
+         * first, so that they are not starved by jobs which are merely wanted. Then StartPriority= decides, and
+         * finally the order in which the jobs were created. */
+
+        if (a->matters_to_anchor != b->matters_to_anchor)
+                return a->matters_to_anchor ? -1 : 1;
+
+        r = CMP(unit_get_start_priority(a->unit), unit_get_start_priority(b->unit));
+        if (r != 0)
+                return r;
+
+        return CMP(a->id, b->id);
+}
+
+static void job_add_to_start_queue(Job *j) {
+        Job *i, *prev = NULL;
+
+        assert(j);
+        assert(j->installed);
+
+        if (j->in_start_queue)
+                return;
+
+        LIST_FOREACH(start_queue, i, j->manager->start_queue) {
+                if (job_compare_start_order(j, i) < 0)
+                        break;
+
+                prev = i;
+        }
+
+        LIST_INSERT_AFTER(start_queue, j->manager->start_queue, prev, j);
+        j->in_start_queue = true;
+}
+
+static void job_remove_from_start_queue(Job *j) {
+        assert(j);
+        assert(j->in_start_queue);
+
+        LIST_REMOVE(start_queue, j->manager->start_queue, j);
+        j->in_start_queue = false;
+}
+
+int job_run_and_invalidate(Job *j) {
+        assert(j);
+        assert(j->installed);
+        assert(j->type < _JOB_TYPE_MAX_IN_TRANSACTION);
+        assert(j->in_run_queue);
+
+        LIST_REMOVE(run_queue, j->manager->run_queue, j);
+        j->in_run_queue = false;
+
+        if (j->state != JOB_WAITING)
+                return 0;
+
+        if (!job_is_runnable(j))
+                return -EAGAIN;
+
+        if (job_is_start_limited(j)) {
+                /* Leave it to job_dispatch_start_queue() to decide when this job may actually start */
+                job_add_to_start_queue(j);
+                return 0;
+        }
+
+        return job_perform(j);
+}
+
+unsigned job_dispatch_start_queue(Manager *m) {
+        unsigned n = 0;
+        Job *j;
+
+        assert(m);
+
+        /* Starts the queued start jobs in order, as long as start slots are available. Jobs that may not be started
+         * anymore, or are not limited anymore, are handed back to the run queue. Starting one job might delete
+         * others, hence we start from the beginning every time. Returns the number of jobs started or handed
+         * back. */
+
+rescan:
+        LIST_FOREACH(start_queue, j, m->start_queue) {
+
+                /* No slot left at all? Then nothing else can start. */
+                if (m->default_start_concurrency > 0 && m->n_running_start_jobs >= m->default_start_concurrency)
+                        break;
+
+                if (j->state != JOB_WAITING || !job_is_start_limited(j) || !job_is_runnable(j)) {
+                        job_remove_from_start_queue(j);
+                        job_add_to_run_queue(j);
+                        n++;
+                        goto rescan;
+                }
+
+                /* Only the slice of this job is full? Then maybe a job in another slice can be started. */
+                if (!job_start_slot_available(j))
+                        continue;
+
+                job_remove_from_start_queue(j);
+                (void) job_perform(j);
+                n++;
+                goto rescan;
+        }
+
+        return n;
+}
+
+
 _pure_ static const char *job_get_done_status_message_format(Unit *u, JobType t, JobResult result) {
 
         static const char *const generic_finished_start_job[_JOB_RESULT_MAX] = {
@@ -953,7 +1198,7 @@ static void job_fail_dependencies(Unit *u, UnitDependency d) {
 
         assert(u);
 
-        HASHMAP_FOREACH_KEY(v, other, u->dependencies[d], i) {
+        DEPENDENCY_SET_FOREACH(v, other, u->dependencies[d], i) {
                 Job *j = other->job;
 
                 if (!j)
@@ -994,6 +1239,8 @@ int job_finish_and_invalidate(Job *j, JobResult result, bool recursive, bool alr
 
         j->result = result;
 
+        USDT_PROBE(systemd, job_finish, j->id, u->id, t, result);
+
         log_unit_debug(u, "Job %" PRIu32 " %s/%s finished, result=%s", j->id, u->id, job_type_to_string(t), job_result_to_string(result));
 
         /* If this job did nothing to respective unit we don't log the status message */
@@ -1054,12 +1301,12 @@ int job_finish_and_invalidate(Job *j, JobResult result, bool recursive, bool alr
 
 finish:
         /* Try to start the next jobs that can be started */
-        HASHMAP_FOREACH_KEY(v, other, u->dependencies[UNIT_AFTER], i)
+        DEPENDENCY_SET_FOREACH(v, other, u->dependencies[UNIT_AFTER], i)
                 if (other->job) {
                         job_add_to_run_queue(other->job);
                         job_add_to_gc_queue(other->job);
                 }
-        HASHMAP_FOREACH_KEY(v, other, u->dependencies[UNIT_BEFORE], i)
+        DEPENDENCY_SET_FOREACH(v, other, u->dependencies[UNIT_BEFORE], i)
                 if (other->job) {
                         job_add_to_run_queue(other->job);
                         job_add_to_gc_queue(other->job);
@@ -1202,7 +1449,7 @@ int job_serialize(Job *j, FILE *f) {
         bus_track_serialize(j->bus_track, f, "subscribed");
 
         /* End marker */
-        fputc('\n', f);
+        (void) serialize_end_marker(f);
         return 0;
 }
 
@@ -1217,7 +1464,7 @@ int job_deserialize(Job *j, FILE *f) {
                 char *l, *v;
                 size_t k;
 
-                r = read_line(f, LONG_LINE_MAX, &line);
+                r = deserialize_read_line(f, &line);
                 if (r < 0)
                         return log_error_errno(r, "Failed to read serialization line: %m");
                 if (r == 0)
@@ -1437,7 +1684,7 @@ bool job_may_gc(Job *j) {
 
         /* If a job is ordered after ours, and is to be started, then it needs to wait for us, regardless if we stop or
          * start, hence let's not GC in that case. */
-        HASHMAP_FOREACH_KEY(v, other, j->unit->dependencies[UNIT_BEFORE], i) {
+        DEPENDENCY_SET_FOREACH(v, other, j->unit->dependencies[UNIT_BEFORE], i) {
                 if (!other->job)
                         continue;
 
@@ -1450,7 +1697,7 @@ bool job_may_gc(Job *j) {
 
         /* If we are going down, but something else is ordered After= us, then it needs to wait for us */
         if (IN_SET(j->type, JOB_STOP, JOB_RESTART))
-                HASHMAP_FOREACH_KEY(v, other, j->unit->dependencies[UNIT_AFTER], i) {
+                DEPENDENCY_SET_FOREACH(v, other, j->unit->dependencies[UNIT_AFTER], i) {
                         if (!other->job)
                                 continue;
 
@@ -1534,7 +1781,7 @@ int job_get_before(Job *j, Job*** ret) {
 
         if (IN_SET(j->type, JOB_START, JOB_VERIFY_ACTIVE, JOB_RELOAD)) {
 
-                HASHMAP_FOREACH_KEY(v, other, j->unit->dependencies[UNIT_AFTER], i) {
+                DEPENDENCY_SET_FOREACH(v, other, j->unit->dependencies[UNIT_AFTER], i) {
                         if (!other->job)
                                 continue;
 
@@ -1544,7 +1791,7 @@ int job_get_before(Job *j, Job*** ret) {
                 }
         }
 
-        HASHMAP_FOREACH_KEY(v, other, j->unit->dependencies[UNIT_BEFORE], i) {
+        DEPENDENCY_SET_FOREACH(v, other, j->unit->dependencies[UNIT_BEFORE], i) {
                 if (!other->job)
                         continue;
 
@@ -1575,7 +1822,7 @@ int job_get_after(Job *j, Job*** ret) {
 
         /* Returns a list of all pending jobs that are waiting for this job to finish. */
 
-        HASHMAP_FOREACH_KEY(v, other, j->unit->dependencies[UNIT_BEFORE], i) {
+        DEPENDENCY_SET_FOREACH(v, other, j->unit->dependencies[UNIT_BEFORE], i) {
                 if (!other->job)
                         continue;
 
@@ -1592,7 +1839,7 @@ int job_get_after(Job *j, Job*** ret) {
 
         if (IN_SET(j->type, JOB_STOP, JOB_RESTART)) {
 
-                HASHMAP_FOREACH_KEY(v, other, j->unit->dependencies[UNIT_AFTER], i) {
+                DEPENDENCY_SET_FOREACH(v, other, j->unit->dependencies[UNIT_AFTER], i) {
                         if (!other->job)
                                 continue;
 
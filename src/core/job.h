@@ -108,6 +108,7 @@ struct JobDependency {
 
         bool matters:1;
         bool conflicts:1;
+        bool from_pool:1;
 };
 
 struct Job {
@@ -116,8 +117,10 @@ struct Job {
 
         LIST_FIELDS(Job, transaction);
         LIST_FIELDS(Job, run_queue);
+        LIST_FIELDS(Job, start_queue);
         LIST_FIELDS(Job, dbus_queue);
         LIST_FIELDS(Job, gc_queue);
+        LIST_FIELDS(Job, transaction_gc_queue);
 
         LIST_HEAD(JobDependency, subject_list);
         LIST_HEAD(JobDependency, object_list);
@@ -149,14 +152,18 @@ struct Job {
 
         bool installed:1;
         bool in_run_queue:1;
+        bool in_start_queue:1;
+        bool holds_start_slot:1;
         bool matters_to_anchor:1;
         bool in_dbus_queue:1;
         bool sent_dbus_new_signal:1;
         bool ignore_order:1;
         bool irreversible:1;
         bool in_gc_queue:1;
+        bool in_transaction_gc_queue:1;
         bool ref_by_private_bus:1;
         bool reloaded:1;
+        bool from_pool:1;
 };
 
 Job* job_new(Unit *unit, JobType type);
@@ -167,6 +174,7 @@ Job* job_install(Job *j);
 int job_install_deserialized(Job *j);
 void job_uninstall(Job *j);
 void job_dump(Job *j, FILE*f, const char *prefix);
+void job_dump_pool_stats(FILE *f, const char *prefix);
 int job_serialize(Job *j, FILE *f);
 int job_deserialize(Job *j, FILE *f);
 int job_coldplug(Job *j);
@@ -204,6 +212,7 @@ JobType job_type_collapse(JobType t, Unit *u);
 int job_type_merge_and_collapse(JobType *a, JobType b, Unit *u);
 
 void job_add_to_run_queue(Job *j);
+unsigned job_dispatch_start_queue(Manager *m);
 void job_add_to_dbus_queue(Job *j);
 
 int job_start_timer(Job *j, bool job_running);
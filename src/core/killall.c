@@ -5,15 +5,23 @@
 
 #include <errno.h>
 #include <signal.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
 #include <sys/wait.h>
 #include <unistd.h>
 
+#if HAVE_PIDFD_OPEN
+#include <sys/pidfd.h>
+#endif
+
 #include "alloc-util.h"
 #include "def.h"
 #include "dirent-util.h"
 #include "fd-util.h"
 #include "format-util.h"
+#include "io-util.h"
 #include "killall.h"
+#include "missing_syscall.h"
 #include "parse-util.h"
 #include "process-util.h"
 #include "set.h"
@@ -21,6 +29,129 @@
 #include "terminal-util.h"
 #include "util.h"
 
+/* The processes we killed and wait for. Whenever possible we hold a pidfd for them and watch it with epoll, so that we
+ * learn about each exit right away, without going through all remaining processes on every wake-up, and without
+ * mistaking a process that reused the PID for the one we killed. Processes we couldn't get a pidfd for are checked
+ * with kill(pid, 0) on every SIGCHLD, as before. */
+typedef struct WaitList {
+        Set *pids;
+
+        int *pidfds;
+        size_t n_pidfds, n_pidfds_allocated;
+        size_t n_alive;
+
+        int epoll_fd;
+        int signal_fd;
+} WaitList;
+
+static bool pidfd_supported = true;
+
+static void wait_list_done(WaitList *w) {
+        size_t i;
+
+        assert(w);
+
+        for (i = 0; i < w->n_pidfds; i++)
+                safe_close(w->pidfds[i]);
+
+        w->pidfds = mfree(w->pidfds);
+        w->n_pidfds = w->n_pidfds_allocated = w->n_alive = 0;
+        w->pids = set_free(w->pids);
+        w->epoll_fd = safe_close(w->epoll_fd);
+        w->signal_fd = safe_close(w->signal_fd);
+}
+
+static int wait_list_init(WaitList *w, const sigset_t *mask) {
+        struct epoll_event ev = {
+                .events = EPOLLIN,
+                .data.u32 = UINT32_MAX,
+        };
+
+        assert(w);
+        assert(mask);
+
+        *w = (WaitList) {
+                .epoll_fd = -1,
+                .signal_fd = -1,
+        };
+
+        w->pids = set_new(NULL);
+        if (!w->pids)
+                return -ENOMEM;
+
+        if (!pidfd_supported)
+                return 0;
+
+        /* SIGCHLD is blocked by the caller, hence a signalfd for it wakes us up for children we watch by PID, and
+         * lets us reap the others. */
+        w->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        if (w->epoll_fd < 0)
+                goto fail;
+
+        w->signal_fd = signalfd(-1, mask, SFD_NONBLOCK|SFD_CLOEXEC);
+        if (w->signal_fd < 0)
+                goto fail;
+
+        if (epoll_ctl(w->epoll_fd, EPOLL_CTL_ADD, w->signal_fd, &ev) < 0)
+                goto fail;
+
+        return 0;
+
+fail:
+        log_debug_errno(errno, "Failed to set up epoll for waiting on processes, watching them by PID: %m");
+        w->epoll_fd = safe_close(w->epoll_fd);
+        w->signal_fd = safe_close(w->signal_fd);
+        return 0;
+}
+
+static int wait_list_add(WaitList *w, pid_t pid, int *pidfd) {
+        assert(w);
+        assert(pidfd);
+
+        if (*pidfd >= 0 && w->epoll_fd >= 0 &&
+            w->n_pidfds < UINT32_MAX &&
+            GREEDY_REALLOC(w->pidfds, w->n_pidfds_allocated, w->n_pidfds + 1)) {
+                struct epoll_event ev = {
+                        .events = EPOLLIN,
+                        .data.u32 = w->n_pidfds,
+                };
+
+                if (epoll_ctl(w->epoll_fd, EPOLL_CTL_ADD, *pidfd, &ev) >= 0) {
+                        w->pidfds[w->n_pidfds++] = TAKE_FD(*pidfd);
+                        w->n_alive++;
+                        return 0;
+                }
+        }
+
+        return set_put(w->pids, PID_TO_PTR(pid));
+}
+
+static int pidfd_open_supported(pid_t pid) {
+        int fd;
+
+        if (!pidfd_supported)
+                return -EOPNOTSUPP;
+
+        fd = pidfd_open(pid, 0);
+        if (fd < 0) {
+                if (IN_SET(errno, ENOSYS, EPERM)) {
+                        log_debug_errno(errno, "pidfds are not supported, sending signals by PID: %m");
+                        pidfd_supported = false;
+                }
+
+                return -errno;
+        }
+
+        return fd;
+}
+
+static int kill_pidfd(pid_t pid, int pidfd, int sig) {
+        if (pidfd >= 0)
+                return pidfd_send_signal(pidfd, sig, NULL, 0);
+
+        return kill(pid, sig);
+}
+
 static bool ignore_proc(pid_t pid, bool warn_rootfs) {
         _cleanup_fclose_ FILE *f = NULL;
         const char *p;
@@ -77,12 +208,13 @@ static bool ignore_proc(pid_t pid, bool warn_rootfs) {
         return true;
 }
 
-static void wait_for_children(Set *pids, sigset_t *mask, usec_t timeout) {
+static void wait_for_children(WaitList *w, sigset_t *mask, usec_t timeout) {
         usec_t until;
 
+        assert(w);
         assert(mask);
 
-        if (set_isempty(pids))
+        if (set_isempty(w->pids) && w->n_alive == 0)
                 return;
 
         until = now(CLOCK_MONOTONIC) + timeout;
@@ -111,12 +243,12 @@ static void wait_for_children(Set *pids, sigset_t *mask, usec_t timeout) {
                                 return;
                         }
 
-                        (void) set_remove(pids, PID_TO_PTR(pid));
+                        (void) set_remove(w->pids, PID_TO_PTR(pid));
                 }
 
                 /* Now explicitly check who might be remaining, who
                  * might not be our child. */
-                SET_FOREACH(p, pids, i) {
+                SET_FOREACH(p, w->pids, i) {
 
                         /* kill(pid, 0) sends no signal, but it tells
                          * us whether the process still exists. */
@@ -126,16 +258,48 @@ static void wait_for_children(Set *pids, sigset_t *mask, usec_t timeout) {
                         if (errno != ESRCH)
                                 continue;
 
-                        set_remove(pids, p);
+                        set_remove(w->pids, p);
                 }
 
-                if (set_isempty(pids))
+                if (set_isempty(w->pids) && w->n_alive == 0)
                         return;
 
                 n = now(CLOCK_MONOTONIC);
                 if (n >= until)
                         return;
 
+                if (w->epoll_fd >= 0) {
+                        struct epoll_event events[64];
+                        int j;
+
+                        /* A pidfd becomes readable when its process exited, whether it is our child or not. */
+                        k = epoll_wait(w->epoll_fd, events, ELEMENTSOF(events), DIV_ROUND_UP(until - n, USEC_PER_MSEC));
+                        if (k < 0) {
+                                if (errno == EINTR)
+                                        continue;
+
+                                log_error_errno(errno, "epoll_wait() failed: %m");
+                                return;
+                        }
+
+                        for (j = 0; j < k; j++) {
+                                uint32_t idx = events[j].data.u32;
+
+                                if (idx == UINT32_MAX) {
+                                        (void) flush_fd(w->signal_fd);
+                                        continue;
+                                }
+
+                                assert(idx < w->n_pidfds);
+
+                                /* Closing the pidfd also removes it from the epoll set */
+                                w->pidfds[idx] = safe_close(w->pidfds[idx]);
+                                w->n_alive--;
+                        }
+
+                        continue;
+                }
+
                 timespec_store(&ts, until - n);
                 k = sigtimedwait(mask, NULL, &ts);
                 if (k != SIGCHLD) {
@@ -151,7 +315,7 @@ static void wait_for_children(Set *pids, sigset_t *mask, usec_t timeout) {
         }
 }
 
-static int killall(int sig, Set *pids, bool send_sighup) {
+static int killall(int sig, WaitList *w, bool send_sighup) {
         _cleanup_closedir_ DIR *dir = NULL;
         struct dirent *d;
 
@@ -160,6 +324,8 @@ static int killall(int sig, Set *pids, bool send_sighup) {
                 return -errno;
 
         FOREACH_DIRENT_ALL(d, dir, break) {
+                _cleanup_close_ int pidfd = -1;
+                bool killed;
                 pid_t pid;
                 int r;
 
@@ -172,6 +338,12 @@ static int killall(int sig, Set *pids, bool send_sighup) {
                 if (ignore_proc(pid, sig == SIGKILL && !in_initrd()))
                         continue;
 
+                /* Everything is stopped, so the PID can't have been reused since we looked at the process.
+                 * From now on, the pidfd makes sure we signal and wait for the very same process. */
+                pidfd = pidfd_open_supported(pid);
+                if (pidfd == -ESRCH)
+                        continue;
+
                 if (sig == SIGKILL) {
                         _cleanup_free_ char *s = NULL;
 
@@ -179,13 +351,8 @@ static int killall(int sig, Set *pids, bool send_sighup) {
                         log_notice("Sending SIGKILL to PID "PID_FMT" (%s).", pid, strna(s));
                 }
 
-                if (kill(pid, sig) >= 0) {
-                        if (pids) {
-                                r = set_put(pids, PID_TO_PTR(pid));
-                                if (r < 0)
-                                        log_oom();
-                        }
-                } else if (errno != ENOENT)
+                killed = kill_pidfd(pid, pidfd, sig) >= 0;
+                if (!killed && errno != ESRCH)
                         log_warning_errno(errno, "Could not kill %d: %m", pid);
 
                 if (send_sighup) {
@@ -201,34 +368,46 @@ static int killall(int sig, Set *pids, bool send_sighup) {
 
                         if (get_ctty_devnr(pid, NULL) >= 0)
                                 /* it's OK if the process is gone, just ignore the result */
-                                (void) kill(pid, SIGHUP);
+                                (void) kill_pidfd(pid, pidfd, SIGHUP);
+                }
+
+                /* Only hand over the pidfd once we are done signalling through it */
+                if (killed && w) {
+                        r = wait_list_add(w, pid, &pidfd);
+                        if (r < 0)
+                                log_oom();
                 }
         }
 
-        return set_size(pids);
+        return w ? (int) (set_size(w->pids) + w->n_alive) : 0;
 }
 
 void broadcast_signal(int sig, bool wait_for_exit, bool send_sighup, usec_t timeout) {
+        _cleanup_(wait_list_done) WaitList w = {
+                .epoll_fd = -1,
+                .signal_fd = -1,
+        };
         sigset_t mask, oldmask;
-        _cleanup_set_free_ Set *pids = NULL;
-
-        if (wait_for_exit)
-                pids = set_new(NULL);
 
         assert_se(sigemptyset(&mask) == 0);
         assert_se(sigaddset(&mask, SIGCHLD) == 0);
         assert_se(sigprocmask(SIG_BLOCK, &mask, &oldmask) == 0);
 
+        if (wait_for_exit && wait_list_init(&w, &mask) < 0) {
+                log_oom();
+                wait_for_exit = false;
+        }
+
         if (kill(-1, SIGSTOP) < 0 && errno != ESRCH)
                 log_warning_errno(errno, "kill(-1, SIGSTOP) failed: %m");
 
-        killall(sig, pids, send_sighup);
+        killall(sig, wait_for_exit ? &w : NULL, send_sighup);
 
         if (kill(-1, SIGCONT) < 0 && errno != ESRCH)
                 log_warning_errno(errno, "kill(-1, SIGCONT) failed: %m");
 
         if (wait_for_exit)
-                wait_for_children(pids, &mask, timeout);
+                wait_for_children(&w, &mask, timeout);
 
         assert_se(sigprocmask(SIG_SETMASK, &oldmask, NULL) == 0);
 }
@@ -30,6 +30,7 @@
 #include "errno-list.h"
 #include "escape.h"
 #include "fd-util.h"
+#include "fileio.h"
 #include "fs-util.h"
 #include "hexdecoct.h"
 #include "io-util.h"
@@ -52,6 +53,7 @@
 #include "stat-util.h"
 #include "string-util.h"
 #include "strv.h"
+#include "unit-cache.h"
 #include "unit-name.h"
 #include "unit-printf.h"
 #include "user-util.h"
@@ -1543,7 +1545,7 @@ int config_parse_trigger_unit(
         assert(rvalue);
         assert(data);
 
-        if (!hashmap_isempty(u->dependencies[UNIT_TRIGGERS])) {
+        if (!dependency_set_isempty(u->dependencies[UNIT_TRIGGERS])) {
                 log_syntax(unit, LOG_ERR, filename, line, 0, "Multiple units to trigger specified, ignoring: %s", rvalue);
                 return 0;
         }
@@ -1625,6 +1627,7 @@ int config_parse_path_spec(const char *unit,
         s->path = TAKE_PTR(k);
         s->type = b;
         s->inotify_fd = -1;
+        s->subtree_fd = -1;
 
         LIST_PREPEND(spec, p->specs, s);
 
@@ -1716,6 +1719,52 @@ int config_parse_fdname(
         return free_and_replace(s->fdname, p);
 }
 
+int config_parse_reuse_port_instances(
+                const char *unit,
+                const char *filename,
+                unsigned line,
+                const char *section,
+                unsigned section_line,
+                const char *lvalue,
+                int ltype,
+                const char *rvalue,
+                void *data,
+                void *userdata) {
+
+        Socket *s = data;
+        unsigned n;
+        int r;
+
+        assert(filename);
+        assert(lvalue);
+        assert(rvalue);
+        assert(data);
+
+        if (isempty(rvalue)) {
+                s->reuse_port_instances = 0;
+                return 0;
+        }
+
+        if (streq(rvalue, "ncpu")) {
+                s->reuse_port_instances = SOCKET_REUSE_PORT_INSTANCES_NCPU;
+                return 0;
+        }
+
+        r = safe_atou(rvalue, &n);
+        if (r < 0) {
+                log_syntax(unit, LOG_ERR, filename, line, r, "Failed to parse number of sockets, ignoring: %s", rvalue);
+                return 0;
+        }
+
+        if (n < 1 || n > SOCKET_REUSE_PORT_INSTANCES_MAX) {
+                log_syntax(unit, LOG_ERR, filename, line, 0, "Number of sockets out of range 1…%u, ignoring: %s", SOCKET_REUSE_PORT_INSTANCES_MAX, rvalue);
+                return 0;
+        }
+
+        s->reuse_port_instances = n;
+        return 0;
+}
+
 int config_parse_service_sockets(
                 const char *unit,
                 const char *filename,
@@ -4181,6 +4230,49 @@ int config_parse_job_running_timeout_sec(
         return 0;
 }
 
+int config_parse_start_priority(
+                const char* unit,
+                const char *filename,
+                unsigned line,
+                const char *section,
+                unsigned section_line,
+                const char *lvalue,
+                int ltype,
+                const char *rvalue,
+                void *data,
+                void *userdata) {
+
+        Unit *u = userdata;
+        int r, p;
+
+        assert(filename);
+        assert(lvalue);
+        assert(rvalue);
+        assert(u);
+
+        if (isempty(rvalue)) {
+                u->start_priority = 0;
+                u->start_priority_set = false;
+                return 0;
+        }
+
+        r = safe_atoi(rvalue, &p);
+        if (r < 0) {
+                log_syntax(unit, LOG_ERR, filename, line, r, "Failed to parse start priority, ignoring: %s", rvalue);
+                return 0;
+        }
+
+        if (p < START_PRIORITY_MIN || p > START_PRIORITY_MAX) {
+                log_syntax(unit, LOG_ERR, filename, line, 0, "Start priority out of range, ignoring: %s", rvalue);
+                return 0;
+        }
+
+        u->start_priority = p;
+        u->start_priority_set = true;
+
+        return 0;
+}
+
 int config_parse_emergency_action(
                 const char* unit,
                 const char *filename,
@@ -4449,10 +4541,168 @@ static int merge_by_names(Unit **u, Set *names, const char *id) {
         return 0;
 }
 
+UnitFragment* unit_fragment_free(UnitFragment *f) {
+        if (!f)
+                return NULL;
+
+        free(f->filename);
+        set_free_free(f->names);
+        free(f->data);
+        return mfree(f);
+}
+
+static int find_fragment(
+                char **search_path,
+                Set *path_cache,
+                const char *path,
+                bool background,
+                char **ret_filename,
+                FILE **ret_f,
+                Set *symlink_names,
+                char **ret_id) {
+
+        char **p;
+        int r;
+
+        assert(path);
+        assert(ret_filename);
+        assert(ret_f);
+        assert(symlink_names);
+        assert(ret_id);
+
+        STRV_FOREACH(p, search_path) {
+                _cleanup_free_ char *filename = NULL;
+
+                /* Instead of opening the path right away, we manually
+                 * follow all symlinks and add their name to our unit
+                 * name set while doing so */
+                filename = path_make_absolute(path, *p);
+                if (!filename)
+                        return -ENOMEM;
+
+                if (path_cache &&
+                    !set_get(path_cache, filename))
+                        r = -ENOENT;
+                else
+                        r = open_follow(&filename, ret_f, symlink_names, ret_id);
+                if (r >= 0) {
+                        *ret_filename = TAKE_PTR(filename);
+                        return 1;
+                }
+
+                /* ENOENT means that the file is missing or is a dangling symlink.
+                 * ENOTDIR means that one of paths we expect to be is a directory
+                 * is not a directory, we should just ignore that.
+                 * EACCES means that the directory or file permissions are wrong.
+                 */
+                if (r == -EACCES) {
+                        /* Leave the logging to the synchronous retry */
+                        if (background)
+                                return r;
+
+                        log_debug_errno(r, "Cannot access \"%s\": %m", filename);
+                } else if (!IN_SET(r, -ENOENT, -ENOTDIR))
+                        return r;
+
+                /* Empty the symlink names for the next run */
+                set_clear_free(symlink_names);
+        }
+
+        /* Hmm, no suitable file found? */
+        return 0;
+}
+
+int unit_fragment_read(char **search_path, Set *path_cache, const char *name, UnitFragment **ret) {
+        _cleanup_(unit_fragment_freep) UnitFragment *fragment = NULL;
+        _cleanup_fclose_ FILE *f = NULL;
+        char *id = NULL;
+        int r;
+
+        assert(name);
+        assert(ret);
+
+        /* Looks for the fragment of the specified unit name in the search path, and reads it into memory, for use by
+         * load_from_path() later on. This is called from worker threads, hence must not log, and may not touch the
+         * manager. */
+
+        fragment = new0(UnitFragment, 1);
+        if (!fragment)
+                return -ENOMEM;
+
+        fragment->names = set_new(&string_hash_ops);
+        if (!fragment->names)
+                return -ENOMEM;
+
+        r = find_fragment(search_path, path_cache, name, true, &fragment->filename, &f, fragment->names, &id);
+        if (r <= 0) {
+                fragment->error = r;
+                goto finish;
+        }
+
+        fragment->id = id;
+
+        if (fstat(fileno(f), &fragment->st) < 0) {
+                fragment->error = -errno;
+                goto finish;
+        }
+
+        if (null_or_empty(&fragment->st))
+                goto finish;
+
+        if (!S_ISREG(fragment->st.st_mode)) {
+                fragment->error = -EBADFD;
+                goto finish;
+        }
+
+        fragment->error = read_full_stream(f, &fragment->data, &fragment->size);
+
+finish:
+        *ret = TAKE_PTR(fragment);
+        return 0;
+}
+
+static int fragment_take(UnitFragment *fragment, char **ret_filename, FILE **ret_f, Set *symlink_names, char **ret_id, struct stat *ret_st) {
+        _cleanup_free_ char *filename = NULL;
+        _cleanup_fclose_ FILE *f = NULL;
+        Iterator i;
+        char *n;
+        int r;
+
+        assert(fragment);
+        assert(fragment->filename);
+
+        /* The fragment may be shared by several units (i.e. instances of the same template), hence copy
+         * everything */
+
+        filename = strdup(fragment->filename);
+        if (!filename)
+                return -ENOMEM;
+
+        SET_FOREACH(n, fragment->names, i) {
+                r = set_put_strdup(symlink_names, n);
+                if (r < 0)
+                        return r;
+        }
+
+        if (fragment->size > 0) {
+                f = fmemopen(fragment->data, fragment->size, "r");
+                if (!f)
+                        return -errno;
+        }
+
+        *ret_filename = TAKE_PTR(filename);
+        *ret_f = TAKE_PTR(f);
+        *ret_id = fragment->id ? set_get(symlink_names, fragment->id) : NULL;
+        *ret_st = fragment->st;
+
+        return 0;
+}
+
 static int load_from_path(Unit *u, const char *path) {
         _cleanup_set_free_free_ Set *symlink_names = NULL;
         _cleanup_fclose_ FILE *f = NULL;
         _cleanup_free_ char *filename = NULL;
+        bool prefetched = false;
         char *id = NULL;
         Unit *merged;
         struct stat st;
@@ -4479,38 +4729,35 @@ static int load_from_path(Unit *u, const char *path) {
                 }
 
         } else  {
-                char **p;
-
-                STRV_FOREACH(p, u->manager->lookup_paths.search_path) {
-
-                        /* Instead of opening the path right away, we manually
-                         * follow all symlinks and add their name to our unit
-                         * name set while doing so */
-                        filename = path_make_absolute(path, *p);
-                        if (!filename)
-                                return -ENOMEM;
-
-                        if (u->manager->unit_path_cache &&
-                            !set_get(u->manager->unit_path_cache, filename))
-                                r = -ENOENT;
-                        else
-                                r = open_follow(&filename, &f, symlink_names, &id);
-                        if (r >= 0)
-                                break;
-                        filename = mfree(filename);
+                _cleanup_(unit_fragment_freep) UnitFragment *cached = NULL;
+                UnitFragment *fragment;
+
+                /* Maybe the fragment has been read in the background already, or is in the unit cache */
+                fragment = hashmap_get(u->manager->fragment_cache, path);
+                if (!fragment || fragment->error < 0) {
+                        r = unit_cache_lookup(u->manager->unit_cache, path,
+                                              u->manager->lookup_paths.search_path, u->manager->unit_path_cache,
+                                              &cached);
+                        if (r < 0)
+                                return r;
+
+                        fragment = cached;
+                }
 
-                        /* ENOENT means that the file is missing or is a dangling symlink.
-                         * ENOTDIR means that one of paths we expect to be is a directory
-                         * is not a directory, we should just ignore that.
-                         * EACCES means that the directory or file permissions are wrong.
-                         */
-                        if (r == -EACCES)
-                                log_debug_errno(r, "Cannot access \"%s\": %m", filename);
-                        else if (!IN_SET(r, -ENOENT, -ENOTDIR))
+                if (fragment && fragment->error >= 0) {
+                        if (!fragment->filename)
+                                return 0;
+
+                        r = fragment_take(fragment, &filename, &f, symlink_names, &id, &st);
+                        if (r < 0)
                                 return r;
 
-                        /* Empty the symlink names for the next run */
-                        set_clear_free(symlink_names);
+                        prefetched = true;
+                } else {
+                        r = find_fragment(u->manager->lookup_paths.search_path, u->manager->unit_path_cache, path, false,
+                                          &filename, &f, symlink_names, &id);
+                        if (r < 0)
+                                return r;
                 }
         }
 
@@ -4533,7 +4780,7 @@ static int load_from_path(Unit *u, const char *path) {
                 return 0;
         }
 
-        if (fstat(fileno(f), &st) < 0)
+        if (!prefetched && fstat(fileno(f), &st) < 0)
                 return -errno;
 
         if (null_or_empty(&st)) {
@@ -4543,6 +4790,10 @@ static int load_from_path(Unit *u, const char *path) {
                 u->load_state = UNIT_LOADED;
                 u->fragment_mtime = timespec_load(&st.st_mtim);
 
+                /* config_parse() can't check the permissions of a file read from memory */
+                if (prefetched)
+                        (void) stat_warn_permissions(filename, &st);
+
                 /* Now, parse the file contents */
                 r = config_parse(u->id, filename, f,
                                  UNIT_VTABLE(u)->sections,
@@ -4552,7 +4803,9 @@ static int load_from_path(Unit *u, const char *path) {
                         return r;
         }
 
-        free_and_replace(u->fragment_path, filename);
+        r = unit_set_fragment_path(u, filename);
+        if (r < 0)
+                return r;
 
         if (u->source_path) {
                 if (stat(u->source_path, &st) >= 0)
@@ -4612,7 +4865,7 @@ int unit_load_fragment(Unit *u) {
                         /* Hmm, this didn't work? Then let's get rid
                          * of the fragment path stored for us, so that
                          * we don't point to an invalid location. */
-                        u->fragment_path = mfree(u->fragment_path);
+                        (void) unit_set_fragment_path(u, NULL);
         }
 
         /* Look for a template */
@@ -1,11 +1,33 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 #pragma once
 
+#include <sys/stat.h>
+
 #include "conf-parser.h"
 #include "unit.h"
 
 /* Read service data from .desktop file style configuration fragments */
 
+/* A unit file fragment read into memory, to be parsed later on */
+typedef struct UnitFragment {
+        /* If negative, the fragment couldn't be read in the background, and loading has to be retried
+         * synchronously, so that errors are logged properly */
+        int error;
+
+        /* NULL if no fragment has been found */
+        char *filename;
+        Set *names;
+        char *id;
+
+        struct stat st;
+        char *data;
+        size_t size;
+} UnitFragment;
+
+int unit_fragment_read(char **search_path, Set *path_cache, const char *name, UnitFragment **ret);
+UnitFragment* unit_fragment_free(UnitFragment *f);
+DEFINE_TRIVIAL_CLEANUP_FUNC(UnitFragment*, unit_fragment_free);
+
 int unit_load_fragment(Unit *u);
 
 void unit_dump_config_items(FILE *f);
@@ -93,6 +115,7 @@ CONFIG_PARSER_PROTOTYPE(config_parse_bus_name);
 CONFIG_PARSER_PROTOTYPE(config_parse_exec_utmp_mode);
 CONFIG_PARSER_PROTOTYPE(config_parse_working_directory);
 CONFIG_PARSER_PROTOTYPE(config_parse_fdname);
+CONFIG_PARSER_PROTOTYPE(config_parse_reuse_port_instances);
 CONFIG_PARSER_PROTOTYPE(config_parse_sec_fix_0);
 CONFIG_PARSER_PROTOTYPE(config_parse_user_group);
 CONFIG_PARSER_PROTOTYPE(config_parse_user_group_strv);
@@ -101,6 +124,7 @@ CONFIG_PARSER_PROTOTYPE(config_parse_bind_paths);
 CONFIG_PARSER_PROTOTYPE(config_parse_exec_keyring_mode);
 CONFIG_PARSER_PROTOTYPE(config_parse_job_timeout_sec);
 CONFIG_PARSER_PROTOTYPE(config_parse_job_running_timeout_sec);
+CONFIG_PARSER_PROTOTYPE(config_parse_start_priority);
 CONFIG_PARSER_PROTOTYPE(config_parse_log_extra_fields);
 CONFIG_PARSER_PROTOTYPE(config_parse_collect_mode);
 CONFIG_PARSER_PROTOTYPE(config_parse_pid_file);
@@ -128,6 +128,10 @@ static bool arg_default_blockio_accounting = false;
 static bool arg_default_memory_accounting = MEMORY_ACCOUNTING_DEFAULT;
 static bool arg_default_tasks_accounting = true;
 static uint64_t arg_default_tasks_max = UINT64_MAX;
+static unsigned arg_default_start_concurrency = 0;
+static usec_t arg_boot_trace_interval_usec = 0;
+static bool arg_lazy_device_units = false;
+static bool arg_log_buffered = false;
 static sd_id128_t arg_machine_id = {};
 static EmergencyAction arg_cad_burst_action = EMERGENCY_ACTION_REBOOT_FORCE;
 
@@ -668,6 +672,7 @@ static int parse_config_file(void) {
                 { "Manager", "LogTarget",                 config_parse_target,           0, NULL                                   },
                 { "Manager", "LogColor",                  config_parse_color,            0, NULL                                   },
                 { "Manager", "LogLocation",               config_parse_location,         0, NULL                                   },
+                { "Manager", "LogBuffered",               config_parse_bool,             0, &arg_log_buffered                      },
                 { "Manager", "DumpCore",                  config_parse_bool,             0, &arg_dump_core                         },
                 { "Manager", "CrashChVT", /* legacy */    config_parse_crash_chvt,       0, NULL                                   },
                 { "Manager", "CrashChangeVT",             config_parse_crash_chvt,       0, NULL                                   },
@@ -718,6 +723,9 @@ static int parse_config_file(void) {
                 { "Manager", "DefaultMemoryAccounting",   config_parse_bool,             0, &arg_default_memory_accounting         },
                 { "Manager", "DefaultTasksAccounting",    config_parse_bool,             0, &arg_default_tasks_accounting          },
                 { "Manager", "DefaultTasksMax",           config_parse_tasks_max,        0, &arg_default_tasks_max                 },
+                { "Manager", "DefaultStartConcurrency",   config_parse_unsigned,         0, &arg_default_start_concurrency         },
+                { "Manager", "BootTraceIntervalSec",      config_parse_sec,              0, &arg_boot_trace_interval_usec          },
+                { "Manager", "LazyDeviceUnits",           config_parse_bool,             0, &arg_lazy_device_units                 },
                 { "Manager", "CtrlAltDelBurstAction",     config_parse_emergency_action, 0, &arg_cad_burst_action                  },
                 {}
         };
@@ -793,6 +801,11 @@ static void set_manager_settings(Manager *m) {
         m->runtime_watchdog = arg_runtime_watchdog;
         m->shutdown_watchdog = arg_shutdown_watchdog;
         m->cad_burst_action = arg_cad_burst_action;
+        m->default_start_concurrency = arg_default_start_concurrency;
+        m->boot_trace_interval_usec = arg_boot_trace_interval_usec;
+        m->lazy_device_units = arg_lazy_device_units;
+
+        log_set_buffered(arg_log_buffered);
 
         manager_set_show_status(m, arg_show_status);
 }
@@ -3,6 +3,7 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <linux/kd.h>
+#include <pthread.h>
 #include <signal.h>
 #include <stdio_ext.h>
 #include <string.h>
@@ -28,10 +29,13 @@
 #include "boot-timestamps.h"
 #include "bus-common-errors.h"
 #include "bus-error.h"
+#include "bus-internal.h"
 #include "bus-kernel.h"
+#include "bus-message.h"
 #include "bus-util.h"
 #include "clean-ipc.h"
 #include "clock-util.h"
+#include "conf-files.h"
 #include "dbus-job.h"
 #include "dbus-manager.h"
 #include "dbus-unit.h"
@@ -39,15 +43,19 @@
 #include "dirent-util.h"
 #include "env-util.h"
 #include "escape.h"
+#include "event-util.h"
 #include "exec-util.h"
 #include "execute.h"
 #include "exit-status.h"
 #include "fd-util.h"
 #include "fileio.h"
+#include "format-util.h"
 #include "fs-util.h"
+#include "generator-cache.h"
 #include "hashmap.h"
 #include "io-util.h"
 #include "label.h"
+#include "load-fragment.h"
 #include "locale-setup.h"
 #include "log.h"
 #include "macro.h"
@@ -75,6 +83,7 @@
 #include "time-util.h"
 #include "transaction.h"
 #include "umask-util.h"
+#include "unit-cache.h"
 #include "unit-name.h"
 #include "user-util.h"
 #include "util.h"
@@ -84,6 +93,31 @@
 #define NOTIFY_RCVBUF_SIZE (8*1024*1024)
 #define CGROUPS_AGENT_RCVBUF_SIZE (8*1024*1024)
 
+/* How many datagrams to read from the notification and cgroups agent sockets with a single recvmmsg() call, and how
+ * many such calls to make at most per wakeup before returning to the event loop. */
+#define RECEIVE_BATCH_SIZE 16U
+#define RECEIVE_BATCH_ROUNDS_MAX 4U
+
+typedef struct ReceiveSlot {
+        char buffer[CONST_MAX(NOTIFY_BUFFER_MAX, PATH_MAX) + 1];
+        union {
+                struct cmsghdr cmsghdr;
+                uint8_t buf[CMSG_SPACE(sizeof(struct ucred)) +
+                            CMSG_SPACE(sizeof(int) * NOTIFY_FD_MAX)];
+        } control;
+
+        /* The sender of a notification message and whether it was a plain watchdog ping, once processed */
+        pid_t pid;
+        bool ping;
+} ReceiveSlot;
+
+/* The receive buffers are shared by both sockets, and allocated on first use */
+struct ReceiveBatch {
+        struct mmsghdr messages[RECEIVE_BATCH_SIZE];
+        struct iovec iovecs[RECEIVE_BATCH_SIZE];
+        ReceiveSlot slots[RECEIVE_BATCH_SIZE];
+};
+
 /* Initial delay and the interval for printing status messages about running jobs */
 #define JOBS_IN_PROGRESS_WAIT_USEC (5*USEC_PER_SEC)
 #define JOBS_IN_PROGRESS_PERIOD_USEC (USEC_PER_SEC / 3)
@@ -96,6 +130,21 @@
 /* How many units and jobs to process of the bus queue before returning to the event loop. */
 #define MANAGER_BUS_MESSAGE_BUDGET 100U
 
+/* Send at most one change signal per unit in this interval. Further changes are coalesced, and the signal sent at the
+ * end of the interval carries the final state. */
+#define MANAGER_UNIT_SIGNAL_INTERVAL_USEC (100*USEC_PER_MSEC)
+
+/* How many units to process of the GC queue, and for how long at most, before returning to the event loop. */
+#define MANAGER_GC_UNIT_BUDGET 1000U
+#define MANAGER_GC_TIME_BUDGET_USEC (10*USEC_PER_MSEC)
+
+/* The GC queue is dispatched at idle priority, hence might never run while the manager is busy. If it didn't get
+ * to process a slice for this long, process one from the main loop anyway. */
+#define MANAGER_GC_STARVATION_USEC (1*USEC_PER_SEC)
+
+/* With LogBuffered=, how soon to try again to send the log messages the journal didn't take yet */
+#define MANAGER_LOG_FLUSH_RETRY_USEC (50*USEC_PER_MSEC)
+
 static int manager_dispatch_notify_fd(sd_event_source *source, int fd, uint32_t revents, void *userdata);
 static int manager_dispatch_cgroups_agent_fd(sd_event_source *source, int fd, uint32_t revents, void *userdata);
 static int manager_dispatch_signal_fd(sd_event_source *source, int fd, uint32_t revents, void *userdata);
@@ -104,6 +153,8 @@ static int manager_dispatch_idle_pipe_fd(sd_event_source *source, int fd, uint32
 static int manager_dispatch_user_lookup_fd(sd_event_source *source, int fd, uint32_t revents, void *userdata);
 static int manager_dispatch_jobs_in_progress(sd_event_source *source, usec_t usec, void *userdata);
 static int manager_dispatch_run_queue(sd_event_source *source, void *userdata);
+static int manager_dispatch_gc_unit_queue(sd_event_source *source, void *userdata);
+static int manager_dispatch_dbus_unit_deferred_queue(sd_event_source *source, usec_t usec, void *userdata);
 static int manager_dispatch_sigchld(sd_event_source *source, void *userdata);
 static int manager_dispatch_timezone_change(sd_event_source *source, const struct inotify_event *event, void *userdata);
 static int manager_run_environment_generators(Manager *m);
@@ -695,6 +746,30 @@ static int manager_setup_run_queue(Manager *m) {
         return 0;
 }
 
+static int manager_setup_gc_unit_queue(Manager *m) {
+        int r;
+
+        assert(m);
+        assert(!m->gc_unit_event_source);
+
+        r = sd_event_add_defer(m->event, &m->gc_unit_event_source, manager_dispatch_gc_unit_queue, m);
+        if (r < 0)
+                return r;
+
+        /* Collecting units is the least urgent thing we do, let's run it after everything else */
+        r = sd_event_source_set_priority(m->gc_unit_event_source, SD_EVENT_PRIORITY_IDLE+1);
+        if (r < 0)
+                return r;
+
+        r = sd_event_source_set_enabled(m->gc_unit_event_source, SD_EVENT_OFF);
+        if (r < 0)
+                return r;
+
+        (void) sd_event_source_set_description(m->gc_unit_event_source, "manager-gc-unit-queue");
+
+        return 0;
+}
+
 static int manager_setup_sigchld_event_source(Manager *m) {
         int r;
 
@@ -718,6 +793,44 @@ static int manager_setup_sigchld_event_source(Manager *m) {
         return 0;
 }
 
+static void manager_dispatch_memory_pressure(MemoryPressureLevel level, void *userdata) {
+        Manager *m = userdata;
+        Iterator i;
+        sd_bus *b;
+
+        assert(m);
+
+        /* Everything dropped here is recreated on demand, there's nothing to grow back once the pressure is
+         * gone */
+        if (level == MEMORY_PRESSURE_NONE)
+                return;
+
+        log_debug("Memory pressure level %s, dropping caches.", memory_pressure_level_to_string(level));
+
+        m->seccomp_filter_cache = exec_seccomp_filter_cache_free(m->seccomp_filter_cache);
+        m->receive_batch = mfree(m->receive_batch);
+        conf_files_cache_flush();
+
+        bus_trim_caches(m->api_bus);
+        if (m->system_bus != m->api_bus)
+                bus_trim_caches(m->system_bus);
+        SET_FOREACH(b, m->private_buses, i)
+                bus_trim_caches(b);
+}
+
+static int manager_setup_memory_pressure(Manager *m) {
+        int r;
+
+        assert(m);
+        assert(!m->memory_pressure);
+
+        r = memory_pressure_new(m->event, &m->memory_pressure);
+        if (r < 0)
+                return 0; /* Not available, that's fine */
+
+        return memory_pressure_add_handler(m->memory_pressure, manager_dispatch_memory_pressure, m);
+}
+
 int manager_new(UnitFileScope scope, ManagerTestRunFlags test_run_flags, Manager **_m) {
         _cleanup_(manager_freep) Manager *m = NULL;
         int r;
@@ -749,6 +862,7 @@ int manager_new(UnitFileScope scope, ManagerTestRunFlags test_run_flags, Manager
                 .signal_fd = -1,
                 .time_change_fd = -1,
                 .user_lookup_fds = { -1, -1 },
+                .executor_fd = -1,
                 .private_listen_fd = -1,
                 .dev_autofs_fd = -1,
                 .cgroup_inotify_fd = -1,
@@ -786,8 +900,13 @@ int manager_new(UnitFileScope scope, ManagerTestRunFlags test_run_flags, Manager
                 m->invocation_log_format_string = "USER_INVOCATION_ID=%s";
         }
 
+        /* Drop-in directories are shared by many units, and enumerated again on each reload. Let's keep the
+         * listings around, they are validated against the directory modification times. */
+        conf_files_cache_set_enabled(true);
+
         /* Reboot immediately if the user hits C-A-D more often than 7x per 2s */
         RATELIMIT_INIT(m->ctrl_alt_del_ratelimit, 2 * USEC_PER_SEC, 7);
+        RATELIMIT_INIT(m->mount_ratelimit, 1 * USEC_PER_SEC, 5);
 
         r = manager_default_environment(m);
         if (r < 0)
@@ -821,6 +940,10 @@ int manager_new(UnitFileScope scope, ManagerTestRunFlags test_run_flags, Manager
         if (r < 0)
                 return r;
 
+        r = manager_setup_gc_unit_queue(m);
+        if (r < 0)
+                return r;
+
         if (test_run_flags == MANAGER_TEST_RUN_MINIMAL) {
                 m->cgroup_root = strdup("");
                 if (!m->cgroup_root)
@@ -847,6 +970,10 @@ int manager_new(UnitFileScope scope, ManagerTestRunFlags test_run_flags, Manager
                 r = manager_setup_sigchld_event_source(m);
                 if (r < 0)
                         return r;
+
+                r = manager_setup_memory_pressure(m);
+                if (r < 0)
+                        return r;
         }
 
         if (MANAGER_IS_SYSTEM(m) && test_run_flags == 0) {
@@ -1089,7 +1216,7 @@ static void unit_gc_mark_good(Unit *u, unsigned gc_marker) {
         u->gc_marker = gc_marker + GC_OFFSET_GOOD;
 
         /* Recursively mark referenced units as GOOD as well */
-        HASHMAP_FOREACH_KEY(v, other, u->dependencies[UNIT_REFERENCES], i)
+        DEPENDENCY_SET_FOREACH(v, other, u->dependencies[UNIT_REFERENCES], i)
                 if (other->gc_marker == gc_marker + GC_OFFSET_UNSURE)
                         unit_gc_mark_good(other, gc_marker);
 }
@@ -1116,7 +1243,7 @@ static void unit_gc_sweep(Unit *u, unsigned gc_marker) {
 
         is_bad = true;
 
-        HASHMAP_FOREACH_KEY(v, other, u->dependencies[UNIT_REFERENCED_BY], i) {
+        DEPENDENCY_SET_FOREACH(v, other, u->dependencies[UNIT_REFERENCED_BY], i) {
                 unit_gc_sweep(other, gc_marker);
 
                 if (other->gc_marker == gc_marker + GC_OFFSET_GOOD)
@@ -1160,23 +1287,41 @@ good:
         unit_gc_mark_good(u, gc_marker);
 }
 
-static unsigned manager_dispatch_gc_unit_queue(Manager *m) {
+static int manager_dispatch_gc_unit_queue(sd_event_source *source, void *userdata) {
+        Manager *m = userdata;
         unsigned n = 0, gc_marker;
+        usec_t deadline;
         Unit *u;
+        int r;
 
+        assert(source);
         assert(m);
 
-        /* log_debug("Running GC..."); */
+        /* After mass stop operations the queue may contain many thousands of units. Process it in slices, so that
+         * we don't block the event loop for too long. Each slice starts a new generation of markers, as the
+         * dependencies might have changed in between. */
 
         m->gc_marker += _GC_OFFSET_MAX;
         if (m->gc_marker + _GC_OFFSET_MAX <= _GC_OFFSET_MAX)
                 m->gc_marker = 1;
 
         gc_marker = m->gc_marker;
+        m->gc_unit_queue_timestamp = now(CLOCK_MONOTONIC);
+        deadline = usec_add(m->gc_unit_queue_timestamp, MANAGER_GC_TIME_BUDGET_USEC);
 
         while ((u = m->gc_unit_queue)) {
                 assert(u->in_gc_queue);
 
+                if (n >= MANAGER_GC_UNIT_BUDGET ||
+                    (n % 16 == 0 && n > 0 && now(CLOCK_MONOTONIC) >= deadline)) {
+                        r = sd_event_source_set_enabled(source, SD_EVENT_ONESHOT);
+                        if (r < 0)
+                                log_warning_errno(r, "Failed to enable GC queue event source, ignoring: %m");
+
+                        log_debug("Collected %u units, deferring the remaining ones.", n);
+                        break;
+                }
+
                 unit_gc_sweep(u, gc_marker);
 
                 LIST_REMOVE(gc_queue, m->gc_unit_queue, u);
@@ -1193,7 +1338,7 @@ static unsigned manager_dispatch_gc_unit_queue(Manager *m) {
                 }
         }
 
-        return n;
+        return 1;
 }
 
 static unsigned manager_dispatch_gc_job_queue(Manager *m) {
@@ -1271,7 +1416,9 @@ static void manager_clear_jobs_and_units(Manager *m) {
 
         assert(!m->load_queue);
         assert(!m->run_queue);
+        assert(!m->start_queue);
         assert(!m->dbus_unit_queue);
+        assert(!m->dbus_unit_deferred_queue);
         assert(!m->dbus_job_queue);
         assert(!m->cleanup_queue);
         assert(!m->gc_unit_queue);
@@ -1289,6 +1436,7 @@ static void manager_clear_jobs_and_units(Manager *m) {
 
 Manager* manager_free(Manager *m) {
         ExecDirectoryType dt;
+        UnitLatency l;
         UnitType c;
 
         if (!m)
@@ -1313,9 +1461,13 @@ Manager* manager_free(Manager *m) {
         dynamic_user_vacuum(m, false);
         hashmap_free(m->dynamic_users);
 
+        manager_free_boot_trace(m);
+
         hashmap_free(m->units);
         hashmap_free(m->units_by_invocation_id);
         hashmap_free(m->jobs);
+        assert(string_pool_size(m->string_pool) == 0);
+        string_pool_free(m->string_pool);
         hashmap_free(m->watch_pids);
         hashmap_free(m->watch_bus);
 
@@ -1330,14 +1482,20 @@ Manager* manager_free(Manager *m) {
         sd_event_source_unref(m->timezone_change_event_source);
         sd_event_source_unref(m->jobs_in_progress_event_source);
         sd_event_source_unref(m->run_queue_event_source);
+        sd_event_source_unref(m->gc_unit_event_source);
+        sd_event_source_unref(m->dbus_unit_deferred_event_source);
         sd_event_source_unref(m->user_lookup_event_source);
         sd_event_source_unref(m->sync_bus_names_event_source);
 
+        memory_pressure_free(m->memory_pressure);
+
         safe_close(m->signal_fd);
         safe_close(m->notify_fd);
         safe_close(m->cgroups_agent_fd);
         safe_close(m->time_change_fd);
         safe_close_pair(m->user_lookup_fds);
+        safe_close(m->executor_fd);
+        free(m->receive_batch);
 
         manager_close_ask_password(m);
 
@@ -1353,15 +1511,31 @@ Manager* manager_free(Manager *m) {
 
         hashmap_free(m->cgroup_unit);
         set_free_free(m->unit_path_cache);
+        hashmap_free(m->fragment_cache);
+        unit_cache_free(m->unit_cache);
+        conf_files_cache_set_enabled(false);
 
         free(m->switch_root);
         free(m->switch_root_init);
 
         rlimit_free_all(m->rlimit);
+        exec_shared_rlimits_unref(m->shared_rlimits);
+        exec_seccomp_filter_cache_free(m->seccomp_filter_cache);
+
+        assert(hashmap_isempty(m->bpf_programs));
+        hashmap_free(m->bpf_programs);
+        assert(hashmap_isempty(m->bpf_access_maps));
+        hashmap_free(m->bpf_access_maps);
+
+        for (l = 0; l < _UNIT_LATENCY_MAX; l++)
+                histogram_free(m->unit_latency[l]);
 
         assert(hashmap_isempty(m->units_requiring_mounts_for));
         hashmap_free(m->units_requiring_mounts_for);
 
+        assert(set_isempty(m->units_with_mount_ns));
+        set_free(m->units_with_mount_ns);
+
         hashmap_free(m->uid_refs);
         hashmap_free(m->gid_refs);
 
@@ -1450,6 +1624,33 @@ static void manager_catchup(Manager *m) {
         }
 }
 
+static void manager_open_unit_cache(Manager *m) {
+        const char *path;
+        int r;
+
+        assert(m);
+
+        m->unit_cache = unit_cache_free(m->unit_cache);
+
+        /* The unit cache is only built for the system manager, and only is of use together with the unit path
+         * cache */
+        if (m->unit_file_scope != UNIT_FILE_SYSTEM || MANAGER_IS_TEST_RUN(m) || !m->unit_path_cache)
+                return;
+
+        path = unit_cache_path();
+
+        r = unit_cache_open(path, m->lookup_paths.search_path, &m->unit_cache);
+        if (r == -ENOENT)
+                return;
+        if (r < 0) {
+                log_full_errno(r == -ESTALE ? LOG_DEBUG : LOG_WARNING, r,
+                               "Failed to open unit cache %s, ignoring: %m", path);
+                return;
+        }
+
+        log_debug("Using unit cache %s.", path);
+}
+
 static void manager_build_unit_path_cache(Manager *m) {
         char **i;
         int r;
@@ -1658,6 +1859,7 @@ int manager_startup(Manager *m, FILE *serialization, FDSet *fds) {
                 log_warning_errno(r, "Failed ot reduce unit file paths, ignoring: %m");
 
         manager_build_unit_path_cache(m);
+        manager_open_unit_cache(m);
 
         {
                 /* This block is (optionally) done with the reloading counter bumped */
@@ -1711,6 +1913,11 @@ int manager_startup(Manager *m, FILE *serialization, FDSet *fds) {
                         log_warning_errno(r, "Failed to deserialized tracked clients, ignoring: %m");
                 m->deserialized_subscribed = strv_free(m->deserialized_subscribed);
 
+                r = bus_track_coldplug(m, &m->subscribed_settled, false, m->deserialized_subscribed_settled);
+                if (r < 0)
+                        log_warning_errno(r, "Failed to deserialized tracked clients, ignoring: %m");
+                m->deserialized_subscribed_settled = strv_free(m->deserialized_subscribed_settled);
+
                 /* Third, fire things up! */
                 manager_coldplug(m);
 
@@ -1723,8 +1930,14 @@ int manager_startup(Manager *m, FILE *serialization, FDSet *fds) {
                         m->send_reloading_done = true;
         }
 
+        m->fragment_cache = hashmap_free(m->fragment_cache);
+
         manager_ready(m);
 
+        /* Trace resource use only on the initial startup, not when we are reexecuted */
+        if (!serialization && !MANAGER_IS_TEST_RUN(m))
+                (void) manager_start_boot_trace(m);
+
         return 0;
 }
 
@@ -1888,7 +2101,7 @@ static int manager_dispatch_target_deps_queue(Manager *m) {
                         Iterator i;
                         void *v;
 
-                        HASHMAP_FOREACH_KEY(v, target, u->dependencies[deps[k]], i) {
+                        DEPENDENCY_SET_FOREACH(v, target, u->dependencies[deps[k]], i) {
                                 r = unit_add_default_target_dependency(u, target);
                                 if (r < 0)
                                         return r;
@@ -1899,6 +2112,173 @@ static int manager_dispatch_target_deps_queue(Manager *m) {
         return r;
 }
 
+/* Reading unit file fragments in the background is only worth it if there are at least this many */
+#define PREFETCH_FRAGMENTS_MIN 16U
+
+/* The maximum number of threads to read unit file fragments with */
+#define PREFETCH_THREADS_MAX 16U
+
+DEFINE_PRIVATE_HASH_OPS_FULL(fragment_hash_ops, char, string_hash_func, string_compare_func, free,
+                             UnitFragment, unit_fragment_free);
+
+typedef struct PrefetchContext {
+        Manager *manager;
+        char **names;
+        UnitFragment **fragments;
+        size_t n_names;
+        size_t next;
+} PrefetchContext;
+
+static void *prefetch_thread(void *userdata) {
+        PrefetchContext *c = userdata;
+        size_t i;
+
+        for (;;) {
+                i = __sync_fetch_and_add(&c->next, 1);
+                if (i >= c->n_names)
+                        break;
+
+                (void) unit_fragment_read(c->manager->lookup_paths.search_path, c->manager->unit_path_cache,
+                                         c->names[i], c->fragments + i);
+        }
+
+        return NULL;
+}
+
+int manager_prefetch_fragments(Manager *m, char **names) {
+        _cleanup_free_ UnitFragment **fragments = NULL;
+        _cleanup_free_ char **todo = NULL;
+        pthread_t threads[PREFETCH_THREADS_MAX];
+        sigset_t ss, saved_ss;
+        size_t n = 0, n_threads, i;
+        PrefetchContext c;
+        char **name;
+        long k;
+        int r;
+
+        assert(m);
+
+        /* Looks for the fragments of the specified unit names and reads them using a number of worker threads, so
+         * that the file system accesses involved are done in parallel. Then, load_from_path() only parses them,
+         * which has to happen on the main thread, as it modifies the units. */
+
+        if (strv_isempty(names))
+                return 0;
+
+        todo = new(char*, strv_length(names));
+        if (!todo)
+                return -ENOMEM;
+
+        r = hashmap_ensure_allocated(&m->fragment_cache, &fragment_hash_ops);
+        if (r < 0)
+                return r;
+
+        STRV_FOREACH(name, names) {
+                _cleanup_free_ char *key = NULL;
+
+                if (hashmap_contains(m->fragment_cache, *name))
+                        continue;
+
+                /* No need to read what the unit cache knows */
+                if (unit_cache_contains(m->unit_cache, *name))
+                        continue;
+
+                key = strdup(*name);
+                if (!key)
+                        return -ENOMEM;
+
+                /* Without a fragment, the name is loaded synchronously, hence this also serves to not look for a
+                 * name twice */
+                r = hashmap_put(m->fragment_cache, key, NULL);
+                if (r < 0)
+                        return r;
+
+                todo[n++] = TAKE_PTR(key);
+        }
+
+        if (n < PREFETCH_FRAGMENTS_MIN)
+                return 0;
+
+        fragments = new0(UnitFragment*, n);
+        if (!fragments)
+                return -ENOMEM;
+
+        c = (PrefetchContext) {
+                .manager = m,
+                .names = todo,
+                .fragments = fragments,
+                .n_names = n,
+        };
+
+        k = sysconf(_SC_NPROCESSORS_ONLN);
+        n_threads = CLAMP(k > 0 ? (size_t) k : 1, 1U, PREFETCH_THREADS_MAX);
+        n_threads = MIN(n_threads, n / PREFETCH_FRAGMENTS_MIN);
+
+        /* Make sure the threads don't receive any signals, see asynchronous_job() */
+        assert_se(sigfillset(&ss) >= 0);
+        r = pthread_sigmask(SIG_BLOCK, &ss, &saved_ss);
+        if (r > 0)
+                return -r;
+
+        /* The main thread does its share of the work too */
+        for (i = 0; i < n_threads - 1; i++)
+                if (pthread_create(threads + i, NULL, prefetch_thread, &c) != 0)
+                        break;
+
+        assert_se(pthread_sigmask(SIG_SETMASK, &saved_ss, NULL) == 0);
+
+        n_threads = i;
+
+        (void) prefetch_thread(&c);
+
+        for (i = 0; i < n_threads; i++)
+                assert_se(pthread_join(threads[i], NULL) == 0);
+
+        for (i = 0; i < n; i++)
+                if (fragments[i])
+                        assert_se(hashmap_update(m->fragment_cache, todo[i], fragments[i]) >= 0);
+
+        log_debug("Read %zu unit file fragments using %zu threads.", n, n_threads + 1);
+
+        return 0;
+}
+
+static int manager_prefetch_load_queue(Manager *m) {
+        _cleanup_strv_free_ char **names = NULL;
+        Unit *u;
+        int r;
+
+        assert(m);
+
+        LIST_FOREACH(load_queue, u, m->load_queue) {
+                if (u->fragment_prefetched)
+                        continue;
+
+                u->fragment_prefetched = true;
+
+                if (u->transient || u->load_state != UNIT_STUB)
+                        continue;
+
+                r = strv_extend(&names, u->id);
+                if (r < 0)
+                        return r;
+
+                if (u->instance) {
+                        char *t;
+
+                        r = unit_name_template(u->id, &t);
+                        if (r < 0)
+                                return r;
+
+                        r = strv_consume(&names, t);
+                        if (r < 0)
+                                return r;
+                }
+        }
+
+        return manager_prefetch_fragments(m, names);
+}
+
 unsigned manager_dispatch_load_queue(Manager *m) {
         Unit *u;
         unsigned n = 0;
@@ -1917,12 +2297,21 @@ unsigned manager_dispatch_load_queue(Manager *m) {
         while ((u = m->load_queue)) {
                 assert(u->in_load_queue);
 
+                /* Whenever units were added to the queue, read their fragments in the background first */
+                if (!u->fragment_prefetched)
+                        (void) manager_prefetch_load_queue(m);
+
                 unit_load(u);
                 n++;
         }
 
         m->dispatching_load_queue = false;
 
+        /* While reloading, the fragments of the units to deserialize have been read in advance, keep them until
+         * then. Otherwise, make sure changed unit files are read again the next time they are loaded. */
+        if (!MANAGER_IS_RELOADING(m))
+                m->fragment_cache = hashmap_free(m->fragment_cache);
+
         /* Dispatch the units waiting for their target dependencies to be added now, as all targets that we know about
          * should be loaded and have aliases resolved */
         (void) manager_dispatch_target_deps_queue(m);
@@ -1975,9 +2364,9 @@ int manager_load_unit_prepare(
                 return -ENOMEM;
 
         if (path) {
-                ret->fragment_path = strdup(path);
-                if (!ret->fragment_path)
-                        return -ENOMEM;
+                r = unit_set_fragment_path(ret, path);
+                if (r < 0)
+                        return r;
         }
 
         r = unit_add_name(ret, name);
@@ -2057,6 +2446,12 @@ void manager_dump_jobs(Manager *s, FILE *f, const char *prefix) {
 }
 
 void manager_dump_units(Manager *s, FILE *f, const char *prefix) {
+        size_t type_memory[_UNIT_TYPE_MAX] = {}, rlimit_memory[_UNIT_TYPE_MAX] = {}, rlimit_shared[_UNIT_TYPE_MAX] = {};
+        unsigned type_n[_UNIT_TYPE_MAX] = {};
+        char buf[FORMAT_BYTES_MAX];
+        size_t memory = 0;
+        unsigned n = 0;
+        UnitType type;
         Iterator i;
         Unit *u;
         const char *t;
@@ -2065,8 +2460,65 @@ void manager_dump_units(Manager *s, FILE *f, const char *prefix) {
         assert(f);
 
         HASHMAP_FOREACH_KEY(u, t, s->units, i)
-                if (u->id == t)
+                if (u->id == t) {
+                        ExecContext *ec;
+
                         unit_dump(u, f, prefix);
+                        memory += unit_dependencies_memory_usage(u);
+                        n++;
+
+                        type_n[u->type]++;
+                        type_memory[u->type] += UNIT_VTABLE(u)->object_size;
+
+                        ec = unit_get_exec_context(u);
+                        if (ec) {
+                                int r;
+
+                                rlimit_memory[u->type] += exec_context_rlimit_memory_usage(ec);
+
+                                for (r = 0; r < _RLIMIT_MAX; r++)
+                                        if (exec_context_rlimit_is_shared(ec, r))
+                                                rlimit_shared[u->type] += sizeof(struct rlimit);
+                        }
+                }
+
+        fprintf(f, "%sDependency memory of %u units: %s\n",
+                strempty(prefix), n, format_bytes(buf, sizeof(buf), memory));
+
+        for (type = 0; type < _UNIT_TYPE_MAX; type++) {
+                char buf2[FORMAT_BYTES_MAX], buf3[FORMAT_BYTES_MAX];
+
+                if (type_n[type] == 0)
+                        continue;
+
+                /* The shared limits would otherwise have been copied into each unit, i.e. that's what we save */
+                fprintf(f, "%sMemory of %u %s units: %s, resource limits: %s, resource limits shared: %s\n",
+                        strempty(prefix), type_n[type], unit_type_to_string(type),
+                        format_bytes(buf, sizeof(buf), type_memory[type]),
+                        format_bytes(buf2, sizeof(buf2), rlimit_memory[type]),
+                        format_bytes(buf3, sizeof(buf3), rlimit_shared[type]));
+        }
+}
+
+static void manager_dump_hashmaps(Manager *m, FILE *f, const char *prefix) {
+        assert(m);
+        assert(f);
+
+        /* The tables which grow with the number of units, to find out which of them are bloated or badly
+         * distributed */
+        hashmap_dump_stats(m->units, f, prefix, "units");
+        hashmap_dump_stats(m->units_by_invocation_id, f, prefix, "units_by_invocation_id");
+        hashmap_dump_stats(m->jobs, f, prefix, "jobs");
+        hashmap_dump_stats(m->watch_pids, f, prefix, "watch_pids");
+        hashmap_dump_stats(m->watch_bus, f, prefix, "watch_bus");
+        hashmap_dump_stats(m->cgroup_unit, f, prefix, "cgroup_unit");
+        hashmap_dump_stats(m->cgroup_inotify_wd_unit, f, prefix, "cgroup_inotify_wd_unit");
+        hashmap_dump_stats(m->devices_by_sysfs, f, prefix, "devices_by_sysfs");
+        hashmap_dump_stats(m->units_requiring_mounts_for, f, prefix, "units_requiring_mounts_for");
+        hashmap_dump_stats(m->exec_runtime_by_id, f, prefix, "exec_runtime_by_id");
+        set_dump_stats(m->unit_path_cache, f, prefix, "unit_path_cache");
+        set_dump_stats(m->startup_units, f, prefix, "startup_units");
+        set_dump_stats(m->failed_units, f, prefix, "failed_units");
 }
 
 void manager_dump(Manager *m, FILE *f, const char *prefix) {
@@ -2087,6 +2539,14 @@ void manager_dump(Manager *m, FILE *f, const char *prefix) {
 
         manager_dump_units(m, f, prefix);
         manager_dump_jobs(m, f, prefix);
+        manager_dump_hashmaps(m, f, prefix);
+        job_dump_pool_stats(f, prefix);
+        (void) event_dump_profile(m->event, f, prefix);
+
+        if (m->api_bus)
+                bus_message_cache_dump(m->api_bus, f, prefix);
+        if (m->system_bus && m->system_bus != m->api_bus)
+                bus_message_cache_dump(m->system_bus, f, prefix);
 }
 
 int manager_get_dump_string(Manager *m, char **ret) {
@@ -2134,12 +2594,17 @@ static int manager_dispatch_run_queue(sd_event_source *source, void *userdata) {
         assert(source);
         assert(m);
 
-        while ((j = m->run_queue)) {
-                assert(j->installed);
-                assert(j->in_run_queue);
+        do {
+                while ((j = m->run_queue)) {
+                        assert(j->installed);
+                        assert(j->in_run_queue);
 
-                (void) job_run_and_invalidate(j);
-        }
+                        (void) job_run_and_invalidate(j);
+                }
+
+                /* Start jobs whose start is limited were put in the start queue, let's see how many of them we
+                 * may start now. This might make more jobs runnable. */
+        } while (job_dispatch_start_queue(m) > 0);
 
         if (m->n_running_jobs > 0)
                 manager_watch_jobs_in_progress(m);
@@ -2150,18 +2615,87 @@ static int manager_dispatch_run_queue(sd_event_source *source, void *userdata) {
         return 1;
 }
 
+static void manager_flush_dbus_unit_deferred_queue(Manager *m) {
+        Unit *u;
+
+        assert(m);
+
+        while ((u = m->dbus_unit_deferred_queue)) {
+                assert(u->in_dbus_queue && u->in_dbus_deferred_queue);
+
+                LIST_REMOVE(dbus_queue, m->dbus_unit_deferred_queue, u);
+                LIST_PREPEND(dbus_queue, m->dbus_unit_queue, u);
+                u->in_dbus_deferred_queue = false;
+        }
+}
+
+static int manager_defer_dbus_unit(Manager *m, Unit *u) {
+        usec_t next;
+        int r;
+
+        assert(m);
+        assert(u);
+        assert(u->in_dbus_queue && !u->in_dbus_deferred_queue);
+
+        /* The timer is only armed for the first unit deferred. All others deferred in the meantime are sent out
+         * together with it, i.e. possibly a bit earlier than the interval, which is fine. */
+        if (!m->dbus_unit_deferred_queue) {
+                next = usec_add(u->dbus_signal_timestamp, MANAGER_UNIT_SIGNAL_INTERVAL_USEC);
+
+                if (m->dbus_unit_deferred_event_source) {
+                        r = sd_event_source_set_time(m->dbus_unit_deferred_event_source, next);
+                        if (r < 0)
+                                return r;
+
+                        r = sd_event_source_set_enabled(m->dbus_unit_deferred_event_source, SD_EVENT_ONESHOT);
+                        if (r < 0)
+                                return r;
+                } else {
+                        r = sd_event_add_time(
+                                        m->event,
+                                        &m->dbus_unit_deferred_event_source,
+                                        CLOCK_MONOTONIC,
+                                        next, 0,
+                                        manager_dispatch_dbus_unit_deferred_queue, m);
+                        if (r < 0)
+                                return r;
+
+                        (void) sd_event_source_set_description(m->dbus_unit_deferred_event_source, "manager-dbus-unit-deferred-queue");
+                }
+        }
+
+        LIST_REMOVE(dbus_queue, m->dbus_unit_queue, u);
+        LIST_PREPEND(dbus_queue, m->dbus_unit_deferred_queue, u);
+        u->in_dbus_deferred_queue = true;
+
+        return 0;
+}
+
+static int manager_dispatch_dbus_unit_deferred_queue(sd_event_source *source, usec_t usec, void *userdata) {
+        Manager *m = userdata;
+
+        assert(m);
+
+        /* Put everything back into the regular queue, which is dispatched from the main loop right after this */
+        manager_flush_dbus_unit_deferred_queue(m);
+        return 0;
+}
+
 static unsigned manager_dispatch_dbus_queue(Manager *m) {
         unsigned n = 0, budget;
+        usec_t ts = USEC_INFINITY;
         Unit *u;
         Job *j;
+        int r;
 
         assert(m);
 
         /* When we are reloading, let's not wait with generating signals, since we need to exit the manager as quickly
          * as we can. There's no point in throttling generation of signals in that case. */
-        if (MANAGER_IS_RELOADING(m) || m->send_reloading_done || m->pending_reload_message)
+        if (MANAGER_IS_RELOADING(m) || m->send_reloading_done || m->pending_reload_message) {
                 budget = (unsigned) -1; /* infinite budget in this case */
-        else {
+                manager_flush_dbus_unit_deferred_queue(m);
+        } else {
                 /* Anything to do at all? */
                 if (!m->dbus_unit_queue && !m->dbus_job_queue)
                         return 0;
@@ -2189,6 +2723,23 @@ static unsigned manager_dispatch_dbus_queue(Manager *m) {
 
                 assert(u->in_dbus_queue);
 
+                /* If we sent a change signal for this unit very recently, hold off until the coalescing window is
+                 * over, so that a unit flapping through its states doesn't generate a signal for each of them. The
+                 * signal for a new unit, and the ones while reloading, are never deferred. */
+                if (budget != (unsigned) -1 && u->sent_dbus_new_signal) {
+                        if (ts == USEC_INFINITY)
+                                ts = now(CLOCK_MONOTONIC);
+
+                        if (u->dbus_signal_timestamp + MANAGER_UNIT_SIGNAL_INTERVAL_USEC > ts) {
+                                r = manager_defer_dbus_unit(m, u);
+                                if (r >= 0)
+                                        continue;
+
+                                /* Without the timer we'd never get to send it, hence send it right away */
+                                log_debug_errno(r, "Failed to arm unit change signal timer, not coalescing: %m");
+                        }
+                }
+
                 bus_unit_send_change_signal(u);
                 n++;
 
@@ -2220,31 +2771,94 @@ static unsigned manager_dispatch_dbus_queue(Manager *m) {
         return n;
 }
 
-static int manager_dispatch_cgroups_agent_fd(sd_event_source *source, int fd, uint32_t revents, void *userdata) {
-        Manager *m = userdata;
-        char buf[PATH_MAX+1];
-        ssize_t n;
+static int manager_receive_batch(Manager *m, int fd, size_t max_size, bool with_control) {
+        ReceiveBatch *b;
+        unsigned i;
+        int n;
 
-        n = recv(fd, buf, sizeof(buf), 0);
-        if (n < 0)
-                return log_error_errno(errno, "Failed to read cgroups agent message: %m");
-        if (n == 0) {
-                log_error("Got zero-length cgroups agent message, ignoring.");
-                return 0;
-        }
-        if ((size_t) n >= sizeof(buf)) {
-                log_error("Got overly long cgroups agent message, ignoring.");
-                return 0;
-        }
+        assert(m);
+        assert(fd >= 0);
+        assert(max_size <= CONST_MAX(NOTIFY_BUFFER_MAX, PATH_MAX));
+
+        if (!m->receive_batch) {
+                m->receive_batch = new(ReceiveBatch, 1);
+                if (!m->receive_batch)
+                        return -ENOMEM;
+        }
+
+        b = m->receive_batch;
+
+        /* The kernel updates the lengths in place, hence reset all slots before each call. We pass MSG_TRUNC, so that
+         * the returned lengths tell us about oversized datagrams. */
+        for (i = 0; i < RECEIVE_BATCH_SIZE; i++) {
+                b->iovecs[i] = IOVEC_MAKE(b->slots[i].buffer, max_size);
+                b->messages[i] = (struct mmsghdr) {
+                        .msg_hdr = {
+                                .msg_iov = b->iovecs + i,
+                                .msg_iovlen = 1,
+                                .msg_control = with_control ? &b->slots[i].control : NULL,
+                                .msg_controllen = with_control ? sizeof(b->slots[i].control) : 0,
+                        },
+                };
+        }
+
+        n = recvmmsg(fd, b->messages, RECEIVE_BATCH_SIZE, MSG_DONTWAIT|MSG_CMSG_CLOEXEC|MSG_TRUNC, NULL);
+        if (n < 0)
+                return -errno;
+
+        return n;
+}
+
+static void manager_process_cgroups_agent_message(Manager *m, char *buf, size_t n, int flags) {
+        assert(m);
+        assert(buf);
+
+        if (n == 0) {
+                log_error("Got zero-length cgroups agent message, ignoring.");
+                return;
+        }
+        if (n > PATH_MAX || (flags & MSG_TRUNC)) {
+                log_error("Got overly long cgroups agent message, ignoring.");
+                return;
+        }
 
         if (memchr(buf, 0, n)) {
                 log_error("Got cgroups agent message with embedded NUL byte, ignoring.");
-                return 0;
+                return;
         }
         buf[n] = 0;
 
         manager_notify_cgroup_empty(m, buf);
         (void) bus_forward_agent_released(m, buf);
+}
+
+static int manager_dispatch_cgroups_agent_fd(sd_event_source *source, int fd, uint32_t revents, void *userdata) {
+        Manager *m = userdata;
+        unsigned round;
+        int i, n;
+
+        assert(m);
+
+        for (round = 0; round < RECEIVE_BATCH_ROUNDS_MAX; round++) {
+                n = manager_receive_batch(m, fd, PATH_MAX, false);
+                if (n == -ENOMEM) {
+                        log_oom();
+                        return 0;
+                }
+                if (IN_SET(n, -EAGAIN, -EINTR))
+                        return 0;
+                if (n < 0)
+                        return log_error_errno(n, "Failed to read cgroups agent message: %m");
+
+                for (i = 0; i < n; i++)
+                        manager_process_cgroups_agent_message(m,
+                                                              m->receive_batch->slots[i].buffer,
+                                                              m->receive_batch->messages[i].msg_len,
+                                                              m->receive_batch->messages[i].msg_hdr.msg_flags);
+
+                if ((unsigned) n < RECEIVE_BATCH_SIZE)
+                        break;
+        }
 
         return 0;
 }
@@ -2287,27 +2901,26 @@ static void manager_invoke_notify_message(
         }
 }
 
-static int manager_dispatch_notify_fd(sd_event_source *source, int fd, uint32_t revents, void *userdata) {
+static bool receive_batch_repeats_ping(ReceiveBatch *b, unsigned i, pid_t pid) {
+        assert(b);
 
-        _cleanup_fdset_free_ FDSet *fds = NULL;
-        Manager *m = userdata;
-        char buf[NOTIFY_BUFFER_MAX+1];
-        struct iovec iovec = {
-                .iov_base = buf,
-                .iov_len = sizeof(buf)-1,
-        };
-        union {
-                struct cmsghdr cmsghdr;
-                uint8_t buf[CMSG_SPACE(sizeof(struct ucred)) +
-                            CMSG_SPACE(sizeof(int) * NOTIFY_FD_MAX)];
-        } control = {};
-        struct msghdr msghdr = {
-                .msg_iov = &iovec,
-                .msg_iovlen = 1,
-                .msg_control = &control,
-                .msg_controllen = sizeof(control),
-        };
+        /* Returns true if the last message this PID sent earlier in the batch was a plain watchdog ping too, in which
+         * case another one right after it only rearms the watchdog timer once more, and can be skipped. */
+        while (i > 0) {
+                i--;
+
+                if (b->slots[i].pid == pid)
+                        return b->slots[i].ping;
+        }
+
+        return false;
+}
 
+static void manager_process_notify_message(Manager *m, ReceiveBatch *b, unsigned i) {
+        _cleanup_fdset_free_ FDSet *fds = NULL;
+        struct msghdr *msghdr = &b->messages[i].msg_hdr;
+        size_t n = b->messages[i].msg_len;
+        char *buf = b->slots[i].buffer;
         struct cmsghdr *cmsg;
         struct ucred *ucred = NULL;
         _cleanup_free_ Unit **array_copy = NULL;
@@ -2315,28 +2928,13 @@ static int manager_dispatch_notify_fd(sd_event_source *source, int fd, uint32_t
         int r, *fd_array = NULL;
         size_t n_fds = 0;
         bool found = false;
-        ssize_t n;
 
         assert(m);
-        assert(m->notify_fd == fd);
-
-        if (revents != EPOLLIN) {
-                log_warning("Got unexpected poll event for notify fd.");
-                return 0;
-        }
-
-        n = recvmsg(m->notify_fd, &msghdr, MSG_DONTWAIT|MSG_CMSG_CLOEXEC|MSG_TRUNC);
-        if (n < 0) {
-                if (IN_SET(errno, EAGAIN, EINTR))
-                        return 0; /* Spurious wakeup, try again */
 
-                /* If this is any other, real error, then let's stop processing this socket. This of course means we
-                 * won't take notification messages anymore, but that's still better than busy looping around this:
-                 * being woken up over and over again but being unable to actually read the message off the socket. */
-                return log_error_errno(errno, "Failed to receive notification message: %m");
-        }
+        b->slots[i].pid = 0;
+        b->slots[i].ping = false;
 
-        CMSG_FOREACH(cmsg, &msghdr) {
+        CMSG_FOREACH(cmsg, msghdr) {
                 if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
 
                         fd_array = (int*) CMSG_DATA(cmsg);
@@ -2357,30 +2955,40 @@ static int manager_dispatch_notify_fd(sd_event_source *source, int fd, uint32_t
                 if (r < 0) {
                         close_many(fd_array, n_fds);
                         log_oom();
-                        return 0;
+                        return;
                 }
         }
 
         if (!ucred || !pid_is_valid(ucred->pid)) {
                 log_warning("Received notify message without valid credentials. Ignoring.");
-                return 0;
+                return;
         }
 
-        if ((size_t) n >= sizeof(buf) || (msghdr.msg_flags & MSG_TRUNC)) {
+        if (n > NOTIFY_BUFFER_MAX || (msghdr->msg_flags & MSG_TRUNC)) {
                 log_warning("Received notify message exceeded maximum size. Ignoring.");
-                return 0;
+                return;
         }
 
         /* As extra safety check, let's make sure the string we get doesn't contain embedded NUL bytes. We permit one
          * trailing NUL byte in the message, but don't expect it. */
         if (n > 1 && memchr(buf, 0, n-1)) {
                 log_warning("Received notify message with embedded NUL bytes. Ignoring.");
-                return 0;
+                return;
         }
 
         /* Make sure it's NUL-terminated. */
         buf[n] = 0;
 
+        /* Services with a short WatchdogSec= may ping faster than we get around to reading the socket. Only act on
+         * the first of a series of pings of the same process within one batch. */
+        b->slots[i].pid = ucred->pid;
+        if (n_fds == 0 && STR_IN_SET(buf, "WATCHDOG=1", "WATCHDOG=1\n")) {
+                b->slots[i].ping = true;
+
+                if (receive_batch_repeats_ping(b, i, ucred->pid))
+                        return;
+        }
+
         /* Increase the generation counter used for filtering out duplicate unit invocations. */
         m->notifygen++;
 
@@ -2409,8 +3017,8 @@ static int manager_dispatch_notify_fd(sd_event_source *source, int fd, uint32_t
                 found = true;
         }
         if (array_copy)
-                for (size_t i = 0; array_copy[i]; i++) {
-                        manager_invoke_notify_message(m, array_copy[i], ucred, buf, fds);
+                for (size_t k = 0; array_copy[k]; k++) {
+                        manager_invoke_notify_message(m, array_copy[k], ucred, buf, fds);
                         found = true;
                 }
 
@@ -2419,6 +3027,46 @@ static int manager_dispatch_notify_fd(sd_event_source *source, int fd, uint32_t
 
         if (fdset_size(fds) > 0)
                 log_warning("Got extra auxiliary fds with notification message, closing them.");
+}
+
+static int manager_dispatch_notify_fd(sd_event_source *source, int fd, uint32_t revents, void *userdata) {
+        Manager *m = userdata;
+        unsigned round;
+        int i, n;
+
+        assert(m);
+        assert(m->notify_fd == fd);
+
+        if (revents != EPOLLIN) {
+                log_warning("Got unexpected poll event for notify fd.");
+                return 0;
+        }
+
+        /* Read a batch of messages at a time. The units only queue their D-Bus property change signals while
+         * processing them (see unit_add_to_dbus_queue()), hence each unit sends at most one of them for the whole
+         * batch once we return to the event loop. */
+        for (round = 0; round < RECEIVE_BATCH_ROUNDS_MAX; round++) {
+                n = manager_receive_batch(m, fd, NOTIFY_BUFFER_MAX, true);
+                if (n == -ENOMEM) {
+                        log_oom();
+                        return 0;
+                }
+                if (IN_SET(n, -EAGAIN, -EINTR))
+                        return 0; /* Spurious wakeup, or we read everything, try again */
+
+                /* If this is any other, real error, then let's stop processing this socket. This of course means we
+                 * won't take notification messages anymore, but that's still better than busy looping around this:
+                 * being woken up over and over again but being unable to actually read the message off the
+                 * socket. */
+                if (n < 0)
+                        return log_error_errno(n, "Failed to receive notification message: %m");
+
+                for (i = 0; i < n; i++)
+                        manager_process_notify_message(m, m->receive_batch, i);
+
+                if ((unsigned) n < RECEIVE_BATCH_SIZE)
+                        break;
+        }
 
         return 0;
 }
@@ -2852,8 +3500,9 @@ int manager_loop(Manager *m) {
         assert(m);
         assert(m->objective == MANAGER_OK); /* Ensure manager_startup() has been called */
 
-        /* Release the path cache */
+        /* Release the path cache, and with it the unit cache, which can't be validated without it */
         m->unit_path_cache = set_free_free(m->unit_path_cache);
+        m->unit_cache = unit_cache_free(m->unit_cache);
 
         manager_check_finished(m);
 
@@ -2880,8 +3529,13 @@ int manager_loop(Manager *m) {
                 if (manager_dispatch_gc_job_queue(m) > 0)
                         continue;
 
-                if (manager_dispatch_gc_unit_queue(m) > 0)
+                /* Make sure a steady stream of higher-priority events can't keep units from being collected
+                 * forever */
+                if (m->gc_unit_queue &&
+                    now(CLOCK_MONOTONIC) >= usec_add(m->gc_unit_queue_timestamp, MANAGER_GC_STARVATION_USEC)) {
+                        (void) manager_dispatch_gc_unit_queue(m->gc_unit_event_source, m);
                         continue;
+                }
 
                 if (manager_dispatch_cleanup_queue(m) > 0)
                         continue;
@@ -2903,6 +3557,10 @@ int manager_loop(Manager *m) {
                 } else
                         wait_usec = USEC_INFINITY;
 
+                /* Send out the log messages that were queued while the journal was busy */
+                if (log_flush_buffered() > 0)
+                        wait_usec = MIN(wait_usec, MANAGER_LOG_FLUSH_RETRY_USEC);
+
                 r = sd_event_run(m->event, wait_usec);
                 if (r < 0)
                         return log_error_errno(r, "Failed to run event loop: %m");
@@ -3151,6 +3809,8 @@ int manager_serialize(
                 (void) serialize_dual_timestamp(f, joined, m->timestamps + q);
         }
 
+        unit_serialize_latency(f, m->unit_latency);
+
         if (!switching_root)
                 (void) serialize_strv(f, "env", m->client_environment);
 
@@ -3183,6 +3843,7 @@ int manager_serialize(
         }
 
         bus_track_serialize(m->subscribed, f, "subscribed");
+        bus_track_serialize(m->subscribed_settled, f, "subscribed-settled");
 
         r = dynamic_user_serialize(m, f, fds);
         if (r < 0)
@@ -3195,15 +3856,14 @@ int manager_serialize(
         if (r < 0)
                 return r;
 
-        (void) fputc('\n', f);
+        (void) serialize_end_marker(f);
 
         HASHMAP_FOREACH_KEY(u, t, m->units, i) {
                 if (u->id != t)
                         continue;
 
                 /* Start marker */
-                fputs(u->id, f);
-                fputc('\n', f);
+                (void) serialize_marker(f, u->id);
 
                 r = unit_serialize(u, f, fds, !switching_root);
                 if (r < 0)
@@ -3249,7 +3909,7 @@ static int manager_deserialize_units(Manager *m, FILE *f, FDSet *fds) {
 
         for (;;) {
                 /* Start marker */
-                r = read_line(f, LONG_LINE_MAX, &line);
+                r = deserialize_read_line(f, &line);
                 if (r < 0)
                         return log_error_errno(r, "Failed to read serialization line: %m");
                 if (r == 0)
@@ -3270,6 +3930,36 @@ static int manager_deserialize_units(Manager *m, FILE *f, FDSet *fds) {
         return 0;
 }
 
+static int manager_deserialize_latency(Manager *m, const char *l) {
+        UnitLatency q;
+        const char *val = NULL;
+        int r;
+
+        assert(m);
+        assert(l);
+
+        for (q = 0; q < _UNIT_LATENCY_MAX; q++) {
+                val = startswith(l, unit_latency_to_string(q));
+                if (!val)
+                        continue;
+
+                val = startswith(val, "-latency=");
+                if (val)
+                        break;
+        }
+        if (q >= _UNIT_LATENCY_MAX)
+                return 0;
+
+        m->unit_latency[q] = histogram_free(m->unit_latency[q]);
+
+        r = histogram_from_string(val, m->unit_latency + q);
+        if (r < 0)
+                log_notice_errno(r, "Failed to parse %s latency histogram '%s', ignoring: %m",
+                                 unit_latency_to_string(q), val);
+
+        return 1;
+}
+
 int manager_deserialize(Manager *m, FILE *f, FDSet *fds) {
         int r = 0;
 
@@ -3287,7 +3977,7 @@ int manager_deserialize(Manager *m, FILE *f, FDSet *fds) {
                 _cleanup_free_ char *line = NULL;
                 const char *val, *l;
 
-                r = read_line(f, LONG_LINE_MAX, &line);
+                r = deserialize_read_line(f, &line);
                 if (r < 0)
                         return log_error_errno(r, "Failed to read serialization line: %m");
                 if (r == 0)
@@ -3441,6 +4131,11 @@ int manager_deserialize(Manager *m, FILE *f, FDSet *fds) {
                         if (strv_extend(&m->deserialized_subscribed, val) < 0)
                                 return -ENOMEM;
 
+                } else if ((val = startswith(l, "subscribed-settled="))) {
+
+                        if (strv_extend(&m->deserialized_subscribed_settled, val) < 0)
+                                return -ENOMEM;
+
                 } else {
                         ManagerTimestamp q;
 
@@ -3456,7 +4151,8 @@ int manager_deserialize(Manager *m, FILE *f, FDSet *fds) {
 
                         if (q < _MANAGER_TIMESTAMP_MAX) /* found it */
                                 (void) deserialize_dual_timestamp(val, m->timestamps + q);
-                        else if (!startswith(l, "kdbus-fd=")) /* ignore kdbus */
+                        else if (manager_deserialize_latency(m, l) == 0 &&
+                                 !startswith(l, "kdbus-fd=")) /* ignore kdbus */
                                 log_notice("Unknown serialization item '%s', ignoring.", l);
                 }
         }
@@ -3475,10 +4171,51 @@ static void manager_flush_finished_jobs(Manager *m) {
         m->pending_finished_jobs = set_free(m->pending_finished_jobs);
 }
 
+static int manager_get_fragment_names(Manager *m, char ***ret) {
+        _cleanup_strv_free_ char **names = NULL;
+        Iterator i;
+        Unit *u;
+        char *k;
+        int r;
+
+        assert(m);
+        assert(ret);
+
+        HASHMAP_FOREACH_KEY(u, k, m->units, i) {
+
+                /* ignore aliases */
+                if (u->id != k)
+                        continue;
+
+                if (u->transient)
+                        continue;
+
+                r = strv_extend(&names, u->id);
+                if (r < 0)
+                        return r;
+
+                if (u->instance) {
+                        char *t;
+
+                        r = unit_name_template(u->id, &t);
+                        if (r < 0)
+                                return r;
+
+                        r = strv_consume(&names, t);
+                        if (r < 0)
+                                return r;
+                }
+        }
+
+        *ret = TAKE_PTR(names);
+        return 0;
+}
+
 int manager_reload(Manager *m) {
         _cleanup_(manager_reloading_stopp) Manager *reloading = NULL;
         _cleanup_fdset_free_ FDSet *fds = NULL;
         _cleanup_fclose_ FILE *f = NULL;
+        _cleanup_strv_free_ char **names = NULL;
         int r;
 
         assert(m);
@@ -3494,7 +4231,12 @@ int manager_reload(Manager *m) {
         /* We are officially in reload mode from here on. */
         reloading = manager_reloading_start(m);
 
+        /* The binary format is quicker to read back, but only use it when we read the serialization back
+         * ourselves. On daemon-reexec and when switching root it is read by another systemd binary, which might
+         * be an older version that only knows the text format. */
+        serialize_begin_binary(f);
         r = manager_serialize(m, f, fds, false);
+        serialize_end_binary(f);
         if (r < 0)
                 return r;
 
@@ -3506,12 +4248,16 @@ int manager_reload(Manager *m) {
 
         bus_manager_send_reloading(m, true);
 
+        /* Remember which units we had, so that we can read their fragments in one go below */
+        r = manager_get_fragment_names(m, &names);
+        if (r < 0)
+                log_warning_errno(r, "Failed to determine unit names, ignoring: %m");
+
         /* Start by flushing out all jobs and units, all generated units, all runtime environments, all dynamic users
          * and everything else that is worth flushing out. We'll get it all back from the serialization — if we need
          * it.*/
 
         manager_clear_jobs_and_units(m);
-        lookup_paths_flush_generator(&m->lookup_paths);
         lookup_paths_free(&m->lookup_paths);
         exec_runtime_vacuum(m);
         dynamic_user_vacuum(m, false);
@@ -3523,13 +4269,18 @@ int manager_reload(Manager *m) {
                 log_warning_errno(r, "Failed to initialize path lookup table, ignoring: %m");
 
         (void) manager_run_environment_generators(m);
-        (void) manager_run_generators(m);
+        (void) manager_run_generators(m); /* This flushes the output of the previous run, unless it is reused */
 
         r = lookup_paths_reduce(&m->lookup_paths);
         if (r < 0)
                 log_warning_errno(r, "Failed ot reduce unit file paths, ignoring: %m");
 
         manager_build_unit_path_cache(m);
+        manager_open_unit_cache(m);
+
+        r = manager_prefetch_fragments(m, names);
+        if (r < 0)
+                log_warning_errno(r, "Failed to read unit files in the background, ignoring: %m");
 
         /* First, enumerate what we can from kernel and suchlike */
         manager_enumerate_perpetual(m);
@@ -3558,6 +4309,8 @@ int manager_reload(Manager *m) {
         assert(m->n_reloading > 0);
         m->n_reloading--;
 
+        m->fragment_cache = hashmap_free(m->fragment_cache);
+
         manager_ready(m);
 
         if (!MANAGER_IS_RELOADING(m))
@@ -3567,6 +4320,317 @@ int manager_reload(Manager *m) {
         return 0;
 }
 
+typedef struct ReloadDependency {
+        Unit *other;
+        UnitDependency d;
+        UnitDependencyMask mask;
+} ReloadDependency;
+
+typedef struct ReloadRef {
+        UnitRef *ref;
+        Unit *source;
+} ReloadRef;
+
+static bool unit_shall_reload(Unit *u) {
+        assert(u);
+
+        /* Units that are enumerated from the kernel, transient and perpetual units have no unit files we could
+         * re-read individually. */
+        if (UNIT_VTABLE(u)->enumerate || u->transient || u->perpetual)
+                return false;
+
+        if (IN_SET(u->load_state, UNIT_NOT_FOUND, UNIT_BAD_SETTING, UNIT_ERROR))
+                return true;
+
+        if (!IN_SET(u->load_state, UNIT_LOADED, UNIT_MASKED))
+                return false;
+
+        return unit_need_daemon_reload(u);
+}
+
+static int reload_dependency_add(ReloadDependency **deps, size_t *n_deps, size_t *n_allocated, Unit *other, UnitDependency d, UnitDependencyMask mask) {
+        if (!GREEDY_REALLOC(*deps, *n_allocated, *n_deps + 1))
+                return -ENOMEM;
+
+        (*deps)[(*n_deps)++] = (ReloadDependency) {
+                .other = other,
+                .d = d,
+                .mask = mask,
+        };
+
+        return 0;
+}
+
+static int unit_get_foreign_dependencies(Unit *u, ReloadDependency **ret, size_t *ret_n) {
+        _cleanup_free_ ReloadDependency *deps = NULL;
+        _cleanup_set_free_ Set *seen = NULL;
+        size_t n_deps = 0, n_allocated = 0;
+        UnitDependency d, e;
+        const char *t;
+        Iterator i;
+        Unit *other;
+        void *v;
+        int r;
+
+        assert(u);
+        assert(ret);
+        assert(ret_n);
+
+        /* Collects the dependencies other units have on this unit, i.e. the ones that would be lost when the unit is
+         * freed and that reloading the unit's own files would not recreate. Almost all dependencies are registered
+         * on both ends, hence looking at our own neighbours suffices. OnFailure= and JoinsNamespaceOf= are only
+         * registered on the depending unit, hence check all units for those. */
+
+        seen = set_new(NULL);
+        if (!seen)
+                return -ENOMEM;
+
+        for (d = 0; d < _UNIT_DEPENDENCY_MAX; d++)
+                DEPENDENCY_SET_FOREACH(v, other, u->dependencies[d], i) {
+                        if (other == u)
+                                continue;
+
+                        r = set_put(seen, other);
+                        if (r < 0)
+                                return r;
+                        if (r == 0)
+                                continue;
+
+                        for (e = 0; e < _UNIT_DEPENDENCY_MAX; e++) {
+                                UnitDependencyInfo di;
+
+                                if (IN_SET(e, UNIT_ON_FAILURE, UNIT_JOINS_NAMESPACE_OF))
+                                        continue;
+
+                                di.data = dependency_set_get(other->dependencies[e], u);
+                                if (di.origin_mask == 0)
+                                        continue;
+
+                                r = reload_dependency_add(&deps, &n_deps, &n_allocated, other, e, di.origin_mask);
+                                if (r < 0)
+                                        return r;
+                        }
+                }
+
+        HASHMAP_FOREACH_KEY(other, t, u->manager->units, i) {
+                UnitDependency one_way[] = { UNIT_ON_FAILURE, UNIT_JOINS_NAMESPACE_OF };
+                size_t k;
+
+                if (other->id != t || other == u)
+                        continue;
+
+                for (k = 0; k < ELEMENTSOF(one_way); k++) {
+                        UnitDependencyInfo di;
+
+                        di.data = dependency_set_get(other->dependencies[one_way[k]], u);
+                        if (di.origin_mask == 0)
+                                continue;
+
+                        r = reload_dependency_add(&deps, &n_deps, &n_allocated, other, one_way[k], di.origin_mask);
+                        if (r < 0)
+                                return r;
+                }
+        }
+
+        *ret = TAKE_PTR(deps);
+        *ret_n = n_deps;
+        return 0;
+}
+
+static int manager_reload_one_unit(Manager *m, Unit *u, Unit **ret) {
+        _cleanup_free_ ReloadDependency *deps = NULL;
+        _cleanup_free_ ReloadRef *refs = NULL;
+        _cleanup_fdset_free_ FDSet *fds = NULL;
+        _cleanup_fclose_ FILE *f = NULL;
+        _cleanup_free_ char *id = NULL;
+        size_t n_deps = 0, n_refs = 0, k;
+        ExecRuntime *rt;
+        UnitRef *ref;
+        Unit *n;
+        int r;
+
+        assert(m);
+        assert(u);
+        assert(ret);
+
+        id = strdup(u->id);
+        if (!id)
+                return log_oom();
+
+        r = unit_get_foreign_dependencies(u, &deps, &n_deps);
+        if (r < 0)
+                return log_unit_error_errno(u, r, "Failed to collect dependencies on unit: %m");
+
+        LIST_FOREACH(refs_by_target, ref, u->refs_by_target)
+                n_refs++;
+
+        refs = new(ReloadRef, n_refs);
+        if (!refs)
+                return log_oom();
+
+        k = 0;
+        LIST_FOREACH(refs_by_target, ref, u->refs_by_target)
+                refs[k++] = (ReloadRef) {
+                        .ref = ref,
+                        .source = ref->source,
+                };
+
+        r = manager_open_serialization(m, &f);
+        if (r < 0)
+                return log_unit_error_errno(u, r, "Failed to create serialization file: %m");
+
+        fds = fdset_new();
+        if (!fds)
+                return log_oom();
+
+        r = unit_serialize(u, f, fds, false);
+        if (r < 0)
+                return log_unit_error_errno(u, r, "Failed to serialize unit: %m");
+
+        r = fflush_and_check(f);
+        if (r < 0)
+                return log_unit_error_errno(u, r, "Failed to flush serialization: %m");
+
+        if (fseeko(f, 0, SEEK_SET) < 0)
+                return log_unit_error_errno(u, errno, "Failed to seek to beginning of serialization: %m");
+
+        /* The runtime directories and namespaces are otherwise only kept across a reload by the manager's
+         * serialization, hence keep the unit's ExecRuntime object alive until the new unit picked it up again */
+        rt = exec_runtime_ref(unit_get_exec_runtime(u));
+
+        /* From here on there is no way back: the unit is loaded again from scratch, and patched up to look like it
+         * did before as well as we can. */
+        unit_free(u);
+        u = NULL;
+
+        r = manager_load_unit(m, id, NULL, NULL, &n);
+        if (r < 0) {
+                log_error_errno(r, "Failed to load unit %s again: %m", id);
+                goto finish;
+        }
+        if (!streq(n->id, id))
+                /* The name has become an alias of some other unit, which keeps its own state */
+                log_unit_notice(n, "Unit %s is now an alias of %s, not restoring its state.", id, n->id);
+        else {
+                r = unit_deserialize(n, f, fds);
+                if (r < 0)
+                        log_unit_warning_errno(n, r, "Failed to deserialize unit, proceeding anyway: %m");
+        }
+
+        for (k = 0; k < n_deps; k++) {
+                r = unit_add_dependency(deps[k].other, deps[k].d, n, false, deps[k].mask);
+                if (r < 0)
+                        log_unit_warning_errno(deps[k].other, r, "Failed to restore %s dependency on %s, ignoring: %m",
+                                               unit_dependency_to_string(deps[k].d), n->id);
+        }
+
+        for (k = 0; k < n_refs; k++)
+                unit_ref_set(refs[k].ref, refs[k].source, n);
+
+        r = unit_coldplug(n);
+        if (r < 0)
+                log_unit_warning_errno(n, r, "Failed to coldplug unit, ignoring: %m");
+
+        *ret = n;
+        r = 0;
+
+finish:
+        exec_runtime_unref(rt, false);
+        return r;
+}
+
+int manager_reload_changed(Manager *m, char ***ret) {
+        _cleanup_(manager_reloading_stopp) Manager *reloading = NULL;
+        _cleanup_strv_free_ char **names = NULL, **reloaded = NULL;
+        _cleanup_free_ Unit **units = NULL;
+        size_t n_units = 0, k;
+        const char *t;
+        Iterator i;
+        char **name;
+        Unit *u;
+        int r;
+
+        assert(m);
+
+        /* Unlike manager_reload(), this only reloads those units whose unit files or drop-ins changed since they
+         * were loaded, as well as those that failed to load. All other units, their dependencies and runtime state
+         * are left alone. Generators are not run again, and the unit search path stays the same. */
+
+        HASHMAP_FOREACH_KEY(u, t, m->units, i) {
+                if (u->id != t)
+                        continue;
+
+                if (!unit_shall_reload(u))
+                        continue;
+
+                if (u->job || u->nop_job) {
+                        log_unit_notice(u, "Unit has a pending job, not reloading.");
+                        continue;
+                }
+
+                r = strv_extend(&names, u->id);
+                if (r < 0)
+                        return log_oom();
+        }
+
+        if (strv_isempty(names)) {
+                log_info("No changed units to reload.");
+
+                if (ret)
+                        *ret = NULL;
+                return 0;
+        }
+
+        units = new(Unit*, strv_length(names));
+        if (!units)
+                return log_oom();
+
+        reloading = manager_reloading_start(m);
+
+        r = manager_prefetch_fragments(m, names);
+        if (r < 0)
+                log_warning_errno(r, "Failed to read unit files in the background, ignoring: %m");
+
+        STRV_FOREACH(name, names) {
+                Unit *n;
+
+                /* Earlier unit reloads might have merged this unit into another one */
+                u = manager_get_unit(m, *name);
+                if (!u || !streq(u->id, *name))
+                        continue;
+
+                log_unit_debug(u, "Reloading unit files of %s.", u->id);
+
+                r = manager_reload_one_unit(m, u, &n);
+                if (r == -ENOMEM)
+                        return r;
+                if (r < 0)
+                        continue;
+
+                units[n_units++] = n;
+
+                r = strv_extend(&reloaded, *name);
+                if (r < 0)
+                        return log_oom();
+        }
+
+        m->fragment_cache = hashmap_free(m->fragment_cache);
+
+        reloading = NULL;
+        assert(m->n_reloading > 0);
+        m->n_reloading--;
+
+        /* Catch up with what happened to the reloaded units' processes and suchlike in the meantime */
+        for (k = 0; k < n_units; k++)
+                unit_catchup(units[k]);
+
+        log_info("Reloaded %zu changed units.", n_units);
+
+        if (ret)
+                *ret = TAKE_PTR(reloaded);
+        return 0;
+}
+
 void manager_reset_failed(Manager *m) {
         Unit *u;
         Iterator i;
@@ -3577,6 +4641,20 @@ void manager_reset_failed(Manager *m) {
                 unit_reset_failed(u);
 }
 
+void manager_reset_latency(Manager *m) {
+        UnitLatency l;
+        Unit *u;
+        Iterator i;
+
+        assert(m);
+
+        for (l = 0; l < _UNIT_LATENCY_MAX; l++)
+                m->unit_latency[l] = histogram_free(m->unit_latency[l]);
+
+        HASHMAP_FOREACH(u, m->units, i)
+                unit_reset_latency(u);
+}
+
 bool manager_unit_inactive_or_pending(Manager *m, const char *name) {
         Unit *u;
 
@@ -3618,6 +4696,8 @@ static void manager_notify_finished(Manager *m) {
         if (MANAGER_IS_TEST_RUN(m))
                 return;
 
+        manager_stop_boot_trace(m);
+
         if (MANAGER_IS_SYSTEM(m) && detect_container() <= 0) {
                 char ts[FORMAT_TIMESPAN_MAX];
                 char buf[FORMAT_TIMESPAN_MAX + STRLEN(" (firmware) + ") + FORMAT_TIMESPAN_MAX + STRLEN(" (loader) + ")]
@@ -3832,6 +4912,8 @@ static int manager_run_environment_generators(Manager *m) {
 static int manager_run_generators(Manager *m) {
         _cleanup_strv_free_ char **paths = NULL;
         const char *argv[5];
+        uint64_t digest = 0;
+        bool cacheable;
         int r;
 
         assert(m);
@@ -3843,8 +4925,29 @@ static int manager_run_generators(Manager *m) {
         if (!paths)
                 return log_oom();
 
-        if (!generator_path_any((const char* const*) paths))
+        /* If all generators declared their inputs, and none of them changed since the last run, the output of that
+         * run is still current, and we don't have to run them again. See generator-cache.h for details. */
+        r = generator_inputs_digest(paths, m->transient_environment, &digest);
+        if (r < 0)
+                log_debug_errno(r, "Failed to determine inputs of generators, ignoring: %m");
+        cacheable = r > 0;
+
+        if (MANAGER_IS_RELOADING(m)) {
+                if (cacheable && m->generator_inputs_digest_set && m->generator_inputs_digest == digest) {
+                        log_debug("Inputs of generators unchanged, reusing their previous output.");
+                        return 0;
+                }
+
+                lookup_paths_flush_generator(&m->lookup_paths);
+        }
+
+        m->generator_inputs_digest = digest;
+        m->generator_inputs_digest_set = false;
+
+        if (!generator_path_any((const char* const*) paths)) {
+                m->generator_inputs_digest_set = cacheable;
                 return 0;
+        }
 
         r = lookup_paths_mkdir_generator(&m->lookup_paths);
         if (r < 0) {
@@ -3862,6 +4965,7 @@ static int manager_run_generators(Manager *m) {
                 (void) execute_directories((const char* const*) paths, DEFAULT_TIMEOUT_USEC,
                                            NULL, NULL, (char**) argv, m->transient_environment);
 
+        m->generator_inputs_digest_set = cacheable;
         r = 0;
 
 finish:
@@ -3949,6 +5053,9 @@ int manager_set_default_rlimits(Manager *m, struct rlimit **default_rlimit) {
 
         assert(m);
 
+        /* Units loaded from now on get a new block, the ones loaded so far keep a reference to the old one */
+        m->shared_rlimits = exec_shared_rlimits_unref(m->shared_rlimits);
+
         for (i = 0; i < _RLIMIT_MAX; i++) {
                 m->rlimit[i] = mfree(m->rlimit[i]);
 
@@ -3963,6 +5070,15 @@ int manager_set_default_rlimits(Manager *m, struct rlimit **default_rlimit) {
         return 0;
 }
 
+ExecSharedRlimits *manager_get_shared_rlimits(Manager *m) {
+        assert(m);
+
+        if (!m->shared_rlimits)
+                m->shared_rlimits = exec_shared_rlimits_new(m->rlimit);
+
+        return m->shared_rlimits;
+}
+
 void manager_recheck_dbus(Manager *m) {
         assert(m);
 
@@ -4035,6 +5151,73 @@ void manager_recheck_journal(Manager *m) {
         log_open();
 }
 
+int manager_get_executor(Manager *m) {
+        _cleanup_close_pair_ int pair[2] = { -1, -1 };
+        pid_t pid;
+        int r;
+
+        assert(m);
+
+        /* Returns the socket connected to systemd-executor, and starts it first if needed. Spawning processes
+         * through it is optional, and only enabled with $SYSTEMD_EXECUTOR=1. If it can't be started, or fails
+         * later on, we don't try again, and spawn everything ourselves. */
+
+        if (m->executor_fd >= 0)
+                return m->executor_fd;
+
+        if (m->executor_disabled)
+                return -EOPNOTSUPP;
+
+        if (getenv_bool("SYSTEMD_EXECUTOR") <= 0) {
+                m->executor_disabled = true;
+                return -EOPNOTSUPP;
+        }
+
+        if (socketpair(AF_UNIX, SOCK_SEQPACKET|SOCK_CLOEXEC, 0, pair) < 0) {
+                m->executor_disabled = true;
+                return log_error_errno(errno, "Failed to allocate socket pair for systemd-executor: %m");
+        }
+
+        r = safe_fork_full("(sd-executor)", pair + 1, 1, FORK_RESET_SIGNALS|FORK_CLOSE_ALL_FDS|FORK_LOG, &pid);
+        if (r < 0) {
+                m->executor_disabled = true;
+                return r;
+        }
+        if (r == 0) {
+                /* Child */
+
+                if (dup2(pair[1], SD_LISTEN_FDS_START) < 0) {
+                        log_error_errno(errno, "Failed to move socket to systemd-executor: %m");
+                        _exit(EXIT_FAILURE);
+                }
+
+                execl(SYSTEMD_EXECUTOR_PATH, "systemd-executor", NULL);
+
+                log_error_errno(errno, "Failed to execute " SYSTEMD_EXECUTOR_PATH ": %m");
+                _exit(EXIT_FAILURE);
+        }
+
+        log_debug("Started systemd-executor as " PID_FMT ".", pid);
+
+        m->executor_fd = TAKE_FD(pair[0]);
+        m->executor_pid = pid;
+
+        return m->executor_fd;
+}
+
+void manager_drop_executor(Manager *m) {
+        assert(m);
+
+        m->executor_fd = safe_close(m->executor_fd);
+
+        if (m->executor_pid > 0) {
+                (void) kill_and_sigcont(m->executor_pid, SIGKILL);
+                m->executor_pid = 0;
+        }
+
+        m->executor_disabled = true;
+}
+
 void manager_set_show_status(Manager *m, ShowStatus mode) {
         assert(m);
         assert(IN_SET(mode, SHOW_STATUS_AUTO, SHOW_STATUS_NO, SHOW_STATUS_YES, SHOW_STATUS_TEMPORARY));
@@ -11,9 +11,12 @@
 #include "cgroup-util.h"
 #include "fdset.h"
 #include "hashmap.h"
+#include "histogram.h"
 #include "ip-address-access.h"
 #include "list.h"
+#include "memory-pressure.h"
 #include "ratelimit.h"
+#include "string-pool.h"
 
 struct libmnt_monitor;
 typedef struct Unit Unit;
@@ -22,6 +25,8 @@ typedef struct Unit Unit;
 #define MANAGER_MAX_NAMES 131072 /* 128K */
 
 typedef struct Manager Manager;
+typedef struct UnitCache UnitCache;
+typedef struct ReceiveBatch ReceiveBatch;
 
 /* An externally visible state. We don't actually maintain this as state variable, but derive it from various fields
  * when requested */
@@ -102,6 +107,16 @@ typedef enum ManagerTimestamp {
         _MANAGER_TIMESTAMP_INVALID = -1,
 } ManagerTimestamp;
 
+/* The latencies we keep histograms of, for each unit and for the manager as a whole */
+typedef enum UnitLatency {
+        UNIT_LATENCY_JOB_WAIT,       /* From a job being enqueued until it is run */
+        UNIT_LATENCY_SPAWN,          /* How long it takes to spawn a process of the unit */
+        UNIT_LATENCY_ACTIVATION,     /* From the unit leaving the inactive state until it is active, e.g. READY=1 */
+        _UNIT_LATENCY_MAX,
+        _UNIT_LATENCY_INVALID = -1,
+} UnitLatency;
+
+#include "boot-trace.h"
 #include "execute.h"
 #include "job.h"
 #include "path-lookup.h"
@@ -129,6 +144,9 @@ struct Manager {
         Hashmap *units_by_invocation_id;
         Hashmap *jobs;   /* job id => Job object 1:1 */
 
+        /* Strings shared by many units, i.e. fragment paths */
+        StringPool *string_pool;
+
         /* To make it easy to iterate through the units of a specific
          * type we maintain a per type linked list */
         LIST_HEAD(Unit, units_by_type[_UNIT_TYPE_MAX]);
@@ -139,6 +157,9 @@ struct Manager {
         /* Jobs that need to be run */
         LIST_HEAD(Job, run_queue);   /* more a stack than a queue, too */
 
+        /* Runnable start jobs waiting for one of the limited start slots, in the order they shall be dispatched */
+        LIST_HEAD(Job, start_queue);
+
         /* Units and jobs that have not yet been announced via
          * D-Bus. When something about a job changes it is added here
          * if it is not in there yet. This allows easy coalescing of
@@ -146,6 +167,11 @@ struct Manager {
         LIST_HEAD(Unit, dbus_unit_queue);
         LIST_HEAD(Job, dbus_job_queue);
 
+        /* Units that changed again within the coalescing window after their last change signal, and the timer that
+         * puts them back into the queue above */
+        LIST_HEAD(Unit, dbus_unit_deferred_queue);
+        sd_event_source *dbus_unit_deferred_event_source;
+
         /* Units to remove */
         LIST_HEAD(Unit, cleanup_queue);
 
@@ -183,6 +209,8 @@ struct Manager {
         Set *failed_units;
 
         sd_event_source *run_queue_event_source;
+        sd_event_source *gc_unit_event_source;
+        usec_t gc_unit_queue_timestamp; /* When the GC queue was last dispatched, or became non-empty */
 
         char *notify_socket;
         int notify_fd;
@@ -191,6 +219,9 @@ struct Manager {
         int cgroups_agent_fd;
         sd_event_source *cgroups_agent_event_source;
 
+        /* Receive buffers for reading several datagrams at once with recvmmsg() from the two sockets above */
+        ReceiveBatch *receive_batch;
+
         int signal_fd;
         sd_event_source *signal_event_source;
 
@@ -201,18 +232,35 @@ struct Manager {
 
         sd_event_source *timezone_change_event_source;
 
+        MemoryPressure *memory_pressure;
+
         sd_event_source *jobs_in_progress_event_source;
 
         int user_lookup_fds[2];
         sd_event_source *user_lookup_event_source;
 
+        /* The connection to systemd-executor, if $SYSTEMD_EXECUTOR=1 is set */
+        int executor_fd;
+        pid_t executor_pid;
+        bool executor_disabled;
+
         sd_event_source *sync_bus_names_event_source;
 
         UnitFileScope unit_file_scope;
         LookupPaths lookup_paths;
         Set *unit_path_cache;
 
+        /* Unit file fragments read in the background, indexed by the name they were looked for */
+        Hashmap *fragment_cache;
+
+        /* The precompiled unit database, only used while the unit path cache exists */
+        UnitCache *unit_cache;
+
         char **transient_environment;  /* The environment, as determined from config files, kernel cmdline and environment generators */
+
+        /* The digest of the inputs of the generators when we last ran them, if all of them declared their inputs */
+        uint64_t generator_inputs_digest;
+        bool generator_inputs_digest_set;
         char **client_environment;     /* Environment variables created by clients through the bus API */
 
         usec_t runtime_watchdog;
@@ -224,10 +272,23 @@ struct Manager {
         sd_device_monitor *device_monitor;
         Hashmap *devices_by_sysfs;
 
+        /* If true, device units are only created for devices that are referenced by some other unit or asked for
+         * explicitly, and the other devices are only recorded in device_index, a map from each path a device unit
+         * could be named after to the sysfs path of the device. */
+        bool lazy_device_units;
+        Hashmap *device_index;
+
         /* Data specific to the mount subsystem */
         struct libmnt_monitor *mount_monitor;
         sd_event_source *mount_event_source;
 
+        /* The last parsed contents of /proc/self/mountinfo, indexed by mount ID, so that only the entries that
+         * changed since have to be processed. Storms of changes are rate limited, and coalesced into one rescan
+         * from the timer event source. */
+        OrderedHashmap *mountinfo;
+        RateLimit mount_ratelimit;
+        sd_event_source *mount_rescan_event_source;
+
         /* Data specific to the swap filesystem */
         FILE *proc_swaps;
         sd_event_source *swap_event_source;
@@ -246,6 +307,11 @@ struct Manager {
         sd_bus_track *subscribed;
         char **deserialized_subscribed;
 
+        /* Clients on the API bus that only want to know about units that reached a settled state, i.e. subscribed
+         * with SUBSCRIBE_SETTLED */
+        sd_bus_track *subscribed_settled;
+        char **deserialized_subscribed_settled;
+
         /* This is used during reloading: before the reload we queue
          * the reply message here, and afterwards we send it */
         sd_bus_message *pending_reload_message;
@@ -328,12 +394,31 @@ struct Manager {
         uint64_t default_tasks_max;
         usec_t default_timer_accuracy_usec;
 
+        /* The maximum number of start jobs of units that fork processes which may be running at the same time, 0 if
+         * unlimited */
+        unsigned default_start_concurrency;
+
+        /* The resource use of units sampled while starting up, see boot-trace.h */
+        usec_t boot_trace_interval_usec;
+        sd_event_source *boot_trace_event_source;
+        BootTraceSample *boot_trace;
+        size_t n_boot_trace, n_boot_trace_allocated;
+
         int original_log_level;
         LogTarget original_log_target;
         bool log_level_overridden:1;
         bool log_target_overridden:1;
 
         struct rlimit *rlimit[_RLIMIT_MAX];
+        ExecSharedRlimits *shared_rlimits; /* The same, for the execution contexts of units to point into */
+
+        /* System call filters compiled to BPF, indexed by a description of the filter, see exec_spawn() */
+        Hashmap *seccomp_filter_cache;
+
+        /* BPF objects shared among the units with the same configuration, indexed by their contents. Units keep
+         * references to the entries, which drop out as soon as the last unit lets go of them. */
+        Hashmap *bpf_programs;
+        Hashmap *bpf_access_maps;
 
         /* non-zero if we are reloading or reexecuting, */
         int n_reloading;
@@ -346,6 +431,7 @@ struct Manager {
 
         /* Jobs in progress watching */
         unsigned n_running_jobs;
+        unsigned n_running_start_jobs; /* Running start jobs of units that fork processes */
         unsigned n_on_console;
         unsigned jobs_in_progress_iteration;
 
@@ -366,6 +452,12 @@ struct Manager {
          * value where Unit objects are contained. */
         Hashmap *units_requiring_mounts_for;
 
+        /* All units that have a mount namespace stored for their processes, see unit_flush_mount_ns() */
+        Set *units_with_mount_ns;
+
+        /* The latencies of all units taken together, see unit_add_latency() */
+        Histogram *unit_latency[_UNIT_LATENCY_MAX];
+
         /* Used for processing polkit authorization responses */
         Hashmap *polkit_registry;
 
@@ -440,6 +532,7 @@ int manager_get_dump_string(Manager *m, char **ret);
 
 void manager_clear_jobs(Manager *m);
 
+int manager_prefetch_fragments(Manager *m, char **names);
 unsigned manager_dispatch_load_queue(Manager *m);
 
 int manager_default_environment(Manager *m);
@@ -448,6 +541,7 @@ int manager_client_environment_modify(Manager *m, char **minus, char **plus);
 int manager_get_effective_environment(Manager *m, char ***ret);
 
 int manager_set_default_rlimits(Manager *m, struct rlimit **default_rlimit);
+ExecSharedRlimits *manager_get_shared_rlimits(Manager *m);
 
 int manager_loop(Manager *m);
 
@@ -457,8 +551,10 @@ int manager_serialize(Manager *m, FILE *f, FDSet *fds, bool switching_root);
 int manager_deserialize(Manager *m, FILE *f, FDSet *fds);
 
 int manager_reload(Manager *m);
+int manager_reload_changed(Manager *m, char ***ret);
 
 void manager_reset_failed(Manager *m);
+void manager_reset_latency(Manager *m);
 
 void manager_send_unit_audit(Manager *m, Unit *u, int type, bool success);
 void manager_send_unit_plymouth(Manager *m, Unit *u);
@@ -470,6 +566,9 @@ void manager_check_finished(Manager *m);
 void manager_recheck_dbus(Manager *m);
 void manager_recheck_journal(Manager *m);
 
+int manager_get_executor(Manager *m);
+void manager_drop_executor(Manager *m);
+
 void manager_set_show_status(Manager *m, ShowStatus mode);
 void manager_set_first_boot(Manager *m, bool b);
 
@@ -1591,34 +1591,72 @@ fail:
         return log_warning_errno(r, "Failed to set up mount unit: %m");
 }
 
-static int mount_load_proc_self_mountinfo(Manager *m, bool set_flags) {
+typedef struct MountInfoEntry {
+        int id;
+        char *what;
+        char *where;
+        char *options;
+        char *fstype;
+} MountInfoEntry;
+
+static MountInfoEntry* mount_info_entry_free(MountInfoEntry *e) {
+        if (!e)
+                return NULL;
+
+        free(e->what);
+        free(e->where);
+        free(e->options);
+        free(e->fstype);
+
+        return mfree(e);
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(MountInfoEntry*, mount_info_entry_free);
+
+static OrderedHashmap* mount_info_free(OrderedHashmap *h) {
+        return ordered_hashmap_free_with_destructor(h, mount_info_entry_free);
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(OrderedHashmap*, mount_info_free);
+
+static bool mount_info_entry_equal(const MountInfoEntry *a, const MountInfoEntry *b) {
+        assert(a);
+        assert(b);
+
+        return streq(a->what, b->what) &&
+                streq(a->where, b->where) &&
+                streq(a->options, b->options) &&
+                streq(a->fstype, b->fstype);
+}
+
+static int mount_parse_proc_self_mountinfo(OrderedHashmap **ret) {
+        _cleanup_(mount_info_freep) OrderedHashmap *h = NULL;
         _cleanup_(mnt_free_tablep) struct libmnt_table *t = NULL;
         _cleanup_(mnt_free_iterp) struct libmnt_iter *i = NULL;
-        int r = 0;
+        int r;
 
-        assert(m);
+        assert(ret);
 
         t = mnt_new_table();
         i = mnt_new_iter(MNT_ITER_FORWARD);
-        if (!t || !i)
+        h = ordered_hashmap_new(NULL);
+        if (!t || !i || !h)
                 return log_oom();
 
         r = mnt_table_parse_mtab(t, NULL);
         if (r < 0)
                 return log_error_errno(r, "Failed to parse /proc/self/mountinfo: %m");
 
-        r = 0;
         for (;;) {
-                struct libmnt_fs *fs;
+                _cleanup_(mount_info_entry_freep) MountInfoEntry *e = NULL;
                 const char *device, *path, *options, *fstype;
-                _cleanup_free_ char *d = NULL, *p = NULL;
-                int k;
+                struct libmnt_fs *fs;
 
-                k = mnt_table_next_fs(t, i, &fs);
-                if (k == 1)
+                r = mnt_table_next_fs(t, i, &fs);
+                if (r == 1)
                         break;
-                if (k < 0)
-                        return log_error_errno(k, "Failed to get next entry from /proc/self/mountinfo: %m");
+                if (r < 0)
+                        return log_error_errno(r, "Failed to get next entry from /proc/self/mountinfo: %m");
 
                 device = mnt_fs_get_source(fs);
                 path = mnt_fs_get_target(fs);
@@ -1628,19 +1666,107 @@ static int mount_load_proc_self_mountinfo(Manager *m, bool set_flags) {
                 if (!device || !path)
                         continue;
 
-                if (cunescape(device, UNESCAPE_RELAX, &d) < 0)
+                e = new0(MountInfoEntry, 1);
+                if (!e)
+                        return log_oom();
+
+                e->id = mnt_fs_get_id(fs);
+
+                if (cunescape(device, UNESCAPE_RELAX, &e->what) < 0)
+                        return log_oom();
+
+                if (cunescape(path, UNESCAPE_RELAX, &e->where) < 0)
+                        return log_oom();
+
+                e->options = strdup(options);
+                e->fstype = strdup(fstype);
+                if (!e->options || !e->fstype)
                         return log_oom();
 
-                if (cunescape(path, UNESCAPE_RELAX, &p) < 0)
+                r = ordered_hashmap_put(h, INT_TO_PTR(e->id), e);
+                if (r == -EEXIST) {
+                        log_debug("Duplicate mount ID %i in /proc/self/mountinfo, ignoring.", e->id);
+                        continue;
+                }
+                if (r < 0)
                         return log_oom();
 
-                device_found_node(m, d, DEVICE_FOUND_MOUNT, DEVICE_FOUND_MOUNT);
+                TAKE_PTR(e);
+        }
+
+        *ret = TAKE_PTR(h);
+        return 0;
+}
+
+static int mount_diff_proc_self_mountinfo(OrderedHashmap *old, OrderedHashmap *new, Set **ret_changed, Set **ret_gone) {
+        _cleanup_set_free_ Set *changed = NULL, *gone = NULL;
+        MountInfoEntry *e, *o;
+        Iterator i;
+
+        assert(ret_changed);
+        assert(ret_gone);
+
+        /* Determines the mount points whose entries were added, removed, or changed, and the sources of the
+         * removed entries. The strings are borrowed from the entries of the two tables. Note that mount IDs may
+         * be reused, hence a changed entry may belong to another mount point than before. */
+
+        ORDERED_HASHMAP_FOREACH(e, new, i) {
+                o = ordered_hashmap_get(old, INT_TO_PTR(e->id));
+                if (o && mount_info_entry_equal(o, e))
+                        continue;
+
+                if (set_ensure_allocated(&changed, &path_hash_ops) < 0 ||
+                    set_put(changed, e->where) < 0)
+                        return -ENOMEM;
+        }
+
+        ORDERED_HASHMAP_FOREACH(o, old, i) {
+                e = ordered_hashmap_get(new, INT_TO_PTR(o->id));
+                if (e && mount_info_entry_equal(o, e))
+                        continue;
 
-                k = mount_setup_unit(m, d, p, options, fstype, set_flags);
+                if (set_ensure_allocated(&changed, &path_hash_ops) < 0 ||
+                    set_put(changed, o->where) < 0)
+                        return -ENOMEM;
+
+                if (set_ensure_allocated(&gone, &path_hash_ops) < 0 ||
+                    set_put(gone, o->what) < 0)
+                        return -ENOMEM;
+        }
+
+        *ret_changed = TAKE_PTR(changed);
+        *ret_gone = TAKE_PTR(gone);
+        return 0;
+}
+
+static int mount_load_proc_self_mountinfo(Manager *m, bool set_flags) {
+        _cleanup_(mount_info_freep) OrderedHashmap *t = NULL;
+        MountInfoEntry *e;
+        Iterator i;
+        int r = 0;
+
+        assert(m);
+
+        /* Parses the complete table and sets up the mount units for all entries. The table is kept, so that later
+         * changes can be processed incrementally by mount_dispatch_proc_self_mountinfo(). */
+
+        r = mount_parse_proc_self_mountinfo(&t);
+        if (r < 0)
+                return r;
+
+        ORDERED_HASHMAP_FOREACH(e, t, i) {
+                int k;
+
+                device_found_node(m, e->what, DEVICE_FOUND_MOUNT, DEVICE_FOUND_MOUNT);
+
+                k = mount_setup_unit(m, e->what, e->where, e->options, e->fstype, set_flags);
                 if (r == 0 && k < 0)
                         r = k;
         }
 
+        mount_info_free(m->mountinfo);
+        m->mountinfo = TAKE_PTR(t);
+
         return r;
 }
 
@@ -1648,9 +1774,12 @@ static void mount_shutdown(Manager *m) {
         assert(m);
 
         m->mount_event_source = sd_event_source_unref(m->mount_event_source);
+        m->mount_rescan_event_source = sd_event_source_unref(m->mount_rescan_event_source);
 
         mnt_unref_monitor(m->mount_monitor);
         m->mount_monitor = NULL;
+
+        m->mountinfo = mount_info_free(m->mountinfo);
 }
 
 static int mount_get_timeout(Unit *u, usec_t *timeout) {
@@ -1762,133 +1891,182 @@ fail:
         mount_shutdown(m);
 }
 
-static int mount_dispatch_io(sd_event_source *source, int fd, uint32_t revents, void *userdata) {
-        _cleanup_set_free_ Set *around = NULL, *gone = NULL;
-        Manager *m = userdata;
-        const char *what;
-        Iterator i;
-        Unit *u;
-        int r;
+static void mount_process_unit(Mount *mount, Set **gone) {
+        assert(mount);
+        assert(gone);
 
-        assert(m);
-        assert(revents & EPOLLIN);
+        if (!mount_is_mounted(mount)) {
 
-        if (fd == mnt_monitor_get_fd(m->mount_monitor)) {
-                bool rescan = false;
+                /* A mount point is not around right now. It
+                 * might be gone, or might never have
+                 * existed. */
 
-                /* Drain all events and verify that the event is valid.
-                 *
-                 * Note that libmount also monitors /run/mount mkdir if the
-                 * directory does not exist yet. The mkdir may generate event
-                 * which is irrelevant for us.
-                 *
-                 * error: r < 0; valid: r == 0, false positive: rc == 1 */
-                do {
-                        r = mnt_monitor_next_change(m->mount_monitor, NULL, NULL);
-                        if (r == 0)
-                                rescan = true;
-                        else if (r < 0)
-                                return log_error_errno(r, "Failed to drain libmount events: %m");
-                } while (r == 0);
+                if (mount->from_proc_self_mountinfo &&
+                    mount->parameters_proc_self_mountinfo.what) {
 
-                log_debug("libmount event [rescan: %s]", yes_no(rescan));
-                if (!rescan)
-                        return 0;
-        }
+                        /* Remember that this device might just have disappeared */
+                        if (set_ensure_allocated(gone, &path_hash_ops) < 0 ||
+                            set_put(*gone, mount->parameters_proc_self_mountinfo.what) < 0)
+                                log_oom(); /* we don't care too much about OOM here... */
+                }
 
-        r = mount_load_proc_self_mountinfo(m, true);
-        if (r < 0) {
-                /* Reset flags, just in case, for later calls */
-                LIST_FOREACH(units_by_type, u, m->units_by_type[UNIT_MOUNT]) {
-                        Mount *mount = MOUNT(u);
+                mount->from_proc_self_mountinfo = false;
 
-                        mount->is_mounted = mount->just_mounted = mount->just_changed = false;
+                switch (mount->state) {
+
+                case MOUNT_MOUNTED:
+                        /* This has just been unmounted by
+                         * somebody else, follow the state
+                         * change. */
+                        mount->result = MOUNT_SUCCESS; /* make sure we forget any earlier umount failures */
+                        mount_enter_dead(mount, MOUNT_SUCCESS);
+                        break;
+
+                default:
+                        break;
                 }
 
-                return 0;
+        } else if (mount->just_mounted || mount->just_changed) {
+
+                /* A mount point was added or changed */
+
+                switch (mount->state) {
+
+                case MOUNT_DEAD:
+                case MOUNT_FAILED:
+
+                        /* This has just been mounted by somebody else, follow the state change, but let's
+                         * generate a new invocation ID for this implicitly and automatically. */
+                        (void) unit_acquire_invocation_id(UNIT(mount));
+                        mount_enter_mounted(mount, MOUNT_SUCCESS);
+                        break;
+
+                case MOUNT_MOUNTING:
+                        mount_set_state(mount, MOUNT_MOUNTING_DONE);
+                        break;
+
+                default:
+                        /* Nothing really changed, but let's
+                         * issue an notification call
+                         * nonetheless, in case somebody is
+                         * waiting for this. (e.g. file system
+                         * ro/rw remounts.) */
+                        mount_set_state(mount, mount->state);
+                        break;
+                }
         }
 
-        manager_dispatch_load_queue(m);
+        /* Reset the flags for later calls */
+        mount->is_mounted = mount->just_mounted = mount->just_changed = false;
+}
 
-        LIST_FOREACH(units_by_type, u, m->units_by_type[UNIT_MOUNT]) {
-                Mount *mount = MOUNT(u);
+static bool mount_info_has_what(OrderedHashmap *h, const char *what) {
+        MountInfoEntry *e;
+        Iterator i;
 
-                if (!mount_is_mounted(mount)) {
+        ORDERED_HASHMAP_FOREACH(e, h, i)
+                if (path_equal(e->what, what))
+                        return true;
 
-                        /* A mount point is not around right now. It
-                         * might be gone, or might never have
-                         * existed. */
+        return false;
+}
 
-                        if (mount->from_proc_self_mountinfo &&
-                            mount->parameters_proc_self_mountinfo.what) {
+static void mount_flush_mount_namespaces(Manager *m) {
+        Unit *u;
 
-                                /* Remember that this device might just have disappeared */
-                                if (set_ensure_allocated(&gone, &path_hash_ops) < 0 ||
-                                    set_put(gone, mount->parameters_proc_self_mountinfo.what) < 0)
-                                        log_oom(); /* we don't care too much about OOM here... */
-                        }
+        assert(m);
 
-                        mount->from_proc_self_mountinfo = false;
+        /* The mount namespaces stored for reuse were set up for the previous mount table, e.g. new mounts below
+         * ProtectSystem=strict wouldn't be read-only in them, hence have them all set up anew. */
+        while ((u = set_first(m->units_with_mount_ns)))
+                unit_flush_mount_ns(u);
+}
 
-                        switch (mount->state) {
+static int mount_dispatch_proc_self_mountinfo(Manager *m) {
+        _cleanup_(mount_info_freep) OrderedHashmap *old = NULL, *t = NULL;
+        _cleanup_set_free_ Set *changed = NULL, *gone = NULL, *units = NULL;
+        MountInfoEntry *e;
+        const char *what, *where;
+        Iterator i;
+        Unit *u;
+        int r;
+
+        assert(m);
+
+        if (!m->mountinfo) {
+                /* We don't know the previous state, hence set up all mount units, and check them all */
 
-                        case MOUNT_MOUNTED:
-                                /* This has just been unmounted by
-                                 * somebody else, follow the state
-                                 * change. */
-                                mount->result = MOUNT_SUCCESS; /* make sure we forget any earlier umount failures */
-                                mount_enter_dead(mount, MOUNT_SUCCESS);
-                                break;
+                r = mount_load_proc_self_mountinfo(m, true);
+                if (r < 0) {
+                        /* Reset flags, just in case, for later calls */
+                        LIST_FOREACH(units_by_type, u, m->units_by_type[UNIT_MOUNT]) {
+                                Mount *mount = MOUNT(u);
 
-                        default:
-                                break;
+                                mount->is_mounted = mount->just_mounted = mount->just_changed = false;
                         }
 
-                } else if (mount->just_mounted || mount->just_changed) {
+                        return 0;
+                }
 
-                        /* A mount point was added or changed */
+                manager_dispatch_load_queue(m);
 
-                        switch (mount->state) {
+                mount_flush_mount_namespaces(m);
 
-                        case MOUNT_DEAD:
-                        case MOUNT_FAILED:
+                LIST_FOREACH(units_by_type, u, m->units_by_type[UNIT_MOUNT])
+                        mount_process_unit(MOUNT(u), &gone);
 
-                                /* This has just been mounted by somebody else, follow the state change, but let's
-                                 * generate a new invocation ID for this implicitly and automatically. */
-                                (void) unit_acquire_invocation_id(UNIT(mount));
-                                mount_enter_mounted(mount, MOUNT_SUCCESS);
-                                break;
+        } else {
+                /* Only set up the mount units of the mount points whose entries changed, in the order of the
+                 * table, so that the last of several stacked mounts wins as before, and then check only those. */
 
-                        case MOUNT_MOUNTING:
-                                mount_set_state(mount, MOUNT_MOUNTING_DONE);
-                                break;
+                r = mount_parse_proc_self_mountinfo(&t);
+                if (r < 0)
+                        return 0;
 
-                        default:
-                                /* Nothing really changed, but let's
-                                 * issue an notification call
-                                 * nonetheless, in case somebody is
-                                 * waiting for this. (e.g. file system
-                                 * ro/rw remounts.) */
-                                mount_set_state(mount, mount->state);
-                                break;
-                        }
+                r = mount_diff_proc_self_mountinfo(m->mountinfo, t, &changed, &gone);
+                if (r < 0)
+                        return log_oom();
+
+                if (set_isempty(changed))
+                        return 0;
+
+                mount_flush_mount_namespaces(m);
+
+                ORDERED_HASHMAP_FOREACH(e, t, i) {
+                        if (!set_contains(changed, e->where))
+                                continue;
+
+                        device_found_node(m, e->what, DEVICE_FOUND_MOUNT, DEVICE_FOUND_MOUNT);
+                        (void) mount_setup_unit(m, e->what, e->where, e->options, e->fstype, true);
                 }
 
-                if (mount_is_mounted(mount) &&
-                    mount->from_proc_self_mountinfo &&
-                    mount->parameters_proc_self_mountinfo.what) {
+                /* Keep the old table around until we are done, the sets borrow strings from it */
+                old = TAKE_PTR(m->mountinfo);
+                m->mountinfo = TAKE_PTR(t);
+
+                SET_FOREACH(where, changed, i) {
+                        _cleanup_free_ char *name = NULL;
+
+                        if (unit_name_from_path(where, ".mount", &name) < 0)
+                                continue;
 
-                        if (set_ensure_allocated(&around, &path_hash_ops) < 0 ||
-                            set_put(around, mount->parameters_proc_self_mountinfo.what) < 0)
-                                log_oom();
+                        u = manager_get_unit(m, name);
+                        if (!u)
+                                continue;
+
+                        if (set_ensure_allocated(&units, NULL) < 0 ||
+                            set_put(units, u) < 0)
+                                return log_oom();
                 }
 
-                /* Reset the flags for later calls */
-                mount->is_mounted = mount->just_mounted = mount->just_changed = false;
+                manager_dispatch_load_queue(m);
+
+                SET_FOREACH(u, units, i)
+                        mount_process_unit(MOUNT(u), &gone);
         }
 
         SET_FOREACH(what, gone, i) {
-                if (set_contains(around, what))
+                if (mount_info_has_what(m->mountinfo, what))
                         continue;
 
                 /* Let the device units know that the device is no longer mounted */
@@ -1898,6 +2076,77 @@ static int mount_dispatch_io(sd_event_source *source, int fd, uint32_t revents,
         return 0;
 }
 
+static int mount_dispatch_rescan(sd_event_source *source, usec_t usec, void *userdata) {
+        Manager *m = userdata;
+
+        assert(m);
+
+        return mount_dispatch_proc_self_mountinfo(m);
+}
+
+static int mount_dispatch_io(sd_event_source *source, int fd, uint32_t revents, void *userdata) {
+        Manager *m = userdata;
+        usec_t usec;
+        int r;
+
+        assert(m);
+        assert(revents & EPOLLIN);
+
+        if (fd == mnt_monitor_get_fd(m->mount_monitor)) {
+                bool rescan = false;
+
+                /* Drain all events and verify that the event is valid.
+                 *
+                 * Note that libmount also monitors /run/mount mkdir if the
+                 * directory does not exist yet. The mkdir may generate event
+                 * which is irrelevant for us.
+                 *
+                 * error: r < 0; valid: r == 0, false positive: rc == 1 */
+                do {
+                        r = mnt_monitor_next_change(m->mount_monitor, NULL, NULL);
+                        if (r == 0)
+                                rescan = true;
+                        else if (r < 0)
+                                return log_error_errno(r, "Failed to drain libmount events: %m");
+                } while (r == 0);
+
+                log_debug("libmount event [rescan: %s]", yes_no(rescan));
+                if (!rescan)
+                        return 0;
+        }
+
+        if (ratelimit_below(&m->mount_ratelimit)) {
+                if (m->mount_rescan_event_source)
+                        (void) sd_event_source_set_enabled(m->mount_rescan_event_source, SD_EVENT_OFF);
+
+                return mount_dispatch_proc_self_mountinfo(m);
+        }
+
+        /* Too many changes in a row. Coalesce all further ones until the end of the rate limit interval into a
+         * single rescan. */
+        usec = usec_add(m->mount_ratelimit.begin, m->mount_ratelimit.interval);
+
+        if (m->mount_rescan_event_source) {
+                r = sd_event_source_set_time(m->mount_rescan_event_source, usec);
+                if (r >= 0)
+                        r = sd_event_source_set_enabled(m->mount_rescan_event_source, SD_EVENT_ONESHOT);
+        } else {
+                log_debug("Too many changes of /proc/self/mountinfo, coalescing them.");
+
+                r = sd_event_add_time(m->event, &m->mount_rescan_event_source, CLOCK_MONOTONIC, usec, 0, mount_dispatch_rescan, m);
+                if (r >= 0) {
+                        r = sd_event_source_set_priority(m->mount_rescan_event_source, SD_EVENT_PRIORITY_NORMAL-10);
+                        (void) sd_event_source_set_description(m->mount_rescan_event_source, "mount-rescan");
+                }
+        }
+        if (r < 0) {
+                log_warning_errno(r, "Failed to delay rescan of /proc/self/mountinfo, rescanning immediately: %m");
+                return mount_dispatch_proc_self_mountinfo(m);
+        }
+
+        return 0;
+}
+
 static void mount_reset_failed(Unit *u) {
         Mount *m = MOUNT(u);
 
@@ -1691,6 +1691,64 @@ fail:
         return r;
 }
 
+int mntns_storage_join(const int mntns_storage_socket[2]) {
+        _cleanup_close_ int mntns = -1;
+        int r;
+
+        assert(mntns_storage_socket);
+        assert(mntns_storage_socket[0] >= 0);
+        assert(mntns_storage_socket[1] >= 0);
+
+        /* Like setup_netns(), but for mount namespaces, which take much longer to set up, and hence aren't set up
+         * here. If a namespace is stored in the socket pair already, joins it and returns 1. Otherwise returns 0
+         * with the lock on the socket pair held, and the caller shall set up a new namespace and pass it to
+         * mntns_storage_store(), which releases the lock again. */
+
+        if (lockf(mntns_storage_socket[0], F_LOCK, 0) < 0)
+                return -errno;
+
+        mntns = receive_one_fd(mntns_storage_socket[0], MSG_DONTWAIT);
+        if (mntns == -EAGAIN)
+                return 0;
+        if (mntns < 0) {
+                r = mntns;
+                goto finish;
+        }
+
+        r = setns(mntns, CLONE_NEWNS) < 0 ? -errno : 1;
+
+        /* Put it back for the next one, even if we failed to join it */
+        (void) send_one_fd(mntns_storage_socket[1], mntns, MSG_DONTWAIT);
+
+finish:
+        (void) lockf(mntns_storage_socket[0], F_ULOCK, 0);
+        return r;
+}
+
+int mntns_storage_store(const int mntns_storage_socket[2], int ns_dir_fd) {
+        _cleanup_close_ int mntns = -1;
+        int r = 0;
+
+        assert(mntns_storage_socket);
+        assert(mntns_storage_socket[0] >= 0);
+        assert(mntns_storage_socket[1] >= 0);
+
+        /* Stores the mount namespace we are in now, and releases the lock taken by mntns_storage_join(). Takes an fd
+         * of our /proc/self/ns/ directory opened in advance, as the namespace might not have /proc/ mounted. Pass
+         * -1 to only release the lock, if setting up the namespace failed. */
+
+        if (ns_dir_fd >= 0) {
+                mntns = openat(ns_dir_fd, "mnt", O_RDONLY|O_CLOEXEC|O_NOCTTY);
+                if (mntns < 0)
+                        r = -errno;
+                else
+                        r = send_one_fd(mntns_storage_socket[1], mntns, MSG_DONTWAIT);
+        }
+
+        (void) lockf(mntns_storage_socket[0], F_ULOCK, 0);
+        return r;
+}
+
 bool ns_type_supported(NamespaceType type) {
         const char *t, *ns_proc;
 
@@ -93,6 +93,9 @@ int setup_tmp_dirs(
 
 int setup_netns(int netns_storage_socket[2]);
 
+int mntns_storage_join(const int mntns_storage_socket[2]);
+int mntns_storage_store(const int mntns_storage_socket[2], int ns_dir_fd);
+
 const char* protect_home_to_string(ProtectHome p) _const_;
 ProtectHome protect_home_from_string(const char *s) _pure_;
 
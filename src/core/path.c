@@ -1,7 +1,9 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 
 #include <errno.h>
+#include <fcntl.h>
 #include <sys/epoll.h>
+#include <sys/fanotify.h>
 #include <sys/inotify.h>
 #include <unistd.h>
 
@@ -12,7 +14,9 @@
 #include "fs-util.h"
 #include "glob-util.h"
 #include "macro.h"
+#include "missing.h"
 #include "mkdir.h"
+#include "path-util.h"
 #include "path.h"
 #include "serialize.h"
 #include "special.h"
@@ -31,6 +35,64 @@ static const UnitActiveState state_translation_table[_PATH_STATE_MAX] = {
 
 static int path_dispatch_io(sd_event_source *source, int fd, uint32_t revents, void *userdata);
 
+static bool path_spec_wants_subtree(PathSpec *s) {
+        assert(s);
+
+        return s->unit->type == UNIT_PATH &&
+                PATH(s->unit)->watch_subtree &&
+                IN_SET(s->type, PATH_CHANGED, PATH_MODIFIED);
+}
+
+static int path_spec_watch_subtree(PathSpec *s, sd_event_io_handler_t handler) {
+        uint64_t mask;
+        int r;
+
+        assert(s);
+        assert(handler);
+
+        /* Watches the path and everything below it with a single fanotify mark on the file system it is on, instead
+         * of one inotify watch per directory. The events are reported with a handle for the directory they happened
+         * in, which we resolve to find out whether that is below our path. This requires privileges, Linux 5.9, and
+         * the path to exist, hence the caller falls back to inotify if this fails. */
+
+        mask = FAN_CREATE|FAN_DELETE|FAN_MOVED_FROM|FAN_MOVED_TO|FAN_DELETE_SELF|FAN_MOVE_SELF|FAN_ATTRIB|FAN_CLOSE_WRITE|FAN_ONDIR;
+        if (s->type == PATH_MODIFIED)
+                mask |= FAN_MODIFY;
+
+        s->subtree_fd = open(s->path, O_PATH|O_DIRECTORY|O_CLOEXEC);
+        if (s->subtree_fd < 0) {
+                r = -errno;
+                goto fail;
+        }
+
+        r = fd_get_path(s->subtree_fd, &s->subtree_path);
+        if (r < 0)
+                goto fail;
+
+        s->inotify_fd = fanotify_init(FAN_CLASS_NOTIF|FAN_CLOEXEC|FAN_NONBLOCK|FAN_REPORT_DIR_FID, O_RDONLY|O_CLOEXEC);
+        if (s->inotify_fd < 0) {
+                r = -errno;
+                goto fail;
+        }
+
+        if (fanotify_mark(s->inotify_fd, FAN_MARK_ADD|FAN_MARK_FILESYSTEM, mask, AT_FDCWD, s->subtree_path) < 0) {
+                r = -errno;
+                goto fail;
+        }
+
+        r = sd_event_add_io(s->unit->manager->event, &s->event_source, s->inotify_fd, EPOLLIN, handler, s);
+        if (r < 0)
+                goto fail;
+
+        (void) sd_event_source_set_description(s->event_source, "path-subtree");
+
+        return 0;
+
+fail:
+        path_spec_unwatch(s);
+        return r;
+}
+
 int path_spec_watch(PathSpec *s, sd_event_io_handler_t handler) {
 
         static const int flags_table[_PATH_TYPE_MAX] = {
@@ -51,6 +113,14 @@ int path_spec_watch(PathSpec *s, sd_event_io_handler_t handler) {
 
         path_spec_unwatch(s);
 
+        if (path_spec_wants_subtree(s)) {
+                r = path_spec_watch_subtree(s, handler);
+                if (r >= 0)
+                        return 0;
+
+                log_unit_debug_errno(s->unit, r, "Failed to watch file system of %s, watching only the directory itself: %m", s->path);
+        }
+
         s->inotify_fd = inotify_init1(IN_NONBLOCK|IN_CLOEXEC);
         if (s->inotify_fd < 0) {
                 r = -errno;
@@ -138,6 +208,117 @@ void path_spec_unwatch(PathSpec *s) {
 
         s->event_source = sd_event_source_unref(s->event_source);
         s->inotify_fd = safe_close(s->inotify_fd);
+        s->subtree_fd = safe_close(s->subtree_fd);
+        s->subtree_path = mfree(s->subtree_path);
+}
+
+static const struct file_handle *path_spec_subtree_event_handle(const struct fanotify_event_metadata *e) {
+        const uint8_t *i, *end;
+
+        assert(e);
+
+        end = (const uint8_t*) e + e->event_len;
+
+        for (i = (const uint8_t*) e + e->metadata_len; i + sizeof(struct fanotify_event_info_fid) <= end; ) {
+                const struct fanotify_event_info_fid *fid = (const struct fanotify_event_info_fid*) i;
+
+                if (fid->hdr.len < sizeof(struct fanotify_event_info_fid) || fid->hdr.len > (size_t) (end - i))
+                        break;
+
+                if (fid->hdr.info_type == FAN_EVENT_INFO_TYPE_DFID)
+                        return (const struct file_handle*) fid->handle;
+
+                i += fid->hdr.len;
+        }
+
+        return NULL;
+}
+
+static bool file_handle_equal(const struct file_handle *a, const struct file_handle *b) {
+        return a->handle_type == b->handle_type &&
+                a->handle_bytes == b->handle_bytes &&
+                memcmp(a->f_handle, b->f_handle, a->handle_bytes) == 0;
+}
+
+static int path_spec_subtree_event(PathSpec *s) {
+        union {
+                struct fanotify_event_metadata metadata;
+                uint8_t raw[4096];
+        } buffer;
+        const struct file_handle *previous = NULL;
+        struct fanotify_event_metadata *e;
+        bool self = false;
+        ssize_t l;
+        int r = 0;
+
+        assert(s);
+
+        l = read(s->inotify_fd, &buffer, sizeof(buffer));
+        if (l < 0) {
+                if (IN_SET(errno, EAGAIN, EINTR))
+                        return 0;
+
+                return log_error_errno(errno, "Failed to read fanotify event: %m");
+        }
+
+        for (e = &buffer.metadata; FAN_EVENT_OK(e, l); e = FAN_EVENT_NEXT(e, l)) {
+                _cleanup_free_ char *p = NULL;
+                _cleanup_close_ int fd = -1;
+                const struct file_handle *h;
+
+                if (e->vers != FANOTIFY_METADATA_VERSION)
+                        return log_error_errno(SYNTHETIC_ERRNO(EINVAL), "Unexpected fanotify metadata version %u.", e->vers);
+
+                if (e->fd >= 0)
+                        safe_close(e->fd);
+
+                /* One match is enough, the events of one read are coalesced into a single trigger */
+                if (r > 0)
+                        continue;
+
+                if (e->mask & FAN_Q_OVERFLOW) {
+                        r = 1;
+                        continue;
+                }
+
+                if (e->mask & (FAN_DELETE_SELF|FAN_MOVE_SELF))
+                        self = true;
+
+                h = path_spec_subtree_event_handle(e);
+                if (!h)
+                        continue;
+
+                /* Busy file systems tend to report many events for the same directory in a row */
+                if (previous && file_handle_equal(previous, h))
+                        continue;
+
+                fd = open_by_handle_at(s->subtree_fd, (struct file_handle*) h, O_PATH|O_CLOEXEC);
+                if (fd < 0) {
+                        if (errno != ESTALE)
+                                log_debug_errno(errno, "Failed to open directory of fanotify event, ignoring: %m");
+                        continue;
+                }
+
+                if (fd_get_path(fd, &p) < 0)
+                        continue;
+
+                if (path_startswith(p, s->subtree_path))
+                        r = 1;
+                else
+                        previous = h;
+        }
+
+        if (r == 0 && self) {
+                struct stat a, b;
+
+                /* Our directory itself might have been removed or replaced, check that it is still in place */
+                if (fstat(s->subtree_fd, &a) < 0 ||
+                    stat(s->subtree_path, &b) < 0 ||
+                    a.st_dev != b.st_dev || a.st_ino != b.st_ino)
+                        r = 1;
+        }
+
+        return r;
 }
 
 int path_spec_fd_event(PathSpec *s, uint32_t revents) {
@@ -150,6 +331,9 @@ int path_spec_fd_event(PathSpec *s, uint32_t revents) {
                 return log_error_errno(SYNTHETIC_ERRNO(EINVAL),
                                        "Got invalid poll event on inotify.");
 
+        if (s->subtree_fd >= 0)
+                return path_spec_subtree_event(s);
+
         l = read(s->inotify_fd, &buffer, sizeof(buffer));
         if (l < 0) {
                 if (IN_SET(errno, EAGAIN, EINTR))
@@ -227,6 +411,7 @@ static void path_spec_dump(PathSpec *s, FILE *f, const char *prefix) {
 void path_spec_done(PathSpec *s) {
         assert(s);
         assert(s->inotify_fd == -1);
+        assert(s->subtree_fd == -1);
 
         free(s->path);
 }
@@ -317,7 +502,7 @@ static int path_add_trigger_dependencies(Path *p) {
 
         assert(p);
 
-        if (!hashmap_isempty(UNIT(p)->dependencies[UNIT_TRIGGERS]))
+        if (!dependency_set_isempty(UNIT(p)->dependencies[UNIT_TRIGGERS]))
                 return 0;
 
         r = unit_load_related_unit(UNIT(p), ".service", &x);
@@ -371,12 +556,14 @@ static void path_dump(Unit *u, FILE *f, const char *prefix) {
                 "%sResult: %s\n"
                 "%sUnit: %s\n"
                 "%sMakeDirectory: %s\n"
-                "%sDirectoryMode: %04o\n",
+                "%sDirectoryMode: %04o\n"
+                "%sWatchSubtree: %s\n",
                 prefix, path_state_to_string(p->state),
                 prefix, path_result_to_string(p->result),
                 prefix, trigger ? trigger->id : "n/a",
                 prefix, yes_no(p->make_directory),
-                prefix, p->directory_mode);
+                prefix, p->directory_mode,
+                prefix, yes_no(p->watch_subtree));
 
         LIST_FOREACH(spec, s, p->specs)
                 path_spec_dump(s, f, prefix);
@@ -677,6 +864,11 @@ static int path_dispatch_io(sd_event_source *source, int fd, uint32_t revents, v
         if (changed < 0)
                 goto fail;
 
+        /* A fanotify mark covers the whole file system, and nothing happened below our path, so there's no need to
+         * recheck or to rebuild the watch */
+        if (changed == 0 && s->subtree_fd >= 0)
+                return 0;
+
         /* If we are already running, then remember that one event was
          * dispatched so that we restart the service only if something
          * actually changed on disk */
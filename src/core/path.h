@@ -29,6 +29,11 @@ typedef struct PathSpec {
         int inotify_fd;
         int primary_wd;
 
+        /* If non-negative, inotify_fd is actually a fanotify fd with a mark on the whole file system the path is on,
+         * and this is an O_PATH fd for the path itself, see path_spec_watch_subtree(). */
+        int subtree_fd;
+        char *subtree_path;
+
         bool previous_exists;
 } PathSpec;
 
@@ -61,6 +66,8 @@ struct Path {
         bool make_directory;
         mode_t directory_mode;
 
+        bool watch_subtree;
+
         PathResult result;
 };
 
@@ -1237,7 +1237,8 @@ static int service_collect_fds(
 
                 /* Pass all our configured sockets for singleton services */
 
-                HASHMAP_FOREACH_KEY(v, u, UNIT(s)->dependencies[UNIT_TRIGGERED_BY], i) {
+                DEPENDENCY_SET_FOREACH(v, u, UNIT(s)->dependencies[UNIT_TRIGGERED_BY], i) {
+                        _cleanup_strv_free_ char **cfd_names = NULL;
                         _cleanup_free_ int *cfds = NULL;
                         Socket *sock;
                         int cn_fds;
@@ -1247,7 +1248,7 @@ static int service_collect_fds(
 
                         sock = SOCKET(u);
 
-                        cn_fds = socket_collect_fds(sock, &cfds);
+                        cn_fds = socket_collect_fds(sock, &cfds, &cfd_names);
                         if (cn_fds < 0)
                                 return cn_fds;
 
@@ -1270,7 +1271,7 @@ static int service_collect_fds(
                                 rn_socket_fds += cn_fds;
                         }
 
-                        r = strv_extend_n(&rfd_names, socket_fdname(sock), cn_fds);
+                        r = strv_extend_strv(&rfd_names, cfd_names, false);
                         if (r < 0)
                                 return r;
                 }
@@ -3021,6 +3022,7 @@ static int service_demand_pid_file(Service *s) {
          * keep their PID file open all the time. */
         ps->type = PATH_MODIFIED;
         ps->inotify_fd = -1;
+        ps->subtree_fd = -1;
 
         s->pid_file_pathspec = ps;
 
@@ -211,6 +211,11 @@ static void slice_dump(Unit *u, FILE *f, const char *prefix) {
                 "%sSlice State: %s\n",
                 prefix, slice_state_to_string(t->state));
 
+        if (t->start_concurrency > 0)
+                fprintf(f,
+                        "%sStart Concurrency: %u/%u\n",
+                        prefix, t->n_running_start_jobs, t->start_concurrency);
+
         cgroup_context_dump(&t->cgroup_context, f, prefix);
 }
 
@@ -11,6 +11,11 @@ struct Slice {
         SliceState state, deserialized_state;
 
         CGroupContext cgroup_context;
+
+        /* The maximum number of units in this slice (including its sub-slices) that may be activating at the same
+         * time, 0 if unlimited, and how many currently are. */
+        unsigned start_concurrency;
+        unsigned n_running_start_jobs;
 };
 
 extern const UnitVTable slice_vtable;
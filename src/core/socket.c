@@ -9,6 +9,7 @@
 #include <sys/epoll.h>
 #include <sys/stat.h>
 #include <unistd.h>
+#include <linux/filter.h>
 #include <linux/sctp.h>
 
 #include "alloc-util.h"
@@ -84,6 +85,7 @@ static void socket_init(Unit *u) {
         s->socket_mode = 0666;
 
         s->max_connections = 64;
+        s->accept_pool_idle_usec = USEC_INFINITY;
 
         s->priority = -1;
         s->ip_tos = -1;
@@ -134,6 +136,162 @@ void socket_free_ports(Socket *s) {
         }
 }
 
+static int socket_load_instance(Socket *s, Unit **ret) {
+        _cleanup_free_ char *prefix = NULL;
+        unsigned n;
+        int r;
+
+        assert(s);
+        assert(ret);
+
+        r = unit_name_to_prefix(UNIT(s)->id, &prefix);
+        if (r < 0)
+                return r;
+
+        /* Instances waiting in the accept pool already took the names following the number of accepted
+         * connections, hence skip over those. */
+        for (n = s->n_accepted;; n++) {
+                _cleanup_free_ char *name = NULL;
+
+                if (asprintf(&name, "%s@%u.service", prefix, n) < 0)
+                        return -ENOMEM;
+
+                if (!manager_get_unit(UNIT(s)->manager, name))
+                        return manager_load_unit(UNIT(s)->manager, name, NULL, NULL, ret);
+        }
+}
+
+static void socket_release_accept_pool(Socket *s) {
+        assert(s);
+
+        while (s->n_accept_pool > 0)
+                unit_ref_unset(s->accept_pool + --s->n_accept_pool);
+
+        if (s->accept_pool_event_source)
+                (void) sd_event_source_set_enabled(s->accept_pool_event_source, SD_EVENT_OFF);
+        if (s->accept_pool_idle_event_source)
+                (void) sd_event_source_set_enabled(s->accept_pool_idle_event_source, SD_EVENT_OFF);
+}
+
+static bool socket_accept_pool_wanted(Socket *s) {
+        assert(s);
+
+        return s->accept &&
+                s->accept_pool_size > 0 &&
+                IN_SET(s->state, SOCKET_LISTENING, SOCKET_RUNNING);
+}
+
+static int socket_dispatch_accept_pool(sd_event_source *source, void *userdata) {
+        Socket *s = SOCKET(userdata);
+        unsigned size;
+        Unit *u;
+        int r;
+
+        assert(s);
+
+        if (!socket_accept_pool_wanted(s))
+                return 0;
+
+        size = MIN(s->accept_pool_size, SOCKET_ACCEPT_POOL_SIZE_MAX);
+
+        if (!s->accept_pool) {
+                s->accept_pool = new0(UnitRef, size);
+                if (!s->accept_pool)
+                        return log_oom();
+        }
+
+        if (s->n_accept_pool >= size)
+                return 0;
+
+        /* Load one instance per iteration of the event loop, so that we never delay the processing of other events
+         * by much. */
+        r = socket_load_instance(s, &u);
+        if (r < 0) {
+                log_unit_warning_errno(UNIT(s), r, "Failed to load service instance for the accept pool, not refilling it: %m");
+                return 0;
+        }
+
+        if (u->load_state != UNIT_LOADED) {
+                log_unit_debug(UNIT(s), "Service instance %s is not loaded properly, not refilling accept pool.", u->id);
+                unit_add_to_gc_queue(u);
+                return 0;
+        }
+
+        unit_ref_set(s->accept_pool + s->n_accept_pool++, UNIT(s), u);
+
+        if (s->n_accept_pool < size) {
+                r = sd_event_source_set_enabled(source, SD_EVENT_ONESHOT);
+                if (r < 0)
+                        log_unit_warning_errno(UNIT(s), r, "Failed to enable accept pool event source, not refilling it: %m");
+        }
+
+        return 0;
+}
+
+static int socket_dispatch_accept_pool_idle(sd_event_source *source, usec_t usec, void *userdata) {
+        char buf[FORMAT_TIMESPAN_MAX];
+        Socket *s = SOCKET(userdata);
+
+        assert(s);
+
+        log_unit_debug(UNIT(s), "No incoming connections for %s, releasing accept pool.",
+                       format_timespan(buf, sizeof(buf), s->accept_pool_idle_usec, USEC_PER_SEC));
+
+        socket_release_accept_pool(s);
+        return 0;
+}
+
+static void socket_arm_accept_pool_idle(Socket *s) {
+        usec_t usec;
+        int r;
+
+        assert(s);
+
+        if (IN_SET(s->accept_pool_idle_usec, 0, USEC_INFINITY))
+                return;
+
+        usec = usec_add(now(CLOCK_MONOTONIC), s->accept_pool_idle_usec);
+
+        if (s->accept_pool_idle_event_source) {
+                r = sd_event_source_set_time(s->accept_pool_idle_event_source, usec);
+                if (r >= 0)
+                        r = sd_event_source_set_enabled(s->accept_pool_idle_event_source, SD_EVENT_ONESHOT);
+        } else {
+                r = sd_event_add_time(UNIT(s)->manager->event, &s->accept_pool_idle_event_source, CLOCK_MONOTONIC,
+                                      usec, 0, socket_dispatch_accept_pool_idle, s);
+                if (r >= 0)
+                        (void) sd_event_source_set_description(s->accept_pool_idle_event_source, "socket-accept-pool-idle");
+        }
+        if (r < 0)
+                log_unit_warning_errno(UNIT(s), r, "Failed to arm accept pool idle timer, ignoring: %m");
+}
+
+static void socket_schedule_accept_pool(Socket *s) {
+        int r;
+
+        assert(s);
+
+        if (!socket_accept_pool_wanted(s))
+                return;
+
+        if (s->accept_pool_event_source)
+                r = sd_event_source_set_enabled(s->accept_pool_event_source, SD_EVENT_ONESHOT);
+        else {
+                r = sd_event_add_defer(UNIT(s)->manager->event, &s->accept_pool_event_source, socket_dispatch_accept_pool, s);
+                if (r >= 0) {
+                        /* Refilling the pool is only worth it when there's nothing else to do */
+                        r = sd_event_source_set_priority(s->accept_pool_event_source, SD_EVENT_PRIORITY_IDLE);
+                        (void) sd_event_source_set_description(s->accept_pool_event_source, "socket-accept-pool");
+                }
+        }
+        if (r < 0) {
+                log_unit_warning_errno(UNIT(s), r, "Failed to schedule refilling of accept pool, ignoring: %m");
+                return;
+        }
+
+        socket_arm_accept_pool_idle(s);
+}
+
 static void socket_done(Unit *u) {
         Socket *s = SOCKET(u);
         SocketPeer *p;
@@ -157,6 +315,11 @@ static void socket_done(Unit *u) {
 
         unit_ref_unset(&s->service);
 
+        socket_release_accept_pool(s);
+        s->accept_pool = mfree(s->accept_pool);
+        s->accept_pool_event_source = sd_event_source_unref(s->accept_pool_event_source);
+        s->accept_pool_idle_event_source = sd_event_source_unref(s->accept_pool_idle_event_source);
+
         s->tcp_congestion = mfree(s->tcp_congestion);
         s->bind_to_device = mfree(s->bind_to_device);
 
@@ -205,16 +368,16 @@ static int socket_arm_timer(Socket *s, usec_t usec) {
 }
 
 int socket_instantiate_service(Socket *s) {
-        _cleanup_free_ char *prefix = NULL, *name = NULL;
+        Unit *u = NULL;
         int r;
-        Unit *u;
 
         assert(s);
 
         /* This fills in s->service if it isn't filled in yet. For
          * Accept=yes sockets we create the next connection service
-         * here. For Accept=no this is mostly a NOP since the service
-         * is figured out at load time anyway. */
+         * here, or take it from the accept pool. For Accept=no this
+         * is mostly a NOP since the service is figured out at load
+         * time anyway. */
 
         if (UNIT_DEREF(s->service))
                 return 0;
@@ -222,19 +385,29 @@ int socket_instantiate_service(Socket *s) {
         if (!s->accept)
                 return 0;
 
-        r = unit_name_to_prefix(UNIT(s)->id, &prefix);
-        if (r < 0)
-                return r;
+        while (s->n_accept_pool > 0) {
+                UnitRef *ref = s->accept_pool + --s->n_accept_pool;
 
-        if (asprintf(&name, "%s@%u.service", prefix, s->n_accepted) < 0)
-                return -ENOMEM;
+                u = UNIT_DEREF(*ref);
+                unit_ref_unset(ref);
 
-        r = manager_load_unit(UNIT(s)->manager, name, NULL, NULL, &u);
-        if (r < 0)
-                return r;
+                /* Somebody might have started the instance in the meantime, or it might have been reloaded */
+                if (u && u->load_state == UNIT_LOADED && !unit_active_or_pending(u))
+                        break;
+
+                u = NULL;
+        }
+
+        if (!u) {
+                r = socket_load_instance(s, &u);
+                if (r < 0)
+                        return r;
+        }
 
         unit_ref_set(&s->service, UNIT(s), u);
 
+        socket_schedule_accept_pool(s);
+
         return unit_add_two_dependencies(UNIT(s), UNIT_BEFORE, UNIT_TRIGGERS, u, false, UNIT_DEPENDENCY_IMPLICIT);
 }
 
@@ -326,12 +499,89 @@ _pure_ static bool socket_has_exec(Socket *s) {
         return false;
 }
 
+static bool socket_port_can_reuse_port(SocketPort *p) {
+        assert(p);
+
+        return p->type == SOCKET_SOCKET &&
+                IN_SET(socket_address_family(&p->address), AF_INET, AF_INET6) &&
+                IN_SET(p->address.type, SOCK_STREAM, SOCK_DGRAM);
+}
+
+static unsigned socket_reuse_port_instances(Socket *s) {
+        long k;
+
+        assert(s);
+
+        if (s->reuse_port_instances != SOCKET_REUSE_PORT_INSTANCES_NCPU)
+                return CLAMP(s->reuse_port_instances, 1U, SOCKET_REUSE_PORT_INSTANCES_MAX);
+
+        k = sysconf(_SC_NPROCESSORS_ONLN);
+        if (k <= 0)
+                return 1;
+
+        return MIN((unsigned long) k, (unsigned long) SOCKET_REUSE_PORT_INSTANCES_MAX);
+}
+
+static int socket_add_reuse_port_instances(Socket *s) {
+        bool warned = false;
+        unsigned n, i;
+        SocketPort *p;
+
+        assert(s);
+
+        /* For ReusePortInstances= clone each internet socket port, so that we open that many sockets bound to the
+         * same address, among which the kernel distributes incoming connections. The clones are inserted right
+         * after the original, hence they are opened in order, which is the order the kernel indexes the members of
+         * the SO_REUSEPORT group in. */
+
+        n = socket_reuse_port_instances(s);
+        if (n <= 1)
+                return 0;
+
+        LIST_FOREACH(port, p, s->ports) {
+                SocketPort *last = p;
+
+                if (p->reuse_port_index > 0)
+                        continue;
+
+                if (!socket_port_can_reuse_port(p)) {
+                        if (!warned)
+                                log_unit_warning(UNIT(s), "ReusePortInstances= is only supported for stream and datagram internet sockets, opening a single socket for the others.");
+                        warned = true;
+                        continue;
+                }
+
+                for (i = 1; i < n; i++) {
+                        SocketPort *c;
+
+                        c = new0(SocketPort, 1);
+                        if (!c)
+                                return -ENOMEM;
+
+                        c->socket = s;
+                        c->type = p->type;
+                        c->fd = -1;
+                        c->address = p->address;
+                        c->reuse_port_index = i;
+
+                        LIST_INSERT_AFTER(port, s->ports, last, c);
+                        last = c;
+                }
+        }
+
+        return 0;
+}
+
 static int socket_add_extras(Socket *s) {
         Unit *u = UNIT(s);
         int r;
 
         assert(s);
 
+        r = socket_add_reuse_port_instances(s);
+        if (r < 0)
+                return r;
+
         /* Pick defaults for the trigger limit, if nothing was explicitly configured. We pick a relatively high limit
          * in Accept=yes mode, and a lower limit for Accept=no. Reason: in Accept=yes mode we are invoking accept()
          * ourselves before the trigger limit can hit, thus incoming connections are taken off the socket queue quickly
@@ -729,6 +979,27 @@ static void socket_dump(Unit *u, FILE *f, const char *prefix) {
                         "%sReusePort: %s\n",
                          prefix, yes_no(s->reuse_port));
 
+        if (s->accept_pool_size > 0)
+                fprintf(f,
+                        "%sAcceptPoolSize: %u (%u loaded)\n"
+                        "%sAcceptPoolIdleSec: %s\n",
+                        prefix, s->accept_pool_size, s->n_accept_pool,
+                        prefix, format_timespan(time_string, FORMAT_TIMESPAN_MAX, s->accept_pool_idle_usec, USEC_PER_SEC));
+
+        if (s->reuse_port_instances == SOCKET_REUSE_PORT_INSTANCES_NCPU)
+                fprintf(f,
+                        "%sReusePortInstances: ncpu\n",
+                        prefix);
+        else if (s->reuse_port_instances > 1)
+                fprintf(f,
+                        "%sReusePortInstances: %u\n",
+                        prefix, s->reuse_port_instances);
+
+        if (s->reuse_port_cpu_steering)
+                fprintf(f,
+                        "%sReusePortCPUSteering: %s\n",
+                        prefix, yes_no(s->reuse_port_cpu_steering));
+
         if (s->smack)
                 fprintf(f,
                         "%sSmackLabel: %s\n",
@@ -1456,7 +1727,7 @@ static int socket_address_listen_do(
                         s->backlog,
                         s->bind_ipv6_only,
                         s->bind_to_device,
-                        s->reuse_port,
+                        s->reuse_port || s->reuse_port_instances > 1,
                         s->free_bind,
                         s->transparent,
                         s->directory_mode,
@@ -1538,6 +1809,38 @@ shortcut:
         return fd;
 }
 
+static void socket_attach_reuse_port_steering(Socket *s) {
+        static const struct sock_filter code[] = {
+                /* Return the index of the CPU the packet is processed on as index of the socket to deliver to */
+                BPF_STMT(BPF_LD|BPF_W|BPF_ABS, SKF_AD_OFF + SKF_AD_CPU),
+                BPF_STMT(BPF_RET|BPF_A, 0),
+        };
+        const struct sock_fprog prog = {
+                .len = ELEMENTSOF(code),
+                .filter = (struct sock_filter*) code,
+        };
+        SocketPort *p;
+
+        assert(s);
+
+        if (!s->reuse_port_cpu_steering)
+                return;
+
+        /* The program applies to the whole SO_REUSEPORT group, hence attach it to the first socket of each set. If
+         * the returned index is beyond the size of the group, the kernel falls back to its hash-based selection. */
+
+        LIST_FOREACH(port, p, s->ports) {
+                if (p->fd < 0 || p->reuse_port_index > 0)
+                        continue;
+
+                if (!p->port_next || p->port_next->reuse_port_index == 0)
+                        continue;
+
+                if (setsockopt(p->fd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof(prog)) < 0)
+                        log_unit_warning_errno(UNIT(s), errno, "Failed to attach CPU steering program to SO_REUSEPORT sockets, ignoring: %m");
+        }
+}
+
 static int socket_open_fds(Socket *s) {
         _cleanup_(mac_selinux_freep) char *label = NULL;
         bool know_label = false;
@@ -1653,6 +1956,8 @@ static int socket_open_fds(Socket *s) {
                 }
         }
 
+        socket_attach_reuse_port_steering(s);
+
         return 0;
 
 rollback:
@@ -1775,6 +2080,11 @@ static void socket_set_state(Socket *s, SocketState state) {
                     SOCKET_STOP_PRE_SIGKILL))
                 socket_close_fds(s);
 
+        if (IN_SET(state, SOCKET_LISTENING, SOCKET_RUNNING))
+                socket_schedule_accept_pool(s);
+        else
+                socket_release_accept_pool(s);
+
         if (state != old_state)
                 log_unit_debug(UNIT(s), "Changed %s -> %s", socket_state_to_string(old_state), socket_state_to_string(state));
 
@@ -2250,7 +2560,7 @@ static void socket_enter_running(Socket *s, int cfd) {
 
                 /* If there's already a start pending don't bother to
                  * do anything */
-                HASHMAP_FOREACH_KEY(v, other, UNIT(s)->dependencies[UNIT_TRIGGERS], i)
+                DEPENDENCY_SET_FOREACH(v, other, UNIT(s)->dependencies[UNIT_TRIGGERS], i)
                         if (unit_active_or_pending(other)) {
                                 pending = true;
                                 break;
@@ -2657,7 +2967,7 @@ static int socket_deserialize_item(Unit *u, const char *key, const char *value,
                         log_unit_debug(u, "Failed to parse socket value: %s", value);
                 else
                         LIST_FOREACH(port, p, s->ports)
-                                if (socket_address_is(&p->address, value+skip, type)) {
+                                if (p->fd < 0 && socket_address_is(&p->address, value+skip, type)) {
                                         socket_port_take_fd(p, fds, fd);
                                         break;
                                 }
@@ -3098,15 +3408,19 @@ static int socket_dispatch_timer(sd_event_source *source, usec_t usec, void *use
         return 0;
 }
 
-int socket_collect_fds(Socket *s, int **fds) {
+int socket_collect_fds(Socket *s, int **fds, char ***fd_names) {
+        _cleanup_strv_free_ char **rfd_names = NULL;
+        _cleanup_free_ int *rfds = NULL;
         size_t k = 0, n = 0;
         SocketPort *p;
-        int *rfds;
+        int r;
 
         assert(s);
         assert(fds);
+        assert(fd_names);
 
-        /* Called from the service code for requesting our fds */
+        /* Called from the service code for requesting our fds. The sockets opened for ReusePortInstances= are named
+         * after the socket with their index as suffix, so that the service may tell them apart. */
 
         LIST_FOREACH(port, p, s->ports) {
                 if (p->fd >= 0)
@@ -3116,6 +3430,7 @@ int socket_collect_fds(Socket *s, int **fds) {
 
         if (n <= 0) {
                 *fds = NULL;
+                *fd_names = NULL;
                 return 0;
         }
 
@@ -3126,15 +3441,29 @@ int socket_collect_fds(Socket *s, int **fds) {
         LIST_FOREACH(port, p, s->ports) {
                 size_t i;
 
-                if (p->fd >= 0)
+                if (p->fd >= 0) {
                         rfds[k++] = p->fd;
+
+                        if (p->reuse_port_index > 0 || (p->port_next && p->port_next->reuse_port_index > 0))
+                                r = strv_extendf(&rfd_names, "%s.%u", socket_fdname(s), p->reuse_port_index);
+                        else
+                                r = strv_extend(&rfd_names, socket_fdname(s));
+                        if (r < 0)
+                                return r;
+                }
+
                 for (i = 0; i < p->n_auxiliary_fds; ++i)
                         rfds[k++] = p->auxiliary_fds[i];
+
+                r = strv_extend_n(&rfd_names, socket_fdname(s), p->n_auxiliary_fds);
+                if (r < 0)
+                        return r;
         }
 
         assert(k == n);
 
-        *fds = rfds;
+        *fds = TAKE_PTR(rfds);
+        *fd_names = TAKE_PTR(rfd_names);
         return (int) n;
 }
 
@@ -55,6 +55,9 @@ typedef struct SocketPort {
         char *path;
         sd_event_source *event_source;
 
+        /* Which of the ReusePortInstances= sockets of the same address this is, counting from 0 */
+        unsigned reuse_port_index;
+
         LIST_FIELDS(struct SocketPort, port);
 } SocketPort;
 
@@ -91,6 +94,16 @@ struct Socket {
          * to refer to the next service we spawn. */
         UnitRef service;
 
+        /* For Accept=yes sockets with AcceptPoolSize= set: service instances that are already loaded, and are
+         * handed out by socket_instantiate_service() before loading a new one. Refilled from an idle event source,
+         * and released again if no connection arrived for AcceptPoolIdleSec=. */
+        unsigned accept_pool_size;
+        usec_t accept_pool_idle_usec;
+        UnitRef *accept_pool;
+        unsigned n_accept_pool;
+        sd_event_source *accept_pool_event_source;
+        sd_event_source *accept_pool_idle_event_source;
+
         SocketState state, deserialized_state;
 
         sd_event_source *timer_event_source;
@@ -134,6 +147,8 @@ struct Socket {
         char *bind_to_device;
         char *tcp_congestion;
         bool reuse_port;
+        unsigned reuse_port_instances;
+        bool reuse_port_cpu_steering;
         long mq_maxmsg;
         long mq_msgsize;
 
@@ -150,6 +165,12 @@ struct Socket {
         RateLimit trigger_limit;
 };
 
+/* The special value of Socket.reuse_port_instances to open one socket per online CPU */
+#define SOCKET_REUSE_PORT_INSTANCES_NCPU UINT_MAX
+#define SOCKET_REUSE_PORT_INSTANCES_MAX 1024U
+
+#define SOCKET_ACCEPT_POOL_SIZE_MAX 256U
+
 SocketPeer *socket_peer_ref(SocketPeer *p);
 SocketPeer *socket_peer_unref(SocketPeer *p);
 int socket_acquire_peer(Socket *s, int fd, SocketPeer **p);
@@ -157,7 +178,7 @@ int socket_acquire_peer(Socket *s, int fd, SocketPeer **p);
 DEFINE_TRIVIAL_CLEANUP_FUNC(SocketPeer*, socket_peer_unref);
 
 /* Called from the service code when collecting fds */
-int socket_collect_fds(Socket *s, int **fds);
+int socket_collect_fds(Socket *s, int **fds, char ***fd_names);
 
 /* Called from the service code when a per-connection service ended */
 void socket_connection_unref(Socket *s);
@@ -20,9 +20,28 @@ static void transaction_delete_job(Transaction *tr, Job *j, bool delete_dependen
 
         transaction_unlink_job(tr, j, delete_dependencies);
 
+        if (j->in_transaction_gc_queue) {
+                LIST_REMOVE(transaction_gc_queue, tr->gc_queue, j);
+                j->in_transaction_gc_queue = false;
+        }
+
         job_free(j);
 }
 
+static void transaction_add_to_gc_queue(Transaction *tr, Job *j) {
+        assert(tr);
+        assert(j);
+
+        if (!tr->collecting_garbage)
+                return;
+
+        if (j->in_transaction_gc_queue)
+                return;
+
+        LIST_PREPEND(transaction_gc_queue, tr->gc_queue, j);
+        j->in_transaction_gc_queue = true;
+}
+
 static void transaction_delete_unit(Transaction *tr, Unit *u) {
         Job *j;
 
@@ -46,26 +65,39 @@ void transaction_abort(Transaction *tr) {
 
 static void transaction_find_jobs_that_matter_to_anchor(Job *j, unsigned generation) {
         JobDependency *l;
+        Job *stack;
 
-        /* A recursive sweep through the graph that marks all units
-         * that matter to the anchor job, i.e. are directly or
-         * indirectly a dependency of the anchor job via paths that
-         * are fully marked as mattering. */
+        /* A sweep through the graph that marks all units that matter
+         * to the anchor job, i.e. are directly or indirectly a
+         * dependency of the anchor job via paths that are fully
+         * marked as mattering. The jobs still to visit are chained
+         * up via their marker, so that this needs neither recursion
+         * nor memory allocation. */
 
-        j->matters_to_anchor = true;
         j->generation = generation;
+        j->marker = NULL;
+        stack = j;
 
-        LIST_FOREACH(subject, l, j->subject_list) {
+        while ((j = stack)) {
+                stack = j->marker;
+                j->marker = NULL;
 
-                /* This link does not matter */
-                if (!l->matters)
-                        continue;
+                j->matters_to_anchor = true;
 
-                /* This unit has already been marked */
-                if (l->object->generation == generation)
-                        continue;
+                LIST_FOREACH(subject, l, j->subject_list) {
 
-                transaction_find_jobs_that_matter_to_anchor(l->object, generation);
+                        /* This link does not matter */
+                        if (!l->matters)
+                                continue;
+
+                        /* This unit has already been marked */
+                        if (l->object->generation == generation)
+                                continue;
+
+                        l->object->generation = generation;
+                        l->object->marker = stack;
+                        stack = l->object;
+                }
         }
 }
 
@@ -288,7 +320,6 @@ static void transaction_drop_redundant(Transaction *tr) {
 
         assert(tr);
 
-rescan:
         HASHMAP_FOREACH(j, tr->jobs, i) {
                 Job *k;
 
@@ -300,9 +331,13 @@ rescan:
                                 goto next_unit;
                 }
 
+                /* Whether a job is redundant does not depend on the other jobs in the transaction, and the
+                 * jobs are not deleted with their dependencies, hence this only removes the current entry
+                 * of the hashmap, and we don't have to start over. */
+
                 /* log_debug("Found redundant job %s/%s, dropping.", j->unit->id, job_type_to_string(j->type)); */
-                transaction_delete_job(tr, j, false);
-                goto rescan;
+                while ((k = hashmap_get(tr->jobs, j->unit)))
+                        transaction_delete_job(tr, k, false);
         next_unit:;
         }
 }
@@ -340,134 +375,163 @@ static char* merge_unit_ids(const char* unit_log_field, char **pairs) {
         return ans;
 }
 
-static int transaction_verify_order_one(Transaction *tr, Job *j, Job *from, unsigned generation, sd_bus_error *e) {
+typedef struct VerifyOrderFrame {
+        Job *job;
         Iterator i;
-        Unit *u;
-        void *v;
-        int r;
+} VerifyOrderFrame;
+
+static int transaction_break_cycle(Transaction *tr, Job *j, Job *from, unsigned generation, sd_bus_error *e) {
+        Job *k, *delete = NULL;
+        _cleanup_free_ char **array = NULL, *unit_ids = NULL;
+        char **unit_id, **job_type;
 
         assert(tr);
         assert(j);
-        assert(!j->transaction_prev);
+        assert(from);
 
-        /* Does a recursive sweep through the ordering graph, looking
-         * for a cycle. If we find a cycle we try to break it. */
+        /* We found a cycle: 'j' is on our current path, and we got to it from 'from'. Let's try to break it. We go
+         * backwards in our path and try to find a suitable job to remove. We use the marker to find our way back,
+         * since smart how we are we stored our way back in there. */
 
-        /* Have we seen this before? */
-        if (j->generation == generation) {
-                Job *k, *delete = NULL;
-                _cleanup_free_ char **array = NULL, *unit_ids = NULL;
-                char **unit_id, **job_type;
+        for (k = from; k; k = ((k->generation == generation && k->marker != k) ? k->marker : NULL)) {
+                /* For logging below */
+                if (strv_push_pair(&array, k->unit->id, (char*) job_type_to_string(k->type)) < 0)
+                        log_oom();
 
-                /* If the marker is NULL we have been here already and
-                 * decided the job was loop-free from here. Hence
-                 * shortcut things and return right-away. */
-                if (!j->marker)
-                        return 0;
+                if (!delete && hashmap_get(tr->jobs, k->unit) && !unit_matters_to_anchor(k->unit, k))
+                        /* Ok, we can drop this one, so let's do so. */
+                        delete = k;
 
-                /* So, the marker is not NULL and we already have been here. We have
-                 * a cycle. Let's try to break it. We go backwards in our path and
-                 * try to find a suitable job to remove. We use the marker to find
-                 * our way back, since smart how we are we stored our way back in
-                 * there. */
+                /* Check if this in fact was the beginning of the cycle */
+                if (k == j)
+                        break;
+        }
 
-                for (k = from; k; k = ((k->generation == generation && k->marker != k) ? k->marker : NULL)) {
+        unit_ids = merge_unit_ids(j->manager->unit_log_field, array); /* ignore error */
 
-                        /* For logging below */
-                        if (strv_push_pair(&array, k->unit->id, (char*) job_type_to_string(k->type)) < 0)
-                                log_oom();
+        STRV_FOREACH_PAIR(unit_id, job_type, array)
+                /* logging for j not k here to provide a consistent narrative */
+                log_struct(LOG_WARNING,
+                           "MESSAGE=%s: Found %s on %s/%s",
+                           j->unit->id,
+                           unit_id == array ? "ordering cycle" : "dependency",
+                           *unit_id, *job_type,
+                           unit_ids);
 
-                        if (!delete && hashmap_get(tr->jobs, k->unit) && !unit_matters_to_anchor(k->unit, k))
-                                /* Ok, we can drop this one, so let's do so. */
-                                delete = k;
+        if (delete) {
+                const char *status;
+                /* logging for j not k here to provide a consistent narrative */
+                log_struct(LOG_ERR,
+                           "MESSAGE=%s: Job %s/%s deleted to break ordering cycle starting with %s/%s",
+                           j->unit->id, delete->unit->id, job_type_to_string(delete->type),
+                           j->unit->id, job_type_to_string(j->type),
+                           unit_ids);
 
-                        /* Check if this in fact was the beginning of the cycle */
-                        if (k == j)
-                                break;
-                }
+                if (log_get_show_color())
+                        status = ANSI_HIGHLIGHT_RED " SKIP " ANSI_NORMAL;
+                else
+                        status = " SKIP ";
 
-                unit_ids = merge_unit_ids(j->manager->unit_log_field, array); /* ignore error */
-
-                STRV_FOREACH_PAIR(unit_id, job_type, array)
-                        /* logging for j not k here to provide a consistent narrative */
-                        log_struct(LOG_WARNING,
-                                   "MESSAGE=%s: Found %s on %s/%s",
-                                   j->unit->id,
-                                   unit_id == array ? "ordering cycle" : "dependency",
-                                   *unit_id, *job_type,
-                                   unit_ids);
-
-                if (delete) {
-                        const char *status;
-                        /* logging for j not k here to provide a consistent narrative */
-                        log_struct(LOG_ERR,
-                                   "MESSAGE=%s: Job %s/%s deleted to break ordering cycle starting with %s/%s",
-                                   j->unit->id, delete->unit->id, job_type_to_string(delete->type),
-                                   j->unit->id, job_type_to_string(j->type),
-                                   unit_ids);
-
-                        if (log_get_show_color())
-                                status = ANSI_HIGHLIGHT_RED " SKIP " ANSI_NORMAL;
-                        else
-                                status = " SKIP ";
+                unit_status_printf(delete->unit, status,
+                                   "Ordering cycle found, skipping %s");
+                transaction_delete_unit(tr, delete->unit);
+                return -EAGAIN;
+        }
 
-                        unit_status_printf(delete->unit, status,
-                                           "Ordering cycle found, skipping %s");
-                        transaction_delete_unit(tr, delete->unit);
-                        return -EAGAIN;
-                }
+        log_struct(LOG_ERR,
+                   "MESSAGE=%s: Unable to break cycle starting with %s/%s",
+                   j->unit->id, j->unit->id, job_type_to_string(j->type),
+                   unit_ids);
 
-                log_struct(LOG_ERR,
-                           "MESSAGE=%s: Unable to break cycle starting with %s/%s",
-                           j->unit->id, j->unit->id, job_type_to_string(j->type),
-                           unit_ids);
+        return sd_bus_error_setf(e, BUS_ERROR_TRANSACTION_ORDER_IS_CYCLIC,
+                                 "Transaction order is cyclic. See system logs for details.");
+}
 
-                return sd_bus_error_setf(e, BUS_ERROR_TRANSACTION_ORDER_IS_CYCLIC,
-                                         "Transaction order is cyclic. See system logs for details.");
-        }
+static int transaction_verify_order_one(
+                Transaction *tr,
+                Job *j,
+                unsigned generation,
+                VerifyOrderFrame *stack,
+                size_t n_stack_max,
+                sd_bus_error *e) {
+
+        size_t n_stack = 0;
+
+        assert(tr);
+        assert(j);
+        assert(stack);
+
+        /* Does a depth-first sweep through the ordering graph, looking for a cycle. If we find a cycle we try to
+         * break it. The path we are currently on is kept in 'stack', so that even very deep graphs don't exhaust
+         * our real stack. Every job is visited only once per generation. */
+
+        /* Have we seen this before? We then decided the job was loop-free from here, since the marker is only set
+         * while a job is on the stack. */
+        if (j->generation == generation)
+                return 0;
 
-        /* Make the marker point to where we come from, so that we can
-         * find our way backwards if we want to break a cycle. We use
-         * a special marker for the beginning: we point to
-         * ourselves. */
-        j->marker = from ? from : j;
+        /* Make the marker point to where we come from, so that we can find our way backwards if we want to break a
+         * cycle. We use a special marker for the beginning: we point to ourselves. */
+        j->marker = j;
         j->generation = generation;
+        stack[n_stack++] = (VerifyOrderFrame) { .job = j, .i = ITERATOR_FIRST };
 
-        /* We assume that the dependencies are bidirectional, and
-         * hence can ignore UNIT_AFTER */
-        HASHMAP_FOREACH_KEY(v, u, j->unit->dependencies[UNIT_BEFORE], i) {
+        while (n_stack > 0) {
+                VerifyOrderFrame *f = stack + n_stack - 1;
                 Job *o;
+                Unit *u;
+
+                /* We assume that the dependencies are bidirectional, and hence can ignore UNIT_AFTER */
+                if (!dependency_set_iterate(f->job->unit->dependencies[UNIT_BEFORE], &f->i, NULL, &u)) {
+                        /* Ok, let's backtrack, and remember that this entry is not on our path anymore. */
+                        f->job->marker = NULL;
+                        n_stack--;
+                        continue;
+                }
 
                 /* Is there a job for this unit? */
                 o = hashmap_get(tr->jobs, u);
                 if (!o) {
-                        /* Ok, there is no job for this in the
-                         * transaction, but maybe there is already one
+                        /* Ok, there is no job for this in the transaction, but maybe there is already one
                          * running? */
                         o = u->job;
                         if (!o)
                                 continue;
                 }
 
-                r = transaction_verify_order_one(tr, o, j, generation, e);
-                if (r < 0)
-                        return r;
-        }
+                assert(!o->transaction_prev);
 
-        /* Ok, let's backtrack, and remember that this entry is not on
-         * our path anymore. */
-        j->marker = NULL;
+                if (o->generation == generation) {
+                        /* If the marker is NULL we have been here already and decided the job was loop-free from
+                         * here. Hence shortcut things and continue right-away. */
+                        if (!o->marker)
+                                continue;
+
+                        /* So, the marker is not NULL and we already have been here. We have a cycle. */
+                        return transaction_break_cycle(tr, o, f->job, generation, e);
+                }
+
+                /* Each job is pushed at most once, hence the stack cannot grow larger than the number of jobs */
+                assert(n_stack < n_stack_max);
+
+                o->marker = f->job;
+                o->generation = generation;
+                stack[n_stack++] = (VerifyOrderFrame) { .job = o, .i = ITERATOR_FIRST };
+        }
 
         return 0;
 }
 
-static int transaction_verify_order(Transaction *tr, unsigned *generation, sd_bus_error *e) {
+static int transaction_verify_order(Transaction *tr, Manager *m, unsigned *generation, sd_bus_error *e) {
+        _cleanup_free_ VerifyOrderFrame *stack = NULL;
+        size_t n_stack_max;
         Job *j;
         int r;
         Iterator i;
         unsigned g;
 
         assert(tr);
+        assert(m);
         assert(generation);
 
         /* Check if the ordering graph is cyclic. If it is, try to fix
@@ -475,8 +539,14 @@ static int transaction_verify_order(Transaction *tr, unsigned *generation, sd_bu
 
         g = (*generation)++;
 
+        /* The path may contain each job of the transaction, and each installed job, once */
+        n_stack_max = hashmap_size(tr->jobs) + hashmap_size(m->jobs);
+        stack = new(VerifyOrderFrame, n_stack_max);
+        if (!stack)
+                return -ENOMEM;
+
         HASHMAP_FOREACH(j, tr->jobs, i) {
-                r = transaction_verify_order_one(tr, j, NULL, g, e);
+                r = transaction_verify_order_one(tr, j, g, stack, n_stack_max, e);
                 if (r < 0)
                         return r;
         }
@@ -490,10 +560,24 @@ static void transaction_collect_garbage(Transaction *tr) {
 
         assert(tr);
 
-        /* Drop jobs that are not required by any other job */
+        /* Drop jobs that are not required by any other job. Deleting a job may make the jobs it required garbage
+         * too, as well as the next job for the same unit. Instead of starting over after each deletion, these jobs
+         * are queued up by transaction_unlink_job() and checked again. */
+
+        tr->collecting_garbage = true;
+
+        HASHMAP_FOREACH(j, tr->jobs, i)
+                transaction_add_to_gc_queue(tr, j);
+
+        while ((j = tr->gc_queue)) {
+                LIST_REMOVE(transaction_gc_queue, tr->gc_queue, j);
+                j->in_transaction_gc_queue = false;
+
+                /* Only the first job of each unit is considered. The next one is queued once the first one is
+                 * deleted. */
+                if (j->transaction_prev)
+                        continue;
 
-rescan:
-        HASHMAP_FOREACH(j, tr->jobs, i) {
                 if (tr->anchor_job == j || j->object_list) {
                         /* log_debug("Keeping job %s/%s because of %s/%s", */
                         /*           j->unit->id, job_type_to_string(j->type), */
@@ -504,8 +588,9 @@ rescan:
 
                 /* log_debug("Garbage collecting job %s/%s", j->unit->id, job_type_to_string(j->type)); */
                 transaction_delete_job(tr, j, true);
-                goto rescan;
         }
+
+        tr->collecting_garbage = false;
 }
 
 static int transaction_is_destructive(Transaction *tr, JobMode mode, sd_bus_error *e) {
@@ -693,9 +778,11 @@ int transaction_activate(Transaction *tr, Manager *m, JobMode mode, sd_bus_error
 
                 /* Fifth step: verify order makes sense and correct
                  * cycles if necessary and possible */
-                r = transaction_verify_order(tr, &generation, e);
+                r = transaction_verify_order(tr, m, &generation, e);
                 if (r >= 0)
                         break;
+                if (r == -ENOMEM)
+                        return log_oom();
 
                 if (r != -EAGAIN)
                         return log_warning_errno(r, "Requested transaction contains an unfixable cyclic ordering dependency: %s", bus_error_message(e, r));
@@ -809,9 +896,10 @@ static void transaction_unlink_job(Transaction *tr, Job *j, bool delete_dependen
 
         if (j->transaction_prev)
                 j->transaction_prev->transaction_next = j->transaction_next;
-        else if (j->transaction_next)
+        else if (j->transaction_next) {
                 hashmap_replace(tr->jobs, j->unit, j->transaction_next);
-        else
+                transaction_add_to_gc_queue(tr, j->transaction_next);
+        } else
                 hashmap_remove_value(tr->jobs, j->unit, j);
 
         if (j->transaction_next)
@@ -819,8 +907,12 @@ static void transaction_unlink_job(Transaction *tr, Job *j, bool delete_dependen
 
         j->transaction_prev = j->transaction_next = NULL;
 
-        while (j->subject_list)
+        while (j->subject_list) {
+                Job *object = j->subject_list->object;
+
                 job_dependency_free(j->subject_list);
+                transaction_add_to_gc_queue(tr, object);
+        }
 
         while (j->object_list) {
                 Job *other = j->object_list->matters ? j->object_list->subject : NULL;
@@ -847,7 +939,7 @@ void transaction_add_propagate_reload_jobs(Transaction *tr, Unit *unit, Job *by,
         assert(tr);
         assert(unit);
 
-        HASHMAP_FOREACH_KEY(v, dep, unit->dependencies[UNIT_PROPAGATES_RELOAD_TO], i) {
+        DEPENDENCY_SET_FOREACH(v, dep, unit->dependencies[UNIT_PROPAGATES_RELOAD_TO], i) {
                 nt = job_type_collapse(JOB_TRY_RELOAD, dep);
                 if (nt == JOB_NOP)
                         continue;
@@ -952,7 +1044,7 @@ int transaction_add_job_and_dependencies(
 
                 /* Finally, recursively add in all dependencies. */
                 if (IN_SET(type, JOB_START, JOB_RESTART)) {
-                        HASHMAP_FOREACH_KEY(v, dep, ret->unit->dependencies[UNIT_REQUIRES], i) {
+                        DEPENDENCY_SET_FOREACH(v, dep, ret->unit->dependencies[UNIT_REQUIRES], i) {
                                 r = transaction_add_job_and_dependencies(tr, JOB_START, dep, ret, true, false, false, ignore_order, e);
                                 if (r < 0) {
                                         if (r != -EBADR) /* job type not applicable */
@@ -962,7 +1054,7 @@ int transaction_add_job_and_dependencies(
                                 }
                         }
 
-                        HASHMAP_FOREACH_KEY(v, dep, ret->unit->dependencies[UNIT_BINDS_TO], i) {
+                        DEPENDENCY_SET_FOREACH(v, dep, ret->unit->dependencies[UNIT_BINDS_TO], i) {
                                 r = transaction_add_job_and_dependencies(tr, JOB_START, dep, ret, true, false, false, ignore_order, e);
                                 if (r < 0) {
                                         if (r != -EBADR) /* job type not applicable */
@@ -972,7 +1064,7 @@ int transaction_add_job_and_dependencies(
                                 }
                         }
 
-                        HASHMAP_FOREACH_KEY(v, dep, ret->unit->dependencies[UNIT_WANTS], i) {
+                        DEPENDENCY_SET_FOREACH(v, dep, ret->unit->dependencies[UNIT_WANTS], i) {
                                 r = transaction_add_job_and_dependencies(tr, JOB_START, dep, ret, false, false, false, ignore_order, e);
                                 if (r < 0) {
                                         /* unit masked, job type not applicable and unit not found are not considered as errors. */
@@ -984,7 +1076,7 @@ int transaction_add_job_and_dependencies(
                                 }
                         }
 
-                        HASHMAP_FOREACH_KEY(v, dep, ret->unit->dependencies[UNIT_REQUISITE], i) {
+                        DEPENDENCY_SET_FOREACH(v, dep, ret->unit->dependencies[UNIT_REQUISITE], i) {
                                 r = transaction_add_job_and_dependencies(tr, JOB_VERIFY_ACTIVE, dep, ret, true, false, false, ignore_order, e);
                                 if (r < 0) {
                                         if (r != -EBADR) /* job type not applicable */
@@ -994,7 +1086,7 @@ int transaction_add_job_and_dependencies(
                                 }
                         }
 
-                        HASHMAP_FOREACH_KEY(v, dep, ret->unit->dependencies[UNIT_CONFLICTS], i) {
+                        DEPENDENCY_SET_FOREACH(v, dep, ret->unit->dependencies[UNIT_CONFLICTS], i) {
                                 r = transaction_add_job_and_dependencies(tr, JOB_STOP, dep, ret, true, true, false, ignore_order, e);
                                 if (r < 0) {
                                         if (r != -EBADR) /* job type not applicable */
@@ -1004,7 +1096,7 @@ int transaction_add_job_and_dependencies(
                                 }
                         }
 
-                        HASHMAP_FOREACH_KEY(v, dep, ret->unit->dependencies[UNIT_CONFLICTED_BY], i) {
+                        DEPENDENCY_SET_FOREACH(v, dep, ret->unit->dependencies[UNIT_CONFLICTED_BY], i) {
                                 r = transaction_add_job_and_dependencies(tr, JOB_STOP, dep, ret, false, false, false, ignore_order, e);
                                 if (r < 0) {
                                         log_unit_warning(dep,
@@ -1033,7 +1125,7 @@ int transaction_add_job_and_dependencies(
                         ptype = type == JOB_RESTART ? JOB_TRY_RESTART : type;
 
                         for (j = 0; j < ELEMENTSOF(propagate_deps); j++)
-                                HASHMAP_FOREACH_KEY(v, dep, ret->unit->dependencies[propagate_deps[j]], i) {
+                                DEPENDENCY_SET_FOREACH(v, dep, ret->unit->dependencies[propagate_deps[j]], i) {
                                         JobType nt;
 
                                         nt = job_type_collapse(ptype, dep);
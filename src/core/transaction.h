@@ -5,6 +5,7 @@ typedef struct Transaction Transaction;
 
 #include "hashmap.h"
 #include "job.h"
+#include "list.h"
 #include "manager.h"
 #include "unit.h"
 
@@ -13,6 +14,10 @@ struct Transaction {
         Hashmap *jobs;      /* Unit object => Job object list 1:1 */
         Job *anchor_job;      /* the job the user asked for */
         bool irreversible;
+
+        /* Jobs that might have become garbage, only maintained while collecting garbage */
+        LIST_HEAD(Job, gc_queue);
+        bool collecting_garbage;
 };
 
 Transaction *transaction_new(bool irreversible);
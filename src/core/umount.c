@@ -9,6 +9,7 @@
 #include <string.h>
 #include <sys/mount.h>
 #include <sys/swap.h>
+#include <sys/wait.h>
 
 /* This needs to be after sys/mount.h :( */
 #include <libmount.h>
@@ -22,12 +23,14 @@
 #include "escape.h"
 #include "fd-util.h"
 #include "fstab-util.h"
+#include "hashmap.h"
 #include "linux-3.13/dm-ioctl.h"
 #include "mount-setup.h"
 #include "mount-util.h"
 #include "mountpoint-util.h"
 #include "path-util.h"
 #include "process-util.h"
+#include "set.h"
 #include "signal-util.h"
 #include "string-util.h"
 #include "strv.h"
@@ -173,6 +176,8 @@ int mount_points_list_get(const char *mountinfo, MountPoint **head) {
                 free_and_replace(m->remount_options, remount_options);
                 m->remount_flags = remount_flags;
                 m->try_remount_ro = try_remount_ro;
+                m->mount_id = mnt_fs_get_id(fs);
+                m->parent_id = mnt_fs_get_parent_id(fs);
 
                 LIST_PREPEND(mount_point, *head, m);
         }
@@ -388,143 +393,395 @@ static bool nonunmountable_path(const char *path) {
                 || path_startswith(path, "/run/initramfs");
 }
 
-static int remount_with_timeout(MountPoint *m, int umount_log_level) {
+/* How many remount and umount child processes to run at the same time. Getting rid of a file system mostly means
+ * waiting for it to write back its data, hence this isn't related to the number of CPUs. */
+#define UMOUNT_JOBS_MAX 32U
+
+typedef enum UmountJobState {
+        UMOUNT_JOB_WAITING,     /* Mounts on top of this one are not done yet */
+        UMOUNT_JOB_QUEUED,
+        UMOUNT_JOB_REMOUNTING,
+        UMOUNT_JOB_UNMOUNTING,
+        UMOUNT_JOB_DONE,
+} UmountJobState;
+
+typedef struct UmountJob {
+        MountPoint *mount_point;
+        UmountJobState state;
+        size_t parent;          /* The job of the mount this one is mounted on, or SIZE_MAX */
+        unsigned n_children;    /* How many jobs of mounts on top of this one are not done yet */
         pid_t pid;
-        int r;
+        usec_t until;
+        bool failed;
+} UmountJob;
 
-        BLOCK_SIGNALS(SIGCHLD);
+typedef struct UmountContext {
+        UmountJob *jobs;
+        size_t n_jobs;
+
+        /* Jobs whose children are all done, in the order they shall be started */
+        size_t *queue;
+        size_t n_queued, queue_idx;
+
+        size_t running[UMOUNT_JOBS_MAX];
+        size_t n_running;
+
+        mount_point_fork_t fork;
+        int umount_log_level;
+        int n_failed;
+        bool changed;
+} UmountContext;
+
+static int mount_point_fork(MountPoint *m, bool remount, int umount_log_level, pid_t *ret_pid) {
+        pid_t pid;
+        int r;
 
         assert(m);
+        assert(ret_pid);
 
-        /* Due to the possiblity of a remount operation hanging, we
-         * fork a child process and set a timeout. If the timeout
-         * lapses, the assumption is that that particular remount
+        /* Due to the possiblity of a remount or umount operation hanging, we
+         * fork a child process for it, and the caller sets a timeout. If the
+         * timeout lapses, the assumption is that that particular operation
          * failed. */
-        r = safe_fork("(sd-remount)", FORK_RESET_SIGNALS|FORK_CLOSE_ALL_FDS|FORK_LOG|FORK_REOPEN_LOG, &pid);
+        r = safe_fork(remount ? "(sd-remount)" : "(sd-umount)",
+                      FORK_RESET_SIGNALS|FORK_CLOSE_ALL_FDS|FORK_LOG|FORK_REOPEN_LOG, &pid);
         if (r < 0)
                 return r;
         if (r == 0) {
-                log_info("Remounting '%s' read-only in with options '%s'.", m->path, m->remount_options);
+                if (remount) {
+                        log_info("Remounting '%s' read-only in with options '%s'.", m->path, m->remount_options);
 
-                /* Start the mount operation here in the child */
-                r = mount(NULL, m->path, NULL, m->remount_flags, m->remount_options);
-                if (r < 0)
-                        log_full_errno(umount_log_level, errno, "Failed to remount '%s' read-only: %m", m->path);
+                        /* Start the mount operation here in the child */
+                        r = mount(NULL, m->path, NULL, m->remount_flags, m->remount_options);
+                        if (r < 0)
+                                log_full_errno(umount_log_level, errno, "Failed to remount '%s' read-only: %m", m->path);
+                } else {
+                        log_info("Unmounting '%s'.", m->path);
+
+                        /* Start the mount operation here in the child Using MNT_FORCE
+                         * causes some filesystems (e.g. FUSE and NFS and other network
+                         * filesystems) to abort any pending requests and return -EIO
+                         * rather than blocking indefinitely. If the filesysten is
+                         * "busy", this may allow processes to die, thus making the
+                         * filesystem less busy so the unmount might succeed (rather
+                         * then return EBUSY).*/
+                        r = umount2(m->path, MNT_FORCE);
+                        if (r < 0)
+                                log_full_errno(umount_log_level, errno, "Failed to unmount %s: %m", m->path);
+                }
 
                 _exit(r < 0 ? EXIT_FAILURE : EXIT_SUCCESS);
         }
 
-        r = wait_for_terminate_with_timeout(pid, DEFAULT_TIMEOUT_USEC);
-        if (r == -ETIMEDOUT) {
-                log_error_errno(r, "Remounting '%s' timed out, issuing SIGKILL to PID " PID_FMT ".", m->path, pid);
-                (void) kill(pid, SIGKILL);
-        } else if (r == -EPROTO)
-                log_debug_errno(r, "Remounting '%s' failed abnormally, child process " PID_FMT " aborted or exited non-zero.", m->path, pid);
-        else if (r < 0)
-                log_error_errno(r, "Remounting '%s' failed unexpectedly, couldn't wait for child process " PID_FMT ": %m", m->path, pid);
+        *ret_pid = pid;
+        return 0;
+}
 
-        return r;
+static void umount_job_queue(UmountContext *c, size_t i) {
+        assert(c);
+        assert(i < c->n_jobs);
+
+        if (c->jobs[i].state != UMOUNT_JOB_WAITING)
+                return;
+
+        c->jobs[i].state = UMOUNT_JOB_QUEUED;
+        c->queue[c->n_queued++] = i;
 }
 
-static int umount_with_timeout(MountPoint *m, int umount_log_level) {
-        pid_t pid;
+static void umount_job_done(UmountContext *c, size_t i, bool failed, bool changed) {
+        UmountJob *j;
+
+        assert(c);
+        assert(i < c->n_jobs);
+
+        j = c->jobs + i;
+        j->state = UMOUNT_JOB_DONE;
+        j->failed = failed;
+
+        if (failed)
+                c->n_failed++;
+        if (changed)
+                c->changed = true;
+
+        /* Go on with the mount below even if this one failed. Unmounting it will fail then too, but / and
+         * /usr still need to be remounted read-only. */
+        if (j->parent != SIZE_MAX) {
+                assert(c->jobs[j->parent].n_children > 0);
+
+                if (--c->jobs[j->parent].n_children == 0)
+                        umount_job_queue(c, j->parent);
+        }
+}
+
+static void umount_job_wait(UmountContext *c, size_t i, UmountJobState state) {
+        assert(c);
+        assert(i < c->n_jobs);
+        assert(c->n_running < UMOUNT_JOBS_MAX);
+
+        c->jobs[i].state = state;
+        c->jobs[i].until = usec_add(now(CLOCK_MONOTONIC), DEFAULT_TIMEOUT_USEC);
+        c->running[c->n_running++] = i;
+}
+
+static void umount_job_unmount(UmountContext *c, size_t i, int remount_result) {
+        MountPoint *m;
         int r;
 
-        BLOCK_SIGNALS(SIGCHLD);
+        assert(c);
+        assert(i < c->n_jobs);
 
-        assert(m);
+        m = c->jobs[i].mount_point;
 
-        /* Due to the possiblity of a umount operation hanging, we
-         * fork a child process and set a timeout. If the timeout
-         * lapses, the assumption is that that particular umount
-         * failed. */
-        r = safe_fork("(sd-umount)", FORK_RESET_SIGNALS|FORK_CLOSE_ALL_FDS|FORK_LOG|FORK_REOPEN_LOG, &pid);
-        if (r < 0)
-                return r;
-        if (r == 0) {
-                log_info("Unmounting '%s'.", m->path);
-
-                /* Start the mount operation here in the child Using MNT_FORCE
-                 * causes some filesystems (e.g. FUSE and NFS and other network
-                 * filesystems) to abort any pending requests and return -EIO
-                 * rather than blocking indefinitely. If the filesysten is
-                 * "busy", this may allow processes to die, thus making the
-                 * filesystem less busy so the unmount might succeed (rather
-                 * then return EBUSY).*/
-                r = umount2(m->path, MNT_FORCE);
-                if (r < 0)
-                        log_full_errno(umount_log_level, errno, "Failed to unmount %s: %m", m->path);
+        /* Skip / and /usr since we cannot unmount that anyway, since we are running from it. They have already
+         * been remounted ro. If that failed, count them as failed. */
+        if (nonunmountable_path(m->path)) {
+                umount_job_done(c, i, remount_result < 0, false);
+                return;
+        }
 
-                _exit(r < 0 ? EXIT_FAILURE : EXIT_SUCCESS);
+        /* If the remount failed, try unmounting anyway. */
+        r = c->fork(m, false, c->umount_log_level, &c->jobs[i].pid);
+        if (r < 0) {
+                umount_job_done(c, i, true, false);
+                return;
         }
 
-        r = wait_for_terminate_with_timeout(pid, DEFAULT_TIMEOUT_USEC);
+        umount_job_wait(c, i, UMOUNT_JOB_UNMOUNTING);
+}
+
+static void umount_job_start(UmountContext *c, size_t i) {
+        MountPoint *m;
+        int r = 0;
+
+        assert(c);
+        assert(i < c->n_jobs);
+
+        m = c->jobs[i].mount_point;
+
+        if (m->try_remount_ro) {
+                /* We always try to remount directories
+                 * read-only first, before we go on and umount
+                 * them.
+                 *
+                 * Mount points can be stacked. If a mount
+                 * point is stacked below / or /usr, we
+                 * cannot umount or remount it directly,
+                 * since there is no way to refer to the
+                 * underlying mount. There's nothing we can do
+                 * about it for the general case, but we can
+                 * do something about it if it is aliased
+                 * somehwere else via a bind mount. If we
+                 * explicitly remount the super block of that
+                 * alias read-only we hence should be
+                 * relatively safe regarding keeping a dirty fs
+                 * we cannot otherwise see.
+                 *
+                 * Since the remount can hang in the instance of
+                 * remote filesystems, we remount asynchronously
+                 * and skip the subsequent umount if it fails. */
+                r = c->fork(m, true, c->umount_log_level, &c->jobs[i].pid);
+                if (r >= 0) {
+                        umount_job_wait(c, i, UMOUNT_JOB_REMOUNTING);
+                        return;
+                }
+        }
+
+        umount_job_unmount(c, i, r);
+}
+
+static void umount_job_exited(UmountContext *c, size_t i, int r) {
+        const char *what;
+        UmountJob *j;
+
+        assert(c);
+        assert(i < c->n_jobs);
+
+        j = c->jobs + i;
+        what = j->state == UMOUNT_JOB_REMOUNTING ? "Remounting" : "Unmounting";
+
         if (r == -ETIMEDOUT) {
-                log_error_errno(r, "Unmounting '%s' timed out, issuing SIGKILL to PID " PID_FMT ".", m->path, pid);
-                (void) kill(pid, SIGKILL);
+                log_error_errno(r, "%s '%s' timed out, issuing SIGKILL to PID " PID_FMT ".", what, j->mount_point->path, j->pid);
+                (void) kill(j->pid, SIGKILL);
         } else if (r == -EPROTO)
-                log_debug_errno(r, "Unmounting '%s' failed abnormally, child process " PID_FMT " aborted or exited non-zero.", m->path, pid);
-        else if (r < 0)
-                log_error_errno(r, "Unmounting '%s' failed unexpectedly, couldn't wait for child process " PID_FMT ": %m", m->path, pid);
+                log_debug_errno(r, "%s '%s' failed abnormally, child process " PID_FMT " aborted or exited non-zero.", what, j->mount_point->path, j->pid);
+        else if (r < 0) {
+                log_error_errno(r, "%s '%s' failed unexpectedly, couldn't wait for child process " PID_FMT ": %m", what, j->mount_point->path, j->pid);
+                (void) kill(j->pid, SIGKILL);
+        }
+
+        if (j->state == UMOUNT_JOB_REMOUNTING)
+                umount_job_unmount(c, i, r);
+        else
+                umount_job_done(c, i, r < 0, r >= 0);
+}
+
+static int umount_jobs_wait(UmountContext *c) {
+        siginfo_t status = {};
+        usec_t n, until = USEC_INFINITY;
+        size_t k;
+
+        assert(c);
+        assert(c->n_running > 0);
+
+        /* Waits for any of the running child processes to exit or time out. This assumes SIGCHLD is blocked. */
+
+        if (waitid(P_ALL, 0, &status, WEXITED|WNOHANG) < 0)
+                return -errno;
+        if (status.si_pid > 0) {
+                for (k = 0; k < c->n_running; k++) {
+                        size_t i = c->running[k];
+
+                        if (c->jobs[i].pid != status.si_pid)
+                                continue;
+
+                        c->running[k] = c->running[--c->n_running];
+                        umount_job_exited(c, i, status.si_code == CLD_EXITED && status.si_status == 0 ? 0 : -EPROTO);
+                        break;
+                }
+
+                /* Otherwise this was one we killed before, ignore it. */
+                return 0;
+        }
+
+        for (k = 0; k < c->n_running; k++)
+                until = MIN(until, c->jobs[c->running[k]].until);
+
+        n = now(CLOCK_MONOTONIC);
+        if (until > n) {
+                struct timespec ts;
+                sigset_t mask;
 
-        return r;
+                assert_se(sigemptyset(&mask) == 0);
+                assert_se(sigaddset(&mask, SIGCHLD) == 0);
+
+                if (sigtimedwait(&mask, NULL, timespec_store(&ts, until - n)) >= 0 || errno == EINTR)
+                        return 0;
+                if (errno != EAGAIN)
+                        return -errno;
+
+                n = now(CLOCK_MONOTONIC);
+        }
+
+        /* Timed out, these children are likely hung. */
+        for (k = 0; k < c->n_running; ) {
+                size_t i = c->running[k];
+
+                if (c->jobs[i].until > n) {
+                        k++;
+                        continue;
+                }
+
+                c->running[k] = c->running[--c->n_running];
+                umount_job_exited(c, i, -ETIMEDOUT);
+        }
+
+        return 0;
 }
 
-/* This includes remounting readonly, which changes the kernel mount options.
- * Therefore the list passed to this function is invalidated, and should not be reused. */
-static int mount_points_list_umount(MountPoint **head, bool *changed, int umount_log_level) {
+/* This includes remounting readonly, which changes the kernel mount options. On return the list only contains the
+ * mount points that couldn't be dealt with, and it should only be used to identify them, see
+ * mount_points_list_refresh(). The remount and umount child processes are started through fork_func. */
+int mount_points_list_umount(MountPoint **head, bool *changed, int umount_log_level, mount_point_fork_t fork_func) {
+        _cleanup_hashmap_free_ Hashmap *by_id = NULL;
+        _cleanup_free_ UmountJob *jobs = NULL;
+        _cleanup_free_ size_t *queue = NULL;
+        UmountContext c = {
+                .fork = fork_func,
+                .umount_log_level = umount_log_level,
+        };
         MountPoint *m;
-        int n_failed = 0;
+        size_t n = 0, i, k = 0;
+        int r;
 
         assert(head);
         assert(changed);
+        assert(fork_func);
+
+        BLOCK_SIGNALS(SIGCHLD);
+
+        LIST_FOREACH(mount_point, m, *head)
+                n++;
+        if (n == 0)
+                return 0;
+
+        jobs = new0(UmountJob, n);
+        queue = new(size_t, n);
+        by_id = hashmap_new(NULL);
+        if (!jobs || !queue || !by_id)
+                return log_oom();
+
+        c.jobs = jobs;
+        c.n_jobs = n;
+        c.queue = queue;
 
         LIST_FOREACH(mount_point, m, *head) {
-                if (m->try_remount_ro) {
-                        /* We always try to remount directories
-                         * read-only first, before we go on and umount
-                         * them.
-                         *
-                         * Mount points can be stacked. If a mount
-                         * point is stacked below / or /usr, we
-                         * cannot umount or remount it directly,
-                         * since there is no way to refer to the
-                         * underlying mount. There's nothing we can do
-                         * about it for the general case, but we can
-                         * do something about it if it is aliased
-                         * somehwere else via a bind mount. If we
-                         * explicitly remount the super block of that
-                         * alias read-only we hence should be
-                         * relatively safe regarding keeping a dirty fs
-                         * we cannot otherwise see.
-                         *
-                         * Since the remount can hang in the instance of
-                         * remote filesystems, we remount asynchronously
-                         * and skip the subsequent umount if it fails. */
-                        if (remount_with_timeout(m, umount_log_level) < 0) {
-                                /* Remount failed, but try unmounting anyway,
-                                 * unless this is a mount point we want to skip. */
-                                if (nonunmountable_path(m->path)) {
-                                        n_failed++;
-                                        continue;
-                                }
+                jobs[k] = (UmountJob) {
+                        .mount_point = m,
+                        .parent = SIZE_MAX,
+                };
+
+                r = hashmap_put(by_id, INT_TO_PTR(m->mount_id), jobs + k);
+                if (r < 0 && r != -EEXIST)
+                        return log_oom();
+
+                k++;
+        }
+
+        /* Unmount bottom up along the mount tree: a mount is only processed once all the mounts on top of it,
+         * in particular the ones stacked on the same path, are done. Mounts that don't depend on each other are
+         * processed in parallel. Among the ones that are ready, the list order is kept, i.e. newest first. */
+        for (i = 0; i < n; i++) {
+                UmountJob *p;
+
+                p = hashmap_get(by_id, INT_TO_PTR(jobs[i].mount_point->parent_id));
+                if (!p || p == jobs + i)
+                        continue;
+
+                jobs[i].parent = p - jobs;
+                p->n_children++;
+        }
+
+        for (i = 0; i < n; i++)
+                if (jobs[i].n_children == 0)
+                        umount_job_queue(&c, i);
+
+        for (k = 0;;) {
+                while (c.n_running < UMOUNT_JOBS_MAX && c.queue_idx < c.n_queued)
+                        umount_job_start(&c, c.queue[c.queue_idx++]);
+
+                if (c.n_running > 0) {
+                        r = umount_jobs_wait(&c);
+                        if (r < 0) {
+                                log_error_errno(r, "Failed to wait for child processes: %m");
+
+                                while (c.n_running > 0)
+                                        umount_job_exited(&c, c.running[--c.n_running], r);
                         }
+
+                        continue;
                 }
 
-                /* Skip / and /usr since we cannot unmount that
-                 * anyway, since we are running from it. They have
-                 * already been remounted ro. */
-                if (nonunmountable_path(m->path))
+                if (c.queue_idx < c.n_queued)
                         continue;
 
-                /* Trying to umount */
-                if (umount_with_timeout(m, umount_log_level) < 0)
-                        n_failed++;
-                else
-                        *changed = true;
+                /* Nothing is queued or running anymore. Either we are done, or the parent IDs form a loop, which
+                 * the kernel never reports, but a garbled mount table might. Break it up. */
+                while (k < n && jobs[k].state != UMOUNT_JOB_WAITING)
+                        k++;
+                if (k >= n)
+                        break;
+
+                umount_job_queue(&c, k);
         }
 
-        return n_failed;
+        for (i = 0; i < n; i++)
+                if (!jobs[i].failed)
+                        mount_point_free(head, jobs[i].mount_point);
+
+        if (c.changed)
+                *changed = true;
+
+        return c.n_failed;
 }
 
 static int swap_points_list_off(MountPoint **head, bool *changed) {
@@ -619,38 +876,71 @@ static int dm_points_list_detach(MountPoint **head, bool *changed, int umount_lo
         return n_failed;
 }
 
-static int umount_all_once(bool *changed, int umount_log_level) {
+/* Re-reads the mount table, but only keeps the mount points that are on the passed list */
+int mount_points_list_refresh(const char *mountinfo, MountPoint **head) {
+        _cleanup_(mount_points_list_free) LIST_HEAD(MountPoint, new_head);
+        _cleanup_set_free_ Set *ids = NULL;
+        MountPoint *m, *n;
         int r;
-        _cleanup_(mount_points_list_free) LIST_HEAD(MountPoint, mp_list_head);
 
-        assert(changed);
+        assert(head);
 
-        LIST_HEAD_INIT(mp_list_head);
-        r = mount_points_list_get(NULL, &mp_list_head);
+        ids = set_new(NULL);
+        if (!ids)
+                return log_oom();
+
+        LIST_FOREACH(mount_point, m, *head) {
+                r = set_put(ids, INT_TO_PTR(m->mount_id));
+                if (r < 0)
+                        return log_oom();
+        }
+
+        LIST_HEAD_INIT(new_head);
+        r = mount_points_list_get(mountinfo, &new_head);
         if (r < 0)
                 return r;
 
-        return mount_points_list_umount(&mp_list_head, changed, umount_log_level);
+        LIST_FOREACH_SAFE(mount_point, m, n, new_head)
+                if (!set_contains(ids, INT_TO_PTR(m->mount_id)))
+                        mount_point_free(&new_head, m);
+
+        mount_points_list_free(head);
+        *head = TAKE_PTR(new_head);
+
+        return 0;
 }
 
 int umount_all(bool *changed, int umount_log_level) {
+        _cleanup_(mount_points_list_free) LIST_HEAD(MountPoint, mp_list_head);
         bool umount_changed;
         int r;
 
         assert(changed);
 
-        /* Retry umount, until nothing can be umounted anymore. Mounts are
-         * processed in order, newest first. The retries are needed when
-         * an old mount has been moved, to a path inside a newer mount. */
-        do {
+        LIST_HEAD_INIT(mp_list_head);
+        r = mount_points_list_get(NULL, &mp_list_head);
+        if (r < 0)
+                return r;
+
+        /* Retry the mount points that couldn't be dealt with, until nothing can
+         * be umounted anymore. Mounts are processed bottom up along the mount
+         * tree, so a single pass gets rid of everything it can, but getting rid
+         * of something might make an earlier failure go away. */
+        for (;;) {
                 umount_changed = false;
 
-                r = umount_all_once(&umount_changed, umount_log_level);
+                r = mount_points_list_umount(&mp_list_head, &umount_changed, umount_log_level, mount_point_fork);
+                if (r < 0)
+                        return r;
                 if (umount_changed)
                         *changed = true;
-        } while (umount_changed);
+                if (!umount_changed || !mp_list_head)
+                        return r;
 
-        return r;
+                r = mount_points_list_refresh(NULL, &mp_list_head);
+                if (r < 0)
+                        return r;
+        }
 }
 
 int swapoff_all(bool *changed) {
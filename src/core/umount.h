@@ -22,9 +22,14 @@ typedef struct MountPoint {
         unsigned long remount_flags;
         bool try_remount_ro;
         dev_t devnum;
+        int mount_id, parent_id;
         LIST_FIELDS(struct MountPoint, mount_point);
 } MountPoint;
 
 int mount_points_list_get(const char *mountinfo, MountPoint **head);
 void mount_points_list_free(MountPoint **head);
 int swap_list_get(const char *swaps, MountPoint **head);
+
+typedef int (*mount_point_fork_t)(MountPoint *m, bool remount, int umount_log_level, pid_t *ret_pid);
+int mount_points_list_umount(MountPoint **head, bool *changed, int umount_log_level, mount_point_fork_t fork_func);
+int mount_points_list_refresh(const char *mountinfo, MountPoint **head);
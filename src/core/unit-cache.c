@@ -0,0 +1,715 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "alloc-util.h"
+#include "dirent-util.h"
+#include "fd-util.h"
+#include "fileio.h"
+#include "fs-util.h"
+#include "log.h"
+#include "mkdir.h"
+#include "path-util.h"
+#include "sparse-endian.h"
+#include "string-util.h"
+#include "strv.h"
+#include "time-util.h"
+#include "tmpfile-util.h"
+#include "unit-cache.h"
+#include "unit-name.h"
+
+/* The file starts with the header. All offsets are relative to the beginning of the file, and 8 byte aligned.
+ * Offset 0 denotes a missing string. Strings are NUL terminated. */
+
+#define UNIT_CACHE_SIGNATURE ((const char[]) { 'S', 'D', 'U', 'N', 'I', 'T', 'D', 'B' })
+#define UNIT_CACHE_VERSION 1
+
+/* Same as in load-fragment.c */
+#define FOLLOW_MAX 8
+
+struct UnitCacheHeader {
+        uint8_t signature[8];
+        le64_t version;
+        le64_t file_size;
+
+        /* Offsets of the strings of the search path the cache was built for, in order */
+        le64_t n_dirs;
+        le64_t dirs_offset;
+
+        /* Sorted by name */
+        le64_t n_entries;
+        le64_t entries_offset;
+};
+
+/* A file system object, as returned by lstat() */
+struct UnitCacheLink {
+        le64_t path_offset;
+        le64_t mode;
+        le64_t ino;
+        le64_t size;
+        le64_t mtime;   /* nsec */
+};
+
+struct UnitCacheEntry {
+        le64_t name_offset;
+
+        /* The index of the search path directory the fragment was found in */
+        le64_t dir_index;
+
+        /* The symlinks followed from there, the last one being the fragment itself */
+        le64_t n_links;
+        le64_t links_offset;
+
+        /* The symlink names, as a nulstr, and the one chosen as id */
+        le64_t names_offset;
+        le64_t names_size;
+        le64_t id_offset;
+
+        le64_t data_offset;
+        le64_t data_size;
+};
+
+struct UnitCache {
+        void *map;
+        size_t size;
+
+        const struct UnitCacheHeader *header;
+        const struct UnitCacheEntry *entries;
+        size_t n_entries;
+};
+
+static const void* cache_get(UnitCache *c, uint64_t offset, uint64_t size) {
+        assert(c);
+
+        if (offset > c->size || size > c->size - offset)
+                return NULL;
+
+        return (const uint8_t*) c->map + offset;
+}
+
+static const char* cache_string(UnitCache *c, le64_t offset) {
+        uint64_t o = le64toh(offset);
+
+        assert(c);
+
+        if (o == 0 || o >= c->size)
+                return NULL;
+
+        if (!memchr((const uint8_t*) c->map + o, 0, c->size - o))
+                return NULL;
+
+        return (const char*) c->map + o;
+}
+
+int unit_cache_open(const char *path, char **search_path, UnitCache **ret) {
+        _cleanup_(unit_cache_freep) UnitCache *c = NULL;
+        _cleanup_close_ int fd = -1;
+        const le64_t *dirs;
+        uint64_t n_dirs, n_entries, i;
+        struct stat st;
+        void *p;
+
+        assert(path);
+        assert(ret);
+
+        /* Opens the unit cache. If a search path is specified, fails with -ESTALE if the cache was built for a
+         * different one. */
+
+        fd = open(path, O_RDONLY|O_CLOEXEC|O_NOCTTY);
+        if (fd < 0)
+                return -errno;
+
+        if (fstat(fd, &st) < 0)
+                return -errno;
+
+        if (!S_ISREG(st.st_mode))
+                return -EBADMSG;
+
+        if ((uint64_t) st.st_size < sizeof(struct UnitCacheHeader) || (uint64_t) st.st_size > SIZE_MAX)
+                return -EBADMSG;
+
+        c = new0(UnitCache, 1);
+        if (!c)
+                return -ENOMEM;
+
+        p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (p == MAP_FAILED)
+                return -errno;
+
+        c->map = p;
+        c->size = st.st_size;
+        c->header = c->map;
+
+        if (memcmp(c->header->signature, UNIT_CACHE_SIGNATURE, sizeof(c->header->signature)) != 0)
+                return -EBADMSG;
+
+        if (le64toh(c->header->version) != UNIT_CACHE_VERSION)
+                return -EPROTONOSUPPORT;
+
+        if (le64toh(c->header->file_size) != c->size)
+                return -EBADMSG;
+
+        n_dirs = le64toh(c->header->n_dirs);
+        if (n_dirs > c->size / sizeof(le64_t))
+                return -EBADMSG;
+
+        dirs = cache_get(c, le64toh(c->header->dirs_offset), n_dirs * sizeof(le64_t));
+        if (!dirs)
+                return -EBADMSG;
+
+        for (i = 0; i < n_dirs; i++)
+                if (!cache_string(c, dirs[i]))
+                        return -EBADMSG;
+
+        if (search_path) {
+                if (strv_length(search_path) != n_dirs)
+                        return -ESTALE;
+
+                for (i = 0; i < n_dirs; i++)
+                        if (!streq(search_path[i], cache_string(c, dirs[i])))
+                                return -ESTALE;
+        }
+
+        n_entries = le64toh(c->header->n_entries);
+        if (n_entries > c->size / sizeof(struct UnitCacheEntry))
+                return -EBADMSG;
+
+        c->entries = cache_get(c, le64toh(c->header->entries_offset), n_entries * sizeof(struct UnitCacheEntry));
+        if (!c->entries)
+                return -EBADMSG;
+
+        c->n_entries = n_entries;
+
+        *ret = TAKE_PTR(c);
+        return 0;
+}
+
+UnitCache* unit_cache_free(UnitCache *c) {
+        if (!c)
+                return NULL;
+
+        if (c->map)
+                (void) munmap(c->map, c->size);
+
+        return mfree(c);
+}
+
+static const struct UnitCacheEntry* cache_find(UnitCache *c, const char *name) {
+        size_t left, right;
+
+        assert(c);
+        assert(name);
+
+        left = 0;
+        right = c->n_entries;
+
+        while (left < right) {
+                size_t middle = left + (right - left) / 2;
+                const char *k;
+                int d;
+
+                k = cache_string(c, c->entries[middle].name_offset);
+                if (!k)
+                        return NULL;
+
+                d = strcmp(name, k);
+                if (d == 0)
+                        return c->entries + middle;
+                if (d < 0)
+                        right = middle;
+                else
+                        left = middle + 1;
+        }
+
+        return NULL;
+}
+
+bool unit_cache_contains(UnitCache *c, const char *name) {
+        assert(name);
+
+        return c && cache_find(c, name);
+}
+
+static bool link_is_current(const struct UnitCacheLink *l, const struct stat *st) {
+        assert(l);
+        assert(st);
+
+        return le64toh(l->mode) == st->st_mode &&
+                le64toh(l->ino) == st->st_ino &&
+                le64toh(l->size) == (uint64_t) st->st_size &&
+                le64toh(l->mtime) == timespec_load_nsec(&st->st_mtim);
+}
+
+int unit_cache_lookup(UnitCache *c, const char *name, char **search_path, Set *path_cache, UnitFragment **ret) {
+        _cleanup_(unit_fragment_freep) UnitFragment *fragment = NULL;
+        const struct UnitCacheEntry *e;
+        const struct UnitCacheLink *links;
+        const char *names, *filename = NULL, *id, *n;
+        uint64_t dir_index, n_links, names_size, i;
+        const void *data;
+        struct stat st;
+        int r;
+
+        assert(name);
+        assert(ret);
+
+        /* Returns the fragment of the specified unit name, if the cache knows it, and it is current. We need the
+         * listing of the search path directories for that, in order to detect files that would take precedence
+         * now. Returns 0 if the caller has to look for the fragment itself. */
+
+        if (!c || !path_cache)
+                return 0;
+
+        e = cache_find(c, name);
+        if (!e)
+                return 0;
+
+        dir_index = le64toh(e->dir_index);
+        if (dir_index >= strv_length(search_path))
+                return 0;
+
+        for (i = 0; i < dir_index; i++) {
+                _cleanup_free_ char *p = NULL;
+
+                p = path_make_absolute(name, search_path[i]);
+                if (!p)
+                        return -ENOMEM;
+
+                if (set_contains(path_cache, p)) {
+                        log_debug("Unit cache entry of %s is shadowed by %s, ignoring.", name, p);
+                        return 0;
+                }
+        }
+
+        n_links = le64toh(e->n_links);
+        if (n_links == 0 || n_links > FOLLOW_MAX + 1)
+                return 0;
+
+        links = cache_get(c, le64toh(e->links_offset), n_links * sizeof(struct UnitCacheLink));
+        if (!links)
+                return 0;
+
+        for (i = 0; i < n_links; i++) {
+                filename = cache_string(c, links[i].path_offset);
+                if (!filename)
+                        return 0;
+
+                if (lstat(filename, &st) < 0 || !link_is_current(links + i, &st)) {
+                        log_debug("Unit cache entry of %s is out of date, ignoring.", name);
+                        return 0;
+                }
+        }
+
+        names_size = le64toh(e->names_size);
+        names = cache_get(c, le64toh(e->names_offset), names_size);
+        if (!names || (names_size > 0 && names[names_size - 1] != 0))
+                return 0;
+
+        data = cache_get(c, le64toh(e->data_offset), le64toh(e->data_size));
+        if (!data)
+                return 0;
+
+        fragment = new0(UnitFragment, 1);
+        if (!fragment)
+                return -ENOMEM;
+
+        fragment->filename = strdup(filename);
+        if (!fragment->filename)
+                return -ENOMEM;
+
+        fragment->names = set_new(&string_hash_ops);
+        if (!fragment->names)
+                return -ENOMEM;
+
+        for (n = names; n < names + names_size; n += strlen(n) + 1) {
+                r = set_put_strdup(fragment->names, n);
+                if (r < 0)
+                        return r;
+        }
+
+        id = cache_string(c, e->id_offset);
+        if (id) {
+                fragment->id = set_get(fragment->names, (char*) id);
+                if (!fragment->id)
+                        return 0;
+        }
+
+        /* The last link is the fragment itself, hence this is what fstat() would return on it */
+        fragment->st = st;
+
+        fragment->size = le64toh(e->data_size);
+        if (fragment->size > 0) {
+                fragment->data = memdup(data, fragment->size);
+                if (!fragment->data)
+                        return -ENOMEM;
+        }
+
+        *ret = TAKE_PTR(fragment);
+        return 1;
+}
+
+typedef struct Writer {
+        uint8_t *data;
+        size_t size;
+        size_t allocated;
+} Writer;
+
+static int writer_add(Writer *w, const void *p, size_t n, le64_t *ret_offset) {
+        size_t offset;
+
+        assert(w);
+        assert(p || n == 0);
+
+        offset = ALIGN8(w->size);
+
+        if (!GREEDY_REALLOC(w->data, w->allocated, offset + n))
+                return -ENOMEM;
+
+        memzero(w->data + w->size, offset - w->size);
+        memcpy_safe(w->data + offset, p, n);
+        w->size = offset + n;
+
+        if (ret_offset)
+                *ret_offset = htole64(offset);
+
+        return 0;
+}
+
+static int writer_add_string(Writer *w, const char *s, le64_t *ret_offset) {
+        assert(s);
+
+        return writer_add(w, s, strlen(s) + 1, ret_offset);
+}
+
+static int follow_links(
+                char **search_path,
+                const char *name,
+                Writer *w,
+                uint64_t *ret_dir_index,
+                struct UnitCacheLink *links,
+                size_t *ret_n_links,
+                char **ret_filename) {
+
+        _cleanup_free_ char *p = NULL;
+        size_t n = 0;
+        char **d;
+        struct stat st;
+        int r;
+
+        /* Reproduces the way find_fragment() and open_follow() resolve the name, and records what they saw on the
+         * way */
+
+        STRV_FOREACH(d, search_path) {
+                p = path_make_absolute(name, *d);
+                if (!p)
+                        return -ENOMEM;
+
+                path_simplify(p, false);
+
+                if (lstat(p, &st) >= 0)
+                        break;
+
+                if (!IN_SET(errno, ENOENT, ENOTDIR))
+                        return -errno;
+
+                p = mfree(p);
+        }
+
+        if (!p)
+                return 0;
+
+        *ret_dir_index = d - search_path;
+
+        for (;;) {
+                char *target;
+
+                if (n > FOLLOW_MAX)
+                        return 0;
+
+                links[n] = (struct UnitCacheLink) {
+                        .mode = htole64(st.st_mode),
+                        .ino = htole64(st.st_ino),
+                        .size = htole64(st.st_size),
+                        .mtime = htole64(timespec_load_nsec(&st.st_mtim)),
+                };
+
+                r = writer_add_string(w, p, &links[n].path_offset);
+                if (r < 0)
+                        return r;
+
+                n++;
+
+                if (!S_ISLNK(st.st_mode))
+                        break;
+
+                r = readlink_and_make_absolute(p, &target);
+                if (r < 0)
+                        return r;
+
+                free_and_replace(p, target);
+                path_simplify(p, false);
+
+                if (lstat(p, &st) < 0) {
+                        if (IN_SET(errno, ENOENT, ENOTDIR))
+                                return 0;
+
+                        return -errno;
+                }
+        }
+
+        *ret_n_links = n;
+        *ret_filename = TAKE_PTR(p);
+        return 1;
+}
+
+static int writer_add_unit(Writer *w, char **search_path, const char *name, struct UnitCacheEntry *ret) {
+        _cleanup_(unit_fragment_freep) UnitFragment *fragment = NULL;
+        _cleanup_free_ char *filename = NULL, *names = NULL;
+        struct UnitCacheLink links[FOLLOW_MAX + 1];
+        struct UnitCacheEntry e = {};
+        size_t n_links, names_size = 0, names_allocated = 0;
+        uint64_t dir_index;
+        Iterator i;
+        char *n;
+        int r;
+
+        assert(w);
+        assert(name);
+        assert(ret);
+
+        r = unit_fragment_read(search_path, NULL, name, &fragment);
+        if (r < 0)
+                return r;
+        if (fragment->error < 0)
+                return log_debug_errno(fragment->error, "Failed to read fragment of %s, not caching it: %m", name);
+        if (!fragment->filename)
+                return 0;
+
+        r = follow_links(search_path, name, w, &dir_index, links, &n_links, &filename);
+        if (r < 0)
+                return log_debug_errno(r, "Failed to follow symlinks of %s, not caching it: %m", name);
+        if (r == 0 || !streq(filename, fragment->filename)) {
+                log_debug("Failed to resolve %s like the service manager does, not caching it.", name);
+                return 0;
+        }
+
+        r = writer_add_string(w, name, &e.name_offset);
+        if (r < 0)
+                return r;
+
+        e.dir_index = htole64(dir_index);
+        e.n_links = htole64(n_links);
+
+        r = writer_add(w, links, n_links * sizeof(struct UnitCacheLink), &e.links_offset);
+        if (r < 0)
+                return r;
+
+        SET_FOREACH(n, fragment->names, i) {
+                size_t l = strlen(n) + 1;
+
+                if (!GREEDY_REALLOC(names, names_allocated, names_size + l))
+                        return -ENOMEM;
+
+                memcpy(names + names_size, n, l);
+                names_size += l;
+        }
+
+        e.names_size = htole64(names_size);
+        r = writer_add(w, names, names_size, &e.names_offset);
+        if (r < 0)
+                return r;
+
+        if (fragment->id) {
+                r = writer_add_string(w, fragment->id, &e.id_offset);
+                if (r < 0)
+                        return r;
+        }
+
+        e.data_size = htole64(fragment->size);
+        r = writer_add(w, fragment->data, fragment->size, &e.data_offset);
+        if (r < 0)
+                return r;
+
+        *ret = e;
+        return 1;
+}
+
+int unit_cache_write(const char *path, char **search_path) {
+        _cleanup_(set_free_freep) Set *found = NULL;
+        _cleanup_free_ struct UnitCacheEntry *entries = NULL;
+        _cleanup_free_ le64_t *dirs = NULL;
+        _cleanup_free_ char **names = NULL;
+        _cleanup_free_ char *temp = NULL;
+        _cleanup_fclose_ FILE *f = NULL;
+        struct UnitCacheHeader header = {};
+        size_t n_entries = 0, n_dirs, i;
+        Writer w = {};
+        char **d;
+        int r;
+
+        assert(path);
+
+        /* Reserve space for the header, which also makes sure no string ends up at offset 0 */
+        r = writer_add(&w, &header, sizeof(header), NULL);
+        if (r < 0)
+                goto finish;
+
+        found = set_new(&string_hash_ops);
+        if (!found) {
+                r = -ENOMEM;
+                goto finish;
+        }
+
+        n_dirs = strv_length(search_path);
+        dirs = new(le64_t, n_dirs);
+        if (!dirs) {
+                r = -ENOMEM;
+                goto finish;
+        }
+
+        for (i = 0; i < n_dirs; i++) {
+                _cleanup_closedir_ DIR *dir = NULL;
+                struct dirent *de;
+
+                d = search_path + i;
+
+                r = writer_add_string(&w, *d, dirs + i);
+                if (r < 0)
+                        goto finish;
+
+                dir = opendir(*d);
+                if (!dir) {
+                        if (errno == ENOENT)
+                                continue;
+
+                        r = log_error_errno(errno, "Failed to open directory %s: %m", *d);
+                        goto finish;
+                }
+
+                FOREACH_DIRENT(de, dir, r = -errno; goto finish) {
+                        if (!unit_name_is_valid(de->d_name, UNIT_NAME_ANY))
+                                continue;
+
+                        r = set_put_strdup(found, de->d_name);
+                        if (r < 0)
+                                goto finish;
+                }
+        }
+
+        r = writer_add(&w, dirs, n_dirs * sizeof(le64_t), &header.dirs_offset);
+        if (r < 0)
+                goto finish;
+
+        names = set_get_strv(found);
+        if (!names) {
+                r = -ENOMEM;
+                goto finish;
+        }
+
+        strv_sort(names);
+
+        entries = new(struct UnitCacheEntry, strv_length(names));
+        if (!entries) {
+                r = -ENOMEM;
+                goto finish;
+        }
+
+        STRV_FOREACH(d, names) {
+                r = writer_add_unit(&w, search_path, *d, entries + n_entries);
+                if (r < 0)
+                        goto finish;
+                if (r > 0)
+                        n_entries++;
+        }
+
+        r = writer_add(&w, entries, n_entries * sizeof(struct UnitCacheEntry), &header.entries_offset);
+        if (r < 0)
+                goto finish;
+
+        memcpy(header.signature, UNIT_CACHE_SIGNATURE, sizeof(header.signature));
+        header.version = htole64(UNIT_CACHE_VERSION);
+        header.file_size = htole64(w.size);
+        header.n_dirs = htole64(n_dirs);
+        header.n_entries = htole64(n_entries);
+        memcpy(w.data, &header, sizeof(header));
+
+        (void) mkdir_parents(path, 0755);
+
+        r = fopen_temporary(path, &f, &temp);
+        if (r < 0)
+                goto finish;
+
+        (void) fchmod(fileno(f), 0644);
+
+        fwrite(w.data, 1, w.size, f);
+
+        r = fflush_and_check(f);
+        if (r < 0)
+                goto finish;
+
+        if (rename(temp, path) < 0) {
+                r = -errno;
+                goto finish;
+        }
+
+        temp = mfree(temp);
+        log_debug("Wrote %zu unit cache entries to %s.", n_entries, path);
+        r = 0;
+
+finish:
+        if (temp)
+                (void) unlink(temp);
+
+        free(w.data);
+        return r;
+}
+
+int unit_cache_dump(UnitCache *c, FILE *f) {
+        const le64_t *dirs;
+        uint64_t i;
+
+        assert(c);
+        assert(f);
+
+        dirs = cache_get(c, le64toh(c->header->dirs_offset), le64toh(c->header->n_dirs) * sizeof(le64_t));
+        assert(dirs);
+
+        fputs("Search path:\n", f);
+        for (i = 0; i < le64toh(c->header->n_dirs); i++)
+                fprintf(f, "\t%s\n", cache_string(c, dirs[i]));
+
+        fprintf(f, "Entries: %zu\n", c->n_entries);
+
+        for (i = 0; i < c->n_entries; i++) {
+                const struct UnitCacheEntry *e = c->entries + i;
+                const struct UnitCacheLink *links;
+                const char *name, *filename = NULL;
+                uint64_t n_links;
+
+                name = cache_string(c, e->name_offset);
+                n_links = le64toh(e->n_links);
+
+                links = cache_get(c, le64toh(e->links_offset), n_links * sizeof(struct UnitCacheLink));
+                if (links && n_links > 0)
+                        filename = cache_string(c, links[n_links - 1].path_offset);
+
+                fprintf(f, "\t%s → %s (%" PRIu64 " bytes, %" PRIu64 " symlinks)\n",
+                        strna(name), strna(filename), le64toh(e->data_size), n_links > 0 ? n_links - 1 : 0);
+        }
+
+        return fflush_and_check(f);
+}
+
+const char* unit_cache_path(void) {
+        const char *e;
+
+        e = secure_getenv("SYSTEMD_UNIT_CACHE");
+        if (e && path_is_absolute(e))
+                return e;
+
+        return UNIT_CACHE_PATH;
+}
@@ -0,0 +1,30 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+#pragma once
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "load-fragment.h"
+#include "macro.h"
+#include "set.h"
+
+/* A precompiled database of the unit file fragments found in the unit search path, similar to what hwdb.bin is for
+ * udev: for each unit name, it stores the resolved fragment path, the symlink names found on the way, and the
+ * fragment contents, so that PID 1 doesn't have to look for and read every unit file separately on startup and
+ * daemon-reload. Every entry is validated with a few lstat() calls before it is used. */
+
+#define UNIT_CACHE_PATH "/etc/systemd/units.bin"
+
+typedef struct UnitCache UnitCache;
+
+int unit_cache_open(const char *path, char **search_path, UnitCache **ret);
+UnitCache* unit_cache_free(UnitCache *c);
+DEFINE_TRIVIAL_CLEANUP_FUNC(UnitCache*, unit_cache_free);
+
+bool unit_cache_contains(UnitCache *c, const char *name);
+int unit_cache_lookup(UnitCache *c, const char *name, char **search_path, Set *path_cache, UnitFragment **ret);
+
+int unit_cache_write(const char *path, char **search_path);
+int unit_cache_dump(UnitCache *c, FILE *f);
+
+const char* unit_cache_path(void);
@@ -12,6 +12,7 @@
 
 #include "all-units.h"
 #include "alloc-util.h"
+#include "bpf-firewall.h"
 #include "bus-common-errors.h"
 #include "bus-util.h"
 #include "cgroup-util.h"
@@ -52,6 +53,7 @@
 #include "umask-util.h"
 #include "unit-name.h"
 #include "unit.h"
+#include "usdt.h"
 #include "user-util.h"
 #include "virt.h"
 
@@ -102,10 +104,8 @@ Unit *unit_new(Manager *m, size_t size) {
 
         u->ip_accounting_ingress_map_fd = -1;
         u->ip_accounting_egress_map_fd = -1;
-        u->ipv4_allow_map_fd = -1;
-        u->ipv6_allow_map_fd = -1;
-        u->ipv4_deny_map_fd = -1;
-        u->ipv6_deny_map_fd = -1;
+
+        u->mount_ns_storage_socket[0] = u->mount_ns_storage_socket[1] = -1;
 
         u->last_section_private = -1;
 
@@ -420,8 +420,19 @@ void unit_add_to_gc_queue(Unit *u) {
         if (!unit_may_gc(u))
                 return;
 
+        if (!u->manager->gc_unit_queue)
+                u->manager->gc_unit_queue_timestamp = now(CLOCK_MONOTONIC);
+
         LIST_PREPEND(gc_queue, u->manager->gc_unit_queue, u);
         u->in_gc_queue = true;
+
+        if (u->manager->gc_unit_event_source) {
+                int r;
+
+                r = sd_event_source_set_enabled(u->manager->gc_unit_event_source, SD_EVENT_ONESHOT);
+                if (r < 0)
+                        log_warning_errno(r, "Failed to enable GC queue event source, ignoring: %m");
+        }
 }
 
 void unit_add_to_dbus_queue(Unit *u) {
@@ -433,6 +444,7 @@ void unit_add_to_dbus_queue(Unit *u) {
 
         /* Shortcut things if nobody cares */
         if (sd_bus_track_count(u->manager->subscribed) <= 0 &&
+            sd_bus_track_count(u->manager->subscribed_settled) <= 0 &&
             sd_bus_track_count(u->bus_track) <= 0 &&
             set_isempty(u->manager->private_buses)) {
                 u->sent_dbus_new_signal = true;
@@ -443,6 +455,39 @@ void unit_add_to_dbus_queue(Unit *u) {
         u->in_dbus_queue = true;
 }
 
+int unit_set_fragment_path(Unit *u, const char *path) {
+        const char *p = NULL;
+        int r;
+
+        assert(u);
+
+        /* All instances of a template share the template's fragment path, hence store it only once */
+        if (path) {
+                r = string_pool_intern(&u->manager->string_pool, path, &p);
+                if (r < 0)
+                        return r;
+        }
+
+        string_pool_unref(u->manager->string_pool, u->fragment_path);
+        u->fragment_path = p;
+
+        return 0;
+}
+
+void unit_remove_from_dbus_queue(Unit *u) {
+        assert(u);
+
+        if (!u->in_dbus_queue)
+                return;
+
+        if (u->in_dbus_deferred_queue)
+                LIST_REMOVE(dbus_queue, u->manager->dbus_unit_deferred_queue, u);
+        else
+                LIST_REMOVE(dbus_queue, u->manager->dbus_unit_queue, u);
+
+        u->in_dbus_queue = u->in_dbus_deferred_queue = false;
+}
+
 void unit_submit_to_stop_when_unneeded_queue(Unit *u) {
         assert(u);
 
@@ -459,7 +504,7 @@ void unit_submit_to_stop_when_unneeded_queue(Unit *u) {
         u->in_stop_when_unneeded_queue = true;
 }
 
-static void bidi_set_free(Unit *u, Hashmap *h) {
+static void bidi_set_free(Unit *u, DependencySet *h) {
         Unit *other;
         Iterator i;
         void *v;
@@ -468,16 +513,16 @@ static void bidi_set_free(Unit *u, Hashmap *h) {
 
         /* Frees the hashmap and makes sure we are dropped from the inverse pointers */
 
-        HASHMAP_FOREACH_KEY(v, other, h, i) {
+        DEPENDENCY_SET_FOREACH(v, other, h, i) {
                 UnitDependency d;
 
                 for (d = 0; d < _UNIT_DEPENDENCY_MAX; d++)
-                        hashmap_remove(other->dependencies[d], u);
+                        dependency_set_remove(other->dependencies[d], u);
 
                 unit_add_to_gc_queue(other);
         }
 
-        hashmap_free(h);
+        dependency_set_free(h);
 }
 
 static void unit_remove_transient(Unit *u) {
@@ -645,8 +690,7 @@ void unit_free(Unit *u) {
         if (u->in_load_queue)
                 LIST_REMOVE(load_queue, u->manager->load_queue, u);
 
-        if (u->in_dbus_queue)
-                LIST_REMOVE(dbus_queue, u->manager->dbus_unit_queue, u);
+        unit_remove_from_dbus_queue(u);
 
         if (u->in_gc_queue)
                 LIST_REMOVE(gc_queue, u->manager->gc_unit_queue, u);
@@ -666,13 +710,13 @@ void unit_free(Unit *u) {
         if (u->in_stop_when_unneeded_queue)
                 LIST_REMOVE(stop_when_unneeded_queue, u->manager->stop_when_unneeded_queue, u);
 
+        unit_flush_mount_ns(u);
+
         safe_close(u->ip_accounting_ingress_map_fd);
         safe_close(u->ip_accounting_egress_map_fd);
 
-        safe_close(u->ipv4_allow_map_fd);
-        safe_close(u->ipv6_allow_map_fd);
-        safe_close(u->ipv4_deny_map_fd);
-        safe_close(u->ipv6_deny_map_fd);
+        bpf_access_maps_unref(u->ip_allow_maps);
+        bpf_access_maps_unref(u->ip_deny_maps);
 
         bpf_program_unref(u->ip_bpf_ingress);
         bpf_program_unref(u->ip_bpf_ingress_installed);
@@ -681,12 +725,14 @@ void unit_free(Unit *u) {
 
         bpf_program_unref(u->bpf_device_control_installed);
 
+        unit_reset_latency(u);
+
         condition_free_list(u->conditions);
         condition_free_list(u->asserts);
 
         free(u->description);
         strv_free(u->documentation);
-        free(u->fragment_path);
+        u->fragment_path = string_pool_unref(u->manager->string_pool, u->fragment_path);
         free(u->source_path);
         strv_free(u->dropin_paths);
         free(u->instance);
@@ -734,21 +780,6 @@ static int set_complete_move(Set **s, Set **other) {
         return 0;
 }
 
-static int hashmap_complete_move(Hashmap **s, Hashmap **other) {
-        assert(s);
-        assert(other);
-
-        if (!*other)
-                return 0;
-
-        if (*s)
-                return hashmap_move(*s, *other);
-        else
-                *s = TAKE_PTR(*other);
-
-        return 0;
-}
-
 static int merge_names(Unit *u, Unit *other) {
         char *t;
         Iterator i;
@@ -787,9 +818,9 @@ static int reserve_dependencies(Unit *u, Unit *other, UnitDependency d) {
                 return 0;
 
         /* merge_dependencies() will skip a u-on-u dependency */
-        n_reserve = hashmap_size(other->dependencies[d]) - !!hashmap_get(other->dependencies[d], u);
+        n_reserve = dependency_set_size(other->dependencies[d]) - !!dependency_set_get(other->dependencies[d], u);
 
-        return hashmap_reserve(u->dependencies[d], n_reserve);
+        return dependency_set_reserve(u->dependencies + d, n_reserve);
 }
 
 static void merge_dependencies(Unit *u, Unit *other, const char *other_id, UnitDependency d) {
@@ -805,7 +836,7 @@ static void merge_dependencies(Unit *u, Unit *other, const char *other_id, UnitD
         assert(d < _UNIT_DEPENDENCY_MAX);
 
         /* Fix backwards pointers. Let's iterate through all dependendent units of the other unit. */
-        HASHMAP_FOREACH_KEY(v, back, other->dependencies[d], i) {
+        DEPENDENCY_SET_FOREACH(v, back, other->dependencies[d], i) {
                 UnitDependency k;
 
                 /* Let's now iterate through the dependencies of that dependencies of the other units, looking for
@@ -814,7 +845,7 @@ static void merge_dependencies(Unit *u, Unit *other, const char *other_id, UnitD
                 for (k = 0; k < _UNIT_DEPENDENCY_MAX; k++) {
                         if (back == u) {
                                 /* Do not add dependencies between u and itself. */
-                                if (hashmap_remove(back->dependencies[k], other))
+                                if (dependency_set_remove(back->dependencies[k], other))
                                         maybe_warn_about_dependency(u, other_id, k);
                         } else {
                                 UnitDependencyInfo di_u, di_other, di_merged;
@@ -823,37 +854,37 @@ static void merge_dependencies(Unit *u, Unit *other, const char *other_id, UnitD
                                  * "back" and "u" instead. Let's merge the bit masks of the dependency we are moving,
                                  * and any such dependency which might already exist */
 
-                                di_other.data = hashmap_get(back->dependencies[k], other);
+                                di_other.data = dependency_set_get(back->dependencies[k], other);
                                 if (!di_other.data)
                                         continue; /* dependency isn't set, let's try the next one */
 
-                                di_u.data = hashmap_get(back->dependencies[k], u);
+                                di_u.data = dependency_set_get(back->dependencies[k], u);
 
                                 di_merged = (UnitDependencyInfo) {
                                         .origin_mask = di_u.origin_mask | di_other.origin_mask,
                                         .destination_mask = di_u.destination_mask | di_other.destination_mask,
                                 };
 
-                                r = hashmap_remove_and_replace(back->dependencies[k], other, u, di_merged.data);
+                                r = dependency_set_remove_and_replace(back->dependencies[k], other, u, di_merged.data);
                                 if (r < 0)
                                         log_warning_errno(r, "Failed to remove/replace: back=%s other=%s u=%s: %m", back->id, other_id, u->id);
                                 assert(r >= 0);
 
-                                /* assert_se(hashmap_remove_and_replace(back->dependencies[k], other, u, di_merged.data) >= 0); */
+                                /* assert_se(dependency_set_remove_and_replace(back->dependencies[k], other, u, di_merged.data) >= 0); */
                         }
                 }
 
         }
 
         /* Also do not move dependencies on u to itself */
-        back = hashmap_remove(other->dependencies[d], u);
+        back = dependency_set_remove(other->dependencies[d], u);
         if (back)
                 maybe_warn_about_dependency(u, other_id, d);
 
         /* The move cannot fail. The caller must have performed a reservation. */
-        assert_se(hashmap_complete_move(&u->dependencies[d], &other->dependencies[d]) == 0);
+        assert_se(dependency_set_complete_move(&u->dependencies[d], &other->dependencies[d]) == 0);
 
-        other->dependencies[d] = hashmap_free(other->dependencies[d]);
+        other->dependencies[d] = dependency_set_free(other->dependencies[d]);
 }
 
 int unit_merge(Unit *u, Unit *other) {
@@ -1100,6 +1131,18 @@ static void print_unit_dependency_mask(FILE *f, const char *kind, UnitDependency
         assert(mask == 0);
 }
 
+size_t unit_dependencies_memory_usage(Unit *u) {
+        UnitDependency d;
+        size_t sum = 0;
+
+        assert(u);
+
+        for (d = 0; d < _UNIT_DEPENDENCY_MAX; d++)
+                sum += dependency_set_memory_usage(u->dependencies[d]);
+
+        return sum;
+}
+
 void unit_dump(Unit *u, FILE *f, const char *prefix) {
         char *t, **j;
         UnitDependency d;
@@ -1111,7 +1154,8 @@ void unit_dump(Unit *u, FILE *f, const char *prefix) {
                 timestamp2[FORMAT_TIMESTAMP_MAX],
                 timestamp3[FORMAT_TIMESTAMP_MAX],
                 timestamp4[FORMAT_TIMESTAMP_MAX],
-                timespan[FORMAT_TIMESPAN_MAX];
+                timespan[FORMAT_TIMESPAN_MAX],
+                bytes[FORMAT_BYTES_MAX];
         Unit *following;
         _cleanup_set_free_ Set *following_set = NULL;
         const char *n;
@@ -1244,6 +1288,9 @@ void unit_dump(Unit *u, FILE *f, const char *prefix) {
         if (u->job_timeout_reboot_arg)
                 fprintf(f, "%s\tJob Timeout Reboot Argument: %s\n", prefix, u->job_timeout_reboot_arg);
 
+        if (u->start_priority_set)
+                fprintf(f, "%s\tStart Priority: %i\n", prefix, u->start_priority);
+
         condition_dump_list(u->conditions, f, prefix, condition_type_to_string);
         condition_dump_list(u->asserts, f, prefix, assert_type_to_string);
 
@@ -1265,7 +1312,7 @@ void unit_dump(Unit *u, FILE *f, const char *prefix) {
                 UnitDependencyInfo di;
                 Unit *other;
 
-                HASHMAP_FOREACH_KEY(di.data, other, u->dependencies[d], i) {
+                DEPENDENCY_SET_FOREACH(di.data, other, u->dependencies[d], i) {
                         bool space = false;
 
                         fprintf(f, "%s\t%s: %s (", prefix, unit_dependency_to_string(d), other->id);
@@ -1277,6 +1324,9 @@ void unit_dump(Unit *u, FILE *f, const char *prefix) {
                 }
         }
 
+        fprintf(f, "%s\tDependency Memory: %s\n",
+                prefix, format_bytes(bytes, sizeof(bytes), unit_dependencies_memory_usage(u)));
+
         if (!hashmap_isempty(u->requires_mounts_for)) {
                 UnitDependencyInfo di;
                 const char *path;
@@ -1403,7 +1453,7 @@ int unit_add_default_target_dependency(Unit *u, Unit *target) {
                 return 0;
 
         /* Don't create loops */
-        if (hashmap_get(target->dependencies[UNIT_BEFORE], u))
+        if (dependency_set_get(target->dependencies[UNIT_BEFORE], u))
                 return 0;
 
         return unit_add_dependency(target, UNIT_AFTER, u, true, UNIT_DEPENDENCY_DEFAULT);
@@ -1554,7 +1604,7 @@ int unit_load(Unit *u) {
                 if (r < 0)
                         goto fail;
 
-                if (u->on_failure_job_mode == JOB_ISOLATE && hashmap_size(u->dependencies[UNIT_ON_FAILURE]) > 1) {
+                if (u->on_failure_job_mode == JOB_ISOLATE && dependency_set_size(u->dependencies[UNIT_ON_FAILURE]) > 1) {
                         log_unit_error(u, "More than one OnFailure= dependencies specified but OnFailureJobMode=isolate set. Refusing.");
                         r = -ENOEXEC;
                         goto fail;
@@ -1707,9 +1757,9 @@ static bool unit_verify_deps(Unit *u) {
          * processing, but do not have any effect afterwards. We don't check BindsTo= dependencies that are not used in
          * conjunction with After= as for them any such check would make things entirely racy. */
 
-        HASHMAP_FOREACH_KEY(v, other, u->dependencies[UNIT_BINDS_TO], j) {
+        DEPENDENCY_SET_FOREACH(v, other, u->dependencies[UNIT_BINDS_TO], j) {
 
-                if (!hashmap_contains(u->dependencies[UNIT_AFTER], other))
+                if (!dependency_set_contains(u->dependencies[UNIT_AFTER], other))
                         continue;
 
                 if (!UNIT_IS_ACTIVE_OR_RELOADING(unit_active_state(other))) {
@@ -1921,7 +1971,7 @@ bool unit_can_reload(Unit *u) {
         if (UNIT_VTABLE(u)->can_reload)
                 return UNIT_VTABLE(u)->can_reload(u);
 
-        if (!hashmap_isempty(u->dependencies[UNIT_PROPAGATES_RELOAD_TO]))
+        if (!dependency_set_isempty(u->dependencies[UNIT_PROPAGATES_RELOAD_TO]))
                 return true;
 
         return UNIT_VTABLE(u)->reload;
@@ -1955,7 +2005,7 @@ bool unit_is_unneeded(Unit *u) {
                 /* If a dependent unit has a job queued, is active or transitioning, or is marked for
                  * restart, then don't clean this one up. */
 
-                HASHMAP_FOREACH_KEY(v, other, u->dependencies[deps[j]], i) {
+                DEPENDENCY_SET_FOREACH(v, other, u->dependencies[deps[j]], i) {
                         if (other->job)
                                 return false;
 
@@ -1989,7 +2039,7 @@ static void check_unneeded_dependencies(Unit *u) {
                 Iterator i;
                 void *v;
 
-                HASHMAP_FOREACH_KEY(v, other, u->dependencies[deps[j]], i)
+                DEPENDENCY_SET_FOREACH(v, other, u->dependencies[deps[j]], i)
                         unit_submit_to_stop_when_unneeded_queue(other);
         }
 }
@@ -2010,7 +2060,7 @@ static void unit_check_binds_to(Unit *u) {
         if (unit_active_state(u) != UNIT_ACTIVE)
                 return;
 
-        HASHMAP_FOREACH_KEY(v, other, u->dependencies[UNIT_BINDS_TO], i) {
+        DEPENDENCY_SET_FOREACH(v, other, u->dependencies[UNIT_BINDS_TO], i) {
                 if (other->job)
                         continue;
 
@@ -2053,26 +2103,26 @@ static void retroactively_start_dependencies(Unit *u) {
         assert(u);
         assert(UNIT_IS_ACTIVE_OR_ACTIVATING(unit_active_state(u)));
 
-        HASHMAP_FOREACH_KEY(v, other, u->dependencies[UNIT_REQUIRES], i)
-                if (!hashmap_get(u->dependencies[UNIT_AFTER], other) &&
+        DEPENDENCY_SET_FOREACH(v, other, u->dependencies[UNIT_REQUIRES], i)
+                if (!dependency_set_get(u->dependencies[UNIT_AFTER], other) &&
                     !UNIT_IS_ACTIVE_OR_ACTIVATING(unit_active_state(other)))
                         manager_add_job(u->manager, JOB_START, other, JOB_REPLACE, NULL, NULL);
 
-        HASHMAP_FOREACH_KEY(v, other, u->dependencies[UNIT_BINDS_TO], i)
-                if (!hashmap_get(u->dependencies[UNIT_AFTER], other) &&
+        DEPENDENCY_SET_FOREACH(v, other, u->dependencies[UNIT_BINDS_TO], i)
+                if (!dependency_set_get(u->dependencies[UNIT_AFTER], other) &&
                     !UNIT_IS_ACTIVE_OR_ACTIVATING(unit_active_state(other)))
                         manager_add_job(u->manager, JOB_START, other, JOB_REPLACE, NULL, NULL);
 
-        HASHMAP_FOREACH_KEY(v, other, u->dependencies[UNIT_WANTS], i)
-                if (!hashmap_get(u->dependencies[UNIT_AFTER], other) &&
+        DEPENDENCY_SET_FOREACH(v, other, u->dependencies[UNIT_WANTS], i)
+                if (!dependency_set_get(u->dependencies[UNIT_AFTER], other) &&
                     !UNIT_IS_ACTIVE_OR_ACTIVATING(unit_active_state(other)))
                         manager_add_job(u->manager, JOB_START, other, JOB_FAIL, NULL, NULL);
 
-        HASHMAP_FOREACH_KEY(v, other, u->dependencies[UNIT_CONFLICTS], i)
+        DEPENDENCY_SET_FOREACH(v, other, u->dependencies[UNIT_CONFLICTS], i)
                 if (!UNIT_IS_INACTIVE_OR_DEACTIVATING(unit_active_state(other)))
                         manager_add_job(u->manager, JOB_STOP, other, JOB_REPLACE, NULL, NULL);
 
-        HASHMAP_FOREACH_KEY(v, other, u->dependencies[UNIT_CONFLICTED_BY], i)
+        DEPENDENCY_SET_FOREACH(v, other, u->dependencies[UNIT_CONFLICTED_BY], i)
                 if (!UNIT_IS_INACTIVE_OR_DEACTIVATING(unit_active_state(other)))
                         manager_add_job(u->manager, JOB_STOP, other, JOB_REPLACE, NULL, NULL);
 }
@@ -2086,7 +2136,7 @@ static void retroactively_stop_dependencies(Unit *u) {
         assert(UNIT_IS_INACTIVE_OR_DEACTIVATING(unit_active_state(u)));
 
         /* Pull down units which are bound to us recursively if enabled */
-        HASHMAP_FOREACH_KEY(v, other, u->dependencies[UNIT_BOUND_BY], i)
+        DEPENDENCY_SET_FOREACH(v, other, u->dependencies[UNIT_BOUND_BY], i)
                 if (!UNIT_IS_INACTIVE_OR_DEACTIVATING(unit_active_state(other)))
                         manager_add_job(u->manager, JOB_STOP, other, JOB_REPLACE, NULL, NULL);
 }
@@ -2099,12 +2149,12 @@ void unit_start_on_failure(Unit *u) {
 
         assert(u);
 
-        if (hashmap_size(u->dependencies[UNIT_ON_FAILURE]) <= 0)
+        if (dependency_set_size(u->dependencies[UNIT_ON_FAILURE]) <= 0)
                 return;
 
         log_unit_info(u, "Triggering OnFailure= dependencies.");
 
-        HASHMAP_FOREACH_KEY(v, other, u->dependencies[UNIT_ON_FAILURE], i) {
+        DEPENDENCY_SET_FOREACH(v, other, u->dependencies[UNIT_ON_FAILURE], i) {
                 _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
 
                 r = manager_add_job(u->manager, JOB_START, other, u->on_failure_job_mode, &error, NULL);
@@ -2120,7 +2170,7 @@ void unit_trigger_notify(Unit *u) {
 
         assert(u);
 
-        HASHMAP_FOREACH_KEY(v, other, u->dependencies[UNIT_TRIGGERED_BY], i)
+        DEPENDENCY_SET_FOREACH(v, other, u->dependencies[UNIT_TRIGGERED_BY], i)
                 if (UNIT_VTABLE(other)->trigger_notify)
                         UNIT_VTABLE(other)->trigger_notify(other, u);
 }
@@ -2339,6 +2389,8 @@ void unit_notify(Unit *u, UnitActiveState os, UnitActiveState ns, UnitNotifyFlag
 
         m = u->manager;
 
+        USDT_PROBE(systemd, unit_state, u->id, os, ns);
+
         /* Update timestamps for state changes */
         if (!MANAGER_IS_RELOADING(m)) {
                 dual_timestamp_get(&u->state_change_timestamp);
@@ -2348,9 +2400,14 @@ void unit_notify(Unit *u, UnitActiveState os, UnitActiveState ns, UnitNotifyFlag
                 else if (!UNIT_IS_INACTIVE_OR_FAILED(os) && UNIT_IS_INACTIVE_OR_FAILED(ns))
                         u->inactive_enter_timestamp = u->state_change_timestamp;
 
-                if (!UNIT_IS_ACTIVE_OR_RELOADING(os) && UNIT_IS_ACTIVE_OR_RELOADING(ns))
+                if (!UNIT_IS_ACTIVE_OR_RELOADING(os) && UNIT_IS_ACTIVE_OR_RELOADING(ns)) {
                         u->active_enter_timestamp = u->state_change_timestamp;
-                else if (UNIT_IS_ACTIVE_OR_RELOADING(os) && !UNIT_IS_ACTIVE_OR_RELOADING(ns))
+
+                        if (os != UNIT_DEACTIVATING && dual_timestamp_is_set(&u->inactive_exit_timestamp))
+                                unit_add_latency(u, UNIT_LATENCY_ACTIVATION,
+                                                 usec_sub_unsigned(u->active_enter_timestamp.monotonic,
+                                                                   u->inactive_exit_timestamp.monotonic));
+                } else if (UNIT_IS_ACTIVE_OR_RELOADING(os) && !UNIT_IS_ACTIVE_OR_RELOADING(ns))
                         u->active_exit_timestamp = u->state_change_timestamp;
         }
 
@@ -2746,8 +2803,8 @@ static void maybe_warn_about_dependency(Unit *u, const char *other, UnitDependen
                 log_unit_warning(u, "Dependency %s=%s dropped, merged into %s", unit_dependency_to_string(dependency), strna(other), u->id);
 }
 
-static int unit_add_dependency_hashmap(
-                Hashmap **h,
+static int unit_add_dependency_entry(
+                DependencySet **h,
                 Unit *other,
                 UnitDependencyMask origin_mask,
                 UnitDependencyMask destination_mask) {
@@ -2761,13 +2818,9 @@ static int unit_add_dependency_hashmap(
         assert(destination_mask < _UNIT_DEPENDENCY_MASK_FULL);
         assert(origin_mask > 0 || destination_mask > 0);
 
-        r = hashmap_ensure_allocated(h, NULL);
-        if (r < 0)
-                return r;
-
         assert_cc(sizeof(void*) == sizeof(info));
 
-        info.data = hashmap_get(*h, other);
+        info.data = dependency_set_get(*h, other);
         if (info.data) {
                 /* Entry already exists. Add in our mask. */
 
@@ -2778,14 +2831,14 @@ static int unit_add_dependency_hashmap(
                 info.origin_mask |= origin_mask;
                 info.destination_mask |= destination_mask;
 
-                r = hashmap_update(*h, other, info.data);
+                r = dependency_set_update(*h, other, info.data);
         } else {
                 info = (UnitDependencyInfo) {
                         .origin_mask = origin_mask,
                         .destination_mask = destination_mask,
                 };
 
-                r = hashmap_put(*h, other, info.data);
+                r = dependency_set_put(h, other, info.data);
         }
         if (r < 0)
                 return r;
@@ -2847,22 +2900,22 @@ int unit_add_dependency(
                 return 0;
         }
 
-        r = unit_add_dependency_hashmap(u->dependencies + d, other, mask, 0);
+        r = unit_add_dependency_entry(u->dependencies + d, other, mask, 0);
         if (r < 0)
                 return r;
 
         if (inverse_table[d] != _UNIT_DEPENDENCY_INVALID && inverse_table[d] != d) {
-                r = unit_add_dependency_hashmap(other->dependencies + inverse_table[d], u, 0, mask);
+                r = unit_add_dependency_entry(other->dependencies + inverse_table[d], u, 0, mask);
                 if (r < 0)
                         return r;
         }
 
         if (add_reference) {
-                r = unit_add_dependency_hashmap(u->dependencies + UNIT_REFERENCES, other, mask, 0);
+                r = unit_add_dependency_entry(u->dependencies + UNIT_REFERENCES, other, mask, 0);
                 if (r < 0)
                         return r;
 
-                r = unit_add_dependency_hashmap(other->dependencies + UNIT_REFERENCED_BY, u, 0, mask);
+                r = unit_add_dependency_entry(other->dependencies + UNIT_REFERENCED_BY, u, 0, mask);
                 if (r < 0)
                         return r;
         }
@@ -3238,6 +3291,8 @@ int unit_serialize(Unit *u, FILE *f, FDSet *fds, bool serialize_jobs) {
         if (u->cpu_usage_last != NSEC_INFINITY)
                 (void) serialize_item_format(f, "cpu-usage-last", "%" PRIu64, u->cpu_usage_last);
 
+        unit_serialize_latency(f, u->latency);
+
         if (u->cgroup_path)
                 (void) serialize_item(f, "cgroup", u->cgroup_path);
 
@@ -3266,18 +3321,18 @@ int unit_serialize(Unit *u, FILE *f, FDSet *fds, bool serialize_jobs) {
 
         if (serialize_jobs) {
                 if (u->job) {
-                        fputs("job\n", f);
+                        (void) serialize_marker(f, "job");
                         job_serialize(u->job, f);
                 }
 
                 if (u->nop_job) {
-                        fputs("job\n", f);
+                        (void) serialize_marker(f, "job");
                         job_serialize(u->nop_job, f);
                 }
         }
 
         /* End marker */
-        fputc('\n', f);
+        (void) serialize_end_marker(f);
         return 0;
 }
 
@@ -3294,7 +3349,7 @@ int unit_deserialize(Unit *u, FILE *f, FDSet *fds) {
                 char *l, *v;
                 size_t k;
 
-                r = read_line(f, LONG_LINE_MAX, &line);
+                r = deserialize_read_line(f, &line);
                 if (r < 0)
                         return log_error_errno(r, "Failed to read serialization line: %m");
                 if (r == 0) /* eof */
@@ -3469,6 +3524,14 @@ int unit_deserialize(Unit *u, FILE *f, FDSet *fds) {
 
                         continue;
 
+                } else if (endswith(l, "-latency")) {
+
+                        r = unit_deserialize_latency(u->latency, l, v);
+                        if (r < 0)
+                                log_unit_debug_errno(u, r, "Failed to parse %s histogram %s, ignoring: %m", l, v);
+                        if (r != 0)
+                                continue;
+
                 } else if (streq(l, "cgroup")) {
 
                         r = unit_set_cgroup_path(u, v);
@@ -3611,7 +3674,7 @@ int unit_deserialize_skip(FILE *f) {
                 _cleanup_free_ char *line = NULL;
                 char *l;
 
-                r = read_line(f, LONG_LINE_MAX, &line);
+                r = deserialize_read_line(f, &line);
                 if (r < 0)
                         return log_error_errno(r, "Failed to read serialization line: %m");
                 if (r == 0)
@@ -3774,6 +3837,101 @@ void unit_reset_failed(Unit *u) {
         u->start_limit_hit = false;
 }
 
+void unit_add_latency(Unit *u, UnitLatency l, usec_t t) {
+        int r;
+
+        assert(u);
+        assert(l >= 0 && l < _UNIT_LATENCY_MAX);
+
+        /* Records the latency both for the unit itself and for the manager as a whole */
+
+        r = histogram_add(&u->latency[l], t);
+        if (r >= 0)
+                r = histogram_add(&u->manager->unit_latency[l], t);
+        if (r < 0)
+                log_unit_debug_errno(u, r, "Failed to record %s latency, ignoring: %m", unit_latency_to_string(l));
+}
+
+void unit_reset_latency(Unit *u) {
+        UnitLatency l;
+
+        assert(u);
+
+        for (l = 0; l < _UNIT_LATENCY_MAX; l++)
+                u->latency[l] = histogram_free(u->latency[l]);
+}
+
+void unit_serialize_latency(FILE *f, Histogram **h) {
+        UnitLatency l;
+
+        assert(f);
+        assert(h);
+
+        for (l = 0; l < _UNIT_LATENCY_MAX; l++) {
+                _cleanup_free_ char *s = NULL;
+                const char *key;
+
+                if (!h[l])
+                        continue;
+
+                if (histogram_to_string(h[l], &s) < 0) {
+                        log_oom();
+                        continue;
+                }
+
+                key = strjoina(unit_latency_to_string(l), "-latency");
+                (void) serialize_item(f, key, s);
+        }
+}
+
+int unit_deserialize_latency(Histogram **h, const char *key, const char *value) {
+        _cleanup_free_ char *kind = NULL;
+        Histogram *n;
+        UnitLatency l;
+        const char *e;
+        int r;
+
+        assert(h);
+        assert(key);
+        assert(value);
+
+        /* Returns 0 if the key doesn't refer to a latency histogram, > 0 if it was parsed */
+
+        e = endswith(key, "-latency");
+        if (!e)
+                return 0;
+
+        kind = strndup(key, e - key);
+        if (!kind)
+                return -ENOMEM;
+
+        l = unit_latency_from_string(kind);
+        if (l < 0)
+                return 0;
+
+        r = histogram_from_string(value, &n);
+        if (r < 0)
+                return r;
+
+        histogram_free(h[l]);
+        h[l] = n;
+
+        return 1;
+}
+
+int unit_get_start_priority(Unit *u) {
+        assert(u);
+
+        /* Returns the explicitly configured start priority of the unit, or otherwise the one of the closest slice
+         * it is in that has one. */
+
+        for (; u; u = UNIT_DEREF(u->slice))
+                if (u->start_priority_set)
+                        return u->start_priority;
+
+        return 0;
+}
+
 Unit *unit_following(Unit *u) {
         assert(u);
 
@@ -4040,12 +4198,21 @@ int unit_patch_contexts(Unit *u) {
 
         ec = unit_get_exec_context(u);
         if (ec) {
-                /* This only copies in the ones that need memory */
+                /* This only patches in the ones that need memory. The limits the unit doesn't override point into
+                 * a block shared with all other units, instead of being copied. */
                 for (i = 0; i < _RLIMIT_MAX; i++)
                         if (u->manager->rlimit[i] && !ec->rlimit[i]) {
-                                ec->rlimit[i] = newdup(struct rlimit, u->manager->rlimit[i], 1);
-                                if (!ec->rlimit[i])
-                                        return -ENOMEM;
+                                if (!ec->shared_rlimits) {
+                                        ExecSharedRlimits *s;
+
+                                        s = manager_get_shared_rlimits(u->manager);
+                                        if (!s)
+                                                return -ENOMEM;
+
+                                        ec->shared_rlimits = exec_shared_rlimits_ref(s);
+                                }
+
+                                ec->rlimit[i] = ec->shared_rlimits->rlimit + i;
                         }
 
                 if (MANAGER_IS_USER(u->manager) &&
@@ -4373,6 +4540,7 @@ int unit_write_settingf(Unit *u, UnitWriteFlags flags, const char *name, const c
 int unit_make_transient(Unit *u) {
         _cleanup_free_ char *path = NULL;
         FILE *f;
+        int r;
 
         assert(u);
 
@@ -4397,7 +4565,9 @@ int unit_make_transient(Unit *u) {
         safe_fclose(u->transient_file);
         u->transient_file = f;
 
-        free_and_replace(u->fragment_path, path);
+        r = unit_set_fragment_path(u, path);
+        if (r < 0)
+                return r;
 
         u->source_path = mfree(u->source_path);
         u->dropin_paths = strv_free(u->dropin_paths);
@@ -4666,7 +4836,7 @@ int unit_setup_exec_runtime(Unit *u) {
                 return 0;
 
         /* Try to get it from somebody else */
-        HASHMAP_FOREACH_KEY(v, other, u->dependencies[UNIT_JOINS_NAMESPACE_OF], i) {
+        DEPENDENCY_SET_FOREACH(v, other, u->dependencies[UNIT_JOINS_NAMESPACE_OF], i) {
                 r = exec_runtime_acquire(u->manager, NULL, other->id, false, rt);
                 if (r == 1)
                         return 1;
@@ -5049,11 +5219,11 @@ static void unit_update_dependency_mask(Unit *u, UnitDependency d, Unit *other,
 
         if (di.origin_mask == 0 && di.destination_mask == 0) {
                 /* No bit set anymore, let's drop the whole entry */
-                assert_se(hashmap_remove(u->dependencies[d], other));
+                assert_se(dependency_set_remove(u->dependencies[d], other));
                 log_unit_debug(u, "%s lost dependency %s=%s", u->id, unit_dependency_to_string(d), other->id);
         } else
                 /* Mask was reduced, let's update the entry */
-                assert_se(hashmap_update(u->dependencies[d], other, di.data) == 0);
+                assert_se(dependency_set_update(u->dependencies[d], other, di.data) == 0);
 }
 
 void unit_remove_dependencies(Unit *u, UnitDependencyMask mask) {
@@ -5076,7 +5246,7 @@ void unit_remove_dependencies(Unit *u, UnitDependencyMask mask) {
 
                         done = true;
 
-                        HASHMAP_FOREACH_KEY(di.data, other, u->dependencies[d], i) {
+                        DEPENDENCY_SET_FOREACH(di.data, other, u->dependencies[d], i) {
                                 UnitDependency q;
 
                                 if ((di.origin_mask & ~mask) == di.origin_mask)
@@ -5092,7 +5262,7 @@ void unit_remove_dependencies(Unit *u, UnitDependencyMask mask) {
                                 for (q = 0; q < _UNIT_DEPENDENCY_MAX; q++) {
                                         UnitDependencyInfo dj;
 
-                                        dj.data = hashmap_get(other->dependencies[q], u);
+                                        dj.data = dependency_set_get(other->dependencies[q], u);
                                         if ((dj.destination_mask & ~mask) == dj.destination_mask)
                                                 continue;
                                         dj.destination_mask &= ~mask;
@@ -5354,6 +5524,67 @@ void unit_unlink_state_files(Unit *u) {
         }
 }
 
+void unit_flush_mount_ns(Unit *u) {
+        assert(u);
+
+        /* Forgets the mount namespace stored for the unit's processes, so that the next one sets up a new one */
+
+        if (u->mount_ns_storage_socket[0] < 0)
+                return;
+
+        safe_close_pair(u->mount_ns_storage_socket);
+        u->mount_ns_tmp_dir = mfree(u->mount_ns_tmp_dir);
+
+        (void) set_remove(u->manager->units_with_mount_ns, u);
+}
+
+static int unit_setup_mount_ns_storage(Unit *u) {
+        _cleanup_free_ char *copy = NULL;
+        ExecContext *ec;
+        ExecRuntime *rt;
+        int r;
+
+        assert(u);
+
+        ec = unit_get_exec_context(u);
+        if (!ec || !ec->reuse_mount_namespace) {
+                unit_flush_mount_ns(u);
+                return 0;
+        }
+
+        /* The namespace has the private /tmp of the unit mounted, which is created anew with every runtime of the
+         * unit, hence a stored namespace is only good as long as the runtime stays the same. */
+        rt = unit_get_exec_runtime(u);
+        if (rt && rt->tmp_dir) {
+                copy = strdup(rt->tmp_dir);
+                if (!copy)
+                        return -ENOMEM;
+        }
+
+        if (u->mount_ns_storage_socket[0] >= 0) {
+                if (streq_ptr(u->mount_ns_tmp_dir, copy))
+                        return 0;
+
+                unit_flush_mount_ns(u);
+        }
+
+        r = set_ensure_allocated(&u->manager->units_with_mount_ns, NULL);
+        if (r < 0)
+                return r;
+
+        if (socketpair(AF_UNIX, SOCK_DGRAM|SOCK_CLOEXEC, 0, u->mount_ns_storage_socket) < 0)
+                return -errno;
+
+        r = set_put(u->manager->units_with_mount_ns, u);
+        if (r < 0) {
+                safe_close_pair(u->mount_ns_storage_socket);
+                return r;
+        }
+
+        u->mount_ns_tmp_dir = TAKE_PTR(copy);
+        return 1;
+}
+
 int unit_prepare_exec(Unit *u) {
         int r;
 
@@ -5379,6 +5610,10 @@ int unit_prepare_exec(Unit *u) {
         if (r < 0)
                 return r;
 
+        r = unit_setup_mount_ns_storage(u);
+        if (r < 0)
+                log_unit_warning_errno(u, r, "Failed to set up storage for the mount namespace, not reusing it: %m");
+
         return 0;
 }
 
@@ -5579,3 +5814,11 @@ static const char* const collect_mode_table[_COLLECT_MODE_MAX] = {
 };
 
 DEFINE_STRING_TABLE_LOOKUP(collect_mode, CollectMode);
+
+static const char* const unit_latency_table[_UNIT_LATENCY_MAX] = {
+        [UNIT_LATENCY_JOB_WAIT] = "job-wait",
+        [UNIT_LATENCY_SPAWN] = "spawn",
+        [UNIT_LATENCY_ACTIVATION] = "activation",
+};
+
+DEFINE_STRING_TABLE_LOOKUP(unit_latency, UnitLatency);
@@ -7,6 +7,7 @@
 
 #include "bpf-program.h"
 #include "condition.h"
+#include "dependency-set.h"
 #include "emergency-action.h"
 #include "install.h"
 #include "list.h"
@@ -14,6 +15,7 @@
 #include "cgroup.h"
 
 typedef struct UnitRef UnitRef;
+typedef struct BPFAccessMaps BPFAccessMaps;
 
 typedef enum KillOperation {
         KILL_TERMINATE,
@@ -83,8 +85,8 @@ typedef enum UnitDependencyMask {
         _UNIT_DEPENDENCY_MASK_FULL         = (1 << 8) - 1,
 } UnitDependencyMask;
 
-/* The Unit's dependencies[] hashmaps use this structure as value. It has the same size as a void pointer, and thus can
- * be stored directly as hashmap value, without any indirection. Note that this stores two masks, as both the origin
+/* The Unit's dependencies[] sets use this structure as value. It has the same size as a void pointer, and thus can
+ * be stored directly as set value, without any indirection. Note that this stores two masks, as both the origin
  * and the destination of a dependency might have created it. */
 typedef union UnitDependencyInfo {
         void *data;
@@ -94,6 +96,10 @@ typedef union UnitDependencyInfo {
         } _packed_;
 } UnitDependencyInfo;
 
+/* The range of StartPriority= */
+#define START_PRIORITY_MIN (-1000)
+#define START_PRIORITY_MAX 1000
+
 #include "job.h"
 
 struct UnitRef {
@@ -117,9 +123,9 @@ typedef struct Unit {
 
         Set *names;
 
-        /* For each dependency type we maintain a Hashmap whose key is the Unit* object, and the value encodes why the
-         * dependency exists, using the UnitDependencyInfo type */
-        Hashmap *dependencies[_UNIT_DEPENDENCY_MAX];
+        /* For each dependency type we maintain a DependencySet whose key is the Unit* object, and the value encodes why
+         * the dependency exists, using the UnitDependencyInfo type */
+        DependencySet *dependencies[_UNIT_DEPENDENCY_MAX];
 
         /* Similar, for RequiresMountsFor= path dependencies. The key is the path, the value the UnitDependencyInfo type */
         Hashmap *requires_mounts_for;
@@ -127,7 +133,7 @@ typedef struct Unit {
         char *description;
         char **documentation;
 
-        char *fragment_path; /* if loaded from a config file this is the primary path to it */
+        const char *fragment_path; /* if loaded from a config file this is the primary path to it, interned in Manager.string_pool */
         char *source_path; /* if converted, the source file */
         char **dropin_paths;
 
@@ -158,6 +164,11 @@ typedef struct Unit {
         EmergencyAction job_timeout_action;
         char *job_timeout_reboot_arg;
 
+        /* The order in which start jobs are dispatched when their number is limited, lower values first. If not
+         * set, the value of the slice is used. */
+        int start_priority;
+        bool start_priority_set:1;
+
         /* References to this */
         LIST_HEAD(UnitRef, refs_by_target);
 
@@ -238,6 +249,9 @@ typedef struct Unit {
         uid_t ref_uid;
         gid_t ref_gid;
 
+        /* When we sent the last PropertiesChanged signal for this unit, see manager_dispatch_dbus_queue() */
+        usec_t dbus_signal_timestamp;
+
         /* Cached unit file state and preset */
         UnitFileState unit_file_state;
         int unit_file_preset;
@@ -246,6 +260,9 @@ typedef struct Unit {
         nsec_t cpu_usage_base;
         nsec_t cpu_usage_last; /* the most recently read value */
 
+        /* Allocated only once the first latency of the respective kind has been recorded */
+        Histogram *latency[_UNIT_LATENCY_MAX];
+
         /* Counterparts in the cgroup filesystem */
         char *cgroup_path;
         CGroupMask cgroup_realized_mask;           /* In which hierarchies does this unit's cgroup exist? (only relevant on cgroupsv1) */
@@ -254,6 +271,9 @@ typedef struct Unit {
         CGroupMask cgroup_members_mask;            /* A cache for the controllers required by all children of this cgroup (only relevant for slice units) */
         int cgroup_inotify_wd;
 
+        /* The values we last wrote to the attributes of this unit's cgroup, see set_attribute_and_warn() */
+        Hashmap *cgroup_attributes;
+
         /* Device Controller BPF program */
         BPFProgram *bpf_device_control_installed;
 
@@ -261,16 +281,23 @@ typedef struct Unit {
         int ip_accounting_ingress_map_fd;
         int ip_accounting_egress_map_fd;
 
-        int ipv4_allow_map_fd;
-        int ipv6_allow_map_fd;
-        int ipv4_deny_map_fd;
-        int ipv6_deny_map_fd;
+        BPFAccessMaps *ip_allow_maps;
+        BPFAccessMaps *ip_deny_maps;
 
         BPFProgram *ip_bpf_ingress, *ip_bpf_ingress_installed;
         BPFProgram *ip_bpf_egress, *ip_bpf_egress_installed;
 
         uint64_t ip_accounting_extra[_CGROUP_IP_ACCOUNTING_METRIC_MAX];
 
+        /* With ReuseMountNamespace=, a socket pair storing the mount namespace set up for the unit's processes, and
+         * the private /tmp it was set up with, see unit_setup_mount_ns_storage() */
+        int mount_ns_storage_socket[2];
+        char *mount_ns_tmp_dir;
+
+        /* Cached cgroup statistics, and when we read them, see unit_get_cgroup_stat() */
+        uint64_t cgroup_stats[_CGROUP_STAT_MAX];
+        usec_t cgroup_stats_timestamp[_CGROUP_STAT_MAX];
+
         /* Low-priority event source which is used to remove watched PIDs that have gone away, and subscribe to any new
          * ones which might have appeared. */
         sd_event_source *rewatch_pids_event_source;
@@ -315,7 +342,9 @@ typedef struct Unit {
 
         /* Booleans indicating membership of this unit in the various queues */
         bool in_load_queue:1;
+        bool fragment_prefetched:1;
         bool in_dbus_queue:1;
+        bool in_dbus_deferred_queue:1; /* in_dbus_queue is set too, but we are waiting for the coalescing window */
         bool in_cleanup_queue:1;
         bool in_gc_queue:1;
         bool in_cgroup_realize_queue:1;
@@ -599,7 +628,7 @@ static inline const UnitVTable* UNIT_VTABLE(Unit *u) {
 #define UNIT_HAS_KILL_CONTEXT(u) (UNIT_VTABLE(u)->kill_context_offset > 0)
 
 static inline Unit* UNIT_TRIGGER(Unit *u) {
-        return hashmap_first_key(u->dependencies[UNIT_TRIGGERS]);
+        return dependency_set_first_key(u->dependencies[UNIT_TRIGGERS]);
 }
 
 Unit *unit_new(Manager *m, size_t size);
@@ -624,6 +653,9 @@ bool unit_may_gc(Unit *u);
 
 void unit_add_to_load_queue(Unit *u);
 void unit_add_to_dbus_queue(Unit *u);
+void unit_remove_from_dbus_queue(Unit *u);
+
+int unit_set_fragment_path(Unit *u, const char *path);
 void unit_add_to_cleanup_queue(Unit *u);
 void unit_add_to_gc_queue(Unit *u);
 void unit_add_to_target_deps_queue(Unit *u);
@@ -650,6 +682,9 @@ UnitActiveState unit_active_state(Unit *u);
 const char* unit_sub_state_to_string(Unit *u);
 
 void unit_dump(Unit *u, FILE *f, const char *prefix);
+size_t unit_dependencies_memory_usage(Unit *u);
+
+int unit_get_start_priority(Unit *u) _pure_;
 
 bool unit_can_reload(Unit *u) _pure_;
 bool unit_can_start(Unit *u) _pure_;
@@ -707,6 +742,11 @@ bool unit_need_daemon_reload(Unit *u);
 
 void unit_reset_failed(Unit *u);
 
+void unit_add_latency(Unit *u, UnitLatency l, usec_t t);
+void unit_reset_latency(Unit *u);
+void unit_serialize_latency(FILE *f, Histogram **h);
+int unit_deserialize_latency(Histogram **h, const char *key, const char *value);
+
 Unit *unit_following(Unit *u);
 int unit_following_set(Unit *u, Set **s);
 
@@ -799,6 +839,8 @@ void unit_unlink_state_files(Unit *u);
 
 int unit_prepare_exec(Unit *u);
 
+void unit_flush_mount_ns(Unit *u);
+
 void unit_warn_leftover_processes(Unit *u);
 
 bool unit_needs_console(Unit *u);
@@ -849,3 +891,6 @@ int unit_failure_action_exit_status(Unit *u);
 
 const char* collect_mode_to_string(CollectMode m) _const_;
 CollectMode collect_mode_from_string(const char *s) _pure_;
+
+const char* unit_latency_to_string(UnitLatency l) _const_;
+UnitLatency unit_latency_from_string(const char *s) _pure_;
@@ -319,6 +319,77 @@ static int make_filename(const char *context[_CONTEXT_MAX], char **ret) {
         return 0;
 }
 
+static bool coredump_needs_processing(void) {
+#if HAVE_ELFUTILS
+        /* The stack trace is generated from the uncompressed core */
+        return arg_process_size_max > 0;
+#else
+        return false;
+#endif
+}
+
+static void log_truncated_core(uint64_t max_size) {
+        log_struct(LOG_INFO,
+                   LOG_MESSAGE("Core file was truncated to %"PRIu64" bytes.", max_size),
+                   "SIZE_LIMIT=%"PRIu64, max_size,
+                   "MESSAGE_ID=" SD_MESSAGE_TRUNCATED_CORE_STR);
+}
+
+#if HAVE_COMPRESSION && COMPRESS_STREAM_FROM_PIPE
+static int save_compressed_coredump(
+                const char *context[_CONTEXT_MAX],
+                int input_fd,
+                const char *fn,
+                uid_t uid,
+                uint64_t max_size,
+                char **ret_filename,
+                int *ret_node_fd,
+                uint64_t *ret_size,
+                bool *ret_truncated) {
+
+        _cleanup_free_ char *fn_compressed = NULL, *tmp_compressed = NULL;
+        _cleanup_close_ int fd_compressed = -1;
+        uint64_t size;
+        int r;
+
+        fn_compressed = strappend(fn, COMPRESSED_EXT);
+        if (!fn_compressed)
+                return log_oom();
+
+        fd_compressed = open_tmpfile_linkable(fn_compressed, O_RDWR|O_CLOEXEC, &tmp_compressed);
+        if (fd_compressed < 0) {
+                /* Retry the old way, maybe that works */
+                log_debug_errno(fd_compressed, "Failed to create temporary file for coredump %s, not compressing while reading: %m", fn_compressed);
+                return -EOPNOTSUPP;
+        }
+
+        r = compress_stream(input_fd, fd_compressed, max_size, &size);
+        if (r < 0) {
+                log_error_errno(r, "Cannot store coredump of %s (%s): %m", context[CONTEXT_PID], context[CONTEXT_COMM]);
+                goto fail;
+        }
+
+        *ret_truncated = size >= max_size;
+        if (*ret_truncated)
+                log_truncated_core(max_size);
+
+        r = fix_permissions(fd_compressed, tmp_compressed, fn_compressed, context, uid);
+        if (r < 0)
+                goto fail;
+
+        *ret_filename = TAKE_PTR(fn_compressed);
+        *ret_node_fd = TAKE_FD(fd_compressed);
+        *ret_size = size; /* uncompressed */
+
+        return 0;
+
+fail:
+        if (tmp_compressed)
+                (void) unlink(tmp_compressed);
+        return r;
+}
+#endif
+
 static int save_external_coredump(
                 const char *context[_CONTEXT_MAX],
                 int input_fd,
@@ -371,6 +442,22 @@ static int save_external_coredump(
 
         mkdir_p_label("/var/lib/systemd/coredump", 0755);
 
+#if HAVE_COMPRESSION && COMPRESS_STREAM_FROM_PIPE
+        /* If the core is only going to be stored compressed, there's no point in writing it to disk uncompressed
+         * first: compress it right away while reading it. We don't need more than we are going to store then. */
+        if (arg_compress && arg_storage == COREDUMP_STORAGE_EXTERNAL && arg_external_size_max > 0 &&
+            !coredump_needs_processing()) {
+                r = save_compressed_coredump(context, input_fd, fn, uid, MIN(rlimit, arg_external_size_max),
+                                             ret_filename, ret_node_fd, ret_size, ret_truncated);
+                if (r >= 0) {
+                        *ret_data_fd = -1;
+                        return 0;
+                }
+                if (r != -EOPNOTSUPP)
+                        return r;
+        }
+#endif
+
         fd = open_tmpfile_linkable(fn, O_RDWR|O_CLOEXEC, &tmp);
         if (fd < 0)
                 return log_error_errno(fd, "Failed to create temporary file for coredump %s: %m", fn);
@@ -382,10 +469,7 @@ static int save_external_coredump(
         }
         *ret_truncated = r == 1;
         if (*ret_truncated)
-                log_struct(LOG_INFO,
-                           LOG_MESSAGE("Core file was truncated to %zu bytes.", max_size),
-                           "SIZE_LIMIT=%zu", max_size,
-                           "MESSAGE_ID=" SD_MESSAGE_TRUNCATED_CORE_STR);
+                log_truncated_core(max_size);
 
         if (fstat(fd, &st) < 0) {
                 log_error_errno(errno, "Failed to fstat core file %s: %m", coredump_tmpfile_name(tmp));
@@ -397,7 +481,7 @@ static int save_external_coredump(
                 goto fail;
         }
 
-#if HAVE_XZ || HAVE_LZ4
+#if HAVE_COMPRESSION
         /* If we will remove the coredump anyway, do not compress. */
         if (arg_compress && !maybe_remove_external_coredump(NULL, st.st_size)) {
 
@@ -416,7 +500,7 @@ static int save_external_coredump(
                         goto uncompressed;
                 }
 
-                r = compress_stream(fd, fd_compressed, -1);
+                r = compress_stream(fd, fd_compressed, (uint64_t) -1, NULL);
                 if (r < 0) {
                         log_error_errno(r, "Failed to compress %s: %m", coredump_tmpfile_name(tmp_compressed));
                         goto fail_compressed;
@@ -769,7 +853,7 @@ static int submit_coredump(
 
 #if HAVE_ELFUTILS
         /* Try to get a strack trace if we can */
-        if (coredump_size <= arg_process_size_max) {
+        if (coredump_fd >= 0 && coredump_size <= arg_process_size_max) {
                 _cleanup_free_ char *stacktrace = NULL;
 
                 r = coredump_make_stack_trace(coredump_fd, context[CONTEXT_EXE], &stacktrace);
@@ -692,6 +692,8 @@ static int dump_list(int argc, char **argv, void *userdata) {
                         if (r == 0)
                                 break;
 
+                        /* Entries are sorted by time, hence once we are past the end of the range, no later entry
+                         * can be in it anymore */
                         if (arg_until != USEC_INFINITY && !arg_reverse) {
                                 usec_t usec;
 
@@ -699,7 +701,7 @@ static int dump_list(int argc, char **argv, void *userdata) {
                                 if (r < 0)
                                         return log_error_errno(r, "Failed to determine timestamp: %m");
                                 if (usec > arg_until)
-                                        continue;
+                                        break;
                         }
 
                         if (arg_since != USEC_INFINITY && arg_reverse) {
@@ -709,7 +711,7 @@ static int dump_list(int argc, char **argv, void *userdata) {
                                 if (r < 0)
                                         return log_error_errno(r, "Failed to determine timestamp: %m");
                                 if (usec < arg_since)
-                                        continue;
+                                        break;
                         }
 
                         r = print_entry(j, n_found++, verb_is_info);
@@ -806,7 +808,7 @@ static int save_core(sd_journal *j, FILE *file, char **path, bool *unlink_temp)
         }
 
         if (filename) {
-#if HAVE_XZ || HAVE_LZ4
+#if HAVE_COMPRESSION
                 _cleanup_close_ int fdf;
 
                 fdf = open(filename, O_RDONLY | O_CLOEXEC);
@@ -0,0 +1,522 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio_ext.h>
+#include <sys/eventfd.h>
+
+#include "alloc-util.h"
+#include "fd-util.h"
+#include "fileio.h"
+#include "hashmap.h"
+#include "journal-gatewayd-follower.h"
+#include "log.h"
+#include "logs-show.h"
+#include "macro.h"
+#include "strv.h"
+
+/* A follower is a thread that follows the journal with one particular filter and output mode, and keeps the most
+ * recent entries it read in serialized form. All requests in follow mode with the same filter and output mode share
+ * one follower: each of them reads the journal on its own until it caught up with the journal's end, and from then on
+ * copies entries from the follower, and closes its own journal. Requests that fall too far behind continue on their
+ * own again, starting after the cursor of the last entry they sent.
+ *
+ * Note that gatewayd runs one thread per connection, hence everything here is called from multiple threads. The
+ * journal and the entries of a follower are protected by its mutex, the set of followers by followers_mutex. */
+
+#define FOLLOWER_ENTRIES_MAX 1024U
+
+typedef struct FollowerEntry {
+        char *cursor;
+        char *data;
+        size_t size;
+} FollowerEntry;
+
+struct Follower {
+        unsigned n_ref;
+        char *key;
+        OutputMode mode;
+
+        pthread_t thread;
+        bool running;
+        int stop_fd;
+
+        pthread_mutex_t mutex;
+        pthread_cond_t cond;
+
+        sd_journal *journal;
+
+        /* The entry with sequence number n is stored at n % FOLLOWER_ENTRIES_MAX */
+        FollowerEntry entries[FOLLOWER_ENTRIES_MAX];
+        uint64_t next_seqnum;
+        int error;
+};
+
+static pthread_mutex_t followers_mutex = PTHREAD_MUTEX_INITIALIZER;
+static Hashmap *followers = NULL;
+
+static Follower* follower_free(Follower *f) {
+        size_t i;
+
+        if (!f)
+                return NULL;
+
+        if (f->running) {
+                (void) eventfd_write(f->stop_fd, 1);
+                assert_se(pthread_join(f->thread, NULL) == 0);
+        }
+
+        safe_close(f->stop_fd);
+        sd_journal_close(f->journal);
+
+        for (i = 0; i < FOLLOWER_ENTRIES_MAX; i++) {
+                free(f->entries[i].cursor);
+                free(f->entries[i].data);
+        }
+
+        assert_se(pthread_cond_destroy(&f->cond) == 0);
+        assert_se(pthread_mutex_destroy(&f->mutex) == 0);
+
+        free(f->key);
+        return mfree(f);
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(Follower*, follower_free);
+
+static uint64_t follower_oldest(Follower *f) {
+        assert(f);
+
+        return f->next_seqnum > FOLLOWER_ENTRIES_MAX ? f->next_seqnum - FOLLOWER_ENTRIES_MAX : 0;
+}
+
+/* Must be called with the follower's mutex held */
+static int follower_drain(Follower *f) {
+        int r;
+
+        assert(f);
+
+        for (;;) {
+                _cleanup_free_ char *data = NULL, *cursor = NULL;
+                _cleanup_fclose_ FILE *mf = NULL;
+                FollowerEntry *e;
+                size_t size = 0;
+
+                r = sd_journal_next(f->journal);
+                if (r <= 0)
+                        return r;
+
+                r = sd_journal_get_cursor(f->journal, &cursor);
+                if (r < 0)
+                        return r;
+
+                mf = open_memstream(&data, &size);
+                if (!mf)
+                        return -ENOMEM;
+
+                (void) __fsetlocking(mf, FSETLOCKING_BYCALLER);
+
+                r = show_journal_entry(mf, f->journal, f->mode, 0, OUTPUT_FULL_WIDTH, NULL, NULL, NULL);
+                if (r < 0)
+                        return r;
+
+                r = fflush_and_check(mf);
+                if (r < 0)
+                        return r;
+
+                mf = safe_fclose(mf);
+
+                e = f->entries + f->next_seqnum % FOLLOWER_ENTRIES_MAX;
+                free(e->cursor);
+                free(e->data);
+                *e = (FollowerEntry) {
+                        .cursor = TAKE_PTR(cursor),
+                        .data = TAKE_PTR(data),
+                        .size = size,
+                };
+
+                f->next_seqnum++;
+                assert_se(pthread_cond_broadcast(&f->cond) == 0);
+        }
+}
+
+static void *follower_thread(void *p) {
+        Follower *f = p;
+        int r;
+
+        for (;;) {
+                struct pollfd pollfd[2];
+                uint64_t timeout;
+                int fd, events, msec;
+
+                assert_se(pthread_mutex_lock(&f->mutex) == 0);
+                fd = sd_journal_get_fd(f->journal);
+                events = sd_journal_get_events(f->journal);
+                r = sd_journal_get_timeout(f->journal, &timeout);
+                assert_se(pthread_mutex_unlock(&f->mutex) == 0);
+                if (fd < 0)
+                        r = fd;
+                else if (events < 0)
+                        r = events;
+                if (r < 0)
+                        break;
+
+                if (timeout == (uint64_t) -1)
+                        msec = -1;
+                else {
+                        usec_t n;
+
+                        n = now(CLOCK_MONOTONIC);
+                        msec = timeout > n ? (int) MIN(DIV_ROUND_UP(timeout - n, USEC_PER_MSEC), (usec_t) INT_MAX) : 0;
+                }
+
+                pollfd[0] = (struct pollfd) { .fd = fd, .events = events };
+                pollfd[1] = (struct pollfd) { .fd = f->stop_fd, .events = POLLIN };
+
+                if (poll(pollfd, ELEMENTSOF(pollfd), msec) < 0) {
+                        if (errno == EINTR)
+                                continue;
+
+                        r = -errno;
+                        break;
+                }
+
+                if (pollfd[1].revents != 0)
+                        return NULL;
+
+                assert_se(pthread_mutex_lock(&f->mutex) == 0);
+                r = sd_journal_process(f->journal);
+                if (r >= 0)
+                        r = follower_drain(f);
+                assert_se(pthread_mutex_unlock(&f->mutex) == 0);
+                if (r < 0)
+                        break;
+        }
+
+        log_error_errno(r, "Shared journal follower failed: %m");
+
+        assert_se(pthread_mutex_lock(&f->mutex) == 0);
+        f->error = r;
+        assert_se(pthread_cond_broadcast(&f->cond) == 0);
+        assert_se(pthread_mutex_unlock(&f->mutex) == 0);
+
+        return NULL;
+}
+
+static char* follower_key(OutputMode mode, char **matches) {
+        _cleanup_strv_free_ char **l = NULL;
+        _cleanup_free_ char *s = NULL;
+        size_t allocated = 0, n = 0;
+        char **i;
+
+        l = strv_copy(matches);
+        if (!l)
+                return NULL;
+
+        /* The order of matches doesn't make a difference to the result, hence let's share followers regardless
+         * of it. Every match is prefixed with its length, so that the key is unambiguous. */
+        strv_sort(l);
+
+        if (asprintf(&s, "%i", mode) < 0)
+                return NULL;
+        n = allocated = strlen(s) + 1;
+
+        STRV_FOREACH(i, l) {
+                int k;
+
+                if (!GREEDY_REALLOC(s, allocated, n + strlen(*i) + 2 + DECIMAL_STR_MAX(size_t)))
+                        return NULL;
+
+                k = sprintf(s + n - 1, " %zu:%s", strlen(*i), *i);
+                n += k;
+        }
+
+        return TAKE_PTR(s);
+}
+
+static int follower_new(const char *directory, OutputMode mode, char **matches, char *key, Follower **ret) {
+        _cleanup_(follower_freep) Follower *f = NULL;
+        pthread_condattr_t attr;
+        char **i;
+        int r;
+
+        assert(key);
+        assert(ret);
+
+        f = new0(Follower, 1);
+        if (!f)
+                return -ENOMEM;
+
+        f->n_ref = 1;
+        f->mode = mode;
+        f->stop_fd = -1;
+        assert_se(pthread_mutex_init(&f->mutex, NULL) == 0);
+
+        assert_se(pthread_condattr_init(&attr) == 0);
+        assert_se(pthread_condattr_setclock(&attr, CLOCK_MONOTONIC) == 0);
+        assert_se(pthread_cond_init(&f->cond, &attr) == 0);
+        assert_se(pthread_condattr_destroy(&attr) == 0);
+
+        if (directory)
+                r = sd_journal_open_directory(&f->journal, directory, 0);
+        else
+                r = sd_journal_open(&f->journal, SD_JOURNAL_LOCAL_ONLY|SD_JOURNAL_SYSTEM);
+        if (r < 0)
+                return r;
+
+        STRV_FOREACH(i, matches) {
+                r = sd_journal_add_match(f->journal, *i, 0);
+                if (r < 0)
+                        return r;
+        }
+
+        /* Set up inotify before seeking, so that nothing written after the seek is missed */
+        r = sd_journal_get_fd(f->journal);
+        if (r < 0)
+                return r;
+
+        r = sd_journal_seek_tail(f->journal);
+        if (r < 0)
+                return r;
+
+        /* Position on the last entry, so that the next one is the first new one */
+        r = sd_journal_previous(f->journal);
+        if (r < 0)
+                return r;
+
+        f->stop_fd = eventfd(0, EFD_CLOEXEC|EFD_NONBLOCK);
+        if (f->stop_fd < 0)
+                return -errno;
+
+        r = pthread_create(&f->thread, NULL, follower_thread, f);
+        if (r != 0)
+                return -r;
+
+        f->running = true;
+        f->key = key;
+
+        *ret = TAKE_PTR(f);
+        return 0;
+}
+
+int follower_acquire(const char *directory, OutputMode mode, char **matches, Follower **ret) {
+        _cleanup_free_ char *key = NULL;
+        Follower *f;
+        int r;
+
+        assert(ret);
+
+        key = follower_key(mode, matches);
+        if (!key)
+                return -ENOMEM;
+
+        assert_se(pthread_mutex_lock(&followers_mutex) == 0);
+
+        f = hashmap_get(followers, key);
+        if (f) {
+                assert_se(pthread_mutex_lock(&f->mutex) == 0);
+                r = f->error;
+                assert_se(pthread_mutex_unlock(&f->mutex) == 0);
+
+                if (r >= 0) {
+                        f->n_ref++;
+                        *ret = f;
+                }
+
+                goto finish;
+        }
+
+        r = hashmap_ensure_allocated(&followers, &string_hash_ops);
+        if (r < 0)
+                goto finish;
+
+        r = follower_new(directory, mode, matches, key, &f);
+        if (r < 0)
+                goto finish;
+        key = NULL;
+
+        r = hashmap_put(followers, f->key, f);
+        if (r < 0) {
+                follower_free(f);
+                goto finish;
+        }
+
+        log_debug("Started shared journal follower for filter \"%s\".", f->key);
+
+        *ret = f;
+        r = 0;
+
+finish:
+        assert_se(pthread_mutex_unlock(&followers_mutex) == 0);
+        return r;
+}
+
+Follower* follower_release(Follower *f) {
+        bool last;
+
+        if (!f)
+                return NULL;
+
+        assert_se(pthread_mutex_lock(&followers_mutex) == 0);
+
+        assert(f->n_ref > 0);
+        f->n_ref--;
+
+        last = f->n_ref == 0;
+        if (last)
+                (void) hashmap_remove(followers, f->key);
+
+        assert_se(pthread_mutex_unlock(&followers_mutex) == 0);
+
+        if (last) {
+                log_debug("Stopping shared journal follower for filter \"%s\".", f->key);
+                follower_free(f);
+        }
+
+        return NULL;
+}
+
+int follower_attach(Follower *f, sd_journal *j, const char *cursor, uint64_t *ret_seqnum) {
+        uint64_t s, oldest;
+        bool found = false;
+        int r;
+
+        assert(f);
+        assert(j);
+        assert(cursor);
+        assert(ret_seqnum);
+
+        /* j must have been used with the same filter, and be at its end, with cursor being the last entry read from
+         * it. Returns > 0 and the first sequence number to read from the follower, if we could take over. Returns
+         * -EAGAIN if more entries showed up for j in the meantime, and 0 if we can't take over, in which case j
+         * should be used to wait for more entries. */
+
+        /* Check for new files and entries once more, so that j really has seen everything written before the follower
+         * catches up below. Everything written later the follower will see, too. */
+        r = sd_journal_get_fd(j);
+        if (r < 0)
+                return r;
+
+        r = sd_journal_process(j);
+        if (r < 0)
+                return r;
+
+        r = sd_journal_next(j);
+        if (r < 0)
+                return r;
+        if (r > 0) {
+                /* Step back, so that the caller reads this entry next */
+                r = sd_journal_previous(j);
+                if (r < 0)
+                        return r;
+
+                return -EAGAIN;
+        }
+
+        assert_se(pthread_mutex_lock(&f->mutex) == 0);
+
+        r = f->error;
+        if (r < 0)
+                goto finish;
+
+        r = sd_journal_process(f->journal);
+        if (r >= 0)
+                r = follower_drain(f);
+        if (r < 0) {
+                f->error = r;
+                assert_se(pthread_cond_broadcast(&f->cond) == 0);
+                goto finish;
+        }
+
+        oldest = follower_oldest(f);
+        for (s = f->next_seqnum; s > oldest; s--)
+                if (streq(f->entries[(s - 1) % FOLLOWER_ENTRIES_MAX].cursor, cursor)) {
+                        found = true;
+                        break;
+                }
+
+        if (found)
+                *ret_seqnum = s;
+        else if (oldest == 0)
+                /* The last entry was written before the follower started, and all the follower has is newer */
+                *ret_seqnum = 0;
+        else {
+                r = 0;
+                goto finish;
+        }
+
+        r = 1;
+
+finish:
+        assert_se(pthread_mutex_unlock(&f->mutex) == 0);
+        return r;
+}
+
+int follower_next(Follower *f, uint64_t *seqnum, usec_t timeout,
+                  char **buffer, size_t *allocated, size_t *ret_size, char **ret_cursor) {
+
+        struct timespec ts;
+        int r;
+
+        assert(f);
+        assert(seqnum);
+        assert(buffer);
+        assert(allocated);
+        assert(ret_size);
+        assert(ret_cursor);
+
+        /* Copies the entry with the specified sequence number, waiting for it up to timeout. Returns 0 on timeout,
+         * and -ESTALE if the entry isn't available anymore. */
+
+        timespec_store(&ts, usec_add(now(CLOCK_MONOTONIC), timeout));
+
+        assert_se(pthread_mutex_lock(&f->mutex) == 0);
+
+        for (;;) {
+                if (f->error < 0) {
+                        r = f->error;
+                        break;
+                }
+
+                if (*seqnum < follower_oldest(f)) {
+                        r = -ESTALE;
+                        break;
+                }
+
+                if (*seqnum < f->next_seqnum) {
+                        FollowerEntry *e = f->entries + *seqnum % FOLLOWER_ENTRIES_MAX;
+                        char *c;
+
+                        c = strdup(e->cursor);
+                        if (!c) {
+                                r = -ENOMEM;
+                                break;
+                        }
+
+                        if (!GREEDY_REALLOC(*buffer, *allocated, e->size)) {
+                                free(c);
+                                r = -ENOMEM;
+                                break;
+                        }
+
+                        memcpy(*buffer, e->data, e->size);
+                        *ret_size = e->size;
+                        free_and_replace(*ret_cursor, c);
+
+                        (*seqnum)++;
+                        r = 1;
+                        break;
+                }
+
+                r = pthread_cond_timedwait(&f->cond, &f->mutex, &ts);
+                if (r == ETIMEDOUT) {
+                        r = 0;
+                        break;
+                }
+                assert(r == 0);
+        }
+
+        assert_se(pthread_mutex_unlock(&f->mutex) == 0);
+        return r;
+}
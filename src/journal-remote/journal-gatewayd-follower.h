@@ -0,0 +1,18 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+#pragma once
+
+#include <inttypes.h>
+
+#include "sd-journal.h"
+
+#include "output-mode.h"
+#include "time-util.h"
+
+typedef struct Follower Follower;
+
+int follower_acquire(const char *directory, OutputMode mode, char **matches, Follower **ret);
+Follower* follower_release(Follower *f);
+
+int follower_attach(Follower *f, sd_journal *j, const char *cursor, uint64_t *ret_seqnum);
+int follower_next(Follower *f, uint64_t *seqnum, usec_t timeout,
+                  char **buffer, size_t *allocated, size_t *ret_size, char **ret_cursor);
@@ -16,6 +16,7 @@
 #include "fd-util.h"
 #include "fileio.h"
 #include "hostname-util.h"
+#include "journal-gatewayd-follower.h"
 #include "log.h"
 #include "logs-show.h"
 #include "microhttpd-util.h"
@@ -23,6 +24,7 @@
 #include "parse-util.h"
 #include "pretty-print.h"
 #include "sigbus.h"
+#include "strv.h"
 #include "tmpfile-util.h"
 #include "util.h"
 
@@ -53,6 +55,17 @@ typedef struct RequestMeta {
 
         uint64_t n_fields;
         bool n_fields_set;
+
+        char **matches;
+
+        /* In follow mode, once we caught up with the end of the journal, entries are copied from a follower shared
+         * with all other requests for the same matches and output mode, and our own journal is closed. */
+        Follower *follower;
+        bool attached;
+        uint64_t follower_seqnum;
+        char *last_cursor;
+        char *buffer;
+        size_t buffer_allocated;
 } RequestMeta;
 
 static const char* const mime_types[_OUTPUT_MODE_MAX] = {
@@ -61,6 +74,7 @@ static const char* const mime_types[_OUTPUT_MODE_MAX] = {
         [OUTPUT_JSON_SSE] = "text/event-stream",
         [OUTPUT_JSON_SEQ] = "application/json-seq",
         [OUTPUT_EXPORT] = "application/vnd.fdo.journal",
+        [OUTPUT_EXPORT_BINARY] = "application/vnd.fdo.journal-binary",
 };
 
 static RequestMeta *request_meta(void **connection_cls) {
@@ -90,10 +104,14 @@ static void request_meta_free(
                 return;
 
         sd_journal_close(m->journal);
+        follower_release(m->follower);
 
         safe_fclose(m->tmp);
 
         free(m->cursor);
+        strv_free(m->matches);
+        free(m->last_cursor);
+        free(m->buffer);
         free(m);
 }
 
@@ -109,6 +127,47 @@ static int open_journal(RequestMeta *m) {
                 return sd_journal_open(&m->journal, SD_JOURNAL_LOCAL_ONLY|SD_JOURNAL_SYSTEM);
 }
 
+static int request_add_matches(RequestMeta *m) {
+        char **i;
+        int r;
+
+        assert(m);
+
+        STRV_FOREACH(i, m->matches) {
+                r = sd_journal_add_match(m->journal, *i, 0);
+                if (r < 0)
+                        return r;
+        }
+
+        return 0;
+}
+
+static int request_reopen_journal(RequestMeta *m) {
+        int r;
+
+        assert(m);
+        assert(m->last_cursor);
+
+        /* We fell behind the shared follower, hence continue on our own, after the last entry we sent */
+
+        r = open_journal(m);
+        if (r < 0)
+                return r;
+
+        r = request_add_matches(m);
+        if (r < 0)
+                return r;
+
+        r = sd_journal_seek_cursor(m->journal, m->last_cursor);
+        if (r < 0)
+                return r;
+
+        m->n_skip = 1;
+        m->attached = false;
+
+        return 0;
+}
+
 static int request_meta_ensure_tmp(RequestMeta *m) {
         assert(m);
 
@@ -158,6 +217,39 @@ static ssize_t request_reader_entries(
                     m->n_entries <= 0)
                         return MHD_CONTENT_READER_END_OF_STREAM;
 
+                if (m->attached) {
+                        size_t size;
+
+                        r = follower_next(m->follower, &m->follower_seqnum, JOURNAL_WAIT_TIMEOUT,
+                                          &m->buffer, &m->buffer_allocated, &size, &m->last_cursor);
+                        if (r == -ESTALE) {
+                                log_debug("Fell behind shared journal follower, continuing on our own.");
+
+                                r = request_reopen_journal(m);
+                                if (r < 0) {
+                                        log_error_errno(r, "Failed to reopen journal: %m");
+                                        return MHD_CONTENT_READER_END_WITH_ERROR;
+                                }
+
+                                continue;
+                        }
+                        if (r < 0) {
+                                log_error_errno(r, "Failed to get entry from shared journal follower: %m");
+                                return MHD_CONTENT_READER_END_WITH_ERROR;
+                        }
+                        if (r == 0)
+                                break;
+
+                        pos -= m->size;
+                        m->delta += m->size;
+
+                        if (m->n_entries_set)
+                                m->n_entries -= 1;
+
+                        m->size = size;
+                        continue;
+                }
+
                 if (m->n_skip < 0)
                         r = sd_journal_previous_skip(m->journal, (uint64_t) -m->n_skip + 1);
                 else if (m->n_skip > 0)
@@ -171,6 +263,24 @@ static ssize_t request_reader_entries(
                 } else if (r == 0) {
 
                         if (m->follow) {
+                                if (m->follower && m->last_cursor) {
+                                        r = follower_attach(m->follower, m->journal, m->last_cursor, &m->follower_seqnum);
+                                        if (r == -EAGAIN)
+                                                continue;
+                                        if (r < 0) {
+                                                log_error_errno(r, "Failed to switch to shared journal follower: %m");
+                                                return MHD_CONTENT_READER_END_WITH_ERROR;
+                                        }
+                                        if (r > 0) {
+                                                log_debug("Caught up with shared journal follower, switching over.");
+
+                                                m->attached = true;
+                                                sd_journal_close(m->journal);
+                                                m->journal = NULL;
+                                                continue;
+                                        }
+                                }
+
                                 r = sd_journal_wait(m->journal, (uint64_t) JOURNAL_WAIT_TIMEOUT);
                                 if (r < 0) {
                                         log_error_errno(r, "Couldn't wait for journal event: %m");
@@ -226,6 +336,29 @@ static ssize_t request_reader_entries(
                 }
 
                 m->size = (uint64_t) sz;
+
+                if (m->follower) {
+                        char *c;
+
+                        r = sd_journal_get_cursor(m->journal, &c);
+                        if (r < 0) {
+                                log_error_errno(r, "Failed to get cursor: %m");
+                                return MHD_CONTENT_READER_END_WITH_ERROR;
+                        }
+
+                        free_and_replace(m->last_cursor, c);
+                }
+        }
+
+        if (m->attached) {
+                n = m->size - pos;
+                if (n < 1)
+                        return 0;
+                if (n > max)
+                        n = max;
+
+                memcpy(buf, m->buffer + pos, n);
+                return (ssize_t) n;
         }
 
         if (m->tmp == NULL && m->follow)
@@ -273,6 +406,8 @@ static int request_parse_accept(
                 m->mode = OUTPUT_JSON_SEQ;
         else if (streq(header, mime_types[OUTPUT_EXPORT]))
                 m->mode = OUTPUT_EXPORT;
+        else if (streq(header, mime_types[OUTPUT_EXPORT_BINARY]))
+                m->mode = OUTPUT_EXPORT_BINARY;
         else
                 m->mode = OUTPUT_SHORT;
 
@@ -414,7 +549,7 @@ static int request_parse_arguments_iterator(
                         }
 
                         sd_id128_to_string(bid, match + 9);
-                        r = sd_journal_add_match(m->journal, match, sizeof(match)-1);
+                        r = strv_extend(&m->matches, match);
                         if (r < 0) {
                                 m->argument_parse_error = r;
                                 return MHD_NO;
@@ -430,7 +565,7 @@ static int request_parse_arguments_iterator(
                 return MHD_NO;
         }
 
-        r = sd_journal_add_match(m->journal, p, 0);
+        r = strv_consume(&m->matches, TAKE_PTR(p));
         if (r < 0) {
                 m->argument_parse_error = r;
                 return MHD_NO;
@@ -473,7 +608,8 @@ static int request_handler_entries(
         if (request_parse_range(m, connection) < 0)
                 return mhd_respond(connection, MHD_HTTP_BAD_REQUEST, "Failed to parse Range header.");
 
-        if (request_parse_arguments(m, connection) < 0)
+        if (request_parse_arguments(m, connection) < 0 ||
+            request_add_matches(m) < 0)
                 return mhd_respond(connection, MHD_HTTP_BAD_REQUEST, "Failed to parse URL arguments.");
 
         if (m->discrete) {
@@ -493,6 +629,12 @@ static int request_handler_entries(
         if (r < 0)
                 return mhd_respond(connection, MHD_HTTP_BAD_REQUEST, "Failed to seek in journal.");
 
+        if (m->follow && !m->discrete) {
+                r = follower_acquire(arg_directory, m->mode, m->matches, &m->follower);
+                if (r < 0)
+                        log_debug_errno(r, "Failed to set up shared journal follower, following on our own: %m");
+        }
+
         response = MHD_create_response_from_callback(MHD_SIZE_UNKNOWN, 4*1024, request_reader_entries, m, NULL);
         if (!response)
                 return respond_oom(connection);
@@ -3,14 +3,20 @@
 #include <getopt.h>
 #include <unistd.h>
 
+#if HAVE_ZSTD
+#include <zstd.h>
+#endif
+
 #include "sd-daemon.h"
 
+#include "alloc-util.h"
 #include "conf-parser.h"
 #include "def.h"
 #include "fd-util.h"
 #include "fileio.h"
 #include "journal-remote-write.h"
 #include "journal-remote.h"
+#include "parse-util.h"
 #include "pretty-print.h"
 #include "process-util.h"
 #include "rlimit-util.h"
@@ -24,6 +30,8 @@
 #define CERT_FILE     CERTIFICATE_ROOT "/certs/journal-remote.pem"
 #define TRUST_FILE    CERTIFICATE_ROOT "/ca/trusted.pem"
 
+#define WORKERS_MAX 256U
+
 static char* arg_url = NULL;
 static char* arg_getter = NULL;
 static char* arg_listen_raw = NULL;
@@ -37,6 +45,7 @@ static char** arg_gnutls_log = NULL;
 
 static JournalWriteSplitMode arg_split_mode = _JOURNAL_WRITE_SPLIT_INVALID;
 static char* arg_output = NULL;
+static unsigned arg_workers = 1;
 
 static char *arg_key = NULL;
 static char *arg_cert = NULL;
@@ -137,98 +146,301 @@ static int dispatch_http_event(sd_event_source *event,
                                uint32_t revents,
                                void *userdata);
 
-static int request_meta(void **connection_cls, int fd, char *hostname) {
+typedef struct HttpUpload {
         RemoteSource *source;
-        Writer *writer;
+
+        /* If set, the uploaded data is processed on this worker thread, while the connection is suspended. The
+         * source's writer then belongs to the worker. */
+        RemoteWorker *worker;
+        RemoteWorkerJob job;
+        struct MHD_Connection *connection;
+        char *data;
+        size_t size;
+        int error;
+
+#if HAVE_ZSTD
+        /* Set if the upload uses "Content-Encoding: zstd" */
+        ZSTD_DCtx *decompress_ctx;
+        char *decompress_buffer;
+        size_t decompress_buffer_size;
+        bool decompress_pending;
+#endif
+} HttpUpload;
+
+static HttpUpload* http_upload_free(HttpUpload *u) {
+        if (!u)
+                return NULL;
+
+        source_free(u->source);
+        free(u->data);
+#if HAVE_ZSTD
+        ZSTD_freeDCtx(u->decompress_ctx);
+        free(u->decompress_buffer);
+#endif
+        return mfree(u);
+}
+
+static int request_meta(void **connection_cls, struct MHD_Connection *connection, int fd, char *hostname, bool compressed) {
+        HttpUpload *u;
+        RemoteWorker *w;
+        Writer *writer = NULL;
         int r;
 
         assert(connection_cls);
         if (*connection_cls)
                 return 0;
 
-        r = journal_remote_get_writer(journal_remote_server_global, hostname, &writer);
-        if (r < 0)
-                return log_warning_errno(r, "Failed to get writer for source %s: %m",
-                                         hostname);
+        /* With workers, the writer is looked up by the worker when the first data arrives */
+        w = journal_remote_server_pick_worker(journal_remote_server_global, hostname);
+        if (!w) {
+                r = journal_remote_get_writer(journal_remote_server_global, hostname, &writer);
+                if (r < 0)
+                        return log_warning_errno(r, "Failed to get writer for source %s: %m",
+                                                 hostname);
+        }
+
+        u = new0(HttpUpload, 1);
+        if (!u) {
+                writer_unref(writer);
+                return log_oom();
+        }
 
-        source = source_new(fd, true, hostname, writer);
-        if (!source) {
+        u->source = source_new(fd, true, hostname, writer);
+        if (!u->source) {
                 writer_unref(writer);
+                free(u);
                 return log_oom();
         }
 
-        log_debug("Added RemoteSource as connection metadata %p", source);
+        u->worker = w;
+        u->connection = connection;
+
+        if (compressed) {
+#if HAVE_ZSTD
+                u->decompress_ctx = ZSTD_createDCtx();
+                u->decompress_buffer_size = ZSTD_DStreamOutSize();
+                u->decompress_buffer = malloc(u->decompress_buffer_size);
+                if (!u->decompress_ctx || !u->decompress_buffer) {
+                        http_upload_free(u);
+                        return log_oom();
+                }
+#else
+                assert_not_reached("Compressed upload without zstd support");
+#endif
+        }
+
+        log_debug("Added RemoteSource as connection metadata %p", u);
 
-        *connection_cls = source;
+        *connection_cls = u;
         return 0;
 }
 
+static void http_upload_free_on_worker(RemoteServer *s, void *userdata) {
+        http_upload_free(userdata);
+}
+
 static void request_meta_free(void *cls,
                               struct MHD_Connection *connection,
                               void **connection_cls,
                               enum MHD_RequestTerminationCode toe) {
-        RemoteSource *s;
+        HttpUpload *u;
 
         assert(connection_cls);
-        s = *connection_cls;
+        u = *connection_cls;
+
+        if (u) {
+                log_debug("Cleaning up connection metadata %p", u);
+
+                /* The writer is shared with other sources of the worker, hence drop our reference there */
+                if (u->worker)
+                        remote_worker_queue(u->worker, &u->job, http_upload_free_on_worker, u);
+                else
+                        http_upload_free(u);
 
-        if (s) {
-                log_debug("Cleaning up connection metadata %p", s);
-                source_free(s);
                 *connection_cls = NULL;
         }
 }
 
+static int http_upload_push_plain(RemoteSource *source, const char *data, size_t size, bool compress, bool seal) {
+        int r;
+
+        assert(source);
+
+        if (size > 0) {
+                r = journal_importer_push_data(&source->importer, data, size);
+                if (r < 0)
+                        return r;
+        }
+
+        for (;;) {
+                r = process_source(source, compress, seal);
+                if (r == -EAGAIN)
+                        return 0;
+                if (r < 0)
+                        return r;
+        }
+}
+
+#if HAVE_ZSTD
+static int http_upload_push_zstd(HttpUpload *u, const char *data, size_t size, bool compress, bool seal) {
+        ZSTD_inBuffer input = {
+                .src = data,
+                .size = size,
+        };
+        bool more = size > 0;
+        int r;
+
+        assert(u);
+        assert(u->decompress_ctx);
+
+        /* Decompress in pieces, and process each of them right away, so that the importer doesn't need to hold more
+         * than one piece plus an incomplete entry, however well the data compresses. */
+        while (more) {
+                ZSTD_outBuffer output = {
+                        .dst = u->decompress_buffer,
+                        .size = u->decompress_buffer_size,
+                };
+                size_t k;
+
+                k = ZSTD_decompressStream(u->decompress_ctx, &output, &input);
+                if (ZSTD_isError(k)) {
+                        log_debug("Failed to decompress upload data: %s", ZSTD_getErrorName(k));
+                        return -EBADMSG;
+                }
+
+                /* 0 means exactly that a frame is complete, another one might follow */
+                u->decompress_pending = k > 0;
+
+                r = http_upload_push_plain(u->source, u->decompress_buffer, output.pos, compress, seal);
+                if (r < 0)
+                        return r;
+
+                /* If the output buffer was filled up, there might be more output even without more input */
+                more = input.pos < input.size || output.pos == output.size;
+        }
+
+        return http_upload_push_plain(u->source, NULL, 0, compress, seal);
+}
+#endif
+
+static int http_upload_push(HttpUpload *u, const char *data, size_t size, bool compress, bool seal) {
+        assert(u);
+
+#if HAVE_ZSTD
+        if (u->decompress_ctx)
+                return http_upload_push_zstd(u, data, size, compress, seal);
+#endif
+
+        return http_upload_push_plain(u->source, data, size, compress, seal);
+}
+
+static void http_upload_process_on_worker(RemoteServer *s, void *userdata) {
+        HttpUpload *u = userdata;
+        int r = 0;
+
+        assert(u);
+
+        if (!u->source->writer) {
+                r = journal_remote_get_writer(s, u->source->importer.name, &u->source->writer);
+                if (r < 0)
+                        log_warning_errno(r, "Failed to get writer for source %s: %m", u->source->importer.name);
+        }
+
+        if (r >= 0)
+                r = http_upload_push(u, u->data, u->size, s->compress, s->seal);
+
+        u->error = r;
+        u->data = mfree(u->data);
+        u->size = 0;
+
+        /* Don't touch the upload after this, the main thread takes over again */
+        MHD_resume_connection(u->connection);
+}
+
+static int http_upload_respond_error(struct MHD_Connection *connection, int error) {
+        assert(error < 0);
+
+        log_warning("Failed to process data for connection %p", connection);
+
+        if (error == -ENOMEM)
+                return mhd_respond_oom(connection);
+        if (error == -E2BIG)
+                return mhd_respondf(connection,
+                                    error, MHD_HTTP_PAYLOAD_TOO_LARGE,
+                                    "Entry is too large, maximum is " STRINGIFY(DATA_SIZE_MAX) " bytes.");
+
+        return mhd_respondf(connection,
+                            error, MHD_HTTP_UNPROCESSABLE_ENTITY,
+                            "Processing failed: %m.");
+}
+
 static int process_http_upload(
                 struct MHD_Connection *connection,
                 const char *upload_data,
                 size_t *upload_data_size,
-                RemoteSource *source) {
+                HttpUpload *u) {
 
-        bool finished = false;
+        RemoteSource *source;
         size_t remaining;
         int r;
 
-        assert(source);
+        assert(u);
+        assert(u->source);
+
+        source = u->source;
 
         log_trace("%s: connection %p, %zu bytes",
                   __func__, connection, *upload_data_size);
 
+        /* Processing of the previous chunk failed on the worker */
+        if (u->error < 0)
+                return http_upload_respond_error(connection, u->error);
+
         if (*upload_data_size) {
                 log_trace("Received %zu bytes", *upload_data_size);
 
-                r = journal_importer_push_data(&source->importer,
-                                               upload_data, *upload_data_size);
-                if (r < 0)
-                        return mhd_respond_oom(connection);
+                if (u->worker) {
+                        /* Hand the data over to the worker, and don't let µhttpd bother us with this
+                         * connection until the worker is done with it */
+                        u->data = memdup(upload_data, *upload_data_size);
+                        if (!u->data)
+                                return mhd_respond_oom(connection);
 
-                *upload_data_size = 0;
-        } else
-                finished = true;
+                        u->size = *upload_data_size;
+                        *upload_data_size = 0;
 
-        for (;;) {
-                r = process_source(source,
-                                   journal_remote_server_global->compress,
-                                   journal_remote_server_global->seal);
-                if (r == -EAGAIN)
-                        break;
-                else if (r < 0) {
-                        log_warning("Failed to process data for connection %p", connection);
-                        if (r == -E2BIG)
-                                return mhd_respondf(connection,
-                                                    r, MHD_HTTP_PAYLOAD_TOO_LARGE,
-                                                    "Entry is too large, maximum is " STRINGIFY(DATA_SIZE_MAX) " bytes.");
-                        else
-                                return mhd_respondf(connection,
-                                                    r, MHD_HTTP_UNPROCESSABLE_ENTITY,
-                                                    "Processing failed: %m.");
+                        MHD_suspend_connection(connection);
+                        remote_worker_queue(u->worker, &u->job, http_upload_process_on_worker, u);
+                        return MHD_YES;
                 }
-        }
 
-        if (!finished)
+                r = http_upload_push(u, upload_data, *upload_data_size,
+                                     journal_remote_server_global->compress,
+                                     journal_remote_server_global->seal);
+                *upload_data_size = 0;
+                if (r < 0)
+                        return http_upload_respond_error(connection, r);
+
                 return MHD_YES;
+        }
+
+        /* The upload is finished. The worker processed everything it got already, but on the main thread let's
+         * make sure nothing is left over. */
+        if (!u->worker) {
+                r = http_upload_push(u, NULL, 0,
+                                     journal_remote_server_global->compress,
+                                     journal_remote_server_global->seal);
+                if (r < 0)
+                        return http_upload_respond_error(connection, r);
+        }
 
-        /* The upload is finished */
+#if HAVE_ZSTD
+        if (u->decompress_pending) {
+                log_warning("Premature EOF in compressed data.");
+                return mhd_respond(connection, MHD_HTTP_EXPECTATION_FAILED,
+                                   "Premature EOF in compressed data.");
+        }
+#endif
 
         remaining = journal_importer_bytes_remaining(&source->importer);
         if (remaining > 0) {
@@ -255,6 +467,7 @@ static int request_handler(
         const char *header;
         int r, code, fd;
         _cleanup_free_ char *hostname = NULL;
+        bool compressed = false;
 
         assert(connection);
         assert(connection_cls);
@@ -276,9 +489,22 @@ static int request_handler(
 
         header = MHD_lookup_connection_value(connection,
                                              MHD_HEADER_KIND, "Content-Type");
-        if (!header || !streq(header, "application/vnd.fdo.journal"))
+        /* Both formats may be mixed on the same stream, the importer tells them apart by itself */
+        if (!header || !STR_IN_SET(header, "application/vnd.fdo.journal", "application/vnd.fdo.journal-binary"))
                 return mhd_respond(connection, MHD_HTTP_UNSUPPORTED_MEDIA_TYPE,
-                                   "Content-Type: application/vnd.fdo.journal is required.");
+                                   "Content-Type: application/vnd.fdo.journal or application/vnd.fdo.journal-binary is required.");
+
+        header = MHD_lookup_connection_value(connection,
+                                             MHD_HEADER_KIND, "Content-Encoding");
+        if (header && !streq(header, "identity")) {
+#if HAVE_ZSTD
+                if (!streq(header, "zstd"))
+#endif
+                        return mhd_respond(connection, MHD_HTTP_UNSUPPORTED_MEDIA_TYPE,
+                                           "Unsupported Content-Encoding.");
+
+                compressed = true;
+        }
 
         {
                 const union MHD_ConnectionInfo *ci;
@@ -308,7 +534,7 @@ static int request_handler(
 
         assert(hostname);
 
-        r = request_meta(connection_cls, fd, hostname);
+        r = request_meta(connection_cls, connection, fd, hostname, compressed);
         if (r == -ENOMEM)
                 return respond_oom(connection);
         else if (r < 0)
@@ -364,6 +590,10 @@ static int setup_microhttpd_server(RemoteServer *s,
         flags |= MHD_USE_PEDANTIC_CHECKS;
 #endif
 
+        /* Connections are suspended while the workers are processing their data */
+        if (s->n_workers > 0)
+                flags |= MHD_ALLOW_SUSPEND_RESUME;
+
         if (key) {
                 assert(cert);
 
@@ -563,6 +793,11 @@ static int create_remoteserver(
         if (r < 0)
                 return log_error_errno(r, "Failed to set up signals: %m");
 
+        /* After the signals are blocked, so that the threads don't get them */
+        r = journal_remote_server_start_workers(s, arg_workers);
+        if (r < 0)
+                return r;
+
         n = sd_listen_fds(true);
         if (n < 0)
                 return log_error_errno(n, "Failed to read listening file descriptors from environment: %m");
@@ -716,6 +951,7 @@ static int parse_config(void) {
         const ConfigTableItem items[] = {
                 { "Remote",  "Seal",                   config_parse_bool,             0, &arg_seal       },
                 { "Remote",  "SplitMode",              config_parse_write_split_mode, 0, &arg_split_mode },
+                { "Remote",  "Workers",                config_parse_unsigned,         0, &arg_workers    },
                 { "Remote",  "ServerKeyFile",          config_parse_path,             0, &arg_key        },
                 { "Remote",  "ServerCertificateFile",  config_parse_path,             0, &arg_cert       },
                 { "Remote",  "TrustedCertificateFile", config_parse_path,             0, &arg_trust      },
@@ -757,6 +993,7 @@ static int help(void) {
                "     --gnutls-log=CATEGORY...\n"
                "                            Specify a list of gnutls logging categories\n"
                "     --split-mode=none|host How many output files to create\n"
+               "     --workers=N            Number of threads to process connections on\n"
                "\nNote: file descriptors from sd_listen_fds() will be consumed, too.\n"
                "\nSee the %s for details.\n"
                , program_invocation_short_name
@@ -781,6 +1018,7 @@ static int parse_argv(int argc, char *argv[]) {
                 ARG_CERT,
                 ARG_TRUST,
                 ARG_GNUTLS_LOG,
+                ARG_WORKERS,
         };
 
         static const struct option options[] = {
@@ -799,6 +1037,7 @@ static int parse_argv(int argc, char *argv[]) {
                 { "cert",         required_argument, NULL, ARG_CERT         },
                 { "trust",        required_argument, NULL, ARG_TRUST        },
                 { "gnutls-log",   required_argument, NULL, ARG_GNUTLS_LOG   },
+                { "workers",      required_argument, NULL, ARG_WORKERS      },
                 {}
         };
 
@@ -973,6 +1212,13 @@ static int parse_argv(int argc, char *argv[]) {
 #endif
                 }
 
+                case ARG_WORKERS:
+                        r = safe_atou(optarg, &arg_workers);
+                        if (r < 0 || arg_workers == 0)
+                                return log_error_errno(SYNTHETIC_ERRNO(EINVAL),
+                                                       "Failed to parse --workers= parameter: %s", optarg);
+                        break;
+
                 case '?':
                         return -EINVAL;
 
@@ -1021,8 +1267,18 @@ static int parse_argv(int argc, char *argv[]) {
                 return log_error_errno(SYNTHETIC_ERRNO(EINVAL),
                                        "For SplitMode=host, output must be a directory.");
 
-        log_debug("Full config: SplitMode=%s Key=%s Cert=%s Trust=%s",
+        if (arg_workers > WORKERS_MAX)
+                return log_error_errno(SYNTHETIC_ERRNO(EINVAL),
+                                       "At most %u workers are supported.", WORKERS_MAX);
+
+        if (arg_workers > 1 && arg_split_mode != JOURNAL_WRITE_SPLIT_HOST) {
+                log_warning("Workers= is only supported with SplitMode=host, ignoring.");
+                arg_workers = 1;
+        }
+
+        log_debug("Full config: SplitMode=%s Workers=%u Key=%s Cert=%s Trust=%s",
                   journal_write_split_mode_to_string(arg_split_mode),
+                  arg_workers,
                   strna(arg_key),
                   strna(arg_cert),
                   strna(arg_trust));
@@ -1119,10 +1375,13 @@ int main(int argc, char **argv) {
                 }
         }
 
+        /* Let the workers finish, so that we know how much they wrote */
+        journal_remote_server_stop_workers(&s);
+
         sd_notifyf(false,
                    "STOPPING=1\n"
-                   "STATUS=Shutting down after writing %" PRIu64 " entries...", s.event_count);
-        log_info("Finishing after writing %" PRIu64 " entries", s.event_count);
+                   "STATUS=Shutting down after writing %" PRIu64 " entries...", journal_remote_server_event_count(&s));
+        log_info("Finishing after writing %" PRIu64 " entries", journal_remote_server_event_count(&s));
 
         journal_remote_server_destroy(&s);
 
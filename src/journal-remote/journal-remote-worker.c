@@ -0,0 +1,201 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+
+#include "sd-event.h"
+
+#include "alloc-util.h"
+#include "fd-util.h"
+#include "journal-remote-worker.h"
+#include "journal-remote.h"
+#include "log.h"
+#include "macro.h"
+
+/* A worker is a thread with its own event loop, which owns a subset of the sources and all writers used by them.
+ * With SplitMode=host, sources are assigned to workers by host name, hence every output file is written by exactly
+ * one thread, and no locking is needed anywhere but in the job queue. All functions here must be called from the
+ * main thread. */
+
+struct RemoteWorker {
+        RemoteServer server;
+        unsigned index;
+
+        pthread_t thread;
+        bool running;
+
+        int wakeup_fd;
+        sd_event_source *wakeup_event_source;
+
+        pthread_mutex_t mutex;
+        RemoteWorkerJob *jobs, *jobs_tail;
+        bool stop;
+};
+
+static void worker_run_jobs(RemoteWorker *w, RemoteWorkerJob *j) {
+        assert(w);
+
+        while (j) {
+                RemoteWorkerJob *next = j->next;
+
+                /* The function might free the job, hence don't touch it afterwards */
+                j->func(&w->server, j->userdata);
+                j = next;
+        }
+}
+
+static int dispatch_wakeup(sd_event_source *es, int fd, uint32_t revents, void *userdata) {
+        RemoteWorker *w = userdata;
+        RemoteWorkerJob *j;
+        eventfd_t value;
+        bool stop;
+
+        assert(w);
+
+        (void) eventfd_read(fd, &value);
+
+        assert_se(pthread_mutex_lock(&w->mutex) == 0);
+        j = TAKE_PTR(w->jobs);
+        w->jobs_tail = NULL;
+        stop = w->stop;
+        assert_se(pthread_mutex_unlock(&w->mutex) == 0);
+
+        worker_run_jobs(w, j);
+
+        if (stop)
+                return sd_event_exit(w->server.events, 0);
+
+        return 0;
+}
+
+static void *worker_thread(void *p) {
+        RemoteWorker *w = p;
+        int r;
+
+        r = sd_event_loop(w->server.events);
+        if (r < 0)
+                log_error_errno(r, "Event loop of worker %u failed: %m", w->index);
+
+        return NULL;
+}
+
+int remote_worker_new(RemoteServer *parent, unsigned index, RemoteWorker **ret) {
+        _cleanup_(remote_worker_freep) RemoteWorker *w = NULL;
+        int r;
+
+        assert(parent);
+        assert(ret);
+
+        w = new0(RemoteWorker, 1);
+        if (!w)
+                return log_oom();
+
+        w->index = index;
+        w->wakeup_fd = -1;
+        assert_se(pthread_mutex_init(&w->mutex, NULL) == 0);
+
+        r = journal_remote_server_init_worker(&w->server, parent);
+        if (r < 0)
+                return r;
+
+        w->wakeup_fd = eventfd(0, EFD_CLOEXEC|EFD_NONBLOCK);
+        if (w->wakeup_fd < 0)
+                return log_error_errno(errno, "Failed to allocate eventfd for worker: %m");
+
+        r = sd_event_add_io(w->server.events, &w->wakeup_event_source, w->wakeup_fd, EPOLLIN, dispatch_wakeup, w);
+        if (r < 0)
+                return log_error_errno(r, "Failed to watch worker eventfd: %m");
+
+        /* The signals were blocked already, hence the thread inherits that */
+        r = pthread_create(&w->thread, NULL, worker_thread, w);
+        if (r != 0)
+                return log_error_errno(r, "Failed to start worker thread: %m");
+
+        w->running = true;
+
+        log_debug("Started worker %u.", index);
+
+        *ret = TAKE_PTR(w);
+        return 0;
+}
+
+void remote_worker_stop(RemoteWorker *w) {
+        RemoteWorkerJob *j;
+
+        assert(w);
+
+        if (!w->running)
+                return;
+
+        assert_se(pthread_mutex_lock(&w->mutex) == 0);
+        w->stop = true;
+        assert_se(pthread_mutex_unlock(&w->mutex) == 0);
+
+        (void) eventfd_write(w->wakeup_fd, 1);
+
+        assert_se(pthread_join(w->thread, NULL) == 0);
+        w->running = false;
+
+        /* The thread normally processed everything before exiting, but not if its event loop failed. Every job
+         * must be run exactly once, and the thread is gone, hence do it here. */
+        j = TAKE_PTR(w->jobs);
+        w->jobs_tail = NULL;
+        worker_run_jobs(w, j);
+
+        log_debug("Stopped worker %u.", w->index);
+}
+
+RemoteWorker* remote_worker_free(RemoteWorker *w) {
+        if (!w)
+                return NULL;
+
+        remote_worker_stop(w);
+
+        w->wakeup_event_source = sd_event_source_unref(w->wakeup_event_source);
+        safe_close(w->wakeup_fd);
+
+        if (w->server.events)
+                journal_remote_server_destroy(&w->server);
+
+        assert_se(pthread_mutex_destroy(&w->mutex) == 0);
+
+        return mfree(w);
+}
+
+void remote_worker_queue(RemoteWorker *w, RemoteWorkerJob *job, remote_worker_func_t func, void *userdata) {
+        assert(w);
+        assert(job);
+        assert(func);
+
+        *job = (RemoteWorkerJob) {
+                .func = func,
+                .userdata = userdata,
+        };
+
+        /* If the thread is gone already, nothing else accesses the worker's state anymore, hence just do the
+         * work right away */
+        if (!w->running) {
+                func(&w->server, userdata);
+                return;
+        }
+
+        assert_se(pthread_mutex_lock(&w->mutex) == 0);
+
+        if (w->jobs_tail)
+                w->jobs_tail->next = job;
+        else
+                w->jobs = job;
+        w->jobs_tail = job;
+
+        assert_se(pthread_mutex_unlock(&w->mutex) == 0);
+
+        (void) eventfd_write(w->wakeup_fd, 1);
+}
+
+uint64_t remote_worker_event_count(RemoteWorker *w) {
+        assert(w);
+
+        /* Only consistent once the worker has been stopped */
+        return w->server.event_count;
+}
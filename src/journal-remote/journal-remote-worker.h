@@ -0,0 +1,31 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+#pragma once
+
+#include <inttypes.h>
+
+#include "macro.h"
+
+typedef struct RemoteServer RemoteServer;
+typedef struct RemoteWorker RemoteWorker;
+typedef struct RemoteWorkerJob RemoteWorkerJob;
+
+/* Called on the worker thread, with the private RemoteServer of the worker, which owns all sources and writers of
+ * that thread. */
+typedef void (*remote_worker_func_t)(RemoteServer *s, void *userdata);
+
+/* Jobs are embedded in the objects they act on, so that queueing them cannot fail. A job must stay around until its
+ * function was called, which may free it. */
+struct RemoteWorkerJob {
+        remote_worker_func_t func;
+        void *userdata;
+        RemoteWorkerJob *next;
+};
+
+int remote_worker_new(RemoteServer *parent, unsigned index, RemoteWorker **ret);
+RemoteWorker* remote_worker_free(RemoteWorker *w);
+DEFINE_TRIVIAL_CLEANUP_FUNC(RemoteWorker*, remote_worker_free);
+
+void remote_worker_stop(RemoteWorker *w);
+void remote_worker_queue(RemoteWorker *w, RemoteWorkerJob *job, remote_worker_func_t func, void *userdata);
+
+uint64_t remote_worker_event_count(RemoteWorker *w);
@@ -58,6 +58,7 @@ DEFINE_TRIVIAL_REF_UNREF_FUNC(Writer, writer, writer_free);
 
 int writer_write(Writer *w,
                  struct iovec_wrapper *iovw,
+                 const JournalFilePayload *payloads,
                  dual_timestamp *ts,
                  bool compress,
                  bool seal) {
@@ -75,9 +76,9 @@ int writer_write(Writer *w,
                         return r;
         }
 
-        r = journal_file_append_entry(w->journal, ts, NULL,
-                                      iovw->iovec, iovw->count,
-                                      &w->seqnum, NULL, NULL);
+        r = journal_file_append_entry_full(w->journal, ts, NULL,
+                                           iovw->iovec, payloads, iovw->count,
+                                           &w->seqnum, NULL, NULL);
         if (r >= 0) {
                 if (w->server)
                         w->server->event_count += 1;
@@ -93,9 +94,9 @@ int writer_write(Writer *w,
                 log_debug("%s: Successfully rotated journal", w->journal->path);
 
         log_debug("Retrying write.");
-        r = journal_file_append_entry(w->journal, ts, NULL,
-                                      iovw->iovec, iovw->count,
-                                      &w->seqnum, NULL, NULL);
+        r = journal_file_append_entry_full(w->journal, ts, NULL,
+                                           iovw->iovec, payloads, iovw->count,
+                                           &w->seqnum, NULL, NULL);
         if (r < 0)
                 return r;
 
@@ -27,6 +27,7 @@ DEFINE_TRIVIAL_CLEANUP_FUNC(Writer*, writer_unref);
 
 int writer_write(Writer *s,
                  struct iovec_wrapper *iovw,
+                 const JournalFilePayload *payloads,
                  dual_timestamp *ts,
                  bool compress,
                  bool seal);
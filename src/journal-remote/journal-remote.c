@@ -22,6 +22,7 @@
 #include "macro.h"
 #include "parse-util.h"
 #include "process-util.h"
+#include "siphash24.h"
 #include "socket-util.h"
 #include "stdio-util.h"
 #include "string-util.h"
@@ -337,6 +338,93 @@ int journal_remote_server_init(
         return 0;
 }
 
+int journal_remote_server_init_worker(RemoteServer *s, const RemoteServer *parent) {
+        int r;
+
+        assert(s);
+        assert(parent);
+
+        /* Sets up the private state of a worker thread, see journal-remote-worker.c. The worker gets its own
+         * event loop and writers, everything else is the same as for the main server. */
+
+        s->split_mode = parent->split_mode;
+        s->compress = parent->compress;
+        s->seal = parent->seal;
+        s->output = parent->output;
+
+        r = sd_event_new(&s->events);
+        if (r < 0)
+                return log_error_errno(r, "Failed to allocate event loop: %m");
+
+        r = init_writer_hashmap(s);
+        if (r < 0)
+                return r;
+
+        return 0;
+}
+
+int journal_remote_server_start_workers(RemoteServer *s, unsigned n) {
+        unsigned i;
+        int r;
+
+        assert(s);
+        assert(s->n_workers == 0);
+
+        /* With SplitMode=none all sources write to the same file, hence there's nothing to distribute */
+        if (n <= 1 || s->split_mode != JOURNAL_WRITE_SPLIT_HOST)
+                return 0;
+
+        s->workers = new0(RemoteWorker*, n);
+        if (!s->workers)
+                return log_oom();
+
+        for (i = 0; i < n; i++) {
+                r = remote_worker_new(s, i, s->workers + i);
+                if (r < 0)
+                        return r;
+
+                s->n_workers++;
+        }
+
+        log_debug("Distributing connections over %u worker threads.", n);
+        return 0;
+}
+
+void journal_remote_server_stop_workers(RemoteServer *s) {
+        size_t i;
+
+        assert(s);
+
+        for (i = 0; i < s->n_workers; i++)
+                remote_worker_stop(s->workers[i]);
+}
+
+RemoteWorker* journal_remote_server_pick_worker(RemoteServer *s, const char *host) {
+        static const uint8_t key[16] = {};
+
+        assert(s);
+
+        if (s->n_workers == 0)
+                return NULL;
+
+        /* All sources of the same host must end up in the same thread, as they share the writer */
+        assert(host);
+        return s->workers[siphash24(host, strlen(host), key) % s->n_workers];
+}
+
+uint64_t journal_remote_server_event_count(RemoteServer *s) {
+        uint64_t n;
+        size_t i;
+
+        assert(s);
+
+        n = s->event_count;
+        for (i = 0; i < s->n_workers; i++)
+                n += remote_worker_event_count(s->workers[i]);
+
+        return n;
+}
+
 #if HAVE_MICROHTTPD
 static void MHDDaemonWrapper_free(MHDDaemonWrapper *d) {
         MHD_stop_daemon(d->daemon);
@@ -349,6 +437,11 @@ static void MHDDaemonWrapper_free(MHDDaemonWrapper *d) {
 RemoteServer* journal_remote_server_destroy(RemoteServer *s) {
         size_t i;
 
+        /* Let the workers finish what they are doing first, so that the connections they are working on stay
+         * valid until they are done with them. The workers' state — in particular their writers — is only
+         * freed after the daemons, since the HTTP sources of the connections still reference it. */
+        journal_remote_server_stop_workers(s);
+
 #if HAVE_MICROHTTPD
         hashmap_free_with_destructor(s->daemons, MHDDaemonWrapper_free);
 #endif
@@ -361,6 +454,10 @@ RemoteServer* journal_remote_server_destroy(RemoteServer *s) {
         writer_unref(s->_single_writer);
         hashmap_free(s->writers);
 
+        for (i = 0; i < s->n_workers; i++)
+                remote_worker_free(s->workers[i]);
+        free(s->workers);
+
         sd_event_source_unref(s->sigterm_event);
         sd_event_source_unref(s->sigint_event);
         sd_event_source_unref(s->listen_event);
@@ -428,7 +525,7 @@ static int dispatch_raw_source_until_block(sd_event_source *event,
         /* Make sure event stays around even if source is destroyed */
         sd_event_source_ref(event);
 
-        r = journal_remote_handle_raw_source(event, source->importer.fd, EPOLLIN, journal_remote_server_global);
+        r = journal_remote_handle_raw_source(event, source->importer.fd, EPOLLIN, source->writer->server);
         if (r != 1)
                 /* No more data for now */
                 sd_event_source_set_enabled(event, SD_EVENT_OFF);
@@ -448,7 +545,7 @@ static int dispatch_raw_source_event(sd_event_source *event,
         assert(source->event);
         assert(source->buffer_event);
 
-        r = journal_remote_handle_raw_source(event, fd, EPOLLIN, journal_remote_server_global);
+        r = journal_remote_handle_raw_source(event, fd, EPOLLIN, source->writer->server);
         if (r == 1)
                 /* Might have more data. We need to rerun the handler
                  * until we are sure the buffer is exhausted. */
@@ -461,7 +558,7 @@ static int dispatch_blocking_source_event(sd_event_source *event,
                                           void *userdata) {
         RemoteSource *source = userdata;
 
-        return journal_remote_handle_raw_source(event, source->importer.fd, EPOLLIN, journal_remote_server_global);
+        return journal_remote_handle_raw_source(event, source->importer.fd, EPOLLIN, source->writer->server);
 }
 
 static int accept_connection(const char* type, int fd,
@@ -511,11 +608,26 @@ static int accept_connection(const char* type, int fd,
         }
 }
 
+typedef struct RawSourceJob {
+        RemoteWorkerJob job;
+        int fd;
+        char *name;
+} RawSourceJob;
+
+static void add_raw_source_on_worker(RemoteServer *s, void *userdata) {
+        RawSourceJob *j = userdata;
+
+        /* Same as on the main thread, errors are logged and the connection is dropped */
+        (void) journal_remote_add_source(s, j->fd, j->name, true);
+        free(j);
+}
+
 static int dispatch_raw_connection_event(sd_event_source *event,
                                          int fd,
                                          uint32_t revents,
                                          void *userdata) {
         RemoteServer *s = userdata;
+        RemoteWorker *w;
         int fd2;
         SocketAddress addr = {
                 .size = sizeof(union sockaddr_union),
@@ -527,5 +639,22 @@ static int dispatch_raw_connection_event(sd_event_source *event,
         if (fd2 < 0)
                 return fd2;
 
+        w = journal_remote_server_pick_worker(s, hostname);
+        if (w) {
+                RawSourceJob *j;
+
+                j = new(RawSourceJob, 1);
+                if (!j) {
+                        safe_close(fd2);
+                        free(hostname);
+                        return log_oom();
+                }
+
+                j->fd = fd2;
+                j->name = hostname;
+                remote_worker_queue(w, &j->job, add_raw_source_on_worker, j);
+                return 0;
+        }
+
         return journal_remote_add_source(s, fd2, hostname, true);
 }
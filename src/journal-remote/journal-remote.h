@@ -5,6 +5,7 @@
 
 #include "hashmap.h"
 #include "journal-remote-parse.h"
+#include "journal-remote-worker.h"
 #include "journal-remote-write.h"
 
 #if HAVE_MICROHTTPD
@@ -36,6 +37,9 @@ struct RemoteServer {
 #if HAVE_MICROHTTPD
         Hashmap *daemons;
 #endif
+        RemoteWorker **workers;
+        size_t n_workers;
+
         const char *output;                    /* either the output file or directory */
 
         JournalWriteSplitMode split_mode;
@@ -52,6 +56,13 @@ int journal_remote_server_init(
                 bool compress,
                 bool seal);
 
+int journal_remote_server_init_worker(RemoteServer *s, const RemoteServer *parent);
+
+int journal_remote_server_start_workers(RemoteServer *s, unsigned n);
+void journal_remote_server_stop_workers(RemoteServer *s);
+RemoteWorker* journal_remote_server_pick_worker(RemoteServer *s, const char *host);
+uint64_t journal_remote_server_event_count(RemoteServer *s);
+
 int journal_remote_get_writer(RemoteServer *s, const char *host, Writer **writer);
 
 int journal_remote_add_source(RemoteServer *s, int fd, char* name, bool own_name);
@@ -251,6 +251,26 @@ static inline void check_update_watchdog(Uploader *u) {
         }
 }
 
+static bool batch_complete(Uploader *u) {
+        assert(u);
+
+        if (u->batch_entries_max > 0 && u->batch_entries >= u->batch_entries_max)
+                return true;
+
+        if (u->batch_usec > 0 && u->batch_start > 0 &&
+            now(CLOCK_MONOTONIC) >= usec_add(u->batch_start, u->batch_usec))
+                return true;
+
+        return false;
+}
+
+static void batch_reset(Uploader *u) {
+        assert(u);
+
+        u->batch_entries = 0;
+        u->batch_start = 0;
+}
+
 static size_t journal_input_callback(void *buf, size_t size, size_t nmemb, void *userp) {
         Uploader *u = userp;
         int r;
@@ -265,8 +285,23 @@ static size_t journal_input_callback(void *buf, size_t size, size_t nmemb, void
 
         j = u->journal;
 
+        if (u->batch_start == 0)
+                u->batch_start = now(CLOCK_MONOTONIC);
+
         while (j && filled < size * nmemb) {
                 if (u->entry_state == ENTRY_DONE) {
+                        if (batch_complete(u)) {
+                                /* Finish this upload once everything written so far has been passed on, and keep
+                                 * u->uploading set so that the next one is started right away. */
+                                if (filled == 0) {
+                                        log_debug("Batch of %zu entries complete, finishing upload.",
+                                                  u->batch_entries);
+                                        batch_reset(u);
+                                }
+
+                                break;
+                        }
+
                         r = sd_journal_next(j);
                         if (r < 0) {
                                 log_error_errno(r, "Failed to move to next entry in journal: %m");
@@ -280,6 +315,7 @@ static size_t journal_input_callback(void *buf, size_t size, size_t nmemb, void
                                 }
 
                                 u->uploading = false;
+                                batch_reset(u);
 
                                 break;
                         }
@@ -299,6 +335,8 @@ static size_t journal_input_callback(void *buf, size_t size, size_t nmemb, void
                         /* This means that all available space was used up */
                         break;
 
+                u->batch_entries++;
+
                 log_debug("Entry %zu (%s) has been uploaded.",
                           u->entries_sent, u->current_cursor);
         }
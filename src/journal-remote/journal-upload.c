@@ -48,6 +48,9 @@ static const char *arg_machine = NULL;
 static bool arg_merge = false;
 static int arg_follow = -1;
 static const char *arg_save_state = NULL;
+static bool arg_compress = false;
+static unsigned arg_batch_entries = 0;
+static usec_t arg_batch_timeout_usec = 0;
 
 static void close_fd_input(Uploader *u);
 
@@ -163,6 +166,89 @@ static int load_cursor_state(Uploader *u) {
         return 0;
 }
 
+#if HAVE_ZSTD
+static size_t compress_input_callback(void *buf, size_t size, size_t nmemb, void *userp) {
+        Uploader *u = userp;
+        ZSTD_outBuffer output;
+
+        assert(u);
+        assert(u->plain_callback);
+        assert(nmemb <= SSIZE_MAX / size);
+
+        if (u->compress_done) {
+                /* The frame was completed by the previous call, now signal the end of the upload */
+                u->compress_done = false;
+                return 0;
+        }
+
+        output = (ZSTD_outBuffer) {
+                .dst = buf,
+                .size = size * nmemb,
+        };
+
+        while (output.pos < output.size) {
+                ZSTD_inBuffer input;
+                ZSTD_EndDirective mode;
+                size_t remaining;
+
+                if (u->compress_pos >= u->compress_size && !u->compress_eof) {
+                        size_t n;
+
+                        n = u->plain_callback(u->compress_buffer, 1, JOURNAL_UPLOAD_COMPRESS_BUFFER_SIZE, u->plain_data);
+                        if (n == CURL_READFUNC_ABORT)
+                                return CURL_READFUNC_ABORT;
+
+                        u->compress_pos = 0;
+                        u->compress_size = n;
+                        u->compress_eof = n == 0;
+                }
+
+                /* If the input didn't fill our buffer there's nothing more to read right now, so flush what we have
+                 * instead of waiting for more input, which might take a while when following. */
+                if (u->compress_eof)
+                        mode = ZSTD_e_end;
+                else if (u->compress_size < JOURNAL_UPLOAD_COMPRESS_BUFFER_SIZE)
+                        mode = ZSTD_e_flush;
+                else
+                        mode = ZSTD_e_continue;
+
+                input = (ZSTD_inBuffer) {
+                        .src = u->compress_buffer,
+                        .size = u->compress_size,
+                        .pos = u->compress_pos,
+                };
+
+                remaining = ZSTD_compressStream2(u->compress_ctx, &output, &input, mode);
+                if (ZSTD_isError(remaining)) {
+                        log_error("Failed to compress upload data: %s", ZSTD_getErrorName(remaining));
+                        return CURL_READFUNC_ABORT;
+                }
+
+                u->compress_pos = input.pos;
+
+                if (remaining > 0 || input.pos < input.size)
+                        continue;
+
+                if (mode == ZSTD_e_end) {
+                        u->compress_eof = false;
+                        u->compress_pos = u->compress_size = 0;
+
+                        if (output.pos == 0)
+                                return 0;
+
+                        u->compress_done = true;
+                        break;
+                }
+
+                if (mode == ZSTD_e_flush && output.pos > 0)
+                        break;
+        }
+
+        log_debug("%s: compressed %zu bytes", __func__, output.pos);
+        return output.pos;
+}
+#endif
+
 int start_upload(Uploader *u,
                  size_t (*input_callback)(void *ptr,
                                           size_t size,
@@ -193,6 +279,14 @@ int start_upload(Uploader *u,
                         return log_oom();
                 }
 
+                if (u->compress) {
+                        h = curl_slist_append(h, "Content-Encoding: zstd");
+                        if (!h) {
+                                curl_slist_free_all(h);
+                                return log_oom();
+                        }
+                }
+
                 u->header = h;
         }
 
@@ -219,11 +313,22 @@ int start_upload(Uploader *u,
                             LOG_ERR, return -EXFULL);
 
                 /* set where to read from */
-                easy_setopt(curl, CURLOPT_READFUNCTION, input_callback,
-                            LOG_ERR, return -EXFULL);
+#if HAVE_ZSTD
+                if (u->compress) {
+                        easy_setopt(curl, CURLOPT_READFUNCTION, compress_input_callback,
+                                    LOG_ERR, return -EXFULL);
 
-                easy_setopt(curl, CURLOPT_READDATA, data,
-                            LOG_ERR, return -EXFULL);
+                        easy_setopt(curl, CURLOPT_READDATA, u,
+                                    LOG_ERR, return -EXFULL);
+                } else
+#endif
+                {
+                        easy_setopt(curl, CURLOPT_READFUNCTION, input_callback,
+                                    LOG_ERR, return -EXFULL);
+
+                        easy_setopt(curl, CURLOPT_READDATA, data,
+                                    LOG_ERR, return -EXFULL);
+                }
 
                 /* use our special own mime type and chunked transfer */
                 easy_setopt(curl, CURLOPT_HTTPHEADER, u->header,
@@ -256,13 +361,25 @@ int start_upload(Uploader *u,
                                     LOG_WARNING, );
 
                 u->easy = curl;
-        } else {
-                /* truncate the potential old error message */
-                u->error[0] = '\0';
+        }
+
+        u->plain_callback = input_callback;
+        u->plain_data = data;
+
+#if HAVE_ZSTD
+        if (u->compress) {
+                size_t z;
+
+                /* Every upload is a separate frame, also after an aborted one */
+                z = ZSTD_CCtx_reset(u->compress_ctx, ZSTD_reset_session_only);
+                if (ZSTD_isError(z))
+                        return log_error_errno(SYNTHETIC_ERRNO(EIO),
+                                               "Failed to reset compression context: %s", ZSTD_getErrorName(z));
 
-                free(u->answer);
-                u->answer = 0;
+                u->compress_pos = u->compress_size = 0;
+                u->compress_eof = u->compress_done = false;
         }
+#endif
 
         /* upload to this place */
         code = curl_easy_setopt(u->easy, CURLOPT_URL, u->url);
@@ -409,9 +526,33 @@ static int setup_uploader(Uploader *u, const char *url, const char *state_file)
         assert(url);
 
         *u = (Uploader) {
-                .input = -1
+                .input = -1,
+                .compress = arg_compress,
+                .batch_entries_max = arg_batch_entries,
+                .batch_usec = arg_batch_timeout_usec,
         };
 
+        if (u->compress) {
+#if HAVE_ZSTD
+                size_t z;
+
+                u->compress_ctx = ZSTD_createCCtx();
+                if (!u->compress_ctx)
+                        return log_oom();
+
+                z = ZSTD_CCtx_setParameter(u->compress_ctx, ZSTD_c_checksumFlag, 1);
+                if (ZSTD_isError(z))
+                        log_debug("Failed to enable ZSTD checksum, ignoring: %s", ZSTD_getErrorName(z));
+
+                u->compress_buffer = malloc(JOURNAL_UPLOAD_COMPRESS_BUFFER_SIZE);
+                if (!u->compress_buffer)
+                        return log_oom();
+#else
+                return log_error_errno(SYNTHETIC_ERRNO(EOPNOTSUPP),
+                                       "Compression requested, but zstd support is not compiled in.");
+#endif
+        }
+
         host = STARTSWITH_SET(url, "http://", "https://");
         if (!host) {
                 host = url;
@@ -456,6 +597,11 @@ static void destroy_uploader(Uploader *u) {
         curl_slist_free_all(u->header);
         free(u->answer);
 
+#if HAVE_ZSTD
+        ZSTD_freeCCtx(u->compress_ctx);
+#endif
+        free(u->compress_buffer);
+
         free(u->last_cursor);
         free(u->current_cursor);
 
@@ -477,6 +623,10 @@ static int perform_upload(Uploader *u) {
 
         assert(u);
 
+        /* truncate the potential old error message */
+        u->error[0] = '\0';
+        u->answer = mfree(u->answer);
+
         u->watchdog_timestamp = now(CLOCK_MONOTONIC);
         code = curl_easy_perform(u->easy);
         if (code) {
@@ -514,10 +664,13 @@ static int perform_upload(Uploader *u) {
 
 static int parse_config(void) {
         const ConfigTableItem items[] = {
-                { "Upload",  "URL",                    config_parse_string, 0, &arg_url    },
-                { "Upload",  "ServerKeyFile",          config_parse_path,   0, &arg_key    },
-                { "Upload",  "ServerCertificateFile",  config_parse_path,   0, &arg_cert   },
-                { "Upload",  "TrustedCertificateFile", config_parse_path,   0, &arg_trust  },
+                { "Upload",  "URL",                    config_parse_string,   0, &arg_url                },
+                { "Upload",  "ServerKeyFile",          config_parse_path,     0, &arg_key                },
+                { "Upload",  "ServerCertificateFile",  config_parse_path,     0, &arg_cert               },
+                { "Upload",  "TrustedCertificateFile", config_parse_path,     0, &arg_trust              },
+                { "Upload",  "Compress",               config_parse_bool,     0, &arg_compress           },
+                { "Upload",  "BatchEntries",           config_parse_unsigned, 0, &arg_batch_entries      },
+                { "Upload",  "BatchTimeoutSec",        config_parse_sec,      0, &arg_batch_timeout_usec },
                 {}};
 
         return config_parse_many_nulstr(PKGSYSCONFDIR "/journal-upload.conf",
@@ -557,6 +710,9 @@ static int help(void) {
                "     --follow[=BOOL]        Do [not] wait for input\n"
                "     --save-state[=FILE]    Save uploaded cursors (default \n"
                "                            " STATE_FILE ")\n"
+               "     --compress[=BOOL]      Compress the uploaded data with zstd\n"
+               "     --batch-entries=N      Finish each upload after N journal entries\n"
+               "     --batch-timeout=SEC    Finish each upload after this much time\n"
                "\nSee the %s for details.\n"
                , program_invocation_short_name
                , link
@@ -578,25 +734,31 @@ static int parse_argv(int argc, char *argv[]) {
                 ARG_AFTER_CURSOR,
                 ARG_FOLLOW,
                 ARG_SAVE_STATE,
+                ARG_COMPRESS,
+                ARG_BATCH_ENTRIES,
+                ARG_BATCH_TIMEOUT,
         };
 
         static const struct option options[] = {
-                { "help",         no_argument,       NULL, 'h'                },
-                { "version",      no_argument,       NULL, ARG_VERSION        },
-                { "url",          required_argument, NULL, 'u'                },
-                { "key",          required_argument, NULL, ARG_KEY            },
-                { "cert",         required_argument, NULL, ARG_CERT           },
-                { "trust",        required_argument, NULL, ARG_TRUST          },
-                { "system",       no_argument,       NULL, ARG_SYSTEM         },
-                { "user",         no_argument,       NULL, ARG_USER           },
-                { "merge",        no_argument,       NULL, 'm'                },
-                { "machine",      required_argument, NULL, 'M'                },
-                { "directory",    required_argument, NULL, 'D'                },
-                { "file",         required_argument, NULL, ARG_FILE           },
-                { "cursor",       required_argument, NULL, ARG_CURSOR         },
-                { "after-cursor", required_argument, NULL, ARG_AFTER_CURSOR   },
-                { "follow",       optional_argument, NULL, ARG_FOLLOW         },
-                { "save-state",   optional_argument, NULL, ARG_SAVE_STATE     },
+                { "help",          no_argument,       NULL, 'h'                },
+                { "version",       no_argument,       NULL, ARG_VERSION        },
+                { "url",           required_argument, NULL, 'u'                },
+                { "key",           required_argument, NULL, ARG_KEY            },
+                { "cert",          required_argument, NULL, ARG_CERT           },
+                { "trust",         required_argument, NULL, ARG_TRUST          },
+                { "system",        no_argument,       NULL, ARG_SYSTEM         },
+                { "user",          no_argument,       NULL, ARG_USER           },
+                { "merge",         no_argument,       NULL, 'm'                },
+                { "machine",       required_argument, NULL, 'M'                },
+                { "directory",     required_argument, NULL, 'D'                },
+                { "file",          required_argument, NULL, ARG_FILE           },
+                { "cursor",        required_argument, NULL, ARG_CURSOR         },
+                { "after-cursor",  required_argument, NULL, ARG_AFTER_CURSOR   },
+                { "follow",        optional_argument, NULL, ARG_FOLLOW         },
+                { "save-state",    optional_argument, NULL, ARG_SAVE_STATE     },
+                { "compress",      optional_argument, NULL, ARG_COMPRESS       },
+                { "batch-entries", required_argument, NULL, ARG_BATCH_ENTRIES  },
+                { "batch-timeout", required_argument, NULL, ARG_BATCH_TIMEOUT  },
                 {}
         };
 
@@ -715,6 +877,31 @@ static int parse_argv(int argc, char *argv[]) {
                         arg_save_state = optarg ?: STATE_FILE;
                         break;
 
+                case ARG_COMPRESS:
+                        if (optarg) {
+                                r = parse_boolean(optarg);
+                                if (r < 0)
+                                        return log_error_errno(SYNTHETIC_ERRNO(EINVAL),
+                                                               "Failed to parse --compress= parameter.");
+
+                                arg_compress = r;
+                        } else
+                                arg_compress = true;
+
+                        break;
+
+                case ARG_BATCH_ENTRIES:
+                        r = safe_atou(optarg, &arg_batch_entries);
+                        if (r < 0)
+                                return log_error_errno(r, "Failed to parse --batch-entries= parameter: %s", optarg);
+                        break;
+
+                case ARG_BATCH_TIMEOUT:
+                        r = parse_sec(optarg, &arg_batch_timeout_usec);
+                        if (r < 0)
+                                return log_error_errno(r, "Failed to parse --batch-timeout= parameter: %s", optarg);
+                        break;
+
                 case '?':
                         return log_error_errno(SYNTHETIC_ERRNO(EINVAL),
                                                "Unknown option %s.",
@@ -841,7 +1028,8 @@ int main(int argc, char **argv) {
                                 break;
                 }
 
-                r = sd_event_run(u.events, u.timeout);
+                /* If an upload was finished because the batch was complete, more entries are waiting already */
+                r = sd_event_run(u.events, u.uploading ? 0 : u.timeout);
                 if (r < 0) {
                         log_error_errno(r, "Failed to run event loop: %m");
                         break;
@@ -2,6 +2,10 @@
 
 #include <inttypes.h>
 
+#if HAVE_ZSTD
+#include <zstd.h>
+#endif
+
 #include "sd-event.h"
 #include "sd-journal.h"
 #include "time-util.h"
@@ -34,6 +38,23 @@ typedef struct Uploader {
         sd_event_source *input_event;
         uint64_t timeout;
 
+        /* compression stuff, the actual input callback is wrapped when the upload is compressed */
+        bool compress;
+#if HAVE_ZSTD
+        ZSTD_CCtx *compress_ctx;
+#endif
+        size_t (*plain_callback)(void *ptr, size_t size, size_t nmemb, void *userdata);
+        void *plain_data;
+        char *compress_buffer;
+        size_t compress_pos, compress_size;
+        bool compress_eof, compress_done;
+
+        /* batch stuff, an upload is finished after this many entries or this much time, 0 means unlimited */
+        size_t batch_entries_max;
+        usec_t batch_usec;
+        size_t batch_entries;
+        usec_t batch_start;
+
         /* fd stuff */
         int input;
 
@@ -54,6 +75,7 @@ typedef struct Uploader {
 } Uploader;
 
 #define JOURNAL_UPLOAD_POLL_TIMEOUT (10 * USEC_PER_SEC)
+#define JOURNAL_UPLOAD_COMPRESS_BUFFER_SIZE (128U*1024U)
 
 int start_upload(Uploader *u,
                  size_t (*input_callback)(void *ptr,
@@ -0,0 +1,124 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "sd-journal.h"
+
+#include "alloc-util.h"
+#include "io-util.h"
+#include "journal-file.h"
+#include "journal-gatewayd-follower.h"
+#include "log.h"
+#include "path-util.h"
+#include "rm-rf.h"
+#include "string-util.h"
+#include "strv.h"
+#include "tests.h"
+#include "tmpfile-util.h"
+
+static void append_message(JournalFile *f, const sd_id128_t *boot_id, const char *message) {
+        _cleanup_free_ char *m = NULL;
+        dual_timestamp ts;
+        struct iovec iovec[2];
+
+        assert_se(m = strjoin("MESSAGE=", message));
+        iovec[0] = IOVEC_MAKE_STRING(m);
+        iovec[1] = IOVEC_MAKE_STRING("TEST_FOLLOWER=1");
+
+        assert_se(dual_timestamp_get(&ts));
+        assert_se(journal_file_append_entry(f, &ts, boot_id, iovec, ELEMENTSOF(iovec), NULL, NULL, NULL) == 0);
+}
+
+static void assert_next(Follower *f, uint64_t *seqnum, const char *message) {
+        _cleanup_free_ char *buffer = NULL, *cursor = NULL;
+        size_t allocated = 0, size;
+
+        assert_se(follower_next(f, seqnum, 5 * USEC_PER_SEC, &buffer, &allocated, &size, &cursor) > 0);
+        assert_se(cursor);
+
+        /* The entries are serialized in export format, hence the fields show up verbatim */
+        assert_se(memmem(buffer, size, message, strlen(message)));
+}
+
+static void test_follower(void) {
+        _cleanup_(rm_rf_physical_and_freep) char *dir = NULL;
+        _cleanup_(sd_journal_closep) sd_journal *j = NULL;
+        _cleanup_free_ char *path = NULL, *cursor = NULL, *buffer = NULL, *c = NULL;
+        Follower *f = NULL, *g = NULL, *h = NULL;
+        uint64_t seqnum, seqnum2;
+        size_t allocated = 0, size;
+        sd_id128_t boot_id;
+        JournalFile *file;
+
+        log_info("/* %s */", __func__);
+
+        assert_se(mkdtemp_malloc("/tmp/test-journal-gatewayd-follower.XXXXXX", &dir) >= 0);
+        assert_se(path = path_join(dir, "test.journal"));
+        assert_se(sd_id128_randomize(&boot_id) >= 0);
+
+        assert_se(journal_file_open(-1, path, O_RDWR|O_CREAT, 0644, false, (uint64_t) -1, false, NULL, NULL, NULL, NULL, &file) == 0);
+        append_message(file, &boot_id, "old one");
+        append_message(file, &boot_id, "old two");
+
+        assert_se(follower_acquire(dir, OUTPUT_EXPORT, STRV_MAKE("TEST_FOLLOWER=1", "TEST_FOLLOWER=2"), &f) >= 0);
+
+        /* Requests with the same filter and output mode share the follower, regardless of the order of matches */
+        assert_se(follower_acquire(dir, OUTPUT_EXPORT, STRV_MAKE("TEST_FOLLOWER=2", "TEST_FOLLOWER=1"), &g) >= 0);
+        assert_se(f == g);
+        assert_se(follower_acquire(dir, OUTPUT_JSON, STRV_MAKE("TEST_FOLLOWER=1", "TEST_FOLLOWER=2"), &h) >= 0);
+        assert_se(f != h);
+        h = follower_release(h);
+
+        /* Like a request, read to the end of the journal on our own first, and then take over */
+        assert_se(sd_journal_open_directory(&j, dir, 0) >= 0);
+        assert_se(sd_journal_add_match(j, "TEST_FOLLOWER=1", 0) >= 0);
+        assert_se(sd_journal_add_match(j, "TEST_FOLLOWER=2", 0) >= 0);
+        while (sd_journal_next(j) > 0) {
+                cursor = mfree(cursor);
+                assert_se(sd_journal_get_cursor(j, &cursor) >= 0);
+        }
+        assert_se(cursor);
+
+        assert_se(follower_attach(f, j, cursor, &seqnum) > 0);
+        sd_journal_close(TAKE_PTR(j));
+
+        /* Nothing new yet */
+        assert_se(follower_next(f, &seqnum, 100 * USEC_PER_MSEC, &buffer, &allocated, &size, &c) == 0);
+
+        /* New entries show up in order, also for the second user, which only starts reading now */
+        seqnum2 = seqnum;
+        append_message(file, &boot_id, "new one");
+        append_message(file, &boot_id, "new two");
+
+        assert_next(f, &seqnum, "MESSAGE=new one");
+        assert_next(f, &seqnum, "MESSAGE=new two");
+        assert_next(g, &seqnum2, "MESSAGE=new one");
+
+        append_message(file, &boot_id, "new three");
+        assert_next(g, &seqnum2, "MESSAGE=new two");
+        assert_next(g, &seqnum2, "MESSAGE=new three");
+        assert_next(f, &seqnum, "MESSAGE=new three");
+
+        /* The thread is stopped and joined when the last user goes away, while it is waiting for more */
+        f = follower_release(f);
+        g = follower_release(g);
+
+        /* And a new follower is set up for later requests, which only sees what is written after it started */
+        assert_se(follower_acquire(dir, OUTPUT_EXPORT, STRV_MAKE("TEST_FOLLOWER=1", "TEST_FOLLOWER=2"), &f) >= 0);
+        seqnum = 0;
+        assert_se(follower_next(f, &seqnum, 100 * USEC_PER_MSEC, &buffer, &allocated, &size, &c) == 0);
+        append_message(file, &boot_id, "new four");
+        assert_next(f, &seqnum, "MESSAGE=new four");
+        f = follower_release(f);
+
+        (void) journal_file_close(file);
+}
+
+int main(int argc, char *argv[]) {
+        test_setup_logging(LOG_DEBUG);
+
+        test_follower();
+
+        return 0;
+}
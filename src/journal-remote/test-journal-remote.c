@@ -0,0 +1,169 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "sd-journal.h"
+
+#include "alloc-util.h"
+#include "fd-util.h"
+#include "io-util.h"
+#include "journal-remote.h"
+#include "log.h"
+#include "parse-util.h"
+#include "rm-rf.h"
+#include "socket-util.h"
+#include "string-util.h"
+#include "tests.h"
+#include "tmpfile-util.h"
+
+#define N_CLIENTS 8U
+#define N_ENTRIES 200U
+#define N_WORKERS 4U
+
+static int make_listener(union sockaddr_union *ret_sa) {
+        _cleanup_close_ int fd = -1;
+        socklen_t salen = sizeof(ret_sa->in);
+
+        *ret_sa = (union sockaddr_union) {
+                .in.sin_family = AF_INET,
+                .in.sin_addr.s_addr = htobe32(INADDR_LOOPBACK),
+        };
+
+        fd = socket(AF_INET, SOCK_STREAM|SOCK_CLOEXEC|SOCK_NONBLOCK, 0);
+        if (fd < 0)
+                return -errno;
+
+        if (bind(fd, &ret_sa->sa, salen) < 0)
+                return -errno;
+        if (listen(fd, N_CLIENTS) < 0)
+                return -errno;
+        if (getsockname(fd, &ret_sa->sa, &salen) < 0)
+                return -errno;
+
+        return TAKE_FD(fd);
+}
+
+static void upload(const union sockaddr_union *server, unsigned client, usec_t realtime) {
+        union sockaddr_union sa = {
+                .in.sin_family = AF_INET,
+                /* Every client connects from a different address, and hence is a different host */
+                .in.sin_addr.s_addr = htobe32(INADDR_LOOPBACK + client),
+        };
+        _cleanup_free_ char *data = NULL;
+        _cleanup_close_ int fd = -1;
+        sd_id128_t boot_id;
+        unsigned i;
+
+        assert_se(sd_id128_randomize(&boot_id) >= 0);
+
+        for (i = 0; i < N_ENTRIES; i++) {
+                _cleanup_free_ char *entry = NULL;
+
+                /* The timestamps of all clients are interleaved, so that the merged view mixes them */
+                assert_se(asprintf(&entry,
+                                   "__REALTIME_TIMESTAMP=" USEC_FMT "\n"
+                                   "__MONOTONIC_TIMESTAMP=" USEC_FMT "\n"
+                                   "_BOOT_ID=" SD_ID128_FORMAT_STR "\n"
+                                   "MESSAGE=Entry %u of client %u\n"
+                                   "TEST_CLIENT=%u\n"
+                                   "TEST_SEQ=%u\n"
+                                   "\n",
+                                   realtime + i * N_CLIENTS + client, (usec_t) i + 1, SD_ID128_FORMAT_VAL(boot_id),
+                                   i, client, client, i) >= 0);
+                assert_se(strextend(&data, entry, NULL));
+        }
+
+        assert_se((fd = socket(AF_INET, SOCK_STREAM|SOCK_CLOEXEC, 0)) >= 0);
+        assert_se(bind(fd, &sa.sa, sizeof(sa.in)) >= 0);
+        assert_se(connect(fd, &server->sa, sizeof(server->in)) >= 0);
+
+        /* The server only accepts the connection once we're done here, the kernel buffers it all for us */
+        assert_se(loop_write(fd, data, strlen(data), false) >= 0);
+}
+
+static unsigned count_entries(const char *dir) {
+        _cleanup_(sd_journal_closep) sd_journal *j = NULL;
+        unsigned n = 0;
+
+        if (sd_journal_open_directory(&j, dir, 0) < 0)
+                return 0;
+
+        SD_JOURNAL_FOREACH(j)
+                n++;
+
+        return n;
+}
+
+static void test_workers(void) {
+        _cleanup_(rm_rf_physical_and_freep) char *dir = NULL;
+        _cleanup_(sd_journal_closep) sd_journal *j = NULL;
+        unsigned seen[N_CLIENTS] = {}, n = 0, k;
+        RemoteServer s = {};
+        union sockaddr_union sa;
+        usec_t deadline, realtime;
+        int fd;
+
+        log_info("/* %s */", __func__);
+
+        fd = make_listener(&sa);
+        if (fd < 0) {
+                log_notice_errno(fd, "Cannot listen on the loopback device, skipping: %m");
+                return;
+        }
+
+        assert_se(mkdtemp_malloc("/tmp/test-journal-remote.XXXXXX", &dir) >= 0);
+
+        assert_se(journal_remote_server_init(&s, dir, JOURNAL_WRITE_SPLIT_HOST, false, false) >= 0);
+        assert_se(journal_remote_server_start_workers(&s, N_WORKERS) >= 0);
+        assert_se(s.n_workers == N_WORKERS);
+        assert_se(journal_remote_add_raw_socket(&s, fd) >= 0);
+
+        realtime = now(CLOCK_REALTIME);
+        for (k = 0; k < N_CLIENTS; k++)
+                upload(&sa, k, realtime);
+
+        /* The main thread accepts the connections, and the workers write the data */
+        deadline = usec_add(now(CLOCK_MONOTONIC), 30 * USEC_PER_SEC);
+        while (count_entries(dir) < N_CLIENTS * N_ENTRIES) {
+                assert_se(now(CLOCK_MONOTONIC) < deadline);
+                assert_se(sd_event_run(s.events, 10 * USEC_PER_MSEC) >= 0);
+        }
+
+        journal_remote_server_stop_workers(&s);
+        assert_se(journal_remote_server_event_count(&s) == N_CLIENTS * N_ENTRIES);
+
+        /* Every entry made it exactly once, and the entries of every client are still in order */
+        assert_se(sd_journal_open_directory(&j, dir, 0) >= 0);
+        SD_JOURNAL_FOREACH(j) {
+                unsigned client, seq;
+                const void *d;
+                size_t l;
+
+                assert_se(sd_journal_get_data(j, "TEST_CLIENT", &d, &l) >= 0);
+                assert_se(safe_atou(strndupa((const char*) d + STRLEN("TEST_CLIENT="), l - STRLEN("TEST_CLIENT=")), &client) >= 0);
+                assert_se(client < N_CLIENTS);
+
+                assert_se(sd_journal_get_data(j, "TEST_SEQ", &d, &l) >= 0);
+                assert_se(safe_atou(strndupa((const char*) d + STRLEN("TEST_SEQ="), l - STRLEN("TEST_SEQ=")), &seq) >= 0);
+
+                assert_se(seq == seen[client]);
+                seen[client]++;
+                n++;
+        }
+
+        assert_se(n == N_CLIENTS * N_ENTRIES);
+        for (k = 0; k < N_CLIENTS; k++)
+                assert_se(seen[k] == N_ENTRIES);
+
+        journal_remote_server_destroy(&s);
+}
+
+int main(int argc, char *argv[]) {
+        test_setup_logging(LOG_DEBUG);
+
+        test_workers();
+
+        return 0;
+}
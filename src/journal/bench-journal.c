@@ -0,0 +1,267 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "sd-journal.h"
+
+#include "alloc-util.h"
+#include "hashmap.h"
+#include "io-util.h"
+#include "journal-file.h"
+#include "journal-internal.h"
+#include "json.h"
+#include "log.h"
+#include "macro.h"
+#include "parse-util.h"
+#include "random-util.h"
+#include "rm-rf.h"
+#include "stdio-util.h"
+#include "string-util.h"
+#include "strv.h"
+#include "tests.h"
+#include "time-util.h"
+#include "util.h"
+
+/* Measures the performance of the journal code paths that matter most for journald and journalctl, and prints the
+ * results as one JSON object per line, so that they can be compared between versions.
+ *
+ * Usage: bench-journal [ENTRIES [FILES]] */
+
+#define DEFAULT_ENTRIES 100000U
+#define DEFAULT_FILES 4U
+#define N_SEEKS 1000U
+
+/* Cardinalities of the fields of the generated entries, loosely modelled after a typical system journal */
+#define N_UNITS 50U
+#define N_PIDS 500U
+#define N_CODE_LINES 200U
+
+static unsigned arg_entries = DEFAULT_ENTRIES;
+static unsigned arg_files = DEFAULT_FILES;
+
+static void report(const char *benchmark, uint64_t n, usec_t duration) {
+        _cleanup_(json_variant_unrefp) JsonVariant *v = NULL;
+
+        assert_se(json_build(&v, JSON_BUILD_OBJECT(
+                                             JSON_BUILD_PAIR("benchmark", JSON_BUILD_STRING(benchmark)),
+                                             JSON_BUILD_PAIR("entries", JSON_BUILD_UNSIGNED(arg_entries)),
+                                             JSON_BUILD_PAIR("files", JSON_BUILD_UNSIGNED(arg_files)),
+                                             JSON_BUILD_PAIR("operations", JSON_BUILD_UNSIGNED(n)),
+                                             JSON_BUILD_PAIR("usec", JSON_BUILD_UNSIGNED(duration)),
+                                             JSON_BUILD_PAIR("usec_per_operation", JSON_BUILD_REAL(n > 0 ? (long double) duration / n : 0)),
+                                             JSON_BUILD_PAIR("operations_per_second", JSON_BUILD_REAL(duration > 0 ? (long double) n * USEC_PER_SEC / duration : 0)))) >= 0);
+
+        json_variant_dump(v, JSON_FORMAT_NEWLINE, stdout, NULL);
+        fflush(stdout);
+}
+
+static void bench_append(const char *directory, usec_t *ret_first, usec_t *ret_last) {
+        dual_timestamp ts = {};
+        usec_t start, duration = 0;
+        unsigned i, k;
+        char hostname[] = "_HOSTNAME=bench";
+
+        /* Writes the entries into the files one after the other, i.e. like a sequence of rotated journal files */
+
+        for (k = 0; k < arg_files; k++) {
+                _cleanup_free_ char *fn = NULL;
+                JournalFile *f;
+
+                assert_se(asprintf(&fn, "%s/bench-%u.journal", directory, k) >= 0);
+                assert_se(journal_file_open(-1, fn, O_RDWR|O_CREAT, 0644, true, (uint64_t) -1, false, NULL, NULL, NULL, NULL, &f) == 0);
+
+                start = now(CLOCK_MONOTONIC);
+
+                for (i = k * arg_entries / arg_files; i < (k + 1) * arg_entries / arg_files; i++) {
+                        char message[STRLEN("MESSAGE=Request  handled in  ms") + 2 * DECIMAL_STR_MAX(unsigned)],
+                                priority[STRLEN("PRIORITY=") + DECIMAL_STR_MAX(unsigned)],
+                                unit[STRLEN("_SYSTEMD_UNIT=unit-.service") + DECIMAL_STR_MAX(unsigned)],
+                                identifier[STRLEN("SYSLOG_IDENTIFIER=unit-") + DECIMAL_STR_MAX(unsigned)],
+                                pid[STRLEN("_PID=") + DECIMAL_STR_MAX(unsigned)],
+                                code_line[STRLEN("CODE_LINE=") + DECIMAL_STR_MAX(unsigned)];
+                        struct iovec iovec[7];
+                        unsigned u = i % N_UNITS;
+
+                        if (i == 0) {
+                                dual_timestamp_get(&ts);
+                                *ret_first = ts.realtime;
+                        } else {
+                                ts.realtime += 100;
+                                ts.monotonic += 100;
+                        }
+
+                        xsprintf(message, "MESSAGE=Request %u handled in %u ms", i, (unsigned) (random_u64() % 1000));
+                        xsprintf(priority, "PRIORITY=%u", i % 7 == 0 ? 4U : 6U);
+                        xsprintf(unit, "_SYSTEMD_UNIT=unit-%u.service", u);
+                        xsprintf(identifier, "SYSLOG_IDENTIFIER=unit-%u", u);
+                        xsprintf(pid, "_PID=%u", 1000 + u * (N_PIDS / N_UNITS) + i % (N_PIDS / N_UNITS));
+                        xsprintf(code_line, "CODE_LINE=%u", i % N_CODE_LINES);
+
+                        iovec[0] = IOVEC_MAKE_STRING(message);
+                        iovec[1] = IOVEC_MAKE_STRING(priority);
+                        iovec[2] = IOVEC_MAKE_STRING(unit);
+                        iovec[3] = IOVEC_MAKE_STRING(identifier);
+                        iovec[4] = IOVEC_MAKE_STRING(pid);
+                        iovec[5] = IOVEC_MAKE_STRING(code_line);
+                        iovec[6] = IOVEC_MAKE_STRING(hostname);
+
+                        assert_se(journal_file_append_entry(f, &ts, NULL, iovec, ELEMENTSOF(iovec), NULL, NULL, NULL) == 0);
+                }
+
+                duration += now(CLOCK_MONOTONIC) - start;
+
+                (void) journal_file_close(f);
+        }
+
+        *ret_last = ts.realtime;
+
+        report("append", arg_entries, duration);
+}
+
+static void bench_next(const char *directory, const char *match) {
+        _cleanup_(sd_journal_closep) sd_journal *j = NULL;
+        usec_t start;
+        uint64_t n = 0;
+
+        assert_se(sd_journal_open_directory(&j, directory, 0) >= 0);
+
+        if (match)
+                assert_se(sd_journal_add_match(j, match, 0) >= 0);
+
+        start = now(CLOCK_MONOTONIC);
+
+        SD_JOURNAL_FOREACH(j)
+                n++;
+
+        report(match ? "next-match" : "next", n, now(CLOCK_MONOTONIC) - start);
+
+        assert_se(match || n == arg_entries);
+}
+
+static void bench_seek_realtime(const char *directory, usec_t first, usec_t last) {
+        _cleanup_(sd_journal_closep) sd_journal *j = NULL;
+        usec_t start;
+        unsigned i;
+
+        assert_se(sd_journal_open_directory(&j, directory, 0) >= 0);
+
+        start = now(CLOCK_MONOTONIC);
+
+        for (i = 0; i < N_SEEKS; i++) {
+                assert_se(sd_journal_seek_realtime_usec(j, first + random_u64() % (last - first + 1)) >= 0);
+                assert_se(sd_journal_next(j) > 0);
+        }
+
+        report("seek-realtime", N_SEEKS, now(CLOCK_MONOTONIC) - start);
+}
+
+static void bench_seek_cursor(const char *directory, usec_t first, usec_t last) {
+        _cleanup_(sd_journal_closep) sd_journal *j = NULL;
+        char **cursors;
+        usec_t start;
+        unsigned i;
+
+        assert_se(sd_journal_open_directory(&j, directory, 0) >= 0);
+
+        /* Collect the cursors first, so that only the seeking is measured */
+        cursors = new0(char*, N_SEEKS + 1);
+        assert_se(cursors);
+
+        for (i = 0; i < N_SEEKS; i++) {
+                assert_se(sd_journal_seek_realtime_usec(j, first + random_u64() % (last - first + 1)) >= 0);
+                assert_se(sd_journal_next(j) > 0);
+                assert_se(sd_journal_get_cursor(j, cursors + i) >= 0);
+        }
+
+        sd_journal_close(j);
+        assert_se(sd_journal_open_directory(&j, directory, 0) >= 0);
+
+        start = now(CLOCK_MONOTONIC);
+
+        for (i = 0; i < N_SEEKS; i++) {
+                assert_se(sd_journal_seek_cursor(j, cursors[i]) >= 0);
+                assert_se(sd_journal_next(j) > 0);
+        }
+
+        report("seek-cursor", N_SEEKS, now(CLOCK_MONOTONIC) - start);
+
+        strv_free(cursors);
+}
+
+static void bench_flush(const char *directory, const char *destination) {
+        _cleanup_(sd_journal_closep) sd_journal *j = NULL;
+        _cleanup_free_ char *fn = NULL;
+        JournalFile *to, *last = NULL;
+        Hashmap *copied_data = NULL;
+        uint64_t n = 0;
+        usec_t start;
+
+        /* Does the same as server_flush_to_var(), but without needing a running server: copies all entries of the
+         * files into a single new one. */
+
+        assert_se(asprintf(&fn, "%s/flush.journal", destination) >= 0);
+        assert_se(journal_file_open(-1, fn, O_RDWR|O_CREAT, 0644, true, (uint64_t) -1, false, NULL, NULL, NULL, NULL, &to) == 0);
+
+        assert_se(sd_journal_open_directory(&j, directory, 0) >= 0);
+        sd_journal_set_data_threshold(j, 0);
+
+        start = now(CLOCK_MONOTONIC);
+
+        SD_JOURNAL_FOREACH(j) {
+                JournalFile *f = j->current_file;
+                Object *o;
+
+                /* The copied data map is only valid for one source file */
+                if (f != last) {
+                        hashmap_free_free(copied_data);
+                        copied_data = hashmap_new(&uint64_hash_ops);
+                        last = f;
+                }
+
+                assert_se(journal_file_move_to_object(f, OBJECT_ENTRY, f->current_offset, &o) >= 0);
+                assert_se(journal_file_copy_entry(f, to, o, f->current_offset, copied_data) >= 0);
+                n++;
+        }
+
+        report("flush", n, now(CLOCK_MONOTONIC) - start);
+
+        hashmap_free_free(copied_data);
+        (void) journal_file_close(to);
+}
+
+int main(int argc, char *argv[]) {
+        char t[] = "/var/tmp/bench-journal-XXXXXX", d[] = "/var/tmp/bench-journal-flush-XXXXXX";
+        usec_t first = 0, last = 0;
+
+        /* journal_file_open requires a valid machine id */
+        if (access("/etc/machine-id", F_OK) != 0)
+                return log_tests_skipped("/etc/machine-id not found");
+
+        test_setup_logging(LOG_INFO);
+
+        if (argc > 3) {
+                log_error("Usage: %s [ENTRIES [FILES]]", program_invocation_short_name);
+                return EXIT_FAILURE;
+        }
+
+        if (argc > 1)
+                assert_se(safe_atou(argv[1], &arg_entries) >= 0 && arg_entries > 0);
+        if (argc > 2)
+                assert_se(safe_atou(argv[2], &arg_files) >= 0 && arg_files > 0 && arg_files <= arg_entries);
+
+        assert_se(mkdtemp(t));
+        assert_se(mkdtemp(d));
+
+        bench_append(t, &first, &last);
+        bench_next(t, NULL);
+        bench_next(t, "_SYSTEMD_UNIT=unit-7.service");
+        bench_seek_realtime(t, first, last);
+        bench_seek_cursor(t, first, last);
+        bench_flush(t, d);
+
+        assert_se(rm_rf(t, REMOVE_ROOT|REMOVE_PHYSICAL) >= 0);
+        assert_se(rm_rf(d, REMOVE_ROOT|REMOVE_PHYSICAL) >= 0);
+
+        return 0;
+}
@@ -15,6 +15,12 @@
 #include <lz4frame.h>
 #endif
 
+#if HAVE_ZSTD
+#include <zdict.h>
+#include <zstd.h>
+#include <zstd_errors.h>
+#endif
+
 #include "alloc-util.h"
 #include "compress.h"
 #include "fd-util.h"
@@ -31,15 +37,131 @@ DEFINE_TRIVIAL_CLEANUP_FUNC(LZ4F_compressionContext_t, LZ4F_freeCompressionConte
 DEFINE_TRIVIAL_CLEANUP_FUNC(LZ4F_decompressionContext_t, LZ4F_freeDecompressionContext);
 #endif
 
+#if HAVE_ZSTD
+DEFINE_TRIVIAL_CLEANUP_FUNC(ZSTD_CCtx*, ZSTD_freeCCtx);
+DEFINE_TRIVIAL_CLEANUP_FUNC(ZSTD_DCtx*, ZSTD_freeDCtx);
+
+static int zstd_ret_to_errno(size_t ret) {
+        switch (ZSTD_getErrorCode(ret)) {
+        case ZSTD_error_dstSize_tooSmall:
+                return -ENOBUFS;
+        case ZSTD_error_memory_allocation:
+                return -ENOMEM;
+        default:
+                return -EBADMSG;
+        }
+}
+#endif
+
+struct CompressDictionary {
+#if HAVE_ZSTD
+        ZSTD_CDict *cdict;
+        ZSTD_DDict *ddict;
+        ZSTD_CCtx *cctx;
+        ZSTD_DCtx *dctx;
+#endif
+        uint32_t id;
+};
+
 #define ALIGN_8(l) ALIGN_TO(l, sizeof(size_t))
 
 static const char* const object_compressed_table[_OBJECT_COMPRESSED_MAX] = {
         [OBJECT_COMPRESSED_XZ] = "XZ",
         [OBJECT_COMPRESSED_LZ4] = "LZ4",
+        [OBJECT_COMPRESSED_ZSTD] = "ZSTD",
 };
 
 DEFINE_STRING_TABLE_LOOKUP(object_compressed, int);
 
+int compress_dictionary_new(const void *data, size_t size, CompressDictionary **ret) {
+#if HAVE_ZSTD
+        _cleanup_(compress_dictionary_freep) CompressDictionary *d = NULL;
+
+        assert(data);
+        assert(size > 0);
+        assert(ret);
+
+        d = new0(CompressDictionary, 1);
+        if (!d)
+                return -ENOMEM;
+
+        d->id = ZSTD_getDictID_fromDict(data, size);
+        if (d->id == 0)
+                /* Not a trained dictionary, refuse. Frames compressed with raw content dictionaries do not carry
+                 * any dictionary ID, hence we could never tell which dictionary they need. */
+                return -EBADMSG;
+
+        /* Both ZSTD_createCDict() and ZSTD_createDDict() copy the dictionary, hence the caller may release the
+         * data right after we return. */
+        d->cdict = ZSTD_createCDict(data, size, ZSTD_CLEVEL_DEFAULT);
+        d->ddict = ZSTD_createDDict(data, size);
+        d->cctx = ZSTD_createCCtx();
+        d->dctx = ZSTD_createDCtx();
+        if (!d->cdict || !d->ddict || !d->cctx || !d->dctx)
+                return -ENOMEM;
+
+        *ret = TAKE_PTR(d);
+        return 0;
+#else
+        return -EPROTONOSUPPORT;
+#endif
+}
+
+CompressDictionary* compress_dictionary_free(CompressDictionary *d) {
+        if (!d)
+                return NULL;
+
+#if HAVE_ZSTD
+        ZSTD_freeCDict(d->cdict);
+        ZSTD_freeDDict(d->ddict);
+        ZSTD_freeCCtx(d->cctx);
+        ZSTD_freeDCtx(d->dctx);
+#endif
+
+        return mfree(d);
+}
+
+uint32_t compress_dictionary_id(const CompressDictionary *d) {
+        return d ? d->id : 0;
+}
+
+int compress_dictionary_train(const void *samples, const size_t *sample_sizes, size_t n_samples,
+                              size_t max_size, void **ret, size_t *ret_size) {
+#if HAVE_ZSTD
+        _cleanup_free_ void *buf = NULL;
+        size_t k;
+
+        assert(samples);
+        assert(sample_sizes);
+        assert(max_size > 0);
+        assert(ret);
+        assert(ret_size);
+
+        /* Trains a dictionary from the concatenated samples. The samples should be representative of the data that
+         * is to be compressed later on. Training will fail if there are too few samples, or if they are too
+         * uniform to extract anything useful from them. */
+
+        if (n_samples <= 0 || n_samples > UINT_MAX)
+                return -EINVAL;
+
+        buf = malloc(max_size);
+        if (!buf)
+                return -ENOMEM;
+
+        k = ZDICT_trainFromBuffer(buf, max_size, samples, sample_sizes, (unsigned) n_samples);
+        if (ZDICT_isError(k))
+                return log_debug_errno(SYNTHETIC_ERRNO(ENODATA),
+                                       "Failed to train zstd dictionary from %zu samples: %s",
+                                       n_samples, ZDICT_getErrorName(k));
+
+        *ret = TAKE_PTR(buf);
+        *ret_size = k;
+        return 0;
+#else
+        return -EPROTONOSUPPORT;
+#endif
+}
+
 int compress_blob_xz(const void *src, uint64_t src_size,
                      void *dst, size_t dst_alloc_size, size_t *dst_size) {
 #if HAVE_XZ
@@ -108,6 +230,56 @@ int compress_blob_lz4(const void *src, uint64_t src_size,
 #endif
 }
 
+int compress_blob_zstd_dict(const void *src, uint64_t src_size,
+                            void *dst, size_t dst_alloc_size, size_t *dst_size,
+                            CompressDictionary *dict) {
+#if HAVE_ZSTD
+        size_t k;
+
+        assert(src);
+        assert(src_size > 0);
+        assert(dst);
+        assert(dst_alloc_size > 0);
+        assert(dst_size);
+
+        /* Returns < 0 if we couldn't compress the data or the
+         * compressed result is longer than the original */
+
+        if (dict)
+                k = ZSTD_compress_usingCDict(dict->cctx, dst, dst_alloc_size, src, src_size, dict->cdict);
+        else
+                k = ZSTD_compress(dst, dst_alloc_size, src, src_size, ZSTD_CLEVEL_DEFAULT);
+        if (ZSTD_isError(k))
+                return zstd_ret_to_errno(k);
+
+        *dst_size = k;
+        return 0;
+#else
+        return -EPROTONOSUPPORT;
+#endif
+}
+
+int compress_blob_zstd(const void *src, uint64_t src_size,
+                       void *dst, size_t dst_alloc_size, size_t *dst_size) {
+        return compress_blob_zstd_dict(src, src_size, dst, dst_alloc_size, dst_size, NULL);
+}
+
+int compress_blob(int compression, CompressDictionary *dict,
+                  const void *src, uint64_t src_size,
+                  void *dst, size_t dst_alloc_size, size_t *dst_size) {
+        if (compression == OBJECT_COMPRESSED_XZ)
+                return compress_blob_xz(src, src_size,
+                                        dst, dst_alloc_size, dst_size);
+        else if (compression == OBJECT_COMPRESSED_LZ4)
+                return compress_blob_lz4(src, src_size,
+                                         dst, dst_alloc_size, dst_size);
+        else if (compression == OBJECT_COMPRESSED_ZSTD)
+                return compress_blob_zstd_dict(src, src_size,
+                                               dst, dst_alloc_size, dst_size, dict);
+        else
+                return -EOPNOTSUPP;
+}
+
 int decompress_blob_xz(const void *src, uint64_t src_size,
                        void **dst, size_t *dst_alloc_size, size_t* dst_size, size_t dst_max) {
 
@@ -208,7 +380,105 @@ int decompress_blob_lz4(const void *src, uint64_t src_size,
 #endif
 }
 
-int decompress_blob(int compression,
+int decompress_blob_zstd_dict(const void *src, uint64_t src_size,
+                              void **dst, size_t *dst_alloc_size, size_t* dst_size, size_t dst_max,
+                              CompressDictionary *dict) {
+#if HAVE_ZSTD
+        _cleanup_(ZSTD_freeDCtxp) ZSTD_DCtx *own = NULL;
+        ZSTD_DCtx *dctx;
+        unsigned long long size;
+        uint32_t id;
+        size_t space, k;
+
+        assert(src);
+        assert(src_size > 0);
+        assert(dst);
+        assert(dst_alloc_size);
+        assert(dst_size);
+        assert(*dst_alloc_size == 0 || *dst);
+
+        size = ZSTD_getFrameContentSize(src, src_size);
+        if (IN_SET(size, ZSTD_CONTENTSIZE_ERROR, ZSTD_CONTENTSIZE_UNKNOWN))
+                return -EBADMSG;
+
+        if (dst_max > 0 && size > dst_max)
+                size = dst_max;
+        if (size > SIZE_MAX)
+                return -E2BIG;
+
+        id = ZSTD_getDictID_fromFrame(src, src_size);
+        if (id != 0 && id != compress_dictionary_id(dict))
+                return log_debug_errno(SYNTHETIC_ERRNO(EBADMSG),
+                                       "Frame requires zstd dictionary %" PRIu32 ", which is not available.", id);
+
+        /* Allocate at least one byte, so that *dst is never NULL, even for empty frames */
+        space = MAX((size_t) size, 1u);
+        if (!greedy_realloc(dst, dst_alloc_size, space, 1))
+                return -ENOMEM;
+
+        if (dict)
+                dctx = dict->dctx;
+        else {
+                dctx = own = ZSTD_createDCtx();
+                if (!dctx)
+                        return -ENOMEM;
+        }
+
+        if (dst_max == 0 || size < dst_max) {
+                /* Decompress the full frame in one go, this is the common case. */
+                if (id != 0)
+                        k = ZSTD_decompress_usingDDict(dctx, *dst, space, src, src_size, dict->ddict);
+                else
+                        k = ZSTD_decompressDCtx(dctx, *dst, space, src, src_size);
+                if (ZSTD_isError(k))
+                        return zstd_ret_to_errno(k);
+                if (k != size)
+                        return -EBADMSG;
+        } else {
+                /* Only a prefix was requested, use the streaming API, so that we stop once we have enough. */
+                ZSTD_inBuffer input = {
+                        .src = src,
+                        .size = src_size,
+                };
+                ZSTD_outBuffer output = {
+                        .dst = *dst,
+                        .size = (size_t) size,
+                };
+
+                (void) ZSTD_DCtx_reset(dctx, ZSTD_reset_session_only);
+                k = ZSTD_DCtx_refDDict(dctx, id != 0 ? dict->ddict : NULL);
+                if (ZSTD_isError(k))
+                        return zstd_ret_to_errno(k);
+
+                for (;;) {
+                        size_t pos = output.pos;
+
+                        k = ZSTD_decompressStream(dctx, &output, &input);
+                        if (ZSTD_isError(k))
+                                return zstd_ret_to_errno(k);
+                        if (k == 0 || output.pos >= output.size)
+                                break;
+                        if (input.pos >= input.size && output.pos == pos)
+                                return -EBADMSG; /* Truncated frame */
+                }
+
+                (void) ZSTD_DCtx_reset(dctx, ZSTD_reset_session_only);
+                k = output.pos;
+        }
+
+        *dst_size = k;
+        return 0;
+#else
+        return -EPROTONOSUPPORT;
+#endif
+}
+
+int decompress_blob_zstd(const void *src, uint64_t src_size,
+                         void **dst, size_t *dst_alloc_size, size_t* dst_size, size_t dst_max) {
+        return decompress_blob_zstd_dict(src, src_size, dst, dst_alloc_size, dst_size, dst_max, NULL);
+}
+
+int decompress_blob(int compression, CompressDictionary *dict,
                     const void *src, uint64_t src_size,
                     void **dst, size_t *dst_alloc_size, size_t* dst_size, size_t dst_max) {
         if (compression == OBJECT_COMPRESSED_XZ)
@@ -217,6 +487,9 @@ int decompress_blob(int compression,
         else if (compression == OBJECT_COMPRESSED_LZ4)
                 return decompress_blob_lz4(src, src_size,
                                            dst, dst_alloc_size, dst_size, dst_max);
+        else if (compression == OBJECT_COMPRESSED_ZSTD)
+                return decompress_blob_zstd_dict(src, src_size,
+                                                 dst, dst_alloc_size, dst_size, dst_max, dict);
         else
                 return -EBADMSG;
 }
@@ -342,7 +615,52 @@ int decompress_startswith_lz4(const void *src, uint64_t src_size,
 #endif
 }
 
-int decompress_startswith(int compression,
+int decompress_startswith_zstd_dict(const void *src, uint64_t src_size,
+                                    void **buffer, size_t *buffer_size,
+                                    const void *prefix, size_t prefix_len,
+                                    uint8_t extra,
+                                    CompressDictionary *dict) {
+#if HAVE_ZSTD
+        size_t size;
+        int r;
+
+        /* Checks whether the decompressed blob starts with the
+         * mentioned prefix. The byte extra needs to follow the
+         * prefix */
+
+        assert(src);
+        assert(src_size > 0);
+        assert(buffer);
+        assert(buffer_size);
+        assert(prefix);
+        assert(*buffer_size == 0 || *buffer);
+
+        /* zstd frames know their uncompressed size, hence we can tell right-away if the data is too short */
+        if (ZSTD_getFrameContentSize(src, src_size) < prefix_len + 1)
+                return 0;
+
+        r = decompress_blob_zstd_dict(src, src_size, buffer, buffer_size, &size, prefix_len + 1, dict);
+        if (r < 0)
+                return r;
+
+        if (size < prefix_len + 1)
+                return 0;
+
+        return memcmp(*buffer, prefix, prefix_len) == 0 &&
+                ((const uint8_t*) *buffer)[prefix_len] == extra;
+#else
+        return -EPROTONOSUPPORT;
+#endif
+}
+
+int decompress_startswith_zstd(const void *src, uint64_t src_size,
+                               void **buffer, size_t *buffer_size,
+                               const void *prefix, size_t prefix_len,
+                               uint8_t extra) {
+        return decompress_startswith_zstd_dict(src, src_size, buffer, buffer_size, prefix, prefix_len, extra, NULL);
+}
+
+int decompress_startswith(int compression, CompressDictionary *dict,
                           const void *src, uint64_t src_size,
                           void **buffer, size_t *buffer_size,
                           const void *prefix, size_t prefix_len,
@@ -357,11 +675,16 @@ int decompress_startswith(int compression,
                                                  buffer, buffer_size,
                                                  prefix, prefix_len,
                                                  extra);
+        else if (compression == OBJECT_COMPRESSED_ZSTD)
+                return decompress_startswith_zstd_dict(src, src_size,
+                                                       buffer, buffer_size,
+                                                       prefix, prefix_len,
+                                                       extra, dict);
         else
                 return -EBADMSG;
 }
 
-int compress_stream_xz(int fdf, int fdt, uint64_t max_bytes) {
+int compress_stream_xz(int fdf, int fdt, uint64_t max_bytes, uint64_t *ret_uncompressed_size) {
 #if HAVE_XZ
         _cleanup_(lzma_end) lzma_stream s = LZMA_STREAM_INIT;
         lzma_ret ret;
@@ -426,6 +749,9 @@ int compress_stream_xz(int fdf, int fdt, uint64_t max_bytes) {
                                           s.total_in, s.total_out,
                                           (double) s.total_out / s.total_in * 100);
 
+                                if (ret_uncompressed_size)
+                                        *ret_uncompressed_size = s.total_in;
+
                                 return 0;
                         }
                 }
@@ -437,14 +763,14 @@ int compress_stream_xz(int fdf, int fdt, uint64_t max_bytes) {
 
 #define LZ4_BUFSIZE (512*1024u)
 
-int compress_stream_lz4(int fdf, int fdt, uint64_t max_bytes) {
+int compress_stream_lz4(int fdf, int fdt, uint64_t max_bytes, uint64_t *ret_uncompressed_size) {
 
 #if HAVE_LZ4
         LZ4F_errorCode_t c;
         _cleanup_(LZ4F_freeCompressionContextp) LZ4F_compressionContext_t ctx = NULL;
         _cleanup_free_ char *buf = NULL;
         char *src = NULL;
-        size_t size, n, total_in = 0, total_out, offset = 0, frame_size;
+        size_t size, n, total_in = 0, total_out, offset = 0, frame_size, in_size;
         struct stat st;
         int r;
         static const LZ4F_compressOptions_t options = {
@@ -461,6 +787,9 @@ int compress_stream_lz4(int fdf, int fdt, uint64_t max_bytes) {
         if (fstat(fdf, &st) < 0)
                 return log_debug_errno(errno, "fstat() failed: %m");
 
+        /* The input is mapped as a whole, hence this only works for regular files */
+        in_size = (size_t) MIN((uint64_t) st.st_size, max_bytes);
+
         frame_size = LZ4F_compressBound(LZ4_BUFSIZE, &preferences);
         size =  frame_size + 64*1024; /* add some space for header and trailer */
         buf = malloc(size);
@@ -477,10 +806,10 @@ int compress_stream_lz4(int fdf, int fdt, uint64_t max_bytes) {
 
         log_debug("Buffer size is %zu bytes, header size %zu bytes.", size, n);
 
-        while (total_in < (size_t) st.st_size) {
+        while (total_in < in_size) {
                 ssize_t k;
 
-                k = MIN(LZ4_BUFSIZE, st.st_size - total_in);
+                k = MIN(LZ4_BUFSIZE, in_size - total_in);
                 n = LZ4F_compressUpdate(ctx, buf + offset, size - offset,
                                         src + total_in, k, &options);
                 if (LZ4F_isError(n)) {
@@ -492,11 +821,6 @@ int compress_stream_lz4(int fdf, int fdt, uint64_t max_bytes) {
                 offset += n;
                 total_out += n;
 
-                if (max_bytes != (uint64_t) -1 && total_out > (size_t) max_bytes) {
-                        log_debug("Compressed stream longer than %"PRIu64" bytes", max_bytes);
-                        return -EFBIG;
-                }
-
                 if (size - offset < frame_size + 4) {
                         k = loop_write(fdt, buf, offset, false);
                         if (k < 0) {
@@ -522,6 +846,9 @@ int compress_stream_lz4(int fdf, int fdt, uint64_t max_bytes) {
         log_debug("LZ4 compression finished (%zu -> %zu bytes, %.1f%%)",
                   total_in, total_out,
                   (double) total_out / total_in * 100);
+
+        if (ret_uncompressed_size)
+                *ret_uncompressed_size = total_in;
  cleanup:
         munmap(src, st.st_size);
         return r;
@@ -530,6 +857,117 @@ int compress_stream_lz4(int fdf, int fdt, uint64_t max_bytes) {
 #endif
 }
 
+int compress_stream_zstd(int fdf, int fdt, uint64_t max_bytes, uint64_t *ret_uncompressed_size) {
+#if HAVE_ZSTD
+        _cleanup_(ZSTD_freeCCtxp) ZSTD_CCtx *cctx = NULL;
+        _cleanup_free_ void *in_buff = NULL, *out_buff = NULL;
+        size_t in_allocsize, out_allocsize;
+        size_t z;
+        uint64_t left = max_bytes, in_bytes = 0, out_bytes = 0;
+        long n_cpus;
+
+        assert(fdf >= 0);
+        assert(fdt >= 0);
+
+        /* Create the context and buffers */
+        in_allocsize = ZSTD_CStreamInSize();
+        out_allocsize = ZSTD_CStreamOutSize();
+        in_buff = malloc(in_allocsize);
+        out_buff = malloc(out_allocsize);
+        cctx = ZSTD_createCCtx();
+        if (!cctx || !out_buff || !in_buff)
+                return -ENOMEM;
+
+        z = ZSTD_CCtx_setParameter(cctx, ZSTD_c_checksumFlag, 1);
+        if (ZSTD_isError(z))
+                log_debug("Failed to enable ZSTD checksum, ignoring: %s", ZSTD_getErrorName(z));
+
+        /* Let libzstd compress on worker threads of its own, reading and writing continues in this thread
+         * meanwhile. Every worker needs its own buffers of a few MiB, hence don't use too many. This fails if
+         * libzstd was built without multithreading support, in which case we compress in this thread. */
+        n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        if (n_cpus > 1) {
+                z = ZSTD_CCtx_setParameter(cctx, ZSTD_c_nbWorkers, (int) MIN(n_cpus, 8));
+                if (ZSTD_isError(z))
+                        log_debug("Failed to enable ZSTD multithreading, ignoring: %s", ZSTD_getErrorName(z));
+        }
+
+        /* This loop read from the input file, compresses that entire chunk,
+         * and writes all output produced to the output file.
+         */
+        for (;;) {
+                bool is_last_chunk;
+                ZSTD_inBuffer input = {
+                        .src = in_buff,
+                        .size = 0,
+                        .pos = 0
+                };
+                ssize_t red;
+
+                red = loop_read(fdf, in_buff, MIN(in_allocsize, left), true);
+                if (red < 0)
+                        return red;
+                is_last_chunk = red == 0;
+
+                in_bytes += (size_t) red;
+                input.size = (size_t) red;
+                left -= (size_t) red;
+
+                for (bool finished = false; !finished;) {
+                        ZSTD_outBuffer output = {
+                                .dst = out_buff,
+                                .size = out_allocsize,
+                                .pos = 0
+                        };
+                        size_t remaining;
+                        ssize_t wrote;
+
+                        /* Compress into the output buffer and write all of the
+                         * output to the file so we can reuse the buffer next
+                         * iteration.
+                         */
+                        remaining = ZSTD_compressStream2(
+                                cctx, &output, &input,
+                                is_last_chunk ? ZSTD_e_end : ZSTD_e_continue);
+
+                        if (ZSTD_isError(remaining)) {
+                                log_debug("ZSTD encoder failed: %s", ZSTD_getErrorName(remaining));
+                                return zstd_ret_to_errno(remaining);
+                        }
+
+                        wrote = loop_write(fdt, output.dst, output.pos, false);
+                        if (wrote < 0)
+                                return wrote;
+
+                        out_bytes += output.pos;
+
+                        /* If we're on the last chunk we're finished when zstd
+                         * returns 0, which means its consumed all the input AND
+                         * finished the frame. Otherwise, we're finished when
+                         * we've consumed all the input.
+                         */
+                        finished = is_last_chunk ? (remaining == 0) : (input.pos == input.size);
+                }
+
+                /* zstd only returns 0 when the input is completely consumed */
+                assert(input.pos == input.size);
+                if (is_last_chunk)
+                        break;
+        }
+
+        log_debug("ZSTD compression finished (%" PRIu64 " -> %" PRIu64 " bytes, %.1f%%)",
+                  in_bytes, out_bytes,
+                  in_bytes > 0 ? (double) out_bytes / in_bytes * 100 : 0.0);
+
+        if (ret_uncompressed_size)
+                *ret_uncompressed_size = in_bytes;
+
+        return 0;
+#else
+        return -EPROTONOSUPPORT;
+#endif
+}
+
 int decompress_stream_xz(int fdf, int fdt, uint64_t max_bytes) {
 
 #if HAVE_XZ
@@ -666,12 +1104,122 @@ int decompress_stream_lz4(int in, int out, uint64_t max_bytes) {
 #endif
 }
 
+int decompress_stream_zstd(int fdf, int fdt, uint64_t max_bytes) {
+#if HAVE_ZSTD
+        _cleanup_(ZSTD_freeDCtxp) ZSTD_DCtx *dctx = NULL;
+        _cleanup_free_ void *in_buff = NULL, *out_buff = NULL;
+        size_t in_allocsize, out_allocsize;
+        size_t last_result = 0;
+        uint64_t left = max_bytes, in_bytes = 0;
+
+        assert(fdf >= 0);
+        assert(fdt >= 0);
+
+        /* Create the context and buffers */
+        in_allocsize = ZSTD_DStreamInSize();
+        out_allocsize = ZSTD_DStreamOutSize();
+        in_buff = malloc(in_allocsize);
+        out_buff = malloc(out_allocsize);
+        dctx = ZSTD_createDCtx();
+        if (!dctx || !out_buff || !in_buff)
+                return -ENOMEM;
+
+        /* This loop assumes that the input file is one or more concatenated
+         * zstd streams. This example won't work if there is trailing non-zstd
+         * data at the end, but streaming decompression in general handles this
+         * case. ZSTD_decompressStream() returns 0 exactly when the frame is
+         * completed, and doesn't consume input after the frame.
+         */
+        for (;;) {
+                bool has_error = false;
+                ZSTD_inBuffer input = {
+                        .src = in_buff,
+                        .size = 0,
+                        .pos = 0
+                };
+                ssize_t red;
+
+                red = loop_read(fdf, in_buff, in_allocsize, true);
+                if (red < 0)
+                        return red;
+                if (red == 0)
+                        break;
+
+                in_bytes += (size_t) red;
+                input.size = (size_t) red;
+                input.pos = 0;
+
+                /* Given a valid frame, zstd won't consume the last byte of the
+                 * frame until it has flushed all of the decompressed data of
+                 * the frame. So input.pos < input.size means frame is not done
+                 * or there is still output available.
+                 */
+                while (input.pos < input.size) {
+                        ZSTD_outBuffer output = {
+                                .dst = out_buff,
+                                .size = out_allocsize,
+                                .pos = 0
+                        };
+                        ssize_t wrote;
+                        /* The return code is zero if the frame is complete, but
+                         * there may be multiple frames concatenated together.
+                         * Zstd will automatically reset the context when a
+                         * frame is complete. Still, calling ZSTD_DCtx_reset()
+                         * can be useful to reset the context to a clean state,
+                         * for instance if the last decompression call returned
+                         * an error.
+                         */
+                        last_result = ZSTD_decompressStream(dctx, &output, &input);
+                        if (ZSTD_isError(last_result)) {
+                                has_error = true;
+                                break;
+                        }
+
+                        if (left < output.pos)
+                                return -EFBIG;
+
+                        wrote = loop_write(fdt, output.dst, output.pos, false);
+                        if (wrote < 0)
+                                return wrote;
+
+                        left -= output.pos;
+                }
+                if (has_error)
+                        break;
+        }
+
+        if (in_bytes == 0)
+                return log_debug_errno(SYNTHETIC_ERRNO(EBADMSG), "ZSTD decoder failed: no data read");
+
+        if (last_result != 0) {
+                /* The last return value from ZSTD_decompressStream did not end
+                 * on a frame, but we reached the end of the file! We assume
+                 * this is an error, and the input was truncated.
+                 */
+                log_debug("ZSTD decoder failed: %s", ZSTD_getErrorName(last_result));
+                return zstd_ret_to_errno(last_result);
+        }
+
+        log_debug(
+                "ZSTD decompression finished (%" PRIu64 " -> %" PRIu64 " bytes, %.1f%%)",
+                in_bytes,
+                max_bytes - left,
+                (double) (max_bytes - left) / in_bytes * 100);
+        return 0;
+#else
+        log_debug("Cannot decompress file. Compiled without ZSTD support.");
+        return -EPROTONOSUPPORT;
+#endif
+}
+
 int decompress_stream(const char *filename, int fdf, int fdt, uint64_t max_bytes) {
 
         if (endswith(filename, ".lz4"))
                 return decompress_stream_lz4(fdf, fdt, max_bytes);
         else if (endswith(filename, ".xz"))
                 return decompress_stream_xz(fdf, fdt, max_bytes);
+        else if (endswith(filename, ".zst"))
+                return decompress_stream_zstd(fdf, fdt, max_bytes);
         else
                 return -EPROTONOSUPPORT;
 }
@@ -266,6 +266,27 @@ int journal_file_hmac_put_object(JournalFile *f, ObjectType type, Object *o, uin
                 gcry_md_write(f->hmac, &o->tag.seqnum, sizeof(o->tag.seqnum));
                 gcry_md_write(f->hmac, &o->tag.epoch, sizeof(o->tag.epoch));
                 break;
+
+        case OBJECT_DICTIONARY:
+                /* All */
+                gcry_md_write(f->hmac, &o->dictionary.dictionary_id, le64toh(o->object.size) - offsetof(DictionaryObject, dictionary_id));
+                break;
+
+        case OBJECT_BLOOM:
+                /* All */
+                gcry_md_write(f->hmac, &o->bloom.n_hashes, le64toh(o->object.size) - offsetof(BloomObject, n_hashes));
+                break;
+
+        case OBJECT_BOOT_INDEX:
+                /* All */
+                gcry_md_write(f->hmac, o->boot_index.items, le64toh(o->object.size) - offsetof(BootIndexObject, items));
+                break;
+
+        case OBJECT_ENTRY_ARRAY_INDEX:
+                /* All */
+                gcry_md_write(f->hmac, o->entry_array_index.items, le64toh(o->object.size) - offsetof(EntryArrayIndexObject, items));
+                break;
+
         default:
                 return -EINVAL;
         }
@@ -23,9 +23,15 @@ typedef struct EntryObject EntryObject;
 typedef struct HashTableObject HashTableObject;
 typedef struct EntryArrayObject EntryArrayObject;
 typedef struct TagObject TagObject;
+typedef struct DictionaryObject DictionaryObject;
+typedef struct BloomObject BloomObject;
+typedef struct BootIndexObject BootIndexObject;
+typedef struct EntryArrayIndexObject EntryArrayIndexObject;
 
 typedef struct EntryItem EntryItem;
 typedef struct HashItem HashItem;
+typedef struct BootIndexItem BootIndexItem;
+typedef struct EntryArrayIndexItem EntryArrayIndexItem;
 
 typedef struct FSSHeader FSSHeader;
 
@@ -39,6 +45,10 @@ typedef enum ObjectType {
         OBJECT_FIELD_HASH_TABLE,
         OBJECT_ENTRY_ARRAY,
         OBJECT_TAG,
+        OBJECT_DICTIONARY,
+        OBJECT_BLOOM,
+        OBJECT_BOOT_INDEX,
+        OBJECT_ENTRY_ARRAY_INDEX,
         _OBJECT_TYPE_MAX
 } ObjectType;
 
@@ -46,10 +56,13 @@ typedef enum ObjectType {
 enum {
         OBJECT_COMPRESSED_XZ = 1 << 0,
         OBJECT_COMPRESSED_LZ4 = 1 << 1,
+        OBJECT_COMPRESSED_ZSTD = 1 << 2,
         _OBJECT_COMPRESSED_MAX
 };
 
-#define OBJECT_COMPRESSION_MASK (OBJECT_COMPRESSED_XZ | OBJECT_COMPRESSED_LZ4)
+#define OBJECT_COMPRESSION_MASK (OBJECT_COMPRESSED_XZ | OBJECT_COMPRESSED_LZ4 | OBJECT_COMPRESSED_ZSTD)
+
+#define HAVE_COMPRESSION (HAVE_XZ || HAVE_LZ4 || HAVE_ZSTD)
 
 struct ObjectHeader {
         uint8_t type;
@@ -118,6 +131,50 @@ struct TagObject {
         uint8_t tag[TAG_LENGTH]; /* SHA-256 HMAC */
 } _packed_;
 
+/* A zstd dictionary trained from the first data objects of the file, referenced from the header */
+struct DictionaryObject {
+        ObjectHeader object;
+        le32_t dictionary_id;
+        uint8_t reserved[4];
+        uint8_t payload[];
+} _packed_;
+
+/* A Bloom filter over the hashes of all data objects, written when the file is archived. Bit i of the filter is
+ * bits[i / 8] & (1 << (i % 8)). */
+struct BloomObject {
+        ObjectHeader object;
+        le32_t n_hashes;
+        uint8_t reserved[4];
+        uint8_t bits[];
+} _packed_;
+
+struct BootIndexItem {
+        sd_id128_t boot_id;
+        le64_t first_seqnum;
+        le64_t last_seqnum;
+        le64_t first_realtime;
+        le64_t last_realtime;
+} _packed_;
+
+/* The first and last entry of every boot in the file, written when the file is archived */
+struct BootIndexObject {
+        ObjectHeader object;
+        BootIndexItem items[];
+} _packed_;
+
+struct EntryArrayIndexItem {
+        le64_t offset;     /* the entry array object */
+        le64_t n_items;    /* the number of items it has room for */
+        le64_t last_entry; /* the last entry it references */
+} _packed_;
+
+/* All arrays of the entry array chain starting at entry_array_offset, written when the file is archived, so that
+ * readers may bisect over them without walking the chain */
+struct EntryArrayIndexObject {
+        ObjectHeader object;
+        EntryArrayIndexItem items[];
+} _packed_;
+
 union Object {
         ObjectHeader object;
         DataObject data;
@@ -126,6 +183,10 @@ union Object {
         HashTableObject hash_table;
         EntryArrayObject entry_array;
         TagObject tag;
+        DictionaryObject dictionary;
+        BloomObject bloom;
+        BootIndexObject boot_index;
+        EntryArrayIndexObject entry_array_index;
 };
 
 enum {
@@ -139,19 +200,21 @@ enum {
 enum {
         HEADER_INCOMPATIBLE_COMPRESSED_XZ = 1 << 0,
         HEADER_INCOMPATIBLE_COMPRESSED_LZ4 = 1 << 1,
+        HEADER_INCOMPATIBLE_KEYED_HASH = 1 << 2, /* DATA and FIELD objects are hashed with siphash24, keyed by the file ID */
+        HEADER_INCOMPATIBLE_COMPRESSED_ZSTD = 1 << 3,
 };
 
-#define HEADER_INCOMPATIBLE_ANY (HEADER_INCOMPATIBLE_COMPRESSED_XZ|HEADER_INCOMPATIBLE_COMPRESSED_LZ4)
+#define HEADER_INCOMPATIBLE_ANY                 \
+        (HEADER_INCOMPATIBLE_COMPRESSED_XZ |    \
+         HEADER_INCOMPATIBLE_COMPRESSED_LZ4 |   \
+         HEADER_INCOMPATIBLE_COMPRESSED_ZSTD |  \
+         HEADER_INCOMPATIBLE_KEYED_HASH)
 
-#if HAVE_XZ && HAVE_LZ4
-#  define HEADER_INCOMPATIBLE_SUPPORTED HEADER_INCOMPATIBLE_ANY
-#elif HAVE_XZ
-#  define HEADER_INCOMPATIBLE_SUPPORTED HEADER_INCOMPATIBLE_COMPRESSED_XZ
-#elif HAVE_LZ4
-#  define HEADER_INCOMPATIBLE_SUPPORTED HEADER_INCOMPATIBLE_COMPRESSED_LZ4
-#else
-#  define HEADER_INCOMPATIBLE_SUPPORTED 0
-#endif
+#define HEADER_INCOMPATIBLE_SUPPORTED                                   \
+        ((HAVE_XZ ? HEADER_INCOMPATIBLE_COMPRESSED_XZ : 0) |            \
+         (HAVE_LZ4 ? HEADER_INCOMPATIBLE_COMPRESSED_LZ4 : 0) |          \
+         (HAVE_ZSTD ? HEADER_INCOMPATIBLE_COMPRESSED_ZSTD : 0) |        \
+         HEADER_INCOMPATIBLE_KEYED_HASH)
 
 enum {
         HEADER_COMPATIBLE_SEALED = 1
@@ -197,10 +260,26 @@ struct Header {
         /* Added in 189 */
         le64_t n_tags;
         le64_t n_entry_arrays;
+        /* Added in 246 */
+        le64_t data_hash_chain_depth;
+        le64_t field_hash_chain_depth;
 
-        /* Size: 240 */
+        /* Size: 256 */
+
+        /* Not known to other implementations, which ignore whatever follows the fields they know about */
+        le64_t zstd_dictionary_offset;
+        le64_t bloom_filter_offset;
+        le64_t boot_index_offset;
+        le64_t entry_array_index_offset;
+
+        /* Size: 288 */
 } _packed_;
 
+/* The fields shared with other implementations must stay where they are */
+assert_cc(offsetof(Header, data_hash_chain_depth) == 240);
+assert_cc(offsetof(Header, zstd_dictionary_offset) == 256);
+assert_cc(sizeof(Header) == 288);
+
 #define FSS_HEADER_SIGNATURE ((char[]) { 'K', 'S', 'H', 'H', 'R', 'H', 'L', 'P' })
 
 struct FSSHeader {
@@ -16,6 +16,7 @@
 #include "btrfs-util.h"
 #include "chattr-util.h"
 #include "compress.h"
+#include "env-util.h"
 #include "fd-util.h"
 #include "fs-util.h"
 #include "journal-authenticate.h"
@@ -26,6 +27,7 @@
 #include "path-util.h"
 #include "random-util.h"
 #include "set.h"
+#include "siphash24.h"
 #include "stat-util.h"
 #include "string-util.h"
 #include "strv.h"
@@ -65,11 +67,34 @@
 /* n_data was the first entry we added after the initial file format design */
 #define HEADER_SIZE_MIN ALIGN64(offsetof(Header, n_data))
 
+/* How many data objects to sample at most for training a zstd dictionary, how much of each object to sample, and
+ * how large the resulting dictionary may get */
+#define DICTIONARY_SAMPLES_MAX 16384U
+#define DICTIONARY_SAMPLE_SIZE_MAX (4U*1024U)                  /* 4 KiB */
+#define DICTIONARY_SIZE_MAX (64U*1024U)                        /* 64 KiB */
+
+/* If the longest hash chain of a file gets longer than this, the hash table is too small or badly distributed for the
+ * data we are storing, and we suggest rotation */
+#define HASH_CHAIN_DEPTH_MAX 100
+
+/* Bits per data object and number of hash functions of the Bloom filter written on archival, for a false positive
+ * rate of about 1%, and the maximum size of the filter */
+#define BLOOM_BITS_PER_ITEM 10U
+#define BLOOM_N_HASHES 7U
+#define BLOOM_SIZE_MAX (4U*1024U*1024U)                        /* 4 MiB */
+
 /* How many entries to keep in the entry array chain cache at max */
 #define CHAIN_CACHE_MAX 20
 
-/* How much to increase the journal file size at once each time we allocate something new. */
+/* From how many items on we bisect over the arrays of a chain first, instead of walking through them */
+#define CHAIN_CACHE_INDEX_MIN 1024
+
+/* How much to increase the journal file size at once each time we allocate something new. The step is doubled up
+ * to the maximum whenever the file has to grow again within the interval, and halved again when it doesn't, so
+ * that files which are written to quickly are extended rarely and in large, contiguous extents. */
 #define FILE_SIZE_INCREASE (8ULL*1024ULL*1024ULL)              /* 8MB */
+#define FILE_SIZE_INCREASE_MAX (128ULL*1024ULL*1024ULL)        /* 128MB */
+#define FILE_SIZE_INCREASE_INTERVAL_USEC (10*USEC_PER_SEC)
 
 /* Reread fstat() of the file for detecting deletions at least this often */
 #define LAST_STAT_REFRESH_USEC (5*USEC_PER_SEC)
@@ -140,6 +165,29 @@ static void * journal_file_set_offline_thread(void *arg) {
         return NULL;
 }
 
+static int journal_file_start_thread(JournalFile *f, pthread_t *ret, void *(*func)(void *)) {
+        sigset_t ss, saved_ss;
+        int r;
+
+        assert(f);
+        assert(ret);
+        assert(func);
+
+        /* Signals are dealt with by the main thread only, hence block them all in the new one */
+        if (sigfillset(&ss) < 0)
+                return -errno;
+
+        r = pthread_sigmask(SIG_BLOCK, &ss, &saved_ss);
+        if (r > 0)
+                return -r;
+
+        r = pthread_create(ret, NULL, func, f);
+
+        assert_se(pthread_sigmask(SIG_SETMASK, &saved_ss, NULL) == 0);
+
+        return -r;
+}
+
 static int journal_file_set_offline_thread_join(JournalFile *f) {
         int r;
 
@@ -233,25 +281,11 @@ int journal_file_set_offline(JournalFile *f, bool wait) {
         if (wait) /* Without using a thread if waiting. */
                 journal_file_set_offline_internal(f);
         else {
-                sigset_t ss, saved_ss;
-                int k;
-
-                if (sigfillset(&ss) < 0)
-                        return -errno;
-
-                r = pthread_sigmask(SIG_BLOCK, &ss, &saved_ss);
-                if (r > 0)
-                        return -r;
-
-                r = pthread_create(&f->offline_thread, NULL, journal_file_set_offline_thread, f);
-
-                k = pthread_sigmask(SIG_SETMASK, &saved_ss, NULL);
-                if (r > 0) {
+                r = journal_file_start_thread(f, &f->offline_thread, journal_file_set_offline_thread);
+                if (r < 0) {
                         f->offline_state = OFFLINE_JOINED;
-                        return -r;
+                        return r;
                 }
-                if (k > 0)
-                        return -k;
         }
 
         return 0;
@@ -335,6 +369,134 @@ bool journal_file_is_offlining(JournalFile *f) {
         return true;
 }
 
+typedef struct ChainCacheArray {
+        uint64_t offset; /* the array object */
+        uint64_t total; /* the total number of items in all arrays before this one in the chain */
+        uint64_t n_items; /* the number of items this array has room for */
+        uint64_t last; /* the last item, once known and final, or 0 */
+} ChainCacheArray;
+
+typedef struct ChainCacheItem {
+        uint64_t first; /* the array at the beginning of the chain */
+        uint64_t array; /* the cached array */
+        uint64_t begin; /* the first item in the cached array */
+        uint64_t total; /* the total number of items in all arrays before this one in the chain */
+        uint64_t last_index; /* the last index we looked at, to optimize locality when bisecting */
+
+        /* All arrays of the chain seen so far, in order. Since each array is twice as large as the one before
+         * there are only a few dozen of them even in huge files, but walking through them on every bisection
+         * means touching a new part of the file for each of them. */
+        ChainCacheArray *arrays;
+        size_t n_arrays, n_arrays_allocated;
+} ChainCacheItem;
+
+static ChainCacheItem* chain_cache_item_free(ChainCacheItem *ci) {
+        if (!ci)
+                return NULL;
+
+        free(ci->arrays);
+        return mfree(ci);
+}
+
+static void* journal_file_reserve_thread(void *arg) {
+        JournalFile *f = arg;
+
+        (void) pthread_setname_np(pthread_self(), "journal-reserve");
+
+        /* This only allocates blocks beyond the end of the arena, which nobody looks at, so that they are there
+         * already when the arena is grown into them later on. Note that we call fallocate() directly rather
+         * than posix_fallocate(): the glibc fallback for file systems that don't support it writes to each
+         * block, which would race with the objects appended to the arena meanwhile. The blocks are kept
+         * beyond EOF here, journal_file_post_change() extends the file over them afterwards. */
+        if (fallocate(f->fd, FALLOC_FL_KEEP_SIZE, f->reserve_offset, f->reserve_length) < 0)
+                f->reserve_error = -errno;
+
+        return NULL;
+}
+
+static int journal_file_reserve_thread_join(JournalFile *f, bool wait) {
+        int r;
+
+        assert(f);
+
+        if (!f->reserve_thread_running)
+                return 0;
+
+        r = wait ? pthread_join(f->reserve_thread, NULL) : pthread_tryjoin_np(f->reserve_thread, NULL);
+        if (r == EBUSY)
+                return -EBUSY;
+        if (r > 0)
+                return -r;
+
+        f->reserve_thread_running = false;
+
+        if (IN_SET(f->reserve_error, -EOPNOTSUPP, -ENOSYS)) {
+                log_debug_errno(f->reserve_error, "File system of journal file %s doesn't support fallocate(), not reserving space: %m", f->path);
+                f->reserve_failed = true;
+        } else if (f->reserve_error < 0) {
+                log_debug_errno(f->reserve_error, "Failed to reserve space for journal file %s, not trying again: %m", f->path);
+                f->reserve_failed = true;
+        }
+
+        return 0;
+}
+
+static void journal_file_reserve(JournalFile *f, uint64_t size, uint64_t available) {
+        uint64_t end;
+
+        assert(f);
+
+        /* Reserve disk space for the next step ahead of time in the background, but only if the file grows
+         * quickly. Otherwise this isn't worth it. */
+
+        if (f->size_increase <= FILE_SIZE_INCREASE)
+                return;
+        if (f->reserve_failed) /* e.g. the disk is full, or the file system doesn't support it */
+                return;
+
+        end = size + f->size_increase;
+        if (f->metrics.max_size > 0 && end > f->metrics.max_size)
+                end = f->metrics.max_size;
+        if (end <= MAX(size, f->reserved_size))
+                return;
+        if (end - size > available)
+                return;
+
+        /* Only one at a time, if the previous reservation isn't done yet, we'll try again next time */
+        if (journal_file_reserve_thread_join(f, false) < 0)
+                return;
+        if (f->reserve_failed)
+                return;
+
+        f->reserve_offset = MAX(size, f->reserved_size);
+        f->reserve_length = end - f->reserve_offset;
+        f->reserve_error = 0;
+
+        if (journal_file_start_thread(f, &f->reserve_thread, journal_file_reserve_thread) < 0)
+                return;
+
+        f->reserve_thread_running = true;
+        f->reserved_size = end;
+}
+
+static void journal_file_drop_reservation(JournalFile *f) {
+        uint64_t size;
+
+        assert(f);
+
+        (void) journal_file_reserve_thread_join(f, true);
+
+        if (!f->header || f->reserved_size == 0)
+                return;
+
+        /* Give back the space we reserved but didn't get to use */
+        size = le64toh(f->header->header_size) + le64toh(f->header->arena_size);
+        if (f->reserved_size > size && ftruncate(f->fd, size) < 0)
+                log_debug_errno(errno, "Failed to drop reserved space of journal file %s, ignoring: %m", f->path);
+
+        f->reserved_size = 0;
+}
+
 JournalFile* journal_file_close(JournalFile *f) {
         assert(f);
 
@@ -357,6 +519,9 @@ JournalFile* journal_file_close(JournalFile *f) {
                 sd_event_source_unref(f->post_change_timer);
         }
 
+        if (f->writable && f->fd >= 0)
+                journal_file_drop_reservation(f);
+
         journal_file_set_offline(f, true);
 
         if (f->mmap && f->cache_fd)
@@ -380,12 +545,18 @@ JournalFile* journal_file_close(JournalFile *f) {
 
         mmap_cache_unref(f->mmap);
 
-        ordered_hashmap_free_free(f->chain_cache);
+        ordered_hashmap_free_with_destructor(f->chain_cache, chain_cache_item_free);
 
-#if HAVE_XZ || HAVE_LZ4
+#if HAVE_COMPRESSION
         free(f->compress_buffer);
 #endif
 
+#if HAVE_ZSTD
+        compress_dictionary_free(f->compress_dictionary);
+        free(f->dictionary_samples);
+        free(f->dictionary_sample_sizes);
+#endif
+
 #if HAVE_GCRYPT
         if (f->fss_file)
                 munmap(f->fss_file, PAGE_ALIGN(f->fss_file_size));
@@ -413,7 +584,9 @@ static int journal_file_init_header(JournalFile *f, JournalFile *template) {
 
         h.incompatible_flags |= htole32(
                 f->compress_xz * HEADER_INCOMPATIBLE_COMPRESSED_XZ |
-                f->compress_lz4 * HEADER_INCOMPATIBLE_COMPRESSED_LZ4);
+                f->compress_lz4 * HEADER_INCOMPATIBLE_COMPRESSED_LZ4 |
+                f->compress_zstd * HEADER_INCOMPATIBLE_COMPRESSED_ZSTD |
+                f->keyed_hash * HEADER_INCOMPATIBLE_KEYED_HASH);
 
         h.compatible_flags = htole32(
                 f->seal * HEADER_COMPATIBLE_SEALED);
@@ -483,7 +656,7 @@ static bool warn_wrong_flags(const JournalFile *f, bool compatible) {
                                   f->path, type, flags & ~any);
                 flags = (flags & any) & ~supported;
                 if (flags) {
-                        const char* strv[3];
+                        const char* strv[5];
                         unsigned n = 0;
                         _cleanup_free_ char *t = NULL;
 
@@ -493,6 +666,10 @@ static bool warn_wrong_flags(const JournalFile *f, bool compatible) {
                                 strv[n++] = "xz-compressed";
                         if (!compatible && (flags & HEADER_INCOMPATIBLE_COMPRESSED_LZ4))
                                 strv[n++] = "lz4-compressed";
+                        if (!compatible && (flags & HEADER_INCOMPATIBLE_COMPRESSED_ZSTD))
+                                strv[n++] = "zstd-compressed";
+                        if (!compatible && (flags & HEADER_INCOMPATIBLE_KEYED_HASH))
+                                strv[n++] = "keyed-hash";
                         strv[n] = NULL;
                         assert(n < ELEMENTSOF(strv));
 
@@ -589,8 +766,10 @@ static int journal_file_verify_header(JournalFile *f) {
 
         f->compress_xz = JOURNAL_HEADER_COMPRESSED_XZ(f->header);
         f->compress_lz4 = JOURNAL_HEADER_COMPRESSED_LZ4(f->header);
+        f->compress_zstd = JOURNAL_HEADER_COMPRESSED_ZSTD(f->header);
 
         f->seal = JOURNAL_HEADER_SEALED(f->header);
+        f->keyed_hash = JOURNAL_HEADER_KEYED_HASH(f->header);
 
         return 0;
 }
@@ -618,8 +797,25 @@ static int journal_file_fstat(JournalFile *f) {
         return 0;
 }
 
+static void journal_file_update_size_increase(JournalFile *f) {
+        usec_t n;
+
+        assert(f);
+
+        n = now(CLOCK_MONOTONIC);
+
+        if (f->size_increase == 0)
+                f->size_increase = FILE_SIZE_INCREASE;
+        else if (n < usec_add(f->last_grow_usec, FILE_SIZE_INCREASE_INTERVAL_USEC))
+                f->size_increase = MIN(f->size_increase * 2, FILE_SIZE_INCREASE_MAX);
+        else
+                f->size_increase = MAX(f->size_increase / 2, FILE_SIZE_INCREASE);
+
+        f->last_grow_usec = n;
+}
+
 static int journal_file_allocate(JournalFile *f, uint64_t offset, uint64_t size) {
-        uint64_t old_size, new_size;
+        uint64_t old_size, new_size, available = UINT64_MAX;
         int r;
 
         assert(f);
@@ -663,8 +859,6 @@ static int journal_file_allocate(JournalFile *f, uint64_t offset, uint64_t size)
                 struct statvfs svfs;
 
                 if (fstatvfs(f->fd, &svfs) >= 0) {
-                        uint64_t available;
-
                         available = LESS_BY((uint64_t) svfs.f_bfree * (uint64_t) svfs.f_bsize, f->metrics.keep_free);
 
                         if (new_size - old_size > available)
@@ -672,11 +866,20 @@ static int journal_file_allocate(JournalFile *f, uint64_t offset, uint64_t size)
                 }
         }
 
-        /* Increase by larger blocks at once */
-        new_size = DIV_ROUND_UP(new_size, FILE_SIZE_INCREASE) * FILE_SIZE_INCREASE;
+        /* Increase by larger blocks at once, but fall back to the smallest step if disk space is tight */
+        journal_file_update_size_increase(f);
+        if (DIV_ROUND_UP(new_size, f->size_increase) * f->size_increase - old_size > available)
+                f->size_increase = FILE_SIZE_INCREASE;
+
+        new_size = DIV_ROUND_UP(new_size, f->size_increase) * f->size_increase;
         if (f->metrics.max_size > 0 && new_size > f->metrics.max_size)
                 new_size = f->metrics.max_size;
 
+        /* The reservation running in the background covers the range we are about to grow into, wait for it
+         * to finish before we allocate it ourselves and start writing objects there. */
+        if (f->reserve_thread_running && new_size > f->reserve_offset)
+                (void) journal_file_reserve_thread_join(f, true);
+
         /* Note that the glibc fallocate() fallback is very
            inefficient, hence we try to minimize the allocation area
            as we can. */
@@ -686,7 +889,13 @@ static int journal_file_allocate(JournalFile *f, uint64_t offset, uint64_t size)
 
         f->header->arena_size = htole64(new_size - le64toh(f->header->header_size));
 
-        return journal_file_fstat(f);
+        r = journal_file_fstat(f);
+        if (r < 0)
+                return r;
+
+        journal_file_reserve(f, new_size, LESS_BY(available, new_size - old_size));
+
+        return 0;
 }
 
 static unsigned type_to_context(ObjectType type) {
@@ -731,6 +940,10 @@ static uint64_t minimum_header_size(Object *o) {
                 [OBJECT_FIELD_HASH_TABLE] = sizeof(HashTableObject),
                 [OBJECT_ENTRY_ARRAY] = sizeof(EntryArrayObject),
                 [OBJECT_TAG] = sizeof(TagObject),
+                [OBJECT_DICTIONARY] = sizeof(DictionaryObject),
+                [OBJECT_BLOOM] = sizeof(BloomObject),
+                [OBJECT_BOOT_INDEX] = sizeof(BootIndexObject),
+                [OBJECT_ENTRY_ARRAY_INDEX] = sizeof(EntryArrayIndexObject),
         };
 
         if (o->object.type >= ELEMENTSOF(table) || table[o->object.type] <= 0)
@@ -868,6 +1081,56 @@ static int journal_file_check_object(JournalFile *f, uint64_t offset, Object *o)
                                                le64toh(o->tag.epoch), offset);
 
                 break;
+
+        case OBJECT_DICTIONARY:
+                if (le64toh(o->object.size) - offsetof(DictionaryObject, payload) <= 0)
+                        return log_debug_errno(SYNTHETIC_ERRNO(EBADMSG),
+                                               "Bad dictionary size (<= %zu): %" PRIu64 ": %" PRIu64,
+                                               offsetof(DictionaryObject, payload),
+                                               le64toh(o->object.size),
+                                               offset);
+
+                if (le32toh(o->dictionary.dictionary_id) == 0)
+                        return log_debug_errno(SYNTHETIC_ERRNO(EBADMSG),
+                                               "Invalid dictionary ID: %" PRIu64,
+                                               offset);
+
+                break;
+
+        case OBJECT_BLOOM:
+                if (le64toh(o->object.size) - offsetof(BloomObject, bits) <= 0)
+                        return log_debug_errno(SYNTHETIC_ERRNO(EBADMSG),
+                                               "Bad Bloom filter size (<= %zu): %" PRIu64 ": %" PRIu64,
+                                               offsetof(BloomObject, bits),
+                                               le64toh(o->object.size),
+                                               offset);
+
+                if (le32toh(o->bloom.n_hashes) == 0)
+                        return log_debug_errno(SYNTHETIC_ERRNO(EBADMSG),
+                                               "Invalid number of Bloom filter hashes: %" PRIu64,
+                                               offset);
+
+                break;
+
+        case OBJECT_BOOT_INDEX:
+                if ((le64toh(o->object.size) - offsetof(BootIndexObject, items)) % sizeof(BootIndexItem) != 0 ||
+                    (le64toh(o->object.size) - offsetof(BootIndexObject, items)) / sizeof(BootIndexItem) <= 0)
+                        return log_debug_errno(SYNTHETIC_ERRNO(EBADMSG),
+                                               "Invalid object boot index size: %" PRIu64 ": %" PRIu64,
+                                               le64toh(o->object.size),
+                                               offset);
+
+                break;
+
+        case OBJECT_ENTRY_ARRAY_INDEX:
+                if ((le64toh(o->object.size) - offsetof(EntryArrayIndexObject, items)) % sizeof(EntryArrayIndexItem) != 0 ||
+                    (le64toh(o->object.size) - offsetof(EntryArrayIndexObject, items)) / sizeof(EntryArrayIndexItem) <= 0)
+                        return log_debug_errno(SYNTHETIC_ERRNO(EBADMSG),
+                                               "Invalid object entry array index size: %" PRIu64 ": %" PRIu64,
+                                               le64toh(o->object.size),
+                                               offset);
+
+                break;
         }
 
         return 0;
@@ -1234,7 +1497,7 @@ int journal_file_find_field_object_with_hash(
                 const void *field, uint64_t size, uint64_t hash,
                 Object **ret, uint64_t *offset) {
 
-        uint64_t p, osize, h, m;
+        uint64_t p, osize, h, m, depth = 0;
         int r;
 
         assert(f);
@@ -1279,11 +1542,32 @@ int journal_file_find_field_object_with_hash(
                 }
 
                 p = le64toh(o->field.next_hash_offset);
+                depth++;
         }
 
+        /* We walked the whole chain, remember how long it is, so that we can rotate if it gets out of hand */
+        if (f->writable &&
+            JOURNAL_HEADER_CONTAINS(f->header, field_hash_chain_depth) &&
+            depth > le64toh(f->header->field_hash_chain_depth))
+                f->header->field_hash_chain_depth = htole64(depth);
+
         return 0;
 }
 
+uint64_t journal_file_hash_data(JournalFile *f, const void *data, size_t sz) {
+        assert(f);
+        assert(f->header);
+
+        /* Files with the keyed hash flag use siphash24 keyed by the file ID, so that the hash table layout can't be
+         * predicted, and attacked with colliding data, by anyone who doesn't know the file ID. Otherwise we use
+         * Jenkins' lookup3 as before. */
+
+        if (JOURNAL_HEADER_KEYED_HASH(f->header))
+                return siphash24(data, sz, f->header->file_id.bytes);
+
+        return hash64(data, sz);
+}
+
 int journal_file_find_field_object(
                 JournalFile *f,
                 const void *field, uint64_t size,
@@ -1294,19 +1578,134 @@ int journal_file_find_field_object(
         assert(f);
         assert(field && size > 0);
 
-        hash = hash64(field, size);
+        hash = journal_file_hash_data(f, field, size);
 
         return journal_file_find_field_object_with_hash(f,
                                                         field, size, hash,
                                                         ret, offset);
 }
 
+static uint64_t bloom_bit(uint64_t hash, unsigned i, uint64_t n_bits) {
+        /* Derive the hash functions from the two halves of the data hash, as suggested by Kirsch and Mitzenmacher */
+        return ((hash & UINT32_MAX) + (uint64_t) i * ((hash >> 32) | 1)) % n_bits;
+}
+
+static int journal_file_bloom_test(JournalFile *f, uint64_t hash) {
+        uint64_t n_bits;
+        unsigned i, n;
+        Object *o;
+        int r;
+
+        assert(f);
+        assert(f->header);
+
+        /* Returns 0 if the file definitely contains no data object with this hash, > 0 if it might */
+
+        if (!JOURNAL_HEADER_CONTAINS(f->header, bloom_filter_offset) ||
+            f->header->bloom_filter_offset == 0)
+                return 1;
+
+        r = journal_file_move_to_object(f, OBJECT_BLOOM, le64toh(f->header->bloom_filter_offset), &o);
+        if (r < 0)
+                return r;
+
+        n_bits = (le64toh(o->object.size) - offsetof(Object, bloom.bits)) * 8;
+        n = le32toh(o->bloom.n_hashes);
+
+        for (i = 0; i < n; i++) {
+                uint64_t b = bloom_bit(hash, i, n_bits);
+
+                if (!(o->bloom.bits[b / 8] & (1U << (b % 8))))
+                        return 0;
+        }
+
+        return 1;
+}
+
+static int journal_file_append_bloom(JournalFile *f) {
+        _cleanup_free_ uint8_t *bits = NULL;
+        uint64_t n_data, n_bits, size, n = 0, m, i, p;
+        Object *o;
+        int r;
+
+        assert(f);
+        assert(f->header);
+
+        /* Archived files don't change anymore, hence this is when we write a Bloom filter over all data hashes,
+         * which allows readers to skip files that can't match without looking into the data hash table. */
+
+        if (!JOURNAL_HEADER_CONTAINS(f->header, bloom_filter_offset) ||
+            f->header->bloom_filter_offset != 0)
+                return 0;
+
+        n_data = le64toh(f->header->n_data);
+        if (n_data == 0)
+                return 0;
+
+        size = MIN(ALIGN64(DIV_ROUND_UP(n_data * BLOOM_BITS_PER_ITEM, 8)), (uint64_t) BLOOM_SIZE_MAX);
+        n_bits = size * 8;
+
+        bits = new0(uint8_t, size);
+        if (!bits)
+                return -ENOMEM;
+
+        r = journal_file_map_data_hash_table(f);
+        if (r < 0)
+                return r;
+
+        m = le64toh(f->header->data_hash_table_size) / sizeof(HashItem);
+        for (i = 0; i < m; i++) {
+                uint64_t q = le64toh(f->data_hash_table[i].head_hash_offset);
+
+                while (q > 0) {
+                        uint64_t hash;
+                        unsigned k;
+
+                        /* Don't loop forever on a cycle in a corrupted hash chain */
+                        if (++n > n_data)
+                                return -EBADMSG;
+
+                        r = journal_file_move_to_object(f, OBJECT_DATA, q, &o);
+                        if (r < 0)
+                                return r;
+
+                        hash = le64toh(o->data.hash);
+                        for (k = 0; k < BLOOM_N_HASHES; k++) {
+                                uint64_t b = bloom_bit(hash, k, n_bits);
+
+                                bits[b / 8] |= 1U << (b % 8);
+                        }
+
+                        q = le64toh(o->data.next_hash_offset);
+                }
+        }
+
+        r = journal_file_append_object(f, OBJECT_BLOOM, offsetof(Object, bloom.bits) + size, &o, &p);
+        if (r < 0)
+                return r;
+
+        o->bloom.n_hashes = htole32(BLOOM_N_HASHES);
+        memcpy(o->bloom.bits, bits, size);
+
+#if HAVE_GCRYPT
+        r = journal_file_hmac_put_object(f, OBJECT_BLOOM, o, p);
+        if (r < 0)
+                return r;
+#endif
+
+        f->header->bloom_filter_offset = htole64(p);
+
+        log_debug("Appended Bloom filter of %" PRIu64 " bytes over %" PRIu64 " data objects to %s.", size, n, f->path);
+
+        return 0;
+}
+
 int journal_file_find_data_object_with_hash(
                 JournalFile *f,
                 const void *data, uint64_t size, uint64_t hash,
                 Object **ret, uint64_t *offset) {
 
-        uint64_t p, osize, h, m;
+        uint64_t p, osize, h, m, depth = 0;
         int r;
 
         assert(f);
@@ -1317,6 +1716,11 @@ int journal_file_find_data_object_with_hash(
         if (le64toh(f->header->data_hash_table_size) <= 0)
                 return 0;
 
+        /* Archived files carry a Bloom filter, which might tell us right-away the data is not in this file */
+        r = journal_file_bloom_test(f, hash);
+        if (r <= 0)
+                return r;
+
         /* Map the data hash table, if it isn't mapped yet. */
         r = journal_file_map_data_hash_table(f);
         if (r < 0)
@@ -1342,7 +1746,9 @@ int journal_file_find_data_object_with_hash(
                         goto next;
 
                 if (o->object.flags & OBJECT_COMPRESSION_MASK) {
-#if HAVE_XZ || HAVE_LZ4
+#if HAVE_COMPRESSION
+                        CompressDictionary *dict;
+                        int compression;
                         uint64_t l;
                         size_t rsize = 0;
 
@@ -1352,7 +1758,13 @@ int journal_file_find_data_object_with_hash(
 
                         l -= offsetof(Object, data.payload);
 
-                        r = decompress_blob(o->object.flags & OBJECT_COMPRESSION_MASK,
+                        compression = o->object.flags & OBJECT_COMPRESSION_MASK;
+
+                        r = journal_file_get_compress_dictionary(f, compression, &dict);
+                        if (r < 0)
+                                return r;
+
+                        r = decompress_blob(compression, dict,
                                             o->data.payload, l, &f->compress_buffer, &f->compress_buffer_size, &rsize, 0);
                         if (r < 0)
                                 return r;
@@ -1385,8 +1797,14 @@ int journal_file_find_data_object_with_hash(
 
         next:
                 p = le64toh(o->data.next_hash_offset);
+                depth++;
         }
 
+        if (f->writable &&
+            JOURNAL_HEADER_CONTAINS(f->header, data_hash_chain_depth) &&
+            depth > le64toh(f->header->data_hash_chain_depth))
+                f->header->data_hash_chain_depth = htole64(depth);
+
         return 0;
 }
 
@@ -1400,7 +1818,7 @@ int journal_file_find_data_object(
         assert(f);
         assert(data || size == 0);
 
-        hash = hash64(data, size);
+        hash = journal_file_hash_data(f, data, size);
 
         return journal_file_find_data_object_with_hash(f,
                                                        data, size, hash,
@@ -1420,7 +1838,7 @@ static int journal_file_append_field(
         assert(f);
         assert(field && size > 0);
 
-        hash = hash64(field, size);
+        hash = journal_file_hash_data(f, field, size);
 
         r = journal_file_find_field_object_with_hash(f, field, size, hash, &o, &p);
         if (r < 0)
@@ -1469,9 +1887,167 @@ static int journal_file_append_field(
         return 0;
 }
 
+int journal_file_get_compress_dictionary(JournalFile *f, int compression, CompressDictionary **ret) {
+        assert(f);
+        assert(f->header);
+        assert(ret);
+
+        /* Returns the dictionary to use for data compressed with the specified algorithm, or NULL if there is
+         * none. The dictionary is loaded from the file on first use. */
+
+#if HAVE_ZSTD
+        if (compression == OBJECT_COMPRESSED_ZSTD &&
+            !f->compress_dictionary &&
+            JOURNAL_HEADER_CONTAINS(f->header, zstd_dictionary_offset) &&
+            f->header->zstd_dictionary_offset != 0) {
+                _cleanup_(compress_dictionary_freep) CompressDictionary *d = NULL;
+                Object *o;
+                int r;
+
+                r = journal_file_move_to_object(f, OBJECT_DICTIONARY, le64toh(f->header->zstd_dictionary_offset), &o);
+                if (r < 0)
+                        return r;
+
+                r = compress_dictionary_new(o->dictionary.payload,
+                                            le64toh(o->object.size) - offsetof(Object, dictionary.payload),
+                                            &d);
+                if (r < 0)
+                        return r;
+
+                if (compress_dictionary_id(d) != le32toh(o->dictionary.dictionary_id))
+                        return -EBADMSG;
+
+                f->compress_dictionary = TAKE_PTR(d);
+        }
+
+        *ret = compression == OBJECT_COMPRESSED_ZSTD ? f->compress_dictionary : NULL;
+#else
+        *ret = NULL;
+#endif
+        return 0;
+}
+
+#if HAVE_ZSTD
+static int journal_file_append_dictionary(JournalFile *f) {
+        _cleanup_(compress_dictionary_freep) CompressDictionary *d = NULL;
+        _cleanup_free_ void *dict = NULL;
+        size_t dict_size;
+        uint64_t p;
+        Object *o;
+        int r;
+
+        assert(f);
+
+        r = compress_dictionary_train(f->dictionary_samples, f->dictionary_sample_sizes, f->n_dictionary_samples,
+                                      DICTIONARY_SIZE_MAX, &dict, &dict_size);
+        if (r < 0)
+                return r;
+
+        r = compress_dictionary_new(dict, dict_size, &d);
+        if (r < 0)
+                return r;
+
+        r = journal_file_append_object(f, OBJECT_DICTIONARY, offsetof(Object, dictionary.payload) + dict_size, &o, &p);
+        if (r < 0)
+                return r;
+
+        o->dictionary.dictionary_id = htole32(compress_dictionary_id(d));
+        memcpy(o->dictionary.payload, dict, dict_size);
+
+#if HAVE_GCRYPT
+        r = journal_file_hmac_put_object(f, OBJECT_DICTIONARY, o, p);
+        if (r < 0)
+                return r;
+#endif
+
+        f->header->zstd_dictionary_offset = htole64(p);
+        f->compress_dictionary = TAKE_PTR(d);
+
+        log_debug("Trained zstd dictionary of %zu bytes from %zu data objects for %s.",
+                  dict_size, f->n_dictionary_samples, f->path);
+
+        return 0;
+}
+
+static void journal_file_sample_data(JournalFile *f, const void *data, uint64_t size) {
+        size_t n;
+        int r;
+
+        assert(f);
+        assert(data);
+
+        /* Collects (the beginning of) the payload of the first data objects of the file, and trains a dictionary
+         * from them once we have enough. Data objects appended before that are compressed without dictionary. */
+
+        if (f->dictionary_samples_max == 0)
+                return;
+
+        n = (size_t) MIN(size, (uint64_t) DICTIONARY_SAMPLE_SIZE_MAX);
+
+        if (!GREEDY_REALLOC(f->dictionary_samples, f->dictionary_samples_allocated, f->dictionary_samples_size + n) ||
+            !GREEDY_REALLOC(f->dictionary_sample_sizes, f->n_dictionary_samples_allocated, f->n_dictionary_samples + 1)) {
+                r = -ENOMEM;
+                goto finish;
+        }
+
+        memcpy(f->dictionary_samples + f->dictionary_samples_size, data, n);
+        f->dictionary_samples_size += n;
+        f->dictionary_sample_sizes[f->n_dictionary_samples++] = n;
+
+        if (f->n_dictionary_samples < f->dictionary_samples_max)
+                return;
+
+        r = journal_file_append_dictionary(f);
+
+finish:
+        if (r < 0)
+                log_debug_errno(r, "Failed to set up zstd dictionary for %s, continuing without: %m", f->path);
+
+        /* Whether this worked or not, we won't try again for this file */
+        f->dictionary_samples_max = 0;
+        f->dictionary_samples = mfree(f->dictionary_samples);
+        f->dictionary_samples_size = f->dictionary_samples_allocated = 0;
+        f->dictionary_sample_sizes = mfree(f->dictionary_sample_sizes);
+        f->n_dictionary_samples = f->n_dictionary_samples_allocated = 0;
+}
+
+static size_t dictionary_samples_from_env(void) {
+        const char *e;
+        unsigned n;
+
+        /* Training a dictionary is optional and off by default, since data objects compressed with it cannot be
+         * read without also loading the dictionary. */
+
+        e = getenv("SYSTEMD_JOURNAL_ZSTD_DICTIONARY_SAMPLES");
+        if (!e)
+                return 0;
+
+        if (safe_atou(e, &n) < 0) {
+                log_debug("Failed to parse $SYSTEMD_JOURNAL_ZSTD_DICTIONARY_SAMPLES, ignoring: %s", e);
+                return 0;
+        }
+
+        return MIN(n, DICTIONARY_SAMPLES_MAX);
+}
+#endif
+
+static int journal_file_compression(JournalFile *f) {
+        assert(f);
+
+        if (f->compress_zstd)
+                return OBJECT_COMPRESSED_ZSTD;
+        if (f->compress_lz4)
+                return OBJECT_COMPRESSED_LZ4;
+        if (f->compress_xz)
+                return OBJECT_COMPRESSED_XZ;
+
+        return 0;
+}
+
 static int journal_file_append_data(
                 JournalFile *f,
                 const void *data, uint64_t size,
+                const JournalFilePayload *payload,
                 Object **ret, uint64_t *offset) {
 
         uint64_t hash, p;
@@ -1483,7 +2059,7 @@ static int journal_file_append_data(
         assert(f);
         assert(data || size == 0);
 
-        hash = hash64(data, size);
+        hash = journal_file_hash_data(f, data, size);
 
         r = journal_file_find_data_object_with_hash(f, data, size, hash, &o, &p);
         if (r < 0)
@@ -1499,6 +2075,30 @@ static int journal_file_append_data(
                 return 0;
         }
 
+#if HAVE_ZSTD
+        /* Do this before appending the new object, since training appends an object of its own */
+        if (f->compress_zstd && size >= f->compress_threshold_bytes)
+                journal_file_sample_data(f, data, size);
+#endif
+
+        /* If the caller already has the data compressed in the way we'd compress it ourselves, store it as-is */
+        if (payload && payload->compression != 0 && payload->size < size &&
+            JOURNAL_FILE_COMPRESS(f) && payload->compression == journal_file_compression(f)) {
+                osize = offsetof(Object, data.payload) + payload->size;
+                r = journal_file_append_object(f, OBJECT_DATA, osize, &o, &p);
+                if (r < 0)
+                        return r;
+
+                o->data.hash = htole64(hash);
+                o->object.flags |= payload->compression;
+                memcpy(o->data.payload, payload->data, payload->size);
+                compression = payload->compression;
+
+                log_debug("Stored data object %"PRIu64" -> %zu compressed using %s as received",
+                          size, payload->size, object_compressed_to_string(compression));
+                goto link;
+        }
+
         osize = offsetof(Object, data.payload) + size;
         r = journal_file_append_object(f, OBJECT_DATA, osize, &o, &p);
         if (r < 0)
@@ -1506,18 +2106,27 @@ static int journal_file_append_data(
 
         o->data.hash = htole64(hash);
 
-#if HAVE_XZ || HAVE_LZ4
+#if HAVE_COMPRESSION
         if (JOURNAL_FILE_COMPRESS(f) && size >= f->compress_threshold_bytes) {
+                CompressDictionary *dict;
                 size_t rsize = 0;
 
-                compression = compress_blob(data, size, o->data.payload, size - 1, &rsize);
+                compression = journal_file_compression(f);
 
-                if (compression >= 0) {
+                r = journal_file_get_compress_dictionary(f, compression, &dict);
+                if (r < 0) {
+                        log_debug_errno(r, "Failed to load compression dictionary of %s, compressing without: %m", f->path);
+                        dict = NULL;
+                }
+
+                r = compress_blob(compression, dict, data, size, o->data.payload, size - 1, &rsize);
+                if (r >= 0) {
                         o->object.size = htole64(offsetof(Object, data.payload) + rsize);
                         o->object.flags |= compression;
 
-                        log_debug("Compressed data object %"PRIu64" -> %zu using %s",
-                                  size, rsize, object_compressed_to_string(compression));
+                        log_debug("Compressed data object %"PRIu64" -> %zu using %s%s",
+                                  size, rsize, object_compressed_to_string(compression),
+                                  dict ? " with dictionary" : "");
                 } else
                         /* Compression didn't work, we don't really care why, let's continue without compression */
                         compression = 0;
@@ -1527,6 +2136,7 @@ static int journal_file_append_data(
         if (compression == 0)
                 memcpy_safe(o->data.payload, data, size);
 
+link:
         r = journal_file_link_data(f, o, p, hash);
         if (r < 0)
                 return r;
@@ -1826,7 +2436,9 @@ void journal_file_post_change(JournalFile *f) {
 
         __sync_synchronize();
 
-        if (ftruncate(f->fd, f->last_stat.st_size) < 0)
+        /* Extend the file over the space reserved in the background ahead of the arena: it is allocated with
+         * FALLOC_FL_KEEP_SIZE, and truncating to the current size would drop it again. */
+        if (ftruncate(f->fd, MAX((uint64_t) f->last_stat.st_size, f->reserved_size)) < 0)
                 log_debug_errno(errno, "Failed to truncate file to its own size: %m");
 }
 
@@ -1906,11 +2518,13 @@ static int entry_item_cmp(const EntryItem *a, const EntryItem *b) {
         return CMP(le64toh(a->object_offset), le64toh(b->object_offset));
 }
 
-int journal_file_append_entry(
+static int journal_file_append_entry_no_post_change(
                 JournalFile *f,
                 const dual_timestamp *ts,
                 const sd_id128_t *boot_id,
-                const struct iovec iovec[], unsigned n_iovec,
+                const struct iovec iovec[],
+                const JournalFilePayload payloads[],
+                unsigned n_iovec,
                 uint64_t *seqnum,
                 Object **ret, uint64_t *offset) {
 
@@ -1951,11 +2565,17 @@ int journal_file_append_entry(
                 uint64_t p;
                 Object *o;
 
-                r = journal_file_append_data(f, iovec[i].iov_base, iovec[i].iov_len, &o, &p);
+                r = journal_file_append_data(f, iovec[i].iov_base, iovec[i].iov_len, payloads ? payloads + i : NULL, &o, &p);
                 if (r < 0)
                         return r;
 
-                xor_hash ^= le64toh(o->data.hash);
+                /* The XOR hash is used to recognize the same entry in different files, hence it is always
+                 * calculated with Jenkins' hash, regardless of what the file uses for its hash tables */
+                if (JOURNAL_HEADER_KEYED_HASH(f->header))
+                        xor_hash ^= hash64(iovec[i].iov_base, iovec[i].iov_len);
+                else
+                        xor_hash ^= le64toh(o->data.hash);
+
                 items[i].object_offset = htole64(p);
                 items[i].hash = o->data.hash;
         }
@@ -1964,7 +2584,11 @@ int journal_file_append_entry(
          * times for rotating media. */
         typesafe_qsort(items, n_iovec, entry_item_cmp);
 
-        r = journal_file_append_entry_internal(f, ts, boot_id, xor_hash, items, n_iovec, seqnum, ret, offset);
+        return journal_file_append_entry_internal(f, ts, boot_id, xor_hash, items, n_iovec, seqnum, ret, offset);
+}
+
+static int journal_file_append_finish(JournalFile *f, int r) {
+        assert(f);
 
         /* If the memory mapping triggered a SIGBUS then we return an
          * IO error and ignore the error code passed down to us, since
@@ -1982,51 +2606,252 @@ int journal_file_append_entry(
         return r;
 }
 
-typedef struct ChainCacheItem {
-        uint64_t first; /* the array at the beginning of the chain */
-        uint64_t array; /* the cached array */
-        uint64_t begin; /* the first item in the cached array */
-        uint64_t total; /* the total number of items in all arrays before this one in the chain */
-        uint64_t last_index; /* the last index we looked at, to optimize locality when bisecting */
-} ChainCacheItem;
+int journal_file_append_entry(
+                JournalFile *f,
+                const dual_timestamp *ts,
+                const sd_id128_t *boot_id,
+                const struct iovec iovec[], unsigned n_iovec,
+                uint64_t *seqnum,
+                Object **ret, uint64_t *offset) {
+
+        return journal_file_append_entry_full(f, ts, boot_id, iovec, NULL, n_iovec, seqnum, ret, offset);
+}
+
+int journal_file_append_entry_full(
+                JournalFile *f,
+                const dual_timestamp *ts,
+                const sd_id128_t *boot_id,
+                const struct iovec iovec[],
+                const JournalFilePayload payloads[],
+                unsigned n_iovec,
+                uint64_t *seqnum,
+                Object **ret, uint64_t *offset) {
+
+        int r;
+
+        /* Like journal_file_append_entry(), but optionally takes the already compressed payload for each of the
+         * fields, which is stored as-is if it matches the compression the file uses. */
+
+        r = journal_file_append_entry_no_post_change(f, ts, boot_id, iovec, payloads, n_iovec, seqnum, ret, offset);
+
+        return journal_file_append_finish(f, r);
+}
+
+int journal_file_append_entries(
+                JournalFile *f,
+                const JournalFileEntry entries[], size_t n_entries,
+                uint64_t *seqnum,
+                size_t *ret_n_appended) {
+
+        size_t i;
+        int r = 0;
+
+        assert(f);
+        assert(entries || n_entries == 0);
+
+        /* Appends a batch of entries, but does the SIGBUS check and the change notification only once for all of
+         * them. Stops at the first entry that fails, and returns the number of entries appended before it in
+         * ret_n_appended. */
+
+        for (i = 0; i < n_entries; i++) {
+                r = journal_file_append_entry_no_post_change(f, &entries[i].ts, NULL,
+                                                             entries[i].iovec, NULL, entries[i].n_iovec,
+                                                             seqnum, NULL, NULL);
+                if (r < 0)
+                        break;
+        }
+
+        r = journal_file_append_finish(f, r);
+
+        /* After a SIGBUS we don't know which of the entries made it, hence report none */
+        if (ret_n_appended)
+                *ret_n_appended = r == -EIO ? 0 : i;
+
+        return r;
+}
+
+static ChainCacheItem* chain_cache_new(OrderedHashmap *h, uint64_t first) {
+        ChainCacheItem *ci;
+
+        if (ordered_hashmap_size(h) >= CHAIN_CACHE_MAX) {
+                ci = ordered_hashmap_steal_first(h);
+                assert(ci);
+        } else {
+                ci = new0(ChainCacheItem, 1);
+                if (!ci)
+                        return NULL;
+        }
+
+        ci->first = first;
+        ci->array = first;
+        ci->begin = 0;
+        ci->total = 0;
+        ci->last_index = (uint64_t) -1;
+        ci->n_arrays = 0;
+
+        if (ordered_hashmap_put(h, &ci->first, ci) < 0) {
+                chain_cache_item_free(ci);
+                return NULL;
+        }
+
+        return ci;
+}
+
+static void chain_cache_put(
+                OrderedHashmap *h,
+                ChainCacheItem *ci,
+                uint64_t first,
+                uint64_t array,
+                uint64_t begin,
+                uint64_t total,
+                uint64_t last_index) {
+
+        if (!ci) {
+                /* If the chain item to cache for this chain is the
+                 * first one it's not worth caching anything */
+                if (array == first)
+                        return;
+
+                ci = chain_cache_new(h, first);
+                if (!ci)
+                        return;
+        } else
+                assert(ci->first == first);
+
+        ci->array = array;
+        ci->begin = begin;
+        ci->total = total;
+        ci->last_index = last_index;
+}
+
+static int chain_cache_load_index(JournalFile *f, ChainCacheItem *ci) {
+        uint64_t n, i, total = 0;
+        Object *o;
+        int r;
+
+        assert(f);
+        assert(ci);
+
+        /* Archived files come with an index of the arrays of the main entry array chain, use it if there is one */
+
+        if (!JOURNAL_HEADER_CONTAINS(f->header, entry_array_index_offset) ||
+            f->header->entry_array_index_offset == 0)
+                return 0;
+
+        r = journal_file_move_to_object(f, OBJECT_ENTRY_ARRAY_INDEX, le64toh(f->header->entry_array_index_offset), &o);
+        if (r < 0)
+                return r;
+
+        n = (le64toh(o->object.size) - offsetof(EntryArrayIndexObject, items)) / sizeof(EntryArrayIndexItem);
+
+        if (le64toh(o->entry_array_index.items[0].offset) != ci->first)
+                return -EBADMSG;
+
+        if (!GREEDY_REALLOC(ci->arrays, ci->n_arrays_allocated, n))
+                return -ENOMEM;
+
+        for (i = 0; i < n; i++) {
+                uint64_t k = le64toh(o->entry_array_index.items[i].n_items);
+
+                if (k == 0)
+                        return -EBADMSG;
+
+                ci->arrays[i] = (ChainCacheArray) {
+                        .offset = le64toh(o->entry_array_index.items[i].offset),
+                        .total = total,
+                        .n_items = k,
+                        .last = le64toh(o->entry_array_index.items[i].last_entry),
+                };
+
+                total += k;
+        }
+
+        ci->n_arrays = n;
+        return 0;
+}
+
+static int chain_cache_index(JournalFile *f, ChainCacheItem *ci, uint64_t n) {
+        uint64_t a, total = 0;
+        Object *o;
+        int r;
+
+        assert(f);
+        assert(ci);
+
+        /* Makes sure the arrays of the chain are known up to the one containing item n-1. The chain might have
+         * grown since we looked last, hence continue where we stopped the last time. */
+
+        if (ci->n_arrays == 0 && ci->first == le64toh(f->header->entry_array_offset)) {
+                r = chain_cache_load_index(f, ci);
+                if (r < 0)
+                        return r;
+        }
+
+        a = ci->first;
+
+        if (ci->n_arrays > 0) {
+                ChainCacheArray *last = ci->arrays + ci->n_arrays - 1;
+
+                total = last->total + last->n_items;
+                if (total >= n)
+                        return 0;
+
+                r = journal_file_move_to_object(f, OBJECT_ENTRY_ARRAY, last->offset, &o);
+                if (r < 0)
+                        return r;
+
+                a = le64toh(o->entry_array.next_entry_array_offset);
+        }
+
+        while (a > 0 && total < n) {
+                uint64_t k;
+
+                r = journal_file_move_to_object(f, OBJECT_ENTRY_ARRAY, a, &o);
+                if (r < 0)
+                        return r;
+
+                k = journal_file_entry_array_n_items(o);
+                if (k == 0)
+                        return -EBADMSG;
+
+                if (!GREEDY_REALLOC(ci->arrays, ci->n_arrays_allocated, ci->n_arrays + 1))
+                        return -ENOMEM;
+
+                ci->arrays[ci->n_arrays++] = (ChainCacheArray) {
+                        .offset = a,
+                        .total = total,
+                        .n_items = k,
+                };
+
+                total += k;
+                a = le64toh(o->entry_array.next_entry_array_offset);
+        }
+
+        return 0;
+}
 
-static void chain_cache_put(
-                OrderedHashmap *h,
-                ChainCacheItem *ci,
-                uint64_t first,
-                uint64_t array,
-                uint64_t begin,
-                uint64_t total,
-                uint64_t last_index) {
+static size_t chain_cache_find(ChainCacheItem *ci, uint64_t i) {
+        size_t left = 0, right;
 
-        if (!ci) {
-                /* If the chain item to cache for this chain is the
-                 * first one it's not worth caching anything */
-                if (array == first)
-                        return;
+        assert(ci);
 
-                if (ordered_hashmap_size(h) >= CHAIN_CACHE_MAX) {
-                        ci = ordered_hashmap_steal_first(h);
-                        assert(ci);
-                } else {
-                        ci = new(ChainCacheItem, 1);
-                        if (!ci)
-                                return;
-                }
+        /* Returns the array in the index containing item i, or n_arrays if the index doesn't reach that far */
 
-                ci->first = first;
+        if (ci->n_arrays == 0 ||
+            i >= ci->arrays[ci->n_arrays-1].total + ci->arrays[ci->n_arrays-1].n_items)
+                return ci->n_arrays;
 
-                if (ordered_hashmap_put(h, &ci->first, ci) < 0) {
-                        free(ci);
-                        return;
-                }
-        } else
-                assert(ci->first == first);
+        right = ci->n_arrays - 1;
+        while (left < right) {
+                size_t m = (left + right + 1) / 2;
 
-        ci->array = array;
-        ci->begin = begin;
-        ci->total = total;
-        ci->last_index = last_index;
+                if (ci->arrays[m].total <= i)
+                        left = m;
+                else
+                        right = m - 1;
+        }
+
+        return left;
 }
 
 static int generic_array_get(
@@ -2050,6 +2875,15 @@ static int generic_array_get(
                 a = ci->array;
                 i -= ci->total;
                 t = ci->total;
+        } else if (ci) {
+                size_t j;
+
+                j = chain_cache_find(ci, i);
+                if (j < ci->n_arrays) {
+                        a = ci->arrays[j].offset;
+                        t = ci->arrays[j].total;
+                        i -= t;
+                }
         }
 
         while (a > 0) {
@@ -2125,6 +2959,99 @@ enum {
         TEST_RIGHT
 };
 
+static bool chain_cache_bisect_arrays(
+                JournalFile *f,
+                ChainCacheItem **ci,
+                uint64_t first,
+                uint64_t n,
+                uint64_t needle,
+                int (*test_object)(JournalFile *f, uint64_t p, uint64_t needle),
+                direction_t direction,
+                uint64_t *a,
+                uint64_t *t,
+                uint64_t *last_p) {
+
+        size_t left, right;
+        uint64_t lp = 0;
+        Object *array;
+        int r;
+
+        assert(f);
+        assert(ci);
+        assert(a);
+        assert(t);
+        assert(last_p);
+
+        /* Finds the array in a long chain that the needle has to be in, starting from the array at *a, by
+         * bisecting over the arrays, testing the last item of each. Returns false if we can't tell, in which
+         * case the caller should just walk the chain as before. Errors are not propagated, since the caller
+         * will run into them again anyway. */
+
+        if (n < CHAIN_CACHE_INDEX_MIN)
+                return false;
+
+        if (!*ci) {
+                *ci = chain_cache_new(f->chain_cache, first);
+                if (!*ci)
+                        return false;
+        }
+
+        r = chain_cache_index(f, *ci, n);
+        if (r < 0)
+                return false;
+
+        left = chain_cache_find(*ci, *t);
+        if (left >= (*ci)->n_arrays || (*ci)->arrays[left].offset != *a)
+                return false;
+
+        /* Only arrays which contain any of the n items */
+        right = chain_cache_find(*ci, n - 1);
+        if (right >= (*ci)->n_arrays)
+                right = (*ci)->n_arrays - 1;
+
+        while (left < right) {
+                size_t m = (left + right) / 2;
+                ChainCacheArray *c = (*ci)->arrays + m;
+                uint64_t p;
+
+                if (c->last == 0) {
+                        r = journal_file_move_to_object(f, OBJECT_ENTRY_ARRAY, c->offset, &array);
+                        if (r < 0)
+                                return false;
+
+                        /* All of this array is among the n items, since it is not the last one, hence its
+                         * last item won't change anymore and can be remembered. */
+                        c->last = le64toh(array->entry_array.items[c->n_items - 1]);
+                        if (c->last <= 0)
+                                return false;
+                }
+
+                p = c->last;
+
+                r = test_object(f, p, needle);
+                if (r < 0)
+                        return false;
+
+                if (r == TEST_FOUND)
+                        r = direction == DIRECTION_DOWN ? TEST_RIGHT : TEST_LEFT;
+
+                if (r == TEST_RIGHT)
+                        right = m;
+                else {
+                        left = m + 1;
+                        lp = p;
+                }
+        }
+
+        if ((*ci)->arrays[left].offset == *a)
+                return false;
+
+        *a = (*ci)->arrays[left].offset;
+        *t = (*ci)->arrays[left].total;
+        *last_p = lp;
+        return true;
+}
+
 static int generic_array_bisect(
                 JournalFile *f,
                 uint64_t first,
@@ -2136,7 +3063,7 @@ static int generic_array_bisect(
                 uint64_t *offset,
                 uint64_t *idx) {
 
-        uint64_t a, p, t = 0, i = 0, last_p = 0, last_index = (uint64_t) -1;
+        uint64_t a, p, q, t = 0, i = 0, last_p = 0, last_index = (uint64_t) -1;
         bool subtract_one = false;
         Object *o, *array = NULL;
         int r;
@@ -2173,6 +3100,13 @@ static int generic_array_bisect(
                 }
         }
 
+        /* In long chains, jump right to the array the needle has to be in */
+        q = t;
+        if (chain_cache_bisect_arrays(f, &ci, first, n + t, needle, test_object, direction, &a, &t, &last_p)) {
+                n -= t - q;
+                last_index = (uint64_t) -1;
+        }
+
         while (a > 0) {
                 uint64_t left, right, k, lp;
 
@@ -3019,6 +3953,26 @@ void journal_file_dump(JournalFile *f) {
                                le64toh(o->tag.epoch));
                         break;
 
+                case OBJECT_DICTIONARY:
+                        printf("Type: OBJECT_DICTIONARY id=%"PRIu32"\n",
+                               le32toh(o->dictionary.dictionary_id));
+                        break;
+
+                case OBJECT_BLOOM:
+                        printf("Type: OBJECT_BLOOM n_hashes=%"PRIu32"\n",
+                               le32toh(o->bloom.n_hashes));
+                        break;
+
+                case OBJECT_BOOT_INDEX:
+                        printf("Type: OBJECT_BOOT_INDEX n_items=%"PRIu64"\n",
+                               (le64toh(o->object.size) - offsetof(BootIndexObject, items)) / sizeof(BootIndexItem));
+                        break;
+
+                case OBJECT_ENTRY_ARRAY_INDEX:
+                        printf("Type: OBJECT_ENTRY_ARRAY_INDEX n_items=%"PRIu64"\n",
+                               (le64toh(o->object.size) - offsetof(EntryArrayIndexObject, items)) / sizeof(EntryArrayIndexItem));
+                        break;
+
                 default:
                         printf("Type: unknown (%i)\n", o->object.type);
                         break;
@@ -3048,6 +4002,22 @@ static const char* format_timestamp_safe(char *buf, size_t l, usec_t t) {
         return " --- ";
 }
 
+static double hash_table_chain_length_avg(const HashItem *table, uint64_t n_buckets, uint64_t n_items) {
+        uint64_t i, used = 0;
+
+        /* Returns the average length of the hash chains that aren't empty, i.e. how many objects we have to look
+         * at on average when looking up something that is in the table. */
+
+        for (i = 0; i < n_buckets; i++)
+                if (table[i].head_hash_offset != 0)
+                        used++;
+
+        if (used == 0)
+                return 0.0;
+
+        return (double) n_items / (double) used;
+}
+
 void journal_file_print_header(JournalFile *f) {
         char a[33], b[33], c[33], d[33];
         char x[FORMAT_TIMESTAMP_MAX], y[FORMAT_TIMESTAMP_MAX], z[FORMAT_TIMESTAMP_MAX];
@@ -3064,7 +4034,7 @@ void journal_file_print_header(JournalFile *f) {
                "Sequential Number ID: %s\n"
                "State: %s\n"
                "Compatible Flags:%s%s\n"
-               "Incompatible Flags:%s%s%s\n"
+               "Incompatible Flags:%s%s%s%s%s\n"
                "Header size: %"PRIu64"\n"
                "Arena size: %"PRIu64"\n"
                "Data Hash Table Size: %"PRIu64"\n"
@@ -3089,6 +4059,8 @@ void journal_file_print_header(JournalFile *f) {
                (le32toh(f->header->compatible_flags) & ~HEADER_COMPATIBLE_ANY) ? " ???" : "",
                JOURNAL_HEADER_COMPRESSED_XZ(f->header) ? " COMPRESSED-XZ" : "",
                JOURNAL_HEADER_COMPRESSED_LZ4(f->header) ? " COMPRESSED-LZ4" : "",
+               JOURNAL_HEADER_COMPRESSED_ZSTD(f->header) ? " COMPRESSED-ZSTD" : "",
+               JOURNAL_HEADER_KEYED_HASH(f->header) ? " KEYED-HASH" : "",
                (le32toh(f->header->incompatible_flags) & ~HEADER_INCOMPATIBLE_ANY) ? " ???" : "",
                le64toh(f->header->header_size),
                le64toh(f->header->arena_size),
@@ -3103,24 +4075,60 @@ void journal_file_print_header(JournalFile *f) {
                le64toh(f->header->n_objects),
                le64toh(f->header->n_entries));
 
-        if (JOURNAL_HEADER_CONTAINS(f->header, n_data))
+        if (JOURNAL_HEADER_CONTAINS(f->header, n_data)) {
                 printf("Data Objects: %"PRIu64"\n"
                        "Data Hash Table Fill: %.1f%%\n",
                        le64toh(f->header->n_data),
                        100.0 * (double) le64toh(f->header->n_data) / ((double) (le64toh(f->header->data_hash_table_size) / sizeof(HashItem))));
 
-        if (JOURNAL_HEADER_CONTAINS(f->header, n_fields))
+                if (journal_file_map_data_hash_table(f) >= 0 && f->data_hash_table)
+                        printf("Data Hash Chain Average Length: %.2f\n",
+                               hash_table_chain_length_avg(f->data_hash_table,
+                                                           le64toh(f->header->data_hash_table_size) / sizeof(HashItem),
+                                                           le64toh(f->header->n_data)));
+        }
+
+        if (JOURNAL_HEADER_CONTAINS(f->header, n_fields)) {
                 printf("Field Objects: %"PRIu64"\n"
                        "Field Hash Table Fill: %.1f%%\n",
                        le64toh(f->header->n_fields),
                        100.0 * (double) le64toh(f->header->n_fields) / ((double) (le64toh(f->header->field_hash_table_size) / sizeof(HashItem))));
 
+                if (journal_file_map_field_hash_table(f) >= 0 && f->field_hash_table)
+                        printf("Field Hash Chain Average Length: %.2f\n",
+                               hash_table_chain_length_avg(f->field_hash_table,
+                                                           le64toh(f->header->field_hash_table_size) / sizeof(HashItem),
+                                                           le64toh(f->header->n_fields)));
+        }
+
         if (JOURNAL_HEADER_CONTAINS(f->header, n_tags))
                 printf("Tag Objects: %"PRIu64"\n",
                        le64toh(f->header->n_tags));
         if (JOURNAL_HEADER_CONTAINS(f->header, n_entry_arrays))
                 printf("Entry Array Objects: %"PRIu64"\n",
                        le64toh(f->header->n_entry_arrays));
+        if (JOURNAL_HEADER_CONTAINS(f->header, zstd_dictionary_offset) &&
+            f->header->zstd_dictionary_offset != 0)
+                printf("ZSTD Dictionary Offset: "OFSfmt"\n",
+                       le64toh(f->header->zstd_dictionary_offset));
+        if (JOURNAL_HEADER_CONTAINS(f->header, data_hash_chain_depth))
+                printf("Deepest Data Hash Chain: %" PRIu64"\n",
+                       le64toh(f->header->data_hash_chain_depth));
+        if (JOURNAL_HEADER_CONTAINS(f->header, field_hash_chain_depth))
+                printf("Deepest Field Hash Chain: %" PRIu64"\n",
+                       le64toh(f->header->field_hash_chain_depth));
+        if (JOURNAL_HEADER_CONTAINS(f->header, bloom_filter_offset) &&
+            f->header->bloom_filter_offset != 0)
+                printf("Bloom Filter Offset: "OFSfmt"\n",
+                       le64toh(f->header->bloom_filter_offset));
+        if (JOURNAL_HEADER_CONTAINS(f->header, boot_index_offset) &&
+            f->header->boot_index_offset != 0)
+                printf("Boot Index Offset: "OFSfmt"\n",
+                       le64toh(f->header->boot_index_offset));
+        if (JOURNAL_HEADER_CONTAINS(f->header, entry_array_index_offset) &&
+            f->header->entry_array_index_offset != 0)
+                printf("Entry Array Index Offset: "OFSfmt"\n",
+                       le64toh(f->header->entry_array_index_offset));
 
         if (fstat(f->fd, &st) >= 0)
                 printf("Disk usage: %s\n", format_bytes(bytes, sizeof(bytes), (uint64_t) st.st_blocks * 512ULL));
@@ -3202,7 +4210,9 @@ int journal_file_open(
                 .prot = prot_from_flags(flags),
                 .writable = (flags & O_ACCMODE) != O_RDONLY,
 
-#if HAVE_LZ4
+#if HAVE_ZSTD
+                .compress_zstd = compress,
+#elif HAVE_LZ4
                 .compress_lz4 = compress,
 #elif HAVE_XZ
                 .compress_xz = compress,
@@ -3215,9 +4225,17 @@ int journal_file_open(
 #endif
         };
 
-        log_debug("Journal effective settings seal=%s compress=%s compress_threshold_bytes=%s",
+        /* The keyed hash is opt-in for now, as readers that predate it refuse to open files using it, and that
+         * includes all released versions of this implementation. */
+        r = getenv_bool("SYSTEMD_JOURNAL_KEYED_HASH");
+        if (r < 0 && r != -ENXIO)
+                log_debug_errno(r, "Failed to parse $SYSTEMD_JOURNAL_KEYED_HASH, ignoring: %m");
+        f->keyed_hash = r > 0;
+
+        log_debug("Journal effective settings seal=%s compress=%s compress_threshold_bytes=%s keyed_hash=%s",
                   yes_no(f->seal), yes_no(JOURNAL_FILE_COMPRESS(f)),
-                  format_bytes(bytes, sizeof(bytes), f->compress_threshold_bytes));
+                  format_bytes(bytes, sizeof(bytes), f->compress_threshold_bytes),
+                  yes_no(f->keyed_hash));
 
         if (mmap_cache)
                 f->mmap = mmap_cache_ref(mmap_cache);
@@ -3346,9 +4364,22 @@ int journal_file_open(
                 } else if (template)
                         f->metrics = template->metrics;
 
+                /* Continue growing at the pace of the file we replace */
+                if (template) {
+                        f->size_increase = template->size_increase;
+                        f->last_grow_usec = template->last_grow_usec;
+                }
+
                 r = journal_file_refresh_header(f);
                 if (r < 0)
                         goto fail;
+
+#if HAVE_ZSTD
+                if (f->compress_zstd &&
+                    JOURNAL_HEADER_CONTAINS(f->header, zstd_dictionary_offset) &&
+                    f->header->zstd_dictionary_offset == 0)
+                        f->dictionary_samples_max = dictionary_samples_from_env();
+#endif
         }
 
 #if HAVE_GCRYPT
@@ -3403,8 +4434,248 @@ fail:
         return r;
 }
 
+static int journal_file_collect_boots(JournalFile *f, JournalBootInfo **ret, size_t *ret_n) {
+        _cleanup_free_ JournalBootInfo *boots = NULL;
+        size_t n = 0, allocated = 0;
+        uint64_t p, n_data = 0;
+        Object *o;
+        int r;
+
+        assert(f);
+        assert(ret);
+        assert(ret_n);
+
+        /* Determines the boots in this file from the _BOOT_ID= data objects, which are all linked from the _BOOT_ID
+         * field object. The first and last entry of each of these data objects are the first and last entry of
+         * the boot. */
+
+        if (!JOURNAL_HEADER_CONTAINS(f->header, n_fields))
+                return -EOPNOTSUPP;
+
+        r = journal_file_find_field_object(f, "_BOOT_ID", STRLEN("_BOOT_ID"), &o, NULL);
+        if (r < 0)
+                return r;
+
+        p = r > 0 ? le64toh(o->field.head_data_offset) : 0;
+        while (p > 0) {
+                JournalBootInfo *b;
+                uint64_t next;
+
+                /* Don't loop forever on a cycle in a corrupted field chain */
+                if (++n_data > le64toh(f->header->n_data))
+                        return -EBADMSG;
+
+                r = journal_file_move_to_object(f, OBJECT_DATA, p, &o);
+                if (r < 0)
+                        return r;
+
+                next = le64toh(o->data.next_field_offset);
+
+                if (le64toh(o->data.n_entries) > 0) {
+                        if (!GREEDY_REALLOC(boots, allocated, n + 1))
+                                return -ENOMEM;
+
+                        b = boots + n;
+
+                        r = journal_file_next_entry_for_data(f, NULL, 0, p, DIRECTION_DOWN, &o, NULL);
+                        if (r < 0)
+                                return r;
+                        if (r > 0) {
+                                b->boot_id = o->entry.boot_id;
+                                b->first_seqnum = le64toh(o->entry.seqnum);
+                                b->first_realtime = le64toh(o->entry.realtime);
+
+                                r = journal_file_next_entry_for_data(f, NULL, 0, p, DIRECTION_UP, &o, NULL);
+                                if (r < 0)
+                                        return r;
+                                if (r == 0)
+                                        return -EBADMSG;
+
+                                b->last_seqnum = le64toh(o->entry.seqnum);
+                                b->last_realtime = le64toh(o->entry.realtime);
+
+                                n++;
+                        }
+                }
+
+                p = next;
+        }
+
+        *ret = TAKE_PTR(boots);
+        *ret_n = n;
+
+        return 0;
+}
+
+int journal_file_get_boots(JournalFile *f, JournalBootInfo **ret, size_t *ret_n) {
+        _cleanup_free_ JournalBootInfo *boots = NULL;
+        uint64_t i, n;
+        Object *o;
+        int r;
+
+        assert(f);
+        assert(f->header);
+        assert(ret);
+        assert(ret_n);
+
+        /* Returns the boots in the file, from the boot index written on archival if there is one, and from the
+         * _BOOT_ID= data objects otherwise. Returns -EOPNOTSUPP for files from before the field objects were
+         * introduced. */
+
+        if (!JOURNAL_HEADER_CONTAINS(f->header, boot_index_offset) ||
+            f->header->boot_index_offset == 0)
+                return journal_file_collect_boots(f, ret, ret_n);
+
+        r = journal_file_move_to_object(f, OBJECT_BOOT_INDEX, le64toh(f->header->boot_index_offset), &o);
+        if (r < 0)
+                return r;
+
+        n = (le64toh(o->object.size) - offsetof(BootIndexObject, items)) / sizeof(BootIndexItem);
+
+        boots = new(JournalBootInfo, n);
+        if (!boots)
+                return -ENOMEM;
+
+        for (i = 0; i < n; i++)
+                boots[i] = (JournalBootInfo) {
+                        .boot_id = o->boot_index.items[i].boot_id,
+                        .first_seqnum = le64toh(o->boot_index.items[i].first_seqnum),
+                        .last_seqnum = le64toh(o->boot_index.items[i].last_seqnum),
+                        .first_realtime = le64toh(o->boot_index.items[i].first_realtime),
+                        .last_realtime = le64toh(o->boot_index.items[i].last_realtime),
+                };
+
+        *ret = TAKE_PTR(boots);
+        *ret_n = n;
+
+        return 0;
+}
+
+static int journal_file_append_boot_index(JournalFile *f) {
+        _cleanup_free_ JournalBootInfo *boots = NULL;
+        size_t n, i;
+        uint64_t p;
+        Object *o;
+        int r;
+
+        assert(f);
+        assert(f->header);
+
+        /* Archived files don't get new entries anymore, hence store which boots they contain, so that readers can
+         * list boots without looking at the _BOOT_ID= data objects of each file */
+
+        if (!JOURNAL_HEADER_CONTAINS(f->header, boot_index_offset) ||
+            f->header->boot_index_offset != 0)
+                return 0;
+
+        r = journal_file_collect_boots(f, &boots, &n);
+        if (r < 0)
+                return r;
+        if (n == 0)
+                return 0;
+
+        r = journal_file_append_object(f, OBJECT_BOOT_INDEX, offsetof(Object, boot_index.items) + n * sizeof(BootIndexItem), &o, &p);
+        if (r < 0)
+                return r;
+
+        for (i = 0; i < n; i++)
+                o->boot_index.items[i] = (BootIndexItem) {
+                        .boot_id = boots[i].boot_id,
+                        .first_seqnum = htole64(boots[i].first_seqnum),
+                        .last_seqnum = htole64(boots[i].last_seqnum),
+                        .first_realtime = htole64(boots[i].first_realtime),
+                        .last_realtime = htole64(boots[i].last_realtime),
+                };
+
+#if HAVE_GCRYPT
+        r = journal_file_hmac_put_object(f, OBJECT_BOOT_INDEX, o, p);
+        if (r < 0)
+                return r;
+#endif
+
+        f->header->boot_index_offset = htole64(p);
+
+        log_debug("Appended boot index with %zu boots to %s.", n, f->path);
+
+        return 0;
+}
+
+static int journal_file_append_entry_array_index(JournalFile *f) {
+        _cleanup_free_ EntryArrayIndexItem *items = NULL;
+        size_t n = 0, n_allocated = 0;
+        uint64_t a, p, total = 0, n_entries;
+        Object *o;
+        int r;
+
+        assert(f);
+        assert(f->header);
+
+        /* Archived files don't get new entries anymore, hence the arrays of the entry array chain are final, and
+         * we can store where they are, so that bisecting doesn't have to walk the chain first. Not worth it for
+         * short chains. */
+
+        if (!JOURNAL_HEADER_CONTAINS(f->header, entry_array_index_offset) ||
+            f->header->entry_array_index_offset != 0)
+                return 0;
+
+        n_entries = le64toh(f->header->n_entries);
+        if (n_entries < CHAIN_CACHE_INDEX_MIN)
+                return 0;
+
+        a = le64toh(f->header->entry_array_offset);
+        while (a > 0 && total < n_entries) {
+                uint64_t k, last;
+
+                r = journal_file_move_to_object(f, OBJECT_ENTRY_ARRAY, a, &o);
+                if (r < 0)
+                        return r;
+
+                k = journal_file_entry_array_n_items(o);
+                if (k == 0)
+                        return -EBADMSG;
+
+                last = le64toh(o->entry_array.items[MIN(k, n_entries - total) - 1]);
+                if (last == 0)
+                        return -EBADMSG;
+
+                if (!GREEDY_REALLOC(items, n_allocated, n + 1))
+                        return -ENOMEM;
+
+                items[n++] = (EntryArrayIndexItem) {
+                        .offset = htole64(a),
+                        .n_items = htole64(k),
+                        .last_entry = htole64(last),
+                };
+
+                total += k;
+                a = le64toh(o->entry_array.next_entry_array_offset);
+        }
+
+        if (total < n_entries)
+                return -EBADMSG;
+
+        r = journal_file_append_object(f, OBJECT_ENTRY_ARRAY_INDEX, offsetof(Object, entry_array_index.items) + n * sizeof(EntryArrayIndexItem), &o, &p);
+        if (r < 0)
+                return r;
+
+        memcpy(o->entry_array_index.items, items, n * sizeof(EntryArrayIndexItem));
+
+#if HAVE_GCRYPT
+        r = journal_file_hmac_put_object(f, OBJECT_ENTRY_ARRAY_INDEX, o, p);
+        if (r < 0)
+                return r;
+#endif
+
+        f->header->entry_array_index_offset = htole64(p);
+
+        log_debug("Appended entry array index with %zu arrays to %s.", n, f->path);
+
+        return 0;
+}
+
 int journal_file_archive(JournalFile *f) {
         _cleanup_free_ char *p = NULL;
+        int r;
 
         assert(f);
 
@@ -3419,6 +4690,18 @@ int journal_file_archive(JournalFile *f) {
         if (!endswith(f->path, ".journal"))
                 return -EINVAL;
 
+        r = journal_file_append_bloom(f);
+        if (r < 0)
+                log_debug_errno(r, "Failed to append Bloom filter to %s, ignoring: %m", f->path);
+
+        r = journal_file_append_boot_index(f);
+        if (r < 0)
+                log_debug_errno(r, "Failed to append boot index to %s, ignoring: %m", f->path);
+
+        r = journal_file_append_entry_array_index(f);
+        if (r < 0)
+                log_debug_errno(r, "Failed to append entry array index to %s, ignoring: %m", f->path);
+
         if (asprintf(&p, "%.*s@" SD_ID128_FORMAT_STR "-%016"PRIx64"-%016"PRIx64".journal",
                      (int) strlen(f->path) - 8, f->path,
                      SD_ID128_FORMAT_VAL(f->header->seqnum_id),
@@ -3591,9 +4874,15 @@ int journal_file_open_reliably(
                                  deferred_closes, template, ret);
 }
 
-int journal_file_copy_entry(JournalFile *from, JournalFile *to, Object *o, uint64_t p) {
+typedef struct CopiedData {
+        uint64_t from; /* offset of the data object in the source file, used as hashmap key */
+        uint64_t to;   /* offset of the same data object in the destination file */
+        le64_t hash;   /* hash of the data object in the destination file */
+} CopiedData;
+
+int journal_file_copy_entry(JournalFile *from, JournalFile *to, Object *o, uint64_t p, Hashmap *copied_data) {
         uint64_t i, n;
-        uint64_t q, xor_hash = 0;
+        uint64_t q, xor_hash;
         int r;
         EntryItem *items;
         dual_timestamp ts;
@@ -3611,11 +4900,15 @@ int journal_file_copy_entry(JournalFile *from, JournalFile *to, Object *o, uint6
         ts.realtime = le64toh(o->entry.realtime);
         boot_id = &o->entry.boot_id;
 
+        /* The XOR hash is calculated the same way in all files, hence can be taken over as is */
+        xor_hash = le64toh(o->entry.xor_hash);
+
         n = journal_file_entry_n_items(o);
         /* alloca() can't take 0, hence let's allocate at least one */
         items = newa(EntryItem, MAX(1u, n));
 
         for (i = 0; i < n; i++) {
+                JournalFilePayload payload = {};
                 uint64_t l, h;
                 le64_t le_hash;
                 size_t t;
@@ -3625,6 +4918,19 @@ int journal_file_copy_entry(JournalFile *from, JournalFile *to, Object *o, uint6
                 q = le64toh(o->entry.items[i].object_offset);
                 le_hash = o->entry.items[i].hash;
 
+                if (copied_data) {
+                        CopiedData *c;
+
+                        /* Already copied this data object for an earlier entry? Then don't bother hashing and
+                         * looking it up in the destination again. */
+                        c = hashmap_get(copied_data, &q);
+                        if (c) {
+                                items[i].object_offset = htole64(c->to);
+                                items[i].hash = c->hash;
+                                continue;
+                        }
+                }
+
                 r = journal_file_move_to_object(from, OBJECT_DATA, q, &o);
                 if (r < 0)
                         return r;
@@ -3640,14 +4946,28 @@ int journal_file_copy_entry(JournalFile *from, JournalFile *to, Object *o, uint6
                         return -E2BIG;
 
                 if (o->object.flags & OBJECT_COMPRESSION_MASK) {
-#if HAVE_XZ || HAVE_LZ4
+#if HAVE_COMPRESSION
+                        CompressDictionary *dict;
                         size_t rsize = 0;
 
-                        r = decompress_blob(o->object.flags & OBJECT_COMPRESSION_MASK,
+                        r = journal_file_get_compress_dictionary(from, o->object.flags & OBJECT_COMPRESSION_MASK, &dict);
+                        if (r < 0)
+                                return r;
+
+                        r = decompress_blob(o->object.flags & OBJECT_COMPRESSION_MASK, dict,
                                             o->data.payload, l, &from->compress_buffer, &from->compress_buffer_size, &rsize, 0);
                         if (r < 0)
                                 return r;
 
+                        /* Data compressed with the dictionary of the source file can't be decompressed without
+                         * it, so only reuse the compressed payload if there is none */
+                        if (!dict)
+                                payload = (JournalFilePayload) {
+                                        .compression = o->object.flags & OBJECT_COMPRESSION_MASK,
+                                        .data = o->data.payload,
+                                        .size = t,
+                                };
+
                         data = from->compress_buffer;
                         l = rsize;
 #else
@@ -3656,14 +4976,31 @@ int journal_file_copy_entry(JournalFile *from, JournalFile *to, Object *o, uint6
                 } else
                         data = o->data.payload;
 
-                r = journal_file_append_data(to, data, l, &u, &h);
+                r = journal_file_append_data(to, data, l, &payload, &u, &h);
                 if (r < 0)
                         return r;
 
-                xor_hash ^= le64toh(u->data.hash);
                 items[i].object_offset = htole64(h);
                 items[i].hash = u->data.hash;
 
+                if (copied_data) {
+                        CopiedData *c;
+
+                        /* This is only a cache, hence if we can't remember the object, we'll just look it up
+                         * again next time. */
+                        c = new(CopiedData, 1);
+                        if (c) {
+                                *c = (CopiedData) {
+                                        .from = q,
+                                        .to = h,
+                                        .hash = u->data.hash,
+                                };
+
+                                if (hashmap_put(copied_data, &c->from, c) < 0)
+                                        free(c);
+                        }
+                }
+
                 r = journal_file_move_to_object(from, OBJECT_ENTRY, p, &o);
                 if (r < 0)
                         return r;
@@ -3888,6 +5225,22 @@ bool journal_file_rotate_suggested(JournalFile *f, usec_t max_file_usec) {
                         return true;
                 }
 
+        /* The fill level doesn't tell us anything about how well the hash values are distributed over the table. If
+         * the chains got long nonetheless, lookups on every append get slow, hence suggest rotation too. */
+        if (JOURNAL_HEADER_CONTAINS(f->header, data_hash_chain_depth) &&
+            le64toh(f->header->data_hash_chain_depth) > HASH_CHAIN_DEPTH_MAX) {
+                log_debug("Data hash table of %s has deepest hash chain of length %" PRIu64 ", suggesting rotation.",
+                          f->path, le64toh(f->header->data_hash_chain_depth));
+                return true;
+        }
+
+        if (JOURNAL_HEADER_CONTAINS(f->header, field_hash_chain_depth) &&
+            le64toh(f->header->field_hash_chain_depth) > HASH_CHAIN_DEPTH_MAX) {
+                log_debug("Field hash table of %s has deepest hash chain of length %" PRIu64 ", suggesting rotation.",
+                          f->path, le64toh(f->header->field_hash_chain_depth));
+                return true;
+        }
+
         /* Are the data objects properly indexed by field objects? */
         if (JOURNAL_HEADER_CONTAINS(f->header, n_data) &&
             JOURNAL_HEADER_CONTAINS(f->header, n_fields) &&
@@ -10,6 +10,7 @@
 #include "sd-event.h"
 #include "sd-id128.h"
 
+#include "compress.h"
 #include "hashmap.h"
 #include "journal-def.h"
 #include "macro.h"
@@ -55,6 +56,28 @@ typedef enum OfflineState {
         OFFLINE_DONE
 } OfflineState;
 
+/* The payload of a data object as it is stored in a journal file, i.e. possibly compressed. Passing this along with
+ * the uncompressed data allows appending it without compressing it again. */
+typedef struct JournalFilePayload {
+        int compression; /* OBJECT_COMPRESSED_XYZ, or 0 if uncompressed */
+        const void *data;
+        size_t size;
+} JournalFilePayload;
+
+typedef struct JournalFileEntry {
+        dual_timestamp ts;
+        const struct iovec *iovec;
+        unsigned n_iovec;
+} JournalFileEntry;
+
+typedef struct JournalBootInfo {
+        sd_id128_t boot_id;
+        uint64_t first_seqnum;
+        uint64_t last_seqnum;
+        uint64_t first_realtime;
+        uint64_t last_realtime;
+} JournalBootInfo;
+
 typedef struct JournalFile {
         int fd;
         MMapFileDescriptor *cache_fd;
@@ -66,7 +89,9 @@ typedef struct JournalFile {
         bool writable:1;
         bool compress_xz:1;
         bool compress_lz4:1;
+        bool compress_zstd:1;
         bool seal:1;
+        bool keyed_hash:1;
         bool defrag_on_close:1;
         bool close_fd:1;
         bool archive:1;
@@ -74,6 +99,8 @@ typedef struct JournalFile {
         direction_t last_direction;
         LocationType location_type;
         uint64_t last_n_entries;
+        unsigned prioq_idx;
+        bool prioq_pending; /* queued by the seqnum range of the file, no candidate entry looked for yet */
 
         char *path;
         struct stat last_stat;
@@ -101,14 +128,37 @@ typedef struct JournalFile {
         pthread_t offline_thread;
         volatile OfflineState offline_state;
 
+        /* The current step by which the file grows, and disk space reserved beyond its end in the background,
+         * see journal_file_allocate() */
+        uint64_t size_increase;
+        usec_t last_grow_usec;
+        uint64_t reserved_size;
+        pthread_t reserve_thread;
+        bool reserve_thread_running;
+        bool reserve_failed;
+        uint64_t reserve_offset, reserve_length;
+        int reserve_error;
+
         unsigned last_seen_generation;
 
         uint64_t compress_threshold_bytes;
-#if HAVE_XZ || HAVE_LZ4
+#if HAVE_COMPRESSION
         void *compress_buffer;
         size_t compress_buffer_size;
 #endif
 
+#if HAVE_ZSTD
+        /* The trained dictionary of this file, loaded lazily */
+        CompressDictionary *compress_dictionary;
+
+        /* Samples collected from the first data objects, until we have enough to train a dictionary from them */
+        size_t dictionary_samples_max;
+        uint8_t *dictionary_samples;
+        size_t dictionary_samples_size, dictionary_samples_allocated;
+        size_t *dictionary_sample_sizes;
+        size_t n_dictionary_samples, n_dictionary_samples_allocated;
+#endif
+
 #if HAVE_GCRYPT
         gcry_md_hd_t hmac;
         bool hmac_running;
@@ -192,8 +242,18 @@ static inline bool VALID_EPOCH(uint64_t u) {
 #define JOURNAL_HEADER_COMPRESSED_LZ4(h) \
         (!!(le32toh((h)->incompatible_flags) & HEADER_INCOMPATIBLE_COMPRESSED_LZ4))
 
+#define JOURNAL_HEADER_COMPRESSED_ZSTD(h) \
+        (!!(le32toh((h)->incompatible_flags) & HEADER_INCOMPATIBLE_COMPRESSED_ZSTD))
+
+#define JOURNAL_HEADER_KEYED_HASH(h) \
+        (!!(le32toh((h)->incompatible_flags) & HEADER_INCOMPATIBLE_KEYED_HASH))
+
 int journal_file_move_to_object(JournalFile *f, ObjectType type, uint64_t offset, Object **ret);
 
+uint64_t journal_file_hash_data(JournalFile *f, const void *data, size_t sz);
+
+int journal_file_get_compress_dictionary(JournalFile *f, int compression, CompressDictionary **ret);
+
 uint64_t journal_file_entry_n_items(Object *o) _pure_;
 uint64_t journal_file_entry_array_n_items(Object *o) _pure_;
 uint64_t journal_file_hash_table_n_items(Object *o) _pure_;
@@ -207,6 +267,22 @@ int journal_file_append_entry(
                 uint64_t *seqno,
                 Object **ret,
                 uint64_t *offset);
+int journal_file_append_entry_full(
+                JournalFile *f,
+                const dual_timestamp *ts,
+                const sd_id128_t *boot_id,
+                const struct iovec iovec[],
+                const JournalFilePayload payloads[],
+                unsigned n_iovec,
+                uint64_t *seqno,
+                Object **ret,
+                uint64_t *offset);
+
+int journal_file_append_entries(
+                JournalFile *f,
+                const JournalFileEntry entries[], size_t n_entries,
+                uint64_t *seqno,
+                size_t *ret_n_appended);
 
 int journal_file_find_data_object(JournalFile *f, const void *data, uint64_t size, Object **ret, uint64_t *offset);
 int journal_file_find_data_object_with_hash(JournalFile *f, const void *data, uint64_t size, uint64_t hash, Object **ret, uint64_t *offset);
@@ -221,6 +297,8 @@ int journal_file_next_entry(JournalFile *f, uint64_t p, direction_t direction, O
 
 int journal_file_next_entry_for_data(JournalFile *f, Object *o, uint64_t p, uint64_t data_offset, direction_t direction, Object **ret, uint64_t *offset);
 
+int journal_file_get_boots(JournalFile *f, JournalBootInfo **ret, size_t *ret_n);
+
 int journal_file_move_to_entry_by_seqnum(JournalFile *f, uint64_t seqnum, direction_t direction, Object **ret, uint64_t *offset);
 int journal_file_move_to_entry_by_realtime(JournalFile *f, uint64_t realtime, direction_t direction, Object **ret, uint64_t *offset);
 int journal_file_move_to_entry_by_monotonic(JournalFile *f, sd_id128_t boot_id, uint64_t monotonic, direction_t direction, Object **ret, uint64_t *offset);
@@ -230,7 +308,10 @@ int journal_file_move_to_entry_by_seqnum_for_data(JournalFile *f, uint64_t data_
 int journal_file_move_to_entry_by_realtime_for_data(JournalFile *f, uint64_t data_offset, uint64_t realtime, direction_t direction, Object **ret, uint64_t *offset);
 int journal_file_move_to_entry_by_monotonic_for_data(JournalFile *f, uint64_t data_offset, sd_id128_t boot_id, uint64_t monotonic, direction_t direction, Object **ret, uint64_t *offset);
 
-int journal_file_copy_entry(JournalFile *from, JournalFile *to, Object *o, uint64_t p);
+/* If copied_data is non-NULL, it should be a hashmap with uint64_hash_ops that is used for copying entries from the
+ * same source file into the same destination file only. It remembers where the data objects already copied ended up,
+ * so that they are not hashed and looked up again. Free it with hashmap_free_free(). */
+int journal_file_copy_entry(JournalFile *from, JournalFile *to, Object *o, uint64_t p, Hashmap *copied_data);
 
 void journal_file_dump(JournalFile *f);
 void journal_file_print_header(JournalFile *f);
@@ -257,5 +338,5 @@ int journal_file_map_field_hash_table(JournalFile *f);
 
 static inline bool JOURNAL_FILE_COMPRESS(JournalFile *f) {
         assert(f);
-        return f->compress_xz || f->compress_lz4;
+        return f->compress_xz || f->compress_lz4 || f->compress_zstd;
 }
@@ -12,6 +12,7 @@
 #include "journal-def.h"
 #include "journal-file.h"
 #include "list.h"
+#include "prioq.h"
 #include "set.h"
 
 typedef struct Match Match;
@@ -74,6 +75,11 @@ struct sd_journal {
         IteratedCache *files_cache;
         MMapCache *mmap;
 
+        /* All files that have a candidate entry to return next, ordered by that entry's location in the iteration
+         * direction. NULL if it needs to be recalculated. */
+        Prioq *files_prioq;
+        direction_t files_prioq_direction;
+
         Location current_location;
 
         JournalFile *current_file;
@@ -92,6 +98,7 @@ struct sd_journal {
         char *unique_field;
         JournalFile *unique_file;
         uint64_t unique_offset;
+        Set *unique_values; /* values returned so far, for skipping them when they show up in later files */
 
         /* Iterating through known fields */
         JournalFile *fields_file;
@@ -123,6 +130,8 @@ struct sd_journal {
 
 char *journal_make_match_string(sd_journal *j);
 void journal_print_header(sd_journal *j);
+int journal_get_boots(sd_journal *j, JournalBootInfo **ret, size_t *ret_n);
+int journal_enumerate_data_payload(sd_journal *j, JournalFilePayload *ret);
 
 #define JOURNAL_FOREACH_DATA_RETVAL(j, data, l, retval)                     \
         for (sd_journal_restart_data(j); ((retval) = sd_journal_enumerate_data((j), &(data), &(l))) > 0; )
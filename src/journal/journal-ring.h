@@ -0,0 +1,59 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+#pragma once
+
+#include <inttypes.h>
+
+#include "macro.h"
+
+/* Layout of the shared memory ring a client may write native protocol records into, instead of sending one datagram
+ * per record. The client allocates a memfd of JOURNAL_RING_DATA_OFFSET plus the ring size, seals its size and sends it
+ * to journald on the native socket, together with one end of an AF_UNIX/SOCK_SEQPACKET socket pair, in an otherwise
+ * empty datagram. From then on the client writes records into the ring, and only sends one byte on the socket pair
+ * whenever the ring goes from empty to non-empty. journald starts reading the ring once it is set up, and marks it as
+ * accepted in the header then. Until that, journald may still refuse the ring by closing the socket pair, in which
+ * case the client sends the records on the socket instead. Either side closing its end of the socket pair tears the
+ * ring down.
+ *
+ * head and tail are running byte counters, that are only ever increased, and are accessed with atomic operations.
+ * head is only written by the client and points to the end of the last complete record, tail is only written by
+ * journald and points to the end of the last record it consumed. Both live on separate cache lines. */
+
+#define JOURNAL_RING_SIGNATURE ((const char[]) { 'J', 'R', 'N', 'L', 'R', 'I', 'N', 'G' })
+
+#define JOURNAL_RING_SIZE_MIN (64U*1024U)
+#define JOURNAL_RING_SIZE_MAX (64U*1024U*1024U)
+
+#define JOURNAL_RING_DATA_OFFSET 4096U
+
+enum {
+        JOURNAL_RING_ACCEPTED = 1 << 0,
+};
+
+typedef struct JournalRingHeader {
+        uint8_t signature[8];
+        uint32_t size;      /* of the data area, a power of two */
+        uint32_t flags;     /* JOURNAL_RING_ACCEPTED, set by journald */
+        uint8_t reserved[48];
+
+        uint64_t head;
+        uint8_t reserved_head[56];
+
+        uint64_t tail;
+        uint8_t reserved_tail[56];
+} JournalRingHeader;
+
+assert_cc(sizeof(JournalRingHeader) == 192);
+assert_cc(sizeof(JournalRingHeader) <= JOURNAL_RING_DATA_OFFSET);
+
+enum {
+        JOURNAL_RING_RECORD_PADDING = 1 << 0, /* the rest of the ring up to its end is unused, continue at the start */
+};
+
+/* Every record starts 8 byte aligned, so that there's always room for a padding record at the end of the ring */
+typedef struct JournalRingRecord {
+        uint32_t size;      /* of the payload following, excluding this header and the alignment */
+        uint32_t flags;
+        uint8_t payload[];
+} JournalRingRecord;
+
+#define JOURNAL_RING_RECORD_SIZE(payload_size) ALIGN8(sizeof(JournalRingRecord) + (uint64_t) (payload_size))
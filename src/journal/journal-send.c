@@ -2,8 +2,11 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <poll.h>
 #include <printf.h>
+#include <pthread.h>
 #include <stddef.h>
+#include <sys/mman.h>
 #include <sys/socket.h>
 #include <sys/un.h>
 #include <unistd.h>
@@ -15,7 +18,11 @@
 #include "alloc-util.h"
 #include "fd-util.h"
 #include "io-util.h"
+#include "journal-ring.h"
 #include "memfd-util.h"
+#include "missing.h"
+#include "parse-util.h"
+#include "process-util.h"
 #include "socket-util.h"
 #include "stdio-util.h"
 #include "string-util.h"
@@ -62,6 +69,373 @@ retry:
         return fd;
 }
 
+static int journal_send_socket(struct iovec *w, int j) {
+        _cleanup_close_ int buffer_fd = -1;
+        static const union sockaddr_union sa = {
+                .un.sun_family = AF_UNIX,
+                .un.sun_path = "/run/systemd/journal/socket",
+        };
+        struct msghdr mh = {
+                .msg_name = (struct sockaddr*) &sa.sa,
+                .msg_namelen = SOCKADDR_UN_LEN(sa.un),
+                .msg_iov = w,
+                .msg_iovlen = j,
+        };
+        bool seal = true;
+        ssize_t k;
+        int fd, r;
+
+        fd = journal_fd();
+        if (_unlikely_(fd < 0))
+                return fd;
+
+        k = sendmsg(fd, &mh, MSG_NOSIGNAL);
+        if (k >= 0)
+                return 0;
+
+        /* Fail silently if the journal is not available */
+        if (errno == ENOENT)
+                return 0;
+
+        if (!IN_SET(errno, EMSGSIZE, ENOBUFS))
+                return -errno;
+
+        /* Message doesn't fit... Let's dump the data in a memfd or
+         * temporary file and just pass a file descriptor of it to the
+         * other side.
+         *
+         * For the temporary files we use /dev/shm instead of /tmp
+         * here, since we want this to be a tmpfs, and one that is
+         * available from early boot on and where unprivileged users
+         * can create files. */
+        buffer_fd = memfd_new(NULL);
+        if (buffer_fd < 0) {
+                if (buffer_fd == -ENOSYS) {
+                        buffer_fd = open_tmpfile_unlinkable("/dev/shm", O_RDWR | O_CLOEXEC);
+                        if (buffer_fd < 0)
+                                return buffer_fd;
+
+                        seal = false;
+                } else
+                        return buffer_fd;
+        }
+
+        k = writev(buffer_fd, w, j);
+        if (k < 0)
+                return -errno;
+
+        if (seal) {
+                r = memfd_set_sealed(buffer_fd);
+                if (r < 0)
+                        return r;
+        }
+
+        r = send_one_fd_sa(fd, buffer_fd, mh.msg_name, mh.msg_namelen, 0);
+        if (r == -ENOENT)
+                /* Fail silently if the journal is not available */
+                return 0;
+        return r;
+}
+
+/* The shared memory ring, if the process opted into the ring transport with $SYSTEMD_JOURNAL_RING_SIZE. Unlike the
+ * socket above this is not shared with subprocesses, since only one process may write into a ring.
+ *
+ * Records in the ring and datagrams on the socket are read by journald independently of each other, hence the
+ * socket is never used while the ring might still hold records journald didn't get to, as they could be overtaken
+ * otherwise. Once the socket had to be used instead of the ring, it is used for good. */
+static pthread_mutex_t ring_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t ring_atfork_once = PTHREAD_ONCE_INIT;
+static JournalRingHeader *ring_header = NULL;
+static size_t ring_mapped_size = 0;
+static int ring_doorbell_fd = -1;
+static pid_t ring_pid = 0;
+static bool ring_disabled = false;
+
+/* journald doesn't tell us when it made room in the ring, hence check that this often while waiting for it */
+#define RING_WAIT_USEC (1 * USEC_PER_MSEC)
+
+static void journal_ring_close(void) {
+        if (ring_header)
+                (void) munmap(ring_header, ring_mapped_size);
+
+        ring_header = NULL;
+        ring_mapped_size = 0;
+        ring_doorbell_fd = safe_close(ring_doorbell_fd);
+        ring_pid = 0;
+}
+
+static void journal_ring_atfork_prepare(void) {
+        assert_se(pthread_mutex_lock(&ring_mutex) == 0);
+}
+
+static void journal_ring_atfork_parent(void) {
+        assert_se(pthread_mutex_unlock(&ring_mutex) == 0);
+}
+
+static void journal_ring_atfork_child(void) {
+        /* The ring belongs to the parent, the child sets up a ring of its own if it logs anything */
+        journal_ring_close();
+        assert_se(pthread_mutex_unlock(&ring_mutex) == 0);
+}
+
+static void journal_ring_atfork_install(void) {
+        /* Another thread might hold the lock while we are forked off, make sure the child can take it */
+        assert_se(pthread_atfork(journal_ring_atfork_prepare, journal_ring_atfork_parent, journal_ring_atfork_child) == 0);
+}
+
+static int journal_ring_setup(void) {
+        static const union sockaddr_union sa = {
+                .un.sun_family = AF_UNIX,
+                .un.sun_path = "/run/systemd/journal/socket",
+        };
+        union {
+                struct cmsghdr cmsghdr;
+                uint8_t buf[CMSG_SPACE(sizeof(int) * 2)];
+        } control = {};
+        struct msghdr mh = {
+                .msg_name = (struct sockaddr*) &sa.sa,
+                .msg_namelen = SOCKADDR_UN_LEN(sa.un),
+                .msg_control = &control,
+                .msg_controllen = sizeof(control),
+        };
+        _cleanup_close_pair_ int pair[2] = { -1, -1 };
+        _cleanup_close_ int memfd = -1;
+        struct cmsghdr *cmsg;
+        JournalRingHeader *h;
+        uint64_t size;
+        const char *e;
+        size_t ms;
+        int fd, r;
+
+        e = secure_getenv("SYSTEMD_JOURNAL_RING_SIZE");
+        if (!e)
+                return -EOPNOTSUPP;
+
+        r = parse_size(e, 1024, &size);
+        if (r < 0)
+                return r;
+
+        /* Round up to the next power of two */
+        size = MIN(size, (uint64_t) JOURNAL_RING_SIZE_MAX);
+        for (ms = JOURNAL_RING_SIZE_MIN; ms < size; ms <<= 1)
+                ;
+        size = ms;
+
+        fd = journal_fd();
+        if (fd < 0)
+                return fd;
+
+        memfd = memfd_new("journal-ring");
+        if (memfd < 0)
+                return memfd;
+
+        ms = JOURNAL_RING_DATA_OFFSET + size;
+        if (ftruncate(memfd, ms) < 0)
+                return -errno;
+
+        /* journald maps this too, hence make sure the file can never shrink under its feet */
+        if (fcntl(memfd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) < 0)
+                return -errno;
+
+        h = mmap(NULL, ms, PROT_READ|PROT_WRITE, MAP_SHARED, memfd, 0);
+        if (h == MAP_FAILED)
+                return -errno;
+
+        memcpy(h->signature, JOURNAL_RING_SIGNATURE, sizeof(h->signature));
+        h->size = (uint32_t) size;
+
+        if (socketpair(AF_UNIX, SOCK_SEQPACKET|SOCK_CLOEXEC|SOCK_NONBLOCK, 0, pair) < 0) {
+                r = -errno;
+                goto fail;
+        }
+
+        cmsg = CMSG_FIRSTHDR(&mh);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int) * 2);
+        memcpy(CMSG_DATA(cmsg), (int[]) { memfd, pair[1] }, sizeof(int) * 2);
+
+        if (sendmsg(fd, &mh, MSG_NOSIGNAL) < 0) {
+                r = -errno;
+                goto fail;
+        }
+
+        ring_header = h;
+        ring_mapped_size = ms;
+        ring_doorbell_fd = TAKE_FD(pair[0]);
+        ring_pid = getpid_cached();
+
+        return 0;
+
+fail:
+        (void) munmap(h, ms);
+        return r;
+}
+
+static int journal_ring_wait(uint64_t tail) {
+        int r;
+
+        /* Waits until journald consumed the ring up to the specified position, or went away */
+
+        for (;;) {
+                if ((int64_t) (__atomic_load_n(&ring_header->tail, __ATOMIC_SEQ_CST) - tail) >= 0)
+                        return 0;
+
+                r = fd_wait_for_event(ring_doorbell_fd, 0, RING_WAIT_USEC);
+                if (r < 0 && r != -EINTR)
+                        return r;
+                if (r > 0 && (r & (POLLHUP|POLLERR)))
+                        return -ECONNRESET;
+        }
+}
+
+static void journal_ring_abandon(void) {
+        uint64_t head, tail, size;
+        uint8_t *data;
+
+        /* journald went away or refused the ring. Send whatever it didn't get to on the socket instead, in order, and
+         * keep using the socket from now on. journald might have consumed the last record without telling us yet,
+         * but it's better to log it twice than not at all. */
+
+        head = ring_header->head;
+        tail = __atomic_load_n(&ring_header->tail, __ATOMIC_SEQ_CST);
+        size = ring_header->size;
+        data = (uint8_t*) ring_header + JOURNAL_RING_DATA_OFFSET;
+
+        while (head - tail >= sizeof(JournalRingRecord) && head - tail <= size) {
+                JournalRingRecord *rec;
+                uint64_t pos, need;
+
+                pos = tail & (size - 1);
+                rec = (JournalRingRecord*) (data + pos);
+
+                need = rec->flags & JOURNAL_RING_RECORD_PADDING ? size - pos : JOURNAL_RING_RECORD_SIZE(rec->size);
+                if (need > size - pos || need > head - tail)
+                        break;
+
+                if (!(rec->flags & JOURNAL_RING_RECORD_PADDING))
+                        (void) journal_send_socket(&IOVEC_MAKE(rec->payload, rec->size), 1);
+
+                tail += need;
+        }
+
+        journal_ring_close();
+        __atomic_store_n(&ring_disabled, true, __ATOMIC_RELEASE);
+}
+
+static int journal_ring_send(const struct iovec *w, int j) {
+        static const char doorbell = 0;
+        uint64_t head, size, pos, skip, need, payload = 0;
+        JournalRingRecord *rec;
+        uint8_t *data, *q;
+        int i, r;
+
+        /* Returns 0 if the record was put into the ring, and a negative error if the caller shall use the socket
+         * instead. */
+
+        if (__atomic_load_n(&ring_disabled, __ATOMIC_ACQUIRE))
+                return -EOPNOTSUPP;
+
+        for (i = 0; i < j; i++)
+                payload += w[i].iov_len;
+
+        assert_se(pthread_once(&ring_atfork_once, journal_ring_atfork_install) == 0);
+        assert_se(pthread_mutex_lock(&ring_mutex) == 0);
+
+        if (ring_disabled) {
+                r = -EOPNOTSUPP;
+                goto finish;
+        }
+
+        /* The ring belongs to the process that created it, i.e. our parent if we have been forked off without the
+         * atfork handlers being run */
+        if (ring_header && ring_pid != getpid_cached())
+                journal_ring_close();
+
+        if (!ring_header) {
+                r = journal_ring_setup();
+                if (r < 0) {
+                        __atomic_store_n(&ring_disabled, true, __ATOMIC_RELEASE);
+                        goto finish;
+                }
+        }
+
+        /* Records may be written before journald accepted the ring, it reads them once it did. Until then, it
+         * might also refuse the ring though, and close its end of the socket pair. */
+        if (!(__atomic_load_n(&ring_header->flags, __ATOMIC_ACQUIRE) & JOURNAL_RING_ACCEPTED)) {
+                r = fd_wait_for_event(ring_doorbell_fd, 0, 0);
+                if (r > 0 && (r & (POLLHUP|POLLERR))) {
+                        journal_ring_abandon();
+                        r = -ECONNRESET;
+                        goto finish;
+                }
+        }
+
+        size = ring_header->size;
+        data = (uint8_t*) ring_header + JOURNAL_RING_DATA_OFFSET;
+
+        need = JOURNAL_RING_RECORD_SIZE(payload);
+        if (need > size / 4) {
+                /* Too large for the ring, hence the socket has to be used, but only once journald got
+                 * everything before this record */
+                r = journal_ring_wait(ring_header->head);
+                if (r < 0)
+                        journal_ring_abandon();
+                else {
+                        journal_ring_close();
+                        __atomic_store_n(&ring_disabled, true, __ATOMIC_RELEASE);
+                }
+
+                r = -EMSGSIZE;
+                goto finish;
+        }
+
+        head = ring_header->head;
+
+        /* Records are never split, if the record doesn't fit before the end of the ring, skip to its start */
+        pos = head & (size - 1);
+        skip = need > size - pos ? size - pos : 0;
+
+        /* If the ring is full, wait for journald to make room, like a blocking socket would */
+        r = journal_ring_wait(head + skip + need - size);
+        if (r < 0) {
+                journal_ring_abandon();
+                goto finish;
+        }
+
+        if (skip > 0) {
+                rec = (JournalRingRecord*) (data + pos);
+                rec->size = 0;
+                rec->flags = JOURNAL_RING_RECORD_PADDING;
+                pos = 0;
+        }
+
+        rec = (JournalRingRecord*) (data + pos);
+        rec->size = (uint32_t) payload;
+        rec->flags = 0;
+
+        q = rec->payload;
+        for (i = 0; i < j; i++)
+                q = mempcpy(q, w[i].iov_base, w[i].iov_len);
+
+        /* Publish the record, and then check if journald had consumed everything before it. If so it might be
+         * waiting for us, hence wake it up. journald does the same in reverse, hence one of us will notice. */
+        __atomic_store_n(&ring_header->head, head + skip + need, __ATOMIC_SEQ_CST);
+
+        r = 0;
+        if (__atomic_load_n(&ring_header->tail, __ATOMIC_SEQ_CST) == head &&
+            send(ring_doorbell_fd, &doorbell, sizeof(doorbell), MSG_DONTWAIT|MSG_NOSIGNAL) < 0 &&
+            errno != EAGAIN) {
+                /* journald went away. The caller doesn't need to send the record itself, as it is sent on the
+                 * socket along with whatever else journald didn't get to. */
+                journal_ring_abandon();
+        }
+
+finish:
+        assert_se(pthread_mutex_unlock(&ring_mutex) == 0);
+        return r;
+}
+
 _public_ int sd_journal_print(int priority, const char *format, ...) {
         int r;
         va_list ap;
@@ -194,22 +568,10 @@ finish:
 
 _public_ int sd_journal_sendv(const struct iovec *iov, int n) {
         PROTECT_ERRNO;
-        int fd, r;
-        _cleanup_close_ int buffer_fd = -1;
         struct iovec *w;
         uint64_t *l;
         int i, j = 0;
-        static const union sockaddr_union sa = {
-                .un.sun_family = AF_UNIX,
-                .un.sun_path = "/run/systemd/journal/socket",
-        };
-        struct msghdr mh = {
-                .msg_name = (struct sockaddr*) &sa.sa,
-                .msg_namelen = SOCKADDR_UN_LEN(sa.un),
-        };
-        ssize_t k;
         bool have_syslog_identifier = false;
-        bool seal = true;
 
         assert_return(iov, -EINVAL);
         assert_return(n > 0, -EINVAL);
@@ -270,59 +632,11 @@ _public_ int sd_journal_sendv(const struct iovec *iov, int n) {
                 w[j++] = IOVEC_MAKE_STRING("\n");
         }
 
-        fd = journal_fd();
-        if (_unlikely_(fd < 0))
-                return fd;
-
-        mh.msg_iov = w;
-        mh.msg_iovlen = j;
-
-        k = sendmsg(fd, &mh, MSG_NOSIGNAL);
-        if (k >= 0)
+        /* If the process opted into the shared memory ring, try that first */
+        if (journal_ring_send(w, j) >= 0)
                 return 0;
 
-        /* Fail silently if the journal is not available */
-        if (errno == ENOENT)
-                return 0;
-
-        if (!IN_SET(errno, EMSGSIZE, ENOBUFS))
-                return -errno;
-
-        /* Message doesn't fit... Let's dump the data in a memfd or
-         * temporary file and just pass a file descriptor of it to the
-         * other side.
-         *
-         * For the temporary files we use /dev/shm instead of /tmp
-         * here, since we want this to be a tmpfs, and one that is
-         * available from early boot on and where unprivileged users
-         * can create files. */
-        buffer_fd = memfd_new(NULL);
-        if (buffer_fd < 0) {
-                if (buffer_fd == -ENOSYS) {
-                        buffer_fd = open_tmpfile_unlinkable("/dev/shm", O_RDWR | O_CLOEXEC);
-                        if (buffer_fd < 0)
-                                return buffer_fd;
-
-                        seal = false;
-                } else
-                        return buffer_fd;
-        }
-
-        n = writev(buffer_fd, w, j);
-        if (n < 0)
-                return -errno;
-
-        if (seal) {
-                r = memfd_set_sealed(buffer_fd);
-                if (r < 0)
-                        return r;
-        }
-
-        r = send_one_fd_sa(fd, buffer_fd, mh.msg_name, mh.msg_namelen, 0);
-        if (r == -ENOENT)
-                /* Fail silently if the journal is not available */
-                return 0;
-        return r;
+        return journal_send_socket(w, j);
 }
 
 static int fill_iovec_perror_and_send(const char *message, int skip, struct iovec iov[]) {
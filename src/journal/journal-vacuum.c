@@ -1,7 +1,9 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 
 #include <fcntl.h>
+#include <sys/inotify.h>
 #include <sys/stat.h>
+#include <sys/statvfs.h>
 #include <unistd.h>
 
 #include "sd-id128.h"
@@ -10,16 +12,26 @@
 #include "dirent-util.h"
 #include "fd-util.h"
 #include "fs-util.h"
+#include "hashmap.h"
 #include "journal-def.h"
 #include "journal-file.h"
 #include "journal-vacuum.h"
 #include "parse-util.h"
+#include "set.h"
 #include "string-util.h"
 #include "time-util.h"
 #include "util.h"
 #include "xattr-util.h"
 
+typedef enum VacuumFileType {
+        VACUUM_FILE_ACTIVE,   /* online (or otherwise unparsable) files, we never remove these */
+        VACUUM_FILE_ARCHIVED, /* archived or corrupted files, removed oldest first */
+        VACUUM_FILE_EMPTY,    /* archived or corrupted files without entries, always removed */
+} VacuumFileType;
+
 struct vacuum_info {
+        VacuumFileType type;
+
         uint64_t usage;
         char *filename;
 
@@ -30,6 +42,27 @@ struct vacuum_info {
         bool have_seqnum;
 };
 
+struct JournalVacuumIndex {
+        char *directory;
+        int dir_fd;
+
+        /* If we watch the directory, we keep the index up-to-date from the inotify events, and only rescan the
+         * whole directory if we lost track (e.g. because the inotify queue overflowed). Otherwise we need to rescan
+         * everything whenever we are asked something. */
+        int inotify_fd;
+        bool dirty:1;
+        bool stale:1;
+
+        Hashmap *by_name;                 /* filename → struct vacuum_info, owns the objects */
+        Set *active;
+        Set *empty;
+        struct vacuum_info **archived;  /* sorted by vacuum_compare() */
+        size_t n_archived, n_archived_allocated;
+
+        uint64_t archived_usage;
+        uint64_t empty_usage;
+};
+
 static int vacuum_compare(const struct vacuum_info *a, const struct vacuum_info *b) {
         int r;
 
@@ -118,204 +151,616 @@ static int journal_file_empty(int dir_fd, const char *name) {
         return le64toh(n_entries) <= 0;
 }
 
-int journal_directory_vacuum(
-                const char *directory,
-                uint64_t max_use,
-                uint64_t n_max_files,
-                usec_t max_retention_usec,
-                usec_t *oldest_usec,
-                bool verbose) {
+static struct vacuum_info* vacuum_info_free(struct vacuum_info *info) {
+        if (!info)
+                return NULL;
 
-        uint64_t sum = 0, freed = 0, n_active_files = 0;
-        size_t n_list = 0, n_allocated = 0, i;
-        _cleanup_closedir_ DIR *d = NULL;
-        struct vacuum_info *list = NULL;
-        usec_t retention_limit = 0;
-        char sbytes[FORMAT_BYTES_MAX];
-        struct dirent *de;
+        free(info->filename);
+        return mfree(info);
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(struct vacuum_info*, vacuum_info_free);
+
+static int vacuum_info_new(int dir_fd, const char *directory, const char *name, struct vacuum_info **ret) {
+        _cleanup_(vacuum_info_freep) struct vacuum_info *info = NULL;
+        unsigned long long seqnum = 0, realtime;
+        sd_id128_t seqnum_id = SD_ID128_NULL;
+        bool have_seqnum;
+        struct stat st;
+        char *copy;
+        size_t q;
         int r;
 
-        assert(directory);
+        assert(dir_fd >= 0);
+        assert(name);
+        assert(ret);
 
-        if (max_use <= 0 && max_retention_usec <= 0 && n_max_files <= 0)
+        /* Returns 0 if the file is nothing we care about, and 1 and the new object otherwise */
+
+        if (fstatat(dir_fd, name, &st, AT_SYMLINK_NOFOLLOW) < 0) {
+                if (errno == ENOENT)
+                        return -ENOENT;
+
+                log_debug_errno(errno, "Failed to stat file %s while vacuuming, ignoring: %m", name);
                 return 0;
+        }
 
-        if (max_retention_usec > 0)
-                retention_limit = usec_sub_unsigned(now(CLOCK_REALTIME), max_retention_usec);
+        if (!S_ISREG(st.st_mode))
+                return 0;
 
-        d = opendir(directory);
-        if (!d)
-                return -errno;
+        info = new0(struct vacuum_info, 1);
+        if (!info)
+                return -ENOMEM;
 
-        FOREACH_DIRENT_ALL(de, d, r = -errno; goto finish) {
+        info->filename = strdup(name);
+        if (!info->filename)
+                return -ENOMEM;
 
-                unsigned long long seqnum = 0, realtime;
-                _cleanup_free_ char *p = NULL;
-                sd_id128_t seqnum_id;
-                bool have_seqnum;
-                uint64_t size;
-                struct stat st;
-                size_t q;
+        info->usage = 512UL * (uint64_t) st.st_blocks;
 
-                if (fstatat(dirfd(d), de->d_name, &st, AT_SYMLINK_NOFOLLOW) < 0) {
-                        log_debug_errno(errno, "Failed to stat file %s while vacuuming, ignoring: %m", de->d_name);
-                        continue;
+        copy = strdupa(name);
+        q = strlen(copy);
+
+        if (endswith(copy, ".journal")) {
+
+                /* Vacuum archived files. Active files are
+                 * left around */
+
+                if (q < 1 + 32 + 1 + 16 + 1 + 16 + 8)
+                        goto active;
+
+                if (copy[q-8-16-1] != '-' ||
+                    copy[q-8-16-1-16-1] != '-' ||
+                    copy[q-8-16-1-16-1-32-1] != '@')
+                        goto active;
+
+                copy[q-8-16-1-16-1] = 0;
+                if (sd_id128_from_string(copy + q-8-16-1-16-1-32, &seqnum_id) < 0)
+                        goto active;
+
+                if (sscanf(copy + q-8-16-1-16, "%16llx-%16llx.journal", &seqnum, &realtime) != 2)
+                        goto active;
+
+                have_seqnum = true;
+
+        } else if (endswith(copy, ".journal~")) {
+                unsigned long long tmp;
+
+                /* Vacuum corrupted files */
+
+                if (q < 1 + 16 + 1 + 16 + 8 + 1)
+                        goto active;
+
+                if (copy[q-1-8-16-1] != '-' ||
+                    copy[q-1-8-16-1-16-1] != '@')
+                        goto active;
+
+                if (sscanf(copy + q-1-8-16-1-16, "%16llx-%16llx.journal~", &realtime, &tmp) != 2)
+                        goto active;
+
+                have_seqnum = false;
+        } else {
+                /* We do not vacuum unknown files! */
+                log_debug("Not vacuuming unknown file %s.", name);
+                return 0;
+        }
+
+        r = journal_file_empty(dir_fd, name);
+        if (r < 0) {
+                log_debug_errno(r, "Failed check if %s/%s is empty, ignoring: %m", directory, name);
+                return 0;
+        }
+        if (r > 0)
+                /* Always vacuum empty non-online files. */
+                info->type = VACUUM_FILE_EMPTY;
+        else {
+                patch_realtime(dir_fd, name, &st, &realtime);
+                info->type = VACUUM_FILE_ARCHIVED;
+        }
+
+        info->seqnum = seqnum;
+        info->realtime = realtime;
+        info->seqnum_id = seqnum_id;
+        info->have_seqnum = have_seqnum;
+
+        *ret = TAKE_PTR(info);
+        return 1;
+
+active:
+        info->type = VACUUM_FILE_ACTIVE;
+
+        *ret = TAKE_PTR(info);
+        return 1;
+}
+
+static size_t index_archived_lower_bound(JournalVacuumIndex *i, const struct vacuum_info *info) {
+        size_t a = 0, b;
+
+        assert(i);
+        assert(info);
+
+        b = i->n_archived;
+        while (a < b) {
+                size_t c = (a + b) / 2;
+
+                if (vacuum_compare(i->archived[c], info) < 0)
+                        a = c + 1;
+                else
+                        b = c;
+        }
+
+        return a;
+}
+
+static int index_add(JournalVacuumIndex *i, struct vacuum_info *info) {
+        size_t k;
+        int r;
+
+        assert(i);
+        assert(info);
+
+        r = hashmap_ensure_allocated(&i->by_name, &string_hash_ops);
+        if (r < 0)
+                return r;
+
+        switch (info->type) {
+
+        case VACUUM_FILE_ACTIVE:
+                r = set_ensure_allocated(&i->active, NULL);
+                if (r < 0)
+                        return r;
+
+                r = set_put(i->active, info);
+                if (r < 0)
+                        return r;
+                break;
+
+        case VACUUM_FILE_EMPTY:
+                r = set_ensure_allocated(&i->empty, NULL);
+                if (r < 0)
+                        return r;
+
+                r = set_put(i->empty, info);
+                if (r < 0)
+                        return r;
+                break;
+
+        case VACUUM_FILE_ARCHIVED:
+                if (!GREEDY_REALLOC(i->archived, i->n_archived_allocated, i->n_archived + 1))
+                        return -ENOMEM;
+
+                /* Keep the list sorted, so that vacuuming can just go from the front */
+                k = index_archived_lower_bound(i, info);
+                memmove(i->archived + k + 1, i->archived + k, (i->n_archived - k) * sizeof(struct vacuum_info*));
+                i->archived[k] = info;
+                i->n_archived++;
+                break;
+
+        default:
+                assert_not_reached("Unknown vacuum file type");
+        }
+
+        r = hashmap_put(i->by_name, info->filename, info);
+        if (r < 0) {
+                /* Undo the above, hence just take the object out again */
+                switch (info->type) {
+
+                case VACUUM_FILE_ACTIVE:
+                        (void) set_remove(i->active, info);
+                        break;
+
+                case VACUUM_FILE_EMPTY:
+                        (void) set_remove(i->empty, info);
+                        break;
+
+                case VACUUM_FILE_ARCHIVED:
+                        k = index_archived_lower_bound(i, info);
+                        while (i->archived[k] != info)
+                                k++;
+                        memmove(i->archived + k, i->archived + k + 1, (i->n_archived - k - 1) * sizeof(struct vacuum_info*));
+                        i->n_archived--;
+                        break;
                 }
 
-                if (!S_ISREG(st.st_mode))
+                return r;
+        }
+
+        if (info->type == VACUUM_FILE_ARCHIVED)
+                i->archived_usage += info->usage;
+        else if (info->type == VACUUM_FILE_EMPTY)
+                i->empty_usage += info->usage;
+
+        return 0;
+}
+
+static void index_remove(JournalVacuumIndex *i, const char *name) {
+        struct vacuum_info *info;
+        size_t k;
+
+        assert(i);
+        assert(name);
+
+        info = hashmap_remove(i->by_name, name);
+        if (!info)
+                return;
+
+        switch (info->type) {
+
+        case VACUUM_FILE_ACTIVE:
+                (void) set_remove(i->active, info);
+                break;
+
+        case VACUUM_FILE_EMPTY:
+                (void) set_remove(i->empty, info);
+                i->empty_usage = LESS_BY(i->empty_usage, info->usage);
+                break;
+
+        case VACUUM_FILE_ARCHIVED:
+                /* vacuum_compare() is not necessarily unique, hence search from the first equal item on */
+                for (k = index_archived_lower_bound(i, info); k < i->n_archived; k++)
+                        if (i->archived[k] == info)
+                                break;
+
+                assert(k < i->n_archived);
+                memmove(i->archived + k, i->archived + k + 1, (i->n_archived - k - 1) * sizeof(struct vacuum_info*));
+                i->n_archived--;
+
+                i->archived_usage = LESS_BY(i->archived_usage, info->usage);
+                break;
+        }
+
+        vacuum_info_free(info);
+}
+
+static int index_add_file(JournalVacuumIndex *i, const char *name) {
+        _cleanup_(vacuum_info_freep) struct vacuum_info *info = NULL;
+        int r;
+
+        assert(i);
+        assert(name);
+
+        /* Replace whatever we knew about the file before */
+        index_remove(i, name);
+
+        r = vacuum_info_new(i->dir_fd, i->directory, name, &info);
+        if (r <= 0)
+                return r;
+
+        r = index_add(i, info);
+        if (r < 0)
+                return r;
+
+        TAKE_PTR(info);
+        return 0;
+}
+
+static void index_clear(JournalVacuumIndex *i) {
+        struct vacuum_info *info;
+
+        assert(i);
+
+        set_clear(i->active);
+        set_clear(i->empty);
+        i->n_archived = 0;
+        i->archived_usage = i->empty_usage = 0;
+
+        while ((info = hashmap_steal_first(i->by_name)))
+                vacuum_info_free(info);
+}
+
+static int index_rescan(JournalVacuumIndex *i) {
+        _cleanup_closedir_ DIR *d = NULL;
+        struct dirent *de;
+        int fd, r;
+
+        assert(i);
+
+        index_clear(i);
+
+        fd = fcntl(i->dir_fd, F_DUPFD_CLOEXEC, 3);
+        if (fd < 0)
+                return -errno;
+
+        d = fdopendir(fd);
+        if (!d) {
+                safe_close(fd);
+                return -errno;
+        }
+
+        rewinddir(d);
+
+        FOREACH_DIRENT_ALL(de, d, return -errno) {
+
+                if (dot_or_dot_dot(de->d_name))
                         continue;
 
-                q = strlen(de->d_name);
+                r = index_add_file(i, de->d_name);
+                if (r < 0 && r != -ENOENT)
+                        return r;
+        }
 
-                if (endswith(de->d_name, ".journal")) {
+        i->dirty = false;
+        return 0;
+}
 
-                        /* Vacuum archived files. Active files are
-                         * left around */
+static int index_process_inotify(JournalVacuumIndex *i) {
+        int r;
 
-                        if (q < 1 + 32 + 1 + 16 + 1 + 16 + 8) {
-                                n_active_files++;
-                                continue;
-                        }
+        assert(i);
+        assert(i->inotify_fd >= 0);
 
-                        if (de->d_name[q-8-16-1] != '-' ||
-                            de->d_name[q-8-16-1-16-1] != '-' ||
-                            de->d_name[q-8-16-1-16-1-32-1] != '@') {
-                                n_active_files++;
-                                continue;
-                        }
+        for (;;) {
+                union inotify_event_buffer buffer;
+                struct inotify_event *e;
+                ssize_t l;
+
+                l = read(i->inotify_fd, &buffer, sizeof(buffer));
+                if (l < 0) {
+                        if (IN_SET(errno, EAGAIN, EINTR))
+                                return 0;
+
+                        return -errno;
+                }
 
-                        p = strdup(de->d_name);
-                        if (!p) {
-                                r = -ENOMEM;
-                                goto finish;
+                FOREACH_INOTIFY_EVENT(e, buffer, l) {
+
+                        if (e->mask & (IN_DELETE_SELF|IN_MOVE_SELF|IN_UNMOUNT|IN_IGNORED)) {
+                                /* The directory itself is gone, we can't follow it anymore */
+                                i->stale = true;
+                                continue;
                         }
 
-                        de->d_name[q-8-16-1-16-1] = 0;
-                        if (sd_id128_from_string(de->d_name + q-8-16-1-16-1-32, &seqnum_id) < 0) {
-                                n_active_files++;
+                        if (e->mask & IN_Q_OVERFLOW) {
+                                /* We missed something, hence we need to start from scratch */
+                                i->dirty = true;
                                 continue;
                         }
 
-                        if (sscanf(de->d_name + q-8-16-1-16, "%16llx-%16llx.journal", &seqnum, &realtime) != 2) {
-                                n_active_files++;
+                        if (i->dirty || i->stale || e->len <= 0)
                                 continue;
+
+                        if (e->mask & (IN_DELETE|IN_MOVED_FROM))
+                                index_remove(i, e->name);
+                        else if (e->mask & (IN_CREATE|IN_MOVED_TO|IN_CLOSE_WRITE)) {
+                                r = index_add_file(i, e->name);
+                                if (r < 0 && r != -ENOENT)
+                                        /* Couldn't update the index in place? Then let's rescan later. */
+                                        i->dirty = true;
                         }
+                }
+        }
+}
 
-                        have_seqnum = true;
+static int index_update(JournalVacuumIndex *i) {
+        int r;
 
-                } else if (endswith(de->d_name, ".journal~")) {
-                        unsigned long long tmp;
+        assert(i);
 
-                        /* Vacuum corrupted files */
+        if (i->inotify_fd >= 0) {
+                r = index_process_inotify(i);
+                if (r < 0)
+                        return r;
+        }
 
-                        if (q < 1 + 16 + 1 + 16 + 8 + 1) {
-                                n_active_files++;
-                                continue;
-                        }
+        if (i->stale)
+                return -ESTALE;
 
-                        if (de->d_name[q-1-8-16-1] != '-' ||
-                            de->d_name[q-1-8-16-1-16-1] != '@') {
-                                n_active_files++;
-                                continue;
-                        }
+        if (i->dirty)
+                return index_rescan(i);
 
-                        p = strdup(de->d_name);
-                        if (!p) {
-                                r = -ENOMEM;
-                                goto finish;
-                        }
+        return 0;
+}
 
-                        if (sscanf(de->d_name + q-1-8-16-1-16, "%16llx-%16llx.journal~", &realtime, &tmp) != 2) {
-                                n_active_files++;
-                                continue;
-                        }
+int journal_vacuum_index_new(const char *directory, bool watch, JournalVacuumIndex **ret) {
+        _cleanup_(journal_vacuum_index_freep) JournalVacuumIndex *i = NULL;
 
-                        have_seqnum = false;
-                } else {
-                        /* We do not vacuum unknown files! */
-                        log_debug("Not vacuuming unknown file %s.", de->d_name);
-                        continue;
+        assert(directory);
+        assert(ret);
+
+        i = new0(JournalVacuumIndex, 1);
+        if (!i)
+                return -ENOMEM;
+
+        i->dir_fd = i->inotify_fd = -1;
+        i->dirty = true;
+
+        i->directory = strdup(directory);
+        if (!i->directory)
+                return -ENOMEM;
+
+        /* Set up the watch first, so that we don't miss anything happening between the initial scan and it */
+        if (watch) {
+                i->inotify_fd = inotify_init1(IN_NONBLOCK|IN_CLOEXEC);
+                if (i->inotify_fd < 0)
+                        log_debug_errno(errno, "Failed to allocate inotify object, rescanning %s on every use: %m", directory);
+                else if (inotify_add_watch(i->inotify_fd, directory,
+                                           IN_CREATE|IN_DELETE|IN_MOVED_FROM|IN_MOVED_TO|IN_CLOSE_WRITE|
+                                           IN_DELETE_SELF|IN_MOVE_SELF|IN_ONLYDIR) < 0) {
+                        if (errno == ENOENT)
+                                return -ENOENT;
+
+                        log_debug_errno(errno, "Failed to watch %s, rescanning on every use: %m", directory);
+                        i->inotify_fd = safe_close(i->inotify_fd);
                 }
+        }
 
-                size = 512UL * (uint64_t) st.st_blocks;
+        i->dir_fd = open(directory, O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+        if (i->dir_fd < 0)
+                return -errno;
 
-                r = journal_file_empty(dirfd(d), p);
-                if (r < 0) {
-                        log_debug_errno(r, "Failed check if %s is empty, ignoring: %m", p);
-                        continue;
-                }
-                if (r > 0) {
-                        /* Always vacuum empty non-online files. */
+        *ret = TAKE_PTR(i);
+        return 0;
+}
 
-                        r = unlinkat_deallocate(dirfd(d), p, 0);
-                        if (r >= 0) {
+JournalVacuumIndex* journal_vacuum_index_free(JournalVacuumIndex *i) {
+        if (!i)
+                return NULL;
 
-                                log_full(verbose ? LOG_INFO : LOG_DEBUG,
-                                         "Deleted empty archived journal %s/%s (%s).", directory, p, format_bytes(sbytes, sizeof(sbytes), size));
+        index_clear(i);
+
+        hashmap_free(i->by_name);
+        set_free(i->active);
+        set_free(i->empty);
+        free(i->archived);
+
+        safe_close(i->inotify_fd);
+        safe_close(i->dir_fd);
+        free(i->directory);
+
+        return mfree(i);
+}
+
+int journal_vacuum_index_usage(JournalVacuumIndex *i, uint64_t *ret_used, uint64_t *ret_free) {
+        struct vacuum_info *info;
+        struct statvfs ss;
+        uint64_t sum;
+        Iterator it;
+        int r;
+
+        assert(i);
+        assert(ret_used);
+        assert(ret_free);
+
+        r = index_update(i);
+        if (r < 0)
+                return r;
+
+        if (fstatvfs(i->dir_fd, &ss) < 0)
+                return -errno;
 
-                                freed += size;
-                        } else if (r != -ENOENT)
-                                log_warning_errno(r, "Failed to delete empty archived journal %s/%s: %m", directory, p);
+        /* Archived files don't change anymore, only the online ones do, hence refresh only their sizes */
+        sum = i->archived_usage + i->empty_usage;
+        SET_FOREACH(info, i->active, it) {
+                struct stat st;
 
+                if (fstatat(i->dir_fd, info->filename, &st, AT_SYMLINK_NOFOLLOW) < 0) {
+                        log_debug_errno(errno, "Failed to stat %s/%s, ignoring: %m", i->directory, info->filename);
                         continue;
                 }
 
-                patch_realtime(dirfd(d), p, &st, &realtime);
+                info->usage = (uint64_t) st.st_blocks * 512UL;
+                sum += info->usage;
+        }
 
-                if (!GREEDY_REALLOC(list, n_allocated, n_list + 1)) {
-                        r = -ENOMEM;
-                        goto finish;
-                }
+        if (i->inotify_fd < 0)
+                i->dirty = true;
+
+        *ret_used = sum;
+        *ret_free = ss.f_bsize * ss.f_bavail;
+        return 0;
+}
+
+int journal_vacuum_index_vacuum(
+                JournalVacuumIndex *i,
+                uint64_t max_use,
+                uint64_t n_max_files,
+                usec_t max_retention_usec,
+                usec_t *oldest_usec,
+                bool verbose) {
 
-                list[n_list++] = (struct vacuum_info) {
-                        .filename = TAKE_PTR(p),
-                        .usage = size,
-                        .seqnum = seqnum,
-                        .realtime = realtime,
-                        .seqnum_id = seqnum_id,
-                        .have_seqnum = have_seqnum,
-                };
+        uint64_t sum, freed = 0;
+        struct vacuum_info *info;
+        usec_t retention_limit = 0;
+        char sbytes[FORMAT_BYTES_MAX];
+        size_t k, n_kept = 0;
+        Iterator it;
+        int r;
+
+        assert(i);
+
+        if (max_use <= 0 && max_retention_usec <= 0 && n_max_files <= 0)
+                return 0;
 
-                sum += size;
+        if (max_retention_usec > 0)
+                retention_limit = usec_sub_unsigned(now(CLOCK_REALTIME), max_retention_usec);
+
+        r = index_update(i);
+        if (r < 0)
+                return r;
+
+        SET_FOREACH(info, i->empty, it) {
+                r = unlinkat_deallocate(i->dir_fd, info->filename, 0);
+                if (r >= 0 || r == -ENOENT) {
+                        if (r >= 0) {
+                                log_full(verbose ? LOG_INFO : LOG_DEBUG,
+                                         "Deleted empty archived journal %s/%s (%s).", i->directory, info->filename, format_bytes(sbytes, sizeof(sbytes), info->usage));
+
+                                freed += info->usage;
+                        }
+
+                        index_remove(i, info->filename);
+                } else
+                        log_warning_errno(r, "Failed to delete empty archived journal %s/%s: %m", i->directory, info->filename);
         }
 
-        typesafe_qsort(list, n_list, vacuum_compare);
+        sum = i->archived_usage;
 
-        for (i = 0; i < n_list; i++) {
+        for (k = 0; k < i->n_archived; k++) {
                 uint64_t left;
 
-                left = n_active_files + n_list - i;
+                info = i->archived[k];
+                left = set_size(i->active) + i->n_archived - k;
 
-                if ((max_retention_usec <= 0 || list[i].realtime >= retention_limit) &&
+                if ((max_retention_usec <= 0 || info->realtime >= retention_limit) &&
                     (max_use <= 0 || sum <= max_use) &&
                     (n_max_files <= 0 || left <= n_max_files))
                         break;
 
-                r = unlinkat_deallocate(dirfd(d), list[i].filename, 0);
-                if (r >= 0) {
-                        log_full(verbose ? LOG_INFO : LOG_DEBUG, "Deleted archived journal %s/%s (%s).", directory, list[i].filename, format_bytes(sbytes, sizeof(sbytes), list[i].usage));
-                        freed += list[i].usage;
+                r = unlinkat_deallocate(i->dir_fd, info->filename, 0);
+                if (r >= 0 || r == -ENOENT) {
+                        if (r >= 0) {
+                                log_full(verbose ? LOG_INFO : LOG_DEBUG, "Deleted archived journal %s/%s (%s).", i->directory, info->filename, format_bytes(sbytes, sizeof(sbytes), info->usage));
+                                freed += info->usage;
+                        }
+
+                        sum = LESS_BY(sum, info->usage);
+                        i->archived_usage = LESS_BY(i->archived_usage, info->usage);
 
-                        if (list[i].usage < sum)
-                                sum -= list[i].usage;
-                        else
-                                sum = 0;
+                        assert_se(hashmap_remove(i->by_name, info->filename) == info);
+                        vacuum_info_free(info);
+                } else {
+                        log_warning_errno(r, "Failed to delete archived journal %s/%s: %m", i->directory, info->filename);
 
-                } else if (r != -ENOENT)
-                        log_warning_errno(r, "Failed to delete archived journal %s/%s: %m", directory, list[i].filename);
+                        /* Keep it at the front of the list */
+                        i->archived[n_kept++] = info;
+                }
         }
 
-        if (oldest_usec && i < n_list && (*oldest_usec == 0 || list[i].realtime < *oldest_usec))
-                *oldest_usec = list[i].realtime;
+        if (oldest_usec && k < i->n_archived && (*oldest_usec == 0 || i->archived[k]->realtime < *oldest_usec))
+                *oldest_usec = i->archived[k]->realtime;
+
+        /* Close the gap left by what we removed, this is the only step that doesn't scale with the number of files
+         * removed, but it's just a memmove() of pointers */
+        memmove(i->archived + n_kept, i->archived + k, (i->n_archived - k) * sizeof(struct vacuum_info*));
+        i->n_archived -= k - n_kept;
 
-        r = 0;
+        if (i->inotify_fd < 0)
+                i->dirty = true;
 
-finish:
-        for (i = 0; i < n_list; i++)
-                free(list[i].filename);
-        free(list);
+        log_full(verbose ? LOG_INFO : LOG_DEBUG, "Vacuuming done, freed %s of archived journals from %s.", format_bytes(sbytes, sizeof(sbytes), freed), i->directory);
+
+        return 0;
+}
 
-        log_full(verbose ? LOG_INFO : LOG_DEBUG, "Vacuuming done, freed %s of archived journals from %s.", format_bytes(sbytes, sizeof(sbytes), freed), directory);
+int journal_directory_vacuum(
+                const char *directory,
+                uint64_t max_use,
+                uint64_t n_max_files,
+                usec_t max_retention_usec,
+                usec_t *oldest_usec,
+                bool verbose) {
+
+        _cleanup_(journal_vacuum_index_freep) JournalVacuumIndex *i = NULL;
+        int r;
+
+        assert(directory);
+
+        if (max_use <= 0 && max_retention_usec <= 0 && n_max_files <= 0)
+                return 0;
+
+        r = journal_vacuum_index_new(directory, false, &i);
+        if (r < 0)
+                return r;
 
-        return r;
+        return journal_vacuum_index_vacuum(i, max_use, n_max_files, max_retention_usec, oldest_usec, verbose);
 }
@@ -4,6 +4,19 @@
 #include <inttypes.h>
 #include <stdbool.h>
 
+#include "macro.h"
 #include "time-util.h"
 
+/* An index of the journal files in one directory, with their disk usage, sorted in the order they shall be vacuumed
+ * in. If it is told to watch the directory it is updated from inotify events, so that usage queries and vacuuming
+ * don't have to enumerate the whole directory each time. */
+typedef struct JournalVacuumIndex JournalVacuumIndex;
+
+int journal_vacuum_index_new(const char *directory, bool watch, JournalVacuumIndex **ret);
+JournalVacuumIndex* journal_vacuum_index_free(JournalVacuumIndex *i);
+DEFINE_TRIVIAL_CLEANUP_FUNC(JournalVacuumIndex*, journal_vacuum_index_free);
+
+int journal_vacuum_index_usage(JournalVacuumIndex *i, uint64_t *ret_used, uint64_t *ret_free);
+int journal_vacuum_index_vacuum(JournalVacuumIndex *i, uint64_t max_use, uint64_t n_max_files, usec_t max_retention_usec, usec_t *oldest_usec, bool verbose);
+
 int journal_directory_vacuum(const char *directory, uint64_t max_use, uint64_t n_max_files, usec_t max_retention_usec, usec_t *oldest_usec, bool verbose);
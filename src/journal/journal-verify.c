@@ -1,6 +1,7 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 
 #include <fcntl.h>
+#include <signal.h>
 #include <stddef.h>
 #include <sys/mman.h>
 #include <unistd.h>
@@ -16,10 +17,14 @@
 #include "journal-verify.h"
 #include "lookup3.h"
 #include "macro.h"
+#include "process-util.h"
 #include "terminal-util.h"
 #include "tmpfile-util.h"
 #include "util.h"
 
+/* The minimum number of hash table buckets to hand to each worker process when verifying in parallel */
+#define VERIFY_HASH_TABLE_WORKER_MIN 512U
+
 static void draw_progress(uint64_t p, usec_t *last_usec) {
         unsigned n, i, j, k;
         usec_t z, x;
@@ -119,7 +124,7 @@ static int journal_file_object_verify(JournalFile *f, uint64_t offset, Object *o
          * possible field values. It does not follow any references to
          * other objects. */
 
-        if ((o->object.flags & OBJECT_COMPRESSED_XZ) &&
+        if ((o->object.flags & OBJECT_COMPRESSION_MASK) &&
             o->object.type != OBJECT_DATA) {
                 error(offset, "Found compressed object that isn't of type DATA, which is not allowed.");
                 return -EBADMSG;
@@ -151,9 +156,16 @@ static int journal_file_object_verify(JournalFile *f, uint64_t offset, Object *o
                 compression = o->object.flags & OBJECT_COMPRESSION_MASK;
                 if (compression) {
                         _cleanup_free_ void *b = NULL;
+                        CompressDictionary *dict;
                         size_t alloc = 0, b_size;
 
-                        r = decompress_blob(compression,
+                        r = journal_file_get_compress_dictionary(f, compression, &dict);
+                        if (r < 0) {
+                                error_errno(offset, r, "Failed to load compression dictionary: %m");
+                                return r;
+                        }
+
+                        r = decompress_blob(compression, dict,
                                             o->data.payload,
                                             le64toh(o->object.size) - offsetof(Object, data.payload),
                                             &b, &alloc, &b_size, 0);
@@ -163,9 +175,9 @@ static int journal_file_object_verify(JournalFile *f, uint64_t offset, Object *o
                                 return r;
                         }
 
-                        h2 = hash64(b, b_size);
+                        h2 = journal_file_hash_data(f, b, b_size);
                 } else
-                        h2 = hash64(o->data.payload, le64toh(o->object.size) - offsetof(Object, data.payload));
+                        h2 = journal_file_hash_data(f, o->data.payload, le64toh(o->object.size) - offsetof(Object, data.payload));
 
                 if (h1 != h2) {
                         error(offset, "Invalid hash (%08"PRIx64" vs. %08"PRIx64, h1, h2);
@@ -344,9 +356,104 @@ static int journal_file_object_verify(JournalFile *f, uint64_t offset, Object *o
                         return -EBADMSG;
                 }
 
+                break;
+
+        case OBJECT_DICTIONARY:
+                if (le64toh(o->object.size) <= offsetof(DictionaryObject, payload)) {
+                        error(offset,
+                              "Invalid object dictionary size: %"PRIu64,
+                              le64toh(o->object.size));
+                        return -EBADMSG;
+                }
+
+                if (le32toh(o->dictionary.dictionary_id) == 0) {
+                        error(offset, "Invalid dictionary ID 0");
+                        return -EBADMSG;
+                }
+
+                break;
+
+        case OBJECT_BLOOM:
+                if (le64toh(o->object.size) <= offsetof(BloomObject, bits)) {
+                        error(offset,
+                              "Invalid Bloom filter object size: %"PRIu64,
+                              le64toh(o->object.size));
+                        return -EBADMSG;
+                }
+
+                if (le32toh(o->bloom.n_hashes) == 0) {
+                        error(offset, "Invalid number of Bloom filter hashes 0");
+                        return -EBADMSG;
+                }
+
+                break;
+
+        case OBJECT_BOOT_INDEX: {
+                uint64_t i, n;
+
+                if (le64toh(o->object.size) <= offsetof(BootIndexObject, items) ||
+                    (le64toh(o->object.size) - offsetof(BootIndexObject, items)) % sizeof(BootIndexItem) != 0) {
+                        error(offset,
+                              "Invalid boot index object size: %"PRIu64,
+                              le64toh(o->object.size));
+                        return -EBADMSG;
+                }
+
+                n = (le64toh(o->object.size) - offsetof(BootIndexObject, items)) / sizeof(BootIndexItem);
+                for (i = 0; i < n; i++) {
+                        if (sd_id128_is_null(o->boot_index.items[i].boot_id)) {
+                                error(offset, "Boot index item %"PRIu64" has null boot ID", i);
+                                return -EBADMSG;
+                        }
+
+                        if (le64toh(o->boot_index.items[i].first_seqnum) > le64toh(o->boot_index.items[i].last_seqnum)) {
+                                error(offset,
+                                      "Boot index item %"PRIu64" has invalid seqnum range: %"PRIu64" > %"PRIu64,
+                                      i,
+                                      le64toh(o->boot_index.items[i].first_seqnum),
+                                      le64toh(o->boot_index.items[i].last_seqnum));
+                                return -EBADMSG;
+                        }
+                }
+
                 break;
         }
 
+        case OBJECT_ENTRY_ARRAY_INDEX: {
+                uint64_t i, n;
+
+                if (le64toh(o->object.size) <= offsetof(EntryArrayIndexObject, items) ||
+                    (le64toh(o->object.size) - offsetof(EntryArrayIndexObject, items)) % sizeof(EntryArrayIndexItem) != 0) {
+                        error(offset,
+                              "Invalid entry array index object size: %"PRIu64,
+                              le64toh(o->object.size));
+                        return -EBADMSG;
+                }
+
+                n = (le64toh(o->object.size) - offsetof(EntryArrayIndexObject, items)) / sizeof(EntryArrayIndexItem);
+                for (i = 0; i < n; i++) {
+                        if (!VALID64(le64toh(o->entry_array_index.items[i].offset)) ||
+                            !VALID64(le64toh(o->entry_array_index.items[i].last_entry))) {
+                                error(offset, "Entry array index item %"PRIu64" has invalid offset", i);
+                                return -EBADMSG;
+                        }
+
+                        if (le64toh(o->entry_array_index.items[i].n_items) <= 0) {
+                                error(offset, "Entry array index item %"PRIu64" has no items", i);
+                                return -EBADMSG;
+                        }
+
+                        if (i > 0 &&
+                            le64toh(o->entry_array_index.items[i].offset) <= le64toh(o->entry_array_index.items[i-1].offset)) {
+                                error(offset, "Entry array index item %"PRIu64" out of order", i);
+                                return -EBADMSG;
+                        }
+                }
+
+                break;
+        }
+        }
+
         return 0;
 }
 
@@ -566,32 +673,28 @@ static int verify_data(
         return 0;
 }
 
-static int verify_hash_table(
+static int verify_hash_table_range(
                 JournalFile *f,
                 MMapFileDescriptor *cache_data_fd, uint64_t n_data,
                 MMapFileDescriptor *cache_entry_fd, uint64_t n_entries,
                 MMapFileDescriptor *cache_entry_array_fd, uint64_t n_entry_arrays,
+                uint64_t n, uint64_t start, uint64_t end,
                 usec_t *last_usec,
                 bool show_progress) {
 
-        uint64_t i, n;
+        uint64_t i;
         int r;
 
         assert(f);
+        assert(f->data_hash_table);
         assert(cache_data_fd);
         assert(cache_entry_fd);
         assert(cache_entry_array_fd);
+        assert(start <= end);
+        assert(end <= n);
         assert(last_usec);
 
-        n = le64toh(f->header->data_hash_table_size) / sizeof(HashItem);
-        if (n <= 0)
-                return 0;
-
-        r = journal_file_map_data_hash_table(f);
-        if (r < 0)
-                return log_error_errno(r, "Failed to map data hash table: %m");
-
-        for (i = 0; i < n; i++) {
+        for (i = start; i < end; i++) {
                 uint64_t last = 0, p;
 
                 if (show_progress)
@@ -639,6 +742,100 @@ static int verify_hash_table(
         return 0;
 }
 
+static int verify_hash_table(
+                JournalFile *f,
+                MMapFileDescriptor *cache_data_fd, uint64_t n_data,
+                MMapFileDescriptor *cache_entry_fd, uint64_t n_entries,
+                MMapFileDescriptor *cache_entry_array_fd, uint64_t n_entry_arrays,
+                unsigned n_workers,
+                usec_t *last_usec,
+                bool show_progress) {
+
+        _cleanup_free_ pid_t *pids = NULL;
+        unsigned k, n_started = 0;
+        uint64_t n;
+        int r;
+
+        assert(f);
+        assert(last_usec);
+
+        n = le64toh(f->header->data_hash_table_size) / sizeof(HashItem);
+        if (n <= 0)
+                return 0;
+
+        r = journal_file_map_data_hash_table(f);
+        if (r < 0)
+                return log_error_errno(r, "Failed to map data hash table: %m");
+
+        /* Small tables are not worth the fork()s */
+        if (n_workers > 1 && n / n_workers < VERIFY_HASH_TABLE_WORKER_MIN)
+                n_workers = MAX(n / VERIFY_HASH_TABLE_WORKER_MIN, (uint64_t) 1);
+
+        if (n_workers <= 1)
+                return verify_hash_table_range(f,
+                                               cache_data_fd, n_data,
+                                               cache_entry_fd, n_entries,
+                                               cache_entry_array_fd, n_entry_arrays,
+                                               n, 0, n,
+                                               last_usec,
+                                               show_progress);
+
+        /* Everything we look at in this phase is only read, hence we can split the buckets up between child
+         * processes, which inherit the file mappings and the data offset table we wrote. */
+
+        pids = new(pid_t, n_workers);
+        if (!pids)
+                return log_oom();
+
+        if (show_progress)
+                draw_progress(0xC000, last_usec);
+
+        for (k = 0; k < n_workers; k++) {
+                r = safe_fork("(sd-verify)", FORK_RESET_SIGNALS|FORK_DEATHSIG|FORK_LOG, pids + k);
+                if (r < 0)
+                        break;
+                if (r == 0) {
+                        usec_t child_usec = 0;
+
+                        /* Child */
+                        r = verify_hash_table_range(f,
+                                                    cache_data_fd, n_data,
+                                                    cache_entry_fd, n_entries,
+                                                    cache_entry_array_fd, n_entry_arrays,
+                                                    n, n * k / n_workers, n * (k + 1) / n_workers,
+                                                    &child_usec,
+                                                    false);
+                        _exit(r < 0 ? -r : EXIT_SUCCESS);
+                }
+
+                n_started++;
+        }
+
+        /* If we failed to fork, kill what we already started, but still reap it */
+        if (r < 0)
+                for (k = 0; k < n_started; k++)
+                        (void) kill(pids[k], SIGKILL);
+        else
+                r = 0;
+
+        for (k = 0; k < n_started; k++) {
+                int q;
+
+                q = wait_for_terminate_and_check(NULL, pids[k], 0);
+                if (r < 0)
+                        continue;
+                if (q < 0)
+                        r = q;
+                else if (q != EXIT_SUCCESS)
+                        r = -q;
+        }
+
+        if (show_progress)
+                draw_progress(0xFFFF, last_usec);
+
+        return r;
+}
+
 static int data_object_in_hash_table(JournalFile *f, uint64_t hash, uint64_t p) {
         uint64_t n, h, q;
         int r;
@@ -799,11 +996,74 @@ static int verify_entry_array(
         return 0;
 }
 
+static int verify_entry_array_index(JournalFile *f) {
+        uint64_t i, k, a, n, total = 0;
+        Object *o;
+        int r;
+
+        assert(f);
+
+        /* The index has to describe exactly the arrays of the chain verified by verify_entry_array() */
+
+        if (!JOURNAL_HEADER_CONTAINS(f->header, entry_array_index_offset) ||
+            f->header->entry_array_index_offset == 0)
+                return 0;
+
+        r = journal_file_move_to_object(f, OBJECT_ENTRY_ARRAY_INDEX, le64toh(f->header->entry_array_index_offset), &o);
+        if (r < 0)
+                return r;
+
+        k = (le64toh(o->object.size) - offsetof(EntryArrayIndexObject, items)) / sizeof(EntryArrayIndexItem);
+        n = le64toh(f->header->n_entries);
+        a = le64toh(f->header->entry_array_offset);
+
+        for (i = 0; i < k; i++) {
+                EntryArrayIndexItem item;
+                uint64_t m;
+
+                r = journal_file_move_to_object(f, OBJECT_ENTRY_ARRAY_INDEX, le64toh(f->header->entry_array_index_offset), &o);
+                if (r < 0)
+                        return r;
+
+                item = o->entry_array_index.items[i];
+
+                if (a == 0 || total >= n || le64toh(item.offset) != a) {
+                        error(le64toh(f->header->entry_array_index_offset),
+                              "Entry array index item %"PRIu64" doesn't match array chain", i);
+                        return -EBADMSG;
+                }
+
+                r = journal_file_move_to_object(f, OBJECT_ENTRY_ARRAY, a, &o);
+                if (r < 0)
+                        return r;
+
+                m = journal_file_entry_array_n_items(o);
+                if (le64toh(item.n_items) != m ||
+                    le64toh(item.last_entry) != le64toh(o->entry_array.items[MIN(m, n - total) - 1])) {
+                        error(le64toh(f->header->entry_array_index_offset),
+                              "Entry array index item %"PRIu64" doesn't match array "OFSfmt, i, a);
+                        return -EBADMSG;
+                }
+
+                total += m;
+                a = le64toh(o->entry_array.next_entry_array_offset);
+        }
+
+        if (total < n) {
+                error(le64toh(f->header->entry_array_index_offset),
+                      "Entry array index too short at %"PRIu64" of %"PRIu64, total, n);
+                return -EBADMSG;
+        }
+
+        return 0;
+}
+
 int journal_file_verify(
                 JournalFile *f,
                 const char *key,
                 usec_t *first_contained, usec_t *last_validated, usec_t *last_contained,
-                bool show_progress) {
+                bool show_progress,
+                unsigned n_workers) {
         int r;
         Object *o;
         uint64_t p = 0, last_epoch = 0, last_tag_realtime = 0, last_sealed_realtime = 0;
@@ -925,8 +1185,8 @@ int journal_file_verify(
                         goto fail;
                 }
 
-                if ((o->object.flags & OBJECT_COMPRESSED_XZ) &&
-                    (o->object.flags & OBJECT_COMPRESSED_LZ4)) {
+                if (!IN_SET(o->object.flags & OBJECT_COMPRESSION_MASK,
+                            0, OBJECT_COMPRESSED_XZ, OBJECT_COMPRESSED_LZ4, OBJECT_COMPRESSED_ZSTD)) {
                         error(p, "Objected with double compression");
                         r = -EINVAL;
                         goto fail;
@@ -944,6 +1204,12 @@ int journal_file_verify(
                         goto fail;
                 }
 
+                if ((o->object.flags & OBJECT_COMPRESSED_ZSTD) && !JOURNAL_HEADER_COMPRESSED_ZSTD(f->header)) {
+                        error(p, "ZSTD compressed object in file without ZSTD compression");
+                        r = -EBADMSG;
+                        goto fail;
+                }
+
                 switch (o->object.type) {
 
                 case OBJECT_DATA:
@@ -1157,6 +1423,52 @@ int journal_file_verify(
                         n_tags++;
                         break;
 
+                case OBJECT_DICTIONARY:
+                        if (!JOURNAL_HEADER_COMPRESSED_ZSTD(f->header)) {
+                                error(p, "Dictionary object in file without ZSTD compression");
+                                r = -EBADMSG;
+                                goto fail;
+                        }
+
+                        if (!JOURNAL_HEADER_CONTAINS(f->header, zstd_dictionary_offset) ||
+                            p != le64toh(f->header->zstd_dictionary_offset)) {
+                                error(p, "Dictionary object not referenced from header");
+                                r = -EBADMSG;
+                                goto fail;
+                        }
+
+                        break;
+
+                case OBJECT_BLOOM:
+                        if (!JOURNAL_HEADER_CONTAINS(f->header, bloom_filter_offset) ||
+                            p != le64toh(f->header->bloom_filter_offset)) {
+                                error(p, "Bloom filter object not referenced from header");
+                                r = -EBADMSG;
+                                goto fail;
+                        }
+
+                        break;
+
+                case OBJECT_BOOT_INDEX:
+                        if (!JOURNAL_HEADER_CONTAINS(f->header, boot_index_offset) ||
+                            p != le64toh(f->header->boot_index_offset)) {
+                                error(p, "Boot index object not referenced from header");
+                                r = -EBADMSG;
+                                goto fail;
+                        }
+
+                        break;
+
+                case OBJECT_ENTRY_ARRAY_INDEX:
+                        if (!JOURNAL_HEADER_CONTAINS(f->header, entry_array_index_offset) ||
+                            p != le64toh(f->header->entry_array_index_offset)) {
+                                error(p, "Entry array index object not referenced from header");
+                                r = -EBADMSG;
+                                goto fail;
+                        }
+
+                        break;
+
                 default:
                         n_weird++;
                 }
@@ -1259,10 +1571,15 @@ int journal_file_verify(
         if (r < 0)
                 goto fail;
 
+        r = verify_entry_array_index(f);
+        if (r < 0)
+                goto fail;
+
         r = verify_hash_table(f,
                               cache_data_fd, n_data,
                               cache_entry_fd, n_entries,
                               cache_entry_array_fd, n_entry_arrays,
+                              n_workers,
                               &last_usec,
                               show_progress);
         if (r < 0)
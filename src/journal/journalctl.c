@@ -31,6 +31,7 @@
 #include "bus-util.h"
 #include "catalog.h"
 #include "chattr-util.h"
+#include "copy.h"
 #include "def.h"
 #include "device-private.h"
 #include "fd-util.h"
@@ -50,11 +51,13 @@
 #include "locale-util.h"
 #include "log.h"
 #include "logs-show.h"
+#include "memfd-util.h"
 #include "mkdir.h"
 #include "pager.h"
 #include "parse-util.h"
 #include "path-util.h"
 #include "pretty-print.h"
+#include "process-util.h"
 #include "rlimit-util.h"
 #include "set.h"
 #include "sigbus.h"
@@ -70,6 +73,10 @@
 
 #define PROCESS_INOTIFY_INTERVAL 1024   /* Every 1,024 messages processed */
 
+/* When pattern matching in parallel, give up on a file if more entries than this match. Showing them takes longer
+ * than matching then anyway. */
+#define GREP_JOB_MATCHES_MAX (1024U*1024U)
+
 #if HAVE_PCRE2
 DEFINE_TRIVIAL_CLEANUP_FUNC(pcre2_match_data*, pcre2_match_data_free);
 DEFINE_TRIVIAL_CLEANUP_FUNC(pcre2_code*, pcre2_code_free);
@@ -519,7 +526,7 @@ static int parse_argv(int argc, char *argv[]) {
                                 return -EINVAL;
                         }
 
-                        if (IN_SET(arg_output, OUTPUT_EXPORT, OUTPUT_JSON, OUTPUT_JSON_PRETTY, OUTPUT_JSON_SSE, OUTPUT_JSON_SEQ, OUTPUT_CAT))
+                        if (IN_SET(arg_output, OUTPUT_EXPORT, OUTPUT_EXPORT_BINARY, OUTPUT_JSON, OUTPUT_JSON_PRETTY, OUTPUT_JSON_SSE, OUTPUT_JSON_SEQ, OUTPUT_CAT))
                                 arg_quiet = true;
 
                         break;
@@ -1191,6 +1198,75 @@ static int discover_next_boot(sd_journal *j,
         return 0;
 }
 
+static int get_boots_from_summaries(
+                sd_journal *j,
+                BootId **boots,
+                sd_id128_t *boot_id,
+                int offset) {
+
+        _cleanup_free_ JournalBootInfo *infos = NULL;
+        BootId *head = NULL, *tail = NULL;
+        size_t n, k;
+        ssize_t idx;
+        int r;
+
+        assert(j);
+
+        /* Determines the boots from the per-file boot summaries, without iterating through the journal. Same
+         * semantics as get_boots() below. */
+
+        r = journal_get_boots(j, &infos, &n);
+        if (r < 0)
+                return r;
+
+        sd_journal_flush_matches(j);
+
+        if (!boot_id) {
+                for (k = 0; k < n; k++) {
+                        BootId *id;
+
+                        id = new0(BootId, 1);
+                        if (!id) {
+                                boot_id_free_all(head);
+                                return -ENOMEM;
+                        }
+
+                        id->id = infos[k].boot_id;
+                        id->first = infos[k].first_realtime;
+                        id->last = infos[k].last_realtime;
+
+                        LIST_INSERT_AFTER(boot_list, head, tail, id);
+                        tail = id;
+                }
+
+                if (boots)
+                        *boots = head;
+                else
+                        boot_id_free_all(head);
+
+                return (int) n;
+        }
+
+        if (sd_id128_is_null(*boot_id))
+                /* Offset 0 is the last (and current) boot, while 1 is the (chronological) first boot */
+                idx = offset <= 0 ? (ssize_t) n - 1 + offset : offset - 1;
+        else {
+                for (k = 0; k < n; k++)
+                        if (sd_id128_equal(infos[k].boot_id, *boot_id))
+                                break;
+                if (k >= n)
+                        return 0;
+
+                idx = (ssize_t) k + offset;
+        }
+
+        if (idx < 0 || (size_t) idx >= n)
+                return 0;
+
+        *boot_id = infos[idx].boot_id;
+        return 1;
+}
+
 static int get_boots(
                 sd_journal *j,
                 BootId **boots,
@@ -1205,6 +1281,12 @@ static int get_boots(
 
         assert(j);
 
+        r = get_boots_from_summaries(j, boots, boot_id, offset);
+        if (r >= 0)
+                return r;
+
+        log_debug_errno(r, "Failed to determine boots from file summaries, iterating through the journal: %m");
+
         /* Adjust for the asymmetry that offset 0 is
          * the last (and current) boot, while 1 is considered the
          * (chronological) first boot in the journal. */
@@ -1836,48 +1918,173 @@ finish:
 #endif
 }
 
+static int verify_one(JournalFile *f, bool show_progress, unsigned n_workers) {
+        usec_t first = 0, validated = 0, last = 0;
+        int k;
+
+        assert(f);
+
+#if HAVE_GCRYPT
+        if (!arg_verify_key && JOURNAL_HEADER_SEALED(f->header))
+                log_notice("Journal file %s has sealing enabled but verification key has not been passed using --verify-key=.", f->path);
+#endif
+
+        k = journal_file_verify(f, arg_verify_key, &first, &validated, &last, show_progress, n_workers);
+        if (k == -EINVAL)
+                /* If the key was invalid give up right-away. */
+                return k;
+        else if (k < 0)
+                log_warning_errno(k, "FAIL: %s (%m)", f->path);
+        else {
+                char a[FORMAT_TIMESTAMP_MAX], b[FORMAT_TIMESTAMP_MAX], c[FORMAT_TIMESPAN_MAX];
+                log_info("PASS: %s", f->path);
+
+                if (arg_verify_key && JOURNAL_HEADER_SEALED(f->header)) {
+                        if (validated > 0) {
+                                log_info("=> Validated from %s to %s, final %s entries not sealed.",
+                                         format_timestamp_maybe_utc(a, sizeof(a), first),
+                                         format_timestamp_maybe_utc(b, sizeof(b), validated),
+                                         format_timespan(c, sizeof(c), last > validated ? last - validated : 0, 0));
+                        } else if (last > 0)
+                                log_info("=> No sealing yet, %s of entries not sealed.",
+                                         format_timespan(c, sizeof(c), last - first, 0));
+                        else
+                                log_info("=> No sealing yet, no entries in file.");
+                }
+        }
+
+        return k;
+}
+
+typedef struct VerifyJob {
+        JournalFile *file;
+        pid_t pid;
+        int output_fd;
+} VerifyJob;
+
+static int verify_job_start(VerifyJob *job, unsigned n_workers) {
+        int r;
+
+        assert(job);
+
+        /* Each file is verified in a child process of its own, with everything it logs collected in a memfd, so that
+         * we can show the results in the same order as we'd have done when verifying one file after the other. */
+
+        job->output_fd = memfd_new("journal-verify");
+        if (job->output_fd < 0)
+                return log_error_errno(job->output_fd, "Failed to allocate memfd: %m");
+
+        r = safe_fork("(sd-verify)", FORK_RESET_SIGNALS|FORK_DEATHSIG|FORK_LOG, &job->pid);
+        if (r < 0) {
+                job->output_fd = safe_close(job->output_fd);
+                return r;
+        }
+        if (r == 0) {
+                /* Child */
+                if (dup2(job->output_fd, STDERR_FILENO) < 0)
+                        _exit(EXIT_FAILURE);
+
+                r = verify_one(job->file, false, n_workers);
+                _exit(r < 0 ? -r : EXIT_SUCCESS);
+        }
+
+        return 0;
+}
+
+static int verify_job_finish(VerifyJob *job) {
+        int r;
+
+        assert(job);
+        assert(job->pid > 0);
+
+        r = wait_for_terminate_and_check(NULL, job->pid, 0);
+        job->pid = 0;
+
+        if (lseek(job->output_fd, 0, SEEK_SET) >= 0)
+                (void) copy_bytes(job->output_fd, STDERR_FILENO, (uint64_t) -1, 0);
+        job->output_fd = safe_close(job->output_fd);
+
+        if (r < 0)
+                return log_warning_errno(r, "FAIL: %s (%m)", job->file->path);
+
+        return r == EXIT_SUCCESS ? 0 : -r;
+}
+
 static int verify(sd_journal *j) {
-        int r = 0;
-        Iterator i;
+        _cleanup_free_ VerifyJob *jobs = NULL;
+        size_t n_files, n_jobs, n_started = 0, n_finished = 0, i;
+        unsigned n_workers;
+        Iterator it;
         JournalFile *f;
+        long cpus;
+        int r = 0;
 
         assert(j);
 
         log_show_color(true);
 
-        ORDERED_HASHMAP_FOREACH(f, j->files, i) {
+        cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        n_workers = cpus > 0 ? (unsigned) cpus : 1;
+        n_files = ordered_hashmap_size(j->files);
+
+        if (n_workers <= 1 || n_files <= 1) {
+                /* Nothing to run in parallel on the file level, but we might still split up a single big file */
+                ORDERED_HASHMAP_FOREACH(f, j->files, it) {
+                        int k;
+
+                        k = verify_one(f, true, n_workers);
+                        if (k == -EINVAL)
+                                return k;
+                        if (k < 0)
+                                r = k;
+                }
+
+                return r;
+        }
+
+        jobs = new0(VerifyJob, n_files);
+        if (!jobs)
+                return log_oom();
+
+        i = 0;
+        ORDERED_HASHMAP_FOREACH(f, j->files, it)
+                jobs[i++] = (VerifyJob) { .file = f, .output_fd = -1 };
+
+        /* Verify as many files at the same time as we have CPUs; if there are fewer files than that, hand the remaining
+         * CPUs to the hash table checks of each file. */
+        n_jobs = MIN(n_files, (size_t) n_workers);
+        n_workers = MAX(n_workers / (unsigned) n_files, 1U);
+
+        while (n_finished < n_files) {
                 int k;
-                usec_t first = 0, validated = 0, last = 0;
 
-#if HAVE_GCRYPT
-                if (!arg_verify_key && JOURNAL_HEADER_SEALED(f->header))
-                        log_notice("Journal file %s has sealing enabled but verification key has not been passed using --verify-key=.", f->path);
-#endif
+                while (n_started < n_files && n_started - n_finished < n_jobs) {
+                        k = verify_job_start(jobs + n_started, n_workers);
+                        if (k < 0) {
+                                r = k;
+                                goto finish;
+                        }
+
+                        n_started++;
+                }
+
+                k = verify_job_finish(jobs + n_finished);
+                n_finished++;
 
-                k = journal_file_verify(f, arg_verify_key, &first, &validated, &last, true);
                 if (k == -EINVAL) {
-                        /* If the key was invalid give up right-away. */
-                        return k;
-                } else if (k < 0) {
-                        log_warning_errno(k, "FAIL: %s (%m)", f->path);
                         r = k;
-                } else {
-                        char a[FORMAT_TIMESTAMP_MAX], b[FORMAT_TIMESTAMP_MAX], c[FORMAT_TIMESPAN_MAX];
-                        log_info("PASS: %s", f->path);
-
-                        if (arg_verify_key && JOURNAL_HEADER_SEALED(f->header)) {
-                                if (validated > 0) {
-                                        log_info("=> Validated from %s to %s, final %s entries not sealed.",
-                                                 format_timestamp_maybe_utc(a, sizeof(a), first),
-                                                 format_timestamp_maybe_utc(b, sizeof(b), validated),
-                                                 format_timespan(c, sizeof(c), last > validated ? last - validated : 0, 0));
-                                } else if (last > 0)
-                                        log_info("=> No sealing yet, %s of entries not sealed.",
-                                                 format_timespan(c, sizeof(c), last - first, 0));
-                                else
-                                        log_info("=> No sealing yet, no entries in file.");
-                        }
+                        goto finish;
                 }
+                if (k < 0)
+                        r = k;
+        }
+
+finish:
+        /* Reap whatever is still running if we gave up early, without showing its output */
+        for (i = n_finished; i < n_started; i++) {
+                (void) kill(jobs[i].pid, SIGKILL);
+                (void) wait_for_terminate(jobs[i].pid, NULL);
+                safe_close(jobs[i].output_fd);
         }
 
         return r;
@@ -2075,9 +2282,368 @@ static int wait_for_change(sd_journal *j, int poll_fd) {
         return 0;
 }
 
+#if HAVE_PCRE2
+static int pattern_match_entry(sd_journal *j, pcre2_match_data *md, size_t highlight[2]) {
+        const void *message;
+        PCRE2_SIZE *ovec;
+        size_t len;
+        int r;
+
+        assert(j);
+        assert(md);
+        assert(highlight);
+
+        /* Returns > 0 if the MESSAGE= field of the current entry matches the pattern, 0 if not */
+
+        r = sd_journal_get_data(j, "MESSAGE", &message, &len);
+        if (r == -ENOENT)
+                return 0;
+        if (r < 0)
+                return log_error_errno(r, "Failed to get MESSAGE field: %m");
+
+        assert_se(message = startswith(message, "MESSAGE="));
+
+        r = pcre2_match(arg_compiled_pattern,
+                        message,
+                        len - strlen("MESSAGE="),
+                        0,      /* start at offset 0 in the subject */
+                        0,      /* default options */
+                        md,
+                        NULL);
+        if (r == PCRE2_ERROR_NOMATCH)
+                return 0;
+        if (r < 0) {
+                unsigned char buf[LINE_MAX];
+                int r2;
+
+                r2 = pcre2_get_error_message(r, buf, sizeof buf);
+                return log_error_errno(SYNTHETIC_ERRNO(EINVAL),
+                                       "Pattern matching failed: %s",
+                                       r2 < 0 ? "unknown error" : (char*) buf);
+        }
+
+        ovec = pcre2_get_ovector_pointer(md);
+        highlight[0] = ovec[0];
+        highlight[1] = ovec[1];
+
+        return 1;
+}
+
+typedef struct GrepMatch {
+        uint64_t offset;
+        uint64_t highlight[2];
+} GrepMatch;
+
+typedef struct GrepJob {
+        JournalFile *file;
+        sd_id128_t file_id;
+        pid_t pid;
+        int output_fd;
+
+        /* The entries of the file matching the pattern, ordered by offset, and the last entry looked at */
+        GrepMatch *matches;
+        size_t n_matches;
+        uint64_t tail;
+} GrepJob;
+
+static GrepJob* grep_job_free(GrepJob *job) {
+        if (!job)
+                return NULL;
+
+        if (job->pid > 0) {
+                (void) kill(job->pid, SIGKILL);
+                (void) wait_for_terminate(job->pid, NULL);
+        }
+
+        safe_close(job->output_fd);
+        free(job->matches);
+        return mfree(job);
+}
+
+static int grep_job_scan(GrepJob *job, size_t data_threshold) {
+        _cleanup_(pcre2_match_data_freep) pcre2_match_data *md = NULL;
+        _cleanup_(sd_journal_closep) sd_journal *j = NULL;
+        _cleanup_free_ GrepMatch *matches = NULL;
+        size_t n_matches = 0, n_allocated = 0;
+        uint64_t tail = 0;
+        int r;
+
+        assert(job);
+
+        /* Runs in the child: finds the matching entries of the file, and writes the offset of the last entry
+         * looked at followed by the matches to the output fd. The file mappings of the parent's sd_journal object
+         * can't be used after fork(), hence open the file once more. */
+
+        r = sd_journal_open_files(&j, (const char**) STRV_MAKE(job->file->path), 0);
+        if (r < 0)
+                return log_debug_errno(r, "Failed to open %s: %m", job->file->path);
+
+        r = sd_journal_set_data_threshold(j, data_threshold);
+        if (r < 0)
+                return r;
+
+        if (arg_since_set) {
+                r = sd_journal_seek_realtime_usec(j, arg_since);
+                if (r < 0)
+                        return r;
+        }
+
+        md = pcre2_match_data_create(1, NULL);
+        if (!md)
+                return -ENOMEM;
+
+        for (;;) {
+                size_t highlight[2];
+
+                r = sd_journal_next(j);
+                if (r < 0)
+                        return r;
+                if (r == 0)
+                        break;
+
+                if (arg_until_set) {
+                        usec_t usec;
+
+                        r = sd_journal_get_realtime_usec(j, &usec);
+                        if (r < 0)
+                                return r;
+                        if (usec > arg_until)
+                                break;
+                }
+
+                tail = j->current_file->current_offset;
+
+                r = pattern_match_entry(j, md, highlight);
+                if (r < 0)
+                        return r;
+                if (r == 0)
+                        continue;
+
+                if (n_matches >= GREP_JOB_MATCHES_MAX)
+                        return -E2BIG;
+
+                if (!GREEDY_REALLOC(matches, n_allocated, n_matches + 1))
+                        return -ENOMEM;
+
+                matches[n_matches++] = (GrepMatch) {
+                        .offset = tail,
+                        .highlight = { highlight[0], highlight[1] },
+                };
+        }
+
+        r = loop_write(job->output_fd, &tail, sizeof(tail), false);
+        if (r < 0)
+                return r;
+
+        if (n_matches > 0) {
+                r = loop_write(job->output_fd, matches, n_matches * sizeof(GrepMatch), false);
+                if (r < 0)
+                        return r;
+        }
+
+        return 0;
+}
+
+static int grep_job_start(GrepJob *job, size_t data_threshold) {
+        int r;
+
+        assert(job);
+
+        job->output_fd = memfd_new("journal-grep");
+        if (job->output_fd < 0)
+                return job->output_fd;
+
+        r = safe_fork("(sd-grep)", FORK_RESET_SIGNALS|FORK_DEATHSIG, &job->pid);
+        if (r < 0)
+                return r;
+        if (r == 0) {
+                /* Child */
+                r = grep_job_scan(job, data_threshold);
+                _exit(r < 0 ? EXIT_FAILURE : EXIT_SUCCESS);
+        }
+
+        return 0;
+}
+
+static int grep_job_finish(GrepJob *job) {
+        struct stat st;
+        ssize_t n;
+        size_t size;
+        int r;
+
+        assert(job);
+        assert(job->pid > 0);
+
+        r = wait_for_terminate_and_check(NULL, job->pid, 0);
+        job->pid = 0;
+        if (r < 0)
+                return r;
+        if (r != EXIT_SUCCESS)
+                return -EPROTO;
+
+        if (fstat(job->output_fd, &st) < 0)
+                return -errno;
+
+        if (st.st_size < (off_t) sizeof(job->tail) ||
+            (st.st_size - sizeof(job->tail)) % sizeof(GrepMatch) != 0)
+                return -EBADMSG;
+
+        job->n_matches = (st.st_size - sizeof(job->tail)) / sizeof(GrepMatch);
+        job->matches = new(GrepMatch, job->n_matches);
+        if (!job->matches)
+                return -ENOMEM;
+
+        n = pread(job->output_fd, &job->tail, sizeof(job->tail), 0);
+        if (n < 0)
+                return -errno;
+        if (n != sizeof(job->tail))
+                return -EIO;
+
+        size = job->n_matches * sizeof(GrepMatch);
+        n = pread(job->output_fd, job->matches, size, sizeof(job->tail));
+        if (n < 0)
+                return -errno;
+        if ((size_t) n != size)
+                return -EIO;
+
+        job->output_fd = safe_close(job->output_fd);
+        return 0;
+}
+
+static int grep_jobs_run(sd_journal *j, Hashmap **ret) {
+        _cleanup_(hashmap_freep) Hashmap *jobs = NULL;
+        _cleanup_free_ GrepJob **pending = NULL;
+        size_t n_files, n_started = 0, n_finished = 0, n_jobs, i = 0;
+        Iterator it;
+        JournalFile *f;
+        long cpus;
+        int r;
+
+        assert(j);
+        assert(ret);
+
+        /* Matching the pattern against every message is what takes the time when grepping through many files,
+         * hence do that for each file in a child process of its own, as many at a time as we have CPUs, and
+         * remember which entries matched. Files changing while we look at them and files showing up later are
+         * matched in the main loop as before. */
+
+        cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        n_files = ordered_hashmap_size(j->files);
+        if (cpus <= 1 || n_files <= 1) {
+                *ret = NULL;
+                return 0;
+        }
+
+        n_jobs = MIN(n_files, (size_t) cpus);
+
+        jobs = hashmap_new(&trivial_hash_ops);
+        if (!jobs)
+                return -ENOMEM;
+
+        pending = new(GrepJob*, n_files);
+        if (!pending)
+                return -ENOMEM;
+
+        ORDERED_HASHMAP_FOREACH(f, j->files, it) {
+                pending[i] = new(GrepJob, 1);
+                if (!pending[i]) {
+                        r = -ENOMEM;
+                        goto finish;
+                }
+
+                *pending[i] = (GrepJob) {
+                        .file = f,
+                        .file_id = f->header->file_id,
+                        .output_fd = -1,
+                };
+                i++;
+        }
+
+        while (n_finished < n_files) {
+                while (n_started < n_files && n_started - n_finished < n_jobs) {
+                        r = grep_job_start(pending[n_started], j->data_threshold);
+                        if (r < 0)
+                                goto finish;
+
+                        n_started++;
+                }
+
+                r = grep_job_finish(pending[n_finished]);
+                if (r < 0)
+                        log_debug_errno(r, "Failed to match pattern against %s in child, will do so when showing entries: %m",
+                                        pending[n_finished]->file->path);
+                else {
+                        r = hashmap_put(jobs, pending[n_finished]->file, pending[n_finished]);
+                        if (r < 0)
+                                goto finish;
+
+                        pending[n_finished] = NULL;
+                }
+
+                n_finished++;
+        }
+
+        *ret = TAKE_PTR(jobs);
+        r = 0;
+
+finish:
+        for (i = 0; i < n_files; i++)
+                grep_job_free(pending[i]);
+
+        hashmap_free_with_destructor(jobs, grep_job_free);
+
+        return r;
+}
+
+static int grep_jobs_lookup(Hashmap *jobs, sd_journal *j, size_t highlight[2]) {
+        size_t left = 0, right;
+        uint64_t p;
+        GrepJob *job;
+
+        assert(j);
+        assert(highlight);
+
+        /* Returns > 0 if the current entry was found to match by a child, 0 if it wasn't, and -ENOENT if we
+         * don't know */
+
+        if (!j->current_file)
+                return -ENOENT;
+
+        /* The JournalFile object might have been replaced by one for another file in the meantime */
+        job = hashmap_get(jobs, j->current_file);
+        if (!job || !sd_id128_equal(job->file_id, j->current_file->header->file_id))
+                return -ENOENT;
+
+        p = j->current_file->current_offset;
+        if (p > job->tail)
+                return -ENOENT;
+
+        right = job->n_matches;
+        while (left < right) {
+                size_t m = (left + right) / 2;
+
+                if (job->matches[m].offset < p)
+                        left = m + 1;
+                else
+                        right = m;
+        }
+
+        if (left >= job->n_matches || job->matches[left].offset != p)
+                return 0;
+
+        highlight[0] = job->matches[left].highlight[0];
+        highlight[1] = job->matches[left].highlight[1];
+        return 1;
+}
+#endif
+
 int main(int argc, char *argv[]) {
         bool previous_boot_id_valid = false, first_line = true, ellipsized = false, need_seek = false;
         _cleanup_(sd_journal_closep) sd_journal *j = NULL;
+#if HAVE_PCRE2
+        _cleanup_(pcre2_match_data_freep) pcre2_match_data *md = NULL;
+        Hashmap *grep_jobs = NULL;
+#endif
         sd_id128_t previous_boot_id;
         int n_shown = 0, r, poll_fd = -1;
 
@@ -2491,6 +3057,24 @@ int main(int argc, char *argv[]) {
         if (r == 0)
                 need_seek = true;
 
+#if HAVE_PCRE2
+        if (arg_compiled_pattern) {
+                md = pcre2_match_data_create(1, NULL);
+                if (!md) {
+                        r = log_oom();
+                        goto finish;
+                }
+
+                /* Without further matches we have to look at every entry in the selected time range. That's
+                 * worth doing in parallel, unless we only want the last few entries, or wait for new ones. */
+                if (!arg_follow && arg_lines < 0 && !j->level0) {
+                        r = grep_jobs_run(j, &grep_jobs);
+                        if (r < 0)
+                                log_debug_errno(r, "Failed to match pattern in parallel, ignoring: %m");
+                }
+        }
+#endif
+
         if (!arg_follow)
                 (void) pager_open(arg_pager_flags);
 
@@ -2574,53 +3158,15 @@ int main(int argc, char *argv[]) {
 
 #if HAVE_PCRE2
                         if (arg_compiled_pattern) {
-                                _cleanup_(pcre2_match_data_freep) pcre2_match_data *md = NULL;
-                                const void *message;
-                                size_t len;
-                                PCRE2_SIZE *ovec;
-
-                                md = pcre2_match_data_create(1, NULL);
-                                if (!md)
-                                        return log_oom();
-
-                                r = sd_journal_get_data(j, "MESSAGE", &message, &len);
-                                if (r < 0) {
-                                        if (r == -ENOENT) {
-                                                need_seek = true;
-                                                continue;
-                                        }
-
-                                        log_error_errno(r, "Failed to get MESSAGE field: %m");
+                                r = grep_jobs_lookup(grep_jobs, j, highlight);
+                                if (r == -ENOENT)
+                                        r = pattern_match_entry(j, md, highlight);
+                                if (r < 0)
                                         goto finish;
-                                }
-
-                                assert_se(message = startswith(message, "MESSAGE="));
-
-                                r = pcre2_match(arg_compiled_pattern,
-                                                message,
-                                                len - strlen("MESSAGE="),
-                                                0,      /* start at offset 0 in the subject */
-                                                0,      /* default options */
-                                                md,
-                                                NULL);
-                                if (r == PCRE2_ERROR_NOMATCH) {
+                                if (r == 0) {
                                         need_seek = true;
                                         continue;
                                 }
-                                if (r < 0) {
-                                        unsigned char buf[LINE_MAX];
-                                        int r2;
-
-                                        r2 = pcre2_get_error_message(r, buf, sizeof buf);
-                                        log_error("Pattern matching failed: %s",
-                                                  r2 < 0 ? "unknown error" : (char*) buf);
-                                        r = -EINVAL;
-                                        goto finish;
-                                }
-
-                                ovec = pcre2_get_ovector_pointer(md);
-                                highlight[0] = ovec[0];
-                                highlight[1] = ovec[1];
                         }
 #endif
 
@@ -2698,6 +3244,8 @@ finish:
         free(arg_verify_key);
 
 #if HAVE_PCRE2
+        hashmap_free_with_destructor(grep_jobs, grep_job_free);
+
         if (arg_compiled_pattern)
                 pcre2_code_free(arg_compiled_pattern);
 #endif
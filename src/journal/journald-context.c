@@ -1,9 +1,16 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 
+#include <poll.h>
+#include <sys/epoll.h>
+
 #if HAVE_SELINUX
 #include <selinux/selinux.h>
 #endif
 
+#if HAVE_PIDFD_OPEN
+#include <sys/pidfd.h>
+#endif
+
 #include "alloc-util.h"
 #include "audit-util.h"
 #include "cgroup-util.h"
@@ -13,6 +20,7 @@
 #include "io-util.h"
 #include "journal-util.h"
 #include "journald-context.h"
+#include "missing_syscall.h"
 #include "parse-util.h"
 #include "process-util.h"
 #include "string-util.h"
@@ -31,6 +39,13 @@
  * refreshed in an incremental way (meaning: data is reread from /proc, but any old data we can't refresh is not
  * flushed out). Data newer than 1s is used immediately without refresh.
  *
+ * If the kernel supports it, we hold a pidfd for each cached client, and watch it in the event loop. When the client
+ * exits its entry is dropped right away if it isn't pinned, and detached from the PID index otherwise, so that its
+ * data remains available unmodified to whoever pinned it, while a process reusing the PID gets a new entry. As long
+ * as a client with a pidfd didn't exit its PID can't have been reused, hence such entries are not flushed out after
+ * 5s, and the data that normally only changes on execve() (executable, command line, capabilities, audit data) is
+ * only reread every 30s, or when the comm changed, as it does on execve().
+ *
  * Log stream clients (i.e. all clients using the AF_UNIX/SOCK_STREAM stdout/stderr transport) will pin a cache entry
  * as long as their socket is connected. Note that cache entries are shared between different transports. That means a
  * cache entry pinned for the stream connection logic may be reused for the syslog or native protocols.
@@ -56,6 +71,9 @@
 /* Data older than 5s we flush out */
 #define MAX_USEC (5*USEC_PER_SEC)
 
+/* Data that only changes on execve() we refresh every 30s, if we know the PID wasn't reused */
+#define STATIC_REFRESH_USEC (30*USEC_PER_SEC)
+
 /* Keep at most 16K entries in the cache. (Note though that this limit may be violated if enough streams pin entries in
  * the cache, in which case we *do* permit this limit to be breached. That's safe however, as the number of stream
  * clients itself is limited.) */
@@ -72,6 +90,93 @@ static int client_context_compare(const void *a, const void *b) {
         return CMP(x->pid, y->pid);
 }
 
+static bool pidfd_supported = true;
+
+static ClientContext* client_context_free(Server *s, ClientContext *c);
+
+static void client_context_unwatch(ClientContext *c) {
+        assert(c);
+
+        c->pidfd_event_source = sd_event_source_unref(c->pidfd_event_source);
+        c->pidfd = safe_close(c->pidfd);
+}
+
+static int client_context_dispatch_exit(sd_event_source *es, int fd, uint32_t revents, void *userdata) {
+        ClientContext *c = userdata;
+        Server *s;
+
+        assert(c);
+        assert(c->server);
+
+        s = c->server;
+        s->n_client_context_exits++;
+
+        client_context_unwatch(c);
+
+        /* Nobody needs the data anymore, drop it right-away */
+        if (c->n_ref == 0) {
+                client_context_free(s, c);
+                return 0;
+        }
+
+        /* The entry is still pinned, let's keep the data around unmodified until it is released, but make sure a
+         * process that reuses the PID gets an entry of its own. */
+        assert_se(hashmap_remove(s->client_contexts, PID_TO_PTR(c->pid)) == c);
+        c->dead = true;
+
+        return 0;
+}
+
+static int client_context_watch(Server *s, ClientContext *c) {
+        _cleanup_close_ int fd = -1;
+        int r;
+
+        assert(s);
+        assert(c);
+
+        if (!s->event || !pidfd_supported)
+                return 0;
+
+        fd = pidfd_open(c->pid, 0);
+        if (fd < 0) {
+                if (IN_SET(errno, ENOSYS, EPERM)) {
+                        log_debug_errno(errno, "pidfds are not supported, not watching clients for exit: %m");
+                        pidfd_supported = false;
+                        return 0;
+                }
+
+                return -errno;
+        }
+
+        r = sd_event_add_io(s->event, &c->pidfd_event_source, fd, EPOLLIN, client_context_dispatch_exit, c);
+        if (r < 0)
+                return r;
+
+        /* Run after the input sources and the entry queue, so that everything the client logged before exiting is
+         * processed while we still have its entry. */
+        r = sd_event_source_set_priority(c->pidfd_event_source, SD_EVENT_PRIORITY_NORMAL+12);
+        if (r < 0) {
+                c->pidfd_event_source = sd_event_source_unref(c->pidfd_event_source);
+                return r;
+        }
+
+        c->pidfd = TAKE_FD(fd);
+        return 0;
+}
+
+static bool client_context_alive(ClientContext *c) {
+        assert(c);
+
+        /* Returns true if we know for sure the process behind the PID is still the one we cached data for, i.e. we
+         * hold a pidfd for it and it didn't signal the exit yet. The exit event might not have been dispatched yet,
+         * hence check directly. */
+
+        if (c->pidfd < 0)
+                return false;
+
+        return fd_wait_for_event(c->pidfd, POLLIN, 0) == 0;
+}
+
 static int client_context_new(Server *s, pid_t pid, ClientContext **ret) {
         ClientContext *c;
         int r;
@@ -92,7 +197,9 @@ static int client_context_new(Server *s, pid_t pid, ClientContext **ret) {
         if (!c)
                 return -ENOMEM;
 
+        c->server = s;
         c->pid = pid;
+        c->pidfd = -1;
 
         c->uid = UID_INVALID;
         c->gid = GID_INVALID;
@@ -101,6 +208,7 @@ static int client_context_new(Server *s, pid_t pid, ClientContext **ret) {
         c->owner_uid = UID_INVALID;
         c->lru_index = PRIOQ_IDX_NULL;
         c->timestamp = USEC_INFINITY;
+        c->static_timestamp = USEC_INFINITY;
         c->extra_fields_mtime = NSEC_INFINITY;
         c->log_level_max = -1;
         c->log_rate_limit_interval = s->rate_limit_interval;
@@ -112,6 +220,10 @@ static int client_context_new(Server *s, pid_t pid, ClientContext **ret) {
                 return r;
         }
 
+        r = client_context_watch(s, c);
+        if (r < 0)
+                log_debug_errno(r, "Failed to watch client " PID_FMT " for exit, ignoring: %m", pid);
+
         *ret = c;
         return 0;
 }
@@ -132,6 +244,7 @@ static void client_context_reset(Server *s, ClientContext *c) {
 
         c->auditid = AUDIT_SESSION_INVALID;
         c->loginuid = UID_INVALID;
+        c->static_timestamp = USEC_INFINITY;
 
         c->cgroup = mfree(c->cgroup);
         c->session = mfree(c->session);
@@ -141,6 +254,8 @@ static void client_context_reset(Server *s, ClientContext *c) {
         c->slice = mfree(c->slice);
         c->user_slice = mfree(c->user_slice);
 
+        c->rate_limit_slice = journal_rate_limit_slice_unref(c->rate_limit_slice);
+
         c->invocation_id = SD_ID128_NULL;
 
         c->label = mfree(c->label);
@@ -163,40 +278,60 @@ static ClientContext* client_context_free(Server *s, ClientContext *c) {
         if (!c)
                 return NULL;
 
-        assert_se(hashmap_remove(s->client_contexts, PID_TO_PTR(c->pid)) == c);
+        if (!c->dead)
+                assert_se(hashmap_remove(s->client_contexts, PID_TO_PTR(c->pid)) == c);
 
         if (c->in_lru)
                 assert_se(prioq_remove(s->client_contexts_lru, c, &c->lru_index) >= 0);
 
+        client_context_unwatch(c);
         client_context_reset(s, c);
 
         return mfree(c);
 }
 
 static void client_context_read_uid_gid(ClientContext *c, const struct ucred *ucred) {
+        bool have_uid, have_gid;
+
         assert(c);
         assert(pid_is_valid(c->pid));
 
         /* The ucred data passed in is always the most current and accurate, if we have any. Use it. */
-        if (ucred && uid_is_valid(ucred->uid))
+        have_uid = ucred && uid_is_valid(ucred->uid);
+        if (have_uid)
                 c->uid = ucred->uid;
-        else
-                (void) get_process_uid(c->pid, &c->uid);
 
-        if (ucred && gid_is_valid(ucred->gid))
+        have_gid = ucred && gid_is_valid(ucred->gid);
+        if (have_gid)
                 c->gid = ucred->gid;
-        else
-                (void) get_process_gid(c->pid, &c->gid);
+
+        /* Read whatever is missing from /proc in one go */
+        if (!have_uid || !have_gid)
+                (void) get_process_status(c->pid,
+                                          have_uid ? NULL : &c->uid,
+                                          have_gid ? NULL : &c->gid,
+                                          NULL);
 }
 
-static void client_context_read_basic(ClientContext *c) {
+static void client_context_read_basic(ClientContext *c, usec_t timestamp) {
+        bool comm_changed = false;
         char *t;
 
         assert(c);
         assert(pid_is_valid(c->pid));
 
-        if (get_process_comm(c->pid, &t) >= 0)
+        if (get_process_comm(c->pid, &t) >= 0) {
+                comm_changed = !streq_ptr(c->comm, t);
                 free_and_replace(c->comm, t);
+        }
+
+        /* The rest normally only changes on execve(), which also changes the comm. If we know the PID wasn't reused,
+         * let's skip rereading it for a while hence. */
+        if (!comm_changed &&
+            c->static_timestamp != USEC_INFINITY &&
+            c->static_timestamp + STATIC_REFRESH_USEC >= timestamp &&
+            client_context_alive(c))
+                return;
 
         if (get_process_exe(c->pid, &t) >= 0)
                 free_and_replace(c->exe, t);
@@ -206,6 +341,11 @@ static void client_context_read_basic(ClientContext *c) {
 
         if (get_process_capeff(c->pid, &t) >= 0)
                 free_and_replace(c->capeff, t);
+
+        (void) audit_session_from_pid(c->pid, &c->auditid);
+        (void) audit_loginuid_from_pid(c->pid, &c->loginuid);
+
+        c->static_timestamp = timestamp;
 }
 
 static int client_context_read_label(
@@ -287,6 +427,11 @@ static int client_context_read_cgroup(Server *s, ClientContext *c, const char *u
         (void) cg_path_get_slice(c->cgroup, &t);
         free_and_replace(c->slice, t);
 
+        /* Resolve the slice's rate limit budget here, so that nothing needs to be looked up per message */
+        c->rate_limit_slice = journal_rate_limit_slice_unref(c->rate_limit_slice);
+        if (c->slice && s->slice_rate_limit_interval > 0 && s->slice_rate_limit_burst > 0)
+                (void) journal_rate_limit_slice_acquire(s->rate_limit, c->slice, &c->rate_limit_slice);
+
         (void) cg_path_get_user_slice(c->cgroup, &t);
         free_and_replace(c->user_slice, t);
 
@@ -483,12 +628,9 @@ static void client_context_really_refresh(
                 timestamp = now(CLOCK_MONOTONIC);
 
         client_context_read_uid_gid(c, ucred);
-        client_context_read_basic(c);
+        client_context_read_basic(c, timestamp);
         (void) client_context_read_label(c, label, label_size);
 
-        (void) audit_session_from_pid(c->pid, &c->auditid);
-        (void) audit_loginuid_from_pid(c->pid, &c->loginuid);
-
         (void) client_context_read_cgroup(s, c, unit_id);
         (void) client_context_read_invocation_id(s, c);
         (void) client_context_read_log_level_max(s, c);
@@ -515,6 +657,12 @@ void client_context_maybe_refresh(
         assert(s);
         assert(c);
 
+        /* The process exited, the data we have is final, and the PID might already belong to somebody else */
+        if (c->dead) {
+                s->n_client_context_hits++;
+                return;
+        }
+
         if (timestamp == USEC_INFINITY)
                 timestamp = now(CLOCK_MONOTONIC);
 
@@ -523,8 +671,9 @@ void client_context_maybe_refresh(
                 goto refresh;
 
         /* If the data isn't pinned and if the cashed data is older than the upper limit, we flush it out
-         * entirely. This follows the logic that as long as an entry is pinned the PID reuse is unlikely. */
-        if (c->n_ref == 0 && c->timestamp + MAX_USEC < timestamp) {
+         * entirely. This follows the logic that as long as an entry is pinned the PID reuse is unlikely. If we have
+         * a pidfd we know for sure whether the PID was reused, and don't need to do that. */
+        if (c->n_ref == 0 && c->timestamp + MAX_USEC < timestamp && !client_context_alive(c)) {
                 client_context_reset(s, c);
                 goto refresh;
         }
@@ -543,9 +692,11 @@ void client_context_maybe_refresh(
         if (label_size > 0 && (label_size != c->label_size || memcmp(label, c->label, label_size) != 0))
                 goto refresh;
 
+        s->n_client_context_hits++;
         return;
 
 refresh:
+        s->n_client_context_refreshes++;
         client_context_really_refresh(s, c, ucred, label, label_size, unit_id, timestamp);
 }
 
@@ -589,6 +740,33 @@ void client_context_flush_all(Server *s) {
         s->client_contexts = hashmap_free(s->client_contexts);
 }
 
+void client_context_trim(Server *s, MemoryPressureLevel level) {
+        assert(s);
+
+        /* While memory is short, keep only a fraction of the usual number of entries around. Entries pinned by
+         * streams stay in any case. */
+
+        switch (level) {
+
+        case MEMORY_PRESSURE_NONE:
+                s->client_contexts_limit_shift = 0;
+                return;
+
+        case MEMORY_PRESSURE_SOME:
+                s->client_contexts_limit_shift = 4;
+                break;
+
+        case MEMORY_PRESSURE_FULL:
+                s->client_contexts_limit_shift = 8;
+                break;
+
+        default:
+                assert_not_reached("Unknown memory pressure level");
+        }
+
+        client_context_try_shrink_to(s, CACHE_MAX >> s->client_contexts_limit_shift);
+}
+
 static int client_context_get_internal(
                 Server *s,
                 pid_t pid,
@@ -627,7 +805,9 @@ static int client_context_get_internal(
                 return 0;
         }
 
-        client_context_try_shrink_to(s, CACHE_MAX-1);
+        s->n_client_context_misses++;
+
+        client_context_try_shrink_to(s, (CACHE_MAX >> s->client_contexts_limit_shift) - 1);
 
         r = client_context_new(s, pid, &c);
         if (r < 0)
@@ -686,6 +866,12 @@ ClientContext *client_context_release(Server *s, ClientContext *c) {
         if (c->n_ref > 0)
                 return NULL;
 
+        /* The process is gone already, and the entry can't be looked up anymore */
+        if (c->dead) {
+                client_context_free(s, c);
+                return NULL;
+        }
+
         /* The entry is not pinned anymore, let's add it to the LRU prioq if we can. If we can't we'll drop it
          * right-away */
 
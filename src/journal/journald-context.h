@@ -4,18 +4,30 @@
 #include <inttypes.h>
 #include <sys/types.h>
 
+#include "sd-event.h"
 #include "sd-id128.h"
 
 typedef struct ClientContext ClientContext;
 
+#include "journald-rate-limit.h"
 #include "journald-server.h"
+#include "memory-pressure.h"
 
 struct ClientContext {
+        Server *server;
+
         unsigned n_ref;
         unsigned lru_index;
         usec_t timestamp;
         bool in_lru;
 
+        /* If the kernel supports it we hold a pidfd for the client, so that we notice when it exits, and know that
+         * the PID was not reused as long as it didn't. Once the process is gone the entry is detached from the PID
+         * index, and its data is considered final. */
+        int pidfd;
+        sd_event_source *pidfd_event_source;
+        bool dead;
+
         pid_t pid;
         uid_t uid;
         gid_t gid;
@@ -28,6 +40,8 @@ struct ClientContext {
         uint32_t auditid;
         uid_t loginuid;
 
+        usec_t static_timestamp; /* when exe/cmdline/capeff/audit data was last read */
+
         char *cgroup;
         char *session;
         uid_t owner_uid;
@@ -38,6 +52,8 @@ struct ClientContext {
         char *slice;
         char *user_slice;
 
+        JournalRateLimitSlice *rate_limit_slice;
+
         sd_id128_t invocation_id;
 
         char *label;
@@ -82,6 +98,7 @@ void client_context_maybe_refresh(
 
 void client_context_acquire_default(Server *s);
 void client_context_flush_all(Server *s);
+void client_context_trim(Server *s, MemoryPressureLevel level);
 
 static inline size_t client_context_extra_fields_n_iovec(const ClientContext *c) {
         return c ? c->extra_fields_n_iovec : 0;
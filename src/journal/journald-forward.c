@@ -0,0 +1,402 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+
+#include "alloc-util.h"
+#include "fd-util.h"
+#include "io-util.h"
+#include "journald-forward.h"
+#include "journald-server.h"
+#include "process-util.h"
+#include "socket-util.h"
+#include "string-table.h"
+#include "terminal-util.h"
+
+/* Messages to forward are queued and written out after the current batch of incoming messages has been processed,
+ * so that a slow syslog daemon or console never holds up the ingestion of log data. The queues are bounded, whatever
+ * doesn't fit is dropped and accounted for. */
+
+#define FORWARD_QUEUE_MESSAGES_MAX 4096U
+#define FORWARD_QUEUE_SIZE_MAX (4U*1024U*1024U)
+
+/* Send at most this many datagrams to syslog with a single sendmmsg() call */
+#define FORWARD_SYSLOG_BATCH_MAX 64U
+
+/* Warn once every 30s if we dropped forwarded messages */
+#define WARN_FORWARD_DROPPED_USEC (30 * USEC_PER_SEC)
+
+struct ForwardMessage {
+        size_t size;
+        bool has_ucred;
+        struct ucred ucred;
+        char data[];
+};
+
+static const char* const forward_target_table[_FORWARD_TARGET_MAX] = {
+        [FORWARD_SYSLOG] = "syslog",
+        [FORWARD_KMSG] = "kmsg",
+        [FORWARD_CONSOLE] = "console",
+};
+
+DEFINE_PRIVATE_STRING_TABLE_LOOKUP_TO_STRING(forward_target, ForwardTarget);
+
+static void forward_queue_drop(ForwardQueue *q, size_t n) {
+        size_t i;
+
+        assert(q);
+        assert(n <= q->n_messages);
+
+        /* Removes the first n messages from the queue */
+
+        for (i = 0; i < n; i++) {
+                q->size -= q->messages[i]->size;
+                free(q->messages[i]);
+        }
+
+        memmove(q->messages, q->messages + n, (q->n_messages - n) * sizeof(ForwardMessage*));
+        q->n_messages -= n;
+        q->offset = 0;
+}
+
+static void forward_queue_release_console(ForwardQueue *q) {
+        assert(q);
+
+        q->event_source = sd_event_source_unref(q->event_source);
+        q->fd = safe_close(q->fd);
+}
+
+void server_forward_queues_init(Server *s) {
+        ForwardTarget t;
+
+        assert(s);
+
+        for (t = 0; t < _FORWARD_TARGET_MAX; t++)
+                s->forward_queues[t] = (ForwardQueue) {
+                        .fd = -1,
+                };
+}
+
+void server_forward_queues_done(Server *s) {
+        ForwardTarget t;
+
+        assert(s);
+
+        s->forward_event_source = sd_event_source_unref(s->forward_event_source);
+
+        for (t = 0; t < _FORWARD_TARGET_MAX; t++) {
+                ForwardQueue *q = s->forward_queues + t;
+
+                forward_queue_drop(q, q->n_messages);
+                q->messages = mfree(q->messages);
+                q->n_allocated = 0;
+
+                forward_queue_release_console(q);
+        }
+}
+
+static void forward_syslog_flush(Server *s, ForwardQueue *q) {
+        static const union sockaddr_union sa = {
+                .un.sun_family = AF_UNIX,
+                .un.sun_path = "/run/systemd/journal/syslog",
+        };
+        union {
+                struct cmsghdr cmsghdr;
+                uint8_t buf[CMSG_SPACE(sizeof(struct ucred))];
+        } control[FORWARD_SYSLOG_BATCH_MAX];
+        struct mmsghdr msgs[FORWARD_SYSLOG_BATCH_MAX];
+        struct iovec iovec[FORWARD_SYSLOG_BATCH_MAX];
+        size_t done = 0;
+
+        assert(s);
+        assert(q);
+
+        /* Forward the syslog messages we received via /dev/log to /run/systemd/syslog. Unfortunately we currently
+         * can't set the SO_TIMESTAMP auxiliary data, and hence we don't. */
+
+        while (done < q->n_messages) {
+                size_t i, n;
+                int r;
+
+                n = MIN(q->n_messages - done, FORWARD_SYSLOG_BATCH_MAX);
+
+                for (i = 0; i < n; i++) {
+                        ForwardMessage *m = q->messages[done + i];
+
+                        iovec[i] = IOVEC_MAKE(m->data, m->size);
+                        msgs[i] = (struct mmsghdr) {
+                                .msg_hdr.msg_iov = iovec + i,
+                                .msg_hdr.msg_iovlen = 1,
+                                .msg_hdr.msg_name = (struct sockaddr*) &sa.sa,
+                                .msg_hdr.msg_namelen = SOCKADDR_UN_LEN(sa.un),
+                        };
+
+                        if (m->has_ucred) {
+                                struct cmsghdr *cmsg;
+
+                                zero(control[i]);
+                                msgs[i].msg_hdr.msg_control = control + i;
+                                msgs[i].msg_hdr.msg_controllen = sizeof(control[i]);
+
+                                cmsg = CMSG_FIRSTHDR(&msgs[i].msg_hdr);
+                                cmsg->cmsg_level = SOL_SOCKET;
+                                cmsg->cmsg_type = SCM_CREDENTIALS;
+                                cmsg->cmsg_len = CMSG_LEN(sizeof(struct ucred));
+                                memcpy(CMSG_DATA(cmsg), &m->ucred, sizeof(struct ucred));
+                                msgs[i].msg_hdr.msg_controllen = cmsg->cmsg_len;
+                        }
+                }
+
+                r = sendmmsg(s->syslog_fd, msgs, n, MSG_NOSIGNAL|MSG_DONTWAIT);
+                if (r > 0) {
+                        done += r;
+                        continue;
+                }
+
+                /* The socket is full? I guess the syslog implementation is too slow, and we shouldn't wait for
+                 * that... */
+                if (errno == EAGAIN) {
+                        s->n_forward_syslog_missed += q->n_messages - done;
+                        break;
+                }
+
+                if (IN_SET(errno, ESRCH, EPERM) &&
+                    q->messages[done]->has_ucred &&
+                    q->messages[done]->ucred.pid != getpid_cached()) {
+
+                        /* Hmm, presumably the sender process vanished by now, or we don't have CAP_SYS_AMDIN, so
+                         * let's fix it as good as we can, and retry */
+                        q->messages[done]->ucred.pid = getpid_cached();
+                        continue;
+                }
+
+                if (errno != ENOENT)
+                        log_debug_errno(errno, "Failed to forward syslog message: %m");
+
+                /* Skip the message that failed, and try the rest. If syslog is not around at all, don't bother */
+                if (errno == ENOENT || errno == ECONNREFUSED)
+                        break;
+
+                done++;
+        }
+
+        forward_queue_drop(q, q->n_messages);
+}
+
+static void forward_kmsg_flush(Server *s, ForwardQueue *q) {
+        size_t i;
+
+        assert(s);
+        assert(q);
+
+        /* Every write() to /dev/kmsg is turned into one record, hence we can't combine them */
+
+        if (s->dev_kmsg_fd >= 0)
+                for (i = 0; i < q->n_messages; i++)
+                        if (write(s->dev_kmsg_fd, q->messages[i]->data, q->messages[i]->size) < 0)
+                                log_debug_errno(errno, "Failed to write to /dev/kmsg for logging: %m");
+
+        forward_queue_drop(q, q->n_messages);
+}
+
+static void forward_console_flush(Server *s, ForwardQueue *q);
+
+static int dispatch_console_writable(sd_event_source *es, int fd, uint32_t revents, void *userdata) {
+        Server *s = userdata;
+
+        assert(s);
+
+        forward_console_flush(s, s->forward_queues + FORWARD_CONSOLE);
+        return 0;
+}
+
+static void forward_console_flush(Server *s, ForwardQueue *q) {
+        const char *tty;
+        int r;
+
+        assert(s);
+        assert(q);
+
+        tty = s->tty_path ?: "/dev/console";
+
+        /* Before you ask: yes, on purpose we open/close the console whenever we are done writing what is queued. This
+         * is a good strategy to avoid journald getting killed by the kernel's SAK concept (it doesn't fix this
+         * entirely, but minimizes the time window the kernel might end up killing journald due to SAK). It also makes
+         * things easier for us so that we don't have to recover from hangups and suchlike triggered on the
+         * console. We only keep it open while we wait for a slow console to become writable again. */
+
+        if (q->fd < 0) {
+                q->fd = open_terminal(tty, O_WRONLY|O_NOCTTY|O_CLOEXEC|O_NONBLOCK);
+                if (q->fd < 0) {
+                        log_debug_errno(q->fd, "Failed to open %s for logging: %m", tty);
+                        goto drop;
+                }
+        }
+
+        while (q->n_messages > 0) {
+                struct iovec iovec[MIN(IOV_MAX, 1024)];
+                size_t i, n;
+                ssize_t l;
+
+                n = MIN(q->n_messages, ELEMENTSOF(iovec));
+                for (i = 0; i < n; i++)
+                        iovec[i] = IOVEC_MAKE(q->messages[i]->data, q->messages[i]->size);
+
+                iovec[0].iov_base = (uint8_t*) iovec[0].iov_base + q->offset;
+                iovec[0].iov_len -= q->offset;
+
+                l = writev(q->fd, iovec, n);
+                if (l < 0) {
+                        if (errno == EINTR)
+                                continue;
+                        if (errno == EAGAIN)
+                                break;
+
+                        log_debug_errno(errno, "Failed to write to %s for logging: %m", tty);
+                        goto drop;
+                }
+
+                /* Drop what was written completely, and remember how far we got with the rest */
+                for (i = 0; i < n && (size_t) l >= iovec[i].iov_len; i++)
+                        l -= iovec[i].iov_len;
+
+                if (i > 0)
+                        forward_queue_drop(q, i);
+                q->offset += l;
+        }
+
+        if (q->n_messages == 0) {
+                forward_queue_release_console(q);
+                return;
+        }
+
+        /* The console is slow, let's continue when it's ready to take more */
+        if (!q->event_source) {
+                r = sd_event_add_io(s->event, &q->event_source, q->fd, EPOLLOUT, dispatch_console_writable, s);
+                if (r < 0) {
+                        log_debug_errno(r, "Failed to watch %s for writability: %m", tty);
+                        goto drop;
+                }
+
+                (void) sd_event_source_set_priority(q->event_source, SD_EVENT_PRIORITY_NORMAL+10);
+        }
+
+        return;
+
+drop:
+        forward_queue_drop(q, q->n_messages);
+        forward_queue_release_console(q);
+}
+
+void server_forward_queues_flush(Server *s) {
+        assert(s);
+
+        if (s->forward_queues[FORWARD_SYSLOG].n_messages > 0)
+                forward_syslog_flush(s, s->forward_queues + FORWARD_SYSLOG);
+
+        if (s->forward_queues[FORWARD_KMSG].n_messages > 0)
+                forward_kmsg_flush(s, s->forward_queues + FORWARD_KMSG);
+
+        /* If we are waiting for the console already, it'll continue once it is ready */
+        if (s->forward_queues[FORWARD_CONSOLE].n_messages > 0 && !s->forward_queues[FORWARD_CONSOLE].event_source)
+                forward_console_flush(s, s->forward_queues + FORWARD_CONSOLE);
+}
+
+static int dispatch_forward_queues(sd_event_source *es, void *userdata) {
+        Server *s = userdata;
+
+        assert(s);
+
+        server_forward_queues_flush(s);
+        return 0;
+}
+
+int server_forward_queue_push(Server *s, ForwardTarget t, const struct iovec *iovec, size_t n_iovec, const struct ucred *ucred) {
+        ForwardQueue *q;
+        ForwardMessage *m;
+        size_t size, i;
+        uint8_t *p;
+        int r;
+
+        assert(s);
+        assert(t >= 0 && t < _FORWARD_TARGET_MAX);
+        assert(iovec || n_iovec == 0);
+
+        q = s->forward_queues + t;
+
+        size = IOVEC_TOTAL_SIZE(iovec, n_iovec);
+
+        if (q->n_messages >= FORWARD_QUEUE_MESSAGES_MAX || q->size + size > FORWARD_QUEUE_SIZE_MAX) {
+                if (t == FORWARD_SYSLOG)
+                        s->n_forward_syslog_missed++;
+                else
+                        q->n_dropped++;
+
+                return 0;
+        }
+
+        if (!s->forward_event_source) {
+                r = sd_event_add_defer(s->event, &s->forward_event_source, dispatch_forward_queues, s);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to add forward event source: %m");
+
+                /* Run after the entries are written to the journal */
+                r = sd_event_source_set_priority(s->forward_event_source, SD_EVENT_PRIORITY_NORMAL+11);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to adjust forward event source priority: %m");
+        }
+
+        if (!GREEDY_REALLOC(q->messages, q->n_allocated, q->n_messages + 1))
+                return log_oom();
+
+        m = malloc(offsetof(ForwardMessage, data) + size);
+        if (!m)
+                return log_oom();
+
+        m->size = size;
+        m->has_ucred = !!ucred;
+        if (ucred)
+                m->ucred = *ucred;
+
+        for (p = (uint8_t*) m->data, i = 0; i < n_iovec; i++)
+                p = mempcpy(p, iovec[i].iov_base, iovec[i].iov_len);
+
+        r = sd_event_source_set_enabled(s->forward_event_source, SD_EVENT_ONESHOT);
+        if (r < 0) {
+                free(m);
+                return log_error_errno(r, "Failed to enable forward event source: %m");
+        }
+
+        q->messages[q->n_messages++] = m;
+        q->size += size;
+
+        return 1;
+}
+
+void server_maybe_warn_forward_dropped(Server *s) {
+        ForwardTarget t;
+        usec_t n;
+
+        assert(s);
+
+        n = now(CLOCK_MONOTONIC);
+        if (s->last_warn_forward_dropped + WARN_FORWARD_DROPPED_USEC > n)
+                return;
+
+        for (t = 0; t < _FORWARD_TARGET_MAX; t++) {
+                ForwardQueue *q = s->forward_queues + t;
+
+                if (q->n_dropped <= 0)
+                        continue;
+
+                server_driver_message(s, 0, NULL,
+                                      LOG_MESSAGE("Forwarding to %s dropped %"PRIu64" messages.",
+                                                  forward_target_to_string(t), q->n_dropped),
+                                      NULL);
+
+                q->n_dropped = 0;
+                s->last_warn_forward_dropped = n;
+        }
+}
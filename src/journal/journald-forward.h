@@ -0,0 +1,41 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+#pragma once
+
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include "sd-event.h"
+
+typedef struct ForwardMessage ForwardMessage;
+typedef struct ForwardQueue ForwardQueue;
+
+typedef enum ForwardTarget {
+        FORWARD_SYSLOG,
+        FORWARD_KMSG,
+        FORWARD_CONSOLE,
+        _FORWARD_TARGET_MAX,
+} ForwardTarget;
+
+struct ForwardQueue {
+        ForwardMessage **messages;
+        size_t n_messages, n_allocated;
+        size_t size;
+
+        /* Console only: how much of the first message was written already, and the terminal we keep open while we
+         * wait for it to become writable again */
+        size_t offset;
+        int fd;
+        sd_event_source *event_source;
+
+        uint64_t n_dropped; /* since the last warning */
+};
+
+#include "journald-server.h"
+
+void server_forward_queues_init(Server *s);
+void server_forward_queues_done(Server *s);
+
+int server_forward_queue_push(Server *s, ForwardTarget t, const struct iovec *iovec, size_t n_iovec, const struct ucred *ucred);
+void server_forward_queues_flush(Server *s);
+
+void server_maybe_warn_forward_dropped(Server *s);
@@ -15,6 +15,7 @@
 #include "fd-util.h"
 #include "format-util.h"
 #include "io-util.h"
+#include "journald-forward.h"
 #include "journald-kmsg.h"
 #include "journald-server.h"
 #include "journald-syslog.h"
@@ -22,6 +23,154 @@
 #include "process-util.h"
 #include "stdio-util.h"
 #include "string-util.h"
+#include "strv.h"
+
+/* Read at most this many records from /dev/kmsg per event loop iteration, and for at most this long, so that
+ * a kernel log storm is drained quickly without starving everything else */
+#define KMSG_DRAIN_MAX 1024U
+#define KMSG_DRAIN_USEC (50*USEC_PER_MSEC)
+
+/* The udev metadata we attach to kernel messages about a device is cached for this long, and for at most this many
+ * devices at a time */
+#define KMSG_DEVICE_CACHE_USEC (10*USEC_PER_SEC)
+#define KMSG_DEVICES_MAX 256U
+
+typedef struct KmsgDevice {
+        char *id;
+        char **fields; /* _UDEV_DEVNODE=, _UDEV_SYSNAME=, _UDEV_DEVLINK=, empty if the device is not known to udev */
+        usec_t timestamp;
+} KmsgDevice;
+
+static KmsgDevice* kmsg_device_free(KmsgDevice *d) {
+        if (!d)
+                return NULL;
+
+        free(d->id);
+        strv_free(d->fields);
+        return mfree(d);
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(KmsgDevice*, kmsg_device_free);
+
+void server_flush_kmsg_devices(Server *s) {
+        assert(s);
+
+        s->kmsg_devices = hashmap_free_with_destructor(s->kmsg_devices, kmsg_device_free);
+}
+
+static int kmsg_device_read(const char *id, char ***ret) {
+        _cleanup_(sd_device_unrefp) sd_device *d = NULL;
+        _cleanup_strv_free_ char **l = NULL;
+        const char *g;
+        size_t j = 0;
+
+        assert(id);
+        assert(ret);
+
+        if (sd_device_new_from_device_id(&d, id) < 0) {
+                /* Remember that we don't know anything about this one either */
+                l = strv_new(NULL, NULL);
+                if (!l)
+                        return -ENOMEM;
+
+                *ret = TAKE_PTR(l);
+                return 0;
+        }
+
+        if (sd_device_get_devname(d, &g) >= 0) {
+                char *b;
+
+                b = strappend("_UDEV_DEVNODE=", g);
+                if (!b || strv_consume(&l, b) < 0)
+                        return -ENOMEM;
+        }
+
+        if (sd_device_get_sysname(d, &g) >= 0) {
+                char *b;
+
+                b = strappend("_UDEV_SYSNAME=", g);
+                if (!b || strv_consume(&l, b) < 0)
+                        return -ENOMEM;
+        }
+
+        FOREACH_DEVICE_DEVLINK(d, g) {
+                char *b;
+
+                if (j >= N_IOVEC_UDEV_FIELDS)
+                        break;
+
+                b = strappend("_UDEV_DEVLINK=", g);
+                if (!b || strv_consume(&l, b) < 0)
+                        return -ENOMEM;
+
+                j++;
+        }
+
+        if (!l) {
+                l = strv_new(NULL, NULL);
+                if (!l)
+                        return -ENOMEM;
+        }
+
+        *ret = TAKE_PTR(l);
+        return 0;
+}
+
+static char** kmsg_device_get_fields(Server *s, const char *id, usec_t ts) {
+        _cleanup_(kmsg_device_freep) KmsgDevice *d = NULL;
+        KmsgDevice *cached;
+        int r;
+
+        assert(s);
+        assert(id);
+
+        /* Looking up a device in the udev database means a couple of file system accesses, which we don't want to
+         * repeat for every message, as drivers tend to log in bursts. */
+
+        cached = hashmap_get(s->kmsg_devices, id);
+        if (cached && cached->timestamp + KMSG_DEVICE_CACHE_USEC > ts)
+                return cached->fields;
+
+        if (cached) {
+                char **l;
+
+                r = kmsg_device_read(id, &l);
+                if (r < 0)
+                        return NULL;
+
+                strv_free_and_replace(cached->fields, l);
+                cached->timestamp = ts;
+                return cached->fields;
+        }
+
+        /* Keep this simple, and start over if there are too many devices logging */
+        if (hashmap_size(s->kmsg_devices) >= KMSG_DEVICES_MAX)
+                server_flush_kmsg_devices(s);
+
+        r = hashmap_ensure_allocated(&s->kmsg_devices, &string_hash_ops);
+        if (r < 0)
+                return NULL;
+
+        d = new0(KmsgDevice, 1);
+        if (!d)
+                return NULL;
+
+        d->id = strdup(id);
+        if (!d->id)
+                return NULL;
+
+        r = kmsg_device_read(id, &d->fields);
+        if (r < 0)
+                return NULL;
+
+        d->timestamp = ts;
+
+        r = hashmap_put(s->kmsg_devices, d->id, d);
+        if (r < 0)
+                return NULL;
+
+        return TAKE_PTR(d)->fields;
+}
 
 void server_forward_kmsg(
         Server *s,
@@ -77,8 +226,7 @@ void server_forward_kmsg(
         iovec[n++] = IOVEC_MAKE_STRING(message);
         iovec[n++] = IOVEC_MAKE_STRING("\n");
 
-        if (writev(s->dev_kmsg_fd, iovec, n) < 0)
-                log_debug_errno(errno, "Failed to write to /dev/kmsg for logging: %m");
+        (void) server_forward_queue_push(s, FORWARD_KMSG, iovec, n, NULL);
 }
 
 static bool is_us(const char *identifier, const char *pid) {
@@ -210,43 +358,12 @@ void dev_kmsg_record(Server *s, char *p, size_t l) {
         }
 
         if (kernel_device) {
-                _cleanup_(sd_device_unrefp) sd_device *d = NULL;
-
-                if (sd_device_new_from_device_id(&d, kernel_device) >= 0) {
-                        const char *g;
-                        char *b;
-
-                        if (sd_device_get_devname(d, &g) >= 0) {
-                                b = strappend("_UDEV_DEVNODE=", g);
-                                if (b) {
-                                        iovec[n++] = IOVEC_MAKE_STRING(b);
-                                        z++;
-                                }
-                        }
-
-                        if (sd_device_get_sysname(d, &g) >= 0) {
-                                b = strappend("_UDEV_SYSNAME=", g);
-                                if (b) {
-                                        iovec[n++] = IOVEC_MAKE_STRING(b);
-                                        z++;
-                                }
-                        }
-
-                        j = 0;
-                        FOREACH_DEVICE_DEVLINK(d, g) {
-
-                                if (j >= N_IOVEC_UDEV_FIELDS)
-                                        break;
-
-                                b = strappend("_UDEV_DEVLINK=", g);
-                                if (b) {
-                                        iovec[n++] = IOVEC_MAKE_STRING(b);
-                                        z++;
-                                }
-
-                                j++;
-                        }
-                }
+                char **fields, **i;
+
+                /* These are owned by the cache, hence not counted in z */
+                fields = kmsg_device_get_fields(s, kernel_device, now(CLOCK_MONOTONIC));
+                STRV_FOREACH(i, fields)
+                        iovec[n++] = IOVEC_MAKE_STRING(*i);
         }
 
         if (asprintf(&source_time, "_SOURCE_MONOTONIC_TIMESTAMP=%llu", usec) >= 0)
@@ -312,9 +429,14 @@ static int server_read_dev_kmsg(Server *s) {
                         return 0;
                 }
 
-                if (IN_SET(errno, EAGAIN, EINTR, EPIPE))
+                if (IN_SET(errno, EAGAIN, EINTR))
                         return 0;
 
+                /* The record we were about to read was overwritten, the next read continues with the oldest record
+                 * still around. dev_kmsg_record() notices the gap in the sequence numbers. */
+                if (errno == EPIPE)
+                        return 1;
+
                 return log_error_errno(errno, "Failed to read from kernel: %m");
         }
 
@@ -349,6 +471,9 @@ int server_flush_dev_kmsg(Server *s) {
 
 static int dispatch_dev_kmsg(sd_event_source *es, int fd, uint32_t revents, void *userdata) {
         Server *s = userdata;
+        usec_t deadline;
+        unsigned i;
+        int r;
 
         assert(es);
         assert(fd == s->dev_kmsg_fd);
@@ -360,7 +485,21 @@ static int dispatch_dev_kmsg(sd_event_source *es, int fd, uint32_t revents, void
         if (!(revents & EPOLLIN))
                 log_error("Got invalid event from epoll for /dev/kmsg: %"PRIx32, revents);
 
-        return server_read_dev_kmsg(s);
+        /* Every read() returns exactly one record, hence read as many as we can now, instead of going through the
+         * event loop for each, so that we keep up when the kernel logs a lot. Anything left is picked up in the next
+         * iteration. */
+        deadline = usec_add(now(CLOCK_MONOTONIC), KMSG_DRAIN_USEC);
+
+        for (i = 0; i < KMSG_DRAIN_MAX; i++) {
+                r = server_read_dev_kmsg(s);
+                if (r <= 0)
+                        return r;
+
+                if (now(CLOCK_MONOTONIC) >= deadline)
+                        break;
+        }
+
+        return 0;
 }
 
 int server_open_dev_kmsg(Server *s) {
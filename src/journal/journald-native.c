@@ -1,16 +1,20 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 
+#include <fcntl.h>
 #include <stddef.h>
 #include <sys/epoll.h>
 #include <sys/mman.h>
 #include <sys/statvfs.h>
 #include <unistd.h>
 
+#include "sd-daemon.h"
+
 #include "alloc-util.h"
 #include "fd-util.h"
 #include "fs-util.h"
 #include "io-util.h"
 #include "journal-importer.h"
+#include "journal-ring.h"
 #include "journal-util.h"
 #include "journald-console.h"
 #include "journald-kmsg.h"
@@ -19,6 +23,7 @@
 #include "journald-syslog.h"
 #include "journald-wall.h"
 #include "memfd-util.h"
+#include "missing.h"
 #include "parse-util.h"
 #include "path-util.h"
 #include "process-util.h"
@@ -433,6 +438,365 @@ void server_process_native_file(
         }
 }
 
+/* How many clients may use the shared memory ring transport at the same time */
+#define NATIVE_RINGS_MAX 256U
+
+struct NativeRing {
+        Server *server;
+
+        JournalRingHeader *header;
+        size_t mapped_size;
+        uint64_t size;
+        uint64_t tail;
+
+        int doorbell_fd;
+        sd_event_source *event_source;
+        sd_event_source *defer_event_source;
+
+        /* The credentials are captured once, when the ring is set up */
+        struct ucred ucred;
+        char *label;
+        size_t label_len;
+        ClientContext *context;
+
+        LIST_FIELDS(NativeRing, native_rings);
+};
+
+static NativeRing* native_ring_free(NativeRing *ring) {
+        if (!ring)
+                return NULL;
+
+        if (ring->server) {
+                LIST_REMOVE(native_rings, ring->server->native_rings, ring);
+                assert(ring->server->n_native_rings > 0);
+                ring->server->n_native_rings--;
+
+                client_context_release(ring->server, ring->context);
+        }
+
+        sd_event_source_unref(ring->event_source);
+        sd_event_source_unref(ring->defer_event_source);
+        safe_close(ring->doorbell_fd);
+
+        if (ring->header)
+                (void) munmap(ring->header, ring->mapped_size);
+
+        free(ring->label);
+        return mfree(ring);
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(NativeRing*, native_ring_free);
+
+static int native_ring_drain(NativeRing *ring) {
+        uint64_t budget;
+        Server *s;
+        uint8_t *data;
+        int r;
+
+        assert(ring);
+        assert(ring->server);
+
+        /* Processes whatever the client put into the ring so far. Returns 0 if the ring is empty now, > 0 if we
+         * stopped early to give others a chance, and < 0 if the ring is corrupted. */
+
+        s = ring->server;
+        data = (uint8_t*) ring->header + JOURNAL_RING_DATA_OFFSET;
+
+        if (ring->context)
+                client_context_maybe_refresh(s, ring->context, &ring->ucred, ring->label, ring->label_len, NULL, USEC_INFINITY);
+
+        /* Don't process more than one ring's worth of data in one go */
+        budget = ring->size;
+
+        for (;;) {
+                uint64_t head;
+
+                head = __atomic_load_n(&ring->header->head, __ATOMIC_SEQ_CST);
+                if (head == ring->tail)
+                        return 0;
+
+                if (head - ring->tail > ring->size)
+                        return log_warning_errno(SYNTHETIC_ERRNO(EBADMSG), "Ring of PID " PID_FMT " has invalid head.", ring->ucred.pid);
+
+                while (ring->tail != head) {
+                        JournalRingRecord rec;
+                        uint64_t pos, need;
+
+                        if (budget == 0)
+                                break;
+
+                        pos = ring->tail & (ring->size - 1);
+
+                        if (head - ring->tail < sizeof(rec))
+                                return log_warning_errno(SYNTHETIC_ERRNO(EBADMSG), "Ring of PID " PID_FMT " has truncated record.", ring->ucred.pid);
+
+                        memcpy(&rec, data + pos, sizeof(rec));
+
+                        if (rec.flags & JOURNAL_RING_RECORD_PADDING) {
+                                need = ring->size - pos;
+                                if (need > head - ring->tail)
+                                        return log_warning_errno(SYNTHETIC_ERRNO(EBADMSG), "Ring of PID " PID_FMT " has invalid padding.", ring->ucred.pid);
+
+                                ring->tail += need;
+                                budget = LESS_BY(budget, need);
+                                continue;
+                        }
+
+                        need = JOURNAL_RING_RECORD_SIZE(rec.size);
+                        if (need > ring->size - pos || need > head - ring->tail)
+                                return log_warning_errno(SYNTHETIC_ERRNO(EBADMSG), "Ring of PID " PID_FMT " has oversized record.", ring->ucred.pid);
+
+                        if (rec.size > 0) {
+                                size_t remaining = rec.size;
+
+                                /* The client can write to the ring at any time, hence copy the record out before
+                                 * looking at it */
+                                if (!GREEDY_REALLOC(s->buffer, s->buffer_size, rec.size + 1))
+                                        return log_oom();
+
+                                memcpy(s->buffer, data + pos + sizeof(rec), rec.size);
+                                s->buffer[rec.size] = 0;
+
+                                do {
+                                        r = server_process_entry(s,
+                                                                 (const uint8_t*) s->buffer + (rec.size - remaining), &remaining,
+                                                                 ring->context, &ring->ucred, NULL,
+                                                                 ring->label, ring->label_len);
+                                } while (r == 0);
+                        }
+
+                        ring->tail += need;
+                        budget = LESS_BY(budget, need);
+                }
+
+                /* Make room for the client, and then check again whether it added anything in the meantime. The
+                 * client does the same in reverse, hence we can't both miss each other. */
+                __atomic_store_n(&ring->header->tail, ring->tail, __ATOMIC_SEQ_CST);
+
+                if (budget == 0)
+                        return head != ring->tail || __atomic_load_n(&ring->header->head, __ATOMIC_SEQ_CST) != ring->tail;
+        }
+}
+
+static void native_ring_process(NativeRing *ring, bool hangup) {
+        int r;
+
+        assert(ring);
+
+        r = native_ring_drain(ring);
+        if (r < 0 || hangup) {
+                log_debug("Closing ring of PID " PID_FMT ".", ring->ucred.pid);
+                native_ring_free(ring);
+                return;
+        }
+
+        if (r > 0) {
+                /* There's more, but let's first let others have their turn */
+                r = sd_event_source_set_enabled(ring->defer_event_source, SD_EVENT_ONESHOT);
+                if (r < 0) {
+                        log_warning_errno(r, "Failed to enable ring event source, closing ring of PID " PID_FMT ": %m", ring->ucred.pid);
+                        native_ring_free(ring);
+                }
+        }
+}
+
+static int dispatch_native_ring(sd_event_source *es, int fd, uint32_t revents, void *userdata) {
+        NativeRing *ring = userdata;
+
+        assert(ring);
+        assert(fd == ring->doorbell_fd);
+
+        /* The doorbell messages carry no information, just flush them out */
+        for (;;) {
+                char buf[64];
+                ssize_t l;
+
+                l = recv(fd, buf, sizeof(buf), MSG_DONTWAIT);
+                if (l < 0 && errno == EINTR)
+                        continue;
+                if (l <= 0)
+                        break;
+        }
+
+        native_ring_process(ring, revents & (EPOLLHUP|EPOLLERR));
+        return 0;
+}
+
+static int dispatch_native_ring_defer(sd_event_source *es, void *userdata) {
+        NativeRing *ring = userdata;
+
+        assert(ring);
+
+        native_ring_process(ring, false);
+        return 0;
+}
+
+void server_process_native_ring(
+                Server *s,
+                int memfd,
+                int doorbell_fd,
+                const struct ucred *ucred,
+                const char *label, size_t label_len) {
+
+        _cleanup_(native_ring_freep) NativeRing *ring = NULL;
+        struct stat st;
+        uint64_t size;
+        int seals, r;
+
+        assert(s);
+        assert(memfd >= 0);
+        assert(doorbell_fd >= 0);
+
+        if (!ucred || !pid_is_valid(ucred->pid)) {
+                log_warning("Got journal ring without credentials, ignoring.");
+                return;
+        }
+
+        if (s->n_native_rings >= NATIVE_RINGS_MAX) {
+                log_warning("Too many journal ring clients, refusing ring of PID " PID_FMT ".", ucred->pid);
+                return;
+        }
+
+        /* We map the ring and access it at any time, hence it must not be possible to truncate it under our feet */
+        seals = fcntl(memfd, F_GET_SEALS);
+        if (seals < 0 || (seals & (F_SEAL_SHRINK|F_SEAL_GROW)) != (F_SEAL_SHRINK|F_SEAL_GROW)) {
+                log_warning("Journal ring of PID " PID_FMT " is not a sealed memfd, refusing.", ucred->pid);
+                return;
+        }
+
+        if (fstat(memfd, &st) < 0) {
+                log_warning_errno(errno, "Failed to stat journal ring of PID " PID_FMT ", refusing: %m", ucred->pid);
+                return;
+        }
+
+        if (!S_ISREG(st.st_mode) ||
+            st.st_size < JOURNAL_RING_DATA_OFFSET + JOURNAL_RING_SIZE_MIN ||
+            st.st_size > JOURNAL_RING_DATA_OFFSET + JOURNAL_RING_SIZE_MAX) {
+                log_warning("Journal ring of PID " PID_FMT " has invalid size, refusing.", ucred->pid);
+                return;
+        }
+
+        r = sd_is_socket(doorbell_fd, AF_UNIX, SOCK_SEQPACKET, -1);
+        if (r < 0) {
+                log_warning_errno(r, "Failed to check journal ring doorbell of PID " PID_FMT ", refusing: %m", ucred->pid);
+                return;
+        }
+        if (r == 0) {
+                log_warning_errno(SYNTHETIC_ERRNO(EINVAL), "Journal ring doorbell of PID " PID_FMT " is not a seqpacket socket, refusing.", ucred->pid);
+                return;
+        }
+
+        ring = new0(NativeRing, 1);
+        if (!ring) {
+                log_oom();
+                return;
+        }
+
+        ring->doorbell_fd = -1;
+        ring->mapped_size = st.st_size;
+
+        ring->header = mmap(NULL, ring->mapped_size, PROT_READ|PROT_WRITE, MAP_SHARED, memfd, 0);
+        if (ring->header == MAP_FAILED) {
+                ring->header = NULL;
+                log_warning_errno(errno, "Failed to map journal ring of PID " PID_FMT ", refusing: %m", ucred->pid);
+                return;
+        }
+
+        size = ring->header->size;
+        if (memcmp(ring->header->signature, JOURNAL_RING_SIGNATURE, sizeof(ring->header->signature)) != 0 ||
+            size == 0 || (size & (size - 1)) != 0 ||
+            JOURNAL_RING_DATA_OFFSET + size != (uint64_t) st.st_size) {
+                log_warning("Journal ring of PID " PID_FMT " has invalid header, refusing.", ucred->pid);
+                return;
+        }
+
+        ring->size = size;
+        ring->tail = __atomic_load_n(&ring->header->tail, __ATOMIC_SEQ_CST);
+
+        ring->doorbell_fd = fcntl(doorbell_fd, F_DUPFD_CLOEXEC, 3);
+        if (ring->doorbell_fd < 0) {
+                log_warning_errno(errno, "Failed to duplicate journal ring doorbell fd: %m");
+                return;
+        }
+
+        ring->ucred = *ucred;
+
+        if (label) {
+                ring->label = memdup_suffix0(label, label_len);
+                if (!ring->label) {
+                        log_oom();
+                        return;
+                }
+
+                ring->label_len = label_len;
+        }
+
+        r = client_context_acquire(s, ucred->pid, ucred, ring->label, ring->label_len, NULL, &ring->context);
+        if (r < 0)
+                log_warning_errno(r, "Failed to retrieve credentials for PID " PID_FMT ", ignoring: %m", ucred->pid);
+
+        r = sd_event_add_io(s->event, &ring->event_source, ring->doorbell_fd, EPOLLIN, dispatch_native_ring, ring);
+        if (r < 0) {
+                log_warning_errno(r, "Failed to watch journal ring doorbell: %m");
+                goto fail;
+        }
+
+        r = sd_event_source_set_priority(ring->event_source, SD_EVENT_PRIORITY_NORMAL+5);
+        if (r < 0) {
+                log_warning_errno(r, "Failed to adjust journal ring event source priority: %m");
+                goto fail;
+        }
+
+        r = sd_event_add_defer(s->event, &ring->defer_event_source, dispatch_native_ring_defer, ring);
+        if (r < 0) {
+                log_warning_errno(r, "Failed to allocate journal ring event source: %m");
+                goto fail;
+        }
+
+        r = sd_event_source_set_enabled(ring->defer_event_source, SD_EVENT_OFF);
+        if (r < 0) {
+                log_warning_errno(r, "Failed to disable journal ring event source: %m");
+                goto fail;
+        }
+
+        r = sd_event_source_set_priority(ring->defer_event_source, SD_EVENT_PRIORITY_NORMAL+5);
+        if (r < 0) {
+                log_warning_errno(r, "Failed to adjust journal ring event source priority: %m");
+                goto fail;
+        }
+
+        LIST_PREPEND(native_rings, s->native_rings, ring);
+        s->n_native_rings++;
+        ring->server = s;
+
+        /* Tell the client we are listening */
+        __atomic_or_fetch(&ring->header->flags, JOURNAL_RING_ACCEPTED, __ATOMIC_RELEASE);
+
+        log_debug("Set up journal ring of %" PRIu64 " bytes for PID " PID_FMT ".", size, ucred->pid);
+
+        TAKE_PTR(ring);
+        return;
+
+fail:
+        ring->context = client_context_release(s, ring->context);
+}
+
+void server_close_native_rings(Server *s) {
+        assert(s);
+
+        /* Process whatever is still queued, and close all rings */
+        while (s->native_rings) {
+                NativeRing *ring = s->native_rings;
+                int r;
+
+                do
+                        r = native_ring_drain(ring);
+                while (r > 0);
+
+                native_ring_free(ring);
+        }
+}
+
 int server_open_native_socket(Server*s) {
 
         static const union sockaddr_union sa = {
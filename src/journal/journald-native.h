@@ -20,4 +20,14 @@ void server_process_native_file(
                 const char *label,
                 size_t label_len);
 
+void server_process_native_ring(
+                Server *s,
+                int memfd,
+                int doorbell_fd,
+                const struct ucred *ucred,
+                const char *label,
+                size_t label_len);
+
+void server_close_native_rings(Server *s);
+
 int server_open_native_socket(Server *s);
@@ -8,7 +8,9 @@
 #include "journald-rate-limit.h"
 #include "list.h"
 #include "random-util.h"
+#include "special.h"
 #include "string-util.h"
+#include "unit-name.h"
 #include "util.h"
 
 #define POOLS_MAX 5
@@ -50,6 +52,24 @@ struct JournalRateLimitGroup {
         LIST_FIELDS(JournalRateLimitGroup, lru);
 };
 
+/* Slices get a token bucket each, that is shared by all units in the slice and its child slices. The credit is kept
+ * scaled by the interval, so that refilling it is exact: every microsecond adds burst, every message costs
+ * interval. */
+struct JournalRateLimitSlice {
+        JournalRateLimit *limit;
+        unsigned n_ref;
+
+        char *id;
+        JournalRateLimitSlice *parent;
+
+        uint64_t credit;
+        usec_t last;
+
+        unsigned suppressed; /* since the last report */
+        usec_t reported;
+        uint64_t n_suppressed; /* in total */
+};
+
 struct JournalRateLimit {
 
         JournalRateLimitGroup* buckets[BUCKETS_MAX];
@@ -58,6 +78,8 @@ struct JournalRateLimit {
         unsigned n_groups;
 
         uint8_t hash_key[16];
+
+        Hashmap *slices;
 };
 
 JournalRateLimit *journal_rate_limit_new(void) {
@@ -97,6 +119,10 @@ void journal_rate_limit_free(JournalRateLimit *r) {
         while (r->lru)
                 journal_rate_limit_group_free(r->lru);
 
+        /* Slices are referenced by client contexts, which must have been flushed out already */
+        assert(hashmap_isempty(r->slices));
+        hashmap_free(r->slices);
+
         free(r);
 }
 
@@ -253,3 +279,175 @@ int journal_rate_limit_test(JournalRateLimit *r, const char *id, usec_t rl_inter
         p->suppressed++;
         return 0;
 }
+
+int journal_rate_limit_slice_acquire(JournalRateLimit *r, const char *id, JournalRateLimitSlice **ret) {
+        _cleanup_free_ char *parent_id = NULL;
+        JournalRateLimitSlice *sl, *parent = NULL;
+        int k;
+
+        assert(id);
+        assert(ret);
+
+        /* The root slice contains everything, a budget for it would just be a global rate limit */
+        if (!r || streq(id, SPECIAL_ROOT_SLICE)) {
+                *ret = NULL;
+                return 0;
+        }
+
+        sl = hashmap_get(r->slices, id);
+        if (sl) {
+                sl->n_ref++;
+                *ret = sl;
+                return 1;
+        }
+
+        k = slice_build_parent_slice(id, &parent_id);
+        if (k < 0)
+                return k;
+
+        if (parent_id) {
+                k = journal_rate_limit_slice_acquire(r, parent_id, &parent);
+                if (k < 0)
+                        return k;
+        }
+
+        k = hashmap_ensure_allocated(&r->slices, &string_hash_ops);
+        if (k < 0)
+                goto fail;
+
+        sl = new0(JournalRateLimitSlice, 1);
+        if (!sl) {
+                k = -ENOMEM;
+                goto fail;
+        }
+
+        sl->id = strdup(id);
+        if (!sl->id) {
+                free(sl);
+                k = -ENOMEM;
+                goto fail;
+        }
+
+        k = hashmap_put(r->slices, sl->id, sl);
+        if (k < 0) {
+                free(sl->id);
+                free(sl);
+                goto fail;
+        }
+
+        sl->limit = r;
+        sl->n_ref = 1;
+        sl->parent = parent;
+
+        *ret = sl;
+        return 1;
+
+fail:
+        journal_rate_limit_slice_unref(parent);
+        return k;
+}
+
+JournalRateLimitSlice* journal_rate_limit_slice_unref(JournalRateLimitSlice *sl) {
+        while (sl) {
+                JournalRateLimitSlice *parent;
+
+                assert(sl->n_ref > 0);
+
+                sl->n_ref--;
+                if (sl->n_ref > 0)
+                        break;
+
+                assert_se(hashmap_remove(sl->limit->slices, sl->id) == sl);
+
+                parent = sl->parent;
+                free(sl->id);
+                free(sl);
+
+                sl = parent;
+        }
+
+        return NULL;
+}
+
+const char* journal_rate_limit_slice_id(JournalRateLimitSlice *sl) {
+        assert(sl);
+        return sl->id;
+}
+
+uint64_t journal_rate_limit_slice_suppressed(JournalRateLimitSlice *sl) {
+        assert(sl);
+        return sl->n_suppressed;
+}
+
+int journal_rate_limit_slice_test(
+                JournalRateLimitSlice *sl,
+                usec_t rl_interval,
+                unsigned rl_burst,
+                uint64_t available,
+                usec_t ts,
+                JournalRateLimitSlice **ret_report) {
+
+        JournalRateLimitSlice *i, *blocked = NULL;
+        uint64_t capacity;
+        unsigned burst;
+
+        /* Returns:
+         *
+         * 0     → the log message shall be suppressed,
+         * 1 + n → the log message shall be permitted, and n messages were dropped from the slice returned in
+         *         ret_report before
+         *
+         * Note that this doesn't hash anything, the slice and its parents are resolved once when the client's cgroup
+         * is read. */
+
+        if (ret_report)
+                *ret_report = NULL;
+
+        if (!sl || rl_interval == 0 || rl_burst == 0)
+                return 1;
+
+        burst = burst_modulate(rl_burst, available);
+        capacity = (uint64_t) burst * rl_interval;
+
+        for (i = sl; i; i = i->parent) {
+                if (i->last == 0 || ts < i->last || ts - i->last >= rl_interval)
+                        i->credit = capacity;
+                else
+                        i->credit = MIN(capacity, i->credit + (ts - i->last) * burst);
+
+                i->last = ts;
+
+                if (!blocked && i->credit < rl_interval)
+                        blocked = i;
+        }
+
+        if (blocked) {
+                if (blocked->suppressed == 0)
+                        blocked->reported = ts;
+
+                blocked->suppressed++;
+                blocked->n_suppressed++;
+                return 0;
+        }
+
+        for (i = sl; i; i = i->parent)
+                i->credit -= rl_interval;
+
+        /* Report suppressed messages at most once per interval and slice, so that a slice that is continuously over
+         * its budget doesn't result in a report for every message that makes it through. */
+        for (i = sl; i; i = i->parent)
+                if (i->suppressed > 0 && i->reported + rl_interval <= ts) {
+                        unsigned n;
+
+                        n = i->suppressed;
+                        i->suppressed = 0;
+                        i->reported = ts;
+
+                        if (ret_report)
+                                *ret_report = i;
+
+                        return 1 + n;
+                }
+
+        return 1;
+}
@@ -4,7 +4,14 @@
 #include "util.h"
 
 typedef struct JournalRateLimit JournalRateLimit;
+typedef struct JournalRateLimitSlice JournalRateLimitSlice;
 
 JournalRateLimit *journal_rate_limit_new(void);
 void journal_rate_limit_free(JournalRateLimit *r);
 int journal_rate_limit_test(JournalRateLimit *r, const char *id, usec_t rl_interval, unsigned rl_burst, int priority, uint64_t available);
+
+int journal_rate_limit_slice_acquire(JournalRateLimit *r, const char *id, JournalRateLimitSlice **ret);
+JournalRateLimitSlice* journal_rate_limit_slice_unref(JournalRateLimitSlice *sl);
+const char* journal_rate_limit_slice_id(JournalRateLimitSlice *sl);
+uint64_t journal_rate_limit_slice_suppressed(JournalRateLimitSlice *sl);
+int journal_rate_limit_slice_test(JournalRateLimitSlice *sl, usec_t rl_interval, unsigned rl_burst, uint64_t available, usec_t ts, JournalRateLimitSlice **ret_report);
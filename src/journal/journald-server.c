@@ -54,10 +54,15 @@
 #include "string-table.h"
 #include "string-util.h"
 #include "syslog-util.h"
+#include "usdt.h"
 #include "user-util.h"
 
 #define USER_JOURNALS_MAX 1024
 
+/* How many (and how many bytes of) received entries to collect at most before writing them out */
+#define PENDING_ENTRIES_MAX 1024U
+#define PENDING_SIZE_MAX (8U*1024U*1024U)
+
 #define DEFAULT_SYNC_INTERVAL_USEC (5*USEC_PER_MINUTE)
 #define DEFAULT_RATE_LIMIT_INTERVAL (30*USEC_PER_SEC)
 #define DEFAULT_RATE_LIMIT_BURST 10000
@@ -76,40 +81,48 @@
 
 #define DEFERRED_CLOSES_MAX (4096)
 
-static int determine_path_usage(Server *s, const char *path, uint64_t *ret_used, uint64_t *ret_free) {
-        _cleanup_closedir_ DIR *d = NULL;
-        struct dirent *de;
-        struct statvfs ss;
+/* How many datagrams to read from the native and syslog sockets with a single recvmmsg() call by default, and at
+ * most. Each slot gets a buffer large enough for the biggest datagram an unprivileged client can send with the default
+ * socket buffer sizes. */
+#define DEFAULT_DATAGRAM_BATCH_SIZE 16U
+#define DATAGRAM_BATCH_SIZE_MAX 128U
+#define DATAGRAM_BATCH_SLOT_SIZE ((size_t) (256U*1024U))
 
-        assert(ret_used);
-        assert(ret_free);
+static int storage_vacuum_index(JournalStorage *storage, JournalVacuumIndex **ret) {
+        int r;
 
-        d = opendir(path);
-        if (!d)
-                return log_full_errno(errno == ENOENT ? LOG_DEBUG : LOG_ERR,
-                                      errno, "Failed to open %s: %m", path);
+        assert(storage);
+        assert(ret);
 
-        if (fstatvfs(dirfd(d), &ss) < 0)
-                return log_error_errno(errno, "Failed to fstatvfs(%s): %m", path);
+        if (!storage->vacuum_index) {
+                r = journal_vacuum_index_new(storage->path, true, &storage->vacuum_index);
+                if (r < 0)
+                        return log_full_errno(r == -ENOENT ? LOG_DEBUG : LOG_ERR,
+                                              r, "Failed to open %s: %m", storage->path);
+        }
 
-        *ret_free = ss.f_bsize * ss.f_bavail;
-        *ret_used = 0;
-        FOREACH_DIRENT_ALL(de, d, break) {
-                struct stat st;
+        *ret = storage->vacuum_index;
+        return 0;
+}
 
-                if (!endswith(de->d_name, ".journal") &&
-                    !endswith(de->d_name, ".journal~"))
-                        continue;
+static int determine_path_usage(Server *s, JournalStorage *storage, uint64_t *ret_used, uint64_t *ret_free) {
+        JournalVacuumIndex *i;
+        int r;
 
-                if (fstatat(dirfd(d), de->d_name, &st, AT_SYMLINK_NOFOLLOW) < 0) {
-                        log_debug_errno(errno, "Failed to stat %s/%s, ignoring: %m", path, de->d_name);
-                        continue;
-                }
+        assert(storage);
+        assert(ret_used);
+        assert(ret_free);
 
-                if (!S_ISREG(st.st_mode))
-                        continue;
+        r = storage_vacuum_index(storage, &i);
+        if (r < 0)
+                return r;
 
-                *ret_used += (uint64_t) st.st_blocks * 512UL;
+        r = journal_vacuum_index_usage(i, ret_used, ret_free);
+        if (r < 0) {
+                /* Maybe the directory was removed or replaced? Then start from scratch next time. */
+                storage->vacuum_index = journal_vacuum_index_free(storage->vacuum_index);
+                return log_full_errno(IN_SET(r, -ENOENT, -ESTALE) ? LOG_DEBUG : LOG_ERR,
+                                      r, "Failed to determine disk usage of %s: %m", storage->path);
         }
 
         return 0;
@@ -136,7 +149,7 @@ static int cache_space_refresh(Server *s, JournalStorage *storage) {
         if (space->timestamp != 0 && space->timestamp + RECHECK_SPACE_USEC > ts)
                 return 0;
 
-        r = determine_path_usage(s, storage->path, &vfs_used, &vfs_avail);
+        r = determine_path_usage(s, storage, &vfs_used, &vfs_avail);
         if (r < 0)
                 return r;
 
@@ -220,6 +233,11 @@ void server_space_usage_message(Server *s, JournalStorage *storage) {
                               "LIMIT_PRETTY=%s", fb5,
                               "AVAILABLE=%"PRIu64, storage->space.available,
                               "AVAILABLE_PRETTY=%s", fb6,
+                              "CLIENT_CONTEXTS=%u", hashmap_size(s->client_contexts),
+                              "CLIENT_CONTEXT_HITS=%"PRIu64, s->n_client_context_hits,
+                              "CLIENT_CONTEXT_MISSES=%"PRIu64, s->n_client_context_misses,
+                              "CLIENT_CONTEXT_REFRESHES=%"PRIu64, s->n_client_context_refreshes,
+                              "CLIENT_CONTEXT_EXITS=%"PRIu64, s->n_client_context_exits,
                               NULL);
 }
 
@@ -536,6 +554,8 @@ void server_rotate(Server *s) {
 
         log_debug("Rotating...");
 
+        server_commit_pending_entries(s);
+
         /* First, rotate the system journal (either in its runtime flavour or in its runtime flavour) */
         (void) do_rotate(s, &s->runtime_journal, "runtime", false, 0);
         (void) do_rotate(s, &s->system_journal, "system", s->seal, 0);
@@ -645,6 +665,8 @@ void server_sync(Server *s) {
         Iterator i;
         int r;
 
+        server_commit_pending_entries(s);
+
         if (s->system_journal) {
                 r = journal_file_set_offline(s->system_journal, false);
                 if (r < 0)
@@ -667,7 +689,7 @@ void server_sync(Server *s) {
 }
 
 static void do_vacuum(Server *s, JournalStorage *storage, bool verbose) {
-
+        JournalVacuumIndex *i;
         int r;
 
         assert(s);
@@ -678,10 +700,15 @@ static void do_vacuum(Server *s, JournalStorage *storage, bool verbose) {
         if (verbose)
                 server_space_usage_message(s, storage);
 
-        r = journal_directory_vacuum(storage->path, storage->space.limit,
-                                     storage->metrics.n_max_files, s->max_retention_usec,
-                                     &s->oldest_file_usec, verbose);
-        if (r < 0 && r != -ENOENT)
+        r = storage_vacuum_index(storage, &i);
+        if (r >= 0) {
+                r = journal_vacuum_index_vacuum(i, storage->space.limit,
+                                                storage->metrics.n_max_files, s->max_retention_usec,
+                                                &s->oldest_file_usec, verbose);
+                if (r < 0)
+                        storage->vacuum_index = journal_vacuum_index_free(storage->vacuum_index);
+        }
+        if (r < 0 && !IN_SET(r, -ENOENT, -ESTALE))
                 log_warning_errno(r, "Failed to vacuum %s, ignoring: %m", storage->path);
 
         cache_space_invalidate(&storage->space);
@@ -791,23 +818,18 @@ static bool shall_try_append_again(JournalFile *f, int r) {
         }
 }
 
-static void write_to_journal(Server *s, uid_t uid, struct iovec *iovec, size_t n, int priority) {
+static void write_entries_to_journal(Server *s, uid_t uid, const JournalFileEntry *entries, size_t n, int priority) {
         bool vacuumed = false, rotate = false;
-        struct dual_timestamp ts;
-        JournalFile *f;
+        JournalFile *f = NULL;
         int r;
 
         assert(s);
-        assert(iovec);
+        assert(entries);
         assert(n > 0);
 
-        /* Get the closest, linearized time we have for this log event from the event loop. (Note that we do not use
-         * the source time, and not even the time the event was originally seen, but instead simply the time we started
-         * processing it, as we want strictly linear ordering in what we write out.) */
-        assert_se(sd_event_now(s->event, CLOCK_REALTIME, &ts.realtime) >= 0);
-        assert_se(sd_event_now(s->event, CLOCK_MONOTONIC, &ts.monotonic) >= 0);
+        USDT_PROBE(journald, entries_write, n);
 
-        if (ts.realtime < s->last_realtime_clock) {
+        if (entries[0].ts.realtime < s->last_realtime_clock) {
                 /* When the time jumps backwards, let's immediately rotate. Of course, this should not happen during
                  * regular operation. However, when it does happen, then we should make sure that we start fresh files
                  * to ensure that the entries in the journal files are strictly ordered by time, in order to ensure
@@ -837,32 +859,204 @@ static void write_to_journal(Server *s, uid_t uid, struct iovec *iovec, size_t n
                         return;
         }
 
-        s->last_realtime_clock = ts.realtime;
+        s->last_realtime_clock = entries[n-1].ts.realtime;
 
-        r = journal_file_append_entry(f, &ts, NULL, iovec, n, &s->seqnum, NULL, NULL);
-        if (r >= 0) {
-                server_schedule_sync(s, priority);
-                return;
+        while (n > 0) {
+                size_t k = 0;
+
+                r = journal_file_append_entries(f, entries, n, &s->seqnum, &k);
+                entries += k;
+                n -= k;
+
+                if (r >= 0)
+                        break;
+
+                /* Every entry gets to rotate once, like it would if we wrote it on its own */
+                if (k > 0)
+                        vacuumed = false;
+
+                if (vacuumed || !shall_try_append_again(f, r)) {
+                        log_error_errno(r, "Failed to write entry (%u items, %zu bytes)%s, ignoring: %m",
+                                        entries[0].n_iovec, IOVEC_TOTAL_SIZE(entries[0].iovec, entries[0].n_iovec),
+                                        vacuumed ? " despite vacuuming" : "");
+                        entries++;
+                        n--;
+                        vacuumed = false;
+                        continue;
+                }
+
+                server_rotate(s);
+                server_vacuum(s, false);
+                vacuumed = true;
+
+                f = find_journal(s, uid);
+                if (!f)
+                        return;
+
+                log_debug("Retrying write.");
         }
 
-        if (vacuumed || !shall_try_append_again(f, r)) {
-                log_error_errno(r, "Failed to write entry (%zu items, %zu bytes), ignoring: %m", n, IOVEC_TOTAL_SIZE(iovec, n));
+        server_schedule_sync(s, priority);
+}
+
+void server_commit_pending_entries(Server *s) {
+        _cleanup_free_ JournalFileEntry *entries = NULL;
+        PendingEntry *pending;
+        size_t n, i, k;
+
+        assert(s);
+
+        if (s->n_pending_entries == 0)
                 return;
+
+        /* Take the queue, so that anything that is logged while we write (or a rotation, which commits the queue
+         * first) doesn't interfere with us */
+        pending = TAKE_PTR(s->pending_entries);
+        n = s->n_pending_entries;
+        s->n_pending_entries = s->n_pending_entries_allocated = s->pending_size = 0;
+
+        /* If we can't allocate the batch, write the entries one by one */
+        entries = new(JournalFileEntry, n);
+
+        for (i = 0; i < n; i = k) {
+                int priority = pending[i].priority;
+
+                /* Write runs of entries that go to the same file, and which are ordered by time, in one go */
+                for (k = i + 1; k < n; k++) {
+                        if (pending[k].uid != pending[i].uid ||
+                            pending[k].entry.ts.realtime < pending[k-1].entry.ts.realtime)
+                                break;
+
+                        priority = MIN(priority, pending[k].priority);
+                }
+
+                if (entries) {
+                        size_t j;
+
+                        for (j = i; j < k; j++)
+                                entries[j - i] = pending[j].entry;
+
+                        write_entries_to_journal(s, pending[i].uid, entries, k - i, priority);
+                } else {
+                        size_t j;
+
+                        for (j = i; j < k; j++)
+                                write_entries_to_journal(s, pending[j].uid, &pending[j].entry, 1, pending[j].priority);
+                }
         }
 
-        server_rotate(s);
-        server_vacuum(s, false);
+        for (i = 0; i < n; i++)
+                free((struct iovec*) pending[i].entry.iovec);
+        free(pending);
+}
+
+static int dispatch_pending_entries(sd_event_source *es, void *userdata) {
+        Server *s = userdata;
+
+        assert(s);
+
+        server_commit_pending_entries(s);
+        return 0;
+}
+
+static int queue_entry(Server *s, uid_t uid, const dual_timestamp *ts, const struct iovec *iovec, size_t n, int priority) {
+        struct iovec *copy;
+        uint8_t *p;
+        size_t size, i;
+        int r;
+
+        assert(s);
+        assert(ts);
+        assert(iovec);
+        assert(n > 0);
+
+        /* The iovecs point into buffers that are reused for the next message, hence copy everything into a single
+         * allocation */
+
+        if (!s->pending_event_source) {
+                r = sd_event_add_defer(s->event, &s->pending_event_source, dispatch_pending_entries, s);
+                if (r < 0)
+                        return r;
+
+                /* Lower priority than the sockets and kmsg, so that we only write once everything that is
+                 * readable has been read */
+                r = sd_event_source_set_priority(s->pending_event_source, SD_EVENT_PRIORITY_NORMAL+10);
+                if (r < 0)
+                        return r;
+        }
+
+        if (!GREEDY_REALLOC(s->pending_entries, s->n_pending_entries_allocated, s->n_pending_entries + 1))
+                return -ENOMEM;
+
+        size = IOVEC_TOTAL_SIZE(iovec, n);
+
+        copy = malloc(n * sizeof(struct iovec) + size);
+        if (!copy)
+                return -ENOMEM;
+
+        p = (uint8_t*) (copy + n);
+        for (i = 0; i < n; i++) {
+                memcpy_safe(p, iovec[i].iov_base, iovec[i].iov_len);
+                copy[i] = IOVEC_MAKE(p, iovec[i].iov_len);
+                p += iovec[i].iov_len;
+        }
+
+        r = sd_event_source_set_enabled(s->pending_event_source, SD_EVENT_ONESHOT);
+        if (r < 0) {
+                free(copy);
+                return r;
+        }
+
+        s->pending_entries[s->n_pending_entries++] = (PendingEntry) {
+                .entry = {
+                        .ts = *ts,
+                        .iovec = copy,
+                        .n_iovec = n,
+                },
+                .uid = uid,
+                .priority = priority,
+        };
+        s->pending_size += size;
+
+        return 0;
+}
+
+static void write_to_journal(Server *s, uid_t uid, struct iovec *iovec, size_t n, int priority) {
+        struct dual_timestamp ts;
+        int r;
+
+        assert(s);
+        assert(iovec);
+        assert(n > 0);
+
+        USDT_PROBE(journald, message_append, uid, n, priority);
 
-        f = find_journal(s, uid);
-        if (!f)
+        /* Get the closest, linearized time we have for this log event from the event loop. (Note that we do not use
+         * the source time, and not even the time the event was originally seen, but instead simply the time we started
+         * processing it, as we want strictly linear ordering in what we write out.) */
+        assert_se(sd_event_now(s->event, CLOCK_REALTIME, &ts.realtime) >= 0);
+        assert_se(sd_event_now(s->event, CLOCK_MONOTONIC, &ts.monotonic) >= 0);
+
+        r = queue_entry(s, uid, &ts, iovec, n, priority);
+        if (r < 0) {
+                JournalFileEntry entry = {
+                        .ts = ts,
+                        .iovec = iovec,
+                        .n_iovec = n,
+                };
+
+                log_debug_errno(r, "Failed to queue entry, writing it right-away: %m");
+
+                server_commit_pending_entries(s);
+                write_entries_to_journal(s, uid, &entry, 1, priority);
                 return;
+        }
 
-        log_debug("Retrying write.");
-        r = journal_file_append_entry(f, &ts, NULL, iovec, n, &s->seqnum, NULL, NULL);
-        if (r < 0)
-                log_error_errno(r, "Failed to write entry (%zu items, %zu bytes) despite vacuuming, ignoring: %m", n, IOVEC_TOTAL_SIZE(iovec, n));
-        else
-                server_schedule_sync(s, priority);
+        /* Don't delay important messages, and don't let the queue grow without bounds if we are flooded */
+        if (priority <= LOG_CRIT ||
+            s->n_pending_entries >= PENDING_ENTRIES_MAX ||
+            s->pending_size >= PENDING_SIZE_MAX)
+                server_commit_pending_entries(s);
 }
 
 #define IOVEC_ADD_NUMERIC_FIELD(iovec, n, value, type, isset, format, field)  \
@@ -1103,15 +1297,90 @@ void server_dispatch_message(
                                               NULL);
         }
 
+        if (c && c->rate_limit_slice) {
+                JournalRateLimitSlice *report;
+
+                if (!c->unit)
+                        (void) determine_space(s, &available, NULL);
+
+                rl = journal_rate_limit_slice_test(c->rate_limit_slice, s->slice_rate_limit_interval, s->slice_rate_limit_burst, available, now(CLOCK_MONOTONIC), &report);
+                if (rl == 0)
+                        return;
+
+                if (rl > 1)
+                        server_driver_message(s, 0,
+                                              "MESSAGE_ID=" SD_MESSAGE_JOURNAL_DROPPED_STR,
+                                              LOG_MESSAGE("Suppressed %i messages from slice %s", rl - 1, journal_rate_limit_slice_id(report)),
+                                              "N_DROPPED=%i", rl - 1,
+                                              "SLICE=%s", journal_rate_limit_slice_id(report),
+                                              "SLICE_N_DROPPED=%"PRIu64, journal_rate_limit_slice_suppressed(report),
+                                              NULL);
+        }
+
+        USDT_PROBE(journald, message_accept, priority, n, c ? c->pid : 0);
+
         dispatch_message_real(s, iovec, n, m, c, tv, priority, object_pid);
 }
 
+static Hashmap* copied_data_free(Hashmap *h) {
+        Hashmap *d;
+
+        /* Frees the per-source-file maps of data objects already copied during a flush */
+
+        while ((d = hashmap_steal_first(h)))
+                hashmap_free_free(d);
+
+        return hashmap_free(h);
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(Hashmap*, copied_data_free);
+
+static void copied_data_flush(Hashmap *h) {
+        Hashmap *d;
+        Iterator i;
+
+        /* The destination changed, hence everything we remember points into the wrong file now */
+
+        HASHMAP_FOREACH(d, h, i)
+                hashmap_clear_free(d);
+}
+
+static Hashmap* copied_data_get(Hashmap **h, JournalFile *f) {
+        Hashmap *d;
+
+        assert(h);
+        assert(f);
+
+        /* Returns the map of data objects already copied from the specified source file. This is just an
+         * optimization, hence if we are out of memory we just return NULL, so that everything is looked up
+         * again. */
+
+        d = hashmap_get(*h, f);
+        if (d)
+                return d;
+
+        if (hashmap_ensure_allocated(h, NULL) < 0)
+                return NULL;
+
+        d = hashmap_new(&uint64_hash_ops);
+        if (!d)
+                return NULL;
+
+        if (hashmap_put(*h, f, d) < 0)
+                return hashmap_free(d);
+
+        return d;
+}
+
 int server_flush_to_var(Server *s, bool require_flag_file) {
+        _cleanup_(copied_data_freep) Hashmap *copied_data = NULL;
         sd_id128_t machine;
         sd_journal *j = NULL;
         char ts[FORMAT_TIMESPAN_MAX];
         usec_t start;
-        unsigned n = 0;
+        unsigned n = 0, n_data = 0;
+        Hashmap *d;
+        Iterator i;
         int r;
 
         assert(s);
@@ -1119,6 +1388,8 @@ int server_flush_to_var(Server *s, bool require_flag_file) {
         if (!IN_SET(s->storage, STORAGE_AUTO, STORAGE_PERSISTENT))
                 return 0;
 
+        server_commit_pending_entries(s);
+
         if (!s->runtime_journal)
                 return 0;
 
@@ -1159,7 +1430,7 @@ int server_flush_to_var(Server *s, bool require_flag_file) {
                         goto finish;
                 }
 
-                r = journal_file_copy_entry(f, s->system_journal, o, f->current_offset);
+                r = journal_file_copy_entry(f, s->system_journal, o, f->current_offset, copied_data_get(&copied_data, f));
                 if (r >= 0)
                         continue;
 
@@ -1177,8 +1448,10 @@ int server_flush_to_var(Server *s, bool require_flag_file) {
                         goto finish;
                 }
 
+                copied_data_flush(copied_data);
+
                 log_debug("Retrying write.");
-                r = journal_file_copy_entry(f, s->system_journal, o, f->current_offset);
+                r = journal_file_copy_entry(f, s->system_journal, o, f->current_offset, copied_data_get(&copied_data, f));
                 if (r < 0) {
                         log_error_errno(r, "Can't write entry: %m");
                         goto finish;
@@ -1196,87 +1469,111 @@ finish:
         if (r >= 0)
                 (void) rm_rf("/run/log/journal", REMOVE_ROOT);
 
+        HASHMAP_FOREACH(d, copied_data, i)
+                n_data += hashmap_size(d);
+
+        /* The maps are keyed by the source files, hence drop them before the files go away */
+        copied_data = copied_data_free(copied_data);
+
         sd_journal_close(j);
 
         server_driver_message(s, 0, NULL,
-                              LOG_MESSAGE("Time spent on flushing to /var is %s for %u entries.",
+                              LOG_MESSAGE("Time spent on flushing to /var is %s for %u entries (%u data objects).",
                                           format_timespan(ts, sizeof(ts), now(CLOCK_MONOTONIC) - start, 0),
-                                          n),
+                                          n, n_data),
                               NULL);
 
         return r;
 }
 
-int server_process_datagram(sd_event_source *es, int fd, uint32_t revents, void *userdata) {
-        Server *s = userdata;
-        struct ucred *ucred = NULL;
-        struct timeval *tv = NULL;
-        struct cmsghdr *cmsg;
-        char *label = NULL;
-        size_t label_len = 0, m;
-        struct iovec iovec;
-        ssize_t n;
-        int *fds = NULL, v = 0;
-        size_t n_fds = 0;
+typedef union DatagramControl {
+        struct cmsghdr cmsghdr;
+
+        /* We use NAME_MAX space for the SELinux label
+         * here. The kernel currently enforces no
+         * limit, but according to suggestions from
+         * the SELinux people this will change and it
+         * will probably be identical to NAME_MAX. For
+         * now we use that, but this should be updated
+         * one day when the final limit is known. */
+        uint8_t buf[CMSG_SPACE(sizeof(struct ucred)) +
+                    CMSG_SPACE(sizeof(struct timeval)) +
+                    CMSG_SPACE(sizeof(int)) + /* fd */
+                    CMSG_SPACE(NAME_MAX)]; /* selinux label */
+} DatagramControl;
+
+struct DatagramBatch {
+        unsigned n_slots;
+        struct mmsghdr *messages;
+        struct iovec *iovecs;
+        DatagramControl *controls;
+        char **buffers;
+};
 
-        union {
-                struct cmsghdr cmsghdr;
-
-                /* We use NAME_MAX space for the SELinux label
-                 * here. The kernel currently enforces no
-                 * limit, but according to suggestions from
-                 * the SELinux people this will change and it
-                 * will probably be identical to NAME_MAX. For
-                 * now we use that, but this should be updated
-                 * one day when the final limit is known. */
-                uint8_t buf[CMSG_SPACE(sizeof(struct ucred)) +
-                            CMSG_SPACE(sizeof(struct timeval)) +
-                            CMSG_SPACE(sizeof(int)) + /* fd */
-                            CMSG_SPACE(NAME_MAX)]; /* selinux label */
-        } control = {};
+static DatagramBatch* datagram_batch_free(DatagramBatch *b) {
+        unsigned i;
 
-        union sockaddr_union sa = {};
+        if (!b)
+                return NULL;
 
-        struct msghdr msghdr = {
-                .msg_iov = &iovec,
-                .msg_iovlen = 1,
-                .msg_control = &control,
-                .msg_controllen = sizeof(control),
-                .msg_name = &sa,
-                .msg_namelen = sizeof(sa),
-        };
+        if (b->buffers)
+                for (i = 0; i < b->n_slots; i++)
+                        free(b->buffers[i]);
 
-        assert(s);
-        assert(fd == s->native_fd || fd == s->syslog_fd || fd == s->audit_fd);
+        free(b->buffers);
+        free(b->controls);
+        free(b->iovecs);
+        free(b->messages);
 
-        if (revents != EPOLLIN)
-                return log_error_errno(SYNTHETIC_ERRNO(EIO),
-                                       "Got invalid event from epoll for datagram fd: %" PRIx32,
-                                       revents);
+        return mfree(b);
+}
 
-        /* Try to get the right size, if we can. (Not all sockets support SIOCINQ, hence we just try, but don't rely on
-         * it.) */
-        (void) ioctl(fd, SIOCINQ, &v);
+DEFINE_TRIVIAL_CLEANUP_FUNC(DatagramBatch*, datagram_batch_free);
 
-        /* Fix it up, if it is too small. We use the same fixed value as auditd here. Awful! */
-        m = PAGE_ALIGN(MAX3((size_t) v + 1,
-                            (size_t) LINE_MAX,
-                            ALIGN(sizeof(struct nlmsghdr)) + ALIGN((size_t) MAX_AUDIT_MESSAGE_LENGTH)) + 1);
+static int datagram_batch_new(unsigned n_slots, DatagramBatch **ret) {
+        _cleanup_(datagram_batch_freep) DatagramBatch *b = NULL;
+        unsigned i;
 
-        if (!GREEDY_REALLOC(s->buffer, s->buffer_size, m))
-                return log_oom();
+        assert(n_slots > 0);
+        assert(ret);
 
-        iovec = IOVEC_MAKE(s->buffer, s->buffer_size - 1); /* Leave room for trailing NUL we add later */
+        b = new0(DatagramBatch, 1);
+        if (!b)
+                return -ENOMEM;
 
-        n = recvmsg(fd, &msghdr, MSG_DONTWAIT|MSG_CMSG_CLOEXEC);
-        if (n < 0) {
-                if (IN_SET(errno, EINTR, EAGAIN))
-                        return 0;
+        b->messages = new0(struct mmsghdr, n_slots);
+        b->iovecs = new0(struct iovec, n_slots);
+        b->controls = new0(DatagramControl, n_slots);
+        b->buffers = new0(char*, n_slots);
+        if (!b->messages || !b->iovecs || !b->controls || !b->buffers)
+                return -ENOMEM;
 
-                return log_error_errno(errno, "recvmsg() failed: %m");
+        b->n_slots = n_slots;
+
+        for (i = 0; i < n_slots; i++) {
+                b->buffers[i] = malloc(DATAGRAM_BATCH_SLOT_SIZE);
+                if (!b->buffers[i])
+                        return -ENOMEM;
         }
 
-        CMSG_FOREACH(cmsg, &msghdr) {
+        *ret = TAKE_PTR(b);
+        return 0;
+}
+
+static void server_dispatch_datagram(Server *s, int fd, char *buffer, size_t n, struct msghdr *msghdr) {
+        struct ucred *ucred = NULL;
+        struct timeval *tv = NULL;
+        struct cmsghdr *cmsg;
+        char *label = NULL;
+        size_t label_len = 0;
+        int *fds = NULL;
+        size_t n_fds = 0;
+
+        assert(s);
+        assert(buffer);
+        assert(msghdr);
+
+        CMSG_FOREACH(cmsg, msghdr) {
 
                 if (cmsg->cmsg_level == SOL_SOCKET &&
                     cmsg->cmsg_type == SCM_CREDENTIALS &&
@@ -1298,19 +1595,21 @@ int server_process_datagram(sd_event_source *es, int fd, uint32_t revents, void
         }
 
         /* And a trailing NUL, just in case */
-        s->buffer[n] = 0;
+        buffer[n] = 0;
 
         if (fd == s->syslog_fd) {
                 if (n > 0 && n_fds == 0)
-                        server_process_syslog_message(s, s->buffer, n, ucred, tv, label, label_len);
+                        server_process_syslog_message(s, buffer, n, ucred, tv, label, label_len);
                 else if (n_fds > 0)
                         log_warning("Got file descriptors via syslog socket. Ignoring.");
 
         } else if (fd == s->native_fd) {
                 if (n > 0 && n_fds == 0)
-                        server_process_native_message(s, s->buffer, n, ucred, tv, label, label_len);
+                        server_process_native_message(s, buffer, n, ucred, tv, label, label_len);
                 else if (n == 0 && n_fds == 1)
                         server_process_native_file(s, fds[0], ucred, tv, label, label_len);
+                else if (n == 0 && n_fds == 2)
+                        server_process_native_ring(s, fds[0], fds[1], ucred, label, label_len);
                 else if (n_fds > 0)
                         log_warning("Got too many file descriptors via native socket. Ignoring.");
 
@@ -1318,12 +1617,131 @@ int server_process_datagram(sd_event_source *es, int fd, uint32_t revents, void
                 assert(fd == s->audit_fd);
 
                 if (n > 0 && n_fds == 0)
-                        server_process_audit_message(s, s->buffer, n, ucred, &sa, msghdr.msg_namelen);
+                        server_process_audit_message(s, buffer, n, ucred, msghdr->msg_name, msghdr->msg_namelen);
                 else if (n_fds > 0)
                         log_warning("Got file descriptors via audit socket. Ignoring.");
         }
 
         close_many(fds, n_fds);
+}
+
+static int server_process_datagram_batch(Server *s, int fd) {
+        DatagramBatch *b;
+        unsigned i;
+        int n, r;
+
+        assert(s);
+        assert(fd == s->native_fd || fd == s->syslog_fd);
+
+        if (!s->datagram_batch) {
+                r = datagram_batch_new(s->datagram_batch_size, &s->datagram_batch);
+                if (r < 0)
+                        return log_oom();
+        }
+
+        b = s->datagram_batch;
+
+        /* The kernel updates the lengths in place, hence reset all slots before each call */
+        for (i = 0; i < b->n_slots; i++) {
+                b->iovecs[i] = IOVEC_MAKE(b->buffers[i], DATAGRAM_BATCH_SLOT_SIZE - 1); /* Leave room for trailing NUL */
+                b->messages[i] = (struct mmsghdr) {
+                        .msg_hdr = {
+                                .msg_iov = b->iovecs + i,
+                                .msg_iovlen = 1,
+                                .msg_control = b->controls + i,
+                                .msg_controllen = sizeof(DatagramControl),
+                        },
+                };
+        }
+
+        n = recvmmsg(fd, b->messages, b->n_slots, MSG_DONTWAIT|MSG_CMSG_CLOEXEC, NULL);
+        if (n < 0) {
+                if (IN_SET(errno, EINTR, EAGAIN))
+                        return 0;
+
+                return log_error_errno(errno, "recvmmsg() failed: %m");
+        }
+
+        for (i = 0; i < (unsigned) n; i++) {
+                struct mmsghdr *m = b->messages + i;
+
+                if (m->msg_hdr.msg_flags & MSG_TRUNC) {
+                        struct cmsghdr *cmsg;
+
+                        log_warning("Got datagram larger than %zu bytes via %s socket, dropping.",
+                                    DATAGRAM_BATCH_SLOT_SIZE - 1, fd == s->native_fd ? "native" : "syslog");
+
+                        CMSG_FOREACH(cmsg, &m->msg_hdr)
+                                if (cmsg->cmsg_level == SOL_SOCKET &&
+                                    cmsg->cmsg_type == SCM_RIGHTS)
+                                        close_many((int*) CMSG_DATA(cmsg), (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+                        continue;
+                }
+
+                server_dispatch_datagram(s, fd, b->buffers[i], m->msg_len, &m->msg_hdr);
+        }
+
+        return 0;
+}
+
+int server_process_datagram(sd_event_source *es, int fd, uint32_t revents, void *userdata) {
+        Server *s = userdata;
+        struct iovec iovec;
+        size_t m;
+        ssize_t n;
+        int v = 0;
+
+        DatagramControl control = {};
+
+        union sockaddr_union sa = {};
+
+        struct msghdr msghdr = {
+                .msg_iov = &iovec,
+                .msg_iovlen = 1,
+                .msg_control = &control,
+                .msg_controllen = sizeof(control),
+                .msg_name = &sa,
+                .msg_namelen = sizeof(sa),
+        };
+
+        assert(s);
+        assert(fd == s->native_fd || fd == s->syslog_fd || fd == s->audit_fd);
+
+        if (revents != EPOLLIN)
+                return log_error_errno(SYNTHETIC_ERRNO(EIO),
+                                       "Got invalid event from epoll for datagram fd: %" PRIx32,
+                                       revents);
+
+        /* Try to get the right size, if we can. (Not all sockets support SIOCINQ, hence we just try, but don't rely on
+         * it.) */
+        (void) ioctl(fd, SIOCINQ, &v);
+
+        /* If the next datagram fits into a batch slot, read it together with whatever else is queued behind it. The
+         * audit netlink socket is left alone, it doesn't see enough traffic to matter. */
+        if (s->datagram_batch_size > 1 &&
+            fd != s->audit_fd &&
+            (size_t) v < DATAGRAM_BATCH_SLOT_SIZE)
+                return server_process_datagram_batch(s, fd);
+
+        /* Fix it up, if it is too small. We use the same fixed value as auditd here. Awful! */
+        m = PAGE_ALIGN(MAX3((size_t) v + 1,
+                            (size_t) LINE_MAX,
+                            ALIGN(sizeof(struct nlmsghdr)) + ALIGN((size_t) MAX_AUDIT_MESSAGE_LENGTH)) + 1);
+
+        if (!GREEDY_REALLOC(s->buffer, s->buffer_size, m))
+                return log_oom();
+
+        iovec = IOVEC_MAKE(s->buffer, s->buffer_size - 1); /* Leave room for trailing NUL we add later */
+
+        n = recvmsg(fd, &msghdr, MSG_DONTWAIT|MSG_CMSG_CLOEXEC);
+        if (n < 0) {
+                if (IN_SET(errno, EINTR, EAGAIN))
+                        return 0;
+
+                return log_error_errno(errno, "recvmsg() failed: %m");
+        }
+
+        server_dispatch_datagram(s, fd, s->buffer, n, &msghdr);
         return 0;
 }
 
@@ -1399,6 +1817,22 @@ static int dispatch_sigrtmin1(sd_event_source *es, const struct signalfd_siginfo
         return 0;
 }
 
+static void dispatch_memory_pressure(MemoryPressureLevel level, void *userdata) {
+        Server *s = userdata;
+        unsigned n;
+
+        assert(s);
+
+        client_context_trim(s, level);
+
+        if (level == MEMORY_PRESSURE_NONE)
+                return;
+
+        n = mmap_cache_trim(s->mmap);
+        log_debug("Memory pressure level %s: %u client contexts cached, %u mmap windows unmapped.",
+                  memory_pressure_level_to_string(level), hashmap_size(s->client_contexts), n);
+}
+
 static int setup_signals(Server *s) {
         int r;
 
@@ -1819,6 +2253,7 @@ int server_init(Server *s) {
 
         zero(*s);
         s->syslog_fd = s->native_fd = s->stdout_fd = s->dev_kmsg_fd = s->audit_fd = s->hostname_fd = s->notify_fd = -1;
+        server_forward_queues_init(s);
         s->compress.enabled = true;
         s->compress.threshold_bytes = (uint64_t) -1;
         s->seal = true;
@@ -1831,6 +2266,7 @@ int server_init(Server *s) {
 
         s->rate_limit_interval = DEFAULT_RATE_LIMIT_INTERVAL;
         s->rate_limit_burst = DEFAULT_RATE_LIMIT_BURST;
+        s->slice_rate_limit_interval = DEFAULT_RATE_LIMIT_INTERVAL;
 
         s->forward_to_wall = true;
 
@@ -1844,6 +2280,8 @@ int server_init(Server *s) {
 
         s->line_max = DEFAULT_LINE_MAX;
 
+        s->datagram_batch_size = DEFAULT_DATAGRAM_BATCH_SIZE;
+
         journal_reset_metrics(&s->system_storage.metrics);
         journal_reset_metrics(&s->runtime_storage.metrics);
 
@@ -1859,6 +2297,17 @@ int server_init(Server *s) {
                 s->rate_limit_interval = s->rate_limit_burst = 0;
         }
 
+        if (!!s->slice_rate_limit_interval ^ !!s->slice_rate_limit_burst) {
+                log_debug("Setting both slice rate limit interval and burst from "USEC_FMT",%u to 0,0",
+                          s->slice_rate_limit_interval, s->slice_rate_limit_burst);
+                s->slice_rate_limit_interval = s->slice_rate_limit_burst = 0;
+        }
+
+        if (s->datagram_batch_size > DATAGRAM_BATCH_SIZE_MAX) {
+                log_debug("Datagram batch size %u too large, lowering to %u.", s->datagram_batch_size, DATAGRAM_BATCH_SIZE_MAX);
+                s->datagram_batch_size = DATAGRAM_BATCH_SIZE_MAX;
+        }
+
         (void) mkdir_p("/run/systemd/journal", 0755);
 
         s->user_journals = ordered_hashmap_new(NULL);
@@ -1981,6 +2430,10 @@ int server_init(Server *s) {
         if (r < 0)
                 return r;
 
+        r = memory_pressure_new(s->event, &s->memory_pressure);
+        if (r >= 0)
+                (void) memory_pressure_add_handler(s->memory_pressure, dispatch_memory_pressure, s);
+
         s->rate_limit = journal_rate_limit_new();
         if (!s->rate_limit)
                 return -ENOMEM;
@@ -2027,6 +2480,15 @@ void server_maybe_append_tags(Server *s) {
 void server_done(Server *s) {
         assert(s);
 
+        /* Pick up what clients left in their rings, and write out whatever we still have queued before we close
+         * the files */
+        server_close_native_rings(s);
+        server_commit_pending_entries(s);
+        s->pending_event_source = sd_event_source_unref(s->pending_event_source);
+
+        server_forward_queues_flush(s);
+        server_forward_queues_done(s);
+
         set_free_with_destructor(s->deferred_closes, journal_file_close);
 
         while (s->stdout_streams)
@@ -2056,6 +2518,7 @@ void server_done(Server *s) {
         sd_event_source_unref(s->hostname_event_source);
         sd_event_source_unref(s->notify_event_source);
         sd_event_source_unref(s->watchdog_event_source);
+        memory_pressure_free(s->memory_pressure);
         sd_event_unref(s->event);
 
         safe_close(s->syslog_fd);
@@ -2072,10 +2535,16 @@ void server_done(Server *s) {
         if (s->kernel_seqnum)
                 munmap(s->kernel_seqnum, sizeof(uint64_t));
 
+        server_flush_kmsg_devices(s);
+
         free(s->buffer);
+        datagram_batch_free(s->datagram_batch);
         free(s->tty_path);
         free(s->cgroup_root);
         free(s->hostname_field);
+        journal_vacuum_index_free(s->runtime_storage.vacuum_index);
+        journal_vacuum_index_free(s->system_storage.vacuum_index);
+
         free(s->runtime_storage.path);
         free(s->system_storage.path);
 
@@ -7,14 +7,19 @@
 #include "sd-event.h"
 
 typedef struct Server Server;
+typedef struct DatagramBatch DatagramBatch;
+typedef struct NativeRing NativeRing;
 
 #include "conf-parser.h"
 #include "hashmap.h"
 #include "journal-file.h"
+#include "journal-vacuum.h"
 #include "journald-context.h"
+#include "journald-forward.h"
 #include "journald-rate-limit.h"
 #include "journald-stream.h"
 #include "list.h"
+#include "memory-pressure.h"
 #include "prioq.h"
 
 typedef enum Storage {
@@ -49,12 +54,21 @@ typedef struct JournalStorageSpace {
         uint64_t vfs_available;
 } JournalStorageSpace;
 
+typedef struct PendingEntry {
+        JournalFileEntry entry;
+        uid_t uid;
+        int priority;
+} PendingEntry;
+
 typedef struct JournalStorage {
         const char *name;
         char *path;
 
         JournalMetrics metrics;
         JournalStorageSpace space;
+
+        /* The files in the directory, kept up-to-date via inotify, for determining space usage and vacuuming */
+        JournalVacuumIndex *vacuum_index;
 } JournalStorage;
 
 struct Server {
@@ -82,6 +96,9 @@ struct Server {
         sd_event_source *hostname_event_source;
         sd_event_source *notify_event_source;
         sd_event_source *watchdog_event_source;
+        sd_event_source *pending_event_source;
+
+        MemoryPressure *memory_pressure;
 
         JournalFile *runtime_journal;
         JournalFile *system_journal;
@@ -89,13 +106,24 @@ struct Server {
 
         uint64_t seqnum;
 
+        /* Entries we received, but didn't write yet, so that we can append them to the journal files in one go */
+        PendingEntry *pending_entries;
+        size_t n_pending_entries, n_pending_entries_allocated;
+        size_t pending_size;
+
         char *buffer;
         size_t buffer_size;
 
+        /* Receive buffers for reading several datagrams at once with recvmmsg() */
+        DatagramBatch *datagram_batch;
+        unsigned datagram_batch_size;
+
         JournalRateLimit *rate_limit;
         usec_t sync_interval_usec;
         usec_t rate_limit_interval;
         unsigned rate_limit_burst;
+        usec_t slice_rate_limit_interval;
+        unsigned slice_rate_limit_burst;
 
         JournalStorage runtime_storage;
         JournalStorage system_storage;
@@ -112,6 +140,11 @@ struct Server {
         unsigned n_forward_syslog_missed;
         usec_t last_warn_forward_syslog_missed;
 
+        /* Messages to forward, written out asynchronously */
+        ForwardQueue forward_queues[_FORWARD_TARGET_MAX];
+        sd_event_source *forward_event_source;
+        usec_t last_warn_forward_dropped;
+
         uint64_t var_available_timestamp;
 
         usec_t max_retention_usec;
@@ -122,6 +155,9 @@ struct Server {
         LIST_HEAD(StdoutStream, stdout_streams_notify_queue);
         unsigned n_stdout_streams;
 
+        LIST_HEAD(NativeRing, native_rings);
+        unsigned n_native_rings;
+
         char *tty_path;
 
         int max_level_store;
@@ -138,6 +174,7 @@ struct Server {
         Set *deferred_closes;
 
         uint64_t *kernel_seqnum;
+        Hashmap *kmsg_devices;
         bool dev_kmsg_readable:1;
 
         bool send_watchdog:1;
@@ -160,6 +197,12 @@ struct Server {
         /* Caching of client metadata */
         Hashmap *client_contexts;
         Prioq *client_contexts_lru;
+        unsigned client_contexts_limit_shift; /* the cache size is divided by 2^limit_shift while memory is short */
+
+        uint64_t n_client_context_hits;
+        uint64_t n_client_context_misses;
+        uint64_t n_client_context_refreshes;
+        uint64_t n_client_context_exits;
 
         ClientContext *my_context; /* the context of journald itself */
         ClientContext *pid1_context; /* the context of PID 1 */
@@ -182,6 +225,7 @@ struct Server {
 /* kmsg: Maximum number of extra fields we'll import from udev's devices */
 #define N_IOVEC_UDEV_FIELDS 32
 
+void server_commit_pending_entries(Server *s);
 void server_dispatch_message(Server *s, struct iovec *iovec, size_t n, size_t m, ClientContext *c, const struct timeval *tv, int priority, pid_t object_pid);
 void server_driver_message(Server *s, pid_t object_pid, const char *message_id, const char *format, ...) _sentinel_ _printf_(4,0);
 
@@ -37,6 +37,11 @@
 
 #define STDOUT_STREAMS_MAX 4096
 
+/* Streams start out with a small buffer, which is grown while reads keep filling it up, up to the maximum line
+ * length, and shrunk again, down to nothing, after this many reads in a row used only a small part of it */
+#define STDOUT_STREAM_BUFFER_MIN 1024U
+#define STDOUT_STREAM_SHRINK_READS 16U
+
 typedef enum StdoutStreamState {
         STDOUT_STREAM_IDENTIFIER,
         STDOUT_STREAM_UNIT_ID,
@@ -67,6 +72,7 @@ struct StdoutStream {
         struct ucred ucred;
         char *label;
         char *identifier;
+        char *identifier_field;
         char *unit_id;
         int priority;
         bool level_prefix:1;
@@ -81,6 +87,15 @@ struct StdoutStream {
         size_t length;
         size_t allocated;
 
+        /* How much of the beginning of the buffer is known to contain no line break */
+        size_t scanned;
+
+        bool read_full;
+        unsigned n_short_reads;
+
+        /* Only refresh the client context once for all lines from one read */
+        bool context_fresh;
+
         sd_event_source *event_source;
 
         char *state_file;
@@ -118,6 +133,7 @@ void stdout_stream_free(StdoutStream *s) {
         safe_close(s->fd);
         free(s->label);
         free(s->identifier);
+        free(s->identifier_field);
         free(s->unit_id);
         free(s->state_file);
         free(s->buffer);
@@ -240,21 +256,24 @@ static int stdout_stream_log(StdoutStream *s, const char *p, LineBreak line_brea
         int priority;
         char syslog_priority[] = "PRIORITY=\0";
         char syslog_facility[STRLEN("SYSLOG_FACILITY=") + DECIMAL_STR_MAX(int) + 1];
-        _cleanup_free_ char *message = NULL, *syslog_identifier = NULL;
+        _cleanup_free_ char *message = NULL;
         size_t n = 0, m;
         int r;
 
         assert(s);
         assert(p);
 
-        if (s->context)
-                (void) client_context_maybe_refresh(s->server, s->context, NULL, NULL, 0, NULL, USEC_INFINITY);
-        else if (pid_is_valid(s->ucred.pid)) {
+        if (s->context) {
+                if (!s->context_fresh)
+                        (void) client_context_maybe_refresh(s->server, s->context, NULL, NULL, 0, NULL, USEC_INFINITY);
+        } else if (pid_is_valid(s->ucred.pid)) {
                 r = client_context_acquire(s->server, s->ucred.pid, &s->ucred, s->label, strlen_ptr(s->label), s->unit_id, &s->context);
                 if (r < 0)
                         log_warning_errno(r, "Failed to acquire client context, ignoring: %m");
         }
 
+        s->context_fresh = true;
+
         priority = s->priority;
 
         if (s->level_prefix)
@@ -293,9 +312,10 @@ static int stdout_stream_log(StdoutStream *s, const char *p, LineBreak line_brea
         }
 
         if (s->identifier) {
-                syslog_identifier = strappend("SYSLOG_IDENTIFIER=", s->identifier);
-                if (syslog_identifier)
-                        iovec[n++] = IOVEC_MAKE_STRING(syslog_identifier);
+                if (!s->identifier_field)
+                        s->identifier_field = strappend("SYSLOG_IDENTIFIER=", s->identifier);
+                if (s->identifier_field)
+                        iovec[n++] = IOVEC_MAKE_STRING(s->identifier_field);
         }
 
         if (line_break != LINE_BREAK_NEWLINE) {
@@ -423,8 +443,8 @@ static int stdout_stream_line(StdoutStream *s, char *p, LineBreak line_break) {
 }
 
 static int stdout_stream_scan(StdoutStream *s, bool force_flush) {
+        size_t remaining, scanned;
         char *p;
-        size_t remaining;
         int r;
 
         assert(s);
@@ -432,6 +452,14 @@ static int stdout_stream_scan(StdoutStream *s, bool force_flush) {
         p = s->buffer;
         remaining = s->length;
 
+        /* The part of a line that was left over from the previous read has been searched for line breaks already,
+         * hence only look at what was added since. This keeps long lines that arrive in small pieces from being
+         * searched over and over again. */
+        scanned = MIN(s->scanned, remaining);
+
+        /* The client context is refreshed at most once per call, i.e. for all lines from one read */
+        s->context_fresh = false;
+
         /* XXX: This function does nothing if (s->length == 0) */
 
         for (;;) {
@@ -439,8 +467,8 @@ static int stdout_stream_scan(StdoutStream *s, bool force_flush) {
                 size_t skip;
                 char *end1, *end2;
 
-                end1 = memchr(p, '\n', remaining);
-                end2 = memchr(p, 0, end1 ? (size_t) (end1 - p) : remaining);
+                end1 = memchr(p + scanned, '\n', remaining - scanned);
+                end2 = memchr(p + scanned, 0, end1 ? (size_t) (end1 - p) - scanned : remaining - scanned);
 
                 if (end2) {
                         /* We found a NUL terminator */
@@ -465,6 +493,7 @@ static int stdout_stream_scan(StdoutStream *s, bool force_flush) {
 
                 remaining -= skip;
                 p += skip;
+                scanned = 0;
         }
 
         if (force_flush && remaining > 0) {
@@ -482,12 +511,56 @@ static int stdout_stream_scan(StdoutStream *s, bool force_flush) {
                 s->length = remaining;
         }
 
+        /* Whatever is left contains no line break */
+        s->scanned = remaining;
+
         return 0;
 }
 
+static int stdout_stream_resize(StdoutStream *s, size_t size) {
+        char *p;
+
+        assert(s);
+        assert(size == 0 || size > s->length);
+
+        if (size == 0) {
+                s->buffer = mfree(s->buffer);
+                s->allocated = 0;
+                return 0;
+        }
+
+        p = realloc(s->buffer, size);
+        if (!p)
+                return -ENOMEM;
+
+        s->buffer = p;
+        s->allocated = size;
+        return 0;
+}
+
+static void stdout_stream_adjust_buffer(StdoutStream *s, size_t n_read, size_t n_requested) {
+        assert(s);
+
+        /* If a read filled up all the room we had, the service is likely writing faster than we are reading,
+         * hence read more at once next time, and thus also process more lines per wakeup. */
+        s->read_full = n_read >= n_requested;
+        if (s->read_full || s->length > 0 || n_read >= s->allocated / 4) {
+                s->n_short_reads = 0;
+                return;
+        }
+
+        /* A stream that hasn't needed most of its buffer for a while gets a smaller one, quiet ones none at all,
+         * until they write again. */
+        if (++s->n_short_reads < STDOUT_STREAM_SHRINK_READS)
+                return;
+
+        s->n_short_reads = 0;
+        (void) stdout_stream_resize(s, s->allocated / 2 >= STDOUT_STREAM_BUFFER_MIN ? s->allocated / 2 : 0);
+}
+
 static int stdout_stream_process(sd_event_source *es, int fd, uint32_t revents, void *userdata) {
         StdoutStream *s = userdata;
-        size_t limit;
+        size_t limit, requested;
         ssize_t l;
         int r;
 
@@ -498,9 +571,17 @@ static int stdout_stream_process(sd_event_source *es, int fd, uint32_t revents,
                 goto terminate;
         }
 
+        if (s->read_full && s->allocated <= s->server->line_max) {
+                /* The last read filled up the buffer, double it */
+                if (stdout_stream_resize(s, MIN(s->allocated * 2, s->server->line_max + 1)) < 0) {
+                        log_oom();
+                        goto terminate;
+                }
+        }
+
         /* If the buffer is full already (discounting the extra NUL we need), add room for another 1K */
         if (s->length + 1 >= s->allocated) {
-                if (!GREEDY_REALLOC(s->buffer, s->allocated, s->length + 1 + 1024)) {
+                if (!GREEDY_REALLOC(s->buffer, s->allocated, s->length + 1 + STDOUT_STREAM_BUFFER_MIN)) {
                         log_oom();
                         goto terminate;
                 }
@@ -510,7 +591,9 @@ static int stdout_stream_process(sd_event_source *es, int fd, uint32_t revents,
          * always leave room for a terminating NUL we might need to add. */
         limit = MIN(s->allocated - 1, s->server->line_max);
 
-        l = read(s->fd, s->buffer + s->length, limit - s->length);
+        requested = limit - s->length;
+
+        l = read(s->fd, s->buffer + s->length, requested);
         if (l < 0) {
                 if (errno == EAGAIN)
                         return 0;
@@ -529,6 +612,8 @@ static int stdout_stream_process(sd_event_source *es, int fd, uint32_t revents,
         if (r < 0)
                 goto terminate;
 
+        stdout_stream_adjust_buffer(s, l, requested);
+
         return 1;
 
 terminate:
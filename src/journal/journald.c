@@ -7,6 +7,7 @@
 
 #include "format-util.h"
 #include "journal-authenticate.h"
+#include "journald-forward.h"
 #include "journald-kmsg.h"
 #include "journald-server.h"
 #include "journald-syslog.h"
@@ -97,6 +98,7 @@ int main(int argc, char *argv[]) {
 
                 server_maybe_append_tags(&server);
                 server_maybe_warn_forward_syslog_missed(&server);
+                server_maybe_warn_forward_dropped(&server);
         }
 
         log_debug("systemd-journald stopped as pid "PID_FMT, getpid_cached());
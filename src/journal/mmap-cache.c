@@ -23,11 +23,13 @@ struct Window {
         bool invalidated:1;
         bool keep_always:1;
         bool in_unused:1;
+        bool at_eof:1;          /* clamped to the file size when it was mapped */
 
         int prot;
         void *ptr;
         uint64_t offset;
         size_t size;
+        size_t reserved;        /* address space reserved right after the mapping, for growing it */
 
         MMapFileDescriptor *fd;
 
@@ -50,13 +52,22 @@ struct MMapFileDescriptor {
         int fd;
         bool sigbus;
         LIST_HEAD(Window, windows);
+
+        /* Where the last miss on this file was, and where the window we created for it ended. Used to guess whether
+         * the file is scanned sequentially or accessed randomly (e.g. by bisection). */
+        uint64_t last_miss_offset;
+        uint64_t last_window_end;
+        int access_pattern;
 };
 
 struct MMapCache {
         unsigned n_ref;
         unsigned n_windows;
 
-        unsigned n_hit, n_missed;
+        unsigned n_context_hit, n_window_hit, n_missed;
+        unsigned n_evicted;
+        unsigned n_sequential, n_random;
+        unsigned n_grown;
 
         Hashmap *fds;
         Context *contexts[MMAP_CACHE_MAX_CONTEXTS];
@@ -70,10 +81,22 @@ struct MMapCache {
 #if ENABLE_DEBUG_MMAP_CACHE
 /* Tiny windows increase mmap activity and the chance of exposing unsafe use. */
 # define WINDOW_SIZE (page_size())
+# define WINDOW_SIZE_SEQUENTIAL WINDOW_SIZE
+# define WINDOW_SIZE_RANDOM WINDOW_SIZE
 #else
 # define WINDOW_SIZE (8ULL*1024ULL*1024ULL)
+/* Forward scans get bigger windows that are read ahead, random access (such as bisection) smaller ones. */
+# define WINDOW_SIZE_SEQUENTIAL (4ULL*WINDOW_SIZE)
+# define WINDOW_SIZE_RANDOM (WINDOW_SIZE/8ULL)
 #endif
 
+/* Windows that end at the end of the file are grown in place while the file grows, up to this size */
+#define WINDOW_SIZE_GROW_MAX (8ULL*WINDOW_SIZE)
+
+/* How many consecutive misses of the same kind we need to see before we switch window sizes */
+#define ACCESS_PATTERN_THRESHOLD 2
+#define ACCESS_PATTERN_MAX 4
+
 MMapCache* mmap_cache_new(void) {
         MMapCache *m;
 
@@ -91,7 +114,7 @@ static void window_unlink(Window *w) {
         assert(w);
 
         if (w->ptr)
-                munmap(w->ptr, w->size);
+                munmap(w->ptr, w->size + w->reserved);
 
         if (w->fd)
                 LIST_REMOVE(by_fd, w->fd->windows, w);
@@ -171,6 +194,7 @@ static Window *window_add(MMapCache *m, MMapFileDescriptor *f, int prot, bool ke
                 w = m->last_unused;
                 window_unlink(w);
                 zero(*w);
+                m->n_evicted++;
         }
 
         w->cache = m;
@@ -296,9 +320,24 @@ static int make_room(MMapCache *m) {
                 return 0;
 
         window_free(m->last_unused);
+        m->n_evicted++;
         return 1;
 }
 
+unsigned mmap_cache_trim(MMapCache *m) {
+        unsigned n = 0;
+
+        assert(m);
+
+        /* Unmap all windows no context is looking at right now. Contexts keep their current window, so that
+         * pointers handed out to callers stay valid. */
+
+        while (make_room(m) > 0)
+                n++;
+
+        return n;
+}
+
 static int try_context(
                 MMapCache *m,
                 MMapFileDescriptor *f,
@@ -416,6 +455,26 @@ static int mmap_try_harder(MMapCache *m, void *addr, MMapFileDescriptor *f, int
         return 0;
 }
 
+static void update_access_pattern(MMapFileDescriptor *f, uint64_t offset) {
+        assert(f);
+
+        /* A miss right after the end of the previous window (or within one window size of it) means we are walking
+         * forward through the file, a miss far away from the previous one means we are jumping around. Anything else
+         * slowly moves us back to the default. */
+
+        if (offset >= f->last_miss_offset &&
+            offset <= f->last_window_end + WINDOW_SIZE)
+                f->access_pattern = MIN(f->access_pattern + 1, ACCESS_PATTERN_MAX);
+        else if ((offset > f->last_miss_offset ? offset - f->last_miss_offset : f->last_miss_offset - offset) > WINDOW_SIZE)
+                f->access_pattern = MAX(f->access_pattern - 1, -ACCESS_PATTERN_MAX);
+        else if (f->access_pattern > 0)
+                f->access_pattern--;
+        else if (f->access_pattern < 0)
+                f->access_pattern++;
+
+        f->last_miss_offset = offset;
+}
+
 static int add_mmap(
                 MMapCache *m,
                 MMapFileDescriptor *f,
@@ -429,9 +488,11 @@ static int add_mmap(
                 size_t *ret_size) {
 
         uint64_t woffset, wsize;
+        bool sequential, scattered, at_eof = false;
+        size_t reserved = 0;
         Context *c;
         Window *w;
-        void *d;
+        void *a = NULL, *d;
         int r;
 
         assert(m);
@@ -440,21 +501,37 @@ static int add_mmap(
         assert(size > 0);
         assert(ret);
 
+        update_access_pattern(f, offset);
+        sequential = f->access_pattern >= ACCESS_PATTERN_THRESHOLD;
+        scattered = f->access_pattern <= -ACCESS_PATTERN_THRESHOLD;
+
         woffset = offset & ~((uint64_t) page_size() - 1ULL);
         wsize = size + (offset - woffset);
         wsize = PAGE_ALIGN(wsize);
 
-        if (wsize < WINDOW_SIZE) {
-                uint64_t delta;
+        if (sequential) {
+                /* When scanning forward, there's no point in keeping what's before the requested object mapped,
+                 * hence start the window right there. */
+                if (wsize < WINDOW_SIZE_SEQUENTIAL)
+                        wsize = WINDOW_SIZE_SEQUENTIAL;
 
-                delta = PAGE_ALIGN((WINDOW_SIZE - wsize) / 2);
+        } else {
+                uint64_t window_size;
 
-                if (delta > offset)
-                        woffset = 0;
-                else
-                        woffset -= delta;
+                window_size = scattered ? WINDOW_SIZE_RANDOM : WINDOW_SIZE;
+
+                if (wsize < window_size) {
+                        uint64_t delta;
 
-                wsize = WINDOW_SIZE;
+                        delta = PAGE_ALIGN((window_size - wsize) / 2);
+
+                        if (delta > offset)
+                                woffset = 0;
+                        else
+                                woffset -= delta;
+
+                        wsize = window_size;
+                }
         }
 
         if (st) {
@@ -465,13 +542,42 @@ static int add_mmap(
                 if (woffset >= (uint64_t) st->st_size)
                         return -EADDRNOTAVAIL;
 
-                if (woffset + wsize > (uint64_t) st->st_size)
+                if (woffset + wsize > (uint64_t) st->st_size) {
                         wsize = PAGE_ALIGN(st->st_size - woffset);
+                        at_eof = true;
+                }
         }
 
-        r = mmap_try_harder(m, NULL, f, prot, MAP_SHARED, woffset, wsize, &d);
-        if (r < 0)
+        if (at_eof && (prot & PROT_WRITE) && wsize < WINDOW_SIZE_GROW_MAX) {
+                /* New mappings are placed right below the previous ones, hence there's usually no space to grow
+                 * a window in place. Reserve some address space behind windows at the end of files we write to,
+                 * as those will grow, and map the file into its beginning. */
+                a = mmap(NULL, WINDOW_SIZE_GROW_MAX, PROT_NONE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE, -1, 0);
+                if (a == MAP_FAILED)
+                        a = NULL;
+                else
+                        reserved = WINDOW_SIZE_GROW_MAX - wsize;
+        }
+
+        r = mmap_try_harder(m, a, f, prot, a ? MAP_SHARED|MAP_FIXED : MAP_SHARED, woffset, wsize, &d);
+        if (r < 0) {
+                if (a)
+                        (void) munmap(a, WINDOW_SIZE_GROW_MAX);
                 return r;
+        }
+
+        /* Let the kernel know what to expect, so that it can read ahead (or not) accordingly. These are only hints,
+         * hence ignore failures. */
+        if (sequential) {
+                (void) madvise(d, wsize, MADV_SEQUENTIAL);
+                (void) madvise(d, wsize, MADV_WILLNEED);
+                m->n_sequential++;
+        } else if (scattered) {
+                (void) madvise(d, wsize, MADV_RANDOM);
+                m->n_random++;
+        }
+
+        f->last_window_end = woffset + wsize;
 
         c = context_add(m, context);
         if (!c)
@@ -481,6 +587,9 @@ static int add_mmap(
         if (!w)
                 goto outofmem;
 
+        w->at_eof = at_eof;
+        w->reserved = reserved;
+
         context_attach_window(c, w);
 
         *ret = (uint8_t*) w->ptr + (offset - w->offset);
@@ -490,10 +599,97 @@ static int add_mmap(
         return 1;
 
 outofmem:
-        (void) munmap(d, wsize);
+        (void) munmap(d, wsize + reserved);
         return -ENOMEM;
 }
 
+static int grow_mmap(
+                MMapCache *m,
+                MMapFileDescriptor *f,
+                int prot,
+                unsigned context,
+                bool keep_always,
+                uint64_t offset,
+                size_t size,
+                struct stat *st,
+                void **ret,
+                size_t *ret_size) {
+
+        uint64_t wsize;
+        bool at_eof;
+        Context *c;
+        Window *w;
+
+        assert(m);
+        assert(m->n_ref > 0);
+        assert(f);
+        assert(size > 0);
+        assert(ret);
+
+        /* Files that are written to grow at the end, and objects are appended right where the previous window
+         * was clamped to the old file size, or close to it. Instead of mapping a new window for them, extend the
+         * old one, into the address space reserved for that by add_mmap(), or with mremap() otherwise. The
+         * mapping must not move, as pointers into the window may have been handed out already, hence the
+         * latter only works if the address space right after the window happens to be free. */
+
+        if (!st || f->sigbus)
+                return 0;
+
+        LIST_FOREACH(by_fd, w, f->windows)
+                if (w->at_eof &&
+                    w->prot == prot &&
+                    offset >= w->offset)
+                        break;
+        if (!w)
+                return 0;
+
+        if (offset + size > (uint64_t) st->st_size)
+                return 0;
+
+        wsize = PAGE_ALIGN(offset + size - w->offset);
+        if (wsize > WINDOW_SIZE_GROW_MAX)
+                return 0;
+
+        /* Grow in steps of a regular window size, so that we don't have to do this for every single object */
+        wsize = MIN(MAX(wsize, w->size + WINDOW_SIZE), WINDOW_SIZE_GROW_MAX);
+        at_eof = w->offset + wsize >= (uint64_t) st->st_size;
+        if (at_eof)
+                wsize = PAGE_ALIGN(st->st_size - w->offset);
+        if (wsize <= w->size)
+                return 0;
+
+        if (wsize - w->size <= w->reserved) {
+                /* Map the file over the address space we reserved for this */
+                if (mmap((uint8_t*) w->ptr + w->size, wsize - w->size, prot, MAP_SHARED|MAP_FIXED,
+                         f->fd, w->offset + w->size) == MAP_FAILED)
+                        return 0;
+
+                w->reserved -= wsize - w->size;
+
+        } else if (mremap(w->ptr, w->size, wsize, 0) == MAP_FAILED) {
+                w->at_eof = false; /* Don't try again */
+                return 0;
+        }
+
+        w->size = wsize;
+        w->at_eof = at_eof;
+        f->last_window_end = MAX(f->last_window_end, w->offset + w->size);
+        m->n_grown++;
+
+        c = context_add(m, context);
+        if (!c)
+                return -ENOMEM;
+
+        context_attach_window(c, w);
+        w->keep_always = w->keep_always || keep_always;
+
+        *ret = (uint8_t*) w->ptr + (offset - w->offset);
+        if (ret_size)
+                *ret_size = w->size - (offset - w->offset);
+
+        return 1;
+}
+
 int mmap_cache_get(
                 MMapCache *m,
                 MMapFileDescriptor *f,
@@ -518,17 +714,22 @@ int mmap_cache_get(
         /* Check whether the current context is the right one already */
         r = try_context(m, f, prot, context, keep_always, offset, size, ret, ret_size);
         if (r != 0) {
-                m->n_hit++;
+                m->n_context_hit++;
                 return r;
         }
 
         /* Search for a matching mmap */
         r = find_mmap(m, f, prot, context, keep_always, offset, size, ret, ret_size);
         if (r != 0) {
-                m->n_hit++;
+                m->n_window_hit++;
                 return r;
         }
 
+        /* Extend a window at the end of the file */
+        r = grow_mmap(m, f, prot, context, keep_always, offset, size, st, ret, ret_size);
+        if (r != 0)
+                return r;
+
         m->n_missed++;
 
         /* Create a new mmap */
@@ -538,7 +739,7 @@ int mmap_cache_get(
 unsigned mmap_cache_get_hit(MMapCache *m) {
         assert(m);
 
-        return m->n_hit;
+        return m->n_context_hit + m->n_window_hit;
 }
 
 unsigned mmap_cache_get_missed(MMapCache *m) {
@@ -547,6 +748,31 @@ unsigned mmap_cache_get_missed(MMapCache *m) {
         return m->n_missed;
 }
 
+void mmap_cache_get_stats(MMapCache *m, MMapCacheStats *ret) {
+        assert(m);
+        assert(ret);
+
+        *ret = (MMapCacheStats) {
+                .n_context_hit = m->n_context_hit,
+                .n_window_hit = m->n_window_hit,
+                .n_missed = m->n_missed,
+                .n_evicted = m->n_evicted,
+                .n_sequential = m->n_sequential,
+                .n_random = m->n_random,
+                .n_windows = m->n_windows,
+                .n_grown = m->n_grown,
+        };
+}
+
+void mmap_cache_stats_log_debug(MMapCache *m) {
+        assert(m);
+
+        log_debug("mmap cache statistics: %u context hit, %u window list hit, %u miss, %u evicted, "
+                  "%u sequential windows, %u random windows, %u windows allocated, %u windows grown",
+                  m->n_context_hit, m->n_window_hit, m->n_missed, m->n_evicted,
+                  m->n_sequential, m->n_random, m->n_windows, m->n_grown);
+}
+
 static void mmap_cache_process_sigbus(MMapCache *m) {
         bool found = false;
         MMapFileDescriptor *f;
@@ -5,11 +5,22 @@
 #include <sys/stat.h>
 
 /* One context per object type, plus one of the header, plus one "additional" one */
-#define MMAP_CACHE_MAX_CONTEXTS 9
+#define MMAP_CACHE_MAX_CONTEXTS 13
 
 typedef struct MMapCache MMapCache;
 typedef struct MMapFileDescriptor MMapFileDescriptor;
 
+typedef struct MMapCacheStats {
+        unsigned n_context_hit;  /* the context's current window matched */
+        unsigned n_window_hit;   /* some other window of the file matched */
+        unsigned n_missed;       /* a new window had to be mapped */
+        unsigned n_evicted;      /* an unused window was unmapped to make room */
+        unsigned n_sequential;   /* windows mapped for a forward scan */
+        unsigned n_random;       /* windows mapped for random access */
+        unsigned n_windows;      /* windows currently allocated */
+        unsigned n_grown;        /* windows extended in place as the file grew */
+} MMapCacheStats;
+
 MMapCache* mmap_cache_new(void);
 MMapCache* mmap_cache_ref(MMapCache *m);
 MMapCache* mmap_cache_unref(MMapCache *m);
@@ -30,5 +41,8 @@ void mmap_cache_free_fd(MMapCache *m, MMapFileDescriptor *f);
 
 unsigned mmap_cache_get_hit(MMapCache *m);
 unsigned mmap_cache_get_missed(MMapCache *m);
+void mmap_cache_get_stats(MMapCache *m, MMapCacheStats *ret);
+void mmap_cache_stats_log_debug(MMapCache *m);
+unsigned mmap_cache_trim(MMapCache *m);
 
 bool mmap_cache_got_sigbus(MMapCache *m, MMapFileDescriptor *f);
@@ -35,6 +35,7 @@
 #include "path-util.h"
 #include "process-util.h"
 #include "replace-var.h"
+#include "set.h"
 #include "stat-util.h"
 #include "stat-util.h"
 #include "stdio-util.h"
@@ -113,6 +114,8 @@ static void detach_location(sd_journal *j) {
 
         ORDERED_HASHMAP_FOREACH(f, j->files, i)
                 journal_file_reset_location(f);
+
+        j->files_prioq = prioq_free(j->files_prioq);
 }
 
 static void reset_location(sd_journal *j) {
@@ -483,6 +486,17 @@ _pure_ static int compare_with_location(JournalFile *f, Location *l) {
         return 0;
 }
 
+static uint64_t match_hash(Match *m, JournalFile *f) {
+        assert(m);
+        assert(f);
+
+        /* The hash cached in the match is the unkeyed one, files using the keyed hash need their own */
+        if (JOURNAL_HEADER_KEYED_HASH(f->header))
+                return journal_file_hash_data(f, m->data, m->size);
+
+        return le64toh(m->le_hash);
+}
+
 static int next_for_match(
                 sd_journal *j,
                 Match *m,
@@ -503,7 +517,7 @@ static int next_for_match(
         if (m->type == MATCH_DISCRETE) {
                 uint64_t dp;
 
-                r = journal_file_find_data_object_with_hash(f, m->data, m->size, le64toh(m->le_hash), NULL, &dp);
+                r = journal_file_find_data_object_with_hash(f, m->data, m->size, match_hash(m, f), NULL, &dp);
                 if (r <= 0)
                         return r;
 
@@ -592,7 +606,7 @@ static int find_location_for_match(
         if (m->type == MATCH_DISCRETE) {
                 uint64_t dp;
 
-                r = journal_file_find_data_object_with_hash(f, m->data, m->size, le64toh(m->le_hash), NULL, &dp);
+                r = journal_file_find_data_object_with_hash(f, m->data, m->size, match_hash(m, f), NULL, &dp);
                 if (r <= 0)
                         return r;
 
@@ -803,23 +817,167 @@ static int next_beyond_location(sd_journal *j, JournalFile *f, direction_t direc
         }
 }
 
-static int real_journal_next(sd_journal *j, direction_t direction) {
-        JournalFile *new_file = NULL;
+/* Files which are queued without a candidate entry are ordered by the sequence number of the first or last entry
+ * in them, which is where the candidate will be at most. This is only done if all files share the same sequence
+ * number source, as entries are then ordered by their sequence numbers. */
+static uint64_t file_prioq_seqnum(JournalFile *f, direction_t direction) {
+        if (!f->prioq_pending)
+                return f->current_seqnum;
+
+        return le64toh(direction == DIRECTION_DOWN ? f->header->head_entry_seqnum : f->header->tail_entry_seqnum);
+}
+
+static int compare_files_down(const void *a, const void *b) {
+        JournalFile *af = (JournalFile*) a, *bf = (JournalFile*) b;
+
+        if (af->prioq_pending || bf->prioq_pending)
+                return CMP(file_prioq_seqnum(af, DIRECTION_DOWN), file_prioq_seqnum(bf, DIRECTION_DOWN));
+
+        return journal_file_compare_locations(af, bf);
+}
+
+static int compare_files_up(const void *a, const void *b) {
+        JournalFile *af = (JournalFile*) a, *bf = (JournalFile*) b;
+
+        if (af->prioq_pending || bf->prioq_pending)
+                return CMP(file_prioq_seqnum(bf, DIRECTION_UP), file_prioq_seqnum(af, DIRECTION_UP));
+
+        return journal_file_compare_locations(bf, af);
+}
+
+static bool files_share_seqnum_id(const void **files, unsigned n_files) {
+        unsigned i;
+
+        for (i = 1; i < n_files; i++)
+                if (!sd_id128_equal(((JournalFile*) files[0])->header->seqnum_id,
+                                    ((JournalFile*) files[i])->header->seqnum_id))
+                        return false;
+
+        return true;
+}
+
+static bool file_is_behind_location(JournalFile *f, const Location *l, direction_t direction) {
+        assert(f);
+        assert(l);
+
+        /* Returns true if the sequence numbers in the header say that all entries of the file are before the
+         * location, in the direction we are going. */
+
+        if (l->type != LOCATION_DISCRETE || !l->seqnum_set || !sd_id128_equal(l->seqnum_id, f->header->seqnum_id))
+                return false;
+
+        if (direction == DIRECTION_DOWN)
+                return le64toh(f->header->tail_entry_seqnum) < l->seqnum;
+        else
+                return le64toh(f->header->head_entry_seqnum) > l->seqnum;
+}
+
+static int fill_files_prioq(sd_journal *j, direction_t direction) {
+        _cleanup_(prioq_freep) Prioq *q = NULL;
         unsigned i, n_files;
         const void **files;
-        Object *o;
+        bool lazy;
         int r;
 
-        assert_return(j, -EINVAL);
-        assert_return(!journal_pid_changed(j), -ECHILD);
+        assert(j);
+
+        j->files_prioq = prioq_free(j->files_prioq);
+
+        q = prioq_new(direction == DIRECTION_DOWN ? compare_files_down : compare_files_up);
+        if (!q)
+                return -ENOMEM;
 
         r = iterated_cache_get(j->files_cache, NULL, &files, &n_files);
         if (r < 0)
                 return r;
 
+        /* Archived files do not change anymore, hence the sequence numbers in their headers tell where their entries
+         * are. Let's only look for a candidate entry in them when it is their turn, so that we don't have to touch old
+         * files at all when only the most recent entries are shown. */
+        lazy = files_share_seqnum_id(files, n_files);
+
         for (i = 0; i < n_files; i++) {
                 JournalFile *f = (JournalFile *)files[i];
-                bool found;
+
+                f->prioq_idx = PRIOQ_IDX_NULL;
+                f->prioq_pending = false;
+
+                if (file_is_behind_location(f, &j->current_location, direction)) {
+                        f->location_type = LOCATION_TAIL;
+                        continue;
+                }
+
+                f->prioq_pending = lazy &&
+                        f->header->state == STATE_ARCHIVED &&
+                        le64toh(f->header->n_entries) > 0;
+
+                if (!f->prioq_pending) {
+                        r = next_beyond_location(j, f, direction);
+                        if (r < 0) {
+                                log_debug_errno(r, "Can't iterate through %s, ignoring: %m", f->path);
+                                remove_file_real(j, f);
+                                continue;
+                        } else if (r == 0) {
+                                f->location_type = LOCATION_TAIL;
+                                continue;
+                        }
+                }
+
+                r = prioq_put(q, f, &f->prioq_idx);
+                if (r < 0)
+                        return r;
+        }
+
+        j->files_prioq = TAKE_PTR(q);
+        j->files_prioq_direction = direction;
+
+        return 0;
+}
+
+static int real_journal_next(sd_journal *j, direction_t direction) {
+        JournalFile *f;
+        bool filled = false;
+        Object *o;
+        int r;
+
+        assert_return(j, -EINVAL);
+        assert_return(!journal_pid_changed(j), -ECHILD);
+
+        /* Every file in the priority queue already points to its next candidate entry beyond the previous location,
+         * hence only the file we returned the last entry from, and those which have a duplicate of it, need to be
+         * advanced. Files without a candidate are only looked at again when the queue is recalculated, which
+         * happens when files are added or removed, on seeks, direction changes, and before we report EOF. */
+
+        for (;;) {
+                uint64_t offset;
+
+                if (!j->files_prioq || j->files_prioq_direction != direction) {
+                        r = fill_files_prioq(j, direction);
+                        if (r < 0)
+                                return r;
+
+                        filled = true;
+                }
+
+                f = prioq_peek(j->files_prioq);
+                if (!f) {
+                        if (filled)
+                                return 0;
+
+                        /* Entries might have been appended to files that hit EOF earlier, let's check again */
+                        j->files_prioq = prioq_free(j->files_prioq);
+                        continue;
+                }
+
+                offset = f->current_offset;
+
+                if (f->prioq_pending) {
+                        /* Now we need to know the actual candidate, and to requeue the file with it. Look for it
+                         * from the current location, not from wherever we were in this file before. */
+                        f->prioq_pending = false;
+                        f->last_direction = direction == DIRECTION_DOWN ? DIRECTION_UP : DIRECTION_DOWN;
+                        offset = 0;
+                }
 
                 r = next_beyond_location(j, f, direction);
                 if (r < 0) {
@@ -828,31 +986,24 @@ static int real_journal_next(sd_journal *j, direction_t direction) {
                         continue;
                 } else if (r == 0) {
                         f->location_type = LOCATION_TAIL;
+                        (void) prioq_remove(j->files_prioq, f, &f->prioq_idx);
                         continue;
                 }
 
-                if (!new_file)
-                        found = true;
-                else {
-                        int k;
-
-                        k = journal_file_compare_locations(f, new_file);
-
-                        found = direction == DIRECTION_DOWN ? k < 0 : k > 0;
-                }
+                /* Still the same candidate, hence it is beyond the current location and earlier than all others */
+                if (f->current_offset == offset)
+                        break;
 
-                if (found)
-                        new_file = f;
+                r = prioq_reshuffle(j->files_prioq, f, &f->prioq_idx);
+                if (r < 0)
+                        return r;
         }
 
-        if (!new_file)
-                return 0;
-
-        r = journal_file_move_to_object(new_file, OBJECT_ENTRY, new_file->current_offset, &o);
+        r = journal_file_move_to_object(f, OBJECT_ENTRY, f->current_offset, &o);
         if (r < 0)
                 return r;
 
-        set_location(j, new_file, o);
+        set_location(j, f, o);
 
         return 1;
 }
@@ -1340,6 +1491,7 @@ static int add_any_file(
         track_file_disposition(j, f);
         check_network(j, f->fd);
 
+        j->files_prioq = prioq_free(j->files_prioq);
         j->current_invalidate_counter++;
 
         log_debug("File %s added.", f->path);
@@ -1428,6 +1580,9 @@ static void remove_file_real(sd_journal *j, JournalFile *f) {
                         j->fields_file_lost = true;
         }
 
+        /* Drop the priority queue before closing the file, it might still reference it */
+        j->files_prioq = prioq_free(j->files_prioq);
+
         (void) journal_file_close(f);
 
         j->current_invalidate_counter++;
@@ -2060,6 +2215,7 @@ _public_ void sd_journal_close(sd_journal *j) {
 
         sd_journal_flush_matches(j);
 
+        prioq_free(j->files_prioq);
         ordered_hashmap_free_with_destructor(j->files, journal_file_close);
         iterated_cache_free(j->files_cache);
 
@@ -2075,7 +2231,7 @@ _public_ void sd_journal_close(sd_journal *j) {
         safe_close(j->inotify_fd);
 
         if (j->mmap) {
-                log_debug("mmap cache statistics: %u hit, %u miss", mmap_cache_get_hit(j->mmap), mmap_cache_get_missed(j->mmap));
+                mmap_cache_stats_log_debug(j->mmap);
                 mmap_cache_unref(j->mmap);
         }
 
@@ -2084,6 +2240,7 @@ _public_ void sd_journal_close(sd_journal *j) {
         free(j->path);
         free(j->prefix);
         free(j->unique_field);
+        set_free(j->unique_values);
         free(j->fields_buffer);
         free(j);
 }
@@ -2224,8 +2381,14 @@ _public_ int sd_journal_get_data(sd_journal *j, const char *field, const void **
 
                 compression = o->object.flags & OBJECT_COMPRESSION_MASK;
                 if (compression) {
-#if HAVE_XZ || HAVE_LZ4
-                        r = decompress_startswith(compression,
+#if HAVE_COMPRESSION
+                        CompressDictionary *dict;
+
+                        r = journal_file_get_compress_dictionary(f, compression, &dict);
+                        if (r < 0)
+                                return r;
+
+                        r = decompress_startswith(compression, dict,
                                                   o->data.payload, l,
                                                   &f->compress_buffer, &f->compress_buffer_size,
                                                   field, field_length, '=');
@@ -2236,7 +2399,7 @@ _public_ int sd_journal_get_data(sd_journal *j, const char *field, const void **
 
                                 size_t rsize;
 
-                                r = decompress_blob(compression,
+                                r = decompress_blob(compression, dict,
                                                     o->data.payload, l,
                                                     &f->compress_buffer, &f->compress_buffer_size, &rsize,
                                                     j->data_threshold);
@@ -2288,11 +2451,16 @@ static int return_data(sd_journal *j, JournalFile *f, Object *o, const void **da
 
         compression = o->object.flags & OBJECT_COMPRESSION_MASK;
         if (compression) {
-#if HAVE_XZ || HAVE_LZ4
+#if HAVE_COMPRESSION
+                CompressDictionary *dict;
                 size_t rsize;
                 int r;
 
-                r = decompress_blob(compression,
+                r = journal_file_get_compress_dictionary(f, compression, &dict);
+                if (r < 0)
+                        return r;
+
+                r = decompress_blob(compression, dict,
                                     o->data.payload, l, &f->compress_buffer,
                                     &f->compress_buffer_size, &rsize, j->data_threshold);
                 if (r < 0)
@@ -2356,6 +2524,79 @@ _public_ int sd_journal_enumerate_data(sd_journal *j, const void **data, size_t
         return 1;
 }
 
+int journal_enumerate_data_payload(sd_journal *j, JournalFilePayload *ret) {
+        JournalFile *f;
+        uint64_t p, n, l;
+        le64_t le_hash;
+        int r, compression;
+        Object *o;
+
+        assert(j);
+        assert(ret);
+
+        /* Like sd_journal_enumerate_data(), but returns the payload of the data object as it is stored in the
+         * file, i.e. without decompressing it. Payloads that can only be decompressed with the compression
+         * dictionary of the file are returned decompressed, since they are useless anywhere else. */
+
+        f = j->current_file;
+        if (!f)
+                return -EADDRNOTAVAIL;
+
+        if (f->current_offset <= 0)
+                return -EADDRNOTAVAIL;
+
+        r = journal_file_move_to_object(f, OBJECT_ENTRY, f->current_offset, &o);
+        if (r < 0)
+                return r;
+
+        n = journal_file_entry_n_items(o);
+        if (j->current_field >= n)
+                return 0;
+
+        p = le64toh(o->entry.items[j->current_field].object_offset);
+        le_hash = o->entry.items[j->current_field].hash;
+        r = journal_file_move_to_object(f, OBJECT_DATA, p, &o);
+        if (r < 0)
+                return r;
+
+        if (le_hash != o->data.hash)
+                return -EBADMSG;
+
+        compression = o->object.flags & OBJECT_COMPRESSION_MASK;
+        if (compression == OBJECT_COMPRESSED_ZSTD &&
+            JOURNAL_HEADER_CONTAINS(f->header, zstd_dictionary_offset) &&
+            f->header->zstd_dictionary_offset != 0)
+                compression = 0;
+
+        if (compression) {
+                l = le64toh(o->object.size) - offsetof(Object, data.payload);
+                if ((uint64_t) (size_t) l != l)
+                        return -E2BIG;
+
+                *ret = (JournalFilePayload) {
+                        .compression = compression,
+                        .data = o->data.payload,
+                        .size = (size_t) l,
+                };
+        } else {
+                const void *data;
+                size_t size;
+
+                r = return_data(j, f, o, &data, &size);
+                if (r < 0)
+                        return r;
+
+                *ret = (JournalFilePayload) {
+                        .data = data,
+                        .size = size,
+                };
+        }
+
+        j->current_field++;
+
+        return 1;
+}
+
 _public_ void sd_journal_restart_data(sd_journal *j) {
         if (!j)
                 return;
@@ -2502,7 +2743,10 @@ static void process_inotify_event(sd_journal *j, struct inotify_event *e) {
                     (endswith(e->name, ".journal") ||
                      endswith(e->name, ".journal~"))) {
 
-                        /* Event for a journal file */
+                        /* Event for a journal file. Entries might have been appended to files we already hit
+                         * EOF on, hence make sure the next iteration looks at all files again. */
+
+                        j->files_prioq = prioq_free(j->files_prioq);
 
                         if (e->mask & (IN_CREATE|IN_MOVED_TO|IN_MODIFY|IN_ATTRIB))
                                 (void) add_file_by_name(j, d->path, e->name);
@@ -2719,6 +2963,73 @@ void journal_print_header(sd_journal *j) {
         }
 }
 
+static int boot_info_compare_id(const JournalBootInfo *a, const JournalBootInfo *b) {
+        return memcmp(&a->boot_id, &b->boot_id, sizeof(sd_id128_t));
+}
+
+static int boot_info_compare_realtime(const JournalBootInfo *a, const JournalBootInfo *b) {
+        int r;
+
+        r = CMP(a->first_realtime, b->first_realtime);
+        if (r != 0)
+                return r;
+
+        return CMP(a->last_realtime, b->last_realtime);
+}
+
+int journal_get_boots(sd_journal *j, JournalBootInfo **ret, size_t *ret_n) {
+        _cleanup_free_ JournalBootInfo *boots = NULL;
+        size_t n = 0, allocated = 0, k, m;
+        Iterator i;
+        JournalFile *f;
+        int r;
+
+        assert(j);
+        assert(ret);
+        assert(ret_n);
+
+        /* Returns all boots of all files, ordered by their first entry. This only looks at the per-file boot
+         * summaries, and doesn't iterate through entries. Boots that span multiple files are merged. */
+
+        ORDERED_HASHMAP_FOREACH(f, j->files, i) {
+                _cleanup_free_ JournalBootInfo *file_boots = NULL;
+                size_t n_file_boots;
+
+                r = journal_file_get_boots(f, &file_boots, &n_file_boots);
+                if (r < 0)
+                        return log_debug_errno(r, "Failed to determine boots in %s: %m", f->path);
+
+                if (!GREEDY_REALLOC(boots, allocated, n + n_file_boots))
+                        return -ENOMEM;
+
+                memcpy_safe(boots + n, file_boots, n_file_boots * sizeof(JournalBootInfo));
+                n += n_file_boots;
+        }
+
+        typesafe_qsort(boots, n, boot_info_compare_id);
+
+        for (k = 0, m = 0; k < n; k++) {
+                if (m > 0 && sd_id128_equal(boots[m-1].boot_id, boots[k].boot_id)) {
+                        JournalBootInfo *b = boots + m - 1;
+
+                        b->first_seqnum = MIN(b->first_seqnum, boots[k].first_seqnum);
+                        b->last_seqnum = MAX(b->last_seqnum, boots[k].last_seqnum);
+                        b->first_realtime = MIN(b->first_realtime, boots[k].first_realtime);
+                        b->last_realtime = MAX(b->last_realtime, boots[k].last_realtime);
+                        continue;
+                }
+
+                boots[m++] = boots[k];
+        }
+
+        typesafe_qsort(boots, m, boot_info_compare_realtime);
+
+        *ret = TAKE_PTR(boots);
+        *ret_n = m;
+
+        return 0;
+}
+
 _public_ int sd_journal_get_usage(sd_journal *j, uint64_t *bytes) {
         Iterator i;
         JournalFile *f;
@@ -2741,6 +3052,60 @@ _public_ int sd_journal_get_usage(sd_journal *j, uint64_t *bytes) {
         return 0;
 }
 
+typedef struct UniqueValue {
+        uint64_t hash; /* the unkeyed hash64(), as stored in the data objects of files not using the keyed hash */
+        size_t size;
+        uint8_t data[];
+} UniqueValue;
+
+static void unique_value_hash_func(const UniqueValue *v, struct siphash *state) {
+        siphash24_compress(&v->hash, sizeof(v->hash), state);
+}
+
+static int unique_value_compare_func(const UniqueValue *a, const UniqueValue *b) {
+        int r;
+
+        r = CMP(a->hash, b->hash);
+        if (r != 0)
+                return r;
+
+        r = CMP(a->size, b->size);
+        if (r != 0)
+                return r;
+
+        return memcmp(a->data, b->data, a->size);
+}
+
+DEFINE_PRIVATE_HASH_OPS_WITH_KEY_DESTRUCTOR(unique_value_hash_ops, UniqueValue, unique_value_hash_func, unique_value_compare_func, free);
+
+static int unique_value_remember(sd_journal *j, uint64_t hash, const void *data, size_t size) {
+        UniqueValue *v;
+        int r;
+
+        assert(j);
+        assert(data || size == 0);
+
+        /* Returns > 0 if the value was not returned before, and 0 if it was */
+
+        r = set_ensure_allocated(&j->unique_values, &unique_value_hash_ops);
+        if (r < 0)
+                return r;
+
+        v = malloc(offsetof(UniqueValue, data) + size);
+        if (!v)
+                return -ENOMEM;
+
+        v->hash = hash;
+        v->size = size;
+        memcpy_safe(v->data, data, size);
+
+        r = set_put(j->unique_values, v);
+        if (r <= 0)
+                free(v);
+
+        return r;
+}
+
 _public_ int sd_journal_query_unique(sd_journal *j, const char *field) {
         char *f;
 
@@ -2758,6 +3123,7 @@ _public_ int sd_journal_query_unique(sd_journal *j, const char *field) {
         j->unique_file = NULL;
         j->unique_offset = 0;
         j->unique_file_lost = false;
+        j->unique_values = set_free(j->unique_values);
 
         return 0;
 }
@@ -2785,12 +3151,9 @@ _public_ int sd_journal_enumerate_unique(sd_journal *j, const void **data, size_
         }
 
         for (;;) {
-                JournalFile *of;
-                Iterator i;
                 Object *o;
                 const void *odata;
                 size_t ol;
-                bool found;
                 int r;
 
                 /* Proceed to next data object in the field's linked list */
@@ -2850,34 +3213,19 @@ _public_ int sd_journal_enumerate_unique(sd_journal *j, const void **data, size_
                                                j->unique_offset,
                                                j->unique_field);
 
-                /* OK, now let's see if we already returned this data
-                 * object by checking if it exists in the earlier
-                 * traversed files. */
-                found = false;
-                ORDERED_HASHMAP_FOREACH(of, j->files, i) {
-                        if (of == j->unique_file)
-                                break;
-
-                        /* Skip this file it didn't have any fields indexed */
-                        if (JOURNAL_HEADER_CONTAINS(of->header, n_fields) && le64toh(of->header->n_fields) <= 0)
-                                continue;
-
-                        r = journal_file_find_data_object_with_hash(of, odata, ol, le64toh(o->data.hash), NULL, NULL);
-                        if (r < 0)
-                                return r;
-                        if (r > 0) {
-                                found = true;
-                                break;
-                        }
-                }
-
-                if (found)
-                        continue;
-
-                r = return_data(j, j->unique_file, o, data, l);
+                /* OK, now let's see if we already returned this data object. Instead of looking it up in all
+                 * earlier traversed files, which is quadratic in the number of files, we remember the values
+                 * we returned. */
+                r = unique_value_remember(j,
+                                          JOURNAL_HEADER_KEYED_HASH(j->unique_file->header) ? hash64(odata, ol) : le64toh(o->data.hash),
+                                          odata, ol);
                 if (r < 0)
                         return r;
+                if (r == 0)
+                        continue;
 
+                *data = odata;
+                *l = ol;
                 return 1;
         }
 }
@@ -2889,6 +3237,7 @@ _public_ void sd_journal_restart_unique(sd_journal *j) {
         j->unique_file = NULL;
         j->unique_offset = 0;
         j->unique_file_lost = false;
+        j->unique_values = set_free(j->unique_values);
 }
 
 _public_ int sd_journal_enumerate_fields(sd_journal *j, const char **field) {
@@ -2997,7 +3346,11 @@ _public_ int sd_journal_enumerate_fields(sd_journal *j, const char **field) {
                         if (JOURNAL_HEADER_CONTAINS(of->header, n_fields) && le64toh(of->header->n_fields) <= 0)
                                 continue;
 
-                        r = journal_file_find_field_object_with_hash(of, o->field.payload, sz, le64toh(o->field.hash), NULL, NULL);
+                        /* The stored hash is only valid for the other file if both use the same hash function */
+                        if (JOURNAL_HEADER_KEYED_HASH(f->header) || JOURNAL_HEADER_KEYED_HASH(of->header))
+                                r = journal_file_find_field_object(of, o->field.payload, sz, NULL, NULL);
+                        else
+                                r = journal_file_find_field_object_with_hash(of, o->field.payload, sz, le64toh(o->field.hash), NULL, NULL);
                         if (r < 0)
                                 return r;
                         if (r > 0) {
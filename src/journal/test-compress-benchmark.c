@@ -1,8 +1,12 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 
 #include "alloc-util.h"
+#include "sd-journal.h"
+
 #include "compress.h"
 #include "env-util.h"
+#include "io-util.h"
+#include "journal-def.h"
 #include "macro.h"
 #include "parse-util.h"
 #include "process-util.h"
@@ -16,12 +20,13 @@ typedef int (compress_t)(const void *src, uint64_t src_size, void *dst,
 typedef int (decompress_t)(const void *src, uint64_t src_size,
                            void **dst, size_t *dst_alloc_size, size_t* dst_size, size_t dst_max);
 
-#if HAVE_XZ || HAVE_LZ4
+#if HAVE_COMPRESSION
 
-static usec_t arg_duration;
+static uint64_t arg_size;
 static size_t arg_start;
 
 #define MAX_SIZE (1024*1024LU)
+#define JOURNAL_DATA_MAX 20000U
 #define PRIME 1048571  /* A prime close enough to one megabyte that mod 4 == 3 */
 
 static size_t _permute(size_t x) {
@@ -72,23 +77,23 @@ static char* make_buf(size_t count, const char *type) {
         return buf;
 }
 
-static void test_compress_decompress(const char* label, const char* type,
-                                     compress_t compress, decompress_t decompress) {
-        usec_t n, n2 = 0;
-        float dt;
+typedef struct CompressBenchmark {
+        const char *type;
+        compress_t *compress;
+        decompress_t *decompress;
+        size_t n_sizes;
+        char *text, *buf;
+        void *buf2;
+        size_t buf2_allocated;
+        size_t skipped, compressed, total;
+} CompressBenchmark;
 
-        _cleanup_free_ char *text, *buf;
-        _cleanup_free_ void *buf2 = NULL;
-        size_t buf2_allocated = 0;
-        size_t skipped = 0, compressed = 0, total = 0;
+static void compress_decompress(void *userdata) {
+        CompressBenchmark *b = userdata;
 
-        text = make_buf(MAX_SIZE, type);
-        buf = calloc(MAX_SIZE + 1, 1);
-        assert_se(text && buf);
+        b->skipped = b->compressed = b->total = 0;
 
-        n = now(CLOCK_MONOTONIC);
-
-        for (size_t i = 0; i <= MAX_SIZE; i++) {
+        for (size_t i = 0; i < b->n_sizes; i++) {
                 size_t j = 0, k = 0, size;
                 int r;
 
@@ -96,67 +101,282 @@ static void test_compress_decompress(const char* label, const char* type,
                 if (size == 0)
                         continue;
 
-                log_debug("%s %zu %zu", type, i, size);
+                log_debug("%s %zu %zu", b->type, i, size);
 
-                memzero(buf, MIN(size + 1000, MAX_SIZE));
+                memzero(b->buf, MIN(size + 1000, MAX_SIZE));
 
-                r = compress(text, size, buf, size, &j);
+                r = b->compress(b->text, size, b->buf, size, &j);
                 /* assume compression must be successful except for small or random inputs */
-                assert_se(r == 0 || (size < 2048 && r == -ENOBUFS) || streq(type, "random"));
+                assert_se(r == 0 || (size < 2048 && r == -ENOBUFS) || streq(b->type, "random"));
 
                 /* check for overwrites */
-                assert_se(buf[size] == 0);
+                assert_se(b->buf[size] == 0);
                 if (r != 0) {
-                        skipped += size;
+                        b->skipped += size;
                         continue;
                 }
 
                 assert_se(j > 0);
                 if (j >= size)
-                        log_error("%s \"compressed\" %zu -> %zu", label, size, j);
+                        log_error("%s \"compressed\" %zu -> %zu", b->type, size, j);
 
-                r = decompress(buf, j, &buf2, &buf2_allocated, &k, 0);
+                r = b->decompress(b->buf, j, &b->buf2, &b->buf2_allocated, &k, 0);
                 assert_se(r == 0);
-                assert_se(buf2_allocated >= k);
+                assert_se(b->buf2_allocated >= k);
                 assert_se(k == size);
 
-                assert_se(memcmp(text, buf2, size) == 0);
+                assert_se(memcmp(b->text, b->buf2, size) == 0);
+
+                b->total += size;
+                b->compressed += j;
+        }
+}
+
+static void test_compress_decompress(const char* label, const char* type,
+                                     compress_t compress, decompress_t decompress) {
+        _cleanup_free_ char *text = NULL, *buf = NULL;
+        CompressBenchmark b = {
+                .type = type,
+                .compress = compress,
+                .decompress = decompress,
+        };
+        uint64_t bytes = 0;
+        const char *name;
+
+        text = make_buf(MAX_SIZE, type);
+        buf = calloc(MAX_SIZE + 1, 1);
+        assert_se(text && buf);
 
-                total += size;
-                compressed += j;
+        /* Always go through the same sizes, so that the runs are comparable */
+        for (b.n_sizes = 0; b.n_sizes <= MAX_SIZE && bytes < arg_size; b.n_sizes++)
+                bytes += permute(b.n_sizes);
+        if (bytes == 0)
+                return;
+
+        b.text = text;
+        b.buf = buf;
+
+        name = strjoina("compress/", label, "/", type);
+        benchmark_run(name, bytes, compress_decompress, &b);
+
+        log_info("%s/%s: compressed & decompressed %zu bytes, mean compression %.2f%%, skipped %zu bytes",
+                 label, type, b.total,
+                 b.total > 0 ? 100 - b.compressed * 100. / b.total : 0.,
+                 b.skipped);
+
+        free(b.buf2);
+}
 
-                n2 = now(CLOCK_MONOTONIC);
-                if (n2 - n > arg_duration)
-                        break;
+static void free_journal_data(struct iovec *fields, size_t n_fields) {
+        size_t i;
+
+        for (i = 0; i < n_fields; i++)
+                free(fields[i].iov_base);
+        free(fields);
+}
+
+static int read_journal_data(struct iovec **ret, size_t *ret_n) {
+        _cleanup_(sd_journal_closep) sd_journal *j = NULL;
+        struct iovec *fields = NULL;
+        size_t n = 0, allocated = 0;
+        int r;
+
+        r = sd_journal_open(&j, SD_JOURNAL_LOCAL_ONLY);
+        if (r < 0)
+                return r;
+
+        /* Use the fields of the most recent entries, as they are what the journal would actually compress */
+        SD_JOURNAL_FOREACH_BACKWARDS(j) {
+                const void *data;
+                size_t length;
+
+                SD_JOURNAL_FOREACH_DATA(j, data, length) {
+                        void *copy;
+
+                        if (n >= JOURNAL_DATA_MAX)
+                                goto finish;
+
+                        copy = memdup(data, length);
+                        if (!copy || !GREEDY_REALLOC(fields, allocated, n + 1)) {
+                                free(copy);
+                                free_journal_data(fields, n);
+                                return -ENOMEM;
+                        }
+
+                        fields[n++] = IOVEC_MAKE(copy, length);
+                }
         }
 
-        dt = (n2-n) / 1e6;
+finish:
+        if (n == 0) {
+                free(fields);
+                return -ENODATA;
+        }
 
-        log_info("%s/%s: compressed & decompressed %zu bytes in %.2fs (%.2fMiB/s), "
-                 "mean compression %.2f%%, skipped %zu bytes",
-                 label, type, total, dt,
-                 total / 1024. / 1024 / dt,
-                 100 - compressed * 100. / total,
-                 skipped);
+        *ret = fields;
+        *ret_n = n;
+        return 0;
+}
+
+typedef struct JournalBenchmark {
+        int compression;
+        CompressDictionary *dict;
+        const struct iovec *fields;
+        size_t n_fields;
+        void *buf, *buf2;
+        size_t buf2_allocated;
+        size_t skipped, compressed, total;
+} JournalBenchmark;
+
+static void compress_decompress_journal(void *userdata) {
+        JournalBenchmark *b = userdata;
+        size_t i;
+
+        b->skipped = b->compressed = b->total = 0;
+
+        for (i = 0; i < b->n_fields; i++) {
+                size_t j = 0, k = 0, size;
+                int r;
+
+                size = MIN(b->fields[i].iov_len, MAX_SIZE);
+
+                /* Like journal_file_append_data(), only keep the result if it is actually smaller */
+                r = compress_blob(b->compression, b->dict, b->fields[i].iov_base, size, b->buf, size, &j);
+                if (r < 0) {
+                        assert_se(r == -ENOBUFS);
+                        b->skipped += size;
+                        b->compressed += size;
+                        b->total += size;
+                        continue;
+                }
+
+                r = decompress_blob(b->compression, b->dict, b->buf, j, &b->buf2, &b->buf2_allocated, &k, 0);
+                assert_se(r == 0);
+                assert_se(k == size);
+                assert_se(memcmp(b->fields[i].iov_base, b->buf2, size) == 0);
+
+                b->total += size;
+                b->compressed += j;
+        }
+}
+
+static void test_journal_data(const char *label, int compression, CompressDictionary *dict,
+                              const struct iovec *fields, size_t n_fields) {
+        _cleanup_free_ void *buf = NULL;
+        JournalBenchmark b = {
+                .compression = compression,
+                .dict = dict,
+                .fields = fields,
+                .n_fields = n_fields,
+        };
+        uint64_t bytes = 0;
+        const char *name;
+        size_t i;
+
+        for (i = 0; i < n_fields; i++)
+                bytes += MIN(fields[i].iov_len, MAX_SIZE);
+        if (bytes == 0)
+                return;
+
+        buf = malloc(MAX_SIZE);
+        assert_se(buf);
+        b.buf = buf;
+
+        name = strjoina("compress/", label, "/journal");
+        benchmark_run(name, bytes, compress_decompress_journal, &b);
+
+        log_info("%s/journal: compressed & decompressed %zu fields, %zu bytes, "
+                 "mean compression %.2f%%, uncompressible %zu bytes",
+                 label, n_fields, b.total,
+                 100 - b.compressed * 100. / b.total,
+                 b.skipped);
+
+        free(b.buf2);
+}
+
+#if HAVE_ZSTD
+static void test_journal_data_zstd_dictionary(const struct iovec *fields, size_t n_fields) {
+        _cleanup_(compress_dictionary_freep) CompressDictionary *d = NULL;
+        _cleanup_free_ size_t *sizes = NULL;
+        _cleanup_free_ uint8_t *samples = NULL;
+        _cleanup_free_ void *dict = NULL;
+        size_t n_samples, samples_size = 0, dict_size, i;
+        int r;
+
+        /* Train on the first half, and measure on the second, so that we don't benchmark on the training set */
+        n_samples = n_fields / 2;
+        if (n_samples == 0)
+                return;
+
+        sizes = new(size_t, n_samples);
+        assert_se(sizes);
+
+        for (i = 0; i < n_samples; i++)
+                samples_size += fields[i].iov_len;
+
+        samples = malloc(samples_size);
+        assert_se(samples);
+
+        samples_size = 0;
+        for (i = 0; i < n_samples; i++) {
+                memcpy(samples + samples_size, fields[i].iov_base, fields[i].iov_len);
+                samples_size += fields[i].iov_len;
+                sizes[i] = fields[i].iov_len;
+        }
+
+        r = compress_dictionary_train(samples, sizes, n_samples, 64*1024, &dict, &dict_size);
+        if (r < 0) {
+                log_info_errno(r, "Failed to train zstd dictionary on journal data, skipping: %m");
+                return;
+        }
+
+        assert_se(compress_dictionary_new(dict, dict_size, &d) >= 0);
+        log_info("Trained %zu byte zstd dictionary from %zu fields", dict_size, n_samples);
+
+        test_journal_data("ZSTD (held out)", OBJECT_COMPRESSED_ZSTD, NULL, fields + n_samples, n_fields - n_samples);
+        test_journal_data("ZSTD+dictionary (held out)", OBJECT_COMPRESSED_ZSTD, d, fields + n_samples, n_fields - n_samples);
+}
+#endif
+
+static void test_journal(void) {
+        struct iovec *fields = NULL;
+        size_t n_fields = 0;
+        int r;
+
+        r = read_journal_data(&fields, &n_fields);
+        if (r < 0) {
+                log_info_errno(r, "Cannot read local journal data, skipping journal benchmark: %m");
+                return;
+        }
+
+#if HAVE_XZ
+        test_journal_data("XZ", OBJECT_COMPRESSED_XZ, NULL, fields, n_fields);
+#endif
+#if HAVE_LZ4
+        test_journal_data("LZ4", OBJECT_COMPRESSED_LZ4, NULL, fields, n_fields);
+#endif
+#if HAVE_ZSTD
+        test_journal_data("ZSTD", OBJECT_COMPRESSED_ZSTD, NULL, fields, n_fields);
+        test_journal_data_zstd_dictionary(fields, n_fields);
+#endif
+
+        free_journal_data(fields, n_fields);
 }
 #endif
 
 int main(int argc, char *argv[]) {
-#if HAVE_XZ || HAVE_LZ4
+#if HAVE_COMPRESSION
         test_setup_logging(LOG_INFO);
 
-        if (argc >= 2) {
-                unsigned x;
-
-                assert_se(safe_atou(argv[1], &x) >= 0);
-                arg_duration = x * USEC_PER_SEC;
-        } else
-                arg_duration = slow_tests_enabled() ?
-                        2 * USEC_PER_SEC : USEC_PER_SEC / 50;
+        if (argc >= 2)
+                assert_se(parse_size(argv[1], 1024, &arg_size) >= 0);
+        else
+                arg_size = slow_tests_enabled() ? 16U << 20 : 256U << 10;
 
+        /* Vary the sizes between test runs, but not between benchmark runs */
         if (argc == 3)
                 (void) safe_atozu(argv[2], &arg_start);
-        else
+        else if (!benchmarks_enabled())
                 arg_start = getpid_cached();
 
         const char *i;
@@ -166,8 +386,13 @@ int main(int argc, char *argv[]) {
 #endif
 #if HAVE_LZ4
                 test_compress_decompress("LZ4", i, compress_blob_lz4, decompress_blob_lz4);
+#endif
+#if HAVE_ZSTD
+                test_compress_decompress("ZSTD", i, compress_blob_zstd, decompress_blob_zstd);
 #endif
         }
+
+        test_journal();
         return 0;
 #else
         return log_tests_skipped("No compression feature is enabled");
@@ -27,6 +27,12 @@
 # define LZ4_OK -EPROTONOSUPPORT
 #endif
 
+#if HAVE_ZSTD
+# define ZSTD_OK 0
+#else
+# define ZSTD_OK -EPROTONOSUPPORT
+#endif
+
 typedef int (compress_blob_t)(const void *src, uint64_t src_size,
                               void *dst, size_t dst_alloc_size, size_t *dst_size);
 typedef int (decompress_blob_t)(const void *src, uint64_t src_size,
@@ -37,10 +43,10 @@ typedef int (decompress_sw_t)(const void *src, uint64_t src_size,
                               const void *prefix, size_t prefix_len,
                               uint8_t extra);
 
-typedef int (compress_stream_t)(int fdf, int fdt, uint64_t max_bytes);
+typedef int (compress_stream_t)(int fdf, int fdt, uint64_t max_bytes, uint64_t *ret_uncompressed_size);
 typedef int (decompress_stream_t)(int fdf, int fdt, uint64_t max_size);
 
-#if HAVE_XZ || HAVE_LZ4
+#if HAVE_COMPRESSION
 static void test_compress_decompress(int compression,
                                      compress_blob_t compress,
                                      decompress_blob_t decompress,
@@ -171,6 +177,7 @@ static void test_compress_stream(int compression,
         int r;
         _cleanup_free_ char *cmd = NULL, *cmd2 = NULL;
         struct stat st = {};
+        uint64_t uncompressed_size;
 
         r = find_binary(cat, NULL);
         if (r < 0) {
@@ -189,7 +196,7 @@ static void test_compress_stream(int compression,
 
         assert_se((dst = mkostemp_safe(pattern)) >= 0);
 
-        assert_se(compress(src, dst, -1) == 0);
+        assert_se(compress(src, dst, -1, &uncompressed_size) == 0);
 
         if (cat) {
                 assert_se(asprintf(&cmd, "%s %s | diff %s -", cat, pattern, srcfile) > 0);
@@ -219,6 +226,23 @@ static void test_compress_stream(int compression,
         assert_se(lseek(dst2, 0, SEEK_SET) == 0);
         r = decompress(dst, dst2, st.st_size - 1);
         assert_se(r == -EFBIG);
+
+        assert_se(uncompressed_size == (uint64_t) st.st_size);
+
+        log_debug("/* test truncated compression */");
+
+        assert_se(lseek(src, 0, SEEK_SET) == 0);
+        assert_se(lseek(dst, 0, SEEK_SET) == 0);
+        assert_se(ftruncate(dst, 0) == 0);
+        assert_se(compress(src, dst, st.st_size / 2, &uncompressed_size) == 0);
+        assert_se(uncompressed_size == (uint64_t) st.st_size / 2);
+
+        assert_se(lseek(dst, 0, SEEK_SET) == 0);
+        assert_se(lseek(dst2, 0, SEEK_SET) == 0);
+        assert_se(ftruncate(dst2, 0) == 0);
+        assert_se(decompress(dst, dst2, st.st_size) == 0);
+        assert_se(fstat(dst2, &st) == 0);
+        assert_se((uint64_t) st.st_size == uncompressed_size);
 }
 #endif
 
@@ -261,8 +285,70 @@ static void test_lz4_decompress_partial(void) {
 }
 #endif
 
+#if HAVE_ZSTD
+static void test_zstd_dictionary(void) {
+        static const char* const users[] = { "root", "lennart", "zbyszek", "yuwata", "poettering", "nobody" };
+        _cleanup_(compress_dictionary_freep) CompressDictionary *d = NULL;
+        _cleanup_free_ void *dict = NULL, *decompressed = NULL;
+        _cleanup_free_ char *samples = NULL;
+        size_t sizes[4096], n = 0, allocated = 0, dict_size, csize_plain, csize_dict, usize = 0, dsize;
+        char compressed[512], compressed_dict[512];
+        const char *message = "MESSAGE=pam_unix(sshd:session): session opened for user lennart by (uid=0)";
+        int r;
+
+        log_info("/* %s */", __func__);
+
+        /* Generate a bunch of similar, but not identical, short messages, like journal data objects usually are */
+        for (size_t i = 0; i < ELEMENTSOF(sizes); i++) {
+                char buf[LINE_MAX];
+                int k;
+
+                if (i % 2 == 0)
+                        k = snprintf(buf, sizeof(buf), "MESSAGE=pam_unix(sshd:session): session %s for user %s by (uid=%zu)",
+                                     i % 3 == 0 ? "opened" : "closed", users[i % ELEMENTSOF(users)], i % 11);
+                else
+                        k = snprintf(buf, sizeof(buf), "MESSAGE=Started Session %zu of user %s.", i, users[i % ELEMENTSOF(users)]);
+                assert_se(k > 0 && (size_t) k < sizeof(buf));
+
+                assert_se(GREEDY_REALLOC(samples, allocated, n + k));
+                memcpy(samples + n, buf, k);
+                n += k;
+                sizes[i] = k;
+        }
+
+        r = compress_dictionary_train(samples, sizes, ELEMENTSOF(sizes), 8*1024, &dict, &dict_size);
+        assert_se(r >= 0);
+        assert_se(dict_size > 0);
+        log_info("Trained dictionary of %zu bytes from %zu bytes of samples", dict_size, n);
+
+        assert_se(compress_dictionary_new(dict, dict_size, &d) >= 0);
+        assert_se(compress_dictionary_id(d) != 0);
+
+        assert_se(compress_blob_zstd(message, strlen(message), compressed, sizeof(compressed), &csize_plain) == 0);
+        assert_se(compress_blob_zstd_dict(message, strlen(message), compressed_dict, sizeof(compressed_dict), &csize_dict, d) == 0);
+        log_info("Compressed %zu bytes to %zu bytes without dictionary, and to %zu bytes with dictionary",
+                 strlen(message), csize_plain, csize_dict);
+        assert_se(csize_dict < csize_plain);
+
+        /* Decompression requires the dictionary */
+        assert_se(decompress_blob_zstd(compressed_dict, csize_dict, &decompressed, &usize, &dsize, 0) == -EBADMSG);
+        assert_se(decompress_blob(OBJECT_COMPRESSED_ZSTD, d, compressed_dict, csize_dict, &decompressed, &usize, &dsize, 0) == 0);
+        assert_se(dsize == strlen(message));
+        assert_se(memcmp(decompressed, message, dsize) == 0);
+
+        /* Frames without dictionary can still be decompressed if one is passed */
+        assert_se(decompress_blob(OBJECT_COMPRESSED_ZSTD, d, compressed, csize_plain, &decompressed, &usize, &dsize, 0) == 0);
+        assert_se(dsize == strlen(message));
+
+        assert_se(decompress_startswith(OBJECT_COMPRESSED_ZSTD, d, compressed_dict, csize_dict,
+                                        &decompressed, &usize, "MESSAGE", STRLEN("MESSAGE"), '=') > 0);
+        assert_se(decompress_startswith(OBJECT_COMPRESSED_ZSTD, d, compressed_dict, csize_dict,
+                                        &decompressed, &usize, "MESSAGE", STRLEN("MESSAGE"), '_') == 0);
+}
+#endif
+
 int main(int argc, char *argv[]) {
-#if HAVE_XZ || HAVE_LZ4
+#if HAVE_COMPRESSION
         const char text[] =
                 "text\0foofoofoofoo AAAA aaaaaaaaa ghost busters barbarbar FFF"
                 "foofoofoofoo AAAA aaaaaaaaa ghost busters barbarbar FFF";
@@ -333,9 +419,35 @@ int main(int argc, char *argv[]) {
         log_info("/* LZ4 test skipped */");
 #endif
 
+#if HAVE_ZSTD
+        test_compress_decompress(OBJECT_COMPRESSED_ZSTD, compress_blob_zstd, decompress_blob_zstd,
+                                 text, sizeof(text), false);
+        test_compress_decompress(OBJECT_COMPRESSED_ZSTD, compress_blob_zstd, decompress_blob_zstd,
+                                 data, sizeof(data), true);
+
+        test_decompress_startswith(OBJECT_COMPRESSED_ZSTD,
+                                   compress_blob_zstd, decompress_startswith_zstd,
+                                   text, sizeof(text), false);
+        test_decompress_startswith(OBJECT_COMPRESSED_ZSTD,
+                                   compress_blob_zstd, decompress_startswith_zstd,
+                                   data, sizeof(data), true);
+        test_decompress_startswith(OBJECT_COMPRESSED_ZSTD,
+                                   compress_blob_zstd, decompress_startswith_zstd,
+                                   huge, sizeof(huge), true);
+
+        test_compress_stream(OBJECT_COMPRESSED_ZSTD, "zstdcat",
+                             compress_stream_zstd, decompress_stream_zstd, srcfile);
+
+        test_decompress_startswith_short(OBJECT_COMPRESSED_ZSTD, compress_blob_zstd, decompress_startswith_zstd);
+
+        test_zstd_dictionary();
+#else
+        log_info("/* ZSTD test skipped */");
+#endif
+
         return 0;
 #else
-        log_info("/* XZ and LZ4 tests skipped */");
+        log_info("/* XZ, LZ4 and ZSTD tests skipped */");
         return EXIT_TEST_SKIP;
 #endif
 }
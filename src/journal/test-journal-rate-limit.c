@@ -0,0 +1,64 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include "journald-rate-limit.h"
+#include "macro.h"
+#include "string-util.h"
+
+static void test_slice_rate_limit(void) {
+        JournalRateLimitSlice *b, *c, *a, *root, *report;
+        JournalRateLimit *r;
+        usec_t ts = USEC_PER_SEC;
+        unsigned i;
+
+        assert_se(r = journal_rate_limit_new());
+
+        assert_se(journal_rate_limit_slice_acquire(r, "a-b.slice", &b) == 1);
+        assert_se(journal_rate_limit_slice_acquire(r, "a-c.slice", &c) == 1);
+        assert_se(journal_rate_limit_slice_acquire(r, "a.slice", &a) == 1);
+        assert_se(journal_rate_limit_slice_acquire(r, "-.slice", &root) == 0);
+        assert_se(!root);
+        assert_se(journal_rate_limit_slice_acquire(r, "foo", &root) < 0);
+
+        assert_se(streq(journal_rate_limit_slice_id(b), "a-b.slice"));
+
+        /* Disabled */
+        assert_se(journal_rate_limit_slice_test(b, 0, 10, 0, ts, NULL) == 1);
+        assert_se(journal_rate_limit_slice_test(b, USEC_PER_SEC, 0, 0, ts, NULL) == 1);
+
+        /* a-b.slice uses up its own budget and the one of a.slice, which a-c.slice shares */
+        for (i = 0; i < 10; i++)
+                assert_se(journal_rate_limit_slice_test(b, USEC_PER_SEC, 10, 0, ts, NULL) == 1);
+
+        assert_se(journal_rate_limit_slice_test(c, USEC_PER_SEC, 10, 0, ts, NULL) == 0);
+        assert_se(journal_rate_limit_slice_test(b, USEC_PER_SEC, 10, 0, ts, NULL) == 0);
+        assert_se(journal_rate_limit_slice_suppressed(a) == 1);
+        assert_se(journal_rate_limit_slice_suppressed(b) == 1);
+        assert_se(journal_rate_limit_slice_suppressed(c) == 0);
+
+        /* A tenth of the interval refills one message, but it's too early to report the suppressed ones */
+        assert_se(journal_rate_limit_slice_test(c, USEC_PER_SEC, 10, 0, ts + USEC_PER_SEC/10, &report) == 1);
+        assert_se(!report);
+        assert_se(journal_rate_limit_slice_test(c, USEC_PER_SEC, 10, 0, ts + USEC_PER_SEC/10, NULL) == 0);
+
+        /* After a full interval the budget is back, and the suppressed messages are reported once */
+        assert_se(journal_rate_limit_slice_test(c, USEC_PER_SEC, 10, 0, ts + 2*USEC_PER_SEC, &report) == 1 + 2);
+        assert_se(report == a);
+        assert_se(journal_rate_limit_slice_test(c, USEC_PER_SEC, 10, 0, ts + 2*USEC_PER_SEC, &report) == 1);
+        assert_se(!report);
+        assert_se(journal_rate_limit_slice_test(b, USEC_PER_SEC, 10, 0, ts + 2*USEC_PER_SEC, &report) == 1 + 1);
+        assert_se(report == b);
+        assert_se(journal_rate_limit_slice_suppressed(a) == 2);
+        assert_se(journal_rate_limit_slice_suppressed(b) == 1);
+
+        journal_rate_limit_slice_unref(a);
+        journal_rate_limit_slice_unref(b);
+        journal_rate_limit_slice_unref(c);
+
+        journal_rate_limit_free(r);
+}
+
+int main(int argc, char *argv[]) {
+        test_slice_rate_limit();
+
+        return 0;
+}
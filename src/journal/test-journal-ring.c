@@ -0,0 +1,227 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <poll.h>
+#include <stdlib.h>
+#include <sys/mount.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "sd-journal.h"
+
+#include "alloc-util.h"
+#include "io-util.h"
+#include "journald-native.h"
+#include "journald-server.h"
+#include "log.h"
+#include "process-util.h"
+#include "stdio-util.h"
+#include "string-util.h"
+#include "strv.h"
+#include "tests.h"
+
+#define N_RING_MESSAGES 100
+
+static const char binary_value[] = "BINARY=line one\nline two\0after a NUL";
+
+static void run_server(Server *s) {
+        /* Process everything the client sent so far, and write it out */
+        while (sd_event_run(s->event, 0) > 0)
+                ;
+
+        server_commit_pending_entries(s);
+}
+
+static void send_message(const char *id, const char *message) {
+        struct iovec iovec[] = {
+                IOVEC_MAKE_STRING(message),
+                IOVEC_MAKE_STRING(id),
+                IOVEC_MAKE((char*) binary_value, sizeof(binary_value) - 1),
+        };
+
+        assert_se(sd_journal_sendv(iovec, ELEMENTSOF(iovec)) == 0);
+}
+
+static void verify_messages(const char *id, char **expected) {
+        _cleanup_(sd_journal_closep) sd_journal *j = NULL;
+        char **e = expected;
+
+        assert_se(sd_journal_open(&j, SD_JOURNAL_RUNTIME_ONLY) >= 0);
+        assert_se(sd_journal_add_match(j, id, 0) >= 0);
+
+        SD_JOURNAL_FOREACH(j) {
+                const void *d;
+                size_t l;
+
+                assert_se(*e);
+
+                assert_se(sd_journal_get_data(j, "MESSAGE", &d, &l) >= 0);
+                assert_se(l == strlen(*e) && memcmp(d, *e, l) == 0);
+
+                assert_se(sd_journal_get_data(j, "BINARY", &d, &l) >= 0);
+                assert_se(l == sizeof(binary_value) - 1 && memcmp(d, binary_value, l) == 0);
+
+                e++;
+        }
+
+        assert_se(!*e);
+}
+
+static void test_ring_round_trip(void) {
+        char id[STRLEN("TEST_RING_ID=") + SD_ID128_STRING_MAX], message[STRLEN("MESSAGE=ring ") + DECIMAL_STR_MAX(unsigned)];
+        _cleanup_strv_free_ char **expected = NULL;
+        sd_id128_t rnd;
+        Server s;
+        unsigned i;
+
+        log_info("/* %s */", __func__);
+
+        assert_se(sd_id128_randomize(&rnd) >= 0);
+        xsprintf(id, "TEST_RING_ID=%s", sd_id128_to_string(rnd, (char[SD_ID128_STRING_MAX]) {}));
+
+        assert_se(unsetenv("LISTEN_FDS") >= 0);
+        assert_se(server_init(&s) >= 0);
+
+        assert_se(setenv("SYSTEMD_JOURNAL_RING_SIZE", "64K", true) >= 0);
+
+        /* journald didn't accept the ring yet, but reads what was put into it once it did */
+        send_message(id, "MESSAGE=first");
+        assert_se(strv_extend(&expected, "MESSAGE=first") >= 0);
+        run_server(&s);
+        assert_se(s.n_native_rings == 1);
+
+        /* From now on the records are put into the ring, and nothing is sent on the socket anymore */
+        for (i = 0; i < N_RING_MESSAGES; i++) {
+                xsprintf(message, "MESSAGE=ring %u", i);
+                send_message(id, message);
+                assert_se(strv_extend(&expected, message) >= 0);
+        }
+        assert_se(fd_wait_for_event(s.native_fd, POLLIN, 0) == 0);
+
+        run_server(&s);
+        verify_messages(id, expected);
+
+        /* If journald goes away, the client notices, and sends the record on the socket instead */
+        server_close_native_rings(&s);
+        assert_se(s.n_native_rings == 0);
+
+        send_message(id, "MESSAGE=last");
+        assert_se(strv_extend(&expected, "MESSAGE=last") >= 0);
+        assert_se(fd_wait_for_event(s.native_fd, POLLIN, 0) > 0);
+
+        run_server(&s);
+        assert_se(s.n_native_rings == 0);
+        verify_messages(id, expected);
+
+        server_done(&s);
+}
+
+static void test_ring_order(void) {
+        char id[STRLEN("TEST_RING_ID=") + SD_ID128_STRING_MAX], message[STRLEN("MESSAGE=after ") + DECIMAL_STR_MAX(unsigned)];
+        _cleanup_strv_free_ char **expected = NULL;
+        _cleanup_free_ char *big = NULL;
+        sd_id128_t rnd;
+        Server s;
+        unsigned i;
+        pid_t pid;
+        int r;
+
+        log_info("/* %s */", __func__);
+
+        assert_se(sd_id128_randomize(&rnd) >= 0);
+        xsprintf(id, "TEST_RING_ID=%s", sd_id128_to_string(rnd, (char[SD_ID128_STRING_MAX]) {}));
+
+        /* Too large for a quarter of a 64K ring */
+        assert_se(big = malloc(STRLEN("BIG=") + 20000 + 1));
+        memset(stpcpy(big, "BIG="), 'x', 20000);
+        big[STRLEN("BIG=") + 20000] = 0;
+
+        assert_se(strv_extend(&expected, "MESSAGE=first") >= 0);
+        for (i = 0; i < N_RING_MESSAGES * 20; i++)
+                assert_se(strv_extendf(&expected, "MESSAGE=ring %u", i) >= 0);
+        assert_se(strv_extend(&expected, "MESSAGE=big") >= 0);
+        for (i = 0; i < N_RING_MESSAGES; i++)
+                assert_se(strv_extendf(&expected, "MESSAGE=after %u", i) >= 0);
+
+        assert_se(unsetenv("LISTEN_FDS") >= 0);
+        assert_se(server_init(&s) >= 0);
+
+        /* The client writes faster than the server reads, fills the ring several times over, and then logs a record
+         * that only fits on the socket. Regardless, everything shows up in the order it was logged in. */
+        r = safe_fork("(test-journal-ring-client)", FORK_DEATHSIG|FORK_LOG, &pid);
+        assert_se(r >= 0);
+        if (r == 0) {
+                assert_se(setenv("SYSTEMD_JOURNAL_RING_SIZE", "64K", true) >= 0);
+
+                send_message(id, "MESSAGE=first");
+                for (i = 0; i < N_RING_MESSAGES * 20; i++) {
+                        xsprintf(message, "MESSAGE=ring %u", i);
+                        send_message(id, message);
+                }
+
+                struct iovec iovec[] = {
+                        IOVEC_MAKE_STRING("MESSAGE=big"),
+                        IOVEC_MAKE_STRING(id),
+                        IOVEC_MAKE((char*) binary_value, sizeof(binary_value) - 1),
+                        IOVEC_MAKE_STRING(big),
+                };
+                assert_se(sd_journal_sendv(iovec, ELEMENTSOF(iovec)) == 0);
+
+                for (i = 0; i < N_RING_MESSAGES; i++) {
+                        xsprintf(message, "MESSAGE=after %u", i);
+                        send_message(id, message);
+                }
+
+                _exit(EXIT_SUCCESS);
+        }
+
+        for (;;) {
+                siginfo_t si = {};
+
+                assert_se(sd_event_run(s.event, 10 * USEC_PER_MSEC) >= 0);
+
+                assert_se(waitid(P_PID, pid, &si, WEXITED|WNOHANG|WNOWAIT) >= 0);
+                if (si.si_pid == pid)
+                        break;
+        }
+
+        assert_se(wait_for_terminate_and_check("(test-journal-ring-client)", pid, WAIT_LOG) == EXIT_SUCCESS);
+
+        run_server(&s);
+        verify_messages(id, expected);
+
+        server_done(&s);
+}
+
+int main(int argc, char *argv[]) {
+        pid_t pid;
+        int r;
+
+        test_setup_logging(LOG_DEBUG);
+
+        if (getuid() != 0)
+                return log_tests_skipped("not root");
+
+        /* The client always talks to /run/systemd/journal/socket, hence run the server in a mount namespace of our
+         * own, with a fresh /run, where it doesn't get in the way of the real journald. */
+        r = safe_fork("(test-journal-ring)", FORK_DEATHSIG|FORK_LOG|FORK_NEW_MOUNTNS|FORK_MOUNTNS_SLAVE, &pid);
+        assert_se(r >= 0);
+        if (r == 0) {
+                if (mount("tmpfs", "/run", "tmpfs", 0, "mode=755") < 0) {
+                        log_notice_errno(errno, "Failed to mount /run: %m");
+                        _exit(EXIT_TEST_SKIP);
+                }
+
+                log_set_target(LOG_TARGET_CONSOLE);
+                test_ring_order();
+                test_ring_round_trip();
+                _exit(EXIT_SUCCESS);
+        }
+
+        r = wait_for_terminate_and_check("(test-journal-ring)", pid, WAIT_LOG);
+        assert_se(r >= 0);
+        if (r == EXIT_TEST_SKIP)
+                return log_tests_skipped("Cannot mount /run");
+        assert_se(r == EXIT_SUCCESS);
+
+        return 0;
+}
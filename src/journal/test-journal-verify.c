@@ -44,7 +44,7 @@ static int raw_verify(const char *fn, const char *verification_key) {
         if (r < 0)
                 return r;
 
-        r = journal_file_verify(f, verification_key, NULL, NULL, NULL, false);
+        r = journal_file_verify(f, verification_key, NULL, NULL, NULL, false, 1);
         (void) journal_file_close(f);
 
         return r;
@@ -99,7 +99,10 @@ int main(int argc, char *argv[]) {
         /* journal_file_print_header(f); */
         journal_file_dump(f);
 
-        assert_se(journal_file_verify(f, verification_key, &from, &to, &total, true) >= 0);
+        assert_se(journal_file_verify(f, verification_key, &from, &to, &total, true, 1) >= 0);
+
+        /* The same, with the hash table split up between worker processes */
+        assert_se(journal_file_verify(f, verification_key, NULL, NULL, NULL, false, 4) >= 0);
 
         if (verification_key && JOURNAL_HEADER_SEALED(f->header))
                 log_info("=> Validated from %s to %s, %s missing",
@@ -3,12 +3,17 @@
 #include <fcntl.h>
 #include <unistd.h>
 
+#include "dirent-util.h"
+#include "fd-util.h"
 #include "io-util.h"
 #include "journal-authenticate.h"
 #include "journal-file.h"
 #include "journal-vacuum.h"
+#include "journal-verify.h"
 #include "log.h"
 #include "rm-rf.h"
+#include "stdio-util.h"
+#include "string-util.h"
 #include "tests.h"
 
 static bool arg_keep = false;
@@ -29,6 +34,7 @@ static void test_non_empty(void) {
         assert_se(chdir(t) >= 0);
 
         assert_se(journal_file_open(-1, "test.journal", O_RDWR|O_CREAT, 0666, true, (uint64_t) -1, true, NULL, NULL, NULL, NULL, &f) == 0);
+        assert_se(JOURNAL_HEADER_KEYED_HASH(f->header) == f->keyed_hash);
 
         assert_se(dual_timestamp_get(&ts));
         assert_se(sd_id128_randomize(&fake_boot_id) == 0);
@@ -107,6 +113,325 @@ static void test_non_empty(void) {
         puts("------------------------------------------------------------");
 }
 
+static void test_bloom(void) {
+        dual_timestamp ts;
+        JournalFile *f;
+        struct iovec iovec;
+        char t[] = "/tmp/journal-XXXXXX";
+        char buf[32];
+        unsigned i;
+
+        test_setup_logging(LOG_DEBUG);
+
+        assert_se(mkdtemp(t));
+        assert_se(chdir(t) >= 0);
+
+        assert_se(journal_file_open(-1, "test.journal", O_RDWR|O_CREAT, 0666, true, (uint64_t) -1, false, NULL, NULL, NULL, NULL, &f) == 0);
+        assert_se(dual_timestamp_get(&ts));
+
+        for (i = 0; i < 100; i++) {
+                xsprintf(buf, "NUMBER=%u", i);
+                iovec = IOVEC_MAKE_STRING(buf);
+                assert_se(journal_file_append_entry(f, &ts, NULL, &iovec, 1, NULL, NULL, NULL) == 0);
+        }
+
+        assert_se(f->header->bloom_filter_offset == 0);
+        assert_se(journal_file_archive(f) == 0);
+        assert_se(f->header->bloom_filter_offset != 0);
+
+        journal_file_print_header(f);
+
+        /* A Bloom filter may never have false negatives */
+        for (i = 0; i < 100; i++) {
+                xsprintf(buf, "NUMBER=%u", i);
+                assert_se(journal_file_find_data_object(f, buf, strlen(buf), NULL, NULL) == 1);
+        }
+
+        assert_se(journal_file_find_data_object(f, "quux", 4, NULL, NULL) == 0);
+
+        (void) journal_file_close(f);
+
+        log_info("Done...");
+
+        if (arg_keep)
+                log_info("Not removing %s", t);
+        else
+                assert_se(rm_rf(t, REMOVE_ROOT|REMOVE_PHYSICAL) >= 0);
+
+        puts("------------------------------------------------------------");
+}
+
+static void check_boots(JournalFile *f, const sd_id128_t boot_ids[2]) {
+        _cleanup_free_ JournalBootInfo *boots = NULL;
+        size_t n, i, k;
+
+        assert_se(journal_file_get_boots(f, &boots, &n) >= 0);
+        assert_se(n == 2);
+
+        for (i = 0; i < 2; i++) {
+                for (k = 0; k < n; k++)
+                        if (sd_id128_equal(boots[k].boot_id, boot_ids[i]))
+                                break;
+                assert_se(k < n);
+
+                assert_se(boots[k].first_seqnum == i * 3 + 1);
+                assert_se(boots[k].last_seqnum == i * 3 + 3);
+                assert_se(boots[k].first_realtime <= boots[k].last_realtime);
+        }
+}
+
+static void test_boot_index(void) {
+        dual_timestamp ts;
+        JournalFile *f;
+        sd_id128_t boot_ids[2];
+        char t[] = "/tmp/journal-XXXXXX";
+        unsigned i, k;
+
+        test_setup_logging(LOG_DEBUG);
+
+        assert_se(mkdtemp(t));
+        assert_se(chdir(t) >= 0);
+
+        assert_se(journal_file_open(-1, "test.journal", O_RDWR|O_CREAT, 0666, true, (uint64_t) -1, false, NULL, NULL, NULL, NULL, &f) == 0);
+
+        for (i = 0; i < 2; i++) {
+                char buf[STRLEN("_BOOT_ID=") + SD_ID128_STRING_MAX];
+                struct iovec iovec[2];
+
+                assert_se(sd_id128_randomize(&boot_ids[i]) >= 0);
+                xsprintf(buf, "_BOOT_ID=" SD_ID128_FORMAT_STR, SD_ID128_FORMAT_VAL(boot_ids[i]));
+
+                iovec[0] = IOVEC_MAKE_STRING(buf);
+                iovec[1] = IOVEC_MAKE_STRING("MESSAGE=foo");
+
+                for (k = 0; k < 3; k++) {
+                        assert_se(dual_timestamp_get(&ts));
+                        assert_se(journal_file_append_entry(f, &ts, &boot_ids[i], iovec, ELEMENTSOF(iovec), NULL, NULL, NULL) == 0);
+                }
+        }
+
+        /* Determined from the _BOOT_ID= data objects for online files, and from the index once archived */
+        check_boots(f, boot_ids);
+
+        assert_se(f->header->boot_index_offset == 0);
+        assert_se(journal_file_archive(f) == 0);
+        assert_se(f->header->boot_index_offset != 0);
+
+        check_boots(f, boot_ids);
+
+        (void) journal_file_close(f);
+
+        log_info("Done...");
+
+        if (arg_keep)
+                log_info("Not removing %s", t);
+        else
+                assert_se(rm_rf(t, REMOVE_ROOT|REMOVE_PHYSICAL) >= 0);
+
+        puts("------------------------------------------------------------");
+}
+
+static void check_seek(JournalFile *f, uint64_t n, usec_t base) {
+        uint64_t i;
+
+        for (i = 0; i < n; i++) {
+                Object *o;
+
+                assert_se(journal_file_move_to_entry_by_realtime(f, base + i * 10, DIRECTION_DOWN, &o, NULL) == 1);
+                assert_se(le64toh(o->entry.seqnum) == i + 1);
+                assert_se(journal_file_move_to_entry_by_realtime(f, base + i * 10, DIRECTION_UP, &o, NULL) == 1);
+                assert_se(le64toh(o->entry.seqnum) == i + 1);
+
+                assert_se(journal_file_move_to_entry_by_realtime(f, base + i * 10 + 5, DIRECTION_UP, &o, NULL) == 1);
+                assert_se(le64toh(o->entry.seqnum) == i + 1);
+                if (i + 1 < n) {
+                        assert_se(journal_file_move_to_entry_by_realtime(f, base + i * 10 + 5, DIRECTION_DOWN, &o, NULL) == 1);
+                        assert_se(le64toh(o->entry.seqnum) == i + 2);
+                } else
+                        assert_se(journal_file_move_to_entry_by_realtime(f, base + i * 10 + 5, DIRECTION_DOWN, &o, NULL) == 0);
+
+                assert_se(journal_file_move_to_entry_by_seqnum(f, n - i, DIRECTION_DOWN, &o, NULL) == 1);
+                assert_se(le64toh(o->entry.seqnum) == n - i);
+        }
+
+        assert_se(journal_file_move_to_entry_by_realtime(f, base - 1, DIRECTION_UP, NULL, NULL) == 0);
+}
+
+static void test_entry_array_index(void) {
+        _cleanup_free_ char *path = NULL;
+        dual_timestamp ts;
+        JournalFile *f;
+        struct iovec iovec;
+        char t[] = "/tmp/journal-XXXXXX";
+        char buf[32];
+        usec_t base;
+        unsigned i;
+
+        test_setup_logging(LOG_DEBUG);
+
+        assert_se(mkdtemp(t));
+        assert_se(chdir(t) >= 0);
+
+        assert_se(journal_file_open(-1, "test.journal", O_RDWR|O_CREAT, 0666, true, (uint64_t) -1, false, NULL, NULL, NULL, NULL, &f) == 0);
+
+        /* Enough entries for a chain of a few arrays */
+        assert_se(dual_timestamp_get(&ts));
+        base = ts.realtime;
+        for (i = 0; i < 5000; i++) {
+                xsprintf(buf, "NUMBER=%u", i);
+                iovec = IOVEC_MAKE_STRING(buf);
+                ts.realtime = base + i * 10;
+                assert_se(journal_file_append_entry(f, &ts, NULL, &iovec, 1, NULL, NULL, NULL) == 0);
+        }
+
+        check_seek(f, 5000, base);
+
+        assert_se(f->header->entry_array_index_offset == 0);
+        assert_se(journal_file_archive(f) == 0);
+        assert_se(f->header->entry_array_index_offset != 0);
+
+        assert_se(asprintf(&path, "test@" SD_ID128_FORMAT_STR "-%016"PRIx64"-%016"PRIx64".journal",
+                           SD_ID128_FORMAT_VAL(f->header->seqnum_id),
+                           le64toh(f->header->head_entry_seqnum),
+                           le64toh(f->header->head_entry_realtime)) >= 0);
+        (void) journal_file_close(f);
+
+        /* Bisect using the index from the file */
+        assert_se(journal_file_open(-1, path, O_RDONLY, 0, false, 0, false, NULL, NULL, NULL, NULL, &f) == 0);
+        journal_file_print_header(f);
+        check_seek(f, 5000, base);
+        assert_se(journal_file_verify(f, NULL, NULL, NULL, NULL, false, 1) >= 0);
+        (void) journal_file_close(f);
+
+        log_info("Done...");
+
+        if (arg_keep)
+                log_info("Not removing %s", t);
+        else
+                assert_se(rm_rf(t, REMOVE_ROOT|REMOVE_PHYSICAL) >= 0);
+
+        puts("------------------------------------------------------------");
+}
+
+static void test_append_entries(void) {
+        JournalFileEntry entries[3];
+        struct iovec iovec[ELEMENTSOF(entries)];
+        JournalFile *f;
+        Object *o;
+        uint64_t p, seqnum = 0;
+        size_t n = 0;
+        char t[] = "/tmp/journal-XXXXXX";
+        unsigned i;
+
+        test_setup_logging(LOG_DEBUG);
+
+        assert_se(mkdtemp(t));
+        assert_se(chdir(t) >= 0);
+
+        assert_se(journal_file_open(-1, "test.journal", O_RDWR|O_CREAT, 0666, true, (uint64_t) -1, false, NULL, NULL, NULL, NULL, &f) == 0);
+
+        for (i = 0; i < ELEMENTSOF(entries); i++) {
+                const char *field = i == 1 ? "TEST2=2" : "TEST1=1";
+
+                iovec[i] = IOVEC_MAKE_STRING(field);
+                entries[i] = (JournalFileEntry) {
+                        .iovec = &iovec[i],
+                        .n_iovec = 1,
+                };
+                assert_se(dual_timestamp_get(&entries[i].ts));
+        }
+
+        assert_se(journal_file_append_entries(f, entries, ELEMENTSOF(entries), &seqnum, &n) == 0);
+        assert_se(n == ELEMENTSOF(entries));
+        assert_se(seqnum == 3);
+        assert_se(le64toh(f->header->n_entries) == 3);
+
+        assert_se(journal_file_find_data_object(f, "TEST1=1", STRLEN("TEST1=1"), &o, &p) == 1);
+        assert_se(le64toh(o->data.n_entries) == 2);
+
+        /* Invalid entries stop the batch, everything before it is still written */
+        entries[1].ts.realtime = 0;
+        assert_se(journal_file_append_entries(f, entries, ELEMENTSOF(entries), &seqnum, &n) == -EBADMSG);
+        assert_se(n == 1);
+        assert_se(le64toh(f->header->n_entries) == 4);
+
+        (void) journal_file_close(f);
+
+        log_info("Done...");
+
+        if (arg_keep)
+                log_info("Not removing %s", t);
+        else
+                assert_se(rm_rf(t, REMOVE_ROOT|REMOVE_PHYSICAL) >= 0);
+
+        puts("------------------------------------------------------------");
+}
+
+static void test_reserve(void) {
+        static char blob[4096];
+        dual_timestamp ts;
+        JournalFile *f;
+        struct stat st;
+        bool reserving = false;
+        char t[] = "/tmp/journal-XXXXXX";
+        unsigned i;
+
+        test_setup_logging(LOG_INFO);
+
+        assert_se(mkdtemp(t));
+        assert_se(chdir(t) >= 0);
+
+        assert_se(journal_file_open(-1, "test.journal", O_RDWR|O_CREAT, 0666, false, (uint64_t) -1, false, NULL, NULL, NULL, NULL, &f) == 0);
+
+        /* Grow the file quickly, so that it reserves space ahead of the arena in the background, and keep
+         * appending to it while the reservation is running */
+        for (i = 0; i < 20000; i++) {
+                struct iovec iovec = IOVEC_MAKE(blob, sizeof(blob));
+
+                memset(blob, 'x', sizeof(blob));
+                xsprintf(blob, "BLOB=%u", i);
+                blob[strlen(blob)] = 'x';
+
+                assert_se(dual_timestamp_get(&ts));
+                assert_se(journal_file_append_entry(f, &ts, NULL, &iovec, 1, NULL, NULL, NULL) == 0);
+
+                if (f->reserve_thread_running)
+                        reserving = true;
+        }
+
+        log_info("Reservation %s, file grows by %" PRIu64 " bytes per step.",
+                 reserving ? "was in flight" : f->reserve_failed ? "failed" : "never started", f->size_increase);
+        assert_se(reserving || f->reserve_failed);
+        assert_se(f->size_increase > 8U*1024U*1024U);
+
+        /* Everything written next to the reservation is still intact */
+        for (i = 0; i < 20000; i++) {
+                memset(blob, 'x', sizeof(blob));
+                xsprintf(blob, "BLOB=%u", i);
+                blob[strlen(blob)] = 'x';
+
+                assert_se(journal_file_find_data_object(f, blob, sizeof(blob), NULL, NULL) == 1);
+        }
+        assert_se(journal_file_verify(f, NULL, NULL, NULL, NULL, false, 1) >= 0);
+
+        /* Space that was reserved but not used yet is given back */
+        (void) journal_file_close(f);
+        assert_se(stat("test.journal", &st) >= 0);
+        assert_se(journal_file_open(-1, "test.journal", O_RDONLY, 0, false, (uint64_t) -1, false, NULL, NULL, NULL, NULL, &f) == 0);
+        assert_se((uint64_t) st.st_size == le64toh(f->header->header_size) + le64toh(f->header->arena_size));
+        assert_se(le64toh(f->header->n_entries) == 20000);
+        (void) journal_file_close(f);
+
+        log_info("Done...");
+
+        if (arg_keep)
+                log_info("Not removing %s", t);
+        else
+                assert_se(rm_rf(t, REMOVE_ROOT|REMOVE_PHYSICAL) >= 0);
+
+        puts("------------------------------------------------------------");
+}
+
 static void test_empty(void) {
         JournalFile *f1, *f2, *f3, *f4;
         char t[] = "/tmp/journal-XXXXXX";
@@ -149,7 +474,80 @@ static void test_empty(void) {
         (void) journal_file_close(f4);
 }
 
-#if HAVE_XZ || HAVE_LZ4
+static unsigned count_journal_files(void) {
+        _cleanup_closedir_ DIR *d = NULL;
+        struct dirent *de;
+        unsigned n = 0;
+
+        assert_se(d = opendir("."));
+
+        FOREACH_DIRENT(de, d, assert_not_reached("readdir() failed"))
+                if (endswith(de->d_name, ".journal"))
+                        n++;
+
+        return n;
+}
+
+static void test_vacuum_index(void) {
+        _cleanup_(journal_vacuum_index_freep) JournalVacuumIndex *i = NULL;
+        static const char test[] = "TEST1=1";
+        char t[] = "/tmp/journal-vacuum-XXXXXX";
+        uint64_t used, avail, used_before;
+        dual_timestamp ts;
+        struct iovec iovec;
+        JournalFile *f;
+        unsigned k;
+
+        test_setup_logging(LOG_DEBUG);
+
+        assert_se(mkdtemp(t));
+        assert_se(chdir(t) >= 0);
+
+        assert_se(journal_vacuum_index_new(".", true, &i) >= 0);
+        assert_se(journal_vacuum_index_usage(i, &used, &avail) >= 0);
+        assert_se(used == 0);
+
+        assert_se(journal_file_open(-1, "test.journal", O_RDWR|O_CREAT, 0666, true, (uint64_t) -1, false, NULL, NULL, NULL, NULL, &f) == 0);
+
+        /* Three archived files with one entry each, plus the online one */
+        for (k = 0; k < 3; k++) {
+                dual_timestamp_get(&ts);
+                iovec = IOVEC_MAKE_STRING(test);
+                assert_se(journal_file_append_entry(f, &ts, NULL, &iovec, 1, NULL, NULL, NULL) == 0);
+
+                assert_se(journal_file_rotate(&f, true, (uint64_t) -1, false, NULL) >= 0);
+        }
+
+        /* The index only learns about the new files from inotify */
+        assert_se(journal_vacuum_index_usage(i, &used, &avail) >= 0);
+        assert_se(used > 0);
+        assert_se(count_journal_files() == 4);
+        used_before = used;
+
+        /* Keep the online file and one archived one */
+        assert_se(journal_vacuum_index_vacuum(i, 0, 2, 0, NULL, true) >= 0);
+        assert_se(count_journal_files() == 2);
+
+        assert_se(journal_vacuum_index_usage(i, &used, &avail) >= 0);
+        assert_se(used < used_before);
+
+        /* Files removed behind our back are noticed too */
+        (void) journal_file_close(f);
+        assert_se(unlink("test.journal") >= 0);
+        assert_se(journal_vacuum_index_vacuum(i, 0, 0, 1, NULL, true) >= 0);
+        assert_se(count_journal_files() == 0);
+
+        assert_se(journal_vacuum_index_usage(i, &used, &avail) >= 0);
+        assert_se(used == 0);
+
+        log_info("Done...");
+
+        assert_se(rm_rf(t, REMOVE_ROOT|REMOVE_PHYSICAL) >= 0);
+
+        puts("------------------------------------------------------------");
+}
+
+#if HAVE_COMPRESSION
 static bool check_compressed(uint64_t compress_threshold, uint64_t data_size) {
         dual_timestamp ts;
         JournalFile *f;
@@ -233,6 +631,23 @@ static void test_min_compress_size(void) {
 }
 #endif
 
+static void test_keyed_hash_default(void) {
+        JournalFile *f;
+        char t[] = "/tmp/journal-XXXXXX";
+
+        log_info("/* %s */", __func__);
+
+        assert_se(mkdtemp(t));
+        assert_se(chdir(t) >= 0);
+
+        assert_se(journal_file_open(-1, "test.journal", O_RDWR|O_CREAT, 0666, true, (uint64_t) -1, false, NULL, NULL, NULL, NULL, &f) == 0);
+        assert_se(!f->keyed_hash);
+        assert_se(!JOURNAL_HEADER_KEYED_HASH(f->header));
+        (void) journal_file_close(f);
+
+        assert_se(rm_rf(t, REMOVE_ROOT|REMOVE_PHYSICAL) >= 0);
+}
+
 int main(int argc, char *argv[]) {
         arg_keep = argc > 1;
 
@@ -242,9 +657,22 @@ int main(int argc, char *argv[]) {
         if (access("/etc/machine-id", F_OK) != 0)
                 return log_tests_skipped("/etc/machine-id not found");
 
+        /* Lookups must work with both hash functions, and without being asked for it, files are readable by
+         * implementations that predate the keyed one */
+        assert_se(unsetenv("SYSTEMD_JOURNAL_KEYED_HASH") >= 0);
+        test_keyed_hash_default();
+        assert_se(setenv("SYSTEMD_JOURNAL_KEYED_HASH", "0", 1) >= 0);
+        test_non_empty();
+        assert_se(setenv("SYSTEMD_JOURNAL_KEYED_HASH", "1", 1) >= 0);
         test_non_empty();
         test_empty();
-#if HAVE_XZ || HAVE_LZ4
+        test_bloom();
+        test_boot_index();
+        test_entry_array_index();
+        test_append_entries();
+        test_reserve();
+        test_vacuum_index();
+#if HAVE_COMPRESSION
         test_min_compress_size();
 #endif
 
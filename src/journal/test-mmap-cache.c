@@ -12,7 +12,9 @@
 #include "util.h"
 
 int main(int argc, char *argv[]) {
-        MMapFileDescriptor *fx;
+        MMapFileDescriptor *fx, *fy;
+        MMapCacheStats stats;
+        struct stat st;
         int x, y, z, r;
         char px[] = "/tmp/testmmapXXXXXXX", py[] = "/tmp/testmmapYXXXXXX", pz[] = "/tmp/testmmapZXXXXXX";
         MMapCache *m;
@@ -55,6 +57,38 @@ int main(int argc, char *argv[]) {
 
         assert_se((uint8_t*) p + 1 == (uint8_t*) q);
 
+        mmap_cache_get_stats(m, &stats);
+        assert_se(stats.n_context_hit == 1);
+        assert_se(stats.n_window_hit == 2);
+        assert_se(stats.n_missed == 2);
+        assert_se(stats.n_context_hit + stats.n_window_hit == mmap_cache_get_hit(m));
+        assert_se(stats.n_missed == mmap_cache_get_missed(m));
+        mmap_cache_stats_log_debug(m);
+
+        /* A window mapped at the end of a file we write to is grown in place as the file grows */
+        assert_se(fy = mmap_cache_add_fd(m, y));
+
+        assert_se(pwrite(y, "a", 1, 0) == 1);
+        assert_se(fstat(y, &st) >= 0);
+
+        r = mmap_cache_get(m, fy, PROT_READ|PROT_WRITE, 0, false, 0, 1, &st, &p, NULL);
+        assert_se(r >= 0);
+        assert_se(*(char*) p == 'a');
+
+        assert_se(pwrite(y, "b", 1, 3*page_size()) == 1);
+        assert_se(fstat(y, &st) >= 0);
+
+        r = mmap_cache_get(m, fy, PROT_READ|PROT_WRITE, 0, false, 3*page_size(), 1, &st, &q, NULL);
+        assert_se(r >= 0);
+        assert_se(*(char*) q == 'b');
+
+        mmap_cache_get_stats(m, &stats);
+        assert_se(stats.n_grown == 1);
+        assert_se(stats.n_missed == 3);
+        assert_se((uint8_t*) p + 3*page_size() == (uint8_t*) q);
+        assert_se(*(char*) p == 'a');
+
+        mmap_cache_free_fd(m, fy);
         mmap_cache_free_fd(m, fx);
         mmap_cache_unref(m);
 
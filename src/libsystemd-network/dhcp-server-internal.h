@@ -51,9 +51,14 @@ struct sd_dhcp_server {
         bool emit_router;
 
         Hashmap *leases_by_client_id;
-        DHCPLease **bound_leases;
+        Hashmap *leases_by_address;
+        /* one bit per address in the pool, set if the address is bound to a lease or reserved */
+        uint64_t *pool_used;
         DHCPLease invalid_lease;
 
+        char *lease_file;
+        sd_event_source *save_leases;
+
         uint32_t max_lease_time, default_lease_time;
 };
 
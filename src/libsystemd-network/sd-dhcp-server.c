@@ -3,6 +3,8 @@
   Copyright © 2013 Intel Corporation. All rights reserved.
 ***/
 
+#include <arpa/inet.h>
+#include <stdio_ext.h>
 #include <sys/ioctl.h>
 
 #include "sd-dhcp-server.h"
@@ -10,12 +12,18 @@
 #include "alloc-util.h"
 #include "dhcp-internal.h"
 #include "dhcp-server-internal.h"
+#include "extract-word.h"
 #include "fd-util.h"
+#include "fileio.h"
+#include "hexdecoct.h"
 #include "in-addr-util.h"
 #include "io-util.h"
+#include "parse-util.h"
+#include "path-util.h"
 #include "sd-id128.h"
 #include "siphash24.h"
 #include "string-util.h"
+#include "tmpfile-util.h"
 #include "unaligned.h"
 
 #define DHCP_DEFAULT_LEASE_TIME_USEC USEC_PER_HOUR
@@ -29,6 +37,328 @@ static DHCPLease *dhcp_lease_free(DHCPLease *lease) {
         return mfree(lease);
 }
 
+DEFINE_TRIVIAL_CLEANUP_FUNC(DHCPLease*, dhcp_lease_free);
+
+static bool pool_is_used(sd_dhcp_server *server, uint32_t pool_offset) {
+        return server->pool_used[pool_offset / 64] & (UINT64_C(1) << (pool_offset % 64));
+}
+
+static void pool_set_used(sd_dhcp_server *server, uint32_t pool_offset, bool b) {
+        if (b)
+                server->pool_used[pool_offset / 64] |= UINT64_C(1) << (pool_offset % 64);
+        else
+                server->pool_used[pool_offset / 64] &= ~(UINT64_C(1) << (pool_offset % 64));
+}
+
+/* Finds the first free address at or after the given offset into the pool, wrapping around at its end. The bits
+ * past the end of the pool are always set, so only whole words need to be looked at. */
+static int pool_find_free(sd_dhcp_server *server, uint32_t start, uint32_t *ret) {
+        uint32_t n_words, i;
+
+        n_words = DIV_ROUND_UP(server->pool_size, 64);
+
+        for (i = 0; i <= n_words; i++) {
+                uint32_t w = (start / 64 + i) % n_words;
+                uint64_t free_bits = ~server->pool_used[w];
+
+                if (i == 0)
+                        /* in the first word, only look at the bits from the start on… */
+                        free_bits &= UINT64_MAX << (start % 64);
+                else if (i == n_words)
+                        /* …and at the ones before it once we wrapped around */
+                        free_bits &= ~(UINT64_MAX << (start % 64));
+
+                if (free_bits != 0) {
+                        *ret = w * 64 + __builtin_ctzll(free_bits);
+                        return 0;
+                }
+        }
+
+        return -ENOSPC;
+}
+
+static int get_pool_offset(sd_dhcp_server *server, be32_t requested_ip) {
+        assert(server);
+
+        if (!server->pool_size)
+                return -EINVAL;
+
+        if (be32toh(requested_ip) < (be32toh(server->subnet) | server->pool_offset) ||
+            be32toh(requested_ip) >= (be32toh(server->subnet) | (server->pool_offset + server->pool_size)))
+                return -ERANGE;
+
+        return be32toh(requested_ip & ~server->netmask) - server->pool_offset;
+}
+
+/* Returns the lease bound to the address at the given offset into the pool, &server->invalid_lease if the address
+ * is reserved, and NULL if it is free */
+static DHCPLease *pool_get_lease(sd_dhcp_server *server, uint32_t pool_offset) {
+        DHCPLease *lease;
+
+        if (!pool_is_used(server, pool_offset))
+                return NULL;
+
+        lease = hashmap_get(server->leases_by_address,
+                            UINT32_TO_PTR(server->subnet | htobe32(server->pool_offset + pool_offset)));
+
+        return lease ?: &server->invalid_lease;
+}
+
+static int dhcp_server_bind_lease(sd_dhcp_server *server, DHCPLease *lease, uint32_t pool_offset) {
+        int r;
+
+        assert(server);
+        assert(lease);
+
+        r = hashmap_put(server->leases_by_address, UINT32_TO_PTR(lease->address), lease);
+        if (r < 0)
+                return r;
+
+        r = hashmap_put(server->leases_by_client_id, &lease->client_id, lease);
+        if (r < 0) {
+                (void) hashmap_remove(server->leases_by_address, UINT32_TO_PTR(lease->address));
+                return r;
+        }
+
+        pool_set_used(server, pool_offset, true);
+
+        return 0;
+}
+
+static void dhcp_server_unbind_lease(sd_dhcp_server *server, DHCPLease *lease) {
+        int pool_offset;
+
+        assert(server);
+        assert(lease);
+
+        pool_offset = get_pool_offset(server, lease->address);
+        if (pool_offset >= 0)
+                pool_set_used(server, pool_offset, false);
+
+        (void) hashmap_remove(server->leases_by_address, UINT32_TO_PTR(lease->address));
+        (void) hashmap_remove(server->leases_by_client_id, &lease->client_id);
+
+        dhcp_lease_free(lease);
+}
+
+/* Unbinds all expired leases, and returns how many there were */
+static unsigned dhcp_server_drop_expired_leases(sd_dhcp_server *server) {
+        DHCPLease *lease;
+        usec_t time_now;
+        unsigned n = 0;
+        Iterator i;
+
+        if (sd_event_now(server->event, clock_boottime_or_monotonic(), &time_now) < 0)
+                return 0;
+
+        HASHMAP_FOREACH(lease, server->leases_by_client_id, i)
+                if (lease->expiration < time_now) {
+                        dhcp_server_unbind_lease(server, lease);
+                        n++;
+                }
+
+        return n;
+}
+
+/* The lease file contains one line per lease, with the address, the client ID, the hardware address, the relay
+ * agent address, and the expiration time in CLOCK_REALTIME, the only clock which survives a reboot */
+static int dhcp_server_save_leases(sd_dhcp_server *server) {
+        _cleanup_free_ char *temp_path = NULL;
+        _cleanup_fclose_ FILE *f = NULL;
+        usec_t now_boot, now_real;
+        DHCPLease *lease;
+        Iterator i;
+        int r;
+
+        assert(server);
+        assert(server->lease_file);
+
+        r = fopen_temporary(server->lease_file, &f, &temp_path);
+        if (r < 0)
+                goto fail;
+
+        (void) __fsetlocking(f, FSETLOCKING_BYCALLER);
+        (void) fchmod(fileno(f), 0644);
+
+        fprintf(f,
+                "# This is private data. Do not parse.\n");
+
+        now_boot = now(clock_boottime_or_monotonic());
+        now_real = now(CLOCK_REALTIME);
+
+        HASHMAP_FOREACH(lease, server->leases_by_client_id, i) {
+                _cleanup_free_ char *client_id = NULL, *chaddr = NULL;
+                char address[INET_ADDRSTRLEN], gateway[INET_ADDRSTRLEN];
+
+                if (lease->expiration <= now_boot)
+                        continue;
+
+                client_id = hexmem(lease->client_id.data, lease->client_id.length);
+                chaddr = hexmem(lease->chaddr, ETH_ALEN);
+                if (!client_id || !chaddr) {
+                        r = -ENOMEM;
+                        goto fail;
+                }
+
+                fprintf(f, "%s %s %s %s " USEC_FMT "\n",
+                        inet_ntop(AF_INET, &lease->address, address, sizeof(address)),
+                        client_id,
+                        chaddr,
+                        inet_ntop(AF_INET, &lease->gateway, gateway, sizeof(gateway)),
+                        usec_add(now_real, lease->expiration - now_boot));
+        }
+
+        r = fflush_and_check(f);
+        if (r < 0)
+                goto fail;
+
+        if (rename(temp_path, server->lease_file) < 0) {
+                r = -errno;
+                goto fail;
+        }
+
+        return 0;
+
+fail:
+        if (temp_path)
+                (void) unlink(temp_path);
+
+        return log_dhcp_server_errno(server, r, "Failed to save leases to %s: %m", server->lease_file);
+}
+
+static int dhcp_server_load_leases(sd_dhcp_server *server) {
+        _cleanup_fclose_ FILE *f = NULL;
+        usec_t now_boot, now_real;
+        unsigned n = 0;
+        int r;
+
+        assert(server);
+        assert(server->lease_file);
+
+        f = fopen(server->lease_file, "re");
+        if (!f)
+                return errno == ENOENT ? 0 : -errno;
+
+        (void) __fsetlocking(f, FSETLOCKING_BYCALLER);
+
+        now_boot = now(clock_boottime_or_monotonic());
+        now_real = now(CLOCK_REALTIME);
+
+        for (;;) {
+                _cleanup_free_ char *line = NULL, *address = NULL, *client_id = NULL, *chaddr = NULL, *gateway = NULL,
+                        *expiration = NULL;
+                _cleanup_(dhcp_lease_freep) DHCPLease *lease = NULL;
+                _cleanup_free_ void *chaddr_data = NULL;
+                size_t chaddr_len;
+                usec_t expiration_real;
+                const char *p;
+                int pool_offset;
+
+                r = read_line(f, LONG_LINE_MAX, &line);
+                if (r < 0)
+                        return r;
+                if (r == 0)
+                        break;
+
+                p = strstrip(line);
+                if (IN_SET(*p, 0, '#'))
+                        continue;
+
+                r = extract_many_words(&p, NULL, 0, &address, &client_id, &chaddr, &gateway, &expiration, NULL);
+                if (r < 0)
+                        return r;
+                if (r != 5)
+                        goto invalid;
+
+                lease = new0(DHCPLease, 1);
+                if (!lease)
+                        return -ENOMEM;
+
+                if (inet_pton(AF_INET, address, &lease->address) != 1 ||
+                    inet_pton(AF_INET, gateway, &lease->gateway) != 1)
+                        goto invalid;
+
+                if (unhexmem(client_id, strlen(client_id), &lease->client_id.data, &lease->client_id.length) < 0 ||
+                    lease->client_id.length == 0)
+                        goto invalid;
+
+                if (unhexmem(chaddr, strlen(chaddr), &chaddr_data, &chaddr_len) < 0 ||
+                    chaddr_len != ETH_ALEN)
+                        goto invalid;
+                memcpy(lease->chaddr, chaddr_data, ETH_ALEN);
+
+                if (safe_atou64(expiration, &expiration_real) < 0)
+                        goto invalid;
+
+                if (expiration_real <= now_real)
+                        /* expired while we were not running */
+                        continue;
+
+                lease->expiration = usec_add(now_boot, expiration_real - now_real);
+
+                pool_offset = get_pool_offset(server, lease->address);
+                if (pool_offset < 0)
+                        /* the pool changed meanwhile */
+                        continue;
+
+                if (pool_is_used(server, pool_offset) ||
+                    hashmap_contains(server->leases_by_client_id, &lease->client_id))
+                        continue;
+
+                r = dhcp_server_bind_lease(server, lease, pool_offset);
+                if (r < 0)
+                        return r;
+
+                TAKE_PTR(lease);
+                n++;
+                continue;
+
+        invalid:
+                log_dhcp_server(server, "Ignoring invalid lease in %s: %s", server->lease_file, line);
+        }
+
+        log_dhcp_server(server, "Loaded %u leases from %s", n, server->lease_file);
+
+        return 0;
+}
+
+static int save_leases_handler(sd_event_source *s, void *userdata) {
+        sd_dhcp_server *server = userdata;
+
+        assert(server);
+
+        (void) dhcp_server_save_leases(server);
+
+        return 0;
+}
+
+/* Leases are written out from a defer event source of idle priority, so that all the messages which are already
+ * queued are processed before, and the file is written only once for all of them */
+static void dhcp_server_schedule_save_leases(sd_dhcp_server *server) {
+        int r;
+
+        assert(server);
+
+        if (!server->lease_file || !server->event)
+                return;
+
+        if (server->save_leases) {
+                r = sd_event_source_set_enabled(server->save_leases, SD_EVENT_ONESHOT);
+                if (r < 0)
+                        log_dhcp_server_errno(server, r, "Failed to enable event source for saving leases: %m");
+                return;
+        }
+
+        r = sd_event_add_defer(server->event, &server->save_leases, save_leases_handler, server);
+        if (r < 0) {
+                log_dhcp_server_errno(server, r, "Failed to add event source for saving leases: %m");
+                return;
+        }
+
+        (void) sd_event_source_set_priority(server->save_leases, SD_EVENT_PRIORITY_IDLE);
+        (void) sd_event_source_set_description(server->save_leases, "dhcp-server-save-leases");
+}
+
 /* configures the server's address and subnet, and optionally the pool's size and offset into the subnet
  * the whole pool must fit into the subnet, and may not contain the first (any) nor last (broadcast) address
  * moreover, the server's own address may be in the pool, and is in that case reserved in order not to
@@ -73,12 +403,19 @@ int sd_dhcp_server_configure_pool(sd_dhcp_server *server, struct in_addr *addres
                 size = size_max;
 
         if (server->address != address->s_addr || server->netmask != netmask || server->pool_size != size || server->pool_offset != offset) {
+                size_t n_words = DIV_ROUND_UP(size, 64);
+                uint64_t *pool_used;
 
-                free(server->bound_leases);
-                server->bound_leases = new0(DHCPLease*, size);
-                if (!server->bound_leases)
+                pool_used = new0(uint64_t, n_words);
+                if (!pool_used)
                         return -ENOMEM;
 
+                /* the bits past the end of the pool never refer to a free address */
+                if (size % 64 != 0)
+                        pool_used[n_words - 1] = UINT64_MAX << (size % 64);
+
+                free_and_replace(server->pool_used, pool_used);
+
                 server->pool_offset = offset;
                 server->pool_size = size;
 
@@ -87,9 +424,10 @@ int sd_dhcp_server_configure_pool(sd_dhcp_server *server, struct in_addr *addres
                 server->subnet = address->s_addr & netmask;
 
                 if (server_off >= offset && server_off - offset < size)
-                        server->bound_leases[server_off - offset] = &server->invalid_lease;
+                        pool_set_used(server, server_off - offset, true);
 
                 /* Drop any leases associated with the old address range */
+                hashmap_clear(server->leases_by_address);
                 hashmap_clear(server->leases_by_client_id);
         }
 
@@ -140,9 +478,11 @@ static sd_dhcp_server *dhcp_server_free(sd_dhcp_server *server) {
         free(server->dns);
         free(server->ntp);
 
+        hashmap_free(server->leases_by_address);
         hashmap_free(server->leases_by_client_id);
 
-        free(server->bound_leases);
+        free(server->pool_used);
+        free(server->lease_file);
         return mfree(server);
 }
 
@@ -169,6 +509,10 @@ int sd_dhcp_server_new(sd_dhcp_server **ret, int ifindex) {
         if (!server->leases_by_client_id)
                 return -ENOMEM;
 
+        server->leases_by_address = hashmap_new(NULL);
+        if (!server->leases_by_address)
+                return -ENOMEM;
+
         server->default_lease_time = DIV_ROUND_UP(DHCP_DEFAULT_LEASE_TIME_USEC, USEC_PER_SEC);
         server->max_lease_time = DIV_ROUND_UP(DHCP_MAX_LEASE_TIME_USEC, USEC_PER_SEC);
 
@@ -216,6 +560,16 @@ int sd_dhcp_server_stop(sd_dhcp_server *server) {
         server->receive_message =
                 sd_event_source_unref(server->receive_message);
 
+        if (server->save_leases) {
+                int enabled;
+
+                /* write out what is still pending right away */
+                if (sd_event_source_get_enabled(server->save_leases, &enabled) >= 0 && enabled != SD_EVENT_OFF)
+                        (void) dhcp_server_save_leases(server);
+
+                server->save_leases = sd_event_source_unref(server->save_leases);
+        }
+
         server->fd_raw = safe_close(server->fd_raw);
         server->fd = safe_close(server->fd);
 
@@ -652,19 +1006,6 @@ static int ensure_sane_request(sd_dhcp_server *server, DHCPRequest *req, DHCPMes
         return 0;
 }
 
-static int get_pool_offset(sd_dhcp_server *server, be32_t requested_ip) {
-        assert(server);
-
-        if (!server->pool_size)
-                return -EINVAL;
-
-        if (be32toh(requested_ip) < (be32toh(server->subnet) | server->pool_offset) ||
-            be32toh(requested_ip) >= (be32toh(server->subnet) | (server->pool_offset + server->pool_size)))
-                return -ERANGE;
-
-        return be32toh(requested_ip & ~server->netmask) - server->pool_offset;
-}
-
 #define HASH_KEY SD_ID128_MAKE(0d,1d,fe,bd,f1,24,bd,b3,47,f1,dd,6e,73,21,93,30)
 
 int dhcp_server_handle_message(sd_dhcp_server *server, DHCPMessage *message,
@@ -702,7 +1043,6 @@ int dhcp_server_handle_message(sd_dhcp_server *server, DHCPMessage *message,
 
         case DHCP_DISCOVER: {
                 be32_t address = INADDR_ANY;
-                unsigned i;
 
                 log_dhcp_server(server, "DISCOVER (0x%x)",
                                 be32toh(req->message->xid));
@@ -717,7 +1057,7 @@ int dhcp_server_handle_message(sd_dhcp_server *server, DHCPMessage *message,
                 else {
                         struct siphash state;
                         uint64_t hash;
-                        uint32_t next_offer;
+                        uint32_t next_offer, pool_offset;
 
                         /* even with no persistence of leases, we try to offer the same client
                            the same IP address. we do this by using the hash of the client id
@@ -728,14 +1068,13 @@ int dhcp_server_handle_message(sd_dhcp_server *server, DHCPMessage *message,
                         hash = htole64(siphash24_finalize(&state));
                         next_offer = hash % server->pool_size;
 
-                        for (i = 0; i < server->pool_size; i++) {
-                                if (!server->bound_leases[next_offer]) {
-                                        address = server->subnet | htobe32(server->pool_offset + next_offer);
-                                        break;
-                                }
-
-                                next_offer = (next_offer + 1) % server->pool_size;
+                        r = pool_find_free(server, next_offer, &pool_offset);
+                        if (r == -ENOSPC && dhcp_server_drop_expired_leases(server) > 0) {
+                                dhcp_server_schedule_save_leases(server);
+                                r = pool_find_free(server, next_offer, &pool_offset);
                         }
+                        if (r >= 0)
+                                address = server->subnet | htobe32(server->pool_offset + pool_offset);
                 }
 
                 if (address == INADDR_ANY)
@@ -809,10 +1148,23 @@ int dhcp_server_handle_message(sd_dhcp_server *server, DHCPMessage *message,
 
                 pool_offset = get_pool_offset(server, address);
 
+                if (pool_offset >= 0) {
+                        DHCPLease *bound_lease = pool_get_lease(server, pool_offset);
+                        usec_t time_now = 0;
+
+                        /* the address may be taken over once the lease of another client expired */
+                        if (bound_lease && bound_lease != existing_lease && bound_lease != &server->invalid_lease &&
+                            sd_event_now(server->event, clock_boottime_or_monotonic(), &time_now) >= 0 &&
+                            bound_lease->expiration < time_now) {
+                                dhcp_server_unbind_lease(server, bound_lease);
+                                dhcp_server_schedule_save_leases(server);
+                        }
+                }
+
                 /* verify that the requested address is from the pool, and either
                    owned by the current client or free */
                 if (pool_offset >= 0 &&
-                    server->bound_leases[pool_offset] == existing_lease) {
+                    pool_get_lease(server, pool_offset) == existing_lease) {
                         DHCPLease *lease;
                         usec_t time_now = 0;
 
@@ -858,9 +1210,15 @@ int dhcp_server_handle_message(sd_dhcp_server *server, DHCPMessage *message,
                                 log_dhcp_server(server, "ACK (0x%x)",
                                                 be32toh(req->message->xid));
 
-                                server->bound_leases[pool_offset] = lease;
-                                hashmap_put(server->leases_by_client_id,
-                                            &lease->client_id, lease);
+                                if (!existing_lease) {
+                                        r = dhcp_server_bind_lease(server, lease, pool_offset);
+                                        if (r < 0) {
+                                                dhcp_lease_free(lease);
+                                                return log_dhcp_server_errno(server, r, "Could not bind lease: %m");
+                                        }
+                                }
+
+                                dhcp_server_schedule_save_leases(server);
 
                                 return DHCP_ACK;
                         }
@@ -894,10 +1252,9 @@ int dhcp_server_handle_message(sd_dhcp_server *server, DHCPMessage *message,
                 if (pool_offset < 0)
                         return 0;
 
-                if (server->bound_leases[pool_offset] == existing_lease) {
-                        server->bound_leases[pool_offset] = NULL;
-                        hashmap_remove(server->leases_by_client_id, existing_lease);
-                        dhcp_lease_free(existing_lease);
+                if (pool_get_lease(server, pool_offset) == existing_lease) {
+                        dhcp_server_unbind_lease(server, existing_lease);
+                        dhcp_server_schedule_save_leases(server);
                 }
 
                 return 0;
@@ -976,6 +1333,12 @@ int sd_dhcp_server_start(sd_dhcp_server *server) {
         assert_return(server->fd < 0, -EBUSY);
         assert_return(server->address != htobe32(INADDR_ANY), -EUNATCH);
 
+        if (server->lease_file) {
+                r = dhcp_server_load_leases(server);
+                if (r < 0)
+                        log_dhcp_server_errno(server, r, "Failed to load leases from %s, ignoring: %m", server->lease_file);
+        }
+
         r = socket(AF_PACKET, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
         if (r < 0) {
                 r = -errno;
@@ -1012,18 +1375,13 @@ int sd_dhcp_server_start(sd_dhcp_server *server) {
 }
 
 int sd_dhcp_server_forcerenew(sd_dhcp_server *server) {
-        unsigned i;
+        DHCPLease *lease;
+        Iterator i;
         int r = 0;
 
         assert_return(server, -EINVAL);
-        assert(server->bound_leases);
-
-        for (i = 0; i < server->pool_size; i++) {
-                DHCPLease *lease = server->bound_leases[i];
-
-                if (!lease || lease == &server->invalid_lease)
-                        continue;
 
+        HASHMAP_FOREACH(lease, server->leases_by_client_id, i) {
                 r = server_send_forcerenew(server, lease->address,
                                            lease->gateway,
                                            lease->chaddr);
@@ -1072,6 +1430,23 @@ int sd_dhcp_server_set_default_lease_time(sd_dhcp_server *server, uint32_t t) {
         return 1;
 }
 
+int sd_dhcp_server_set_lease_file(sd_dhcp_server *server, const char *path) {
+        int r;
+
+        assert_return(server, -EINVAL);
+        assert_return(!path || path_is_absolute(path), -EINVAL);
+        assert_return(!sd_dhcp_server_is_running(server), -EBUSY);
+
+        if (streq_ptr(path, server->lease_file))
+                return 0;
+
+        r = free_and_strdup(&server->lease_file, path);
+        if (r < 0)
+                return r;
+
+        return 1;
+}
+
 int sd_dhcp_server_set_dns(sd_dhcp_server *server, const struct in_addr dns[], unsigned n) {
         assert_return(server, -EINVAL);
         assert_return(dns || n <= 0, -EINVAL);
@@ -9,7 +9,11 @@
 #include "sd-event.h"
 
 #include "dhcp-server-internal.h"
+#include "fileio.h"
+#include "path-util.h"
+#include "rm-rf.h"
 #include "tests.h"
+#include "tmpfile-util.h"
 
 static void test_pool(struct in_addr *address, unsigned size, int ret) {
         _cleanup_(sd_dhcp_server_unrefp) sd_dhcp_server *server = NULL;
@@ -180,6 +184,90 @@ static void test_message_handler(void) {
         assert_se(dhcp_server_handle_message(server, (DHCPMessage*)&test, sizeof(test)) == 0);
 }
 
+static void test_lease_file(void) {
+        _cleanup_(sd_dhcp_server_unrefp) sd_dhcp_server *server = NULL;
+        _cleanup_free_ char *tmp = NULL, *lease_file = NULL, *contents = NULL;
+        struct {
+                DHCPMessage message;
+                struct {
+                        uint8_t code;
+                        uint8_t length;
+                        uint8_t type;
+                } _packed_ option_type;
+                struct {
+                        uint8_t code;
+                        uint8_t length;
+                        be32_t address;
+                } _packed_ option_requested_ip;
+                struct {
+                        uint8_t code;
+                        uint8_t length;
+                        be32_t address;
+                } _packed_ option_server_id;
+                uint8_t end;
+        } _packed_ test = {
+                .message.op = BOOTREQUEST,
+                .message.htype = ARPHRD_ETHER,
+                .message.hlen = ETHER_ADDR_LEN,
+                .message.xid = htobe32(0x12345678),
+                .message.chaddr = { 'A', 'B', 'C', 'D', 'E', 'F' },
+                .option_type.code = SD_DHCP_OPTION_MESSAGE_TYPE,
+                .option_type.length = 1,
+                .option_type.type = DHCP_REQUEST,
+                .option_requested_ip.code = SD_DHCP_OPTION_REQUESTED_IP_ADDRESS,
+                .option_requested_ip.length = 4,
+                .option_requested_ip.address = htobe32(INADDR_LOOPBACK + 3),
+                .option_server_id.code = SD_DHCP_OPTION_SERVER_IDENTIFIER,
+                .option_server_id.length = 4,
+                .option_server_id.address = htobe32(INADDR_LOOPBACK),
+                .end = SD_DHCP_OPTION_END,
+        };
+        struct in_addr address_lo = {
+                .s_addr = htonl(INADDR_LOOPBACK),
+        };
+
+        assert_se(mkdtemp_malloc(NULL, &tmp) >= 0);
+        lease_file = path_join(tmp, "leases");
+        assert_se(lease_file);
+
+        assert_se(sd_dhcp_server_new(&server, 1) >= 0);
+        assert_se(sd_dhcp_server_set_lease_file(server, "leases") == -EINVAL);
+        assert_se(sd_dhcp_server_set_lease_file(server, lease_file) == 1);
+        assert_se(sd_dhcp_server_set_lease_file(server, lease_file) == 0);
+        assert_se(sd_dhcp_server_configure_pool(server, &address_lo, 24, 0, 0) >= 0);
+        assert_se(sd_dhcp_server_attach_event(server, NULL, 0) >= 0);
+        assert_se(sd_dhcp_server_start(server) >= 0);
+
+        assert_se(dhcp_server_handle_message(server, (DHCPMessage*)&test, sizeof(test)) == DHCP_ACK);
+
+        /* the lease is written out when the server is stopped at the latest */
+        assert_se(sd_dhcp_server_stop(server) >= 0);
+        assert_se(read_full_file(lease_file, &contents, NULL) >= 0);
+        assert_se(strstr(contents, "127.0.0.4 01414243444546 414243444546 0.0.0.0 "));
+
+        server = sd_dhcp_server_unref(server);
+
+        assert_se(sd_dhcp_server_new(&server, 1) >= 0);
+        assert_se(sd_dhcp_server_set_lease_file(server, lease_file) == 1);
+        assert_se(sd_dhcp_server_configure_pool(server, &address_lo, 24, 0, 0) >= 0);
+        assert_se(sd_dhcp_server_attach_event(server, NULL, 0) >= 0);
+        assert_se(sd_dhcp_server_start(server) >= 0);
+
+        /* the address is still bound to the client */
+        assert_se(hashmap_size(server->leases_by_client_id) == 1);
+        assert_se(hashmap_get(server->leases_by_address, UINT32_TO_PTR(htobe32(INADDR_LOOPBACK + 3))));
+
+        /* and is handed out to nobody else */
+        test.message.chaddr[5] = 'G';
+        assert_se(dhcp_server_handle_message(server, (DHCPMessage*)&test, sizeof(test)) == 0);
+
+        test.message.chaddr[5] = 'F';
+        assert_se(dhcp_server_handle_message(server, (DHCPMessage*)&test, sizeof(test)) == DHCP_ACK);
+
+        server = sd_dhcp_server_unref(server);
+        assert_se(rm_rf(tmp, REMOVE_ROOT|REMOVE_PHYSICAL) >= 0);
+}
+
 static uint64_t client_id_hash_helper(DHCPClientId *id, uint8_t key[HASH_KEY_SIZE]) {
         struct siphash state;
 
@@ -238,6 +326,7 @@ int main(int argc, char *argv[]) {
                 return log_tests_skipped("cannot start dhcp server");
 
         test_message_handler();
+        test_lease_file();
         test_client_id_hash();
 
         return 0;
@@ -0,0 +1,461 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <pthread.h>
+#include <sys/socket.h>
+
+#include "sd-bus.h"
+#include "sd-event.h"
+
+#include "alloc-util.h"
+#include "fd-util.h"
+#include "json.h"
+#include "log.h"
+#include "macro.h"
+#include "parse-util.h"
+#include "string-util.h"
+#include "strv.h"
+#include "tests.h"
+#include "time-util.h"
+#include "util.h"
+
+/* Measures sd-bus under loads that resemble those of PID 1 and other busy services: many clients calling methods on
+ * one server concurrently, signals fanned out to many subscribers that each have a number of match rules installed,
+ * and GetAll() storms on an object with many properties. All connections are direct socket pairs, so that the numbers
+ * reflect the cost of sd-bus itself (message allocation, marshalling, socket I/O and match rule evaluation), and not
+ * that of a broker. The results are printed as one JSON object per line, so that they can be compared between
+ * versions.
+ *
+ * Usage: bench-bus [CLIENTS [SUBSCRIBERS [OPERATIONS]]] */
+
+#define DEFAULT_CLIENTS 8U
+#define DEFAULT_SUBSCRIBERS 16U
+#define DEFAULT_OPERATIONS 10000U
+
+/* Each subscriber installs this many match rules that never match besides the one that does */
+#define N_EXTRA_MATCHES 16U
+
+#define BENCH_PATH "/org/freedesktop/systemd1/bench"
+#define BENCH_INTERFACE "org.freedesktop.systemd1.Bench"
+
+static unsigned arg_clients = DEFAULT_CLIENTS;
+static unsigned arg_subscribers = DEFAULT_SUBSCRIBERS;
+static unsigned arg_operations = DEFAULT_OPERATIONS;
+
+typedef struct Object {
+        char *id;
+        char *description;
+        char *load_state;
+        char *active_state;
+        char *sub_state;
+        char *fragment_path;
+        char **names;
+        char **wants;
+        char **after;
+        uint64_t timestamps[8];
+        uint32_t n_restarts;
+        int can_start;
+        int can_stop;
+        int can_reload;
+} Object;
+
+static int method_ping(sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        const char *s;
+        int r;
+
+        r = sd_bus_message_read(m, "s", &s);
+        if (r < 0)
+                return r;
+
+        return sd_bus_reply_method_return(m, "s", s);
+}
+
+static const sd_bus_vtable bench_vtable[] = {
+        SD_BUS_VTABLE_START(0),
+        SD_BUS_METHOD("Ping", "s", "s", method_ping, SD_BUS_VTABLE_UNPRIVILEGED),
+        SD_BUS_PROPERTY("Id", "s", NULL, offsetof(Object, id), SD_BUS_VTABLE_PROPERTY_CONST),
+        SD_BUS_PROPERTY("Description", "s", NULL, offsetof(Object, description), SD_BUS_VTABLE_PROPERTY_CONST),
+        SD_BUS_PROPERTY("LoadState", "s", NULL, offsetof(Object, load_state), SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE),
+        SD_BUS_PROPERTY("ActiveState", "s", NULL, offsetof(Object, active_state), SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE),
+        SD_BUS_PROPERTY("SubState", "s", NULL, offsetof(Object, sub_state), SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE),
+        SD_BUS_PROPERTY("FragmentPath", "s", NULL, offsetof(Object, fragment_path), SD_BUS_VTABLE_PROPERTY_CONST),
+        SD_BUS_PROPERTY("Names", "as", NULL, offsetof(Object, names), SD_BUS_VTABLE_PROPERTY_CONST),
+        SD_BUS_PROPERTY("Wants", "as", NULL, offsetof(Object, wants), SD_BUS_VTABLE_PROPERTY_CONST),
+        SD_BUS_PROPERTY("After", "as", NULL, offsetof(Object, after), SD_BUS_VTABLE_PROPERTY_CONST),
+        SD_BUS_PROPERTY("StateChangeTimestamp", "t", NULL, offsetof(Object, timestamps[0]), SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE),
+        SD_BUS_PROPERTY("InactiveExitTimestamp", "t", NULL, offsetof(Object, timestamps[1]), SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE),
+        SD_BUS_PROPERTY("InactiveExitTimestampMonotonic", "t", NULL, offsetof(Object, timestamps[2]), SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE),
+        SD_BUS_PROPERTY("ActiveEnterTimestamp", "t", NULL, offsetof(Object, timestamps[3]), SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE),
+        SD_BUS_PROPERTY("ActiveEnterTimestampMonotonic", "t", NULL, offsetof(Object, timestamps[4]), SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE),
+        SD_BUS_PROPERTY("ActiveExitTimestamp", "t", NULL, offsetof(Object, timestamps[5]), SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE),
+        SD_BUS_PROPERTY("InactiveEnterTimestamp", "t", NULL, offsetof(Object, timestamps[6]), SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE),
+        SD_BUS_PROPERTY("ConditionTimestamp", "t", NULL, offsetof(Object, timestamps[7]), SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE),
+        SD_BUS_PROPERTY("NRestarts", "u", NULL, offsetof(Object, n_restarts), SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE),
+        SD_BUS_PROPERTY("CanStart", "b", NULL, offsetof(Object, can_start), SD_BUS_VTABLE_PROPERTY_CONST),
+        SD_BUS_PROPERTY("CanStop", "b", NULL, offsetof(Object, can_stop), SD_BUS_VTABLE_PROPERTY_CONST),
+        SD_BUS_PROPERTY("CanReload", "b", NULL, offsetof(Object, can_reload), SD_BUS_VTABLE_PROPERTY_CONST),
+        SD_BUS_SIGNAL("Tick", "st", 0),
+        SD_BUS_VTABLE_END
+};
+
+static Object bench_object = {
+        .id = (char*) "bench.service",
+        .description = (char*) "Benchmark Service",
+        .load_state = (char*) "loaded",
+        .active_state = (char*) "active",
+        .sub_state = (char*) "running",
+        .fragment_path = (char*) "/usr/lib/systemd/system/bench.service",
+        .names = STRV_MAKE("bench.service", "bench-alias.service"),
+        .wants = STRV_MAKE("network.target", "basic.target", "sysinit.target"),
+        .after = STRV_MAKE("network.target", "basic.target", "sysinit.target", "systemd-journald.socket", "system.slice"),
+        .timestamps = { 1, 2, 3, 4, 5, 6, 7, 8 },
+        .n_restarts = 3,
+        .can_start = true,
+        .can_stop = true,
+        .can_reload = false,
+};
+
+typedef struct Client {
+        sd_bus *bus;
+        pthread_t thread;
+        pthread_barrier_t *barrier;
+
+        /* Latency of each operation, in µs */
+        usec_t *latencies;
+        unsigned n_latencies;
+} Client;
+
+typedef struct Server {
+        sd_event *event;
+        sd_bus **buses;
+        unsigned n_buses;
+        unsigned n_disconnected;
+} Server;
+
+static void new_connection_pair(sd_bus **ret_server, sd_bus **ret_client) {
+        _cleanup_(sd_bus_unrefp) sd_bus *a = NULL, *b = NULL;
+        int pair[2];
+
+        assert_se(socketpair(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC|SOCK_NONBLOCK, 0, pair) >= 0);
+
+        assert_se(sd_bus_new(&a) >= 0);
+        assert_se(sd_bus_set_fd(a, pair[0], pair[0]) >= 0);
+        assert_se(sd_bus_set_server(a, true, SD_ID128_MAKE(9c,1d,5e,ad,10,a0,49,4b,a1,c2,05,50,2f,6f,9e,61)) >= 0);
+        assert_se(sd_bus_start(a) >= 0);
+
+        assert_se(sd_bus_new(&b) >= 0);
+        assert_se(sd_bus_set_fd(b, pair[1], pair[1]) >= 0);
+        assert_se(sd_bus_start(b) >= 0);
+
+        *ret_server = TAKE_PTR(a);
+        *ret_client = TAKE_PTR(b);
+}
+
+static void client_wait_for(Client *c) {
+        /* Completes the authentication before the clock starts */
+        assert_se(sd_bus_call_method(c->bus, NULL, BENCH_PATH, BENCH_INTERFACE, "Ping", NULL, NULL, "s", "hello") >= 0);
+}
+
+static int compare_usec(const usec_t *a, const usec_t *b) {
+        return CMP(*a, *b);
+}
+
+static usec_t percentile(const usec_t *sorted, size_t n, unsigned per_mille) {
+        if (n == 0)
+                return 0;
+
+        return sorted[MIN(n - 1, n * per_mille / 1000)];
+}
+
+static void report(const char *benchmark, unsigned connections, uint64_t messages, usec_t duration, Client *clients, unsigned n_clients) {
+        _cleanup_(json_variant_unrefp) JsonVariant *v = NULL;
+        _cleanup_free_ usec_t *all = NULL;
+        size_t n = 0;
+        unsigned i;
+
+        for (i = 0; i < n_clients; i++)
+                n += clients[i].n_latencies;
+
+        all = new(usec_t, MAX(n, (size_t) 1));
+        assert_se(all);
+
+        n = 0;
+        for (i = 0; i < n_clients; i++) {
+                memcpy_safe(all + n, clients[i].latencies, clients[i].n_latencies * sizeof(usec_t));
+                n += clients[i].n_latencies;
+        }
+
+        typesafe_qsort(all, n, compare_usec);
+
+        assert_se(json_build(&v, JSON_BUILD_OBJECT(
+                                             JSON_BUILD_PAIR("benchmark", JSON_BUILD_STRING(benchmark)),
+                                             JSON_BUILD_PAIR("connections", JSON_BUILD_UNSIGNED(connections)),
+                                             JSON_BUILD_PAIR("operations", JSON_BUILD_UNSIGNED(n)),
+                                             JSON_BUILD_PAIR("messages", JSON_BUILD_UNSIGNED(messages)),
+                                             JSON_BUILD_PAIR("usec", JSON_BUILD_UNSIGNED(duration)),
+                                             JSON_BUILD_PAIR("messages_per_second", JSON_BUILD_REAL(duration > 0 ? (long double) messages * USEC_PER_SEC / duration : 0)),
+                                             JSON_BUILD_PAIR("p50_usec", JSON_BUILD_UNSIGNED(percentile(all, n, 500))),
+                                             JSON_BUILD_PAIR("p99_usec", JSON_BUILD_UNSIGNED(percentile(all, n, 990))),
+                                             JSON_BUILD_PAIR("p999_usec", JSON_BUILD_UNSIGNED(percentile(all, n, 999))),
+                                             JSON_BUILD_PAIR("max_usec", JSON_BUILD_UNSIGNED(n > 0 ? all[n - 1] : 0)))) >= 0);
+
+        json_variant_dump(v, JSON_FORMAT_NEWLINE, stdout, NULL);
+        fflush(stdout);
+}
+
+static int on_disconnected(sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        Server *s = userdata;
+
+        if (++s->n_disconnected >= s->n_buses)
+                return sd_event_exit(s->event, 0);
+
+        return 0;
+}
+
+static void server_init(Server *s, Client *clients, unsigned n_clients) {
+        unsigned i;
+
+        assert_se(sd_event_new(&s->event) >= 0);
+
+        s->buses = new0(sd_bus*, n_clients);
+        assert_se(s->buses);
+        s->n_buses = n_clients;
+
+        for (i = 0; i < n_clients; i++) {
+                new_connection_pair(s->buses + i, &clients[i].bus);
+
+                assert_se(sd_bus_add_object_vtable(s->buses[i], NULL, BENCH_PATH, BENCH_INTERFACE, bench_vtable, &bench_object) >= 0);
+                assert_se(sd_bus_match_signal(s->buses[i], NULL, NULL, "/org/freedesktop/DBus/Local", "org.freedesktop.DBus.Local", "Disconnected", on_disconnected, s) >= 0);
+                assert_se(sd_bus_attach_event(s->buses[i], s->event, SD_EVENT_PRIORITY_NORMAL) >= 0);
+        }
+}
+
+static void server_done(Server *s) {
+        unsigned i;
+
+        for (i = 0; i < s->n_buses; i++) {
+                (void) sd_bus_detach_event(s->buses[i]);
+                sd_bus_flush_close_unref(s->buses[i]);
+        }
+
+        s->buses = mfree(s->buses);
+        s->event = sd_event_unref(s->event);
+}
+
+static void *server_thread(void *p) {
+        Server *s = p;
+
+        assert_se(sd_event_loop(s->event) >= 0);
+
+        return NULL;
+}
+
+static void *client_ping_thread(void *p) {
+        Client *c = p;
+        unsigned i;
+
+        client_wait_for(c);
+        (void) pthread_barrier_wait(c->barrier);
+
+        for (i = 0; i < arg_operations; i++) {
+                _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
+                usec_t start;
+
+                start = now(CLOCK_MONOTONIC);
+                assert_se(sd_bus_call_method(c->bus, NULL, BENCH_PATH, BENCH_INTERFACE, "Ping", NULL, &reply, "s", "ping") >= 0);
+                c->latencies[c->n_latencies++] = now(CLOCK_MONOTONIC) - start;
+        }
+
+        return NULL;
+}
+
+static void *client_get_all_thread(void *p) {
+        Client *c = p;
+        unsigned i;
+
+        client_wait_for(c);
+        (void) pthread_barrier_wait(c->barrier);
+
+        for (i = 0; i < arg_operations; i++) {
+                _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
+                usec_t start;
+
+                start = now(CLOCK_MONOTONIC);
+                assert_se(sd_bus_call_method(c->bus, NULL, BENCH_PATH, "org.freedesktop.DBus.Properties", "GetAll", NULL, &reply, "s", BENCH_INTERFACE) >= 0);
+                c->latencies[c->n_latencies++] = now(CLOCK_MONOTONIC) - start;
+        }
+
+        return NULL;
+}
+
+static void bench_method_calls(const char *benchmark, void *(*func)(void *)) {
+        _cleanup_free_ Client *clients = NULL;
+        pthread_barrier_t barrier;
+        pthread_t server;
+        Server s = {};
+        usec_t start;
+        unsigned i;
+
+        clients = new0(Client, arg_clients);
+        assert_se(clients);
+
+        assert_se(pthread_barrier_init(&barrier, NULL, arg_clients + 1) == 0);
+
+        server_init(&s, clients, arg_clients);
+        assert_se(pthread_create(&server, NULL, server_thread, &s) == 0);
+
+        for (i = 0; i < arg_clients; i++) {
+                clients[i].barrier = &barrier;
+                clients[i].latencies = new(usec_t, arg_operations);
+                assert_se(clients[i].latencies);
+
+                assert_se(pthread_create(&clients[i].thread, NULL, func, clients + i) == 0);
+        }
+
+        (void) pthread_barrier_wait(&barrier);
+        start = now(CLOCK_MONOTONIC);
+
+        for (i = 0; i < arg_clients; i++)
+                assert_se(pthread_join(clients[i].thread, NULL) == 0);
+
+        /* Each call is one message in each direction */
+        report(benchmark, arg_clients, 2 * (uint64_t) arg_clients * arg_operations, now(CLOCK_MONOTONIC) - start, clients, arg_clients);
+
+        for (i = 0; i < arg_clients; i++) {
+                clients[i].bus = sd_bus_flush_close_unref(clients[i].bus);
+                free(clients[i].latencies);
+        }
+
+        assert_se(pthread_join(server, NULL) == 0);
+        server_done(&s);
+
+        assert_se(pthread_barrier_destroy(&barrier) == 0);
+}
+
+static int on_tick(sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        Client *c = userdata;
+        const char *s;
+        usec_t sent;
+
+        assert_se(sd_bus_message_read(m, "st", &s, &sent) >= 0);
+        c->latencies[c->n_latencies++] = now(CLOCK_MONOTONIC) - sent;
+
+        return 0;
+}
+
+static int on_tick_unexpected(sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        assert_not_reached("Non-matching match rule triggered");
+}
+
+static void *subscriber_thread(void *p) {
+        Client *c = p;
+
+        while (c->n_latencies < arg_operations) {
+                int r;
+
+                r = sd_bus_process(c->bus, NULL);
+                assert_se(r >= 0);
+                if (r > 0)
+                        continue;
+
+                assert_se(sd_bus_wait(c->bus, USEC_INFINITY) >= 0);
+        }
+
+        return NULL;
+}
+
+static void bench_signals(void) {
+        _cleanup_free_ Client *subscribers = NULL;
+        _cleanup_free_ sd_bus **emitters = NULL;
+        usec_t start;
+        unsigned i, j;
+
+        subscribers = new0(Client, arg_subscribers);
+        emitters = new0(sd_bus*, arg_subscribers);
+        assert_se(subscribers && emitters);
+
+        for (i = 0; i < arg_subscribers; i++) {
+                Client *c = subscribers + i;
+
+                new_connection_pair(emitters + i, &c->bus);
+
+                c->latencies = new(usec_t, arg_operations);
+                assert_se(c->latencies);
+
+                /* Rules that differ from the matching one in each of the fields, so that none can be skipped
+                 * early */
+                for (j = 0; j < N_EXTRA_MATCHES; j++) {
+                        _cleanup_free_ char *match = NULL;
+
+                        switch (j % 4) {
+                        case 0:
+                                assert_se(asprintf(&match, "type='signal',interface='" BENCH_INTERFACE "%u',member='Tick'", j) >= 0);
+                                break;
+                        case 1:
+                                assert_se(asprintf(&match, "type='signal',interface='" BENCH_INTERFACE "',member='Tock%u'", j) >= 0);
+                                break;
+                        case 2:
+                                assert_se(asprintf(&match, "type='signal',path='" BENCH_PATH "/%u'", j) >= 0);
+                                break;
+                        case 3:
+                                assert_se(asprintf(&match, "type='signal',interface='" BENCH_INTERFACE "',member='Tick',arg0='other%u'", j) >= 0);
+                                break;
+                        }
+
+                        assert_se(sd_bus_add_match(c->bus, NULL, match, on_tick_unexpected, NULL) >= 0);
+                }
+
+                assert_se(sd_bus_add_match(c->bus, NULL, "type='signal',interface='" BENCH_INTERFACE "',member='Tick',arg0='bench'", on_tick, c) >= 0);
+
+                assert_se(pthread_create(&c->thread, NULL, subscriber_thread, c) == 0);
+        }
+
+        /* Completes the authentication before the clock starts */
+        for (i = 0; i < arg_subscribers; i++)
+                assert_se(sd_bus_flush(emitters[i]) >= 0);
+
+        start = now(CLOCK_MONOTONIC);
+
+        for (j = 0; j < arg_operations; j++) {
+                usec_t sent = now(CLOCK_MONOTONIC);
+
+                for (i = 0; i < arg_subscribers; i++)
+                        assert_se(sd_bus_emit_signal(emitters[i], BENCH_PATH, BENCH_INTERFACE, "Tick", "st", "bench", sent) >= 0);
+
+                /* Don't let the write queues grow without bounds if the subscribers fall behind */
+                for (i = 0; i < arg_subscribers; i++)
+                        assert_se(sd_bus_flush(emitters[i]) >= 0);
+        }
+
+        for (i = 0; i < arg_subscribers; i++)
+                assert_se(pthread_join(subscribers[i].thread, NULL) == 0);
+
+        report("signal-fanout", arg_subscribers, (uint64_t) arg_subscribers * arg_operations, now(CLOCK_MONOTONIC) - start, subscribers, arg_subscribers);
+
+        for (i = 0; i < arg_subscribers; i++) {
+                sd_bus_flush_close_unref(emitters[i]);
+                sd_bus_flush_close_unref(subscribers[i].bus);
+                free(subscribers[i].latencies);
+        }
+}
+
+int main(int argc, char *argv[]) {
+        test_setup_logging(LOG_INFO);
+
+        if (argc > 4) {
+                log_error("Usage: %s [CLIENTS [SUBSCRIBERS [OPERATIONS]]]", program_invocation_short_name);
+                return EXIT_FAILURE;
+        }
+
+        if (argc > 1)
+                assert_se(safe_atou(argv[1], &arg_clients) >= 0 && arg_clients > 0);
+        if (argc > 2)
+                assert_se(safe_atou(argv[2], &arg_subscribers) >= 0 && arg_subscribers > 0);
+        if (argc > 3)
+                assert_se(safe_atou(argv[3], &arg_operations) >= 0 && arg_operations > 0);
+
+        bench_method_calls("method-call", client_ping_thread);
+        bench_signals();
+        bench_method_calls("get-all", client_get_all_thread);
+
+        return 0;
+}
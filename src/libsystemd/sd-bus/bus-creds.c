@@ -1,11 +1,18 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 
+#include <fcntl.h>
 #include <linux/capability.h>
+#include <poll.h>
 #include <stdlib.h>
 
+#if HAVE_PIDFD_OPEN
+#include <sys/pidfd.h>
+#endif
+
 #include "alloc-util.h"
 #include "audit-util.h"
 #include "bus-creds.h"
+#include "bus-internal.h"
 #include "bus-label.h"
 #include "bus-message.h"
 #include "bus-util.h"
@@ -15,6 +22,8 @@
 #include "fileio.h"
 #include "format-util.h"
 #include "hexdecoct.h"
+#include "io-util.h"
+#include "missing_syscall.h"
 #include "parse-util.h"
 #include "process-util.h"
 #include "string-util.h"
@@ -1101,88 +1110,79 @@ int bus_creds_add_more(sd_bus_creds *c, uint64_t mask, pid_t pid, pid_t tid) {
         if (tid > 0 && tid != pid && !pid_is_unwaited(tid))
                 return -ESRCH;
 
-        c->augmented = missing & c->mask;
+        c->augmented |= missing & c->mask;
 
         return 0;
 }
 
-int bus_creds_extend_by_pid(sd_bus_creds *c, uint64_t mask, sd_bus_creds **ret) {
-        _cleanup_(sd_bus_creds_unrefp) sd_bus_creds *n = NULL;
-        int r;
+static int bus_creds_copy(sd_bus_creds *n, sd_bus_creds *c, uint64_t mask) {
+        uint64_t old_mask;
 
+        assert(n);
         assert(c);
-        assert(ret);
 
-        if ((mask & ~c->mask) == 0 || (!(mask & SD_BUS_CREDS_AUGMENT))) {
-                /* There's already all data we need, or augmentation
-                 * wasn't turned on. */
+        /* Copies the fields selected by mask from c over to n, unless n has them already */
 
-                *ret = sd_bus_creds_ref(c);
-                return 0;
-        }
-
-        n = bus_creds_new();
-        if (!n)
-                return -ENOMEM;
+        old_mask = n->mask;
+        mask &= c->mask & ~n->mask;
 
-        /* Copy the original data over */
 
-        if (c->mask & mask & SD_BUS_CREDS_PID) {
+        if (mask & SD_BUS_CREDS_PID) {
                 n->pid = c->pid;
                 n->mask |= SD_BUS_CREDS_PID;
         }
 
-        if (c->mask & mask & SD_BUS_CREDS_TID) {
+        if (mask & SD_BUS_CREDS_TID) {
                 n->tid = c->tid;
                 n->mask |= SD_BUS_CREDS_TID;
         }
 
-        if (c->mask & mask & SD_BUS_CREDS_PPID) {
+        if (mask & SD_BUS_CREDS_PPID) {
                 n->ppid = c->ppid;
                 n->mask |= SD_BUS_CREDS_PPID;
         }
 
-        if (c->mask & mask & SD_BUS_CREDS_UID) {
+        if (mask & SD_BUS_CREDS_UID) {
                 n->uid = c->uid;
                 n->mask |= SD_BUS_CREDS_UID;
         }
 
-        if (c->mask & mask & SD_BUS_CREDS_EUID) {
+        if (mask & SD_BUS_CREDS_EUID) {
                 n->euid = c->euid;
                 n->mask |= SD_BUS_CREDS_EUID;
         }
 
-        if (c->mask & mask & SD_BUS_CREDS_SUID) {
+        if (mask & SD_BUS_CREDS_SUID) {
                 n->suid = c->suid;
                 n->mask |= SD_BUS_CREDS_SUID;
         }
 
-        if (c->mask & mask & SD_BUS_CREDS_FSUID) {
+        if (mask & SD_BUS_CREDS_FSUID) {
                 n->fsuid = c->fsuid;
                 n->mask |= SD_BUS_CREDS_FSUID;
         }
 
-        if (c->mask & mask & SD_BUS_CREDS_GID) {
+        if (mask & SD_BUS_CREDS_GID) {
                 n->gid = c->gid;
                 n->mask |= SD_BUS_CREDS_GID;
         }
 
-        if (c->mask & mask & SD_BUS_CREDS_EGID) {
+        if (mask & SD_BUS_CREDS_EGID) {
                 n->egid = c->egid;
                 n->mask |= SD_BUS_CREDS_EGID;
         }
 
-        if (c->mask & mask & SD_BUS_CREDS_SGID) {
+        if (mask & SD_BUS_CREDS_SGID) {
                 n->sgid = c->sgid;
                 n->mask |= SD_BUS_CREDS_SGID;
         }
 
-        if (c->mask & mask & SD_BUS_CREDS_FSGID) {
+        if (mask & SD_BUS_CREDS_FSGID) {
                 n->fsgid = c->fsgid;
                 n->mask |= SD_BUS_CREDS_FSGID;
         }
 
-        if (c->mask & mask & SD_BUS_CREDS_SUPPLEMENTARY_GIDS) {
+        if (mask & SD_BUS_CREDS_SUPPLEMENTARY_GIDS) {
                 if (c->supplementary_gids) {
                         n->supplementary_gids = newdup(gid_t, c->supplementary_gids, c->n_supplementary_gids);
                         if (!n->supplementary_gids)
@@ -1196,7 +1196,7 @@ int bus_creds_extend_by_pid(sd_bus_creds *c, uint64_t mask, sd_bus_creds **ret)
                 n->mask |= SD_BUS_CREDS_SUPPLEMENTARY_GIDS;
         }
 
-        if (c->mask & mask & SD_BUS_CREDS_COMM) {
+        if (mask & SD_BUS_CREDS_COMM) {
                 assert(c->comm);
 
                 n->comm = strdup(c->comm);
@@ -1206,7 +1206,7 @@ int bus_creds_extend_by_pid(sd_bus_creds *c, uint64_t mask, sd_bus_creds **ret)
                 n->mask |= SD_BUS_CREDS_COMM;
         }
 
-        if (c->mask & mask & SD_BUS_CREDS_TID_COMM) {
+        if (mask & SD_BUS_CREDS_TID_COMM) {
                 assert(c->tid_comm);
 
                 n->tid_comm = strdup(c->tid_comm);
@@ -1216,7 +1216,7 @@ int bus_creds_extend_by_pid(sd_bus_creds *c, uint64_t mask, sd_bus_creds **ret)
                 n->mask |= SD_BUS_CREDS_TID_COMM;
         }
 
-        if (c->mask & mask & SD_BUS_CREDS_EXE) {
+        if (mask & SD_BUS_CREDS_EXE) {
                 if (c->exe) {
                         n->exe = strdup(c->exe);
                         if (!n->exe)
@@ -1227,7 +1227,7 @@ int bus_creds_extend_by_pid(sd_bus_creds *c, uint64_t mask, sd_bus_creds **ret)
                 n->mask |= SD_BUS_CREDS_EXE;
         }
 
-        if (c->mask & mask & SD_BUS_CREDS_CMDLINE) {
+        if (mask & SD_BUS_CREDS_CMDLINE) {
                 if (c->cmdline) {
                         n->cmdline = memdup(c->cmdline, c->cmdline_size);
                         if (!n->cmdline)
@@ -1242,31 +1242,35 @@ int bus_creds_extend_by_pid(sd_bus_creds *c, uint64_t mask, sd_bus_creds **ret)
                 n->mask |= SD_BUS_CREDS_CMDLINE;
         }
 
-        if (c->mask & mask & (SD_BUS_CREDS_CGROUP|SD_BUS_CREDS_SESSION|SD_BUS_CREDS_UNIT|SD_BUS_CREDS_USER_UNIT|SD_BUS_CREDS_SLICE|SD_BUS_CREDS_USER_SLICE|SD_BUS_CREDS_OWNER_UID)) {
+        if (mask & (SD_BUS_CREDS_CGROUP|SD_BUS_CREDS_SESSION|SD_BUS_CREDS_UNIT|SD_BUS_CREDS_USER_UNIT|SD_BUS_CREDS_SLICE|SD_BUS_CREDS_USER_SLICE|SD_BUS_CREDS_OWNER_UID)) {
                 assert(c->cgroup);
 
-                n->cgroup = strdup(c->cgroup);
-                if (!n->cgroup)
-                        return -ENOMEM;
+                /* All of these are derived from the cgroup path, which we might have already */
+                if (!n->cgroup) {
+                        n->cgroup = strdup(c->cgroup);
+                        if (!n->cgroup)
+                                return -ENOMEM;
 
-                n->cgroup_root = strdup(c->cgroup_root);
-                if (!n->cgroup_root)
-                        return -ENOMEM;
+                        n->cgroup_root = strdup(c->cgroup_root);
+                        if (!n->cgroup_root)
+                                return -ENOMEM;
+                }
 
                 n->mask |= mask & (SD_BUS_CREDS_CGROUP|SD_BUS_CREDS_SESSION|SD_BUS_CREDS_UNIT|SD_BUS_CREDS_USER_UNIT|SD_BUS_CREDS_SLICE|SD_BUS_CREDS_USER_SLICE|SD_BUS_CREDS_OWNER_UID);
         }
 
-        if (c->mask & mask & (SD_BUS_CREDS_EFFECTIVE_CAPS|SD_BUS_CREDS_PERMITTED_CAPS|SD_BUS_CREDS_INHERITABLE_CAPS|SD_BUS_CREDS_BOUNDING_CAPS)) {
+        if ((mask & (SD_BUS_CREDS_EFFECTIVE_CAPS|SD_BUS_CREDS_PERMITTED_CAPS|SD_BUS_CREDS_INHERITABLE_CAPS|SD_BUS_CREDS_BOUNDING_CAPS)) &&
+            !n->capability) {
                 assert(c->capability);
 
                 n->capability = memdup(c->capability, DIV_ROUND_UP(cap_last_cap(), 32U) * 4 * 4);
                 if (!n->capability)
                         return -ENOMEM;
 
-                n->mask |= c->mask & mask & (SD_BUS_CREDS_EFFECTIVE_CAPS|SD_BUS_CREDS_PERMITTED_CAPS|SD_BUS_CREDS_INHERITABLE_CAPS|SD_BUS_CREDS_BOUNDING_CAPS);
+                n->mask |= mask & (SD_BUS_CREDS_EFFECTIVE_CAPS|SD_BUS_CREDS_PERMITTED_CAPS|SD_BUS_CREDS_INHERITABLE_CAPS|SD_BUS_CREDS_BOUNDING_CAPS);
         }
 
-        if (c->mask & mask & SD_BUS_CREDS_SELINUX_CONTEXT) {
+        if (mask & SD_BUS_CREDS_SELINUX_CONTEXT) {
                 assert(c->label);
 
                 n->label = strdup(c->label);
@@ -1275,16 +1279,16 @@ int bus_creds_extend_by_pid(sd_bus_creds *c, uint64_t mask, sd_bus_creds **ret)
                 n->mask |= SD_BUS_CREDS_SELINUX_CONTEXT;
         }
 
-        if (c->mask & mask & SD_BUS_CREDS_AUDIT_SESSION_ID) {
+        if (mask & SD_BUS_CREDS_AUDIT_SESSION_ID) {
                 n->audit_session_id = c->audit_session_id;
                 n->mask |= SD_BUS_CREDS_AUDIT_SESSION_ID;
         }
-        if (c->mask & mask & SD_BUS_CREDS_AUDIT_LOGIN_UID) {
+        if (mask & SD_BUS_CREDS_AUDIT_LOGIN_UID) {
                 n->audit_login_uid = c->audit_login_uid;
                 n->mask |= SD_BUS_CREDS_AUDIT_LOGIN_UID;
         }
 
-        if (c->mask & mask & SD_BUS_CREDS_TTY) {
+        if (mask & SD_BUS_CREDS_TTY) {
                 if (c->tty) {
                         n->tty = strdup(c->tty);
                         if (!n->tty)
@@ -1294,7 +1298,7 @@ int bus_creds_extend_by_pid(sd_bus_creds *c, uint64_t mask, sd_bus_creds **ret)
                 n->mask |= SD_BUS_CREDS_TTY;
         }
 
-        if (c->mask & mask & SD_BUS_CREDS_UNIQUE_NAME) {
+        if (mask & SD_BUS_CREDS_UNIQUE_NAME) {
                 assert(c->unique_name);
 
                 n->unique_name = strdup(c->unique_name);
@@ -1303,7 +1307,7 @@ int bus_creds_extend_by_pid(sd_bus_creds *c, uint64_t mask, sd_bus_creds **ret)
                 n->mask |= SD_BUS_CREDS_UNIQUE_NAME;
         }
 
-        if (c->mask & mask & SD_BUS_CREDS_WELL_KNOWN_NAMES) {
+        if (mask & SD_BUS_CREDS_WELL_KNOWN_NAMES) {
                 if (strv_isempty(c->well_known_names))
                         n->well_known_names = NULL;
                 else {
@@ -1316,7 +1320,7 @@ int bus_creds_extend_by_pid(sd_bus_creds *c, uint64_t mask, sd_bus_creds **ret)
                 n->mask |= SD_BUS_CREDS_WELL_KNOWN_NAMES;
         }
 
-        if (c->mask & mask & SD_BUS_CREDS_DESCRIPTION) {
+        if (mask & SD_BUS_CREDS_DESCRIPTION) {
                 assert(c->description);
                 n->description = strdup(c->description);
                 if (!n->description)
@@ -1324,11 +1328,39 @@ int bus_creds_extend_by_pid(sd_bus_creds *c, uint64_t mask, sd_bus_creds **ret)
                 n->mask |= SD_BUS_CREDS_DESCRIPTION;
         }
 
-        n->augmented = c->augmented & n->mask;
+        n->augmented |= c->augmented & n->mask & ~old_mask;
+
+        return 0;
+}
+
+int bus_creds_extend_by_pid(sd_bus *bus, sd_bus_creds *c, uint64_t mask, sd_bus_creds **ret) {
+        _cleanup_(sd_bus_creds_unrefp) sd_bus_creds *n = NULL;
+        int r;
+
+        assert(bus);
+        assert(c);
+        assert(ret);
+
+        if ((mask & ~c->mask) == 0 || (!(mask & SD_BUS_CREDS_AUGMENT))) {
+                /* There's already all data we need, or augmentation
+                 * wasn't turned on. */
+
+                *ret = sd_bus_creds_ref(c);
+                return 0;
+        }
+
+        n = bus_creds_new();
+        if (!n)
+                return -ENOMEM;
+
+        /* Copy the original data over */
+        r = bus_creds_copy(n, c, mask);
+        if (r < 0)
+                return r;
 
         /* Get more data */
 
-        r = bus_creds_add_more(n, mask, 0, 0);
+        r = bus_creds_augment(bus, n, mask, 0, 0);
         if (r < 0)
                 return r;
 
@@ -1336,3 +1368,216 @@ int bus_creds_extend_by_pid(sd_bus_creds *c, uint64_t mask, sd_bus_creds **ret)
 
         return 0;
 }
+
+/* Augmenting credentials means parsing a number of files in /proc, for every method call that needs them. Hence we
+ * keep the augmented data around for a short while, so that a client issuing a series of calls is looked at only
+ * once. Entries are validated with a pidfd, which becomes readable when the process exits, so that the data of a
+ * dead process is never handed out for a process reusing its PID. Without pidfd support nothing is cached. Data
+ * that is not augmented, i.e. that we got from the kernel or the bus broker, and the data of individual threads is
+ * never taken from the cache. */
+
+typedef struct CredsCacheEntry {
+        pid_t pid;
+        int pidfd;
+        usec_t timestamp;
+        sd_bus_creds *creds;
+} CredsCacheEntry;
+
+static bool pidfd_supported = true;
+
+static CredsCacheEntry* creds_cache_entry_free(CredsCacheEntry *e) {
+        if (!e)
+                return NULL;
+
+        safe_close(e->pidfd);
+        sd_bus_creds_unref(e->creds);
+
+        return mfree(e);
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(CredsCacheEntry*, creds_cache_entry_free);
+
+static bool creds_cache_entry_valid(CredsCacheEntry *e, usec_t now) {
+        assert(e);
+
+        if (e->timestamp + BUS_CREDS_CACHE_USEC <= now)
+                return false;
+
+        /* The pidfd polls readable once the process exited */
+        return fd_wait_for_event(e->pidfd, POLLIN, 0) == 0;
+}
+
+static void creds_cache_flush_locked(sd_bus *bus) {
+        hashmap_clear_with_destructor(bus->creds_cache, creds_cache_entry_free);
+}
+
+static void creds_cache_make_room(sd_bus *bus, usec_t now) {
+        CredsCacheEntry *e;
+        Iterator i;
+
+        assert(bus);
+
+        if (hashmap_size(bus->creds_cache) < BUS_CREDS_CACHE_MAX)
+                return;
+
+        HASHMAP_FOREACH(e, bus->creds_cache, i)
+                if (!creds_cache_entry_valid(e, now))
+                        creds_cache_entry_free(hashmap_remove(bus->creds_cache, PID_TO_PTR(e->pid)));
+
+        /* Still full? Then the cache doesn't help much anyway, start over */
+        if (hashmap_size(bus->creds_cache) >= BUS_CREDS_CACHE_MAX)
+                creds_cache_flush_locked(bus);
+}
+
+static int creds_cache_open_pidfd(pid_t pid) {
+        int fd;
+
+        if (!pidfd_supported)
+                return -EOPNOTSUPP;
+
+        fd = pidfd_open(pid, 0);
+        if (fd < 0) {
+                if (IN_SET(errno, ENOSYS, EPERM))
+                        pidfd_supported = false;
+
+                return -errno;
+        }
+
+        return fd;
+}
+
+static int creds_cache_lookup(sd_bus *bus, sd_bus_creds *c, uint64_t cacheable, pid_t pid, usec_t now) {
+        CredsCacheEntry *e;
+        int r;
+
+        /* Copies what the cache knows about the process into c. Returns a duplicate of the pidfd of the entry, or
+         * -ENOENT if there is none. */
+
+        e = hashmap_get(bus->creds_cache, PID_TO_PTR(pid));
+        if (!e)
+                return -ENOENT;
+
+        if (!creds_cache_entry_valid(e, now)) {
+                creds_cache_entry_free(hashmap_remove(bus->creds_cache, PID_TO_PTR(pid)));
+                return -ENOENT;
+        }
+
+        r = bus_creds_copy(c, e->creds, cacheable & e->creds->augmented);
+        if (r < 0)
+                return r;
+
+        if ((cacheable & ~c->mask) == 0)
+                return 0;
+
+        /* Something is missing, which the caller reads from /proc, while another thread might drop the entry */
+        r = fcntl(e->pidfd, F_DUPFD_CLOEXEC, 3);
+        if (r < 0)
+                return -errno;
+
+        return r;
+}
+
+static int creds_cache_store(sd_bus *bus, sd_bus_creds *c, uint64_t cacheable, pid_t pid, int *pidfd, usec_t now) {
+        _cleanup_(creds_cache_entry_freep) CredsCacheEntry *n = NULL;
+        CredsCacheEntry *e;
+        int r;
+
+        /* Another thread might have added an entry in the meantime. Both of us pinned the process before reading
+         * /proc and checked it is still alive afterwards, hence it's the same process. */
+        e = hashmap_get(bus->creds_cache, PID_TO_PTR(pid));
+        if (e)
+                /* Keep the original timestamp, as some of the data is as old */
+                return bus_creds_copy(e->creds, c, cacheable & c->augmented);
+
+        creds_cache_make_room(bus, now);
+
+        r = hashmap_ensure_allocated(&bus->creds_cache, NULL);
+        if (r < 0)
+                return r;
+
+        n = new(CredsCacheEntry, 1);
+        if (!n)
+                return -ENOMEM;
+
+        *n = (CredsCacheEntry) {
+                .pid = pid,
+                .pidfd = TAKE_FD(*pidfd),
+                .timestamp = now,
+                .creds = bus_creds_new(),
+        };
+        if (!n->creds)
+                return -ENOMEM;
+
+        r = bus_creds_copy(n->creds, c, cacheable & c->augmented);
+        if (r < 0)
+                return r;
+
+        r = hashmap_put(bus->creds_cache, PID_TO_PTR(pid), n);
+        if (r < 0)
+                return r;
+
+        TAKE_PTR(n);
+        return 0;
+}
+
+int bus_creds_augment(sd_bus *bus, sd_bus_creds *c, uint64_t mask, pid_t pid, pid_t tid) {
+        _cleanup_close_ int pidfd = -1;
+        uint64_t cacheable;
+        usec_t n_usec;
+        int r;
+
+        assert(bus);
+        assert(c);
+
+        if (!(mask & SD_BUS_CREDS_AUGMENT))
+                return 0;
+
+        if (pid <= 0 && (c->mask & SD_BUS_CREDS_PID))
+                pid = c->pid;
+        if (pid <= 0)
+                return bus_creds_add_more(c, mask, pid, tid);
+
+        cacheable = mask & ~(SD_BUS_CREDS_PID|SD_BUS_CREDS_TID|SD_BUS_CREDS_TID_COMM|SD_BUS_CREDS_AUGMENT);
+
+        n_usec = now(CLOCK_MONOTONIC);
+
+        /* The lock is not held while reading /proc, that's what the pidfd is for */
+        assert_se(pthread_mutex_lock(&bus->creds_cache_mutex) == 0);
+        r = creds_cache_lookup(bus, c, cacheable, pid, n_usec);
+        assert_se(pthread_mutex_unlock(&bus->creds_cache_mutex) == 0);
+        if (r == 0)
+                return bus_creds_add_more(c, mask, pid, tid);
+        if (r >= 0)
+                pidfd = r;
+        else if (r == -ENOENT) {
+                /* Pin the process before looking at /proc, so that we know the data belongs to it */
+                pidfd = creds_cache_open_pidfd(pid);
+                if (pidfd < 0)
+                        return bus_creds_add_more(c, mask, pid, tid);
+        } else
+                return r;
+
+        r = bus_creds_add_more(c, mask, pid, tid);
+        if (r < 0)
+                return r;
+
+        assert_se(pthread_mutex_lock(&bus->creds_cache_mutex) == 0);
+
+        /* If the process exited while we read /proc, its PID might have been reused already */
+        if (fd_wait_for_event(pidfd, POLLIN, 0) != 0)
+                creds_cache_entry_free(hashmap_remove(bus->creds_cache, PID_TO_PTR(pid)));
+        else
+                /* Cache a copy, as the caller might pass the object on to other threads */
+                r = creds_cache_store(bus, c, cacheable, pid, &pidfd, n_usec);
+
+        assert_se(pthread_mutex_unlock(&bus->creds_cache_mutex) == 0);
+        return r;
+}
+
+void bus_creds_cache_flush(sd_bus *bus) {
+        assert(bus);
+
+        assert_se(pthread_mutex_lock(&bus->creds_cache_mutex) == 0);
+        creds_cache_flush_locked(bus);
+        assert_se(pthread_mutex_unlock(&bus->creds_cache_mutex) == 0);
+}
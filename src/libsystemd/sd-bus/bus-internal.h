@@ -9,6 +9,7 @@
 #include "bus-error.h"
 #include "bus-kernel.h"
 #include "bus-match.h"
+#include "bus-offload.h"
 #include "def.h"
 #include "hashmap.h"
 #include "list.h"
@@ -55,6 +56,11 @@ struct node {
         LIST_HEAD(struct node_vtable, vtables);
         LIST_HEAD(struct node_enumerator, enumerators);
         LIST_HEAD(struct node_object_manager, object_managers);
+
+        /* The reply to Introspect(), for nodes whose introspection data doesn't depend on any callbacks. Valid as
+         * long as introspection_generation matches the bus' nodes_generation. */
+        char *introspection;
+        uint64_t introspection_generation;
 };
 
 struct node_callback {
@@ -92,13 +98,19 @@ struct node_vtable {
         const sd_bus_vtable *vtable;
         sd_bus_object_find_t find;
 
+        /* struct vtable_member objects of the vtable, indexed by member name */
+        Hashmap *methods;
+        Hashmap *properties;
+
+        /* The members of the interface, formatted for Introspect(), generated on first use */
+        char *introspection;
+
         unsigned last_iteration;
 
         LIST_FIELDS(struct node_vtable, vtables);
 };
 
 struct vtable_member {
-        const char *path;
         const char *interface;
         const char *member;
         struct node_vtable *parent;
@@ -170,6 +182,36 @@ enum bus_auth {
         BUS_AUTH_ANONYMOUS
 };
 
+/* How many freed objects of each kind we keep around per bus, and
+ * the largest body buffer and container stack we bother to keep. */
+#define MESSAGE_CACHE_MAX 32
+#define MESSAGE_CACHE_BUFFER_SIZE_MAX (16*1024)
+#define MESSAGE_CACHE_CONTAINERS_MAX 16
+
+struct message_cache {
+        struct {
+                void *message;
+                struct bus_container *containers;
+                size_t containers_allocated;
+        } messages[MESSAGE_CACHE_MAX];
+        unsigned n_messages;
+
+        struct bus_body_part *parts[MESSAGE_CACHE_MAX];
+        unsigned n_parts;
+
+        struct {
+                void *data;
+                size_t allocated;
+        } buffers[MESSAGE_CACHE_MAX];
+        unsigned n_buffers;
+
+        /* How many objects were asked for, and how many of those
+         * could be taken from the cache */
+        uint64_t n_messages_requested, n_messages_reused;
+        uint64_t n_parts_requested, n_parts_reused;
+        uint64_t n_buffers_requested, n_buffers_reused;
+};
+
 struct sd_bus {
         /* We use atomic ref counting here since sd_bus_message
            objects retain references to their originating sd_bus but
@@ -212,6 +254,8 @@ struct sd_bus {
         bool attach_timestamp:1;
         bool connected_signal:1;
         bool close_on_exit:1;
+        bool accept_memfd:1;
+        bool can_memfd:1;
 
         int use_memfd;
 
@@ -238,8 +282,11 @@ struct sd_bus {
         LIST_HEAD(struct filter_callback, filter_callbacks);
 
         Hashmap *nodes;
-        Hashmap *vtable_methods;
-        Hashmap *vtable_properties;
+        uint64_t nodes_generation;
+
+        /* Offloaded method handlers look up credentials too, hence this is protected by a mutex of its own */
+        pthread_mutex_t creds_cache_mutex;
+        Hashmap *creds_cache;
 
         union sockaddr_union sockaddr;
         socklen_t sockaddr_size;
@@ -286,6 +333,11 @@ struct sd_bus {
         struct memfd_cache memfd_cache[MEMFD_CACHE_MAX];
         unsigned n_memfd_cache;
 
+        /* Same for the cache of message objects, body parts and body
+         * buffers that freed messages leave behind for reuse. */
+        pthread_mutex_t message_cache_mutex;
+        struct message_cache message_cache;
+
         pid_t original_pid;
         pid_t busexec_pid;
 
@@ -294,9 +346,13 @@ struct sd_bus {
         sd_event_source *time_event_source;
         sd_event_source *quit_event_source;
         sd_event_source *inotify_event_source;
+        sd_event_source *offload_event_source;
         sd_event *event;
         int event_priority;
 
+        /* Worker threads running method handlers flagged SD_BUS_VTABLE_METHOD_OFFLOAD */
+        BusOffloadPool *offload_pool;
+
         sd_bus_message *current_message;
         sd_bus_slot *current_slot;
         sd_bus_message_handler_t current_handler;
@@ -313,6 +369,11 @@ struct sd_bus {
         LIST_HEAD(sd_bus_slot, slots);
         LIST_HEAD(sd_bus_track, tracks);
 
+        /* The names watched by any of the track objects, mapped to their items, and the NameOwnerChanged match they
+         * all share */
+        Hashmap *track_names;
+        sd_bus_slot *track_slot;
+
         int *inotify_watches;
         size_t n_inotify_watches;
 
@@ -328,6 +389,10 @@ struct sd_bus {
 #define BUS_AUTH_TIMEOUT ((usec_t) DEFAULT_TIMEOUT_USEC)
 
 #define BUS_WQUEUE_MAX (192*1024)
+
+/* How many bytes of queued messages we try to write at once at most, which is somewhat more than the default send
+ * buffer size of AF_UNIX sockets */
+#define BUS_WRITE_BATCH_SIZE (256*1024)
 #define BUS_RQUEUE_MAX (192*1024)
 
 #define BUS_MESSAGE_SIZE_MAX (128*1024*1024)
@@ -342,6 +407,10 @@ struct sd_bus {
 
 #define BUS_EXEC_ARGV_MAX 256
 
+/* How long and for how many processes augmented credentials are cached */
+#define BUS_CREDS_CACHE_USEC (1*USEC_PER_SEC)
+#define BUS_CREDS_CACHE_MAX 64
+
 bool interface_name_is_valid(const char *p) _pure_;
 bool service_name_is_valid(const char *p) _pure_;
 bool member_name_is_valid(const char *p) _pure_;
@@ -379,6 +448,12 @@ int bus_attach_inotify_event(sd_bus *b);
 void bus_close_inotify_fd(sd_bus *b);
 void bus_close_io_fds(sd_bus *b);
 
+static inline void bus_nodes_changed(sd_bus *b) {
+        /* Make object dispatching start over, and invalidate all cached introspection data */
+        b->nodes_modified = true;
+        b->nodes_generation++;
+}
+
 #define OBJECT_PATH_FOREACH_PREFIX(prefix, path)                        \
         for (char *_slash = ({ strcpy((prefix), (path)); streq((prefix), "/") ? NULL : strrchr((prefix), '/'); }) ; \
              _slash && ((_slash[(_slash) == (prefix)] = 0), true);       \
@@ -405,3 +480,5 @@ int bus_maybe_reply_error(sd_bus_message *m, int r, sd_bus_error *error);
 void bus_enter_closing(sd_bus *bus);
 
 void bus_set_state(sd_bus *bus, enum bus_state state);
+
+void bus_trim_caches(sd_bus *bus);
@@ -53,10 +53,15 @@ static inline bool BUS_MATCH_IS_COMPARE(enum bus_match_node_type t) {
         return t >= BUS_MATCH_SENDER && t <= BUS_MATCH_ARG_HAS_LAST;
 }
 
+static inline bool BUS_MATCH_IS_NAMESPACE(enum bus_match_node_type t) {
+        return t == BUS_MATCH_PATH_NAMESPACE ||
+                (t >= BUS_MATCH_ARG_NAMESPACE && t <= BUS_MATCH_ARG_NAMESPACE_LAST);
+}
+
 static inline bool BUS_MATCH_CAN_HASH(enum bus_match_node_type t) {
-        return (t >= BUS_MATCH_MESSAGE_TYPE && t <= BUS_MATCH_PATH) ||
+        return (t >= BUS_MATCH_MESSAGE_TYPE && t <= BUS_MATCH_PATH_NAMESPACE) ||
                 (t >= BUS_MATCH_ARG && t <= BUS_MATCH_ARG_LAST) ||
-                (t >= BUS_MATCH_ARG_HAS && t <= BUS_MATCH_ARG_HAS_LAST);
+                (t >= BUS_MATCH_ARG_NAMESPACE && t <= BUS_MATCH_ARG_HAS_LAST);
 }
 
 static void bus_match_node_free(struct bus_match_node *node) {
@@ -240,6 +245,68 @@ static bool value_node_same(
         }
 }
 
+static int bus_match_run_namespace(
+                sd_bus *bus,
+                struct bus_match_node *node,
+                sd_bus_message *m,
+                const char *test_str) {
+
+        _cleanup_free_ char *p = NULL;
+        size_t k, l, last = (size_t) -1;
+        char c;
+        int r;
+
+        assert(node);
+        assert(BUS_MATCH_IS_NAMESPACE(node->type));
+        assert(test_str);
+
+        /* A namespace matches if it equals the value, or is a prefix of it that is followed by the separator in the
+         * value or ends in the separator itself (see simple_pattern_check()). Hence, instead of testing each
+         * namespace we know, we look up every prefix of the value that qualifies. */
+
+        c = node->type == BUS_MATCH_PATH_NAMESPACE ? '/' : '.';
+
+        p = strdup(test_str);
+        if (!p)
+                return -ENOMEM;
+
+        l = strlen(p);
+
+        for (k = 0; k <= l; k++) {
+                size_t j;
+
+                if (k < l && p[k] != c)
+                        continue;
+
+                /* The prefix up to the separator, and the one including it */
+                for (j = k; j <= MIN(k + 1, l); j++) {
+                        struct bus_match_node *found;
+                        char x;
+
+                        if (j == last)
+                                continue;
+                        last = j;
+
+                        x = p[j];
+                        p[j] = 0;
+                        found = hashmap_get(node->compare.children, p);
+                        p[j] = x;
+
+                        if (!found)
+                                continue;
+
+                        r = bus_match_run(bus, found, m);
+                        if (r != 0)
+                                return r;
+
+                        if (bus && bus->match_callbacks_modified)
+                                return 0;
+                }
+        }
+
+        return 0;
+}
+
 int bus_match_run(
                 sd_bus *bus,
                 struct bus_match_node *node,
@@ -377,7 +444,15 @@ int bus_match_run(
 
                 /* Lookup via hash table, nice! So let's jump directly. */
 
-                if (test_str)
+                if (BUS_MATCH_IS_NAMESPACE(node->type)) {
+                        if (test_str) {
+                                r = bus_match_run_namespace(bus, node, m, test_str);
+                                if (r != 0)
+                                        return r;
+                        }
+
+                        found = NULL;
+                } else if (test_str)
                         found = hashmap_get(node->compare.children, test_str);
                 else if (test_strv) {
                         char **i;
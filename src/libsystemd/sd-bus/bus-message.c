@@ -41,6 +41,232 @@ static void *adjust_pointer(const void *p, void *old_base, size_t sz, void *new_
         return (uint8_t*) new_base + ((uint8_t*) p - (uint8_t*) old_base);
 }
 
+/* Messages we allocate ourselves, as well as received messages without a label, are all of the same size, so that
+ * each of them can be served from the message cache. */
+#define MESSAGE_OBJECT_SIZE (ALIGN(sizeof(sd_bus_message)) + sizeof(struct bus_header))
+
+static struct bus_container *containers_free(struct bus_container *containers, size_t n_allocated) {
+        size_t i;
+
+        for (i = 0; i < n_allocated; i++)
+                free(containers[i].cached_signature);
+
+        return mfree(containers);
+}
+
+static sd_bus_message *message_alloc(sd_bus *bus) {
+        struct bus_container *containers = NULL;
+        size_t containers_allocated = 0;
+        sd_bus_message *m = NULL;
+        struct message_cache *c;
+
+        assert(bus);
+
+        c = &bus->message_cache;
+
+        assert_se(pthread_mutex_lock(&bus->message_cache_mutex) == 0);
+
+        c->n_messages_requested++;
+        if (c->n_messages > 0) {
+                c->n_messages--;
+                m = c->messages[c->n_messages].message;
+                containers = c->messages[c->n_messages].containers;
+                containers_allocated = c->messages[c->n_messages].containers_allocated;
+                c->n_messages_reused++;
+        }
+
+        assert_se(pthread_mutex_unlock(&bus->message_cache_mutex) == 0);
+
+        if (m)
+                memzero(m, MESSAGE_OBJECT_SIZE);
+        else {
+                m = malloc0(MESSAGE_OBJECT_SIZE);
+                if (!m)
+                        return NULL;
+        }
+
+        /* The container stack of the previous user stays allocated, so that we don't have to grow it again */
+        m->containers = containers;
+        m->containers_allocated = containers_allocated;
+        m->cacheable = true;
+
+        return m;
+}
+
+static bool message_cache_put_message(sd_bus *bus, sd_bus_message *m) {
+        struct message_cache *c;
+        bool b = false;
+
+        assert(m);
+        assert(m->n_containers == 0);
+
+        if (!bus || !m->cacheable)
+                return false;
+
+        if (m->containers_allocated > MESSAGE_CACHE_CONTAINERS_MAX) {
+                m->containers = containers_free(m->containers, m->containers_allocated);
+                m->containers_allocated = 0;
+        }
+
+        c = &bus->message_cache;
+
+        assert_se(pthread_mutex_lock(&bus->message_cache_mutex) == 0);
+
+        if (c->n_messages < MESSAGE_CACHE_MAX) {
+                c->messages[c->n_messages].message = m;
+                c->messages[c->n_messages].containers = m->containers;
+                c->messages[c->n_messages].containers_allocated = m->containers_allocated;
+                c->n_messages++;
+                b = true;
+        }
+
+        assert_se(pthread_mutex_unlock(&bus->message_cache_mutex) == 0);
+
+        return b;
+}
+
+static struct bus_body_part *message_cache_get_part(sd_bus *bus) {
+        struct bus_body_part *part = NULL;
+        struct message_cache *c;
+
+        if (!bus)
+                return new0(struct bus_body_part, 1);
+
+        c = &bus->message_cache;
+
+        assert_se(pthread_mutex_lock(&bus->message_cache_mutex) == 0);
+
+        c->n_parts_requested++;
+        if (c->n_parts > 0) {
+                part = c->parts[--c->n_parts];
+                c->n_parts_reused++;
+        }
+
+        assert_se(pthread_mutex_unlock(&bus->message_cache_mutex) == 0);
+
+        if (!part)
+                return new0(struct bus_body_part, 1);
+
+        zero(*part);
+        return part;
+}
+
+static void message_cache_put_part(sd_bus *bus, struct bus_body_part *part) {
+        struct message_cache *c;
+
+        assert(part);
+
+        if (bus) {
+                c = &bus->message_cache;
+
+                assert_se(pthread_mutex_lock(&bus->message_cache_mutex) == 0);
+
+                if (c->n_parts < MESSAGE_CACHE_MAX)
+                        c->parts[c->n_parts++] = TAKE_PTR(part);
+
+                assert_se(pthread_mutex_unlock(&bus->message_cache_mutex) == 0);
+        }
+
+        free(part);
+}
+
+static bool message_cache_get_buffer(sd_bus *bus, void **ret_data, size_t *ret_allocated) {
+        struct message_cache *c;
+        bool b = false;
+
+        assert(ret_data);
+        assert(ret_allocated);
+
+        if (!bus)
+                return false;
+
+        c = &bus->message_cache;
+
+        assert_se(pthread_mutex_lock(&bus->message_cache_mutex) == 0);
+
+        c->n_buffers_requested++;
+        if (c->n_buffers > 0) {
+                c->n_buffers--;
+                *ret_data = c->buffers[c->n_buffers].data;
+                *ret_allocated = c->buffers[c->n_buffers].allocated;
+                c->n_buffers_reused++;
+                b = true;
+        }
+
+        assert_se(pthread_mutex_unlock(&bus->message_cache_mutex) == 0);
+
+        return b;
+}
+
+static void message_cache_put_buffer(sd_bus *bus, void *data, size_t allocated) {
+        struct message_cache *c;
+
+        if (bus && allocated > 0 && allocated <= MESSAGE_CACHE_BUFFER_SIZE_MAX) {
+                c = &bus->message_cache;
+
+                assert_se(pthread_mutex_lock(&bus->message_cache_mutex) == 0);
+
+                if (c->n_buffers < MESSAGE_CACHE_MAX) {
+                        c->buffers[c->n_buffers].data = TAKE_PTR(data);
+                        c->buffers[c->n_buffers].allocated = allocated;
+                        c->n_buffers++;
+                }
+
+                assert_se(pthread_mutex_unlock(&bus->message_cache_mutex) == 0);
+        }
+
+        free(data);
+}
+
+void bus_message_cache_flush(sd_bus *bus) {
+        struct message_cache *c;
+        unsigned i;
+
+        assert(bus);
+
+        c = &bus->message_cache;
+
+        assert_se(pthread_mutex_lock(&bus->message_cache_mutex) == 0);
+
+        for (i = 0; i < c->n_messages; i++) {
+                containers_free(c->messages[i].containers, c->messages[i].containers_allocated);
+                free(c->messages[i].message);
+        }
+        c->n_messages = 0;
+
+        for (i = 0; i < c->n_parts; i++)
+                free(c->parts[i]);
+        c->n_parts = 0;
+
+        for (i = 0; i < c->n_buffers; i++)
+                free(c->buffers[i].data);
+        c->n_buffers = 0;
+
+        assert_se(pthread_mutex_unlock(&bus->message_cache_mutex) == 0);
+}
+
+void bus_message_cache_dump(sd_bus *bus, FILE *f, const char *prefix) {
+        struct message_cache *c;
+
+        assert(bus);
+        assert(f);
+
+        c = &bus->message_cache;
+
+        assert_se(pthread_mutex_lock(&bus->message_cache_mutex) == 0);
+
+        if (c->n_messages_requested > 0)
+                fprintf(f,
+                        "%sBus connection %s: reused %" PRIu64 " of %" PRIu64 " messages, %" PRIu64 " of %" PRIu64 " body parts, %" PRIu64 " of %" PRIu64 " body buffers\n",
+                        strempty(prefix),
+                        strna(bus->description),
+                        c->n_messages_reused, c->n_messages_requested,
+                        c->n_parts_reused, c->n_parts_requested,
+                        c->n_buffers_reused, c->n_buffers_requested);
+
+        assert_se(pthread_mutex_unlock(&bus->message_cache_mutex) == 0);
+}
+
 static void message_free_part(sd_bus_message *m, struct bus_body_part *part) {
         assert(m);
         assert(part);
@@ -50,10 +276,10 @@ static void message_free_part(sd_bus_message *m, struct bus_body_part *part) {
         else if (part->munmap_this)
                 munmap(part->mmap_begin, part->mapped);
         else if (part->free_this)
-                free(part->data);
+                message_cache_put_buffer(m->bus, part->data, part->allocated);
 
         if (part != &m->body)
-                free(part);
+                message_cache_put_part(m->bus, part);
 }
 
 static void message_reset_parts(sd_bus_message *m) {
@@ -85,14 +311,44 @@ static struct bus_container *message_get_last_container(sd_bus_message *m) {
         return m->containers + m->n_containers - 1;
 }
 
+static void container_cache_signature(struct bus_container *c) {
+        assert(c);
+
+        free(c->cached_signature);
+        c->cached_signature = TAKE_PTR(c->signature);
+        c->cached_enclosing = c->enclosing;
+}
+
+static char *container_take_signature(struct bus_container *c, char enclosing, const char *contents, bool *ret_cached) {
+        assert(c);
+        assert(contents);
+        assert(ret_cached);
+
+        /* Returns a copy of the signature for a new container at this position, and whether it is the same as the
+         * one of the container previously opened there, and hence known to be valid */
+
+        if (c->cached_signature && c->cached_enclosing == enclosing && streq(c->cached_signature, contents)) {
+                *ret_cached = true;
+                return TAKE_PTR(c->cached_signature);
+        }
+
+        *ret_cached = false;
+        c->cached_signature = mfree(c->cached_signature);
+
+        return strdup(contents);
+}
+
 static void message_free_last_container(sd_bus_message *m) {
         struct bus_container *c;
 
         c = message_get_last_container(m);
 
-        free(c->signature);
-        free(c->peeked_signature);
-        free(c->offsets);
+        if (m->n_containers > 0)
+                container_cache_signature(c);
+        else
+                c->signature = mfree(c->signature);
+        c->peeked_signature = mfree(c->peeked_signature);
+        c->offsets = mfree(c->offsets);
 
         /* Move to previous container, but not if we are on root container */
         if (m->n_containers > 0)
@@ -105,20 +361,21 @@ static void message_reset_containers(sd_bus_message *m) {
         while (m->n_containers > 0)
                 message_free_last_container(m);
 
-        m->containers = mfree(m->containers);
+        m->containers = containers_free(m->containers, m->containers_allocated);
         m->containers_allocated = 0;
         m->root_container.index = 0;
 }
 
 static sd_bus_message* message_free(sd_bus_message *m) {
+        sd_bus *bus;
+
         assert(m);
 
         if (m->free_header)
                 free(m->header);
 
         message_reset_parts(m);
-
-        sd_bus_unref(m->bus);
+        safe_close(m->body_memfd);
 
         if (m->free_fds) {
                 close_many(m->fds, m->n_fds);
@@ -128,12 +385,22 @@ static sd_bus_message* message_free(sd_bus_message *m) {
         if (m->iovec != m->iovec_fixed)
                 free(m->iovec);
 
-        message_reset_containers(m);
-        assert(m->n_containers == 0);
+        while (m->n_containers > 0)
+                message_free_last_container(m);
         message_free_last_container(m);
 
         bus_creds_done(&m->creds);
-        return mfree(m);
+
+        /* Hand the message object over to the cache before dropping our reference, which might free the bus and
+         * the cache with it */
+        bus = m->bus;
+        if (!message_cache_put_message(bus, m)) {
+                containers_free(m->containers, m->containers_allocated);
+                free(m);
+        }
+
+        sd_bus_unref(bus);
+        return NULL;
 }
 
 DEFINE_TRIVIAL_CLEANUP_FUNC(sd_bus_message*, message_free);
@@ -418,7 +685,7 @@ int bus_message_from_header(
                 size_t extra,
                 sd_bus_message **ret) {
 
-        _cleanup_free_ sd_bus_message *m = NULL;
+        _cleanup_(message_freep) sd_bus_message *m = NULL;
         struct bus_header *h;
         size_t a, label_sz;
 
@@ -455,12 +722,16 @@ int bus_message_from_header(
                 a += label_sz + 1;
         }
 
-        m = malloc0(a);
+        if (a <= MESSAGE_OBJECT_SIZE)
+                m = message_alloc(bus);
+        else
+                m = malloc0(a);
         if (!m)
                 return -ENOMEM;
 
         m->n_ref = 1;
         m->sealed = true;
+        m->body_memfd = -1;
         m->header = header;
         m->header_accessible = header_accessible;
         m->footer = footer;
@@ -472,6 +743,9 @@ int bus_message_from_header(
                 if (h->dbus2.cookie == 0)
                         return -EBADMSG;
 
+                if (h->flags & BUS_MESSAGE_BODY_MEMFD)
+                        return -EBADMSG;
+
                 /* dbus2 derives the sizes from the message size and
                 the offset table at the end, since it is formatted as
                 gvariant "yyyyuta{tv}v". Since the message itself is a
@@ -499,7 +773,9 @@ int bus_message_from_header(
                 m->fields_size = BUS_MESSAGE_BSWAP32(m, h->dbus1.fields_size);
                 m->body_size = BUS_MESSAGE_BSWAP32(m, h->dbus1.body_size);
 
-                if (sizeof(struct bus_header) + ALIGN8(m->fields_size) + m->body_size != message_size)
+                /* A body passed in a memfd is not part of the message data */
+                if (sizeof(struct bus_header) + ALIGN8(m->fields_size) +
+                    (h->flags & BUS_MESSAGE_BODY_MEMFD ? 0 : m->body_size) != message_size)
                         return -EBADMSG;
         }
 
@@ -529,9 +805,20 @@ int bus_message_from_malloc(
                 sd_bus_message **ret) {
 
         _cleanup_(message_freep) sd_bus_message *m = NULL;
+        int body_memfd = -1;
         size_t sz;
         int r;
 
+        if (length >= sizeof(struct bus_header) &&
+            ((struct bus_header*) buffer)->flags & BUS_MESSAGE_BODY_MEMFD) {
+
+                /* The body was passed in a memfd after all other fds */
+                if (!bus->can_memfd || n_fds <= 0)
+                        return -EBADMSG;
+
+                body_memfd = fds[--n_fds];
+        }
+
         r = bus_message_from_header(
                         bus,
                         buffer, length, /* in this case the initial bytes and the final bytes are the same */
@@ -543,22 +830,50 @@ int bus_message_from_malloc(
         if (r < 0)
                 return r;
 
-        sz = length - sizeof(struct bus_header) - ALIGN8(m->fields_size);
-        if (sz > 0) {
+        if (body_memfd >= 0) {
+                uint64_t size;
+
+                /* Make sure nobody can change the body under our feet */
+                r = memfd_get_sealed(body_memfd);
+                if (r < 0)
+                        return r;
+                if (r == 0)
+                        return -EBADMSG;
+
+                r = memfd_get_size(body_memfd, &size);
+                if (r < 0)
+                        return r;
+                if (m->body_size == 0 || size != m->body_size)
+                        return -EBADMSG;
+
                 m->n_body_parts = 1;
-                m->body.data = (uint8_t*) buffer + sizeof(struct bus_header) + ALIGN8(m->fields_size);
-                m->body.size = sz;
+                m->body.size = m->body_size;
                 m->body.sealed = true;
-                m->body.memfd = -1;
-        }
+                m->body.memfd = body_memfd;
 
-        m->n_iovec = 1;
-        m->iovec = m->iovec_fixed;
-        m->iovec[0] = IOVEC_MAKE(buffer, length);
+                /* The flag is about how the message was transferred, not about the message itself */
+                m->header->flags &= ~BUS_MESSAGE_BODY_MEMFD;
+        } else {
+                sz = length - sizeof(struct bus_header) - ALIGN8(m->fields_size);
+                if (sz > 0) {
+                        m->n_body_parts = 1;
+                        m->body.data = (uint8_t*) buffer + sizeof(struct bus_header) + ALIGN8(m->fields_size);
+                        m->body.size = sz;
+                        m->body.sealed = true;
+                        m->body.memfd = -1;
+                }
+
+                m->n_iovec = 1;
+                m->iovec = m->iovec_fixed;
+                m->iovec[0] = IOVEC_MAKE(buffer, length);
+        }
 
         r = bus_message_parse_fields(m);
-        if (r < 0)
+        if (r < 0) {
+                /* The fds stay with the caller on failure */
+                m->body.memfd = -1;
                 return r;
+        }
 
         /* We take possession of the memory and fds now */
         m->free_header = true;
@@ -580,11 +895,12 @@ _public_ int sd_bus_message_new(
         assert_return(m, -EINVAL);
         assert_return(type < _SD_BUS_MESSAGE_TYPE_MAX, -EINVAL);
 
-        t = malloc0(ALIGN(sizeof(sd_bus_message)) + sizeof(struct bus_header));
+        t = message_alloc(bus);
         if (!t)
                 return -ENOMEM;
 
         t->n_ref = 1;
+        t->body_memfd = -1;
         t->header = (struct bus_header*) ((uint8_t*) t + ALIGN(sizeof(struct sd_bus_message)));
         t->header->endian = BUS_NATIVE_ENDIAN;
         t->header->type = type;
@@ -1118,7 +1434,7 @@ struct bus_body_part *message_append_part(sd_bus_message *m) {
         } else {
                 assert(m->body_end);
 
-                part = new0(struct bus_body_part, 1);
+                part = message_cache_get_part(m->bus);
                 if (!part) {
                         m->poisoned = true;
                         return NULL;
@@ -1163,6 +1479,10 @@ static int part_make_space(
         if (m->poisoned)
                 return -ENOMEM;
 
+        if (part->allocated == 0 && !part->data &&
+            message_cache_get_buffer(m->bus, &part->data, &part->allocated))
+                part->free_this = true;
+
         if (part->allocated == 0 || sz > part->allocated) {
                 size_t new_allocated;
 
@@ -1641,6 +1961,7 @@ static int bus_message_open_array(
                 sd_bus_message *m,
                 struct bus_container *c,
                 const char *contents,
+                bool validated,
                 uint32_t **array_size,
                 size_t *begin,
                 bool *need_offsets) {
@@ -1655,7 +1976,7 @@ static int bus_message_open_array(
         assert(begin);
         assert(need_offsets);
 
-        if (!signature_is_single(contents, true))
+        if (!validated && !signature_is_single(contents, true))
                 return -EINVAL;
 
         if (c->signature && c->signature[c->index]) {
@@ -1739,13 +2060,14 @@ static int bus_message_open_array(
 static int bus_message_open_variant(
                 sd_bus_message *m,
                 struct bus_container *c,
-                const char *contents) {
+                const char *contents,
+                bool validated) {
 
         assert(m);
         assert(c);
         assert(contents);
 
-        if (!signature_is_single(contents, false))
+        if (!validated && !signature_is_single(contents, false))
                 return -EINVAL;
 
         if (*contents == SD_BUS_TYPE_DICT_ENTRY_BEGIN)
@@ -1798,6 +2120,7 @@ static int bus_message_open_struct(
                 sd_bus_message *m,
                 struct bus_container *c,
                 const char *contents,
+                bool validated,
                 size_t *begin,
                 bool *need_offsets) {
 
@@ -1810,7 +2133,7 @@ static int bus_message_open_struct(
         assert(begin);
         assert(need_offsets);
 
-        if (!signature_is_valid(contents, false))
+        if (!validated && !signature_is_valid(contents, false))
                 return -EINVAL;
 
         if (c->signature && c->signature[c->index]) {
@@ -1871,6 +2194,7 @@ static int bus_message_open_dict_entry(
                 sd_bus_message *m,
                 struct bus_container *c,
                 const char *contents,
+                bool validated,
                 size_t *begin,
                 bool *need_offsets) {
 
@@ -1882,7 +2206,7 @@ static int bus_message_open_dict_entry(
         assert(begin);
         assert(need_offsets);
 
-        if (!signature_is_pair(contents))
+        if (!validated && !signature_is_pair(contents))
                 return -EINVAL;
 
         if (c->enclosing != SD_BUS_TYPE_ARRAY)
@@ -1934,7 +2258,7 @@ _public_ int sd_bus_message_open_container(
         uint32_t *array_size = NULL;
         _cleanup_free_ char *signature = NULL;
         size_t before, begin = 0;
-        bool need_offsets = false;
+        bool need_offsets = false, validated;
         int r;
 
         assert_return(m, -EINVAL);
@@ -1943,14 +2267,14 @@ _public_ int sd_bus_message_open_container(
         assert_return(!m->poisoned, -ESTALE);
 
         /* Make sure we have space for one more container */
-        if (!GREEDY_REALLOC(m->containers, m->containers_allocated, m->n_containers + 1)) {
+        if (!GREEDY_REALLOC0(m->containers, m->containers_allocated, m->n_containers + 1)) {
                 m->poisoned = true;
                 return -ENOMEM;
         }
 
         c = message_get_last_container(m);
 
-        signature = strdup(contents);
+        signature = container_take_signature(m->containers + m->n_containers, type, contents, &validated);
         if (!signature) {
                 m->poisoned = true;
                 return -ENOMEM;
@@ -1962,13 +2286,13 @@ _public_ int sd_bus_message_open_container(
         before = m->body_size;
 
         if (type == SD_BUS_TYPE_ARRAY)
-                r = bus_message_open_array(m, c, contents, &array_size, &begin, &need_offsets);
+                r = bus_message_open_array(m, c, contents, validated, &array_size, &begin, &need_offsets);
         else if (type == SD_BUS_TYPE_VARIANT)
-                r = bus_message_open_variant(m, c, contents);
+                r = bus_message_open_variant(m, c, contents, validated);
         else if (type == SD_BUS_TYPE_STRUCT)
-                r = bus_message_open_struct(m, c, contents, &begin, &need_offsets);
+                r = bus_message_open_struct(m, c, contents, validated, &begin, &need_offsets);
         else if (type == SD_BUS_TYPE_DICT_ENTRY)
-                r = bus_message_open_dict_entry(m, c, contents, &begin, &need_offsets);
+                r = bus_message_open_dict_entry(m, c, contents, validated, &begin, &need_offsets);
         else
                 r = -EINVAL;
         if (r < 0)
@@ -2190,8 +2514,8 @@ _public_ int sd_bus_message_close_container(sd_bus_message *m) {
         else
                 assert_not_reached("Unknown container type");
 
-        free(c->signature);
-        free(c->offsets);
+        container_cache_signature(c);
+        c->offsets = mfree(c->offsets);
 
         return r;
 }
@@ -3502,6 +3826,7 @@ static int bus_message_enter_array(
                 sd_bus_message *m,
                 struct bus_container *c,
                 const char *contents,
+                bool validated,
                 uint32_t **array_size,
                 size_t *item_size,
                 size_t **offsets,
@@ -3519,7 +3844,7 @@ static int bus_message_enter_array(
         assert(offsets);
         assert(n_offsets);
 
-        if (!signature_is_single(contents, true))
+        if (!validated && !signature_is_single(contents, true))
                 return -EINVAL;
 
         if (!c->signature || c->signature[c->index] == 0)
@@ -3631,6 +3956,7 @@ static int bus_message_enter_variant(
                 sd_bus_message *m,
                 struct bus_container *c,
                 const char *contents,
+                bool validated,
                 size_t *item_size) {
 
         size_t rindex;
@@ -3643,7 +3969,7 @@ static int bus_message_enter_variant(
         assert(contents);
         assert(item_size);
 
-        if (!signature_is_single(contents, false))
+        if (!validated && !signature_is_single(contents, false))
                 return -EINVAL;
 
         if (*contents == SD_BUS_TYPE_DICT_ENTRY_BEGIN)
@@ -3889,6 +4215,7 @@ static int bus_message_enter_struct(
                 sd_bus_message *m,
                 struct bus_container *c,
                 const char *contents,
+                bool validated,
                 size_t *item_size,
                 size_t **offsets,
                 size_t *n_offsets) {
@@ -3903,7 +4230,7 @@ static int bus_message_enter_struct(
         assert(offsets);
         assert(n_offsets);
 
-        if (!signature_is_valid(contents, false))
+        if (!validated && !signature_is_valid(contents, false))
                 return -EINVAL;
 
         if (!c->signature || c->signature[c->index] == 0)
@@ -3930,6 +4257,7 @@ static int bus_message_enter_dict_entry(
                 sd_bus_message *m,
                 struct bus_container *c,
                 const char *contents,
+                bool validated,
                 size_t *item_size,
                 size_t **offsets,
                 size_t *n_offsets) {
@@ -3941,7 +4269,7 @@ static int bus_message_enter_dict_entry(
         assert(c);
         assert(contents);
 
-        if (!signature_is_pair(contents))
+        if (!validated && !signature_is_pair(contents))
                 return -EINVAL;
 
         if (c->enclosing != SD_BUS_TYPE_ARRAY)
@@ -3976,6 +4304,7 @@ _public_ int sd_bus_message_enter_container(sd_bus_message *m,
         size_t before, end;
         _cleanup_free_ size_t *offsets = NULL;
         size_t n_offsets = 0, item_size = 0;
+        bool validated;
         int r;
 
         assert_return(m, -EINVAL);
@@ -4020,7 +4349,7 @@ _public_ int sd_bus_message_enter_container(sd_bus_message *m,
         if (m->n_containers >= BUS_CONTAINER_DEPTH)
                 return -EBADMSG;
 
-        if (!GREEDY_REALLOC(m->containers, m->containers_allocated, m->n_containers + 1))
+        if (!GREEDY_REALLOC0(m->containers, m->containers_allocated, m->n_containers + 1))
                 return -ENOMEM;
 
         if (message_end_of_signature(m))
@@ -4031,7 +4360,7 @@ _public_ int sd_bus_message_enter_container(sd_bus_message *m,
 
         c = message_get_last_container(m);
 
-        signature = strdup(contents);
+        signature = container_take_signature(m->containers + m->n_containers, type, contents, &validated);
         if (!signature)
                 return -ENOMEM;
 
@@ -4039,13 +4368,13 @@ _public_ int sd_bus_message_enter_container(sd_bus_message *m,
         before = m->rindex;
 
         if (type == SD_BUS_TYPE_ARRAY)
-                r = bus_message_enter_array(m, c, contents, &array_size, &item_size, &offsets, &n_offsets);
+                r = bus_message_enter_array(m, c, contents, validated, &array_size, &item_size, &offsets, &n_offsets);
         else if (type == SD_BUS_TYPE_VARIANT)
-                r = bus_message_enter_variant(m, c, contents, &item_size);
+                r = bus_message_enter_variant(m, c, contents, validated, &item_size);
         else if (type == SD_BUS_TYPE_STRUCT)
-                r = bus_message_enter_struct(m, c, contents, &item_size, &offsets, &n_offsets);
+                r = bus_message_enter_struct(m, c, contents, validated, &item_size, &offsets, &n_offsets);
         else if (type == SD_BUS_TYPE_DICT_ENTRY)
-                r = bus_message_enter_dict_entry(m, c, contents, &item_size, &offsets, &n_offsets);
+                r = bus_message_enter_dict_entry(m, c, contents, validated, &item_size, &offsets, &n_offsets);
         else
                 r = -EINVAL;
         if (r <= 0)
@@ -3,6 +3,7 @@
 
 #include <byteswap.h>
 #include <stdbool.h>
+#include <stdio.h>
 #include <sys/socket.h>
 
 #include "sd-bus.h"
@@ -30,6 +31,12 @@ struct bus_container {
         size_t item_size;
 
         char *peeked_signature;
+
+        /* The signature of the container that was last opened at this depth and closed again, so that the next one
+         * with the same signature, e.g. the next element of an array, may be opened without copying and
+         * validating its signature again. Unlike the fields above, these survive the container itself. */
+        char *cached_signature;
+        char cached_enclosing;
 };
 
 struct bus_body_part {
@@ -76,6 +83,7 @@ struct sd_bus_message {
         bool free_header:1;
         bool free_fds:1;
         bool poisoned:1;
+        bool cacheable:1; /* allocated with the size of the objects in the bus' message cache */
 
         /* The first and last bytes of the message */
         struct bus_header *header;
@@ -119,6 +127,9 @@ struct sd_bus_message {
 
         size_t header_offsets[_BUS_MESSAGE_HEADER_MAX];
         unsigned n_header_offsets;
+
+        /* If the body is passed in a memfd rather than inline when written */
+        int body_memfd;
 };
 
 static inline bool BUS_MESSAGE_NEED_BSWAP(sd_bus_message *m) {
@@ -157,6 +168,11 @@ static inline size_t BUS_MESSAGE_BODY_BEGIN(sd_bus_message *m) {
                 ALIGN8(m->fields_size);
 }
 
+static inline size_t BUS_MESSAGE_WIRE_SIZE(sd_bus_message *m) {
+        /* How many bytes of the message are written inline */
+        return m->body_memfd >= 0 ? BUS_MESSAGE_BODY_BEGIN(m) : BUS_MESSAGE_SIZE(m);
+}
+
 static inline void* BUS_MESSAGE_FIELDS(sd_bus_message *m) {
         return (uint8_t*) m->header + sizeof(struct bus_header);
 }
@@ -211,3 +227,6 @@ int bus_message_remarshal(sd_bus *bus, sd_bus_message **m);
 
 void bus_message_set_sender_driver(sd_bus *bus, sd_bus_message *m);
 void bus_message_set_sender_local(sd_bus *bus, sd_bus_message *m);
+
+void bus_message_cache_flush(sd_bus *bus);
+void bus_message_cache_dump(sd_bus *bus, FILE *f, const char *prefix);
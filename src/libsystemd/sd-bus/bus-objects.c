@@ -5,6 +5,7 @@
 #include "bus-introspect.h"
 #include "bus-message.h"
 #include "bus-objects.h"
+#include "bus-offload.h"
 #include "bus-signature.h"
 #include "bus-slot.h"
 #include "bus-type.h"
@@ -89,6 +90,33 @@ static int vtable_property_get_userdata(
         return 1;
 }
 
+static struct vtable_member *node_find_vtable_member(
+                struct node *n,
+                const char *interface,
+                const char *member,
+                bool property) {
+
+        struct node_vtable *c;
+
+        assert(n);
+        assert(interface);
+        assert(member);
+
+        LIST_FOREACH(vtables, c, n->vtables) {
+                struct vtable_member *v;
+
+                if (!streq(c->interface, interface))
+                        continue;
+
+                /* There may be more than one vtable for the same interface */
+                v = hashmap_get(property ? c->properties : c->methods, member);
+                if (v)
+                        return v;
+        }
+
+        return NULL;
+}
+
 static int add_enumerated_to_set(
                 sd_bus *bus,
                 const char *prefix,
@@ -396,6 +424,15 @@ static int method_callbacks_run(
 
                 slot = container_of(c->parent, sd_bus_slot, node_vtable);
 
+                if (c->vtable->flags & SD_BUS_VTABLE_METHOD_OFFLOAD) {
+                        r = bus_offload_method(bus, slot, m, c->vtable->x.method.handler, u);
+                        if (r > 0)
+                                return 1;
+                        if (r < 0)
+                                log_debug_errno(r, "Failed to offload call %s.%s(), calling handler synchronously: %m",
+                                                c->interface, c->member);
+                }
+
                 bus->current_slot = sd_bus_slot_ref(slot);
                 bus->current_handler = c->vtable->x.method.handler;
                 bus->current_userdata = u;
@@ -838,6 +875,154 @@ static int property_get_all_callbacks_run(
         return 1;
 }
 
+static int node_append_properties(
+                sd_bus *bus,
+                sd_bus_message *m,
+                const char *prefix,
+                const char *path,
+                bool require_fallback,
+                const char *interface,
+                char **names,
+                bool *found_object,
+                sd_bus_error *error) {
+
+        struct node_vtable *c;
+        struct node *n;
+        int r;
+
+        assert(bus);
+        assert(m);
+        assert(prefix);
+        assert(path);
+        assert(found_object);
+
+        n = hashmap_get(bus->nodes, prefix);
+        if (!n)
+                return 0;
+
+        LIST_FOREACH(vtables, c, n->vtables) {
+                const sd_bus_vtable *v;
+                void *u;
+
+                if (require_fallback && !c->is_fallback)
+                        continue;
+
+                r = node_vtable_get_userdata(bus, path, c, &u, error);
+                if (r < 0)
+                        return r;
+                if (bus->nodes_modified)
+                        return 0;
+                if (r == 0)
+                        continue;
+
+                *found_object = true;
+
+                if (interface && !streq(c->interface, interface))
+                        continue;
+
+                if (!names) {
+                        r = vtable_append_all_properties(bus, m, path, c, u, error);
+                        if (r < 0)
+                                return r;
+                        if (bus->nodes_modified)
+                                return 0;
+
+                        continue;
+                }
+
+                /* Explicitly requested properties are included even if they are not part of GetAll() */
+                if (c->vtable[0].flags & SD_BUS_VTABLE_HIDDEN)
+                        continue;
+
+                for (v = c->vtable+1; v->type != _SD_BUS_VTABLE_END; v++) {
+                        if (!IN_SET(v->type, _SD_BUS_VTABLE_PROPERTY, _SD_BUS_VTABLE_WRITABLE_PROPERTY))
+                                continue;
+
+                        if (v->flags & SD_BUS_VTABLE_HIDDEN)
+                                continue;
+
+                        if (!strv_contains(names, v->x.property.member))
+                                continue;
+
+                        r = vtable_append_one_property(bus, m, path, c, v, u, error);
+                        if (r < 0)
+                                return r;
+                        if (bus->nodes_modified)
+                                return 0;
+                }
+        }
+
+        return 0;
+}
+
+int bus_message_append_object_properties(
+                sd_bus_message *m,
+                const char *path,
+                const char *interface,
+                char **names,
+                sd_bus_error *error) {
+
+        sd_bus_slot *current_slot;
+        bool found_object = false, modified;
+        void *current_userdata;
+        sd_bus *bus;
+        int r;
+
+        assert(m);
+        assert(object_path_is_valid(path));
+
+        /* Appends the properties of the object at the specified path as "a{sv}" array to the message, the same way
+         * org.freedesktop.DBus.Properties.GetAll() would return them, without going through the bus. This is
+         * useful to return the properties of many objects in a single reply. If interface is NULL, the properties
+         * of all interfaces are included. If names is non-NULL, only the listed properties are included.
+         * Returns > 0 if the object exists, 0 otherwise. */
+
+        bus = sd_bus_message_get_bus(m);
+        if (!bus)
+                return -ENOTCONN;
+
+        r = sd_bus_message_open_container(m, 'a', "{sv}");
+        if (r < 0)
+                return r;
+
+        /* We are probably called from a method handler, hence restore what the dispatcher is working with when
+         * we are done */
+        current_slot = bus->current_slot;
+        current_userdata = bus->current_userdata;
+        modified = bus->nodes_modified;
+        bus->nodes_modified = false;
+
+        r = node_append_properties(bus, m, path, path, false, interface, names, &found_object, error);
+        if (r >= 0 && !found_object && !bus->nodes_modified) {
+                char *prefix;
+
+                prefix = alloca(strlen(path) + 1);
+                OBJECT_PATH_FOREACH_PREFIX(prefix, path) {
+                        r = node_append_properties(bus, m, prefix, path, true, interface, names, &found_object, error);
+                        if (r < 0 || found_object || bus->nodes_modified)
+                                break;
+                }
+        }
+
+        /* The message is partially written already, hence we cannot start over if a callback changed the
+         * object tree under our feet. */
+        if (r >= 0 && bus->nodes_modified)
+                r = -EAGAIN;
+
+        bus->current_slot = current_slot;
+        bus->current_userdata = current_userdata;
+        bus->nodes_modified = bus->nodes_modified || modified;
+
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_close_container(m);
+        if (r < 0)
+                return r;
+
+        return found_object;
+}
+
 static int bus_node_exists(
                 sd_bus *bus,
                 struct node *n,
@@ -881,6 +1066,24 @@ static int bus_node_exists(
         return 0;
 }
 
+static bool node_introspection_is_cacheable(struct node *n, bool require_fallback) {
+        struct node_vtable *c;
+
+        assert(n);
+
+        /* The introspection data of a node only depends on the registered objects, unless enumerator or find
+         * callbacks are involved, or the node is introspected on behalf of a path below it. */
+
+        if (require_fallback || n->enumerators)
+                return false;
+
+        LIST_FOREACH(vtables, c, n->vtables)
+                if (c->find)
+                        return false;
+
+        return true;
+}
+
 static int process_introspect(
                 sd_bus *bus,
                 sd_bus_message *m,
@@ -894,7 +1097,7 @@ static int process_introspect(
         const char *previous_interface = NULL;
         struct introspect intro;
         struct node_vtable *c;
-        bool empty;
+        bool empty, cacheable;
         int r;
 
         assert(bus);
@@ -902,6 +1105,17 @@ static int process_introspect(
         assert(n);
         assert(found_object);
 
+        cacheable = node_introspection_is_cacheable(n, require_fallback);
+        if (cacheable && n->introspection && n->introspection_generation == bus->nodes_generation) {
+                *found_object = true;
+
+                r = sd_bus_reply_method_return(m, "s", n->introspection);
+                if (r < 0)
+                        return r;
+
+                return 1;
+        }
+
         r = get_child_nodes(bus, m->path, n, 0, &s, &error);
         if (r < 0)
                 return bus_maybe_reply_error(m, r, &error);
@@ -947,9 +1161,13 @@ static int process_introspect(
                         fprintf(intro.f, " <interface name=\"%s\">\n", c->interface);
                 }
 
-                r = introspect_write_interface(&intro, c->vtable);
-                if (r < 0)
-                        goto finish;
+                if (!c->introspection) {
+                        r = introspect_format_interface(c->vtable, bus->trusted, &c->introspection);
+                        if (r < 0)
+                                goto finish;
+                }
+
+                fputs(c->introspection, intro.f);
 
                 previous_interface = c->interface;
         }
@@ -981,6 +1199,14 @@ static int process_introspect(
         if (r < 0)
                 goto finish;
 
+        if (cacheable) {
+                r = free_and_strdup(&n->introspection, intro.introspection);
+                if (r < 0)
+                        goto finish;
+
+                n->introspection_generation = bus->nodes_generation;
+        }
+
         r = sd_bus_send(bus, reply, NULL);
         if (r < 0)
                 goto finish;
@@ -1227,8 +1453,8 @@ static int object_find_and_run(
                 bool require_fallback,
                 bool *found_object) {
 
+        struct vtable_member *v;
         struct node *n;
-        struct vtable_member vtable_key, *v;
         int r;
 
         assert(bus);
@@ -1251,11 +1477,7 @@ static int object_find_and_run(
                 return 0;
 
         /* Then, look for a known method */
-        vtable_key.path = (char*) p;
-        vtable_key.interface = m->interface;
-        vtable_key.member = m->member;
-
-        v = hashmap_get(bus->vtable_methods, &vtable_key);
+        v = node_find_vtable_member(n, m->interface, m->member, false);
         if (v) {
                 r = method_callbacks_run(bus, m, v, require_fallback, found_object);
                 if (r != 0)
@@ -1271,18 +1493,17 @@ static int object_find_and_run(
                 get = streq(m->member, "Get");
 
                 if (get || streq(m->member, "Set")) {
+                        const char *iface, *member;
 
                         r = sd_bus_message_rewind(m, true);
                         if (r < 0)
                                 return r;
 
-                        vtable_key.path = (char*) p;
-
-                        r = sd_bus_message_read(m, "ss", &vtable_key.interface, &vtable_key.member);
+                        r = sd_bus_message_read(m, "ss", &iface, &member);
                         if (r < 0)
                                 return sd_bus_reply_method_errorf(m, SD_BUS_ERROR_INVALID_ARGS, "Expected interface and member parameters");
 
-                        v = hashmap_get(bus->vtable_properties, &vtable_key);
+                        v = node_find_vtable_member(n, iface, member, true);
                         if (v) {
                                 r = property_get_set_callbacks_run(bus, m, v, require_fallback, get, found_object);
                                 if (r != 0)
@@ -1485,6 +1706,7 @@ void bus_node_gc(sd_bus *b, struct node *n) {
                 LIST_REMOVE(siblings, n->parent->child, n);
 
         free(n->path);
+        free(n->introspection);
         bus_node_gc(b, n->parent);
         free(n);
 }
@@ -1548,7 +1770,7 @@ static int bus_add_object(
 
         s->node_callback.node = n;
         LIST_PREPEND(callbacks, n->callbacks, &s->node_callback);
-        bus->nodes_modified = true;
+        bus_nodes_changed(bus);
 
         if (slot)
                 *slot = s;
@@ -1582,33 +1804,6 @@ _public_ int sd_bus_add_fallback(
         return bus_add_object(bus, slot, true, prefix, callback, userdata);
 }
 
-static void vtable_member_hash_func(const struct vtable_member *m, struct siphash *state) {
-        assert(m);
-
-        string_hash_func(m->path, state);
-        string_hash_func(m->interface, state);
-        string_hash_func(m->member, state);
-}
-
-static int vtable_member_compare_func(const struct vtable_member *x, const struct vtable_member *y) {
-        int r;
-
-        assert(x);
-        assert(y);
-
-        r = strcmp(x->path, y->path);
-        if (r != 0)
-                return r;
-
-        r = strcmp(x->interface, y->interface);
-        if (r != 0)
-                return r;
-
-        return strcmp(x->member, y->member);
-}
-
-DEFINE_PRIVATE_HASH_OPS(vtable_member_hash_ops, struct vtable_member, vtable_member_hash_func, vtable_member_compare_func);
-
 static int add_object_vtable_internal(
                 sd_bus *bus,
                 sd_bus_slot **slot,
@@ -1638,14 +1833,6 @@ static int add_object_vtable_internal(
                       !streq(interface, "org.freedesktop.DBus.Peer") &&
                       !streq(interface, "org.freedesktop.DBus.ObjectManager"), -EINVAL);
 
-        r = hashmap_ensure_allocated(&bus->vtable_methods, &vtable_member_hash_ops);
-        if (r < 0)
-                return r;
-
-        r = hashmap_ensure_allocated(&bus->vtable_properties, &vtable_member_hash_ops);
-        if (r < 0)
-                return r;
-
         n = bus_node_allocate(bus, path);
         if (!n)
                 return -ENOMEM;
@@ -1699,6 +1886,15 @@ static int add_object_vtable_internal(
                                 goto fail;
                         }
 
+                        if (existing && node_find_vtable_member(n, interface, v->x.method.member, false)) {
+                                r = -EEXIST;
+                                goto fail;
+                        }
+
+                        r = hashmap_ensure_allocated(&s->node_vtable.methods, &string_hash_ops);
+                        if (r < 0)
+                                goto fail;
+
                         m = new0(struct vtable_member, 1);
                         if (!m) {
                                 r = -ENOMEM;
@@ -1706,12 +1902,11 @@ static int add_object_vtable_internal(
                         }
 
                         m->parent = &s->node_vtable;
-                        m->path = n->path;
                         m->interface = s->node_vtable.interface;
                         m->member = v->x.method.member;
                         m->vtable = v;
 
-                        r = hashmap_put(bus->vtable_methods, m, m);
+                        r = hashmap_put(s->node_vtable.methods, m->member, m);
                         if (r < 0) {
                                 free(m);
                                 goto fail;
@@ -1739,7 +1934,7 @@ static int add_object_vtable_internal(
                         if (!member_name_is_valid(v->x.property.member) ||
                             !signature_is_single(v->x.property.signature, false) ||
                             !(v->x.property.get || bus_type_is_basic(v->x.property.signature[0]) || streq(v->x.property.signature, "as")) ||
-                            (v->flags & SD_BUS_VTABLE_METHOD_NO_REPLY) ||
+                            (v->flags & (SD_BUS_VTABLE_METHOD_NO_REPLY|SD_BUS_VTABLE_METHOD_OFFLOAD)) ||
                             (!!(v->flags & SD_BUS_VTABLE_PROPERTY_CONST) + !!(v->flags & SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE) + !!(v->flags & SD_BUS_VTABLE_PROPERTY_EMITS_INVALIDATION)) > 1 ||
                             ((v->flags & SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE) && (v->flags & SD_BUS_VTABLE_PROPERTY_EXPLICIT)) ||
                             (v->flags & SD_BUS_VTABLE_UNPRIVILEGED && v->type == _SD_BUS_VTABLE_PROPERTY)) {
@@ -1747,6 +1942,15 @@ static int add_object_vtable_internal(
                                 goto fail;
                         }
 
+                        if (existing && node_find_vtable_member(n, interface, v->x.property.member, true)) {
+                                r = -EEXIST;
+                                goto fail;
+                        }
+
+                        r = hashmap_ensure_allocated(&s->node_vtable.properties, &string_hash_ops);
+                        if (r < 0)
+                                goto fail;
+
                         m = new0(struct vtable_member, 1);
                         if (!m) {
                                 r = -ENOMEM;
@@ -1754,12 +1958,11 @@ static int add_object_vtable_internal(
                         }
 
                         m->parent = &s->node_vtable;
-                        m->path = n->path;
                         m->interface = s->node_vtable.interface;
                         m->member = v->x.property.member;
                         m->vtable = v;
 
-                        r = hashmap_put(bus->vtable_properties, m, m);
+                        r = hashmap_put(s->node_vtable.properties, m->member, m);
                         if (r < 0) {
                                 free(m);
                                 goto fail;
@@ -1772,7 +1975,7 @@ static int add_object_vtable_internal(
 
                         if (!member_name_is_valid(v->x.signal.member) ||
                             !signature_is_valid(strempty(v->x.signal.signature), false) ||
-                            v->flags & SD_BUS_VTABLE_UNPRIVILEGED) {
+                            v->flags & (SD_BUS_VTABLE_UNPRIVILEGED|SD_BUS_VTABLE_METHOD_OFFLOAD)) {
                                 r = -EINVAL;
                                 goto fail;
                         }
@@ -1787,7 +1990,7 @@ static int add_object_vtable_internal(
 
         s->node_vtable.node = n;
         LIST_INSERT_AFTER(vtables, n->vtables, existing, &s->node_vtable);
-        bus->nodes_modified = true;
+        bus_nodes_changed(bus);
 
         if (slot)
                 *slot = s;
@@ -1855,7 +2058,7 @@ _public_ int sd_bus_add_node_enumerator(
 
         s->node_enumerator.node = n;
         LIST_PREPEND(enumerators, n->enumerators, &s->node_enumerator);
-        bus->nodes_modified = true;
+        bus_nodes_changed(bus);
 
         if (slot)
                 *slot = s;
@@ -1881,7 +2084,6 @@ static int emit_properties_changed_on_interface(
         _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
         _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
         bool has_invalidating = false, has_changing = false;
-        struct vtable_member key = {};
         struct node_vtable *c;
         struct node *n;
         char **property;
@@ -1910,9 +2112,6 @@ static int emit_properties_changed_on_interface(
         if (r < 0)
                 return r;
 
-        key.path = prefix;
-        key.interface = interface;
-
         LIST_FOREACH(vtables, c, n->vtables) {
                 if (require_fallback && !c->is_fallback)
                         continue;
@@ -1940,8 +2139,7 @@ static int emit_properties_changed_on_interface(
 
                                 assert_return(member_name_is_valid(*property), -EINVAL);
 
-                                key.member = *property;
-                                v = hashmap_get(bus->vtable_properties, &key);
+                                v = node_find_vtable_member(n, interface, *property, true);
                                 if (!v)
                                         return -ENOENT;
 
@@ -2033,8 +2231,7 @@ static int emit_properties_changed_on_interface(
                                 STRV_FOREACH(property, names) {
                                         struct vtable_member *v;
 
-                                        key.member = *property;
-                                        assert_se(v = hashmap_get(bus->vtable_properties, &key));
+                                        assert_se(v = node_find_vtable_member(n, interface, *property, true));
                                         assert(c == v->parent);
 
                                         if (!(v->vtable->flags & SD_BUS_VTABLE_PROPERTY_EMITS_INVALIDATION))
@@ -2800,7 +2997,7 @@ _public_ int sd_bus_add_object_manager(sd_bus *bus, sd_bus_slot **slot, const ch
 
         s->node_object_manager.node = n;
         LIST_PREPEND(object_managers, n->object_managers, &s->node_object_manager);
-        bus->nodes_modified = true;
+        bus_nodes_changed(bus);
 
         if (slot)
                 *slot = s;
@@ -0,0 +1,605 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#include "alloc-util.h"
+#include "async.h"
+#include "bus-internal.h"
+#include "bus-message.h"
+#include "bus-offload.h"
+#include "fd-util.h"
+#include "list.h"
+#include "time-util.h"
+
+/* Method handlers flagged with SD_BUS_VTABLE_METHOD_OFFLOAD are run on a pool of worker threads instead of the
+ * thread processing the bus. sd_bus objects are not thread-safe, hence everything that involves the connection itself
+ * is marshalled back to the bus thread, via an eventfd watched in the event loop the bus is attached to:
+ *
+ *   • Jobs are handed to the workers from the eventfd callback only, i.e. once the dispatching of the method call
+ *     message has fully unwound and the bus thread holds no references to it anymore.
+ *   • Messages the handler sends, usually its reply, are queued in the job and sent by the bus thread once the
+ *     handler returned, followed by the usual error reply if the handler failed.
+ *   • Synchronous method calls the handler does are issued asynchronously by the bus thread, while the worker waits
+ *     for the reply, which is handed over once the bus thread finished dispatching it.
+ *
+ * This way each message is only used by one thread at a time, which is all sd_bus_message objects allow. Handlers
+ * must not use the bus in any other way, and have to do their own locking for the daemon state they touch.
+ *
+ * When the bus is closed, jobs whose handler wasn't started yet are dropped, calls of handlers that are still running
+ * fail with -ECONNRESET, and the handlers are waited for, so that nothing refers to the bus anymore afterwards. */
+
+#define BUS_OFFLOAD_THREADS_MAX 16U
+
+/* How long an idle worker waits for new jobs before exiting */
+#define BUS_OFFLOAD_IDLE_USEC (30*USEC_PER_SEC)
+
+typedef struct BusOffloadJob BusOffloadJob;
+typedef struct BusOffloadCall BusOffloadCall;
+
+struct BusOffloadJob {
+        sd_bus *bus;
+        sd_bus_slot *slot;
+        sd_bus_message *message;
+        sd_bus_message_handler_t handler;
+        void *userdata;
+
+        /* Filled in by the worker */
+        int r;
+        sd_bus_error error;
+        sd_bus_message **queued;
+        size_t n_queued, n_queued_allocated;
+
+        LIST_FIELDS(BusOffloadJob, jobs);
+};
+
+struct BusOffloadCall {
+        BusOffloadPool *pool;
+        sd_bus_message *message;
+        uint64_t usec;
+        sd_bus_slot *slot;
+
+        sd_bus_message *reply;
+        int r;
+        bool done;
+
+        LIST_FIELDS(BusOffloadCall, calls);
+};
+
+struct BusOffloadPool {
+        /* Protects everything below, except for event_fd */
+        pthread_mutex_t mutex;
+
+        /* Signalled when jobs are queued or the pool is shut down, and when calls completed or handlers returned after
+         * the bus was closed, respectively */
+        pthread_cond_t job_cond;
+        pthread_cond_t call_cond;
+
+        /* One reference is held by the bus, and one by each worker */
+        unsigned n_ref;
+
+        /* Jobs not handed to the workers yet, jobs waiting for a worker, and jobs whose handler returned */
+        LIST_HEAD(BusOffloadJob, deferred);
+        LIST_HEAD(BusOffloadJob, pending);
+        LIST_HEAD(BusOffloadJob, done);
+        unsigned n_pending, n_running;
+
+        /* Calls waiting to be issued, calls waiting for their reply, and calls whose reply was dispatched but whose
+         * worker wasn't woken up yet */
+        LIST_HEAD(BusOffloadCall, calls);
+        LIST_HEAD(BusOffloadCall, issued);
+        LIST_HEAD(BusOffloadCall, replied);
+
+        unsigned n_threads, n_idle;
+        bool shutdown;
+        bool closed;
+
+        int event_fd;
+};
+
+static thread_local BusOffloadJob *current_job = NULL;
+
+static BusOffloadPool* offload_pool_free(BusOffloadPool *p) {
+        if (!p)
+                return NULL;
+
+        assert(!p->deferred);
+        assert(!p->pending);
+        assert(!p->done);
+        assert(!p->calls);
+        assert(!p->issued);
+        assert(!p->replied);
+        assert(p->n_running == 0);
+
+        assert_se(pthread_mutex_destroy(&p->mutex) == 0);
+        assert_se(pthread_cond_destroy(&p->job_cond) == 0);
+        assert_se(pthread_cond_destroy(&p->call_cond) == 0);
+
+        safe_close(p->event_fd);
+
+        return mfree(p);
+}
+
+static void offload_pool_unref_unlock(BusOffloadPool *p) {
+        bool last;
+
+        assert(p);
+        assert(p->n_ref > 0);
+
+        last = --p->n_ref == 0;
+        assert_se(pthread_mutex_unlock(&p->mutex) == 0);
+
+        if (last)
+                offload_pool_free(p);
+}
+
+static int offload_pool_new(BusOffloadPool **ret) {
+        _cleanup_free_ BusOffloadPool *p = NULL;
+        pthread_condattr_t attr;
+
+        assert(ret);
+
+        p = new(BusOffloadPool, 1);
+        if (!p)
+                return -ENOMEM;
+
+        *p = (BusOffloadPool) {
+                .n_ref = 1,
+                .event_fd = eventfd(0, EFD_CLOEXEC|EFD_NONBLOCK),
+        };
+        if (p->event_fd < 0)
+                return -errno;
+
+        assert_se(pthread_mutex_init(&p->mutex, NULL) == 0);
+
+        assert_se(pthread_condattr_init(&attr) == 0);
+        assert_se(pthread_condattr_setclock(&attr, CLOCK_MONOTONIC) == 0);
+        assert_se(pthread_cond_init(&p->job_cond, &attr) == 0);
+        assert_se(pthread_condattr_destroy(&attr) == 0);
+
+        assert_se(pthread_cond_init(&p->call_cond, NULL) == 0);
+
+        *ret = TAKE_PTR(p);
+        return 0;
+}
+
+static BusOffloadJob* offload_job_free(BusOffloadJob *j) {
+        size_t i;
+
+        if (!j)
+                return NULL;
+
+        for (i = 0; i < j->n_queued; i++)
+                sd_bus_message_unref(j->queued[i]);
+        free(j->queued);
+
+        sd_bus_error_free(&j->error);
+        sd_bus_message_unref(j->message);
+        sd_bus_slot_unref(j->slot);
+        sd_bus_unref(j->bus);
+
+        return mfree(j);
+}
+
+static void offload_job_complete(BusOffloadJob *j) {
+        size_t i;
+        int r;
+
+        assert(j);
+
+        for (i = 0; i < j->n_queued; i++) {
+                r = sd_bus_send(j->bus, j->queued[i], NULL);
+                if (r < 0)
+                        log_debug_errno(r, "Failed to send message queued by offloaded method handler, ignoring: %m");
+        }
+
+        (void) bus_maybe_reply_error(j->message, j->r, &j->error);
+
+        offload_job_free(j);
+}
+
+static void *offload_thread(void *p) {
+        BusOffloadPool *pool = p;
+        struct timespec ts;
+        BusOffloadJob *j;
+        int r;
+
+        assert(pool);
+
+        assert_se(pthread_mutex_lock(&pool->mutex) == 0);
+
+        for (;;) {
+                j = pool->pending;
+                if (!j) {
+                        if (pool->shutdown)
+                                break;
+
+                        pool->n_idle++;
+                        r = pthread_cond_timedwait(&pool->job_cond, &pool->mutex,
+                                                   timespec_store(&ts, now(CLOCK_MONOTONIC) + BUS_OFFLOAD_IDLE_USEC));
+                        pool->n_idle--;
+
+                        if (r == ETIMEDOUT && !pool->pending)
+                                break;
+                        assert(IN_SET(r, 0, ETIMEDOUT));
+
+                        continue;
+                }
+
+                LIST_REMOVE(jobs, pool->pending, j);
+                pool->n_pending--;
+                pool->n_running++;
+
+                assert_se(pthread_mutex_unlock(&pool->mutex) == 0);
+
+                current_job = j;
+                j->r = j->handler(j->message, j->userdata, &j->error);
+                current_job = NULL;
+
+                assert_se(pthread_mutex_lock(&pool->mutex) == 0);
+
+                pool->n_running--;
+                LIST_PREPEND(jobs, pool->done, j);
+                (void) eventfd_write(pool->event_fd, 1);
+
+                if (pool->closed)
+                        assert_se(pthread_cond_broadcast(&pool->call_cond) == 0);
+        }
+
+        pool->n_threads--;
+        offload_pool_unref_unlock(pool);
+
+        return NULL;
+}
+
+static int offload_call_reply(sd_bus_message *m, void *userdata, sd_bus_error *ret_error) {
+        BusOffloadCall *c = userdata;
+        BusOffloadPool *pool;
+
+        assert(m);
+        assert(c);
+
+        pool = c->pool;
+
+        /* The reply is still referenced by the dispatching code, hence only wake up the worker on the next
+         * iteration of the eventfd callback. */
+        c->reply = sd_bus_message_ref(m);
+
+        assert_se(pthread_mutex_lock(&pool->mutex) == 0);
+        LIST_REMOVE(calls, pool->issued, c);
+        LIST_PREPEND(calls, pool->replied, c);
+        (void) eventfd_write(pool->event_fd, 1);
+        assert_se(pthread_mutex_unlock(&pool->mutex) == 0);
+
+        return 0;
+}
+
+static int offload_event_handler(sd_event_source *s, int fd, uint32_t revents, void *userdata) {
+        LIST_HEAD(BusOffloadCall, calls);
+        LIST_HEAD(BusOffloadJob, done);
+        sd_bus *bus = userdata;
+        BusOffloadPool *pool;
+        BusOffloadCall *c;
+        BusOffloadJob *j;
+        eventfd_t v;
+        int r;
+
+        assert(bus);
+
+        pool = bus->offload_pool;
+        assert(pool);
+
+        (void) eventfd_read(fd, &v);
+
+        assert_se(pthread_mutex_lock(&pool->mutex) == 0);
+
+        if (pool->replied) {
+                while ((c = pool->replied)) {
+                        LIST_REMOVE(calls, pool->replied, c);
+                        c->slot = sd_bus_slot_unref(c->slot);
+                        c->done = true;
+                }
+
+                assert_se(pthread_cond_broadcast(&pool->call_cond) == 0);
+        }
+
+        while ((j = pool->deferred)) {
+                LIST_REMOVE(jobs, pool->deferred, j);
+                LIST_APPEND(jobs, pool->pending, j);
+                pool->n_pending++;
+        }
+
+        /* Start as many workers as there are jobs nobody is waiting for, up to the limit */
+        while (pool->n_pending > pool->n_idle && pool->n_threads < BUS_OFFLOAD_THREADS_MAX) {
+                r = asynchronous_job(offload_thread, pool);
+                if (r < 0) {
+                        log_debug_errno(r, "Failed to start bus worker thread: %m");
+
+                        /* If there's no worker at all, the jobs would never be processed. Fail them. */
+                        if (pool->n_threads == 0)
+                                while ((j = pool->pending)) {
+                                        LIST_REMOVE(jobs, pool->pending, j);
+                                        pool->n_pending--;
+                                        j->r = r;
+                                        LIST_PREPEND(jobs, pool->done, j);
+                                }
+
+                        break;
+                }
+
+                pool->n_threads++;
+                pool->n_ref++;
+        }
+
+        if (pool->n_pending > 0 && pool->n_idle > 0)
+                assert_se(pthread_cond_broadcast(&pool->job_cond) == 0);
+
+        calls = TAKE_PTR(pool->calls);
+        done = TAKE_PTR(pool->done);
+
+        assert_se(pthread_mutex_unlock(&pool->mutex) == 0);
+
+        while ((c = calls)) {
+                LIST_REMOVE(calls, calls, c);
+
+                /* Keep a reference to the slot, so that the call can be cancelled if the bus is closed */
+                r = sd_bus_call_async(bus, &c->slot, c->message, offload_call_reply, c, c->usec);
+
+                assert_se(pthread_mutex_lock(&pool->mutex) == 0);
+                if (r < 0) {
+                        c->r = r;
+                        c->done = true;
+                        assert_se(pthread_cond_broadcast(&pool->call_cond) == 0);
+                } else
+                        LIST_PREPEND(calls, pool->issued, c);
+                assert_se(pthread_mutex_unlock(&pool->mutex) == 0);
+        }
+
+        /* Note that completing the last job might drop the last reference to the bus, and hence free the pool */
+        while ((j = done)) {
+                LIST_REMOVE(jobs, done, j);
+                offload_job_complete(j);
+        }
+
+        return 0;
+}
+
+int bus_offload_method(sd_bus *bus, sd_bus_slot *slot, sd_bus_message *m, sd_bus_message_handler_t handler, void *userdata) {
+        BusOffloadPool *pool;
+        BusOffloadJob *j;
+        int r;
+
+        assert(bus);
+        assert(slot);
+        assert(m);
+        assert(handler);
+
+        /* Without an event loop there's no way to get the results back to the bus thread, let the caller run the
+         * handler synchronously then. */
+        if (!bus->event)
+                return 0;
+
+        if (!bus->offload_pool) {
+                r = offload_pool_new(&bus->offload_pool);
+                if (r < 0)
+                        return r;
+        }
+
+        pool = bus->offload_pool;
+
+        r = bus_offload_attach_event(bus);
+        if (r < 0)
+                return r;
+
+        j = new(BusOffloadJob, 1);
+        if (!j)
+                return -ENOMEM;
+
+        *j = (BusOffloadJob) {
+                .bus = sd_bus_ref(bus),
+                .slot = sd_bus_slot_ref(slot),
+                .message = sd_bus_message_ref(m),
+                .handler = handler,
+                .userdata = userdata,
+                .error = SD_BUS_ERROR_NULL,
+        };
+
+        assert_se(pthread_mutex_lock(&pool->mutex) == 0);
+        LIST_APPEND(jobs, pool->deferred, j);
+        (void) eventfd_write(pool->event_fd, 1);
+        assert_se(pthread_mutex_unlock(&pool->mutex) == 0);
+
+        return 1;
+}
+
+bool bus_offload_running(sd_bus *bus) {
+        return current_job && current_job->bus == bus;
+}
+
+int bus_offload_send(sd_bus *bus, sd_bus_message *m, uint64_t *cookie) {
+        BusOffloadJob *j = current_job;
+
+        assert(j);
+        assert(j->bus == bus);
+        assert(m);
+
+        /* Cookies are assigned when sealing, which only happens on the bus thread after the handler returned */
+        if (cookie)
+                return -EDEADLK;
+
+        if (!GREEDY_REALLOC(j->queued, j->n_queued_allocated, j->n_queued + 1))
+                return -ENOMEM;
+
+        j->queued[j->n_queued++] = sd_bus_message_ref(m);
+        return 1;
+}
+
+int bus_offload_call(sd_bus *bus, sd_bus_message *m, uint64_t usec, sd_bus_error *error, sd_bus_message **reply) {
+        BusOffloadPool *pool;
+        BusOffloadCall c;
+        int r;
+
+        assert(current_job);
+        assert(current_job->bus == bus);
+        assert(m);
+
+        pool = bus->offload_pool;
+        assert(pool);
+
+        c = (BusOffloadCall) {
+                .pool = pool,
+                .message = m,
+                .usec = usec,
+        };
+
+        assert_se(pthread_mutex_lock(&pool->mutex) == 0);
+
+        if (pool->closed) {
+                assert_se(pthread_mutex_unlock(&pool->mutex) == 0);
+                return sd_bus_error_set_errno(error, -ECONNRESET);
+        }
+
+        LIST_APPEND(calls, pool->calls, &c);
+        (void) eventfd_write(pool->event_fd, 1);
+
+        while (!c.done)
+                assert_se(pthread_cond_wait(&pool->call_cond, &pool->mutex) == 0);
+
+        assert_se(pthread_mutex_unlock(&pool->mutex) == 0);
+
+        if (c.r < 0)
+                return sd_bus_error_set_errno(error, c.r);
+
+        if (c.reply->header->type == SD_BUS_MESSAGE_METHOD_ERROR) {
+                r = sd_bus_error_copy(error, &c.reply->error);
+                sd_bus_message_unref(c.reply);
+                return r;
+        }
+
+        if (reply)
+                *reply = c.reply;
+        else
+                sd_bus_message_unref(c.reply);
+
+        return 1;
+}
+
+int bus_offload_attach_event(sd_bus *bus) {
+        int r;
+
+        assert(bus);
+
+        if (!bus->offload_pool || !bus->event || bus->offload_event_source)
+                return 0;
+
+        r = sd_event_add_io(bus->event, &bus->offload_event_source, bus->offload_pool->event_fd, EPOLLIN, offload_event_handler, bus);
+        if (r < 0)
+                return r;
+
+        r = sd_event_source_set_priority(bus->offload_event_source, bus->event_priority);
+        if (r < 0)
+                return r;
+
+        r = sd_event_source_set_description(bus->offload_event_source, "bus-offload");
+        if (r < 0)
+                return r;
+
+        return 0;
+}
+
+void bus_offload_detach_event(sd_bus *bus) {
+        assert(bus);
+
+        if (bus->offload_event_source) {
+                sd_event_source_set_enabled(bus->offload_event_source, SD_EVENT_OFF);
+                bus->offload_event_source = sd_event_source_unref(bus->offload_event_source);
+        }
+}
+
+static void offload_calls_cancel(BusOffloadCall **head) {
+        BusOffloadCall *c;
+
+        assert(head);
+
+        while ((c = *head)) {
+                LIST_REMOVE(calls, *head, c);
+
+                /* Calls that got their reply already are completed normally, all others fail. Releasing the slot
+                 * makes sure the reply callback is never called for the worker's call object anymore. */
+                if (!c->reply)
+                        c->r = -ECONNRESET;
+                c->slot = sd_bus_slot_unref(c->slot);
+                c->done = true;
+        }
+}
+
+void bus_offload_close(sd_bus *bus) {
+        LIST_HEAD(BusOffloadJob, cancelled);
+        LIST_HEAD(BusOffloadJob, done);
+        BusOffloadPool *pool;
+        BusOffloadJob *j;
+
+        assert(bus);
+
+        pool = bus->offload_pool;
+        if (!pool)
+                return;
+
+        /* Workers can't close the bus they are run for, they'd wait for themselves */
+        assert(!bus_offload_running(bus));
+
+        assert_se(pthread_mutex_lock(&pool->mutex) == 0);
+
+        pool->closed = true;
+
+        /* Handlers that didn't run yet are not started anymore */
+        cancelled = TAKE_PTR(pool->deferred);
+        while ((j = pool->pending)) {
+                LIST_REMOVE(jobs, pool->pending, j);
+                LIST_PREPEND(jobs, cancelled, j);
+        }
+        pool->n_pending = 0;
+
+        offload_calls_cancel(&pool->calls);
+        offload_calls_cancel(&pool->issued);
+        offload_calls_cancel(&pool->replied);
+        assert_se(pthread_cond_broadcast(&pool->call_cond) == 0);
+
+        /* Wait for the handlers that are running right now. Any call they do from now on fails right away. */
+        while (pool->n_running > 0)
+                assert_se(pthread_cond_wait(&pool->call_cond, &pool->mutex) == 0);
+
+        done = TAKE_PTR(pool->done);
+
+        assert_se(pthread_mutex_unlock(&pool->mutex) == 0);
+
+        /* Nothing can be sent anymore, just drop the jobs and their references to the bus */
+        while ((j = cancelled)) {
+                LIST_REMOVE(jobs, cancelled, j);
+                offload_job_free(j);
+        }
+
+        while ((j = done)) {
+                LIST_REMOVE(jobs, done, j);
+                offload_job_free(j);
+        }
+}
+
+void bus_offload_release(sd_bus *bus) {
+        BusOffloadPool *pool;
+
+        assert(bus);
+
+        bus_offload_detach_event(bus);
+
+        pool = TAKE_PTR(bus->offload_pool);
+        if (!pool)
+                return;
+
+        /* Jobs keep the bus referenced, hence none can be around anymore. Tell the idle workers to exit. */
+        assert_se(pthread_mutex_lock(&pool->mutex) == 0);
+        pool->shutdown = true;
+        assert_se(pthread_cond_broadcast(&pool->job_cond) == 0);
+        offload_pool_unref_unlock(pool);
+}
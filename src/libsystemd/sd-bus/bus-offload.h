@@ -0,0 +1,19 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+#pragma once
+
+#include <stdbool.h>
+
+#include "sd-bus.h"
+
+typedef struct BusOffloadPool BusOffloadPool;
+
+int bus_offload_method(sd_bus *bus, sd_bus_slot *slot, sd_bus_message *m, sd_bus_message_handler_t handler, void *userdata);
+
+bool bus_offload_running(sd_bus *bus);
+int bus_offload_send(sd_bus *bus, sd_bus_message *m, uint64_t *cookie);
+int bus_offload_call(sd_bus *bus, sd_bus_message *m, uint64_t usec, sd_bus_error *error, sd_bus_message **reply);
+
+int bus_offload_attach_event(sd_bus *bus);
+void bus_offload_detach_event(sd_bus *bus);
+void bus_offload_close(sd_bus *bus);
+void bus_offload_release(sd_bus *bus);
@@ -57,6 +57,10 @@ enum {
         BUS_MESSAGE_NO_REPLY_EXPECTED = 1,
         BUS_MESSAGE_NO_AUTO_START = 2,
         BUS_MESSAGE_ALLOW_INTERACTIVE_AUTHORIZATION = 4,
+
+        /* Our own extension, only used on connections that negotiated it: the body is not sent inline, but in a
+         * sealed memfd passed after all fds the message carries */
+        BUS_MESSAGE_BODY_MEMFD = 128,
 };
 
 /* Header fields */
@@ -83,7 +83,7 @@ void bus_slot_disconnect(sd_bus_slot *slot, bool unref) {
 
                 if (slot->node_callback.node) {
                         LIST_REMOVE(callbacks, slot->node_callback.node->callbacks, &slot->node_callback);
-                        slot->bus->nodes_modified = true;
+                        bus_nodes_changed(slot->bus);
 
                         bus_node_gc(slot->bus, slot->node_callback.node);
                 }
@@ -94,7 +94,7 @@ void bus_slot_disconnect(sd_bus_slot *slot, bool unref) {
 
                 if (slot->node_enumerator.node) {
                         LIST_REMOVE(enumerators, slot->node_enumerator.node->enumerators, &slot->node_enumerator);
-                        slot->bus->nodes_modified = true;
+                        bus_nodes_changed(slot->bus);
 
                         bus_node_gc(slot->bus, slot->node_enumerator.node);
                 }
@@ -105,7 +105,7 @@ void bus_slot_disconnect(sd_bus_slot *slot, bool unref) {
 
                 if (slot->node_object_manager.node) {
                         LIST_REMOVE(object_managers, slot->node_object_manager.node->object_managers, &slot->node_object_manager);
-                        slot->bus->nodes_modified = true;
+                        bus_nodes_changed(slot->bus);
 
                         bus_node_gc(slot->bus, slot->node_object_manager.node);
                 }
@@ -114,46 +114,14 @@ void bus_slot_disconnect(sd_bus_slot *slot, bool unref) {
 
         case BUS_NODE_VTABLE:
 
-                if (slot->node_vtable.node && slot->node_vtable.interface && slot->node_vtable.vtable) {
-                        const sd_bus_vtable *v;
-
-                        for (v = slot->node_vtable.vtable; v->type != _SD_BUS_VTABLE_END; v++) {
-                                struct vtable_member *x = NULL;
-
-                                switch (v->type) {
-
-                                case _SD_BUS_VTABLE_METHOD: {
-                                        struct vtable_member key;
-
-                                        key.path = slot->node_vtable.node->path;
-                                        key.interface = slot->node_vtable.interface;
-                                        key.member = v->x.method.member;
-
-                                        x = hashmap_remove(slot->bus->vtable_methods, &key);
-                                        break;
-                                }
-
-                                case _SD_BUS_VTABLE_PROPERTY:
-                                case _SD_BUS_VTABLE_WRITABLE_PROPERTY: {
-                                        struct vtable_member key;
-
-                                        key.path = slot->node_vtable.node->path;
-                                        key.interface = slot->node_vtable.interface;
-                                        key.member = v->x.method.member;
-
-                                        x = hashmap_remove(slot->bus->vtable_properties, &key);
-                                        break;
-                                }}
-
-                                free(x);
-                        }
-                }
-
+                slot->node_vtable.methods = hashmap_free_free(slot->node_vtable.methods);
+                slot->node_vtable.properties = hashmap_free_free(slot->node_vtable.properties);
+                slot->node_vtable.introspection = mfree(slot->node_vtable.introspection);
                 slot->node_vtable.interface = mfree(slot->node_vtable.interface);
 
                 if (slot->node_vtable.node) {
                         LIST_REMOVE(vtables, slot->node_vtable.node->vtables, &slot->node_vtable);
-                        slot->bus->nodes_modified = true;
+                        bus_nodes_changed(slot->bus);
 
                         bus_node_gc(slot->bus, slot->node_vtable.node);
                 }
@@ -1,6 +1,7 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 
 #include <endian.h>
+#include <limits.h>
 #include <poll.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -18,6 +19,7 @@
 #include "hexdecoct.h"
 #include "io-util.h"
 #include "macro.h"
+#include "memfd-util.h"
 #include "missing.h"
 #include "path-util.h"
 #include "process-util.h"
@@ -25,6 +27,7 @@
 #include "signal-util.h"
 #include "stdio-util.h"
 #include "string-util.h"
+#include "usdt.h"
 #include "user-util.h"
 #include "utf8.h"
 #include "util.h"
@@ -60,11 +63,53 @@ static int append_iovec(sd_bus_message *m, const void *p, size_t sz) {
         return 0;
 }
 
-static int bus_message_setup_iovec(sd_bus_message *m) {
+static int bus_message_setup_body_memfd(sd_bus *bus, sd_bus_message *m) {
+        _cleanup_close_ int fd = -1;
+        struct bus_body_part *part;
+        unsigned i;
+        int r;
+
+        assert(bus);
+        assert(m);
+
+        /* Large bodies are passed in a sealed memfd if the peer agreed to that, so that it can map the body
+         * instead of having to receive it all into its buffer */
+        if (!bus->can_memfd ||
+            BUS_MESSAGE_IS_GVARIANT(m) ||
+            m->body_size < MEMFD_MIN_SIZE ||
+            m->n_fds >= BUS_FDS_MAX)
+                return 0;
+
+        fd = memfd_new("sd-bus-body");
+        if (fd < 0)
+                return fd;
+
+        MESSAGE_FOREACH_PART(part, i, m) {
+                r = bus_body_part_map(part);
+                if (r < 0)
+                        return r;
+
+                r = loop_write(fd, part->data, part->size, false);
+                if (r < 0)
+                        return r;
+        }
+
+        r = memfd_set_sealed(fd);
+        if (r < 0)
+                return r;
+
+        m->body_memfd = TAKE_FD(fd);
+        m->header->flags |= BUS_MESSAGE_BODY_MEMFD;
+
+        return 1;
+}
+
+static int bus_message_setup_iovec(sd_bus *bus, sd_bus_message *m) {
         struct bus_body_part *part;
         unsigned n, i;
         int r;
 
+        assert(bus);
         assert(m);
         assert(m->sealed);
 
@@ -73,6 +118,14 @@ static int bus_message_setup_iovec(sd_bus_message *m) {
 
         assert(!m->iovec);
 
+        r = bus_message_setup_body_memfd(bus, m);
+        if (r < 0)
+                log_debug_errno(r, "Failed to pass message body in memfd, sending it inline: %m");
+        if (r > 0) {
+                m->iovec = m->iovec_fixed;
+                return append_iovec(m, m->header, BUS_MESSAGE_BODY_BEGIN(m));
+        }
+
         n = 1 + m->n_body_parts;
         if (n < ELEMENTSOF(m->iovec_fixed))
                 m->iovec = m->iovec_fixed;
@@ -157,15 +210,15 @@ static int bus_socket_write_auth(sd_bus *b) {
 }
 
 static int bus_socket_auth_verify_client(sd_bus *b) {
-        char *e, *f, *start;
+        char *e, *f, *g, *start;
         sd_id128_t peer;
         unsigned i;
         int r;
 
         assert(b);
 
-        /* We expect two response lines: "OK" and possibly
-         * "AGREE_UNIX_FD" */
+        /* We expect up to three response lines: "OK" and possibly
+         * "AGREE_UNIX_FD" and "AGREE_MEMFD" */
 
         e = memmem_safe(b->rbuffer, b->rbuffer_size, "\r\n", 2);
         if (!e)
@@ -176,9 +229,18 @@ static int bus_socket_auth_verify_client(sd_bus *b) {
                 if (!f)
                         return 0;
 
-                start = f + 2;
+                if (b->accept_memfd) {
+                        g = memmem(f + 2, b->rbuffer_size - (f - (char*) b->rbuffer) - 2, "\r\n", 2);
+                        if (!g)
+                                return 0;
+
+                        start = g + 2;
+                } else {
+                        g = NULL;
+                        start = f + 2;
+                }
         } else {
-                f = NULL;
+                f = g = NULL;
                 start = e + 2;
         }
 
@@ -219,6 +281,14 @@ static int bus_socket_auth_verify_client(sd_bus *b) {
                         memcmp(e + 2, "AGREE_UNIX_FD",
                                STRLEN("AGREE_UNIX_FD")) == 0;
 
+        /* The third line is only meaningful if fd passing was agreed on */
+        if (g)
+                b->can_memfd =
+                        b->can_fds &&
+                        (g - f == STRLEN("\r\nAGREE_MEMFD")) &&
+                        memcmp(f + 2, "AGREE_MEMFD",
+                               STRLEN("AGREE_MEMFD")) == 0;
+
         b->rbuffer_size -= (start - (char*) b->rbuffer);
         memmove(b->rbuffer, start, b->rbuffer_size);
 
@@ -458,6 +528,13 @@ static int bus_socket_auth_verify_server(sd_bus *b) {
                                 b->can_fds = true;
                                 r = bus_socket_auth_write(b, "AGREE_UNIX_FD\r\n");
                         }
+                } else if (line_equals(line, l, "NEGOTIATE_MEMFD")) {
+                        if (b->auth == _BUS_AUTH_INVALID || !b->can_fds || !b->accept_memfd)
+                                r = bus_socket_auth_write(b, "ERROR\r\n");
+                        else {
+                                b->can_memfd = true;
+                                r = bus_socket_auth_write(b, "AGREE_MEMFD\r\n");
+                        }
                 } else
                         r = bus_socket_auth_write(b, "ERROR\r\n");
 
@@ -625,7 +702,9 @@ static int bus_socket_start_auth_client(sd_bus *b) {
         if (!b->auth_buffer)
                 return -ENOMEM;
 
-        if (b->accept_fd)
+        if (b->accept_fd && b->accept_memfd)
+                auth_suffix = "\r\nNEGOTIATE_UNIX_FD\r\nNEGOTIATE_MEMFD\r\nBEGIN\r\n";
+        else if (b->accept_fd)
                 auth_suffix = "\r\nNEGOTIATE_UNIX_FD\r\nBEGIN\r\n";
         else
                 auth_suffix = "\r\nBEGIN\r\n";
@@ -958,54 +1037,89 @@ int bus_socket_take_fd(sd_bus *b) {
         return bus_socket_start_auth(b);
 }
 
-int bus_socket_write_message(sd_bus *bus, sd_bus_message *m, size_t *idx) {
+int bus_socket_write_messages(sd_bus *bus, sd_bus_message **messages, size_t n_messages, size_t *idx) {
+        size_t n, i, n_iovec = 0, size = 0;
         struct iovec *iov;
+        sd_bus_message *m;
         ssize_t k;
-        size_t n;
         unsigned j;
         int r;
 
         assert(bus);
-        assert(m);
+        assert(messages);
+        assert(n_messages > 0);
         assert(idx);
         assert(IN_SET(bus->state, BUS_RUNNING, BUS_HELLO));
 
-        if (*idx >= BUS_MESSAGE_SIZE(m))
+        m = messages[0];
+
+        if (*idx >= BUS_MESSAGE_WIRE_SIZE(m))
                 return 0;
 
-        r = bus_message_setup_iovec(m);
-        if (r < 0)
-                return r;
+        /* Let's write as many of the queued messages as we can with a single syscall. Messages with fds are always
+         * written on their own though, so that the fds are unambiguously attached to the first byte of their
+         * message. We stop adding messages once we have more than the socket buffer is going to take anyway. */
+        for (n = 0; n < n_messages; n++) {
+                sd_bus_message *q = messages[n];
+
+                if (n > 0 && (m->n_fds > 0 || m->body_memfd >= 0 || q->n_fds > 0 || size - *idx >= BUS_WRITE_BATCH_SIZE))
+                        break;
+
+                r = bus_message_setup_iovec(bus, q);
+                if (r < 0) {
+                        if (n == 0)
+                                return r;
+
+                        /* Leave it to the next call to report the error */
+                        break;
+                }
+
+                if (n > 0 && (q->body_memfd >= 0 || n_iovec + q->n_iovec > IOV_MAX))
+                        break;
+
+                n_iovec += q->n_iovec;
+                size += BUS_MESSAGE_WIRE_SIZE(q);
+        }
 
-        n = m->n_iovec * sizeof(struct iovec);
-        iov = alloca(n);
-        memcpy_safe(iov, m->iovec, n);
+        iov = newa(struct iovec, n_iovec);
+
+        n_iovec = 0;
+        for (i = 0; i < n; i++) {
+                memcpy_safe(iov + n_iovec, messages[i]->iovec, messages[i]->n_iovec * sizeof(struct iovec));
+                n_iovec += messages[i]->n_iovec;
+        }
 
         j = 0;
         iovec_advance(iov, &j, *idx);
 
         if (bus->prefer_writev)
-                k = writev(bus->output_fd, iov, m->n_iovec);
+                k = writev(bus->output_fd, iov + j, n_iovec - j);
         else {
                 struct msghdr mh = {
-                        .msg_iov = iov,
-                        .msg_iovlen = m->n_iovec,
+                        .msg_iov = iov + j,
+                        .msg_iovlen = n_iovec - j,
                 };
 
-                if (m->n_fds > 0 && *idx == 0) {
+                if ((m->n_fds > 0 || m->body_memfd >= 0) && *idx == 0) {
                         struct cmsghdr *control;
+                        size_t n_fds;
 
-                        mh.msg_control = control = alloca(CMSG_SPACE(sizeof(int) * m->n_fds));
-                        mh.msg_controllen = control->cmsg_len = CMSG_LEN(sizeof(int) * m->n_fds);
+                        /* The memfd with the body, if there is one, goes last */
+                        n_fds = m->n_fds + (m->body_memfd >= 0);
+
+                        mh.msg_control = control = alloca(CMSG_SPACE(sizeof(int) * n_fds));
+                        mh.msg_controllen = control->cmsg_len = CMSG_LEN(sizeof(int) * n_fds);
                         control->cmsg_level = SOL_SOCKET;
                         control->cmsg_type = SCM_RIGHTS;
-                        memcpy(CMSG_DATA(control), m->fds, sizeof(int) * m->n_fds);
+                        memcpy_safe(CMSG_DATA(control), m->fds, sizeof(int) * m->n_fds);
+                        if (m->body_memfd >= 0)
+                                ((int*) CMSG_DATA(control))[m->n_fds] = m->body_memfd;
                 }
 
                 k = sendmsg(bus->output_fd, &mh, MSG_DONTWAIT|MSG_NOSIGNAL);
                 if (k < 0 && errno == ENOTSOCK) {
                         bus->prefer_writev = true;
-                        k = writev(bus->output_fd, iov, m->n_iovec);
+                        k = writev(bus->output_fd, iov + j, n_iovec - j);
                 }
         }
 
@@ -1018,7 +1132,7 @@ int bus_socket_write_message(sd_bus *bus, sd_bus_message *m, size_t *idx) {
 
 static int bus_socket_read_message_need(sd_bus *bus, size_t *need) {
         uint32_t a, b;
-        uint8_t e;
+        uint8_t e, f;
         uint64_t sum;
 
         assert(bus);
@@ -1060,6 +1174,15 @@ static int bus_socket_read_message_need(sd_bus *bus, size_t *need) {
         } else
                 return -EBADMSG;
 
+        /* A body passed in a memfd doesn't follow inline */
+        f = ((const uint8_t*) bus->rbuffer)[2];
+        if (f & BUS_MESSAGE_BODY_MEMFD) {
+                if (!bus->can_memfd)
+                        return -EBADMSG;
+
+                a = 0;
+        }
+
         sum = (uint64_t) sizeof(struct bus_header) + (uint64_t) ALIGN_TO(b, 8) + (uint64_t) a;
         if (sum >= BUS_MESSAGE_SIZE_MAX)
                 return -ENOBUFS;
@@ -1105,6 +1228,8 @@ static int bus_socket_make_message(sd_bus *bus, size_t size) {
         bus->fds = NULL;
         bus->n_fds = 0;
 
+        USDT_PROBE(sd_bus, message_receive, bus, t->header->type, BUS_MESSAGE_COOKIE(t), t->path, t->interface, t->member);
+
         bus->rqueue[bus->rqueue_size++] = t;
 
         return 1;
@@ -10,7 +10,10 @@
 struct track_item {
         unsigned n_ref;
         char *name;
-        sd_bus_slot *slot;
+        sd_bus_track *track;
+
+        /* All items of the connection's track objects with the same name */
+        LIST_FIELDS(struct track_item, by_name);
 };
 
 struct sd_bus_track {
@@ -31,20 +34,81 @@ struct sd_bus_track {
         LIST_FIELDS(sd_bus_track, tracks);
 };
 
-#define MATCH_FOR_NAME(name)                            \
-        strjoina("type='signal',"                       \
-                 "sender='org.freedesktop.DBus',"       \
-                 "path='/org/freedesktop/DBus',"        \
-                 "interface='org.freedesktop.DBus',"    \
-                 "member='NameOwnerChanged',"           \
-                 "arg0='", name, "'")
+/* All track objects of a connection share a single subscription to NameOwnerChanged, and the signals are
+ * dispatched to the track objects locally, so that tracking a name doesn't cost a match on the broker. */
+#define MATCH_NAME_OWNER_CHANGED                        \
+        "type='signal',"                                \
+        "sender='org.freedesktop.DBus',"                \
+        "path='/org/freedesktop/DBus',"                 \
+        "interface='org.freedesktop.DBus',"             \
+        "member='NameOwnerChanged'"
+
+static void track_item_unlink(struct track_item *i) {
+        struct track_item *head;
+        sd_bus *bus;
+
+        assert(i);
+
+        if (!i->track)
+                return;
+
+        bus = i->track->bus;
+
+        head = hashmap_get(bus->track_names, i->name);
+        assert(head);
+
+        LIST_REMOVE(by_name, head, i);
+
+        /* The key is owned by the first item, hence rekey if that's the one we removed */
+        if (!head)
+                assert_se(hashmap_remove(bus->track_names, i->name));
+        else if (hashmap_get(bus->track_names, i->name) != head) {
+                assert_se(hashmap_remove(bus->track_names, i->name));
+                assert_se(hashmap_put(bus->track_names, head->name, head) >= 0);
+        }
+
+        i->track = NULL;
+
+        /* Nothing is tracked anymore, drop the subscription */
+        if (hashmap_isempty(bus->track_names))
+                bus->track_slot = sd_bus_slot_unref(bus->track_slot);
+}
+
+static int track_item_link(struct track_item *i, sd_bus_track *track) {
+        struct track_item *head;
+        sd_bus *bus;
+        int r;
+
+        assert(i);
+        assert(!i->track);
+        assert(track);
+
+        bus = track->bus;
+
+        r = hashmap_ensure_allocated(&bus->track_names, &string_hash_ops);
+        if (r < 0)
+                return r;
+
+        head = hashmap_get(bus->track_names, i->name);
+        if (head) {
+                /* Insert after the first item, so that the key stays valid */
+                LIST_INSERT_AFTER(by_name, head, head, i);
+        } else {
+                r = hashmap_put(bus->track_names, i->name, i);
+                if (r < 0)
+                        return r;
+        }
+
+        i->track = track;
+        return 0;
+}
 
 static struct track_item* track_item_free(struct track_item *i) {
 
         if (!i)
                 return NULL;
 
-        sd_bus_slot_unref(i->slot);
+        track_item_unlink(i);
         free(i->name);
         return mfree(i);
 }
@@ -164,25 +228,31 @@ static sd_bus_track *track_free(sd_bus_track *track) {
 DEFINE_PUBLIC_TRIVIAL_REF_UNREF_FUNC(sd_bus_track, sd_bus_track, track_free);
 
 static int on_name_owner_changed(sd_bus_message *message, void *userdata, sd_bus_error *error) {
-        sd_bus_track *track = userdata;
+        sd_bus *bus = userdata;
         const char *name, *old, *new;
+        struct track_item *i;
         int r;
 
         assert(message);
-        assert(track);
+        assert(bus);
 
         r = sd_bus_message_read(message, "sss", &name, &old, &new);
         if (r < 0)
                 return 0;
 
-        bus_track_remove_name_fully(track, name);
+        /* Removing the name from each track object frees its item, and possibly the name we read, hence copy it */
+        name = strdupa(name);
+
+        while ((i = hashmap_get(bus->track_names, name)))
+                bus_track_remove_name_fully(i->track, name);
+
         return 0;
 }
 
 _public_ int sd_bus_track_add_name(sd_bus_track *track, const char *name) {
         _cleanup_(track_item_freep) struct track_item *n = NULL;
         struct track_item *i;
-        const char *match;
+        bool known;
         int r;
 
         assert_return(track, -EINVAL);
@@ -214,12 +284,22 @@ _public_ int sd_bus_track_add_name(sd_bus_track *track, const char *name) {
         if (!n->name)
                 return -ENOMEM;
 
-        /* First, subscribe to this name */
-        match = MATCH_FOR_NAME(name);
+        /* If another track object already watches this name, it is known to exist, as we'd have seen it go away
+         * otherwise */
+        known = hashmap_contains(track->bus->track_names, name);
 
+        /* First, subscribe to name changes, unless we already are */
         bus_track_remove_from_queue(track); /* don't dispatch this while we work in it */
 
-        r = sd_bus_add_match_async(track->bus, &n->slot, match, on_name_owner_changed, NULL, track);
+        if (!track->bus->track_slot) {
+                r = sd_bus_add_match_async(track->bus, &track->bus->track_slot, MATCH_NAME_OWNER_CHANGED, on_name_owner_changed, NULL, track->bus);
+                if (r < 0) {
+                        bus_track_add_to_queue(track);
+                        return r;
+                }
+        }
+
+        r = track_item_link(n, track);
         if (r < 0) {
                 bus_track_add_to_queue(track);
                 return r;
@@ -232,13 +312,15 @@ _public_ int sd_bus_track_add_name(sd_bus_track *track, const char *name) {
         }
 
         /* Second, check if it is currently existing, or maybe doesn't, or maybe disappeared already. */
-        track->n_adding++; /* again, make sure this isn't dispatch while we are working in it */
-        r = sd_bus_get_name_creds(track->bus, name, 0, NULL);
-        track->n_adding--;
-        if (r < 0) {
-                hashmap_remove(track->names, name);
-                bus_track_add_to_queue(track);
-                return r;
+        if (!known) {
+                track->n_adding++; /* again, make sure this isn't dispatch while we are working in it */
+                r = sd_bus_get_name_creds(track->bus, name, 0, NULL);
+                track->n_adding--;
+                if (r < 0) {
+                        hashmap_remove(track->names, name);
+                        bus_track_add_to_queue(track);
+                        return r;
+                }
         }
 
         n->n_ref = 1;
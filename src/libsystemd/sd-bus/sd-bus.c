@@ -15,11 +15,13 @@
 #include "alloc-util.h"
 #include "bus-container.h"
 #include "bus-control.h"
+#include "bus-creds.h"
 #include "bus-internal.h"
 #include "bus-kernel.h"
 #include "bus-label.h"
 #include "bus-message.h"
 #include "bus-objects.h"
+#include "bus-offload.h"
 #include "bus-protocol.h"
 #include "bus-slot.h"
 #include "bus-socket.h"
@@ -37,6 +39,7 @@
 #include "process-util.h"
 #include "string-util.h"
 #include "strv.h"
+#include "usdt.h"
 #include "util.h"
 
 #define log_debug_bus_message(m)                                         \
@@ -164,10 +167,13 @@ static sd_bus* bus_free(sd_bus *b) {
         assert(b);
         assert(!b->track_queue);
         assert(!b->tracks);
+        assert(hashmap_isempty(b->track_names));
+        assert(!b->track_slot);
 
         b->state = BUS_CLOSED;
 
         sd_bus_detach_event(b);
+        bus_offload_release(b);
 
         while ((s = b->slots)) {
                 /* At this point only floating slots can still be
@@ -181,6 +187,8 @@ static sd_bus* bus_free(sd_bus *b) {
                 bus_slot_disconnect(s, true);
         }
 
+        hashmap_free(b->track_names);
+
         if (b->default_bus_ptr)
                 *b->default_bus_ptr = NULL;
 
@@ -211,21 +219,35 @@ static sd_bus* bus_free(sd_bus *b) {
         assert(b->match_callbacks.type == BUS_MATCH_ROOT);
         bus_match_free(&b->match_callbacks);
 
-        hashmap_free_free(b->vtable_methods);
-        hashmap_free_free(b->vtable_properties);
-
         assert(hashmap_isempty(b->nodes));
         hashmap_free(b->nodes);
 
+        bus_creds_cache_flush(b);
+        hashmap_free(b->creds_cache);
+
         bus_flush_memfd(b);
+        bus_message_cache_flush(b);
 
         assert_se(pthread_mutex_destroy(&b->memfd_cache_mutex) == 0);
+        assert_se(pthread_mutex_destroy(&b->message_cache_mutex) == 0);
+        assert_se(pthread_mutex_destroy(&b->creds_cache_mutex) == 0);
 
         return mfree(b);
 }
 
 DEFINE_TRIVIAL_CLEANUP_FUNC(sd_bus*, bus_free);
 
+void bus_trim_caches(sd_bus *bus) {
+        if (!bus)
+                return;
+
+        /* Drops everything that is kept around only to speed up later messages or credential lookups, and
+         * is recreated on demand. */
+
+        bus_message_cache_flush(bus);
+        bus_creds_cache_flush(bus);
+}
+
 _public_ int sd_bus_new(sd_bus **ret) {
         _cleanup_free_ sd_bus *b = NULL;
 
@@ -249,6 +271,8 @@ _public_ int sd_bus_new(sd_bus **ret) {
         };
 
         assert_se(pthread_mutex_init(&b->memfd_cache_mutex, NULL) == 0);
+        assert_se(pthread_mutex_init(&b->message_cache_mutex, NULL) == 0);
+        assert_se(pthread_mutex_init(&b->creds_cache_mutex, NULL) == 0);
 
         /* We guarantee that wqueue always has space for at least one entry */
         if (!GREEDY_REALLOC(b->wqueue, b->wqueue_allocated, 1))
@@ -334,6 +358,16 @@ _public_ int sd_bus_negotiate_fds(sd_bus *bus, int b) {
         return 0;
 }
 
+_public_ int sd_bus_negotiate_memfd(sd_bus *bus, int b) {
+        assert_return(bus, -EINVAL);
+        assert_return(bus = bus_resolve(bus), -ENOPKG);
+        assert_return(bus->state == BUS_UNSET, -EPERM);
+        assert_return(!bus_pid_changed(bus), -ECHILD);
+
+        bus->accept_memfd = !!b;
+        return 0;
+}
+
 _public_ int sd_bus_negotiate_timestamp(sd_bus *bus, int b) {
         assert_return(bus, -EINVAL);
         assert_return(bus = bus_resolve(bus), -ENOPKG);
@@ -1548,6 +1582,10 @@ _public_ void sd_bus_close(sd_bus *bus) {
 
         sd_bus_detach_event(bus);
 
+        /* Wait for offloaded method handlers, and drop the jobs that
+         * reference the bus object, too */
+        bus_offload_close(bus);
+
         /* Drop all queued messages so that they drop references to
          * the bus object and the bus may be freed */
         bus_reset_queues(bus);
@@ -1706,29 +1744,45 @@ int bus_seal_synthetic_message(sd_bus *b, sd_bus_message *m) {
         return sd_bus_message_seal(m, 0xFFFFFFFFULL, 0);
 }
 
-static int bus_write_message(sd_bus *bus, sd_bus_message *m, size_t *idx) {
+static void bus_log_sent_message(sd_bus_message *m) {
+        assert(m);
+
+        log_debug("Sent message type=%s sender=%s destination=%s path=%s interface=%s member=%s cookie=%" PRIu64 " reply_cookie=%" PRIu64 " signature=%s error-name=%s error-message=%s",
+                  bus_message_type_to_string(m->header->type),
+                  strna(sd_bus_message_get_sender(m)),
+                  strna(sd_bus_message_get_destination(m)),
+                  strna(sd_bus_message_get_path(m)),
+                  strna(sd_bus_message_get_interface(m)),
+                  strna(sd_bus_message_get_member(m)),
+                  BUS_MESSAGE_COOKIE(m),
+                  m->reply_cookie,
+                  strna(m->root_container.signature),
+                  strna(m->error.name),
+                  strna(m->error.message));
+}
+
+static int bus_write_messages(sd_bus *bus, sd_bus_message **messages, size_t n_messages, size_t *idx) {
+        size_t i, before, end = 0;
         int r;
 
         assert(bus);
-        assert(m);
+        assert(messages);
+        assert(idx);
+
+        before = *idx;
 
-        r = bus_socket_write_message(bus, m, idx);
+        r = bus_socket_write_messages(bus, messages, n_messages, idx);
         if (r <= 0)
                 return r;
 
-        if (*idx >= BUS_MESSAGE_SIZE(m))
-                log_debug("Sent message type=%s sender=%s destination=%s path=%s interface=%s member=%s cookie=%" PRIu64 " reply_cookie=%" PRIu64 " signature=%s error-name=%s error-message=%s",
-                          bus_message_type_to_string(m->header->type),
-                          strna(sd_bus_message_get_sender(m)),
-                          strna(sd_bus_message_get_destination(m)),
-                          strna(sd_bus_message_get_path(m)),
-                          strna(sd_bus_message_get_interface(m)),
-                          strna(sd_bus_message_get_member(m)),
-                          BUS_MESSAGE_COOKIE(m),
-                          m->reply_cookie,
-                          strna(m->root_container.signature),
-                          strna(m->error.name),
-                          strna(m->error.message));
+        /* Log all messages this write completed */
+        for (i = 0; i < n_messages; i++) {
+                end += BUS_MESSAGE_WIRE_SIZE(messages[i]);
+                if (end > *idx)
+                        break;
+                if (end > before)
+                        bus_log_sent_message(messages[i]);
+        }
 
         return r;
 }
@@ -1740,28 +1794,26 @@ static int dispatch_wqueue(sd_bus *bus) {
         assert(IN_SET(bus->state, BUS_RUNNING, BUS_HELLO));
 
         while (bus->wqueue_size > 0) {
+                size_t n = 0;
 
-                r = bus_write_message(bus, bus->wqueue[0], &bus->windex);
+                r = bus_write_messages(bus, bus->wqueue, bus->wqueue_size, &bus->windex);
                 if (r < 0)
                         return r;
                 else if (r == 0)
                         /* Didn't do anything this time */
                         return ret;
-                else if (bus->windex >= BUS_MESSAGE_SIZE(bus->wqueue[0])) {
-                        /* Fully written. Let's drop the entry from
-                         * the queue.
-                         *
-                         * This isn't particularly optimized, but
-                         * well, this is supposed to be our worst-case
-                         * buffer only, and the socket buffer is
-                         * supposed to be our primary buffer, and if
-                         * it got full, then all bets are off
-                         * anyway. */
-
-                        bus->wqueue_size--;
-                        sd_bus_message_unref(bus->wqueue[0]);
-                        memmove(bus->wqueue, bus->wqueue + 1, sizeof(sd_bus_message*) * bus->wqueue_size);
-                        bus->windex = 0;
+
+                /* Drop all entries that are fully written now from
+                 * the queue. */
+                while (n < bus->wqueue_size && bus->windex >= BUS_MESSAGE_WIRE_SIZE(bus->wqueue[n])) {
+                        bus->windex -= BUS_MESSAGE_WIRE_SIZE(bus->wqueue[n]);
+                        sd_bus_message_unref(bus->wqueue[n]);
+                        n++;
+                }
+
+                if (n > 0) {
+                        bus->wqueue_size -= n;
+                        memmove(bus->wqueue, bus->wqueue + n, sizeof(sd_bus_message*) * bus->wqueue_size);
 
                         ret = 1;
                 }
@@ -1831,6 +1883,10 @@ _public_ int sd_bus_send(sd_bus *bus, sd_bus_message *_m, uint64_t *cookie) {
 
         assert_return(!bus_pid_changed(bus), -ECHILD);
 
+        /* Offloaded method handlers can't send anything themselves, the bus thread does it for them */
+        if (bus_offload_running(bus))
+                return bus_offload_send(bus, m, cookie);
+
         if (!BUS_IS_OPEN(bus->state))
                 return -ENOTCONN;
 
@@ -1862,10 +1918,12 @@ _public_ int sd_bus_send(sd_bus *bus, sd_bus_message *_m, uint64_t *cookie) {
         if (m->dont_send)
                 goto finish;
 
+        USDT_PROBE(sd_bus, message_send, bus, m->header->type, BUS_MESSAGE_COOKIE(m), m->path, m->interface, m->member);
+
         if (IN_SET(bus->state, BUS_RUNNING, BUS_HELLO) && bus->wqueue_size <= 0) {
                 size_t idx = 0;
 
-                r = bus_write_message(bus, m, &idx);
+                r = bus_write_messages(bus, &m, 1, &idx);
                 if (r < 0) {
                         if (IN_SET(r, -ENOTCONN, -ECONNRESET, -EPIPE, -ESHUTDOWN)) {
                                 bus_enter_closing(bus);
@@ -1875,7 +1933,7 @@ _public_ int sd_bus_send(sd_bus *bus, sd_bus_message *_m, uint64_t *cookie) {
                         return r;
                 }
 
-                if (idx < BUS_MESSAGE_SIZE(m))  {
+                if (idx < BUS_MESSAGE_WIRE_SIZE(m))  {
                         /* Wasn't fully written. So let's remember how
                          * much was written. Note that the first entry
                          * of the wqueue array is always allocated so
@@ -1980,6 +2038,10 @@ _public_ int sd_bus_call_async(
 
         assert_return(!bus_pid_changed(bus), -ECHILD);
 
+        /* The reply callback would have to be dispatched on the bus thread, which offloaded handlers don't run on */
+        if (bus_offload_running(bus))
+                return -EDEADLK;
+
         if (!BUS_IS_OPEN(bus->state))
                 return -ENOTCONN;
 
@@ -2086,6 +2148,9 @@ _public_ int sd_bus_call(
 
         bus_assert_return(!bus_pid_changed(bus), -ECHILD, error);
 
+        if (bus_offload_running(bus))
+                return bus_offload_call(bus, m, usec, error, reply);
+
         if (!BUS_IS_OPEN(bus->state)) {
                 r = -ENOTCONN;
                 goto fail;
@@ -2667,6 +2732,8 @@ static int process_message(sd_bus *bus, sd_bus_message *m) {
         bus->current_message = m;
         bus->iteration_counter++;
 
+        USDT_PROBE(sd_bus, message_dispatch, bus, m->header->type, BUS_MESSAGE_COOKIE(m), m->path, m->interface, m->member);
+
         log_debug_bus_message(m);
 
         r = process_hello(bus, m);
@@ -2696,6 +2763,8 @@ static int process_message(sd_bus *bus, sd_bus_message *m) {
         r = bus_process_object(bus, m);
 
 finish:
+        USDT_PROBE(sd_bus, message_dispatched, bus, BUS_MESSAGE_COOKIE(m), r);
+
         bus->current_message = NULL;
         return r;
 }
@@ -3575,6 +3644,10 @@ _public_ int sd_bus_attach_event(sd_bus *bus, sd_event *event, int priority) {
         if (r < 0)
                 goto fail;
 
+        r = bus_offload_attach_event(bus);
+        if (r < 0)
+                goto fail;
+
         return 0;
 
 fail:
@@ -3591,6 +3664,7 @@ _public_ int sd_bus_detach_event(sd_bus *bus) {
 
         bus_detach_io_events(bus);
         bus_detach_inotify_event(bus);
+        bus_offload_detach_event(bus);
 
         if (bus->time_event_source) {
                 sd_event_source_set_enabled(bus->time_event_source, SD_EVENT_OFF);
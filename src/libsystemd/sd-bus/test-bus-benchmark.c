@@ -10,6 +10,8 @@
 #include "bus-util.h"
 #include "def.h"
 #include "fd-util.h"
+#include "stdio-util.h"
+#include "tests.h"
 #include "time-util.h"
 #include "util.h"
 
@@ -145,6 +147,21 @@ static void client_bisect(const char *address, const char *server_name) {
         sd_bus_unref(b);
 }
 
+typedef struct Transactions {
+        sd_bus *bus;
+        const char *server_name;
+        size_t size;
+        unsigned n;
+} Transactions;
+
+static void transactions(void *userdata) {
+        Transactions *t = userdata;
+        unsigned i;
+
+        for (i = 0; i < t->n; i++)
+                transaction(t->bus, t->size, t->server_name);
+}
+
 static void client_chart(Type type, const char *address, const char *server_name, int fd) {
         _cleanup_(sd_bus_message_unrefp) sd_bus_message *x = NULL;
         size_t csize;
@@ -171,29 +188,18 @@ static void client_chart(Type type, const char *address, const char *server_name
         r = sd_bus_call_method(b, server_name, "/", "benchmark.server", "Ping", NULL, NULL, NULL);
         assert_se(r >= 0);
 
-        switch (type) {
-        case TYPE_LEGACY:
-                printf("SIZE\tLEGACY\n");
-                break;
-        case TYPE_DIRECT:
-                printf("SIZE\tDIRECT\n");
-                break;
-        }
-
         for (csize = 1; csize <= MAX_SIZE; csize *= 2) {
-                usec_t t;
-                unsigned n_memfd;
-
-                printf("%zu\t", csize);
-
-                t = now(CLOCK_MONOTONIC);
-                for (n_memfd = 0;; n_memfd++) {
-                        transaction(b, csize, server_name);
-                        if (now(CLOCK_MONOTONIC) >= t + arg_loop_usec)
-                                break;
-                }
-
-                printf("%u\n", (unsigned) ((n_memfd * USEC_PER_SEC) / arg_loop_usec));
+                Transactions t = {
+                        .bus = b,
+                        .server_name = server_name,
+                        .size = csize,
+                        /* Move about 64M per run, but do at least a few calls for the larger sizes */
+                        .n = CLAMP((64U << 20) / csize, 16U, 4096U),
+                };
+                char name[STRLEN("bus-direct-") + DECIMAL_STR_MAX(size_t)];
+
+                xsprintf(name, "bus-%s-%zu", type == TYPE_DIRECT ? "direct" : "legacy", csize);
+                benchmark_run(name, t.n, transactions, &t);
         }
 
         b->use_memfd = 1;
@@ -65,6 +65,39 @@ static void test_bus_new_signal(void) {
         printf("after bus_flush_close_unref: refcount %u\n", m->n_ref);
 }
 
+static void test_bus_message_cache(void) {
+        _cleanup_(sd_bus_flush_close_unrefp) sd_bus *bus = NULL;
+        sd_bus_message *m, *n;
+        uint64_t requested, reused;
+        unsigned i;
+
+        assert_se(use_system_bus ? sd_bus_open_system(&bus) >= 0 : sd_bus_open_user(&bus) >= 0);
+
+        requested = bus->message_cache.n_messages_requested;
+        reused = bus->message_cache.n_messages_reused;
+
+        for (i = 0; i < 3; i++) {
+                assert_se(sd_bus_message_new_signal(bus, &m, "/an/object/path", "an.interface.name", "Name") >= 0);
+                assert_se(sd_bus_message_append(m, "sa(su)", "foo", 2, "bar", 1, "waldo", 2) >= 0);
+                assert_se(sd_bus_message_append_array(m, 'y', "xxx", 3) >= 0);
+                assert_se(sd_bus_message_seal(m, 1, 0) >= 0);
+
+                n = m;
+                m = sd_bus_message_unref(m);
+
+                /* The message object we just freed is the first one to be handed out again */
+                assert_se(sd_bus_message_new_signal(bus, &m, "/an/object/path", "an.interface.name", "Name") >= 0);
+                assert_se(m == n);
+                m = sd_bus_message_unref(m);
+        }
+
+        bus_message_cache_dump(bus, stdout, "");
+
+        assert_se(bus->message_cache.n_messages_requested == requested + 6);
+        assert_se(bus->message_cache.n_messages_reused >= reused + 5);
+        assert_se(bus->message_cache.n_buffers_reused > 0);
+}
+
 int main(int argc, char **argv) {
         test_setup_logging(LOG_INFO);
 
@@ -75,6 +108,7 @@ int main(int argc, char **argv) {
 
         test_bus_new_method_call();
         test_bus_new_signal();
+        test_bus_message_cache();
 
         return EXIT_SUCCESS;
 }
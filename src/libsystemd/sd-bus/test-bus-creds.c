@@ -1,12 +1,156 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 
+#include <pthread.h>
+#include <signal.h>
+#include <sys/prctl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
 #include "sd-bus.h"
 
+#include "bus-creds.h"
 #include "bus-dump.h"
+#include "bus-internal.h"
 #include "bus-util.h"
 #include "cgroup-util.h"
+#include "process-util.h"
 #include "tests.h"
 
+#define N_THREADS 8U
+#define N_LOOKUPS 500U
+
+typedef struct LookupArgs {
+        sd_bus *bus;
+        pid_t pid;
+        unsigned id;
+} LookupArgs;
+
+static pid_t fork_renamed(void) {
+        pid_t pid;
+
+        pid = fork();
+        assert_se(pid >= 0);
+        if (pid == 0) {
+                (void) prctl(PR_SET_PDEATHSIG, SIGKILL);
+                (void) rename_process("creds-test");
+                pause();
+                _exit(EXIT_SUCCESS);
+        }
+
+        /* Wait until the child renamed itself */
+        for (;;) {
+                _cleanup_free_ char *name = NULL;
+
+                assert_se(get_process_comm(pid, &name) >= 0);
+                if (streq(name, "creds-test"))
+                        break;
+
+                usleep(10 * USEC_PER_MSEC);
+        }
+
+        return pid;
+}
+
+static void *lookup_thread(void *p) {
+        LookupArgs *args = p;
+        unsigned i;
+
+        for (i = 0; i < N_LOOKUPS; i++) {
+                _cleanup_(sd_bus_creds_unrefp) sd_bus_creds *c = NULL;
+                const char *comm;
+
+                assert_se(c = bus_creds_new());
+                assert_se(bus_creds_augment(args->bus, c, SD_BUS_CREDS_AUGMENT|SD_BUS_CREDS_COMM|SD_BUS_CREDS_EUID, args->pid, 0) >= 0);
+                assert_se(sd_bus_creds_get_comm(c, &comm) >= 0);
+                assert_se(streq(comm, "creds-test"));
+
+                /* Also empty the cache now and then, like bus_trim_caches() does */
+                if ((i + args->id) % 97 == 0)
+                        bus_creds_cache_flush(args->bus);
+        }
+
+        return NULL;
+}
+
+static void test_creds_cache_threads(void) {
+        _cleanup_(sd_bus_flush_close_unrefp) sd_bus *bus = NULL;
+        LookupArgs args[N_THREADS];
+        pthread_t t[N_THREADS];
+        pid_t pid;
+        unsigned i;
+
+        log_info("/* %s */", __func__);
+
+        assert_se(sd_bus_new(&bus) >= 0);
+        pid = fork_renamed();
+
+        /* Offloaded method handlers look up credentials on worker threads, all of them going through the same
+         * cache */
+        for (i = 0; i < N_THREADS; i++) {
+                args[i] = (LookupArgs) {
+                        .bus = bus,
+                        .pid = pid,
+                        .id = i,
+                };
+                assert_se(pthread_create(&t[i], NULL, lookup_thread, &args[i]) == 0);
+        }
+
+        for (i = 0; i < N_THREADS; i++)
+                assert_se(pthread_join(t[i], NULL) == 0);
+
+        assert_se(hashmap_size(bus->creds_cache) <= 1);
+
+        assert_se(kill(pid, SIGKILL) >= 0);
+        assert_se(wait_for_terminate(pid, NULL) >= 0);
+}
+
+static void test_creds_cache(void) {
+        _cleanup_(sd_bus_creds_unrefp) sd_bus_creds *a = NULL, *b = NULL, *c = NULL;
+        _cleanup_(sd_bus_flush_close_unrefp) sd_bus *bus = NULL;
+        const char *comm;
+        uint64_t mask = SD_BUS_CREDS_AUGMENT|SD_BUS_CREDS_COMM|SD_BUS_CREDS_EUID|SD_BUS_CREDS_CGROUP;
+        pid_t pid;
+        int r;
+
+        log_info("/* %s */", __func__);
+
+        assert_se(sd_bus_new(&bus) >= 0);
+        pid = fork_renamed();
+
+        assert_se(a = bus_creds_new());
+        assert_se(bus_creds_augment(bus, a, mask, pid, 0) >= 0);
+        assert_se(sd_bus_creds_get_comm(a, &comm) >= 0);
+        assert_se(streq(comm, "creds-test"));
+        assert_se((sd_bus_creds_get_augmented_mask(a) & (SD_BUS_CREDS_COMM|SD_BUS_CREDS_EUID)) == (SD_BUS_CREDS_COMM|SD_BUS_CREDS_EUID));
+
+        if (hashmap_isempty(bus->creds_cache)) {
+                log_info("pidfds not supported, not testing the cache.");
+                assert_se(kill(pid, SIGKILL) >= 0);
+                assert_se(wait_for_terminate(pid, NULL) >= 0);
+                return;
+        }
+
+        assert_se(hashmap_size(bus->creds_cache) == 1);
+
+        /* The second time the data comes from the cache */
+        assert_se(b = bus_creds_new());
+        assert_se(bus_creds_augment(bus, b, mask|SD_BUS_CREDS_PPID, pid, 0) >= 0);
+        assert_se(sd_bus_creds_get_comm(b, &comm) >= 0);
+        assert_se(streq(comm, "creds-test"));
+        assert_se(sd_bus_creds_get_augmented_mask(b) & SD_BUS_CREDS_COMM);
+        assert_se(b->mask & SD_BUS_CREDS_PPID);
+        assert_se(hashmap_size(bus->creds_cache) == 1);
+
+        /* Once the process is gone, its entry must not be used anymore */
+        assert_se(kill(pid, SIGKILL) >= 0);
+        assert_se(wait_for_terminate(pid, NULL) >= 0);
+
+        assert_se(c = bus_creds_new());
+        r = bus_creds_augment(bus, c, mask, pid, 0);
+        assert_se(r == -ESRCH);
+        assert_se(hashmap_isempty(bus->creds_cache));
+}
+
 int main(int argc, char *argv[]) {
         _cleanup_(sd_bus_creds_unrefp) sd_bus_creds *creds = NULL;
         int r;
@@ -31,5 +175,8 @@ int main(int argc, char *argv[]) {
                 bus_creds_dump(creds, NULL, true);
         }
 
+        test_creds_cache();
+        test_creds_cache_threads();
+
         return 0;
 }
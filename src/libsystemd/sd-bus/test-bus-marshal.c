@@ -104,6 +104,55 @@ static void test_bus_label_escape(void) {
         test_bus_label_escape_one(":1", "_3a1");
 }
 
+static void test_container_signature_cache(sd_bus *bus) {
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
+        const char *s;
+        uint32_t u, i;
+
+        /* Opening the same container repeatedly reuses its validated signature, make sure that different and
+         * invalid ones are still recognized as such */
+
+        assert_se(sd_bus_message_new_method_call(bus, &m, "foobar.waldo", "/", "foobar.waldo", "Piep") >= 0);
+
+        assert_se(sd_bus_message_open_container(m, 'a', "(su)") >= 0);
+        for (i = 0; i < 100; i++) {
+                assert_se(sd_bus_message_open_container(m, 'r', "su") >= 0);
+                assert_se(sd_bus_message_append(m, "su", "element", i) >= 0);
+                assert_se(sd_bus_message_close_container(m) >= 0);
+
+                assert_se(sd_bus_message_open_container(m, 'r', "s(") == -EINVAL);
+                assert_se(sd_bus_message_open_container(m, 'r', "us") == -ENXIO);
+                assert_se(sd_bus_message_append(m, "(su)", "element", i + 100) >= 0);
+        }
+        assert_se(sd_bus_message_close_container(m) >= 0);
+
+        assert_se(sd_bus_message_open_container(m, 'a', "(su)") >= 0);
+        assert_se(sd_bus_message_close_container(m) >= 0);
+        assert_se(sd_bus_message_open_container(m, 'v', "(su)") >= 0);
+        assert_se(sd_bus_message_append(m, "(su)", "variant", 4711) >= 0);
+        assert_se(sd_bus_message_close_container(m) >= 0);
+
+        assert_se(sd_bus_message_seal(m, 4713, 0) >= 0);
+
+        assert_se(sd_bus_message_enter_container(m, 'a', "(su)") > 0);
+        for (i = 0; i < 200; i++) {
+                assert_se(sd_bus_message_enter_container(m, 'r', "s(") == -EINVAL);
+                assert_se(sd_bus_message_enter_container(m, 'r', "su") > 0);
+                assert_se(sd_bus_message_read(m, "su", &s, &u) > 0);
+                assert_se(streq(s, "element"));
+                assert_se(u == (i % 2 == 0 ? i / 2 : i / 2 + 100));
+                assert_se(sd_bus_message_exit_container(m) > 0);
+        }
+        assert_se(sd_bus_message_enter_container(m, 'r', "su") == 0);
+        assert_se(sd_bus_message_exit_container(m) > 0);
+
+        assert_se(sd_bus_message_read(m, "a(su)", 0) > 0);
+        assert_se(sd_bus_message_enter_container(m, 'v', "(us)") == -ENXIO);
+        assert_se(sd_bus_message_read(m, "v", "(su)", &s, &u) > 0);
+        assert_se(streq(s, "variant"));
+        assert_se(u == 4711);
+}
+
 int main(int argc, char *argv[]) {
         _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL, *copy = NULL;
         int r, boolean;
@@ -415,6 +464,7 @@ int main(int argc, char *argv[]) {
         test_bus_path_encode();
         test_bus_path_encode_unique();
         test_bus_path_encode_many();
+        test_container_signature_cache(bus);
 
         return 0;
 }
@@ -1,12 +1,16 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 
+#include "alloc-util.h"
 #include "bus-match.h"
 #include "bus-message.h"
 #include "bus-slot.h"
 #include "bus-util.h"
 #include "log.h"
 #include "macro.h"
+#include "stdio-util.h"
+#include "string-util.h"
 #include "tests.h"
+#include "time-util.h"
 
 static bool mask[32];
 
@@ -58,6 +62,74 @@ static int match_add(sd_bus_slot *slots, struct bus_match_node *root, const char
         return r;
 }
 
+static unsigned n_benchmark_calls = 0;
+
+static int benchmark_filter(sd_bus_message *m, void *userdata, sd_bus_error *ret_error) {
+        n_benchmark_calls++;
+        return 0;
+}
+
+#define N_BENCHMARK_RULES 10000U
+#define N_BENCHMARK_MESSAGES 1000U
+
+static void test_match_benchmark(sd_bus *bus) {
+        _cleanup_free_ sd_bus_slot *slots = NULL;
+        struct bus_match_node root = {
+                .type = BUS_MATCH_ROOT,
+        };
+        char buf[FORMAT_TIMESPAN_MAX];
+        usec_t t;
+        unsigned i;
+
+        /* Rules like those of clients tracking many objects: one for each object path, and one for everything below
+         * it. Messages only match the few that concern them, independently of how many rules there are. */
+
+        assert_se(slots = new0(sd_bus_slot, 2 * N_BENCHMARK_RULES));
+
+        for (i = 0; i < N_BENCHMARK_RULES; i++) {
+                struct bus_match_component *components = NULL;
+                unsigned n_components = 0;
+                char match[STRLEN("type='signal',path_namespace='/org/freedesktop/test/'") + DECIMAL_STR_MAX(unsigned)];
+
+                xsprintf(match, "type='signal',path='/org/freedesktop/test/%u'", i);
+                assert_se(bus_match_parse(match, &components, &n_components) >= 0);
+                slots[2*i].match_callback.callback = benchmark_filter;
+                assert_se(bus_match_add(&root, components, n_components, &slots[2*i].match_callback) >= 0);
+                bus_match_parse_free(components, n_components);
+
+                xsprintf(match, "type='signal',path_namespace='/org/freedesktop/test/%u'", i);
+                assert_se(bus_match_parse(match, &components, &n_components) >= 0);
+                slots[2*i+1].match_callback.callback = benchmark_filter;
+                assert_se(bus_match_add(&root, components, n_components, &slots[2*i+1].match_callback) >= 0);
+                bus_match_parse_free(components, n_components);
+        }
+
+        t = now(CLOCK_MONOTONIC);
+
+        for (i = 0; i < N_BENCHMARK_MESSAGES; i++) {
+                _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
+                char path[STRLEN("/org/freedesktop/test//sub") + DECIMAL_STR_MAX(unsigned)];
+
+                xsprintf(path, "/org/freedesktop/test/%u/sub", (i * 7919) % N_BENCHMARK_RULES);
+                assert_se(sd_bus_message_new_signal(bus, &m, path, "org.freedesktop.Test", "Changed") >= 0);
+                assert_se(sd_bus_message_seal(m, 1, 0) >= 0);
+
+                assert_se(bus_match_run(NULL, &root, m) == 0);
+        }
+
+        t = now(CLOCK_MONOTONIC) - t;
+        log_info("Matched %u messages against %u rules in %s.",
+                 N_BENCHMARK_MESSAGES, 2 * N_BENCHMARK_RULES, format_timespan(buf, sizeof(buf), t, 1));
+
+        /* Only the path_namespace rule of the parent object applies to each of them */
+        assert_se(n_benchmark_calls == N_BENCHMARK_MESSAGES);
+
+        for (i = 0; i < 2 * N_BENCHMARK_RULES; i++)
+                assert_se(bus_match_remove(&root, &slots[i].match_callback) >= 0);
+
+        bus_match_free(&root);
+}
+
 static void test_match_scope(const char *match, enum bus_match_scope scope) {
         struct bus_match_component *components = NULL;
         unsigned n_components = 0;
@@ -75,7 +147,7 @@ int main(int argc, char *argv[]) {
         _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
         _cleanup_(sd_bus_flush_close_unrefp) sd_bus *bus = NULL;
         enum bus_match_node_type i;
-        sd_bus_slot slots[19];
+        sd_bus_slot slots[21];
         int r;
 
         test_setup_logging(LOG_INFO);
@@ -104,6 +176,8 @@ int main(int argc, char *argv[]) {
         assert_se(match_add(slots, &root, "arg4has='pa'", 16) >= 0);
         assert_se(match_add(slots, &root, "arg4has='po'", 17) >= 0);
         assert_se(match_add(slots, &root, "arg4='pi'", 18) >= 0);
+        assert_se(match_add(slots, &root, "path_namespace='/'", 19) >= 0);
+        assert_se(match_add(slots, &root, "path_namespace='/foo/ba'", 20) >= 0);
 
         bus_match_dump(&root, 0);
 
@@ -113,7 +187,7 @@ int main(int argc, char *argv[]) {
 
         zero(mask);
         assert_se(bus_match_run(NULL, &root, m) == 0);
-        assert_se(mask_contains((unsigned[]) { 9, 8, 7, 5, 10, 12, 13, 14, 15, 16, 17 }, 11));
+        assert_se(mask_contains((unsigned[]) { 9, 8, 7, 5, 10, 12, 13, 14, 15, 16, 17, 19 }, 12));
 
         assert_se(bus_match_remove(&root, &slots[8].match_callback) >= 0);
         assert_se(bus_match_remove(&root, &slots[13].match_callback) >= 0);
@@ -122,7 +196,7 @@ int main(int argc, char *argv[]) {
 
         zero(mask);
         assert_se(bus_match_run(NULL, &root, m) == 0);
-        assert_se(mask_contains((unsigned[]) { 9, 5, 10, 12, 14, 7, 15, 16, 17 }, 9));
+        assert_se(mask_contains((unsigned[]) { 9, 5, 10, 12, 14, 7, 15, 16, 17, 19 }, 10));
 
         for (i = 0; i < _BUS_MATCH_NODE_TYPE_MAX; i++) {
                 char buf[32];
@@ -136,6 +210,8 @@ int main(int argc, char *argv[]) {
 
         bus_match_free(&root);
 
+        test_match_benchmark(bus);
+
         test_match_scope("interface='foobar'", BUS_MATCH_GENERIC);
         test_match_scope("", BUS_MATCH_GENERIC);
         test_match_scope("interface='org.freedesktop.DBus.Local'", BUS_MATCH_LOCAL);
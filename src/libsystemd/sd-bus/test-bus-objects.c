@@ -9,6 +9,7 @@
 #include "bus-dump.h"
 #include "bus-internal.h"
 #include "bus-message.h"
+#include "bus-objects.h"
 #include "bus-util.h"
 #include "log.h"
 #include "macro.h"
@@ -177,6 +178,45 @@ static int emit_object_removed(sd_bus_message *m, void *userdata, sd_bus_error *
         return 1;
 }
 
+static int get_object_properties(sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
+        _cleanup_strv_free_ char **names = NULL;
+        const char *path;
+        int r;
+
+        assert_se(sd_bus_message_read(m, "o", &path) >= 0);
+        assert_se(sd_bus_message_read_strv(m, &names) >= 0);
+
+        assert_se(sd_bus_message_new_method_return(m, &reply) >= 0);
+
+        r = bus_message_append_object_properties(reply, path, NULL, strv_isempty(names) ? NULL : names, error);
+        assert_se(r >= 0);
+
+        assert_se(sd_bus_message_append(reply, "b", r > 0) >= 0);
+
+        r = sd_bus_send(NULL, reply, NULL);
+        assert_se(r >= 0);
+
+        return 1;
+}
+
+static const sd_bus_vtable vtable3[] = {
+        SD_BUS_VTABLE_START(0),
+        SD_BUS_METHOD("NoOperation", NULL, NULL, NULL, 0),
+        SD_BUS_VTABLE_END
+};
+
+static int add_interface(sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        int r;
+
+        assert_se(sd_bus_add_object_vtable(sd_bus_message_get_bus(m), NULL, "/foo", "org.freedesktop.systemd.test3", vtable3, userdata) >= 0);
+
+        r = sd_bus_reply_method_return(m, NULL);
+        assert_se(r >= 0);
+
+        return 1;
+}
+
 static const sd_bus_vtable vtable[] = {
         SD_BUS_VTABLE_START(0),
         SD_BUS_METHOD("AlterSomething", "s", "s", something_handler, 0),
@@ -189,6 +229,8 @@ static const sd_bus_vtable vtable[] = {
         SD_BUS_METHOD("EmitInterfacesRemoved", NULL, NULL, emit_interfaces_removed, 0),
         SD_BUS_METHOD("EmitObjectAdded", NULL, NULL, emit_object_added, 0),
         SD_BUS_METHOD("EmitObjectRemoved", NULL, NULL, emit_object_removed, 0),
+        SD_BUS_METHOD("AddInterface", NULL, NULL, add_interface, 0),
+        SD_BUS_METHOD("GetObjectProperties", "oas", "a{sv}b", get_object_properties, 0),
         SD_BUS_VTABLE_END
 };
 
@@ -281,8 +323,9 @@ static int client(struct context *c) {
         _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
         _cleanup_(sd_bus_unrefp) sd_bus *bus = NULL;
         _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
+        _cleanup_free_ char *introspection = NULL;
         const char *s;
-        int r;
+        int b, r;
 
         assert_se(sd_bus_new(&bus) >= 0);
         assert_se(sd_bus_set_fd(bus, c->fds[1], c->fds[1]) >= 0);
@@ -353,9 +396,41 @@ static int client(struct context *c) {
         assert_se(r >= 0);
         fputs(s, stdout);
 
+        assert_se(introspection = strdup(s));
+
+        sd_bus_message_unref(reply);
+        reply = NULL;
+
+        /* The second time the reply comes from the cache */
+        r = sd_bus_call_method(bus, "org.freedesktop.systemd.test", "/foo", "org.freedesktop.DBus.Introspectable", "Introspect", &error, &reply, "");
+        assert_se(r >= 0);
+
+        r = sd_bus_message_read(reply, "s", &s);
+        assert_se(r >= 0);
+        assert_se(streq(s, introspection));
+
         sd_bus_message_unref(reply);
         reply = NULL;
 
+        /* Adding an interface must invalidate it */
+        r = sd_bus_call_method(bus, "org.freedesktop.systemd.test", "/foo", "org.freedesktop.systemd.test", "AddInterface", &error, NULL, NULL);
+        assert_se(r >= 0);
+
+        r = sd_bus_call_method(bus, "org.freedesktop.systemd.test", "/foo", "org.freedesktop.DBus.Introspectable", "Introspect", &error, &reply, "");
+        assert_se(r >= 0);
+
+        r = sd_bus_message_read(reply, "s", &s);
+        assert_se(r >= 0);
+        assert_se(!streq(s, introspection));
+        assert_se(strstr(s, "<interface name=\"org.freedesktop.systemd.test3\">"));
+        assert_se(!strstr(introspection, "org.freedesktop.systemd.test3"));
+
+        sd_bus_message_unref(reply);
+        reply = NULL;
+
+        r = sd_bus_call_method(bus, "org.freedesktop.systemd.test", "/foo", "org.freedesktop.systemd.test3", "NoOperation", &error, NULL, NULL);
+        assert_se(r >= 0);
+
         r = sd_bus_get_property(bus, "org.freedesktop.systemd.test", "/value/xuzz", "org.freedesktop.systemd.ValueTest", "Value", &error, &reply, "s");
         assert_se(r >= 0);
 
@@ -366,6 +441,47 @@ static int client(struct context *c) {
         sd_bus_message_unref(reply);
         reply = NULL;
 
+        r = sd_bus_call_method(bus, "org.freedesktop.systemd.test", "/foo", "org.freedesktop.systemd.test", "GetObjectProperties", &error, &reply, "oas", "/value/xuzz", 2, "Value3", "Value");
+        assert_se(r >= 0);
+
+        assert_se(sd_bus_message_enter_container(reply, 'a', "{sv}") > 0);
+        assert_se(sd_bus_message_enter_container(reply, 'e', "sv") > 0);
+        assert_se(sd_bus_message_read(reply, "s", &s) >= 0);
+        assert_se(streq(s, "Value"));
+        assert_se(sd_bus_message_read(reply, "v", "s", &s) >= 0);
+        assert_se(endswith(s, "path /value/xuzz"));
+        assert_se(sd_bus_message_exit_container(reply) >= 0);
+        assert_se(sd_bus_message_enter_container(reply, 'e', "sv") > 0);
+        assert_se(sd_bus_message_read(reply, "s", &s) >= 0);
+        assert_se(streq(s, "Value3"));
+        assert_se(sd_bus_message_skip(reply, "v") >= 0);
+        assert_se(sd_bus_message_exit_container(reply) >= 0);
+        assert_se(sd_bus_message_enter_container(reply, 'e', "sv") == 0);
+        assert_se(sd_bus_message_exit_container(reply) >= 0);
+        assert_se(sd_bus_message_read(reply, "b", &b) >= 0);
+        assert_se(b);
+
+        sd_bus_message_unref(reply);
+        reply = NULL;
+
+        r = sd_bus_call_method(bus, "org.freedesktop.systemd.test", "/foo", "org.freedesktop.systemd.test", "GetObjectProperties", &error, &reply, "oas", "/foo", 0);
+        assert_se(r >= 0);
+
+        bus_message_dump(reply, stdout, BUS_MESSAGE_DUMP_WITH_HEADER);
+
+        sd_bus_message_unref(reply);
+        reply = NULL;
+
+        r = sd_bus_call_method(bus, "org.freedesktop.systemd.test", "/foo", "org.freedesktop.systemd.test", "GetObjectProperties", &error, &reply, "oas", "/doesntexist", 0);
+        assert_se(r >= 0);
+
+        assert_se(sd_bus_message_skip(reply, "a{sv}") >= 0);
+        assert_se(sd_bus_message_read(reply, "b", &b) >= 0);
+        assert_se(!b);
+
+        sd_bus_message_unref(reply);
+        reply = NULL;
+
         r = sd_bus_call_method(bus, "org.freedesktop.systemd.test", "/", "org.freedesktop.DBus.Introspectable", "Introspect", &error, &reply, "");
         assert_se(r >= 0);
 
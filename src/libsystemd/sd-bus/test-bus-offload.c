@@ -0,0 +1,266 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+
+#include "sd-bus.h"
+#include "sd-event.h"
+
+#include "log.h"
+#include "macro.h"
+#include "time-util.h"
+#include "util.h"
+
+#define N_SLOW 4
+
+struct context {
+        int fds[2];
+        pthread_t server_thread;
+
+        pthread_mutex_t mutex;
+        pthread_cond_t cond;
+        unsigned n_slow;
+
+        unsigned n_replies;
+
+        /* Set by the Block() handler */
+        bool blocked;
+        int block_result;
+};
+
+static int slow_handler(sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        struct context *c = userdata;
+        struct timespec ts;
+        bool all = true;
+
+        /* Wait until all slow calls are being processed at the same time, which can't happen if they are run one
+         * after the other. */
+
+        assert_se(!pthread_equal(pthread_self(), c->server_thread));
+
+        assert_se(pthread_mutex_lock(&c->mutex) == 0);
+
+        c->n_slow++;
+        assert_se(pthread_cond_broadcast(&c->cond) == 0);
+
+        timespec_store(&ts, now(CLOCK_REALTIME) + 10 * USEC_PER_SEC);
+        while (c->n_slow < N_SLOW)
+                if (pthread_cond_timedwait(&c->cond, &c->mutex, &ts) == ETIMEDOUT) {
+                        all = false;
+                        break;
+                }
+
+        assert_se(pthread_mutex_unlock(&c->mutex) == 0);
+
+        return sd_bus_reply_method_return(m, "b", all);
+}
+
+static int fail_handler(sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        return sd_bus_error_set(error, "org.freedesktop.systemd.test.Failed", "Failed as requested.");
+}
+
+static int call_handler(sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        sd_bus *bus = sd_bus_message_get_bus(m);
+        int r;
+
+        /* Asynchronous calls would need the bus thread, synchronous ones are done on its behalf */
+        assert_se(sd_bus_call_method_async(bus, NULL, NULL, "/", "org.freedesktop.DBus.Peer", "Ping", NULL, NULL, NULL) == -EDEADLK);
+
+        r = sd_bus_call_method(bus, NULL, "/", "org.freedesktop.DBus.Peer", "Ping", error, NULL, NULL);
+        if (r < 0)
+                return r;
+
+        return sd_bus_reply_method_return(m, "b", true);
+}
+
+static int block_handler(sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        sd_bus *bus = sd_bus_message_get_bus(m);
+        struct context *c = userdata;
+        int r;
+
+        assert_se(pthread_mutex_lock(&c->mutex) == 0);
+        c->blocked = true;
+        assert_se(pthread_cond_broadcast(&c->cond) == 0);
+        assert_se(pthread_mutex_unlock(&c->mutex) == 0);
+
+        /* The peer never answers this, only closing the bus gets us out of here */
+        r = sd_bus_call_method(bus, NULL, "/", "org.freedesktop.DBus.Peer", "Ping", error, NULL, NULL);
+        c->block_result = r;
+
+        return r;
+}
+
+static int close_handler(sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        sd_bus *bus = sd_bus_message_get_bus(m);
+        sd_event *event = sd_bus_get_event(bus);
+
+        /* Closing detaches the bus from the event loop */
+        sd_bus_close(bus);
+        assert_se(sd_event_exit(event, 0) >= 0);
+
+        return 0;
+}
+
+static int quit_handler(sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        assert_se(sd_event_exit(sd_bus_get_event(sd_bus_message_get_bus(m)), 0) >= 0);
+
+        return sd_bus_reply_method_return(m, NULL);
+}
+
+static const sd_bus_vtable vtable[] = {
+        SD_BUS_VTABLE_START(0),
+        SD_BUS_METHOD("Slow", NULL, "b", slow_handler, SD_BUS_VTABLE_METHOD_OFFLOAD),
+        SD_BUS_METHOD("Fail", NULL, NULL, fail_handler, SD_BUS_VTABLE_METHOD_OFFLOAD),
+        SD_BUS_METHOD("Call", NULL, "b", call_handler, SD_BUS_VTABLE_METHOD_OFFLOAD),
+        SD_BUS_METHOD("Block", NULL, NULL, block_handler, SD_BUS_VTABLE_METHOD_OFFLOAD),
+        SD_BUS_METHOD("Close", NULL, NULL, close_handler, 0),
+        SD_BUS_METHOD("Quit", NULL, NULL, quit_handler, 0),
+        SD_BUS_VTABLE_END
+};
+
+static const sd_bus_vtable vtable_invalid[] = {
+        SD_BUS_VTABLE_START(0),
+        SD_BUS_SIGNAL("Signal", NULL, SD_BUS_VTABLE_METHOD_OFFLOAD),
+        SD_BUS_VTABLE_END
+};
+
+static void *server(void *p) {
+        _cleanup_(sd_event_unrefp) sd_event *event = NULL;
+        struct context *c = p;
+        sd_bus *bus = NULL;
+        sd_id128_t id;
+
+        assert_se(sd_id128_randomize(&id) >= 0);
+
+        assert_se(sd_event_new(&event) >= 0);
+
+        assert_se(sd_bus_new(&bus) >= 0);
+        assert_se(sd_bus_set_fd(bus, c->fds[0], c->fds[0]) >= 0);
+        assert_se(sd_bus_set_server(bus, 1, id) >= 0);
+
+        assert_se(sd_bus_add_object_vtable(bus, NULL, "/foo", "org.freedesktop.systemd.test", vtable, c) >= 0);
+        assert_se(sd_bus_add_object_vtable(bus, NULL, "/foo", "org.freedesktop.systemd.test2", vtable_invalid, c) == -EINVAL);
+
+        assert_se(sd_bus_start(bus) >= 0);
+        assert_se(sd_bus_attach_event(bus, event, SD_EVENT_PRIORITY_NORMAL) >= 0);
+
+        assert_se(sd_event_loop(event) >= 0);
+
+        sd_bus_flush(bus);
+        sd_bus_detach_event(bus);
+        sd_bus_unref(bus);
+
+        return NULL;
+}
+
+static int quit_reply(sd_bus_message *m, void *userdata, sd_bus_error *ret_error) {
+        assert_se(!sd_bus_message_is_method_error(m, NULL));
+
+        assert_se(sd_event_exit(sd_bus_get_event(sd_bus_message_get_bus(m)), 0) >= 0);
+        return 0;
+}
+
+static void reply_done(struct context *c, sd_bus_message *m) {
+        if (++c->n_replies < N_SLOW + 2)
+                return;
+
+        assert_se(sd_bus_call_method_async(sd_bus_message_get_bus(m), NULL, NULL, "/foo", "org.freedesktop.systemd.test", "Quit", quit_reply, c, NULL) >= 0);
+}
+
+static int bool_reply(sd_bus_message *m, void *userdata, sd_bus_error *ret_error) {
+        int b;
+
+        assert_se(!sd_bus_message_is_method_error(m, NULL));
+        assert_se(sd_bus_message_read(m, "b", &b) >= 0);
+        assert_se(b);
+
+        reply_done(userdata, m);
+        return 0;
+}
+
+static int fail_reply(sd_bus_message *m, void *userdata, sd_bus_error *ret_error) {
+        assert_se(sd_bus_message_is_method_error(m, "org.freedesktop.systemd.test.Failed"));
+
+        reply_done(userdata, m);
+        return 0;
+}
+
+static void client(struct context *c) {
+        _cleanup_(sd_event_unrefp) sd_event *event = NULL;
+        _cleanup_(sd_bus_flush_close_unrefp) sd_bus *bus = NULL;
+        unsigned i;
+
+        assert_se(sd_event_new(&event) >= 0);
+
+        assert_se(sd_bus_new(&bus) >= 0);
+        assert_se(sd_bus_set_fd(bus, c->fds[1], c->fds[1]) >= 0);
+        assert_se(sd_bus_start(bus) >= 0);
+        assert_se(sd_bus_attach_event(bus, event, SD_EVENT_PRIORITY_NORMAL) >= 0);
+
+        for (i = 0; i < N_SLOW; i++)
+                assert_se(sd_bus_call_method_async(bus, NULL, NULL, "/foo", "org.freedesktop.systemd.test", "Slow", bool_reply, c, NULL) >= 0);
+        assert_se(sd_bus_call_method_async(bus, NULL, NULL, "/foo", "org.freedesktop.systemd.test", "Fail", fail_reply, c, NULL) >= 0);
+        assert_se(sd_bus_call_method_async(bus, NULL, NULL, "/foo", "org.freedesktop.systemd.test", "Call", bool_reply, c, NULL) >= 0);
+
+        /* Keep running the event loop, so that the Ping() call of the Call() method is answered */
+        assert_se(sd_event_loop(event) >= 0);
+        assert_se(c->n_replies == N_SLOW + 2);
+}
+
+static void test_offload(void) {
+        struct context c = {
+                .mutex = PTHREAD_MUTEX_INITIALIZER,
+                .cond = PTHREAD_COND_INITIALIZER,
+        };
+
+        assert_se(socketpair(AF_UNIX, SOCK_STREAM, 0, c.fds) >= 0);
+
+        assert_se(pthread_create(&c.server_thread, NULL, server, &c) == 0);
+
+        client(&c);
+
+        assert_se(pthread_join(c.server_thread, NULL) == 0);
+}
+
+static void test_close(void) {
+        _cleanup_(sd_bus_flush_close_unrefp) sd_bus *bus = NULL;
+        struct context c = {
+                .mutex = PTHREAD_MUTEX_INITIALIZER,
+                .cond = PTHREAD_COND_INITIALIZER,
+        };
+
+        assert_se(socketpair(AF_UNIX, SOCK_STREAM, 0, c.fds) >= 0);
+
+        assert_se(pthread_create(&c.server_thread, NULL, server, &c) == 0);
+
+        assert_se(sd_bus_new(&bus) >= 0);
+        assert_se(sd_bus_set_fd(bus, c.fds[1], c.fds[1]) >= 0);
+        assert_se(sd_bus_start(bus) >= 0);
+
+        /* Wait until the handler is running, but never process the bus, so that its call is not answered */
+        assert_se(sd_bus_call_method_async(bus, NULL, NULL, "/foo", "org.freedesktop.systemd.test", "Block", NULL, NULL, NULL) >= 0);
+        assert_se(sd_bus_flush(bus) >= 0);
+
+        assert_se(pthread_mutex_lock(&c.mutex) == 0);
+        while (!c.blocked)
+                assert_se(pthread_cond_wait(&c.cond, &c.mutex) == 0);
+        assert_se(pthread_mutex_unlock(&c.mutex) == 0);
+
+        /* Closing the bus on the server side cancels the call, and waits for the handler */
+        assert_se(sd_bus_call_method_async(bus, NULL, NULL, "/foo", "org.freedesktop.systemd.test", "Close", NULL, NULL, NULL) >= 0);
+        assert_se(sd_bus_flush(bus) >= 0);
+
+        assert_se(pthread_join(c.server_thread, NULL) == 0);
+        assert_se(IN_SET(c.block_result, -ECONNRESET, -ENOTCONN));
+}
+
+int main(int argc, char *argv[]) {
+        log_set_max_level(LOG_DEBUG);
+        log_parse_environment();
+        log_open();
+
+        test_offload();
+        test_close();
+
+        return EXIT_SUCCESS;
+}
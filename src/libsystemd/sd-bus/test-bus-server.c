@@ -1,26 +1,58 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 
+#include <fcntl.h>
 #include <pthread.h>
 #include <stdlib.h>
 
 #include "sd-bus.h"
 
 #include "bus-internal.h"
+#include "bus-message.h"
 #include "bus-util.h"
+#include "fd-util.h"
 #include "log.h"
 #include "macro.h"
 #include "util.h"
 
+/* Signals sent while the connection is still being set up, which are hence flushed in one go from the write queue */
+#define N_BURST 1000
+
+/* Large enough to be passed in a memfd, if negotiated */
+#define LARGE_SIZE (1024*1024)
+
 struct context {
         int fds[2];
 
+        unsigned n_burst;
+
         bool client_negotiate_unix_fds;
         bool server_negotiate_unix_fds;
 
         bool client_anonymous_auth;
         bool server_anonymous_auth;
+
+        bool client_negotiate_memfd;
+        bool server_negotiate_memfd;
 };
 
+static bool context_use_memfd(struct context *c) {
+        return c->client_negotiate_unix_fds && c->server_negotiate_unix_fds &&
+                c->client_negotiate_memfd && c->server_negotiate_memfd;
+}
+
+static void check_large(sd_bus_message *m, bool use_memfd) {
+        const uint8_t *p;
+        size_t sz, i;
+
+        assert_se(sd_bus_message_read_array(m, 'y', (const void**) &p, &sz) > 0);
+        assert_se(sz == LARGE_SIZE);
+
+        for (i = 0; i < sz; i++)
+                assert_se(p[i] == (uint8_t) i);
+
+        assert_se((m->body.memfd >= 0) == use_memfd);
+}
+
 static void *server(void *p) {
         struct context *c = p;
         sd_bus *bus = NULL;
@@ -35,6 +67,7 @@ static void *server(void *p) {
         assert_se(sd_bus_set_server(bus, 1, id) >= 0);
         assert_se(sd_bus_set_anonymous(bus, c->server_anonymous_auth) >= 0);
         assert_se(sd_bus_negotiate_fds(bus, c->server_negotiate_unix_fds) >= 0);
+        assert_se(sd_bus_negotiate_memfd(bus, c->server_negotiate_memfd) >= 0);
         assert_se(sd_bus_start(bus) >= 0);
 
         while (!quit) {
@@ -61,7 +94,41 @@ static void *server(void *p) {
 
                 log_info("Got message! member=%s", strna(sd_bus_message_get_member(m)));
 
-                if (sd_bus_message_is_method_call(m, "org.freedesktop.systemd.test", "Exit")) {
+                if (sd_bus_message_is_signal(m, "org.freedesktop.systemd.test", "Burst")) {
+                        unsigned i;
+
+                        assert_se(sd_bus_message_read(m, "u", &i) > 0);
+                        assert_se(i == c->n_burst);
+                        c->n_burst++;
+
+                        if (i == N_BURST / 2 && c->server_negotiate_unix_fds && c->client_negotiate_unix_fds) {
+                                int fd;
+
+                                assert_se(sd_bus_message_read(m, "h", &fd) > 0);
+                                assert_se(fd >= 0);
+                        }
+
+                } else if (sd_bus_message_is_method_call(m, "org.freedesktop.systemd.test", "Large")) {
+                        const void *p;
+                        size_t sz;
+
+                        check_large(m, context_use_memfd(c));
+
+                        /* Send it right back */
+                        assert_se(sd_bus_message_rewind(m, true) >= 0);
+                        assert_se(sd_bus_message_read_array(m, 'y', &p, &sz) > 0);
+
+                        r = sd_bus_message_new_method_return(m, &reply);
+                        if (r < 0) {
+                                log_error_errno(r, "Failed to allocate return: %m");
+                                goto fail;
+                        }
+
+                        assert_se(sd_bus_message_append_array(reply, 'y', p, sz) >= 0);
+
+                } else if (sd_bus_message_is_method_call(m, "org.freedesktop.systemd.test", "Exit")) {
+
+                        assert_se(c->n_burst == N_BURST);
 
                         assert_se((sd_bus_can_send(bus, 'h') >= 1) ==
                                   (c->server_negotiate_unix_fds && c->client_negotiate_unix_fds));
@@ -107,16 +174,62 @@ fail:
 
 static int client(struct context *c) {
         _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL, *reply = NULL;
-        _cleanup_(sd_bus_unrefp) sd_bus *bus = NULL;
+        _cleanup_(sd_bus_flush_close_unrefp) sd_bus *bus = NULL;
         sd_bus_error error = SD_BUS_ERROR_NULL;
+        uint8_t *p;
+        unsigned i;
         int r;
 
         assert_se(sd_bus_new(&bus) >= 0);
         assert_se(sd_bus_set_fd(bus, c->fds[1], c->fds[1]) >= 0);
         assert_se(sd_bus_negotiate_fds(bus, c->client_negotiate_unix_fds) >= 0);
+        assert_se(sd_bus_negotiate_memfd(bus, c->client_negotiate_memfd) >= 0);
         assert_se(sd_bus_set_anonymous(bus, c->client_anonymous_auth) >= 0);
         assert_se(sd_bus_start(bus) >= 0);
 
+        for (i = 0; i < N_BURST; i++) {
+                _cleanup_(sd_bus_message_unrefp) sd_bus_message *s = NULL;
+
+                assert_se(sd_bus_message_new_signal(bus, &s, "/", "org.freedesktop.systemd.test", "Burst") >= 0);
+                assert_se(sd_bus_message_append(s, "u", i) >= 0);
+
+                /* Messages with fds are not combined with others when written */
+                if (i == N_BURST / 2 && c->server_negotiate_unix_fds && c->client_negotiate_unix_fds) {
+                        _cleanup_close_ int fd = -1;
+
+                        fd = open("/dev/null", O_RDONLY|O_CLOEXEC);
+                        assert_se(fd >= 0);
+                        assert_se(sd_bus_message_append(s, "h", fd) >= 0);
+                }
+
+                r = sd_bus_send(bus, s, NULL);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to send signal: %m");
+        }
+
+        r = sd_bus_message_new_method_call(
+                        bus,
+                        &m,
+                        "org.freedesktop.systemd.test",
+                        "/",
+                        "org.freedesktop.systemd.test",
+                        "Large");
+        if (r < 0)
+                return log_error_errno(r, "Failed to allocate method call: %m");
+
+        assert_se(sd_bus_message_append_array_space(m, 'y', LARGE_SIZE, (void**) &p) >= 0);
+        for (i = 0; i < LARGE_SIZE; i++)
+                p[i] = (uint8_t) i;
+
+        r = sd_bus_call(bus, m, 0, &error, &reply);
+        if (r < 0)
+                return log_error_errno(r, "Failed to issue method call: %s", bus_error_message(&error, -r));
+
+        check_large(reply, context_use_memfd(c));
+
+        m = sd_bus_message_unref(m);
+        reply = sd_bus_message_unref(reply);
+
         r = sd_bus_message_new_method_call(
                         bus,
                         &m,
@@ -135,7 +248,8 @@ static int client(struct context *c) {
 }
 
 static int test_one(bool client_negotiate_unix_fds, bool server_negotiate_unix_fds,
-                    bool client_anonymous_auth, bool server_anonymous_auth) {
+                    bool client_anonymous_auth, bool server_anonymous_auth,
+                    bool client_negotiate_memfd, bool server_negotiate_memfd) {
 
         struct context c;
         pthread_t s;
@@ -150,6 +264,8 @@ static int test_one(bool client_negotiate_unix_fds, bool server_negotiate_unix_f
         c.server_negotiate_unix_fds = server_negotiate_unix_fds;
         c.client_anonymous_auth = client_anonymous_auth;
         c.server_anonymous_auth = server_anonymous_auth;
+        c.client_negotiate_memfd = client_negotiate_memfd;
+        c.server_negotiate_memfd = server_negotiate_memfd;
 
         r = pthread_create(&s, NULL, server, &c);
         if (r != 0)
@@ -173,26 +289,38 @@ static int test_one(bool client_negotiate_unix_fds, bool server_negotiate_unix_f
 int main(int argc, char *argv[]) {
         int r;
 
-        r = test_one(true, true, false, false);
+        r = test_one(true, true, false, false, false, false);
         assert_se(r >= 0);
 
-        r = test_one(true, false, false, false);
+        r = test_one(true, false, false, false, false, false);
         assert_se(r >= 0);
 
-        r = test_one(false, true, false, false);
+        r = test_one(false, true, false, false, false, false);
         assert_se(r >= 0);
 
-        r = test_one(false, false, false, false);
+        r = test_one(false, false, false, false, false, false);
         assert_se(r >= 0);
 
-        r = test_one(true, true, true, true);
+        r = test_one(true, true, true, true, false, false);
         assert_se(r >= 0);
 
-        r = test_one(true, true, false, true);
+        r = test_one(true, true, false, true, false, false);
         assert_se(r >= 0);
 
-        r = test_one(true, true, true, false);
+        r = test_one(true, true, true, false, false, false);
         assert_se(r == -EPERM);
 
+        r = test_one(true, true, false, false, true, true);
+        assert_se(r >= 0);
+
+        r = test_one(true, true, false, false, true, false);
+        assert_se(r >= 0);
+
+        r = test_one(true, true, false, false, false, true);
+        assert_se(r >= 0);
+
+        r = test_one(false, true, false, false, true, true);
+        assert_se(r >= 0);
+
         return EXIT_SUCCESS;
 }
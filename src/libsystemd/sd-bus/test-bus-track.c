@@ -10,6 +10,7 @@
 
 static bool track_cb_called_x = false;
 static bool track_cb_called_y = false;
+static bool track_cb_called_z = false;
 
 static int track_cb_x(sd_bus_track *t, void *userdata) {
 
@@ -25,6 +26,18 @@ static int track_cb_x(sd_bus_track *t, void *userdata) {
         return 1;
 }
 
+static int track_cb_z(sd_bus_track *t, void *userdata) {
+
+        log_error("TRACK CB Z");
+
+        /* b's name disappeared, which x watches too. Both are notified by the same NameOwnerChanged match. */
+
+        assert_se(!track_cb_called_z);
+        track_cb_called_z = true;
+
+        return 1;
+}
+
 static int track_cb_y(sd_bus_track *t, void *userdata) {
         int r;
 
@@ -43,7 +56,7 @@ static int track_cb_y(sd_bus_track *t, void *userdata) {
 
 int main(int argc, char *argv[]) {
         _cleanup_(sd_event_unrefp) sd_event *event = NULL;
-        _cleanup_(sd_bus_track_unrefp) sd_bus_track *x = NULL, *y = NULL;
+        _cleanup_(sd_bus_track_unrefp) sd_bus_track *x = NULL, *y = NULL, *z = NULL;
         _cleanup_(sd_bus_unrefp) sd_bus *a = NULL, *b = NULL;
         bool use_system_bus = false;
         const char *unique;
@@ -85,6 +98,13 @@ int main(int argc, char *argv[]) {
         r = sd_bus_track_add_name(x, unique);
         assert_se(r >= 0);
 
+        /* Watch b's name from a a second time, with a different track object */
+        r = sd_bus_track_new(a, &z, track_cb_z, NULL);
+        assert_se(r >= 0);
+
+        r = sd_bus_track_add_name(z, unique);
+        assert_se(r >= 0);
+
         /* Watch's a's own name from a */
         r = sd_bus_track_new(a, &y, track_cb_y, NULL);
         assert_se(r >= 0);
@@ -103,6 +123,7 @@ int main(int argc, char *argv[]) {
 
         assert_se(track_cb_called_x);
         assert_se(track_cb_called_y);
+        assert_se(track_cb_called_z);
 
         return 0;
 }
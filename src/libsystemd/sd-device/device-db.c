@@ -0,0 +1,390 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "alloc-util.h"
+#include "device-db.h"
+#include "dirent-util.h"
+#include "fd-util.h"
+#include "fileio.h"
+#include "macro.h"
+#include "string-util.h"
+#include "time-util.h"
+#include "tmpfile-util.h"
+#include "util.h"
+
+/* The snapshot only ever lives in /run, hence it is in native byte order:
+ *
+ *   header | the id and the records of each device | the entries, sorted by id
+ *
+ * Each entry points to the NUL terminated id of a device, i.e. the name of its file in /run/udev/data/, and to its
+ * records, which are the lines of that file with the ':' dropped and the newline replaced by NUL. A snapshot is never
+ * modified once it is written, except for its "valid" field, which is cleared in place by whoever changes anything in
+ * /run/udev/data/, so that readers which have it mapped notice right away. It is then unlinked, and written again by
+ * udevd once it is idle. */
+
+#define DEVICE_DB_DIR "/run/udev/data"
+#define DEVICE_DB_SIGNATURE { 'U', 'D', 'E', 'V', 'D', 'B', '\0', '\1' }
+
+typedef struct DeviceDbHeader {
+        uint8_t signature[8];
+        uint32_t header_size;
+        uint32_t valid;
+        uint64_t file_size;
+        uint64_t entries_offset;
+        uint64_t n_entries;
+} DeviceDbHeader;
+
+typedef struct DeviceDbEntry {
+        uint64_t id_offset;
+        uint64_t data_offset;
+        uint64_t data_size;
+} DeviceDbEntry;
+
+static thread_local void *db_map = NULL;
+static thread_local size_t db_map_size = 0;
+
+static pthread_key_t db_map_key;
+static pthread_once_t db_map_once = PTHREAD_ONCE_INIT;
+static bool db_map_key_valid = false;
+
+static void db_map_free(void *p) {
+        /* The size was checked against the file when mapping it */
+        (void) munmap(p, ((const DeviceDbHeader*) p)->file_size);
+}
+
+static void db_map_key_create(void) {
+        /* Each thread maps the snapshot on its own, so that no other thread can unmap it while records returned
+         * by device_db_binary_get() are still being parsed. Hence, unmap it when the thread exits. */
+        db_map_key_valid = pthread_key_create(&db_map_key, db_map_free) == 0;
+}
+
+void device_db_binary_unmap(void) {
+        if (db_map) {
+                (void) munmap(db_map, db_map_size);
+                (void) pthread_setspecific(db_map_key, NULL);
+        }
+
+        db_map = NULL;
+        db_map_size = 0;
+}
+
+static int db_verify(const uint8_t *p, size_t size) {
+        static const uint8_t signature[] = DEVICE_DB_SIGNATURE;
+        const DeviceDbHeader *h = (const DeviceDbHeader*) p;
+        const DeviceDbEntry *e;
+        uint64_t i;
+
+        if (size < sizeof(DeviceDbHeader) ||
+            memcmp(h->signature, signature, sizeof(signature)) != 0 ||
+            h->header_size != sizeof(DeviceDbHeader) ||
+            h->file_size != size)
+                return -EBADMSG;
+
+        if (h->entries_offset % 8 != 0 ||
+            h->entries_offset < sizeof(DeviceDbHeader) ||
+            h->entries_offset > size ||
+            h->n_entries > (size - h->entries_offset) / sizeof(DeviceDbEntry))
+                return -EBADMSG;
+
+        /* Check everything once when mapping the snapshot, so that lookups do not need to */
+        e = (const DeviceDbEntry*) (p + h->entries_offset);
+        for (i = 0; i < h->n_entries; i++) {
+                if (e[i].id_offset < sizeof(DeviceDbHeader) ||
+                    e[i].id_offset >= h->entries_offset ||
+                    !memchr(p + e[i].id_offset, 0, h->entries_offset - e[i].id_offset))
+                        return -EBADMSG;
+
+                if (e[i].data_size > 0 &&
+                    (e[i].data_offset < sizeof(DeviceDbHeader) ||
+                     e[i].data_offset > h->entries_offset ||
+                     e[i].data_size > h->entries_offset - e[i].data_offset ||
+                     p[e[i].data_offset + e[i].data_size - 1] != '\0'))
+                        return -EBADMSG;
+
+                if (i > 0 && strcmp((const char*) p + e[i - 1].id_offset, (const char*) p + e[i].id_offset) >= 0)
+                        return -EBADMSG;
+        }
+
+        return 0;
+}
+
+static int db_map_open(void) {
+        _cleanup_close_ int fd = -1;
+        struct stat st;
+        void *p;
+        int r;
+
+        /* Without a way to unmap it when the thread exits, the snapshot would be leaked, the caller reads the
+         * text files instead */
+        (void) pthread_once(&db_map_once, db_map_key_create);
+        if (!db_map_key_valid)
+                return -ENOMEM;
+
+        fd = open(DEVICE_DB_BINARY_PATH, O_RDONLY|O_CLOEXEC|O_NOCTTY);
+        if (fd < 0)
+                return -errno;
+
+        if (fstat(fd, &st) < 0)
+                return -errno;
+
+        if (st.st_size < (off_t) sizeof(DeviceDbHeader))
+                return -EBADMSG;
+        if ((uint64_t) st.st_size > SIZE_MAX)
+                return -EFBIG;
+
+        p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (p == MAP_FAILED)
+                return -errno;
+
+        r = db_verify(p, st.st_size);
+        if (r < 0) {
+                (void) munmap(p, st.st_size);
+                return r;
+        }
+
+        r = pthread_setspecific(db_map_key, p);
+        if (r != 0) {
+                (void) munmap(p, st.st_size);
+                return -r;
+        }
+
+        db_map = p;
+        db_map_size = st.st_size;
+
+        return 0;
+}
+
+static int db_map_get(const DeviceDbHeader **ret) {
+        int r;
+
+        if (db_map && ((const DeviceDbHeader*) db_map)->valid)
+                goto finish;
+
+        device_db_binary_unmap();
+
+        r = db_map_open();
+        if (r < 0)
+                return r;
+
+        /* It might have been invalidated, but not unlinked yet */
+        if (!((const DeviceDbHeader*) db_map)->valid) {
+                device_db_binary_unmap();
+                return -ESTALE;
+        }
+
+finish:
+        if (ret)
+                *ret = db_map;
+
+        return 0;
+}
+
+int device_db_binary_get(const char *id, const char **ret_data, size_t *ret_size) {
+        const DeviceDbEntry *entries;
+        const DeviceDbHeader *h;
+        const char *p;
+        size_t lo, hi;
+        int r;
+
+        assert(id);
+        assert(ret_data);
+        assert(ret_size);
+
+        r = db_map_get(&h);
+        if (r < 0)
+                return r;
+
+        p = (const char*) h;
+        entries = (const DeviceDbEntry*) (p + h->entries_offset);
+
+        lo = 0;
+        hi = h->n_entries;
+        while (lo < hi) {
+                size_t mid = lo + (hi - lo) / 2;
+
+                r = strcmp(id, p + entries[mid].id_offset);
+                if (r == 0) {
+                        *ret_data = p + entries[mid].data_offset;
+                        *ret_size = entries[mid].data_size;
+                        return 1;
+                }
+
+                if (r < 0)
+                        hi = mid;
+                else
+                        lo = mid + 1;
+        }
+
+        return 0;
+}
+
+/* Converts "K:value\n" lines to "Kvalue\0" records, which never makes them longer. Invalid lines and an unterminated
+ * last line are dropped, as device_read_db_aux() ignores them too. */
+static size_t db_records_from_text(const char *text, size_t size, char *ret) {
+        const char *p = text, *end = text + size;
+        size_t n = 0;
+
+        while (p < end) {
+                const char *eol;
+                size_t l;
+
+                eol = memchr(p, '\n', end - p);
+                if (!eol)
+                        break;
+
+                l = eol - p;
+                if (l >= 2 && p[1] == ':' && !memchr(p, '\0', l)) {
+                        ret[n++] = p[0];
+                        memcpy(ret + n, p + 2, l - 2);
+                        n += l - 2;
+                        ret[n++] = '\0';
+                }
+
+                p = eol + 1;
+        }
+
+        return n;
+}
+
+static int entry_compare(const DeviceDbEntry *a, const DeviceDbEntry *b, char *buf) {
+        return strcmp(buf + a->id_offset, buf + b->id_offset);
+}
+
+static bool db_dir_unchanged(const struct stat *a, const struct stat *b) {
+        return a->st_ino == b->st_ino &&
+                timespec_load_nsec(&a->st_mtim) == timespec_load_nsec(&b->st_mtim);
+}
+
+int device_db_binary_update(void) {
+        static const uint8_t signature[] = DEVICE_DB_SIGNATURE;
+        _cleanup_free_ DeviceDbEntry *entries = NULL;
+        _cleanup_free_ char *buf = NULL, *path_tmp = NULL;
+        _cleanup_closedir_ DIR *dir = NULL;
+        _cleanup_fclose_ FILE *f = NULL;
+        size_t allocated = 0, size, allocated_entries = 0, n_entries = 0;
+        struct stat st_before, st_after;
+        struct dirent *de;
+        DeviceDbHeader *h;
+        int r;
+
+        if (db_map_get(NULL) >= 0)
+                return 0;
+
+        if (stat(DEVICE_DB_DIR, &st_before) < 0)
+                return errno == ENOENT ? 0 : -errno;
+
+        /* Changes of the directory are detected by its mtime, which has the granularity of a timer tick. Let's not
+         * take a snapshot right after a change, to make sure the next one results in a different mtime. */
+        if (now(CLOCK_REALTIME) < timespec_load(&st_before.st_mtim) + USEC_PER_SEC)
+                return -EAGAIN;
+
+        dir = opendir(DEVICE_DB_DIR);
+        if (!dir)
+                return -errno;
+
+        size = sizeof(DeviceDbHeader);
+        if (!GREEDY_REALLOC0(buf, allocated, size))
+                return -ENOMEM;
+
+        FOREACH_DIRENT(de, dir, return -errno) {
+                _cleanup_free_ char *path = NULL, *text = NULL;
+                size_t text_size, id_size, data_size;
+
+                path = strjoin(DEVICE_DB_DIR "/", de->d_name);
+                if (!path)
+                        return -ENOMEM;
+
+                r = read_full_file(path, &text, &text_size);
+                if (r == -ENOENT)
+                        continue;
+                if (r < 0)
+                        return r;
+
+                id_size = strlen(de->d_name) + 1;
+
+                if (!GREEDY_REALLOC(buf, allocated, size + id_size + text_size))
+                        return -ENOMEM;
+                if (!GREEDY_REALLOC(entries, allocated_entries, n_entries + 1))
+                        return -ENOMEM;
+
+                memcpy(buf + size, de->d_name, id_size);
+                data_size = db_records_from_text(text, text_size, buf + size + id_size);
+
+                entries[n_entries++] = (DeviceDbEntry) {
+                        .id_offset = size,
+                        .data_offset = size + id_size,
+                        .data_size = data_size,
+                };
+
+                size += id_size + data_size;
+        }
+
+        typesafe_qsort_r(entries, n_entries, entry_compare, buf);
+
+        if (!GREEDY_REALLOC0(buf, allocated, ALIGN8(size) + n_entries * sizeof(DeviceDbEntry)))
+                return -ENOMEM;
+
+        memzero(buf + size, ALIGN8(size) - size);
+        size = ALIGN8(size);
+        memcpy_safe(buf + size, entries, n_entries * sizeof(DeviceDbEntry));
+
+        h = (DeviceDbHeader*) buf;
+        memcpy(h->signature, signature, sizeof(signature));
+        h->header_size = sizeof(DeviceDbHeader);
+        h->valid = 1;
+        h->entries_offset = size;
+        h->n_entries = n_entries;
+        size += n_entries * sizeof(DeviceDbEntry);
+        h->file_size = size;
+
+        r = fopen_temporary(DEVICE_DB_BINARY_PATH, &f, &path_tmp);
+        if (r < 0)
+                return r;
+
+        if (fchmod(fileno(f), 0644) < 0) {
+                r = -errno;
+                goto fail;
+        }
+
+        fwrite(buf, 1, size, f);
+
+        r = fflush_and_check(f);
+        if (r < 0)
+                goto fail;
+
+        if (rename(path_tmp, DEVICE_DB_BINARY_PATH) < 0) {
+                r = -errno;
+                goto fail;
+        }
+
+        /* Whoever changed the directory while we were reading it might have invalidated the previous snapshot
+         * before ours replaced it. */
+        if (stat(DEVICE_DB_DIR, &st_after) < 0 || !db_dir_unchanged(&st_before, &st_after)) {
+                device_db_binary_invalidate();
+                return -ESTALE;
+        }
+
+        return 1;
+
+fail:
+        (void) unlink(path_tmp);
+        return r;
+}
+
+void device_db_binary_invalidate(void) {
+        static const uint32_t valid = 0;
+        _cleanup_close_ int fd = -1;
+
+        fd = open(DEVICE_DB_BINARY_PATH, O_WRONLY|O_CLOEXEC|O_NOCTTY);
+        if (fd < 0)
+                return;
+
+        (void) pwrite(fd, &valid, sizeof(valid), offsetof(DeviceDbHeader, valid));
+        (void) unlink(DEVICE_DB_BINARY_PATH);
+}
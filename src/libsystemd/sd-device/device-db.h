@@ -0,0 +1,21 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+#pragma once
+
+#include <stddef.h>
+
+/* A snapshot of all files in /run/udev/data/ in one file, which is mapped by readers instead of reading and parsing
+ * the file of each device. The text files stay authoritative, and the snapshot is only used while it is valid. */
+#define DEVICE_DB_BINARY_PATH "/run/udev/data.bin"
+
+/* Returns 1 and the records of the device, each of them a key character followed by the NUL terminated value, if
+ * the device has a database entry, 0 if it has none, and a negative errno if there is no valid snapshot. */
+int device_db_binary_get(const char *id, const char **ret_data, size_t *ret_size);
+
+/* Writes a new snapshot of /run/udev/data/, unless the current one is still valid */
+int device_db_binary_update(void);
+
+/* The snapshot is mapped once per thread, and unmapped when the thread exits, or earlier by calling this */
+void device_db_binary_unmap(void);
+
+/* Must be called after modifying anything in /run/udev/data/ */
+void device_db_binary_invalidate(void);
@@ -1,8 +1,13 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+
 #include "sd-device.h"
 
 #include "alloc-util.h"
+#include "device-db.h"
 #include "device-enumerator-private.h"
 #include "device-util.h"
 #include "dirent-util.h"
@@ -13,6 +18,7 @@
 #include "util.h"
 
 #define DEVICE_ENUMERATE_MAX_DEPTH 256
+#define DEVICE_ENUMERATE_MAX_THREADS 16
 
 typedef enum DeviceEnumerationType {
         DEVICE_ENUMERATION_TYPE_DEVICES,
@@ -38,8 +44,28 @@ struct sd_device_enumerator {
         Set *match_tag;
         sd_device *match_parent;
         bool match_allow_uninitialized;
+
+        unsigned n_threads;
 };
 
+/* The subsystem directories below one directory in /sys, which are scanned by multiple threads */
+typedef struct ScanJobs {
+        sd_device_enumerator *enumerator;
+        const char *basedir;
+        const char *subdir;
+        char **dirs;
+        size_t n_dirs;
+        size_t next; /* the next directory to scan, increased atomically */
+} ScanJobs;
+
+typedef struct ScanThread {
+        ScanJobs *jobs;
+        pthread_t thread;
+        sd_device **devices;
+        size_t n_devices, n_allocated;
+        int r;
+} ScanThread;
+
 _public_ int sd_device_enumerator_new(sd_device_enumerator **ret) {
         _cleanup_(sd_device_enumerator_unrefp) sd_device_enumerator *enumerator = NULL;
 
@@ -52,6 +78,7 @@ _public_ int sd_device_enumerator_new(sd_device_enumerator **ret) {
         *enumerator = (sd_device_enumerator) {
                 .n_ref = 1,
                 .type = _DEVICE_ENUMERATION_TYPE_INVALID,
+                .n_threads = 1,
         };
 
         *ret = TAKE_PTR(enumerator);
@@ -249,6 +276,23 @@ int device_enumerator_add_match_is_initialized(sd_device_enumerator *enumerator)
         return 0;
 }
 
+int device_enumerator_set_n_threads(sd_device_enumerator *enumerator, unsigned n_threads) {
+        assert_return(enumerator, -EINVAL);
+
+        if (n_threads == 0) {
+                cpu_set_t cpu_set;
+
+                if (sched_getaffinity(0, sizeof(cpu_set), &cpu_set) < 0)
+                        return -errno;
+
+                n_threads = CPU_COUNT(&cpu_set);
+        }
+
+        enumerator->n_threads = CLAMP(n_threads, 1U, (unsigned) DEVICE_ENUMERATE_MAX_THREADS);
+
+        return 0;
+}
+
 static int device_compare(sd_device * const *_a, sd_device * const *_b) {
         sd_device *a = *(sd_device **)_a, *b = *(sd_device **)_b;
         const char *devpath_a, *devpath_b, *sound_a;
@@ -301,6 +345,71 @@ static int device_compare(sd_device * const *_a, sd_device * const *_b) {
         return strcmp(devpath_a, devpath_b);
 }
 
+static size_t devices_run_end(sd_device **devices, size_t start, size_t n) {
+        size_t i;
+
+        for (i = start + 1; i < n; i++)
+                if (device_compare(devices + i - 1, devices + i) > 0)
+                        break;
+
+        return i;
+}
+
+static void devices_merge(sd_device **a, size_t n_a, sd_device **b, size_t n_b, sd_device **ret) {
+        while (n_a > 0 && n_b > 0)
+                if (device_compare(b, a) < 0) {
+                        *(ret++) = *(b++);
+                        n_b--;
+                } else {
+                        *(ret++) = *(a++);
+                        n_a--;
+                }
+
+        memcpy_safe(ret, a, n_a * sizeof(sd_device*));
+        memcpy_safe(ret + n_a, b, n_b * sizeof(sd_device*));
+}
+
+/* Devices are added in runs which are sorted already: those of each scanning thread, and often the entries of a
+ * directory. This merges neighbouring runs until only one is left, hence it is cheap when there are only few. */
+static void device_enumerator_sort_devices(sd_device_enumerator *enumerator) {
+        _cleanup_free_ sd_device **buf = NULL;
+        sd_device **src, **dst;
+        size_t n, n_runs;
+
+        assert(enumerator);
+
+        n = enumerator->n_devices;
+        if (devices_run_end(enumerator->devices, 0, n) >= n)
+                return;
+
+        buf = new(sd_device*, n);
+        if (!buf) {
+                typesafe_qsort(enumerator->devices, n, device_compare);
+                return;
+        }
+
+        src = enumerator->devices;
+        dst = buf;
+        do {
+                size_t i = 0;
+
+                for (n_runs = 0; i < n; n_runs++) {
+                        size_t mid, end;
+
+                        mid = devices_run_end(src, i, n);
+                        end = mid < n ? devices_run_end(src, mid, n) : n;
+
+                        devices_merge(src + i, mid - i, src + mid, end - mid, dst + i);
+                        i = end;
+                }
+
+                SWAP_TWO(src, dst);
+        } while (n_runs > 1);
+
+        if (src != enumerator->devices)
+                memcpy(enumerator->devices, src, n * sizeof(sd_device*));
+}
+
 int device_enumerator_add_device(sd_device_enumerator *enumerator, sd_device *device) {
         assert_return(enumerator, -EINVAL);
         assert_return(device, -EINVAL);
@@ -313,6 +422,18 @@ int device_enumerator_add_device(sd_device_enumerator *enumerator, sd_device *de
         return 0;
 }
 
+static int scan_thread_add_device(ScanThread *thread, sd_device *device) {
+        assert(thread);
+        assert(device);
+
+        if (!GREEDY_REALLOC(thread->devices, thread->n_allocated, thread->n_devices + 1))
+                return -ENOMEM;
+
+        thread->devices[thread->n_devices++] = sd_device_ref(device);
+
+        return 0;
+}
+
 static bool match_sysattr_value(sd_device *device, const char *sysattr, const char *match_value) {
         const char *value;
         int r;
@@ -434,7 +555,9 @@ static bool match_sysname(sd_device_enumerator *enumerator, const char *sysname)
         return false;
 }
 
-static int enumerator_scan_dir_and_add_devices(sd_device_enumerator *enumerator, const char *basedir, const char *subdir1, const char *subdir2) {
+/* Adds the devices to the thread, if it is not NULL, and to the enumerator otherwise */
+static int enumerator_scan_dir_and_add_devices(sd_device_enumerator *enumerator, ScanThread *thread,
+                                               const char *basedir, const char *subdir1, const char *subdir2) {
         _cleanup_closedir_ DIR *dir = NULL;
         char *path;
         struct dirent *dent;
@@ -477,6 +600,10 @@ static int enumerator_scan_dir_and_add_devices(sd_device_enumerator *enumerator,
                         continue;
                 }
 
+                /* this is cheap, unlike the checks below, which need the database or sysfs attributes */
+                if (!match_parent(enumerator, device))
+                        continue;
+
                 initialized = sd_device_get_is_initialized(device);
                 if (initialized < 0) {
                         r = initialized;
@@ -499,9 +626,6 @@ static int enumerator_scan_dir_and_add_devices(sd_device_enumerator *enumerator,
                      sd_device_get_ifindex(device, NULL) >= 0))
                         continue;
 
-                if (!match_parent(enumerator, device))
-                        continue;
-
                 if (!match_tag(enumerator, device))
                         continue;
 
@@ -511,7 +635,10 @@ static int enumerator_scan_dir_and_add_devices(sd_device_enumerator *enumerator,
                 if (!match_sysattr(enumerator, device))
                         continue;
 
-                k = device_enumerator_add_device(enumerator, device);
+                if (thread)
+                        k = scan_thread_add_device(thread, device);
+                else
+                        k = device_enumerator_add_device(enumerator, device);
                 if (k < 0)
                         r = k;
         }
@@ -519,6 +646,93 @@ static int enumerator_scan_dir_and_add_devices(sd_device_enumerator *enumerator,
         return r;
 }
 
+static void *scan_thread(void *userdata) {
+        ScanThread *thread = userdata;
+        ScanJobs *jobs = thread->jobs;
+        size_t i;
+
+        while ((i = __sync_fetch_and_add(&jobs->next, 1)) < jobs->n_dirs) {
+                int k;
+
+                k = enumerator_scan_dir_and_add_devices(jobs->enumerator, thread, jobs->basedir, jobs->dirs[i], jobs->subdir);
+                if (k < 0)
+                        thread->r = k;
+        }
+
+        /* sort in parallel too, so that device_enumerator_sort_devices() only needs to merge */
+        typesafe_qsort(thread->devices, thread->n_devices, device_compare);
+
+        device_db_binary_unmap();
+
+        return NULL;
+}
+
+static int enumerator_scan_dirs_parallel(sd_device_enumerator *enumerator, const char *basedir, const char *subdir, char **dirs) {
+        _cleanup_free_ ScanThread *threads = NULL;
+        ScanJobs jobs = {
+                .enumerator = enumerator,
+                .basedir = basedir,
+                .subdir = subdir,
+                .dirs = dirs,
+                .n_dirs = strv_length(dirs),
+        };
+        sigset_t ss, saved_ss;
+        unsigned n_threads, n_started = 1, i;
+        int r = 0, k;
+
+        n_threads = MIN(enumerator->n_threads, jobs.n_dirs);
+        threads = new0(ScanThread, n_threads);
+        if (!threads)
+                return -ENOMEM;
+
+        for (i = 0; i < n_threads; i++)
+                threads[i].jobs = &jobs;
+
+        /* Like asynchronous_job(), start the threads with all signals blocked, so that they do not get any. The
+         * calling thread scans too, hence if a thread cannot be started, the others do its work. */
+        if (sigfillset(&ss) >= 0 && pthread_sigmask(SIG_BLOCK, &ss, &saved_ss) == 0) {
+                for (; n_started < n_threads; n_started++) {
+                        k = pthread_create(&threads[n_started].thread, NULL, scan_thread, threads + n_started);
+                        if (k != 0) {
+                                log_debug_errno(k, "sd-device-enumerator: Failed to start scanning thread, ignoring: %m");
+                                break;
+                        }
+                }
+
+                assert_se(pthread_sigmask(SIG_SETMASK, &saved_ss, NULL) == 0);
+        }
+
+        log_debug("sd-device-enumerator: Scanning %zu directories in /sys/%s with %u threads", jobs.n_dirs, basedir, n_started);
+
+        (void) scan_thread(threads);
+
+        for (i = 1; i < n_started; i++)
+                assert_se(pthread_join(threads[i].thread, NULL) == 0);
+
+        for (i = 0; i < n_started; i++) {
+                ScanThread *t = threads + i;
+
+                if (t->r < 0)
+                        r = t->r;
+
+                if (GREEDY_REALLOC(enumerator->devices, enumerator->n_allocated, enumerator->n_devices + t->n_devices)) {
+                        memcpy_safe(enumerator->devices + enumerator->n_devices, t->devices, t->n_devices * sizeof(sd_device*));
+                        enumerator->n_devices += t->n_devices;
+                } else {
+                        size_t j;
+
+                        for (j = 0; j < t->n_devices; j++)
+                                sd_device_unref(t->devices[j]);
+
+                        r = -ENOMEM;
+                }
+
+                free(t->devices);
+        }
+
+        return r;
+}
+
 static bool match_subsystem(sd_device_enumerator *enumerator, const char *subsystem) {
         const char *subsystem_match;
         Iterator i;
@@ -544,6 +758,7 @@ static bool match_subsystem(sd_device_enumerator *enumerator, const char *subsys
 
 static int enumerator_scan_dir(sd_device_enumerator *enumerator, const char *basedir, const char *subdir, const char *subsystem) {
         _cleanup_closedir_ DIR *dir = NULL;
+        _cleanup_strv_free_ char **dirs = NULL;
         char *path;
         struct dirent *dent;
         int r = 0;
@@ -565,7 +780,22 @@ static int enumerator_scan_dir(sd_device_enumerator *enumerator, const char *bas
                 if (!match_subsystem(enumerator, subsystem ? : dent->d_name))
                         continue;
 
-                k = enumerator_scan_dir_and_add_devices(enumerator, basedir, dent->d_name, subdir);
+                if (enumerator->n_threads > 1) {
+                        if (strv_extend(&dirs, dent->d_name) < 0)
+                                return -ENOMEM;
+
+                        continue;
+                }
+
+                k = enumerator_scan_dir_and_add_devices(enumerator, NULL, basedir, dent->d_name, subdir);
+                if (k < 0)
+                        r = k;
+        }
+
+        if (!strv_isempty(dirs)) {
+                int k;
+
+                k = enumerator_scan_dirs_parallel(enumerator, basedir, subdir, dirs);
                 if (k < 0)
                         r = k;
         }
@@ -846,7 +1076,7 @@ int device_enumerator_scan_devices(sd_device_enumerator *enumerator) {
                         r = k;
         }
 
-        typesafe_qsort(enumerator->devices, enumerator->n_devices, device_compare);
+        device_enumerator_sort_devices(enumerator);
         device_enumerator_dedup_devices(enumerator);
 
         enumerator->scan_uptodate = true;
@@ -901,7 +1131,7 @@ int device_enumerator_scan_subsystems(sd_device_enumerator *enumerator) {
 
         /* modules */
         if (match_subsystem(enumerator, "module")) {
-                k = enumerator_scan_dir_and_add_devices(enumerator, "module", NULL, NULL);
+                k = enumerator_scan_dir_and_add_devices(enumerator, NULL, "module", NULL, NULL);
                 if (k < 0) {
                         log_debug_errno(k, "sd-device-enumerator: Failed to scan modules: %m");
                         r = k;
@@ -915,7 +1145,7 @@ int device_enumerator_scan_subsystems(sd_device_enumerator *enumerator) {
 
         /* subsystems (only buses support coldplug) */
         if (match_subsystem(enumerator, "subsystem")) {
-                k = enumerator_scan_dir_and_add_devices(enumerator, subsysdir, NULL, NULL);
+                k = enumerator_scan_dir_and_add_devices(enumerator, NULL, subsysdir, NULL, NULL);
                 if (k < 0) {
                         log_debug_errno(k, "sd-device-enumerator: Failed to scan subsystems: %m");
                         r = k;
@@ -931,7 +1161,7 @@ int device_enumerator_scan_subsystems(sd_device_enumerator *enumerator) {
                 }
         }
 
-        typesafe_qsort(enumerator->devices, enumerator->n_devices, device_compare);
+        device_enumerator_sort_devices(enumerator);
         device_enumerator_dedup_devices(enumerator);
 
         enumerator->scan_uptodate = true;
@@ -11,6 +11,9 @@ typedef enum MonitorNetlinkGroup {
         _MONITOR_NETLINK_GROUP_INVALID = -1,
 } MonitorNetlinkGroup;
 
+/* Called with all devices which passed the filter out of a batch of messages read with one recvmmsg() call */
+typedef int (*device_monitor_batch_handler_t)(sd_device_monitor *m, sd_device **devices, size_t n_devices, void *userdata);
+
 int device_monitor_new_full(sd_device_monitor **ret, MonitorNetlinkGroup group, int fd);
 int device_monitor_disconnect(sd_device_monitor *m);
 int device_monitor_allow_unicast_sender(sd_device_monitor *m, sd_device_monitor *sender);
@@ -18,3 +21,4 @@ int device_monitor_enable_receiving(sd_device_monitor *m);
 int device_monitor_get_fd(sd_device_monitor *m);
 int device_monitor_send_device(sd_device_monitor *m, sd_device_monitor *destination, sd_device *device);
 int device_monitor_receive_device(sd_device_monitor *m, sd_device **ret);
+int device_monitor_start_batch(sd_device_monitor *m, device_monitor_batch_handler_t callback, void *userdata);
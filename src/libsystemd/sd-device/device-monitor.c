@@ -1,6 +1,7 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 
 #include <errno.h>
+#include <fnmatch.h>
 #include <linux/filter.h>
 #include <linux/netlink.h>
 #include <sys/socket.h>
@@ -15,6 +16,7 @@
 #include "device-util.h"
 #include "fd-util.h"
 #include "format-util.h"
+#include "glob-util.h"
 #include "hashmap.h"
 #include "io-util.h"
 #include "missing.h"
@@ -34,16 +36,28 @@ struct sd_device_monitor {
 
         Hashmap *subsystem_filter;
         Set *tag_filter;
+        Hashmap *property_filter;
         bool filter_uptodate;
 
         sd_event *event;
         sd_event_source *event_source;
         sd_device_monitor_handler_t callback;
+        device_monitor_batch_handler_t batch_callback;
         void *userdata;
+
+        struct MonitorReceiveBatch *receive_batch;
 };
 
 #define UDEV_MONITOR_MAGIC                0xfeedcafe
 
+/* The number of bits of the bloom filter over the properties of a device, and how many of them are set for each */
+#define PROPERTY_BLOOM_WORDS 16U
+#define PROPERTY_BLOOM_BITS (PROPERTY_BLOOM_WORDS * 32U)
+#define PROPERTY_BLOOM_HASHES 3U
+
+/* How many messages to read with a single recvmmsg() call when dispatching the event source */
+#define RECEIVE_BATCH_SIZE 16U
+
 typedef struct monitor_netlink_header {
         /* "libudev" prefix to distinguish libudev and kernel messages */
         char prefix[8];
@@ -61,8 +75,31 @@ typedef struct monitor_netlink_header {
         unsigned filter_devtype_hash;
         unsigned filter_tag_bloom_hi;
         unsigned filter_tag_bloom_lo;
+        /* Bloom filter over the "KEY=value" strings of all properties, appended later, hence subscribers need to
+         * check header_size before using it; values need to be stored in network order */
+        unsigned filter_property_bloom[PROPERTY_BLOOM_WORDS];
 } monitor_netlink_header;
 
+typedef union MonitorMessageBuffer {
+        monitor_netlink_header nlh;
+        char raw[8192];
+} MonitorMessageBuffer;
+
+typedef struct MonitorReceiveSlot {
+        MonitorMessageBuffer buf;
+        union {
+                struct cmsghdr cmsghdr;
+                uint8_t buf[CMSG_SPACE(sizeof(struct ucred))];
+        } control;
+        union sockaddr_union snl;
+} MonitorReceiveSlot;
+
+typedef struct MonitorReceiveBatch {
+        struct mmsghdr messages[RECEIVE_BATCH_SIZE];
+        struct iovec iovecs[RECEIVE_BATCH_SIZE];
+        MonitorReceiveSlot slots[RECEIVE_BATCH_SIZE];
+} MonitorReceiveBatch;
+
 static int monitor_set_nl_address(sd_device_monitor *m) {
         union sockaddr_union snl;
         socklen_t addrlen;
@@ -185,22 +222,43 @@ _public_ int sd_device_monitor_stop(sd_device_monitor *m) {
         return 0;
 }
 
+static int device_monitor_receive_batch(sd_device_monitor *m, sd_device **devices, size_t *ret_n_devices);
+
 static int device_monitor_event_handler(sd_event_source *s, int fd, uint32_t revents, void *userdata) {
-        _cleanup_(sd_device_unrefp) sd_device *device = NULL;
+        _cleanup_(sd_device_monitor_unrefp) sd_device_monitor *ref = NULL;
+        sd_device *devices[RECEIVE_BATCH_SIZE];
         sd_device_monitor *m = userdata;
+        size_t n_devices = 0, i;
+        int r = 0;
 
         assert(m);
 
-        if (device_monitor_receive_device(m, &device) <= 0)
+        if (device_monitor_receive_batch(m, devices, &n_devices) < 0 || n_devices == 0)
                 return 0;
 
-        if (m->callback)
-                return m->callback(m, device, m->userdata);
+        /* The callback might drop the last reference to the monitor, or stop it */
+        ref = sd_device_monitor_ref(m);
 
-        return 0;
+        if (m->batch_callback)
+                r = m->batch_callback(m, devices, n_devices, m->userdata);
+        else if (m->callback)
+                for (i = 0; i < n_devices; i++) {
+                        r = m->callback(m, devices[i], m->userdata);
+                        if (r < 0 || !m->event_source)
+                                break;
+                }
+
+        for (i = 0; i < n_devices; i++)
+                sd_device_unref(devices[i]);
+
+        return r;
 }
 
-_public_ int sd_device_monitor_start(sd_device_monitor *m, sd_device_monitor_handler_t callback, void *userdata) {
+static int device_monitor_start_internal(
+                sd_device_monitor *m,
+                sd_device_monitor_handler_t callback,
+                device_monitor_batch_handler_t batch_callback,
+                void *userdata) {
         int r;
 
         assert_return(m, -EINVAL);
@@ -218,6 +276,7 @@ _public_ int sd_device_monitor_start(sd_device_monitor *m, sd_device_monitor_han
         }
 
         m->callback = callback;
+        m->batch_callback = batch_callback;
         m->userdata = userdata;
 
         r = sd_event_add_io(m->event, &m->event_source, m->sock, EPOLLIN, device_monitor_event_handler, m);
@@ -229,6 +288,14 @@ _public_ int sd_device_monitor_start(sd_device_monitor *m, sd_device_monitor_han
         return 0;
 }
 
+_public_ int sd_device_monitor_start(sd_device_monitor *m, sd_device_monitor_handler_t callback, void *userdata) {
+        return device_monitor_start_internal(m, callback, NULL, userdata);
+}
+
+int device_monitor_start_batch(sd_device_monitor *m, device_monitor_batch_handler_t callback, void *userdata) {
+        return device_monitor_start_internal(m, NULL, callback, userdata);
+}
+
 _public_ int sd_device_monitor_detach_event(sd_device_monitor *m) {
         assert_return(m, -EINVAL);
 
@@ -302,6 +369,8 @@ static sd_device_monitor *device_monitor_free(sd_device_monitor *m) {
 
         hashmap_free_free_free(m->subsystem_filter);
         set_free_free(m->tag_filter);
+        hashmap_free_free_free(m->property_filter);
+        free(m->receive_batch);
 
         return mfree(m);
 }
@@ -309,7 +378,7 @@ static sd_device_monitor *device_monitor_free(sd_device_monitor *m) {
 DEFINE_PUBLIC_TRIVIAL_REF_UNREF_FUNC(sd_device_monitor, sd_device_monitor, device_monitor_free);
 
 static int passes_filter(sd_device_monitor *m, sd_device *device) {
-        const char *tag, *subsystem, *devtype, *s, *d = NULL;
+        const char *tag, *subsystem, *devtype, *property, *value, *s, *d = NULL;
         Iterator i;
         int r;
 
@@ -345,68 +414,69 @@ static int passes_filter(sd_device_monitor *m, sd_device *device) {
 
 tag:
         if (set_isempty(m->tag_filter))
-                return 1;
+                goto property;
 
         SET_FOREACH(tag, m->tag_filter, i)
                 if (sd_device_has_tag(device, tag) > 0)
-                        return 1;
+                        goto property;
+
+        return 0;
+
+property:
+        if (hashmap_isempty(m->property_filter))
+                return 1;
+
+        HASHMAP_FOREACH_KEY(value, property, m->property_filter, i) {
+                const char *property_dev, *value_dev;
+
+                FOREACH_DEVICE_PROPERTY(device, property_dev, value_dev) {
+                        if (fnmatch(property, property_dev, 0) != 0)
+                                continue;
+
+                        /* Without a value, the property only needs to be set */
+                        if (!value || fnmatch(value, value_dev, 0) == 0)
+                                return 1;
+                }
+        }
 
         return 0;
 }
 
-int device_monitor_receive_device(sd_device_monitor *m, sd_device **ret) {
+static int device_monitor_parse_message(
+                sd_device_monitor *m,
+                const struct msghdr *smsg,
+                MonitorMessageBuffer *buf,
+                ssize_t buflen,
+                sd_device **ret) {
+
         _cleanup_(sd_device_unrefp) sd_device *device = NULL;
-        union {
-                monitor_netlink_header nlh;
-                char raw[8192];
-        } buf;
-        struct iovec iov = {
-                .iov_base = &buf,
-                .iov_len = sizeof(buf)
-        };
-        char cred_msg[CMSG_SPACE(sizeof(struct ucred))];
-        union sockaddr_union snl;
-        struct msghdr smsg = {
-                .msg_iov = &iov,
-                .msg_iovlen = 1,
-                .msg_control = cred_msg,
-                .msg_controllen = sizeof(cred_msg),
-                .msg_name = &snl,
-                .msg_namelen = sizeof(snl),
-        };
+        const union sockaddr_union *snl = smsg->msg_name;
         struct cmsghdr *cmsg;
         struct ucred *cred;
-        ssize_t buflen, bufpos;
+        ssize_t bufpos;
         bool is_initialized = false;
         int r;
 
         assert(ret);
 
-        buflen = recvmsg(m->sock, &smsg, 0);
-        if (buflen < 0) {
-                if (errno != EINTR)
-                        log_debug_errno(errno, "sd-device-monitor: Failed to receive message: %m");
-                return -errno;
-        }
-
-        if (buflen < 32 || (smsg.msg_flags & MSG_TRUNC))
+        if (buflen < 32 || (smsg->msg_flags & MSG_TRUNC))
                 return log_debug_errno(SYNTHETIC_ERRNO(EINVAL),
                                        "sd-device-monitor: Invalid message length.");
 
-        if (snl.nl.nl_groups == MONITOR_GROUP_NONE) {
+        if (snl->nl.nl_groups == MONITOR_GROUP_NONE) {
                 /* unicast message, check if we trust the sender */
                 if (m->snl_trusted_sender.nl.nl_pid == 0 ||
-                    snl.nl.nl_pid != m->snl_trusted_sender.nl.nl_pid)
+                    snl->nl.nl_pid != m->snl_trusted_sender.nl.nl_pid)
                         return log_debug_errno(SYNTHETIC_ERRNO(EAGAIN),
                                                "sd-device-monitor: Unicast netlink message ignored.");
 
-        } else if (snl.nl.nl_groups == MONITOR_GROUP_KERNEL) {
-                if (snl.nl.nl_pid > 0)
+        } else if (snl->nl.nl_groups == MONITOR_GROUP_KERNEL) {
+                if (snl->nl.nl_pid > 0)
                         return log_debug_errno(SYNTHETIC_ERRNO(EAGAIN),
-                                               "sd-device-monitor: Multicast kernel netlink message from PID %"PRIu32" ignored.", snl.nl.nl_pid);
+                                               "sd-device-monitor: Multicast kernel netlink message from PID %"PRIu32" ignored.", snl->nl.nl_pid);
         }
 
-        cmsg = CMSG_FIRSTHDR(&smsg);
+        cmsg = CMSG_FIRSTHDR(smsg);
         if (!cmsg || cmsg->cmsg_type != SCM_CREDENTIALS)
                 return log_debug_errno(SYNTHETIC_ERRNO(EAGAIN),
                                        "sd-device-monitor: No sender credentials received, message ignored.");
@@ -416,37 +486,37 @@ int device_monitor_receive_device(sd_device_monitor *m, sd_device **ret) {
                 return log_debug_errno(SYNTHETIC_ERRNO(EAGAIN),
                                        "sd-device-monitor: Sender uid="UID_FMT", message ignored.", cred->uid);
 
-        if (streq(buf.raw, "libudev")) {
+        if (streq(buf->raw, "libudev")) {
                 /* udev message needs proper version magic */
-                if (buf.nlh.magic != htobe32(UDEV_MONITOR_MAGIC))
+                if (buf->nlh.magic != htobe32(UDEV_MONITOR_MAGIC))
                         return log_debug_errno(SYNTHETIC_ERRNO(EAGAIN),
                                                "sd-device-monitor: Invalid message signature (%x != %x)",
-                                               buf.nlh.magic, htobe32(UDEV_MONITOR_MAGIC));
+                                               buf->nlh.magic, htobe32(UDEV_MONITOR_MAGIC));
 
-                if (buf.nlh.properties_off+32 > (size_t) buflen)
+                if (buf->nlh.properties_off+32 > (size_t) buflen)
                         return log_debug_errno(SYNTHETIC_ERRNO(EAGAIN),
                                                "sd-device-monitor: Invalid message length (%u > %zd)",
-                                               buf.nlh.properties_off+32, buflen);
+                                               buf->nlh.properties_off+32, buflen);
 
-                bufpos = buf.nlh.properties_off;
+                bufpos = buf->nlh.properties_off;
 
                 /* devices received from udev are always initialized */
                 is_initialized = true;
 
         } else {
                 /* kernel message with header */
-                bufpos = strlen(buf.raw) + 1;
+                bufpos = strlen(buf->raw) + 1;
                 if ((size_t) bufpos < sizeof("a@/d") || bufpos >= buflen)
                         return log_debug_errno(SYNTHETIC_ERRNO(EAGAIN),
                                                "sd-device-monitor: Invalid message length");
 
                 /* check message header */
-                if (!strstr(buf.raw, "@/"))
+                if (!strstr(buf->raw, "@/"))
                         return log_debug_errno(SYNTHETIC_ERRNO(EAGAIN),
                                                "sd-device-monitor: Invalid message header");
         }
 
-        r = device_new_from_nulstr(&device, (uint8_t*) &buf.raw[bufpos], buflen - bufpos);
+        r = device_new_from_nulstr(&device, (uint8_t*) &buf->raw[bufpos], buflen - bufpos);
         if (r < 0)
                 return log_debug_errno(r, "sd-device-monitor: Failed to create device from received message: %m");
 
@@ -465,6 +535,89 @@ int device_monitor_receive_device(sd_device_monitor *m, sd_device **ret) {
         return r;
 }
 
+int device_monitor_receive_device(sd_device_monitor *m, sd_device **ret) {
+        MonitorMessageBuffer buf;
+        struct iovec iov = {
+                .iov_base = &buf,
+                .iov_len = sizeof(buf)
+        };
+        char cred_msg[CMSG_SPACE(sizeof(struct ucred))];
+        union sockaddr_union snl;
+        struct msghdr smsg = {
+                .msg_iov = &iov,
+                .msg_iovlen = 1,
+                .msg_control = cred_msg,
+                .msg_controllen = sizeof(cred_msg),
+                .msg_name = &snl,
+                .msg_namelen = sizeof(snl),
+        };
+        ssize_t buflen;
+
+        assert(ret);
+
+        buflen = recvmsg(m->sock, &smsg, 0);
+        if (buflen < 0) {
+                if (errno != EINTR)
+                        log_debug_errno(errno, "sd-device-monitor: Failed to receive message: %m");
+                return -errno;
+        }
+
+        return device_monitor_parse_message(m, &smsg, &buf, buflen, ret);
+}
+
+/* Reads up to RECEIVE_BATCH_SIZE messages at once, and returns the devices which passed the filter */
+static int device_monitor_receive_batch(sd_device_monitor *m, sd_device **devices, size_t *ret_n_devices) {
+        MonitorReceiveBatch *b;
+        size_t n_devices = 0;
+        unsigned i;
+        int n;
+
+        assert(m);
+        assert(devices);
+        assert(ret_n_devices);
+
+        if (!m->receive_batch) {
+                m->receive_batch = new(MonitorReceiveBatch, 1);
+                if (!m->receive_batch)
+                        return -ENOMEM;
+        }
+
+        b = m->receive_batch;
+
+        /* The kernel updates the lengths in place, hence reset all slots before each call */
+        for (i = 0; i < RECEIVE_BATCH_SIZE; i++) {
+                b->iovecs[i] = IOVEC_MAKE(&b->slots[i].buf, sizeof(b->slots[i].buf));
+                b->messages[i] = (struct mmsghdr) {
+                        .msg_hdr = {
+                                .msg_iov = b->iovecs + i,
+                                .msg_iovlen = 1,
+                                .msg_control = &b->slots[i].control,
+                                .msg_controllen = sizeof(b->slots[i].control),
+                                .msg_name = &b->slots[i].snl,
+                                .msg_namelen = sizeof(b->slots[i].snl),
+                        },
+                };
+        }
+
+        n = recvmmsg(m->sock, b->messages, RECEIVE_BATCH_SIZE, MSG_DONTWAIT, NULL);
+        if (n < 0) {
+                if (!IN_SET(errno, EINTR, EAGAIN))
+                        log_debug_errno(errno, "sd-device-monitor: Failed to receive messages: %m");
+                return -errno;
+        }
+
+        for (i = 0; i < (unsigned) n; i++) {
+                sd_device *device = NULL;
+
+                if (device_monitor_parse_message(m, &b->messages[i].msg_hdr, &b->slots[i].buf,
+                                                 b->messages[i].msg_len, &device) > 0)
+                        devices[n_devices++] = device;
+        }
+
+        *ret_n_devices = n_devices;
+        return n;
+}
+
 static uint32_t string_hash32(const char *str) {
         return MurmurHash2(str, strlen(str), 0);
 }
@@ -481,6 +634,18 @@ static uint64_t string_bloom64(const char *str) {
         return bits;
 }
 
+/* Sets PROPERTY_BLOOM_HASHES bits for the "KEY=value" string of a property in the bloom filter */
+static void property_bloom_add(uint32_t bloom[static PROPERTY_BLOOM_WORDS], const char *str, size_t len) {
+        uint32_t hash = MurmurHash2(str, len, 0);
+        unsigned k;
+
+        for (k = 0; k < PROPERTY_BLOOM_HASHES; k++) {
+                unsigned bit = (hash >> (k * 9)) % PROPERTY_BLOOM_BITS;
+
+                bloom[bit / 32] |= UINT32_C(1) << (bit % 32);
+        }
+}
+
 int device_monitor_send_device(
                 sd_device_monitor *m,
                 sd_device_monitor *destination,
@@ -503,10 +668,12 @@ int device_monitor_send_device(
                 .nl.nl_family = AF_NETLINK,
                 .nl.nl_groups = MONITOR_GROUP_UDEV,
         };
+        uint32_t property_bloom[PROPERTY_BLOOM_WORDS] = {};
         uint64_t tag_bloom_bits;
-        const char *buf, *val;
+        const char *buf, *val, *p;
         ssize_t count;
         size_t blen;
+        unsigned w;
         int r;
 
         assert(m);
@@ -539,6 +706,18 @@ int device_monitor_send_device(
                 nlh.filter_tag_bloom_lo = htobe32(tag_bloom_bits & 0xffffffff);
         }
 
+        /* add property bloom filter, the entries of the properties list are exactly the "KEY=value" strings */
+        for (p = buf; p < buf + blen; ) {
+                size_t l = strnlen(p, buf + blen - p);
+
+                if (l > 0)
+                        property_bloom_add(property_bloom, p, l);
+                p += l + 1;
+        }
+
+        for (w = 0; w < PROPERTY_BLOOM_WORDS; w++)
+                nlh.filter_property_bloom[w] = htobe32(property_bloom[w]);
+
         /* add properties list */
         nlh.properties_off = iov[0].iov_len;
         nlh.properties_len = blen;
@@ -584,10 +763,28 @@ static void bpf_jmp(struct sock_filter *ins, unsigned *i,
         };
 }
 
+/* Returns the number of words of the property bloom filter which need to match for the property */
+static unsigned property_bloom_masks(const char *property, const char *value, uint32_t masks[static PROPERTY_BLOOM_WORDS]) {
+        unsigned w, n = 0;
+        const char *s;
+
+        s = strjoina(property, "=", value);
+
+        memzero(masks, PROPERTY_BLOOM_WORDS * sizeof(uint32_t));
+        property_bloom_add(masks, s, strlen(s));
+
+        for (w = 0; w < PROPERTY_BLOOM_WORDS; w++)
+                if (masks[w] != 0)
+                        n++;
+
+        return n;
+}
+
 _public_ int sd_device_monitor_filter_update(sd_device_monitor *m) {
         struct sock_filter ins[512] = {};
         struct sock_fprog filter;
-        const char *subsystem, *devtype, *tag;
+        const char *subsystem, *devtype, *tag, *property, *value;
+        bool property_bpf;
         unsigned i = 0;
         Iterator it;
 
@@ -597,11 +794,21 @@ _public_ int sd_device_monitor_filter_update(sd_device_monitor *m) {
                 return 0;
 
         if (hashmap_isempty(m->subsystem_filter) &&
-            set_isempty(m->tag_filter)) {
+            set_isempty(m->tag_filter) &&
+            hashmap_isempty(m->property_filter)) {
                 m->filter_uptodate = true;
                 return 0;
         }
 
+        /* Only exact property matches can be checked against the bloom filter, if there is any other match, all
+         * property matches are left to userspace */
+        property_bpf = !hashmap_isempty(m->property_filter);
+        HASHMAP_FOREACH_KEY(value, property, m->property_filter, it)
+                if (!value || string_is_glob(property) || string_is_glob(value)) {
+                        property_bpf = false;
+                        break;
+                }
+
         /* load magic in A */
         bpf_stmt(ins, &i, BPF_LD|BPF_W|BPF_ABS, offsetof(monitor_netlink_header, magic));
         /* jump if magic matches */
@@ -638,6 +845,54 @@ _public_ int sd_device_monitor_filter_update(sd_device_monitor *m) {
                 bpf_stmt(ins, &i, BPF_RET|BPF_K, 0);
         }
 
+        if (property_bpf) {
+                uint32_t masks[PROPERTY_BLOOM_WORDS];
+                unsigned len = 0, left;
+
+                HASHMAP_FOREACH_KEY(value, property, m->property_filter, it)
+                        len += property_bloom_masks(property, value, masks) * 3 + 1;
+
+                if (i + 3 + len + 1 >= ELEMENTSOF(ins))
+                        return -E2BIG;
+
+                /* load header size in A, which is stored in host byte order */
+                bpf_stmt(ins, &i, BPF_LD|BPF_W|BPF_ABS, offsetof(monitor_netlink_header, header_size));
+                /* jump if the sender provides the property bloom filter */
+                bpf_jmp(ins, &i, BPF_JMP|BPF_JEQ|BPF_K, be32toh(sizeof(monitor_netlink_header)), 1, 0);
+                /* otherwise jump behind end of property match block */
+                bpf_stmt(ins, &i, BPF_JMP|BPF_JA, len + 1);
+
+                /* add all property matches */
+                left = len;
+                HASHMAP_FOREACH_KEY(value, property, m->property_filter, it) {
+                        unsigned n, w;
+
+                        n = property_bloom_masks(property, value, masks);
+                        left -= n * 3 + 1;
+
+                        for (w = 0; w < PROPERTY_BLOOM_WORDS; w++) {
+                                if (masks[w] == 0)
+                                        continue;
+
+                                n--;
+
+                                /* load device bloom bits in A */
+                                bpf_stmt(ins, &i, BPF_LD|BPF_W|BPF_ABS,
+                                         offsetof(monitor_netlink_header, filter_property_bloom) + w * sizeof(unsigned));
+                                /* clear bits (property bits & bloom bits) */
+                                bpf_stmt(ins, &i, BPF_ALU|BPF_AND|BPF_K, masks[w]);
+                                /* jump to next property if it does not match */
+                                bpf_jmp(ins, &i, BPF_JMP|BPF_JEQ|BPF_K, masks[w], 0, n * 3 + 1);
+                        }
+
+                        /* jump behind end of property match block if property matches */
+                        bpf_stmt(ins, &i, BPF_JMP|BPF_JA, left + 1);
+                }
+
+                /* nothing matched, drop packet */
+                bpf_stmt(ins, &i, BPF_RET|BPF_K, 0);
+        }
+
         /* add all subsystem matches */
         if (!hashmap_isempty(m->subsystem_filter)) {
                 HASHMAP_FOREACH_KEY(devtype, subsystem, m->subsystem_filter, it) {
@@ -742,6 +997,37 @@ _public_ int sd_device_monitor_filter_add_match_tag(sd_device_monitor *m, const
         return 0;
 }
 
+_public_ int sd_device_monitor_filter_add_match_property(sd_device_monitor *m, const char *property, const char *value) {
+        _cleanup_free_ char *p = NULL, *v = NULL;
+        int r;
+
+        assert_return(m, -EINVAL);
+        assert_return(property, -EINVAL);
+
+        p = strdup(property);
+        if (!p)
+                return -ENOMEM;
+
+        if (value) {
+                v = strdup(value);
+                if (!v)
+                        return -ENOMEM;
+        }
+
+        r = hashmap_ensure_allocated(&m->property_filter, NULL);
+        if (r < 0)
+                return r;
+
+        r = hashmap_put(m->property_filter, p, v);
+        if (r < 0)
+                return r;
+
+        p = v = NULL;
+        m->filter_uptodate = false;
+
+        return 0;
+}
+
 _public_ int sd_device_monitor_filter_remove(sd_device_monitor *m) {
         static const struct sock_fprog filter = { 0, NULL };
 
@@ -749,6 +1035,7 @@ _public_ int sd_device_monitor_filter_remove(sd_device_monitor *m) {
 
         m->subsystem_filter = hashmap_free_free_free(m->subsystem_filter);
         m->tag_filter = set_free_free(m->tag_filter);
+        m->property_filter = hashmap_free_free_free(m->property_filter);
 
         if (setsockopt(m->sock, SOL_SOCKET, SO_ATTACH_FILTER, &filter, sizeof(filter)) < 0)
                 return -errno;
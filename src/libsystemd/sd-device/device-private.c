@@ -7,6 +7,7 @@
 #include "sd-device.h"
 
 #include "alloc-util.h"
+#include "device-db.h"
 #include "device-internal.h"
 #include "device-private.h"
 #include "device-util.h"
@@ -160,9 +161,9 @@ int device_ensure_usec_initialized(sd_device *device, sd_device *device_old) {
 static int device_read_db(sd_device *device) {
         _cleanup_free_ char *db = NULL;
         char *path;
-        const char *id, *value;
+        const char *id, *value, *records, *p;
         char key;
-        size_t db_len;
+        size_t db_len, records_size;
         unsigned i;
         int r;
 
@@ -183,6 +184,27 @@ static int device_read_db(sd_device *device) {
         if (r < 0)
                 return r;
 
+        r = device_db_binary_get(id, &records, &records_size);
+        if (r >= 0) {
+                if (r == 0)
+                        return 0;
+
+                device_set_is_initialized(device);
+
+                for (p = records; p < records + records_size; p += strlen(p) + 1) {
+                        if (isempty(p))
+                                continue;
+
+                        r = handle_db_line(device, p[0], p + 1);
+                        if (r < 0)
+                                log_device_debug_errno(device, r, "sd-device: Failed to handle db entry '%c:%s', ignoring: %m", p[0], p + 1);
+                }
+
+                device->db_loaded = true;
+
+                return 0;
+        }
+
         path = strjoina("/run/udev/data/", id);
 
         r = read_full_file(path, &db, &db_len);
@@ -1014,9 +1036,14 @@ int device_update_db(sd_device *device) {
         /* do not store anything for otherwise empty devices */
         if (!has_info && major(device->devnum) == 0 && device->ifindex == 0) {
                 r = unlink(path);
-                if (r < 0 && errno != ENOENT)
-                        return -errno;
+                if (r < 0) {
+                        if (errno != ENOENT)
+                                return -errno;
+
+                        return 0;
+                }
 
+                device_db_binary_invalidate();
                 return 0;
         }
 
@@ -1084,6 +1111,8 @@ int device_update_db(sd_device *device) {
                 goto fail;
         }
 
+        device_db_binary_invalidate();
+
         log_device_debug(device, "sd-device: Created %s file '%s' for '%s'", has_info ? "db" : "empty",
                          path, device->devpath);
 
@@ -1092,6 +1121,7 @@ int device_update_db(sd_device *device) {
 fail:
         (void) unlink(path);
         (void) unlink(path_tmp);
+        device_db_binary_invalidate();
 
         return log_device_debug_errno(device, r, "sd-device: Failed to create %s file '%s' for '%s'", has_info ? "db" : "empty", path, device->devpath);
 }
@@ -1110,9 +1140,14 @@ int device_delete_db(sd_device *device) {
         path = strjoina("/run/udev/data/", id);
 
         r = unlink(path);
-        if (r < 0 && errno != ENOENT)
-                return -errno;
+        if (r < 0) {
+                if (errno != ENOENT)
+                        return -errno;
+
+                return 0;
+        }
 
+        device_db_binary_invalidate();
         return 0;
 }
 
@@ -20,6 +20,13 @@ int device_get_devnode_mode(sd_device *device, mode_t *mode);
 int device_get_devnode_uid(sd_device *device, uid_t *uid);
 int device_get_devnode_gid(sd_device *device, gid_t *gid);
 
+/* Returns -ENOENT if the attribute is not cached, and 0 with a NULL value if it is cached as missing */
+int device_get_cached_sysattr_value(sd_device *device, const char *sysattr, const char **ret_value);
+/* Takes the value on success, NULL caches the attribute as missing */
+int device_cache_sysattr_value(sd_device *device, const char *sysattr, char *value);
+/* Reads the attributes which are not cached yet, through one file descriptor of the sysfs directory */
+int device_prefetch_sysattrs(sd_device *device, const char * const *sysattrs, size_t n_sysattrs);
+
 void device_seal(sd_device *device);
 void device_set_is_initialized(sd_device *device);
 void device_set_watch_handle(sd_device *device, int fd);
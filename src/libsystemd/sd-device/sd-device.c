@@ -7,6 +7,7 @@
 #include "sd-device.h"
 
 #include "alloc-util.h"
+#include "device-db.h"
 #include "device-internal.h"
 #include "device-private.h"
 #include "device-util.h"
@@ -1283,9 +1284,9 @@ int device_get_id_filename(sd_device *device, const char **ret) {
 int device_read_db_aux(sd_device *device, bool force) {
         _cleanup_free_ char *db = NULL;
         char *path;
-        const char *id, *value;
+        const char *id, *value, *records, *p;
         char key;
-        size_t db_len;
+        size_t db_len, records_size;
         unsigned i;
         int r;
 
@@ -1306,6 +1307,26 @@ int device_read_db_aux(sd_device *device, bool force) {
         if (r < 0)
                 return r;
 
+        /* the binary snapshot, if it is valid, saves reading and parsing the file */
+        r = device_db_binary_get(id, &records, &records_size);
+        if (r >= 0) {
+                if (r == 0)
+                        return 0;
+
+                device->is_initialized = true;
+
+                for (p = records; p < records + records_size; p += strlen(p) + 1) {
+                        if (isempty(p))
+                                continue;
+
+                        r = handle_db_line(device, p[0], p + 1);
+                        if (r < 0)
+                                log_device_debug_errno(device, r, "sd-device: Failed to handle db entry '%c:%s', ignoring: %m", p[0], p + 1);
+                }
+
+                return 0;
+        }
+
         path = strjoina("/run/udev/data/", id);
 
         r = read_full_file(path, &db, &db_len);
@@ -1735,41 +1756,27 @@ static int device_get_sysattr_value(sd_device *device, const char *_key, const c
         return 0;
 }
 
-/* We cache all sysattr lookups. If an attribute does not exist, it is stored
- * with a NULL value in the cache, otherwise the returned string is stored */
-_public_ int sd_device_get_sysattr_value(sd_device *device, const char *sysattr, const char **_value) {
-        _cleanup_free_ char *value = NULL;
-        const char *syspath, *cached_value = NULL;
-        char *path;
-        struct stat statbuf;
-        int r;
-
-        assert_return(device, -EINVAL);
-        assert_return(sysattr, -EINVAL);
-
-        /* look for possibly already cached result */
-        r = device_get_sysattr_value(device, sysattr, &cached_value);
-        if (r != -ENOENT) {
-                if (r < 0)
-                        return r;
+int device_get_cached_sysattr_value(sd_device *device, const char *sysattr, const char **ret_value) {
+        assert(device);
+        assert(sysattr);
 
-                if (!cached_value)
-                        /* we looked up the sysattr before and it did not exist */
-                        return -ENOENT;
+        return device_get_sysattr_value(device, sysattr, ret_value);
+}
 
-                if (_value)
-                        *_value = cached_value;
+int device_cache_sysattr_value(sd_device *device, const char *sysattr, char *value) {
+        assert(device);
+        assert(sysattr);
 
-                return 0;
-        }
+        return device_add_sysattr_value(device, sysattr, value);
+}
 
-        r = sd_device_get_syspath(device, &syspath);
-        if (r < 0)
-                return r;
+/* Reads the attribute at path, which is relative to dir_fd, and adds it to the cache */
+static int device_read_sysattr_value(sd_device *device, int dir_fd, const char *path, const char *sysattr, const char **ret_value) {
+        _cleanup_free_ char *value = NULL;
+        struct stat statbuf;
+        int r;
 
-        path = strjoina(syspath, "/", sysattr);
-        r = lstat(path, &statbuf);
-        if (r < 0) {
+        if (fstatat(dir_fd, path, &statbuf, AT_SYMLINK_NOFOLLOW) < 0) {
                 /* remember that we could not access the sysattr */
                 r = device_add_sysattr_value(device, sysattr, NULL);
                 if (r < 0)
@@ -1780,9 +1787,15 @@ _public_ int sd_device_get_sysattr_value(sd_device *device, const char *sysattr,
                 /* Some core links return only the last element of the target path,
                  * these are just values, the paths should not be exposed. */
                 if (STR_IN_SET(sysattr, "driver", "subsystem", "module")) {
-                        r = readlink_value(path, &value);
+                        _cleanup_free_ char *target = NULL;
+
+                        r = readlinkat_malloc(dir_fd, path, &target);
                         if (r < 0)
                                 return r;
+
+                        value = strdup(basename(target));
+                        if (!value)
+                                return -ENOMEM;
                 } else
                         return -EINVAL;
         } else if (S_ISDIR(statbuf.st_mode)) {
@@ -1792,10 +1805,21 @@ _public_ int sd_device_get_sysattr_value(sd_device *device, const char *sysattr,
                 /* skip non-readable files */
                 return -EPERM;
         } else {
+                _cleanup_fclose_ FILE *f = NULL;
+                _cleanup_close_ int fd = -1;
                 size_t size;
 
                 /* read attribute value */
-                r = read_full_file(path, &value, &size);
+                fd = openat(dir_fd, path, O_RDONLY|O_CLOEXEC|O_NOCTTY);
+                if (fd < 0)
+                        return -errno;
+
+                f = fdopen(fd, "re");
+                if (!f)
+                        return -errno;
+                fd = -1;
+
+                r = read_full_stream(f, &value, &size);
                 if (r < 0)
                         return r;
 
@@ -1808,7 +1832,77 @@ _public_ int sd_device_get_sysattr_value(sd_device *device, const char *sysattr,
         if (r < 0)
                 return r;
 
-        *_value = TAKE_PTR(value);
+        if (ret_value)
+                *ret_value = value;
+        value = NULL;
+
+        return 0;
+}
+
+/* We cache all sysattr lookups. If an attribute does not exist, it is stored
+ * with a NULL value in the cache, otherwise the returned string is stored */
+_public_ int sd_device_get_sysattr_value(sd_device *device, const char *sysattr, const char **_value) {
+        const char *syspath, *cached_value = NULL;
+        char *path;
+        int r;
+
+        assert_return(device, -EINVAL);
+        assert_return(sysattr, -EINVAL);
+
+        /* look for possibly already cached result */
+        r = device_get_sysattr_value(device, sysattr, &cached_value);
+        if (r != -ENOENT) {
+                if (r < 0)
+                        return r;
+
+                if (!cached_value)
+                        /* we looked up the sysattr before and it did not exist */
+                        return -ENOENT;
+
+                if (_value)
+                        *_value = cached_value;
+
+                return 0;
+        }
+
+        r = sd_device_get_syspath(device, &syspath);
+        if (r < 0)
+                return r;
+
+        path = strjoina(syspath, "/", sysattr);
+
+        return device_read_sysattr_value(device, AT_FDCWD, path, sysattr, _value);
+}
+
+int device_prefetch_sysattrs(sd_device *device, const char * const *sysattrs, size_t n_sysattrs) {
+        _cleanup_close_ int dir_fd = -1;
+        size_t i;
+        int r;
+
+        assert(device);
+        assert(sysattrs || n_sysattrs == 0);
+
+        for (i = 0; i < n_sysattrs; i++) {
+                if (device_get_sysattr_value(device, sysattrs[i], NULL) != -ENOENT)
+                        continue;
+
+                /* resolve the path of the device only once, instead of for each attribute */
+                if (dir_fd < 0) {
+                        const char *syspath;
+
+                        r = sd_device_get_syspath(device, &syspath);
+                        if (r < 0)
+                                return r;
+
+                        dir_fd = open(syspath, O_PATH|O_DIRECTORY|O_CLOEXEC);
+                        if (dir_fd < 0)
+                                return -errno;
+                }
+
+                r = device_read_sysattr_value(device, dir_fd, sysattrs[i], sysattrs[i], NULL);
+                if (r < 0 && r != -ENOENT)
+                        log_device_debug_errno(device, r, "sd-device: Failed to read sysattr '%s', ignoring: %m", sysattrs[i]);
+        }
 
         return 0;
 }
@@ -102,6 +102,84 @@ static void test_subsystem_filter(sd_device *device) {
         assert_se(sd_event_loop(sd_device_monitor_get_event(monitor_client)) == 0);
 }
 
+static void test_property_filter(sd_device *device, const char *property, const char *value, bool use_bpf) {
+        _cleanup_(sd_device_monitor_unrefp) sd_device_monitor *monitor_server = NULL, *monitor_client = NULL;
+        _cleanup_(sd_device_enumerator_unrefp) sd_device_enumerator *e = NULL;
+        const char *syspath, *subsystem;
+        sd_device *d;
+
+        log_info("/* %s(%s=%s, use_bpf=%s) */", __func__, property, strnull(value), true_false(use_bpf));
+
+        assert_se(sd_device_get_syspath(device, &syspath) >= 0);
+        assert_se(sd_device_get_subsystem(device, &subsystem) >= 0);
+
+        assert_se(device_monitor_new_full(&monitor_server, MONITOR_GROUP_NONE, -1) >= 0);
+        assert_se(sd_device_monitor_start(monitor_server, NULL, NULL) >= 0);
+        assert_se(sd_event_source_set_description(sd_device_monitor_get_event_source(monitor_server), "sender") >= 0);
+
+        assert_se(device_monitor_new_full(&monitor_client, MONITOR_GROUP_NONE, -1) >= 0);
+        assert_se(device_monitor_allow_unicast_sender(monitor_client, monitor_server) >= 0);
+        assert_se(sd_device_monitor_start(monitor_client, monitor_handler, (void *) syspath) >= 0);
+        assert_se(sd_event_source_set_description(sd_device_monitor_get_event_source(monitor_client), "receiver") >= 0);
+
+        assert_se(sd_device_monitor_filter_add_match_property(monitor_client, property, value) >= 0);
+        if (use_bpf)
+                assert_se(sd_device_monitor_filter_update(monitor_client) >= 0);
+
+        /* None of these has the property */
+        assert_se(sd_device_enumerator_new(&e) >= 0);
+        assert_se(sd_device_enumerator_add_match_subsystem(e, subsystem, false) >= 0);
+        FOREACH_DEVICE(e, d) {
+                assert_se(device_add_property(d, "ACTION", "add") >= 0);
+                assert_se(device_add_property(d, "SEQNUM", "10") >= 0);
+                assert_se(device_monitor_send_device(monitor_server, monitor_client, d) >= 0);
+        }
+
+        assert_se(device_add_property(device, "TEST_MONITOR_PROPERTY", "yes") >= 0);
+        assert_se(device_monitor_send_device(monitor_server, monitor_client, device) >= 0);
+        assert_se(device_add_property(device, "TEST_MONITOR_PROPERTY", NULL) >= 0);
+
+        assert_se(sd_event_loop(sd_device_monitor_get_event(monitor_client)) == 0);
+}
+
+#define N_BATCH_DEVICES 40U
+
+static int monitor_batch_handler(sd_device_monitor *m, sd_device **devices, size_t n_devices, void *userdata) {
+        size_t *n_received = userdata;
+
+        log_info("Received batch of %zu devices", n_devices);
+
+        assert_se(n_devices > 0);
+        assert_se(*n_received + n_devices <= N_BATCH_DEVICES);
+
+        *n_received += n_devices;
+        if (*n_received == N_BATCH_DEVICES)
+                return sd_event_exit(sd_device_monitor_get_event(m), 0);
+
+        return 0;
+}
+
+static void test_batch(sd_device *device) {
+        _cleanup_(sd_device_monitor_unrefp) sd_device_monitor *monitor_server = NULL, *monitor_client = NULL;
+        size_t n_received = 0;
+        unsigned i;
+
+        log_info("/* %s */", __func__);
+
+        assert_se(device_monitor_new_full(&monitor_server, MONITOR_GROUP_NONE, -1) >= 0);
+        assert_se(sd_device_monitor_start(monitor_server, NULL, NULL) >= 0);
+
+        assert_se(device_monitor_new_full(&monitor_client, MONITOR_GROUP_NONE, -1) >= 0);
+        assert_se(device_monitor_allow_unicast_sender(monitor_client, monitor_server) >= 0);
+        assert_se(device_monitor_start_batch(monitor_client, monitor_batch_handler, &n_received) >= 0);
+
+        for (i = 0; i < N_BATCH_DEVICES; i++)
+                assert_se(device_monitor_send_device(monitor_server, monitor_client, device) >= 0);
+
+        assert_se(sd_event_loop(sd_device_monitor_get_event(monitor_client)) == 0);
+        assert_se(n_received == N_BATCH_DEVICES);
+}
+
 int main(int argc, char *argv[]) {
         _cleanup_(sd_device_unrefp) sd_device *loopback = NULL, *sda = NULL;
         int r;
@@ -130,6 +208,13 @@ int main(int argc, char *argv[]) {
 
         test_subsystem_filter(loopback);
 
+        test_property_filter(loopback, "TEST_MONITOR_PROPERTY", "yes", false);
+        test_property_filter(loopback, "TEST_MONITOR_PROPERTY", "yes", true);
+        test_property_filter(loopback, "TEST_MONITOR_*", "y*", true);
+        test_property_filter(loopback, "TEST_MONITOR_PROPERTY", NULL, true);
+
+        test_batch(loopback);
+
         r = sd_device_new_from_subsystem_sysname(&sda, "block", "sda");
         if (r < 0) {
                 log_info_errno(r, "Failed to create sd_device for sda, skipping remaining tests: %m");
@@ -1,6 +1,7 @@
 #pragma once
 /* SPDX-License-Identifier: LGPL-2.1+ */
 
+#include <pthread.h>
 #include <sys/epoll.h>
 #include <sys/timerfd.h>
 #include <sys/wait.h>
@@ -26,6 +27,8 @@ typedef enum EventSourceType {
         SOURCE_EXIT,
         SOURCE_WATCHDOG,
         SOURCE_INOTIFY,
+        SOURCE_READ,
+        SOURCE_WORK,
         _SOURCE_EVENT_SOURCE_TYPE_MAX,
         _SOURCE_EVENT_SOURCE_TYPE_INVALID = -1
 } EventSourceType;
@@ -38,12 +41,34 @@ typedef enum WakeupType {
         WAKEUP_CLOCK_DATA,
         WAKEUP_SIGNAL_DATA,
         WAKEUP_INOTIFY_DATA,
+        WAKEUP_URING_DATA,
+        WAKEUP_WORK_DATA,
         _WAKEUP_TYPE_MAX,
         _WAKEUP_TYPE_INVALID = -1,
 } WakeupType;
 
 struct inode_data;
 
+/* An operation submitted to the io_uring of the event loop. The address of this object is the user data of the
+ * submission, hence it is only freed when the final completion for it has been received, which may be well after the
+ * event source it was submitted for is gone. */
+typedef struct EventUringOp EventUringOp;
+
+struct EventUringOp {
+        sd_event_source *source; /* NULL once the event source is gone and the operation is being cancelled */
+        void *buffer;            /* for reads, owned by the operation until it completed */
+        bool cancelled;
+
+        LIST_FIELDS(EventUringOp, ops);
+};
+
+typedef enum WorkState {
+        WORK_IDLE,
+        WORK_QUEUED,   /* waiting for a worker thread */
+        WORK_RUNNING,  /* the work function is being executed */
+        WORK_FINISHED, /* waiting for the event loop to pick up the result */
+} WorkState;
+
 struct sd_event_source {
         WakeupType wakeup;
 
@@ -60,15 +85,27 @@ struct sd_event_source {
         bool pending:1;
         bool dispatching:1;
         bool floating:1;
+        bool from_pool:1;
 
         int64_t priority;
         unsigned pending_index;
         unsigned prepare_index;
         uint64_t pending_iteration;
         uint64_t prepare_iteration;
+        uint64_t dispatch_iteration;
 
         sd_event_destroy_t destroy_callback;
 
+        /* Only maintained while profiling is enabled for the event loop, see sd_event_set_profile() */
+        struct {
+                uint64_t n_dispatched;
+                usec_t dispatch_usec;
+                usec_t dispatch_max_usec;
+                usec_t pending_usec;
+                usec_t pending_max_usec;
+                usec_t pending_since;
+        } profile;
+
         LIST_FIELDS(sd_event_source, sources);
 
         union {
@@ -79,12 +116,15 @@ struct sd_event_source {
                         uint32_t revents;
                         bool registered:1;
                         bool owned:1;
+                        EventUringOp *uring_op; /* the poll, if watched through the io_uring */
                 } io;
                 struct {
                         sd_event_time_handler_t callback;
                         usec_t next, accuracy;
                         unsigned earliest_index;
                         unsigned latest_index;
+                        unsigned wheel_slot;
+                        LIST_FIELDS(sd_event_source, wheel);
                 } time;
                 struct {
                         sd_event_signal_handler_t callback;
@@ -96,6 +136,9 @@ struct sd_event_source {
                         siginfo_t siginfo;
                         pid_t pid;
                         int options;
+                        int pidfd;
+                        bool registered:1; /* whether the pidfd is in the epoll set */
+                        bool exited:1;     /* whether the child has been reaped already */
                 } child;
                 struct {
                         sd_event_handler_t callback;
@@ -113,9 +156,40 @@ struct sd_event_source {
                         struct inode_data *inode_data;
                         LIST_FIELDS(sd_event_source, by_inode_data);
                 } inotify;
+                struct {
+                        sd_event_read_handler_t callback;
+                        int fd;
+                        size_t size;
+                        int flags;
+                        bool recv:1;
+                        void *buffer;   /* the data of the last completed read */
+                        ssize_t result; /* its size, or a negative errno */
+
+                        /* With the io_uring the reads are submitted to the kernel, otherwise we wait for a
+                         * duplicate of the fd to become readable and read in the dispatch. Regular files can't be
+                         * watched, they are always considered readable. */
+                        EventUringOp *uring_op;
+                        int epoll_fd;
+                        bool registered:1;
+                        bool always_ready:1;
+                } read;
+                struct {
+                        sd_event_work_handler_t work;
+                        sd_event_work_done_handler_t callback;
+
+                        /* These are shared with the worker threads, and protected by the mutex of the pool */
+                        WorkState state;
+                        int result;
+                        LIST_FIELDS(sd_event_source, work_queue);
+                } work;
         };
 };
 
+#define TIMER_WHEEL_SLOT_USEC (UINT64_C(1) << 17) /* ~131ms, must stay below DEFAULT_ACCURACY_USEC */
+#define TIMER_WHEEL_SLOTS 512U                    /* ~67s */
+#define TIMER_WHEEL_SLOT_NULL ((unsigned) -1)
+#define TIMER_WHEEL_MIN_SOURCES 64U
+
 struct clock_data {
         WakeupType wakeup;
         int fd;
@@ -131,6 +205,18 @@ struct clock_data {
         Prioq *latest;
         usec_t next;
 
+        /* Once there are many time sources, the enabled ones with an accuracy of at least TIMER_WHEEL_SLOT_USEC
+         * that are due within the next TIMER_WHEEL_SLOTS slots are kept in a timing wheel instead, so that
+         * rescheduling them is O(1). The slot of an absolute slot number k is k % TIMER_WHEEL_SLOTS, and the
+         * wheel covers the slot numbers [wheel_base, wheel_base + TIMER_WHEEL_SLOTS). Disabled and pending time
+         * sources that leave the wheel are in neither the wheel nor the prioqs until they are enabled again. */
+        sd_event_source **wheel;
+        uint64_t wheel_used[TIMER_WHEEL_SLOTS / 64];
+        uint64_t wheel_base;
+        unsigned n_wheel;
+
+        unsigned n_sources;
+
         bool needs_rearm:1;
 };
 
@@ -204,3 +290,26 @@ struct inotify_data {
          * to make it efficient to figure out what inotify objects to process data on next. */
         LIST_FIELDS(struct inotify_data, buffered);
 };
+
+#define WORK_THREADS_MAX 16U
+
+/* The threads executing the work functions of work sources, created on demand. Everything else about the event loop
+ * is only ever touched from the thread running it. Finished work is handed back through the eventfd. */
+struct work_pool {
+        WakeupType wakeup;
+
+        int fd;
+
+        pthread_mutex_t mutex;
+        pthread_cond_t work_cond;     /* signalled when work got queued, or the pool is going away */
+        pthread_cond_t finished_cond; /* broadcast when work finished */
+
+        pthread_t threads[WORK_THREADS_MAX];
+        unsigned n_threads, n_idle, n_queued;
+        bool dead;
+
+        /* New work is prepended, and the worker threads take it from the tail */
+        LIST_HEAD(sd_event_source, queued);
+        sd_event_source *queued_tail;
+        LIST_HEAD(sd_event_source, finished);
+};
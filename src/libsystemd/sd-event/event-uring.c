@@ -0,0 +1,219 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "alloc-util.h"
+#include "event-uring.h"
+#include "fd-util.h"
+#include "util.h"
+
+#if HAVE_IORING_POLL_ADD_MULTI
+
+/* glibc has no wrappers for these, and the syscall numbers are the same on all architectures but alpha and mips */
+#ifndef __NR_io_uring_setup
+#  if defined __alpha__
+#    define __NR_io_uring_setup 535
+#    define __NR_io_uring_enter 536
+#  elif defined _MIPS_SIM
+#    if _MIPS_SIM == _MIPS_SIM_ABI32
+#      define __NR_io_uring_setup 4425
+#      define __NR_io_uring_enter 4426
+#    endif
+#    if _MIPS_SIM == _MIPS_SIM_NABI32
+#      define __NR_io_uring_setup 6425
+#      define __NR_io_uring_enter 6426
+#    endif
+#    if _MIPS_SIM == _MIPS_SIM_ABI64
+#      define __NR_io_uring_setup 5425
+#      define __NR_io_uring_enter 5426
+#    endif
+#  else
+#    define __NR_io_uring_setup 425
+#    define __NR_io_uring_enter 426
+#  endif
+#endif
+
+struct EventUring {
+        int fd;
+
+        void *ring;
+        size_t ring_size;
+        struct io_uring_sqe *sqes;
+        size_t sqes_size;
+
+        unsigned *sq_head, *sq_tail, *sq_flags, *sq_array;
+        unsigned sq_mask, sq_entries;
+
+        unsigned *cq_head, *cq_tail;
+        unsigned cq_mask;
+        struct io_uring_cqe *cqes;
+
+        /* Our own tail of the submission queue, only made visible to the kernel in event_uring_submit() */
+        unsigned sqe_tail;
+};
+
+#define RING_PTR(u, offset) ((unsigned*) ((uint8_t*) (u)->ring + (offset)))
+
+int event_uring_new(unsigned entries, EventUring **ret) {
+        _cleanup_(event_uring_freep) EventUring *u = NULL;
+        struct io_uring_params p = {};
+        size_t sq_size, cq_size;
+        int fd;
+
+        assert(entries > 0);
+        assert(ret);
+
+        u = new(EventUring, 1);
+        if (!u)
+                return -ENOMEM;
+
+        *u = (EventUring) {
+                .fd = -1,
+                .ring = MAP_FAILED,
+                .sqes = MAP_FAILED,
+        };
+
+        fd = syscall(__NR_io_uring_setup, entries, &p);
+        if (fd < 0)
+                return -errno;
+
+        u->fd = fd_move_above_stdio(fd);
+
+        /* We map both rings at once, and rely on the kernel never dropping completions. Resource tags were added in
+         * the same release as multishot poll (5.13), which has no feature flag of its own. */
+        if ((p.features & (IORING_FEAT_SINGLE_MMAP|IORING_FEAT_NODROP|IORING_FEAT_RSRC_TAGS)) !=
+            (IORING_FEAT_SINGLE_MMAP|IORING_FEAT_NODROP|IORING_FEAT_RSRC_TAGS))
+                return -EOPNOTSUPP;
+
+        sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+        cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+        u->ring_size = MAX(sq_size, cq_size);
+
+        u->ring = mmap(NULL, u->ring_size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, u->fd, IORING_OFF_SQ_RING);
+        if (u->ring == MAP_FAILED)
+                return -errno;
+
+        u->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+        u->sqes = mmap(NULL, u->sqes_size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, u->fd, IORING_OFF_SQES);
+        if (u->sqes == MAP_FAILED)
+                return -errno;
+
+        u->sq_head = RING_PTR(u, p.sq_off.head);
+        u->sq_tail = RING_PTR(u, p.sq_off.tail);
+        u->sq_flags = RING_PTR(u, p.sq_off.flags);
+        u->sq_array = RING_PTR(u, p.sq_off.array);
+        u->sq_mask = *RING_PTR(u, p.sq_off.ring_mask);
+        u->sq_entries = p.sq_entries;
+
+        u->cq_head = RING_PTR(u, p.cq_off.head);
+        u->cq_tail = RING_PTR(u, p.cq_off.tail);
+        u->cq_mask = *RING_PTR(u, p.cq_off.ring_mask);
+        u->cqes = (struct io_uring_cqe*) ((uint8_t*) u->ring + p.cq_off.cqes);
+
+        u->sqe_tail = *u->sq_tail;
+
+        *ret = TAKE_PTR(u);
+        return 0;
+}
+
+EventUring* event_uring_free(EventUring *u) {
+        if (!u)
+                return NULL;
+
+        if (u->sqes != MAP_FAILED)
+                (void) munmap(u->sqes, u->sqes_size);
+        if (u->ring != MAP_FAILED)
+                (void) munmap(u->ring, u->ring_size);
+
+        safe_close(u->fd);
+
+        return mfree(u);
+}
+
+int event_uring_get_fd(EventUring *u) {
+        assert(u);
+
+        return u->fd;
+}
+
+int event_uring_get_sqe(EventUring *u, struct io_uring_sqe **ret) {
+        struct io_uring_sqe *sqe;
+        unsigned i;
+        int r;
+
+        assert(u);
+        assert(ret);
+
+        if (u->sqe_tail - __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE) >= u->sq_entries) {
+                /* The queue is full, hand what we have to the kernel first */
+                r = event_uring_submit(u, 0);
+                if (r < 0)
+                        return r;
+
+                if (u->sqe_tail - __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE) >= u->sq_entries)
+                        return -EBUSY;
+        }
+
+        i = u->sqe_tail & u->sq_mask;
+        sqe = u->sqes + i;
+        memzero(sqe, sizeof(*sqe));
+        u->sq_array[i] = i;
+        u->sqe_tail++;
+
+        *ret = sqe;
+        return 0;
+}
+
+int event_uring_submit(EventUring *u, unsigned wait_nr) {
+        unsigned n;
+        int r;
+
+        assert(u);
+
+        /* Entries the kernel didn't consume in an earlier call are still counted, as its head didn't move past them */
+        n = u->sqe_tail - __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE);
+        if (n == 0 && wait_nr == 0)
+                return 0;
+
+        __atomic_store_n(u->sq_tail, u->sqe_tail, __ATOMIC_RELEASE);
+
+        for (;;) {
+                r = syscall(__NR_io_uring_enter, u->fd, n, wait_nr, wait_nr > 0 ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+                if (r >= 0)
+                        return r;
+                if (errno != EINTR)
+                        return -errno;
+        }
+}
+
+bool event_uring_pop_cqe(EventUring *u, struct io_uring_cqe *ret) {
+        unsigned head;
+
+        assert(u);
+        assert(ret);
+
+        head = *u->cq_head;
+
+        if (head == __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE)) {
+                /* Completions that didn't fit into the queue are kept by the kernel, and only moved over when we
+                 * ask for completions */
+                if (!(__atomic_load_n(u->sq_flags, __ATOMIC_RELAXED) & IORING_SQ_CQ_OVERFLOW))
+                        return false;
+
+                if (syscall(__NR_io_uring_enter, u->fd, 0, 0, IORING_ENTER_GETEVENTS, NULL, 0) < 0)
+                        return false;
+
+                if (head == __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE))
+                        return false;
+        }
+
+        *ret = u->cqes[head & u->cq_mask];
+        __atomic_store_n(u->cq_head, head + 1, __ATOMIC_RELEASE);
+
+        return true;
+}
+
+#endif
@@ -0,0 +1,30 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+#pragma once
+
+#include <stdbool.h>
+
+/* A minimal io_uring submission and completion queue pair, just what sd-event needs. Submission queue entries are
+ * only handed to the kernel by event_uring_submit(), so that any number of operations queued during one event loop
+ * iteration costs a single syscall. */
+
+typedef struct EventUring EventUring;
+
+#if HAVE_IORING_POLL_ADD_MULTI
+#include <linux/io_uring.h>
+
+#include "macro.h"
+
+int event_uring_new(unsigned entries, EventUring **ret);
+EventUring* event_uring_free(EventUring *u);
+DEFINE_TRIVIAL_CLEANUP_FUNC(EventUring*, event_uring_free);
+
+int event_uring_get_fd(EventUring *u);
+
+int event_uring_get_sqe(EventUring *u, struct io_uring_sqe **ret);
+int event_uring_submit(EventUring *u, unsigned wait_nr);
+bool event_uring_pop_cqe(EventUring *u, struct io_uring_cqe *ret);
+#else
+static inline EventUring* event_uring_free(EventUring *u) {
+        return NULL;
+}
+#endif
@@ -1,21 +1,34 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 
+#include <fcntl.h>
+#include <pthread.h>
 #include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
 #include <sys/timerfd.h>
 #include <sys/wait.h>
 
+#if HAVE_PIDFD_OPEN
+#include <sys/pidfd.h>
+#endif
+
 #include "sd-daemon.h"
 #include "sd-event.h"
 #include "sd-id128.h"
 
 #include "alloc-util.h"
+#include "env-util.h"
 #include "event-source.h"
+#include "event-uring.h"
+#include "event-util.h"
 #include "fd-util.h"
 #include "fs-util.h"
 #include "hashmap.h"
 #include "list.h"
 #include "macro.h"
+#include "mempool.h"
 #include "missing.h"
+#include "missing_syscall.h"
 #include "prioq.h"
 #include "process-util.h"
 #include "set.h"
@@ -23,10 +36,16 @@
 #include "string-table.h"
 #include "string-util.h"
 #include "time-util.h"
+#include "usdt.h"
 #include "util.h"
 
 #define DEFAULT_ACCURACY_USEC (250 * USEC_PER_MSEC)
 
+#define URING_ENTRIES 256U
+
+assert_cc(TIMER_WHEEL_SLOT_USEC <= DEFAULT_ACCURACY_USEC);
+assert_cc(TIMER_WHEEL_SLOTS % 64 == 0);
+
 static const char* const event_source_type_table[_SOURCE_EVENT_SOURCE_TYPE_MAX] = {
         [SOURCE_IO] = "io",
         [SOURCE_TIME_REALTIME] = "realtime",
@@ -41,6 +60,8 @@ static const char* const event_source_type_table[_SOURCE_EVENT_SOURCE_TYPE_MAX]
         [SOURCE_EXIT] = "exit",
         [SOURCE_WATCHDOG] = "watchdog",
         [SOURCE_INOTIFY] = "inotify",
+        [SOURCE_READ] = "read",
+        [SOURCE_WORK] = "work",
 };
 
 DEFINE_PRIVATE_STRING_TABLE_LOOKUP_TO_STRING(event_source_type, int);
@@ -85,6 +106,16 @@ struct sd_event {
         /* A list of inotify objects that already have events buffered which aren't processed yet */
         LIST_HEAD(struct inotify_data, inotify_data_buffered);
 
+        /* If enabled with $SD_EVENT_IO_URING, one-shot and edge-triggered I/O sources are watched, and the reads of
+         * read sources are done, through an io_uring, whose fd is part of the epoll set. All operations whose final
+         * completion we haven't seen yet are listed in uring_ops. */
+        EventUring *uring;
+        WakeupType uring_wakeup;
+        LIST_HEAD(EventUringOp, uring_ops);
+
+        /* The worker threads of work sources, allocated when the first work is queued */
+        struct work_pool *work_pool;
+
         pid_t original_pid;
 
         uint64_t iteration;
@@ -95,6 +126,7 @@ struct sd_event {
         bool need_process_child:1;
         bool watchdog:1;
         bool profile_delays:1;
+        bool profile_sources:1;
 
         int exit_code;
 
@@ -103,6 +135,10 @@ struct sd_event {
 
         usec_t watchdog_last, watchdog_period;
 
+        /* How many pending sources, and for how long, to dispatch per iteration, see sd_event_set_dispatch_budget() */
+        unsigned dispatch_budget_n;
+        usec_t dispatch_budget_usec;
+
         unsigned n_sources;
 
         LIST_HEAD(sd_event_source, sources);
@@ -113,8 +149,14 @@ struct sd_event {
 
 static thread_local sd_event *default_event = NULL;
 
+DEFINE_MEMPOOL(event_source_pool, sd_event_source, 64);
+
 static void source_disconnect(sd_event_source *s);
 static void event_gc_inode_data(sd_event *e, struct inode_data *d);
+static int event_setup_uring(sd_event *e);
+static int source_set_pending(sd_event_source *s, bool b);
+static void event_free_uring(sd_event *e);
+static void event_free_work_pool(sd_event *e);
 
 static sd_event *event_resolve(sd_event *e) {
         return e == SD_EVENT_DEFAULT ? default_event : e;
@@ -237,6 +279,7 @@ static void free_clock_data(struct clock_data *d) {
         safe_close(d->fd);
         prioq_free(d->earliest);
         prioq_free(d->latest);
+        free(d->wheel);
 }
 
 static sd_event *event_free(sd_event *e) {
@@ -255,6 +298,9 @@ static sd_event *event_free(sd_event *e) {
         if (e->default_event_ptr)
                 *(e->default_event_ptr) = NULL;
 
+        event_free_uring(e);
+        event_free_work_pool(e);
+
         safe_close(e->epoll_fd);
         safe_close(e->watchdog_fd);
 
@@ -310,6 +356,7 @@ _public_ int sd_event_new(sd_event** ret) {
                 .boottime_alarm.next = USEC_INFINITY,
                 .perturb = USEC_INFINITY,
                 .original_pid = getpid_cached(),
+                .dispatch_budget_n = 1,
         };
 
         r = prioq_ensure_allocated(&e->pending, pending_prioq_compare);
@@ -324,11 +371,20 @@ _public_ int sd_event_new(sd_event** ret) {
 
         e->epoll_fd = fd_move_above_stdio(e->epoll_fd);
 
+        if (getenv_bool_secure("SD_EVENT_IO_URING") > 0) {
+                r = event_setup_uring(e);
+                if (r < 0)
+                        log_debug_errno(r, "Failed to set up io_uring, using epoll only: %m");
+        }
+
         if (secure_getenv("SD_EVENT_PROFILE_DELAYS")) {
                 log_debug("Event loop profiling enabled. Logarithmic histogram of event loop iterations in the range 2^0 ... 2^63 us will be logged every 5s.");
                 e->profile_delays = true;
         }
 
+        if (getenv_bool_secure("SD_EVENT_PROFILE_SOURCES") > 0)
+                e->profile_sources = true;
+
         *ret = e;
         return 0;
 
@@ -348,6 +404,154 @@ static bool event_pid_changed(sd_event *e) {
         return e->original_pid != getpid_cached();
 }
 
+#if HAVE_IORING_POLL_ADD_MULTI
+static int uring_op_new(sd_event_source *s, EventUringOp **ret, struct io_uring_sqe **ret_sqe) {
+        _cleanup_free_ EventUringOp *op = NULL;
+        struct io_uring_sqe *sqe;
+        int r;
+
+        assert(s);
+        assert(s->event->uring);
+        assert(ret);
+        assert(ret_sqe);
+
+        op = new(EventUringOp, 1);
+        if (!op)
+                return -ENOMEM;
+
+        *op = (EventUringOp) {
+                .source = s,
+        };
+
+        r = event_uring_get_sqe(s->event->uring, &sqe);
+        if (r < 0)
+                return r;
+
+        sqe->user_data = (uint64_t) (uintptr_t) op;
+        LIST_PREPEND(ops, s->event->uring_ops, op);
+
+        *ret_sqe = sqe;
+        *ret = TAKE_PTR(op);
+        return 0;
+}
+
+static void uring_op_free(sd_event *e, EventUringOp *op) {
+        assert(e);
+        assert(op);
+
+        LIST_REMOVE(ops, e->uring_ops, op);
+        free(op->buffer);
+        free(op);
+}
+
+static void uring_op_cancel(sd_event *e, EventUringOp **op, bool poll) {
+        struct io_uring_sqe *sqe;
+        int r;
+
+        assert(e);
+        assert(op);
+
+        if (!*op)
+                return;
+
+        /* The operation object stays around until its final completion arrives, but it isn't associated with
+         * the event source anymore. After a fork() the ring is shared with the parent, hence leave it alone. */
+        (*op)->source = NULL;
+
+        if (!event_pid_changed(e)) {
+                r = event_uring_get_sqe(e->uring, &sqe);
+                if (r < 0)
+                        log_debug_errno(r, "Failed to queue cancellation of io_uring operation, ignoring: %m");
+                else {
+                        sqe->opcode = poll ? IORING_OP_POLL_REMOVE : IORING_OP_ASYNC_CANCEL;
+                        sqe->fd = -1;
+                        sqe->addr = (uint64_t) (uintptr_t) *op;
+                        (*op)->cancelled = true;
+                }
+        }
+
+        *op = NULL;
+}
+
+static int source_io_uring_poll(sd_event_source *s, int enabled, uint32_t events) {
+        struct io_uring_sqe *sqe;
+        EventUringOp *op;
+        uint32_t mask;
+        int r;
+
+        assert(s);
+        assert(s->type == SOURCE_IO);
+
+        r = uring_op_new(s, &op, &sqe);
+        if (r < 0)
+                return r;
+
+        /* Multishot polls only report changes, i.e. they are edge-triggered */
+        mask = events & ~EPOLLET;
+#if __BYTE_ORDER == __BIG_ENDIAN
+        mask = mask << 16 | mask >> 16;
+#endif
+
+        sqe->opcode = IORING_OP_POLL_ADD;
+        sqe->fd = s->io.fd;
+        sqe->poll32_events = mask;
+        if (enabled != SD_EVENT_ONESHOT)
+                sqe->len = IORING_POLL_ADD_MULTI;
+
+        uring_op_cancel(s->event, &s->io.uring_op, true);
+        s->io.uring_op = op;
+
+        return 0;
+}
+
+static int source_read_uring_submit(sd_event_source *s) {
+        _cleanup_free_ void *buffer = NULL;
+        struct io_uring_sqe *sqe;
+        EventUringOp *op;
+        int r;
+
+        assert(s);
+        assert(s->type == SOURCE_READ);
+
+        /* Every read gets a buffer of its own, so that the one passed to the last callback stays valid while the
+         * next read is in progress */
+        buffer = malloc(s->read.size);
+        if (!buffer)
+                return -ENOMEM;
+
+        r = uring_op_new(s, &op, &sqe);
+        if (r < 0)
+                return r;
+
+        sqe->fd = s->read.fd;
+        sqe->addr = (uint64_t) (uintptr_t) buffer;
+        sqe->len = s->read.size;
+        if (s->read.recv) {
+                sqe->opcode = IORING_OP_RECV;
+                sqe->msg_flags = s->read.flags;
+        } else {
+                sqe->opcode = IORING_OP_READ;
+                sqe->off = (uint64_t) -1; /* use and update the file position */
+        }
+
+        op->buffer = TAKE_PTR(buffer);
+        s->read.uring_op = op;
+
+        return 0;
+}
+#else
+static void uring_op_cancel(sd_event *e, EventUringOp **op, bool poll) {
+}
+
+static int source_io_uring_poll(sd_event_source *s, int enabled, uint32_t events) {
+        return -EOPNOTSUPP;
+}
+
+static int source_read_uring_submit(sd_event_source *s) {
+        return -EOPNOTSUPP;
+}
+#endif
+
 static void source_io_unregister(sd_event_source *s) {
         int r;
 
@@ -357,6 +561,8 @@ static void source_io_unregister(sd_event_source *s) {
         if (event_pid_changed(s->event))
                 return;
 
+        uring_op_cancel(s->event, &s->io.uring_op, true);
+
         if (!s->io.registered)
                 return;
 
@@ -380,19 +586,376 @@ static int source_io_register(
         assert(s->type == SOURCE_IO);
         assert(enabled != SD_EVENT_OFF);
 
+        /* Level-triggered sources that stay enabled are best served by epoll, as they need no syscall per
+         * iteration at all. For one-shot and edge-triggered ones use the io_uring, if we have one, so that
+         * arming and rearming them is batched with everything else. */
+        if (s->event->uring && (enabled == SD_EVENT_ONESHOT || (events & EPOLLET))) {
+                r = source_io_uring_poll(s, enabled, events);
+                if (r < 0)
+                        return r;
+
+                if (s->io.registered) {
+                        if (epoll_ctl(s->event->epoll_fd, EPOLL_CTL_DEL, s->io.fd, NULL) < 0)
+                                log_debug_errno(errno, "Failed to remove source %s (type %s) from epoll: %m",
+                                                strna(s->description), event_source_type_to_string(s->type));
+
+                        s->io.registered = false;
+                }
+
+                return 0;
+        }
+
+        ev = (struct epoll_event) {
+                .events = events | (enabled == SD_EVENT_ONESHOT ? EPOLLONESHOT : 0),
+                .data.ptr = s,
+        };
+
+        if (s->io.registered)
+                r = epoll_ctl(s->event->epoll_fd, EPOLL_CTL_MOD, s->io.fd, &ev);
+        else
+                r = epoll_ctl(s->event->epoll_fd, EPOLL_CTL_ADD, s->io.fd, &ev);
+        if (r < 0)
+                return -errno;
+
+        s->io.registered = true;
+
+        uring_op_cancel(s->event, &s->io.uring_op, true);
+
+        return 0;
+}
+
+static int source_read_submit(sd_event_source *s) {
+        struct epoll_event ev;
+        int r;
+
+        assert(s);
+        assert(s->type == SOURCE_READ);
+
+        if (s->pending || s->read.uring_op)
+                return 0;
+
+        if (s->event->uring)
+                return source_read_uring_submit(s);
+
+        if (s->read.always_ready)
+                return source_set_pending(s, true);
+
+        ev = (struct epoll_event) {
+                .events = EPOLLIN|EPOLLONESHOT,
+                .data.ptr = s,
+        };
+
+        if (s->read.registered)
+                r = epoll_ctl(s->event->epoll_fd, EPOLL_CTL_MOD, s->read.epoll_fd, &ev);
+        else
+                r = epoll_ctl(s->event->epoll_fd, EPOLL_CTL_ADD, s->read.epoll_fd, &ev);
+        if (r < 0) {
+                if (errno != EPERM || s->read.registered)
+                        return -errno;
+
+                /* Regular files can't be polled, they are always readable */
+                s->read.always_ready = true;
+                return source_set_pending(s, true);
+        }
+
+        s->read.registered = true;
+
+        return 0;
+}
+
+static void source_read_unregister(sd_event_source *s) {
+        assert(s);
+        assert(s->type == SOURCE_READ);
+
+        if (event_pid_changed(s->event))
+                return;
+
+        uring_op_cancel(s->event, &s->read.uring_op, false);
+
+        if (!s->read.registered)
+                return;
+
+        if (epoll_ctl(s->event->epoll_fd, EPOLL_CTL_DEL, s->read.epoll_fd, NULL) < 0)
+                log_debug_errno(errno, "Failed to remove source %s (type %s) from epoll: %m",
+                                strna(s->description), event_source_type_to_string(s->type));
+
+        s->read.registered = false;
+}
+
+static void* work_thread(void *p) {
+        struct work_pool *w = p;
+
+        (void) pthread_setname_np(pthread_self(), "sd-event-work");
+
+        assert_se(pthread_mutex_lock(&w->mutex) == 0);
+
+        for (;;) {
+                sd_event_work_handler_t work;
+                sd_event_source *s;
+                void *userdata;
+                int r;
+
+                while (!w->dead && !w->queued_tail) {
+                        w->n_idle++;
+                        assert_se(pthread_cond_wait(&w->work_cond, &w->mutex) == 0);
+                        w->n_idle--;
+                }
+
+                if (w->dead)
+                        break;
+
+                s = w->queued_tail;
+                w->queued_tail = s->work.work_queue_prev;
+                LIST_REMOVE(work.work_queue, w->queued, s);
+                w->n_queued--;
+
+                s->work.state = WORK_RUNNING;
+                work = s->work.work;
+                userdata = s->userdata;
+
+                assert_se(pthread_mutex_unlock(&w->mutex) == 0);
+                r = work(userdata);
+                assert_se(pthread_mutex_lock(&w->mutex) == 0);
+
+                s->work.result = r;
+                s->work.state = WORK_FINISHED;
+                LIST_PREPEND(work.work_queue, w->finished, s);
+
+                assert_se(pthread_cond_broadcast(&w->finished_cond) == 0);
+                (void) eventfd_write(w->fd, 1);
+        }
+
+        assert_se(pthread_mutex_unlock(&w->mutex) == 0);
+
+        return NULL;
+}
+
+static int work_pool_start_thread(struct work_pool *w) {
+        sigset_t ss, saved_ss;
+        int r, k;
+
+        assert(w);
+        assert(w->n_threads < WORK_THREADS_MAX);
+
+        if (sigfillset(&ss) < 0)
+                return -errno;
+
+        /* No signals in the worker threads please, they are handled by the event loop */
+        r = pthread_sigmask(SIG_BLOCK, &ss, &saved_ss);
+        if (r > 0)
+                return -r;
+
+        r = pthread_create(&w->threads[w->n_threads], NULL, work_thread, w);
+        if (r > 0)
+                r = -r;
+        else
+                w->n_threads++;
+
+        k = pthread_sigmask(SIG_SETMASK, &saved_ss, NULL);
+        if (k > 0 && r >= 0)
+                r = -k;
+
+        return r;
+}
+
+static int event_make_work_pool(sd_event *e) {
+        _cleanup_free_ struct work_pool *w = NULL;
+        struct epoll_event ev;
+        int r;
+
+        assert(e);
+
+        if (e->work_pool)
+                return 0;
+
+        w = new(struct work_pool, 1);
+        if (!w)
+                return -ENOMEM;
+
+        *w = (struct work_pool) {
+                .wakeup = WAKEUP_WORK_DATA,
+                .mutex = PTHREAD_MUTEX_INITIALIZER,
+                .work_cond = PTHREAD_COND_INITIALIZER,
+                .finished_cond = PTHREAD_COND_INITIALIZER,
+        };
+
+        w->fd = eventfd(0, EFD_CLOEXEC|EFD_NONBLOCK);
+        if (w->fd < 0)
+                return -errno;
+
+        w->fd = fd_move_above_stdio(w->fd);
+
+        ev = (struct epoll_event) {
+                .events = EPOLLIN,
+                .data.ptr = w,
+        };
+
+        if (epoll_ctl(e->epoll_fd, EPOLL_CTL_ADD, w->fd, &ev) < 0) {
+                r = -errno;
+                safe_close(w->fd);
+                return r;
+        }
+
+        e->work_pool = TAKE_PTR(w);
+        return 0;
+}
+
+static void event_free_work_pool(sd_event *e) {
+        struct work_pool *w;
+        unsigned i;
+
+        assert(e);
+
+        w = e->work_pool;
+        if (!w)
+                return;
+
+        /* All work sources are gone at this point, hence nothing is queued or running anymore. After a fork() the
+         * threads don't exist in this process. */
+        if (!event_pid_changed(e)) {
+                assert_se(pthread_mutex_lock(&w->mutex) == 0);
+                assert(!w->queued && !w->finished);
+                w->dead = true;
+                assert_se(pthread_cond_broadcast(&w->work_cond) == 0);
+                assert_se(pthread_mutex_unlock(&w->mutex) == 0);
+
+                for (i = 0; i < w->n_threads; i++)
+                        (void) pthread_join(w->threads[i], NULL);
+        }
+
+        safe_close(w->fd);
+        e->work_pool = mfree(w);
+}
+
+static int source_work_queue(sd_event_source *s) {
+        struct work_pool *w;
+        int r = 0;
+
+        assert(s);
+        assert(s->type == SOURCE_WORK);
+
+        if (s->pending)
+                return 0;
+
+        r = event_make_work_pool(s->event);
+        if (r < 0)
+                return r;
+
+        w = s->event->work_pool;
+
+        assert_se(pthread_mutex_lock(&w->mutex) == 0);
+
+        if (s->work.state != WORK_IDLE)
+                goto finish;
+
+        if (w->n_queued >= w->n_idle && w->n_threads < WORK_THREADS_MAX) {
+                r = work_pool_start_thread(w);
+                if (r < 0 && w->n_threads == 0)
+                        goto finish;
+
+                /* If we already have some threads, they will get to it eventually */
+                r = 0;
+        }
+
+        LIST_PREPEND(work.work_queue, w->queued, s);
+        if (!w->queued_tail)
+                w->queued_tail = s;
+        w->n_queued++;
+        s->work.state = WORK_QUEUED;
+
+        assert_se(pthread_cond_signal(&w->work_cond) == 0);
+
+finish:
+        assert_se(pthread_mutex_unlock(&w->mutex) == 0);
+        return r;
+}
+
+static void source_work_cancel(sd_event_source *s, bool wait) {
+        struct work_pool *w;
+
+        assert(s);
+        assert(s->type == SOURCE_WORK);
+
+        w = s->event->work_pool;
+        if (!w || event_pid_changed(s->event))
+                return;
+
+        assert_se(pthread_mutex_lock(&w->mutex) == 0);
+
+        /* Work that is already running can't be interrupted. If the event source is disabled, the result is dropped
+         * when it arrives. If it goes away, we have to wait, as the work function might still use the userdata. */
+        if (wait)
+                while (s->work.state == WORK_RUNNING)
+                        assert_se(pthread_cond_wait(&w->finished_cond, &w->mutex) == 0);
+
+        switch (s->work.state) {
+
+        case WORK_QUEUED:
+                if (w->queued_tail == s)
+                        w->queued_tail = s->work.work_queue_prev;
+                LIST_REMOVE(work.work_queue, w->queued, s);
+                w->n_queued--;
+                s->work.state = WORK_IDLE;
+                break;
+
+        case WORK_FINISHED:
+                LIST_REMOVE(work.work_queue, w->finished, s);
+                s->work.state = WORK_IDLE;
+                break;
+
+        default:
+                break;
+        }
+
+        assert_se(pthread_mutex_unlock(&w->mutex) == 0);
+}
+
+/* pidfds only tell us about the exit of a process, hence child sources that also watch for WSTOPPED or WCONTINUED
+ * still need SIGCHLD and the waitid() scan */
+#define EVENT_SOURCE_WATCH_PIDFD(s) \
+        ((s)->type == SOURCE_CHILD && (s)->child.pidfd >= 0 && (s)->child.options == WEXITED)
+
+static void source_child_pidfd_unregister(sd_event_source *s) {
+        int r;
+
+        assert(s);
+        assert(s->type == SOURCE_CHILD);
+
+        if (event_pid_changed(s->event))
+                return;
+
+        if (!s->child.registered)
+                return;
+
+        r = epoll_ctl(s->event->epoll_fd, EPOLL_CTL_DEL, s->child.pidfd, NULL);
+        if (r < 0)
+                log_debug_errno(errno, "Failed to remove source %s (type %s) from epoll: %m",
+                                strna(s->description), event_source_type_to_string(s->type));
+
+        s->child.registered = false;
+}
+
+static int source_child_pidfd_register(sd_event_source *s) {
+        struct epoll_event ev;
+        int r;
+
+        assert(s);
+        assert(EVENT_SOURCE_WATCH_PIDFD(s));
+
+        /* Once the child has been reaped the pidfd stays readable forever, don't busy loop on it */
+        if (s->child.registered || s->child.exited)
+                return 0;
+
         ev = (struct epoll_event) {
-                .events = events | (enabled == SD_EVENT_ONESHOT ? EPOLLONESHOT : 0),
+                .events = EPOLLIN,
                 .data.ptr = s,
         };
 
-        if (s->io.registered)
-                r = epoll_ctl(s->event->epoll_fd, EPOLL_CTL_MOD, s->io.fd, &ev);
-        else
-                r = epoll_ctl(s->event->epoll_fd, EPOLL_CTL_ADD, s->io.fd, &ev);
+        r = epoll_ctl(s->event->epoll_fd, EPOLL_CTL_ADD, s->child.pidfd, &ev);
         if (r < 0)
                 return -errno;
 
-        s->io.registered = true;
+        s->child.registered = true;
 
         return 0;
 }
@@ -470,6 +1033,168 @@ static struct clock_data* event_get_clock_data(sd_event *e, EventSourceType t) {
         }
 }
 
+static bool wheel_eligible(struct clock_data *d, sd_event_source *s) {
+        assert(d);
+        assert(s);
+
+        /* A source in the wheel must be fine with being dispatched at the end of its slot, hence the accuracy
+         * requirement */
+
+        return d->wheel &&
+                s->enabled != SD_EVENT_OFF &&
+                !s->pending &&
+                s->time.accuracy >= TIMER_WHEEL_SLOT_USEC &&
+                s->time.next / TIMER_WHEEL_SLOT_USEC < d->wheel_base + TIMER_WHEEL_SLOTS;
+}
+
+static void wheel_link(struct clock_data *d, sd_event_source *s) {
+        unsigned i;
+
+        assert(d);
+        assert(s);
+        assert(s->time.wheel_slot == TIMER_WHEEL_SLOT_NULL);
+
+        /* Sources that are already overdue go into the current slot */
+        i = MAX(s->time.next / TIMER_WHEEL_SLOT_USEC, d->wheel_base) % TIMER_WHEEL_SLOTS;
+
+        LIST_PREPEND(time.wheel, d->wheel[i], s);
+        d->wheel_used[i / 64] |= UINT64_C(1) << (i % 64);
+        s->time.wheel_slot = i;
+        d->n_wheel++;
+}
+
+static void wheel_unlink(struct clock_data *d, sd_event_source *s) {
+        unsigned i;
+
+        assert(d);
+        assert(s);
+
+        i = s->time.wheel_slot;
+        if (i == TIMER_WHEEL_SLOT_NULL)
+                return;
+
+        LIST_REMOVE(time.wheel, d->wheel[i], s);
+        if (!d->wheel[i])
+                d->wheel_used[i / 64] &= ~(UINT64_C(1) << (i % 64));
+        s->time.wheel_slot = TIMER_WHEEL_SLOT_NULL;
+
+        assert(d->n_wheel > 0);
+        d->n_wheel--;
+}
+
+static bool wheel_first(struct clock_data *d, uint64_t *ret) {
+        unsigned start, j;
+
+        assert(d);
+        assert(ret);
+
+        /* Finds the absolute number of the first non-empty slot */
+
+        if (d->n_wheel == 0)
+                return false;
+
+        start = d->wheel_base % TIMER_WHEEL_SLOTS;
+
+        /* Look at the word of the start slot twice, first for the slots from the start on, and after wrapping
+         * around for the ones before it */
+        for (j = 0; j <= TIMER_WHEEL_SLOTS / 64; j++) {
+                unsigned w = (start / 64 + j) % (TIMER_WHEEL_SLOTS / 64), i;
+                uint64_t bits = d->wheel_used[w];
+
+                if (j == 0)
+                        bits &= UINT64_MAX << (start % 64);
+                else if (j == TIMER_WHEEL_SLOTS / 64)
+                        bits &= ~(UINT64_MAX << (start % 64));
+
+                if (bits == 0)
+                        continue;
+
+                i = w * 64 + __builtin_ctzll(bits);
+                *ret = d->wheel_base + (i + TIMER_WHEEL_SLOTS - start) % TIMER_WHEEL_SLOTS;
+                return true;
+        }
+
+        assert_not_reached("Non-empty wheel without used slots");
+}
+
+static void time_source_update(struct clock_data *d, sd_event_source *s) {
+        assert(d);
+        assert(s);
+
+        /* Moves the time source to where it belongs after its time, accuracy, enablement or pending state
+         * changed. Never fails, since sd_event_add_time() reserved room in the prioqs for all time sources. */
+
+        if (wheel_eligible(d, s)) {
+                wheel_unlink(d, s);
+                prioq_remove(d->earliest, s, &s->time.earliest_index);
+                prioq_remove(d->latest, s, &s->time.latest_index);
+                wheel_link(d, s);
+
+        } else if (s->time.earliest_index != PRIOQ_IDX_NULL) {
+                prioq_reshuffle(d->earliest, s, &s->time.earliest_index);
+                prioq_reshuffle(d->latest, s, &s->time.latest_index);
+
+        } else {
+                wheel_unlink(d, s);
+
+                /* Disabled and pending sources are of no interest to the timer logic, hence we only need to
+                 * track them again once they are enabled */
+                if (s->enabled != SD_EVENT_OFF && !s->pending) {
+                        assert_se(prioq_put(d->earliest, s, &s->time.earliest_index) >= 0);
+                        assert_se(prioq_put(d->latest, s, &s->time.latest_index) >= 0);
+                }
+        }
+
+        d->needs_rearm = true;
+}
+
+static void wheel_flush(struct clock_data *d) {
+        unsigned i;
+
+        assert(d);
+
+        /* Moves all sources from the wheel back into the prioqs */
+
+        for (i = 0; i < TIMER_WHEEL_SLOTS && d->n_wheel > 0; i++) {
+                sd_event_source *s;
+
+                while ((s = d->wheel[i])) {
+                        wheel_unlink(d, s);
+                        assert_se(prioq_put(d->earliest, s, &s->time.earliest_index) >= 0);
+                        assert_se(prioq_put(d->latest, s, &s->time.latest_index) >= 0);
+                }
+        }
+
+        d->needs_rearm = true;
+}
+
+static bool wheel_window(struct clock_data *d, usec_t *ret_earliest, usec_t *ret_latest) {
+        usec_t earliest = USEC_INFINITY, latest = USEC_INFINITY;
+        sd_event_source *s;
+        uint64_t k;
+
+        assert(d);
+        assert(ret_earliest);
+        assert(ret_latest);
+
+        /* Determines the window to wake up in for the sources in the wheel, just like the tops of the prioqs do
+         * for the others. Only the first non-empty slot needs to be looked at: sources in later slots are due
+         * at a later time anyway, and are fine with being dispatched until two slot widths later, given their
+         * accuracy. */
+
+        if (!wheel_first(d, &k))
+                return false;
+
+        LIST_FOREACH(time.wheel, s, d->wheel[k % TIMER_WHEEL_SLOTS]) {
+                earliest = MIN(earliest, s->time.next);
+                latest = MIN(latest, time_event_source_latest(s));
+        }
+
+        *ret_earliest = earliest;
+        *ret_latest = MIN(latest, (k + 2) * TIMER_WHEEL_SLOT_USEC);
+        return true;
+}
+
 static int event_make_signal_data(
                 sd_event *e,
                 int sig,
@@ -672,6 +1397,8 @@ static void source_disconnect(sd_event_source *s) {
 
                 prioq_remove(d->earliest, s, &s->time.earliest_index);
                 prioq_remove(d->latest, s, &s->time.latest_index);
+                wheel_unlink(d, s);
+                d->n_sources--;
                 d->needs_rearm = true;
                 break;
         }
@@ -698,6 +1425,11 @@ static void source_disconnect(sd_event_source *s) {
                         event_gc_signal_data(s->event, &s->priority, SIGCHLD);
                 }
 
+                if (s->child.pidfd >= 0) {
+                        source_child_pidfd_unregister(s);
+                        s->child.pidfd = safe_close(s->child.pidfd);
+                }
+
                 break;
 
         case SOURCE_DEFER:
@@ -712,6 +1444,16 @@ static void source_disconnect(sd_event_source *s) {
                 prioq_remove(s->event->exit, s, &s->exit.prioq_index);
                 break;
 
+        case SOURCE_READ:
+                source_read_unregister(s);
+                s->read.epoll_fd = safe_close(s->read.epoll_fd);
+                s->read.buffer = mfree(s->read.buffer);
+                break;
+
+        case SOURCE_WORK:
+                source_work_cancel(s, true);
+                break;
+
         case SOURCE_INOTIFY: {
                 struct inode_data *inode_data;
 
@@ -780,7 +1522,11 @@ static void source_free(sd_event_source *s) {
                 s->destroy_callback(s->userdata);
 
         free(s->description);
-        free(s);
+
+        if (s->from_pool)
+                mempool_free_tile(&event_source_pool, s);
+        else
+                free(s);
 }
 DEFINE_TRIVIAL_CLEANUP_FUNC(sd_event_source*, source_free);
 
@@ -798,6 +1544,9 @@ static int source_set_pending(sd_event_source *s, bool b) {
         if (b) {
                 s->pending_iteration = s->event->iteration;
 
+                if (s->event->profile_sources)
+                        s->profile.pending_since = now(CLOCK_MONOTONIC);
+
                 r = prioq_put(s->event->pending, s, &s->pending_index);
                 if (r < 0) {
                         s->pending = false;
@@ -812,9 +1561,7 @@ static int source_set_pending(sd_event_source *s, bool b) {
                 d = event_get_clock_data(s->event, s->type);
                 assert(d);
 
-                prioq_reshuffle(d->earliest, s, &s->time.earliest_index);
-                prioq_reshuffle(d->latest, s, &s->time.latest_index);
-                d->needs_rearm = true;
+                time_source_update(d, s);
         }
 
         if (s->type == SOURCE_SIGNAL && !b) {
@@ -843,10 +1590,15 @@ static int source_set_pending(sd_event_source *s, bool b) {
 
 static sd_event_source *source_new(sd_event *e, bool floating, EventSourceType type) {
         sd_event_source *s;
+        bool up;
 
         assert(e);
 
-        s = new(sd_event_source, 1);
+        /* Event sources are allocated and freed all the time, e.g. for every defer or timer event that is only
+         * used once, hence take them from a pool where that is allowed */
+        up = mempool_enabled();
+
+        s = up ? mempool_alloc_tile(&event_source_pool) : new(sd_event_source, 1);
         if (!s)
                 return NULL;
 
@@ -854,6 +1606,7 @@ static sd_event_source *source_new(sd_event *e, bool floating, EventSourceType t
                 .n_ref = 1,
                 .event = e,
                 .floating = floating,
+                .from_pool = up,
                 .type = type,
                 .pending_index = PRIOQ_IDX_NULL,
                 .prepare_index = PRIOQ_IDX_NULL,
@@ -1010,6 +1763,16 @@ _public_ int sd_event_add_time(
         if (r < 0)
                 return r;
 
+        /* Make sure every time source of this clock fits into the prioqs, so that moving sources out of the
+         * timing wheel and back into them can't fail */
+        r = prioq_reserve(d->earliest, d->n_sources + 1);
+        if (r < 0)
+                return r;
+
+        r = prioq_reserve(d->latest, d->n_sources + 1);
+        if (r < 0)
+                return r;
+
         if (d->fd < 0) {
                 r = event_setup_timer_fd(e, d, clock);
                 if (r < 0)
@@ -1024,18 +1787,12 @@ _public_ int sd_event_add_time(
         s->time.accuracy = accuracy == 0 ? DEFAULT_ACCURACY_USEC : accuracy;
         s->time.callback = callback;
         s->time.earliest_index = s->time.latest_index = PRIOQ_IDX_NULL;
+        s->time.wheel_slot = TIMER_WHEEL_SLOT_NULL;
         s->userdata = userdata;
         s->enabled = SD_EVENT_ONESHOT;
 
-        d->needs_rearm = true;
-
-        r = prioq_put(d->earliest, s, &s->time.earliest_index);
-        if (r < 0)
-                return r;
-
-        r = prioq_put(d->latest, s, &s->time.latest_index);
-        if (r < 0)
-                return r;
+        d->n_sources++;
+        time_source_update(d, s);
 
         if (ret)
                 *ret = s;
@@ -1141,6 +1898,8 @@ _public_ int sd_event_add_child(
         if (!s)
                 return -ENOMEM;
 
+        s->wakeup = WAKEUP_EVENT_SOURCE;
+        s->child.pidfd = -1;
         s->child.pid = pid;
         s->child.options = options;
         s->child.callback = callback;
@@ -1151,15 +1910,32 @@ _public_ int sd_event_add_child(
         if (r < 0)
                 return r;
 
+        /* If the kernel supports pidfds, watch the exit of the child through epoll, so that we don't have to
+         * scan all children with waitid() on every SIGCHLD. If we can't get one for whatever reason, the
+         * SIGCHLD logic below is used, which also reports the error if the child doesn't exist. */
+        if (options == WEXITED) {
+                s->child.pidfd = pidfd_open(pid, 0);
+                if (s->child.pidfd < 0)
+                        log_debug_errno(errno, "Failed to acquire pidfd for child " PID_FMT ", watching it via SIGCHLD: %m", pid);
+        }
+
         e->n_enabled_child_sources++;
 
-        r = event_make_signal_data(e, SIGCHLD, NULL);
-        if (r < 0) {
-                e->n_enabled_child_sources--;
-                return r;
-        }
+        if (EVENT_SOURCE_WATCH_PIDFD(s)) {
+                r = source_child_pidfd_register(s);
+                if (r < 0) {
+                        e->n_enabled_child_sources--;
+                        return r;
+                }
+        } else {
+                r = event_make_signal_data(e, SIGCHLD, NULL);
+                if (r < 0) {
+                        e->n_enabled_child_sources--;
+                        return r;
+                }
 
-        e->need_process_child = true;
+                e->need_process_child = true;
+        }
 
         if (ret)
                 *ret = s;
@@ -1589,64 +2365,185 @@ _public_ int sd_event_add_inotify(
 
         assert_return(e, -EINVAL);
         assert_return(e = event_resolve(e), -ENOPKG);
-        assert_return(path, -EINVAL);
+        assert_return(path, -EINVAL);
+        assert_return(callback, -EINVAL);
+        assert_return(e->state != SD_EVENT_FINISHED, -ESTALE);
+        assert_return(!event_pid_changed(e), -ECHILD);
+
+        /* Refuse IN_MASK_ADD since we coalesce watches on the same inode, and hence really don't want to merge
+         * masks. Or in other words, this whole code exists only to manage IN_MASK_ADD type operations for you, hence
+         * the user can't use them for us. */
+        if (mask & IN_MASK_ADD)
+                return -EINVAL;
+
+        fd = open(path, O_PATH|O_CLOEXEC|
+                  (mask & IN_ONLYDIR ? O_DIRECTORY : 0)|
+                  (mask & IN_DONT_FOLLOW ? O_NOFOLLOW : 0));
+        if (fd < 0)
+                return -errno;
+
+        if (fstat(fd, &st) < 0)
+                return -errno;
+
+        s = source_new(e, !ret, SOURCE_INOTIFY);
+        if (!s)
+                return -ENOMEM;
+
+        s->enabled = mask & IN_ONESHOT ? SD_EVENT_ONESHOT : SD_EVENT_ON;
+        s->inotify.mask = mask;
+        s->inotify.callback = callback;
+        s->userdata = userdata;
+
+        /* Allocate an inotify object for this priority, and an inode object within it */
+        r = event_make_inotify_data(e, SD_EVENT_PRIORITY_NORMAL, &inotify_data);
+        if (r < 0)
+                return r;
+
+        r = event_make_inode_data(e, inotify_data, st.st_dev, st.st_ino, &inode_data);
+        if (r < 0) {
+                event_free_inotify_data(e, inotify_data);
+                return r;
+        }
+
+        /* Keep the O_PATH fd around until the first iteration of the loop, so that we can still change the priority of
+         * the event source, until then, for which we need the original inode. */
+        if (inode_data->fd < 0) {
+                inode_data->fd = TAKE_FD(fd);
+                LIST_PREPEND(to_close, e->inode_data_to_close, inode_data);
+        }
+
+        /* Link our event source to the inode data object */
+        LIST_PREPEND(inotify.by_inode_data, inode_data->event_sources, s);
+        s->inotify.inode_data = inode_data;
+
+        /* Actually realize the watch now */
+        r = inode_data_realize_watch(e, inode_data);
+        if (r < 0)
+                return r;
+
+        (void) sd_event_source_set_description(s, path);
+
+        if (ret)
+                *ret = s;
+        TAKE_PTR(s);
+
+        return 0;
+}
+
+static int event_add_read_internal(
+                sd_event *e,
+                sd_event_source **ret,
+                int fd,
+                size_t size,
+                bool recv,
+                int flags,
+                sd_event_read_handler_t callback,
+                void *userdata) {
+
+        _cleanup_(source_freep) sd_event_source *s = NULL;
+        int r;
+
+        assert_return(e, -EINVAL);
+        assert_return(e = event_resolve(e), -ENOPKG);
+        assert_return(fd >= 0, -EBADF);
+        assert_return(size > 0 && size <= UINT32_MAX, -EINVAL);
+        assert_return(callback, -EINVAL);
+        assert_return(e->state != SD_EVENT_FINISHED, -ESTALE);
+        assert_return(!event_pid_changed(e), -ECHILD);
+
+        s = source_new(e, !ret, SOURCE_READ);
+        if (!s)
+                return -ENOMEM;
+
+        s->wakeup = WAKEUP_EVENT_SOURCE;
+        s->read.epoll_fd = -1;
+        s->read.fd = fd;
+        s->read.size = size;
+        s->read.recv = recv;
+        s->read.flags = flags;
+        s->read.callback = callback;
+        s->userdata = userdata;
+        s->enabled = SD_EVENT_ONESHOT;
+
+        if (!e->uring) {
+                /* Without the io_uring we read into a single buffer right before the callback is invoked. We
+                 * watch a duplicate of the fd, so that the same fd may be used in an I/O event source of this
+                 * event loop, too. */
+                s->read.buffer = malloc(size);
+                if (!s->read.buffer)
+                        return -ENOMEM;
+
+                s->read.epoll_fd = fcntl(fd, F_DUPFD_CLOEXEC, 3);
+                if (s->read.epoll_fd < 0)
+                        return -errno;
+        }
+
+        r = source_read_submit(s);
+        if (r < 0)
+                return r;
+
+        if (ret)
+                *ret = s;
+        TAKE_PTR(s);
+
+        return 0;
+}
+
+_public_ int sd_event_add_read(
+                sd_event *e,
+                sd_event_source **ret,
+                int fd,
+                size_t size,
+                sd_event_read_handler_t callback,
+                void *userdata) {
+
+        return event_add_read_internal(e, ret, fd, size, false, 0, callback, userdata);
+}
+
+_public_ int sd_event_add_recv(
+                sd_event *e,
+                sd_event_source **ret,
+                int fd,
+                size_t size,
+                int flags,
+                sd_event_read_handler_t callback,
+                void *userdata) {
+
+        assert_return(!(flags & MSG_DONTWAIT), -EINVAL);
+
+        return event_add_read_internal(e, ret, fd, size, true, flags, callback, userdata);
+}
+
+_public_ int sd_event_add_work(
+                sd_event *e,
+                sd_event_source **ret,
+                sd_event_work_handler_t work,
+                sd_event_work_done_handler_t callback,
+                void *userdata) {
+
+        _cleanup_(source_freep) sd_event_source *s = NULL;
+        int r;
+
+        assert_return(e, -EINVAL);
+        assert_return(e = event_resolve(e), -ENOPKG);
+        assert_return(work, -EINVAL);
         assert_return(callback, -EINVAL);
         assert_return(e->state != SD_EVENT_FINISHED, -ESTALE);
         assert_return(!event_pid_changed(e), -ECHILD);
 
-        /* Refuse IN_MASK_ADD since we coalesce watches on the same inode, and hence really don't want to merge
-         * masks. Or in other words, this whole code exists only to manage IN_MASK_ADD type operations for you, hence
-         * the user can't use them for us. */
-        if (mask & IN_MASK_ADD)
-                return -EINVAL;
-
-        fd = open(path, O_PATH|O_CLOEXEC|
-                  (mask & IN_ONLYDIR ? O_DIRECTORY : 0)|
-                  (mask & IN_DONT_FOLLOW ? O_NOFOLLOW : 0));
-        if (fd < 0)
-                return -errno;
-
-        if (fstat(fd, &st) < 0)
-                return -errno;
-
-        s = source_new(e, !ret, SOURCE_INOTIFY);
+        s = source_new(e, !ret, SOURCE_WORK);
         if (!s)
                 return -ENOMEM;
 
-        s->enabled = mask & IN_ONESHOT ? SD_EVENT_ONESHOT : SD_EVENT_ON;
-        s->inotify.mask = mask;
-        s->inotify.callback = callback;
+        s->work.work = work;
+        s->work.callback = callback;
         s->userdata = userdata;
+        s->enabled = SD_EVENT_ONESHOT;
 
-        /* Allocate an inotify object for this priority, and an inode object within it */
-        r = event_make_inotify_data(e, SD_EVENT_PRIORITY_NORMAL, &inotify_data);
-        if (r < 0)
-                return r;
-
-        r = event_make_inode_data(e, inotify_data, st.st_dev, st.st_ino, &inode_data);
-        if (r < 0) {
-                event_free_inotify_data(e, inotify_data);
-                return r;
-        }
-
-        /* Keep the O_PATH fd around until the first iteration of the loop, so that we can still change the priority of
-         * the event source, until then, for which we need the original inode. */
-        if (inode_data->fd < 0) {
-                inode_data->fd = TAKE_FD(fd);
-                LIST_PREPEND(to_close, e->inode_data_to_close, inode_data);
-        }
-
-        /* Link our event source to the inode data object */
-        LIST_PREPEND(inotify.by_inode_data, inode_data->event_sources, s);
-        s->inotify.inode_data = inode_data;
-
-        /* Actually realize the watch now */
-        r = inode_data_realize_watch(e, inode_data);
+        r = source_work_queue(s);
         if (r < 0)
                 return r;
 
-        (void) sd_event_source_set_description(s, path);
-
         if (ret)
                 *ret = s;
         TAKE_PTR(s);
@@ -1736,10 +2633,13 @@ _public_ int sd_event_source_set_io_fd(sd_event_source *s, int fd) {
                 s->io.fd = fd;
                 s->io.registered = false;
         } else {
+                bool saved_registered;
                 int saved_fd;
 
+                /* If the source is watched through the io_uring, source_io_register() replaces the poll */
                 saved_fd = s->io.fd;
-                assert(s->io.registered);
+                saved_registered = s->io.registered;
+                assert(saved_registered || s->io.uring_op);
 
                 s->io.fd = fd;
                 s->io.registered = false;
@@ -1747,11 +2647,12 @@ _public_ int sd_event_source_set_io_fd(sd_event_source *s, int fd) {
                 r = source_io_register(s, s->enabled, s->io.events);
                 if (r < 0) {
                         s->io.fd = saved_fd;
-                        s->io.registered = true;
+                        s->io.registered = saved_registered;
                         return r;
                 }
 
-                epoll_ctl(s->event->epoll_fd, EPOLL_CTL_DEL, saved_fd, NULL);
+                if (saved_registered)
+                        epoll_ctl(s->event->epoll_fd, EPOLL_CTL_DEL, saved_fd, NULL);
         }
 
         return 0;
@@ -1994,9 +2895,7 @@ _public_ int sd_event_source_set_enabled(sd_event_source *s, int m) {
                         d = event_get_clock_data(s->event, s->type);
                         assert(d);
 
-                        prioq_reshuffle(d->earliest, s, &s->time.earliest_index);
-                        prioq_reshuffle(d->latest, s, &s->time.latest_index);
-                        d->needs_rearm = true;
+                        time_source_update(d, s);
                         break;
                 }
 
@@ -2012,7 +2911,10 @@ _public_ int sd_event_source_set_enabled(sd_event_source *s, int m) {
                         assert(s->event->n_enabled_child_sources > 0);
                         s->event->n_enabled_child_sources--;
 
-                        event_gc_signal_data(s->event, &s->priority, SIGCHLD);
+                        if (EVENT_SOURCE_WATCH_PIDFD(s))
+                                source_child_pidfd_unregister(s);
+                        else
+                                event_gc_signal_data(s->event, &s->priority, SIGCHLD);
                         break;
 
                 case SOURCE_EXIT:
@@ -2020,6 +2922,16 @@ _public_ int sd_event_source_set_enabled(sd_event_source *s, int m) {
                         prioq_reshuffle(s->event->exit, s, &s->exit.prioq_index);
                         break;
 
+                case SOURCE_READ:
+                        source_read_unregister(s);
+                        s->enabled = m;
+                        break;
+
+                case SOURCE_WORK:
+                        source_work_cancel(s, false);
+                        s->enabled = m;
+                        break;
+
                 case SOURCE_DEFER:
                 case SOURCE_POST:
                 case SOURCE_INOTIFY:
@@ -2060,9 +2972,7 @@ _public_ int sd_event_source_set_enabled(sd_event_source *s, int m) {
                         d = event_get_clock_data(s->event, s->type);
                         assert(d);
 
-                        prioq_reshuffle(d->earliest, s, &s->time.earliest_index);
-                        prioq_reshuffle(d->latest, s, &s->time.latest_index);
-                        d->needs_rearm = true;
+                        time_source_update(d, s);
                         break;
                 }
 
@@ -2086,7 +2996,10 @@ _public_ int sd_event_source_set_enabled(sd_event_source *s, int m) {
 
                         s->enabled = m;
 
-                        r = event_make_signal_data(s->event, SIGCHLD, NULL);
+                        if (EVENT_SOURCE_WATCH_PIDFD(s))
+                                r = source_child_pidfd_register(s);
+                        else
+                                r = event_make_signal_data(s->event, SIGCHLD, NULL);
                         if (r < 0) {
                                 s->enabled = SD_EVENT_OFF;
                                 s->event->n_enabled_child_sources--;
@@ -2101,6 +3014,28 @@ _public_ int sd_event_source_set_enabled(sd_event_source *s, int m) {
                         prioq_reshuffle(s->event->exit, s, &s->exit.prioq_index);
                         break;
 
+                case SOURCE_READ:
+                        s->enabled = m;
+
+                        r = source_read_submit(s);
+                        if (r < 0) {
+                                s->enabled = SD_EVENT_OFF;
+                                return r;
+                        }
+
+                        break;
+
+                case SOURCE_WORK:
+                        s->enabled = m;
+
+                        r = source_work_queue(s);
+                        if (r < 0) {
+                                s->enabled = SD_EVENT_OFF;
+                                return r;
+                        }
+
+                        break;
+
                 case SOURCE_DEFER:
                 case SOURCE_POST:
                 case SOURCE_INOTIFY:
@@ -2149,9 +3084,7 @@ _public_ int sd_event_source_set_time(sd_event_source *s, uint64_t usec) {
         d = event_get_clock_data(s->event, s->type);
         assert(d);
 
-        prioq_reshuffle(d->earliest, s, &s->time.earliest_index);
-        prioq_reshuffle(d->latest, s, &s->time.latest_index);
-        d->needs_rearm = true;
+        time_source_update(d, s);
 
         return 0;
 }
@@ -2188,8 +3121,7 @@ _public_ int sd_event_source_set_time_accuracy(sd_event_source *s, uint64_t usec
         d = event_get_clock_data(s->event, s->type);
         assert(d);
 
-        prioq_reshuffle(d->latest, s, &s->time.latest_index);
-        d->needs_rearm = true;
+        time_source_update(d, s);
 
         return 0;
 }
@@ -2224,6 +3156,14 @@ _public_ int sd_event_source_get_inotify_mask(sd_event_source *s, uint32_t *mask
         return 0;
 }
 
+_public_ int sd_event_source_get_read_fd(sd_event_source *s) {
+        assert_return(s, -EINVAL);
+        assert_return(s->type == SOURCE_READ, -EDOM);
+        assert_return(!event_pid_changed(s->event), -ECHILD);
+
+        return s->read.fd;
+}
+
 _public_ int sd_event_source_set_prepare(sd_event_source *s, sd_event_handler_t callback) {
         int r;
 
@@ -2358,8 +3298,8 @@ static int event_arm_timer(
                 struct clock_data *d) {
 
         struct itimerspec its = {};
-        sd_event_source *a, *b;
-        usec_t t;
+        usec_t t, earliest = USEC_INFINITY, latest = USEC_INFINITY, wa, wb;
+        sd_event_source *a;
         int r;
 
         assert(e);
@@ -2370,66 +3310,323 @@ static int event_arm_timer(
         else
                 d->needs_rearm = false;
 
-        a = prioq_peek(d->earliest);
-        if (!a || a->enabled == SD_EVENT_OFF || a->time.next == USEC_INFINITY) {
+        a = prioq_peek(d->earliest);
+        if (a && a->enabled != SD_EVENT_OFF && a->time.next != USEC_INFINITY) {
+                sd_event_source *b;
+
+                b = prioq_peek(d->latest);
+                assert_se(b && b->enabled != SD_EVENT_OFF);
+
+                earliest = a->time.next;
+                latest = time_event_source_latest(b);
+        }
+
+        if (wheel_window(d, &wa, &wb)) {
+                earliest = MIN(earliest, wa);
+                latest = MIN(latest, wb);
+        }
+
+        if (earliest == USEC_INFINITY) {
+
+                if (d->fd < 0)
+                        return 0;
+
+                if (d->next == USEC_INFINITY)
+                        return 0;
+
+                /* disarm */
+                r = timerfd_settime(d->fd, TFD_TIMER_ABSTIME, &its, NULL);
+                if (r < 0)
+                        return r;
+
+                d->next = USEC_INFINITY;
+                return 0;
+        }
+
+        t = sleep_between(e, earliest, latest);
+        if (d->next == t)
+                return 0;
+
+        assert_se(d->fd >= 0);
+
+        if (t == 0) {
+                /* We don' want to disarm here, just mean some time looooong ago. */
+                its.it_value.tv_sec = 0;
+                its.it_value.tv_nsec = 1;
+        } else
+                timespec_store(&its.it_value, t);
+
+        r = timerfd_settime(d->fd, TFD_TIMER_ABSTIME, &its, NULL);
+        if (r < 0)
+                return -errno;
+
+        d->next = t;
+        return 0;
+}
+
+static int process_io(sd_event *e, sd_event_source *s, uint32_t revents) {
+        assert(e);
+        assert(s);
+        assert(s->type == SOURCE_IO);
+
+        /* If the event source was already pending, we just OR in the
+         * new revents, otherwise we reset the value. The ORing is
+         * necessary to handle EPOLLONESHOT events properly where
+         * readability might happen independently of writability, and
+         * we need to keep track of both */
+
+        if (s->pending)
+                s->io.revents |= revents;
+        else
+                s->io.revents = revents;
+
+        return source_set_pending(s, true);
+}
+
+static int process_read_ready(sd_event *e, sd_event_source *s, uint32_t revents) {
+        assert(e);
+        assert(s);
+        assert(s->type == SOURCE_READ);
+
+        /* The fd became readable, the read itself is done in source_dispatch() */
+
+        if (s->pending)
+                return 0;
+
+        if (s->enabled == SD_EVENT_OFF)
+                return 0;
+
+        return source_set_pending(s, true);
+}
+
+static int process_work(sd_event *e, uint32_t events) {
+        struct work_pool *w;
+        sd_event_source *s;
+        eventfd_t x;
+        int r = 0;
+
+        assert(e);
+        assert_se(w = e->work_pool);
+
+        assert_return(events == EPOLLIN, -EIO);
+
+        (void) eventfd_read(w->fd, &x);
+
+        assert_se(pthread_mutex_lock(&w->mutex) == 0);
+
+        while ((s = w->finished)) {
+                LIST_REMOVE(work.work_queue, w->finished, s);
+                s->work.state = WORK_IDLE;
+
+                /* The event source was disabled while the work was running, drop the result */
+                if (s->enabled == SD_EVENT_OFF)
+                        continue;
+
+                r = source_set_pending(s, true);
+                if (r < 0)
+                        break;
+        }
+
+        assert_se(pthread_mutex_unlock(&w->mutex) == 0);
+
+        return r;
+}
+
+#if HAVE_IORING_POLL_ADD_MULTI
+static int process_uring_poll(sd_event_source *s, const struct io_uring_cqe *cqe, bool final) {
+        uint32_t revents;
+        int r;
+
+        assert(s);
+        assert(s->type == SOURCE_IO);
+        assert(cqe);
+
+        if (cqe->res < 0) {
+                /* A multishot poll that the kernel terminated (for example because the completion queue
+                 * overflowed) is simply started again */
+                if (final && cqe->res == -ECANCELED && s->enabled == SD_EVENT_ON)
+                        return source_io_uring_poll(s, s->enabled, s->io.events);
+
+                log_debug_errno(cqe->res, "Failed to poll source %s (type %s) through io_uring: %m",
+                                strna(s->description), event_source_type_to_string(s->type));
+                revents = EPOLLERR;
+        } else {
+                revents = (uint32_t) cqe->res;
+
+                if (final && s->enabled == SD_EVENT_ON) {
+                        r = source_io_uring_poll(s, s->enabled, s->io.events);
+                        if (r < 0)
+                                return r;
+                }
+        }
+
+        return process_io(s->event, s, revents);
+}
+
+static int process_uring_read(sd_event_source *s, EventUringOp *op, const struct io_uring_cqe *cqe) {
+        assert(s);
+        assert(s->type == SOURCE_READ);
+        assert(op);
+        assert(cqe);
+
+        free_and_replace(s->read.buffer, op->buffer);
+        s->read.result = cqe->res;
+
+        return source_set_pending(s, true);
+}
+
+static int process_uring(sd_event *e, uint32_t events) {
+        struct io_uring_cqe cqe;
+        int r = 0;
+
+        assert(e);
+        assert(e->uring);
+        assert_return(events == EPOLLIN, -EIO);
+
+        while (r >= 0 && event_uring_pop_cqe(e->uring, &cqe)) {
+                EventUringOp *op = (EventUringOp*) (uintptr_t) cqe.user_data;
+                sd_event_source *s;
+                bool final;
+
+                /* Completions of cancellations don't carry an operation */
+                if (!op)
+                        continue;
+
+                final = !(cqe.flags & IORING_CQE_F_MORE);
+                s = op->source;
+
+                if (s) {
+                        if (s->type == SOURCE_IO) {
+                                if (final)
+                                        s->io.uring_op = NULL;
+
+                                r = process_uring_poll(s, &cqe, final);
+                        } else {
+                                assert(final);
+                                s->read.uring_op = NULL;
+
+                                r = process_uring_read(s, op, &cqe);
+                        }
+                }
+
+                if (final)
+                        uring_op_free(e, op);
+        }
+
+        return r;
+}
+
+static int event_setup_uring(sd_event *e) {
+        _cleanup_(event_uring_freep) EventUring *u = NULL;
+        struct epoll_event ev;
+        int r;
+
+        assert(e);
+
+        r = event_uring_new(URING_ENTRIES, &u);
+        if (r < 0)
+                return r;
+
+        e->uring_wakeup = WAKEUP_URING_DATA;
+
+        ev = (struct epoll_event) {
+                .events = EPOLLIN,
+                .data.ptr = &e->uring_wakeup,
+        };
+
+        if (epoll_ctl(e->epoll_fd, EPOLL_CTL_ADD, event_uring_get_fd(u), &ev) < 0)
+                return -errno;
+
+        e->uring = TAKE_PTR(u);
+        log_debug("Using io_uring for one-shot and edge-triggered I/O event sources and reads.");
+
+        return 0;
+}
+
+static int event_submit_uring(sd_event *e) {
+        int r;
+
+        assert(e);
+
+        if (!e->uring)
+                return 0;
+
+        /* Hand everything queued during this iteration to the kernel, with a single syscall. If the kernel is busy
+         * flushing completions, we'll try again after we picked them up. */
+        r = event_uring_submit(e->uring, 0);
+        if (r < 0 && !IN_SET(r, -EBUSY, -EAGAIN))
+                return r;
+
+        return 0;
+}
+
+static void event_free_uring(sd_event *e) {
+        EventUringOp *op;
+        int r;
+
+        assert(e);
+
+        if (!e->uring)
+                return;
+
+        /* The kernel may still write into the buffers of reads until they completed, hence wait for those. A
+         * forked off child doesn't own the ring, though. Polls are cancelled by closing the ring. */
+        while (!event_pid_changed(e)) {
+                bool busy = false;
 
-                if (d->fd < 0)
-                        return 0;
+                LIST_FOREACH(ops, op, e->uring_ops) {
+                        struct io_uring_sqe *sqe;
 
-                if (d->next == USEC_INFINITY)
-                        return 0;
+                        if (!op->buffer)
+                                continue;
 
-                /* disarm */
-                r = timerfd_settime(d->fd, TFD_TIMER_ABSTIME, &its, NULL);
-                if (r < 0)
-                        return r;
+                        busy = true;
 
-                d->next = USEC_INFINITY;
-                return 0;
-        }
+                        if (op->cancelled || event_uring_get_sqe(e->uring, &sqe) < 0)
+                                continue;
 
-        b = prioq_peek(d->latest);
-        assert_se(b && b->enabled != SD_EVENT_OFF);
+                        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+                        sqe->fd = -1;
+                        sqe->addr = (uint64_t) (uintptr_t) op;
+                        op->cancelled = true;
+                }
 
-        t = sleep_between(e, a->time.next, time_event_source_latest(b));
-        if (d->next == t)
-                return 0;
+                if (!busy)
+                        break;
 
-        assert_se(d->fd >= 0);
+                r = event_uring_submit(e->uring, 1);
+                if (r >= 0)
+                        r = process_uring(e, EPOLLIN);
+                if (r < 0) {
+                        log_debug_errno(r, "Failed to wait for io_uring reads to finish, leaking their buffers: %m");
 
-        if (t == 0) {
-                /* We don' want to disarm here, just mean some time looooong ago. */
-                its.it_value.tv_sec = 0;
-                its.it_value.tv_nsec = 1;
-        } else
-                timespec_store(&its.it_value, t);
+                        LIST_FOREACH(ops, op, e->uring_ops)
+                                op->buffer = NULL;
+                        break;
+                }
+        }
 
-        r = timerfd_settime(d->fd, TFD_TIMER_ABSTIME, &its, NULL);
-        if (r < 0)
-                return -errno;
+        e->uring = event_uring_free(e->uring);
 
-        d->next = t;
-        return 0;
+        while ((op = e->uring_ops))
+                uring_op_free(e, op);
+}
+#else
+static int process_uring(sd_event *e, uint32_t events) {
+        return -EOPNOTSUPP;
 }
 
-static int process_io(sd_event *e, sd_event_source *s, uint32_t revents) {
-        assert(e);
-        assert(s);
-        assert(s->type == SOURCE_IO);
-
-        /* If the event source was already pending, we just OR in the
-         * new revents, otherwise we reset the value. The ORing is
-         * necessary to handle EPOLLONESHOT events properly where
-         * readability might happen independently of writability, and
-         * we need to keep track of both */
+static int event_setup_uring(sd_event *e) {
+        return -EOPNOTSUPP;
+}
 
-        if (s->pending)
-                s->io.revents |= revents;
-        else
-                s->io.revents = revents;
+static int event_submit_uring(sd_event *e) {
+        return 0;
+}
 
-        return source_set_pending(s, true);
+static void event_free_uring(sd_event *e) {
 }
+#endif
 
 static int flush_timer(sd_event *e, int fd, uint32_t events, usec_t *next) {
         uint64_t x;
@@ -2457,6 +3654,68 @@ static int flush_timer(sd_event *e, int fd, uint32_t events, usec_t *next) {
         return 0;
 }
 
+static int process_timer_wheel(
+                sd_event *e,
+                usec_t n,
+                struct clock_data *d) {
+
+        uint64_t k, now_slot = n / TIMER_WHEEL_SLOT_USEC;
+        sd_event_source *s;
+        int r;
+
+        assert(e);
+        assert(d);
+
+        if (!d->wheel) {
+                if (prioq_size(d->earliest) < TIMER_WHEEL_MIN_SOURCES)
+                        return 0;
+
+                /* Lots of time sources, switch to the wheel. If we can't, we continue with the prioqs only. */
+                d->wheel = new0(sd_event_source*, TIMER_WHEEL_SLOTS);
+                if (!d->wheel)
+                        return 0;
+
+                d->wheel_base = now_slot;
+        }
+
+        if (now_slot < d->wheel_base) {
+                /* The clock jumped backwards, start over */
+                wheel_flush(d);
+                d->wheel_base = now_slot;
+        }
+
+        /* Everything in the slots before the current one is due, and some of what's in the current one */
+        while (wheel_first(d, &k) && k <= now_slot) {
+                sd_event_source *next;
+
+                LIST_FOREACH_SAFE(time.wheel, s, next, d->wheel[k % TIMER_WHEEL_SLOTS]) {
+                        if (s->time.next > n)
+                                continue;
+
+                        /* This also takes it out of the wheel */
+                        r = source_set_pending(s, true);
+                        if (r < 0)
+                                return r;
+                }
+
+                if (k == now_slot)
+                        break;
+        }
+
+        d->wheel_base = now_slot;
+
+        /* Move the sources that are now within reach of the wheel over from the prioqs */
+        for (;;) {
+                s = prioq_peek(d->earliest);
+                if (!s || !wheel_eligible(d, s))
+                        break;
+
+                time_source_update(d, s);
+        }
+
+        return 0;
+}
+
 static int process_timer(
                 sd_event *e,
                 usec_t n,
@@ -2479,13 +3738,9 @@ static int process_timer(
                 r = source_set_pending(s, true);
                 if (r < 0)
                         return r;
-
-                prioq_reshuffle(d->earliest, s, &s->time.earliest_index);
-                prioq_reshuffle(d->latest, s, &s->time.latest_index);
-                d->needs_rearm = true;
         }
 
-        return 0;
+        return process_timer_wheel(e, n, d);
 }
 
 static int process_child(sd_event *e) {
@@ -2524,6 +3779,10 @@ static int process_child(sd_event *e) {
                 if (s->enabled == SD_EVENT_OFF)
                         continue;
 
+                /* Children watched through a pidfd are handled by process_pidfd() */
+                if (EVENT_SOURCE_WATCH_PIDFD(s))
+                        continue;
+
                 zero(s->child.siginfo);
                 r = waitid(P_PID, s->child.pid, &s->child.siginfo,
                            WNOHANG | (s->child.options & WEXITED ? WNOWAIT : 0) | s->child.options);
@@ -2552,6 +3811,31 @@ static int process_child(sd_event *e) {
         return 0;
 }
 
+static int process_pidfd(sd_event *e, sd_event_source *s, uint32_t revents) {
+        assert(e);
+        assert(s);
+        assert(s->type == SOURCE_CHILD);
+
+        if (s->pending)
+                return 0;
+
+        if (s->enabled == SD_EVENT_OFF)
+                return 0;
+
+        if (!EVENT_SOURCE_WATCH_PIDFD(s))
+                return 0;
+
+        /* As in process_child(), don't reap the child yet, that's done after the dispatch */
+        zero(s->child.siginfo);
+        if (waitid(P_PID, s->child.pid, &s->child.siginfo, WNOHANG|WNOWAIT|WEXITED) < 0)
+                return -errno;
+
+        if (s->child.siginfo.si_pid == 0)
+                return 0;
+
+        return source_set_pending(s, true);
+}
+
 static int process_signal(sd_event *e, struct signal_data *d, uint32_t events) {
         bool read_one = false;
         int r;
@@ -2768,8 +4052,39 @@ static int process_inotify(sd_event *e) {
         return done;
 }
 
+static int source_read_now(sd_event_source *s) {
+        ssize_t n;
+        int r;
+
+        assert(s);
+        assert(s->type == SOURCE_READ);
+
+        /* Without the io_uring the read happens right before the callback. Returns 0 if there was nothing to read
+         * after all, and we wait for the fd again. */
+
+        if (s->read.recv)
+                n = recv(s->read.fd, s->read.buffer, s->read.size, s->read.flags|MSG_DONTWAIT);
+        else
+                n = read(s->read.fd, s->read.buffer, s->read.size);
+        if (n < 0) {
+                if (IN_SET(errno, EAGAIN, EINTR)) {
+                        r = source_read_submit(s);
+                        if (r < 0)
+                                return r;
+
+                        return 0;
+                }
+
+                s->read.result = -errno;
+        } else
+                s->read.result = n;
+
+        return 1;
+}
+
 static int source_dispatch(sd_event_source *s) {
         EventSourceType saved_type;
+        usec_t begin = 0;
         int r = 0;
 
         assert(s);
@@ -2785,6 +4100,12 @@ static int source_dispatch(sd_event_source *s) {
                         return r;
         }
 
+        if (s->type == SOURCE_READ && !s->event->uring) {
+                r = source_read_now(s);
+                if (r <= 0)
+                        return r;
+        }
+
         if (s->type != SOURCE_POST) {
                 sd_event_source *z;
                 Iterator i;
@@ -2808,6 +4129,21 @@ static int source_dispatch(sd_event_source *s) {
                         return r;
         }
 
+        if (s->event->profile_sources) {
+                begin = now(CLOCK_MONOTONIC);
+
+                if (s->profile.pending_since > 0 && begin > s->profile.pending_since) {
+                        usec_t t;
+
+                        t = begin - s->profile.pending_since;
+                        s->profile.pending_usec += t;
+                        s->profile.pending_max_usec = MAX(s->profile.pending_max_usec, t);
+                }
+                s->profile.pending_since = 0;
+        }
+
+        USDT_PROBE(sd_event, source_dispatch, s, saved_type, s->description);
+
         s->dispatching = true;
 
         switch (s->type) {
@@ -2836,9 +4172,17 @@ static int source_dispatch(sd_event_source *s) {
                 r = s->child.callback(s, &s->child.siginfo, s->userdata);
 
                 /* Now, reap the PID for good. */
-                if (zombie)
+                if (zombie) {
                         (void) waitid(P_PID, s->child.pid, &s->child.siginfo, WNOHANG|WEXITED);
 
+                        /* The callback might have disconnected the source already */
+                        if (s->type == SOURCE_CHILD) {
+                                s->child.exited = true;
+                                if (s->child.pidfd >= 0)
+                                        source_child_pidfd_unregister(s);
+                        }
+                }
+
                 break;
         }
 
@@ -2876,6 +4220,14 @@ static int source_dispatch(sd_event_source *s) {
                 break;
         }
 
+        case SOURCE_READ:
+                r = s->read.callback(s, s->read.fd, s->read.buffer, s->read.result, s->userdata);
+                break;
+
+        case SOURCE_WORK:
+                r = s->work.callback(s, s->work.result, s->userdata);
+                break;
+
         case SOURCE_WATCHDOG:
         case _SOURCE_EVENT_SOURCE_TYPE_MAX:
         case _SOURCE_EVENT_SOURCE_TYPE_INVALID:
@@ -2884,6 +4236,22 @@ static int source_dispatch(sd_event_source *s) {
 
         s->dispatching = false;
 
+        USDT_PROBE(sd_event, source_dispatched, s, saved_type, r);
+
+        if (begin > 0) {
+                usec_t t;
+
+                t = usec_sub_unsigned(now(CLOCK_MONOTONIC), begin);
+
+                s->profile.n_dispatched++;
+                s->profile.dispatch_usec += t;
+                s->profile.dispatch_max_usec = MAX(s->profile.dispatch_max_usec, t);
+
+                /* Defer sources stay pending while enabled, their next wait starts now */
+                if (s->pending)
+                        s->profile.pending_since = begin + t;
+        }
+
         if (r < 0)
                 log_debug_errno(r, "Event source %s (type %s) returned error, disabling: %m",
                                 strna(s->description), event_source_type_to_string(saved_type));
@@ -2892,6 +4260,23 @@ static int source_dispatch(sd_event_source *s) {
                 source_free(s);
         else if (r < 0)
                 sd_event_source_set_enabled(s, SD_EVENT_OFF);
+        else if (s->type == SOURCE_READ && s->enabled == SD_EVENT_ON) {
+                /* Reads of sources that stay enabled are only started again now, as the callback might have
+                 * consumed the data in place */
+                r = source_read_submit(s);
+                if (r < 0) {
+                        log_debug_errno(r, "Failed to restart read of event source %s, disabling: %m",
+                                        strna(s->description));
+                        sd_event_source_set_enabled(s, SD_EVENT_OFF);
+                }
+        } else if (s->type == SOURCE_WORK && s->enabled == SD_EVENT_ON) {
+                r = source_work_queue(s);
+                if (r < 0) {
+                        log_debug_errno(r, "Failed to queue work of event source %s again, disabling: %m",
+                                        strna(s->description));
+                        sd_event_source_set_enabled(s, SD_EVENT_OFF);
+                }
+        }
 
         return 1;
 }
@@ -3071,6 +4456,11 @@ _public_ int sd_event_prepare(sd_event *e) {
 
         event_close_inode_data_fds(e);
 
+        /* Submit now already, so that the completions are seen by whoever polls our epoll fd */
+        r = event_submit_uring(e);
+        if (r < 0)
+                return r;
+
         if (event_next_pending(e) || e->need_process_child)
                 goto pending;
 
@@ -3110,6 +4500,10 @@ _public_ int sd_event_wait(sd_event *e, uint64_t timeout) {
         if (e->inotify_data_buffered)
                 timeout = 0;
 
+        r = event_submit_uring(e);
+        if (r < 0)
+                goto finish;
+
         m = epoll_wait(e->epoll_fd, ev_queue, ev_queue_max,
                        timeout == (uint64_t) -1 ? -1 : (int) ((timeout + USEC_PER_MSEC - 1) / USEC_PER_MSEC));
         if (m < 0) {
@@ -3133,9 +4527,17 @@ _public_ int sd_event_wait(sd_event *e, uint64_t timeout) {
 
                         switch (*t) {
 
-                        case WAKEUP_EVENT_SOURCE:
-                                r = process_io(e, ev_queue[i].data.ptr, ev_queue[i].events);
+                        case WAKEUP_EVENT_SOURCE: {
+                                sd_event_source *s = ev_queue[i].data.ptr;
+
+                                if (s->type == SOURCE_CHILD)
+                                        r = process_pidfd(e, s, ev_queue[i].events);
+                                else if (s->type == SOURCE_READ)
+                                        r = process_read_ready(e, s, ev_queue[i].events);
+                                else
+                                        r = process_io(e, s, ev_queue[i].events);
                                 break;
+                        }
 
                         case WAKEUP_CLOCK_DATA: {
                                 struct clock_data *d = ev_queue[i].data.ptr;
@@ -3151,6 +4553,14 @@ _public_ int sd_event_wait(sd_event *e, uint64_t timeout) {
                                 r = event_inotify_data_read(e, ev_queue[i].data.ptr, ev_queue[i].events);
                                 break;
 
+                        case WAKEUP_URING_DATA:
+                                r = process_uring(e, ev_queue[i].events);
+                                break;
+
+                        case WAKEUP_WORK_DATA:
+                                r = process_work(e, ev_queue[i].events);
+                                break;
+
                         default:
                                 assert_not_reached("Invalid wake-up pointer");
                         }
@@ -3223,10 +4633,37 @@ _public_ int sd_event_dispatch(sd_event *e) {
         p = event_next_pending(e);
         if (p) {
                 _cleanup_(sd_event_unrefp) sd_event *ref = NULL;
+                usec_t begin = 0;
+                unsigned n = 0;
 
                 ref = sd_event_ref(e);
                 e->state = SD_EVENT_RUNNING;
-                r = source_dispatch(p);
+
+                if (e->dispatch_budget_n > 1 && e->dispatch_budget_usec > 0)
+                        begin = now(CLOCK_MONOTONIC);
+
+                /* With a dispatch budget, we go on with the sources that are pending already, in order of their
+                 * priority, without polling for new events and rearming the timers in between. Defer and exit
+                 * sources that are enabled permanently stay pending after they ran, hence stop when we come
+                 * across a source a second time, so that it can't take the whole budget for itself. */
+                for (;;) {
+                        p->dispatch_iteration = e->iteration;
+
+                        r = source_dispatch(p);
+                        if (r < 0)
+                                break;
+
+                        if (++n >= e->dispatch_budget_n || e->exit_requested)
+                                break;
+
+                        if (begin > 0 && now(CLOCK_MONOTONIC) >= usec_add(begin, e->dispatch_budget_usec))
+                                break;
+
+                        p = event_next_pending(e);
+                        if (!p || p->dispatch_iteration == e->iteration)
+                                break;
+                }
+
                 e->state = SD_EVENT_INITIAL;
                 return r;
         }
@@ -3491,6 +4928,135 @@ _public_ int sd_event_get_iteration(sd_event *e, uint64_t *ret) {
         return 0;
 }
 
+_public_ int sd_event_set_profile(sd_event *e, int b) {
+        sd_event_source *s;
+
+        assert_return(e, -EINVAL);
+        assert_return(e = event_resolve(e), -ENOPKG);
+        assert_return(e->state != SD_EVENT_FINISHED, -ESTALE);
+        assert_return(!event_pid_changed(e), -ECHILD);
+
+        if (e->profile_sources == !!b)
+                return e->profile_sources;
+
+        if (b) {
+                usec_t n;
+
+                /* Sources that are already pending have been waiting since at least now */
+                n = now(CLOCK_MONOTONIC);
+                LIST_FOREACH(sources, s, e->sources)
+                        s->profile.pending_since = s->pending ? n : 0;
+        }
+
+        e->profile_sources = b;
+        return e->profile_sources;
+}
+
+_public_ int sd_event_get_profile(sd_event *e) {
+        assert_return(e, -EINVAL);
+        assert_return(e = event_resolve(e), -ENOPKG);
+        assert_return(!event_pid_changed(e), -ECHILD);
+
+        return e->profile_sources;
+}
+
+_public_ int sd_event_set_dispatch_budget(sd_event *e, unsigned n, uint64_t usec) {
+        assert_return(e, -EINVAL);
+        assert_return(e = event_resolve(e), -ENOPKG);
+        assert_return(e->state != SD_EVENT_FINISHED, -ESTALE);
+        assert_return(n > 0, -EINVAL);
+        assert_return(!event_pid_changed(e), -ECHILD);
+
+        e->dispatch_budget_n = n;
+        e->dispatch_budget_usec = usec == USEC_INFINITY ? 0 : usec;
+
+        return 0;
+}
+
+_public_ int sd_event_get_dispatch_budget(sd_event *e, unsigned *ret_n, uint64_t *ret_usec) {
+        assert_return(e, -EINVAL);
+        assert_return(e = event_resolve(e), -ENOPKG);
+        assert_return(!event_pid_changed(e), -ECHILD);
+
+        if (ret_n)
+                *ret_n = e->dispatch_budget_n;
+        if (ret_usec)
+                *ret_usec = e->dispatch_budget_usec > 0 ? e->dispatch_budget_usec : USEC_INFINITY;
+
+        return 0;
+}
+
+_public_ int sd_event_source_get_profile(
+                sd_event_source *s,
+                uint64_t *ret_n_dispatched,
+                uint64_t *ret_dispatch_usec,
+                uint64_t *ret_dispatch_max_usec,
+                uint64_t *ret_pending_usec,
+                uint64_t *ret_pending_max_usec) {
+
+        assert_return(s, -EINVAL);
+        assert_return(!event_pid_changed(s->event), -ECHILD);
+
+        if (ret_n_dispatched)
+                *ret_n_dispatched = s->profile.n_dispatched;
+        if (ret_dispatch_usec)
+                *ret_dispatch_usec = s->profile.dispatch_usec;
+        if (ret_dispatch_max_usec)
+                *ret_dispatch_max_usec = s->profile.dispatch_max_usec;
+        if (ret_pending_usec)
+                *ret_pending_usec = s->profile.pending_usec;
+        if (ret_pending_max_usec)
+                *ret_pending_max_usec = s->profile.pending_max_usec;
+
+        return 0;
+}
+
+static int source_profile_compare(sd_event_source * const *a, sd_event_source * const *b) {
+        /* Most expensive ones first */
+        return -CMP((*a)->profile.dispatch_usec, (*b)->profile.dispatch_usec);
+}
+
+int event_dump_profile(sd_event *e, FILE *f, const char *prefix) {
+        _cleanup_free_ sd_event_source **list = NULL;
+        sd_event_source *s;
+        size_t n = 0, i;
+
+        assert(e);
+        assert(f);
+
+        if (!e->profile_sources || e->n_sources == 0)
+                return 0;
+
+        list = new(sd_event_source*, e->n_sources);
+        if (!list)
+                return -ENOMEM;
+
+        LIST_FOREACH(sources, s, e->sources)
+                if (s->profile.n_dispatched > 0)
+                        list[n++] = s;
+
+        typesafe_qsort(list, n, source_profile_compare);
+
+        for (i = 0; i < n; i++) {
+                char a[FORMAT_TIMESPAN_MAX], b[FORMAT_TIMESPAN_MAX], c[FORMAT_TIMESPAN_MAX], d[FORMAT_TIMESPAN_MAX];
+
+                s = list[i];
+
+                fprintf(f,
+                        "%sEvent source %s (%s): dispatched %" PRIu64 " times, took %s (max %s), pending for %s (max %s)\n",
+                        strempty(prefix),
+                        strna(s->description),
+                        strna(event_source_type_to_string(s->type)),
+                        s->profile.n_dispatched,
+                        format_timespan(a, sizeof(a), s->profile.dispatch_usec, 1),
+                        format_timespan(b, sizeof(b), s->profile.dispatch_max_usec, 1),
+                        format_timespan(c, sizeof(c), s->profile.pending_usec, 1),
+                        format_timespan(d, sizeof(d), s->profile.pending_max_usec, 1));
+        }
+
+        return 0;
+}
+
 _public_ int sd_event_source_set_destroy_callback(sd_event_source *s, sd_event_destroy_t callback) {
         assert_return(s, -EINVAL);
 
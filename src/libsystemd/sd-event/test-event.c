@@ -5,10 +5,13 @@
 #include "sd-event.h"
 
 #include "alloc-util.h"
+#include "event-util.h"
 #include "fd-util.h"
+#include "fileio.h"
 #include "fs-util.h"
 #include "log.h"
 #include "macro.h"
+#include "missing_syscall.h"
 #include "parse-util.h"
 #include "process-util.h"
 #include "rm-rf.h"
@@ -287,6 +290,269 @@ static void test_sd_event_now(void) {
         assert_se(sd_event_now(e, 900 /* arbitrary big number */, &event_now) == -EOPNOTSUPP);
 }
 
+#define N_WHEEL_TIMERS 200U
+
+static unsigned n_wheel_fired = 0, n_wheel_expected = 0;
+
+static int wheel_handler(sd_event_source *s, uint64_t usec, void *userdata) {
+        unsigned *fired = userdata;
+        uint64_t t;
+
+        assert_se(sd_event_now(sd_event_source_get_event(s), CLOCK_MONOTONIC, &t) >= 0);
+        assert_se(t >= usec);
+
+        n_wheel_fired++;
+
+        /* Let every source fire twice, to exercise rescheduling from the callback */
+        if (++(*fired) < 2) {
+                assert_se(sd_event_source_set_time(s, t + 20 * USEC_PER_MSEC) >= 0);
+                assert_se(sd_event_source_set_enabled(s, SD_EVENT_ONESHOT) >= 0);
+        }
+
+        return 0;
+}
+
+static void test_timer_wheel(void) {
+        _cleanup_(sd_event_unrefp) sd_event *e = NULL;
+        sd_event_source *sources[N_WHEEL_TIMERS];
+        unsigned fired[N_WHEEL_TIMERS] = {}, i;
+        uint64_t t;
+
+        /* Enough timers to make sd-event use its timing wheel, with a mix of accuracies, times far away and
+         * times that are changed while they are pending */
+
+        assert_se(sd_event_new(&e) >= 0);
+        assert_se(sd_event_now(e, CLOCK_MONOTONIC, &t) >= 0);
+
+        for (i = 0; i < N_WHEEL_TIMERS; i++) {
+                assert_se(sd_event_add_time(e, &sources[i], CLOCK_MONOTONIC,
+                                            t + (i % 20) * 10 * USEC_PER_MSEC + (i % 7 == 0 ? 100 * USEC_PER_SEC : 0),
+                                            i % 5 == 0 ? 1 : 0,
+                                            wheel_handler, &fired[i]) >= 0);
+                n_wheel_expected += 2;
+        }
+
+        /* Run once so that the wheel is set up */
+        assert_se(sd_event_run(e, 0) >= 0);
+
+        for (i = 0; i < N_WHEEL_TIMERS; i++) {
+                if (i % 7 == 0)
+                        /* Bring the far away ones close */
+                        assert_se(sd_event_source_set_time(sources[i], t + 50 * USEC_PER_MSEC) >= 0);
+                else if (i % 3 == 0)
+                        assert_se(sd_event_source_set_time(sources[i], t + 300 * USEC_PER_MSEC) >= 0);
+                else if (i % 11 == 0) {
+                        assert_se(sd_event_source_set_enabled(sources[i], SD_EVENT_OFF) >= 0);
+                        n_wheel_expected -= 2;
+                }
+        }
+
+        while (n_wheel_fired < n_wheel_expected)
+                assert_se(sd_event_run(e, (uint64_t) -1) >= 0);
+
+        for (i = 0; i < N_WHEEL_TIMERS; i++) {
+                assert_se(fired[i] == (i % 7 != 0 && i % 3 != 0 && i % 11 == 0 ? 0U : 2U));
+                sd_event_source_unref(sources[i]);
+        }
+
+        assert_se(n_wheel_fired == n_wheel_expected);
+}
+
+#define N_CHILDREN 20U
+
+static unsigned n_children_exited = 0;
+
+static int many_children_handler(sd_event_source *s, const siginfo_t *si, void *userdata) {
+        assert_se(si->si_code == CLD_EXITED);
+        assert_se(si->si_status == PTR_TO_INT(userdata));
+
+        /* Must still be a zombie */
+        assert_se(kill(si->si_pid, 0) >= 0);
+
+        if (++n_children_exited == N_CHILDREN)
+                assert_se(sd_event_exit(sd_event_source_get_event(s), 0) >= 0);
+
+        return 0;
+}
+
+static void test_many_children(void) {
+        _cleanup_(sd_event_unrefp) sd_event *e = NULL;
+        sd_event_source *sources[N_CHILDREN];
+        unsigned i;
+
+        /* Half of the children are only watched for their exit, which uses pidfds where available, the others
+         * are also watched for being stopped, which always goes through SIGCHLD */
+
+        assert_se(sigprocmask_many(SIG_BLOCK, NULL, SIGCHLD, -1) >= 0);
+        assert_se(sd_event_default(&e) >= 0);
+
+        for (i = 0; i < N_CHILDREN; i++) {
+                pid_t pid;
+
+                pid = fork();
+                assert_se(pid >= 0);
+
+                if (pid == 0)
+                        _exit(i);
+
+                assert_se(sd_event_add_child(e, &sources[i], pid, i % 2 == 0 ? WEXITED : WEXITED|WSTOPPED,
+                                             many_children_handler, INT_TO_PTR(i)) >= 0);
+        }
+
+        assert_se(sd_event_loop(e) >= 0);
+        assert_se(n_children_exited == N_CHILDREN);
+
+        for (i = 0; i < N_CHILDREN; i++) {
+                pid_t pid;
+
+                /* All of them must have been reaped */
+                assert_se(sd_event_source_get_child_pid(sources[i], &pid) >= 0);
+                assert_se(waitpid(pid, NULL, WNOHANG) < 0 && errno == ECHILD);
+
+                sd_event_source_unref(sources[i]);
+        }
+}
+
+static unsigned n_pipe_reads = 0, n_recvs = 0, n_oneshot = 0, n_edge = 0;
+static size_t file_read = 0;
+static bool file_eof = false;
+
+static int pipe_read_handler(sd_event_source *s, int fd, const void *data, ssize_t size, void *userdata) {
+        assert_se(size == 5);
+        assert_se(memcmp(data, "hello", 5) == 0);
+
+        n_pipe_reads++;
+
+        return 0;
+}
+
+static int recv_handler(sd_event_source *s, int fd, const void *data, ssize_t size, void *userdata) {
+        static const char *const expected[] = { "one", "two", "three" };
+
+        assert_se(n_recvs < ELEMENTSOF(expected));
+        assert_se(size == (ssize_t) strlen(expected[n_recvs]));
+        assert_se(memcmp(data, expected[n_recvs], size) == 0);
+
+        if (++n_recvs == ELEMENTSOF(expected))
+                assert_se(sd_event_source_set_enabled(s, SD_EVENT_OFF) >= 0);
+
+        return 0;
+}
+
+static int file_read_handler(sd_event_source *s, int fd, const void *data, ssize_t size, void *userdata) {
+        const char *contents = userdata;
+
+        assert_se(size >= 0);
+
+        if (size == 0) {
+                assert_se(file_read == strlen(contents));
+                file_eof = true;
+                assert_se(sd_event_source_set_enabled(s, SD_EVENT_OFF) >= 0);
+                return 0;
+        }
+
+        assert_se(size <= 4);
+        assert_se(memcmp(data, contents + file_read, size) == 0);
+        file_read += size;
+
+        return 0;
+}
+
+static int oneshot_io_handler(sd_event_source *s, int fd, uint32_t revents, void *userdata) {
+        char c;
+
+        assert_se(revents & EPOLLIN);
+        assert_se(read(fd, &c, 1) == 1);
+
+        /* Arm it again for the next byte */
+        if (++n_oneshot < 3)
+                assert_se(sd_event_source_set_enabled(s, SD_EVENT_ONESHOT) >= 0);
+
+        return 0;
+}
+
+static int edge_io_handler(sd_event_source *s, int fd, uint32_t revents, void *userdata) {
+        char buf[16];
+
+        assert_se(revents & EPOLLIN);
+        assert_se(read(fd, buf, sizeof(buf)) > 0);
+
+        n_edge++;
+
+        return 0;
+}
+
+static void test_read(bool uring) {
+        const char *contents = "the contents of a regular file";
+        _cleanup_(unlink_tempfilep) char name[] = "/tmp/test-event-read.XXXXXX";
+        _cleanup_close_pair_ int p[2] = { -1, -1 }, q[2] = { -1, -1 }, r[2] = { -1, -1 }, sp[2] = { -1, -1 };
+        _cleanup_close_ int fd = -1;
+        sd_event_source *a = NULL, *b = NULL, *c = NULL, *d = NULL, *f = NULL;
+        _cleanup_(sd_event_unrefp) sd_event *e = NULL;
+
+        log_info("/* %s(%s) */", __func__, yes_no(uring));
+
+        n_pipe_reads = n_recvs = n_oneshot = n_edge = 0;
+        file_read = 0;
+        file_eof = false;
+
+        assert_se(setenv("SD_EVENT_IO_URING", one_zero(uring), 1) >= 0);
+        assert_se(sd_event_new(&e) >= 0);
+        assert_se(unsetenv("SD_EVENT_IO_URING") >= 0);
+
+        assert_se(pipe2(p, O_CLOEXEC|O_NONBLOCK) >= 0);
+        assert_se(pipe2(q, O_CLOEXEC|O_NONBLOCK) >= 0);
+        assert_se(pipe2(r, O_CLOEXEC|O_NONBLOCK) >= 0);
+        assert_se(socketpair(AF_UNIX, SOCK_DGRAM|SOCK_CLOEXEC|SOCK_NONBLOCK, 0, sp) >= 0);
+
+        fd = mkostemp_safe(name);
+        assert_se(fd >= 0);
+        assert_se(write(fd, contents, strlen(contents)) == (ssize_t) strlen(contents));
+        assert_se(lseek(fd, 0, SEEK_SET) == 0);
+
+        /* A read that is started before the data is there, and one afterwards */
+        assert_se(sd_event_add_read(e, &a, p[0], 64, pipe_read_handler, NULL) >= 0);
+        assert_se(sd_event_source_get_read_fd(a) == p[0]);
+        assert_se(sd_event_run(e, 0) >= 0);
+        assert_se(n_pipe_reads == 0);
+        assert_se(write(p[1], "hello", 5) == 5);
+
+        assert_se(sd_event_add_recv(e, &b, sp[0], 64, 0, recv_handler, NULL) >= 0);
+        assert_se(sd_event_source_set_enabled(b, SD_EVENT_ON) >= 0);
+        assert_se(send(sp[1], "one", 3, 0) == 3);
+        assert_se(send(sp[1], "two", 3, 0) == 3);
+        assert_se(send(sp[1], "three", 5, 0) == 5);
+
+        assert_se(sd_event_add_read(e, &c, fd, 4, file_read_handler, (void*) contents) >= 0);
+        assert_se(sd_event_source_set_enabled(c, SD_EVENT_ON) >= 0);
+
+        assert_se(sd_event_add_io(e, &d, q[0], EPOLLIN, oneshot_io_handler, NULL) >= 0);
+        assert_se(sd_event_source_set_enabled(d, SD_EVENT_ONESHOT) >= 0);
+        assert_se(write(q[1], "xyz", 3) == 3);
+
+        assert_se(sd_event_add_io(e, &f, r[0], EPOLLIN|EPOLLET, edge_io_handler, NULL) >= 0);
+        assert_se(write(r[1], "x", 1) == 1);
+
+        while (n_pipe_reads < 1 || n_recvs < 3 || !file_eof || n_oneshot < 3 || n_edge < 1)
+                assert_se(sd_event_run(e, (uint64_t) -1) >= 0);
+
+        /* The edge-triggered source fires again only for new data */
+        assert_se(write(r[1], "y", 1) == 1);
+        while (n_edge < 2)
+                assert_se(sd_event_run(e, (uint64_t) -1) >= 0);
+
+        /* Start another read that will never complete, it has to be cancelled when the source is released */
+        assert_se(sd_event_source_set_enabled(a, SD_EVENT_ONESHOT) >= 0);
+        assert_se(sd_event_run(e, 0) >= 0);
+        assert_se(n_pipe_reads == 1);
+
+        sd_event_source_unref(a);
+        sd_event_source_unref(b);
+        sd_event_source_unref(c);
+        sd_event_source_unref(d);
+        sd_event_source_unref(f);
+}
+
 static int last_rtqueue_sigval = 0;
 static int n_rtqueue = 0;
 
@@ -481,12 +747,294 @@ static void test_inotify(unsigned n_create_events) {
         sd_event_unref(e);
 }
 
+static int slow_handler(sd_event_source *s, void *userdata) {
+        unsigned *n = userdata;
+
+        assert_se(usleep(2 * USEC_PER_MSEC) >= 0);
+        (*n)++;
+
+        return 0;
+}
+
+static int fast_handler(sd_event_source *s, void *userdata) {
+        return 0;
+}
+
+static void test_profile(void) {
+        _cleanup_(sd_event_source_unrefp) sd_event_source *a = NULL, *b = NULL;
+        _cleanup_(sd_event_unrefp) sd_event *e = NULL;
+        _cleanup_free_ char *dump = NULL;
+        _cleanup_fclose_ FILE *f = NULL;
+        uint64_t n, t, m, p, pm;
+        unsigned k = 0;
+        size_t sz;
+
+        assert_se(sd_event_new(&e) >= 0);
+        assert_se(sd_event_set_profile(e, false) == 0);
+        assert_se(sd_event_get_profile(e) == 0);
+
+        assert_se(sd_event_add_defer(e, &a, slow_handler, &k) >= 0);
+        assert_se(sd_event_source_set_description(a, "slow") >= 0);
+        assert_se(sd_event_add_defer(e, &b, fast_handler, NULL) >= 0);
+        assert_se(sd_event_source_set_description(b, "fast") >= 0);
+        assert_se(sd_event_source_set_priority(b, SD_EVENT_PRIORITY_IDLE) >= 0);
+        assert_se(sd_event_source_set_enabled(b, SD_EVENT_OFF) >= 0);
+
+        /* Nothing is accounted while profiling is off */
+        assert_se(sd_event_run(e, 0) > 0);
+        assert_se(k == 1);
+        assert_se(sd_event_source_get_profile(a, &n, &t, &m, &p, NULL) >= 0);
+        assert_se(n == 0 && t == 0 && m == 0 && p == 0);
+
+        assert_se(sd_event_set_profile(e, true) == 1);
+        assert_se(sd_event_get_profile(e) == 1);
+
+        assert_se(sd_event_source_set_enabled(a, SD_EVENT_ONESHOT) >= 0);
+        assert_se(sd_event_source_set_enabled(b, SD_EVENT_ONESHOT) >= 0);
+        assert_se(sd_event_run(e, 0) > 0);
+        assert_se(sd_event_run(e, 0) > 0);
+        assert_se(k == 2);
+
+        assert_se(sd_event_source_get_profile(a, &n, &t, &m, NULL, NULL) >= 0);
+        assert_se(n == 1);
+        assert_se(m >= 2 * USEC_PER_MSEC);
+        assert_se(t == m);
+
+        /* The fast one had to wait for the slow one */
+        assert_se(sd_event_source_get_profile(b, &n, &t, NULL, &p, &pm) >= 0);
+        assert_se(n == 1);
+        assert_se(t < m);
+        assert_se(p >= m);
+        assert_se(pm == p);
+
+        assert_se(f = open_memstream(&dump, &sz));
+        assert_se(event_dump_profile(e, f, "-> ") >= 0);
+        assert_se(fflush_and_check(f) >= 0);
+        printf("%s", dump);
+        assert_se(startswith(dump, "-> Event source slow (defer): dispatched 1 times"));
+        assert_se(strstr(dump, "\n-> Event source fast (defer): dispatched 1 times"));
+}
+
+#define N_WORK 20U
+
+struct work_context {
+        unsigned n_done;
+        unsigned n_repeat;
+        unsigned n_once;
+        pid_t loop_tid;
+        pid_t tids[N_WORK];
+};
+
+struct work_item {
+        struct work_context *context;
+        unsigned index;
+};
+
+static int work_function(void *userdata) {
+        struct work_item *i = userdata;
+
+        assert_se(usleep(5 * USEC_PER_MSEC) >= 0);
+        i->context->tids[i->index] = gettid();
+
+        return (int) i->index;
+}
+
+static int work_done_handler(sd_event_source *s, int result, void *userdata) {
+        struct work_item *i = userdata;
+        struct work_context *c = i->context;
+
+        assert_se(gettid() == c->loop_tid);
+        assert_se(result == (int) i->index);
+        assert_se(c->tids[i->index] != 0);
+        assert_se(c->tids[i->index] != c->loop_tid);
+
+        c->n_done++;
+
+        return 0;
+}
+
+static int repeat_work_function(void *userdata) {
+        return -EBADMSG;
+}
+
+static int repeat_done_handler(sd_event_source *s, int result, void *userdata) {
+        struct work_context *c = userdata;
+
+        assert_se(result == -EBADMSG);
+
+        if (++c->n_repeat == 3)
+                assert_se(sd_event_source_set_enabled(s, SD_EVENT_OFF) >= 0);
+
+        return 0;
+}
+
+static int once_done_handler(sd_event_source *s, int result, void *userdata) {
+        struct work_context *c = userdata;
+
+        assert_se(result == -EBADMSG);
+        c->n_once++;
+
+        return 0;
+}
+
+static int unexpected_done_handler(sd_event_source *s, int result, void *userdata) {
+        assert_not_reached("work of released event source completed");
+}
+
+static void test_work(void) {
+        _cleanup_(sd_event_source_unrefp) sd_event_source *repeat = NULL, *gone = NULL;
+        _cleanup_(sd_event_unrefp) sd_event *e = NULL;
+        struct work_context c = {
+                .loop_tid = gettid(),
+        };
+        struct work_item items[N_WORK], gone_item = {
+                .context = &c,
+                .index = 0,
+        };
+        sd_event_source *s;
+        unsigned i;
+
+        assert_se(sd_event_new(&e) >= 0);
+
+        for (i = 0; i < N_WORK; i++) {
+                items[i] = (struct work_item) {
+                        .context = &c,
+                        .index = i,
+                };
+
+                assert_se(sd_event_add_work(e, NULL, work_function, work_done_handler, items + i) >= 0);
+        }
+
+        assert_se(sd_event_add_work(e, &repeat, repeat_work_function, repeat_done_handler, &c) >= 0);
+        assert_se(sd_event_source_set_enabled(repeat, SD_EVENT_ON) >= 0);
+
+        /* Released before the loop ever ran, hence either still queued or running, and must never complete */
+        assert_se(sd_event_add_work(e, &gone, work_function, unexpected_done_handler, &gone_item) >= 0);
+        gone = sd_event_source_unref(gone);
+
+        /* Disabled right away, and enabled again later */
+        assert_se(sd_event_add_work(e, &s, repeat_work_function, once_done_handler, &c) >= 0);
+        assert_se(sd_event_source_set_enabled(s, SD_EVENT_OFF) >= 0);
+        assert_se(sd_event_source_set_enabled(s, SD_EVENT_ONESHOT) >= 0);
+        assert_se(sd_event_source_set_floating(s, true) >= 0);
+        sd_event_source_unref(s);
+
+        while (c.n_done < N_WORK || c.n_repeat < 3 || c.n_once < 1)
+                assert_se(sd_event_run(e, (uint64_t) -1) >= 0);
+
+        /* Nothing is left to do */
+        assert_se(sd_event_run(e, 10 * USEC_PER_MSEC) == 0);
+        assert_se(c.n_done == N_WORK);
+        assert_se(c.n_repeat == 3);
+        assert_se(c.n_once == 1);
+}
+
+static int count_handler(sd_event_source *s, void *userdata) {
+        unsigned *n = userdata;
+
+        (*n)++;
+        return 0;
+}
+
+static void test_dispatch_budget(void) {
+        _cleanup_(sd_event_unrefp) sd_event *e = NULL;
+        sd_event_source *s;
+        uint64_t usec;
+        unsigned i, k = 0, l = 0, n;
+
+        assert_se(sd_event_new(&e) >= 0);
+
+        assert_se(sd_event_get_dispatch_budget(e, &n, &usec) >= 0);
+        assert_se(n == 1);
+        assert_se(usec == USEC_INFINITY);
+        assert_se(sd_event_set_dispatch_budget(e, 0, 0) == -EINVAL);
+
+        for (i = 0; i < 5; i++) {
+                assert_se(sd_event_add_defer(e, &s, count_handler, &k) >= 0);
+                assert_se(sd_event_source_set_floating(s, true) >= 0);
+                sd_event_source_unref(s);
+        }
+
+        /* One at a time by default */
+        assert_se(sd_event_run(e, 0) > 0);
+        assert_se(k == 1);
+
+        /* Then up to three per iteration */
+        assert_se(sd_event_set_dispatch_budget(e, 3, USEC_INFINITY) >= 0);
+        assert_se(sd_event_run(e, 0) > 0);
+        assert_se(k == 4);
+        assert_se(sd_event_run(e, 0) > 0);
+        assert_se(k == 5);
+        assert_se(sd_event_run(e, 0) == 0);
+
+        /* Higher priority sources still go first */
+        assert_se(sd_event_add_defer(e, &s, count_handler, &k) >= 0);
+        assert_se(sd_event_source_set_priority(s, SD_EVENT_PRIORITY_IDLE) >= 0);
+        assert_se(sd_event_source_set_floating(s, true) >= 0);
+        sd_event_source_unref(s);
+        assert_se(sd_event_add_defer(e, &s, count_handler, &l) >= 0);
+        assert_se(sd_event_source_set_priority(s, SD_EVENT_PRIORITY_IMPORTANT) >= 0);
+        assert_se(sd_event_source_set_floating(s, true) >= 0);
+        sd_event_source_unref(s);
+        assert_se(sd_event_set_dispatch_budget(e, 1, USEC_INFINITY) >= 0);
+        assert_se(sd_event_run(e, 0) > 0);
+        assert_se(k == 5 && l == 1);
+        assert_se(sd_event_run(e, 0) > 0);
+        assert_se(k == 6 && l == 1);
+
+        /* A source that stays pending after it ran is dispatched only once per iteration, and doesn't take
+         * the budget of the iteration for itself */
+        k = l = 0;
+        assert_se(sd_event_add_defer(e, &s, count_handler, &l) >= 0);
+        assert_se(sd_event_source_set_enabled(s, SD_EVENT_ON) >= 0);
+        assert_se(sd_event_set_dispatch_budget(e, 10, USEC_INFINITY) >= 0);
+        for (i = 0; i < 5; i++) {
+                assert_se(sd_event_run(e, 0) > 0);
+                assert_se(l == i + 1);
+        }
+        for (i = 0; i < 3; i++) {
+                sd_event_source *t;
+
+                assert_se(sd_event_add_defer(e, &t, count_handler, &k) >= 0);
+                assert_se(sd_event_source_set_priority(t, SD_EVENT_PRIORITY_IMPORTANT) >= 0);
+                assert_se(sd_event_source_set_floating(t, true) >= 0);
+                sd_event_source_unref(t);
+        }
+        assert_se(sd_event_run(e, 0) > 0);
+        assert_se(k == 3 && l == 6);
+        s = sd_event_source_unref(s);
+
+        /* The time budget ends the iteration early */
+        k = 0;
+        for (i = 0; i < 3; i++) {
+                assert_se(sd_event_add_defer(e, &s, slow_handler, &k) >= 0);
+                assert_se(sd_event_source_set_floating(s, true) >= 0);
+                sd_event_source_unref(s);
+        }
+        assert_se(sd_event_set_dispatch_budget(e, 100, USEC_PER_MSEC) >= 0);
+        assert_se(sd_event_get_dispatch_budget(e, &n, &usec) >= 0);
+        assert_se(n == 100);
+        assert_se(usec == USEC_PER_MSEC);
+        assert_se(sd_event_run(e, 0) > 0);
+        assert_se(k == 1);
+}
+
 int main(int argc, char *argv[]) {
         test_setup_logging(LOG_DEBUG);
 
         test_basic();
         test_sd_event_now();
         test_rtqueue();
+        test_timer_wheel();
+        test_many_children();
+        test_read(false);
+        test_read(true);
+
+        test_profile();
+
+        test_work();
+
+        test_dispatch_budget();
 
         test_inotify(100); /* should work without overflow */
         test_inotify(33000); /* should trigger a q overflow */
@@ -27,14 +27,31 @@ struct trie_header_f {
         /* size of the nodes and string section */
         le64_t nodes_len;
         le64_t strings_len;
+
+        /* Added later, only valid if header_size covers them. If they are, the nodes are placed in depth-first
+         * order, each right before its children, and carry the hints in trie_node_f. */
+
+        /* sorted array of trie_prefix_entry_f */
+        le64_t prefix_index_off;
+        le64_t prefix_index_count;
+
+        /* array of trie_source_entry_f, only written in the v2 format */
+        le64_t sources_off;
+        le64_t sources_count;
 } _packed_;
 
+/* the node has children for the glob characters '*', '?' or '[' */
+#define TRIE_NODE_GLOB_CHILDREN (UINT8_C(1) << 0)
+
 struct trie_node_f {
         /* prefix of lookup string, shared by all children  */
         le64_t prefix_off;
         /* size of children entry array appended to the node */
         uint8_t children_count;
-        uint8_t padding[7];
+        /* hints, zero in files without the prefix index: if the node has no more children than fit in here, the
+         * characters of all of them, in the order of the children entry array, and TRIE_NODE_* flags */
+        uint8_t children_c[6];
+        uint8_t flags;
         /* size of value entry array appended to the node */
         le64_t values_count;
 } _packed_;
@@ -54,6 +71,26 @@ struct trie_value_entry_f {
         le64_t value_off;
 } _packed_;
 
+/* Where lookups for "TYPE:..." continue, for all types which are reached without passing a node with glob children
+ * and without glob characters: right after the first ':', at the given character of the prefix of the node. Looking
+ * up such a modalias from there gives the same result as from the root. */
+struct trie_prefix_entry_f {
+        /* the modalias up to and including the first ':' */
+        le64_t prefix_off;
+        le64_t node_off;
+        le64_t node_prefix_pos;
+} _packed_;
+
+/* A source file of the database, in the order of its priority. When the database is updated, the values of all
+ * sources whose modification time and size did not change are taken from the previous file. */
+struct trie_source_entry_f {
+        le64_t filename_off;
+        le64_t mtime;
+        le64_t size;
+        le16_t file_priority;
+        uint8_t padding[6];
+} _packed_;
+
 /* v2 extends v1 with filename and line-number */
 struct trie_value_entry2_f {
         le64_t key_off;
@@ -1,7 +1,14 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 
 #include <ctype.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdarg.h>
 #include <stdio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "alloc-util.h"
 #include "conf-files.h"
@@ -10,12 +17,14 @@
 #include "fs-util.h"
 #include "hwdb-internal.h"
 #include "hwdb-util.h"
+#include "io-util.h"
 #include "label.h"
 #include "mkdir.h"
 #include "path-util.h"
 #include "strbuf.h"
 #include "string-util.h"
 #include "strv.h"
+#include "time-util.h"
 #include "tmpfile-util.h"
 
 static const char *default_hwdb_bin_dir = "/etc/udev";
@@ -38,9 +47,17 @@ struct trie {
         size_t nodes_count;
         size_t children_count;
         size_t values_count;
+
+        /* sorted array of the nodes lookups of "TYPE:..." modaliases may start at */
+        struct trie_prefix_entry *prefixes;
+        size_t prefixes_count;
+        size_t prefixes_allocated;
 };
 
 struct trie_node {
+        /* offset in the file, assigned before the nodes are written */
+        uint64_t off;
+
         /* prefix, common part for all children of this node */
         size_t prefix_off;
 
@@ -59,6 +76,14 @@ struct trie_child_entry {
         struct trie_node *child;
 };
 
+/* prefix index item, the lookup of a modalias starting with the prefix continues at the given position of the prefix
+ * of the node */
+struct trie_prefix_entry {
+        size_t prefix_off;
+        struct trie_node *node;
+        size_t node_prefix_pos;
+};
+
 /* value array item with key-value pairs */
 struct trie_value_entry {
         size_t key_off;
@@ -68,6 +93,48 @@ struct trie_value_entry {
         uint16_t file_priority;
 };
 
+/* a property line of a source file, for all matches from match_first on */
+struct hwdb_record {
+        size_t match_first;
+        size_t match_count;
+        const char *key;
+        const char *value;
+        uint32_t line_number;
+};
+
+/* a warning about a source file, logged when its records are inserted, to keep them in order */
+struct hwdb_warning {
+        uint32_t line_number;
+        char *message;
+};
+
+/* a source file, which is parsed by one of the parser threads, unless its values are reused */
+struct hwdb_file {
+        const char *filename;
+        uint16_t file_priority;
+        struct stat st;
+
+        /* the values are taken from the previous database */
+        bool reuse;
+        /* the file was parsed completely, hence it is recorded in the sources of the database */
+        bool parsed;
+        ssize_t filename_off;
+
+        /* the text of the file, which the matches, keys and values point into */
+        char *text;
+        char **matches;
+        size_t matches_count;
+        size_t matches_allocated;
+        struct hwdb_record *records;
+        size_t records_count;
+        size_t records_allocated;
+        struct hwdb_warning *warnings;
+        size_t warnings_count;
+        size_t warnings_allocated;
+
+        int r;
+};
+
 static int trie_children_cmp(const struct trie_child_entry *a, const struct trie_child_entry *b) {
         return CMP(a->c, b->c);
 }
@@ -121,14 +188,21 @@ static void trie_free(struct trie *trie) {
 
         trie_node_cleanup(trie->root);
         strbuf_cleanup(trie->strings);
+        free(trie->prefixes);
         free(trie);
 }
 
 DEFINE_TRIVIAL_CLEANUP_FUNC(struct trie*, trie_free);
 
 static int trie_values_cmp(const struct trie_value_entry *a, const struct trie_value_entry *b, struct trie *trie) {
-        return strcmp(trie->strings->buf + a->key_off,
-                      trie->strings->buf + b->key_off);
+        int r;
+
+        r = strcmp(trie->strings->buf + a->key_off,
+                   trie->strings->buf + b->key_off);
+        if (r != 0)
+                return r;
+
+        return CMP(a->file_priority, b->file_priority);
 }
 
 static int trie_node_add_value(struct trie *trie, struct trie_node *node,
@@ -150,16 +224,23 @@ static int trie_node_add_value(struct trie *trie, struct trie_node *node,
                         return fn;
         }
 
+        /* The v1 format has no priorities, hence there the value of a later file replaces the one of an earlier
+         * file. In the v2 format, the values of all files are kept and readers pick the one with the highest
+         * priority, so that the values of each file can be reused when another one changed. */
+        if (compat)
+                file_priority = 0;
+
         if (node->values_count) {
                 struct trie_value_entry search = {
                         .key_off = k,
                         .value_off = v,
+                        .file_priority = file_priority,
                 };
 
                 val = typesafe_bsearch_r(&search, node->values, node->values_count, trie_values_cmp, trie);
                 if (val) {
                         /* At this point we have 2 identical properties on the same match-string.
-                         * Since we process files in order, we just replace the previous value. */
+                         * Since we process each file in order, we just replace the previous value. */
                         val->value_off = v;
                         val->filename_off = fn;
                         val->file_priority = file_priority;
@@ -275,6 +356,90 @@ static int trie_insert(struct trie *trie, struct trie_node *node, const char *se
         }
 }
 
+#define TRIE_PREFIX_MAX 64U
+
+static bool trie_node_has_glob_children(const struct trie_node *node) {
+        size_t i;
+
+        for (i = 0; i < node->children_count; i++)
+                if (IN_SET(node->children[i].c, '*', '?', '['))
+                        return true;
+
+        return false;
+}
+
+static int trie_add_prefix(struct trie *trie, const char *prefix, size_t len, struct trie_node *node, size_t pos) {
+        ssize_t off;
+
+        off = strbuf_add_string(trie->strings, prefix, len);
+        if (off < 0)
+                return off;
+
+        if (!GREEDY_REALLOC(trie->prefixes, trie->prefixes_allocated, trie->prefixes_count + 1))
+                return -ENOMEM;
+
+        trie->prefixes[trie->prefixes_count++] = (struct trie_prefix_entry) {
+                .prefix_off = off,
+                .node = node,
+                .node_prefix_pos = pos,
+        };
+
+        return 0;
+}
+
+/* Finds the first ':' on all paths from the node which consist of literal characters only, and which do not pass a
+ * node with glob children. A lookup of a match starting with such a path does nothing but compare characters until it
+ * reaches the ':', hence it can start right there. */
+static int trie_index_prefixes(struct trie *trie, struct trie_node *node, char *path, size_t len) {
+        const char *prefix;
+        size_t p, i;
+        int r;
+
+        prefix = trie->strings->buf + node->prefix_off;
+        for (p = 0; prefix[p]; p++) {
+                if (IN_SET(prefix[p], '*', '?', '[') || len + p + 1 >= TRIE_PREFIX_MAX)
+                        return 0;
+
+                path[len + p] = prefix[p];
+                if (prefix[p] == ':')
+                        return trie_add_prefix(trie, path, len + p + 1, node, p + 1);
+        }
+        len += p;
+
+        if (trie_node_has_glob_children(node) || len + 1 >= TRIE_PREFIX_MAX)
+                return 0;
+
+        for (i = 0; i < node->children_count; i++) {
+                path[len] = node->children[i].c;
+
+                if (path[len] == ':')
+                        r = trie_add_prefix(trie, path, len + 1, node->children[i].child, 0);
+                else
+                        r = trie_index_prefixes(trie, node->children[i].child, path, len + 1);
+                if (r < 0)
+                        return r;
+        }
+
+        return 0;
+}
+
+static int trie_prefixes_cmp(const struct trie_prefix_entry *a, const struct trie_prefix_entry *b, struct trie *trie) {
+        return strcmp(trie->strings->buf + a->prefix_off,
+                      trie->strings->buf + b->prefix_off);
+}
+
+static int trie_build_prefix_index(struct trie *trie) {
+        char path[TRIE_PREFIX_MAX];
+        int r;
+
+        r = trie_index_prefixes(trie, trie->root, path, 0);
+        if (r < 0)
+                return r;
+
+        typesafe_qsort_r(trie->prefixes, trie->prefixes_count, trie_prefixes_cmp, trie);
+        return 0;
+}
+
 struct trie_f {
         FILE *f;
         struct trie *trie;
@@ -285,18 +450,21 @@ struct trie_f {
         uint64_t values_count;
 };
 
-/* calculate the storage space for the nodes, children arrays, value arrays */
+/* calculate the storage space for the nodes, children arrays, value arrays, and place each node right before its
+ * children, so that lookups walk forward through the file */
 static void trie_store_nodes_size(struct trie_f *trie, struct trie_node *node, bool compat) {
         uint64_t i;
 
-        for (i = 0; i < node->children_count; i++)
-                trie_store_nodes_size(trie, node->children[i].child, compat);
+        node->off = trie->strings_off;
 
         trie->strings_off += sizeof(struct trie_node_f);
         for (i = 0; i < node->children_count; i++)
                 trie->strings_off += sizeof(struct trie_child_entry_f);
         for (i = 0; i < node->values_count; i++)
                 trie->strings_off += compat ? sizeof(struct trie_value_entry_f) : sizeof(struct trie_value_entry2_f);
+
+        for (i = 0; i < node->children_count; i++)
+                trie_store_nodes_size(trie, node->children[i].child, compat);
 }
 
 static int64_t trie_store_nodes(struct trie_f *trie, struct trie_node *node, bool compat) {
@@ -304,6 +472,7 @@ static int64_t trie_store_nodes(struct trie_f *trie, struct trie_node *node, boo
         struct trie_node_f n = {
                 .prefix_off = htole64(trie->strings_off + node->prefix_off),
                 .children_count = node->children_count,
+                .flags = trie_node_has_glob_children(node) ? TRIE_NODE_GLOB_CHILDREN : 0,
                 .values_count = htole64(node->values_count),
         };
         _cleanup_free_ struct trie_child_entry_f *children = NULL;
@@ -315,22 +484,19 @@ static int64_t trie_store_nodes(struct trie_f *trie, struct trie_node *node, boo
                         return -ENOMEM;
         }
 
-        /* post-order recursion */
         for (i = 0; i < node->children_count; i++) {
-                int64_t child_off;
-
-                child_off = trie_store_nodes(trie, node->children[i].child, compat);
-                if (child_off < 0)
-                        return child_off;
-
                 children[i] = (struct trie_child_entry_f) {
                         .c = node->children[i].c,
-                        .child_off = htole64(child_off),
+                        .child_off = htole64(node->children[i].child->off),
                 };
+
+                if (node->children_count <= ELEMENTSOF(n.children_c))
+                        n.children_c[i] = node->children[i].c;
         }
 
         /* write node */
         node_off = ftello(trie->f);
+        assert((uint64_t) node_off == node->off);
         fwrite(&n, sizeof(struct trie_node_f), 1, trie->f);
         trie->nodes_count++;
 
@@ -354,10 +520,19 @@ static int64_t trie_store_nodes(struct trie_f *trie, struct trie_node *node, boo
         }
         trie->values_count += node->values_count;
 
+        /* pre-order recursion */
+        for (i = 0; i < node->children_count; i++) {
+                int64_t r;
+
+                r = trie_store_nodes(trie, node->children[i].child, compat);
+                if (r < 0)
+                        return r;
+        }
+
         return node_off;
 }
 
-static int trie_store(struct trie *trie, const char *filename, bool compat) {
+static int trie_store(struct trie *trie, const char *filename, const struct hwdb_file *files, size_t files_count, bool compat) {
         struct trie_f t = {
                 .trie = trie,
         };
@@ -365,6 +540,7 @@ static int trie_store(struct trie *trie, const char *filename, bool compat) {
         int64_t pos;
         int64_t root_off;
         int64_t size;
+        size_t i, sources_count = 0;
         struct trie_header_f h = {
                 .signature = HWDB_SIG,
                 .tool_version = htole64(atoi(PACKAGE_VERSION)),
@@ -397,6 +573,37 @@ static int trie_store(struct trie *trie, const char *filename, bool compat) {
         fwrite(trie->strings->buf, trie->strings->len, 1, t.f);
         h.strings_len = htole64(trie->strings->len);
 
+        /* write prefix index */
+        h.prefix_index_off = htole64(ftello(t.f));
+        h.prefix_index_count = htole64(trie->prefixes_count);
+        for (i = 0; i < trie->prefixes_count; i++) {
+                struct trie_prefix_entry_f e = {
+                        .prefix_off = htole64(t.strings_off + trie->prefixes[i].prefix_off),
+                        .node_off = htole64(trie->prefixes[i].node->off),
+                        .node_prefix_pos = htole64(trie->prefixes[i].node_prefix_pos),
+                };
+
+                fwrite(&e, sizeof(e), 1, t.f);
+        }
+
+        /* write sources */
+        h.sources_off = htole64(ftello(t.f));
+        for (i = 0; !compat && i < files_count; i++) {
+                struct trie_source_entry_f e = {
+                        .filename_off = htole64(t.strings_off + files[i].filename_off),
+                        .mtime = htole64(timespec_load_nsec(&files[i].st.st_mtim)),
+                        .size = htole64(files[i].st.st_size),
+                        .file_priority = htole16(files[i].file_priority),
+                };
+
+                if (files[i].filename_off < 0)
+                        continue;
+
+                fwrite(&e, sizeof(e), 1, t.f);
+                sources_count++;
+        }
+        h.sources_count = htole64(sources_count);
+
         /* write header */
         size = ftello(t.f);
         h.file_size = htole64(size);
@@ -427,6 +634,10 @@ static int trie_store(struct trie *trie, const char *filename, bool compat) {
                   t.values_count * (compat ? sizeof(struct trie_value_entry_f) : sizeof(struct trie_value_entry2_f)), t.values_count);
         log_debug("string store:     %8zu bytes", trie->strings->len);
         log_debug("strings start:    %8"PRIu64, t.strings_off);
+        log_debug("prefix index:     %8zu bytes (%8zu)",
+                  trie->prefixes_count * sizeof(struct trie_prefix_entry_f), trie->prefixes_count);
+        log_debug("sources:          %8zu bytes (%8zu)",
+                  sources_count * sizeof(struct trie_source_entry_f), sources_count);
         return 0;
 
  error_fclose:
@@ -436,16 +647,60 @@ static int trie_store(struct trie *trie, const char *filename, bool compat) {
         return r;
 }
 
-static int insert_data(struct trie *trie, char **match_list, char *line, const char *filename,
-                       uint16_t file_priority, uint32_t line_number, bool compat) {
-        char *value, **entry;
+#define HWDB_PARSE_MAX_THREADS 16U
+
+static void hwdb_file_done(struct hwdb_file *file) {
+        size_t i;
+
+        for (i = 0; i < file->warnings_count; i++)
+                free(file->warnings[i].message);
+        free(file->warnings);
+        free(file->records);
+        free(file->matches);
+        free(file->text);
+}
+
+static int hwdb_file_warn(struct hwdb_file *file, uint32_t line_number, const char *format, ...) _printf_(3, 4);
+
+static int hwdb_file_warn(struct hwdb_file *file, uint32_t line_number, const char *format, ...) {
+        char *message;
+        va_list ap;
+        int k;
+
+        if (!GREEDY_REALLOC(file->warnings, file->warnings_allocated, file->warnings_count + 1))
+                return -ENOMEM;
+
+        va_start(ap, format);
+        k = vasprintf(&message, format, ap);
+        va_end(ap);
+        if (k < 0)
+                return -ENOMEM;
+
+        file->warnings[file->warnings_count++] = (struct hwdb_warning) {
+                .line_number = line_number,
+                .message = message,
+        };
+
+        return -EINVAL;
+}
+
+static int hwdb_file_add_match(struct hwdb_file *file, char *match) {
+        if (!GREEDY_REALLOC(file->matches, file->matches_allocated, file->matches_count + 1))
+                return -ENOMEM;
+
+        file->matches[file->matches_count++] = match;
+        return 0;
+}
+
+static int parse_data(struct hwdb_file *file, size_t match_first, char *line, uint32_t line_number) {
+        char *value;
 
         assert(line[0] == ' ');
 
         value = strchr(line, '=');
         if (!value)
-                return log_syntax(NULL, LOG_WARNING, filename, line_number, EINVAL,
-                                  "Key-value pair expected but got \"%s\", ignoring", line);
+                return hwdb_file_warn(file, line_number,
+                                      "Key-value pair expected but got \"%s\", ignoring", line);
 
         value[0] = '\0';
         value++;
@@ -455,43 +710,81 @@ static int insert_data(struct trie *trie, char **match_list, char *line, const c
                 line++;
 
         if (isempty(line + 1) || isempty(value))
-                return log_syntax(NULL, LOG_WARNING, filename, line_number, EINVAL,
-                                  "Empty %s in \"%s=%s\", ignoring",
-                                  isempty(line + 1) ? "key" : "value",
-                                  line, value);
+                return hwdb_file_warn(file, line_number,
+                                      "Empty %s in \"%s=%s\", ignoring",
+                                      isempty(line + 1) ? "key" : "value",
+                                      line, value);
+
+        if (!GREEDY_REALLOC(file->records, file->records_allocated, file->records_count + 1))
+                return -ENOMEM;
 
-        STRV_FOREACH(entry, match_list)
-                trie_insert(trie, trie->root, *entry, line, value, filename, file_priority, line_number, compat);
+        file->records[file->records_count++] = (struct hwdb_record) {
+                .match_first = match_first,
+                .match_count = file->matches_count - match_first,
+                .key = line,
+                .value = value,
+                .line_number = line_number,
+        };
+
+        return 0;
+}
+
+static int hwdb_file_read(struct hwdb_file *file, size_t *ret_size) {
+        _cleanup_close_ int fd = -1;
+        struct stat st;
+        ssize_t n;
+
+        fd = open(file->filename, O_RDONLY|O_CLOEXEC|O_NOCTTY);
+        if (fd < 0)
+                return -errno;
+
+        if (fstat(fd, &st) < 0)
+                return -errno;
+
+        if ((uint64_t) st.st_size >= SIZE_MAX)
+                return -EFBIG;
+
+        file->text = new(char, st.st_size + 1);
+        if (!file->text)
+                return -ENOMEM;
+
+        n = loop_read(fd, file->text, st.st_size, true);
+        if (n < 0)
+                return (int) n;
+
+        file->text[n] = '\0';
+        *ret_size = n;
 
         return 0;
 }
 
-static int import_file(struct trie *trie, const char *filename, uint16_t file_priority, bool compat) {
+/* Splits the file into its records. This runs in the parser threads, hence warnings are only collected, and logged
+ * by hwdb_file_insert(). */
+static int hwdb_file_parse(struct hwdb_file *file) {
         enum {
                 HW_NONE,
                 HW_MATCH,
                 HW_DATA,
         } state = HW_NONE;
-        _cleanup_fclose_ FILE *f = NULL;
-        _cleanup_strv_free_ char **match_list = NULL;
         uint32_t line_number = 0;
-        char *match = NULL;
+        size_t size, match_first = 0;
+        char *p, *end;
         int r = 0, err;
 
-        f = fopen(filename, "re");
-        if (!f)
-                return -errno;
+        err = hwdb_file_read(file, &size);
+        if (err < 0)
+                return err;
 
-        for (;;) {
-                _cleanup_free_ char *line = NULL;
+        for (p = file->text, end = p + size; p < end; ) {
+                char *line = p, *pos;
                 size_t len;
-                char *pos;
 
-                r = read_line(f, LONG_LINE_MAX, &line);
-                if (r < 0)
-                        return r;
-                if (r == 0)
-                        break;
+                /* Like read_line(), split at "\n" and NUL, the text is NUL terminated */
+                len = strcspn(p, "\n");
+                if (len >= LONG_LINE_MAX)
+                        return -ENOBUFS;
+                line[len] = '\0';
+                p += len + 1;
 
                 ++line_number;
 
@@ -516,20 +809,18 @@ static int import_file(struct trie *trie, const char *filename, uint16_t file_pr
                                 break;
 
                         if (line[0] == ' ') {
-                                log_syntax(NULL, LOG_WARNING, filename, line_number, EINVAL,
-                                           "Match expected but got indented property \"%s\", ignoring line", line);
-                                r = -EINVAL;
+                                r = hwdb_file_warn(file, line_number,
+                                                   "Match expected but got indented property \"%s\", ignoring line", line);
+                                if (r == -ENOMEM)
+                                        return r;
                                 break;
                         }
 
                         /* start of record, first match */
                         state = HW_MATCH;
+                        match_first = file->matches_count;
 
-                        match = strdup(line);
-                        if (!match)
-                                return -ENOMEM;
-
-                        err = strv_consume(&match_list, match);
+                        err = hwdb_file_add_match(file, line);
                         if (err < 0)
                                 return err;
 
@@ -537,21 +828,17 @@ static int import_file(struct trie *trie, const char *filename, uint16_t file_pr
 
                 case HW_MATCH:
                         if (len == 0) {
-                                log_syntax(NULL, LOG_WARNING, filename, line_number, EINVAL,
-                                           "Property expected, ignoring record with no properties");
-                                r = -EINVAL;
+                                r = hwdb_file_warn(file, line_number,
+                                                   "Property expected, ignoring record with no properties");
+                                if (r == -ENOMEM)
+                                        return r;
                                 state = HW_NONE;
-                                strv_clear(match_list);
                                 break;
                         }
 
                         if (line[0] != ' ') {
                                 /* another match */
-                                match = strdup(line);
-                                if (!match)
-                                        return -ENOMEM;
-
-                                err = strv_consume(&match_list, match);
+                                err = hwdb_file_add_match(file, line);
                                 if (err < 0)
                                         return err;
 
@@ -560,7 +847,9 @@ static int import_file(struct trie *trie, const char *filename, uint16_t file_pr
 
                         /* first data */
                         state = HW_DATA;
-                        err = insert_data(trie, match_list, line, filename, file_priority, line_number, compat);
+                        err = parse_data(file, match_first, line, line_number);
+                        if (err == -ENOMEM)
+                                return err;
                         if (err < 0)
                                 r = err;
                         break;
@@ -569,45 +858,457 @@ static int import_file(struct trie *trie, const char *filename, uint16_t file_pr
                         if (len == 0) {
                                 /* end of record */
                                 state = HW_NONE;
-                                strv_clear(match_list);
                                 break;
                         }
 
                         if (line[0] != ' ') {
-                                log_syntax(NULL, LOG_WARNING, filename, line_number, EINVAL,
-                                           "Property or empty line expected, got \"%s\", ignoring record", line);
-                                r = -EINVAL;
+                                r = hwdb_file_warn(file, line_number,
+                                                   "Property or empty line expected, got \"%s\", ignoring record", line);
+                                if (r == -ENOMEM)
+                                        return r;
                                 state = HW_NONE;
-                                strv_clear(match_list);
                                 break;
                         }
 
-                        err = insert_data(trie, match_list, line, filename, file_priority, line_number, compat);
+                        err = parse_data(file, match_first, line, line_number);
+                        if (err == -ENOMEM)
+                                return err;
                         if (err < 0)
                                 r = err;
                         break;
                 };
         }
 
-        if (state == HW_MATCH)
-                log_syntax(NULL, LOG_WARNING, filename, line_number, EINVAL,
-                           "Property expected, ignoring record with no properties");
+        if (state == HW_MATCH) {
+                err = hwdb_file_warn(file, line_number,
+                                     "Property expected, ignoring record with no properties");
+                if (err == -ENOMEM)
+                        return err;
+        }
 
+        file->parsed = true;
         return r;
 }
 
-int hwdb_update(const char *root, const char *hwdb_bin_dir, bool strict, bool compat) {
-        _cleanup_free_ char *hwdb_bin = NULL;
-        _cleanup_(trie_freep) struct trie *trie = NULL;
-        _cleanup_strv_free_ char **files = NULL;
-        char **f;
-        uint16_t file_priority = 1;
-        int r = 0, err;
+static int hwdb_file_insert(struct trie *trie, struct hwdb_file *file, bool compat) {
+        size_t i, j;
 
-        /* The argument 'compat' controls the format version of database. If false, then hwdb.bin will be created with
-         * additional information such that priority, line number, and filename of database source. If true, then hwdb.bin
-         * will be created without the information. systemd-hwdb command should set the argument false, and 'udevadm hwdb'
-         * command should set it true. */
+        for (i = 0; i < file->warnings_count; i++)
+                log_syntax(NULL, LOG_WARNING, file->filename, file->warnings[i].line_number, EINVAL,
+                           "%s", file->warnings[i].message);
+
+        for (i = 0; i < file->records_count; i++) {
+                const struct hwdb_record *record = file->records + i;
+
+                for (j = 0; j < record->match_count; j++)
+                        trie_insert(trie, trie->root, file->matches[record->match_first + j],
+                                    record->key, record->value,
+                                    file->filename, file->file_priority, record->line_number, compat);
+        }
+
+        return file->r;
+}
+
+struct hwdb_parse_jobs {
+        struct hwdb_file **files;
+        size_t files_count;
+        size_t next;
+};
+
+static void *parse_thread(void *userdata) {
+        struct hwdb_parse_jobs *jobs = userdata;
+        size_t i;
+
+        while ((i = __sync_fetch_and_add(&jobs->next, 1)) < jobs->files_count)
+                jobs->files[i]->r = hwdb_file_parse(jobs->files[i]);
+
+        return NULL;
+}
+
+/* The files are parsed in parallel, and then inserted in the order of their priority by the calling thread, hence the
+ * trie is the same as if they were parsed one after the other. */
+static void hwdb_parse_files(struct hwdb_file **files, size_t files_count) {
+        pthread_t threads[HWDB_PARSE_MAX_THREADS];
+        struct hwdb_parse_jobs jobs = {
+                .files = files,
+                .files_count = files_count,
+        };
+        unsigned n_threads = 1, n_started = 1, i;
+        cpu_set_t cpu_set;
+        sigset_t ss, saved_ss;
+        int k;
+
+        if (sched_getaffinity(0, sizeof(cpu_set), &cpu_set) >= 0)
+                n_threads = CPU_COUNT(&cpu_set);
+
+        n_threads = MIN(CLAMP(n_threads, 1U, HWDB_PARSE_MAX_THREADS), files_count);
+
+        /* Like asynchronous_job(), start the threads with all signals blocked. The calling thread parses too, hence if
+         * a thread cannot be started, the others do its work. */
+        if (sigfillset(&ss) >= 0 && pthread_sigmask(SIG_BLOCK, &ss, &saved_ss) == 0) {
+                for (; n_started < n_threads; n_started++) {
+                        k = pthread_create(threads + n_started, NULL, parse_thread, &jobs);
+                        if (k != 0) {
+                                log_debug_errno(k, "Failed to start parser thread, ignoring: %m");
+                                break;
+                        }
+                }
+
+                assert_se(pthread_sigmask(SIG_SETMASK, &saved_ss, NULL) == 0);
+        }
+
+        log_debug("Parsing %zu files with %u threads", files_count, n_started);
+
+        (void) parse_thread(&jobs);
+
+        for (i = 1; i < n_started; i++)
+                assert_se(pthread_join(threads[i], NULL) == 0);
+}
+
+/* the previous database, whose values are reused for all source files which did not change */
+struct trie_previous {
+        const uint8_t *map;
+        size_t size;
+
+        /* the new priority of the values with each old priority, 0 if they are dropped */
+        uint16_t *priorities;
+        size_t priorities_count;
+
+        /* for each offset in the string section, the offset of the string in the new string store plus one, if it
+         * was added already, as most keys and all filenames are shared by many values */
+        uint32_t *strings;
+        uint64_t strings_off;
+        uint64_t strings_len;
+};
+
+#define TRIE_PREVIOUS_DEPTH_MAX 4096U
+
+static const char *trie_previous_string(const struct trie_previous *prev, uint64_t off) {
+        if (off >= prev->size || !memchr(prev->map + off, 0, prev->size - off))
+                return NULL;
+
+        return (const char*) prev->map + off;
+}
+
+static ssize_t trie_previous_add_string(struct trie *trie, struct trie_previous *prev, uint64_t off) {
+        bool cache;
+        const char *s;
+        ssize_t r;
+
+        cache = off >= prev->strings_off && off - prev->strings_off < prev->strings_len;
+        if (cache && prev->strings[off - prev->strings_off] > 0)
+                return prev->strings[off - prev->strings_off] - 1;
+
+        s = trie_previous_string(prev, off);
+        if (!s)
+                return -EBADMSG;
+
+        r = strbuf_add_string(trie->strings, s, strlen(s));
+        if (r < 0)
+                return r;
+
+        if (cache && r < UINT32_MAX)
+                prev->strings[off - prev->strings_off] = r + 1;
+
+        return r;
+}
+
+static int trie_previous_add_value(struct trie *trie, struct trie_previous *prev,
+                                   struct trie_node *node, const struct trie_value_entry2_f *entry) {
+        ssize_t k, v, fn;
+        uint16_t priority;
+
+        priority = le16toh(entry->file_priority);
+        if (priority == 0 || priority >= prev->priorities_count || prev->priorities[priority] == 0)
+                return 0;
+
+        k = trie_previous_add_string(trie, prev, le64toh(entry->key_off));
+        if (k < 0)
+                return k;
+        v = trie_previous_add_string(trie, prev, le64toh(entry->value_off));
+        if (v < 0)
+                return v;
+        fn = trie_previous_add_string(trie, prev, le64toh(entry->filename_off));
+        if (fn < 0)
+                return fn;
+
+        node->values[node->values_count++] = (struct trie_value_entry) {
+                .key_off = k,
+                .value_off = v,
+                .filename_off = fn,
+                .line_number = le32toh(entry->line_number),
+                .file_priority = prev->priorities[priority],
+        };
+        trie->values_count++;
+
+        return 0;
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(struct trie_node*, trie_node_cleanup);
+
+/* Copies the node at *off and its children with the values which are reused, and sets *off to the end of the subtree.
+ * Nodes left without values are dropped or merged into their only child, as trie_insert() would never have created
+ * them. Only the layout written by trie_store() is accepted, each node right before its children, which makes sure
+ * every node is visited once. */
+static int trie_previous_load_node(struct trie *trie, struct trie_previous *prev,
+                                   uint64_t *off, unsigned depth, struct trie_node **ret) {
+        _cleanup_(trie_node_cleanupp) struct trie_node *node = NULL;
+        const struct trie_child_entry_f *children;
+        const struct trie_value_entry2_f *values;
+        const struct trie_node_f *n;
+        uint64_t children_count, values_count, i;
+        const char *prefix;
+        ssize_t prefix_off;
+        int r;
+
+        if (depth > TRIE_PREVIOUS_DEPTH_MAX ||
+            *off < sizeof(struct trie_header_f) ||
+            *off > prev->size - sizeof(struct trie_node_f))
+                return -EBADMSG;
+
+        n = (const struct trie_node_f*) (prev->map + *off);
+        *off += sizeof(struct trie_node_f);
+
+        children_count = n->children_count;
+        if (children_count > (prev->size - *off) / sizeof(struct trie_child_entry_f))
+                return -EBADMSG;
+        children = (const struct trie_child_entry_f*) (prev->map + *off);
+        *off += children_count * sizeof(struct trie_child_entry_f);
+
+        values_count = le64toh(n->values_count);
+        if (values_count > (prev->size - *off) / sizeof(struct trie_value_entry2_f))
+                return -EBADMSG;
+        values = (const struct trie_value_entry2_f*) (prev->map + *off);
+        *off += values_count * sizeof(struct trie_value_entry2_f);
+
+        prefix = trie_previous_string(prev, le64toh(n->prefix_off));
+        if (!prefix)
+                return -EBADMSG;
+
+        node = new0(struct trie_node, 1);
+        if (!node)
+                return -ENOMEM;
+
+        prefix_off = strbuf_add_string(trie->strings, prefix, strlen(prefix));
+        if (prefix_off < 0)
+                return prefix_off;
+        node->prefix_off = prefix_off;
+
+        if (values_count > 0) {
+                node->values = new(struct trie_value_entry, values_count);
+                if (!node->values)
+                        return -ENOMEM;
+
+                for (i = 0; i < values_count; i++) {
+                        r = trie_previous_add_value(trie, prev, node, values + i);
+                        if (r < 0)
+                                return r;
+                }
+
+                /* priorities might be in a different order now */
+                typesafe_qsort_r(node->values, node->values_count, trie_values_cmp, trie);
+        }
+
+        if (children_count > 0) {
+                node->children = new(struct trie_child_entry, children_count);
+                if (!node->children)
+                        return -ENOMEM;
+        }
+
+        for (i = 0; i < children_count; i++) {
+                struct trie_node *child;
+
+                if (le64toh(children[i].child_off) != *off || (i > 0 && children[i].c <= children[i - 1].c))
+                        return -EBADMSG;
+
+                r = trie_previous_load_node(trie, prev, off, depth + 1, &child);
+                if (r < 0)
+                        return r;
+                if (!child)
+                        continue;
+
+                node->children[node->children_count++] = (struct trie_child_entry) {
+                        .c = children[i].c,
+                        .child = child,
+                };
+                trie->children_count++;
+                trie->nodes_count++;
+        }
+
+        if (depth > 0 && node->values_count == 0 && node->children_count <= 1) {
+                _cleanup_free_ char *s = NULL;
+                struct trie_node *child;
+                char c[2] = {};
+
+                if (node->children_count == 0) {
+                        *ret = NULL;
+                        return 0;
+                }
+
+                child = node->children[0].child;
+                c[0] = node->children[0].c;
+
+                s = strjoin(prefix, c, trie->strings->buf + child->prefix_off);
+                if (!s)
+                        return -ENOMEM;
+
+                prefix_off = strbuf_add_string(trie->strings, s, strlen(s));
+                if (prefix_off < 0)
+                        return prefix_off;
+
+                child->prefix_off = prefix_off;
+                node->children_count = 0;
+                trie->children_count--;
+                trie->nodes_count--;
+
+                *ret = child;
+                return 0;
+        }
+
+        *ret = TAKE_PTR(node);
+        return 0;
+}
+
+/* Returns 1 if none of the files changed, and 0 if the values of the unchanged files were loaded into the trie */
+static int trie_previous_load(struct trie *trie, const uint8_t *map, size_t size,
+                              struct hwdb_file *files, size_t files_count) {
+        static const uint8_t sig[] = HWDB_SIG;
+        const struct trie_header_f *h = (const struct trie_header_f*) map;
+        const struct trie_source_entry_f *sources;
+        _cleanup_free_ uint16_t *priorities = NULL;
+        _cleanup_free_ uint32_t *strings = NULL;
+        uint64_t strings_off, strings_len, sources_off, sources_count, off, i;
+        struct trie_previous prev;
+        struct trie_node *root;
+        uint16_t last = 0;
+        bool unchanged;
+        int r;
+
+        if (size < sizeof(struct trie_header_f) ||
+            memcmp(h->signature, sig, sizeof(sig)) != 0 ||
+            le64toh(h->file_size) != size ||
+            le64toh(h->header_size) < sizeof(struct trie_header_f) ||
+            le64toh(h->node_size) != sizeof(struct trie_node_f) ||
+            le64toh(h->child_entry_size) != sizeof(struct trie_child_entry_f) ||
+            le64toh(h->value_entry_size) != sizeof(struct trie_value_entry2_f))
+                return -EBADMSG;
+
+        if (le64toh(h->header_size) > size ||
+            le64toh(h->nodes_len) > size - le64toh(h->header_size))
+                return -EBADMSG;
+        strings_off = le64toh(h->header_size) + le64toh(h->nodes_len);
+        strings_len = le64toh(h->strings_len);
+        if (strings_len > size - strings_off)
+                return -EBADMSG;
+
+        sources_off = le64toh(h->sources_off);
+        sources_count = le64toh(h->sources_count);
+        if (sources_off > size ||
+            sources_count > (size - sources_off) / sizeof(struct trie_source_entry_f))
+                return -EBADMSG;
+        sources = (const struct trie_source_entry_f*) (map + sources_off);
+
+        for (i = 0; i < sources_count; i++) {
+                if (le16toh(sources[i].file_priority) <= last)
+                        return -EBADMSG;
+
+                last = le16toh(sources[i].file_priority);
+        }
+
+        priorities = new0(uint16_t, last + 1);
+        if (!priorities)
+                return -ENOMEM;
+
+        prev = (struct trie_previous) {
+                .map = map,
+                .size = size,
+                .priorities = priorities,
+                .priorities_count = last + 1,
+                .strings_off = strings_off,
+                .strings_len = strings_len,
+        };
+
+        unchanged = sources_count == files_count;
+        for (i = 0; i < sources_count; i++) {
+                struct hwdb_file *file = NULL;
+                const char *filename;
+                size_t j;
+
+                filename = trie_previous_string(&prev, le64toh(sources[i].filename_off));
+                if (!filename)
+                        return -EBADMSG;
+
+                for (j = 0; j < files_count; j++)
+                        if (files[j].r >= 0 && streq(files[j].filename, filename)) {
+                                file = files + j;
+                                break;
+                        }
+
+                if (!file ||
+                    timespec_load_nsec(&file->st.st_mtim) != le64toh(sources[i].mtime) ||
+                    (uint64_t) file->st.st_size != le64toh(sources[i].size)) {
+                        unchanged = false;
+                        continue;
+                }
+
+                if (file->reuse)
+                        return -EBADMSG;
+
+                file->reuse = true;
+                priorities[le16toh(sources[i].file_priority)] = file->file_priority;
+
+                if (j != i)
+                        unchanged = false;
+        }
+
+        if (unchanged)
+                return 1;
+
+        strings = prev.strings = new0(uint32_t, strings_len);
+        if (!strings && strings_len > 0)
+                return -ENOMEM;
+
+        off = le64toh(h->nodes_root_off);
+        r = trie_previous_load_node(trie, &prev, &off, 0, &root);
+        if (r < 0)
+                return r;
+
+        trie_node_cleanup(trie->root);
+        trie->root = root;
+
+        return 0;
+}
+
+static int trie_load_previous(struct trie *trie, const char *filename, struct hwdb_file *files, size_t files_count) {
+        _cleanup_close_ int fd = -1;
+        struct stat st;
+        void *map;
+        int r;
+
+        fd = open(filename, O_RDONLY|O_CLOEXEC|O_NOCTTY);
+        if (fd < 0)
+                return -errno;
+
+        if (fstat(fd, &st) < 0)
+                return -errno;
+
+        if (st.st_size < (off_t) sizeof(struct trie_header_f))
+                return -EBADMSG;
+        if ((uint64_t) st.st_size > SIZE_MAX)
+                return -EFBIG;
+
+        map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (map == MAP_FAILED)
+                return -errno;
+
+        r = trie_previous_load(trie, map, st.st_size, files, files_count);
+        (void) munmap(map, st.st_size);
+
+        return r;
+}
+
+static int trie_new(struct trie **ret) {
+        _cleanup_(trie_freep) struct trie *trie = NULL;
 
         trie = new0(struct trie, 1);
         if (!trie)
@@ -625,17 +1326,115 @@ int hwdb_update(const char *root, const char *hwdb_bin_dir, bool strict, bool co
 
         trie->nodes_count++;
 
-        err = conf_files_list_strv(&files, ".hwdb", root, 0, conf_file_dirs);
+        *ret = TAKE_PTR(trie);
+        return 0;
+}
+
+int hwdb_update(const char *root, const char *hwdb_bin_dir, bool strict, bool compat, bool incremental) {
+        _cleanup_free_ struct hwdb_file **parse = NULL;
+        _cleanup_free_ struct hwdb_file *files = NULL;
+        _cleanup_free_ char *hwdb_bin = NULL;
+        _cleanup_(trie_freep) struct trie *trie = NULL;
+        _cleanup_strv_free_ char **filenames = NULL;
+        size_t files_count, parse_count = 0, i;
+        int r = 0, err;
+
+        /* The argument 'compat' controls the format version of database. If false, then hwdb.bin will be created with
+         * additional information such that priority, line number, and filename of database source. If true, then hwdb.bin
+         * will be created without the information. systemd-hwdb command should set the argument false, and 'udevadm hwdb'
+         * command should set it true.
+         *
+         * If 'incremental' is true, the values of all files whose modification time and size did not change are taken
+         * from the existing hwdb.bin, and it is not written at all if none changed. This needs the information
+         * of the v2 format, hence it is ignored if 'compat' is true. */
+
+        err = trie_new(&trie);
+        if (err < 0)
+                return err;
+
+        err = conf_files_list_strv(&filenames, ".hwdb", root, 0, conf_file_dirs);
         if (err < 0)
                 return log_error_errno(err, "Failed to enumerate hwdb files: %m");
 
-        STRV_FOREACH(f, files) {
-                log_debug("Reading file \"%s\"", *f);
-                err = import_file(trie, *f, file_priority++, compat);
+        files_count = strv_length(filenames);
+        files = new0(struct hwdb_file, files_count);
+        parse = new(struct hwdb_file*, files_count);
+        if ((!files || !parse) && files_count > 0)
+                return -ENOMEM;
+
+        for (i = 0; i < files_count; i++) {
+                files[i] = (struct hwdb_file) {
+                        .filename = filenames[i],
+                        .file_priority = i + 1,
+                        .filename_off = -1,
+                };
+
+                if (stat(filenames[i], &files[i].st) < 0)
+                        files[i].r = -errno;
+        }
+
+        hwdb_bin = path_join(root, hwdb_bin_dir ?: default_hwdb_bin_dir, "hwdb.bin");
+        if (!hwdb_bin)
+                return -ENOMEM;
+
+        if (incremental && !compat) {
+                err = trie_load_previous(trie, hwdb_bin, files, files_count);
+                if (err > 0) {
+                        log_debug("%s is up to date", hwdb_bin);
+                        return 0;
+                }
+                if (err < 0) {
+                        log_debug_errno(err, "Failed to load %s, rebuilding it: %m", hwdb_bin);
+
+                        for (i = 0; i < files_count; i++)
+                                files[i].reuse = false;
+
+                        trie_free(TAKE_PTR(trie));
+                        err = trie_new(&trie);
+                        if (err < 0)
+                                return err;
+                }
+        }
+
+        for (i = 0; i < files_count; i++) {
+                if (files[i].reuse)
+                        log_debug("Reusing values of file \"%s\"", files[i].filename);
+                else if (files[i].r >= 0) {
+                        log_debug("Reading file \"%s\"", files[i].filename);
+                        parse[parse_count++] = files + i;
+                }
+        }
+
+        if (parse_count > 0)
+                hwdb_parse_files(parse, parse_count);
+
+        for (i = 0; i < files_count; i++) {
+                if (files[i].reuse)
+                        continue;
+
+                err = hwdb_file_insert(trie, files + i, compat);
                 if (err < 0 && strict)
                         r = err;
         }
 
+        for (i = 0; i < files_count; i++) {
+                if (!files[i].reuse && !files[i].parsed)
+                        continue;
+
+                files[i].filename_off = strbuf_add_string(trie->strings, files[i].filename, strlen(files[i].filename));
+                if (files[i].filename_off < 0) {
+                        r = files[i].filename_off;
+                        goto finish;
+                }
+        }
+
+        /* the index adds strings, hence build it before the string store is completed */
+        err = trie_build_prefix_index(trie);
+        if (err < 0) {
+                r = log_error_errno(err, "Failed to build prefix index: %m");
+                goto finish;
+        }
+
         strbuf_complete(trie->strings);
 
         log_debug("=== trie in-memory ===");
@@ -652,18 +1451,20 @@ int hwdb_update(const char *root, const char *hwdb_bin_dir, bool strict, bool co
         log_debug("strings dedup'ed: %8zu bytes (%8zu)",
                   trie->strings->dedup_len, trie->strings->dedup_count);
 
-        hwdb_bin = path_join(root, hwdb_bin_dir ?: default_hwdb_bin_dir, "hwdb.bin");
-        if (!hwdb_bin)
-                return -ENOMEM;
-
         mkdir_parents_label(hwdb_bin, 0755);
-        err = trie_store(trie, hwdb_bin, compat);
-        if (err < 0)
-                return log_error_errno(err, "Failed to write database %s: %m", hwdb_bin);
+        err = trie_store(trie, hwdb_bin, files, files_count, compat);
+        if (err < 0) {
+                r = log_error_errno(err, "Failed to write database %s: %m", hwdb_bin);
+                goto finish;
+        }
 
         err = label_fix(hwdb_bin, 0);
         if (err < 0)
-                return err;
+                r = err;
+
+finish:
+        for (i = 0; i < files_count; i++)
+                hwdb_file_done(files + i);
 
         return r;
 }
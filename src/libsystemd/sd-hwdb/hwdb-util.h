@@ -6,5 +6,5 @@
 #include "sd-hwdb.h"
 
 bool hwdb_validate(sd_hwdb *hwdb);
-int hwdb_update(const char *root, const char *hwdb_bin_dir, bool strict, bool compat);
+int hwdb_update(const char *root, const char *hwdb_bin_dir, bool strict, bool compat, bool incremental);
 int hwdb_query(const char *modalias);
@@ -31,6 +31,8 @@ struct sd_hwdb {
                 struct trie_header_f *head;
                 const char *map;
         };
+        /* the file has the prefix index, and hints in the nodes */
+        bool indexed;
 
         OrderedHashmap *properties;
         Iterator properties_iterator;
@@ -79,6 +81,42 @@ static void linebuf_rem_char(struct linebuf *buf) {
         linebuf_rem(buf, 1);
 }
 
+/* Every run of literal characters of a glob has to appear in all strings which it matches. The globs of the nodes below
+ * the current one only extend the glob in the buffer, hence none of them can match if the run at its end does not. */
+static bool linebuf_may_match(struct linebuf *buf, const char *search) {
+        size_t i, run = 0, bracket = 0;
+        bool in_bracket = false;
+
+        for (i = 0; i < buf->len; i++) {
+                char c = buf->bytes[i];
+
+                if (in_bracket) {
+                        if (c == ']' && i > bracket) {
+                                in_bracket = false;
+                                run = i + 1;
+                        }
+                        continue;
+                }
+
+                if (c == '\\') {
+                        i++;
+                        run = i + 1;
+                } else if (c == '[') {
+                        in_bracket = true;
+                        /* a ']' right at the beginning is part of the bracket expression */
+                        bracket = i + 1;
+                        if (bracket < buf->len && IN_SET(buf->bytes[bracket], '!', '^'))
+                                bracket++;
+                } else if (IN_SET(c, '*', '?'))
+                        run = i + 1;
+        }
+
+        if (in_bracket || run >= buf->len)
+                return true;
+
+        return !!memmem(search, strlen(search), buf->bytes + run, buf->len - run);
+}
+
 static const struct trie_child_entry_f *trie_node_child(sd_hwdb *hwdb, const struct trie_node_f *node, size_t idx) {
         const char *base = (const char *)node;
 
@@ -104,25 +142,80 @@ static const char *trie_string(sd_hwdb *hwdb, le64_t off) {
         return hwdb->map + le64toh(off);
 }
 
-static int trie_children_cmp_f(const void *v1, const void *v2) {
-        const struct trie_child_entry_f *n1 = v1;
-        const struct trie_child_entry_f *n2 = v2;
+static const struct trie_node_f *node_lookup_f(sd_hwdb *hwdb, const struct trie_node_f *node, uint8_t c) {
+        const struct trie_child_entry_f *child;
+        size_t lo = 0, hi = node->children_count;
 
-        return n1->c - n2->c;
-}
+        if (hwdb->indexed) {
+                if (IN_SET(c, '*', '?', '[') && !(node->flags & TRIE_NODE_GLOB_CHILDREN))
+                        return NULL;
+
+                /* few children, find the right one without looking at the child entries */
+                if (node->children_count <= ELEMENTSOF(node->children_c)) {
+                        const uint8_t *p;
+
+                        p = memchr(node->children_c, c, node->children_count);
+                        if (!p)
+                                return NULL;
+
+                        return trie_node_from_off(hwdb, trie_node_child(hwdb, node, p - node->children_c)->child_off);
+                }
+        }
+
+        while (lo < hi) {
+                size_t mid = lo + (hi - lo) / 2;
+
+                child = trie_node_child(hwdb, node, mid);
+                if (child->c == c)
+                        return trie_node_from_off(hwdb, child->child_off);
+
+                if (child->c < c)
+                        lo = mid + 1;
+                else
+                        hi = mid;
+        }
 
-static const struct trie_node_f *node_lookup_f(sd_hwdb *hwdb, const struct trie_node_f *node, uint8_t c) {
-        struct trie_child_entry_f *child;
-        struct trie_child_entry_f search;
-
-        search.c = c;
-        child = bsearch(&search, (const char *)node + le64toh(hwdb->head->node_size), node->children_count,
-                        le64toh(hwdb->head->child_entry_size), trie_children_cmp_f);
-        if (child)
-                return trie_node_from_off(hwdb, child->child_off);
         return NULL;
 }
 
+/* Finds the node and the position in its prefix to start the lookup of the modalias at */
+static const struct trie_node_f *trie_lookup_prefix_f(sd_hwdb *hwdb, const char *search, size_t *ret_i, size_t *ret_p) {
+        const struct trie_prefix_entry_f *entries;
+        const char *colon;
+        size_t len, lo = 0, hi;
+
+        if (hwdb->indexed) {
+                colon = strchr(search, ':');
+                if (colon) {
+                        len = colon - search + 1;
+                        entries = (const struct trie_prefix_entry_f *) (hwdb->map + le64toh(hwdb->head->prefix_index_off));
+                        hi = le64toh(hwdb->head->prefix_index_count);
+
+                        while (lo < hi) {
+                                size_t mid = lo + (hi - lo) / 2;
+                                int r;
+
+                                /* the prefixes end at their first ':', hence none can be longer than len and match */
+                                r = strncmp(search, trie_string(hwdb, entries[mid].prefix_off), len);
+                                if (r == 0) {
+                                        *ret_i = len;
+                                        *ret_p = le64toh(entries[mid].node_prefix_pos);
+                                        return trie_node_from_off(hwdb, entries[mid].node_off);
+                                }
+
+                                if (r < 0)
+                                        hi = mid;
+                                else
+                                        lo = mid + 1;
+                        }
+                }
+        }
+
+        *ret_i = 0;
+        *ret_p = 0;
+        return trie_node_from_off(hwdb, hwdb->head->nodes_root_off);
+}
+
 static int hwdb_add_property(sd_hwdb *hwdb, const struct trie_value_entry_f *entry) {
         const char *key;
         int r;
@@ -205,6 +298,11 @@ static int trie_fnmatch_f(sd_hwdb *hwdb, const struct trie_node_f *node, size_t
         len = strlen(prefix + p);
         linebuf_add(buf, prefix + p, len);
 
+        if (!linebuf_may_match(buf, search)) {
+                linebuf_rem(buf, len);
+                return 0;
+        }
+
         for (i = 0; i < node->children_count; i++) {
                 const struct trie_child_entry_f *child = trie_node_child(hwdb, node, i);
 
@@ -229,26 +327,25 @@ static int trie_fnmatch_f(sd_hwdb *hwdb, const struct trie_node_f *node, size_t
 static int trie_search_f(sd_hwdb *hwdb, const char *search) {
         struct linebuf buf;
         const struct trie_node_f *node;
-        size_t i = 0;
+        size_t i, p;
         int err;
 
         linebuf_init(&buf);
 
-        node = trie_node_from_off(hwdb, hwdb->head->nodes_root_off);
-        while (node) {
+        node = trie_lookup_prefix_f(hwdb, search, &i, &p);
+        for (; node; p = 0) {
                 const struct trie_node_f *child;
-                size_t p = 0;
 
                 if (node->prefix_off) {
                         uint8_t c;
 
                         for (; (c = trie_string(hwdb, node->prefix_off)[p]); p++) {
                                 if (IN_SET(c, '*', '?', '['))
-                                        return trie_fnmatch_f(hwdb, node, p, &buf, search + i + p);
-                                if (c != search[i + p])
+                                        return trie_fnmatch_f(hwdb, node, p, &buf, search + i);
+                                if (c != (uint8_t) search[i])
                                         return 0;
+                                i++;
                         }
-                        i += p;
                 }
 
                 child = node_lookup_f(hwdb, node, '*');
@@ -348,12 +445,23 @@ _public_ int sd_hwdb_new(sd_hwdb **ret) {
                 return -EINVAL;
         }
 
+        /* Files written by older versions lack the prefix index, and have no hints in the nodes */
+        if ((size_t) hwdb->st.st_size >= sizeof(struct trie_header_f) &&
+            le64toh(hwdb->head->header_size) >= offsetof(struct trie_header_f, prefix_index_count) + sizeof(le64_t)) {
+                uint64_t off = le64toh(hwdb->head->prefix_index_off), n = le64toh(hwdb->head->prefix_index_count);
+
+                hwdb->indexed = off <= (uint64_t) hwdb->st.st_size &&
+                        n <= ((uint64_t) hwdb->st.st_size - off) / sizeof(struct trie_prefix_entry_f);
+        }
+
         log_debug("=== trie on-disk ===");
         log_debug("tool version:          %"PRIu64, le64toh(hwdb->head->tool_version));
         log_debug("file size:        %8"PRIi64" bytes", hwdb->st.st_size);
         log_debug("header size       %8"PRIu64" bytes", le64toh(hwdb->head->header_size));
         log_debug("strings           %8"PRIu64" bytes", le64toh(hwdb->head->strings_len));
         log_debug("nodes             %8"PRIu64" bytes", le64toh(hwdb->head->nodes_len));
+        if (hwdb->indexed)
+                log_debug("prefix index      %8"PRIu64" entries", le64toh(hwdb->head->prefix_index_count));
 
         *ret = TAKE_PTR(hwdb);
 
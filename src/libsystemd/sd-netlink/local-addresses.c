@@ -32,6 +32,8 @@ static int address_compare(const struct local_address *a, const struct local_add
         return memcmp(&a->address, &b->address, FAMILY_ADDRESS_SIZE(a->family));
 }
 
+/* Returns the addresses of the specified link if ifindex > 0. Otherwise the addresses of all links are returned,
+ * excluding those of host scope if ifindex == 0, and including them if ifindex < 0. */
 int local_addresses(sd_netlink *context, int ifindex, int af, struct local_address **ret) {
         _cleanup_(sd_netlink_message_unrefp) sd_netlink_message *req = NULL, *reply = NULL;
         _cleanup_(sd_netlink_unrefp) sd_netlink *rtnl = NULL;
@@ -125,12 +125,14 @@ struct sd_netlink_message {
         unsigned n_containers; /* number of containers */
         bool sealed:1;
         bool broadcast:1;
+        bool hdr_embedded:1; /* hdr is allocated together with the message */
 
         sd_netlink_message *next; /* next in a chain of multi-part messages */
 };
 
 int message_new(sd_netlink *rtnl, sd_netlink_message **ret, uint16_t type);
 int message_new_empty(sd_netlink *rtnl, sd_netlink_message **ret);
+int message_new_received(sd_netlink *rtnl, const struct nlmsghdr *hdr, const NLType *nl_type, sd_netlink_message **ret);
 
 int netlink_open_family(sd_netlink **ret, int family);
 
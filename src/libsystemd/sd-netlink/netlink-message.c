@@ -45,6 +45,40 @@ int message_new_empty(sd_netlink *rtnl, sd_netlink_message **ret) {
         return 0;
 }
 
+int message_new_received(sd_netlink *rtnl, const struct nlmsghdr *hdr, const NLType *nl_type, sd_netlink_message **ret) {
+        sd_netlink_message *m;
+
+        assert(rtnl);
+        assert(hdr);
+        assert(nl_type);
+        assert(ret);
+
+        /* Received messages are never appended to, hence their header is allocated together with the message
+         * itself. The attributes are only indexed when first read, see netlink_message_read_internal(), as many of
+         * the messages of a dump or a notification storm are dropped by their recipient without that. */
+
+        m = malloc(ALIGN(sizeof(sd_netlink_message)) + hdr->nlmsg_len);
+        if (!m)
+                return -ENOMEM;
+
+        *m = (sd_netlink_message) {
+                .n_ref = REFCNT_INIT,
+                .protocol = rtnl->protocol,
+                .hdr = (struct nlmsghdr*) ((uint8_t*) m + ALIGN(sizeof(sd_netlink_message))),
+                .sealed = true,
+                .hdr_embedded = true,
+        };
+
+        memcpy(m->hdr, hdr, hdr->nlmsg_len);
+
+        if (type_get_type(nl_type) == NETLINK_TYPE_NESTED)
+                type_get_type_system(nl_type, &m->containers[0].type_system);
+
+        *ret = m;
+
+        return 0;
+}
+
 int message_new(sd_netlink *rtnl, sd_netlink_message **ret, uint16_t type) {
         _cleanup_(sd_netlink_message_unrefp) sd_netlink_message *m = NULL;
         const NLType *nl_type;
@@ -104,7 +138,8 @@ sd_netlink_message *sd_netlink_message_unref(sd_netlink_message *m) {
         while (m && REFCNT_DEC(m->n_ref) == 0) {
                 unsigned i;
 
-                free(m->hdr);
+                if (!m->hdr_embedded)
+                        free(m->hdr);
 
                 for (i = 0; i <= m->n_containers; i++)
                         free(m->containers[i].attributes);
@@ -535,14 +570,23 @@ int sd_netlink_message_cancel_array(sd_netlink_message *m) {
         return 0;
 }
 
+static int netlink_message_parse_top_level(sd_netlink_message *m);
+
 static int netlink_message_read_internal(sd_netlink_message *m, unsigned short type, void **data, bool *net_byteorder) {
         struct netlink_attribute *attribute;
         struct rtattr *rta;
+        int r;
 
         assert_return(m, -EINVAL);
         assert_return(m->sealed, -EPERM);
         assert_return(data, -EINVAL);
 
+        if (m->n_containers == 0 && !m->containers[0].attributes) {
+                r = netlink_message_parse_top_level(m);
+                if (r < 0)
+                        return r;
+        }
+
         assert(m->n_containers < RTNL_CONTAINER_DEPTH);
         assert(m->containers[m->n_containers].attributes);
         assert(type < m->containers[m->n_containers].n_attributes);
@@ -939,33 +983,19 @@ int sd_netlink_message_get_errno(sd_netlink_message *m) {
         return err->error;
 }
 
-int sd_netlink_message_rewind(sd_netlink_message *m) {
+static int netlink_message_parse_top_level(sd_netlink_message *m) {
         const NLType *nl_type;
         const NLTypeSystem *type_system_root;
         uint16_t type;
         size_t size;
-        unsigned i;
         int r;
 
-        assert_return(m, -EINVAL);
-
-        /* don't allow appending to message once parsed */
-        if (!m->sealed)
-                rtnl_message_seal(m);
+        assert(m);
+        assert(m->hdr);
+        assert(m->n_containers == 0);
 
         type_system_root = type_system_get_root(m->protocol);
 
-        for (i = 1; i <= m->n_containers; i++)
-                m->containers[i].attributes = mfree(m->containers[i].attributes);
-
-        m->n_containers = 0;
-
-        if (m->containers[0].attributes)
-                /* top-level attributes have already been parsed */
-                return 0;
-
-        assert(m->hdr);
-
         r = type_system_get_type(type_system_root, &nl_type, m->hdr->nlmsg_type);
         if (r < 0)
                 return r;
@@ -992,6 +1022,27 @@ int sd_netlink_message_rewind(sd_netlink_message *m) {
         return 0;
 }
 
+int sd_netlink_message_rewind(sd_netlink_message *m) {
+        unsigned i;
+
+        assert_return(m, -EINVAL);
+
+        /* don't allow appending to message once parsed */
+        if (!m->sealed)
+                rtnl_message_seal(m);
+
+        for (i = 1; i <= m->n_containers; i++)
+                m->containers[i].attributes = mfree(m->containers[i].attributes);
+
+        m->n_containers = 0;
+
+        if (m->containers[0].attributes)
+                /* top-level attributes have already been parsed */
+                return 0;
+
+        return netlink_message_parse_top_level(m);
+}
+
 void rtnl_message_seal(sd_netlink_message *m) {
         assert(m);
         assert(!m->sealed);
@@ -397,21 +397,12 @@ int socket_read_message(sd_netlink *rtnl) {
                         continue;
                 }
 
-                r = message_new_empty(rtnl, &m);
+                r = message_new_received(rtnl, new_msg, nl_type, &m);
                 if (r < 0)
                         return r;
 
                 m->broadcast = !!group;
 
-                m->hdr = memdup(new_msg, new_msg->nlmsg_len);
-                if (!m->hdr)
-                        return -ENOMEM;
-
-                /* seal and parse the top-level message */
-                r = sd_netlink_message_rewind(m);
-                if (r < 0)
-                        return r;
-
                 /* push the message onto the multi-part message stack */
                 if (first)
                         m->next = first;
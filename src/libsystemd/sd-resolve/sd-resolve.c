@@ -21,6 +21,7 @@
 #include "list.h"
 #include "missing.h"
 #include "socket-util.h"
+#include "string-util.h"
 #include "util.h"
 #include "process-util.h"
 
@@ -82,6 +83,15 @@ struct sd_resolve_query {
         bool floating:1;
         unsigned id;
 
+        /* The ID of the request the workers answer for this query: our own one, unless an identical getaddrinfo()
+         * query was in flight already, in which case we share its request. */
+        unsigned request_id;
+
+        /* What a getaddrinfo() query asked for, so that identical queries can share its request */
+        char *request_node, *request_service;
+        struct addrinfo request_hints;
+        bool request_hints_valid:1;
+
         int ret;
         int _errno;
         int _h_errno;
@@ -160,6 +170,7 @@ static int getaddrinfo_done(sd_resolve_query* q);
 static int getnameinfo_done(sd_resolve_query *q);
 
 static void resolve_query_disconnect(sd_resolve_query *q);
+static void resolve_freeaddrinfo(struct addrinfo *ai);
 
 #define RESOLVE_DONT_DESTROY(resolve) \
         _cleanup_(sd_resolve_unrefp) _unused_ sd_resolve *_dont_destroy_##resolve = sd_resolve_ref(resolve)
@@ -631,6 +642,49 @@ static sd_resolve_query *lookup_query(sd_resolve *resolve, unsigned id) {
         return NULL;
 }
 
+static sd_resolve_query *lookup_pending_query_by_request(sd_resolve *resolve, unsigned request_id) {
+        sd_resolve_query *q;
+
+        assert(resolve);
+
+        LIST_FOREACH(queries, q, resolve->queries)
+                if (!q->done && q->request_id == request_id)
+                        return q;
+
+        return NULL;
+}
+
+static sd_resolve_query *lookup_addrinfo_request(
+                sd_resolve *resolve,
+                const char *node, const char *service,
+                const struct addrinfo *hints) {
+
+        sd_resolve_query *q;
+
+        assert(resolve);
+
+        LIST_FOREACH(queries, q, resolve->queries) {
+                if (q->type != REQUEST_ADDRINFO || q->done || q->request_id != q->id)
+                        continue;
+
+                if (!streq_ptr(q->request_node, node) ||
+                    !streq_ptr(q->request_service, service) ||
+                    q->request_hints_valid != !!hints)
+                        continue;
+
+                if (hints &&
+                    (q->request_hints.ai_flags != hints->ai_flags ||
+                     q->request_hints.ai_family != hints->ai_family ||
+                     q->request_hints.ai_socktype != hints->ai_socktype ||
+                     q->request_hints.ai_protocol != hints->ai_protocol))
+                        continue;
+
+                return q;
+        }
+
+        return NULL;
+}
+
 static int complete_query(sd_resolve *resolve, sd_resolve_query *q) {
         int r;
 
@@ -744,51 +798,62 @@ static int handle_response(sd_resolve *resolve, const Packet *packet, size_t len
         assert(resolve->n_outstanding > 0);
         resolve->n_outstanding--;
 
-        q = lookup_query(resolve, resp->id);
-        if (!q)
-                return 0;
-
         switch (resp->type) {
 
         case RESPONSE_ADDRINFO: {
                 const AddrInfoResponse *ai_resp = &packet->addrinfo_response;
-                const void *p;
-                size_t l;
-                struct addrinfo *prev = NULL;
+                int ret = 0;
 
                 assert_return(length >= sizeof(AddrInfoResponse), -EBADMSG);
-                assert_return(q->type == REQUEST_ADDRINFO, -EBADMSG);
 
-                query_assign_errno(q, ai_resp->ret, ai_resp->_errno, ai_resp->_h_errno);
+                /* Complete all queries sharing this request. The callbacks might free other queries, hence look
+                 * for the next one from the beginning each time. */
+                while ((q = lookup_pending_query_by_request(resolve, resp->id))) {
+                        const void *p;
+                        size_t l;
+                        struct addrinfo *prev = NULL;
 
-                l = length - sizeof(AddrInfoResponse);
-                p = (const uint8_t*) resp + sizeof(AddrInfoResponse);
+                        assert_return(q->type == REQUEST_ADDRINFO, -EBADMSG);
 
-                while (l > 0 && p) {
-                        struct addrinfo *ai = NULL;
+                        query_assign_errno(q, ai_resp->ret, ai_resp->_errno, ai_resp->_h_errno);
 
-                        r = unserialize_addrinfo(&p, &l, &ai);
-                        if (r < 0) {
-                                query_assign_errno(q, EAI_SYSTEM, r, 0);
-                                freeaddrinfo(q->addrinfo);
-                                q->addrinfo = NULL;
-                                break;
-                        }
+                        l = length - sizeof(AddrInfoResponse);
+                        p = (const uint8_t*) resp + sizeof(AddrInfoResponse);
+
+                        while (l > 0 && p) {
+                                struct addrinfo *ai = NULL;
+
+                                r = unserialize_addrinfo(&p, &l, &ai);
+                                if (r < 0) {
+                                        query_assign_errno(q, EAI_SYSTEM, r, 0);
+                                        resolve_freeaddrinfo(q->addrinfo);
+                                        q->addrinfo = NULL;
+                                        break;
+                                }
 
-                        if (prev)
-                                prev->ai_next = ai;
-                        else
-                                q->addrinfo = ai;
+                                if (prev)
+                                        prev->ai_next = ai;
+                                else
+                                        q->addrinfo = ai;
 
-                        prev = ai;
+                                prev = ai;
+                        }
+
+                        r = complete_query(resolve, q);
+                        if (r < 0 && ret >= 0)
+                                ret = r;
                 }
 
-                return complete_query(resolve, q);
+                return ret;
         }
 
         case RESPONSE_NAMEINFO: {
                 const NameInfoResponse *ni_resp = &packet->nameinfo_response;
 
+                q = lookup_query(resolve, resp->id);
+                if (!q)
+                        return 0;
+
                 assert_return(length >= sizeof(NameInfoResponse), -EBADMSG);
                 assert_return(q->type == REQUEST_NAMEINFO, -EBADMSG);
 
@@ -900,7 +965,7 @@ static int alloc_query(sd_resolve *resolve, bool floating, sd_resolve_query **_q
         q->n_ref = 1;
         q->resolve = resolve;
         q->floating = floating;
-        q->id = resolve->current_id++;
+        q->id = q->request_id = resolve->current_id++;
 
         if (!floating)
                 sd_resolve_ref(resolve);
@@ -920,6 +985,7 @@ _public_ int sd_resolve_getaddrinfo(
                 sd_resolve_getaddrinfo_handler_t callback, void *userdata) {
 
         _cleanup_(sd_resolve_query_unrefp) sd_resolve_query *q = NULL;
+        sd_resolve_query *shared;
         AddrInfoRequest req = {};
         struct iovec iov[3];
         struct msghdr mh = {};
@@ -931,6 +997,10 @@ _public_ int sd_resolve_getaddrinfo(
         assert_return(callback, -EINVAL);
         assert_return(!resolve_pid_changed(resolve), -ECHILD);
 
+        /* If the very same lookup is in flight already, there's no point in keeping another worker busy with
+         * it, let's just wait for the response to it too. */
+        shared = lookup_addrinfo_request(resolve, node, service, hints);
+
         r = alloc_query(resolve, !_q, &q);
         if (r < 0)
                 return r;
@@ -939,6 +1009,33 @@ _public_ int sd_resolve_getaddrinfo(
         q->getaddrinfo_handler = callback;
         q->userdata = userdata;
 
+        if (shared) {
+                q->request_id = shared->request_id;
+                goto finish;
+        }
+
+        if (node) {
+                q->request_node = strdup(node);
+                if (!q->request_node)
+                        return -ENOMEM;
+        }
+
+        if (service) {
+                q->request_service = strdup(service);
+                if (!q->request_service)
+                        return -ENOMEM;
+        }
+
+        if (hints) {
+                q->request_hints = (struct addrinfo) {
+                        .ai_flags = hints->ai_flags,
+                        .ai_family = hints->ai_family,
+                        .ai_socktype = hints->ai_socktype,
+                        .ai_protocol = hints->ai_protocol,
+                };
+                q->request_hints_valid = true;
+        }
+
         node_len = node ? strlen(node) + 1 : 0;
         service_len = service ? strlen(service) + 1 : 0;
 
@@ -969,6 +1066,7 @@ _public_ int sd_resolve_getaddrinfo(
 
         resolve->n_outstanding++;
 
+finish:
         if (_q)
                 *_q = q;
         TAKE_PTR(q);
@@ -1111,6 +1209,8 @@ static sd_resolve_query *resolve_query_free(sd_resolve_query *q) {
         resolve_freeaddrinfo(q->addrinfo);
         free(q->host);
         free(q->serv);
+        free(q->request_node);
+        free(q->request_service);
 
         return mfree(q);
 }
@@ -446,6 +446,38 @@ int manager_get_idle_hint(Manager *m, dual_timestamp *t) {
         return idle_hint;
 }
 
+void manager_save_queued(Manager *m) {
+        Seat *seat;
+        Session *session;
+        User *user;
+
+        assert(m);
+
+        /* Writes the state files of all objects which changed since the last time. Clients watching the directories
+         * thus see one update per object, even if it changed several times while handling one event. */
+
+        while ((seat = m->seat_save_queue)) {
+                LIST_REMOVE(save_queue, m->seat_save_queue, seat);
+                seat->in_save_queue = false;
+
+                (void) seat_save(seat);
+        }
+
+        while ((session = m->session_save_queue)) {
+                LIST_REMOVE(save_queue, m->session_save_queue, session);
+                session->in_save_queue = false;
+
+                (void) session_save(session);
+        }
+
+        while ((user = m->user_save_queue)) {
+                LIST_REMOVE(save_queue, m->user_save_queue, user);
+                user->in_save_queue = false;
+
+                (void) user_save(user);
+        }
+}
+
 bool manager_shall_kill(Manager *m, const char *user) {
         assert(m);
         assert(user);
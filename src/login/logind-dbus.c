@@ -2790,8 +2790,8 @@ int match_job_removed(sd_bus_message *message, void *userdata, sd_bus_error *err
                         session->scope_job = mfree(session->scope_job);
                         (void) session_jobs_reply(session, unit, result);
 
-                        session_save(session);
-                        user_save(session->user);
+                        session_add_to_save_queue(session);
+                        user_add_to_save_queue(session->user);
                 }
 
                 session_add_to_gc_queue(session);
@@ -2805,7 +2805,7 @@ int match_job_removed(sd_bus_message *message, void *userdata, sd_bus_error *err
                         LIST_FOREACH(sessions_by_user, session, user->sessions)
                                 (void) session_jobs_reply(session, unit, NULL /* don't propagate user service failures to the client */);
 
-                        user_save(user);
+                        user_add_to_save_queue(user);
                 }
 
                 user_add_to_gc_queue(user);
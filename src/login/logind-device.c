@@ -100,7 +100,7 @@ void device_attach(Device *d, Seat *s) {
         }
 
         if (!had_master && d->master && s->started) {
-                seat_save(s);
+                seat_add_to_save_queue(s);
                 seat_send_changed(s, "CanGraphical", NULL);
         }
 }
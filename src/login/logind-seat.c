@@ -70,6 +70,9 @@ Seat* seat_free(Seat *s) {
         while (s->devices)
                 device_free(s->devices);
 
+        if (s->in_save_queue)
+                LIST_REMOVE(save_queue, s->manager->seat_save_queue, s);
+
         hashmap_remove(s->manager->seats, s->id);
 
         free(s->positions);
@@ -250,17 +253,17 @@ int seat_set_active(Seat *s, Session *session) {
         if (!session || session->started)
                 seat_send_changed(s, "ActiveSession", NULL);
 
-        seat_save(s);
+        seat_add_to_save_queue(s);
 
         if (session) {
-                session_save(session);
-                user_save(session->user);
+                session_add_to_save_queue(session);
+                user_add_to_save_queue(session->user);
         }
 
         if (old_active) {
-                session_save(old_active);
+                session_add_to_save_queue(old_active);
                 if (!session || session->user != old_active->user)
-                        user_save(old_active->user);
+                        user_add_to_save_queue(old_active->user);
         }
 
         return 0;
@@ -412,7 +415,7 @@ int seat_start(Seat *s) {
         s->started = true;
 
         /* Save seat data */
-        seat_save(s);
+        seat_add_to_save_queue(s);
 
         seat_send_signal(s, true);
 
@@ -639,6 +642,16 @@ void seat_add_to_gc_queue(Seat *s) {
         s->in_gc_queue = true;
 }
 
+void seat_add_to_save_queue(Seat *s) {
+        assert(s);
+
+        if (s->in_save_queue)
+                return;
+
+        LIST_PREPEND(save_queue, s->manager->seat_save_queue, s);
+        s->in_save_queue = true;
+}
+
 static bool seat_name_valid_char(char c) {
         return
                 (c >= 'a' && c <= 'z') ||
@@ -22,9 +22,11 @@ struct Seat {
         size_t position_count;
 
         bool in_gc_queue:1;
+        bool in_save_queue:1;
         bool started:1;
 
         LIST_FIELDS(Seat, gc_queue);
+        LIST_FIELDS(Seat, save_queue);
 };
 
 int seat_new(Seat **ret, Manager *m, const char *id);
@@ -64,6 +66,7 @@ int seat_stop_sessions(Seat *s, bool force);
 
 bool seat_may_gc(Seat *s, bool drop_not_started);
 void seat_add_to_gc_queue(Seat *s);
+void seat_add_to_save_queue(Seat *s);
 
 bool seat_name_is_valid(const char *name);
 
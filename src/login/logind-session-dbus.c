@@ -409,7 +409,7 @@ static int method_take_device(sd_bus_message *message, void *userdata, sd_bus_er
         if (r < 0)
                 goto error;
 
-        session_save(s);
+        session_add_to_save_queue(s);
         return 1;
 
 error:
@@ -443,7 +443,7 @@ static int method_release_device(sd_bus_message *message, void *userdata, sd_bus
                 return sd_bus_error_setf(error, BUS_ERROR_DEVICE_NOT_TAKEN, "Device not taken");
 
         session_device_free(sd);
-        session_save(s);
+        session_add_to_save_queue(s);
 
         return sd_bus_reply_method_return(message, NULL);
 }
@@ -732,8 +732,9 @@ int session_send_create_reply(Session *s, sd_bus_error *error) {
         if (fifo_fd < 0)
                 return fifo_fd;
 
-        /* Update the session state file before we notify the client about the result. */
-        session_save(s);
+        /* Update the state files before we notify the client about the result. */
+        session_add_to_save_queue(s);
+        manager_save_queued(s->manager);
 
         p = session_bus_path(s);
         if (!p)
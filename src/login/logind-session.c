@@ -139,6 +139,9 @@ Session* session_free(Session *s) {
         free(s->service);
         free(s->desktop);
 
+        if (s->in_save_queue)
+                LIST_REMOVE(save_queue, s->manager->session_save_queue, s);
+
         hashmap_remove(s->manager->sessions, s->id);
 
         free(s->state_file);
@@ -701,10 +704,10 @@ int session_start(Session *s, sd_bus_message *properties, sd_bus_error *error) {
         user_elect_display(s->user);
 
         /* Save data */
-        session_save(s);
-        user_save(s->user);
+        session_add_to_save_queue(s);
+        user_add_to_save_queue(s->user);
         if (s->seat)
-                seat_save(s->seat);
+                seat_add_to_save_queue(s->seat);
 
         /* Send signals */
         session_send_signal(s, true);
@@ -794,8 +797,8 @@ int session_stop(Session *s, bool force) {
 
         user_elect_display(s->user);
 
-        session_save(s);
-        user_save(s->user);
+        session_add_to_save_queue(s);
+        user_add_to_save_queue(s->user);
 
         return r;
 }
@@ -838,10 +841,10 @@ int session_finalize(Session *s) {
                 if (s->seat->active == s)
                         seat_set_active(s->seat, NULL);
 
-                seat_save(s->seat);
+                seat_add_to_save_queue(s->seat);
         }
 
-        user_save(s->user);
+        user_add_to_save_queue(s->user);
         user_send_changed(s->user, "Display", NULL);
 
         return 0;
@@ -1128,6 +1131,16 @@ void session_add_to_gc_queue(Session *s) {
         s->in_gc_queue = true;
 }
 
+void session_add_to_save_queue(Session *s) {
+        assert(s);
+
+        if (s->in_save_queue)
+                return;
+
+        LIST_PREPEND(save_queue, s->manager->session_save_queue, s);
+        s->in_save_queue = true;
+}
+
 SessionState session_get_state(Session *s) {
         assert(s);
 
@@ -1386,7 +1399,7 @@ int session_set_controller(Session *s, const char *sender, bool force, bool prep
 
         session_release_controller(s, true);
         s->controller = TAKE_PTR(name);
-        session_save(s);
+        session_add_to_save_queue(s);
 
         return 0;
 }
@@ -1399,7 +1412,7 @@ void session_drop_controller(Session *s) {
 
         s->track = sd_bus_track_unref(s->track);
         session_release_controller(s, false);
-        session_save(s);
+        session_add_to_save_queue(s);
         session_restore_vt(s);
 }
 
@@ -126,6 +126,9 @@ User *user_free(User *u) {
         if (u->slice)
                 hashmap_remove_value(u->manager->user_units, u->slice, u);
 
+        if (u->in_save_queue)
+                LIST_REMOVE(save_queue, u->manager->user_save_queue, u);
+
         hashmap_remove_value(u->manager->users, UID_TO_PTR(u->uid), u);
 
         (void) sd_event_source_unref(u->timer_event_source);
@@ -390,7 +393,7 @@ int user_start(User *u) {
         }
 
         /* Save new user data */
-        user_save(u);
+        user_add_to_save_queue(u);
 
         return 0;
 }
@@ -426,7 +429,7 @@ int user_stop(User *u, bool force) {
                 return 0;
 
         if (u->stopping) { /* Stop jobs have already been queued */
-                user_save(u);
+                user_add_to_save_queue(u);
                 return 0;
         }
 
@@ -442,7 +445,7 @@ int user_stop(User *u, bool force) {
 
         u->stopping = true;
 
-        user_save(u);
+        user_add_to_save_queue(u);
 
         return r;
 }
@@ -618,6 +621,16 @@ void user_add_to_gc_queue(User *u) {
         u->in_gc_queue = true;
 }
 
+void user_add_to_save_queue(User *u) {
+        assert(u);
+
+        if (u->in_save_queue)
+                return;
+
+        LIST_PREPEND(save_queue, u->manager->user_save_queue, u);
+        u->in_save_queue = true;
+}
+
 UserState user_get_state(User *u) {
         Session *i;
 
@@ -1173,8 +1173,10 @@ static int manager_run(Manager *m) {
                 r = sd_event_get_state(m->event);
                 if (r < 0)
                         return r;
-                if (r == SD_EVENT_FINISHED)
+                if (r == SD_EVENT_FINISHED) {
+                        manager_save_queued(m);
                         return 0;
+                }
 
                 manager_gc(m, true);
 
@@ -1184,6 +1186,8 @@ static int manager_run(Manager *m) {
                 if (r > 0)
                         continue;
 
+                manager_save_queued(m);
+
                 r = sd_event_run(m->event, (uint64_t) -1);
                 if (r < 0)
                         return r;
@@ -1,6 +1,8 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 
+#include <sys/epoll.h>
 #include <sys/file.h>
+#include <sys/inotify.h>
 #include <sys/mount.h>
 
 #include "alloc-util.h"
@@ -16,11 +18,17 @@
 #include "loop-util.h"
 #include "machine-image.h"
 #include "mount-util.h"
+#include "path-util.h"
 #include "process-util.h"
 #include "raw-clone.h"
+#include "set.h"
 #include "strv.h"
 #include "user-util.h"
 
+/* How long the cached image list is used as is. Creation, removal and renaming of images is noticed through inotify,
+ * but the usage of images and the modification time of directory images change without any event we could watch. */
+#define IMAGE_LIST_REFRESH_USEC (5 * USEC_PER_SEC)
+
 static BUS_DEFINE_PROPERTY_GET_ENUM(property_get_type, image_type, ImageType);
 
 int bus_image_method_remove(
@@ -230,6 +238,9 @@ int bus_image_method_mark_read_only(
         if (r < 0)
                 return r;
 
+        /* This is not necessarily visible to the inotify watches, hence look at all images again */
+        manager_image_list_flush(m);
+
         return sd_bus_reply_method_return(message, NULL);
 }
 
@@ -269,6 +280,9 @@ int bus_image_method_set_limit(
         if (r < 0)
                 return r;
 
+        /* This is not necessarily visible to the inotify watches, hence look at all images again */
+        manager_image_list_flush(m);
+
         return sd_bus_reply_method_return(message, NULL);
 }
 
@@ -386,6 +400,251 @@ static int image_flush_cache(sd_event_source *s, void *userdata) {
         return 0;
 }
 
+void manager_image_list_flush(Manager *m) {
+        assert(m);
+
+        m->image_list = hashmap_free(m->image_list);
+        m->image_list_watches = set_free_with_destructor(m->image_list_watches, sd_event_source_unref);
+        m->image_list_watched = false;
+        m->image_list_stale = set_free_free(m->image_list_stale);
+
+        (void) sd_event_source_set_enabled(m->image_list_refresh_event, SD_EVENT_OFF);
+}
+
+static int image_list_dispatch_inotify(sd_event_source *s, const struct inotify_event *event, void *userdata) {
+        Manager *m = userdata;
+
+        assert(m);
+
+        log_debug("Image search path changed, flushing image list.");
+        manager_image_list_flush(m);
+
+        return 0;
+}
+
+static int image_list_dispatch_mountinfo(sd_event_source *s, int fd, uint32_t revents, void *userdata) {
+        Manager *m = userdata;
+
+        assert(m);
+
+        /* Something might have been mounted over a directory in the search path, which hides the directory we
+         * watch, hence start from scratch */
+        log_debug("Mount table changed, flushing image list.");
+        manager_image_list_flush(m);
+
+        return 0;
+}
+
+static int image_list_add_watch(Manager *m, sd_event_source *s) {
+        int r;
+
+        r = set_ensure_allocated(&m->image_list_watches, NULL);
+        if (r < 0) {
+                sd_event_source_unref(s);
+                return r;
+        }
+
+        r = set_put(m->image_list_watches, s);
+        if (r < 0) {
+                sd_event_source_unref(s);
+                return r;
+        }
+
+        return 0;
+}
+
+static int image_list_watch_directory(Manager *m, const char *path) {
+        _cleanup_free_ char *p = NULL;
+        sd_event_source *s;
+        uint32_t mask;
+        int r;
+
+        assert(m);
+        assert(path);
+
+        p = strdup(path);
+        if (!p)
+                return -ENOMEM;
+
+        mask = IN_CREATE|IN_DELETE|IN_MOVED_FROM|IN_MOVED_TO|IN_ATTRIB|IN_DELETE_SELF|IN_MOVE_SELF|IN_ONLYDIR;
+
+        for (;;) {
+                char *parent;
+
+                r = sd_event_add_inotify(m->event, &s, p, mask, image_list_dispatch_inotify, m);
+                if (r != -ENOENT || path_equal(p, "/"))
+                        break;
+
+                /* If the directory doesn't exist (yet), watch its parent instead and wait until it is created */
+                parent = dirname_malloc(p);
+                if (!parent)
+                        return -ENOMEM;
+
+                free_and_replace(p, parent);
+                mask = IN_CREATE|IN_MOVED_TO|IN_DELETE_SELF|IN_MOVE_SELF|IN_ONLYDIR;
+        }
+        if (r < 0)
+                return r;
+
+        return image_list_add_watch(m, s);
+}
+
+static int image_list_watch(Manager *m) {
+        _cleanup_close_ int fd = -1;
+        sd_event_source *s;
+        const char *path;
+        int r;
+
+        assert(m);
+
+        NULSTR_FOREACH(path, image_search_path_nulstr(IMAGE_MACHINE)) {
+                r = image_list_watch_directory(m, path);
+                if (r < 0)
+                        return log_debug_errno(r, "Failed to watch %s: %m", path);
+        }
+
+        fd = open("/proc/self/mountinfo", O_RDONLY|O_CLOEXEC);
+        if (fd < 0)
+                return log_debug_errno(errno, "Failed to open /proc/self/mountinfo: %m");
+
+        r = sd_event_add_io(m->event, &s, fd, EPOLLPRI, image_list_dispatch_mountinfo, m);
+        if (r < 0)
+                return log_debug_errno(r, "Failed to watch /proc/self/mountinfo: %m");
+
+        r = sd_event_source_set_io_fd_own(s, true);
+        if (r < 0) {
+                sd_event_source_unref(s);
+                return r;
+        }
+        TAKE_FD(fd);
+
+        r = image_list_add_watch(m, s);
+        if (r < 0)
+                return r;
+
+        m->image_list_watched = true;
+        return 0;
+}
+
+static int image_list_dispatch_refresh(sd_event_source *s, void *userdata) {
+        _cleanup_free_ char *name = NULL;
+        Manager *m = userdata;
+        Image *image, *old;
+        int r;
+
+        assert(s);
+        assert(m);
+
+        /* Look at one image per event loop iteration, so that we never block for long. Until we got to an image,
+         * ListImages() returns what we found out about it last time. */
+
+        name = set_steal_first(m->image_list_stale);
+        if (!name) {
+                m->image_list_timestamp = now(CLOCK_MONOTONIC);
+                return sd_event_source_set_enabled(s, SD_EVENT_OFF);
+        }
+
+        r = image_find(IMAGE_MACHINE, name, &image);
+        if (r == -ENOENT) {
+                image_unref(hashmap_remove(m->image_list, name));
+                return 0;
+        }
+        if (r < 0) {
+                log_debug_errno(r, "Failed to look at image %s again, ignoring: %m", name);
+                return 0;
+        }
+
+        old = hashmap_get(m->image_list, name);
+
+        r = hashmap_replace(m->image_list, image->name, image);
+        if (r < 0) {
+                image_unref(image);
+                return 0;
+        }
+
+        image_unref(old);
+        return 0;
+}
+
+static int image_list_schedule_refresh(Manager *m) {
+        _cleanup_set_free_free_ Set *stale = NULL;
+        Image *image;
+        Iterator i;
+        int r;
+
+        assert(m);
+
+        if (m->image_list_stale || now(CLOCK_MONOTONIC) < usec_add(m->image_list_timestamp, IMAGE_LIST_REFRESH_USEC))
+                return 0;
+
+        stale = set_new(&string_hash_ops);
+        if (!stale)
+                return -ENOMEM;
+
+        HASHMAP_FOREACH(image, m->image_list, i) {
+                r = set_put_strdup(stale, image->name);
+                if (r < 0)
+                        return r;
+        }
+
+        if (!m->image_list_refresh_event) {
+                r = sd_event_add_defer(m->event, &m->image_list_refresh_event, image_list_dispatch_refresh, m);
+                if (r < 0)
+                        return r;
+
+                r = sd_event_source_set_priority(m->image_list_refresh_event, SD_EVENT_PRIORITY_IDLE);
+                if (r < 0)
+                        return r;
+        }
+
+        r = sd_event_source_set_enabled(m->image_list_refresh_event, SD_EVENT_ON);
+        if (r < 0)
+                return r;
+
+        m->image_list_stale = TAKE_PTR(stale);
+        return 0;
+}
+
+int manager_get_images(Manager *m, Hashmap **ret) {
+        _cleanup_hashmap_free_ Hashmap *images = NULL;
+        int r;
+
+        assert(m);
+        assert(ret);
+
+        /* Returns all images in the search path. The hashmap is owned by the manager, and stays valid until
+         * the next iteration of the event loop. */
+
+        if (m->image_list && m->image_list_watched) {
+                r = image_list_schedule_refresh(m);
+                if (r < 0)
+                        return r;
+
+                *ret = m->image_list;
+                return 0;
+        }
+
+        manager_image_list_flush(m);
+
+        /* Set up the watches before enumerating, so that we don't miss anything that changes meanwhile. If that
+         * fails, the images are enumerated again on every call. */
+        (void) image_list_watch(m);
+
+        images = hashmap_new(&image_hash_ops);
+        if (!images)
+                return -ENOMEM;
+
+        r = image_discover(IMAGE_MACHINE, images);
+        if (r < 0)
+                return r;
+
+        m->image_list = TAKE_PTR(images);
+        m->image_list_timestamp = now(CLOCK_MONOTONIC);
+
+        *ret = m->image_list;
+        return 0;
+}
+
 int image_object_find(sd_bus *bus, const char *path, const char *interface, void *userdata, void **found, sd_bus_error *error) {
         _cleanup_free_ char *e = NULL;
         Manager *m = userdata;
@@ -461,8 +720,9 @@ char *image_bus_path(const char *name) {
 }
 
 int image_node_enumerator(sd_bus *bus, const char *path, void *userdata, char ***nodes, sd_bus_error *error) {
-        _cleanup_hashmap_free_ Hashmap *images = NULL;
         _cleanup_strv_free_ char **l = NULL;
+        Manager *m = userdata;
+        Hashmap *images;
         Image *image;
         Iterator i;
         int r;
@@ -470,12 +730,9 @@ int image_node_enumerator(sd_bus *bus, const char *path, void *userdata, char **
         assert(bus);
         assert(path);
         assert(nodes);
+        assert(m);
 
-        images = hashmap_new(&image_hash_ops);
-        if (!images)
-                return -ENOMEM;
-
-        r = image_discover(IMAGE_MACHINE, images);
+        r = manager_get_images(m, &images);
         if (r < 0)
                 return r;
 
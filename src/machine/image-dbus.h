@@ -8,6 +8,9 @@ extern const sd_bus_vtable image_vtable[];
 char *image_bus_path(const char *name);
 
 int image_object_find(sd_bus *bus, const char *path, const char *interface, void *userdata, void **found, sd_bus_error *error);
+int manager_get_images(Manager *m, Hashmap **ret);
+void manager_image_list_flush(Manager *m);
+
 int image_node_enumerator(sd_bus *bus, const char *path, void *userdata, char ***nodes, sd_bus_error *error);
 
 int bus_image_method_remove(sd_bus_message *message, void *userdata, sd_bus_error *error);
@@ -79,6 +79,9 @@ static Manager* manager_unref(Manager *m) {
 
         sd_event_source_unref(m->image_cache_defer_event);
 
+        manager_image_list_flush(m);
+        sd_event_source_unref(m->image_list_refresh_event);
+
         bus_verify_polkit_async_registry_free(m->polkit_registry);
 
         sd_bus_unref(m->bus);
@@ -8,6 +8,8 @@
 
 #include "hashmap.h"
 #include "list.h"
+#include "set.h"
+#include "time-util.h"
 
 typedef struct Manager Manager;
 
@@ -29,6 +31,15 @@ struct Manager {
         Hashmap *image_cache;
         sd_event_source *image_cache_defer_event;
 
+        /* The images in the search path, as returned by ListImages(). The list is dropped when the search path
+         * changes, and the images in it are looked at again when the list is older than a few seconds. */
+        Hashmap *image_list;
+        Set *image_list_watches;
+        bool image_list_watched;
+        usec_t image_list_timestamp;
+        Set *image_list_stale;
+        sd_event_source *image_list_refresh_event;
+
         LIST_HEAD(Machine, machine_gc_queue);
 
         Machine *host_machine;
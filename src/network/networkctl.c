@@ -16,7 +16,9 @@
 #include "device-util.h"
 #include "ether-addr-util.h"
 #include "fd-util.h"
+#include "format-table.h"
 #include "hwdb-util.h"
+#include "json.h"
 #include "local-addresses.h"
 #include "locale-util.h"
 #include "macro.h"
@@ -39,6 +41,16 @@
 static PagerFlags arg_pager_flags = 0;
 static bool arg_legend = true;
 static bool arg_all = false;
+static enum {
+        JSON_OFF,
+        JSON_SHORT,
+        JSON_PRETTY,
+} arg_json = JSON_OFF;
+
+static unsigned json_format_flags(void) {
+        return (arg_json == JSON_PRETTY ? JSON_FORMAT_PRETTY : JSON_FORMAT_NEWLINE) |
+                colors_enabled() * JSON_FORMAT_COLOR;
+}
 
 static char *link_get_type_string(unsigned short iftype, sd_device *d) {
         const char *t, *devtype;
@@ -236,6 +248,7 @@ static int acquire_link_info_all(sd_netlink *rtnl, LinkInfo **ret) {
 
 static int list_links(int argc, char *argv[], void *userdata) {
         _cleanup_(sd_netlink_unrefp) sd_netlink *rtnl = NULL;
+        _cleanup_(table_unrefp) Table *table = NULL;
         _cleanup_free_ LinkInfo *links = NULL;
         int c, i, r;
 
@@ -250,15 +263,12 @@ static int list_links(int argc, char *argv[], void *userdata) {
         if (c < 0)
                 return c;
 
-        (void) pager_open(arg_pager_flags);
+        table = table_new("IDX", "LINK", "TYPE", "OPERATIONAL", "SETUP");
+        if (!table)
+                return log_oom();
 
-        if (arg_legend)
-                printf("%3s %-16s %-18s %-11s %-10s\n",
-                       "IDX",
-                       "LINK",
-                       "TYPE",
-                       "OPERATIONAL",
-                       "SETUP");
+        table_set_header(table, arg_legend);
+        (void) table_set_align_percent(table, TABLE_HEADER_CELL(0), 100);
 
         for (i = 0; i < c; i++) {
                 _cleanup_free_ char *setup_state = NULL, *operational_state = NULL;
@@ -267,6 +277,7 @@ static int list_links(int argc, char *argv[], void *userdata) {
                            *on_color_setup, *off_color_setup;
                 char devid[2 + DECIMAL_STR_MAX(int)];
                 _cleanup_free_ char *t = NULL;
+                TableCell *cell;
 
                 (void) sd_network_link_get_operational_state(links[i].ifindex, &operational_state);
                 operational_state_to_color(operational_state, &on_color_operational, &off_color_operational);
@@ -281,12 +292,38 @@ static int list_links(int argc, char *argv[], void *userdata) {
 
                 t = link_get_type_string(links[i].iftype, d);
 
-                printf("%3i %-16s %-18s %s%-11s%s %s%-10s%s\n",
-                       links[i].ifindex, links[i].name, strna(t),
-                       on_color_operational, strna(operational_state), off_color_operational,
-                       on_color_setup, strna(setup_state), off_color_setup);
+                r = table_add_many(table,
+                                   TABLE_UINT32, (uint32_t) links[i].ifindex,
+                                   TABLE_STRING, links[i].name,
+                                   TABLE_STRING, strna(t));
+                if (r < 0)
+                        return log_error_errno(r, "Failed to add row to table: %m");
+
+                r = table_add_cell(table, &cell, TABLE_STRING, strna(operational_state));
+                if (r < 0)
+                        return log_error_errno(r, "Failed to add row to table: %m");
+                (void) table_set_color(table, cell, on_color_operational);
+
+                r = table_add_cell(table, &cell, TABLE_STRING, strna(setup_state));
+                if (r < 0)
+                        return log_error_errno(r, "Failed to add row to table: %m");
+                (void) table_set_color(table, cell, on_color_setup);
+        }
+
+        if (arg_json != JSON_OFF) {
+                r = table_print_json(table, stdout, json_format_flags());
+                if (r < 0)
+                        return log_error_errno(r, "Failed to show table: %m");
+
+                return 0;
         }
 
+        (void) pager_open(arg_pager_flags);
+
+        r = table_print(table, NULL);
+        if (r < 0)
+                return log_error_errno(r, "Failed to show table: %m");
+
         if (arg_legend)
                 printf("\n%i links listed.\n", c);
 
@@ -327,36 +364,100 @@ static int ieee_oui(sd_hwdb *hwdb, const struct ether_addr *mac, char **ret) {
         return 0;
 }
 
+/* The addresses, gateways and neighbors of all links, each acquired with a single netlink dump, rather than one for
+ * each link that is shown */
+typedef struct StatusContext {
+        sd_netlink *rtnl;
+        sd_hwdb *hwdb;
+
+        struct local_address *addresses;
+        int n_addresses;
+
+        struct local_address *gateways;
+        int n_gateways;
+
+        /* only acquired once the description of a gateway is needed */
+        sd_netlink_message *neighbors_ipv4, *neighbors_ipv6;
+} StatusContext;
+
+static void status_context_done(StatusContext *c) {
+        assert(c);
+
+        c->addresses = mfree(c->addresses);
+        c->gateways = mfree(c->gateways);
+        c->neighbors_ipv4 = sd_netlink_message_unref(c->neighbors_ipv4);
+        c->neighbors_ipv6 = sd_netlink_message_unref(c->neighbors_ipv6);
+}
+
+static int status_context_init(StatusContext *c, sd_netlink *rtnl, sd_hwdb *hwdb) {
+        assert(c);
+        assert(rtnl);
+
+        *c = (StatusContext) {
+                .rtnl = rtnl,
+                .hwdb = hwdb,
+        };
+
+        /* A negative index gets us the addresses of all links, including those of host scope */
+        c->n_addresses = local_addresses(rtnl, -1, AF_UNSPEC, &c->addresses);
+        if (c->n_addresses < 0)
+                return log_error_errno(c->n_addresses, "Failed to enumerate addresses: %m");
+
+        c->n_gateways = local_gateways(rtnl, 0, AF_UNSPEC, &c->gateways);
+        if (c->n_gateways < 0)
+                return log_error_errno(c->n_gateways, "Failed to enumerate gateways: %m");
+
+        return 0;
+}
+
+static bool status_context_address_matches(const StatusContext *c, size_t i, int ifindex) {
+        assert(c);
+
+        /* when showing the addresses of all links, skip those of host scope, as local_addresses() would */
+        if (ifindex <= 0)
+                return !IN_SET(c->addresses[i].scope, RT_SCOPE_HOST, RT_SCOPE_NOWHERE);
+
+        return c->addresses[i].ifindex == ifindex;
+}
+
+static int acquire_neighbors(sd_netlink *rtnl, int family, sd_netlink_message **ret) {
+        _cleanup_(sd_netlink_message_unrefp) sd_netlink_message *req = NULL;
+        int r;
+
+        r = sd_rtnl_message_new_neigh(rtnl, &req, RTM_GETNEIGH, 0, family);
+        if (r < 0)
+                return r;
+
+        r = sd_netlink_message_request_dump(req, true);
+        if (r < 0)
+                return r;
+
+        return sd_netlink_call(rtnl, req, 0, ret);
+}
+
 static int get_gateway_description(
-                sd_netlink *rtnl,
-                sd_hwdb *hwdb,
+                StatusContext *c,
                 int ifindex,
                 int family,
                 union in_addr_union *gateway,
                 char **gateway_description) {
-        _cleanup_(sd_netlink_message_unrefp) sd_netlink_message *req = NULL, *reply = NULL;
-        sd_netlink_message *m;
+        sd_netlink_message **neighbors, *m;
         int r;
 
-        assert(rtnl);
+        assert(c);
         assert(ifindex >= 0);
         assert(IN_SET(family, AF_INET, AF_INET6));
         assert(gateway);
         assert(gateway_description);
 
-        r = sd_rtnl_message_new_neigh(rtnl, &req, RTM_GETNEIGH, ifindex, family);
-        if (r < 0)
-                return r;
-
-        r = sd_netlink_message_request_dump(req, true);
-        if (r < 0)
-                return r;
-
-        r = sd_netlink_call(rtnl, req, 0, &reply);
-        if (r < 0)
-                return r;
+        neighbors = family == AF_INET ? &c->neighbors_ipv4 : &c->neighbors_ipv6;
+        if (!*neighbors) {
+                r = acquire_neighbors(c->rtnl, family, neighbors);
+                if (r < 0)
+                        return r;
+        }
 
-        for (m = reply; m; m = sd_netlink_message_next(m)) {
+        for (m = *neighbors; m; m = sd_netlink_message_next(m)) {
                 union in_addr_union gw = {};
                 struct ether_addr mac = {};
                 uint16_t type;
@@ -423,7 +524,7 @@ static int get_gateway_description(
                 if (r < 0)
                         continue;
 
-                r = ieee_oui(hwdb, &mac, gateway_description);
+                r = ieee_oui(c->hwdb, &mac, gateway_description);
                 if (r < 0)
                         continue;
 
@@ -433,51 +534,54 @@ static int get_gateway_description(
         return -ENODATA;
 }
 
+static void dump_ifname(int ifindex) {
+        char name[IF_NAMESIZE+1];
+
+        if (if_indextoname(ifindex, name)) {
+                fputs(" on ", stdout);
+                fputs(name, stdout);
+        } else
+                printf(" on %%%i", ifindex);
+}
+
 static int dump_gateways(
-                sd_netlink *rtnl,
-                sd_hwdb *hwdb,
+                StatusContext *c,
                 const char *prefix,
                 int ifindex) {
-        _cleanup_free_ struct local_address *local = NULL;
-        int r, n, i;
+        bool first = true;
+        int r, i;
 
-        assert(rtnl);
+        assert(c);
         assert(prefix);
 
-        n = local_gateways(rtnl, ifindex, AF_UNSPEC, &local);
-        if (n < 0)
-                return n;
-
-        for (i = 0; i < n; i++) {
+        for (i = 0; i < c->n_gateways; i++) {
                 _cleanup_free_ char *gateway = NULL, *description = NULL;
+                struct local_address *local = c->gateways + i;
+
+                if (ifindex > 0 && local->ifindex != ifindex)
+                        continue;
 
-                r = in_addr_to_string(local[i].family, &local[i].address, &gateway);
+                r = in_addr_to_string(local->family, &local->address, &gateway);
                 if (r < 0)
                         return r;
 
-                r = get_gateway_description(rtnl, hwdb, local[i].ifindex, local[i].family, &local[i].address, &description);
+                r = get_gateway_description(c, local->ifindex, local->family, &local->address, &description);
                 if (r < 0)
                         log_debug_errno(r, "Could not get description of gateway: %m");
 
                 printf("%*s%s",
                        (int) strlen(prefix),
-                       i == 0 ? prefix : "",
+                       first ? prefix : "",
                        gateway);
+                first = false;
 
                 if (description)
                         printf(" (%s)", description);
 
                 /* Show interface name for the entry if we show
                  * entries for all interfaces */
-                if (ifindex <= 0) {
-                        char name[IF_NAMESIZE+1];
-
-                        if (if_indextoname(local[i].ifindex, name)) {
-                                fputs(" on ", stdout);
-                                fputs(name, stdout);
-                        } else
-                                printf(" on %%%i", local[i].ifindex);
-                }
+                if (ifindex <= 0)
+                        dump_ifname(local->ifindex);
 
                 fputc('\n', stdout);
         }
@@ -486,41 +590,33 @@ static int dump_gateways(
 }
 
 static int dump_addresses(
-                sd_netlink *rtnl,
+                StatusContext *c,
                 const char *prefix,
                 int ifindex) {
+        bool first = true;
+        int r, i;
 
-        _cleanup_free_ struct local_address *local = NULL;
-        int r, n, i;
-
-        assert(rtnl);
+        assert(c);
         assert(prefix);
 
-        n = local_addresses(rtnl, ifindex, AF_UNSPEC, &local);
-        if (n < 0)
-                return n;
-
-        for (i = 0; i < n; i++) {
+        for (i = 0; i < c->n_addresses; i++) {
                 _cleanup_free_ char *pretty = NULL;
 
-                r = in_addr_to_string(local[i].family, &local[i].address, &pretty);
+                if (!status_context_address_matches(c, i, ifindex))
+                        continue;
+
+                r = in_addr_to_string(c->addresses[i].family, &c->addresses[i].address, &pretty);
                 if (r < 0)
                         return r;
 
                 printf("%*s%s",
                        (int) strlen(prefix),
-                       i == 0 ? prefix : "",
+                       first ? prefix : "",
                        pretty);
+                first = false;
 
-                if (ifindex <= 0) {
-                        char name[IF_NAMESIZE+1];
-
-                        if (if_indextoname(local[i].ifindex, name)) {
-                                fputs(" on ", stdout);
-                                fputs(name, stdout);
-                        } else
-                                printf(" on %%%i", local[i].ifindex);
-                }
+                if (ifindex <= 0)
+                        dump_ifname(c->addresses[i].ifindex);
 
                 fputc('\n', stdout);
         }
@@ -528,6 +624,39 @@ static int dump_addresses(
         return 0;
 }
 
+static int addresses_to_strv(StatusContext *c, bool gateways, int ifindex, char ***ret) {
+        _cleanup_strv_free_ char **l = NULL;
+        int r, i, n;
+
+        assert(c);
+        assert(ret);
+
+        n = gateways ? c->n_gateways : c->n_addresses;
+
+        for (i = 0; i < n; i++) {
+                struct local_address *local = (gateways ? c->gateways : c->addresses) + i;
+                char *pretty;
+
+                if (gateways) {
+                        if (ifindex > 0 && local->ifindex != ifindex)
+                                continue;
+                } else if (!status_context_address_matches(c, i, ifindex))
+                        continue;
+
+                r = in_addr_to_string(local->family, &local->address, &pretty);
+                if (r < 0)
+                        return r;
+
+                r = strv_consume(&l, pretty);
+                if (r < 0)
+                        return r;
+        }
+
+        *ret = TAKE_PTR(l);
+
+        return 0;
+}
+
 static int dump_address_labels(sd_netlink *rtnl) {
         _cleanup_(sd_netlink_message_unrefp) sd_netlink_message *req = NULL, *reply = NULL;
         sd_netlink_message *m;
@@ -727,9 +856,9 @@ static void dump_list(const char *prefix, char **l) {
 }
 
 static int link_status_one(
-                sd_netlink *rtnl,
-                sd_hwdb *hwdb,
-                const LinkInfo *info) {
+                StatusContext *c,
+                const LinkInfo *info,
+                JsonVariant **ret_json) {
 
         _cleanup_strv_free_ char **dns = NULL, **ntp = NULL, **search_domains = NULL, **route_domains = NULL;
         _cleanup_free_ char *setup_state = NULL, *operational_state = NULL, *tz = NULL;
@@ -742,7 +871,7 @@ static int link_status_one(
         _cleanup_free_ int *carrier_bound_to = NULL, *carrier_bound_by = NULL;
         int r;
 
-        assert(rtnl);
+        assert(c);
         assert(info);
 
         (void) sd_network_link_get_operational_state(info->ifindex, &operational_state);
@@ -778,6 +907,44 @@ static int link_status_one(
 
         (void) sd_network_link_get_network_file(info->ifindex, &network);
 
+        (void) sd_network_link_get_timezone(info->ifindex, &tz);
+
+        if (ret_json) {
+                _cleanup_strv_free_ char **addresses = NULL, **gateways = NULL;
+                char ea[ETHER_ADDR_TO_STRING_MAX];
+
+                r = addresses_to_strv(c, false, info->ifindex, &addresses);
+                if (r < 0)
+                        return r;
+
+                r = addresses_to_strv(c, true, info->ifindex, &gateways);
+                if (r < 0)
+                        return r;
+
+                return json_build(ret_json, JSON_BUILD_OBJECT(
+                                        JSON_BUILD_PAIR("index", JSON_BUILD_INTEGER(info->ifindex)),
+                                        JSON_BUILD_PAIR("name", JSON_BUILD_STRING(info->name)),
+                                        JSON_BUILD_PAIR_CONDITION(link, "link_file", JSON_BUILD_STRING(link)),
+                                        JSON_BUILD_PAIR_CONDITION(network, "network_file", JSON_BUILD_STRING(network)),
+                                        JSON_BUILD_PAIR_CONDITION(t, "type", JSON_BUILD_STRING(t)),
+                                        JSON_BUILD_PAIR_CONDITION(operational_state, "operational_state", JSON_BUILD_STRING(operational_state)),
+                                        JSON_BUILD_PAIR_CONDITION(setup_state, "setup_state", JSON_BUILD_STRING(setup_state)),
+                                        JSON_BUILD_PAIR_CONDITION(path, "path", JSON_BUILD_STRING(path)),
+                                        JSON_BUILD_PAIR_CONDITION(driver, "driver", JSON_BUILD_STRING(driver)),
+                                        JSON_BUILD_PAIR_CONDITION(vendor, "vendor", JSON_BUILD_STRING(vendor)),
+                                        JSON_BUILD_PAIR_CONDITION(model, "model", JSON_BUILD_STRING(model)),
+                                        JSON_BUILD_PAIR_CONDITION(info->has_mac_address, "hw_address",
+                                                                  JSON_BUILD_STRING(ether_addr_to_string(&info->mac_address, ea))),
+                                        JSON_BUILD_PAIR_CONDITION(info->has_mtu, "mtu", JSON_BUILD_UNSIGNED(info->mtu)),
+                                        JSON_BUILD_PAIR("addresses", JSON_BUILD_STRV(addresses)),
+                                        JSON_BUILD_PAIR("gateways", JSON_BUILD_STRV(gateways)),
+                                        JSON_BUILD_PAIR("dns", JSON_BUILD_STRV(dns)),
+                                        JSON_BUILD_PAIR("search_domains", JSON_BUILD_STRV(search_domains)),
+                                        JSON_BUILD_PAIR("route_domains", JSON_BUILD_STRV(route_domains)),
+                                        JSON_BUILD_PAIR("ntp", JSON_BUILD_STRV(ntp)),
+                                        JSON_BUILD_PAIR_CONDITION(tz, "timezone", JSON_BUILD_STRING(tz))));
+        }
+
         (void) sd_network_link_get_carrier_bound_to(info->ifindex, &carrier_bound_to);
         (void) sd_network_link_get_carrier_bound_by(info->ifindex, &carrier_bound_by);
 
@@ -806,7 +973,7 @@ static int link_status_one(
                 _cleanup_free_ char *description = NULL;
                 char ea[ETHER_ADDR_TO_STRING_MAX];
 
-                (void) ieee_oui(hwdb, &info->mac_address, &description);
+                (void) ieee_oui(c->hwdb, &info->mac_address, &description);
 
                 if (description)
                         printf("      HW Address: %s (%s)\n", ether_addr_to_string(&info->mac_address, ea), description);
@@ -817,8 +984,8 @@ static int link_status_one(
         if (info->has_mtu)
                 printf("             MTU: %" PRIu32 "\n", info->mtu);
 
-        (void) dump_addresses(rtnl, "         Address: ", info->ifindex);
-        (void) dump_gateways(rtnl, hwdb, "         Gateway: ", info->ifindex);
+        (void) dump_addresses(c, "         Address: ", info->ifindex);
+        (void) dump_gateways(c, "         Gateway: ", info->ifindex);
 
         dump_list("             DNS: ", dns);
         dump_list("  Search Domains: ", search_domains);
@@ -829,7 +996,6 @@ static int link_status_one(
         dump_ifindexes("Carrier Bound To: ", carrier_bound_to);
         dump_ifindexes("Carrier Bound By: ", carrier_bound_by);
 
-        (void) sd_network_link_get_timezone(info->ifindex, &tz);
         if (tz)
                 printf("       Time Zone: %s\n", tz);
 
@@ -838,33 +1004,53 @@ static int link_status_one(
         return 0;
 }
 
-static int system_status(sd_netlink *rtnl, sd_hwdb *hwdb) {
+static int system_status(StatusContext *c, JsonVariant **ret_json) {
         _cleanup_free_ char *operational_state = NULL;
         _cleanup_strv_free_ char **dns = NULL, **ntp = NULL, **search_domains = NULL, **route_domains = NULL;
         const char *on_color_operational, *off_color_operational;
+        int r;
 
-        assert(rtnl);
+        assert(c);
 
         (void) sd_network_get_operational_state(&operational_state);
+        (void) sd_network_get_dns(&dns);
+        (void) sd_network_get_search_domains(&search_domains);
+        (void) sd_network_get_route_domains(&route_domains);
+        (void) sd_network_get_ntp(&ntp);
+
+        if (ret_json) {
+                _cleanup_strv_free_ char **addresses = NULL, **gateways = NULL;
+
+                r = addresses_to_strv(c, false, 0, &addresses);
+                if (r < 0)
+                        return r;
+
+                r = addresses_to_strv(c, true, 0, &gateways);
+                if (r < 0)
+                        return r;
+
+                return json_build(ret_json, JSON_BUILD_OBJECT(
+                                        JSON_BUILD_PAIR_CONDITION(operational_state, "operational_state", JSON_BUILD_STRING(operational_state)),
+                                        JSON_BUILD_PAIR("addresses", JSON_BUILD_STRV(addresses)),
+                                        JSON_BUILD_PAIR("gateways", JSON_BUILD_STRV(gateways)),
+                                        JSON_BUILD_PAIR("dns", JSON_BUILD_STRV(dns)),
+                                        JSON_BUILD_PAIR("search_domains", JSON_BUILD_STRV(search_domains)),
+                                        JSON_BUILD_PAIR("route_domains", JSON_BUILD_STRV(route_domains)),
+                                        JSON_BUILD_PAIR("ntp", JSON_BUILD_STRV(ntp))));
+        }
+
         operational_state_to_color(operational_state, &on_color_operational, &off_color_operational);
 
         printf("%s%s%s        State: %s%s%s\n",
                on_color_operational, special_glyph(BLACK_CIRCLE), off_color_operational,
                on_color_operational, strna(operational_state), off_color_operational);
 
-        (void) dump_addresses(rtnl, "       Address: ", 0);
-        (void) dump_gateways(rtnl, hwdb, "       Gateway: ", 0);
+        (void) dump_addresses(c, "       Address: ", 0);
+        (void) dump_gateways(c, "       Gateway: ", 0);
 
-        (void) sd_network_get_dns(&dns);
         dump_list("           DNS: ", dns);
-
-        (void) sd_network_get_search_domains(&search_domains);
         dump_list("Search Domains: ", search_domains);
-
-        (void) sd_network_get_route_domains(&route_domains);
         dump_list(" Route Domains: ", route_domains);
-
-        (void) sd_network_get_ntp(&ntp);
         dump_list("           NTP: ", ntp);
 
         return 0;
@@ -873,10 +1059,14 @@ static int system_status(sd_netlink *rtnl, sd_hwdb *hwdb) {
 static int link_status(int argc, char *argv[], void *userdata) {
         _cleanup_(sd_netlink_unrefp) sd_netlink *rtnl = NULL;
         _cleanup_(sd_hwdb_unrefp) sd_hwdb *hwdb = NULL;
+        _cleanup_(status_context_done) StatusContext context = {};
+        _cleanup_(json_variant_unrefp) JsonVariant *v = NULL;
+        _cleanup_free_ JsonVariant **elements = NULL;
         _cleanup_free_ LinkInfo *links = NULL;
-        int r, c, i;
+        int r, c, i, n_elements = 0;
 
-        (void) pager_open(arg_pager_flags);
+        if (arg_json == JSON_OFF)
+                (void) pager_open(arg_pager_flags);
 
         r = sd_netlink_open(&rtnl);
         if (r < 0)
@@ -886,20 +1076,59 @@ static int link_status(int argc, char *argv[], void *userdata) {
         if (r < 0)
                 log_debug_errno(r, "Failed to open hardware database: %m");
 
+        r = status_context_init(&context, rtnl, hwdb);
+        if (r < 0)
+                return r;
+
+        if (!arg_all && argc <= 1) {
+                r = system_status(&context, arg_json != JSON_OFF ? &v : NULL);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to show system status: %m");
+
+                if (v)
+                        json_variant_dump(v, json_format_flags(), NULL, NULL);
+
+                return 0;
+        }
+
         if (arg_all)
                 c = acquire_link_info_all(rtnl, &links);
-        else if (argc <= 1)
-                return system_status(rtnl, hwdb);
         else
                 c = acquire_link_info_strv(rtnl, argv + 1, &links);
         if (c < 0)
                 return c;
 
+        if (arg_json != JSON_OFF) {
+                elements = new0(JsonVariant*, c);
+                if (!elements)
+                        return log_oom();
+        }
+
         for (i = 0; i < c; i++) {
+                if (elements) {
+                        r = link_status_one(&context, links + i, elements + n_elements);
+                        if (r < 0) {
+                                json_variant_unref_many(elements, n_elements);
+                                return log_error_errno(r, "Failed to build JSON for link %s: %m", links[i].name);
+                        }
+
+                        n_elements++;
+                        continue;
+                }
+
                 if (i > 0)
                         fputc('\n', stdout);
 
-                link_status_one(rtnl, hwdb, links + i);
+                link_status_one(&context, links + i, NULL);
+        }
+
+        if (elements) {
+                r = json_variant_new_array(&v, elements, n_elements);
+                json_variant_unref_many(elements, n_elements);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to build JSON array: %m");
+
+                json_variant_dump(v, json_format_flags(), NULL, NULL);
         }
 
         return 0;
@@ -1076,7 +1305,8 @@ static int help(void) {
                "     --version          Show package version\n"
                "     --no-pager         Do not pipe output into a pager\n"
                "     --no-legend        Do not show the headers and footers\n"
-               "  -a --all              Show status for all links\n\n"
+               "  -a --all              Show status for all links\n"
+               "     --json=MODE        Output as JSON (short or pretty)\n\n"
                "Commands:\n"
                "  list [LINK...]        List links\n"
                "  status [LINK...]      Show link status\n"
@@ -1096,6 +1326,7 @@ static int parse_argv(int argc, char *argv[]) {
                 ARG_VERSION = 0x100,
                 ARG_NO_PAGER,
                 ARG_NO_LEGEND,
+                ARG_JSON,
         };
 
         static const struct option options[] = {
@@ -1104,6 +1335,7 @@ static int parse_argv(int argc, char *argv[]) {
                 { "no-pager",  no_argument,       NULL, ARG_NO_PAGER  },
                 { "no-legend", no_argument,       NULL, ARG_NO_LEGEND },
                 { "all",       no_argument,       NULL, 'a'           },
+                { "json",      required_argument, NULL, ARG_JSON      },
                 {}
         };
 
@@ -1134,6 +1366,22 @@ static int parse_argv(int argc, char *argv[]) {
                         arg_all = true;
                         break;
 
+                case ARG_JSON:
+                        if (streq(optarg, "short"))
+                                arg_json = JSON_SHORT;
+                        else if (streq(optarg, "pretty"))
+                                arg_json = JSON_PRETTY;
+                        else if (streq(optarg, "help")) {
+                                fputs("short\n"
+                                      "pretty\n", stdout);
+                                return 0;
+                        } else
+                                return log_error_errno(SYNTHETIC_ERRNO(EINVAL),
+                                                       "Unknown JSON output mode: %s",
+                                                       optarg);
+
+                        break;
+
                 case '?':
                         return -EINVAL;
 
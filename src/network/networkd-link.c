@@ -22,6 +22,7 @@
 #include "networkd-radv.h"
 #include "networkd-routing-policy-rule.h"
 #include "set.h"
+#include "siphash24.h"
 #include "socket-util.h"
 #include "stdio-util.h"
 #include "string-table.h"
@@ -30,6 +31,10 @@
 #include "util.h"
 #include "virt.h"
 
+/* Static addresses and routes are configured in windows of this many requests in flight at a time, so that
+ * networks with thousands of them do not overrun the rtnl socket with requests, acks and notifications. */
+#define LINK_MESSAGES_IN_FLIGHT_MAX 128U
+
 DUID* link_get_duid(Link *link) {
         if (link->network->duid.type != _DUID_TYPE_INVALID)
                 return &link->network->duid;
@@ -576,6 +581,7 @@ static Link *link_free(Link *link) {
 
         (void) unlink(link->state_file);
         free(link->state_file);
+        free(link->state_file_contents);
 
         sd_device_unref(link->sd_device);
 
@@ -815,6 +821,46 @@ static int link_set_routing_policy_rule(Link *link) {
         return 0;
 }
 
+static int route_handler(sd_netlink *rtnl, sd_netlink_message *m, Link *link);
+
+static int link_set_static_routes(Link *link) {
+        Route *rt;
+        int r;
+
+        assert(link);
+        assert(link->network);
+
+        /* Fills up the window of route requests. First all routes that enable us to talk to gateways are added, then
+         * the others that need a gateway. */
+        while (link->route_messages < LINK_MESSAGES_IN_FLIGHT_MAX) {
+                rt = link->static_route_next;
+                if (!rt) {
+                        if (link->static_routes_gateway_phase)
+                                break;
+
+                        link->static_routes_gateway_phase = true;
+                        link->static_route_next = link->network->static_routes;
+                        continue;
+                }
+
+                link->static_route_next = rt->routes_next;
+
+                if (in_addr_is_null(rt->family, &rt->gw) != !link->static_routes_gateway_phase)
+                        continue;
+
+                r = route_configure(rt, link, route_handler);
+                if (r < 0) {
+                        log_link_warning_errno(link, r, "Could not set routes: %m");
+                        link_enter_failed(link);
+                        return r;
+                }
+
+                link->route_messages++;
+        }
+
+        return 0;
+}
+
 static int route_handler(sd_netlink *rtnl, sd_netlink_message *m, Link *link) {
         int r;
 
@@ -833,6 +879,9 @@ static int route_handler(sd_netlink *rtnl, sd_netlink_message *m, Link *link) {
         if (r < 0 && r != -EEXIST)
                 log_link_warning_errno(link, r, "Could not set route: %m");
 
+        if (link_set_static_routes(link) < 0)
+                return 1;
+
         if (link->route_messages == 0) {
                 log_link_debug(link, "Routes set");
                 link->static_routes_configured = true;
@@ -843,12 +892,6 @@ static int route_handler(sd_netlink *rtnl, sd_netlink_message *m, Link *link) {
 }
 
 static int link_enter_set_routes(Link *link) {
-        enum {
-                PHASE_NON_GATEWAY, /* First phase: Routes without a gateway */
-                PHASE_GATEWAY,     /* Second phase: Routes with a gateway */
-                _PHASE_MAX
-        } phase;
-        Route *rt;
         int r;
 
         assert(link);
@@ -859,22 +902,12 @@ static int link_enter_set_routes(Link *link) {
 
         link_set_state(link, LINK_STATE_SETTING_ROUTES);
 
-        /* First add the routes that enable us to talk to gateways, then add in the others that need a gateway. */
-        for (phase = 0; phase < _PHASE_MAX; phase++)
-                LIST_FOREACH(routes, rt, link->network->static_routes) {
-
-                        if (in_addr_is_null(rt->family, &rt->gw) != (phase == PHASE_NON_GATEWAY))
-                                continue;
-
-                        r = route_configure(rt, link, route_handler);
-                        if (r < 0) {
-                                log_link_warning_errno(link, r, "Could not set routes: %m");
-                                link_enter_failed(link);
-                                return r;
-                        }
+        link->static_route_next = link->network->static_routes;
+        link->static_routes_gateway_phase = false;
 
-                        link->route_messages++;
-                }
+        r = link_set_static_routes(link);
+        if (r < 0)
+                return r;
 
         if (link->route_messages == 0) {
                 link->static_routes_configured = true;
@@ -885,6 +918,32 @@ static int link_enter_set_routes(Link *link) {
         return 0;
 }
 
+static int address_handler(sd_netlink *rtnl, sd_netlink_message *m, Link *link);
+
+static int link_set_static_addresses(Link *link) {
+        Address *ad;
+        int r;
+
+        assert(link);
+
+        /* Fills up the window of address requests */
+        while (link->address_messages < LINK_MESSAGES_IN_FLIGHT_MAX && link->static_address_next) {
+                ad = link->static_address_next;
+                link->static_address_next = ad->addresses_next;
+
+                r = address_configure(ad, link, address_handler, false);
+                if (r < 0) {
+                        log_link_warning_errno(link, r, "Could not set addresses: %m");
+                        link_enter_failed(link);
+                        return r;
+                }
+
+                link->address_messages++;
+        }
+
+        return 0;
+}
+
 static int address_handler(sd_netlink *rtnl, sd_netlink_message *m, Link *link) {
         int r;
 
@@ -907,6 +966,9 @@ static int address_handler(sd_netlink *rtnl, sd_netlink_message *m, Link *link)
         else if (r >= 0)
                 manager_rtnl_process_address(rtnl, m, link->manager);
 
+        if (link_set_static_addresses(link) < 0)
+                return 1;
+
         if (link->address_messages == 0) {
                 log_link_debug(link, "Addresses set");
                 link_enter_set_routes(link);
@@ -1028,7 +1090,6 @@ static int link_set_bridge_fdb(Link *link) {
 
 static int link_enter_set_addresses(Link *link) {
         AddressLabel *label;
-        Address *ad;
         int r;
 
         assert(link);
@@ -1041,16 +1102,11 @@ static int link_enter_set_addresses(Link *link) {
 
         link_set_state(link, LINK_STATE_SETTING_ADDRESSES);
 
-        LIST_FOREACH(addresses, ad, link->network->static_addresses) {
-                r = address_configure(ad, link, address_handler, false);
-                if (r < 0) {
-                        log_link_warning_errno(link, r, "Could not set addresses: %m");
-                        link_enter_failed(link);
-                        return r;
-                }
+        link->static_address_next = link->network->static_addresses;
 
-                link->address_messages++;
-        }
+        r = link_set_static_addresses(link);
+        if (r < 0)
+                return r;
 
         LIST_FOREACH(labels, label, link->network->address_labels) {
                 r = address_label_configure(label, link, NULL, false);
@@ -1168,6 +1224,18 @@ static int link_enter_set_addresses(Link *link) {
                         }
                 }
 
+                if (link->network->dhcp_server_persist_leases) {
+                        _cleanup_free_ char *lease_file = NULL;
+
+                        lease_file = strjoin("/var/lib/systemd/network/dhcp-server-", link->ifname, ".leases");
+                        if (!lease_file)
+                                return log_oom();
+
+                        r = sd_dhcp_server_set_lease_file(link->dhcp_server, lease_file);
+                        if (r < 0)
+                                log_link_warning_errno(link, r, "Failed to set lease file for DHCP server, ignoring: %m");
+                }
+
                 r = sd_dhcp_server_start(link->dhcp_server);
                 if (r < 0) {
                         log_link_warning_errno(link, r, "Could not start DHCPv4 server instance: %m");
@@ -1502,17 +1570,27 @@ static int link_bond_set(Link *link) {
         return r;
 }
 
+static void link_lldp_unlink(Link *link) {
+        assert(link);
+
+        (void) unlink(link->lldp_file);
+        link->lldp_file_saved = false;
+}
+
 static int link_lldp_save(Link *link) {
         _cleanup_free_ char *temp_path = NULL;
         _cleanup_fclose_ FILE *f = NULL;
         sd_lldp_neighbor **l = NULL;
+        struct siphash state;
+        uint64_t hash;
         int n = 0, r, i;
 
         assert(link);
         assert(link->lldp_file);
+        assert(link->manager);
 
         if (!link->lldp) {
-                (void) unlink(link->lldp_file);
+                link_lldp_unlink(link);
                 return 0;
         }
 
@@ -1520,16 +1598,36 @@ static int link_lldp_save(Link *link) {
         if (r < 0)
                 goto finish;
         if (r == 0) {
-                (void) unlink(link->lldp_file);
+                link_lldp_unlink(link);
                 goto finish;
         }
 
         n = r;
 
+        /* The link is saved whenever anything about it changes, and neighbors keep sending the same data again,
+         * hence only write the file out when the neighbors changed since it was written the last time. */
+        siphash24_init(&state, link->manager->lldp_hash_key);
+        for (i = 0; i < n; i++) {
+                const void *p;
+                size_t sz;
+
+                r = sd_lldp_neighbor_get_raw(l[i], &p, &sz);
+                if (r < 0)
+                        goto finish;
+
+                siphash24_compress(&sz, sizeof(sz), &state);
+                siphash24_compress(p, sz, &state);
+        }
+        hash = siphash24_finalize(&state);
+
+        if (link->lldp_file_saved && link->lldp_file_hash == hash)
+                goto finish;
+
         r = fopen_temporary(link->lldp_file, &f, &temp_path);
         if (r < 0)
                 goto finish;
 
+        (void) __fsetlocking(f, FSETLOCKING_BYCALLER);
         fchmod(fileno(f), 0644);
 
         for (i = 0; i < n; i++) {
@@ -1555,12 +1653,17 @@ static int link_lldp_save(Link *link) {
                 goto finish;
         }
 
+        link->lldp_file_hash = hash;
+        link->lldp_file_saved = true;
+
 finish:
         if (r < 0) {
                 (void) unlink(link->lldp_file);
                 if (temp_path)
                         (void) unlink(temp_path);
 
+                link->lldp_file_saved = false;
+
                 log_link_error_errno(link, r, "Failed to save LLDP data to %s: %m", link->lldp_file);
         }
 
@@ -1579,7 +1682,11 @@ static void lldp_handler(sd_lldp *lldp, sd_lldp_event event, sd_lldp_neighbor *n
 
         assert(link);
 
-        (void) link_lldp_save(link);
+        /* A refresh only restarts the TTL of a neighbor, which is not part of what is saved. Everything else is
+         * written out together with the rest of the link state, so that a burst of changes results in one
+         * write only. */
+        if (event != SD_LLDP_EVENT_REFRESHED)
+                link_dirty(link);
 
         if (link_lldp_emit_enabled(link) && event == SD_LLDP_EVENT_ADDED) {
                 /* If we received information about a new neighbor, restart the LLDP "fast" logic */
@@ -2211,6 +2318,7 @@ void link_drop(Link *link) {
         log_link_debug(link, "Link removed");
 
         (void) unlink(link->state_file);
+        link->state_file_contents = mfree(link->state_file_contents);
 
         link_detach_from_manager(link);
 
@@ -3671,9 +3779,10 @@ static void print_link_hashmap(FILE *f, const char *prefix, Hashmap* h) {
 }
 
 int link_save(Link *link) {
-        _cleanup_free_ char *temp_path = NULL;
+        _cleanup_free_ char *contents = NULL;
         _cleanup_fclose_ FILE *f = NULL;
         const char *admin_state, *oper_state;
+        size_t size;
         Address *a;
         Route *route;
         Iterator i;
@@ -3686,6 +3795,7 @@ int link_save(Link *link) {
 
         if (link->state == LINK_STATE_LINGER) {
                 unlink(link->state_file);
+                link->state_file_contents = mfree(link->state_file_contents);
                 return 0;
         }
 
@@ -3697,12 +3807,13 @@ int link_save(Link *link) {
         oper_state = link_operstate_to_string(link->operstate);
         assert(oper_state);
 
-        r = fopen_temporary(link->state_file, &f, &temp_path);
-        if (r < 0)
+        f = open_memstream(&contents, &size);
+        if (!f) {
+                r = -ENOMEM;
                 goto fail;
+        }
 
         (void) __fsetlocking(f, FSETLOCKING_BYCALLER);
-        (void) fchmod(fileno(f), 0644);
 
         fprintf(f,
                 "# This is private data. Do not parse.\n"
@@ -3976,17 +4087,17 @@ int link_save(Link *link) {
         if (r < 0)
                 goto fail;
 
-        if (rename(temp_path, link->state_file) < 0) {
-                r = -errno;
+        f = safe_fclose(f);
+
+        r = network_save_state_file(link->state_file, TAKE_PTR(contents), &link->state_file_contents);
+        if (r < 0)
                 goto fail;
-        }
 
         return 0;
 
 fail:
         (void) unlink(link->state_file);
-        if (temp_path)
-                (void) unlink(temp_path);
+        link->state_file_contents = mfree(link->state_file_contents);
 
         return log_link_error_errno(link, r, "Failed to save link data to %s: %m", link->state_file);
 }
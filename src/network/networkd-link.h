@@ -44,6 +44,7 @@ typedef enum LinkOperationalState {
 typedef struct Manager Manager;
 typedef struct Network Network;
 typedef struct Address Address;
+typedef struct Route Route;
 typedef struct DUID DUID;
 
 typedef struct Link {
@@ -57,6 +58,7 @@ typedef struct Link {
         char *kind;
         unsigned short iftype;
         char *state_file;
+        char *state_file_contents; /* what was written to state_file the last time */
         struct ether_addr mac;
         struct in6_addr ipv6ll_address;
         uint32_t mtu;
@@ -73,6 +75,9 @@ typedef struct Link {
         unsigned address_messages;
         unsigned address_label_messages;
         unsigned route_messages;
+        Address *static_address_next;
+        Route *static_route_next;
+        bool static_routes_gateway_phase;
         unsigned routing_policy_rule_messages;
         unsigned routing_policy_rule_remove_messages;
         unsigned enslaving;
@@ -117,6 +122,8 @@ typedef struct Link {
         /* This is about LLDP reception */
         sd_lldp *lldp;
         char *lldp_file;
+        uint64_t lldp_file_hash; /* hash of the neighbors written to lldp_file, if lldp_file_saved is set */
+        bool lldp_file_saved;
 
         /* This is about LLDP transmission */
         unsigned lldp_tx_fast; /* The LLDP txFast counter (See 802.1ab-2009, section 9.2.5.18) */
@@ -14,6 +14,7 @@
 #include "def.h"
 #include "device-util.h"
 #include "dns-domain.h"
+#include "event-util.h"
 #include "fd-util.h"
 #include "fileio.h"
 #include "local-addresses.h"
@@ -21,6 +22,7 @@
 #include "networkd-manager.h"
 #include "ordered-set.h"
 #include "path-util.h"
+#include "random-util.h"
 #include "set.h"
 #include "strv.h"
 #include "tmpfile-util.h"
@@ -29,6 +31,10 @@
 /* use 8 MB for receive socket kernel queue. */
 #define RCVBUF_SIZE    (8*1024*1024)
 
+/* write out the state files at most 10 times per 100ms */
+#define STATE_SAVE_INTERVAL_USEC (100 * USEC_PER_MSEC)
+#define STATE_SAVE_BURST 10
+
 const char* const network_dirs[] = {
         "/etc/systemd/network",
         "/run/systemd/network",
@@ -425,6 +431,11 @@ int manager_rtnl_process_route(sd_netlink *rtnl, sd_netlink_message *message, vo
         switch (type) {
         case RTM_NEWROUTE:
                 if (!route) {
+                        /* On routers with full routing tables mirroring them all costs a lot of memory and
+                         * time, hence optionally only track the routes we configured ourselves. */
+                        if (!m->manage_foreign_routes)
+                                return 0;
+
                         /* A route appeared that we did not request */
                         r = route_add_foreign(link, family, &dst, dst_prefixlen, tos, priority, table, &route);
                         if (r < 0) {
@@ -1060,8 +1071,9 @@ static int manager_save(Manager *m) {
         _cleanup_ordered_set_free_free_ OrderedSet *dns = NULL, *ntp = NULL, *search_domains = NULL, *route_domains = NULL;
         Link *link;
         Iterator i;
-        _cleanup_free_ char *temp_path = NULL;
+        _cleanup_free_ char *contents = NULL;
         _cleanup_fclose_ FILE *f = NULL;
+        size_t size;
         LinkOperationalState operstate = LINK_OPERSTATE_OFF;
         const char *operstate_str;
         int r;
@@ -1167,12 +1179,11 @@ static int manager_save(Manager *m) {
         operstate_str = link_operstate_to_string(operstate);
         assert(operstate_str);
 
-        r = fopen_temporary(m->state_file, &f, &temp_path);
-        if (r < 0)
-                return r;
+        f = open_memstream(&contents, &size);
+        if (!f)
+                return -ENOMEM;
 
         (void) __fsetlocking(f, FSETLOCKING_BYCALLER);
-        (void) fchmod(fileno(f), 0644);
 
         fprintf(f,
                 "# This is private data. Do not parse.\n"
@@ -1191,10 +1202,11 @@ static int manager_save(Manager *m) {
         if (r < 0)
                 goto fail;
 
-        if (rename(temp_path, m->state_file) < 0) {
-                r = -errno;
+        f = safe_fclose(f);
+
+        r = network_save_state_file(m->state_file, TAKE_PTR(contents), &m->state_file_contents);
+        if (r < 0)
                 goto fail;
-        }
 
         if (m->operational_state != operstate) {
                 m->operational_state = operstate;
@@ -1209,18 +1221,40 @@ static int manager_save(Manager *m) {
 
 fail:
         (void) unlink(m->state_file);
-        (void) unlink(temp_path);
+        m->state_file_contents = mfree(m->state_file_contents);
 
         return log_error_errno(r, "Failed to save network state to %s: %m", m->state_file);
 }
 
+static int manager_save_timer_handler(sd_event_source *s, uint64_t usec, void *userdata) {
+        /* Nothing to do here, the dirty handler runs after this as after any other event */
+        return 0;
+}
+
 static int manager_dirty_handler(sd_event_source *s, void *userdata) {
         Manager *m = userdata;
         Link *link;
         Iterator i;
+        int r;
 
         assert(m);
 
+        if (!m->dirty && set_isempty(m->dirty_links))
+                return 1;
+
+        /* All changes made while processing the events of one iteration of the event loop are written out at once.
+         * When the state is changing continuously, the files are not written more often than the rate limit allows,
+         * the changes accumulate until the end of the interval instead. */
+        if (!ratelimit_below(&m->save_ratelimit)) {
+                r = event_reset_time(m->event, &m->save_timer, CLOCK_MONOTONIC,
+                                     usec_add(m->save_ratelimit.begin, m->save_ratelimit.interval) + 1, 0,
+                                     manager_save_timer_handler, m, 0, "manager-save-timer", false);
+                if (r >= 0)
+                        return 1;
+
+                log_warning_errno(r, "Failed to delay saving state, saving it right away: %m");
+        }
+
         if (m->dirty)
                 manager_save(m);
 
@@ -1360,6 +1394,9 @@ int manager_new(Manager **ret) {
         if (!m->state_file)
                 return -ENOMEM;
 
+        RATELIMIT_INIT(m->save_ratelimit, STATE_SAVE_INTERVAL_USEC, STATE_SAVE_BURST);
+        random_bytes(m->lldp_hash_key, sizeof(m->lldp_hash_key));
+
         r = sd_event_default(&m->event);
         if (r < 0)
                 return r;
@@ -1399,6 +1436,7 @@ int manager_new(Manager **ret) {
                 return r;
 
         m->duid.type = DUID_TYPE_EN;
+        m->manage_foreign_routes = true;
 
         (void) routing_policy_load_rules(m->state_file, &m->rules_saved);
 
@@ -1416,11 +1454,15 @@ void manager_free(Manager *m) {
                 return;
 
         free(m->state_file);
+        free(m->state_file_contents);
+        sd_event_source_unref(m->save_timer);
 
         sd_netlink_unref(m->rtnl);
         sd_netlink_unref(m->genl);
         sd_resolve_unref(m->resolve);
 
+        network_index_free(m);
+
         while ((network = m->networks))
                 network_free(network);
 
@@ -13,6 +13,7 @@
 #include "dhcp-identifier.h"
 #include "hashmap.h"
 #include "list.h"
+#include "ratelimit.h"
 
 #include "networkd-address-pool.h"
 #include "networkd-link.h"
@@ -31,15 +32,31 @@ struct Manager {
 
         bool enumerating:1;
         bool dirty:1;
+        bool manage_foreign_routes;
 
         Set *dirty_links;
 
         char *state_file;
+        char *state_file_contents;
         LinkOperationalState operational_state;
 
+        /* limits how often the state files are written out while links keep changing */
+        RateLimit save_ratelimit;
+        sd_event_source *save_timer;
+
+        /* key for the hashes of the LLDP neighbors which were saved, which come from the network */
+        uint8_t lldp_hash_key[16];
+
         Hashmap *links;
         Hashmap *netdevs;
         Hashmap *networks_by_name;
+        /* Index of the networks by the literal values of their MACAddress=, Name= or Driver= matches. Networks
+         * without such a match are in networks_unindexed, and have to be tested against every link. */
+        Hashmap *networks_by_match_mac;
+        Hashmap *networks_by_match_name;
+        Hashmap *networks_by_match_driver;
+        NetworkList networks_unindexed;
+        bool networks_indexed;
         Hashmap *dhcp6_prefixes;
         LIST_HEAD(Network, networks);
         LIST_HEAD(AddressPool, address_pools);
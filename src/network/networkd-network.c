@@ -7,6 +7,7 @@
 #include "conf-files.h"
 #include "conf-parser.h"
 #include "dns-domain.h"
+#include "ether-addr-util.h"
 #include "fd-util.h"
 #include "hostname-util.h"
 #include "in-addr-util.h"
@@ -270,6 +271,151 @@ int network_load_one(Manager *manager, const char *filename) {
         return 0;
 }
 
+static NetworkList *network_list_free(NetworkList *l) {
+        if (!l)
+                return NULL;
+
+        free(l->networks);
+        return mfree(l);
+}
+
+static int network_list_add(NetworkList *l, Network *network) {
+        assert(l);
+        assert(network);
+
+        /* Networks are added in order, hence a network listed twice, e.g. by "Name=eth0 eth0", is always the last
+         * one */
+        if (l->n_networks > 0 && l->networks[l->n_networks - 1] == network)
+                return 0;
+
+        if (!GREEDY_REALLOC(l->networks, l->n_allocated, l->n_networks + 1))
+                return -ENOMEM;
+
+        l->networks[l->n_networks++] = network;
+        return 0;
+}
+
+static int network_index_add(Hashmap **h, const struct hash_ops *hash_ops, const void *key, Network *network) {
+        _cleanup_free_ NetworkList *new_list = NULL;
+        NetworkList *l;
+        int r;
+
+        assert(h);
+        assert(key);
+        assert(network);
+
+        l = hashmap_get(*h, key);
+        if (!l) {
+                r = hashmap_ensure_allocated(h, hash_ops);
+                if (r < 0)
+                        return r;
+
+                new_list = new0(NetworkList, 1);
+                if (!new_list)
+                        return -ENOMEM;
+
+                r = hashmap_put(*h, key, new_list);
+                if (r < 0)
+                        return r;
+
+                l = TAKE_PTR(new_list);
+        }
+
+        return network_list_add(l, network);
+}
+
+static bool match_strv_is_literal(char **l) {
+        char **s;
+
+        /* Returns true if the patterns only match the strings they consist of, i.e. neither contain glob
+         * characters, nor are negated */
+
+        if (strv_isempty(l) || l[0][0] == '!')
+                return false;
+
+        STRV_FOREACH(s, l)
+                if (strpbrk(*s, GLOB_CHARS "\\"))
+                        return false;
+
+        return true;
+}
+
+static int network_index_one(Manager *manager, Network *network) {
+        struct ether_addr *mac;
+        Iterator i;
+        char **s;
+        int r;
+
+        /* Each of these matches must be satisfied for the network to apply, hence it is enough to index the network
+         * by one of them */
+
+        if (!set_isempty(network->match_mac)) {
+                SET_FOREACH(mac, network->match_mac, i) {
+                        r = network_index_add(&manager->networks_by_match_mac, &ether_addr_hash_ops, mac, network);
+                        if (r < 0)
+                                return r;
+                }
+
+                return 0;
+        }
+
+        if (match_strv_is_literal(network->match_name)) {
+                STRV_FOREACH(s, network->match_name) {
+                        r = network_index_add(&manager->networks_by_match_name, &string_hash_ops, *s, network);
+                        if (r < 0)
+                                return r;
+                }
+
+                return 0;
+        }
+
+        if (match_strv_is_literal(network->match_driver)) {
+                STRV_FOREACH(s, network->match_driver) {
+                        r = network_index_add(&manager->networks_by_match_driver, &string_hash_ops, *s, network);
+                        if (r < 0)
+                                return r;
+                }
+
+                return 0;
+        }
+
+        return network_list_add(&manager->networks_unindexed, network);
+}
+
+void network_index_free(Manager *manager) {
+        assert(manager);
+
+        manager->networks_by_match_mac = hashmap_free_with_destructor(manager->networks_by_match_mac, network_list_free);
+        manager->networks_by_match_name = hashmap_free_with_destructor(manager->networks_by_match_name, network_list_free);
+        manager->networks_by_match_driver = hashmap_free_with_destructor(manager->networks_by_match_driver, network_list_free);
+
+        manager->networks_unindexed.networks = mfree(manager->networks_unindexed.networks);
+        manager->networks_unindexed.n_networks = manager->networks_unindexed.n_allocated = 0;
+
+        manager->networks_indexed = false;
+}
+
+static int network_index(Manager *manager) {
+        Network *network;
+        unsigned n = 0;
+        int r;
+
+        assert(manager);
+
+        LIST_FOREACH(networks, network, manager->networks) {
+                network->match_position = n++;
+
+                r = network_index_one(manager, network);
+                if (r < 0) {
+                        network_index_free(manager);
+                        return r;
+                }
+        }
+
+        manager->networks_indexed = true;
+        return 0;
+}
+
 int network_load(Manager *manager) {
         Network *network;
         _cleanup_strv_free_ char **files = NULL;
@@ -278,6 +424,8 @@ int network_load(Manager *manager) {
 
         assert(manager);
 
+        network_index_free(manager);
+
         while ((network = manager->networks))
                 network_free(network);
 
@@ -291,6 +439,11 @@ int network_load(Manager *manager) {
                         return r;
         }
 
+        /* Without the index all networks are simply tested one after the other, hence this is not fatal */
+        r = network_index(manager);
+        if (r < 0)
+                log_warning_errno(r, "Failed to index networks, ignoring: %m");
+
         return 0;
 }
 
@@ -408,6 +561,38 @@ int network_get_by_name(Manager *manager, const char *name, Network **ret) {
         return 0;
 }
 
+static bool network_match(Network *network, sd_device *device,
+                          const struct ether_addr *address, const char *path,
+                          const char *parent_driver, const char *driver,
+                          const char *devtype, const char *ifname) {
+
+        if (!net_match_config(network->match_mac, network->match_path,
+                              network->match_driver, network->match_type,
+                              network->match_name, network->match_host,
+                              network->match_virt, network->match_kernel_cmdline,
+                              network->match_kernel_version, network->match_arch,
+                              address, path, parent_driver, driver,
+                              devtype, ifname))
+                return false;
+
+        if (network->match_name && device) {
+                const char *attr;
+                uint8_t name_assign_type = NET_NAME_UNKNOWN;
+
+                if (sd_device_get_sysattr_value(device, "name_assign_type", &attr) >= 0)
+                        (void) safe_atou8(attr, &name_assign_type);
+
+                if (name_assign_type == NET_NAME_ENUM)
+                        log_warning("%s: found matching network '%s', based on potentially unpredictable ifname",
+                                    ifname, network->filename);
+                else
+                        log_debug("%s: found matching network '%s'", ifname, network->filename);
+        } else
+                log_debug("%s: found matching network '%s'", ifname, network->filename);
+
+        return true;
+}
+
 int network_get(Manager *manager, sd_device *device,
                 const char *ifname, const struct ether_addr *address,
                 Network **ret) {
@@ -429,33 +614,48 @@ int network_get(Manager *manager, sd_device *device,
                 (void) sd_device_get_devtype(device, &devtype);
         }
 
-        LIST_FOREACH(networks, network, manager->networks) {
-                if (net_match_config(network->match_mac, network->match_path,
-                                     network->match_driver, network->match_type,
-                                     network->match_name, network->match_host,
-                                     network->match_virt, network->match_kernel_cmdline,
-                                     network->match_kernel_version, network->match_arch,
-                                     address, path, parent_driver, driver,
-                                     devtype, ifname)) {
-                        if (network->match_name && device) {
-                                const char *attr;
-                                uint8_t name_assign_type = NET_NAME_UNKNOWN;
-
-                                if (sd_device_get_sysattr_value(device, "name_assign_type", &attr) >= 0)
-                                        (void) safe_atou8(attr, &name_assign_type);
-
-                                if (name_assign_type == NET_NAME_ENUM)
-                                        log_warning("%s: found matching network '%s', based on potentially unpredictable ifname",
-                                                    ifname, network->filename);
-                                else
-                                        log_debug("%s: found matching network '%s'", ifname, network->filename);
-                        } else
-                                log_debug("%s: found matching network '%s'", ifname, network->filename);
-
-                        *ret = network;
-                        return 0;
+        if (manager->networks_indexed) {
+                NetworkList *lists[4];
+                size_t n_lists = 0, k, idx[4] = {};
+
+                /* Only the networks indexed under the values of the link, and those not indexed at all, can
+                 * match. Test them in the same order as all networks would be tested otherwise. */
+                lists[n_lists++] = &manager->networks_unindexed;
+                if (address)
+                        lists[n_lists++] = hashmap_get(manager->networks_by_match_mac, address);
+                if (ifname)
+                        lists[n_lists++] = hashmap_get(manager->networks_by_match_name, ifname);
+                if (driver)
+                        lists[n_lists++] = hashmap_get(manager->networks_by_match_driver, driver);
+
+                for (;;) {
+                        size_t best = (size_t) -1;
+
+                        for (k = 0; k < n_lists; k++) {
+                                if (!lists[k] || idx[k] >= lists[k]->n_networks)
+                                        continue;
+
+                                if (best == (size_t) -1 ||
+                                    lists[k]->networks[idx[k]]->match_position < lists[best]->networks[idx[best]]->match_position)
+                                        best = k;
+                        }
+
+                        if (best == (size_t) -1)
+                                break;
+
+                        network = lists[best]->networks[idx[best]++];
+
+                        if (network_match(network, device, address, path, parent_driver, driver, devtype, ifname)) {
+                                *ret = network;
+                                return 0;
+                        }
                 }
-        }
+        } else
+                LIST_FOREACH(networks, network, manager->networks)
+                        if (network_match(network, device, address, path, parent_driver, driver, devtype, ifname)) {
+                                *ret = network;
+                                return 0;
+                        }
 
         *ret = NULL;
 
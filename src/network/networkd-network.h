@@ -156,6 +156,7 @@ struct Network {
         usec_t dhcp_server_default_lease_time_usec, dhcp_server_max_lease_time_usec;
         uint32_t dhcp_server_pool_offset;
         uint32_t dhcp_server_pool_size;
+        bool dhcp_server_persist_leases;
 
         /* IPV4LL Support */
         AddressFamilyBoolean link_local;
@@ -264,9 +265,18 @@ struct Network {
         DnsOverTlsMode dns_over_tls_mode;
         Set *dnssec_negative_trust_anchors;
 
+        /* The position in manager->networks, i.e. the order in which the [Match] sections are tested */
+        unsigned match_position;
+
         LIST_FIELDS(Network, networks);
 };
 
+/* Networks in the order of their match_position */
+typedef struct NetworkList {
+        Network **networks;
+        size_t n_networks, n_allocated;
+} NetworkList;
+
 void network_free(Network *network);
 
 DEFINE_TRIVIAL_CLEANUP_FUNC(Network*, network_free);
@@ -274,6 +284,8 @@ DEFINE_TRIVIAL_CLEANUP_FUNC(Network*, network_free);
 int network_load(Manager *manager);
 int network_load_one(Manager *manager, const char *filename);
 
+void network_index_free(Manager *manager);
+
 int network_get_by_name(Manager *manager, const char *name, Network **ret);
 int network_get(Manager *manager, sd_device *device, const char *ifname, const struct ether_addr *mac, Network **ret);
 int network_apply(Network *network, Link *link);
@@ -1,11 +1,17 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 
+#include <stdio_ext.h>
+
+#include "alloc-util.h"
 #include "condition.h"
 #include "conf-parser.h"
+#include "fd-util.h"
+#include "fileio.h"
 #include "networkd-util.h"
 #include "parse-util.h"
 #include "string-table.h"
 #include "string-util.h"
+#include "tmpfile-util.h"
 #include "util.h"
 
 const char *address_family_boolean_to_string(AddressFamilyBoolean b) {
@@ -102,3 +108,50 @@ int kernel_route_expiration_supported(void) {
         }
         return cached;
 }
+
+/* Atomically replaces the file with the serialized state, unless it is what was written there the last time, as
+ * recorded in *saved. Every write of a state file wakes up all sd-network monitors, hence it is worth avoiding the
+ * ones which do not change anything. Takes possession of contents, and returns 1 if the file was written. */
+int network_save_state_file(const char *path, char *contents, char **saved) {
+        _cleanup_free_ char *temp_path = NULL, *c = contents;
+        _cleanup_fclose_ FILE *f = NULL;
+        int r;
+
+        assert(path);
+        assert(contents);
+        assert(saved);
+
+        if (streq_ptr(*saved, contents))
+                return 0;
+
+        r = fopen_temporary(path, &f, &temp_path);
+        if (r < 0)
+                goto fail;
+
+        (void) __fsetlocking(f, FSETLOCKING_BYCALLER);
+        (void) fchmod(fileno(f), 0644);
+
+        fputs(contents, f);
+
+        r = fflush_and_check(f);
+        if (r < 0)
+                goto fail;
+
+        if (rename(temp_path, path) < 0) {
+                r = -errno;
+                goto fail;
+        }
+
+        free_and_replace(*saved, c);
+
+        return 1;
+
+fail:
+        (void) unlink(path);
+        if (temp_path)
+                (void) unlink(temp_path);
+
+        *saved = mfree(*saved);
+
+        return r;
+}
@@ -1,11 +1,14 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 
+#include <sys/stat.h>
+
 #include "sd-network.h"
 
 #include "alloc-util.h"
 #include "hashmap.h"
 #include "link.h"
 #include "manager.h"
+#include "stdio-util.h"
 #include "string-util.h"
 
 int link_new(Manager *m, Link **ret, int ifindex, const char *ifname) {
@@ -100,8 +103,26 @@ int link_update_rtnl(Link *l, sd_netlink_message *m) {
 }
 
 int link_update_monitor(Link *l) {
+        char path[STRLEN("/run/systemd/netif/links/") + DECIMAL_STR_MAX(int)];
+        struct stat st = {};
+
         assert(l);
 
+        /* networkd replaces the state file of a link whenever it changes, hence there is no need to parse it again
+         * as long as it is the same file */
+        xsprintf(path, "/run/systemd/netif/links/%i", l->ifindex);
+        if (stat(path, &st) < 0 && errno != ENOENT)
+                return -errno;
+
+        if (l->state_file_read &&
+            l->state_file_ino == st.st_ino &&
+            l->state_file_mtime == timespec_load(&st.st_mtim))
+                return 0;
+
+        l->state_file_read = true;
+        l->state_file_ino = st.st_ino;
+        l->state_file_mtime = timespec_load(&st.st_mtim);
+
         l->required_for_online = sd_network_link_get_required_for_online(l->ifindex) != 0;
 
         l->operational_state = mfree(l->operational_state);
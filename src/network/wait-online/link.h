@@ -1,8 +1,12 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 #pragma once
 
+#include <sys/types.h>
+
 #include "sd-netlink.h"
 
+#include "time-util.h"
+
 typedef struct Link Link;
 typedef struct Manager Manager;
 
@@ -16,6 +20,11 @@ struct Link {
         bool required_for_online;
         char *operational_state;
         char *state;
+
+        /* identifies the version of the state file the fields above were read from */
+        bool state_file_read;
+        ino_t state_file_ino;
+        usec_t state_file_mtime;
 };
 
 int link_new(Manager *m, Link **ret, int ifindex, const char *ifname);
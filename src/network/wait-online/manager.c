@@ -13,7 +13,9 @@
 #include "time-util.h"
 #include "util.h"
 
-bool manager_ignore_link(Manager *m, Link *link) {
+/* Returns true for links we never wait for, whatever networkd says about them, so that their state need not be
+ * looked at */
+static bool manager_link_is_excluded(Manager *m, Link *link) {
         assert(m);
         assert(link);
 
@@ -25,13 +27,20 @@ bool manager_ignore_link(Manager *m, Link *link) {
         if (m->interfaces && !strv_contains(m->interfaces, link->ifname))
                 return true;
 
-        if (!link->required_for_online)
-                return true;
-
         /* ignore interfaces we explicitly are asked to ignore */
         return strv_fnmatch(m->ignore, link->ifname, 0);
 }
 
+bool manager_ignore_link(Manager *m, Link *link) {
+        assert(m);
+        assert(link);
+
+        if (manager_link_is_excluded(m, link))
+                return true;
+
+        return !link->required_for_online;
+}
+
 bool manager_all_configured(Manager *m) {
         Iterator i;
         Link *l;
@@ -111,16 +120,19 @@ static int manager_process_link(sd_netlink *rtnl, sd_netlink_message *mm, void *
                         r = link_new(m, &l, ifindex, ifname);
                         if (r < 0)
                                 goto fail;
-
-                        r = link_update_monitor(l);
-                        if (r < 0)
-                                goto fail;
                 }
 
                 r = link_update_rtnl(l, mm);
                 if (r < 0)
                         goto fail;
 
+                /* the link may have been renamed, and not be excluded anymore */
+                if (!manager_link_is_excluded(m, l)) {
+                        r = link_update_monitor(l);
+                        if (r < 0)
+                                goto fail;
+                }
+
                 break;
 
         case RTM_DELLINK:
@@ -210,6 +222,9 @@ static int on_network_event(sd_event_source *s, int fd, uint32_t revents, void *
         sd_network_monitor_flush(m->network_monitor);
 
         HASHMAP_FOREACH(l, m->links, i) {
+                if (manager_link_is_excluded(m, l))
+                        continue;
+
                 r = link_update_monitor(l);
                 if (r < 0)
                         log_warning_errno(r, "Failed to update monitor information for %i: %m", l->ifindex);
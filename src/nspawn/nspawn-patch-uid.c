@@ -8,6 +8,7 @@
 #include <sys/stat.h>
 #include <sys/statvfs.h>
 #include <sys/vfs.h>
+#include <sys/xattr.h>
 #include <unistd.h>
 
 #include "acl-util.h"
@@ -82,6 +83,30 @@ static int set_acl(int fd, const char *name, acl_type_t type, acl_t acl) {
         return 0;
 }
 
+static int has_extended_acl(int fd, const char *name, acl_type_t type) {
+        char procfs_path[STRLEN("/proc/self/fd/") + DECIMAL_STR_MAX(int) + 1];
+        const char *xattr;
+        ssize_t n;
+
+        assert(fd >= 0);
+
+        /* Checks whether the inode carries an ACL on its own, i.e. one that isn't just derived from the access mode.
+         * Only those can contain user and group entries that need shifting, and most inodes have none. This is a
+         * lot cheaper than opening the inode and asking libacl to synthesize an ACL from the mode. */
+
+        xattr = type == ACL_TYPE_ACCESS ? "system.posix_acl_access" : "system.posix_acl_default";
+
+        if (name) {
+                xsprintf(procfs_path, "/proc/self/fd/%i", fd);
+                n = lgetxattr(strjoina(procfs_path, "/", name), xattr, NULL, 0);
+        } else
+                n = fgetxattr(fd, xattr, NULL, 0);
+        if (n < 0)
+                return errno == ENODATA ? false : -errno;
+
+        return true;
+}
+
 static int shift_acl(acl_t acl, uid_t shift, acl_t *ret) {
         _cleanup_(acl_freep) acl_t copy = NULL;
         acl_entry_t i;
@@ -174,29 +199,40 @@ static int patch_acls(int fd, const char *name, const struct stat *st, uid_t shi
         if (S_ISLNK(st->st_mode))
                 return 0;
 
-        r = get_acl(fd, name, ACL_TYPE_ACCESS, &acl);
+        r = has_extended_acl(fd, name, ACL_TYPE_ACCESS);
         if (r == -EOPNOTSUPP)
                 return 0;
         if (r < 0)
                 return r;
-
-        r = shift_acl(acl, shift, &shifted);
-        if (r < 0)
-                return r;
         if (r > 0) {
-                r = set_acl(fd, name, ACL_TYPE_ACCESS, shifted);
+                r = get_acl(fd, name, ACL_TYPE_ACCESS, &acl);
+                if (r == -EOPNOTSUPP)
+                        return 0;
                 if (r < 0)
                         return r;
 
-                changed = true;
+                r = shift_acl(acl, shift, &shifted);
+                if (r < 0)
+                        return r;
+                if (r > 0) {
+                        r = set_acl(fd, name, ACL_TYPE_ACCESS, shifted);
+                        if (r < 0)
+                                return r;
+
+                        changed = true;
+                }
         }
 
         if (S_ISDIR(st->st_mode)) {
-                acl_free(acl);
-                acl_free(shifted);
+                acl_freep(&acl);
+                acl_freep(&shifted);
 
                 acl = shifted = NULL;
 
+                r = has_extended_acl(fd, name, ACL_TYPE_DEFAULT);
+                if (r <= 0)
+                        return r < 0 ? r : changed;
+
                 r = get_acl(fd, name, ACL_TYPE_DEFAULT, &acl);
                 if (r < 0)
                         return r;
@@ -247,8 +283,11 @@ static int patch_fd(int fd, const char *name, const struct stat *st, uid_t shift
                 if (r < 0)
                         return -errno;
 
-                /* The Linux kernel alters the mode in some cases of chown(). Let's undo this. */
-                if (name) {
+                /* The Linux kernel alters the mode in some cases of chown(), by dropping the SUID and SGID bits.
+                 * Let's undo this. If neither is set, there's nothing to undo. */
+                if ((st->st_mode & (S_ISUID|S_ISGID)) == 0)
+                        r = 0;
+                else if (name) {
                         if (!S_ISLNK(st->st_mode))
                                 r = fchmodat(fd, name, st->st_mode, 0);
                         else /* AT_SYMLINK_NOFOLLOW is not available for fchmodat() */
@@ -3,23 +3,41 @@
 #include <errno.h>
 #include <netdb.h>
 #include <nss.h>
+#include <poll.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 
 #include "sd-bus.h"
 
+#include "alloc-util.h"
 #include "bus-common-errors.h"
+#include "fd-util.h"
 #include "in-addr-util.h"
+#include "io-util.h"
+#include "json.h"
 #include "macro.h"
 #include "nss-util.h"
 #include "resolved-def.h"
+#include "socket-util.h"
 #include "string-util.h"
+#include "strv.h"
+#include "time-util.h"
 #include "util.h"
 #include "signal-util.h"
 
+#define VARLINK_MESSAGE_SIZE_MAX (64U * 1024U)
+
 NSS_GETHOSTBYNAME_PROTOTYPES(resolve);
 NSS_GETHOSTBYADDR_PROTOTYPES(resolve);
 
+typedef struct ResolvedAddress {
+        int ifindex;
+        int family;
+        union in_addr_union address;
+} ResolvedAddress;
+
 static bool bus_error_shall_fallback(sd_bus_error *e) {
         return sd_bus_error_has_name(e, SD_BUS_ERROR_SERVICE_UNKNOWN) ||
                sd_bus_error_has_name(e, SD_BUS_ERROR_NAME_HAS_NO_OWNER) ||
@@ -27,54 +45,457 @@ static bool bus_error_shall_fallback(sd_bus_error *e) {
                sd_bus_error_has_name(e, SD_BUS_ERROR_ACCESS_DENIED);
 }
 
-static int count_addresses(sd_bus_message *m, int af, const char **canonical) {
-        int c = 0, r;
+static bool varlink_error_shall_fallback(int r) {
+        /* Older versions of systemd-resolved do not provide the socket, try the bus then. Also do so if
+         * systemd-resolved dropped the connection: maybe it still answers on the bus. But not if it didn't
+         * answer in time, as the caller would have to wait for the full timeout once again. */
+        return IN_SET(r, -ENOENT, -ECONNREFUSED, -ECONNRESET, -EPIPE);
+}
+
+static bool family_wanted(int family, int af) {
+        if (af == AF_UNSPEC)
+                return IN_SET(family, AF_INET, AF_INET6);
+
+        return family == af;
+}
+
+/* Returns 1 and the parameters of the reply, 0 if systemd-resolved replied with an error, and < 0 if we could not
+ * talk to it. */
+static int varlink_call(const char *method, JsonVariant *parameters, JsonVariant **ret) {
+        _cleanup_(json_variant_unrefp) JsonVariant *call = NULL, *reply = NULL;
+        _cleanup_free_ char *text = NULL, *buf = NULL;
+        size_t size = 0, allocated = 0;
+        union sockaddr_union sa = {};
+        _cleanup_close_ int fd = -1;
+        JsonVariant *error, *p;
+        usec_t end;
+        ssize_t k;
+        int r;
+
+        r = sockaddr_un_set_path(&sa.un, SD_RESOLVED_VARLINK_PATH);
+        if (r < 0)
+                return r;
+
+        fd = socket(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC, 0);
+        if (fd < 0)
+                return -errno;
+
+        if (connect(fd, &sa.sa, SOCKADDR_UN_LEN(sa.un)) < 0)
+                return -errno;
+
+        r = json_build(&call, JSON_BUILD_OBJECT(JSON_BUILD_PAIR("method", JSON_BUILD_STRING(method)),
+                                                JSON_BUILD_PAIR("parameters", JSON_BUILD_VARIANT(parameters))));
+        if (r < 0)
+                return r;
+
+        r = json_variant_format(call, 0, &text);
+        if (r < 0)
+                return r;
+
+        /* Including the NUL byte which terminates the message. Note that we mustn't get SIGPIPE, as it would be
+         * delivered to the application once we unblock signals. */
+        k = send(fd, text, (size_t) r + 1, MSG_NOSIGNAL);
+        if (k < 0)
+                return -errno;
+        if ((size_t) k != (size_t) r + 1)
+                return -EIO;
+
+        end = usec_add(now(CLOCK_MONOTONIC), SD_RESOLVED_QUERY_TIMEOUT_USEC);
+
+        while (size == 0 || !memchr(buf, 0, size)) {
+                usec_t n;
+
+                if (size >= VARLINK_MESSAGE_SIZE_MAX)
+                        return -EMSGSIZE;
+
+                n = now(CLOCK_MONOTONIC);
+                if (n >= end)
+                        return -ETIMEDOUT;
+
+                r = fd_wait_for_event(fd, POLLIN, end - n);
+                if (r < 0)
+                        return r;
+                if (r == 0)
+                        return -ETIMEDOUT;
+
+                if (!GREEDY_REALLOC(buf, allocated, size + 2048))
+                        return -ENOMEM;
+
+                k = read(fd, buf + size, allocated - size);
+                if (k < 0) {
+                        if (errno == EINTR)
+                                continue;
+
+                        return -errno;
+                }
+                if (k == 0)
+                        return -ECONNRESET;
+
+                size += k;
+        }
+
+        r = json_parse(buf, &reply, NULL, NULL);
+        if (r < 0)
+                return r;
+
+        /* Like on the bus, all errors are negative replies, including DNSSEC errors and suchlike */
+        error = json_variant_by_key(reply, "error");
+        if (error)
+                return 0;
+
+        p = json_variant_by_key(reply, "parameters");
+        if (!json_variant_is_object(p))
+                return -EBADMSG;
+
+        *ret = json_variant_ref(p);
+        return 1;
+}
+
+static int json_variant_int(JsonVariant *v, int *ret) {
+        if (!json_variant_is_integer(v) ||
+            json_variant_integer(v) < INT_MIN ||
+            json_variant_integer(v) > INT_MAX)
+                return -EBADMSG;
+
+        *ret = (int) json_variant_integer(v);
+        return 0;
+}
+
+static int json_variant_address(JsonVariant *v, int family, union in_addr_union *ret) {
+        JsonVariant *i;
+        size_t n = 0;
+
+        if (!json_variant_is_array(v) || json_variant_elements(v) != FAMILY_ADDRESS_SIZE(family))
+                return -EBADMSG;
+
+        JSON_VARIANT_ARRAY_FOREACH(i, v) {
+                if (!json_variant_is_unsigned(i) || json_variant_unsigned(i) > 0xFF)
+                        return -EBADMSG;
+
+                ((uint8_t*) ret)[n++] = (uint8_t) json_variant_unsigned(i);
+        }
+
+        return 0;
+}
+
+static int varlink_resolve_hostname(
+                const char *name,
+                int af,
+                ResolvedAddress **ret_addresses,
+                size_t *ret_n_addresses,
+                char **ret_canonical) {
+
+        _cleanup_(json_variant_unrefp) JsonVariant *parameters = NULL, *reply = NULL;
+        _cleanup_free_ ResolvedAddress *addresses = NULL;
+        size_t n = 0, allocated = 0;
+        JsonVariant *a, *i;
+        const char *canonical;
+        int r;
+
+        r = json_build(&parameters, JSON_BUILD_OBJECT(JSON_BUILD_PAIR("name", JSON_BUILD_STRING(name)),
+                                                      JSON_BUILD_PAIR("family", JSON_BUILD_INTEGER(af))));
+        if (r < 0)
+                return r;
+
+        r = varlink_call("io.systemd.Resolve.ResolveHostname", parameters, &reply);
+        if (r <= 0)
+                return r;
+
+        a = json_variant_by_key(reply, "addresses");
+        if (!json_variant_is_array(a))
+                return -EBADMSG;
+
+        JSON_VARIANT_ARRAY_FOREACH(i, a) {
+                ResolvedAddress address;
+
+                r = json_variant_int(json_variant_by_key(i, "ifindex"), &address.ifindex);
+                if (r < 0)
+                        return r;
+                if (address.ifindex < 0)
+                        return -EINVAL;
+
+                r = json_variant_int(json_variant_by_key(i, "family"), &address.family);
+                if (r < 0)
+                        return r;
+
+                if (!family_wanted(address.family, af))
+                        continue;
+
+                r = json_variant_address(json_variant_by_key(i, "address"), address.family, &address.address);
+                if (r < 0)
+                        return r;
+
+                if (!GREEDY_REALLOC(addresses, allocated, n + 1))
+                        return -ENOMEM;
+
+                addresses[n++] = address;
+        }
+
+        canonical = json_variant_string(json_variant_by_key(reply, "name"));
+
+        r = free_and_strdup(ret_canonical, isempty(canonical) ? name : canonical);
+        if (r < 0)
+                return r;
+
+        *ret_addresses = TAKE_PTR(addresses);
+        *ret_n_addresses = n;
+        return 1;
+}
+
+static int bus_resolve_hostname(
+                const char *name,
+                int af,
+                ResolvedAddress **ret_addresses,
+                size_t *ret_n_addresses,
+                char **ret_canonical) {
+
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *req = NULL, *reply = NULL;
+        _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
+        _cleanup_(sd_bus_flush_close_unrefp) sd_bus *bus = NULL;
+        _cleanup_free_ ResolvedAddress *addresses = NULL;
+        size_t n = 0, allocated = 0;
+        const char *canonical;
+        int r;
+
+        r = sd_bus_open_system(&bus);
+        if (r < 0)
+                return r;
 
-        assert(m);
-        assert(canonical);
+        r = sd_bus_message_new_method_call(
+                        bus,
+                        &req,
+                        "org.freedesktop.resolve1",
+                        "/org/freedesktop/resolve1",
+                        "org.freedesktop.resolve1.Manager",
+                        "ResolveHostname");
+        if (r < 0)
+                return r;
 
-        r = sd_bus_message_enter_container(m, 'a', "(iiay)");
+        r = sd_bus_message_set_auto_start(req, false);
         if (r < 0)
                 return r;
 
-        while ((r = sd_bus_message_enter_container(m, 'r', "iiay")) > 0) {
+        r = sd_bus_message_append(req, "isit", 0, name, af, (uint64_t) 0);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_call(bus, req, SD_RESOLVED_QUERY_TIMEOUT_USEC, &error, &reply);
+        if (r < 0) {
+                if (sd_bus_error_has_name(&error, _BUS_ERROR_DNS "NXDOMAIN") ||
+                    !bus_error_shall_fallback(&error))
+                        return 0;
+
+                /* Return NSS_STATUS_UNAVAIL when communication with systemd-resolved fails,
+                   allowing falling back to other nss modules. Treat all other error conditions as
+                   NOTFOUND. This includes DNSSEC errors and suchlike. (We don't use UNAVAIL in this
+                   case so that the nsswitch.conf configuration can distuingish such executed but
+                   negative replies from complete failure to talk to resolved). */
+                return r;
+        }
+
+        r = sd_bus_message_enter_container(reply, 'a', "(iiay)");
+        if (r < 0)
+                return r;
+
+        while ((r = sd_bus_message_enter_container(reply, 'r', "iiay")) > 0) {
                 int family, ifindex;
+                const void *a;
+                size_t sz;
 
                 assert_cc(sizeof(int32_t) == sizeof(int));
 
-                r = sd_bus_message_read(m, "ii", &ifindex, &family);
+                r = sd_bus_message_read(reply, "ii", &ifindex, &family);
                 if (r < 0)
                         return r;
 
-                r = sd_bus_message_skip(m, "ay");
+                if (ifindex < 0)
+                        return -EINVAL;
+
+                r = sd_bus_message_read_array(reply, 'y', &a, &sz);
                 if (r < 0)
                         return r;
 
-                r = sd_bus_message_exit_container(m);
+                r = sd_bus_message_exit_container(reply);
                 if (r < 0)
                         return r;
 
-                if (af != AF_UNSPEC && family != af)
+                if (!family_wanted(family, af))
                         continue;
 
-                c++;
+                if (sz != FAMILY_ADDRESS_SIZE(family))
+                        return -EINVAL;
+
+                if (!GREEDY_REALLOC(addresses, allocated, n + 1))
+                        return -ENOMEM;
+
+                addresses[n] = (ResolvedAddress) {
+                        .ifindex = ifindex,
+                        .family = family,
+                };
+                memcpy(&addresses[n].address, a, sz);
+                n++;
         }
         if (r < 0)
                 return r;
 
-        r = sd_bus_message_exit_container(m);
+        r = sd_bus_message_exit_container(reply);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_read(reply, "s", &canonical);
+        if (r < 0)
+                return r;
+
+        r = free_and_strdup(ret_canonical, isempty(canonical) ? name : canonical);
+        if (r < 0)
+                return r;
+
+        *ret_addresses = TAKE_PTR(addresses);
+        *ret_n_addresses = n;
+        return 1;
+}
+
+/* Returns 1 and the addresses of the requested family (or of both, if AF_UNSPEC), 0 if the name was not found, and
+ * < 0 if we could not talk to systemd-resolved. */
+static int resolve_hostname(
+                const char *name,
+                int af,
+                ResolvedAddress **ret_addresses,
+                size_t *ret_n_addresses,
+                char **ret_canonical) {
+
+        int r;
+
+        r = varlink_resolve_hostname(name, af, ret_addresses, ret_n_addresses, ret_canonical);
+        if (!varlink_error_shall_fallback(r))
+                return r;
+
+        return bus_resolve_hostname(name, af, ret_addresses, ret_n_addresses, ret_canonical);
+}
+
+static int varlink_resolve_address(int af, const void *addr, size_t len, char ***ret_names) {
+        _cleanup_(json_variant_unrefp) JsonVariant *parameters = NULL, *address = NULL, *reply = NULL;
+        _cleanup_strv_free_ char **names = NULL;
+        JsonVariant *a, *i;
+        int r;
+
+        r = json_variant_new_array_bytes(&address, addr, len);
+        if (r < 0)
+                return r;
+
+        r = json_build(&parameters, JSON_BUILD_OBJECT(JSON_BUILD_PAIR("family", JSON_BUILD_INTEGER(af)),
+                                                      JSON_BUILD_PAIR("address", JSON_BUILD_VARIANT(address))));
         if (r < 0)
                 return r;
 
-        r = sd_bus_message_read(m, "s", canonical);
+        r = varlink_call("io.systemd.Resolve.ResolveAddress", parameters, &reply);
+        if (r <= 0)
+                return r;
+
+        a = json_variant_by_key(reply, "names");
+        if (!json_variant_is_array(a))
+                return -EBADMSG;
+
+        JSON_VARIANT_ARRAY_FOREACH(i, a) {
+                JsonVariant *n;
+                int ifindex;
+
+                r = json_variant_int(json_variant_by_key(i, "ifindex"), &ifindex);
+                if (r < 0)
+                        return r;
+                if (ifindex < 0)
+                        return -EINVAL;
+
+                n = json_variant_by_key(i, "name");
+                if (!json_variant_is_string(n))
+                        return -EBADMSG;
+
+                r = strv_extend(&names, json_variant_string(n));
+                if (r < 0)
+                        return r;
+        }
+
+        *ret_names = TAKE_PTR(names);
+        return 1;
+}
+
+static int bus_resolve_address(int af, const void *addr, size_t len, char ***ret_names) {
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *req = NULL, *reply = NULL;
+        _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
+        _cleanup_(sd_bus_flush_close_unrefp) sd_bus *bus = NULL;
+        _cleanup_strv_free_ char **names = NULL;
+        const char *n;
+        int r, ifindex;
+
+        r = sd_bus_open_system(&bus);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_new_method_call(
+                        bus,
+                        &req,
+                        "org.freedesktop.resolve1",
+                        "/org/freedesktop/resolve1",
+                        "org.freedesktop.resolve1.Manager",
+                        "ResolveAddress");
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_set_auto_start(req, false);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_append(req, "ii", 0, af);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_append_array(req, 'y', addr, len);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_append(req, "t", (uint64_t) 0);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_call(bus, req, SD_RESOLVED_QUERY_TIMEOUT_USEC, &error, &reply);
+        if (r < 0) {
+                if (sd_bus_error_has_name(&error, _BUS_ERROR_DNS "NXDOMAIN") ||
+                    !bus_error_shall_fallback(&error))
+                        return 0;
+
+                return r;
+        }
+
+        r = sd_bus_message_enter_container(reply, 'a', "(is)");
         if (r < 0)
                 return r;
 
-        r = sd_bus_message_rewind(m, true);
+        while ((r = sd_bus_message_read(reply, "(is)", &ifindex, &n)) > 0) {
+
+                if (ifindex < 0)
+                        return -EINVAL;
+
+                r = strv_extend(&names, n);
+                if (r < 0)
+                        return r;
+        }
         if (r < 0)
                 return r;
 
-        return c;
+        *ret_names = TAKE_PTR(names);
+        return 1;
+}
+
+/* Returns 1 and the names of the address, 0 if it was not found, and < 0 if we could not talk to
+ * systemd-resolved. */
+static int resolve_address(int af, const void *addr, size_t len, char ***ret_names) {
+        int r;
+
+        r = varlink_resolve_address(af, addr, len, ret_names);
+        if (!varlink_error_shall_fallback(r))
+                return r;
+
+        return bus_resolve_address(af, addr, len, ret_names);
 }
 
 static uint32_t ifindex_to_scopeid(int family, const void *a, int ifindex) {
@@ -112,15 +533,13 @@ enum nss_status _nss_resolve_gethostbyname4_r(
                 int *errnop, int *h_errnop,
                 int32_t *ttlp) {
 
-        _cleanup_(sd_bus_message_unrefp) sd_bus_message *req = NULL, *reply = NULL;
-        _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
         struct gaih_addrtuple *r_tuple, *r_tuple_first = NULL;
-        _cleanup_(sd_bus_flush_close_unrefp) sd_bus *bus = NULL;
+        _cleanup_free_ ResolvedAddress *addresses = NULL;
         enum nss_status ret = NSS_STATUS_UNAVAIL;
-        const char *canonical = NULL;
-        size_t l, ms, idx;
+        _cleanup_free_ char *canonical = NULL;
+        size_t l, ms, idx, c = 0, i;
         char *r_name;
-        int c, r, i = 0;
+        int r;
 
         PROTECT_ERRNO;
         BLOCK_SIGNALS(NSS_SIGNALS_BLOCK);
@@ -136,53 +555,12 @@ enum nss_status _nss_resolve_gethostbyname4_r(
                 goto fail;
         }
 
-        r = sd_bus_open_system(&bus);
-        if (r < 0)
-                goto fail;
-
-        r = sd_bus_message_new_method_call(
-                        bus,
-                        &req,
-                        "org.freedesktop.resolve1",
-                        "/org/freedesktop/resolve1",
-                        "org.freedesktop.resolve1.Manager",
-                        "ResolveHostname");
-        if (r < 0)
-                goto fail;
-
-        r = sd_bus_message_set_auto_start(req, false);
-        if (r < 0)
-                goto fail;
-
-        r = sd_bus_message_append(req, "isit", 0, name, AF_UNSPEC, (uint64_t) 0);
+        r = resolve_hostname(name, AF_UNSPEC, &addresses, &c, &canonical);
         if (r < 0)
                 goto fail;
-
-        r = sd_bus_call(bus, req, SD_RESOLVED_QUERY_TIMEOUT_USEC, &error, &reply);
-        if (r < 0) {
-                if (sd_bus_error_has_name(&error, _BUS_ERROR_DNS "NXDOMAIN") ||
-                    !bus_error_shall_fallback(&error))
-                        goto not_found;
-
-                /* Return NSS_STATUS_UNAVAIL when communication with systemd-resolved fails,
-                   allowing falling back to other nss modules. Treat all other error conditions as
-                   NOTFOUND. This includes DNSSEC errors and suchlike. (We don't use UNAVAIL in this
-                   case so that the nsswitch.conf configuration can distuingish such executed but
-                   negative replies from complete failure to talk to resolved). */
-                goto fail;
-        }
-
-        c = count_addresses(reply, AF_UNSPEC, &canonical);
-        if (c < 0) {
-                r = c;
-                goto fail;
-        }
-        if (c == 0)
+        if (r == 0 || c == 0)
                 goto not_found;
 
-        if (isempty(canonical))
-                canonical = name;
-
         l = strlen(canonical);
         ms = ALIGN(l+1) + ALIGN(sizeof(struct gaih_addrtuple)) * c;
         if (buflen < ms) {
@@ -199,56 +577,19 @@ enum nss_status _nss_resolve_gethostbyname4_r(
         /* Second, append addresses */
         r_tuple_first = (struct gaih_addrtuple*) (buffer + idx);
 
-        r = sd_bus_message_enter_container(reply, 'a', "(iiay)");
-        if (r < 0)
-                goto fail;
-
-        while ((r = sd_bus_message_enter_container(reply, 'r', "iiay")) > 0) {
-                int family, ifindex;
-                const void *a;
-                size_t sz;
-
-                assert_cc(sizeof(int32_t) == sizeof(int));
-
-                r = sd_bus_message_read(reply, "ii", &ifindex, &family);
-                if (r < 0)
-                        goto fail;
-
-                if (ifindex < 0) {
-                        r = -EINVAL;
-                        goto fail;
-                }
-
-                r = sd_bus_message_read_array(reply, 'y', &a, &sz);
-                if (r < 0)
-                        goto fail;
-
-                r = sd_bus_message_exit_container(reply);
-                if (r < 0)
-                        goto fail;
-
-                if (!IN_SET(family, AF_INET, AF_INET6))
-                        continue;
-
-                if (sz != FAMILY_ADDRESS_SIZE(family)) {
-                        r = -EINVAL;
-                        goto fail;
-                }
+        for (i = 0; i < c; i++) {
+                ResolvedAddress *a = addresses + i;
 
                 r_tuple = (struct gaih_addrtuple*) (buffer + idx);
                 r_tuple->next = i == c-1 ? NULL : (struct gaih_addrtuple*) ((char*) r_tuple + ALIGN(sizeof(struct gaih_addrtuple)));
                 r_tuple->name = r_name;
-                r_tuple->family = family;
-                r_tuple->scopeid = ifindex_to_scopeid(family, a, ifindex);
-                memcpy(r_tuple->addr, a, sz);
+                r_tuple->family = a->family;
+                r_tuple->scopeid = ifindex_to_scopeid(a->family, &a->address, a->ifindex);
+                memcpy(r_tuple->addr, &a->address, FAMILY_ADDRESS_SIZE(a->family));
 
                 idx += ALIGN(sizeof(struct gaih_addrtuple));
-                i++;
         }
-        if (r < 0)
-                goto fail;
 
-        assert(i == c);
         assert(idx == ms);
 
         if (*pat)
@@ -285,14 +626,12 @@ enum nss_status _nss_resolve_gethostbyname3_r(
                 int32_t *ttlp,
                 char **canonp) {
 
-        _cleanup_(sd_bus_message_unrefp) sd_bus_message *req = NULL, *reply = NULL;
-        _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
         char *r_name, *r_aliases, *r_addr, *r_addr_list;
-        _cleanup_(sd_bus_flush_close_unrefp) sd_bus *bus = NULL;
+        _cleanup_free_ ResolvedAddress *addresses = NULL;
         enum nss_status ret = NSS_STATUS_UNAVAIL;
-        size_t l, idx, ms, alen;
-        const char *canonical;
-        int c, r, i = 0;
+        _cleanup_free_ char *canonical = NULL;
+        size_t l, idx, ms, alen, c = 0, i;
+        int r;
 
         PROTECT_ERRNO;
         BLOCK_SIGNALS(NSS_SIGNALS_BLOCK);
@@ -316,48 +655,12 @@ enum nss_status _nss_resolve_gethostbyname3_r(
                 goto fail;
         }
 
-        r = sd_bus_open_system(&bus);
-        if (r < 0)
-                goto fail;
-
-        r = sd_bus_message_new_method_call(
-                        bus,
-                        &req,
-                        "org.freedesktop.resolve1",
-                        "/org/freedesktop/resolve1",
-                        "org.freedesktop.resolve1.Manager",
-                        "ResolveHostname");
-        if (r < 0)
-                goto fail;
-
-        r = sd_bus_message_set_auto_start(req, false);
+        r = resolve_hostname(name, af, &addresses, &c, &canonical);
         if (r < 0)
                 goto fail;
-
-        r = sd_bus_message_append(req, "isit", 0, name, af, (uint64_t) 0);
-        if (r < 0)
-                goto fail;
-
-        r = sd_bus_call(bus, req, SD_RESOLVED_QUERY_TIMEOUT_USEC, &error, &reply);
-        if (r < 0) {
-                if (sd_bus_error_has_name(&error, _BUS_ERROR_DNS "NXDOMAIN") ||
-                    !bus_error_shall_fallback(&error))
-                        goto not_found;
-
-                goto fail;
-        }
-
-        c = count_addresses(reply, af, &canonical);
-        if (c < 0) {
-                r = c;
-                goto fail;
-        }
-        if (c == 0)
+        if (r == 0 || c == 0)
                 goto not_found;
 
-        if (isempty(canonical))
-                canonical = name;
-
         alen = FAMILY_ADDRESS_SIZE(af);
         l = strlen(canonical);
 
@@ -382,47 +685,9 @@ enum nss_status _nss_resolve_gethostbyname3_r(
         /* Third, append addresses */
         r_addr = buffer + idx;
 
-        r = sd_bus_message_enter_container(reply, 'a', "(iiay)");
-        if (r < 0)
-                goto fail;
-
-        while ((r = sd_bus_message_enter_container(reply, 'r', "iiay")) > 0) {
-                int ifindex, family;
-                const void *a;
-                size_t sz;
-
-                r = sd_bus_message_read(reply, "ii", &ifindex, &family);
-                if (r < 0)
-                        goto fail;
-
-                if (ifindex < 0) {
-                        r = -EINVAL;
-                        goto fail;
-                }
-
-                r = sd_bus_message_read_array(reply, 'y', &a, &sz);
-                if (r < 0)
-                        goto fail;
-
-                r = sd_bus_message_exit_container(reply);
-                if (r < 0)
-                        goto fail;
-
-                if (family != af)
-                        continue;
-
-                if (sz != alen) {
-                        r = -EINVAL;
-                        goto fail;
-                }
-
-                memcpy(r_addr + i*ALIGN(alen), a, alen);
-                i++;
-        }
-        if (r < 0)
-                goto fail;
+        for (i = 0; i < c; i++)
+                memcpy(r_addr + i*ALIGN(alen), &addresses[i].address, alen);
 
-        assert(i == c);
         idx += c * ALIGN(alen);
 
         /* Fourth, append address pointer array */
@@ -472,15 +737,13 @@ enum nss_status _nss_resolve_gethostbyaddr2_r(
                 int *errnop, int *h_errnop,
                 int32_t *ttlp) {
 
-        _cleanup_(sd_bus_message_unrefp) sd_bus_message *req = NULL, *reply = NULL;
-        _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
         char *r_name, *r_aliases, *r_addr, *r_addr_list;
-        _cleanup_(sd_bus_flush_close_unrefp) sd_bus *bus = NULL;
         enum nss_status ret = NSS_STATUS_UNAVAIL;
-        unsigned c = 0, i = 0;
-        size_t ms = 0, idx;
-        const char *n;
-        int r, ifindex;
+        _cleanup_strv_free_ char **names = NULL;
+        size_t ms = 0, idx, c;
+        unsigned i;
+        char **n;
+        int r;
 
         PROTECT_ERRNO;
         BLOCK_SIGNALS(NSS_SIGNALS_BLOCK);
@@ -508,69 +771,17 @@ enum nss_status _nss_resolve_gethostbyaddr2_r(
                 goto fail;
         }
 
-        r = sd_bus_open_system(&bus);
+        r = resolve_address(af, addr, len, &names);
         if (r < 0)
                 goto fail;
 
-        r = sd_bus_message_new_method_call(
-                        bus,
-                        &req,
-                        "org.freedesktop.resolve1",
-                        "/org/freedesktop/resolve1",
-                        "org.freedesktop.resolve1.Manager",
-                        "ResolveAddress");
-        if (r < 0)
-                goto fail;
-
-        r = sd_bus_message_set_auto_start(req, false);
-        if (r < 0)
-                goto fail;
-
-        r = sd_bus_message_append(req, "ii", 0, af);
-        if (r < 0)
-                goto fail;
-
-        r = sd_bus_message_append_array(req, 'y', addr, len);
-        if (r < 0)
-                goto fail;
-
-        r = sd_bus_message_append(req, "t", (uint64_t) 0);
-        if (r < 0)
-                goto fail;
-
-        r = sd_bus_call(bus, req, SD_RESOLVED_QUERY_TIMEOUT_USEC, &error, &reply);
-        if (r < 0) {
-                if (sd_bus_error_has_name(&error, _BUS_ERROR_DNS "NXDOMAIN") ||
-                    !bus_error_shall_fallback(&error))
-                        goto not_found;
-
-                goto fail;
-        }
-
-        r = sd_bus_message_enter_container(reply, 'a', "(is)");
-        if (r < 0)
-                goto fail;
-
-        while ((r = sd_bus_message_read(reply, "(is)", &ifindex, &n)) > 0) {
-
-                if (ifindex < 0) {
-                        r = -EINVAL;
-                        goto fail;
-                }
-
-                c++;
-                ms += ALIGN(strlen(n) + 1);
-        }
-        if (r < 0)
-                goto fail;
-
-        r = sd_bus_message_rewind(reply, false);
-        if (r < 0)
-                return r;
-
-        if (c <= 0)
+        c = strv_length(names);
+        if (r == 0 || c == 0)
                 goto not_found;
 
+        STRV_FOREACH(n, names)
+                ms += ALIGN(strlen(*n) + 1);
+
         ms += ALIGN(len) +              /* the address */
               2 * sizeof(char*) +       /* pointers to the address, plus trailing NULL */
               c * sizeof(char*);        /* pointers to aliases, plus trailing NULL */
@@ -599,13 +810,13 @@ enum nss_status _nss_resolve_gethostbyaddr2_r(
         /* Fourth, place aliases */
         i = 0;
         r_name = buffer + idx;
-        while ((r = sd_bus_message_read(reply, "(is)", &ifindex, &n)) > 0) {
+        STRV_FOREACH(n, names) {
                 char *p;
                 size_t l;
 
-                l = strlen(n);
+                l = strlen(*n);
                 p = buffer + idx;
-                memcpy(p, n, l+1);
+                memcpy(p, *n, l+1);
 
                 if (i > 0)
                         ((char**) r_aliases)[i-1] = p;
@@ -613,8 +824,6 @@ enum nss_status _nss_resolve_gethostbyaddr2_r(
 
                 idx += ALIGN(l+1);
         }
-        if (r < 0)
-                goto fail;
 
         ((char**) r_aliases)[c-1] = NULL;
         assert(idx == ms);
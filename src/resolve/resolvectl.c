@@ -1005,13 +1005,110 @@ static int verb_tlsa(int argc, char **argv, void *userdata) {
         return r;
 }
 
+static int show_server_rtts(sd_bus *bus) {
+        _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
+        int r;
+
+        assert(bus);
+
+        /* Older versions of resolved do not track this, hence don't fail if it is missing */
+        r = sd_bus_get_property(bus,
+                                "org.freedesktop.resolve1",
+                                "/org/freedesktop/resolve1",
+                                "org.freedesktop.resolve1.Manager",
+                                "DNSServerRoundTripTimes",
+                                &error,
+                                &reply,
+                                "a(iiayttat)");
+        if (r < 0)
+                return 0;
+
+        r = sd_bus_message_enter_container(reply, 'a', "(iiayttat)");
+        if (r < 0)
+                return bus_log_parse_error(r);
+
+        printf("\n%sServer Round-Trip Times%s\n", ansi_highlight(), ansi_normal());
+
+        while ((r = sd_bus_message_enter_container(reply, 'r', "iiayttat")) > 0) {
+                char srtt_str[FORMAT_TIMESPAN_MAX], rttvar_str[FORMAT_TIMESPAN_MAX], bucket_str[FORMAT_TIMESPAN_MAX];
+                _cleanup_free_ char *pretty = NULL;
+                uint64_t srtt, rttvar;
+                const uint64_t *histogram;
+                int ifindex, family;
+                const void *a;
+                size_t sz, n, k;
+
+                r = sd_bus_message_read(reply, "ii", &ifindex, &family);
+                if (r < 0)
+                        return bus_log_parse_error(r);
+
+                r = sd_bus_message_read_array(reply, 'y', &a, &sz);
+                if (r < 0)
+                        return bus_log_parse_error(r);
+
+                r = sd_bus_message_read(reply, "tt", &srtt, &rttvar);
+                if (r < 0)
+                        return bus_log_parse_error(r);
+
+                r = sd_bus_message_read_array(reply, 't', (const void**) &histogram, &n);
+                if (r < 0)
+                        return bus_log_parse_error(r);
+                n /= sizeof(uint64_t);
+
+                r = sd_bus_message_exit_container(reply);
+                if (r < 0)
+                        return bus_log_parse_error(r);
+
+                if (!IN_SET(family, AF_INET, AF_INET6) || sz != FAMILY_ADDRESS_SIZE(family))
+                        continue;
+
+                r = in_addr_ifindex_to_string(family, a, ifindex, &pretty);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to print address: %m");
+
+                if (srtt == 0) {
+                        printf("%s: n/a\n", pretty);
+                        continue;
+                }
+
+                printf("%s: %s (±%s)\n",
+                       pretty,
+                       format_timespan(srtt_str, sizeof(srtt_str), srtt, 1),
+                       format_timespan(rttvar_str, sizeof(rttvar_str), rttvar, 1));
+
+                /* Each bucket counts the times below twice the limit of the previous one, starting at 1ms, the
+                 * last one counts everything else */
+                for (k = 0; k < n; k++) {
+                        if (histogram[k] == 0)
+                                continue;
+
+                        printf("  %s%6s: %" PRIu64 "\n",
+                               k + 1 < n ? "<" : ">=",
+                               format_timespan(bucket_str, sizeof(bucket_str), USEC_PER_MSEC << (k + 1 < n ? k : k - 1), 1),
+                               histogram[k]);
+                }
+        }
+        if (r < 0)
+                return bus_log_parse_error(r);
+
+        r = sd_bus_message_exit_container(reply);
+        if (r < 0)
+                return bus_log_parse_error(r);
+
+        return 0;
+}
+
 static int show_statistics(int argc, char **argv, void *userdata) {
         _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
         _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
         sd_bus *bus = userdata;
         uint64_t n_current_transactions, n_total_transactions,
                 cache_size, n_cache_hit, n_cache_miss,
+                cache_memory, n_cache_evicted, n_cache_prefetch,
+                n_synthesized_nxdomain, n_synthesized_nodata,
                 n_dnssec_secure, n_dnssec_insecure, n_dnssec_bogus, n_dnssec_indeterminate;
+        char memory_str[FORMAT_BYTES_MAX];
         int r, dnssec_supported;
 
         assert(bus);
@@ -1089,6 +1186,58 @@ static int show_statistics(int argc, char **argv, void *userdata) {
 
         reply = sd_bus_message_unref(reply);
 
+        /* Older versions of resolved do not track this, hence don't fail if it is missing */
+        r = sd_bus_get_property(bus,
+                                "org.freedesktop.resolve1",
+                                "/org/freedesktop/resolve1",
+                                "org.freedesktop.resolve1.Manager",
+                                "CacheUsage",
+                                &error,
+                                &reply,
+                                "(ttt)");
+        if (r >= 0) {
+                r = sd_bus_message_read(reply, "(ttt)",
+                                        &cache_memory,
+                                        &n_cache_evicted,
+                                        &n_cache_prefetch);
+                if (r < 0)
+                        return bus_log_parse_error(r);
+
+                printf("Current Cache Memory: %s\n"
+                       "     Cache Evictions: %" PRIu64 "\n"
+                       "    Cache Prefetches: %" PRIu64 "\n",
+                       format_bytes(memory_str, sizeof(memory_str), cache_memory),
+                       n_cache_evicted,
+                       n_cache_prefetch);
+
+                reply = sd_bus_message_unref(reply);
+        } else
+                sd_bus_error_free(&error);
+
+        r = sd_bus_get_property(bus,
+                                "org.freedesktop.resolve1",
+                                "/org/freedesktop/resolve1",
+                                "org.freedesktop.resolve1.Manager",
+                                "CacheSynthesizedNegatives",
+                                &error,
+                                &reply,
+                                "(tt)");
+        if (r >= 0) {
+                r = sd_bus_message_read(reply, "(tt)",
+                                        &n_synthesized_nxdomain,
+                                        &n_synthesized_nodata);
+                if (r < 0)
+                        return bus_log_parse_error(r);
+
+                printf("Synthesized NXDOMAIN: %" PRIu64 "\n"
+                       "  Synthesized NODATA: %" PRIu64 "\n",
+                       n_synthesized_nxdomain,
+                       n_synthesized_nodata);
+
+                reply = sd_bus_message_unref(reply);
+        } else
+                sd_bus_error_free(&error);
+
         r = sd_bus_get_property(bus,
                                 "org.freedesktop.resolve1",
                                 "/org/freedesktop/resolve1",
@@ -1120,7 +1269,7 @@ static int show_statistics(int argc, char **argv, void *userdata) {
                n_dnssec_bogus,
                n_dnssec_indeterminate);
 
-        return 0;
+        return show_server_rtts(bus);
 }
 
 static int reset_statistics(int argc, char **argv, void *userdata) {
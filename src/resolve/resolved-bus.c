@@ -1412,6 +1412,128 @@ static int bus_property_get_cache_statistics(
         return sd_bus_message_append(reply, "(ttt)", size, hit, miss);
 }
 
+static int bus_property_get_cache_usage(
+                sd_bus *bus,
+                const char *path,
+                const char *interface,
+                const char *property,
+                sd_bus_message *reply,
+                void *userdata,
+                sd_bus_error *error) {
+
+        uint64_t size = 0, evicted = 0, prefetch = 0;
+        Manager *m = userdata;
+        DnsScope *s;
+
+        assert(reply);
+        assert(m);
+
+        LIST_FOREACH(scopes, s, m->dns_scopes) {
+                size += s->cache.size;
+                evicted += s->cache.n_evicted;
+                prefetch += s->cache.n_prefetch;
+        }
+
+        return sd_bus_message_append(reply, "(ttt)", size, evicted, prefetch);
+}
+
+static int bus_property_get_cache_synthesized_negatives(
+                sd_bus *bus,
+                const char *path,
+                const char *interface,
+                const char *property,
+                sd_bus_message *reply,
+                void *userdata,
+                sd_bus_error *error) {
+
+        uint64_t nxdomain = 0, nodata = 0;
+        Manager *m = userdata;
+        DnsScope *s;
+
+        assert(reply);
+        assert(m);
+
+        LIST_FOREACH(scopes, s, m->dns_scopes) {
+                nxdomain += s->cache.n_synthesized_nxdomain;
+                nodata += s->cache.n_synthesized_nodata;
+        }
+
+        return sd_bus_message_append(reply, "(tt)", nxdomain, nodata);
+}
+
+static int bus_dns_server_append_rtt(sd_bus_message *reply, DnsServer *s) {
+        int r;
+
+        assert(reply);
+        assert(s);
+
+        r = sd_bus_message_open_container(reply, 'r', "iiayttat");
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_append(reply, "ii", dns_server_ifindex(s), s->family);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_append_array(reply, 'y', &s->address, FAMILY_ADDRESS_SIZE(s->family));
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_append(reply, "tt", (uint64_t) s->rtt_smoothed, (uint64_t) s->rtt_variation);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_append_array(reply, 't', s->rtt_histogram, sizeof(s->rtt_histogram));
+        if (r < 0)
+                return r;
+
+        return sd_bus_message_close_container(reply);
+}
+
+static int bus_property_get_dns_server_rtts(
+                sd_bus *bus,
+                const char *path,
+                const char *interface,
+                const char *property,
+                sd_bus_message *reply,
+                void *userdata,
+                sd_bus_error *error) {
+
+        Manager *m = userdata;
+        DnsServer *s;
+        Iterator i;
+        Link *l;
+        int r;
+
+        assert(reply);
+        assert(m);
+
+        r = sd_bus_message_open_container(reply, 'a', "(iiayttat)");
+        if (r < 0)
+                return r;
+
+        LIST_FOREACH(servers, s, m->dns_servers) {
+                r = bus_dns_server_append_rtt(reply, s);
+                if (r < 0)
+                        return r;
+        }
+
+        LIST_FOREACH(servers, s, m->fallback_dns_servers) {
+                r = bus_dns_server_append_rtt(reply, s);
+                if (r < 0)
+                        return r;
+        }
+
+        HASHMAP_FOREACH(l, m->links, i)
+                LIST_FOREACH(servers, s, l->dns_servers) {
+                        r = bus_dns_server_append_rtt(reply, s);
+                        if (r < 0)
+                                return r;
+                }
+
+        return sd_bus_message_close_container(reply);
+}
+
 static int bus_property_get_dnssec_statistics(
                 sd_bus *bus,
                 const char *path,
@@ -1470,13 +1592,26 @@ static BUS_DEFINE_PROPERTY_GET2(bus_property_get_dns_over_tls_mode, "s", Manager
 
 static int bus_method_reset_statistics(sd_bus_message *message, void *userdata, sd_bus_error *error) {
         Manager *m = userdata;
+        DnsServer *server;
         DnsScope *s;
+        Iterator i;
+        Link *l;
 
         assert(message);
         assert(m);
 
-        LIST_FOREACH(scopes, s, m->dns_scopes)
-                s->cache.n_hit = s->cache.n_miss = 0;
+        LIST_FOREACH(scopes, s, m->dns_scopes) {
+                s->cache.n_hit = s->cache.n_miss = s->cache.n_evicted = s->cache.n_prefetch = 0;
+                s->cache.n_synthesized_nxdomain = s->cache.n_synthesized_nodata = 0;
+        }
+
+        LIST_FOREACH(servers, server, m->dns_servers)
+                zero(server->rtt_histogram);
+        LIST_FOREACH(servers, server, m->fallback_dns_servers)
+                zero(server->rtt_histogram);
+        HASHMAP_FOREACH(l, m->links, i)
+                LIST_FOREACH(servers, server, l->dns_servers)
+                        zero(server->rtt_histogram);
 
         m->n_transactions_total = 0;
         zero(m->n_dnssec_verdict);
@@ -1838,6 +1973,9 @@ static const sd_bus_vtable resolve_vtable[] = {
         SD_BUS_PROPERTY("Domains", "a(isb)", bus_property_get_domains, 0, 0),
         SD_BUS_PROPERTY("TransactionStatistics", "(tt)", bus_property_get_transaction_statistics, 0, 0),
         SD_BUS_PROPERTY("CacheStatistics", "(ttt)", bus_property_get_cache_statistics, 0, 0),
+        SD_BUS_PROPERTY("CacheUsage", "(ttt)", bus_property_get_cache_usage, 0, 0),
+        SD_BUS_PROPERTY("CacheSynthesizedNegatives", "(tt)", bus_property_get_cache_synthesized_negatives, 0, 0),
+        SD_BUS_PROPERTY("DNSServerRoundTripTimes", "a(iiayttat)", bus_property_get_dns_server_rtts, 0, 0),
         SD_BUS_PROPERTY("DNSSEC", "s", bus_property_get_dnssec_mode, 0, 0),
         SD_BUS_PROPERTY("DNSSECStatistics", "(tttt)", bus_property_get_dnssec_statistics, 0, 0),
         SD_BUS_PROPERTY("DNSSECSupported", "b", bus_property_get_dnssec_supported, 0, 0),
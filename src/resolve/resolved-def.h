@@ -23,5 +23,8 @@
 
 #define SD_RESOLVED_QUERY_TIMEOUT_USEC (120 * USEC_PER_SEC)
 
+/* The socket nss-resolve looks up names on, as long as it exists, instead of calling into resolved via the bus */
+#define SD_RESOLVED_VARLINK_PATH "/run/systemd/resolve/io.systemd.Resolve"
+
 /* 127.0.0.53 in native endian */
 #define INADDR_DNS_STUB ((in_addr_t) 0x7f000035U)
@@ -7,6 +7,7 @@
 #include "dns-domain.h"
 #include "resolved-dns-answer.h"
 #include "resolved-dns-cache.h"
+#include "resolved-dns-dnssec.h"
 #include "resolved-dns-packet.h"
 #include "string-util.h"
 
@@ -14,6 +15,14 @@
  * leave DNS caches unbounded, but that's crazy. */
 #define CACHE_MAX 4096
 
+/* Also don't use more than 2M of memory, as some RRs are large */
+#define CACHE_SIZE_MAX (2U * 1024U * 1024U)
+
+/* Entries which were used at least that often are refreshed in the background when they are used again in the last
+ * tenth of their lifetime, so that popular names do not drop out of the cache */
+#define CACHE_PREFETCH_HITS_MIN 2U
+#define CACHE_PREFETCH_LIFETIME_DIVISOR 10U
+
 /* We never keep any item longer than 2h in our cache */
 #define CACHE_TTL_MAX_USEC (2 * USEC_PER_HOUR)
 
@@ -37,16 +46,25 @@ struct DnsCacheItem {
         DnsResourceRecord *rr;
         int rcode;
 
+        usec_t timestamp;
         usec_t until;
         bool authenticated:1;
         bool shared_owner:1;
+        bool prefetched:1;
+        bool nsec_indexed:1;
+
+        usec_t last_used;
+        unsigned n_hit;
+        size_t size;
 
         int ifindex;
         int owner_family;
         union in_addr_union owner_address;
 
         unsigned prioq_idx;
+        unsigned use_prioq_idx;
         LIST_FIELDS(DnsCacheItem, by_key);
+        LIST_FIELDS(DnsCacheItem, by_nsec_zone);
 };
 
 static const char *dns_cache_item_type_to_string(DnsCacheItem *item) {
@@ -81,6 +99,123 @@ static void dns_cache_item_free(DnsCacheItem *i) {
 
 DEFINE_TRIVIAL_CLEANUP_FUNC(DnsCacheItem*, dns_cache_item_free);
 
+static size_t dns_cache_item_size(DnsCacheItem *i) {
+        size_t size;
+
+        assert(i);
+
+        /* This is only an estimate, keys might be shared with other items, and the RDATA of RRs uses more memory
+         * when it is unpacked than on the wire */
+
+        size = sizeof(DnsCacheItem) + sizeof(DnsResourceKey) + strlen(dns_resource_key_name(i->key)) + 1;
+        if (i->rr)
+                size += sizeof(DnsResourceRecord) + i->rr->rdlength;
+
+        return size;
+}
+
+static bool dns_cache_item_is_nsec(DnsCacheItem *i) {
+        assert(i);
+
+        /* Only NSEC/NSEC3 RRs which were validated may be used to derive negative answers for other names, see RFC
+         * 8198 */
+        return i->rr &&
+                i->authenticated &&
+                !i->shared_owner &&
+                IN_SET(i->rr->key->type, DNS_TYPE_NSEC, DNS_TYPE_NSEC3);
+}
+
+static const char *dns_cache_item_nsec_zone(DnsCacheItem *i) {
+        const char *n;
+
+        /* NSEC/NSEC3 RRs are indexed by the parent of their owner name. That is the zone for NSEC3 RRs, and usually
+         * a zone, or at least one of the names below it, for NSEC RRs. */
+        n = dns_resource_key_name(i->rr->key);
+        if (dns_name_parent(&n) <= 0)
+                return NULL;
+
+        return n;
+}
+
+static int dns_cache_index_nsec(DnsCache *c, DnsCacheItem *i) {
+        _cleanup_free_ char *copy = NULL;
+        DnsCacheItem *first;
+        const char *zone;
+        int r;
+
+        assert(c);
+        assert(i);
+
+        if (!dns_cache_item_is_nsec(i))
+                return 0;
+
+        zone = dns_cache_item_nsec_zone(i);
+        if (!zone)
+                return 0;
+
+        first = hashmap_get(c->nsec_by_zone, zone);
+        if (first) {
+                LIST_PREPEND(by_nsec_zone, first, i);
+                assert_se(hashmap_update(c->nsec_by_zone, zone, first) >= 0);
+        } else {
+                r = hashmap_ensure_allocated(&c->nsec_by_zone, &dns_name_hash_ops);
+                if (r < 0)
+                        return r;
+
+                copy = strdup(zone);
+                if (!copy)
+                        return -ENOMEM;
+
+                r = hashmap_put(c->nsec_by_zone, copy, i);
+                if (r < 0)
+                        return r;
+
+                TAKE_PTR(copy);
+        }
+
+        i->nsec_indexed = true;
+        return 1;
+}
+
+static void dns_cache_unindex_nsec(DnsCache *c, DnsCacheItem *i) {
+        DnsCacheItem *first;
+        const char *zone;
+        char *key;
+
+        assert(c);
+        assert(i);
+
+        if (!i->nsec_indexed)
+                return;
+
+        zone = dns_cache_item_nsec_zone(i);
+        assert(zone);
+
+        first = hashmap_get2(c->nsec_by_zone, zone, (void**) &key);
+        LIST_REMOVE(by_nsec_zone, first, i);
+
+        if (first)
+                assert_se(hashmap_update(c->nsec_by_zone, key, first) >= 0);
+        else {
+                hashmap_remove(c->nsec_by_zone, key);
+                free(key);
+        }
+
+        i->nsec_indexed = false;
+}
+
+static void dns_cache_unlink_item(DnsCache *c, DnsCacheItem *i) {
+        assert(c);
+        assert(i);
+
+        prioq_remove(c->by_expiry, i, &i->prioq_idx);
+        prioq_remove(c->by_use, i, &i->use_prioq_idx);
+        dns_cache_unindex_nsec(c, i);
+
+        assert(c->size >= i->size);
+        c->size -= i->size;
+}
+
 static void dns_cache_item_unlink_and_free(DnsCache *c, DnsCacheItem *i) {
         DnsCacheItem *first;
 
@@ -97,7 +232,7 @@ static void dns_cache_item_unlink_and_free(DnsCache *c, DnsCacheItem *i) {
         else
                 hashmap_remove(c->by_key, i->key);
 
-        prioq_remove(c->by_expiry, i, &i->prioq_idx);
+        dns_cache_unlink_item(c, i);
 
         dns_cache_item_free(i);
 }
@@ -131,7 +266,7 @@ static bool dns_cache_remove_by_key(DnsCache *c, DnsResourceKey *key) {
                 return false;
 
         LIST_FOREACH_SAFE(by_key, i, n, first) {
-                prioq_remove(c->by_expiry, i, &i->prioq_idx);
+                dns_cache_unlink_item(c, i);
                 dns_cache_item_free(i);
         }
 
@@ -148,12 +283,19 @@ void dns_cache_flush(DnsCache *c) {
 
         assert(hashmap_size(c->by_key) == 0);
         assert(prioq_size(c->by_expiry) == 0);
+        assert(prioq_size(c->by_use) == 0);
+        assert(c->size == 0);
+        assert(hashmap_size(c->nsec_by_zone) == 0);
 
         c->by_key = hashmap_free(c->by_key);
+        c->nsec_by_zone = hashmap_free(c->nsec_by_zone);
         c->by_expiry = prioq_free(c->by_expiry);
+        c->by_use = prioq_free(c->by_use);
 }
 
 static void dns_cache_make_space(DnsCache *c, unsigned add) {
+        usec_t t = 0;
+
         assert(c);
 
         if (add <= 0)
@@ -162,7 +304,9 @@ static void dns_cache_make_space(DnsCache *c, unsigned add) {
         /* Makes space for n new entries. Note that we actually allow
          * the cache to grow beyond CACHE_MAX, but only when we shall
          * add more RRs to the cache than CACHE_MAX at once. In that
-         * case the cache will be emptied completely otherwise. */
+         * case the cache will be emptied completely otherwise. The
+         * size of the new entries is not known yet, hence the cache
+         * might also grow beyond CACHE_SIZE_MAX by one reply. */
 
         for (;;) {
                 _cleanup_(dns_resource_key_unrefp) DnsResourceKey *key = NULL;
@@ -171,12 +315,25 @@ static void dns_cache_make_space(DnsCache *c, unsigned add) {
                 if (prioq_size(c->by_expiry) <= 0)
                         break;
 
-                if (prioq_size(c->by_expiry) + add < CACHE_MAX)
+                if (prioq_size(c->by_expiry) + add < (CACHE_MAX >> c->limit_shift) &&
+                    c->size < (CACHE_SIZE_MAX >> c->limit_shift))
                         break;
 
+                if (t <= 0)
+                        t = now(clock_boottime_or_monotonic());
+
+                /* Drop expired entries first, and then those which
+                 * were not used for the longest time */
                 i = prioq_peek(c->by_expiry);
                 assert(i);
 
+                if (i->until > t) {
+                        i = prioq_peek(c->by_use);
+                        assert(i);
+
+                        c->n_evicted++;
+                }
+
                 /* Take an extra reference to the key so that it
                  * doesn't go away in the middle of the remove call */
                 key = dns_resource_key_ref(i->key);
@@ -225,12 +382,46 @@ void dns_cache_prune(DnsCache *c) {
         }
 }
 
+void dns_cache_trim(DnsCache *c, MemoryPressureLevel level) {
+        assert(c);
+
+        /* While memory is short, the cache gets only a fraction of its usual size. Under full pressure it is
+         * emptied right away, otherwise we drop what is expired and then the least recently used entries. */
+
+        switch (level) {
+
+        case MEMORY_PRESSURE_NONE:
+                c->limit_shift = 0;
+                break;
+
+        case MEMORY_PRESSURE_SOME:
+                c->limit_shift = 2;
+                dns_cache_prune(c);
+                dns_cache_make_space(c, 1);
+                break;
+
+        case MEMORY_PRESSURE_FULL:
+                c->limit_shift = 4;
+                dns_cache_flush(c);
+                break;
+
+        default:
+                assert_not_reached("Unknown memory pressure level");
+        }
+}
+
 static int dns_cache_item_prioq_compare_func(const void *a, const void *b) {
         const DnsCacheItem *x = a, *y = b;
 
         return CMP(x->until, y->until);
 }
 
+static int dns_cache_item_use_prioq_compare_func(const void *a, const void *b) {
+        const DnsCacheItem *x = a, *y = b;
+
+        return CMP(x->last_used, y->last_used);
+}
+
 static int dns_cache_init(DnsCache *c) {
         int r;
 
@@ -240,6 +431,10 @@ static int dns_cache_init(DnsCache *c) {
         if (r < 0)
                 return r;
 
+        r = prioq_ensure_allocated(&c->by_use, dns_cache_item_use_prioq_compare_func);
+        if (r < 0)
+                return r;
+
         r = hashmap_ensure_allocated(&c->by_key, &dns_resource_key_hash_ops);
         if (r < 0)
                 return r;
@@ -258,6 +453,12 @@ static int dns_cache_link_item(DnsCache *c, DnsCacheItem *i) {
         if (r < 0)
                 return r;
 
+        r = prioq_put(c->by_use, i, &i->use_prioq_idx);
+        if (r < 0) {
+                prioq_remove(c->by_expiry, i, &i->prioq_idx);
+                return r;
+        }
+
         first = hashmap_get(c->by_key, i->key);
         if (first) {
                 _cleanup_(dns_resource_key_unrefp) DnsResourceKey *k = NULL;
@@ -279,10 +480,17 @@ static int dns_cache_link_item(DnsCache *c, DnsCacheItem *i) {
                 r = hashmap_put(c->by_key, i->key, i);
                 if (r < 0) {
                         prioq_remove(c->by_expiry, i, &i->prioq_idx);
+                        prioq_remove(c->by_use, i, &i->use_prioq_idx);
                         return r;
                 }
         }
 
+        i->size = dns_cache_item_size(i);
+        c->size += i->size;
+
+        /* This is only an optimization, hence the item stays cached even if it cannot be indexed */
+        (void) dns_cache_index_nsec(c, i);
+
         return 0;
 }
 
@@ -366,9 +574,15 @@ static void dns_cache_item_update_positive(
         dns_resource_key_unref(i->key);
         i->key = dns_resource_key_ref(rr->key);
 
+        c->size -= i->size;
+        i->size = dns_cache_item_size(i);
+        c->size += i->size;
+
+        i->timestamp = timestamp;
         i->until = calculate_until(rr, (uint32_t) -1, timestamp, false);
         i->authenticated = authenticated;
         i->shared_owner = shared_owner;
+        i->prefetched = false;
 
         i->ifindex = ifindex;
 
@@ -442,6 +656,7 @@ static int dns_cache_put_positive(
         i->type = DNS_CACHE_POSITIVE;
         i->key = dns_resource_key_ref(rr->key);
         i->rr = dns_resource_record_ref(rr);
+        i->timestamp = i->last_used = timestamp;
         i->until = calculate_until(rr, (uint32_t) -1, timestamp, false);
         i->authenticated = authenticated;
         i->shared_owner = shared_owner;
@@ -449,6 +664,7 @@ static int dns_cache_put_positive(
         i->owner_family = owner_family;
         i->owner_address = *owner_address;
         i->prioq_idx = PRIOQ_IDX_NULL;
+        i->use_prioq_idx = PRIOQ_IDX_NULL;
 
         r = dns_cache_link_item(c, i);
         if (r < 0)
@@ -526,6 +742,7 @@ static int dns_cache_put_negative(
         i->type =
                 rcode == DNS_RCODE_SUCCESS ? DNS_CACHE_NODATA :
                 rcode == DNS_RCODE_NXDOMAIN ? DNS_CACHE_NXDOMAIN : DNS_CACHE_RCODE;
+        i->timestamp = i->last_used = timestamp;
         i->until =
                 i->type == DNS_CACHE_RCODE ? timestamp + CACHE_TTL_STRANGE_RCODE_USEC :
                 calculate_until(soa, nsec_ttl, timestamp, true);
@@ -533,6 +750,7 @@ static int dns_cache_put_negative(
         i->owner_family = owner_family;
         i->owner_address = *owner_address;
         i->prioq_idx = PRIOQ_IDX_NULL;
+        i->use_prioq_idx = PRIOQ_IDX_NULL;
         i->rcode = rcode;
 
         if (i->type == DNS_CACHE_NXDOMAIN) {
@@ -812,7 +1030,122 @@ static DnsCacheItem *dns_cache_get_by_key_follow_cname_dname_nsec(DnsCache *c, D
         return NULL;
 }
 
-int dns_cache_lookup(DnsCache *c, DnsResourceKey *key, bool clamp_ttl, int *rcode, DnsAnswer **ret, bool *authenticated) {
+/* Returns 1 and the rcode if the cached NSEC/NSEC3 RRs prove that the key does not exist, and 0 otherwise */
+static int dns_cache_synthesize_negative(DnsCache *c, DnsResourceKey *key, int *ret_rcode) {
+        _cleanup_(dns_answer_unrefp) DnsAnswer *answer = NULL;
+        DnssecNsecResult result;
+        bool authenticated = false;
+        DnsCacheItem *i;
+        const char *n;
+        unsigned k;
+        int r;
+
+        assert(c);
+        assert(key);
+        assert(ret_rcode);
+
+        if (hashmap_isempty(c->nsec_by_zone))
+                return 0;
+
+        /* We only cache NSEC/NSEC3 RRs from the lower zone, see rr_eligible(), hence they say nothing about DS
+         * RRs. */
+        if (IN_SET(key->type, DNS_TYPE_DS, DNS_TYPE_NSEC, DNS_TYPE_NSEC3))
+                return 0;
+
+        /* Collect the RRs indexed under the name and all its parents, i.e. those of all zones the name might be
+         * in, and let the DNSSEC logic figure out whether they prove anything. Twice, in order to size the answer
+         * right first. */
+        for (k = 0; k < 2; k++) {
+                unsigned n_rrs = 0;
+
+                n = dns_resource_key_name(key);
+                for (;;) {
+                        LIST_FOREACH(by_nsec_zone, i, hashmap_get(c->nsec_by_zone, n)) {
+                                if (answer) {
+                                        r = dns_answer_add(answer, i->rr, i->ifindex, DNS_ANSWER_AUTHENTICATED);
+                                        if (r < 0)
+                                                return r;
+                                }
+
+                                n_rrs++;
+                        }
+
+                        r = dns_name_parent(&n);
+                        if (r < 0)
+                                return r;
+                        if (r == 0)
+                                break;
+                }
+
+                if (n_rrs == 0)
+                        return 0;
+
+                if (!answer) {
+                        answer = dns_answer_new(n_rrs);
+                        if (!answer)
+                                return -ENOMEM;
+                }
+        }
+
+        r = dnssec_nsec_test(answer, key, &result, &authenticated, NULL);
+        if (r < 0)
+                return r;
+        if (!authenticated)
+                return 0;
+
+        switch (result) {
+
+        case DNSSEC_NSEC_NXDOMAIN:
+                c->n_synthesized_nxdomain++;
+                *ret_rcode = DNS_RCODE_NXDOMAIN;
+                return 1;
+
+        case DNSSEC_NSEC_NODATA:
+                c->n_synthesized_nodata++;
+                *ret_rcode = DNS_RCODE_SUCCESS;
+                return 1;
+
+        default:
+                return 0;
+        }
+}
+
+static bool dns_cache_use(DnsCache *c, DnsCacheItem *first, bool use_prefetch) {
+        bool prefetch = use_prefetch;
+        DnsCacheItem *j;
+        usec_t t;
+
+        assert(c);
+        assert(first);
+
+        /* Moves the items to the end of the LRU list, and returns true if they are used often enough and expire soon
+         * enough to be refreshed ahead of time. Items are only refreshed once, until they are replaced. */
+
+        t = now(clock_boottime_or_monotonic());
+
+        LIST_FOREACH(by_key, j, first) {
+                j->last_used = t;
+                j->n_hit++;
+                prioq_reshuffle(c->by_use, j, &j->use_prioq_idx);
+
+                if (j->prefetched ||
+                    j->shared_owner ||
+                    j->n_hit < CACHE_PREFETCH_HITS_MIN ||
+                    j->until <= t ||
+                    (j->until - t) * CACHE_PREFETCH_LIFETIME_DIVISOR > LESS_BY(j->until, j->timestamp))
+                        prefetch = false;
+        }
+
+        if (!prefetch)
+                return false;
+
+        LIST_FOREACH(by_key, j, first)
+                j->prefetched = true;
+
+        return true;
+}
+
+int dns_cache_lookup(DnsCache *c, DnsResourceKey *key, bool clamp_ttl, int *rcode, DnsAnswer **ret, bool *authenticated, bool *prefetch) {
         _cleanup_(dns_answer_unrefp) DnsAnswer *answer = NULL;
         char key_str[DNS_RESOURCE_KEY_STRING_MAX];
         unsigned n = 0;
@@ -828,6 +1161,9 @@ int dns_cache_lookup(DnsCache *c, DnsResourceKey *key, bool clamp_ttl, int *rcod
         assert(rcode);
         assert(ret);
         assert(authenticated);
+        assert(prefetch);
+
+        *prefetch = false;
 
         if (key->type == DNS_TYPE_ANY || key->class == DNS_CLASS_ANY) {
                 /* If we have ANY lookups we don't use the cache, so
@@ -847,6 +1183,25 @@ int dns_cache_lookup(DnsCache *c, DnsResourceKey *key, bool clamp_ttl, int *rcod
 
         first = dns_cache_get_by_key_follow_cname_dname_nsec(c, key);
         if (!first) {
+                int synthesized_rcode;
+
+                /* Maybe the name is covered by the NSEC/NSEC3 RRs of some other name? Note that an error here is
+                 * simply a cache miss, after all this is just an optimization. */
+                r = dns_cache_synthesize_negative(c, key, &synthesized_rcode);
+                if (r > 0) {
+                        log_debug("Synthesized %s from cached NSEC/NSEC3 for %s",
+                                  synthesized_rcode == DNS_RCODE_NXDOMAIN ? "NXDOMAIN" : "NODATA",
+                                  dns_resource_key_to_string(key, key_str, sizeof key_str));
+
+                        c->n_hit++;
+
+                        *ret = NULL;
+                        *rcode = synthesized_rcode;
+                        *authenticated = true;
+
+                        return 1;
+                }
+
                 /* If one question cannot be answered we need to refresh */
 
                 log_debug("Cache miss for %s",
@@ -887,6 +1242,8 @@ int dns_cache_lookup(DnsCache *c, DnsResourceKey *key, bool clamp_ttl, int *rcod
                 *rcode = found_rcode;
                 *authenticated = false;
 
+                (void) dns_cache_use(c, first, false);
+
                 c->n_hit++;
                 return 1;
         }
@@ -909,6 +1266,7 @@ int dns_cache_lookup(DnsCache *c, DnsResourceKey *key, bool clamp_ttl, int *rcod
                 if (!bitmap_isset(nsec->rr->nsec.types, key->type) &&
                     !bitmap_isset(nsec->rr->nsec.types, DNS_TYPE_CNAME) &&
                     !bitmap_isset(nsec->rr->nsec.types, DNS_TYPE_DNAME)) {
+                        *prefetch = dns_cache_use(c, first, true);
                         c->n_hit++;
                         return 1;
                 }
@@ -923,6 +1281,7 @@ int dns_cache_lookup(DnsCache *c, DnsResourceKey *key, bool clamp_ttl, int *rcod
                   dns_resource_key_to_string(key, key_str, sizeof key_str));
 
         if (n <= 0) {
+                *prefetch = dns_cache_use(c, first, true);
                 c->n_hit++;
 
                 *ret = NULL;
@@ -957,6 +1316,7 @@ int dns_cache_lookup(DnsCache *c, DnsResourceKey *key, bool clamp_ttl, int *rcod
                         return r;
         }
 
+        *prefetch = dns_cache_use(c, first, true);
         c->n_hit++;
 
         *ret = answer;
@@ -3,14 +3,26 @@
 
 #include "hashmap.h"
 #include "list.h"
+#include "memory-pressure.h"
 #include "prioq.h"
 #include "time-util.h"
 
 typedef struct DnsCache {
         Hashmap *by_key;
         Prioq *by_expiry;
+        Prioq *by_use;          /* least recently used first */
+        size_t size;            /* estimated memory use of all items in bytes */
         unsigned n_hit;
         unsigned n_miss;
+        unsigned n_evicted;     /* RRsets dropped before they expired, to make space */
+        unsigned n_prefetch;    /* RRsets refreshed before they expired, as they were used often */
+        unsigned limit_shift;   /* the size limits are divided by 2^limit_shift while memory is short */
+
+        /* Validated NSEC/NSEC3 items, by the parent name of their owner, and the number of negative answers they
+         * proved for names we had no other cache entry for (RFC 8198) */
+        Hashmap *nsec_by_zone;
+        unsigned n_synthesized_nxdomain;
+        unsigned n_synthesized_nodata;
 } DnsCache;
 
 #include "resolved-dns-answer.h"
@@ -20,9 +32,10 @@ typedef struct DnsCache {
 
 void dns_cache_flush(DnsCache *c);
 void dns_cache_prune(DnsCache *c);
+void dns_cache_trim(DnsCache *c, MemoryPressureLevel level);
 
 int dns_cache_put(DnsCache *c, DnsResourceKey *key, int rcode, DnsAnswer *answer, bool authenticated, uint32_t nsec_ttl, usec_t timestamp, int owner_family, const union in_addr_union *owner_address);
-int dns_cache_lookup(DnsCache *c, DnsResourceKey *key, bool clamp_ttl, int *rcode, DnsAnswer **answer, bool *authenticated);
+int dns_cache_lookup(DnsCache *c, DnsResourceKey *key, bool clamp_ttl, int *rcode, DnsAnswer **answer, bool *authenticated, bool *prefetch);
 
 int dns_cache_check_conflicts(DnsCache *cache, DnsResourceRecord *rr, int owner_family, const union in_addr_union *owner_address);
 
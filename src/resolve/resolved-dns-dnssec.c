@@ -14,6 +14,8 @@
 #include "hexdecoct.h"
 #include "resolved-dns-dnssec.h"
 #include "resolved-dns-packet.h"
+#include "set.h"
+#include "siphash24.h"
 #include "string-table.h"
 
 #define VERIFY_RRS_MAX 256
@@ -25,6 +27,9 @@
 /* Maximum number of NSEC3 iterations we'll do. RFC5155 says 2500 shall be the maximum useful value */
 #define NSEC3_ITERATIONS_MAX 2500
 
+/* Maximum number of signatures we remember to have verified successfully */
+#define VERIFIED_SIGNATURES_MAX 4096U
+
 /*
  * The DNSSEC Chain of trust:
  *
@@ -680,6 +685,109 @@ static void dnssec_fix_rrset_ttl(
         rrsig->expiry = rrsig->rrsig.expiration * USEC_PER_SEC;
 }
 
+/* The same RRsets are validated with the same signatures and keys over and over again, as long as they are cached by
+ * the servers we talk to, but not by us, or when the auxiliary DNSKEY and DS RRs are looked up for multiple
+ * transactions. Hence remember the digests of all data covered by signatures that were found valid, i.e. the signed
+ * data, the signature and the key, until the signature expires. Failures are not remembered. */
+
+typedef struct VerifiedSignature {
+        uint8_t digest[32];
+        usec_t until;
+} VerifiedSignature;
+
+static void verified_signature_hash_func(const VerifiedSignature *v, struct siphash *state) {
+        siphash24_compress(v->digest, sizeof(v->digest), state);
+}
+
+static int verified_signature_compare_func(const VerifiedSignature *a, const VerifiedSignature *b) {
+        return memcmp(a->digest, b->digest, sizeof(a->digest));
+}
+
+DEFINE_PRIVATE_HASH_OPS_WITH_KEY_DESTRUCTOR(verified_signature_hash_ops, VerifiedSignature, verified_signature_hash_func, verified_signature_compare_func, free);
+
+static Set *verified_signatures = NULL;
+
+static int verified_signature_digest(
+                const void *sig_data,
+                size_t sig_size,
+                DnsResourceRecord *rrsig,
+                DnsResourceRecord *dnskey,
+                VerifiedSignature *ret) {
+
+        _cleanup_(gcry_md_closep) gcry_md_hd_t md = NULL;
+        void *digest;
+
+        assert(sig_data || sig_size == 0);
+        assert(rrsig);
+        assert(dnskey);
+        assert(ret);
+
+        gcry_md_open(&md, GCRY_MD_SHA256, 0);
+        if (!md)
+                return -EIO;
+
+        assert(gcry_md_get_algo_dlen(GCRY_MD_SHA256) == sizeof(ret->digest));
+
+        gcry_md_write(md, sig_data, sig_size);
+        gcry_md_write(md, rrsig->rrsig.signature, rrsig->rrsig.signature_size);
+        gcry_md_putc(md, dnskey->dnskey.algorithm);
+        gcry_md_write(md, dnskey->dnskey.key, dnskey->dnskey.key_size);
+
+        digest = gcry_md_read(md, 0);
+        if (!digest)
+                return -EIO;
+
+        memcpy(ret->digest, digest, sizeof(ret->digest));
+        ret->until = usec_add(rrsig->rrsig.expiration * USEC_PER_SEC, SKEW_MAX);
+
+        return 0;
+}
+
+static void verified_signatures_prune(usec_t realtime) {
+        VerifiedSignature *v;
+        Iterator i;
+
+        if (realtime == USEC_INFINITY)
+                realtime = now(CLOCK_REALTIME);
+
+        SET_FOREACH(v, verified_signatures, i)
+                if (v->until < realtime)
+                        free(set_remove(verified_signatures, v));
+
+        /* If all of them are still valid, make room by dropping an arbitrary one */
+        if (set_size(verified_signatures) >= VERIFIED_SIGNATURES_MAX)
+                free(set_steal_first(verified_signatures));
+}
+
+static int verified_signature_remember(const VerifiedSignature *v, usec_t realtime) {
+        _cleanup_free_ VerifiedSignature *copy = NULL;
+        int r;
+
+        assert(v);
+
+        if (set_size(verified_signatures) >= VERIFIED_SIGNATURES_MAX)
+                verified_signatures_prune(realtime);
+
+        r = set_ensure_allocated(&verified_signatures, &verified_signature_hash_ops);
+        if (r < 0)
+                return r;
+
+        copy = newdup(VerifiedSignature, v, 1);
+        if (!copy)
+                return -ENOMEM;
+
+        r = set_put(verified_signatures, copy);
+        if (r <= 0)
+                return r;
+
+        TAKE_PTR(copy);
+        return 1;
+}
+
+void dnssec_flush_verified_signatures(void) {
+        verified_signatures = set_free(verified_signatures);
+}
+
 int dnssec_verify_rrset(
                 DnsAnswer *a,
                 const DnsResourceKey *key,
@@ -697,6 +805,7 @@ int dnssec_verify_rrset(
         size_t sig_size = 0;
         _cleanup_free_ char *sig_data = NULL;
         _cleanup_fclose_ FILE *f = NULL;
+        VerifiedSignature verified;
         size_t hash_size;
         void *hash;
         bool wildcard;
@@ -885,6 +994,15 @@ int dnssec_verify_rrset(
                         return -EIO;
         }
 
+        r = verified_signature_digest(sig_data, sig_size, rrsig, dnskey, &verified);
+        if (r < 0)
+                return r;
+
+        if (set_contains(verified_signatures, &verified)) {
+                r = 1;
+                goto finish;
+        }
+
         switch (rrsig->rrsig.algorithm) {
 
         case DNSSEC_ALGORITHM_RSASHA1:
@@ -920,6 +1038,11 @@ int dnssec_verify_rrset(
         if (r < 0)
                 return r;
 
+        if (r > 0)
+                /* Not being able to remember it only means we verify it again next time */
+                (void) verified_signature_remember(&verified, realtime);
+
+finish:
         /* Now, fix the ttl, expiry, and remember the synthesizing source and the signer */
         if (r > 0)
                 dnssec_fix_rrset_ttl(list, n, rrsig, realtime);
@@ -2206,6 +2329,9 @@ int dnssec_test_positive_wildcard(
 
 #else
 
+void dnssec_flush_verified_signatures(void) {
+}
+
 int dnssec_verify_rrset(
                 DnsAnswer *a,
                 const DnsResourceKey *key,
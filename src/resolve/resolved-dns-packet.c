@@ -166,11 +166,24 @@ DnsPacket *dns_packet_ref(DnsPacket *p) {
         return p;
 }
 
+static void dns_packet_forget_read_keys(DnsPacket *p) {
+        unsigned i;
+
+        assert(p);
+
+        for (i = 0; i < MIN(p->n_read_keys, DNS_PACKET_READ_KEYS_MAX); i++)
+                p->read_keys[i] = dns_resource_key_unref(p->read_keys[i]);
+
+        p->n_read_keys = 0;
+}
+
 static void dns_packet_free(DnsPacket *p) {
         char *s;
 
         assert(p);
 
+        dns_packet_forget_read_keys(p);
+
         dns_question_unref(p->question);
         dns_answer_unref(p->answer);
         dns_resource_record_unref(p->opt);
@@ -1561,19 +1574,86 @@ static int dns_packet_read_type_windows(DnsPacket *p, Bitmap **types, size_t siz
         return 0;
 }
 
+static bool dns_packet_name_offset(DnsPacket *p, size_t *ret) {
+        const uint8_t *d = DNS_PACKET_DATA(p);
+        size_t i = p->rindex;
+
+        assert(p);
+        assert(ret);
+
+        /* Finds where the labels of the name at the read index start, by following the compression pointers in
+         * front of them the same way dns_packet_read_name() does. The name is then the same as the one read from
+         * that offset. Returns false if the pointers are invalid, the name will then fail to parse anyway. */
+
+        while (i < p->size && (d[i] & 0xc0) == 0xc0) {
+                uint16_t ptr;
+
+                if (p->refuse_compression || i + 1 >= p->size)
+                        return false;
+
+                ptr = (uint16_t) (d[i] & ~0xc0) << 8 | (uint16_t) d[i + 1];
+                if (ptr < DNS_PACKET_HEADER_SIZE || ptr >= i)
+                        return false;
+
+                i = ptr;
+        }
+
+        if (i >= p->size)
+                return false;
+
+        *ret = i;
+        return true;
+}
+
+static DnsResourceKey *dns_packet_find_read_key(DnsPacket *p, size_t offset, uint16_t class, uint16_t type) {
+        unsigned i;
+
+        assert(p);
+
+        for (i = 0; i < MIN(p->n_read_keys, DNS_PACKET_READ_KEYS_MAX); i++)
+                if (p->read_key_offsets[i] == offset &&
+                    p->read_keys[i]->class == class &&
+                    p->read_keys[i]->type == type)
+                        return dns_resource_key_ref(p->read_keys[i]);
+
+        return NULL;
+}
+
+static void dns_packet_remember_read_key(DnsPacket *p, size_t offset, DnsResourceKey *key) {
+        unsigned i;
+
+        assert(p);
+        assert(key);
+
+        i = p->n_read_keys++ % DNS_PACKET_READ_KEYS_MAX;
+
+        dns_resource_key_unref(p->read_keys[i]);
+        p->read_keys[i] = dns_resource_key_ref(key);
+        p->read_key_offsets[i] = offset;
+}
+
 int dns_packet_read_key(DnsPacket *p, DnsResourceKey **ret, bool *ret_cache_flush, size_t *start) {
         _cleanup_(rewind_dns_packet) DnsPacketRewinder rewinder;
         _cleanup_free_ char *name = NULL;
-        bool cache_flush = false;
+        bool cache_flush = false, reuse = false;
+        DnsResourceKey *key = NULL;
         uint16_t class, type;
-        DnsResourceKey *key;
+        size_t offset;
         int r;
 
         assert(p);
         assert(ret);
         INIT_REWINDER(rewinder, p);
 
-        r = dns_packet_read_name(p, &name, true, NULL);
+        if (p->reuse_keys)
+                reuse = dns_packet_name_offset(p, &offset);
+
+        if (reuse && offset != p->rindex)
+                /* The name is a compression pointer. Skip it for now, we only need to read the name if we don't have
+                 * a key for it yet. */
+                r = dns_packet_read(p, 2, NULL, NULL);
+        else
+                r = dns_packet_read_name(p, &name, true, NULL);
         if (r < 0)
                 return r;
 
@@ -1594,11 +1674,30 @@ int dns_packet_read_key(DnsPacket *p, DnsResourceKey **ret, bool *ret_cache_flus
                 }
         }
 
-        key = dns_resource_key_new_consume(class, type, name);
-        if (!key)
-                return -ENOMEM;
+        if (reuse)
+                key = dns_packet_find_read_key(p, offset, class, type);
+        if (!key) {
+                if (!name) {
+                        size_t after_rindex = p->rindex;
+
+                        p->rindex = rewinder.saved_rindex;
+                        r = dns_packet_read_name(p, &name, true, NULL);
+                        if (r < 0)
+                                return r;
+
+                        p->rindex = after_rindex;
+                }
+
+                key = dns_resource_key_new_consume(class, type, name);
+                if (!key)
+                        return -ENOMEM;
+
+                name = NULL;
+
+                if (reuse)
+                        dns_packet_remember_read_key(p, offset, key);
+        }
 
-        name = NULL;
         *ret = key;
 
         if (ret_cache_flush)
@@ -1657,6 +1756,7 @@ int dns_packet_read_rr(DnsPacket *p, DnsResourceRecord **ret, bool *ret_cache_fl
         if (p->rindex + rdlength > p->size)
                 return -EBADMSG;
 
+        rr->rdlength = rdlength;
         offset = p->rindex;
 
         switch (rr->key->type) {
@@ -2286,11 +2386,17 @@ int dns_packet_extract(DnsPacket *p) {
         INIT_REWINDER(rewinder, p);
         dns_packet_rewind(p, DNS_PACKET_HEADER_SIZE);
 
+        /* The question and the owners of most records are the same few names, let's share their keys. Note that
+         * the packet data must not change while those are remembered. */
+        p->reuse_keys = true;
+
         r = dns_packet_extract_question(p, &question);
-        if (r < 0)
-                return r;
+        if (r >= 0)
+                r = dns_packet_extract_answer(p, &answer);
+
+        p->reuse_keys = false;
+        dns_packet_forget_read_keys(p);
 
-        r = dns_packet_extract_answer(p, &answer);
         if (r < 0)
                 return r;
 
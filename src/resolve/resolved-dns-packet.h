@@ -52,6 +52,9 @@ struct DnsPacketHeader {
 /* With EDNS0 we can use larger packets, default to 4096, which is what is commonly used */
 #define DNS_PACKET_UNICAST_SIZE_LARGE_MAX 4096u
 
+/* How many keys dns_packet_extract() remembers, see below */
+#define DNS_PACKET_READ_KEYS_MAX 8U
+
 struct DnsPacket {
         unsigned n_ref;
         DnsProtocol protocol;
@@ -75,10 +78,17 @@ struct DnsPacket {
         /* For support of truncated packets */
         DnsPacket *more;
 
+        /* The last keys read by dns_packet_extract(), and the offsets of their names, so that records which
+         * point to the same name share a key, instead of allocating and parsing it again */
+        DnsResourceKey *read_keys[DNS_PACKET_READ_KEYS_MAX];
+        size_t read_key_offsets[DNS_PACKET_READ_KEYS_MAX];
+        unsigned n_read_keys;
+
         bool on_stack:1;
         bool extracted:1;
         bool refuse_compression:1;
         bool canonical_form:1;
+        bool reuse_keys:1;
 };
 
 static inline uint8_t* DNS_PACKET_DATA(DnsPacket *p) {
@@ -9,6 +9,7 @@
 #include "resolved-dns-synthesize.h"
 #include "resolved-etc-hosts.h"
 #include "string-util.h"
+#include "usdt.h"
 
 #define CNAME_MAX 8
 #define QUERIES_MAX 2048
@@ -393,6 +394,9 @@ DnsQuery *dns_query_free(DnsQuery *q) {
                 dns_stream_unref(q->request_dns_stream);
         }
 
+        if (q->varlink_request)
+                q->varlink_request->query = NULL;
+
         free(q->request_address_string);
 
         if (q->manager) {
@@ -527,6 +531,8 @@ static void dns_query_complete(DnsQuery *q, DnsTransactionState state) {
 
         q->state = state;
 
+        USDT_PROBE(resolved, query_complete, q, state);
+
         dns_query_stop(q);
         if (q->complete)
                 q->complete(q);
@@ -665,6 +671,8 @@ int dns_query_go(DnsQuery *q) {
         if (q->state != DNS_TRANSACTION_NULL)
                 return 0;
 
+        USDT_PROBE(resolved, query_start, q, q->flags);
+
         r = dns_query_try_etc_hosts(q);
         if (r < 0)
                 return r;
@@ -12,6 +12,7 @@ typedef struct DnsQuery DnsQuery;
 #include "resolved-dns-question.h"
 #include "resolved-dns-stream.h"
 #include "resolved-dns-search-domain.h"
+#include "resolved-varlink.h"
 
 struct DnsQueryCandidate {
         DnsQuery *query;
@@ -85,6 +86,9 @@ struct DnsQuery {
         DnsStream *request_dns_stream;
         DnsPacket *reply_dns_packet;
 
+        /* Lookup socket information */
+        VarlinkConnection *varlink_request;
+
         /* Completion callback */
         void (*complete)(DnsQuery* q);
         unsigned block_ready;
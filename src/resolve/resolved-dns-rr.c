@@ -7,6 +7,7 @@
 #include "dns-type.h"
 #include "escape.h"
 #include "hexdecoct.h"
+#include "mempool.h"
 #include "resolved-dns-dnssec.h"
 #include "resolved-dns-packet.h"
 #include "resolved-dns-rr.h"
@@ -183,16 +184,17 @@ int dns_resource_key_equal(const DnsResourceKey *a, const DnsResourceKey *b) {
         if (a == b)
                 return 1;
 
-        r = dns_name_equal(dns_resource_key_name(a), dns_resource_key_name(b));
-        if (r <= 0)
-                return r;
-
+        /* Compare the cheap fields first */
         if (a->class != b->class)
                 return 0;
 
         if (a->type != b->type)
                 return 0;
 
+        r = dns_name_equal(dns_resource_key_name(a), dns_resource_key_name(b));
+        if (r <= 0)
+                return r;
+
         return 1;
 }
 
@@ -368,13 +370,21 @@ bool dns_resource_key_reduce(DnsResourceKey **a, DnsResourceKey **b) {
         return true;
 }
 
+/* Records are created for every one parsed from a packet, most of which are dropped again right away or when they
+ * expire from the cache, hence keep them in a pool */
+DEFINE_MEMPOOL(rr_pool, DnsResourceRecord, 64);
+
 DnsResourceRecord* dns_resource_record_new(DnsResourceKey *key) {
         DnsResourceRecord *rr;
+        bool up;
 
-        rr = new0(DnsResourceRecord, 1);
+        up = mempool_enabled();
+
+        rr = up ? mempool_alloc0_tile(&rr_pool) : new0(DnsResourceRecord, 1);
         if (!rr)
                 return NULL;
 
+        rr->from_pool = up;
         rr->n_ref = 1;
         rr->key = dns_resource_key_ref(key);
         rr->expiry = USEC_INFINITY;
@@ -485,7 +495,13 @@ static DnsResourceRecord* dns_resource_record_free(DnsResourceRecord *rr) {
         }
 
         free(rr->to_string);
-        return mfree(rr);
+
+        if (rr->from_pool)
+                mempool_free_tile(&rr_pool, rr);
+        else
+                free(rr);
+
+        return NULL;
 }
 
 DEFINE_TRIVIAL_REF_UNREF_FUNC(DnsResourceRecord, dns_resource_record, dns_resource_record_free);
@@ -1510,6 +1526,7 @@ DnsResourceRecord *dns_resource_record_copy(DnsResourceRecord *rr) {
         copy->n_skip_labels_signer = rr->n_skip_labels_signer;
         copy->n_skip_labels_source = rr->n_skip_labels_source;
         copy->unparseable = rr->unparseable;
+        copy->rdlength = rr->rdlength;
 
         switch (rr->unparseable ? _DNS_TYPE_INVALID : rr->key->type) {
 
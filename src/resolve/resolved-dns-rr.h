@@ -102,6 +102,10 @@ struct DnsResourceRecord {
         unsigned n_skip_labels_source;
 
         bool unparseable:1;
+        bool from_pool:1;
+
+        /* The size of the RDATA in the packet the RR was read from, 0 if it was not read from a packet */
+        uint16_t rdlength;
 
         bool wire_format_canonical:1;
         void *wire_format;
@@ -841,6 +841,11 @@ DnsTransaction *dns_scope_find_transaction(DnsScope *scope, DnsResourceKey *key,
             t->answer_source != DNS_TRANSACTION_NETWORK)
                 return NULL;
 
+        /* Don't make lookups which may be answered from the cache wait
+         * for a transaction that refreshes it. */
+        if (cache_ok && t->prefetch && DNS_TRANSACTION_IS_LIVE(t->state))
+                return NULL;
+
         return t;
 }
 
@@ -17,6 +17,9 @@
 /* The number of times we will attempt a certain feature set before degrading */
 #define DNS_SERVER_FEATURE_RETRY_ATTEMPTS 3
 
+/* The smoothed round-trip time we assume for a server which lost a packet before we got any sample */
+#define DNS_SERVER_RTT_MAX_USEC (5 * USEC_PER_SEC)
+
 int dns_server_new(
                 Manager *m,
                 DnsServer **ret,
@@ -293,6 +296,36 @@ void dns_server_packet_lost(DnsServer *s, int protocol, DnsServerFeatureLevel le
                                 s->n_failed_tcp++;
                 }
         }
+
+        /* Back off, both for the resend timeout, and when picking a server after a failure */
+        if (s->rtt_smoothed > 0)
+                s->rtt_smoothed = MIN(s->rtt_smoothed * 2, DNS_SERVER_RTT_MAX_USEC);
+        else
+                s->rtt_smoothed = DNS_SERVER_RTT_MAX_USEC;
+}
+
+void dns_server_packet_rtt(DnsServer *s, usec_t rtt) {
+        unsigned bucket;
+
+        assert(s);
+
+        /* Updates the smoothed round-trip time as TCP does, see RFC 6298, Section 2 */
+        if (s->rtt_smoothed == 0) {
+                s->rtt_smoothed = MAX(rtt, 1U);
+                s->rtt_variation = rtt / 2;
+        } else {
+                usec_t delta;
+
+                delta = s->rtt_smoothed > rtt ? s->rtt_smoothed - rtt : rtt - s->rtt_smoothed;
+                s->rtt_variation = (3 * s->rtt_variation + delta) / 4;
+                s->rtt_smoothed = MAX((7 * s->rtt_smoothed + rtt) / 8, 1U);
+        }
+
+        for (bucket = 0; bucket < DNS_SERVER_RTT_BUCKETS - 1; bucket++)
+                if (rtt < (USEC_PER_MSEC << bucket))
+                        break;
+
+        s->rtt_histogram[bucket]++;
 }
 
 void dns_server_packet_truncated(DnsServer *s, DnsServerFeatureLevel level) {
@@ -667,6 +700,30 @@ DnsServer *dns_server_find(DnsServer *first, int family, const union in_addr_uni
         return NULL;
 }
 
+DnsServer *dns_server_pick_next(DnsServer *first, DnsServer *current) {
+        DnsServer *start, *i, *best = NULL;
+
+        /* Picks the server to switch to after the current one failed: the one with the lowest smoothed
+         * round-trip time among the others. Servers we never talked to count as the fastest, so that they are tried
+         * in the configured order, starting after the current one as long as it is still linked. */
+
+        start = current && current->linked ? current->servers_next : first;
+
+        LIST_FOREACH(servers, i, start)
+                if (i != current && (!best || i->rtt_smoothed < best->rtt_smoothed))
+                        best = i;
+
+        LIST_FOREACH(servers, i, first) {
+                if (i == start)
+                        break;
+
+                if (i != current && (!best || i->rtt_smoothed < best->rtt_smoothed))
+                        best = i;
+        }
+
+        return best ?: first;
+}
+
 DnsServer *manager_get_first_dns_server(Manager *m, DnsServerType t) {
         assert(m);
 
@@ -743,19 +800,11 @@ void manager_next_dns_server(Manager *m) {
         if (!m->current_dns_server)
                 return;
 
-        /* Change to the next one, but make sure to follow the linked
-         * list only if the server is still linked. */
-        if (m->current_dns_server->linked && m->current_dns_server->servers_next) {
-                manager_set_dns_server(m, m->current_dns_server->servers_next);
-                return;
-        }
-
-        /* If there was no next one, then start from the beginning of
-         * the list */
+        /* Change to another one of the same list, preferring fast ones */
         if (m->current_dns_server->type == DNS_SERVER_FALLBACK)
-                manager_set_dns_server(m, m->fallback_dns_servers);
+                manager_set_dns_server(m, dns_server_pick_next(m->fallback_dns_servers, m->current_dns_server));
         else
-                manager_set_dns_server(m, m->dns_servers);
+                manager_set_dns_server(m, dns_server_pick_next(m->dns_servers, m->current_dns_server));
 }
 
 bool dns_server_address_valid(int family, const union in_addr_union *sa) {
@@ -834,6 +883,8 @@ void dns_server_reset_features_all(DnsServer *s) {
 }
 
 void dns_server_dump(DnsServer *s, FILE *f) {
+        char rtt[FORMAT_TIMESPAN_MAX];
+
         assert(s);
 
         if (!f)
@@ -875,13 +926,21 @@ void dns_server_dump(DnsServer *s, FILE *f) {
                 "\tFailed TCP attempts: %u\n"
                 "\tSeen truncated packet: %s\n"
                 "\tSeen OPT RR getting lost: %s\n"
-                "\tSeen RRSIG RR missing: %s\n",
+                "\tSeen RRSIG RR missing: %s\n"
+                "\tConnections made: %u\n"
+                "\tQueries on reused connections: %u\n"
+                "\tResumed TLS sessions: %u\n"
+                "\tSmoothed round-trip time: %s\n",
                 s->received_udp_packet_max,
                 s->n_failed_udp,
                 s->n_failed_tcp,
                 yes_no(s->packet_truncated),
                 yes_no(s->packet_bad_opt),
-                yes_no(s->packet_rrsig_missing));
+                yes_no(s->packet_rrsig_missing),
+                s->n_stream_connections,
+                s->n_stream_reuses,
+                s->n_tls_resumptions,
+                s->rtt_smoothed > 0 ? format_timespan(rtt, sizeof(rtt), s->rtt_smoothed, 1) : "n/a");
 }
 
 static const char* const dns_server_type_table[_DNS_SERVER_TYPE_MAX] = {
@@ -32,6 +32,9 @@ typedef enum DnsServerFeatureLevel {
 #define DNS_SERVER_FEATURE_LEVEL_BEST (_DNS_SERVER_FEATURE_LEVEL_MAX - 1)
 #define DNS_SERVER_FEATURE_LEVEL_IS_TLS(x) IN_SET(x, DNS_SERVER_FEATURE_LEVEL_TLS_PLAIN, DNS_SERVER_FEATURE_LEVEL_TLS_DO)
 
+/* Round-trip times are counted in buckets of <1ms, <2ms, <4ms, … <1024ms, and everything above */
+#define DNS_SERVER_RTT_BUCKETS 12
+
 const char* dns_server_feature_level_to_string(int i) _const_;
 int dns_server_feature_level_from_string(const char *s) _pure_;
 
@@ -69,6 +72,16 @@ struct DnsServer {
         unsigned n_failed_tcp;
         unsigned n_failed_tls;
 
+        unsigned n_stream_connections; /* TCP connections we made, including those with TLS */
+        unsigned n_stream_reuses;      /* Queries sent on a connection made for an earlier query */
+        unsigned n_tls_resumptions;    /* TLS handshakes that resumed an earlier session */
+
+        /* The smoothed round-trip time of UDP queries and its variation as defined in RFC 6298, 0 as long as we
+         * have no sample. Lost packets double the former. */
+        usec_t rtt_smoothed;
+        usec_t rtt_variation;
+        uint64_t rtt_histogram[DNS_SERVER_RTT_BUCKETS];
+
         bool packet_truncated:1;
         bool packet_bad_opt:1;
         bool packet_rrsig_missing:1;
@@ -104,6 +117,7 @@ void dns_server_move_back_and_unmark(DnsServer *s);
 
 void dns_server_packet_received(DnsServer *s, int protocol, DnsServerFeatureLevel level, size_t size);
 void dns_server_packet_lost(DnsServer *s, int protocol, DnsServerFeatureLevel level);
+void dns_server_packet_rtt(DnsServer *s, usec_t rtt);
 void dns_server_packet_truncated(DnsServer *s, DnsServerFeatureLevel level);
 void dns_server_packet_rrsig_missing(DnsServer *s, DnsServerFeatureLevel level);
 void dns_server_packet_bad_opt(DnsServer *s, DnsServerFeatureLevel level);
@@ -123,6 +137,7 @@ void dns_server_warn_downgrade(DnsServer *server);
 bool dns_server_limited_domains(DnsServer *server);
 
 DnsServer *dns_server_find(DnsServer *first, int family, const union in_addr_union *in_addr, int ifindex);
+DnsServer *dns_server_pick_next(DnsServer *first, DnsServer *current);
 
 void dns_server_unlink_all(DnsServer *first);
 void dns_server_unlink_marked(DnsServer *first);
@@ -45,6 +45,17 @@ static int dns_stream_update_io(DnsStream *s) {
         return sd_event_source_set_io_events(s->io_event_source, f);
 }
 
+static int dns_stream_restart_timeout(DnsStream *s) {
+        assert(s);
+
+        /* The timeout only covers idle time, so that a stream may be kept open for further packets as long as it
+         * is used */
+        if (!s->timeout_event_source)
+                return 0;
+
+        return sd_event_source_set_time(s->timeout_event_source, now(clock_boottime_or_monotonic()) + DNS_STREAM_TIMEOUT_USEC);
+}
+
 static int dns_stream_complete(DnsStream *s, int error) {
         assert(s);
 
@@ -324,6 +335,8 @@ static int on_stream_io(sd_event_source *es, int fd, uint32_t revents, void *use
 
                 /* Are we done? If so, disable the event source for EPOLLOUT */
                 if (s->n_written >= sizeof(s->write_size) + s->write_packet->size) {
+                        (void) dns_stream_restart_timeout(s);
+
                         r = dns_stream_update_io(s);
                         if (r < 0)
                                 return dns_stream_complete(s, -r);
@@ -399,6 +412,8 @@ static int on_stream_io(sd_event_source *es, int fd, uint32_t revents, void *use
 
                         /* Are we done? If so, disable the event source for EPOLLIN */
                         if (s->n_read >= sizeof(s->read_size) + be16toh(s->read_size)) {
+                                (void) dns_stream_restart_timeout(s);
+
                                 /* If there's a packet handler
                                  * installed, call that. Note that
                                  * this is optional... */
@@ -522,5 +537,7 @@ int dns_stream_write_packet(DnsStream *s, DnsPacket *p) {
 
         dns_packet_ref(p);
 
+        (void) dns_stream_restart_timeout(s);
+
         return dns_stream_update_io(s);
 }
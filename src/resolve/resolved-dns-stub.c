@@ -2,12 +2,17 @@
 
 #include "fd-util.h"
 #include "resolved-dns-stub.h"
+#include "resolved-etc-hosts.h"
 #include "socket-util.h"
 
 /* The MTU of the loopback device is 64K on Linux, advertise that as maximum datagram size, but subtract the Ethernet,
  * IP and UDP header sizes */
 #define ADVERTISE_DATAGRAM_SIZE_MAX (65536U-14U-20U-8U)
 
+/* How many datagrams to read from the UDP socket in one event loop iteration at most. This saves wakeups when we are
+ * busy, but doesn't starve other event sources. */
+#define UDP_BATCH_MAX 32U
+
 static int manager_dns_stub_udp_fd(Manager *m);
 static int manager_dns_stub_tcp_fd(Manager *m);
 
@@ -280,6 +285,108 @@ static int dns_stub_stream_complete(DnsStream *s, int error) {
         return 0;
 }
 
+static DnsScope *dns_stub_find_scope(Manager *m, const char *name) {
+        DnsScopeMatch found = DNS_SCOPE_NO;
+        DnsScope *s, *first = NULL;
+
+        assert(m);
+        assert(name);
+
+        /* Returns the scope dns_query_go() would send a query for this name to, if it is a single unicast DNS
+         * scope. */
+
+        LIST_FOREACH(scopes, s, m->dns_scopes) {
+                DnsScopeMatch match;
+
+                match = dns_scope_good_domain(s, 0, SD_RESOLVED_PROTOCOLS_ALL|SD_RESOLVED_NO_SEARCH, name);
+                if (match < 0)
+                        return NULL;
+                if (match == DNS_SCOPE_NO)
+                        continue;
+
+                found = match;
+
+                if (match == DNS_SCOPE_YES) {
+                        first = s;
+                        break;
+                }
+
+                if (!first)
+                        first = s;
+        }
+
+        if (!first || first->protocol != DNS_PROTOCOL_DNS)
+                return NULL;
+
+        LIST_FOREACH(scopes, s, first->scopes_next)
+                if (dns_scope_good_domain(s, 0, SD_RESOLVED_PROTOCOLS_ALL|SD_RESOLVED_NO_SEARCH, name) == found)
+                        return NULL;
+
+        return first;
+}
+
+static int dns_stub_reply_from_cache(Manager *m, DnsPacket *p) {
+        _cleanup_(dns_answer_unrefp) DnsAnswer *hosts = NULL, *answer = NULL;
+        _cleanup_(dns_packet_unrefp) DnsPacket *reply = NULL;
+        bool authenticated, prefetch, truncated;
+        DnsResourceRecord *rr;
+        DnsResourceKey *key;
+        DnsScope *scope;
+        int rcode, r;
+
+        assert(m);
+        assert(p);
+
+        /* Answers positive cache hits right away, without setting up a DnsQuery and a DnsTransaction for them. The
+         * rest, in particular names from /etc/hosts, answers which need CNAME redirects to be followed, and anything
+         * DNSSEC-related, takes the usual path. Returns > 0 if the reply was sent. */
+
+        key = p->question->keys[0];
+        if (dns_type_is_dnssec(key->type))
+                return 0;
+
+        r = manager_etc_hosts_lookup(m, p->question, &hosts);
+        if (r != 0)
+                return 0;
+
+        scope = dns_stub_find_scope(m, dns_resource_key_name(key));
+        if (!scope)
+                return 0;
+
+        /* Same as dns_transaction_prepare() */
+        (void) dns_scope_get_dns_server(scope);
+        dns_cache_prune(&scope->cache);
+
+        r = dns_cache_lookup(&scope->cache, key, true, &rcode, &answer, &authenticated, &prefetch);
+        if (r < 0)
+                return r;
+
+        if (prefetch)
+                dns_transaction_prefetch(scope, key);
+
+        if (r == 0 || rcode != DNS_RCODE_SUCCESS || dns_answer_isempty(answer))
+                return 0;
+
+        DNS_ANSWER_FOREACH(rr, answer) {
+                r = dns_resource_key_match_rr(key, rr, NULL);
+                if (r <= 0)
+                        return r;
+        }
+
+        r = dns_stub_make_reply_packet(&reply, DNS_PACKET_PAYLOAD_SIZE_MAX(p), p->question, answer, &truncated);
+        if (r < 0)
+                return r;
+
+        r = dns_stub_finish_reply_packet(reply, DNS_PACKET_ID(p), DNS_RCODE_SUCCESS, truncated, !!p->opt, DNS_PACKET_DO(p), authenticated);
+        if (r < 0)
+                return r;
+
+        log_debug("Answering query from cache...");
+
+        (void) dns_stub_send(m, NULL, p, reply);
+        return 1;
+}
+
 static void dns_stub_process_query(Manager *m, DnsStream *s, DnsPacket *p) {
         DnsQuery *q = NULL;
         int r;
@@ -335,6 +442,14 @@ static void dns_stub_process_query(Manager *m, DnsStream *s, DnsPacket *p) {
                 goto fail;
         }
 
+        if (!s) {
+                r = dns_stub_reply_from_cache(m, p);
+                if (r < 0)
+                        log_debug_errno(r, "Failed to answer query from cache, ignoring: %m");
+                if (r > 0)
+                        return;
+        }
+
         r = dns_query_new(m, &q, p->question, p->question, 0, SD_RESOLVED_PROTOCOLS_ALL|SD_RESOLVED_NO_SEARCH);
         if (r < 0) {
                 log_error_errno(r, "Failed to generate query object: %m");
@@ -373,20 +488,24 @@ fail:
 }
 
 static int on_dns_stub_packet(sd_event_source *s, int fd, uint32_t revents, void *userdata) {
-        _cleanup_(dns_packet_unrefp) DnsPacket *p = NULL;
         Manager *m = userdata;
+        unsigned n;
         int r;
 
-        r = manager_recv(m, fd, DNS_PROTOCOL_DNS, &p);
-        if (r <= 0)
-                return r;
+        for (n = 0; n < UDP_BATCH_MAX; n++) {
+                _cleanup_(dns_packet_unrefp) DnsPacket *p = NULL;
 
-        if (dns_packet_validate_query(p) > 0) {
-                log_debug("Got DNS stub UDP query packet for id %u", DNS_PACKET_ID(p));
+                r = manager_recv(m, fd, DNS_PROTOCOL_DNS, &p);
+                if (r <= 0)
+                        return r;
 
-                dns_stub_process_query(m, NULL, p);
-        } else
-                log_debug("Invalid DNS stub UDP packet, ignoring.");
+                if (dns_packet_validate_query(p) > 0) {
+                        log_debug("Got DNS stub UDP query packet for id %u", DNS_PACKET_ID(p));
+
+                        dns_stub_process_query(m, NULL, p);
+                } else
+                        log_debug("Invalid DNS stub UDP packet, ignoring.");
+        }
 
         return 0;
 }
@@ -15,12 +15,14 @@
 #include "resolved-dnstls.h"
 #endif
 #include "string-table.h"
+#include "usdt.h"
 
 #define TRANSACTIONS_MAX 4096
 #define TRANSACTION_TCP_TIMEOUT_USEC (10U*USEC_PER_SEC)
 
-/* After how much time to repeat classic DNS requests */
+/* After how much time to repeat classic DNS requests, unless we know the server answers faster */
 #define DNS_TIMEOUT_USEC (SD_RESOLVED_QUERY_TIMEOUT_USEC / DNS_TRANSACTION_ATTEMPTS_MAX)
+#define DNS_TIMEOUT_MIN_USEC (500 * USEC_PER_MSEC)
 
 static void dns_transaction_reset_answer(DnsTransaction *t) {
         assert(t);
@@ -137,6 +139,10 @@ bool dns_transaction_gc(DnsTransaction *t) {
         if (t->block_gc > 0)
                 return true;
 
+        /* Nobody waits for the answer to a prefetch, but it needs to be put into the cache */
+        if (t->prefetch && DNS_TRANSACTION_IS_LIVE(t->state))
+                return true;
+
         if (set_isempty(t->notify_query_candidates) &&
             set_isempty(t->notify_query_candidates_done) &&
             set_isempty(t->notify_zone_items) &&
@@ -306,6 +312,8 @@ void dns_transaction_complete(DnsTransaction *t, DnsTransactionState state) {
         assert(t);
         assert(!DNS_TRANSACTION_IS_LIVE(state));
 
+        USDT_PROBE(resolved, transaction_complete, t->id, state, t->answer_source);
+
         if (state == DNS_TRANSACTION_DNSSEC_FAILED) {
                 dns_resource_key_to_string(t->key, key_str, sizeof key_str);
 
@@ -582,9 +590,10 @@ static int dns_transaction_emit_tcp(DnsTransaction *t) {
                 if (r < 0)
                         return r;
 
-                if (t->server->stream && (DNS_SERVER_FEATURE_LEVEL_IS_TLS(t->current_feature_level) == t->server->stream->encrypted))
+                if (t->server->stream && (DNS_SERVER_FEATURE_LEVEL_IS_TLS(t->current_feature_level) == t->server->stream->encrypted)) {
                         s = dns_stream_ref(t->server->stream);
-                else
+                        t->server->n_stream_reuses++;
+                } else
                         fd = dns_scope_socket_tcp(t->scope, AF_UNSPEC, NULL, t->server, DNS_SERVER_FEATURE_LEVEL_IS_TLS(t->current_feature_level) ? 853 : 53, &sa);
 
                 break;
@@ -641,6 +650,7 @@ static int dns_transaction_emit_tcp(DnsTransaction *t) {
                         dns_stream_unref(t->server->stream);
                         t->server->stream = dns_stream_ref(s);
                         s->server = dns_server_ref(t->server);
+                        t->server->n_stream_connections++;
                 }
 
                 s->complete = on_stream_complete;
@@ -1104,6 +1114,10 @@ void dns_transaction_process_reply(DnsTransaction *t, DnsPacket *p) {
 
                 /* Report that we successfully received a packet */
                 dns_server_packet_received(t->server, p->ipproto, t->current_feature_level, p->size);
+
+                /* Over TCP the time includes setting up the connection, hence only sample UDP */
+                if (p->ipproto == IPPROTO_UDP && !t->rtt_ambiguous)
+                        dns_server_packet_rtt(t->server, ts - t->start_usec);
         }
 
         /* See if we know things we didn't know before that indicate we better restart the lookup immediately. */
@@ -1256,6 +1270,7 @@ static int dns_transaction_emit_udp(DnsTransaction *t) {
 
                         (void) sd_event_source_set_description(t->dns_udp_event_source, "dns-transaction-udp");
                         t->dns_udp_fd = fd;
+                        t->rtt_ambiguous = false;
                 }
 
                 r = dns_server_adjust_opt(t->server, t->sent, t->current_feature_level);
@@ -1286,6 +1301,8 @@ static int on_transaction_timeout(sd_event_source *s, usec_t usec, void *userdat
                 case DNS_PROTOCOL_DNS:
                         assert(t->server);
                         dns_server_packet_lost(t->server, t->stream ? IPPROTO_TCP : IPPROTO_UDP, t->current_feature_level);
+                        if (!t->stream)
+                                t->rtt_ambiguous = true;
                         break;
 
                 case DNS_PROTOCOL_LLMNR:
@@ -1321,6 +1338,10 @@ static usec_t transaction_get_resend_timeout(DnsTransaction *t) {
                 if (t->stream)
                         return TRANSACTION_TCP_TIMEOUT_USEC;
 
+                /* Otherwise wait as long as TCP would, see RFC 6298, Section 2 */
+                if (t->server && t->server->rtt_smoothed > 0)
+                        return CLAMP(t->server->rtt_smoothed + 4 * t->server->rtt_variation, DNS_TIMEOUT_MIN_USEC, DNS_TIMEOUT_USEC);
+
                 return DNS_TIMEOUT_USEC;
 
         case DNS_PROTOCOL_MDNS:
@@ -1338,6 +1359,40 @@ static usec_t transaction_get_resend_timeout(DnsTransaction *t) {
         }
 }
 
+void dns_transaction_prefetch(DnsScope *s, DnsResourceKey *key) {
+        DnsTransaction *t;
+        int r;
+
+        assert(s);
+        assert(key);
+
+        /* The cache entry for the key is used often and expires soon: look it up again in the background, so that the
+         * next lookup is answered from the cache too. */
+
+        if (s->protocol != DNS_PROTOCOL_DNS)
+                return;
+
+        /* Transactions which are answered from the cache right now don't count */
+        t = hashmap_get(s->transactions_by_key, key);
+        if (t && DNS_TRANSACTION_IS_LIVE(t->state) && t->answer_source != DNS_TRANSACTION_CACHE)
+                return;
+
+        r = dns_transaction_new(&t, s, key);
+        if (r < 0) {
+                log_debug_errno(r, "Failed to create transaction to refresh cache entry, ignoring: %m");
+                return;
+        }
+
+        t->prefetch = true;
+        s->cache.n_prefetch++;
+
+        r = dns_transaction_go(t);
+        if (r < 0) {
+                t->answer_errno = -r;
+                dns_transaction_complete(t, DNS_TRANSACTION_ERRNO);
+        }
+}
+
 static int dns_transaction_prepare(DnsTransaction *t, usec_t ts) {
         int r;
 
@@ -1433,8 +1488,10 @@ static int dns_transaction_prepare(DnsTransaction *t, usec_t ts) {
         }
 
         /* Check the cache, but only if this transaction is not used
-         * for probing or verifying a zone item. */
-        if (set_isempty(t->notify_zone_items)) {
+         * for probing or verifying a zone item, or for refreshing the
+         * cache itself. */
+        if (set_isempty(t->notify_zone_items) && !t->prefetch) {
+                bool prefetch;
 
                 /* Before trying the cache, let's make sure we figured out a
                  * server to use. Should this cause a change of server this
@@ -1444,11 +1501,17 @@ static int dns_transaction_prepare(DnsTransaction *t, usec_t ts) {
                 /* Let's then prune all outdated entries */
                 dns_cache_prune(&t->scope->cache);
 
-                r = dns_cache_lookup(&t->scope->cache, t->key, t->clamp_ttl, &t->answer_rcode, &t->answer, &t->answer_authenticated);
+                r = dns_cache_lookup(&t->scope->cache, t->key, t->clamp_ttl, &t->answer_rcode, &t->answer, &t->answer_authenticated, &prefetch);
                 if (r < 0)
                         return r;
                 if (r > 0) {
                         t->answer_source = DNS_TRANSACTION_CACHE;
+
+                        USDT_PROBE(resolved, cache_hit, t->id, t->key->type, t->answer_rcode);
+
+                        if (prefetch)
+                                dns_transaction_prefetch(t->scope, t->key);
+
                         if (t->answer_rcode == DNS_RCODE_SUCCESS)
                                 dns_transaction_complete(t, DNS_TRANSACTION_SUCCESS);
                         else
@@ -58,10 +58,17 @@ struct DnsTransaction {
         bool initial_jitter_scheduled:1;
         bool initial_jitter_elapsed:1;
 
+        /* Set when a query timed out on the current UDP socket, as then a reply might be for any query sent on it,
+         * and tells us nothing about the round-trip time */
+        bool rtt_ambiguous:1;
+
         bool clamp_ttl:1;
 
         bool probing:1;
 
+        /* Set for transactions which refresh cache entries in the background before they expire */
+        bool prefetch:1;
+
         DnsPacket *sent, *received;
 
         DnsAnswer *answer;
@@ -141,6 +148,7 @@ int dns_transaction_go(DnsTransaction *t);
 
 void dns_transaction_process_reply(DnsTransaction *t, DnsPacket *p);
 void dns_transaction_complete(DnsTransaction *t, DnsTransactionState state);
+void dns_transaction_prefetch(DnsScope *s, DnsResourceKey *key);
 
 void dns_transaction_notify(DnsTransaction *t, DnsTransaction *source);
 int dns_transaction_validate_dnssec(DnsTransaction *t);
@@ -105,7 +105,8 @@ int dnstls_stream_on_io(DnsStream *stream, uint32_t revents) {
                         log_debug("Failed to invoke gnutls_handshake: %s", gnutls_strerror(stream->dnstls_data.handshake));
                         if (gnutls_error_is_fatal(stream->dnstls_data.handshake))
                                 return -ECONNREFUSED;
-                }
+                } else if (stream->server && gnutls_session_is_resumed(stream->dnstls_data.session))
+                        stream->server->n_tls_resumptions++;
 
                 stream->dnstls_events = 0;
         }
@@ -181,6 +181,9 @@ int dnstls_stream_on_io(DnsStream *stream, uint32_t revents) {
                         }
                 }
 
+                if (stream->server && SSL_session_reused(stream->dnstls_data.ssl))
+                        stream->server->n_tls_resumptions++;
+
                 stream->dnstls_events = 0;
                 r = dnstls_flush_write_buffer(stream);
                 if (r < 0)
@@ -6,14 +6,13 @@
 #include "resolved-dns-synthesize.h"
 #include "resolved-etc-hosts.h"
 #include "string-util.h"
-#include "strv.h"
 #include "time-util.h"
 
 /* Recheck /etc/hosts at most once every 2s */
 #define ETC_HOSTS_RECHECK_USEC (2*USEC_PER_SEC)
 
 static inline void etc_hosts_item_free(EtcHostsItem *item) {
-        strv_free(item->names);
+        free(item->names);
         free(item);
 }
 
@@ -122,10 +121,6 @@ static int parse_line(EtcHosts *hosts, unsigned nr, const char *line) {
                         continue;
                 }
 
-                r = strv_extend(&item->names, name);
-                if (r < 0)
-                        return log_oom();
-
                 bn = hashmap_get(hosts->by_name, name);
                 if (!bn) {
                         r = hashmap_ensure_allocated(&hosts->by_name, &dns_name_hash_ops);
@@ -149,6 +144,13 @@ static int parse_line(EtcHosts *hosts, unsigned nr, const char *line) {
                         return log_oom();
 
                 bn->addresses[bn->n_addresses++] = &item->address;
+
+                /* Addresses like 127.0.0.1 might be listed with a huge number of names, hence let's not use strv
+                 * here, and share the names with the by name index */
+                if (!GREEDY_REALLOC(item->names, item->n_allocated, item->n_names + 1))
+                        return log_oom();
+
+                item->names[item->n_names++] = bn->name;
         }
 
         if (!found)
@@ -296,20 +298,18 @@ int manager_etc_hosts_lookup(Manager *m, DnsQuestion* q, DnsAnswer **answer) {
                 }
 
                 if (found_ptr) {
-                        char **n;
-
-                        r = dns_answer_reserve(answer, strv_length(item->names));
+                        r = dns_answer_reserve(answer, item->n_names);
                         if (r < 0)
                                 return r;
 
-                        STRV_FOREACH(n, item->names) {
+                        for (i = 0; i < item->n_names; i++) {
                                 _cleanup_(dns_resource_record_unrefp) DnsResourceRecord *rr = NULL;
 
                                 rr = dns_resource_record_new(found_ptr);
                                 if (!rr)
                                         return -ENOMEM;
 
-                                rr->ptr.name = strdup(*n);
+                                rr->ptr.name = strdup(item->names[i]);
                                 if (!rr->ptr.name)
                                         return -ENOMEM;
 
@@ -8,7 +8,9 @@
 typedef struct EtcHostsItem {
         struct in_addr_data address;
 
+        /* Points to the names owned by the EtcHostsItemByName objects */
         char **names;
+        size_t n_names, n_allocated;
 } EtcHostsItem;
 
 typedef struct EtcHostsItemByName {
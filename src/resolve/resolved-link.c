@@ -725,14 +725,8 @@ void link_next_dns_server(Link *l) {
         if (!l->current_dns_server)
                 return;
 
-        /* Change to the next one, but make sure to follow the linked
-         * list only if this server is actually still linked. */
-        if (l->current_dns_server->linked && l->current_dns_server->servers_next) {
-                link_set_dns_server(l, l->current_dns_server->servers_next);
-                return;
-        }
-
-        link_set_dns_server(l, l->dns_servers);
+        /* Change to another one, preferring fast ones */
+        link_set_dns_server(l, dns_server_pick_next(l->dns_servers, l->current_dns_server));
 }
 
 DnsOverTlsMode link_get_dns_over_tls_mode(Link *l) {
@@ -11,6 +11,7 @@
 
 #include "af-list.h"
 #include "alloc-util.h"
+#include "bus-internal.h"
 #include "dirent-util.h"
 #include "dns-domain.h"
 #include "fd-util.h"
@@ -24,6 +25,7 @@
 #include "random-util.h"
 #include "resolved-bus.h"
 #include "resolved-conf.h"
+#include "resolved-dns-dnssec.h"
 #include "resolved-dns-stub.h"
 #include "resolved-dnssd.h"
 #include "resolved-etc-hosts.h"
@@ -31,6 +33,7 @@
 #include "resolved-manager.h"
 #include "resolved-mdns.h"
 #include "resolved-resolv-conf.h"
+#include "resolved-varlink.h"
 #include "socket-util.h"
 #include "string-table.h"
 #include "string-util.h"
@@ -542,6 +545,24 @@ static int manager_sigusr2(sd_event_source *s, const struct signalfd_siginfo *si
         return 0;
 }
 
+static void manager_memory_pressure(MemoryPressureLevel level, void *userdata) {
+        Manager *m = userdata;
+        DnsScope *scope;
+
+        assert(m);
+
+        LIST_FOREACH(scopes, scope, m->dns_scopes)
+                dns_cache_trim(&scope->cache, level);
+
+        if (level == MEMORY_PRESSURE_NONE)
+                return;
+
+        if (level == MEMORY_PRESSURE_FULL)
+                dnssec_flush_verified_signatures();
+
+        bus_trim_caches(m->bus);
+}
+
 static int manager_sigrtmin1(sd_event_source *s, const struct signalfd_siginfo *si, void *userdata) {
         Manager *m = userdata;
 
@@ -572,6 +593,7 @@ int manager_new(Manager **ret) {
                 .mdns_ipv6_fd = -1,
                 .dns_stub_udp_fd = -1,
                 .dns_stub_tcp_fd = -1,
+                .varlink_fd = -1,
                 .hostname_fd = -1,
 
                 .llmnr_support = RESOLVE_SUPPORT_YES,
@@ -632,6 +654,10 @@ int manager_new(Manager **ret) {
         (void) sd_event_add_signal(m->event, &m->sigusr2_event_source, SIGUSR2, manager_sigusr2, m);
         (void) sd_event_add_signal(m->event, &m->sigrtmin1_event_source, SIGRTMIN+1, manager_sigrtmin1, m);
 
+        r = memory_pressure_new(m->event, &m->memory_pressure);
+        if (r >= 0)
+                (void) memory_pressure_add_handler(m->memory_pressure, manager_memory_pressure, m);
+
         manager_cleanup_saved_user(m);
 
         *ret = TAKE_PTR(m);
@@ -648,6 +674,10 @@ int manager_start(Manager *m) {
         if (r < 0)
                 return r;
 
+        r = manager_varlink_init(m);
+        if (r < 0)
+                return r;
+
         return 0;
 }
 
@@ -687,6 +717,7 @@ Manager *manager_free(Manager *m) {
         manager_llmnr_stop(m);
         manager_mdns_stop(m);
         manager_dns_stub_stop(m);
+        manager_varlink_done(m);
 
         sd_bus_unref(m->bus);
 
@@ -694,8 +725,12 @@ Manager *manager_free(Manager *m) {
         sd_event_source_unref(m->sigusr2_event_source);
         sd_event_source_unref(m->sigrtmin1_event_source);
 
+        memory_pressure_free(m->memory_pressure);
+
         sd_event_unref(m->event);
 
+        dnssec_flush_verified_signatures();
+
         dns_resource_key_unref(m->llmnr_host_ipv4_key);
         dns_resource_key_unref(m->llmnr_host_ipv6_key);
         dns_resource_key_unref(m->mdns_host_ipv4_key);
@@ -1427,6 +1462,8 @@ void manager_flush_caches(Manager *m) {
         LIST_FOREACH(scopes, scope, m->dns_scopes)
                 dns_cache_flush(&scope->cache);
 
+        dnssec_flush_verified_signatures();
+
         log_info("Flushed all caches.");
 }
 
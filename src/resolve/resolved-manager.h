@@ -7,6 +7,7 @@
 
 #include "hashmap.h"
 #include "list.h"
+#include "memory-pressure.h"
 #include "ordered-set.h"
 #include "resolve-util.h"
 
@@ -19,6 +20,7 @@ typedef struct Manager Manager;
 #include "resolved-dns-stream.h"
 #include "resolved-dns-trust-anchor.h"
 #include "resolved-link.h"
+#include "resolved-varlink.h"
 
 #define MANAGER_SEARCH_DOMAINS_MAX 32
 #define MANAGER_DNS_SERVERS_MAX 32
@@ -116,6 +118,8 @@ struct Manager {
         sd_event_source *sigusr2_event_source;
         sd_event_source *sigrtmin1_event_source;
 
+        MemoryPressure *memory_pressure;
+
         unsigned n_transactions_total;
         unsigned n_dnssec_verdict[_DNSSEC_VERDICT_MAX];
 
@@ -131,6 +135,12 @@ struct Manager {
         sd_event_source *dns_stub_udp_event_source;
         sd_event_source *dns_stub_tcp_event_source;
 
+        /* Lookup socket in /run/systemd/resolve/ */
+        int varlink_fd;
+        sd_event_source *varlink_event_source;
+        LIST_HEAD(VarlinkConnection, varlink_connections);
+        unsigned n_varlink_connections;
+
         Hashmap *polkit_registry;
 };
 
@@ -0,0 +1,882 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "alloc-util.h"
+#include "fd-util.h"
+#include "json.h"
+#include "resolved-def.h"
+#include "resolved-dns-synthesize.h"
+#include "resolved-varlink.h"
+#include "socket-util.h"
+#include "string-util.h"
+#include "time-util.h"
+
+/* This is a much cheaper way to do host name and address lookups than the bus: clients connect directly to us, and
+ * exchange a single pair of small messages per lookup. It only implements what nss-resolve needs, everything else
+ * stays bus-only. */
+
+#define VARLINK_CONNECTIONS_MAX 128U
+#define VARLINK_MESSAGE_SIZE_MAX (64U * 1024U)
+#define VARLINK_READ_SIZE 2048U
+
+/* The socket is accessible to everybody, hence don't let clients sit on one of the few connection slots. nss-resolve
+ * sends its call right after connecting, and hangs up once it got the reply. */
+#define VARLINK_IDLE_TIMEOUT_USEC (10 * USEC_PER_SEC)
+
+#define VARLINK_ERROR_RESOLVE(name) ("io.systemd.Resolve." name)
+#define VARLINK_ERROR_INVALID_PARAMETER "org.varlink.service.InvalidParameter"
+#define VARLINK_ERROR_METHOD_NOT_FOUND "org.varlink.service.MethodNotFound"
+
+static VarlinkConnection *varlink_connection_free(VarlinkConnection *c) {
+        if (!c)
+                return NULL;
+
+        if (c->query) {
+                c->query->varlink_request = NULL;
+                dns_query_free(c->query);
+        }
+
+        if (c->manager) {
+                LIST_REMOVE(connections, c->manager->varlink_connections, c);
+                c->manager->n_varlink_connections--;
+        }
+
+        sd_event_source_unref(c->io_event_source);
+        sd_event_source_unref(c->idle_event_source);
+        safe_close(c->fd);
+
+        free(c->input);
+        free(c->output);
+
+        return mfree(c);
+}
+
+static int varlink_connection_send(VarlinkConnection *c, JsonVariant *v) {
+        _cleanup_free_ char *text = NULL;
+        int r;
+
+        assert(c);
+        assert(v);
+        assert(!c->output);
+
+        r = json_variant_format(v, 0, &text);
+        if (r < 0)
+                return r;
+
+        /* The NUL byte terminating the string terminates the message, too */
+        c->output = TAKE_PTR(text);
+        c->output_size = (size_t) r + 1;
+        c->output_written = 0;
+
+        return 0;
+}
+
+static int varlink_connection_reply(VarlinkConnection *c, JsonVariant *parameters) {
+        _cleanup_(json_variant_unrefp) JsonVariant *v = NULL;
+        int r;
+
+        assert(c);
+
+        r = json_build(&v, JSON_BUILD_OBJECT(JSON_BUILD_PAIR("parameters", JSON_BUILD_VARIANT(parameters))));
+        if (r < 0)
+                return r;
+
+        return varlink_connection_send(c, v);
+}
+
+static int varlink_connection_error(VarlinkConnection *c, const char *error, JsonVariant *parameters) {
+        _cleanup_(json_variant_unrefp) JsonVariant *v = NULL;
+        int r;
+
+        assert(c);
+        assert(error);
+
+        r = json_build(&v, JSON_BUILD_OBJECT(JSON_BUILD_PAIR("error", JSON_BUILD_STRING(error)),
+                                             JSON_BUILD_PAIR_CONDITION(!!parameters, "parameters", JSON_BUILD_VARIANT(parameters))));
+        if (r < 0)
+                return r;
+
+        return varlink_connection_send(c, v);
+}
+
+static int varlink_connection_error_parameter(VarlinkConnection *c, const char *parameter) {
+        _cleanup_(json_variant_unrefp) JsonVariant *p = NULL;
+        int r;
+
+        r = json_build(&p, JSON_BUILD_OBJECT(JSON_BUILD_PAIR("parameter", JSON_BUILD_STRING(parameter))));
+        if (r < 0)
+                return r;
+
+        return varlink_connection_error(c, VARLINK_ERROR_INVALID_PARAMETER, p);
+}
+
+static int reply_query_state(VarlinkConnection *c, DnsQuery *q) {
+        _cleanup_(json_variant_unrefp) JsonVariant *p = NULL;
+        int r;
+
+        switch (q->state) {
+
+        case DNS_TRANSACTION_NO_SERVERS:
+                return varlink_connection_error(c, VARLINK_ERROR_RESOLVE("NoNameServers"), NULL);
+
+        case DNS_TRANSACTION_TIMEOUT:
+                return varlink_connection_error(c, VARLINK_ERROR_RESOLVE("QueryTimedOut"), NULL);
+
+        case DNS_TRANSACTION_ATTEMPTS_MAX_REACHED:
+                return varlink_connection_error(c, VARLINK_ERROR_RESOLVE("MaxAttemptsReached"), NULL);
+
+        case DNS_TRANSACTION_INVALID_REPLY:
+                return varlink_connection_error(c, VARLINK_ERROR_RESOLVE("InvalidReply"), NULL);
+
+        case DNS_TRANSACTION_ERRNO:
+                r = json_build(&p, JSON_BUILD_OBJECT(JSON_BUILD_PAIR("errno", JSON_BUILD_INTEGER(q->answer_errno))));
+                if (r < 0)
+                        return r;
+
+                return varlink_connection_error(c, VARLINK_ERROR_RESOLVE("QueryFailed"), p);
+
+        case DNS_TRANSACTION_ABORTED:
+                return varlink_connection_error(c, VARLINK_ERROR_RESOLVE("QueryAborted"), NULL);
+
+        case DNS_TRANSACTION_DNSSEC_FAILED:
+                r = json_build(&p, JSON_BUILD_OBJECT(JSON_BUILD_PAIR("result", JSON_BUILD_STRING(dnssec_result_to_string(q->answer_dnssec_result)))));
+                if (r < 0)
+                        return r;
+
+                return varlink_connection_error(c, VARLINK_ERROR_RESOLVE("DNSSECValidationFailed"), p);
+
+        case DNS_TRANSACTION_NO_TRUST_ANCHOR:
+                return varlink_connection_error(c, VARLINK_ERROR_RESOLVE("NoTrustAnchor"), NULL);
+
+        case DNS_TRANSACTION_RR_TYPE_UNSUPPORTED:
+                return varlink_connection_error(c, VARLINK_ERROR_RESOLVE("ResourceRecordTypeUnsupported"), NULL);
+
+        case DNS_TRANSACTION_NETWORK_DOWN:
+                return varlink_connection_error(c, VARLINK_ERROR_RESOLVE("NetworkDown"), NULL);
+
+        case DNS_TRANSACTION_NOT_FOUND:
+                /* Like on the bus, we return this as NXDOMAIN */
+                r = json_build(&p, JSON_BUILD_OBJECT(JSON_BUILD_PAIR("rcode", JSON_BUILD_INTEGER(DNS_RCODE_NXDOMAIN))));
+                if (r < 0)
+                        return r;
+
+                return varlink_connection_error(c, VARLINK_ERROR_RESOLVE("DNSError"), p);
+
+        case DNS_TRANSACTION_RCODE_FAILURE:
+                r = json_build(&p, JSON_BUILD_OBJECT(JSON_BUILD_PAIR("rcode", JSON_BUILD_INTEGER(q->answer_rcode))));
+                if (r < 0)
+                        return r;
+
+                return varlink_connection_error(c, VARLINK_ERROR_RESOLVE("DNSError"), p);
+
+        case DNS_TRANSACTION_NULL:
+        case DNS_TRANSACTION_PENDING:
+        case DNS_TRANSACTION_VALIDATING:
+        case DNS_TRANSACTION_SUCCESS:
+        default:
+                assert_not_reached("Impossible state");
+        }
+}
+
+static int build_address(JsonVariant **ret, int ifindex, int family, const void *address) {
+        _cleanup_(json_variant_unrefp) JsonVariant *a = NULL;
+        int r;
+
+        r = json_variant_new_array_bytes(&a, address, FAMILY_ADDRESS_SIZE(family));
+        if (r < 0)
+                return r;
+
+        return json_build(ret, JSON_BUILD_OBJECT(JSON_BUILD_PAIR("ifindex", JSON_BUILD_INTEGER(ifindex)),
+                                                 JSON_BUILD_PAIR("family", JSON_BUILD_INTEGER(family)),
+                                                 JSON_BUILD_PAIR("address", JSON_BUILD_VARIANT(a))));
+}
+
+static int build_name(JsonVariant **ret, int ifindex, const char *name) {
+        return json_build(ret, JSON_BUILD_OBJECT(JSON_BUILD_PAIR("ifindex", JSON_BUILD_INTEGER(ifindex)),
+                                                 JSON_BUILD_PAIR("name", JSON_BUILD_STRING(name))));
+}
+
+static int varlink_connection_update_idle(VarlinkConnection *c) {
+        int r;
+
+        assert(c);
+
+        /* Lookups time out on their own */
+        if (c->query)
+                return sd_event_source_set_enabled(c->idle_event_source, SD_EVENT_OFF);
+
+        r = sd_event_source_set_time(c->idle_event_source, usec_add(now(clock_boottime_or_monotonic()), VARLINK_IDLE_TIMEOUT_USEC));
+        if (r < 0)
+                return r;
+
+        return sd_event_source_set_enabled(c->idle_event_source, SD_EVENT_ONESHOT);
+}
+
+static void varlink_query_finish(DnsQuery *q, int r, const char *what) {
+        VarlinkConnection *c = q->varlink_request;
+
+        assert(c);
+
+        if (r < 0)
+                log_error_errno(r, "Failed to send %s reply: %m", what);
+
+        /* Also detaches the query from the connection */
+        dns_query_free(q);
+
+        /* This might be called from within dns_query_go(), hence let's not free the connection here, but let the
+         * event loop notice that we hung up on the client if we have no reply. */
+        if (!c->output)
+                (void) shutdown(c->fd, SHUT_RDWR);
+
+        (void) sd_event_source_set_io_events(c->io_event_source, c->output ? EPOLLOUT : EPOLLIN);
+        (void) varlink_connection_update_idle(c);
+}
+
+static void varlink_resolve_hostname_complete(DnsQuery *q) {
+        _cleanup_(dns_resource_record_unrefp) DnsResourceRecord *canonical = NULL;
+        _cleanup_(json_variant_unrefp) JsonVariant *addresses = NULL, *p = NULL;
+        VarlinkConnection *c = q->varlink_request;
+        JsonVariant **array = NULL;
+        size_t n = 0, allocated = 0;
+        _cleanup_free_ char *normalized = NULL;
+        DnsQuestion *question;
+        DnsResourceRecord *rr;
+        int ifindex, r;
+
+        assert(c);
+
+        if (q->state != DNS_TRANSACTION_SUCCESS) {
+                r = reply_query_state(c, q);
+                goto finish;
+        }
+
+        r = dns_query_process_cname(q);
+        if (r == -ELOOP) {
+                r = varlink_connection_error(c, VARLINK_ERROR_RESOLVE("CNAMELoop"), NULL);
+                goto finish;
+        }
+        if (r < 0)
+                goto finish;
+        if (r == DNS_QUERY_RESTARTED) /* This was a cname, and the query was restarted. */
+                return;
+
+        question = dns_query_question_for_protocol(q, q->answer_protocol);
+
+        DNS_ANSWER_FOREACH_IFINDEX(rr, ifindex, q->answer) {
+                int family;
+
+                r = dns_question_matches_rr(question, rr, DNS_SEARCH_DOMAIN_NAME(q->answer_search_domain));
+                if (r < 0)
+                        goto finish;
+                if (r == 0)
+                        continue;
+
+                if (rr->key->type == DNS_TYPE_A)
+                        family = AF_INET;
+                else if (rr->key->type == DNS_TYPE_AAAA)
+                        family = AF_INET6;
+                else
+                        continue;
+
+                if (!GREEDY_REALLOC(array, allocated, n + 1)) {
+                        r = -ENOMEM;
+                        goto finish;
+                }
+
+                r = build_address(array + n, ifindex, family, family == AF_INET ? (const void*) &rr->a.in_addr : (const void*) &rr->aaaa.in6_addr);
+                if (r < 0)
+                        goto finish;
+                n++;
+
+                if (!canonical)
+                        canonical = dns_resource_record_ref(rr);
+        }
+
+        if (n == 0) {
+                r = varlink_connection_error(c, VARLINK_ERROR_RESOLVE("NoSuchResourceRecord"), NULL);
+                goto finish;
+        }
+
+        r = json_variant_new_array(&addresses, array, n);
+        if (r < 0)
+                goto finish;
+
+        /* The key names are not necessarily normalized, make sure that they are when we return them to our
+         * clients. */
+        r = dns_name_normalize(dns_resource_key_name(canonical->key), &normalized);
+        if (r < 0)
+                goto finish;
+
+        r = json_build(&p, JSON_BUILD_OBJECT(JSON_BUILD_PAIR("addresses", JSON_BUILD_VARIANT(addresses)),
+                                             JSON_BUILD_PAIR("name", JSON_BUILD_STRING(normalized)),
+                                             JSON_BUILD_PAIR("flags", JSON_BUILD_UNSIGNED(SD_RESOLVED_FLAGS_MAKE(q->answer_protocol, q->answer_family, dns_query_fully_authenticated(q))))));
+        if (r < 0)
+                goto finish;
+
+        r = varlink_connection_reply(c, p);
+
+finish:
+        json_variant_unref_many(array, n);
+        free(array);
+
+        varlink_query_finish(q, r, "hostname");
+}
+
+static int parse_as_address(VarlinkConnection *c, int ifindex, const char *hostname, int family, uint64_t flags) {
+        _cleanup_(json_variant_unrefp) JsonVariant *a = NULL, *p = NULL;
+        _cleanup_free_ char *canonical = NULL;
+        union in_addr_union parsed;
+        int r, ff, parsed_ifindex = 0;
+
+        /* Check if the hostname is actually already an IP address formatted as string. In that case just parse it,
+         * let's not attempt to look it up. */
+
+        r = in_addr_ifindex_from_string_auto(hostname, &ff, &parsed, &parsed_ifindex);
+        if (r < 0) /* not an address */
+                return 0;
+
+        if ((family != AF_UNSPEC && ff != family) ||
+            (ifindex > 0 && parsed_ifindex > 0 && parsed_ifindex != ifindex)) {
+                r = varlink_connection_error(c, VARLINK_ERROR_RESOLVE("NoSuchResourceRecord"), NULL);
+                return r < 0 ? r : 1;
+        }
+
+        if (parsed_ifindex > 0)
+                ifindex = parsed_ifindex;
+
+        r = build_address(&a, ifindex, ff, &parsed);
+        if (r < 0)
+                return r;
+
+        /* Reformat the address to make sure it is in a truly canonical form, see parse_as_address() in
+         * resolved-bus.c */
+        r = in_addr_ifindex_to_string(ff, &parsed, ifindex, &canonical);
+        if (r < 0)
+                return r;
+
+        r = json_build(&p, JSON_BUILD_OBJECT(JSON_BUILD_PAIR("addresses", JSON_BUILD_ARRAY(JSON_BUILD_VARIANT(a))),
+                                             JSON_BUILD_PAIR("name", JSON_BUILD_STRING(canonical)),
+                                             JSON_BUILD_PAIR("flags", JSON_BUILD_UNSIGNED(SD_RESOLVED_FLAGS_MAKE(dns_synthesize_protocol(flags), ff, true)))));
+        if (r < 0)
+                return r;
+
+        r = varlink_connection_reply(c, p);
+        return r < 0 ? r : 1;
+}
+
+typedef struct LookupParameters {
+        int ifindex;
+        char *name;
+        int family;
+        union in_addr_union address;
+        size_t address_size;
+        uint64_t flags;
+} LookupParameters;
+
+static void lookup_parameters_done(LookupParameters *p) {
+        free(p->name);
+}
+
+static int json_dispatch_address(const char *name, JsonVariant *variant, JsonDispatchFlags flags, void *userdata) {
+        LookupParameters *p = userdata;
+        JsonVariant *i;
+        size_t n = 0;
+
+        assert(variant);
+        assert(p);
+
+        if (!json_variant_is_array(variant) || json_variant_elements(variant) > sizeof(p->address))
+                return -EINVAL;
+
+        JSON_VARIANT_ARRAY_FOREACH(i, variant) {
+                if (!json_variant_is_unsigned(i) || json_variant_unsigned(i) > 0xFF)
+                        return -EINVAL;
+
+                ((uint8_t*) &p->address)[n++] = (uint8_t) json_variant_unsigned(i);
+        }
+
+        p->address_size = n;
+        return 0;
+}
+
+/* Returns the name of the invalid parameter, if any */
+static const char *check_ifindex_flags(int ifindex, uint64_t *flags, uint64_t ok) {
+        assert(flags);
+
+        if (ifindex < 0)
+                return "ifindex";
+
+        if (*flags & ~(SD_RESOLVED_PROTOCOLS_ALL|SD_RESOLVED_NO_CNAME|ok))
+                return "flags";
+
+        if ((*flags & SD_RESOLVED_PROTOCOLS_ALL) == 0) /* If no protocol is enabled, enable all */
+                *flags |= SD_RESOLVED_PROTOCOLS_ALL;
+
+        return NULL;
+}
+
+/* Returns >= 0 if a reply was queued or a query started, and < 0 if the connection shall be closed */
+static int varlink_method_resolve_hostname(VarlinkConnection *c, JsonVariant *parameters) {
+        static const JsonDispatch dispatch_table[] = {
+                { "ifindex", JSON_VARIANT_INTEGER,  json_dispatch_int32,  offsetof(LookupParameters, ifindex), 0              },
+                { "name",    JSON_VARIANT_STRING,   json_dispatch_string, offsetof(LookupParameters, name),    JSON_MANDATORY },
+                { "family",  JSON_VARIANT_INTEGER,  json_dispatch_int32,  offsetof(LookupParameters, family),  0              },
+                { "flags",   JSON_VARIANT_UNSIGNED, json_dispatch_uint64, offsetof(LookupParameters, flags),   0              },
+                {}
+        };
+
+        _cleanup_(dns_question_unrefp) DnsQuestion *question_idna = NULL, *question_utf8 = NULL;
+        _cleanup_(lookup_parameters_done) LookupParameters p = {
+                .family = AF_UNSPEC,
+        };
+        const char *invalid;
+        DnsQuery *q;
+        int r;
+
+        r = json_dispatch(parameters, dispatch_table, NULL, 0, &p);
+        if (r < 0)
+                return varlink_connection_error(c, VARLINK_ERROR_INVALID_PARAMETER, NULL);
+
+        if (!IN_SET(p.family, AF_UNSPEC, AF_INET, AF_INET6))
+                return varlink_connection_error_parameter(c, "family");
+
+        invalid = check_ifindex_flags(p.ifindex, &p.flags, SD_RESOLVED_NO_SEARCH);
+        if (invalid)
+                return varlink_connection_error_parameter(c, invalid);
+
+        r = parse_as_address(c, p.ifindex, p.name, p.family, p.flags);
+        if (r != 0)
+                return r;
+
+        r = dns_name_is_valid(p.name);
+        if (r < 0)
+                return r;
+        if (r == 0)
+                return varlink_connection_error_parameter(c, "name");
+
+        r = dns_question_new_address(&question_utf8, p.family, p.name, false);
+        if (r < 0)
+                return r;
+
+        r = dns_question_new_address(&question_idna, p.family, p.name, true);
+        if (r < 0 && r != -EALREADY)
+                return r;
+
+        r = dns_query_new(c->manager, &q, question_utf8, question_idna ?: question_utf8, p.ifindex, p.flags);
+        if (r < 0)
+                return r;
+
+        q->varlink_request = c;
+        q->request_family = p.family;
+        q->complete = varlink_resolve_hostname_complete;
+        q->suppress_unroutable_family = p.family == AF_UNSPEC;
+        c->query = q;
+
+        r = dns_query_go(q);
+        if (r < 0) {
+                dns_query_free(q);
+                return r;
+        }
+
+        return 0;
+}
+
+static void varlink_resolve_address_complete(DnsQuery *q) {
+        _cleanup_(json_variant_unrefp) JsonVariant *names = NULL, *p = NULL;
+        VarlinkConnection *c = q->varlink_request;
+        JsonVariant **array = NULL;
+        size_t n = 0, allocated = 0;
+        DnsQuestion *question;
+        DnsResourceRecord *rr;
+        int ifindex, r;
+
+        assert(c);
+
+        if (q->state != DNS_TRANSACTION_SUCCESS) {
+                r = reply_query_state(c, q);
+                goto finish;
+        }
+
+        r = dns_query_process_cname(q);
+        if (r == -ELOOP) {
+                r = varlink_connection_error(c, VARLINK_ERROR_RESOLVE("CNAMELoop"), NULL);
+                goto finish;
+        }
+        if (r < 0)
+                goto finish;
+        if (r == DNS_QUERY_RESTARTED) /* This was a cname, and the query was restarted. */
+                return;
+
+        question = dns_query_question_for_protocol(q, q->answer_protocol);
+
+        DNS_ANSWER_FOREACH_IFINDEX(rr, ifindex, q->answer) {
+                _cleanup_free_ char *normalized = NULL;
+
+                r = dns_question_matches_rr(question, rr, NULL);
+                if (r < 0)
+                        goto finish;
+                if (r == 0)
+                        continue;
+
+                r = dns_name_normalize(rr->ptr.name, &normalized);
+                if (r < 0)
+                        goto finish;
+
+                if (!GREEDY_REALLOC(array, allocated, n + 1)) {
+                        r = -ENOMEM;
+                        goto finish;
+                }
+
+                r = build_name(array + n, ifindex, normalized);
+                if (r < 0)
+                        goto finish;
+                n++;
+        }
+
+        if (n == 0) {
+                r = varlink_connection_error(c, VARLINK_ERROR_RESOLVE("NoSuchResourceRecord"), NULL);
+                goto finish;
+        }
+
+        r = json_variant_new_array(&names, array, n);
+        if (r < 0)
+                goto finish;
+
+        r = json_build(&p, JSON_BUILD_OBJECT(JSON_BUILD_PAIR("names", JSON_BUILD_VARIANT(names)),
+                                             JSON_BUILD_PAIR("flags", JSON_BUILD_UNSIGNED(SD_RESOLVED_FLAGS_MAKE(q->answer_protocol, q->answer_family, dns_query_fully_authenticated(q))))));
+        if (r < 0)
+                goto finish;
+
+        r = varlink_connection_reply(c, p);
+
+finish:
+        json_variant_unref_many(array, n);
+        free(array);
+
+        varlink_query_finish(q, r, "address");
+}
+
+static int varlink_method_resolve_address(VarlinkConnection *c, JsonVariant *parameters) {
+        static const JsonDispatch dispatch_table[] = {
+                { "ifindex", JSON_VARIANT_INTEGER,      json_dispatch_int32,   offsetof(LookupParameters, ifindex), 0              },
+                { "family",  JSON_VARIANT_INTEGER,      json_dispatch_int32,   offsetof(LookupParameters, family),  JSON_MANDATORY },
+                { "address", JSON_VARIANT_ARRAY,        json_dispatch_address, 0,                                   JSON_MANDATORY },
+                { "flags",   JSON_VARIANT_UNSIGNED,     json_dispatch_uint64,  offsetof(LookupParameters, flags),   0              },
+                {}
+        };
+
+        _cleanup_(dns_question_unrefp) DnsQuestion *question = NULL;
+        _cleanup_(lookup_parameters_done) LookupParameters p = {
+                .family = AF_UNSPEC,
+        };
+        const char *invalid;
+        DnsQuery *q;
+        int r;
+
+        r = json_dispatch(parameters, dispatch_table, NULL, 0, &p);
+        if (r < 0)
+                return varlink_connection_error(c, VARLINK_ERROR_INVALID_PARAMETER, NULL);
+
+        if (!IN_SET(p.family, AF_INET, AF_INET6))
+                return varlink_connection_error_parameter(c, "family");
+
+        if (p.address_size != FAMILY_ADDRESS_SIZE(p.family))
+                return varlink_connection_error_parameter(c, "address");
+
+        invalid = check_ifindex_flags(p.ifindex, &p.flags, 0);
+        if (invalid)
+                return varlink_connection_error_parameter(c, invalid);
+
+        r = dns_question_new_reverse(&question, p.family, &p.address);
+        if (r < 0)
+                return r;
+
+        r = dns_query_new(c->manager, &q, question, question, p.ifindex, p.flags|SD_RESOLVED_NO_SEARCH);
+        if (r < 0)
+                return r;
+
+        q->varlink_request = c;
+        q->request_family = p.family;
+        q->request_address = p.address;
+        q->complete = varlink_resolve_address_complete;
+        c->query = q;
+
+        r = dns_query_go(q);
+        if (r < 0) {
+                dns_query_free(q);
+                return r;
+        }
+
+        return 0;
+}
+
+static int varlink_connection_dispatch(VarlinkConnection *c, JsonVariant *v) {
+        _cleanup_(json_variant_unrefp) JsonVariant *p = NULL;
+        JsonVariant *method, *parameters;
+        int r;
+
+        assert(c);
+        assert(v);
+
+        method = json_variant_by_key(v, "method");
+        if (!method || !json_variant_is_string(method))
+                return log_debug_errno(SYNTHETIC_ERRNO(EBADMSG), "Lookup socket message without method, closing connection.");
+
+        parameters = json_variant_by_key(v, "parameters");
+
+        if (streq(json_variant_string(method), "io.systemd.Resolve.ResolveHostname"))
+                return varlink_method_resolve_hostname(c, parameters);
+        if (streq(json_variant_string(method), "io.systemd.Resolve.ResolveAddress"))
+                return varlink_method_resolve_address(c, parameters);
+
+        r = json_build(&p, JSON_BUILD_OBJECT(JSON_BUILD_PAIR("method", JSON_BUILD_VARIANT(method))));
+        if (r < 0)
+                return r;
+
+        return varlink_connection_error(c, VARLINK_ERROR_METHOD_NOT_FOUND, p);
+}
+
+static int varlink_connection_process(VarlinkConnection *c) {
+        uint32_t events = 0;
+        int r;
+
+        assert(c);
+
+        /* Handle all complete calls we already read, one after the other, and then update what we wait for */
+        while (!c->output && !c->query) {
+                _cleanup_(json_variant_unrefp) JsonVariant *v = NULL;
+                char *e;
+                size_t l;
+
+                e = c->input_size > 0 ? memchr(c->input, 0, c->input_size) : NULL;
+                if (!e) {
+                        events = EPOLLIN;
+                        break;
+                }
+
+                r = json_parse(c->input, &v, NULL, NULL);
+                if (r < 0)
+                        return log_debug_errno(r, "Failed to parse lookup socket message, closing connection: %m");
+
+                /* Drop the message before processing it, as the reply might be sent right away */
+                l = e - c->input + 1;
+                memmove(c->input, c->input + l, c->input_size - l);
+                c->input_size -= l;
+
+                r = varlink_connection_dispatch(c, v);
+                if (r < 0)
+                        return r;
+        }
+
+        if (c->output)
+                events = EPOLLOUT;
+
+        r = sd_event_source_set_io_events(c->io_event_source, events);
+        if (r < 0)
+                return r;
+
+        return varlink_connection_update_idle(c);
+}
+
+static int varlink_connection_read(VarlinkConnection *c) {
+        ssize_t n;
+
+        if (!GREEDY_REALLOC(c->input, c->input_allocated, c->input_size + VARLINK_READ_SIZE))
+                return -ENOMEM;
+
+        n = read(c->fd, c->input + c->input_size, c->input_allocated - c->input_size);
+        if (n < 0)
+                return IN_SET(errno, EAGAIN, EINTR) ? 0 : -errno;
+        if (n == 0)
+                return -ECONNRESET;
+
+        c->input_size += n;
+
+        if (c->input_size > VARLINK_MESSAGE_SIZE_MAX && !memchr(c->input, 0, c->input_size))
+                return -EMSGSIZE;
+
+        return 0;
+}
+
+static int varlink_connection_write(VarlinkConnection *c) {
+        ssize_t n;
+
+        n = send(c->fd, c->output + c->output_written, c->output_size - c->output_written, MSG_NOSIGNAL);
+        if (n < 0)
+                return IN_SET(errno, EAGAIN, EINTR) ? 0 : -errno;
+
+        c->output_written += n;
+        if (c->output_written >= c->output_size)
+                c->output = mfree(c->output);
+
+        return 0;
+}
+
+static int on_varlink_connection_io(sd_event_source *s, int fd, uint32_t revents, void *userdata) {
+        VarlinkConnection *c = userdata;
+        int r = 0;
+
+        assert(c);
+
+        if (revents & EPOLLOUT)
+                r = varlink_connection_write(c);
+        else if (revents & EPOLLIN)
+                r = varlink_connection_read(c);
+        else if (revents & (EPOLLHUP|EPOLLERR))
+                r = -ECONNRESET;
+
+        if (r >= 0)
+                r = varlink_connection_process(c);
+        if (r < 0)
+                varlink_connection_free(c);
+
+        return 0;
+}
+
+static int on_varlink_connection_idle(sd_event_source *s, usec_t usec, void *userdata) {
+        VarlinkConnection *c = userdata;
+
+        assert(c);
+
+        log_debug("Lookup socket connection idle for too long, closing.");
+        varlink_connection_free(c);
+
+        return 0;
+}
+
+int manager_varlink_add_connection(Manager *m, int fd) {
+        VarlinkConnection *c;
+        int r;
+
+        assert(m);
+        assert(fd >= 0);
+
+        if (m->n_varlink_connections >= VARLINK_CONNECTIONS_MAX) {
+                safe_close(fd);
+                return log_debug_errno(SYNTHETIC_ERRNO(EBUSY), "Too many connections on the lookup socket, refusing.");
+        }
+
+        c = new(VarlinkConnection, 1);
+        if (!c) {
+                safe_close(fd);
+                return -ENOMEM;
+        }
+
+        *c = (VarlinkConnection) {
+                .fd = fd,
+        };
+
+        r = sd_event_add_io(m->event, &c->io_event_source, c->fd, EPOLLIN, on_varlink_connection_io, c);
+        if (r < 0) {
+                varlink_connection_free(c);
+                return r;
+        }
+
+        (void) sd_event_source_set_description(c->io_event_source, "varlink-connection");
+
+        r = sd_event_add_time(
+                        m->event,
+                        &c->idle_event_source,
+                        clock_boottime_or_monotonic(),
+                        usec_add(now(clock_boottime_or_monotonic()), VARLINK_IDLE_TIMEOUT_USEC), 0,
+                        on_varlink_connection_idle, c);
+        if (r < 0) {
+                varlink_connection_free(c);
+                return r;
+        }
+
+        (void) sd_event_source_set_description(c->idle_event_source, "varlink-connection-idle");
+
+        c->manager = m;
+        LIST_PREPEND(connections, m->varlink_connections, c);
+        m->n_varlink_connections++;
+
+        return 0;
+}
+
+static int on_varlink_connection(sd_event_source *s, int fd, uint32_t revents, void *userdata) {
+        Manager *m = userdata;
+        int cfd, r;
+
+        assert(m);
+
+        /* Note that we never return an error here: sd-event would disable the listening socket for good
+         * then, and all clients would hang until they time out. */
+
+        cfd = accept4(fd, NULL, NULL, SOCK_NONBLOCK|SOCK_CLOEXEC);
+        if (cfd < 0) {
+                if (IN_SET(errno, EAGAIN, EINTR, ECONNABORTED))
+                        return 0;
+
+                if (IN_SET(errno, EMFILE, ENFILE, ENOBUFS, ENOMEM))
+                        log_warning_errno(errno, "Failed to accept connection on lookup socket, ignoring: %m");
+                else
+                        log_error_errno(errno, "Failed to accept connection on lookup socket, ignoring: %m");
+                return 0;
+        }
+
+        r = manager_varlink_add_connection(m, cfd);
+        if (r == -ENOMEM)
+                log_oom();
+        else if (r < 0 && r != -EBUSY)
+                log_warning_errno(r, "Failed to set up connection on lookup socket, ignoring: %m");
+
+        return 0;
+}
+
+int manager_varlink_init(Manager *m) {
+        union sockaddr_union sa = {};
+        _cleanup_close_ int fd = -1;
+        int r;
+
+        assert(m);
+
+        if (m->varlink_fd >= 0)
+                return 0;
+
+        r = sockaddr_un_set_path(&sa.un, SD_RESOLVED_VARLINK_PATH);
+        if (r < 0)
+                return r;
+
+        fd = socket(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC|SOCK_NONBLOCK, 0);
+        if (fd < 0)
+                return log_error_errno(errno, "Failed to create lookup socket: %m");
+
+        (void) unlink(SD_RESOLVED_VARLINK_PATH);
+
+        if (bind(fd, &sa.sa, SOCKADDR_UN_LEN(sa.un)) < 0)
+                return log_error_errno(errno, "Failed to bind lookup socket " SD_RESOLVED_VARLINK_PATH ": %m");
+
+        /* Everybody may look up names, as on the bus */
+        if (chmod(SD_RESOLVED_VARLINK_PATH, 0666) < 0)
+                return log_error_errno(errno, "Failed to change access mode of " SD_RESOLVED_VARLINK_PATH ": %m");
+
+        if (listen(fd, SOMAXCONN) < 0)
+                return log_error_errno(errno, "Failed to listen on lookup socket: %m");
+
+        r = sd_event_add_io(m->event, &m->varlink_event_source, fd, EPOLLIN, on_varlink_connection, m);
+        if (r < 0)
+                return log_error_errno(r, "Failed to watch lookup socket: %m");
+
+        (void) sd_event_source_set_description(m->varlink_event_source, "varlink");
+
+        m->varlink_fd = TAKE_FD(fd);
+        return 0;
+}
+
+void manager_varlink_done(Manager *m) {
+        assert(m);
+
+        while (m->varlink_connections)
+                varlink_connection_free(m->varlink_connections);
+
+        m->varlink_event_source = sd_event_source_unref(m->varlink_event_source);
+
+        if (m->varlink_fd >= 0) {
+                (void) unlink(SD_RESOLVED_VARLINK_PATH);
+                m->varlink_fd = safe_close(m->varlink_fd);
+        }
+}
@@ -0,0 +1,37 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+#pragma once
+
+#include "sd-event.h"
+
+#include "list.h"
+
+typedef struct VarlinkConnection VarlinkConnection;
+
+#include "resolved-manager.h"
+
+/* A connection on the lookup socket, which carries NUL terminated JSON messages in varlink style: each call is
+ * answered by exactly one reply, and calls on the same connection are processed one after the other. */
+struct VarlinkConnection {
+        Manager *manager;
+
+        int fd;
+        sd_event_source *io_event_source;
+
+        /* Closes the connection if the client does nothing while no lookup is in progress */
+        sd_event_source *idle_event_source;
+
+        char *input;
+        size_t input_size, input_allocated;
+
+        char *output;
+        size_t output_size, output_written;
+
+        /* The lookup of the call currently being processed, if any */
+        DnsQuery *query;
+
+        LIST_FIELDS(VarlinkConnection, connections);
+};
+
+int manager_varlink_init(Manager *m);
+int manager_varlink_add_connection(Manager *m, int fd);
+void manager_varlink_done(Manager *m);
@@ -0,0 +1,193 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <netinet/in.h>
+#include <stdarg.h>
+#include <sys/socket.h>
+
+#include "alloc-util.h"
+#include "bitmap.h"
+#include "log.h"
+#include "resolved-dns-cache.h"
+#include "resolved-dns-rr.h"
+#include "string-util.h"
+#include "tests.h"
+
+static DnsResourceRecord *make_nsec(const char *owner, const char *next, unsigned n_skip_labels_signer, ...) {
+        DnsResourceRecord *rr;
+        va_list ap;
+        int type;
+
+        rr = dns_resource_record_new_full(DNS_CLASS_IN, DNS_TYPE_NSEC, owner);
+        assert_se(rr);
+
+        rr->ttl = 3600;
+        assert_se(rr->nsec.next_domain_name = strdup(next));
+        assert_se(rr->nsec.types = bitmap_new());
+
+        va_start(ap, n_skip_labels_signer);
+        while ((type = va_arg(ap, int)) > 0)
+                assert_se(bitmap_set(rr->nsec.types, type) >= 0);
+        va_end(ap);
+
+        /* This is what validation would have found out about the RR */
+        rr->n_skip_labels_signer = n_skip_labels_signer;
+        rr->n_skip_labels_source = 0;
+
+        return rr;
+}
+
+static void cache_nsec(DnsCache *c, bool authenticated, bool with_wildcard_proof) {
+        _cleanup_(dns_resource_record_unrefp) DnsResourceRecord *apex = NULL, *alpha = NULL;
+        _cleanup_(dns_answer_unrefp) DnsAnswer *answer = NULL;
+        DnsAnswerFlags flags = DNS_ANSWER_CACHEABLE | (authenticated ? DNS_ANSWER_AUTHENTICATED : 0);
+        union in_addr_union owner = {};
+
+        /* The apex NSEC proves that there's no *.example.com. The other one proves that nothing exists between
+         * alpha.example.com and delta.foo.example.com, with foo.example.com an empty non-terminal. */
+        apex = make_nsec("example.com", "alpha.example.com", 0,
+                         DNS_TYPE_NS, DNS_TYPE_SOA, DNS_TYPE_RRSIG, DNS_TYPE_NSEC, DNS_TYPE_DNSKEY, 0);
+        alpha = make_nsec("alpha.example.com", "delta.foo.example.com", 1,
+                          DNS_TYPE_A, DNS_TYPE_RRSIG, DNS_TYPE_NSEC, 0);
+
+        assert_se(answer = dns_answer_new(2));
+        if (with_wildcard_proof)
+                assert_se(dns_answer_add(answer, apex, 0, flags) >= 0);
+        assert_se(dns_answer_add(answer, alpha, 0, flags) >= 0);
+
+        assert_se(dns_cache_put(c, NULL, DNS_RCODE_SUCCESS, answer, authenticated, 0, 0, AF_INET, &owner) >= 0);
+}
+
+static int lookup(DnsCache *c, uint16_t type, const char *name, int *ret_rcode) {
+        _cleanup_(dns_answer_unrefp) DnsAnswer *answer = NULL;
+        bool authenticated = false, prefetch;
+        int r;
+
+        r = dns_cache_lookup(c, &DNS_RESOURCE_KEY_CONST(DNS_CLASS_IN, type, name), false, ret_rcode, &answer, &authenticated, &prefetch);
+        assert_se(r >= 0);
+
+        /* Synthesized answers are empty, and validated, as the RRs they are derived from */
+        if (r > 0) {
+                assert_se(!answer);
+                assert_se(authenticated);
+        }
+
+        return r;
+}
+
+#if HAVE_GCRYPT
+static void test_nsec_nxdomain(void) {
+        DnsCache c = {}, d = {};
+        int rcode;
+
+        log_info("/* %s */", __func__);
+
+        cache_nsec(&c, true, true);
+
+        assert_se(lookup(&c, DNS_TYPE_A, "beta.example.com", &rcode) > 0);
+        assert_se(rcode == DNS_RCODE_NXDOMAIN);
+        assert_se(lookup(&c, DNS_TYPE_AAAA, "charlie.example.com", &rcode) > 0);
+        assert_se(rcode == DNS_RCODE_NXDOMAIN);
+        assert_se(c.n_synthesized_nxdomain == 2);
+        assert_se(c.n_synthesized_nodata == 0);
+
+        dns_cache_flush(&c);
+
+        /* Without the proof that there's no wildcard which could have synthesized the name, nothing is known */
+        cache_nsec(&d, true, false);
+
+        assert_se(lookup(&d, DNS_TYPE_A, "beta.example.com", &rcode) == 0);
+        assert_se(d.n_synthesized_nxdomain == 0);
+
+        dns_cache_flush(&d);
+}
+
+static void test_nsec_nodata(void) {
+        DnsCache c = {};
+        int rcode;
+
+        log_info("/* %s */", __func__);
+
+        cache_nsec(&c, true, true);
+
+        /* foo.example.com exists, as there's a name below it, but has no RRs */
+        assert_se(lookup(&c, DNS_TYPE_A, "foo.example.com", &rcode) > 0);
+        assert_se(rcode == DNS_RCODE_SUCCESS);
+        assert_se(c.n_synthesized_nodata == 1);
+        assert_se(c.n_synthesized_nxdomain == 0);
+
+        dns_cache_flush(&c);
+}
+#endif
+
+static void test_nsec_outside_span(void) {
+        DnsCache c = {};
+        int rcode;
+
+        log_info("/* %s */", __func__);
+
+        cache_nsec(&c, true, true);
+
+        /* Names after the end of the covered range, the next name itself, and names in other zones */
+        assert_se(lookup(&c, DNS_TYPE_A, "zulu.example.com", &rcode) == 0);
+        assert_se(lookup(&c, DNS_TYPE_A, "delta.foo.example.com", &rcode) == 0);
+        assert_se(lookup(&c, DNS_TYPE_A, "beta.example.org", &rcode) == 0);
+        assert_se(c.n_synthesized_nxdomain == 0);
+        assert_se(c.n_synthesized_nodata == 0);
+
+        dns_cache_flush(&c);
+}
+
+static void test_nsec_unauthenticated(void) {
+        DnsCache c = {};
+        int rcode;
+
+        log_info("/* %s */", __func__);
+
+        cache_nsec(&c, false, true);
+
+        /* The RRs are cached, but not indexed, and hence don't prove anything about other names */
+        assert_se(!dns_cache_is_empty(&c));
+        assert_se(hashmap_isempty(c.nsec_by_zone));
+
+        assert_se(lookup(&c, DNS_TYPE_A, "beta.example.com", &rcode) == 0);
+        assert_se(lookup(&c, DNS_TYPE_A, "foo.example.com", &rcode) == 0);
+
+        dns_cache_flush(&c);
+}
+
+static void test_nsec_excluded_types(void) {
+        DnsCache c = {};
+        int rcode;
+
+        log_info("/* %s */", __func__);
+
+        cache_nsec(&c, true, true);
+        assert_se(!hashmap_isempty(c.nsec_by_zone));
+
+        /* Only the NSEC RRs of the lower zone are cached, hence they can't prove anything about DS RRs, and
+         * NSEC/NSEC3 lookups need the real RRs */
+        assert_se(lookup(&c, DNS_TYPE_DS, "beta.example.com", &rcode) == 0);
+        assert_se(lookup(&c, DNS_TYPE_NSEC, "beta.example.com", &rcode) == 0);
+        assert_se(lookup(&c, DNS_TYPE_NSEC3, "beta.example.com", &rcode) == 0);
+        assert_se(lookup(&c, DNS_TYPE_DS, "foo.example.com", &rcode) == 0);
+        assert_se(c.n_synthesized_nxdomain == 0);
+        assert_se(c.n_synthesized_nodata == 0);
+
+        dns_cache_flush(&c);
+        assert_se(hashmap_isempty(c.nsec_by_zone));
+}
+
+int main(int argc, char *argv[]) {
+        test_setup_logging(LOG_DEBUG);
+
+#if HAVE_GCRYPT
+        /* Without libgcrypt there's no DNSSEC, and hence nothing is ever proven */
+        test_nsec_nxdomain();
+        test_nsec_nodata();
+#endif
+        test_nsec_outside_span();
+        test_nsec_unauthenticated();
+        test_nsec_excluded_types();
+
+        return 0;
+}
@@ -6,6 +6,7 @@
 #include "sd-id128.h"
 
 #include "alloc-util.h"
+#include "dns-domain.h"
 #include "fileio.h"
 #include "glob-util.h"
 #include "log.h"
@@ -16,10 +17,13 @@
 #include "string-util.h"
 #include "strv.h"
 #include "tests.h"
+#include "time-util.h"
 #include "unaligned.h"
 
 #define HASH_KEY SD_ID128_MAKE(d3,1e,48,90,4b,fa,4c,fe,af,9d,d5,a1,d7,2e,8a,b1)
 
+#define EXTRACT_ITERATIONS 1000U
+
 static void verify_rr_copy(DnsResourceRecord *rr) {
         _cleanup_(dns_resource_record_unrefp) DnsResourceRecord *copy = NULL;
         const char *a, *b;
@@ -91,6 +95,79 @@ static void test_packet_from_file(const char* filename, bool canonical) {
         }
 }
 
+static void test_packet_extract_from_file(const char *filename) {
+        _cleanup_(dns_packet_unrefp) DnsPacket *p = NULL;
+        _cleanup_(dns_answer_unrefp) DnsAnswer *answer = NULL;
+        _cleanup_free_ char *data = NULL;
+        char buf[FORMAT_TIMESPAN_MAX];
+        size_t data_size, packet_size, offset;
+        DnsResourceRecord *rr;
+        unsigned i, n = 0;
+        usec_t t;
+
+        assert_se(read_full_file(filename, &data, &data_size) >= 0);
+        assert_se(data);
+
+        for (offset = 0; offset < data_size; offset += 8 + packet_size) {
+                _cleanup_(dns_packet_unrefp) DnsPacket *q = NULL;
+                _cleanup_(dns_resource_record_unrefp) DnsResourceRecord *r = NULL;
+
+                packet_size = unaligned_read_le64(data + offset);
+                assert_se(offset + 8 + packet_size <= data_size);
+
+                assert_se(dns_packet_new(&q, DNS_PROTOCOL_DNS, 0, DNS_PACKET_SIZE_MAX) >= 0);
+                assert_se(dns_packet_append_blob(q, data + offset + 8, packet_size, NULL) >= 0);
+                assert_se(dns_packet_read_rr(q, &r, NULL, NULL) >= 0);
+                assert_se(dns_answer_add_extend(&answer, r, 0, DNS_ANSWER_CACHEABLE) >= 0);
+        }
+
+        /* Put the records into a reply to a question for the first of them, the way a server would */
+        assert_se(dns_packet_new(&p, DNS_PROTOCOL_DNS, 0, DNS_PACKET_SIZE_MAX) >= 0);
+        DNS_PACKET_HEADER(p)->flags = htobe16(DNS_PACKET_MAKE_FLAGS(1, 0, 0, 0, 1, 1, 0, 0, DNS_RCODE_SUCCESS));
+        assert_se(dns_packet_append_key(p, answer->items[0].rr->key, 0, NULL) >= 0);
+        DNS_PACKET_HEADER(p)->qdcount = htobe16(1);
+
+        DNS_ANSWER_FOREACH(rr, answer) {
+                assert_se(dns_packet_append_rr(p, rr, 0, NULL, NULL) >= 0);
+                n++;
+        }
+        DNS_PACKET_HEADER(p)->ancount = htobe16(n);
+
+        t = now(CLOCK_MONOTONIC);
+
+        for (i = 0; i < EXTRACT_ITERATIONS; i++) {
+                _cleanup_(dns_packet_unrefp) DnsPacket *q = NULL;
+                DnsResourceKey *question;
+                unsigned j = 0;
+
+                assert_se(dns_packet_new(&q, DNS_PROTOCOL_DNS, 0, DNS_PACKET_SIZE_MAX) >= 0);
+                memcpy(DNS_PACKET_DATA(q), DNS_PACKET_DATA(p), DNS_PACKET_HEADER_SIZE);
+                assert_se(dns_packet_append_blob(q, DNS_PACKET_DATA(p) + DNS_PACKET_HEADER_SIZE, p->size - DNS_PACKET_HEADER_SIZE, NULL) >= 0);
+
+                assert_se(dns_packet_extract(q) >= 0);
+                assert_se(dns_question_size(q->question) == 1);
+                assert_se(dns_answer_size(q->answer) == n);
+
+                if (i > 0)
+                        continue;
+
+                /* Records for the question share its key, unless their name is the root domain, which is never
+                 * compressed */
+                question = q->question->keys[0];
+
+                DNS_ANSWER_FOREACH(rr, q->answer) {
+                        assert_se(dns_resource_record_equal(rr, answer->items[j++].rr) > 0);
+                        assert_se(rr->key == question ||
+                                  dns_resource_key_equal(rr->key, question) == 0 ||
+                                  dns_name_is_root(dns_resource_key_name(rr->key)));
+                }
+        }
+
+        t = now(CLOCK_MONOTONIC) - t;
+
+        log_info("%s: %u records, %s per reply", filename, n, format_timespan(buf, sizeof(buf), t / EXTRACT_ITERATIONS, 1));
+}
+
 int main(int argc, char **argv) {
         int i, N;
         _cleanup_free_ char *pkts_glob = NULL;
@@ -113,6 +190,7 @@ int main(int argc, char **argv) {
                 test_packet_from_file(fnames[i], false);
                 puts("");
                 test_packet_from_file(fnames[i], true);
+                test_packet_extract_from_file(fnames[i]);
                 if (i + 1 < N)
                         puts("");
         }
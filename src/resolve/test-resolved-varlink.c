@@ -0,0 +1,243 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <poll.h>
+#include <sys/socket.h>
+
+#include "sd-event.h"
+
+#include "alloc-util.h"
+#include "fd-util.h"
+#include "io-util.h"
+#include "json.h"
+#include "log.h"
+#include "resolved-manager.h"
+#include "resolved-varlink.h"
+#include "string-util.h"
+#include "tests.h"
+
+static void send_call(int fd, const char *method, JsonVariant *parameters) {
+        _cleanup_(json_variant_unrefp) JsonVariant *v = NULL;
+        _cleanup_free_ char *text = NULL;
+        int r;
+
+        assert_se(json_build(&v, JSON_BUILD_OBJECT(JSON_BUILD_PAIR("method", JSON_BUILD_STRING(method)),
+                                                   JSON_BUILD_PAIR_CONDITION(!!parameters, "parameters", JSON_BUILD_VARIANT(parameters)))) >= 0);
+
+        r = json_variant_format(v, 0, &text);
+        assert_se(r >= 0);
+        assert_se(loop_write(fd, text, (size_t) r + 1, false) >= 0);
+}
+
+static JsonVariant *receive_reply(sd_event *e, int fd) {
+        static char buf[64 * 1024];
+        static size_t size = 0;
+        JsonVariant *v = NULL;
+        char *end;
+        size_t l;
+
+        /* Run the server side until a reply arrived. Replies to calls sent in one go are buffered, hence
+         * only read more if there is no complete message left. */
+        while (!(end = memchr(buf, 0, size))) {
+                ssize_t k;
+
+                while (fd_wait_for_event(fd, POLLIN, 0) == 0)
+                        assert_se(sd_event_run(e, 5 * USEC_PER_SEC) > 0);
+
+                k = read(fd, buf + size, sizeof(buf) - size);
+                assert_se(k > 0);
+                size += k;
+        }
+
+        assert_se(json_parse(buf, &v, NULL, NULL) >= 0);
+
+        l = end - buf + 1;
+        memmove(buf, buf + l, size - l);
+        size -= l;
+
+        json_variant_dump(v, JSON_FORMAT_NEWLINE, stdout, NULL);
+        return v;
+}
+
+static void assert_error(JsonVariant *v, const char *error) {
+        JsonVariant *e;
+
+        e = json_variant_by_key(v, "error");
+        assert_se(e);
+        assert_se(streq(json_variant_string(e), error));
+}
+
+static bool has_address(JsonVariant *reply, int family, const uint8_t *address, size_t size) {
+        JsonVariant *p, *a;
+
+        p = json_variant_by_key(reply, "parameters");
+        assert_se(p);
+        assert_se(!json_variant_by_key(reply, "error"));
+
+        JSON_VARIANT_ARRAY_FOREACH(a, json_variant_by_key(p, "addresses")) {
+                JsonVariant *bytes;
+                size_t i;
+
+                if (json_variant_integer(json_variant_by_key(a, "family")) != family)
+                        continue;
+
+                bytes = json_variant_by_key(a, "address");
+                if (json_variant_elements(bytes) != size)
+                        continue;
+
+                for (i = 0; i < size; i++)
+                        if (json_variant_unsigned(json_variant_by_index(bytes, i)) != address[i])
+                                break;
+                if (i == size)
+                        return true;
+        }
+
+        return false;
+}
+
+static void test_resolve_hostname(sd_event *e, int fd) {
+        static const uint8_t localhost4[] = { 127, 0, 0, 1 }, localhost6[] = { [15] = 1 }, other[] = { 192, 168, 0, 1 };
+        _cleanup_(json_variant_unrefp) JsonVariant *parameters = NULL, *reply = NULL;
+
+        log_info("/* %s */", __func__);
+
+        /* Synthesized locally, hence doesn't need any network */
+        assert_se(json_build(&parameters, JSON_BUILD_OBJECT(JSON_BUILD_PAIR("name", JSON_BUILD_STRING("localhost")))) >= 0);
+        send_call(fd, "io.systemd.Resolve.ResolveHostname", parameters);
+        reply = receive_reply(e, fd);
+        assert_se(has_address(reply, AF_INET, localhost4, sizeof(localhost4)));
+        assert_se(has_address(reply, AF_INET6, localhost6, sizeof(localhost6)));
+        assert_se(streq(json_variant_string(json_variant_by_key(json_variant_by_key(reply, "parameters"), "name")), "localhost"));
+
+        /* Addresses are parsed, not looked up */
+        parameters = json_variant_unref(parameters);
+        reply = json_variant_unref(reply);
+        assert_se(json_build(&parameters, JSON_BUILD_OBJECT(JSON_BUILD_PAIR("name", JSON_BUILD_STRING("192.168.0.1")))) >= 0);
+        send_call(fd, "io.systemd.Resolve.ResolveHostname", parameters);
+        reply = receive_reply(e, fd);
+        assert_se(has_address(reply, AF_INET, other, sizeof(other)));
+
+        parameters = json_variant_unref(parameters);
+        reply = json_variant_unref(reply);
+        assert_se(json_build(&parameters, JSON_BUILD_OBJECT(JSON_BUILD_PAIR("name", JSON_BUILD_STRING("192.168.0.1")),
+                                                            JSON_BUILD_PAIR("family", JSON_BUILD_INTEGER(AF_INET6)))) >= 0);
+        send_call(fd, "io.systemd.Resolve.ResolveHostname", parameters);
+        reply = receive_reply(e, fd);
+        assert_error(reply, "io.systemd.Resolve.NoSuchResourceRecord");
+
+        parameters = json_variant_unref(parameters);
+        reply = json_variant_unref(reply);
+        assert_se(json_build(&parameters, JSON_BUILD_OBJECT(JSON_BUILD_PAIR("name", JSON_BUILD_STRING("localhost")),
+                                                            JSON_BUILD_PAIR("family", JSON_BUILD_INTEGER(4711)))) >= 0);
+        send_call(fd, "io.systemd.Resolve.ResolveHostname", parameters);
+        reply = receive_reply(e, fd);
+        assert_error(reply, "org.varlink.service.InvalidParameter");
+        assert_se(streq(json_variant_string(json_variant_by_key(json_variant_by_key(reply, "parameters"), "parameter")), "family"));
+}
+
+static void test_resolve_address(sd_event *e, int fd) {
+        static const uint8_t localhost4[] = { 127, 0, 0, 1 };
+        _cleanup_(json_variant_unrefp) JsonVariant *parameters = NULL, *address = NULL, *reply = NULL;
+        JsonVariant *names;
+
+        log_info("/* %s */", __func__);
+
+        assert_se(json_variant_new_array_bytes(&address, localhost4, sizeof(localhost4)) >= 0);
+        assert_se(json_build(&parameters, JSON_BUILD_OBJECT(JSON_BUILD_PAIR("family", JSON_BUILD_INTEGER(AF_INET)),
+                                                            JSON_BUILD_PAIR("address", JSON_BUILD_VARIANT(address)))) >= 0);
+        send_call(fd, "io.systemd.Resolve.ResolveAddress", parameters);
+        reply = receive_reply(e, fd);
+
+        names = json_variant_by_key(json_variant_by_key(reply, "parameters"), "names");
+        assert_se(json_variant_elements(names) >= 1);
+        assert_se(streq(json_variant_string(json_variant_by_key(json_variant_by_index(names, 0), "name")), "localhost"));
+
+        /* The address must match the family */
+        parameters = json_variant_unref(parameters);
+        reply = json_variant_unref(reply);
+        assert_se(json_build(&parameters, JSON_BUILD_OBJECT(JSON_BUILD_PAIR("family", JSON_BUILD_INTEGER(AF_INET6)),
+                                                            JSON_BUILD_PAIR("address", JSON_BUILD_VARIANT(address)))) >= 0);
+        send_call(fd, "io.systemd.Resolve.ResolveAddress", parameters);
+        reply = receive_reply(e, fd);
+        assert_error(reply, "org.varlink.service.InvalidParameter");
+}
+
+static void test_pipelined(sd_event *e, int fd) {
+        _cleanup_(json_variant_unrefp) JsonVariant *first = NULL, *second = NULL, *third = NULL;
+        _cleanup_(json_variant_unrefp) JsonVariant *reply1 = NULL, *reply2 = NULL, *reply3 = NULL;
+        static const uint8_t a[] = { 10, 0, 0, 1 }, b[] = { 10, 0, 0, 2 };
+
+        log_info("/* %s */", __func__);
+
+        /* Calls sent without waiting for replies are answered in order, and unknown methods don't break the
+         * connection */
+        assert_se(json_build(&first, JSON_BUILD_OBJECT(JSON_BUILD_PAIR("name", JSON_BUILD_STRING("10.0.0.1")))) >= 0);
+        assert_se(json_build(&third, JSON_BUILD_OBJECT(JSON_BUILD_PAIR("name", JSON_BUILD_STRING("10.0.0.2")))) >= 0);
+        send_call(fd, "io.systemd.Resolve.ResolveHostname", first);
+        send_call(fd, "io.systemd.Resolve.NoSuchMethod", second);
+        send_call(fd, "io.systemd.Resolve.ResolveHostname", third);
+
+        reply1 = receive_reply(e, fd);
+        assert_se(has_address(reply1, AF_INET, a, sizeof(a)));
+        reply2 = receive_reply(e, fd);
+        assert_error(reply2, "org.varlink.service.MethodNotFound");
+        reply3 = receive_reply(e, fd);
+        assert_se(has_address(reply3, AF_INET, b, sizeof(b)));
+}
+
+static void test_idle(Manager *m) {
+        _cleanup_close_pair_ int pair[2] = { -1, -1 };
+        VarlinkConnection *c;
+        int enabled;
+
+        log_info("/* %s */", __func__);
+
+        assert_se(socketpair(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC, 0, pair) >= 0);
+        assert_se(fd_nonblock(pair[0], true) >= 0);
+        assert_se(manager_varlink_add_connection(m, TAKE_FD(pair[0])) >= 0);
+        assert_se(m->n_varlink_connections == 1);
+
+        c = m->varlink_connections;
+        assert_se(sd_event_source_get_enabled(c->idle_event_source, &enabled) >= 0);
+        assert_se(enabled == SD_EVENT_ONESHOT);
+
+        /* A client that does nothing is disconnected once the timeout elapsed, pretend it did */
+        assert_se(sd_event_source_set_time(c->idle_event_source, 1) >= 0);
+        while (m->n_varlink_connections > 0)
+                assert_se(sd_event_run(m->event, 5 * USEC_PER_SEC) > 0);
+
+        assert_se(fd_wait_for_event(pair[1], POLLIN, 0) > 0);
+        assert_se(read(pair[1], (char[1]) {}, 1) == 0);
+}
+
+int main(int argc, char *argv[]) {
+        _cleanup_(sd_event_unrefp) sd_event *e = NULL;
+        _cleanup_close_pair_ int pair[2] = { -1, -1 };
+        Manager m = {
+                .varlink_fd = -1,
+        };
+
+        test_setup_logging(LOG_DEBUG);
+
+        assert_se(sd_event_new(&e) >= 0);
+        m.event = e;
+
+        assert_se(socketpair(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC, 0, pair) >= 0);
+        assert_se(fd_nonblock(pair[0], true) >= 0);
+        assert_se(manager_varlink_add_connection(&m, TAKE_FD(pair[0])) >= 0);
+        assert_se(m.n_varlink_connections == 1);
+
+        test_resolve_hostname(e, pair[1]);
+        test_resolve_address(e, pair[1]);
+        test_pipelined(e, pair[1]);
+
+        /* The connection goes away when the client hangs up */
+        pair[1] = safe_close(pair[1]);
+        while (m.n_varlink_connections > 0)
+                assert_se(sd_event_run(e, 5 * USEC_PER_SEC) > 0);
+
+        test_idle(&m);
+
+        manager_varlink_done(&m);
+
+        return 0;
+}
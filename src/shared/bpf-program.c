@@ -42,6 +42,10 @@ static BPFProgram *bpf_program_free(BPFProgram *p) {
          * whenever we close the BPF fd. */
         (void) bpf_program_cgroup_detach(p);
 
+        if (p->shared_cache)
+                (void) hashmap_remove_value(p->shared_cache, p, p);
+        bpf_program_unref(p->shared);
+
         safe_close(p->kernel_fd);
         free(p->instructions);
         free(p->attached_path);
@@ -94,6 +98,91 @@ int bpf_program_load_kernel(BPFProgram *p, char *log_buf, size_t log_size) {
         return 0;
 }
 
+static void bpf_program_hash_func(const BPFProgram *p, struct siphash *state) {
+        assert(p);
+
+        siphash24_compress(&p->prog_type, sizeof(p->prog_type), state);
+        siphash24_compress(&p->n_instructions, sizeof(p->n_instructions), state);
+        siphash24_compress(p->instructions, sizeof(struct bpf_insn) * p->n_instructions, state);
+}
+
+static int bpf_program_compare_func(const BPFProgram *a, const BPFProgram *b) {
+        int r;
+
+        r = CMP(a->prog_type, b->prog_type);
+        if (r != 0)
+                return r;
+
+        r = CMP(a->n_instructions, b->n_instructions);
+        if (r != 0)
+                return r;
+
+        return memcmp(a->instructions, b->instructions, sizeof(struct bpf_insn) * a->n_instructions);
+}
+
+DEFINE_PRIVATE_HASH_OPS(bpf_program_hash_ops, BPFProgram, bpf_program_hash_func, bpf_program_compare_func);
+
+bool bpf_program_equal(const BPFProgram *a, const BPFProgram *b) {
+        if (a == b)
+                return true;
+        if (!a || !b)
+                return false;
+
+        return bpf_program_compare_func(a, b) == 0;
+}
+
+int bpf_program_load_kernel_shared(BPFProgram *p, Hashmap **cache) {
+        _cleanup_(bpf_program_unrefp) BPFProgram *q = NULL;
+        int fd, r;
+
+        assert(p);
+        assert(cache);
+
+        /* Like bpf_program_load_kernel(), but shares the kernel object among all programs with the same instructions
+         * loaded through the same cache, so that it is verified and compiled only once. Each program still gets its
+         * own fd for it, as we track the attachment per program. The cache doesn't keep the shared objects around
+         * on its own, they are dropped from it as soon as the last program using them is freed. Note that the
+         * instructions are compared literally, hence this must not be used for programs that refer to maps by fd,
+         * as an fd number might be reused for a different map in the meantime. */
+
+        if (p->kernel_fd >= 0)
+                return 0;
+
+        q = bpf_program_ref(hashmap_get(*cache, p));
+        if (!q) {
+                r = bpf_program_new(p->prog_type, &q);
+                if (r < 0)
+                        return r;
+
+                r = bpf_program_add_instructions(q, p->instructions, p->n_instructions);
+                if (r < 0)
+                        return r;
+
+                r = bpf_program_load_kernel(q, NULL, 0);
+                if (r < 0)
+                        return r;
+
+                r = hashmap_ensure_allocated(cache, &bpf_program_hash_ops);
+                if (r < 0)
+                        return r;
+
+                r = hashmap_put(*cache, q, q);
+                if (r < 0)
+                        return r;
+
+                q->shared_cache = *cache;
+        }
+
+        fd = fcntl(q->kernel_fd, F_DUPFD_CLOEXEC, 3);
+        if (fd < 0)
+                return -errno;
+
+        p->kernel_fd = fd;
+        p->shared = TAKE_PTR(q);
+
+        return 0;
+}
+
 int bpf_program_cgroup_attach(BPFProgram *p, int type, const char *path, uint32_t flags) {
         _cleanup_free_ char *copy = NULL;
         _cleanup_close_ int fd = -1;
@@ -235,3 +324,44 @@ int bpf_map_lookup_element(int fd, const void *key, void *value) {
 
         return 0;
 }
+
+/* The BPF_MAP_LOOKUP_BATCH command was added in Linux 5.6, after the version our copy of linux/bpf.h is taken
+ * from, hence define the command and the part of union bpf_attr it uses here. */
+#define BPF_MAP_LOOKUP_BATCH_CMD 24
+
+struct bpf_map_batch_attr {
+        uint64_t in_batch;
+        uint64_t out_batch;
+        uint64_t keys;
+        uint64_t values;
+        uint32_t count;
+        uint32_t map_fd;
+        uint64_t elem_flags;
+        uint64_t flags;
+};
+
+int bpf_map_lookup_batch(int fd, void *keys, void *values, size_t *n) {
+        uint64_t out_batch = 0;
+        struct bpf_map_batch_attr attr = {
+                .out_batch = PTR_TO_UINT64(&out_batch),
+                .keys = PTR_TO_UINT64(keys),
+                .values = PTR_TO_UINT64(values),
+                .map_fd = fd,
+        };
+
+        assert(n);
+
+        /* Reads the first *n elements of the map in one go, and returns the number of elements read in *n. Fails
+         * with -EINVAL on kernels that don't know the command. */
+
+        if (*n > UINT32_MAX)
+                return -EINVAL;
+        attr.count = *n;
+
+        if (bpf(BPF_MAP_LOOKUP_BATCH_CMD, (union bpf_attr*) &attr, sizeof(attr)) < 0 && errno != ENOENT)
+                return -errno;
+
+        /* ENOENT means we reached the end of the map, but the count is filled in either way */
+        *n = attr.count;
+        return 0;
+}
@@ -5,6 +5,7 @@
 #include <stdint.h>
 #include <sys/syscall.h>
 
+#include "hashmap.h"
 #include "list.h"
 #include "macro.h"
 
@@ -23,6 +24,12 @@ struct BPFProgram {
         char *attached_path;
         int attached_type;
         uint32_t attached_flags;
+
+        /* Set if the kernel object is shared with other programs with the same instructions, see
+         * bpf_program_load_kernel_shared(). For the program owning the shared kernel object, the cache it is
+         * registered in. */
+        BPFProgram *shared;
+        Hashmap *shared_cache;
 };
 
 int bpf_program_new(uint32_t prog_type, BPFProgram **ret);
@@ -31,6 +38,8 @@ BPFProgram *bpf_program_ref(BPFProgram *p);
 
 int bpf_program_add_instructions(BPFProgram *p, const struct bpf_insn *insn, size_t count);
 int bpf_program_load_kernel(BPFProgram *p, char *log_buf, size_t log_size);
+int bpf_program_load_kernel_shared(BPFProgram *p, Hashmap **cache);
+bool bpf_program_equal(const BPFProgram *a, const BPFProgram *b) _pure_;
 
 int bpf_program_cgroup_attach(BPFProgram *p, int type, const char *path, uint32_t flags);
 int bpf_program_cgroup_detach(BPFProgram *p);
@@ -38,5 +47,6 @@ int bpf_program_cgroup_detach(BPFProgram *p);
 int bpf_map_new(enum bpf_map_type type, size_t key_size, size_t value_size, size_t max_entries, uint32_t flags);
 int bpf_map_update_element(int fd, const void *key, void *value);
 int bpf_map_lookup_element(int fd, const void *key, void *value);
+int bpf_map_lookup_batch(int fd, void *keys, void *values, size_t *n);
 
 DEFINE_TRIVIAL_CLEANUP_FUNC(BPFProgram*, bpf_program_unref);
@@ -736,7 +736,7 @@ static int bus_append_execute_property(sd_bus_message *m, const char *field, con
         if (STR_IN_SET(field,
                        "IgnoreSIGPIPE", "TTYVHangup", "TTYReset", "TTYVTDisallocate",
                        "PrivateTmp", "PrivateDevices", "PrivateNetwork", "PrivateUsers",
-                       "PrivateMounts", "NoNewPrivileges", "SyslogLevelPrefix",
+                       "PrivateMounts", "ReuseMountNamespace", "NoNewPrivileges", "SyslogLevelPrefix",
                        "MemoryDenyWriteExecute", "RestrictRealtime", "DynamicUser", "RemoveIPC",
                        "ProtectKernelTunables", "ProtectKernelModules", "ProtectControlGroups",
                        "MountAPIVFS", "CPUSchedulingResetOnFork", "LockPersonality"))
@@ -1272,7 +1272,7 @@ static int bus_append_mount_property(sd_bus_message *m, const char *field, const
 static int bus_append_path_property(sd_bus_message *m, const char *field, const char *eq) {
         int r;
 
-        if (streq(field, "MakeDirectory"))
+        if (STR_IN_SET(field, "MakeDirectory", "WatchSubtree"))
 
                 return bus_append_parse_boolean(m, field, eq);
 
@@ -1417,7 +1417,8 @@ static int bus_append_socket_property(sd_bus_message *m, const char *field, cons
 
         if (STR_IN_SET(field,
                        "Accept", "Writable", "KeepAlive", "NoDelay", "FreeBind", "Transparent", "Broadcast",
-                       "PassCredentials", "PassSecurity", "ReusePort", "RemoveOnStop", "SELinuxContextFromNet"))
+                       "PassCredentials", "PassSecurity", "ReusePort", "ReusePortCPUSteering", "RemoveOnStop",
+                       "SELinuxContextFromNet"))
 
                 return bus_append_parse_boolean(m, field, eq);
 
@@ -1429,10 +1430,23 @@ static int bus_append_socket_property(sd_bus_message *m, const char *field, cons
 
                 return bus_append_ip_tos_from_string(m, field, eq);
 
-        if (STR_IN_SET(field, "Backlog", "MaxConnections", "MaxConnectionsPerSource", "KeepAliveProbes", "TriggerLimitBurst"))
+        if (STR_IN_SET(field, "Backlog", "MaxConnections", "MaxConnectionsPerSource", "AcceptPoolSize", "KeepAliveProbes",
+                       "TriggerLimitBurst"))
 
                 return bus_append_safe_atou(m, field, eq);
 
+        if (streq(field, "ReusePortInstances")) {
+
+                if (!streq(eq, "ncpu"))
+                        return bus_append_safe_atou(m, field, eq);
+
+                r = sd_bus_message_append(m, "(sv)", field, "u", UINT_MAX);
+                if (r < 0)
+                        return bus_log_create_error(r);
+
+                return 1;
+        }
+
         if (STR_IN_SET(field, "SocketMode", "DirectoryMode"))
 
                 return bus_append_parse_mode(m, field, eq);
@@ -1441,7 +1455,8 @@ static int bus_append_socket_property(sd_bus_message *m, const char *field, cons
 
                 return bus_append_safe_atoi64(m, field, eq);
 
-        if (STR_IN_SET(field, "TimeoutSec", "KeepAliveTimeSec", "KeepAliveIntervalSec", "DeferAcceptSec", "TriggerLimitIntervalSec"))
+        if (STR_IN_SET(field, "TimeoutSec", "KeepAliveTimeSec", "KeepAliveIntervalSec", "DeferAcceptSec", "AcceptPoolIdleSec",
+                       "TriggerLimitIntervalSec"))
 
                 return bus_append_parse_sec_rename(m, field, eq);
 
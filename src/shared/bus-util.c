@@ -578,6 +578,10 @@ int bus_connect_system_systemd(sd_bus **_bus) {
         if (r < 0)
                 return r;
 
+        r = sd_bus_negotiate_memfd(bus, true);
+        if (r < 0)
+                return r;
+
         r = sd_bus_start(bus);
         if (r < 0)
                 return sd_bus_default_system(_bus);
@@ -615,6 +619,10 @@ int bus_connect_user_systemd(sd_bus **_bus) {
         if (!bus->address)
                 return -ENOMEM;
 
+        r = sd_bus_negotiate_memfd(bus, true);
+        if (r < 0)
+                return r;
+
         r = sd_bus_start(bus);
         if (r < 0)
                 return sd_bus_default_user(_bus);
@@ -730,7 +738,11 @@ static int bus_print_property(const char *name, const char *expected_value, sd_b
                         if (t || all)
                                 bus_print_property_value(name, expected_value, value, "%s", strempty(t));
 
-                } else if (strstr(name, "USec")) {
+                } else if (strstr(name, "Pressure") && endswith(name, "USec") && u == (uint64_t) -1)
+
+                        bus_print_property_value(name, expected_value, value, "%s", "[not set]");
+
+                else if (strstr(name, "USec")) {
                         char timespan[FORMAT_TIMESPAN_MAX];
 
                         (void) format_timespan(timespan, sizeof(timespan), u, 0);
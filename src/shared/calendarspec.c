@@ -1296,6 +1296,114 @@ static int find_next(const CalendarSpec *spec, struct tm *tm, usec_t *usec) {
         }
 }
 
+static int find_next_in_chain(const CalendarComponent *c, int val, int max) {
+        int d = -1;
+
+        /* Like find_matching_component(), but for the time of day, where no special cases apply. Returns -1 if
+         * there's no matching value up to max. */
+
+        if (!c)
+                return val <= max ? val : -1;
+
+        for (; c; c = c->next) {
+                int k;
+
+                if (c->start >= val)
+                        k = c->start;
+                else if (c->repeat > 0) {
+                        k = c->start + c->repeat * DIV_ROUND_UP(val - c->start, c->repeat);
+                        if (c->stop >= 0 && k > c->stop)
+                                continue;
+                } else
+                        continue;
+
+                if (d < 0 || k < d)
+                        d = k;
+        }
+
+        return d <= max ? d : -1;
+}
+
+static bool find_next_time_of_day(const CalendarSpec *spec, usec_t start, usec_t *ret) {
+        int h0, m0, u0, h, m, u;
+
+        assert(spec);
+        assert(start < USEC_PER_DAY);
+        assert(ret);
+
+        h0 = start / USEC_PER_HOUR;
+        m0 = start / USEC_PER_MINUTE % 60;
+        u0 = start % USEC_PER_MINUTE;
+
+        for (h = find_next_in_chain(spec->hour, h0, 23); h >= 0; h = find_next_in_chain(spec->hour, h + 1, 23))
+                for (m = find_next_in_chain(spec->minute, h == h0 ? m0 : 0, 59); m >= 0; m = find_next_in_chain(spec->minute, m + 1, 59)) {
+                        u = find_next_in_chain(spec->microsecond, h == h0 && m == m0 ? u0 : 0, 60 * USEC_PER_SEC - 1);
+                        if (u >= 0) {
+                                *ret = h * USEC_PER_HOUR + m * USEC_PER_MINUTE + u;
+                                return true;
+                        }
+                }
+
+        return false;
+}
+
+static bool calendar_spec_next_usec_fast(const CalendarSpec *spec, usec_t usec, usec_t *next) {
+        usec_t local, day, tod = 0, n;
+        struct tm tm;
+        int64_t offset;
+        unsigned i;
+        time_t t;
+
+        assert(spec);
+        assert(next);
+
+        /* A closed-form solver for the common case of specifications that only constrain the time of day and
+         * possibly the weekday, such as "daily", "hourly" or "Mon..Fri 09:00". We compute the time of day and the
+         * weekday arithmetically from the UTC offset in effect at the start, which is valid as long as the offset
+         * doesn't change before the next elapse. If it does, or for anything more complex, we return false and
+         * find_next() has to step through the candidate times. */
+
+        if (spec->year || spec->month || spec->day || spec->end_of_month || spec->dst >= 0)
+                return false;
+
+        /* Don't bother with times right after the epoch, where the local time might still be negative */
+        if (usec < 2 * USEC_PER_DAY)
+                return false;
+
+        t = (time_t) (usec / USEC_PER_SEC);
+        if (!localtime_or_gmtime_r(&t, &tm, spec->utc))
+                return false;
+        offset = (int64_t) tm.tm_gmtoff * (int64_t) USEC_PER_SEC;
+
+        local = (usec_t) ((int64_t) usec + offset);
+        day = local / USEC_PER_DAY;
+
+        /* All weekdays are covered within a week, if the time of day matches at all */
+        for (i = 0; i <= 7; i++) {
+                if (spec->weekdays_bits >= 0 && spec->weekdays_bits < BITS_WEEKDAYS &&
+                    !(spec->weekdays_bits & (1 << ((day + i + 3) % 7)))) /* 1970-01-01 was a Thursday */
+                        continue;
+
+                if (find_next_time_of_day(spec, i == 0 ? local % USEC_PER_DAY : 0, &tod))
+                        break;
+        }
+        if (i > 7)
+                return false;
+
+        n = (usec_t) ((int64_t) ((day + i) * USEC_PER_DAY + tod) - offset);
+
+        t = (time_t) (n / USEC_PER_SEC);
+        if (!localtime_or_gmtime_r(&t, &tm, spec->utc))
+                return false;
+        if ((int64_t) tm.tm_gmtoff * (int64_t) USEC_PER_SEC != offset)
+                return false;
+        if (tm.tm_year + 1900 > MAX_YEAR)
+                return false;
+
+        *next = n;
+        return true;
+}
+
 static int calendar_spec_next_usec_impl(const CalendarSpec *spec, usec_t usec, usec_t *next) {
         struct tm tm;
         time_t t;
@@ -1309,6 +1417,10 @@ static int calendar_spec_next_usec_impl(const CalendarSpec *spec, usec_t usec, u
                 return -EINVAL;
 
         usec++;
+
+        if (calendar_spec_next_usec_fast(spec, usec, next))
+                return 0;
+
         t = (time_t) (usec / USEC_PER_SEC);
         assert_se(localtime_or_gmtime_r(&t, &tm, spec->utc));
         tm_usec = usec % USEC_PER_SEC;
@@ -78,38 +78,27 @@ static int show_cgroup_one_by_path(
                 bool more,
                 OutputFlags flags) {
 
-        char *fn;
-        _cleanup_fclose_ FILE *f = NULL;
-        size_t n = 0, n_allocated = 0;
         _cleanup_free_ pid_t *pids = NULL;
         _cleanup_free_ char *p = NULL;
-        pid_t pid;
+        size_t n, i, k;
         int r;
 
         r = cg_mangle_path(path, &p);
         if (r < 0)
                 return r;
 
-        fn = strjoina(p, "/cgroup.procs");
-        f = fopen(fn, "re");
-        if (!f)
-                return -errno;
-
-        while ((r = cg_read_pid(f, &pid)) > 0) {
-
-                if (!(flags & OUTPUT_KERNEL_THREADS) && is_kernel_thread(pid) > 0)
-                        continue;
+        r = cg_read_pids(NULL, p, &pids, &n);
+        if (r < 0)
+                return r;
 
-                if (!GREEDY_REALLOC(pids, n_allocated, n + 1))
-                        return -ENOMEM;
+        if (!(flags & OUTPUT_KERNEL_THREADS)) {
+                for (i = 0, k = 0; i < n; i++)
+                        if (is_kernel_thread(pids[i]) <= 0)
+                                pids[k++] = pids[i];
 
-                assert(n < n_allocated);
-                pids[n++] = pid;
+                n = k;
         }
 
-        if (r < 0)
-                return r;
-
         show_pid_array(pids, n, prefix, n_columns, false, more, flags);
 
         return 0;
@@ -813,6 +813,7 @@ typedef struct DecryptedPartition {
         struct crypt_device *device;
         char *name;
         bool relinquished;
+        bool shared; /* set up by somebody else, hence not ours to deactivate */
 } DecryptedPartition;
 
 struct DecryptedImage {
@@ -833,7 +834,7 @@ DecryptedImage* decrypted_image_unref(DecryptedImage* d) {
         for (i = 0; i < d->n_decrypted; i++) {
                 DecryptedPartition *p = d->decrypted + i;
 
-                if (p->device && p->name && !p->relinquished) {
+                if (p->device && p->name && !p->relinquished && !p->shared) {
                         r = crypt_deactivate(p->device, p->name);
                         if (r < 0)
                                 log_debug_errno(r, "Failed to deactivate encrypted partition %s", p->name);
@@ -883,6 +884,33 @@ static int make_dm_name_and_node(const void *original_node, const char *suffix,
         return 0;
 }
 
+static int make_verity_name_and_node(const void *root_hash, size_t root_hash_size, char **ret_name, char **ret_node) {
+        _cleanup_free_ char *hex = NULL, *name = NULL, *node = NULL;
+
+        assert(root_hash);
+        assert(ret_name);
+        assert(ret_node);
+
+        hex = hexmem(root_hash, root_hash_size);
+        if (!hex)
+                return -ENOMEM;
+
+        name = strjoin(hex, "-verity");
+        if (!name)
+                return -ENOMEM;
+        if (strlen(name) >= DM_NAME_LEN)
+                return -ENAMETOOLONG;
+
+        node = strjoin(crypt_get_dir(), "/", name);
+        if (!node)
+                return -ENOMEM;
+
+        *ret_name = TAKE_PTR(name);
+        *ret_node = TAKE_PTR(node);
+
+        return 0;
+}
+
 static int decrypt_partition(
                 DissectedPartition *m,
                 const char *passphrase,
@@ -947,6 +975,8 @@ static int verity_partition(
 
         _cleanup_free_ char *node = NULL, *name = NULL;
         _cleanup_(crypt_freep) struct crypt_device *cd = NULL;
+        bool shared = false;
+        unsigned i;
         int r;
 
         assert(m);
@@ -963,31 +993,60 @@ static int verity_partition(
         if (!streq(v->fstype, "DM_verity_hash"))
                 return 0;
 
-        r = make_dm_name_and_node(m->node, "-verity", &name, &node);
+        /* The root hash determines the contents of the device completely, hence name the device after it: everybody
+         * using the same image then shares one device, instead of setting up their own each time the image is
+         * used. Hashes too long for a device mapper name get a name derived from the partition instead. */
+        r = make_verity_name_and_node(root_hash, root_hash_size, &name, &node);
+        if (r == -ENAMETOOLONG)
+                r = make_dm_name_and_node(m->node, "-verity", &name, &node);
         if (r < 0)
                 return r;
 
         if (!GREEDY_REALLOC0(d->decrypted, d->n_allocated, d->n_decrypted + 1))
                 return -ENOMEM;
 
-        r = crypt_init(&cd, v->node);
-        if (r < 0)
-                return r;
+        for (i = 0;; i++) {
+                r = crypt_init(&cd, v->node);
+                if (r < 0)
+                        return r;
 
-        r = crypt_load(cd, CRYPT_VERITY, NULL);
-        if (r < 0)
-                return r;
+                r = crypt_load(cd, CRYPT_VERITY, NULL);
+                if (r < 0)
+                        return r;
 
-        r = crypt_set_data_device(cd, m->node);
-        if (r < 0)
-                return r;
+                r = crypt_set_data_device(cd, m->node);
+                if (r < 0)
+                        return r;
+
+                r = crypt_activate_by_volume_key(cd, name, root_hash, root_hash_size, CRYPT_ACTIVATE_READONLY);
+                if (r != -EEXIST)
+                        break;
+
+                /* Somebody else already set up this image, use their device. It might go away between the two calls
+                 * if its last user just released it, in which case we try again. */
+                crypt_free(cd);
+                cd = NULL;
+
+                r = crypt_init_by_name(&cd, name);
+                if (r >= 0) {
+                        if (!streq_ptr(crypt_get_type(cd), CRYPT_VERITY))
+                                return -EEXIST;
 
-        r = crypt_activate_by_volume_key(cd, name, root_hash, root_hash_size, CRYPT_ACTIVATE_READONLY);
+                        shared = true;
+                        break;
+                }
+                if (r != -ENODEV || i >= 3)
+                        return r;
+
+                crypt_free(cd);
+                cd = NULL;
+        }
         if (r < 0)
                 return r;
 
         d->decrypted[d->n_decrypted].name = TAKE_PTR(name);
         d->decrypted[d->n_decrypted].device = TAKE_PTR(cd);
+        d->decrypted[d->n_decrypted].shared = shared;
         d->n_decrypted++;
 
         m->decrypted_node = TAKE_PTR(node);
@@ -7,6 +7,7 @@
 #include "fileio.h"
 #include "format-table.h"
 #include "gunicode.h"
+#include "json.h"
 #include "pager.h"
 #include "parse-util.h"
 #include "pretty-print.h"
@@ -1256,9 +1257,9 @@ int table_print(Table *t, FILE *f) {
 
                 for (j = 0; j < display_columns; j++) {
                         _cleanup_free_ char *buffer = NULL;
+                        size_t l, lspace = 0, rspace = 0;
                         const char *field;
                         TableData *d;
-                        size_t l;
 
                         assert_se(d = row[t->display_map ? t->display_map[j] : j]);
 
@@ -1276,6 +1277,13 @@ int table_print(Table *t, FILE *f) {
 
                                 field = buffer;
 
+                        } else if (l < width[j] && !d->url) {
+                                /* Field is shorter than allocated space, and isn't a link. Let's write the spaces to
+                                 * align it directly, instead of building a padded copy of it. */
+
+                                lspace = (width[j] - l) * d->align_percent / 100U;
+                                rspace = width[j] - l - lspace;
+
                         } else if (l < width[j]) {
                                 /* Field is shorter than allocated space. Let's align with spaces */
 
@@ -1310,7 +1318,7 @@ int table_print(Table *t, FILE *f) {
                                 fputs(d->color, f);
                         }
 
-                        fputs(field, f);
+                        fprintf(f, "%*s%s%*s", (int) lspace, "", field, (int) rspace, "");
 
                         if (colors_enabled() && (d->color || row == t->data))
                                 fputs(ANSI_NORMAL, f);
@@ -1414,3 +1422,161 @@ const void* table_get_at(Table *t, size_t row, size_t column) {
 
         return table_get(t, cell);
 }
+
+static int table_data_to_json(TableData *d, JsonVariant **ret) {
+        assert(d);
+        assert(ret);
+
+        switch (d->type) {
+
+        case TABLE_EMPTY:
+                return json_variant_new_null(ret);
+
+        case TABLE_STRING:
+                return json_variant_new_string(ret, d->string);
+
+        case TABLE_BOOLEAN:
+                return json_variant_new_boolean(ret, d->boolean);
+
+        case TABLE_TIMESTAMP:
+        case TABLE_TIMESPAN:
+                if (d->timestamp == USEC_INFINITY)
+                        return json_variant_new_null(ret);
+
+                return json_variant_new_unsigned(ret, d->timestamp);
+
+        case TABLE_SIZE:
+                if (d->size == (uint64_t) -1)
+                        return json_variant_new_null(ret);
+
+                return json_variant_new_unsigned(ret, d->size);
+
+        case TABLE_UINT32:
+                return json_variant_new_unsigned(ret, d->uint32);
+
+        case TABLE_UINT64:
+                return json_variant_new_unsigned(ret, d->uint64);
+
+        case TABLE_PERCENT:
+                return json_variant_new_integer(ret, d->percent);
+
+        default:
+                return -EINVAL;
+        }
+}
+
+/* The field names are derived from the header cells: "MAC ADDRESS" becomes "mac_address" */
+static int table_header_to_json(TableData *d, JsonVariant **ret) {
+        _cleanup_free_ char *name = NULL;
+        const char *s;
+        char *p;
+
+        assert(d);
+
+        s = table_data_format(d);
+        if (!s)
+                return -ENOMEM;
+
+        name = strdup(s);
+        if (!name)
+                return -ENOMEM;
+
+        for (p = name; *p; p++)
+                *p = strchr(ALPHANUMERICAL, *p) ? ascii_tolower(*p) : '_';
+
+        return json_variant_new_string(ret, name);
+}
+
+/* Converts the table into an array of objects, one for each row except the header, with one field for each
+ * displayed column, in the order the rows would be printed in */
+int table_to_json(Table *t, JsonVariant **ret) {
+        JsonVariant **rows = NULL, **elements = NULL;
+        _cleanup_free_ size_t *sorted = NULL;
+        size_t n_rows, display_columns, i, j;
+        int r;
+
+        assert(t);
+        assert(ret);
+
+        /* Ensure we have no incomplete rows */
+        assert(t->n_cells % t->n_columns == 0);
+
+        n_rows = t->n_cells / t->n_columns;
+        assert(n_rows > 0); /* at least the header row must be complete */
+
+        if (t->sort_map) {
+                sorted = new(size_t, n_rows);
+                if (!sorted)
+                        return -ENOMEM;
+
+                for (i = 0; i < n_rows; i++)
+                        sorted[i] = i * t->n_columns;
+
+                typesafe_qsort_r(sorted, n_rows, table_data_compare, t);
+        }
+
+        display_columns = t->display_map ? t->n_display_map : t->n_columns;
+        assert(display_columns > 0);
+
+        rows = new0(JsonVariant*, n_rows - 1);
+        elements = new0(JsonVariant*, display_columns * 2);
+        if (!rows || !elements) {
+                r = -ENOMEM;
+                goto finish;
+        }
+
+        for (i = 1; i < n_rows; i++) {
+                TableData **row;
+
+                row = t->data + (sorted ? sorted[i] : i * t->n_columns);
+
+                for (j = 0; j < display_columns; j++) {
+                        size_t c = t->display_map ? t->display_map[j] : j;
+
+                        r = table_header_to_json(t->data[c], elements + j * 2);
+                        if (r < 0)
+                                goto finish;
+
+                        r = table_data_to_json(row[c], elements + j * 2 + 1);
+                        if (r < 0)
+                                goto finish;
+                }
+
+                r = json_variant_new_object(rows + i - 1, elements, display_columns * 2);
+                if (r < 0)
+                        goto finish;
+
+                json_variant_unref_many(elements, display_columns * 2);
+                memzero(elements, sizeof(JsonVariant*) * display_columns * 2);
+        }
+
+        r = json_variant_new_array(ret, rows, n_rows - 1);
+
+finish:
+        if (elements) {
+                json_variant_unref_many(elements, display_columns * 2);
+                free(elements);
+        }
+
+        if (rows) {
+                json_variant_unref_many(rows, n_rows - 1);
+                free(rows);
+        }
+
+        return r;
+}
+
+int table_print_json(Table *t, FILE *f, unsigned flags) {
+        _cleanup_(json_variant_unrefp) JsonVariant *v = NULL;
+        int r;
+
+        assert(t);
+
+        r = table_to_json(t, &v);
+        if (r < 0)
+                return r;
+
+        json_variant_dump(v, flags, f, NULL);
+
+        return fflush_and_check(f ?: stdout);
+}
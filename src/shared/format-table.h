@@ -5,6 +5,7 @@
 #include <stdio.h>
 #include <sys/types.h>
 
+#include "json.h"
 #include "macro.h"
 
 typedef enum TableDataType {
@@ -60,6 +61,9 @@ int table_set_reverse(Table *t, size_t column, bool b);
 int table_print(Table *t, FILE *f);
 int table_format(Table *t, char **ret);
 
+int table_to_json(Table *t, JsonVariant **ret);
+int table_print_json(Table *t, FILE *f, unsigned json_format_flags);
+
 static inline TableCell* TABLE_HEADER_CELL(size_t i) {
         return SIZE_TO_PTR(i + 1);
 }
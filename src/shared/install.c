@@ -23,6 +23,7 @@
 #include "hashmap.h"
 #include "install-printf.h"
 #include "install.h"
+#include "list.h"
 #include "locale-util.h"
 #include "log.h"
 #include "macro.h"
@@ -49,6 +50,9 @@ typedef enum SearchFlags {
 typedef struct {
         OrderedHashmap *will_process;
         OrderedHashmap *have_processed;
+
+        /* If set, the paths of all files in the search path, see unit_path_cache_new(). Not owned. */
+        Set *unit_path_cache;
 } InstallContext;
 
 typedef enum {
@@ -709,6 +713,153 @@ static int is_symlink_with_known_name(const UnitFileInstallInfo *i, const char *
         return false;
 }
 
+static int symlink_matches_unit(
+                UnitFileInstallInfo *i,
+                bool match_aliases,
+                const char *path,
+                const char *dest,
+                const char *config_path,
+                bool *same_name_link) {
+
+        bool found_path, found_dest, b = false;
+        int q;
+
+        assert(i);
+        assert(path);
+        assert(dest);
+        assert(config_path);
+        assert(same_name_link);
+
+        /* Check if the symlink itself matches what we
+         * are looking for */
+        if (path_is_absolute(i->name))
+                found_path = path_equal(path, i->name);
+        else
+                found_path = streq(basename(path), i->name);
+
+        /* Check if what the symlink points to
+         * matches what we are looking for */
+        if (path_is_absolute(i->name))
+                found_dest = path_equal(dest, i->name);
+        else
+                found_dest = streq(basename(dest), i->name);
+
+        if (found_path && found_dest) {
+                _cleanup_free_ char *t = NULL;
+
+                /* Filter out same name links in the main
+                 * config path */
+                t = path_make_absolute(i->name, config_path);
+                if (!t)
+                        return -ENOMEM;
+
+                b = path_equal(t, path);
+        }
+
+        if (b)
+                *same_name_link = true;
+        else if (found_path || found_dest) {
+                if (!match_aliases)
+                        return 1;
+
+                /* Check if symlink name is in the set of names used by [Install] */
+                q = is_symlink_with_known_name(i, basename(path));
+                if (q != 0)
+                        return q;
+        }
+
+        return 0;
+}
+
+typedef struct ConfigSymlink ConfigSymlink;
+
+struct ConfigSymlink {
+        char *path;
+        char *dest;
+
+        LIST_FIELDS(ConfigSymlink, symlinks);
+        LIST_FIELDS(ConfigSymlink, by_name);
+        LIST_FIELDS(ConfigSymlink, by_dest);
+};
+
+/* All symlinks below one directory of the search path, so that we don't have to read the whole tree again for every
+ * unit whose state is looked up. The lists are indexed by the file name of the symlink and the one it points to. */
+typedef struct ConfigSymlinks {
+        char *config_path;
+
+        LIST_HEAD(ConfigSymlink, symlinks);
+        Hashmap *by_name;
+        Hashmap *by_dest;
+
+        /* The first error we ran into while reading the directory, if any */
+        int error;
+} ConfigSymlinks;
+
+static ConfigSymlinks* config_symlinks_free(ConfigSymlinks *c) {
+        ConfigSymlink *l;
+
+        if (!c)
+                return NULL;
+
+        hashmap_free(c->by_name);
+        hashmap_free(c->by_dest);
+
+        while ((l = c->symlinks)) {
+                LIST_REMOVE(symlinks, c->symlinks, l);
+                free(l->path);
+                free(l->dest);
+                free(l);
+        }
+
+        free(c->config_path);
+        return mfree(c);
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(ConfigSymlinks*, config_symlinks_free);
+
+static Hashmap* symlink_index_free(Hashmap *index) {
+        return hashmap_free_with_destructor(index, config_symlinks_free);
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(Hashmap*, symlink_index_free);
+
+static int config_symlinks_add(ConfigSymlinks *c, char *path, char *dest) {
+        ConfigSymlink *l, *head;
+        int r;
+
+        assert(c);
+        assert(path);
+        assert(dest);
+
+        l = new0(ConfigSymlink, 1);
+        if (!l) {
+                free(path);
+                free(dest);
+                return -ENOMEM;
+        }
+
+        l->path = path;
+        l->dest = dest;
+        LIST_PREPEND(symlinks, c->symlinks, l);
+
+        head = hashmap_get(c->by_name, basename(path));
+        LIST_PREPEND(by_name, head, l);
+        r = hashmap_ensure_allocated(&c->by_name, &string_hash_ops);
+        if (r < 0)
+                return r;
+        r = hashmap_replace(c->by_name, basename(path), head);
+        if (r < 0)
+                return r;
+
+        head = hashmap_get(c->by_dest, basename(dest));
+        LIST_PREPEND(by_dest, head, l);
+        r = hashmap_ensure_allocated(&c->by_dest, &string_hash_ops);
+        if (r < 0)
+                return r;
+
+        return hashmap_replace(c->by_dest, basename(dest), head);
+}
+
 static int find_symlinks_fd(
                 const char *root_dir,
                 UnitFileInstallInfo *i,
@@ -716,17 +867,20 @@ static int find_symlinks_fd(
                 int fd,
                 const char *path,
                 const char *config_path,
-                bool *same_name_link) {
+                bool *same_name_link,
+                ConfigSymlinks *c) {
 
         _cleanup_closedir_ DIR *d = NULL;
         struct dirent *de;
         int r = 0;
 
-        assert(i);
+        assert(i || c);
         assert(fd >= 0);
         assert(path);
         assert(config_path);
-        assert(same_name_link);
+        assert(same_name_link || c);
+
+        /* Looks for symlinks matching the unit, or, if c is set, adds all of them to c */
 
         d = fdopendir(fd);
         if (!d) {
@@ -760,15 +914,16 @@ static int find_symlinks_fd(
 
                         /* This will close nfd, regardless whether it succeeds or not */
                         q = find_symlinks_fd(root_dir, i, match_aliases, nfd,
-                                             p, config_path, same_name_link);
+                                             p, config_path, same_name_link, c);
                         if (q > 0)
                                 return 1;
+                        if (c && q == -ENOMEM)
+                                return q;
                         if (r == 0)
                                 r = q;
 
                 } else if (de->d_type == DT_LNK) {
                         _cleanup_free_ char *p = NULL, *dest = NULL;
-                        bool found_path, found_dest, b = false;
                         int q;
 
                         /* Acquire symlink name */
@@ -798,49 +953,92 @@ static int find_symlinks_fd(
                                 dest = x;
                         }
 
-                        /* Check if the symlink itself matches what we
-                         * are looking for */
-                        if (path_is_absolute(i->name))
-                                found_path = path_equal(p, i->name);
-                        else
-                                found_path = streq(de->d_name, i->name);
+                        if (c) {
+                                q = config_symlinks_add(c, TAKE_PTR(p), TAKE_PTR(dest));
+                                if (q < 0)
+                                        return q;
 
-                        /* Check if what the symlink points to
-                         * matches what we are looking for */
-                        if (path_is_absolute(i->name))
-                                found_dest = path_equal(dest, i->name);
-                        else
-                                found_dest = streq(basename(dest), i->name);
+                                continue;
+                        }
 
-                        if (found_path && found_dest) {
-                                _cleanup_free_ char *t = NULL;
+                        q = symlink_matches_unit(i, match_aliases, p, dest, config_path, same_name_link);
+                        if (q != 0)
+                                return q;
+                }
+        }
 
-                                /* Filter out same name links in the main
-                                 * config path */
-                                t = path_make_absolute(i->name, config_path);
-                                if (!t)
-                                        return -ENOMEM;
+        return r;
+}
 
-                                b = path_equal(t, p);
-                        }
+static int config_symlinks_find(
+                ConfigSymlinks *c,
+                UnitFileInstallInfo *i,
+                bool match_aliases,
+                const char *config_path,
+                bool *same_name_link) {
 
-                        if (b)
-                                *same_name_link = true;
-                        else if (found_path || found_dest) {
-                                if (!match_aliases)
-                                        return 1;
+        ConfigSymlink *l;
+        int r;
 
-                                /* Check if symlink name is in the set of names used by [Install] */
-                                q = is_symlink_with_known_name(i, de->d_name);
-                                if (q < 0)
-                                        return q;
-                                if (q > 0)
-                                        return 1;
-                        }
+        assert(c);
+        assert(i);
+
+        if (path_is_absolute(i->name)) {
+                LIST_FOREACH(symlinks, l, c->symlinks) {
+                        r = symlink_matches_unit(i, match_aliases, l->path, l->dest, config_path, same_name_link);
+                        if (r != 0)
+                                return r;
                 }
+
+                return c->error;
         }
 
-        return r;
+        LIST_FOREACH(by_name, l, hashmap_get(c->by_name, i->name)) {
+                r = symlink_matches_unit(i, match_aliases, l->path, l->dest, config_path, same_name_link);
+                if (r != 0)
+                        return r;
+        }
+
+        LIST_FOREACH(by_dest, l, hashmap_get(c->by_dest, i->name)) {
+                r = symlink_matches_unit(i, match_aliases, l->path, l->dest, config_path, same_name_link);
+                if (r != 0)
+                        return r;
+        }
+
+        return c->error;
+}
+
+static int config_symlinks_new(const char *root_dir, const char *config_path, ConfigSymlinks **ret) {
+        _cleanup_(config_symlinks_freep) ConfigSymlinks *c = NULL;
+        int fd, r = 0;
+
+        assert(config_path);
+        assert(ret);
+
+        c = new0(ConfigSymlinks, 1);
+        if (!c)
+                return -ENOMEM;
+
+        c->config_path = strdup(config_path);
+        if (!c->config_path)
+                return -ENOMEM;
+
+        fd = open(config_path, O_RDONLY|O_NONBLOCK|O_DIRECTORY|O_CLOEXEC);
+        if (fd < 0) {
+                if (!IN_SET(errno, ENOENT, ENOTDIR, EACCES))
+                        r = -errno;
+        } else {
+                /* This takes possession of fd and closes it */
+                r = find_symlinks_fd(root_dir, NULL, false, fd, config_path, config_path, NULL, c);
+                if (r == -ENOMEM)
+                        return r;
+        }
+
+        /* Errors are only reported to those looking for a unit which we don't find */
+        c->error = r;
+
+        *ret = TAKE_PTR(c);
+        return 0;
 }
 
 static int find_symlinks(
@@ -848,14 +1046,37 @@ static int find_symlinks(
                 UnitFileInstallInfo *i,
                 bool match_name,
                 const char *config_path,
-                bool *same_name_link) {
+                bool *same_name_link,
+                Hashmap **index) {
 
-        int fd;
+        ConfigSymlinks *c;
+        int fd, r;
 
         assert(i);
         assert(config_path);
         assert(same_name_link);
 
+        if (index) {
+                c = hashmap_get(*index, config_path);
+                if (!c) {
+                        r = hashmap_ensure_allocated(index, &path_hash_ops);
+                        if (r < 0)
+                                return r;
+
+                        r = config_symlinks_new(root_dir, config_path, &c);
+                        if (r < 0)
+                                return r;
+
+                        r = hashmap_put(*index, c->config_path, c);
+                        if (r < 0) {
+                                config_symlinks_free(c);
+                                return r;
+                        }
+                }
+
+                return config_symlinks_find(c, i, match_name, config_path, same_name_link);
+        }
+
         fd = open(config_path, O_RDONLY|O_NONBLOCK|O_DIRECTORY|O_CLOEXEC);
         if (fd < 0) {
                 if (IN_SET(errno, ENOENT, ENOTDIR, EACCES))
@@ -865,7 +1086,7 @@ static int find_symlinks(
 
         /* This takes possession of fd and closes it */
         return find_symlinks_fd(root_dir, i, match_name, fd,
-                                config_path, config_path, same_name_link);
+                                config_path, config_path, same_name_link, NULL);
 }
 
 static int find_symlinks_in_scope(
@@ -873,7 +1094,8 @@ static int find_symlinks_in_scope(
                 const LookupPaths *paths,
                 UnitFileInstallInfo *i,
                 bool match_name,
-                UnitFileState *state) {
+                UnitFileState *state,
+                Hashmap **index) {
 
         bool same_name_link_runtime = false, same_name_link_config = false;
         bool enabled_in_runtime = false, enabled_at_all = false;
@@ -886,7 +1108,7 @@ static int find_symlinks_in_scope(
         STRV_FOREACH(p, paths->search_path)  {
                 bool same_name_link = false;
 
-                r = find_symlinks(paths->root_dir, i, match_name, *p, &same_name_link);
+                r = find_symlinks(paths->root_dir, i, match_name, *p, &same_name_link, index);
                 if (r < 0)
                         return r;
                 if (r > 0) {
@@ -1378,6 +1600,55 @@ static int unit_file_load_or_readlink(
         return 0;
 }
 
+static int unit_path_cache_new(const LookupPaths *paths, Set **ret) {
+        _cleanup_set_free_free_ Set *cache = NULL;
+        char **i;
+        int r;
+
+        assert(paths);
+        assert(ret);
+
+        /* Lists the files in all directories of the search path, so that looking for a unit doesn't have to try to
+         * open it in each of them. The cache may only be used as long as we don't change anything there. If a
+         * directory can't be listed, no cache is returned, as files in it might still be accessible. */
+
+        cache = set_new(&path_hash_ops);
+        if (!cache)
+                return -ENOMEM;
+
+        STRV_FOREACH(i, paths->search_path) {
+                _cleanup_closedir_ DIR *d = NULL;
+                struct dirent *de;
+
+                d = opendir(*i);
+                if (!d) {
+                        if (errno == ENOENT)
+                                continue;
+
+                        *ret = NULL;
+                        return 0;
+                }
+
+                FOREACH_DIRENT_ALL(de, d, return -errno) {
+                        char *p;
+
+                        if (dot_or_dot_dot(de->d_name))
+                                continue;
+
+                        p = path_join(*i, de->d_name);
+                        if (!p)
+                                return -ENOMEM;
+
+                        r = set_consume(cache, p);
+                        if (r < 0)
+                                return r;
+                }
+        }
+
+        *ret = TAKE_PTR(cache);
+        return 0;
+}
+
 static int unit_file_search(
                 InstallContext *c,
                 UnitFileInstallInfo *info,
@@ -1416,6 +1687,9 @@ static int unit_file_search(
                 if (!path)
                         return -ENOMEM;
 
+                if (c && c->unit_path_cache && !set_contains(c->unit_path_cache, path))
+                        continue;
+
                 r = unit_file_load_or_readlink(c, info, path, paths->root_dir, flags);
                 if (r >= 0) {
                         info->path = TAKE_PTR(path);
@@ -1439,6 +1713,9 @@ static int unit_file_search(
                         if (!path)
                                 return -ENOMEM;
 
+                        if (c && c->unit_path_cache && !set_contains(c->unit_path_cache, path))
+                                continue;
+
                         r = unit_file_load_or_readlink(c, info, path, paths->root_dir, flags);
                         if (r >= 0) {
                                 info->path = TAKE_PTR(path);
@@ -1468,6 +1745,11 @@ static int unit_file_search(
                 if (!path)
                         return -ENOMEM;
 
+                if (c && c->unit_path_cache && !set_contains(c->unit_path_cache, path)) {
+                        free(path);
+                        continue;
+                }
+
                 r = strv_consume(&dirs, path);
                 if (r < 0)
                         return r;
@@ -1482,6 +1764,11 @@ static int unit_file_search(
                         if (!path)
                                 return -ENOMEM;
 
+                        if (c && c->unit_path_cache && !set_contains(c->unit_path_cache, path)) {
+                                free(path);
+                                continue;
+                        }
+
                         r = strv_consume(&dirs, path);
                         if (r < 0)
                                 return r;
@@ -2469,6 +2756,7 @@ int unit_file_enable(
 
         _cleanup_(lookup_paths_free) LookupPaths paths = {};
         _cleanup_(install_context_done) InstallContext c = {};
+        _cleanup_set_free_free_ Set *unit_path_cache = NULL;
         const char *config_path;
         UnitFileInstallInfo *i;
         char **f;
@@ -2485,6 +2773,14 @@ int unit_file_enable(
         if (!config_path)
                 return -ENXIO;
 
+        if (strv_length(files) > 1) {
+                r = unit_path_cache_new(&paths, &unit_path_cache);
+                if (r < 0)
+                        return r;
+
+                c.unit_path_cache = unit_path_cache;
+        }
+
         STRV_FOREACH(f, files) {
                 r = install_info_discover_and_check(scope, &c, &paths, *f, SEARCH_LOAD|SEARCH_FOLLOW_CONFIG_SYMLINKS,
                                                     &i, changes, n_changes);
@@ -2494,6 +2790,9 @@ int unit_file_enable(
                 assert(i->type == UNIT_FILE_TYPE_REGULAR);
         }
 
+        /* We are going to create symlinks in the search path now */
+        c.unit_path_cache = NULL;
+
         /* This will return the number of symlink rules that were
            supposed to be created, not the ones actually created. This
            is useful to determine whether the passed files had any
@@ -2512,7 +2811,7 @@ int unit_file_disable(
 
         _cleanup_(lookup_paths_free) LookupPaths paths = {};
         _cleanup_(install_context_done) InstallContext c = {};
-        _cleanup_set_free_free_ Set *remove_symlinks_to = NULL;
+        _cleanup_set_free_free_ Set *remove_symlinks_to = NULL, *unit_path_cache = NULL;
         bool dry_run = !!(flags & UNIT_FILE_DRY_RUN);
         const char *config_path;
         char **i;
@@ -2534,6 +2833,14 @@ int unit_file_disable(
                         return r;
         }
 
+        if (strv_length(files) > 1) {
+                r = unit_path_cache_new(&paths, &unit_path_cache);
+                if (r < 0)
+                        return r;
+
+                c.unit_path_cache = unit_path_cache;
+        }
+
         r = install_context_mark_for_removal(scope, &c, &paths, &remove_symlinks_to, changes, n_changes);
         if (r < 0)
                 return r;
@@ -2644,11 +2951,12 @@ int unit_file_get_default(
         return 0;
 }
 
-int unit_file_lookup_state(
+static int unit_file_lookup_state_internal(
                 UnitFileScope scope,
                 const LookupPaths *paths,
                 const char *name,
-                UnitFileState *ret) {
+                UnitFileState *ret,
+                Hashmap **index) {
 
         _cleanup_(install_context_done) InstallContext c = {};
         UnitFileInstallInfo *i;
@@ -2700,7 +3008,7 @@ int unit_file_lookup_state(
                 /* Check if any of the Alias= symlinks have been created.
                  * We ignore other aliases, and only check those that would
                  * be created by systemctl enable for this unit. */
-                r = find_symlinks_in_scope(scope, paths, i, true, &state);
+                r = find_symlinks_in_scope(scope, paths, i, true, &state, index);
                 if (r < 0)
                         return r;
                 if (r > 0)
@@ -2708,7 +3016,7 @@ int unit_file_lookup_state(
 
                 /* Check if the file is known under other names. If it is,
                  * it might be in use. Report that as UNIT_FILE_INDIRECT. */
-                r = find_symlinks_in_scope(scope, paths, i, false, &state);
+                r = find_symlinks_in_scope(scope, paths, i, false, &state, index);
                 if (r < 0)
                         return r;
                 if (r > 0)
@@ -2732,6 +3040,15 @@ int unit_file_lookup_state(
         return 0;
 }
 
+int unit_file_lookup_state(
+                UnitFileScope scope,
+                const LookupPaths *paths,
+                const char *name,
+                UnitFileState *ret) {
+
+        return unit_file_lookup_state_internal(scope, paths, name, ret, NULL);
+}
+
 int unit_file_get_state(
                 UnitFileScope scope,
                 const char *root_dir,
@@ -3047,6 +3364,9 @@ static int execute_preset(
         assert(minus);
         assert(paths);
 
+        /* We are going to change the search path now */
+        plus->unit_path_cache = minus->unit_path_cache = NULL;
+
         if (mode != UNIT_FILE_PRESET_ENABLE_ONLY) {
                 _cleanup_set_free_free_ Set *remove_symlinks_to = NULL;
 
@@ -3083,7 +3403,9 @@ static int preset_prepare_one(
                 UnitFileChange **changes,
                 size_t *n_changes) {
 
-        _cleanup_(install_context_done) InstallContext tmp = {};
+        _cleanup_(install_context_done) InstallContext tmp = {
+                .unit_path_cache = plus->unit_path_cache,
+        };
         _cleanup_strv_free_ char **instance_name_list = NULL;
         UnitFileInstallInfo *i;
         int r;
@@ -3139,6 +3461,7 @@ int unit_file_preset(
         _cleanup_(install_context_done) InstallContext plus = {}, minus = {};
         _cleanup_(lookup_paths_free) LookupPaths paths = {};
         _cleanup_(presets_freep) Presets presets = {};
+        _cleanup_set_free_free_ Set *unit_path_cache = NULL;
         char **i;
         int r;
 
@@ -3154,6 +3477,14 @@ int unit_file_preset(
         if (r < 0)
                 return r;
 
+        if (strv_length(files) > 1) {
+                r = unit_path_cache_new(&paths, &unit_path_cache);
+                if (r < 0)
+                        return r;
+
+                plus.unit_path_cache = minus.unit_path_cache = unit_path_cache;
+        }
+
         STRV_FOREACH(i, files) {
                 r = preset_prepare_one(scope, &plus, &minus, &paths, *i, presets, changes, n_changes);
                 if (r < 0)
@@ -3174,6 +3505,7 @@ int unit_file_preset_all(
         _cleanup_(install_context_done) InstallContext plus = {}, minus = {};
         _cleanup_(lookup_paths_free) LookupPaths paths = {};
         _cleanup_(presets_freep) Presets presets = {};
+        _cleanup_set_free_free_ Set *unit_path_cache = NULL;
         char **i;
         int r;
 
@@ -3189,6 +3521,12 @@ int unit_file_preset_all(
         if (r < 0)
                 return r;
 
+        r = unit_path_cache_new(&paths, &unit_path_cache);
+        if (r < 0)
+                return r;
+
+        plus.unit_path_cache = minus.unit_path_cache = unit_path_cache;
+
         STRV_FOREACH(i, paths.search_path) {
                 _cleanup_closedir_ DIR *d = NULL;
                 struct dirent *de;
@@ -3250,6 +3588,7 @@ int unit_file_get_list(
                 char **patterns) {
 
         _cleanup_(lookup_paths_free) LookupPaths paths = {};
+        _cleanup_(symlink_index_freep) Hashmap *index = NULL;
         char **i;
         int r;
 
@@ -3257,6 +3596,9 @@ int unit_file_get_list(
         assert(scope < _UNIT_FILE_SCOPE_MAX);
         assert(h);
 
+        /* The state of each unit depends on the symlinks in all directories of the search path, hence we read each
+         * of them only once, and look the symlinks up in the index for every unit we find. */
+
         r = lookup_paths_init(&paths, scope, 0, root_dir);
         if (r < 0)
                 return r;
@@ -3302,7 +3644,7 @@ int unit_file_get_list(
                         if (!f->path)
                                 return -ENOMEM;
 
-                        r = unit_file_lookup_state(scope, &paths, de->d_name, &f->state);
+                        r = unit_file_lookup_state_internal(scope, &paths, de->d_name, &f->state, &index);
                         if (r < 0)
                                 f->state = UNIT_FILE_BAD;
 
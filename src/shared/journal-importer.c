@@ -4,6 +4,7 @@
 #include <unistd.h>
 
 #include "alloc-util.h"
+#include "compress.h"
 #include "escape.h"
 #include "fd-util.h"
 #include "io-util.h"
@@ -19,6 +20,7 @@ enum {
         IMPORTER_STATE_DATA_START,  /* reading binary data header */
         IMPORTER_STATE_DATA,        /* reading binary data */
         IMPORTER_STATE_DATA_FINISH, /* expecting newline */
+        IMPORTER_STATE_BINARY,      /* reading a frame of the binary format */
         IMPORTER_STATE_EOF,         /* done */
 };
 
@@ -42,6 +44,23 @@ static void iovw_rebase(struct iovec_wrapper *iovw, char *old, char *new) {
                 iovw->iovec[i].iov_base = (char*) iovw->iovec[i].iov_base - old + new;
 }
 
+static void payloads_rebase(JournalImporter *imp, char *old, char *new) {
+        size_t i;
+
+        for (i = 0; i < imp->n_payloads; i++)
+                if (imp->payloads[i].compression != 0)
+                        imp->payloads[i].data = (const char*) imp->payloads[i].data - old + new;
+}
+
+static void payloads_free_contents(JournalImporter *imp) {
+        size_t i;
+
+        for (i = 0; i < imp->n_decompressed; i++)
+                free(imp->decompressed[i]);
+
+        imp->n_decompressed = imp->n_payloads = 0;
+}
+
 size_t iovw_size(struct iovec_wrapper *iovw) {
         size_t n = 0, i;
 
@@ -60,6 +79,9 @@ void journal_importer_cleanup(JournalImporter *imp) {
         free(imp->name);
         free(imp->buf);
         iovw_free_contents(&imp->iovw);
+        payloads_free_contents(imp);
+        free(imp->payloads);
+        free(imp->decompressed);
 }
 
 static char* realloc_buffer(JournalImporter *imp, size_t size) {
@@ -70,6 +92,7 @@ static char* realloc_buffer(JournalImporter *imp, size_t size) {
                 return NULL;
 
         iovw_rebase(&imp->iovw, old, imp->buf);
+        payloads_rebase(imp, old, imp->buf);
 
         return b;
 }
@@ -141,8 +164,9 @@ static int get_line(JournalImporter *imp, char **line, size_t *size) {
 static int fill_fixed_size(JournalImporter *imp, void **data, size_t size) {
 
         assert(imp);
-        assert(IN_SET(imp->state, IMPORTER_STATE_DATA_START, IMPORTER_STATE_DATA, IMPORTER_STATE_DATA_FINISH));
-        assert(size <= DATA_SIZE_MAX);
+        assert(IN_SET(imp->state, IMPORTER_STATE_LINE, IMPORTER_STATE_DATA_START, IMPORTER_STATE_DATA,
+                      IMPORTER_STATE_DATA_FINISH, IMPORTER_STATE_BINARY));
+        assert(size <= (imp->state == IMPORTER_STATE_BINARY ? ENTRY_SIZE_MAX : DATA_SIZE_MAX));
         assert(imp->offset <= imp->filled);
         assert(imp->filled <= imp->size);
         assert(imp->buf || imp->size == 0);
@@ -240,6 +264,162 @@ static int get_data_newline(JournalImporter *imp) {
         return 1;
 }
 
+static int peek_binary(JournalImporter *imp) {
+        void *data;
+        int r;
+
+        assert(imp);
+        assert(imp->state == IMPORTER_STATE_LINE);
+
+        /* Checks whether the next entry is in the binary format, without consuming anything */
+
+        r = fill_fixed_size(imp, &data, 1);
+        if (r <= 0)
+                return r;
+
+        imp->offset--;
+
+        return *(uint8_t*) data == EXPORT_BINARY_SIGNATURE[0] ? 1 : 2;
+}
+
+static int put_payload(JournalImporter *imp, const JournalFilePayload *payload) {
+        assert(imp);
+        assert(payload);
+
+        if (!GREEDY_REALLOC(imp->payloads, imp->n_payloads_allocated, imp->n_payloads + 1))
+                return log_oom();
+
+        imp->payloads[imp->n_payloads++] = *payload;
+        return 0;
+}
+
+static int process_binary_field(JournalImporter *imp, uint8_t *payload, const ExportBinaryField *h) {
+        const char *eq;
+        void *data;
+        size_t size;
+        int compression, r;
+
+        assert(imp);
+        assert(payload);
+        assert(h);
+
+        compression = le32toh(h->compression);
+        size = le64toh(h->size);
+
+        if (compression == 0) {
+                data = payload;
+        } else {
+                _cleanup_free_ void *buf = NULL;
+                size_t allocated = 0;
+
+                if (!IN_SET(compression, OBJECT_COMPRESSED_XZ, OBJECT_COMPRESSED_LZ4, OBJECT_COMPRESSED_ZSTD))
+                        return log_error_errno(SYNTHETIC_ERRNO(EBADMSG),
+                                               "Field with unknown compression %i.", compression);
+
+                /* We need the uncompressed data anyway, to hash it and to find the field name */
+                r = decompress_blob(compression, NULL, payload, size, &buf, &allocated, &size, DATA_SIZE_MAX);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to decompress %s field: %m",
+                                               object_compressed_to_string(compression));
+                if (size >= DATA_SIZE_MAX)
+                        return log_error_errno(SYNTHETIC_ERRNO(E2BIG),
+                                               "Stream declares field with size >= DATA_SIZE_MAX = %u",
+                                               DATA_SIZE_MAX);
+
+                if (!GREEDY_REALLOC(imp->decompressed, imp->n_decompressed_allocated, imp->n_decompressed + 1))
+                        return log_oom();
+
+                data = imp->decompressed[imp->n_decompressed++] = TAKE_PTR(buf);
+        }
+
+        eq = memchr(data, '=', size);
+        if (!eq || !journal_field_valid(data, eq - (char*) data, true) || startswith(data, "__")) {
+                char buf[64];
+
+                log_debug("Ignoring invalid field: \"%s\"",
+                          cellescape(buf, sizeof buf, strndupa(data, eq ? eq - (char*) data : MIN(size, sizeof buf))));
+                return 0;
+        }
+
+        r = iovw_put(&imp->iovw, data, size);
+        if (r < 0)
+                return r;
+
+        return put_payload(imp, &(JournalFilePayload) {
+                        .compression = compression,
+                        .data = compression != 0 ? payload : NULL,
+                        .size = compression != 0 ? le64toh(h->size) : 0,
+                });
+}
+
+static int get_binary_entry(JournalImporter *imp) {
+        ExportBinaryEntry h;
+        uint8_t *frame, *p, *end;
+        uint64_t size;
+        uint32_t i, n;
+        void *data;
+        int r;
+
+        assert(imp);
+        assert(imp->state == IMPORTER_STATE_BINARY);
+        assert(imp->iovw.count == 0);
+
+        /* Look at the header first, then read the whole frame in one go */
+        r = fill_fixed_size(imp, &data, sizeof(h));
+        if (r <= 0)
+                return r;
+        memcpy(&h, data, sizeof(h));
+        imp->offset -= sizeof(h);
+
+        if (memcmp(h.signature, EXPORT_BINARY_SIGNATURE, sizeof(h.signature)) != 0)
+                return log_error_errno(SYNTHETIC_ERRNO(EBADMSG), "Invalid binary entry signature.");
+
+        size = le64toh(h.size);
+        if (size < sizeof(h) || size > ENTRY_SIZE_MAX)
+                return log_error_errno(SYNTHETIC_ERRNO(E2BIG),
+                                       "Stream declares entry with size %"PRIu64" outside of [%zu, %u]",
+                                       size, sizeof(h), ENTRY_SIZE_MAX);
+
+        if (!VALID_REALTIME(le64toh(h.realtime)) || !VALID_MONOTONIC(le64toh(h.monotonic)))
+                return log_error_errno(SYNTHETIC_ERRNO(ERANGE), "Binary entry timestamp out of range.");
+
+        r = fill_fixed_size(imp, &data, size);
+        if (r <= 0)
+                return r;
+
+        imp->ts.realtime = le64toh(h.realtime);
+        imp->ts.monotonic = le64toh(h.monotonic);
+        imp->boot_id = h.boot_id;
+
+        frame = data;
+        end = frame + size;
+        n = le32toh(h.n_fields);
+
+        for (i = 0, p = frame + sizeof(h); i < n; i++) {
+                ExportBinaryField fh;
+
+                if ((size_t) (end - p) < sizeof(fh))
+                        return log_error_errno(SYNTHETIC_ERRNO(EBADMSG), "Binary entry truncated.");
+
+                memcpy(&fh, p, sizeof(fh));
+                p += sizeof(fh);
+
+                if (le64toh(fh.size) > (uint64_t) (end - p) || le64toh(fh.size) > DATA_SIZE_MAX)
+                        return log_error_errno(SYNTHETIC_ERRNO(EBADMSG), "Binary field exceeds its entry.");
+
+                r = process_binary_field(imp, p, &fh);
+                if (r < 0)
+                        return r;
+
+                p += le64toh(fh.size);
+        }
+
+        if (p != end)
+                return log_error_errno(SYNTHETIC_ERRNO(EBADMSG), "Trailing garbage after binary entry.");
+
+        return 1;
+}
+
 static int process_special_field(JournalImporter *imp, char *line) {
         const char *value;
         char buf[CELLESCAPE_DEFAULT_LENGTH];
@@ -318,6 +498,21 @@ int journal_importer_process_data(JournalImporter *imp) {
 
                 assert(imp->data_size == 0);
 
+                if (imp->iovw.count == 0) {
+                        /* At the start of an entry, which may be in either format */
+                        r = peek_binary(imp);
+                        if (r < 0)
+                                return r;
+                        if (r == 0) {
+                                imp->state = IMPORTER_STATE_EOF;
+                                return 0;
+                        }
+                        if (r == 1) {
+                                imp->state = IMPORTER_STATE_BINARY;
+                                return 0; /* continue */
+                        }
+                }
+
                 r = get_line(imp, &line, &n);
                 if (r < 0)
                         return r;
@@ -436,6 +631,24 @@ int journal_importer_process_data(JournalImporter *imp) {
                 imp->state = IMPORTER_STATE_LINE;
 
                 return 0; /* continue */
+
+        case IMPORTER_STATE_BINARY:
+                r = get_binary_entry(imp);
+                if (r < 0) {
+                        /* Don't leave half an entry behind */
+                        journal_importer_drop_iovw(imp);
+                        return r;
+                }
+                if (r == 0) {
+                        imp->state = IMPORTER_STATE_EOF;
+                        return 0;
+                }
+
+                log_trace("Received binary entry with %zu fields", imp->iovw.count);
+
+                imp->state = IMPORTER_STATE_LINE;
+                return 1;
+
         default:
                 assert_not_reached("wtf?");
         }
@@ -464,6 +677,7 @@ void journal_importer_drop_iovw(JournalImporter *imp) {
         /* This function drops processed data that along with the iovw that points at it */
 
         iovw_free_contents(&imp->iovw);
+        payloads_free_contents(imp);
 
         /* possibly reset buffer position */
         remain = imp->filled - imp->offset;
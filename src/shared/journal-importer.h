@@ -8,6 +8,8 @@
 
 #include "sd-id128.h"
 
+#include "journal-file.h"
+#include "sparse-endian.h"
 #include "time-util.h"
 
 /* Make sure not to make this smaller than the maximum coredump size.
@@ -21,6 +23,32 @@
 #endif
 #define LINE_CHUNK 8*1024u
 
+/* The binary export format: every entry is one self-contained frame, made of an ExportBinaryEntry header followed
+ * by n_fields ExportBinaryField records, each immediately followed by its payload. Payloads are either "FIELD=value"
+ * or the compressed form of that, exactly as stored in the data object of a journal file, so that they can be
+ * passed from one journal file to another without decompressing and compressing them again. All integers are
+ * little endian. Frames start with a NUL byte, which cannot start an entry of the text based export format, hence
+ * both may be mixed on the same stream. */
+#define EXPORT_BINARY_SIGNATURE ((const uint8_t[]) { 0, 'J', 'B', 'E' })
+
+typedef struct ExportBinaryEntry {
+        uint8_t signature[4];
+        le32_t n_fields;
+        le64_t size;            /* of the whole frame, including this header */
+        le64_t realtime;
+        le64_t monotonic;
+        sd_id128_t boot_id;
+        sd_id128_t seqnum_id;   /* these three are only needed to build a cursor for the entry */
+        le64_t seqnum;
+        le64_t xor_hash;
+} _packed_ ExportBinaryEntry;
+
+typedef struct ExportBinaryField {
+        le64_t size;            /* of the payload following */
+        le32_t compression;     /* OBJECT_COMPRESSED_XYZ the payload is compressed with, or 0 */
+        le32_t reserved;
+} _packed_ ExportBinaryField;
+
 struct iovec_wrapper {
         struct iovec *iovec;
         size_t size_bytes;
@@ -45,6 +73,13 @@ typedef struct JournalImporter {
 
         struct iovec_wrapper iovw;
 
+        /* Binary export format only: the fields as received, indexed like iovw, and the buffers the compressed ones
+         * were decompressed into */
+        JournalFilePayload *payloads;
+        size_t n_payloads, n_payloads_allocated;
+        void **decompressed;
+        size_t n_decompressed, n_decompressed_allocated;
+
         int state;
         dual_timestamp ts;
         sd_id128_t boot_id;
@@ -59,3 +94,8 @@ bool journal_importer_eof(const JournalImporter *);
 static inline size_t journal_importer_bytes_remaining(const JournalImporter *imp) {
         return imp->filled;
 }
+
+/* Returns the payloads to pass to journal_file_append_entry_full() along with iovw, or NULL if there are none */
+static inline const JournalFilePayload* journal_importer_payloads(const JournalImporter *imp) {
+        return imp->n_payloads > 0 ? imp->payloads : NULL;
+}
@@ -1837,6 +1837,19 @@ static int json_parse_string(const char **p, char **ret) {
         for (;;) {
                 int len;
 
+                /* Copy runs of printable ASCII characters, i.e. most of any string, in one go */
+                for (len = 0; c[len] >= ' ' && c[len] < 0x7f && !IN_SET(c[len], '"', '\\'); len++)
+                        ;
+                if (len > 0) {
+                        if (!GREEDY_REALLOC(s, allocated, n + len + 1))
+                                return -ENOMEM;
+
+                        memcpy(s + n, c, len);
+                        n += len;
+                        c += len;
+                        continue;
+                }
+
                 /* Check for EOF */
                 if (*c == 0)
                         return -EINVAL;
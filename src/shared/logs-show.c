@@ -2,6 +2,7 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <pthread.h>
 #include <signal.h>
 #include <stdint.h>
 #include <stdlib.h>
@@ -18,8 +19,10 @@
 #include "fd-util.h"
 #include "format-util.h"
 #include "hashmap.h"
+#include "hexdecoct.h"
 #include "hostname-util.h"
 #include "io-util.h"
+#include "journal-importer.h"
 #include "journal-internal.h"
 #include "json.h"
 #include "log.h"
@@ -689,6 +692,113 @@ static int output_export(
         return 0;
 }
 
+static int append_binary_field(uint8_t **buf, size_t *allocated, size_t *size, int compression, const void *data, size_t l) {
+        ExportBinaryField h = {
+                .size = htole64(l),
+                .compression = htole32(compression),
+        };
+
+        if (!GREEDY_REALLOC(*buf, *allocated, *size + sizeof(h) + l))
+                return log_oom();
+
+        memcpy(*buf + *size, &h, sizeof(h));
+        memcpy_safe(*buf + *size + sizeof(h), data, l);
+        *size += sizeof(h) + l;
+
+        return 0;
+}
+
+static int output_export_binary(
+                FILE *f,
+                sd_journal *j,
+                OutputMode mode,
+                unsigned n_columns,
+                OutputFlags flags,
+                Set *output_fields,
+                const size_t highlight[2]) {
+
+        _cleanup_free_ uint8_t *buf = NULL;
+        size_t allocated = 0, size = sizeof(ExportBinaryEntry);
+        ExportBinaryEntry h = {};
+        uint32_t n_fields = 0;
+        JournalFile *jf;
+        Object *o;
+        int r;
+
+        assert(j);
+
+        /* Like output_export(), but compressed data objects are passed through as they are, unless fields are
+         * filtered, since for that we need to look at the field names. */
+
+        sd_journal_set_data_threshold(j, 0);
+
+        jf = j->current_file;
+        if (!jf || jf->current_offset <= 0)
+                return log_error_errno(SYNTHETIC_ERRNO(EADDRNOTAVAIL), "No current entry.");
+
+        r = journal_file_move_to_object(jf, OBJECT_ENTRY, jf->current_offset, &o);
+        if (r < 0)
+                return log_error_errno(r, "Failed to read entry: %m");
+
+        memcpy(h.signature, EXPORT_BINARY_SIGNATURE, sizeof(h.signature));
+        h.realtime = o->entry.realtime;
+        h.monotonic = o->entry.monotonic;
+        h.boot_id = o->entry.boot_id;
+        h.seqnum_id = jf->header->seqnum_id;
+        h.seqnum = o->entry.seqnum;
+        h.xor_hash = o->entry.xor_hash;
+
+        if (!GREEDY_REALLOC(buf, allocated, size))
+                return log_oom();
+
+        sd_journal_restart_data(j);
+        for (;;) {
+                JournalFilePayload payload = {};
+
+                if (output_fields) {
+                        const char *c;
+
+                        r = sd_journal_enumerate_data(j, &payload.data, &payload.size);
+                        if (r <= 0)
+                                break;
+
+                        c = memchr(payload.data, '=', payload.size);
+                        if (!c)
+                                return log_error_errno(SYNTHETIC_ERRNO(EINVAL), "Invalid field.");
+
+                        r = field_set_test(output_fields, payload.data, c - (const char*) payload.data);
+                        if (r < 0)
+                                return r;
+                        if (!r && !memory_startswith(payload.data, payload.size, "_BOOT_ID="))
+                                continue;
+                } else {
+                        r = journal_enumerate_data_payload(j, &payload);
+                        if (r <= 0)
+                                break;
+                }
+
+                r = append_binary_field(&buf, &allocated, &size, payload.compression, payload.data, payload.size);
+                if (r < 0)
+                        return r;
+
+                n_fields++;
+        }
+        if (r == -EBADMSG) {
+                log_debug_errno(r, "Skipping message we can't read: %m");
+                return 0;
+        }
+        if (r < 0)
+                return r;
+
+        h.n_fields = htole32(n_fields);
+        h.size = htole64(size);
+        memcpy(buf, &h, sizeof(h));
+
+        fwrite(buf, size, 1, f);
+
+        return 0;
+}
+
 void json_escape(
                 FILE *f,
                 const char* p,
@@ -748,7 +858,7 @@ struct json_data {
 };
 
 static int update_json_data(
-                Hashmap *h,
+                OrderedHashmap *h,
                 OutputFlags flags,
                 const char *name,
                 const void *value,
@@ -767,7 +877,7 @@ static int update_json_data(
         if (r < 0)
                 return log_error_errno(r, "Failed to allocate JSON data: %m");
 
-        d = hashmap_get(h, name);
+        d = ordered_hashmap_get(h, name);
         if (d) {
                 struct json_data *w;
 
@@ -776,7 +886,7 @@ static int update_json_data(
                         return log_oom();
 
                 d = w;
-                assert_se(hashmap_update(h, json_variant_string(d->name), d) >= 0);
+                assert_se(ordered_hashmap_update(h, json_variant_string(d->name), d) >= 0);
         } else {
                 _cleanup_(json_variant_unrefp) JsonVariant *n = NULL;
 
@@ -788,7 +898,7 @@ static int update_json_data(
                 if (!d)
                         return log_oom();
 
-                r = hashmap_put(h, json_variant_string(n), d);
+                r = ordered_hashmap_put(h, json_variant_string(n), d);
                 if (r < 0) {
                         free(d);
                         return log_error_errno(r, "Failed to insert JSON name into hashmap: %m");
@@ -802,7 +912,7 @@ static int update_json_data(
 }
 
 static int update_json_data_split(
-                Hashmap *h,
+                OrderedHashmap *h,
                 OutputFlags flags,
                 Set *output_fields,
                 const void *data,
@@ -831,6 +941,461 @@ static int update_json_data_split(
         return update_json_data(h, flags, name, eq + 1, size - (eq - (const char*) data) - 1);
 }
 
+/* The fast path for the non-pretty, uncolored JSON output modes. Instead of building a JsonVariant object for each
+ * entry, the fields are copied into a scratch buffer that is reused for all entries, repeated fields are found via a
+ * small open addressing table, and the output is assembled in a reusable buffer and written out in one go. The
+ * output is identical to what json_variant_dump() generates for the same entry. */
+
+typedef struct JsonField {
+        size_t offset;      /* of the field in the data buffer */
+        size_t name_size;
+        size_t size;        /* of the whole field, i.e. including the name and the '=' */
+        size_t next;        /* index of the next field of the same name, plus one, or 0 if there's none */
+        size_t last;        /* for the first field of a name only: index of the last field of the name seen so far */
+        bool repeated;      /* not the first field of its name */
+} JsonField;
+
+typedef struct JsonScratch {
+        char *data;
+        size_t data_size, data_allocated;
+
+        JsonField *fields;
+        size_t n_fields, n_fields_allocated;
+
+        size_t *table;
+        size_t table_allocated;
+
+        char *out;
+        size_t out_size, out_allocated;
+} JsonScratch;
+
+static bool json_fast_path = true;
+
+void json_fast_path_set_enabled(bool b) {
+        json_fast_path = b;
+}
+
+static pthread_key_t json_scratch_key;
+static pthread_once_t json_scratch_once = PTHREAD_ONCE_INIT;
+static bool json_scratch_key_valid = false;
+
+static void json_scratch_free(void *p) {
+        JsonScratch *s = p;
+
+        if (!s)
+                return;
+
+        free(s->data);
+        free(s->fields);
+        free(s->table);
+        free(s->out);
+        free(s);
+}
+
+static void json_scratch_key_create(void) {
+        /* gatewayd runs one thread per connection, hence keep one scratch area per thread, and free it when the
+         * thread exits */
+        json_scratch_key_valid = pthread_key_create(&json_scratch_key, json_scratch_free) == 0;
+}
+
+static JsonScratch *json_scratch_get(void) {
+        JsonScratch *s;
+
+        (void) pthread_once(&json_scratch_once, json_scratch_key_create);
+        if (!json_scratch_key_valid)
+                return NULL;
+
+        s = pthread_getspecific(json_scratch_key);
+        if (s)
+                return s;
+
+        s = new0(JsonScratch, 1);
+        if (!s)
+                return NULL;
+
+        if (pthread_setspecific(json_scratch_key, s) != 0) {
+                free(s);
+                return NULL;
+        }
+
+        return s;
+}
+
+static int json_scratch_add(JsonScratch *s, const char *name, size_t name_size, const void *value, size_t value_size) {
+        JsonField *field;
+        char *p;
+
+        assert(s);
+        assert(name);
+        assert(value || value_size == 0);
+
+        if (!GREEDY_REALLOC(s->data, s->data_allocated, s->data_size + name_size + 1 + value_size))
+                return log_oom();
+
+        if (!GREEDY_REALLOC(s->fields, s->n_fields_allocated, s->n_fields + 1))
+                return log_oom();
+
+        field = s->fields + s->n_fields++;
+        *field = (JsonField) {
+                .offset = s->data_size,
+                .name_size = name_size,
+                .size = name_size + 1 + value_size,
+        };
+
+        p = mempcpy(s->data + s->data_size, name, name_size);
+        *(p++) = '=';
+        memcpy_safe(p, value, value_size);
+
+        s->data_size += field->size;
+        return 0;
+}
+
+static int json_scratch_add_split(JsonScratch *s, Set *output_fields, const void *data, size_t size) {
+        const char *eq;
+
+        assert(s);
+        assert(data || size == 0);
+
+        /* Same filtering as update_json_data_split() */
+
+        if (memory_startswith(data, size, "_BOOT_ID="))
+                return 0;
+
+        eq = memchr(data, '=', MIN(size, JSON_THRESHOLD));
+        if (!eq)
+                return 0;
+
+        if (eq == data)
+                return 0;
+
+        if (output_fields && !set_get(output_fields, strndupa(data, eq - (const char*) data)))
+                return 0;
+
+        return json_scratch_add(s, data, eq - (const char*) data, eq + 1, size - (eq - (const char*) data) - 1);
+}
+
+static uint32_t json_field_name_hash(const char *name, size_t size) {
+        uint32_t h = 2166136261U;
+
+        /* FNV-1a, good enough for the few dozen field names of a single entry */
+        for (; size > 0; name++, size--)
+                h = (h ^ (uint8_t) *name) * 16777619U;
+
+        return h;
+}
+
+static int json_scratch_link_repeated(JsonScratch *s) {
+        size_t n_slots = 64, mask, i;
+
+        assert(s);
+
+        while (n_slots < s->n_fields * 2)
+                n_slots *= 2;
+
+        if (!GREEDY_REALLOC(s->table, s->table_allocated, n_slots))
+                return log_oom();
+
+        memzero(s->table, n_slots * sizeof(size_t));
+        mask = n_slots - 1;
+
+        for (i = 0; i < s->n_fields; i++) {
+                JsonField *f = s->fields + i;
+                const char *name = s->data + f->offset;
+                size_t k;
+
+                for (k = json_field_name_hash(name, f->name_size) & mask;; k = (k + 1) & mask) {
+                        JsonField *first;
+
+                        if (s->table[k] == 0) {
+                                s->table[k] = i + 1;
+                                f->last = i;
+                                break;
+                        }
+
+                        first = s->fields + s->table[k] - 1;
+                        if (first->name_size == f->name_size &&
+                            memcmp(s->data + first->offset, name, f->name_size) == 0) {
+                                s->fields[first->last].next = i + 1;
+                                first->last = i;
+                                f->repeated = true;
+                                break;
+                        }
+                }
+        }
+
+        return 0;
+}
+
+static int json_scratch_reserve(JsonScratch *s, size_t n) {
+        assert(s);
+
+        if (!GREEDY_REALLOC(s->out, s->out_allocated, s->out_size + n))
+                return log_oom();
+
+        return 0;
+}
+
+static void json_scratch_append(JsonScratch *s, const char *p, size_t n) {
+        assert(s);
+        assert(s->out_size + n <= s->out_allocated);
+
+        memcpy_safe(s->out + s->out_size, p, n);
+        s->out_size += n;
+}
+
+static int json_scratch_append_string(JsonScratch *s, const char *p, size_t n) {
+        char *o;
+        int r;
+
+        assert(s);
+        assert(p || n == 0);
+
+        /* Every byte takes at most six bytes escaped, plus the quotes */
+        r = json_scratch_reserve(s, n * 6 + 2);
+        if (r < 0)
+                return r;
+
+        o = s->out + s->out_size;
+        *(o++) = '"';
+
+        for (; n > 0; p++, n--) {
+                switch (*p) {
+
+                case '"':
+                case '\\':
+                case '/':
+                        *(o++) = '\\';
+                        *(o++) = *p;
+                        break;
+
+                case '\b':
+                        o = mempcpy(o, "\\b", 2);
+                        break;
+
+                case '\f':
+                        o = mempcpy(o, "\\f", 2);
+                        break;
+
+                case '\n':
+                        o = mempcpy(o, "\\n", 2);
+                        break;
+
+                case '\r':
+                        o = mempcpy(o, "\\r", 2);
+                        break;
+
+                case '\t':
+                        o = mempcpy(o, "\\t", 2);
+                        break;
+
+                default:
+                        if ((signed char) *p >= 0 && *p < ' ') {
+                                o = mempcpy(o, "\\u00", 4);
+                                *(o++) = hexchar(*p >> 4);
+                                *(o++) = hexchar(*p);
+                        } else
+                                *(o++) = *p;
+                }
+        }
+
+        *(o++) = '"';
+        s->out_size = o - s->out;
+
+        return 0;
+}
+
+static int json_scratch_append_value(JsonScratch *s, OutputFlags flags, const JsonField *f) {
+        const char *value;
+        size_t size;
+        char *o;
+        int r;
+
+        assert(s);
+        assert(f);
+
+        value = s->data + f->offset + f->name_size + 1;
+        size = f->size - f->name_size - 1;
+
+        if (!(flags & OUTPUT_SHOW_ALL) && f->size >= JSON_THRESHOLD) {
+                r = json_scratch_reserve(s, STRLEN("null"));
+                if (r < 0)
+                        return r;
+
+                json_scratch_append(s, "null", STRLEN("null"));
+                return 0;
+        }
+
+        if (utf8_is_printable(value, size))
+                return json_scratch_append_string(s, value, size);
+
+        /* Not a string: format as array of bytes, each up to three digits and a separator */
+        r = json_scratch_reserve(s, size * 4 + 2);
+        if (r < 0)
+                return r;
+
+        o = s->out + s->out_size;
+        *(o++) = '[';
+
+        for (; size > 0; value++, size--) {
+                uint8_t c = *value;
+
+                if (c >= 100)
+                        *(o++) = '0' + c / 100;
+                if (c >= 10)
+                        *(o++) = '0' + c / 10 % 10;
+                *(o++) = '0' + c % 10;
+
+                if (size > 1)
+                        *(o++) = ',';
+        }
+
+        *(o++) = ']';
+        s->out_size = o - s->out;
+
+        return 0;
+}
+
+static int output_json_fast(
+                FILE *f,
+                sd_journal *j,
+                JsonScratch *s,
+                OutputMode mode,
+                OutputFlags flags,
+                Set *output_fields,
+                const char *cursor,
+                uint64_t realtime,
+                uint64_t monotonic,
+                sd_id128_t boot_id) {
+
+        char sid[SD_ID128_STRING_MAX], usecbuf[DECIMAL_STR_MAX(usec_t)];
+        bool first = true;
+        size_t i;
+        int r;
+
+        assert(f);
+        assert(j);
+        assert(s);
+
+        s->data_size = s->n_fields = s->out_size = 0;
+
+        r = json_scratch_add(s, "__CURSOR", STRLEN("__CURSOR"), cursor, strlen(cursor));
+        if (r < 0)
+                return r;
+
+        xsprintf(usecbuf, USEC_FMT, realtime);
+        r = json_scratch_add(s, "__REALTIME_TIMESTAMP", STRLEN("__REALTIME_TIMESTAMP"), usecbuf, strlen(usecbuf));
+        if (r < 0)
+                return r;
+
+        xsprintf(usecbuf, USEC_FMT, monotonic);
+        r = json_scratch_add(s, "__MONOTONIC_TIMESTAMP", STRLEN("__MONOTONIC_TIMESTAMP"), usecbuf, strlen(usecbuf));
+        if (r < 0)
+                return r;
+
+        sd_id128_to_string(boot_id, sid);
+        r = json_scratch_add(s, "_BOOT_ID", STRLEN("_BOOT_ID"), sid, strlen(sid));
+        if (r < 0)
+                return r;
+
+        for (;;) {
+                const void *data;
+                size_t size;
+
+                r = sd_journal_enumerate_data(j, &data, &size);
+                if (r == -EBADMSG) {
+                        log_debug_errno(r, "Skipping message we can't read: %m");
+                        return 0;
+                }
+                if (r < 0)
+                        return log_error_errno(r, "Failed to read journal: %m");
+                if (r == 0)
+                        break;
+
+                r = json_scratch_add_split(s, output_fields, data, size);
+                if (r < 0)
+                        return r;
+        }
+
+        r = json_scratch_link_repeated(s);
+        if (r < 0)
+                return r;
+
+        r = json_scratch_reserve(s, STRLEN("data: {"));
+        if (r < 0)
+                return r;
+
+        if (mode == OUTPUT_JSON_SSE)
+                json_scratch_append(s, "data: ", STRLEN("data: "));
+        else if (mode == OUTPUT_JSON_SEQ)
+                json_scratch_append(s, "\x1e", 1); /* ASCII Record Separator */
+
+        json_scratch_append(s, "{", 1);
+
+        for (i = 0; i < s->n_fields; i++) {
+                const JsonField *field = s->fields + i;
+
+                if (field->repeated)
+                        continue;
+
+                r = json_scratch_reserve(s, 1);
+                if (r < 0)
+                        return r;
+
+                if (!first)
+                        json_scratch_append(s, ",", 1);
+                first = false;
+
+                r = json_scratch_append_string(s, s->data + field->offset, field->name_size);
+                if (r < 0)
+                        return r;
+
+                r = json_scratch_reserve(s, 2);
+                if (r < 0)
+                        return r;
+
+                json_scratch_append(s, ":", 1);
+
+                if (field->next == 0) {
+                        r = json_scratch_append_value(s, flags, field);
+                        if (r < 0)
+                                return r;
+
+                        continue;
+                }
+
+                json_scratch_append(s, "[", 1);
+
+                for (;;) {
+                        r = json_scratch_append_value(s, flags, field);
+                        if (r < 0)
+                                return r;
+
+                        r = json_scratch_reserve(s, 1);
+                        if (r < 0)
+                                return r;
+
+                        if (field->next == 0)
+                                break;
+
+                        json_scratch_append(s, ",", 1);
+                        field = s->fields + field->next - 1;
+                }
+
+                json_scratch_append(s, "]", 1);
+        }
+
+        r = json_scratch_reserve(s, 3);
+        if (r < 0)
+                return r;
+
+        json_scratch_append(s, "}\n", 2);
+        if (mode == OUTPUT_JSON_SSE)
+                json_scratch_append(s, "\n", 1); /* In case of SSE add a second newline */
+
+        fwrite(s->out, 1, s->out_size, f);
+        return 0;
+}
+
 static int output_json(
                 FILE *f,
                 sd_journal *j,
@@ -846,8 +1411,8 @@ static int output_json(
         uint64_t realtime, monotonic;
         JsonVariant **array = NULL;
         struct json_data *d;
+        OrderedHashmap *h = NULL;
         sd_id128_t boot_id;
-        Hashmap *h = NULL;
         size_t n = 0;
         Iterator i;
         int r;
@@ -868,7 +1433,16 @@ static int output_json(
         if (r < 0)
                 return log_error_errno(r, "Failed to get cursor: %m");
 
-        h = hashmap_new(&string_hash_ops);
+        if (json_fast_path && mode != OUTPUT_JSON_PRETTY && !FLAGS_SET(flags, OUTPUT_COLOR)) {
+                JsonScratch *s;
+
+                s = json_scratch_get();
+                if (s)
+                        return output_json_fast(f, j, s, mode, flags, output_fields, cursor, realtime, monotonic, boot_id);
+        }
+
+        /* Fields are shown in the order they first appear in, like the fast path does */
+        h = ordered_hashmap_new(&string_hash_ops);
         if (!h)
                 return log_oom();
 
@@ -913,13 +1487,13 @@ static int output_json(
                         goto finish;
         }
 
-        array = new(JsonVariant*, hashmap_size(h)*2);
+        array = new(JsonVariant*, ordered_hashmap_size(h)*2);
         if (!array) {
                 r = log_oom();
                 goto finish;
         }
 
-        HASHMAP_FOREACH(d, h, i) {
+        ORDERED_HASHMAP_FOREACH(d, h, i) {
                 assert(d->n_values > 0);
 
                 array[n++] = json_variant_ref(d->name);
@@ -956,7 +1530,7 @@ static int output_json(
         r = 0;
 
 finish:
-        while ((d = hashmap_steal_first(h))) {
+        while ((d = ordered_hashmap_steal_first(h))) {
                 size_t k;
 
                 json_variant_unref(d->name);
@@ -966,7 +1540,7 @@ finish:
                 free(d);
         }
 
-        hashmap_free(h);
+        ordered_hashmap_free(h);
 
         json_variant_unref_many(array, n);
         free(array);
@@ -1047,6 +1621,7 @@ static int (*output_funcs[_OUTPUT_MODE_MAX])(
         [OUTPUT_SHORT_FULL] = output_short,
         [OUTPUT_VERBOSE] = output_verbose,
         [OUTPUT_EXPORT] = output_export,
+        [OUTPUT_EXPORT_BINARY] = output_export_binary,
         [OUTPUT_JSON] = output_json,
         [OUTPUT_JSON_PRETTY] = output_json,
         [OUTPUT_JSON_SSE] = output_json,
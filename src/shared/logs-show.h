@@ -61,3 +61,6 @@ void json_escape(
                 const char* p,
                 size_t l,
                 OutputFlags flags);
+
+/* This is exported just for testing */
+void json_fast_path_set_enabled(bool b);
@@ -598,6 +598,13 @@ int image_discover(ImageClass class, Hashmap *h) {
         return 0;
 }
 
+const char *image_search_path_nulstr(ImageClass class) {
+        assert(class >= 0);
+        assert(class < _IMAGE_CLASS_MAX);
+
+        return image_search_path[class];
+}
+
 int image_remove(Image *i) {
         _cleanup_(release_lock_file) LockFile global_lock = LOCK_FILE_INIT, local_lock = LOCK_FILE_INIT;
         _cleanup_strv_free_ char **settings = NULL;
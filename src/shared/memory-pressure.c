@@ -0,0 +1,270 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <fcntl.h>
+#include <malloc.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+
+#include "alloc-util.h"
+#include "cgroup-util.h"
+#include "event-util.h"
+#include "fd-util.h"
+#include "log.h"
+#include "memory-pressure.h"
+#include "stdio-util.h"
+#include "string-table.h"
+#include "string-util.h"
+#include "time-util.h"
+
+/* Report when tasks were stalled for more than this in the window below. The kernel only allows
+ * unprivileged processes to register triggers with windows that are multiples of 2s. */
+#define MEMORY_PRESSURE_SOME_THRESHOLD_USEC (200 * USEC_PER_MSEC)
+#define MEMORY_PRESSURE_FULL_THRESHOLD_USEC (100 * USEC_PER_MSEC)
+#define MEMORY_PRESSURE_WINDOW_USEC (2 * USEC_PER_SEC)
+
+/* Consider the pressure gone if the kernel didn't report anything for this long */
+#define MEMORY_PRESSURE_RELIEF_USEC (30 * USEC_PER_SEC)
+
+typedef struct MemoryPressureHandler {
+        memory_pressure_handler_t handler;
+        void *userdata;
+} MemoryPressureHandler;
+
+struct MemoryPressure {
+        sd_event *event;
+
+        sd_event_source *some_event_source;
+        sd_event_source *full_event_source;
+        sd_event_source *relief_event_source;
+
+        MemoryPressureLevel level;
+
+        MemoryPressureHandler *handlers;
+        size_t n_handlers, n_allocated;
+};
+
+static void memory_pressure_dispatch(MemoryPressure *mp, MemoryPressureLevel level) {
+        size_t i;
+
+        assert(mp);
+
+        log_debug("Memory pressure level changed: %s → %s",
+                  memory_pressure_level_to_string(mp->level), memory_pressure_level_to_string(level));
+
+        mp->level = level;
+
+        for (i = 0; i < mp->n_handlers; i++)
+                mp->handlers[i].handler(level, mp->handlers[i].userdata);
+
+        /* Whatever the handlers released likely sits in free lists of the allocator now, hand it back to the
+         * kernel so that it is actually available to others. */
+        if (level != MEMORY_PRESSURE_NONE)
+                (void) malloc_trim(0);
+}
+
+static int on_relief(sd_event_source *s, uint64_t usec, void *userdata) {
+        MemoryPressure *mp = userdata;
+
+        assert(mp);
+
+        memory_pressure_dispatch(mp, MEMORY_PRESSURE_NONE);
+        return 0;
+}
+
+static int on_pressure(sd_event_source *s, int fd, uint32_t revents, void *userdata) {
+        MemoryPressure *mp = userdata;
+        MemoryPressureLevel level;
+        int r;
+
+        assert(mp);
+
+        if (revents & EPOLLERR) {
+                /* The cgroup went away, or the kernel doesn't want to tell us anything anymore */
+                log_debug("Memory pressure trigger failed, not watching it anymore.");
+                return sd_event_source_set_enabled(s, SD_EVENT_OFF);
+        }
+
+        level = s == mp->full_event_source ? MEMORY_PRESSURE_FULL : MEMORY_PRESSURE_SOME;
+
+        /* Events are reported at most once per window, and only while the stall is ongoing, hence we keep
+         * pushing the relief timer out as long as they arrive, and only grow the caches back afterwards. */
+        r = event_reset_time(mp->event, &mp->relief_event_source,
+                             CLOCK_MONOTONIC, usec_add(now(CLOCK_MONOTONIC), MEMORY_PRESSURE_RELIEF_USEC), USEC_PER_SEC,
+                             on_relief, mp, SD_EVENT_PRIORITY_NORMAL, "memory-pressure-relief", true);
+        if (r < 0)
+                log_debug_errno(r, "Failed to set up memory pressure relief timer, ignoring: %m");
+
+        if (level > mp->level)
+                memory_pressure_dispatch(mp, level);
+
+        return 0;
+}
+
+static int memory_pressure_open(char **ret_path) {
+        int r;
+
+        assert(ret_path);
+
+        /* Prefer the pressure of our own cgroup, that is the memory we are actually limited by */
+        if (cg_all_unified() > 0) {
+                _cleanup_free_ char *cgroup = NULL, *path = NULL;
+
+                r = cg_pid_get_path(SYSTEMD_CGROUP_CONTROLLER, 0, &cgroup);
+                if (r >= 0)
+                        r = cg_get_path(SYSTEMD_CGROUP_CONTROLLER, cgroup, "memory.pressure", &path);
+                if (r >= 0 && access(path, W_OK) >= 0) {
+                        *ret_path = TAKE_PTR(path);
+                        return 0;
+                }
+        }
+
+        if (access("/proc/pressure/memory", W_OK) < 0)
+                return -errno;
+
+        return free_and_strdup(ret_path, "/proc/pressure/memory");
+}
+
+static int memory_pressure_open_trigger(const char *path, const char *type, usec_t threshold) {
+        _cleanup_close_ int fd = -1;
+        char buf[STRLEN("full ") + 2 * DECIMAL_STR_MAX(usec_t) + 1];
+
+        assert(path);
+        assert(type);
+
+        fd = open(path, O_RDWR|O_NONBLOCK|O_CLOEXEC);
+        if (fd < 0)
+                return -errno;
+
+        /* Every fd carries one trigger, and the kernel insists on the trailing NUL byte */
+        xsprintf(buf, "%s " USEC_FMT " " USEC_FMT, type, threshold, MEMORY_PRESSURE_WINDOW_USEC);
+        if (write(fd, buf, strlen(buf) + 1) < 0)
+                return -errno;
+
+        return TAKE_FD(fd);
+}
+
+static int memory_pressure_watch(MemoryPressure *mp, int fd, const char *type, sd_event_source **ret) {
+        int r;
+
+        assert(mp);
+        assert(fd >= 0);
+        assert(type);
+        assert(ret);
+
+        r = sd_event_add_io(mp->event, ret, fd, EPOLLPRI, on_pressure, mp);
+        if (r < 0)
+                return r;
+
+        (void) sd_event_source_set_description(*ret, type);
+
+        return 0;
+}
+
+int memory_pressure_new_from_fds(sd_event *event, int some_fd, int full_fd, MemoryPressure **ret) {
+        _cleanup_(memory_pressure_freep) MemoryPressure *mp = NULL;
+        int r;
+
+        assert(event);
+        assert(some_fd >= 0);
+        assert(full_fd >= 0);
+        assert(ret);
+
+        mp = new(MemoryPressure, 1);
+        if (!mp)
+                return -ENOMEM;
+
+        *mp = (MemoryPressure) {
+                .event = sd_event_ref(event),
+                .level = MEMORY_PRESSURE_NONE,
+        };
+
+        r = memory_pressure_watch(mp, some_fd, "some", &mp->some_event_source);
+        if (r < 0)
+                return r;
+
+        r = memory_pressure_watch(mp, full_fd, "full", &mp->full_event_source);
+        if (r < 0)
+                return r;
+
+        /* Only take possession of the fds once nothing can fail anymore */
+        assert_se(sd_event_source_set_io_fd_own(mp->some_event_source, true) >= 0);
+        assert_se(sd_event_source_set_io_fd_own(mp->full_event_source, true) >= 0);
+
+        *ret = TAKE_PTR(mp);
+        return 0;
+}
+
+int memory_pressure_new(sd_event *event, MemoryPressure **ret) {
+        _cleanup_close_ int some_fd = -1, full_fd = -1;
+        _cleanup_free_ char *path = NULL;
+        int r;
+
+        assert(event);
+        assert(ret);
+
+        r = memory_pressure_open(&path);
+        if (r < 0)
+                return log_debug_errno(r, "Memory pressure information not available: %m");
+
+        some_fd = memory_pressure_open_trigger(path, "some", MEMORY_PRESSURE_SOME_THRESHOLD_USEC);
+        if (some_fd < 0)
+                return log_debug_errno(some_fd, "Failed to install memory pressure trigger on %s: %m", path);
+
+        full_fd = memory_pressure_open_trigger(path, "full", MEMORY_PRESSURE_FULL_THRESHOLD_USEC);
+        if (full_fd < 0)
+                return log_debug_errno(full_fd, "Failed to install memory pressure trigger on %s: %m", path);
+
+        r = memory_pressure_new_from_fds(event, some_fd, full_fd, ret);
+        if (r < 0)
+                return log_debug_errno(r, "Failed to watch memory pressure triggers on %s: %m", path);
+        TAKE_FD(some_fd);
+        TAKE_FD(full_fd);
+
+        log_debug("Watching memory pressure through %s.", path);
+
+        return 0;
+}
+
+MemoryPressure *memory_pressure_free(MemoryPressure *mp) {
+        if (!mp)
+                return NULL;
+
+        sd_event_source_unref(mp->some_event_source);
+        sd_event_source_unref(mp->full_event_source);
+        sd_event_source_unref(mp->relief_event_source);
+        sd_event_unref(mp->event);
+
+        free(mp->handlers);
+
+        return mfree(mp);
+}
+
+int memory_pressure_add_handler(MemoryPressure *mp, memory_pressure_handler_t handler, void *userdata) {
+        assert(mp);
+        assert(handler);
+
+        if (!GREEDY_REALLOC(mp->handlers, mp->n_allocated, mp->n_handlers + 1))
+                return -ENOMEM;
+
+        mp->handlers[mp->n_handlers++] = (MemoryPressureHandler) {
+                .handler = handler,
+                .userdata = userdata,
+        };
+
+        return 0;
+}
+
+MemoryPressureLevel memory_pressure_get_level(MemoryPressure *mp) {
+        if (!mp)
+                return MEMORY_PRESSURE_NONE;
+
+        return mp->level;
+}
+
+static const char* const memory_pressure_level_table[_MEMORY_PRESSURE_LEVEL_MAX] = {
+        [MEMORY_PRESSURE_NONE] = "none",
+        [MEMORY_PRESSURE_SOME] = "some",
+        [MEMORY_PRESSURE_FULL] = "full",
+};
+
+DEFINE_STRING_TABLE_LOOKUP(memory_pressure_level, MemoryPressureLevel);
@@ -0,0 +1,34 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+#pragma once
+
+#include "sd-event.h"
+
+#include "macro.h"
+
+/* Watches the memory pressure of the cgroup we are running in (or of the whole system, if cgroup v2 isn't
+ * available) through PSI triggers, and tells interested parties to shrink their caches when memory is short. */
+
+typedef enum MemoryPressureLevel {
+        MEMORY_PRESSURE_NONE,   /* No (more) pressure, caches may grow back to their usual size */
+        MEMORY_PRESSURE_SOME,   /* Some tasks are stalled on memory, drop what is cheap to recreate */
+        MEMORY_PRESSURE_FULL,   /* All tasks are stalled on memory, drop everything that can be dropped */
+        _MEMORY_PRESSURE_LEVEL_MAX,
+        _MEMORY_PRESSURE_LEVEL_INVALID = -1,
+} MemoryPressureLevel;
+
+typedef struct MemoryPressure MemoryPressure;
+
+typedef void (*memory_pressure_handler_t)(MemoryPressureLevel level, void *userdata);
+
+int memory_pressure_new(sd_event *event, MemoryPressure **ret);
+/* Watches fds that already carry a "some" and a "full" trigger, takes possession of them on success */
+int memory_pressure_new_from_fds(sd_event *event, int some_fd, int full_fd, MemoryPressure **ret);
+MemoryPressure *memory_pressure_free(MemoryPressure *mp);
+DEFINE_TRIVIAL_CLEANUP_FUNC(MemoryPressure*, memory_pressure_free);
+
+int memory_pressure_add_handler(MemoryPressure *mp, memory_pressure_handler_t handler, void *userdata);
+
+MemoryPressureLevel memory_pressure_get_level(MemoryPressure *mp);
+
+const char* memory_pressure_level_to_string(MemoryPressureLevel l) _const_;
+MemoryPressureLevel memory_pressure_level_from_string(const char *s) _pure_;
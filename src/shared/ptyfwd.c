@@ -35,6 +35,7 @@ struct PTYForward {
         sd_event_source *master_event_source;
 
         sd_event_source *sigwinch_event_source;
+        sd_event_source *defer_event_source;
 
         struct termios saved_stdin_attr;
         struct termios saved_stdout_attr;
@@ -58,7 +59,10 @@ struct PTYForward {
         bool last_char_set:1;
         char last_char;
 
-        char in_buffer[LINE_MAX], out_buffer[LINE_MAX];
+        /* The pending data is at buffer + start, and is full bytes long */
+        char *in_buffer, *out_buffer;
+        size_t in_buffer_size, out_buffer_size;
+        size_t in_buffer_start, out_buffer_start;
         size_t in_buffer_full, out_buffer_full;
 
         usec_t escape_timestamp;
@@ -70,6 +74,14 @@ struct PTYForward {
 
 #define ESCAPE_USEC (1*USEC_PER_SEC)
 
+/* The buffers start small, which is plenty for interactive use, and grow if they fill up, i.e. when lots of data is
+ * passed through. */
+#define BUFFER_SIZE_MIN LINE_MAX
+#define BUFFER_SIZE_MAX (64U*1024U)
+
+/* How much to read in one go, before giving the other event sources a chance to run */
+#define SHOVEL_BUDGET (256U*1024U)
+
 static void pty_forward_disconnect(PTYForward *f) {
 
         if (f) {
@@ -78,6 +90,7 @@ static void pty_forward_disconnect(PTYForward *f) {
 
                 f->master_event_source = sd_event_source_unref(f->master_event_source);
                 f->sigwinch_event_source = sd_event_source_unref(f->sigwinch_event_source);
+                f->defer_event_source = sd_event_source_unref(f->defer_event_source);
                 f->event = sd_event_unref(f->event);
 
                 if (f->saved_stdout)
@@ -178,19 +191,68 @@ static bool drained(PTYForward *f) {
         return true;
 }
 
+/* Returns how much can be read into the buffer. The pending data is moved to the front if there is no room
+ * behind it. */
+static size_t buffer_room(char *buffer, size_t size, size_t *start, size_t full) {
+        assert(start);
+
+        if (*start > 0 && *start + full >= size) {
+                memmove(buffer, buffer + *start, full);
+                *start = 0;
+        }
+
+        return size - *start - full;
+}
+
+/* Called after a read filled the buffer, to read more in one go the next time */
+static void buffer_grow(char **buffer, size_t *size) {
+        size_t n;
+        char *p;
+
+        assert(buffer);
+        assert(size);
+
+        if (*size >= BUFFER_SIZE_MAX)
+                return;
+
+        n = MIN(*size * 2, BUFFER_SIZE_MAX);
+
+        p = realloc(*buffer, n);
+        if (!p)
+                return; /* Not fatal, just continue with what we have */
+
+        *buffer = p;
+        *size = n;
+}
+
 static int shovel(PTYForward *f) {
+        size_t budget = SHOVEL_BUDGET, room;
         ssize_t k;
+        int r;
 
         assert(f);
 
-        while ((f->stdin_readable && f->in_buffer_full <= 0) ||
+        while ((f->stdin_readable && f->in_buffer_full < f->in_buffer_size) ||
                (f->master_writable && f->in_buffer_full > 0) ||
-               (f->master_readable && f->out_buffer_full <= 0) ||
+               (f->master_readable && f->out_buffer_full < f->out_buffer_size) ||
                (f->stdout_writable && f->out_buffer_full > 0)) {
 
-                if (f->stdin_readable && f->in_buffer_full < LINE_MAX) {
+                if (budget == 0) {
+                        /* There's more to do, but let's give other event sources a chance first. Since we'll not
+                         * be woken up again for the data that is already there, continue in the next iteration. */
+                        r = sd_event_source_set_enabled(f->defer_event_source, SD_EVENT_ONESHOT);
+                        if (r < 0) {
+                                log_error_errno(r, "Failed to enable deferred event source: %m");
+                                return pty_forward_done(f, r);
+                        }
 
-                        k = read(STDIN_FILENO, f->in_buffer + f->in_buffer_full, LINE_MAX - f->in_buffer_full);
+                        return 0;
+                }
+
+                while (f->stdin_readable &&
+                       (room = buffer_room(f->in_buffer, f->in_buffer_size, &f->in_buffer_start, f->in_buffer_full)) > 0) {
+
+                        k = read(STDIN_FILENO, f->in_buffer + f->in_buffer_start + f->in_buffer_full, room);
                         if (k < 0) {
 
                                 if (errno == EAGAIN)
@@ -213,16 +275,20 @@ static int shovel(PTYForward *f) {
                         } else  {
                                 /* Check if ^] has been pressed three times within one second. If we get this we quite
                                  * immediately. */
-                                if (look_for_escape(f, f->in_buffer + f->in_buffer_full, k))
+                                if (look_for_escape(f, f->in_buffer + f->in_buffer_start + f->in_buffer_full, k))
                                         return pty_forward_done(f, -ECANCELED);
 
                                 f->in_buffer_full += (size_t) k;
+                                budget = LESS_BY(budget, (size_t) k);
+
+                                if (f->in_buffer_start + f->in_buffer_full >= f->in_buffer_size)
+                                        buffer_grow(&f->in_buffer, &f->in_buffer_size);
                         }
                 }
 
                 if (f->master_writable && f->in_buffer_full > 0) {
 
-                        k = write(f->master, f->in_buffer, f->in_buffer_full);
+                        k = write(f->master, f->in_buffer + f->in_buffer_start, f->in_buffer_full);
                         if (k < 0) {
 
                                 if (IN_SET(errno, EAGAIN, EIO))
@@ -238,14 +304,15 @@ static int shovel(PTYForward *f) {
                                 }
                         } else {
                                 assert(f->in_buffer_full >= (size_t) k);
-                                memmove(f->in_buffer, f->in_buffer + k, f->in_buffer_full - k);
                                 f->in_buffer_full -= k;
+                                f->in_buffer_start = f->in_buffer_full > 0 ? f->in_buffer_start + k : 0;
                         }
                 }
 
-                if (f->master_readable && f->out_buffer_full < LINE_MAX) {
+                while (f->master_readable &&
+                       (room = buffer_room(f->out_buffer, f->out_buffer_size, &f->out_buffer_start, f->out_buffer_full)) > 0) {
 
-                        k = read(f->master, f->out_buffer + f->out_buffer_full, LINE_MAX - f->out_buffer_full);
+                        k = read(f->master, f->out_buffer + f->out_buffer_start + f->out_buffer_full, room);
                         if (k < 0) {
 
                                 /* Note that EIO on the master device
@@ -269,12 +336,16 @@ static int shovel(PTYForward *f) {
                         }  else {
                                 f->read_from_master = true;
                                 f->out_buffer_full += (size_t) k;
+                                budget = LESS_BY(budget, (size_t) k);
+
+                                if (f->out_buffer_start + f->out_buffer_full >= f->out_buffer_size)
+                                        buffer_grow(&f->out_buffer, &f->out_buffer_size);
                         }
                 }
 
                 if (f->stdout_writable && f->out_buffer_full > 0) {
 
-                        k = write(STDOUT_FILENO, f->out_buffer, f->out_buffer_full);
+                        k = write(STDOUT_FILENO, f->out_buffer + f->out_buffer_start, f->out_buffer_full);
                         if (k < 0) {
 
                                 if (errno == EAGAIN)
@@ -291,13 +362,13 @@ static int shovel(PTYForward *f) {
                         } else {
 
                                 if (k > 0) {
-                                        f->last_char = f->out_buffer[k-1];
+                                        f->last_char = f->out_buffer[f->out_buffer_start + k - 1];
                                         f->last_char_set = true;
                                 }
 
                                 assert(f->out_buffer_full >= (size_t) k);
-                                memmove(f->out_buffer, f->out_buffer + k, f->out_buffer_full - k);
                                 f->out_buffer_full -= k;
+                                f->out_buffer_start = f->out_buffer_full > 0 ? f->out_buffer_start + k : 0;
                         }
                 }
         }
@@ -367,6 +438,16 @@ static int on_stdout_event(sd_event_source *e, int fd, uint32_t revents, void *u
         return shovel(f);
 }
 
+static int on_defer_event(sd_event_source *e, void *userdata) {
+        PTYForward *f = userdata;
+
+        assert(f);
+        assert(e);
+        assert(e == f->defer_event_source);
+
+        return shovel(f);
+}
+
 static int on_sigwinch_event(sd_event_source *e, const struct signalfd_siginfo *si, void *userdata) {
         PTYForward *f = userdata;
         struct winsize ws;
@@ -399,8 +480,15 @@ int pty_forward_new(
         *f = (struct PTYForward) {
                 .flags = flags,
                 .master = -1,
+                .in_buffer_size = BUFFER_SIZE_MIN,
+                .out_buffer_size = BUFFER_SIZE_MIN,
         };
 
+        f->in_buffer = malloc(f->in_buffer_size);
+        f->out_buffer = malloc(f->out_buffer_size);
+        if (!f->in_buffer || !f->out_buffer)
+                return -ENOMEM;
+
         if (event)
                 f->event = sd_event_ref(event);
         else {
@@ -490,6 +578,16 @@ int pty_forward_new(
 
         (void) sd_event_source_set_description(f->sigwinch_event_source, "ptyfwd-sigwinch");
 
+        r = sd_event_add_defer(f->event, &f->defer_event_source, on_defer_event, f);
+        if (r < 0)
+                return r;
+
+        r = sd_event_source_set_enabled(f->defer_event_source, SD_EVENT_OFF);
+        if (r < 0)
+                return r;
+
+        (void) sd_event_source_set_description(f->defer_event_source, "ptyfwd-defer");
+
         *ret = TAKE_PTR(f);
 
         return 0;
@@ -497,6 +595,12 @@ int pty_forward_new(
 
 PTYForward *pty_forward_free(PTYForward *f) {
         pty_forward_disconnect(f);
+
+        if (f) {
+                free(f->in_buffer);
+                free(f->out_buffer);
+        }
+
         return mfree(f);
 }
 
@@ -588,6 +692,10 @@ int pty_forward_set_priority(PTYForward *f, int64_t priority) {
         if (r < 0)
                 return r;
 
+        r = sd_event_source_set_priority(f->defer_event_source, priority);
+        if (r < 0)
+                return r;
+
         return 0;
 }
 
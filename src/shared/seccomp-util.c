@@ -10,7 +10,10 @@
 
 #include "af-list.h"
 #include "alloc-util.h"
+#include "fd-util.h"
+#include "io-util.h"
 #include "macro.h"
+#include "memfd-util.h"
 #include "nsflags.h"
 #include "process-util.h"
 #include "seccomp-util.h"
@@ -959,6 +962,55 @@ int seccomp_load_syscall_filter_set(uint32_t default_action, const SyscallFilter
         return 0;
 }
 
+static int seccomp_build_syscall_filter_set_raw(
+                uint32_t arch,
+                uint32_t default_action,
+                Hashmap* set,
+                uint32_t action,
+                bool log_missing,
+                scmp_filter_ctx *ret) {
+
+        _cleanup_(seccomp_releasep) scmp_filter_ctx seccomp = NULL;
+        Iterator i;
+        void *syscall_id, *val;
+        int r;
+
+        assert(ret);
+
+        log_debug("Operating on architecture: %s", seccomp_arch_to_string(arch));
+
+        r = seccomp_init_for_arch(&seccomp, arch, default_action);
+        if (r < 0)
+                return r;
+
+        HASHMAP_FOREACH_KEY(val, syscall_id, set, i) {
+                uint32_t a = action;
+                int id = PTR_TO_INT(syscall_id) - 1;
+                int error = PTR_TO_INT(val);
+
+                if (action != SCMP_ACT_ALLOW && error >= 0)
+                        a = SCMP_ACT_ERRNO(error);
+
+                r = seccomp_rule_add_exact(seccomp, a, id, 0);
+                if (r < 0) {
+                        /* If the system call is not known on this architecture, then that's fine, let's ignore it */
+                        _cleanup_free_ char *n = NULL;
+                        bool ignore;
+
+                        n = seccomp_syscall_resolve_num_arch(SCMP_ARCH_NATIVE, id);
+                        ignore = r == -EDOM;
+                        if (!ignore || log_missing)
+                                log_debug_errno(r, "Failed to add rule for system call %s() / %d%s: %m",
+                                                strna(n), id, ignore ? ", ignoring" : "");
+                        if (!ignore)
+                                return r;
+                }
+        }
+
+        *ret = TAKE_PTR(seccomp);
+        return 0;
+}
+
 int seccomp_load_syscall_filter_set_raw(uint32_t default_action, Hashmap* set, uint32_t action, bool log_missing) {
         uint32_t arch;
         int r;
@@ -971,39 +1023,11 @@ int seccomp_load_syscall_filter_set_raw(uint32_t default_action, Hashmap* set, u
 
         SECCOMP_FOREACH_LOCAL_ARCH(arch) {
                 _cleanup_(seccomp_releasep) scmp_filter_ctx seccomp = NULL;
-                Iterator i;
-                void *syscall_id, *val;
-
-                log_debug("Operating on architecture: %s", seccomp_arch_to_string(arch));
 
-                r = seccomp_init_for_arch(&seccomp, arch, default_action);
+                r = seccomp_build_syscall_filter_set_raw(arch, default_action, set, action, log_missing, &seccomp);
                 if (r < 0)
                         return r;
 
-                HASHMAP_FOREACH_KEY(val, syscall_id, set, i) {
-                        uint32_t a = action;
-                        int id = PTR_TO_INT(syscall_id) - 1;
-                        int error = PTR_TO_INT(val);
-
-                        if (action != SCMP_ACT_ALLOW && error >= 0)
-                                a = SCMP_ACT_ERRNO(error);
-
-                        r = seccomp_rule_add_exact(seccomp, a, id, 0);
-                        if (r < 0) {
-                                /* If the system call is not known on this architecture, then that's fine, let's ignore it */
-                                _cleanup_free_ char *n = NULL;
-                                bool ignore;
-
-                                n = seccomp_syscall_resolve_num_arch(SCMP_ARCH_NATIVE, id);
-                                ignore = r == -EDOM;
-                                if (!ignore || log_missing)
-                                        log_debug_errno(r, "Failed to add rule for system call %s() / %d%s: %m",
-                                                        strna(n), id, ignore ? ", ignoring" : "");
-                                if (!ignore)
-                                        return r;
-                        }
-                }
-
                 r = seccomp_load(seccomp);
                 if (IN_SET(r, -EPERM, -EACCES))
                         return r;
@@ -1014,6 +1038,129 @@ int seccomp_load_syscall_filter_set_raw(uint32_t default_action, Hashmap* set, u
         return 0;
 }
 
+static int seccomp_export_program(scmp_filter_ctx seccomp, struct sock_fprog *ret) {
+        _cleanup_free_ struct sock_filter *filter = NULL;
+        _cleanup_close_ int fd = -1;
+        uint64_t size;
+        ssize_t n;
+        int r;
+
+        assert(seccomp);
+        assert(ret);
+
+        /* libseccomp can only export BPF into an fd, let's use a memfd for that */
+        fd = memfd_new("seccomp-bpf");
+        if (fd < 0)
+                return fd;
+
+        r = seccomp_export_bpf(seccomp, fd);
+        if (r < 0)
+                return r;
+
+        r = memfd_get_size(fd, &size);
+        if (r < 0)
+                return r;
+
+        if (size == 0 || size % sizeof(struct sock_filter) != 0 || size / sizeof(struct sock_filter) > BPF_MAXINSNS)
+                return -EBADMSG;
+
+        filter = malloc(size);
+        if (!filter)
+                return -ENOMEM;
+
+        n = pread(fd, filter, size, 0);
+        if (n < 0)
+                return -errno;
+        if ((uint64_t) n != size)
+                return -EIO;
+
+        *ret = (struct sock_fprog) {
+                .len = size / sizeof(struct sock_filter),
+                .filter = TAKE_PTR(filter),
+        };
+
+        return 0;
+}
+
+int seccomp_compile_syscall_filter_set_raw(
+                uint32_t default_action,
+                Hashmap* set,
+                uint32_t action,
+                bool log_missing,
+                SeccompCompiledFilter **ret) {
+
+        _cleanup_(seccomp_compiled_filter_freep) SeccompCompiledFilter *f = NULL;
+        uint32_t arch;
+        int r;
+
+        assert(ret);
+
+        /* Like seccomp_load_syscall_filter_set_raw(), but returns the programs to load instead of loading them, so
+         * that they may be loaded into any number of processes with seccomp_load_compiled_filter(). */
+
+        f = new0(SeccompCompiledFilter, 1);
+        if (!f)
+                return -ENOMEM;
+
+        if (hashmap_isempty(set) && default_action == SCMP_ACT_ALLOW) {
+                *ret = TAKE_PTR(f);
+                return 0;
+        }
+
+        SECCOMP_FOREACH_LOCAL_ARCH(arch) {
+                _cleanup_(seccomp_releasep) scmp_filter_ctx seccomp = NULL;
+
+                r = seccomp_build_syscall_filter_set_raw(arch, default_action, set, action, log_missing, &seccomp);
+                if (r < 0)
+                        return r;
+
+                if (!GREEDY_REALLOC(f->programs, f->n_allocated, f->n_programs + 1))
+                        return -ENOMEM;
+
+                r = seccomp_export_program(seccomp, f->programs + f->n_programs);
+                if (r < 0)
+                        return r;
+
+                f->n_programs++;
+        }
+
+        *ret = TAKE_PTR(f);
+        return 0;
+}
+
+int seccomp_load_compiled_filter(const SeccompCompiledFilter *f) {
+        size_t i;
+
+        assert(f);
+
+        /* This is what seccomp_load() ends up doing, given the attributes set by seccomp_init_for_arch() */
+
+        for (i = 0; i < f->n_programs; i++) {
+                if (prctl(PR_SET_SECCOMP, SECCOMP_MODE_FILTER, f->programs + i, 0, 0) >= 0)
+                        continue;
+
+                if (IN_SET(errno, EPERM, EACCES))
+                        return -errno;
+
+                log_debug_errno(errno, "Failed to install compiled filter %zu, skipping: %m", i);
+        }
+
+        return 0;
+}
+
+SeccompCompiledFilter *seccomp_compiled_filter_free(SeccompCompiledFilter *f) {
+        size_t i;
+
+        if (!f)
+                return NULL;
+
+        for (i = 0; i < f->n_programs; i++)
+                free(f->programs[i].filter);
+
+        free(f->programs);
+        return mfree(f);
+}
+
 int seccomp_parse_syscall_filter_full(
                 const char *name,
                 int errno_num,
@@ -1,6 +1,7 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 #pragma once
 
+#include <linux/filter.h>
 #include <seccomp.h>
 #include <stdbool.h>
 #include <stdint.h>
@@ -63,6 +64,18 @@ int seccomp_add_syscall_filter_item(scmp_filter_ctx *ctx, const char *name, uint
 int seccomp_load_syscall_filter_set(uint32_t default_action, const SyscallFilterSet *set, uint32_t action, bool log_missing);
 int seccomp_load_syscall_filter_set_raw(uint32_t default_action, Hashmap* set, uint32_t action, bool log_missing);
 
+/* A filter exported as BPF, one program for each local architecture, so that it can be compiled once and loaded into
+ * many processes */
+typedef struct SeccompCompiledFilter {
+        struct sock_fprog *programs;
+        size_t n_programs, n_allocated;
+} SeccompCompiledFilter;
+
+int seccomp_compile_syscall_filter_set_raw(uint32_t default_action, Hashmap* set, uint32_t action, bool log_missing, SeccompCompiledFilter **ret);
+int seccomp_load_compiled_filter(const SeccompCompiledFilter *f);
+SeccompCompiledFilter *seccomp_compiled_filter_free(SeccompCompiledFilter *f);
+DEFINE_TRIVIAL_CLEANUP_FUNC(SeccompCompiledFilter*, seccomp_compiled_filter_free);
+
 typedef enum SeccompParseFlags {
         SECCOMP_PARSE_INVERT     = 1 << 0,
         SECCOMP_PARSE_WHITELIST  = 1 << 1,
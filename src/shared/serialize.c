@@ -1,5 +1,6 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 
+#include <endian.h>
 #include <sys/mman.h>
 
 #include "alloc-util.h"
@@ -9,27 +10,80 @@
 #include "parse-util.h"
 #include "process-util.h"
 #include "serialize.h"
+#include "sparse-endian.h"
 #include "strv.h"
 #include "tmpfile-util.h"
 
+/* In the binary format every record starts with one of these bytes, which never show up at the beginning of a line
+ * of the text format. This way both formats can be read back by the same code, and the reader does not need to know
+ * in advance which one it gets. */
+#define SERIALIZE_TAG_END 0x1D
+#define SERIALIZE_TAG_LINE 0x1E
+#define SERIALIZE_TAG_HEADER 0x1F
+
+#define SERIALIZE_BINARY_VERSION 1
+
+/* The stream that is currently written in the binary format, if any. Only one serialization is written at a time. */
+static FILE *binary_stream = NULL;
+
+void serialize_begin_binary(FILE *f) {
+        assert(f);
+        assert(!binary_stream);
+
+        fputc(SERIALIZE_TAG_HEADER, f);
+        fputc(SERIALIZE_BINARY_VERSION, f);
+
+        binary_stream = f;
+}
+
+void serialize_end_binary(FILE *f) {
+        assert(f);
+        assert(binary_stream == f);
+
+        binary_stream = NULL;
+}
+
+static void serialize_write(FILE *f, const char *key, size_t key_len, const char *value, size_t value_len) {
+        if (binary_stream == f) {
+                le32_t len;
+
+                /* A record is the tag, the length of the "key=value" string in little endian, and the string
+                 * itself, without any trailing NUL byte. */
+
+                len = htole32(key_len + 1 + value_len);
+
+                fputc(SERIALIZE_TAG_LINE, f);
+                fwrite(&len, sizeof(len), 1, f);
+        }
+
+        fwrite(key, 1, key_len, f);
+        fputc('=', f);
+        fwrite(value, 1, value_len, f);
+
+        if (binary_stream != f)
+                fputc('\n', f);
+}
+
 int serialize_item(FILE *f, const char *key, const char *value) {
+        size_t key_len, value_len;
+
         assert(f);
         assert(key);
 
         if (!value)
                 return 0;
 
+        key_len = strlen(key);
+        value_len = strlen(value);
+
         /* Make sure that anything we serialize we can also read back again with read_line() with a maximum line size
          * of LONG_LINE_MAX. This is a safety net only. All code calling us should filter this out earlier anyway. */
-        if (strlen(key) + 1 + strlen(value) + 1 > LONG_LINE_MAX) {
+        if (key_len + 1 + value_len + 1 > LONG_LINE_MAX) {
                 log_warning("Attempted to serialize overly long item '%s', refusing.", key);
                 return -EINVAL;
         }
 
-        fputs(key, f);
-        fputc('=', f);
-        fputs(value, f);
-        fputc('\n', f);
+        serialize_write(f, key, key_len, value, value_len);
 
         return 1;
 }
@@ -68,14 +122,47 @@ int serialize_item_format(FILE *f, const char *key, const char *format, ...) {
                 return -EINVAL;
         }
 
-        fputs(key, f);
-        fputc('=', f);
-        fputs(buf, f);
-        fputc('\n', f);
+        serialize_write(f, key, strlen(key), buf, k);
 
         return 1;
 }
 
+int serialize_marker(FILE *f, const char *name) {
+        size_t n;
+
+        assert(f);
+        assert(name);
+
+        /* Writes out a line consisting of just the specified name, as used for the start markers of the sections of
+         * the serialization */
+
+        n = strlen(name);
+        if (n + 1 > LONG_LINE_MAX)
+                return -EINVAL;
+
+        if (binary_stream == f) {
+                le32_t len = htole32(n);
+
+                fputc(SERIALIZE_TAG_LINE, f);
+                fwrite(&len, sizeof(len), 1, f);
+                fwrite(name, 1, n, f);
+        } else {
+                fputs(name, f);
+                fputc('\n', f);
+        }
+
+        return 0;
+}
+
+int serialize_end_marker(FILE *f) {
+        assert(f);
+
+        /* The end marker of a section is an empty line */
+
+        fputc(binary_stream == f ? SERIALIZE_TAG_END : '\n', f);
+        return 0;
+}
+
 int serialize_fd(FILE *f, FDSet *fds, const char *key, int fd) {
         int copy;
 
@@ -129,6 +216,79 @@ int serialize_strv(FILE *f, const char *key, char **l) {
         return ret;
 }
 
+int deserialize_read_line(FILE *f, char **ret) {
+        _cleanup_free_ char *line = NULL;
+        le32_t len;
+        size_t n;
+        int c;
+
+        assert(f);
+        assert(ret);
+
+        /* Like read_line() with a limit of LONG_LINE_MAX, but also understands the binary format. In that case the
+         * whole line is read at once, with a single allocation. */
+
+        for (;;) {
+                errno = 0;
+                c = fgetc(f);
+                if (c == EOF) {
+                        if (ferror(f))
+                                return errno > 0 ? -errno : -EIO;
+
+                        *ret = NULL;
+                        return 0;
+                }
+
+                if (c != SERIALIZE_TAG_HEADER)
+                        break;
+
+                c = fgetc(f);
+                if (c == EOF)
+                        return -EBADMSG;
+                if (c != SERIALIZE_BINARY_VERSION)
+                        return log_debug_errno(SYNTHETIC_ERRNO(EPROTONOSUPPORT),
+                                               "Unsupported binary serialization version %i.", c);
+        }
+
+        if (c == SERIALIZE_TAG_END) {
+                line = strdup("");
+                if (!line)
+                        return -ENOMEM;
+
+                *ret = TAKE_PTR(line);
+                return 1;
+        }
+
+        if (c != SERIALIZE_TAG_LINE) {
+                if (ungetc(c, f) == EOF)
+                        return -EIO;
+
+                return read_line(f, LONG_LINE_MAX, ret);
+        }
+
+        if (fread(&len, sizeof(len), 1, f) != 1)
+                return -EBADMSG;
+
+        n = le32toh(len);
+        if (n >= LONG_LINE_MAX)
+                return -ENOBUFS;
+
+        line = new(char, n + 1);
+        if (!line)
+                return -ENOMEM;
+
+        if (fread(line, 1, n, f) != n)
+                return -EBADMSG;
+        line[n] = 0;
+
+        /* Embedded NUL bytes terminate lines in the text format, hence do the same here */
+        if (memchr(line, 0, n))
+                return -EBADMSG;
+
+        *ret = TAKE_PTR(line);
+        return (int) (1 + sizeof(len) + n);
+}
+
 int deserialize_usec(const char *value, usec_t *ret) {
         int r;
 
@@ -1,9 +1,12 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 
+#include <linux/perf_event.h>
 #include <sched.h>
 #include <signal.h>
 #include <stdlib.h>
+#include <sys/ioctl.h>
 #include <sys/mount.h>
+#include <sys/syscall.h>
 #include <sys/wait.h>
 #include <util.h>
 
@@ -16,11 +19,17 @@
 #include "alloc-util.h"
 #include "env-file.h"
 #include "env-util.h"
+#include "fd-util.h"
 #include "fs-util.h"
+#include "json.h"
 #include "log.h"
+#include "parse-util.h"
 #include "path-util.h"
+#include "stdio-util.h"
+#include "string-util.h"
 #include "strv.h"
 #include "tests.h"
+#include "time-util.h"
 
 char* setup_fake_runtime_dir(void) {
         char t[] = "/tmp/fake-xdg-runtime-XXXXXX", *p;
@@ -149,3 +158,192 @@ bool have_namespaces(void) {
 
         assert_not_reached("unexpected exit code");
 }
+
+bool benchmarks_enabled(void) {
+        int r;
+
+        r = getenv_bool("SYSTEMD_BENCHMARK");
+        if (r >= 0)
+                return r;
+
+        if (r != -ENXIO)
+                log_warning_errno(r, "Cannot parse $SYSTEMD_BENCHMARK, ignoring.");
+        return false;
+}
+
+static unsigned benchmark_iterations(void) {
+        const char *e;
+        unsigned n;
+
+        if (!benchmarks_enabled())
+                return 1;
+
+        e = getenv("SYSTEMD_BENCHMARK_ITERATIONS");
+        if (!e)
+                return 5;
+
+        if (safe_atou(e, &n) < 0 || n == 0) {
+                log_warning("Cannot parse $SYSTEMD_BENCHMARK_ITERATIONS, ignoring.");
+                return 5;
+        }
+
+        return n;
+}
+
+/* Hardware counters are often not available: perf_event_paranoid might not allow them, or there is no PMU in a
+ * virtual machine or a container. In that case they are simply not reported. */
+static int perf_counter_open(uint64_t config) {
+        struct perf_event_attr attr = {
+                .type = PERF_TYPE_HARDWARE,
+                .size = sizeof(struct perf_event_attr),
+                .config = config,
+                .disabled = true,
+                .exclude_kernel = true,
+                .exclude_hv = true,
+        };
+        int fd;
+
+        fd = syscall(__NR_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC);
+        if (fd < 0)
+                return -errno;
+
+        return fd;
+}
+
+static void perf_counter_start(int *fd) {
+        if (*fd < 0)
+                return;
+
+        if (ioctl(*fd, PERF_EVENT_IOC_RESET, 0) < 0 ||
+            ioctl(*fd, PERF_EVENT_IOC_ENABLE, 0) < 0)
+                *fd = safe_close(*fd);
+}
+
+static void perf_counter_stop(int *fd, uint64_t *sum) {
+        uint64_t value;
+
+        if (*fd < 0)
+                return;
+
+        if (ioctl(*fd, PERF_EVENT_IOC_DISABLE, 0) < 0 ||
+            read(*fd, &value, sizeof(value)) != sizeof(value)) {
+                *fd = safe_close(*fd);
+                return;
+        }
+
+        *sum += value;
+}
+
+static int nsec_compare(const nsec_t *a, const nsec_t *b) {
+        return CMP(*a, *b);
+}
+
+static void benchmark_write_json(
+                const char *name,
+                unsigned n_iterations,
+                uint64_t n_ops,
+                nsec_t min,
+                nsec_t median,
+                long double cycles,
+                long double instructions) {
+
+        _cleanup_(json_variant_unrefp) JsonVariant *v = NULL;
+        _cleanup_fclose_ FILE *f = NULL;
+        const char *e;
+        int r;
+
+        e = getenv("SYSTEMD_BENCHMARK_JSON");
+        if (isempty(e))
+                return;
+
+        r = json_build(&v, JSON_BUILD_OBJECT(
+                                       JSON_BUILD_PAIR("name", JSON_BUILD_STRING(name)),
+                                       JSON_BUILD_PAIR("iterations", JSON_BUILD_UNSIGNED(n_iterations)),
+                                       JSON_BUILD_PAIR("operations", JSON_BUILD_UNSIGNED(n_ops)),
+                                       JSON_BUILD_PAIR("min_nsec", JSON_BUILD_UNSIGNED(min)),
+                                       JSON_BUILD_PAIR("median_nsec", JSON_BUILD_UNSIGNED(median)),
+                                       JSON_BUILD_PAIR("nsec_per_op", JSON_BUILD_REAL((long double) median / n_ops)),
+                                       JSON_BUILD_PAIR_CONDITION(cycles >= 0, "cycles_per_op", JSON_BUILD_REAL(cycles)),
+                                       JSON_BUILD_PAIR_CONDITION(instructions >= 0, "instructions_per_op", JSON_BUILD_REAL(instructions))));
+        if (r < 0) {
+                log_warning_errno(r, "Failed to build JSON benchmark result, ignoring: %m");
+                return;
+        }
+
+        if (streq(e, "-")) {
+                json_variant_dump(v, JSON_FORMAT_NEWLINE, stdout, NULL);
+                return;
+        }
+
+        f = fopen(e, "ae");
+        if (!f) {
+                log_warning_errno(errno, "Failed to open %s, ignoring: %m", e);
+                return;
+        }
+
+        json_variant_dump(v, JSON_FORMAT_NEWLINE, f, NULL);
+}
+
+void benchmark_run(const char *name, uint64_t n_ops, void (*func)(void *userdata), void *userdata) {
+        _cleanup_close_ int cycles_fd = -1, instructions_fd = -1;
+        uint64_t cycles = 0, instructions = 0;
+        long double cycles_per_op = -1, instructions_per_op = -1;
+        char counters[128] = "";
+        _cleanup_free_ nsec_t *t = NULL;
+        unsigned n, i;
+
+        assert(name);
+        assert(n_ops > 0);
+        assert(func);
+
+        n = benchmark_iterations();
+        assert_se(t = new(nsec_t, n));
+
+        if (benchmarks_enabled()) {
+                /* One run that isn't measured, to fault in memory and warm up caches and branch predictors */
+                func(userdata);
+
+                cycles_fd = perf_counter_open(PERF_COUNT_HW_CPU_CYCLES);
+                instructions_fd = perf_counter_open(PERF_COUNT_HW_INSTRUCTIONS);
+        }
+
+        for (i = 0; i < n; i++) {
+                nsec_t start;
+
+                perf_counter_start(&cycles_fd);
+                perf_counter_start(&instructions_fd);
+
+                start = now_nsec(CLOCK_MONOTONIC);
+                func(userdata);
+                t[i] = now_nsec(CLOCK_MONOTONIC) - start;
+
+                perf_counter_stop(&cycles_fd, &cycles);
+                perf_counter_stop(&instructions_fd, &instructions);
+        }
+
+        typesafe_qsort(t, n, nsec_compare);
+
+        if (cycles_fd >= 0 && instructions_fd >= 0) {
+                cycles_per_op = (long double) cycles / n / n_ops;
+                instructions_per_op = (long double) instructions / n / n_ops;
+
+                xsprintf(counters, ", %.1Lf cycles/op, %.1Lf instructions/op", cycles_per_op, instructions_per_op);
+        }
+
+        if (n > 1)
+                log_info("%s: median %.3fms, min %.3fms of %u iterations, %.1fns/op%s",
+                         name,
+                         (double) t[n / 2] / NSEC_PER_MSEC,
+                         (double) t[0] / NSEC_PER_MSEC,
+                         n,
+                         (double) t[n / 2] / n_ops,
+                         counters);
+        else
+                log_info("%s: %.3fms, %.1fns/op%s",
+                         name,
+                         (double) t[0] / NSEC_PER_MSEC,
+                         (double) t[0] / n_ops,
+                         counters);
+
+        benchmark_write_json(name, n, n_ops, t[0], t[n / 2], cycles_per_op, instructions_per_op);
+}
@@ -2,6 +2,7 @@
 #pragma once
 
 #include <stdbool.h>
+#include <stdint.h>
 
 char* setup_fake_runtime_dir(void);
 const char* get_testdata_dir(void);
@@ -12,3 +13,10 @@ int log_tests_skipped(const char *message);
 int log_tests_skipped_errno(int r, const char *message);
 
 bool have_namespaces(void);
+
+/* Runs func(), which is expected to do n_ops operations, and logs how long it took. With $SYSTEMD_BENCHMARK=1 this
+ * is preceded by a warmup run and repeated $SYSTEMD_BENCHMARK_ITERATIONS times (5 by default), and hardware
+ * counters are read if they are available. If $SYSTEMD_BENCHMARK_JSON is set to a path (or "-" for stdout),
+ * the result is also appended to it as a line of JSON. */
+bool benchmarks_enabled(void);
+void benchmark_run(const char *name, uint64_t n_ops, void (*func)(void *userdata), void *userdata);
@@ -17,6 +17,7 @@
 
 #include "alloc-util.h"
 #include "fd-util.h"
+#include "in-addr-util.h"
 #include "log.h"
 #include "main-func.h"
 #include "parse-util.h"
@@ -377,7 +378,9 @@ static int resolve_remote(Connection *c) {
 
         union sockaddr_union sa = {};
         const char *node, *service;
-        int r;
+        union in_addr_union a;
+        uint16_t port;
+        int r, family;
 
         if (IN_SET(arg_remote_host[0], '/', '@')) {
                 int salen;
@@ -400,6 +403,30 @@ static int resolve_remote(Connection *c) {
                 service = "80";
         }
 
+        /* Numeric addresses need no resolving, hence connect right-away without a round trip through the
+         * resolver thread for each connection. */
+        if (in_addr_from_string_auto(node, &family, &a) >= 0 &&
+            parse_ip_port(service, &port) >= 0) {
+
+                if (family == AF_INET) {
+                        sa.in = (struct sockaddr_in) {
+                                .sin_family = AF_INET,
+                                .sin_port = htobe16(port),
+                                .sin_addr = a.in,
+                        };
+
+                        return connection_start(c, &sa.sa, sizeof(sa.in));
+                }
+
+                sa.in6 = (struct sockaddr_in6) {
+                        .sin6_family = AF_INET6,
+                        .sin6_port = htobe16(port),
+                        .sin6_addr = a.in6,
+                };
+
+                return connection_start(c, &sa.sa, sizeof(sa.in6));
+        }
+
         log_debug("Looking up address info for %s:%s", node, service);
         r = sd_resolve_getaddrinfo(c->context->resolve, &c->resolve_query, node, service, &hints, resolve_cb, c);
         if (r < 0) {
@@ -1,6 +1,7 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 
 #include <errno.h>
+#include <fcntl.h>
 #include <getopt.h>
 #include <poll.h>
 #include <stddef.h>
@@ -14,14 +15,20 @@
 #include "build.h"
 #include "bus-internal.h"
 #include "bus-util.h"
+#include "fd-util.h"
+#include "io-util.h"
 #include "log.h"
 #include "main-func.h"
 #include "util.h"
 
 #define DEFAULT_BUS_PATH "unix:path=/run/dbus/system_bus_socket"
 
+/* How much to move from one side to the other in one go, when passing through the raw data */
+#define RELAY_SIZE (64U*1024U)
+
 static const char *arg_bus_path = DEFAULT_BUS_PATH;
 static BusTransport arg_transport = BUS_TRANSPORT_LOCAL;
+static bool arg_parse = false;
 
 static int help(void) {
 
@@ -30,7 +37,9 @@ static int help(void) {
                "  -h --help              Show this help\n"
                "     --version           Show package version\n"
                "  -p --bus-path=PATH     Path to the kernel bus (default: %s)\n"
-               "  -M --machine=MACHINE   Name of machine to connect to\n",
+               "  -M --machine=MACHINE   Name of machine to connect to\n"
+               "     --parse             Parse and resend every message, instead of passing\n"
+               "                         through the data once authentication is complete\n",
                program_invocation_short_name, DEFAULT_BUS_PATH);
 
         return 0;
@@ -41,6 +50,7 @@ static int parse_argv(int argc, char *argv[]) {
         enum {
                 ARG_VERSION = 0x100,
                 ARG_MACHINE,
+                ARG_PARSE,
         };
 
         static const struct option options[] = {
@@ -48,6 +58,7 @@ static int parse_argv(int argc, char *argv[]) {
                 { "version",         no_argument,       NULL, ARG_VERSION },
                 { "bus-path",        required_argument, NULL, 'p'         },
                 { "machine",         required_argument, NULL, 'M'         },
+                { "parse",           no_argument,       NULL, ARG_PARSE   },
                 {},
         };
 
@@ -81,6 +92,11 @@ static int parse_argv(int argc, char *argv[]) {
                         arg_transport = BUS_TRANSPORT_MACHINE;
 
                         break;
+
+                case ARG_PARSE:
+                        arg_parse = true;
+                        break;
+
                 default:
                         return log_error_errno(SYNTHETIC_ERRNO(EINVAL),
                                                "Unknown option code %c", c);
@@ -90,6 +106,205 @@ static int parse_argv(int argc, char *argv[]) {
         return 1;
 }
 
+typedef struct Relay {
+        int in_fd, out_fd;
+        int pipe[2];  /* the data is splice()d through this pipe */
+        char *buffer; /* used instead, if splice() does not work with the fds */
+        size_t pending;
+        bool eof;
+} Relay;
+
+static int relay_fallback(Relay *r) {
+        ssize_t n;
+
+        assert(r);
+
+        /* splice() is not supported by one of the fds, let's copy the data through a buffer instead, starting
+         * with what's already in the pipe. */
+
+        r->buffer = malloc(RELAY_SIZE);
+        if (!r->buffer)
+                return -ENOMEM;
+
+        if (r->pending > 0) {
+                n = read(r->pipe[0], r->buffer, r->pending);
+                if (n < 0)
+                        return -errno;
+                if ((size_t) n != r->pending)
+                        return -EIO;
+        }
+
+        safe_close_pair(r->pipe);
+        return 0;
+}
+
+static int relay_read(Relay *r) {
+        ssize_t n;
+        int k;
+
+        assert(r);
+        assert(r->pending == 0);
+
+        if (r->buffer)
+                n = read(r->in_fd, r->buffer, RELAY_SIZE);
+        else {
+                n = splice(r->in_fd, NULL, r->pipe[1], NULL, RELAY_SIZE, SPLICE_F_MOVE|SPLICE_F_NONBLOCK);
+                if (n < 0 && errno == EINVAL) {
+                        k = relay_fallback(r);
+                        if (k < 0)
+                                return k;
+
+                        return relay_read(r);
+                }
+        }
+        if (n < 0)
+                return errno == EAGAIN ? 0 : -errno;
+        if (n == 0)
+                r->eof = true;
+
+        r->pending = n;
+        return n > 0;
+}
+
+static int relay_write(Relay *r) {
+        ssize_t n;
+        int k;
+
+        assert(r);
+        assert(r->pending > 0);
+
+        if (r->buffer) {
+                n = write(r->out_fd, r->buffer, r->pending);
+                if (n > 0)
+                        memmove(r->buffer, r->buffer + n, r->pending - n);
+        } else {
+                n = splice(r->pipe[0], NULL, r->out_fd, NULL, r->pending, SPLICE_F_MOVE|SPLICE_F_NONBLOCK);
+                if (n < 0 && errno == EINVAL) {
+                        k = relay_fallback(r);
+                        if (k < 0)
+                                return k;
+
+                        return relay_write(r);
+                }
+        }
+        if (n < 0)
+                return errno == EAGAIN ? 0 : -errno;
+
+        r->pending -= n;
+        return n > 0;
+}
+
+static int relay_process(Relay *r) {
+        int k;
+
+        assert(r);
+
+        /* Only read more when everything read before is written, so that we know that EAGAIN from splice()
+         * refers to the input fd, and not to a full pipe. */
+
+        for (;;) {
+                if (r->pending == 0 && !r->eof) {
+                        k = relay_read(r);
+                        if (k < 0)
+                                return k;
+                        if (k == 0)
+                                return 0;
+                }
+
+                if (r->pending == 0)
+                        return 0;
+
+                k = relay_write(r);
+                if (k <= 0)
+                        return k;
+        }
+}
+
+static bool bus_idle(sd_bus *bus) {
+        assert(bus);
+
+        /* Returns true if authentication is complete and nothing is queued, i.e. if what follows on the
+         * connection is just the data of the next messages. */
+
+        return bus->state == BUS_RUNNING &&
+                bus->rqueue_size == 0 &&
+                bus->wqueue_size == 0 &&
+                bus->n_fds == 0;
+}
+
+static int relay(sd_bus *a, sd_bus *b, int in_fd, int out_fd) {
+        Relay relays[2] = {
+                /* From the bus to us */
+                { .in_fd = a->input_fd, .out_fd = out_fd, .pipe = { -1, -1 } },
+                /* From us to the bus */
+                { .in_fd = in_fd, .out_fd = a->output_fd, .pipe = { -1, -1 } },
+        };
+        size_t i;
+        int r;
+
+        /* Data which has already been read by sd-bus isn't parsed yet, so just pass it on before anything else */
+        if (a->rbuffer_size > 0) {
+                r = loop_write(relays[0].out_fd, a->rbuffer, a->rbuffer_size, true);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to write to client: %m");
+        }
+
+        if (b->rbuffer_size > 0) {
+                r = loop_write(relays[1].out_fd, b->rbuffer, b->rbuffer_size, true);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to write to bus: %m");
+        }
+
+        log_debug("Authentication complete, passing through the data.");
+
+        for (i = 0; i < ELEMENTSOF(relays); i++)
+                if (pipe2(relays[i].pipe, O_CLOEXEC|O_NONBLOCK) < 0) {
+                        r = log_error_errno(errno, "Failed to create pipe: %m");
+                        goto finish;
+                }
+
+        for (;;) {
+                struct pollfd p[4];
+                size_t n = 0;
+
+                for (i = 0; i < ELEMENTSOF(relays); i++) {
+                        r = relay_process(relays + i);
+                        if (r < 0) {
+                                /* treat 'connection reset by peer' as clean exit condition */
+                                if (IN_SET(r, -ECONNRESET, -EPIPE))
+                                        r = 0;
+                                else
+                                        log_error_errno(r, "Failed to pass through data: %m");
+                                goto finish;
+                        }
+
+                        /* One side hung up, and everything it sent was passed on */
+                        if (relays[i].eof && relays[i].pending == 0) {
+                                r = 0;
+                                goto finish;
+                        }
+
+                        if (relays[i].pending > 0)
+                                p[n++] = (struct pollfd) { .fd = relays[i].out_fd, .events = POLLOUT };
+                        else
+                                p[n++] = (struct pollfd) { .fd = relays[i].in_fd, .events = POLLIN };
+                }
+
+                if (poll(p, n, -1) < 0) {
+                        r = log_error_errno(errno, "poll() failed: %m");
+                        goto finish;
+                }
+        }
+
+finish:
+        for (i = 0; i < ELEMENTSOF(relays); i++) {
+                safe_close_pair(relays[i].pipe);
+                free(relays[i].buffer);
+        }
+
+        return r;
+}
+
 static int run(int argc, char *argv[]) {
         _cleanup_(sd_bus_unrefp) sd_bus *a = NULL, *b = NULL;
         sd_id128_t server_id;
@@ -200,6 +415,14 @@ static int run(int argc, char *argv[]) {
                 if (r > 0)
                         continue;
 
+                /* Once both sides are set up, and there's nothing in the queues, just pass the data through,
+                 * unless file descriptors may be sent in either direction: they are passed as ancillary data,
+                 * which splice() would drop, hence that only works when handling each message. */
+                if (!arg_parse && bus_idle(a) && bus_idle(b) &&
+                    sd_bus_can_send(a, SD_BUS_TYPE_UNIX_FD) <= 0 &&
+                    sd_bus_can_send(b, SD_BUS_TYPE_UNIX_FD) <= 0)
+                        return relay(a, b, in_fd, out_fd);
+
                 fd = sd_bus_get_fd(a);
                 if (fd < 0)
                         return log_error_errno(fd, "Failed to get fd: %m");
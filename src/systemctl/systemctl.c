@@ -121,6 +121,7 @@ static bool arg_no_wtmp = false;
 static bool arg_no_sync = false;
 static bool arg_no_wall = false;
 static bool arg_no_reload = false;
+static bool arg_incremental = false;
 static bool arg_value = false;
 static bool arg_show_types = false;
 static bool arg_ignore_inhibitors = false;
@@ -4987,8 +4988,9 @@ static const char* const systemctl_show_mode_table[_SYSTEMCTL_SHOW_MODE_MAX] = {
 
 DEFINE_PRIVATE_STRING_TABLE_LOOKUP_FROM_STRING(systemctl_show_mode, SystemctlShowMode);
 
-static int show_one(
+static int show_one_reply(
                 sd_bus *bus,
+                sd_bus_message *reply,
                 const char *path,
                 const char *unit,
                 SystemctlShowMode show_mode,
@@ -5071,7 +5073,6 @@ static int show_one(
                 {}
         };
 
-        _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
         _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
         _cleanup_set_free_ Set *found_properties = NULL;
         _cleanup_(unit_status_info_free) UnitStatusInfo info = {
@@ -5086,22 +5087,23 @@ static int show_one(
                 .ip_ingress_bytes = (uint64_t) -1,
                 .ip_egress_bytes = (uint64_t) -1,
         };
-        char **pp;
+        char **pp, type;
         int r;
 
+        assert(reply);
         assert(path);
         assert(new_line);
 
+        /* The reply is positioned at the properties array, which is either the body of a GetAll() reply, or
+         * follows the unit name in an entry of a GetUnitsProperties() reply. */
+
         log_debug("Showing one %s", path);
 
-        r = bus_map_all_properties(
-                        bus,
-                        "org.freedesktop.systemd1",
-                        path,
+        r = bus_message_map_all_properties(
+                        reply,
                         show_mode == SYSTEMCTL_SHOW_STATUS ? status_map : property_map,
                         BUS_MAP_BOOLEAN_AS_BOOL,
                         &error,
-                        &reply,
                         &info);
         if (r < 0)
                 return log_error_errno(r, "Failed to get properties: %s", bus_error_message(&error, r));
@@ -5134,10 +5136,19 @@ static int show_one(
                 return 0;
         }
 
-        r = sd_bus_message_rewind(reply, true);
+        r = sd_bus_message_rewind(reply, false);
         if (r < 0)
                 return log_error_errno(r, "Failed to rewind: %s", bus_error_message(&error, r));
 
+        r = sd_bus_message_peek_type(reply, &type, NULL);
+        if (r < 0)
+                return bus_log_parse_error(r);
+        if (type == SD_BUS_TYPE_STRING) {
+                r = sd_bus_message_skip(reply, "s");
+                if (r < 0)
+                        return bus_log_parse_error(r);
+        }
+
         r = bus_message_print_all_properties(reply, print_property, arg_properties, arg_value, arg_all, &found_properties);
         if (r < 0)
                 return bus_log_parse_error(r);
@@ -5149,6 +5160,165 @@ static int show_one(
         return 0;
 }
 
+static int show_one(
+                sd_bus *bus,
+                const char *path,
+                const char *unit,
+                SystemctlShowMode show_mode,
+                bool *new_line,
+                bool *ellipsized) {
+
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
+        _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
+        int r;
+
+        assert(path);
+
+        r = sd_bus_call_method(
+                        bus,
+                        "org.freedesktop.systemd1",
+                        path,
+                        "org.freedesktop.DBus.Properties",
+                        "GetAll",
+                        &error,
+                        &reply,
+                        "s", "");
+        if (r < 0)
+                return log_error_errno(r, "Failed to get properties: %s", bus_error_message(&error, r));
+
+        return show_one_reply(bus, reply, path, unit, show_mode, new_line, ellipsized);
+}
+
+/* How many units to ask for with a single GetUnitsProperties() call, so that the reply stays well below the
+ * message size limits of the bus */
+#define SHOW_UNITS_BATCH_MAX 256U
+
+static int show_units_batch(
+                sd_bus *bus,
+                char **names,
+                size_t n_names,
+                SystemctlShowMode show_mode,
+                bool *new_line,
+                bool *ellipsized) {
+
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL, *reply = NULL;
+        _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
+        int r, ret = 0;
+        size_t i;
+
+        r = sd_bus_message_new_method_call(
+                        bus,
+                        &m,
+                        "org.freedesktop.systemd1",
+                        "/org/freedesktop/systemd1",
+                        "org.freedesktop.systemd1.Manager",
+                        "GetUnitsProperties");
+        if (r < 0)
+                return bus_log_create_error(r);
+
+        r = sd_bus_message_open_container(m, 'a', "s");
+        if (r < 0)
+                return bus_log_create_error(r);
+
+        for (i = 0; i < n_names; i++) {
+                r = sd_bus_message_append(m, "s", names[i]);
+                if (r < 0)
+                        return bus_log_create_error(r);
+        }
+
+        r = sd_bus_message_close_container(m);
+        if (r < 0)
+                return bus_log_create_error(r);
+
+        /* Ask for all properties, just like GetAll() */
+        r = sd_bus_message_append_strv(m, NULL);
+        if (r < 0)
+                return bus_log_create_error(r);
+
+        r = sd_bus_call(bus, m, 0, &error, &reply);
+        if (sd_bus_error_has_name(&error, SD_BUS_ERROR_UNKNOWN_METHOD))
+                return -EOPNOTSUPP;
+        if (r < 0)
+                return log_error_errno(r, "Failed to get properties: %s", bus_error_message(&error, r));
+
+        r = sd_bus_message_enter_container(reply, 'a', "(sa{sv})");
+        if (r < 0)
+                return bus_log_parse_error(r);
+
+        while ((r = sd_bus_message_enter_container(reply, 'r', "sa{sv}")) > 0) {
+                _cleanup_free_ char *path = NULL;
+                const char *name;
+
+                r = sd_bus_message_read(reply, "s", &name);
+                if (r < 0)
+                        return bus_log_parse_error(r);
+
+                path = unit_dbus_path_from_name(name);
+                if (!path)
+                        return log_oom();
+
+                r = show_one_reply(bus, reply, path, name, show_mode, new_line, ellipsized);
+                if (r < 0)
+                        return r;
+                if (r > 0 && ret == 0)
+                        ret = r;
+
+                r = sd_bus_message_exit_container(reply);
+                if (r < 0)
+                        return bus_log_parse_error(r);
+        }
+        if (r < 0)
+                return bus_log_parse_error(r);
+
+        r = sd_bus_message_exit_container(reply);
+        if (r < 0)
+                return bus_log_parse_error(r);
+
+        return ret;
+}
+
+static int show_units(
+                sd_bus *bus,
+                char **names,
+                SystemctlShowMode show_mode,
+                bool *new_line,
+                bool *ellipsized) {
+
+        size_t n, i;
+        int r, ret = 0;
+
+        /* Shows the listed units, fetching their properties in batches if the manager supports it, and one by one
+         * otherwise */
+
+        n = strv_length(names);
+
+        for (i = 0; i < n; i += SHOW_UNITS_BATCH_MAX) {
+                r = show_units_batch(bus, names + i, MIN(n - i, SHOW_UNITS_BATCH_MAX), show_mode, new_line, ellipsized);
+                if (r == -EOPNOTSUPP)
+                        break;
+                if (r < 0)
+                        return r;
+                if (r > 0 && ret == 0)
+                        ret = r;
+        }
+
+        for (; i < n; i++) {
+                _cleanup_free_ char *path = NULL;
+
+                path = unit_dbus_path_from_name(names[i]);
+                if (!path)
+                        return log_oom();
+
+                r = show_one(bus, path, names[i], show_mode, new_line, ellipsized);
+                if (r < 0)
+                        return r;
+                if (r > 0 && ret == 0)
+                        ret = r;
+        }
+
+        return ret;
+}
+
 static int get_unit_dbus_path_by_pid(
                 sd_bus *bus,
                 uint32_t pid,
@@ -5190,9 +5360,9 @@ static int show_all(
 
         _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
         _cleanup_free_ UnitInfo *unit_infos = NULL;
-        const UnitInfo *u;
-        unsigned c;
-        int r, ret = 0;
+        _cleanup_free_ char **names = NULL;
+        unsigned c, i;
+        int r;
 
         r = get_unit_list(bus, NULL, NULL, &unit_infos, 0, &reply);
         if (r < 0)
@@ -5204,21 +5374,16 @@ static int show_all(
 
         typesafe_qsort(unit_infos, c, compare_unit_info);
 
-        for (u = unit_infos; u < unit_infos + c; u++) {
-                _cleanup_free_ char *p = NULL;
-
-                p = unit_dbus_path_from_name(u->id);
-                if (!p)
-                        return log_oom();
+        /* The names are owned by the reply message */
+        names = new(char*, c + 1);
+        if (!names)
+                return log_oom();
 
-                r = show_one(bus, p, u->id, SYSTEMCTL_SHOW_STATUS, new_line, ellipsized);
-                if (r < 0)
-                        return r;
-                else if (r > 0 && ret == 0)
-                        ret = r;
-        }
+        for (i = 0; i < c; i++)
+                names[i] = (char*) unit_infos[i].id;
+        names[c] = NULL;
 
-        return ret;
+        return show_units(bus, names, SYSTEMCTL_SHOW_STATUS, new_line, ellipsized);
 }
 
 static int show_system_status(sd_bus *bus) {
@@ -5366,19 +5531,11 @@ static int show(int argc, char *argv[], void *userdata) {
                         if (r < 0)
                                 return log_error_errno(r, "Failed to expand names: %m");
 
-                        STRV_FOREACH(name, names) {
-                                _cleanup_free_ char *path;
-
-                                path = unit_dbus_path_from_name(*name);
-                                if (!path)
-                                        return log_oom();
-
-                                r = show_one(bus, path, *name, show_mode, &new_line, &ellipsized);
-                                if (r < 0)
-                                        return r;
-                                if (r > 0 && ret == 0)
-                                        ret = r;
-                        }
+                        r = show_units(bus, names, show_mode, &new_line, &ellipsized);
+                        if (r < 0)
+                                return r;
+                        if (r > 0 && ret == 0)
+                                ret = r;
                 }
         }
 
@@ -5525,7 +5682,7 @@ static int set_property(int argc, char *argv[], void *userdata) {
 
 static int daemon_reload(int argc, char *argv[], void *userdata) {
         _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
-        _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL, *reply = NULL;
         const char *method;
         sd_bus *bus;
         int r;
@@ -5547,8 +5704,12 @@ static int daemon_reload(int argc, char *argv[], void *userdata) {
                 break;
 
         case ACTION_SYSTEMCTL:
-                method = streq(argv[0], "daemon-reexec") ? "Reexecute" :
-                                     /* "daemon-reload" */ "Reload";
+                if (streq(argv[0], "daemon-reexec"))
+                        method = "Reexecute";
+                else if (streq(argv[0], "daemon-reload") && arg_incremental)
+                        method = "ReloadChangedUnits";
+                else
+                        method = "Reload";
                 break;
 
         default:
@@ -5569,7 +5730,7 @@ static int daemon_reload(int argc, char *argv[], void *userdata) {
          * are timed out after DEFAULT_TIMEOUT_USEC. Let's use twice that time here, so that the generators can have
          * their timeout, and for everything else there's the same time budget in place. */
 
-        r = sd_bus_call(bus, m, DEFAULT_TIMEOUT_USEC * 2, &error, NULL);
+        r = sd_bus_call(bus, m, DEFAULT_TIMEOUT_USEC * 2, &error, &reply);
 
         /* On reexecution, we expect a disconnect, not a reply */
         if (IN_SET(r, -ETIMEDOUT, -ECONNRESET) && streq(method, "Reexecute"))
@@ -5578,6 +5739,19 @@ static int daemon_reload(int argc, char *argv[], void *userdata) {
         if (r < 0 && arg_action == ACTION_SYSTEMCTL)
                 return log_error_errno(r, "Failed to reload daemon: %s", bus_error_message(&error, r));
 
+        if (r >= 0 && streq(method, "ReloadChangedUnits")) {
+                _cleanup_strv_free_ char **reloaded = NULL;
+                char **name;
+
+                r = sd_bus_message_read_strv(reply, &reloaded);
+                if (r < 0)
+                        return bus_log_parse_error(r);
+
+                if (!arg_quiet)
+                        STRV_FOREACH(name, reloaded)
+                                log_info("Reloaded %s.", *name);
+        }
+
         /* Note that for the legacy commands (i.e. those with action != ACTION_SYSTEMCTL) we support fallbacks to the
          * old ways of doing things, hence don't log any error in that case here. */
 
@@ -7187,6 +7361,7 @@ static int systemctl_help(void) {
                "     --no-block       Do not wait until operation finished\n"
                "     --no-wall        Don't send wall message before halt/power-off/reboot\n"
                "     --no-reload      Don't reload daemon after en-/dis-abling unit files\n"
+               "     --incremental    For daemon-reload, only reload changed units\n"
                "     --no-legend      Do not print a legend (column headers and hints)\n"
                "     --no-pager       Do not pipe output into a pager\n"
                "     --no-ask-password\n"
@@ -7480,6 +7655,7 @@ static int systemctl_parse_argv(int argc, char *argv[]) {
                 ARG_NO_WALL,
                 ARG_ROOT,
                 ARG_NO_RELOAD,
+                ARG_INCREMENTAL,
                 ARG_KILL_WHO,
                 ARG_NO_ASK_PASSWORD,
                 ARG_FAILED,
@@ -7525,6 +7701,7 @@ static int systemctl_parse_argv(int argc, char *argv[]) {
                 { "root",                required_argument, NULL, ARG_ROOT                },
                 { "force",               no_argument,       NULL, 'f'                     },
                 { "no-reload",           no_argument,       NULL, ARG_NO_RELOAD           },
+                { "incremental",         no_argument,       NULL, ARG_INCREMENTAL         },
                 { "kill-who",            required_argument, NULL, ARG_KILL_WHO            },
                 { "signal",              required_argument, NULL, 's'                     },
                 { "no-ask-password",     no_argument,       NULL, ARG_NO_ASK_PASSWORD     },
@@ -7744,6 +7921,10 @@ static int systemctl_parse_argv(int argc, char *argv[]) {
                         arg_no_reload = true;
                         break;
 
+                case ARG_INCREMENTAL:
+                        arg_incremental = true;
+                        break;
+
                 case ARG_KILL_WHO:
                         arg_kill_who = optarg;
                         break;
@@ -53,6 +53,8 @@ int sd_dhcp_server_set_emit_router(sd_dhcp_server *server, int enabled);
 int sd_dhcp_server_set_max_lease_time(sd_dhcp_server *server, uint32_t t);
 int sd_dhcp_server_set_default_lease_time(sd_dhcp_server *server, uint32_t t);
 
+int sd_dhcp_server_set_lease_file(sd_dhcp_server *server, const char *path);
+
 int sd_dhcp_server_forcerenew(sd_dhcp_server *server);
 
 _SD_DEFINE_POINTER_CLEANUP_FUNC(sd_dhcp_server, sd_dhcp_server_unref);
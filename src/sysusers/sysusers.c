@@ -75,6 +75,11 @@ static Hashmap *database_by_uid = NULL, *database_by_username = NULL;
 static Hashmap *database_by_gid = NULL, *database_by_groupname = NULL;
 static Set *database_users = NULL, *database_groups = NULL;
 
+/* Results of NSS lookups by numeric ID, mapping to the user or group name, or to the empty string if the ID is not
+ * known. While searching for a free ID for a user and its group of the same name each candidate is checked in both
+ * databases twice, this way NSS (and whatever network service backs it) is asked only once. */
+static Hashmap *nss_by_uid = NULL, *nss_by_gid = NULL;
+
 static uid_t search_uid = UID_INVALID;
 static UidRange *uid_range = NULL;
 static unsigned n_uid_range = 0;
@@ -90,6 +95,8 @@ STATIC_DESTRUCTOR_REGISTER(database_users, set_free_freep);
 STATIC_DESTRUCTOR_REGISTER(database_by_gid, hashmap_freep);
 STATIC_DESTRUCTOR_REGISTER(database_by_groupname, hashmap_freep);
 STATIC_DESTRUCTOR_REGISTER(database_groups, set_free_freep);
+STATIC_DESTRUCTOR_REGISTER(nss_by_uid, hashmap_free_freep);
+STATIC_DESTRUCTOR_REGISTER(nss_by_gid, hashmap_free_freep);
 STATIC_DESTRUCTOR_REGISTER(uid_range, freep);
 STATIC_DESTRUCTOR_REGISTER(arg_root, freep);
 
@@ -819,11 +826,84 @@ static int write_files(void) {
         return 0;
 }
 
+static int nss_cache_name(Hashmap **h, void *key, const char *name, const char **ret) {
+        _cleanup_free_ char *n = NULL;
+        int r;
+
+        n = strdup(strempty(name));
+        if (!n)
+                return -ENOMEM;
+
+        r = hashmap_ensure_allocated(h, NULL);
+        if (r < 0)
+                return r;
+
+        r = hashmap_put(*h, key, n);
+        if (r < 0)
+                return r;
+
+        *ret = TAKE_PTR(n);
+        return 0;
+}
+
+/* Returns 1 and the name if the UID is known to NSS, 0 otherwise */
+static int nss_uid_name(uid_t uid, const char **ret_name) {
+        const char *n;
+        int r;
+
+        n = hashmap_get(nss_by_uid, UID_TO_PTR(uid));
+        if (!n) {
+                struct passwd *p;
+
+                errno = 0;
+                p = getpwuid(uid);
+                if (!p && !IN_SET(errno, 0, ENOENT))
+                        return -errno;
+
+                r = nss_cache_name(&nss_by_uid, UID_TO_PTR(uid), p ? p->pw_name : NULL, &n);
+                if (r < 0)
+                        return r;
+        }
+
+        if (isempty(n))
+                return 0;
+
+        if (ret_name)
+                *ret_name = n;
+        return 1;
+}
+
+/* Returns 1 and the name if the GID is known to NSS, 0 otherwise */
+static int nss_gid_name(gid_t gid, const char **ret_name) {
+        const char *n;
+        int r;
+
+        n = hashmap_get(nss_by_gid, GID_TO_PTR(gid));
+        if (!n) {
+                struct group *g;
+
+                errno = 0;
+                g = getgrgid(gid);
+                if (!g && !IN_SET(errno, 0, ENOENT))
+                        return -errno;
+
+                r = nss_cache_name(&nss_by_gid, GID_TO_PTR(gid), g ? g->gr_name : NULL, &n);
+                if (r < 0)
+                        return r;
+        }
+
+        if (isempty(n))
+                return 0;
+
+        if (ret_name)
+                *ret_name = n;
+        return 1;
+}
+
 static int uid_is_ok(uid_t uid, const char *name, bool check_with_gid) {
-        struct passwd *p;
-        struct group *g;
         const char *n;
         Item *i;
+        int r;
 
         /* Let's see if we already have assigned the UID a second time */
         if (ordered_hashmap_get(todo_uids, UID_TO_PTR(uid)))
@@ -849,21 +929,16 @@ static int uid_is_ok(uid_t uid, const char *name, bool check_with_gid) {
 
         /* Let's also check via NSS, to avoid UID clashes over LDAP and such, just in case */
         if (!arg_root) {
-                errno = 0;
-                p = getpwuid(uid);
-                if (p)
-                        return 0;
-                if (!IN_SET(errno, 0, ENOENT))
-                        return -errno;
+                r = nss_uid_name(uid, NULL);
+                if (r != 0)
+                        return r < 0 ? r : 0;
 
                 if (check_with_gid) {
-                        errno = 0;
-                        g = getgrgid((gid_t) uid);
-                        if (g) {
-                                if (!streq(g->gr_name, name))
-                                        return 0;
-                        } else if (!IN_SET(errno, 0, ENOENT))
-                                return -errno;
+                        r = nss_gid_name((gid_t) uid, &n);
+                        if (r < 0)
+                                return r;
+                        if (r > 0 && !streq(n, name))
+                                return 0;
                 }
         }
 
@@ -1052,8 +1127,7 @@ static int add_user(Item *i) {
 }
 
 static int gid_is_ok(gid_t gid) {
-        struct group *g;
-        struct passwd *p;
+        int r;
 
         if (ordered_hashmap_get(todo_gids, GID_TO_PTR(gid)))
                 return 0;
@@ -1069,19 +1143,13 @@ static int gid_is_ok(gid_t gid) {
                 return 0;
 
         if (!arg_root) {
-                errno = 0;
-                g = getgrgid(gid);
-                if (g)
-                        return 0;
-                if (!IN_SET(errno, 0, ENOENT))
-                        return -errno;
+                r = nss_gid_name(gid, NULL);
+                if (r != 0)
+                        return r < 0 ? r : 0;
 
-                errno = 0;
-                p = getpwuid((uid_t) gid);
-                if (p)
-                        return 0;
-                if (!IN_SET(errno, 0, ENOENT))
-                        return -errno;
+                r = nss_uid_name((uid_t) gid, NULL);
+                if (r != 0)
+                        return r < 0 ? r : 0;
         }
 
         return 1;
@@ -1,19 +1,62 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 
+#include <fcntl.h>
 #include <linux/libbpf.h>
 #include <string.h>
 #include <unistd.h>
 
 #include "bpf-firewall.h"
 #include "bpf-program.h"
+#include "cgroup-util.h"
+#include "fd-util.h"
 #include "load-fragment.h"
 #include "manager.h"
+#include "missing_syscall.h"
 #include "rm-rf.h"
 #include "service.h"
 #include "test-helper.h"
 #include "tests.h"
 #include "unit.h"
 
+static unsigned n_attached(Unit *u, int type) {
+        _cleanup_free_ char *path = NULL;
+        _cleanup_close_ int fd = -1;
+        union bpf_attr attr;
+
+        /* Asks the kernel how many programs are attached to the unit's cgroup right now */
+
+        assert_se(u->cgroup_path);
+        assert_se(cg_get_path(SYSTEMD_CGROUP_CONTROLLER, u->cgroup_path, NULL, &path) >= 0);
+
+        fd = open(path, O_DIRECTORY|O_RDONLY|O_CLOEXEC);
+        assert_se(fd >= 0);
+
+        attr = (union bpf_attr) {
+                .query.target_fd = fd,
+                .query.attach_type = type,
+        };
+
+        assert_se(bpf(BPF_PROG_QUERY, &attr, sizeof(attr)) >= 0);
+        return attr.query.prog_cnt;
+}
+
+static void run_and_check(Manager *m, Unit *u) {
+        assert_se(unit_start(u) >= 0);
+
+        /* The cgroup is set up when the first command is spawned, with the firewall attached */
+        assert_se(n_attached(u, BPF_CGROUP_INET_INGRESS) == 1);
+        assert_se(n_attached(u, BPF_CGROUP_INET_EGRESS) == 1);
+
+        while (!IN_SET(SERVICE(u)->state, SERVICE_DEAD, SERVICE_FAILED))
+                assert_se(sd_event_run(m->event, UINT64_MAX) >= 0);
+
+        assert_se(SERVICE(u)->exec_command[SERVICE_EXEC_START]->exec_status.code == CLD_EXITED &&
+                  SERVICE(u)->exec_command[SERVICE_EXEC_START]->exec_status.status == EXIT_SUCCESS);
+
+        assert_se(SERVICE(u)->exec_command[SERVICE_EXEC_START]->command_next->exec_status.code != CLD_EXITED ||
+                  SERVICE(u)->exec_command[SERVICE_EXEC_START]->command_next->exec_status.status != EXIT_SUCCESS);
+}
+
 int main(int argc, char *argv[]) {
         struct bpf_insn exit_insn[] = {
                 BPF_MOV64_IMM(BPF_REG_0, 1),
@@ -22,9 +65,10 @@ int main(int argc, char *argv[]) {
 
         _cleanup_(rm_rf_physical_and_freep) char *runtime_dir = NULL;
         CGroupContext *cc = NULL;
-        _cleanup_(bpf_program_unrefp) BPFProgram *p = NULL;
+        _cleanup_(bpf_program_unrefp) BPFProgram *p = NULL, *q = NULL;
         _cleanup_(manager_freep) Manager *m = NULL;
         Unit *u;
+        Hashmap *programs = NULL;
         char log_buf[65535];
         int r;
 
@@ -61,6 +105,28 @@ int main(int argc, char *argv[]) {
 
         p = bpf_program_unref(p);
 
+        /* Programs with the same instructions share their kernel object if loaded through the same cache, and it
+         * goes away with the last of them */
+        r = bpf_program_new(BPF_PROG_TYPE_CGROUP_SKB, &p);
+        assert_se(r == 0);
+        assert_se(bpf_program_add_instructions(p, exit_insn, ELEMENTSOF(exit_insn)) == 0);
+        r = bpf_program_new(BPF_PROG_TYPE_CGROUP_SKB, &q);
+        assert_se(r == 0);
+        assert_se(bpf_program_add_instructions(q, exit_insn, ELEMENTSOF(exit_insn)) == 0);
+        assert_se(bpf_program_equal(p, q));
+
+        assert_se(bpf_program_load_kernel_shared(p, &programs) >= 0);
+        assert_se(bpf_program_load_kernel_shared(q, &programs) >= 0);
+        assert_se(p->shared && p->shared == q->shared);
+        assert_se(p->kernel_fd >= 0 && q->kernel_fd >= 0 && p->kernel_fd != q->kernel_fd);
+        assert_se(hashmap_size(programs) == 1);
+
+        p = bpf_program_unref(p);
+        assert_se(hashmap_size(programs) == 1);
+        q = bpf_program_unref(q);
+        assert_se(hashmap_isempty(programs));
+        programs = hashmap_free(programs);
+
         /* The simple tests suceeded. Now let's try full unit-based use-case. */
 
         assert_se(manager_new(UNIT_FILE_USER, MANAGER_TEST_RUN_BASIC, &m) >= 0);
@@ -127,16 +193,24 @@ int main(int argc, char *argv[]) {
 
         assert(r >= 0);
 
-        assert_se(unit_start(u) >= 0);
+        /* Compiling again without any changes keeps the programs */
+        p = bpf_program_ref(u->ip_bpf_ingress);
+        q = bpf_program_ref(u->ip_bpf_egress);
+        assert_se(bpf_firewall_compile(u) >= 0);
+        assert_se(u->ip_bpf_ingress == p);
+        assert_se(u->ip_bpf_egress == q);
+        p = bpf_program_unref(p);
+        q = bpf_program_unref(q);
 
-        while (!IN_SET(SERVICE(u)->state, SERVICE_DEAD, SERVICE_FAILED))
-                assert_se(sd_event_run(m->event, UINT64_MAX) >= 0);
+        run_and_check(m, u);
 
-        assert_se(SERVICE(u)->exec_command[SERVICE_EXEC_START]->exec_status.code == CLD_EXITED &&
-                  SERVICE(u)->exec_command[SERVICE_EXEC_START]->exec_status.status == EXIT_SUCCESS);
+        /* The cgroup was removed when the unit stopped, and the programs with it */
+        assert_se(!u->cgroup_path);
+        assert_se(!u->ip_bpf_ingress_installed && !u->ip_bpf_egress_installed);
 
-        assert_se(SERVICE(u)->exec_command[SERVICE_EXEC_START]->command_next->exec_status.code != CLD_EXITED ||
-                  SERVICE(u)->exec_command[SERVICE_EXEC_START]->command_next->exec_status.status != EXIT_SUCCESS);
+        /* On the next start the cgroup is created again at the same path, and the firewall must be attached to
+         * it again, not just assumed to be still in place */
+        run_and_check(m, u);
 
         return 0;
 }
@@ -116,6 +116,63 @@ static void test_hourly_bug_4031(void) {
         calendar_spec_free(c);
 }
 
+static void test_next_fast(const char *input, const char *new_tz) {
+        _cleanup_(calendar_spec_freep) CalendarSpec *fast = NULL, *slow = NULL;
+        _cleanup_free_ char *p = NULL, *q = NULL;
+        char buf[FORMAT_TIMESPAN_MAX];
+        usec_t u, x, y, start, t_fast = 0, t_slow = 0;
+        unsigned n = 0;
+        char *old_tz, *d;
+        int r, k;
+
+        old_tz = getenv("TZ");
+        if (old_tz)
+                old_tz = strdupa(old_tz);
+
+        if (new_tz)
+                assert_se(setenv("TZ", new_tz, 1) >= 0);
+        else
+                assert_se(unsetenv("TZ") >= 0);
+        tzset();
+
+        /* Specifications that only constrain the time of day and the weekday are solved arithmetically. Compare
+         * with an equivalent specification that has to step through the candidate times, because the year range
+         * doesn't qualify for that: for a sweep of start times over two years, including the changes of daylight
+         * saving time, both must always agree. Also time both, as a microbenchmark. */
+
+        assert_se(calendar_spec_from_string(input, &fast) >= 0);
+        assert_se(calendar_spec_to_string(fast, &p) >= 0);
+        assert_se(d = strchr(p, '-'));
+        assert_se(q = strjoin(strndupa(p, d - p - 1), "1970..2199", d));
+        assert_se(calendar_spec_from_string(q, &slow) >= 0);
+
+        printf("\"%s\" vs. \"%s\" (TZ=%s)\n", p, q, strnull(new_tz));
+
+        for (u = 1483228800000000; u < 1546300800000000; u += 13 * USEC_PER_HOUR + 17 * USEC_PER_MINUTE + 42) {
+                start = now(CLOCK_MONOTONIC);
+                r = calendar_spec_next_usec(fast, u, &x);
+                t_fast += now(CLOCK_MONOTONIC) - start;
+
+                start = now(CLOCK_MONOTONIC);
+                k = calendar_spec_next_usec(slow, u, &y);
+                t_slow += now(CLOCK_MONOTONIC) - start;
+
+                assert_se(r == k);
+                assert_se(r < 0 || x == y);
+                assert_se(r < 0 || x > u);
+                n++;
+        }
+
+        printf("%u iterations: %s", n, format_timespan(buf, sizeof(buf), t_fast, 1));
+        printf(" vs. %s\n", format_timespan(buf, sizeof(buf), t_slow, 1));
+
+        if (old_tz)
+                assert_se(setenv("TZ", old_tz, 1) >= 0);
+        else
+                assert_se(unsetenv("TZ") >= 0);
+        tzset();
+}
+
 int main(int argc, char* argv[]) {
         CalendarSpec *c;
 
@@ -246,5 +303,13 @@ int main(int argc, char* argv[]) {
         test_timestamp();
         test_hourly_bug_4031();
 
+        test_next_fast("daily", "");
+        test_next_fast("hourly", "Europe/Berlin");
+        test_next_fast("*:0/7:30.5", "America/New_York");
+        test_next_fast("02:30", "Europe/Berlin");
+        test_next_fast("Mon..Fri 9,17:00", "Pacific/Auckland");
+        test_next_fast("Sat,Sun 01:15 UTC", "EET");
+        test_next_fast("*:*:20..40/5", "Australia/Lord_Howe");
+
         return 0;
 }
@@ -447,6 +447,37 @@ static void test_cg_get_keyed_attribute(void) {
         }
 }
 
+static void test_cg_read_pids(void) {
+        _cleanup_free_ char *path = NULL;
+        _cleanup_free_ pid_t *pids = NULL;
+        bool found = false;
+        size_t n, i;
+        int r;
+
+        r = cg_pid_get_path(SYSTEMD_CGROUP_CONTROLLER, 0, &path);
+        if (r < 0) {
+                log_info_errno(r, "Skipping %s, cannot determine own cgroup: %m", __func__);
+                return;
+        }
+
+        r = cg_read_pids(SYSTEMD_CGROUP_CONTROLLER, path, &pids, &n);
+        if (r < 0) {
+                log_info_errno(r, "Skipping %s, cannot read processes of %s: %m", __func__, path);
+                return;
+        }
+
+        log_info("%s contains %zu processes", path, n);
+
+        for (i = 0; i < n; i++) {
+                assert_se(pids[i] > 0);
+
+                if (pids[i] == getpid_cached())
+                        found = true;
+        }
+
+        assert_se(found);
+}
+
 int main(void) {
         test_setup_logging(LOG_DEBUG);
 
@@ -471,6 +502,7 @@ int main(void) {
         test_is_wanted();
         test_cg_tests();
         test_cg_get_keyed_attribute();
+        test_cg_read_pids();
 
         return 0;
 }
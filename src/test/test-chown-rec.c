@@ -146,6 +146,47 @@ static void test_chown_recursive(void) {
         assert_se(!has_xattr(p));
 }
 
+static void test_chown_recursive_marker(void) {
+        _cleanup_(rm_rf_physical_and_freep) char *t = NULL;
+        char buf[64];
+        struct stat st;
+        const char *p;
+        ssize_t l;
+
+        assert_se(mkdtemp_malloc(NULL, &t) >= 0);
+
+        p = strjoina(t, "/reg");
+        assert_se(mknod(p, S_IFREG|0644, 0) >= 0);
+
+        assert_se(path_chown_recursive(t, 1, 2) >= 0);
+
+        l = getxattr(t, "trusted.systemd.chown", buf, sizeof(buf));
+        if (l < 0 && IN_SET(errno, EOPNOTSUPP, ENOTTY, ENODATA, ENOSYS)) {
+                log_info("File system does not support trusted extended attributes, skipping marker test.");
+                return;
+        }
+        assert_se(l == STRLEN("1:2") && memcmp(buf, "1:2", l) == 0);
+
+        /* With the marker in place, the tree is not looked at again */
+        assert_se(lchown(p, 0, 0) >= 0);
+        assert_se(path_chown_recursive(t, 1, 2) == 0);
+        assert_se(lstat(p, &st) >= 0);
+        assert_se(st.st_uid == 0 && st.st_gid == 0);
+
+        /* Without it, it is */
+        assert_se(removexattr(t, "trusted.systemd.chown") >= 0);
+        assert_se(path_chown_recursive(t, 1, 2) > 0);
+        assert_se(lstat(p, &st) >= 0);
+        assert_se(st.st_uid == 1 && st.st_gid == 2);
+
+        /* And so it is if the owner changes */
+        assert_se(path_chown_recursive(t, 3, 4) > 0);
+        assert_se(lstat(p, &st) >= 0);
+        assert_se(st.st_uid == 3 && st.st_gid == 4);
+        l = getxattr(t, "trusted.systemd.chown", buf, sizeof(buf));
+        assert_se(l == STRLEN("3:4") && memcmp(buf, "3:4", l) == 0);
+}
+
 int main(int argc, char *argv[]) {
         test_setup_logging(LOG_DEBUG);
 
@@ -153,6 +194,7 @@ int main(int argc, char *argv[]) {
                 return log_tests_skipped("not running as root");
 
         test_chown_recursive();
+        test_chown_recursive_marker();
 
         return EXIT_SUCCESS;
 }
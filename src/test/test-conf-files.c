@@ -5,6 +5,7 @@
 
 #include <stdarg.h>
 #include <stdio.h>
+#include <sys/stat.h>
 
 #include "alloc-util.h"
 #include "conf-files.h"
@@ -93,10 +94,61 @@ static void test_conf_files_list(bool use_root) {
         assert_se(rm_rf(tmp_dir, REMOVE_ROOT|REMOVE_PHYSICAL) == 0);
 }
 
+static void test_conf_files_cache(void) {
+        char tmp_dir[] = "/tmp/test-conf-files-cache-XXXXXX";
+        _cleanup_strv_free_ char **found_files = NULL;
+        struct timespec ts[2] = {
+                { .tv_sec = 1 },
+                { .tv_sec = 1 },
+        };
+        const char *dir, *b;
+
+        log_debug("/* %s */", __func__);
+
+        setup_test_dir(tmp_dir,
+                       "/dir/a.conf",
+                       NULL);
+
+        dir = strjoina(tmp_dir, "/dir");
+        b = strjoina(dir, "/b.conf");
+
+        conf_files_cache_set_enabled(true);
+
+        /* A directory modified just now is listed again */
+        assert_se(conf_files_list(&found_files, ".conf", NULL, 0, dir, NULL) == 0);
+        assert_se(strv_length(found_files) == 1);
+        found_files = strv_free(found_files);
+
+        assert_se(write_string_file(b, "foobar", WRITE_STRING_FILE_CREATE) >= 0);
+        assert_se(conf_files_list(&found_files, ".conf", NULL, 0, dir, NULL) == 0);
+        assert_se(strv_length(found_files) == 2);
+        found_files = strv_free(found_files);
+
+        /* An old one is served from the cache, until its modification time changes */
+        assert_se(utimensat(AT_FDCWD, dir, ts, 0) >= 0);
+        assert_se(conf_files_list(&found_files, ".conf", NULL, 0, dir, NULL) == 0);
+        assert_se(strv_length(found_files) == 2);
+        found_files = strv_free(found_files);
+
+        assert_se(conf_files_list(&found_files, ".conf", NULL, 0, dir, NULL) == 0);
+        assert_se(strv_length(found_files) == 2);
+        found_files = strv_free(found_files);
+
+        assert_se(unlink(b) >= 0);
+        assert_se(conf_files_list(&found_files, ".conf", NULL, 0, dir, NULL) == 0);
+        assert_se(strv_length(found_files) == 1);
+        found_files = strv_free(found_files);
+
+        conf_files_cache_set_enabled(false);
+
+        assert_se(rm_rf(tmp_dir, REMOVE_ROOT|REMOVE_PHYSICAL) == 0);
+}
+
 int main(int argc, char **argv) {
         test_setup_logging(LOG_DEBUG);
 
         test_conf_files_list(false);
         test_conf_files_list(true);
+        test_conf_files_cache();
         return 0;
 }
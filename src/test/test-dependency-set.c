@@ -0,0 +1,122 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include "dependency-set.h"
+#include "macro.h"
+#include "tests.h"
+
+/* The set never dereferences its keys, hence any distinct pointers will do */
+static char units[DEPENDENCY_SET_ARRAY_MAX * 2];
+#define UNIT_N(n) ((Unit*) (units + (n)))
+
+static void test_dependency_set_basic(void) {
+        DependencySet *s = NULL;
+        unsigned k;
+
+        assert_se(dependency_set_isempty(s));
+        assert_se(!dependency_set_get(s, UNIT_N(0)));
+        assert_se(!dependency_set_remove(s, UNIT_N(0)));
+        assert_se(dependency_set_update(s, UNIT_N(0), INT_TO_PTR(1)) == -ENOENT);
+        assert_se(dependency_set_memory_usage(s) == 0);
+
+        assert_se(dependency_set_put(&s, UNIT_N(0), INT_TO_PTR(1)) == 1);
+        assert_se(dependency_set_put(&s, UNIT_N(0), INT_TO_PTR(1)) == 0);
+        assert_se(dependency_set_put(&s, UNIT_N(0), INT_TO_PTR(2)) == -EEXIST);
+        assert_se(dependency_set_update(s, UNIT_N(0), INT_TO_PTR(2)) == 0);
+        assert_se(PTR_TO_INT(dependency_set_get(s, UNIT_N(0))) == 2);
+        assert_se(dependency_set_first_key(s) == UNIT_N(0));
+
+        /* Fill the array, and then go beyond, which promotes the set to a hashmap */
+        for (k = 1; k < ELEMENTSOF(units); k++) {
+                assert_se(dependency_set_put(&s, UNIT_N(k), INT_TO_PTR(k + 1)) == 1);
+                assert_se(!s->hashmap == (k < DEPENDENCY_SET_ARRAY_MAX));
+                assert_se(dependency_set_size(s) == k + 1);
+        }
+
+        for (k = 0; k < ELEMENTSOF(units); k++)
+                assert_se(PTR_TO_INT(dependency_set_get(s, UNIT_N(k))) == (int) k + 1 + (k == 0));
+
+        assert_se(dependency_set_memory_usage(s) > sizeof(DependencySet));
+
+        s = dependency_set_free(s);
+        assert_se(!s);
+}
+
+static void test_dependency_set_iterate_remove(void) {
+        DependencySet *s = NULL;
+        unsigned k, n = 0;
+        Iterator i;
+        Unit *u;
+        void *v;
+
+        for (k = 0; k < 5; k++)
+                assert_se(dependency_set_put(&s, UNIT_N(k), INT_TO_PTR(k + 1)) == 1);
+        assert_se(!s->hashmap);
+
+        /* Removing the current entry while iterating must not skip the next one */
+        DEPENDENCY_SET_FOREACH(v, u, s, i) {
+                assert_se(u == UNIT_N(n));
+                assert_se(PTR_TO_INT(v) == (int) n + 1);
+                n++;
+
+                if (u == UNIT_N(1) || u == UNIT_N(2))
+                        assert_se(dependency_set_remove(s, u) == v);
+        }
+
+        assert_se(n == 5);
+        assert_se(dependency_set_size(s) == 3);
+        assert_se(!dependency_set_contains(s, UNIT_N(1)));
+        assert_se(!dependency_set_contains(s, UNIT_N(2)));
+
+        /* Replacing a key drops the entry of the new key, if there is one */
+        assert_se(dependency_set_remove_and_replace(s, UNIT_N(0), UNIT_N(4), INT_TO_PTR(7)) == 0);
+        assert_se(dependency_set_size(s) == 2);
+        assert_se(!dependency_set_contains(s, UNIT_N(0)));
+        assert_se(PTR_TO_INT(dependency_set_get(s, UNIT_N(4))) == 7);
+        assert_se(dependency_set_remove_and_replace(s, UNIT_N(0), UNIT_N(1), INT_TO_PTR(7)) == -ENOENT);
+
+        dependency_set_free(s);
+}
+
+static void test_dependency_set_complete_move(bool promote) {
+        DependencySet *a = NULL, *b = NULL;
+        unsigned k, n_b;
+
+        log_info("/* %s(%s) */", __func__, yes_no(promote));
+
+        /* The second set overlaps the first one in one entry, and the entry of the first one wins */
+        for (k = 0; k < 3; k++)
+                assert_se(dependency_set_put(&a, UNIT_N(k), INT_TO_PTR(1)) == 1);
+        n_b = promote ? ELEMENTSOF(units) - 2 : 4;
+        for (k = 2; k < 2 + n_b; k++)
+                assert_se(dependency_set_put(&b, UNIT_N(k), INT_TO_PTR(2)) == 1);
+
+        assert_se(dependency_set_reserve(&a, n_b - 1) >= 0);
+        assert_se(!a->hashmap == !promote);
+        assert_se(dependency_set_complete_move(&a, &b) == 0);
+
+        assert_se(dependency_set_size(a) == 2 + n_b);
+        assert_se(PTR_TO_INT(dependency_set_get(a, UNIT_N(2))) == 1);
+        assert_se(PTR_TO_INT(dependency_set_get(a, UNIT_N(3))) == 2);
+        assert_se(dependency_set_size(b) == 1);
+        assert_se(PTR_TO_INT(dependency_set_get(b, UNIT_N(2))) == 2);
+
+        b = dependency_set_free(b);
+
+        /* Moving into an empty set takes over the other set as a whole */
+        assert_se(dependency_set_complete_move(&b, &a) == 0);
+        assert_se(!a);
+        assert_se(dependency_set_size(b) == 2 + n_b);
+
+        dependency_set_free(b);
+}
+
+int main(int argc, char *argv[]) {
+        test_setup_logging(LOG_DEBUG);
+
+        test_dependency_set_basic();
+        test_dependency_set_iterate_remove();
+        test_dependency_set_complete_move(false);
+        test_dependency_set_complete_move(true);
+
+        return 0;
+}
@@ -1,14 +1,326 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 
 #include <errno.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/stat.h>
 
+#include "alloc-util.h"
 #include "bus-util.h"
+#include "fileio.h"
 #include "manager.h"
+#include "path-util.h"
 #include "rm-rf.h"
+#include "service.h"
+#include "stdio-util.h"
+#include "string-util.h"
+#include "strv.h"
+#include "target.h"
 #include "test-helper.h"
 #include "tests.h"
+#include "tmpfile-util.h"
+
+static void test_large_transaction(unsigned n_units) {
+        _cleanup_(rm_rf_physical_and_freep) char *unit_dir = NULL;
+        _cleanup_(sd_bus_error_free) sd_bus_error err = SD_BUS_ERROR_NULL;
+        _cleanup_(manager_freep) Manager *m = NULL;
+        char timespan[FORMAT_TIMESPAN_MAX], buf_a[DECIMAL_STR_MAX(unsigned)], buf_b[DECIMAL_STR_MAX(unsigned)];
+        usec_t start;
+        unsigned k;
+        Unit *root, *a, *b;
+        Job *j;
+        int r;
+
+        assert_se(n_units >= 3);
+
+        log_info("/* %s(%u) */", __func__, n_units);
+
+        /* Builds a synthetic graph: every unit wants up to two children, which are ordered before it, and in
+         * addition all units are ordered in one long chain, so that the ordering graph is as deep as it is large.
+         * The two last units form an ordering cycle, which is fixable since neither of them matters to the
+         * anchor. */
+
+        assert_se(mkdtemp_malloc("/tmp/test-engine-units.XXXXXX", &unit_dir) >= 0);
+
+        for (k = 0; k < n_units; k++) {
+                _cleanup_free_ char *path = NULL, *contents = NULL;
+                char buf[DECIMAL_STR_MAX(unsigned)];
+                unsigned c;
+
+                assert_se(contents = strdup("[Unit]\nDefaultDependencies=no\n"));
+
+                for (c = 2 * k + 1; c <= 2 * k + 2 && c < n_units; c++) {
+                        xsprintf(buf, "%u", c);
+                        assert_se(strextend(&contents,
+                                            "Wants=bench-", buf, ".service\n",
+                                            "After=bench-", buf, ".service\n", NULL));
+                }
+
+                if (k + 1 < n_units) {
+                        xsprintf(buf, "%u", k + 1);
+                        assert_se(strextend(&contents, "After=bench-", buf, ".service\n", NULL));
+                } else {
+                        xsprintf(buf, "%u", k - 1);
+                        assert_se(strextend(&contents, "After=bench-", buf, ".service\n", NULL));
+                }
+
+                assert_se(strextend(&contents, "[Service]\nType=oneshot\nExecStart=/bin/true\n", NULL));
+
+                assert_se(asprintf(&path, "%s/bench-%u.service", unit_dir, k) >= 0);
+                assert_se(write_string_file(path, contents, WRITE_STRING_FILE_CREATE) >= 0);
+        }
+
+        assert_se(set_unit_path(unit_dir) >= 0);
+        r = manager_new(UNIT_FILE_USER, MANAGER_TEST_RUN_BASIC, &m);
+        if (MANAGER_SKIP_TEST(r)) {
+                log_tests_skipped_errno(r, "manager_new");
+                return;
+        }
+        assert_se(r >= 0);
+        assert_se(manager_startup(m, NULL, NULL) >= 0);
+
+        start = now(CLOCK_MONOTONIC);
+        assert_se(manager_load_startable_unit_or_warn(m, "bench-0.service", NULL, &root) >= 0);
+        log_info("Loading %u units took %s", n_units,
+                 format_timespan(timespan, sizeof(timespan), now(CLOCK_MONOTONIC) - start, USEC_PER_MSEC));
+
+        start = now(CLOCK_MONOTONIC);
+        r = manager_add_job(m, JOB_START, root, JOB_REPLACE, &err, &j);
+        if (sd_bus_error_is_set(&err))
+                log_error("error: %s: %s", err.name, err.message);
+        assert_se(r == 0);
+        log_info("Adding a transaction with %u jobs took %s", hashmap_size(m->jobs),
+                 format_timespan(timespan, sizeof(timespan), now(CLOCK_MONOTONIC) - start, USEC_PER_MSEC));
+
+        /* Exactly one job of the cycle was dropped */
+        xsprintf(buf_a, "%u", n_units - 1);
+        xsprintf(buf_b, "%u", n_units - 2);
+        assert_se(a = manager_get_unit(m, strjoina("bench-", buf_a, ".service")));
+        assert_se(b = manager_get_unit(m, strjoina("bench-", buf_b, ".service")));
+        assert_se(!a->job != !b->job);
+        assert_se(hashmap_size(m->jobs) >= n_units - 1);
+}
+
+static void write_unit_file(const char *dir, const char *name, const char *contents, const struct timespec *mtime) {
+        _cleanup_free_ char *path = NULL;
+        struct timespec ts[2];
+
+        assert_se(path = path_join(dir, name));
+        assert_se(write_string_file(path, contents, WRITE_STRING_FILE_CREATE) >= 0);
+
+        /* Don't rely on the file system's timestamp granularity */
+        ts[0] = ts[1] = *mtime;
+        assert_se(utimensat(AT_FDCWD, path, ts, 0) >= 0);
+}
+
+static void assert_reloaded(Manager *m, char **reloaded, const char *name) {
+        char **i;
+
+        /* Units that failed to load are always tried again, ignore those */
+        STRV_FOREACH(i, reloaded) {
+                Unit *u;
+
+                if (streq_ptr(*i, name))
+                        continue;
+
+                assert_se(u = manager_get_unit(m, *i));
+                assert_se(u->load_state != UNIT_LOADED);
+        }
+
+        assert_se(!name || strv_contains(reloaded, name));
+}
+
+static void test_reload_changed(void) {
+        _cleanup_(rm_rf_physical_and_freep) char *unit_dir = NULL;
+        _cleanup_(manager_freep) Manager *m = NULL;
+        _cleanup_strv_free_ char **reloaded = NULL;
+        struct timespec before, after;
+        Unit *top, *changed, *other, *u;
+        int r;
+
+        log_info("/* %s */", __func__);
+
+        assert_se(mkdtemp_malloc("/tmp/test-engine-reload.XXXXXX", &unit_dir) >= 0);
+
+        timespec_store(&before, now(CLOCK_REALTIME) - 10 * USEC_PER_SEC);
+        timespec_store(&after, now(CLOCK_REALTIME));
+
+        write_unit_file(unit_dir, "reload-top.target",
+                        "[Unit]\n"
+                        "Wants=reload-changed.target reload-other.target\n", &before);
+        write_unit_file(unit_dir, "reload-changed.target",
+                        "[Unit]\n"
+                        "Description=before\n"
+                        "After=reload-other.target\n", &before);
+        write_unit_file(unit_dir, "reload-other.target",
+                        "[Unit]\n"
+                        "Description=other\n", &before);
+
+        assert_se(set_unit_path(unit_dir) >= 0);
+        r = manager_new(UNIT_FILE_USER, MANAGER_TEST_RUN_BASIC, &m);
+        if (MANAGER_SKIP_TEST(r)) {
+                log_tests_skipped_errno(r, "manager_new");
+                return;
+        }
+        assert_se(r >= 0);
+        assert_se(manager_startup(m, NULL, NULL) >= 0);
+
+        assert_se(manager_load_startable_unit_or_warn(m, "reload-top.target", NULL, &top) >= 0);
+        assert_se(changed = manager_get_unit(m, "reload-changed.target"));
+        assert_se(other = manager_get_unit(m, "reload-other.target"));
+        assert_se(streq(changed->description, "before"));
+
+        /* Pretend the units were started, the runtime state has to survive the reload */
+        TARGET(changed)->state = TARGET_ACTIVE;
+        TARGET(other)->state = TARGET_ACTIVE;
+
+        /* Nothing changed yet */
+        assert_se(manager_reload_changed(m, &reloaded) >= 0);
+        assert_reloaded(m, reloaded, NULL);
+        reloaded = strv_free(reloaded);
+
+        /* Change one unit file for real, and the other one behind our back, keeping its timestamp. Only the
+         * former is noticed, hence the latter must keep the old contents. */
+        write_unit_file(unit_dir, "reload-changed.target",
+                        "[Unit]\n"
+                        "Description=after\n"
+                        "After=reload-other.target\n", &after);
+        write_unit_file(unit_dir, "reload-other.target",
+                        "[Unit]\n"
+                        "Description=other, changed\n", &before);
+
+        assert_se(manager_reload_changed(m, &reloaded) >= 0);
+        assert_reloaded(m, reloaded, "reload-changed.target");
+
+        /* The others are the very same objects as before, with their state and configuration untouched */
+        assert_se(manager_get_unit(m, "reload-top.target") == top);
+        assert_se(manager_get_unit(m, "reload-other.target") == other);
+        assert_se(streq(other->description, "other"));
+        assert_se(unit_active_state(other) == UNIT_ACTIVE);
+        assert_se(unit_active_state(top) == UNIT_INACTIVE);
+
+        /* The changed one was loaded again and kept its state */
+        assert_se(u = manager_get_unit(m, "reload-changed.target"));
+        assert_se(u->load_state == UNIT_LOADED);
+        assert_se(streq(u->description, "after"));
+        assert_se(unit_active_state(u) == UNIT_ACTIVE);
+        assert_se(!unit_need_daemon_reload(u));
+
+        /* Dependencies of others on it are restored, the ones from its own file are parsed again */
+        assert_se(dependency_set_get(top->dependencies[UNIT_WANTS], u));
+        assert_se(dependency_set_get(u->dependencies[UNIT_WANTED_BY], top));
+        assert_se(dependency_set_get(u->dependencies[UNIT_AFTER], other));
+        assert_se(dependency_set_get(other->dependencies[UNIT_BEFORE], u));
+
+        reloaded = strv_free(reloaded);
+        assert_se(manager_reload_changed(m, &reloaded) >= 0);
+        assert_reloaded(m, reloaded, NULL);
+}
+
+static void test_start_concurrency(void) {
+        _cleanup_(rm_rf_physical_and_freep) char *unit_dir = NULL;
+        _cleanup_(manager_freep) Manager *m = NULL;
+        unsigned k, max_running = 0, max_running_slice = 0;
+        struct timespec ts;
+        Unit *top, *units[6];
+        usec_t deadline;
+        int r;
+
+        log_info("/* %s */", __func__);
+
+        /* Six oneshot services which take a while, at most two of which may start at the same time. Two of them are
+         * in a slice that allows only one at a time. */
+
+        assert_se(mkdtemp_malloc("/tmp/test-engine-concurrency.XXXXXX", &unit_dir) >= 0);
+        timespec_store(&ts, now(CLOCK_REALTIME));
+
+        write_unit_file(unit_dir, "concurrency.target",
+                        "[Unit]\n"
+                        "DefaultDependencies=no\n"
+                        "Wants=concurrency-0.service concurrency-1.service concurrency-2.service\n"
+                        "Wants=concurrency-3.service concurrency-4.service concurrency-5.service\n", &ts);
+        write_unit_file(unit_dir, "concurrency.slice",
+                        "[Unit]\n"
+                        "DefaultDependencies=no\n"
+                        "[Slice]\n"
+                        "StartConcurrency=1\n", &ts);
+
+        for (k = 0; k < ELEMENTSOF(units); k++) {
+                char name[STRLEN("concurrency-.service") + DECIMAL_STR_MAX(unsigned)];
+
+                xsprintf(name, "concurrency-%u.service", k);
+                write_unit_file(unit_dir, name,
+                                k >= 4 ?
+                                "[Unit]\n"
+                                "DefaultDependencies=no\n"
+                                "[Service]\n"
+                                "Type=oneshot\n"
+                                "Slice=concurrency.slice\n"
+                                "ExecStart=/bin/sleep 0.2\n" :
+                                "[Unit]\n"
+                                "DefaultDependencies=no\n"
+                                "[Service]\n"
+                                "Type=oneshot\n"
+                                "ExecStart=/bin/sleep 0.2\n", &ts);
+        }
+
+        assert_se(set_unit_path(unit_dir) >= 0);
+        r = manager_new(UNIT_FILE_USER, MANAGER_TEST_RUN_BASIC, &m);
+        if (MANAGER_SKIP_TEST(r)) {
+                log_tests_skipped_errno(r, "manager_new");
+                return;
+        }
+        assert_se(r >= 0);
+        assert_se(manager_startup(m, NULL, NULL) >= 0);
+
+        m->default_start_concurrency = 2;
+
+        assert_se(manager_load_startable_unit_or_warn(m, "concurrency.target", NULL, &top) >= 0);
+        for (k = 0; k < ELEMENTSOF(units); k++) {
+                char name[STRLEN("concurrency-.service") + DECIMAL_STR_MAX(unsigned)];
+
+                xsprintf(name, "concurrency-%u.service", k);
+                assert_se(units[k] = manager_get_unit(m, name));
+        }
+
+        assert_se(manager_add_job(m, JOB_START, top, JOB_REPLACE, NULL, NULL) >= 0);
+
+        deadline = usec_add(now(CLOCK_MONOTONIC), 30 * USEC_PER_SEC);
+
+        while (!hashmap_isempty(m->jobs)) {
+                unsigned running = 0, running_slice = 0;
+
+                assert_se(now(CLOCK_MONOTONIC) < deadline);
+                assert_se(sd_event_run(m->event, 100 * USEC_PER_MSEC) >= 0);
+
+                for (k = 0; k < ELEMENTSOF(units); k++)
+                        if (units[k]->job && units[k]->job->state == JOB_RUNNING) {
+                                running++;
+                                if (k >= 4)
+                                        running_slice++;
+                        }
+
+                /* The limits are honoured, also by the accounting */
+                assert_se(running <= 2);
+                assert_se(running_slice <= 1);
+                assert_se(m->n_running_start_jobs == running);
+
+                max_running = MAX(max_running, running);
+                max_running_slice = MAX(max_running_slice, running_slice);
+        }
+
+        /* The queued jobs were started as slots became available, and all of them ran */
+        assert_se(max_running == 2);
+        assert_se(max_running_slice == 1);
+        assert_se(!m->start_queue);
+        assert_se(m->n_running_start_jobs == 0);
+
+        for (k = 0; k < ELEMENTSOF(units); k++) {
+                assert_se(dual_timestamp_is_set(&units[k]->inactive_exit_timestamp));
+                assert_se(SERVICE(units[k])->result == SERVICE_SUCCESS);
+        }
+}
 
 int main(int argc, char *argv[]) {
         _cleanup_(rm_rf_physical_and_freep) char *runtime_dir = NULL;
@@ -94,37 +406,41 @@ int main(int argc, char *argv[]) {
         assert_se(manager_add_job(m, JOB_START, h, JOB_FAIL, NULL, &j) == 0);
         manager_dump_jobs(m, stdout, "\t");
 
-        assert_se(!hashmap_get(a->dependencies[UNIT_PROPAGATES_RELOAD_TO], b));
-        assert_se(!hashmap_get(b->dependencies[UNIT_RELOAD_PROPAGATED_FROM], a));
-        assert_se(!hashmap_get(a->dependencies[UNIT_PROPAGATES_RELOAD_TO], c));
-        assert_se(!hashmap_get(c->dependencies[UNIT_RELOAD_PROPAGATED_FROM], a));
+        assert_se(!dependency_set_get(a->dependencies[UNIT_PROPAGATES_RELOAD_TO], b));
+        assert_se(!dependency_set_get(b->dependencies[UNIT_RELOAD_PROPAGATED_FROM], a));
+        assert_se(!dependency_set_get(a->dependencies[UNIT_PROPAGATES_RELOAD_TO], c));
+        assert_se(!dependency_set_get(c->dependencies[UNIT_RELOAD_PROPAGATED_FROM], a));
 
         assert_se(unit_add_dependency(a, UNIT_PROPAGATES_RELOAD_TO, b, true, UNIT_DEPENDENCY_UDEV) == 0);
         assert_se(unit_add_dependency(a, UNIT_PROPAGATES_RELOAD_TO, c, true, UNIT_DEPENDENCY_PROC_SWAP) == 0);
 
-        assert_se(hashmap_get(a->dependencies[UNIT_PROPAGATES_RELOAD_TO], b));
-        assert_se(hashmap_get(b->dependencies[UNIT_RELOAD_PROPAGATED_FROM], a));
-        assert_se(hashmap_get(a->dependencies[UNIT_PROPAGATES_RELOAD_TO], c));
-        assert_se(hashmap_get(c->dependencies[UNIT_RELOAD_PROPAGATED_FROM], a));
+        assert_se(dependency_set_get(a->dependencies[UNIT_PROPAGATES_RELOAD_TO], b));
+        assert_se(dependency_set_get(b->dependencies[UNIT_RELOAD_PROPAGATED_FROM], a));
+        assert_se(dependency_set_get(a->dependencies[UNIT_PROPAGATES_RELOAD_TO], c));
+        assert_se(dependency_set_get(c->dependencies[UNIT_RELOAD_PROPAGATED_FROM], a));
 
         unit_remove_dependencies(a, UNIT_DEPENDENCY_UDEV);
 
-        assert_se(!hashmap_get(a->dependencies[UNIT_PROPAGATES_RELOAD_TO], b));
-        assert_se(!hashmap_get(b->dependencies[UNIT_RELOAD_PROPAGATED_FROM], a));
-        assert_se(hashmap_get(a->dependencies[UNIT_PROPAGATES_RELOAD_TO], c));
-        assert_se(hashmap_get(c->dependencies[UNIT_RELOAD_PROPAGATED_FROM], a));
+        assert_se(!dependency_set_get(a->dependencies[UNIT_PROPAGATES_RELOAD_TO], b));
+        assert_se(!dependency_set_get(b->dependencies[UNIT_RELOAD_PROPAGATED_FROM], a));
+        assert_se(dependency_set_get(a->dependencies[UNIT_PROPAGATES_RELOAD_TO], c));
+        assert_se(dependency_set_get(c->dependencies[UNIT_RELOAD_PROPAGATED_FROM], a));
 
         unit_remove_dependencies(a, UNIT_DEPENDENCY_PROC_SWAP);
 
-        assert_se(!hashmap_get(a->dependencies[UNIT_PROPAGATES_RELOAD_TO], b));
-        assert_se(!hashmap_get(b->dependencies[UNIT_RELOAD_PROPAGATED_FROM], a));
-        assert_se(!hashmap_get(a->dependencies[UNIT_PROPAGATES_RELOAD_TO], c));
-        assert_se(!hashmap_get(c->dependencies[UNIT_RELOAD_PROPAGATED_FROM], a));
+        assert_se(!dependency_set_get(a->dependencies[UNIT_PROPAGATES_RELOAD_TO], b));
+        assert_se(!dependency_set_get(b->dependencies[UNIT_RELOAD_PROPAGATED_FROM], a));
+        assert_se(!dependency_set_get(a->dependencies[UNIT_PROPAGATES_RELOAD_TO], c));
+        assert_se(!dependency_set_get(c->dependencies[UNIT_RELOAD_PROPAGATED_FROM], a));
 
         assert_se(manager_load_unit(m, "unit-with-multiple-dashes.service", NULL, NULL, &unit_with_multiple_dashes) >= 0);
 
         assert_se(strv_equal(unit_with_multiple_dashes->documentation, STRV_MAKE("man:test", "man:override2", "man:override3")));
         assert_se(streq_ptr(unit_with_multiple_dashes->description, "override4"));
 
+        test_reload_changed();
+        test_start_concurrency();
+        test_large_transaction(slow_tests_enabled() ? 50000 : 500);
+
         return 0;
 }
@@ -98,6 +98,49 @@ static void test_strv_env_merge(void) {
         assert_se(strv_length(r) == 5);
 }
 
+static void test_strv_env_merge_many(void) {
+        _cleanup_strv_free_ char **a = NULL, **b = NULL, **r = NULL;
+        unsigned i;
+
+        /* Enough entries to have the merge and clean use a hash table */
+
+        for (i = 0; i < 200; i++)
+                assert_se(strv_extendf(&a, "V%u=a", i) >= 0);
+        assert_se(strv_extend(&a, "PIEP") >= 0);
+
+        for (i = 100; i < 300; i++)
+                assert_se(strv_extendf(&b, "V%u=b", i) >= 0);
+        assert_se(strv_extend(&b, "PIEP=") >= 0);
+
+        r = strv_env_merge(2, a, b);
+        assert_se(r);
+        assert_se(strv_length(r) == 302);
+        assert_se(streq(r[0], "V0=a"));
+        assert_se(streq(r[99], "V99=a"));
+        assert_se(streq(r[100], "V100=b"));
+        assert_se(streq(r[199], "V199=b"));
+        assert_se(streq(r[200], "PIEP"));
+        assert_se(streq(r[201], "V200=b"));
+        assert_se(streq(r[300], "V299=b"));
+        assert_se(streq(r[301], "PIEP="));
+
+        /* An invalid assignment is dropped, but still hides the earlier one */
+        assert_se(strv_extend(&r, "V5=c") >= 0);
+        assert_se(strv_extend(&r, "V7=\x01") >= 0);
+
+        assert_se(strv_env_clean(r) == r);
+        assert_se(strv_length(r) == 300);
+        assert_se(streq(r[4], "V4=a"));
+        assert_se(streq(r[5], "V6=a"));
+        assert_se(streq(r[6], "V8=a"));
+        assert_se(streq(r[197], "V199=b"));
+        assert_se(streq(r[198], "V200=b"));
+        assert_se(streq(r[297], "V299=b"));
+        assert_se(streq(r[298], "PIEP="));
+        assert_se(streq(r[299], "V5=c"));
+        assert_se(strv_env_is_valid(r));
+}
+
 static void test_env_strv_get_n(void) {
         const char *_env[] = {
                 "FOO=NO NO NO",
@@ -310,6 +353,7 @@ int main(int argc, char *argv[]) {
         test_strv_env_unset();
         test_strv_env_set();
         test_strv_env_merge();
+        test_strv_env_merge_many();
         test_env_strv_get_n();
         test_replace_env(false);
         test_replace_env(true);
@@ -0,0 +1,107 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <unistd.h>
+
+#include "alloc-util.h"
+#include "execute-simple.h"
+#include "fd-util.h"
+#include "strv.h"
+#include "tests.h"
+
+static void test_exec_simple_serialize(void) {
+        _cleanup_(exec_simple_done) ExecSimple d = {};
+        struct rlimit nofile = { 1024, 4096 };
+        const struct rlimit *rlimit[_RLIMIT_MAX] = {
+                [RLIMIT_NOFILE] = &nofile,
+        };
+        _cleanup_free_ void *buf = NULL;
+        _cleanup_free_ int *fds = NULL;
+        int socket_fds[2] = { 10, 11 };
+        char **argv, **envp;
+        size_t size, n_fds;
+        ExecSimple c;
+
+        argv = STRV_MAKE("/bin/foo", "--bar", "");
+        envp = STRV_MAKE("PATH=/usr/bin", "LISTEN_PID=1", "LISTEN_FDS=2");
+
+        c = (ExecSimple) {
+                .path = "/bin/foo",
+                .argv = argv,
+                .envp = envp,
+                .listen_pid = envp[1] + strlen("LISTEN_PID="),
+                .stdio = { 12, STDOUT_FILENO, EXEC_SIMPLE_FD_KEEP },
+                .socket_fd = -1,
+                .fds = socket_fds,
+                .n_socket_fds = 2,
+                .exec_fd = 13,
+                .cgroup_fd = -1,
+                .nice_set = true,
+                .nice = -5,
+                .umask = 0027,
+                .new_keyring = true,
+                .rlimit = rlimit,
+                .working_directory = "/",
+                .working_directory_missing_ok = true,
+                .unit_id = "foo.service",
+                .unit_log_field = "UNIT=foo.service",
+                .invocation_log_field = "INVOCATION_ID=",
+        };
+
+        assert_se(exec_simple_serialize(&c, &buf, &size, &fds, &n_fds) >= 0);
+
+        /* The socket fds come first, followed by the ones referenced by index */
+        assert_se(n_fds == 4);
+        assert_se(fds[0] == 10 && fds[1] == 11 && fds[2] == 12 && fds[3] == 13);
+
+        /* The receiving side gets different fd numbers */
+        fds[0] = 20;
+        fds[1] = 21;
+        fds[2] = 22;
+        fds[3] = 23;
+
+        assert_se(exec_simple_deserialize(buf, size, fds, n_fds, &d) >= 0);
+
+        assert_se(streq(d.path, "/bin/foo"));
+        assert_se(strv_equal(d.argv, argv));
+        assert_se(streq(d.envp[0], "PATH=/usr/bin"));
+        assert_se(startswith(d.envp[1], "LISTEN_PID="));
+        assert_se(d.listen_pid == d.envp[1] + strlen("LISTEN_PID="));
+        assert_se(!d.watchdog_pid);
+        assert_se(streq(d.envp[2], "LISTEN_FDS=2"));
+
+        assert_se(d.stdio[STDIN_FILENO] == 22);
+        assert_se(d.stdio[STDOUT_FILENO] == STDOUT_FILENO);
+        assert_se(d.stdio[STDERR_FILENO] == EXEC_SIMPLE_FD_KEEP);
+        assert_se(d.socket_fd == -1);
+        assert_se(d.n_socket_fds == 2 && d.n_storage_fds == 0);
+        assert_se(d.fds[0] == 20 && d.fds[1] == 21);
+        assert_se(d.exec_fd == 23);
+        assert_se(d.cgroup_fd == -1);
+
+        assert_se(d.nice_set && d.nice == -5);
+        assert_se(d.umask == 0027);
+        assert_se(d.new_keyring && !d.link_user_keyring);
+        assert_se(d.working_directory_missing_ok && !d.ignore_enoent);
+        assert_se(streq(d.working_directory, "/"));
+        assert_se(streq(d.unit_id, "foo.service"));
+        assert_se(streq(d.unit_log_field, "UNIT=foo.service"));
+        assert_se(streq(d.invocation_log_field, "INVOCATION_ID="));
+
+        assert_se(d.rlimit);
+        assert_se(!d.rlimit[RLIMIT_CORE]);
+        assert_se(d.rlimit[RLIMIT_NOFILE]->rlim_cur == 1024);
+        assert_se(d.rlimit[RLIMIT_NOFILE]->rlim_max == 4096);
+
+        /* Truncated requests, or a different number of fds, are refused */
+        exec_simple_done(&d);
+        assert_se(exec_simple_deserialize(buf, size - 1, fds, n_fds, &d) == -EBADMSG);
+        assert_se(exec_simple_deserialize(buf, size, fds, n_fds - 1, &d) == -EBADMSG);
+}
+
+int main(int argc, char *argv[]) {
+        test_setup_logging(LOG_DEBUG);
+
+        test_exec_simple_serialize();
+
+        return 0;
+}
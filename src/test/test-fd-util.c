@@ -39,6 +39,34 @@ static void test_close_many(void) {
         unlink(name2);
 }
 
+static void test_close_all_fds_without_malloc(void) {
+        pid_t pid;
+        int r;
+
+        r = safe_fork("close-all", FORK_WAIT|FORK_LOG, &pid);
+        assert_se(r >= 0);
+
+        if (r == 0) {
+                int fds[64], keep[2];
+                size_t i;
+
+                /* Child */
+
+                for (i = 0; i < ELEMENTSOF(fds); i++)
+                        assert_se((fds[i] = open("/dev/null", O_RDONLY|O_CLOEXEC)) >= 0);
+
+                keep[0] = fds[7];
+                keep[1] = fds[ELEMENTSOF(fds) - 1];
+
+                assert_se(close_all_fds_without_malloc(keep, ELEMENTSOF(keep)) >= 0);
+
+                for (i = 0; i < ELEMENTSOF(fds); i++)
+                        assert_se((fcntl(fds[i], F_GETFD) >= 0) == (fds[i] == keep[0] || fds[i] == keep[1]));
+
+                _exit(EXIT_SUCCESS);
+        }
+}
+
 static void test_close_nointr(void) {
         char name[] = "/tmp/test-test-close_nointr.XXXXXX";
         int fd;
@@ -323,6 +351,7 @@ int main(int argc, char *argv[]) {
 
         test_close_many();
         test_close_nointr();
+        test_close_all_fds_without_malloc();
         test_same_fd();
         test_open_serialization_fd();
         test_acquire_data_fd();
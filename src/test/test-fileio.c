@@ -688,6 +688,36 @@ static void test_read_line3(void) {
         assert_se(read_line(f, LINE_MAX, NULL) == 0);
 }
 
+static void test_read_full_file_buf(void) {
+        _cleanup_(unlink_tempfilep) char name[] = "/tmp/test-fileio-buf.XXXXXX";
+        _cleanup_free_ char *comm = NULL;
+        _cleanup_close_ int fd = -1;
+        char buf[16];
+        size_t size;
+
+        fd = mkostemp_safe(name);
+        assert_se(fd >= 0);
+        assert_se(write(fd, "first\nsecond\n", 13) == 13);
+
+        assert_se(read_full_file_buf(name, buf, sizeof(buf), &size) == 0);
+        assert_se(size == 13);
+        assert_se(streq(buf, "first\nsecond\n"));
+
+        assert_se(read_one_line_file_buf(name, buf, sizeof(buf)) == 0);
+        assert_se(streq(buf, "first"));
+
+        /* The file and the trailing NUL byte need to fit */
+        assert_se(read_full_file_buf(name, buf, 14, NULL) == 0);
+        assert_se(read_full_file_buf(name, buf, 13, NULL) == -ENOBUFS);
+        assert_se(read_one_line_file_buf(name, buf, 13) == -ENOBUFS);
+
+        assert_se(read_full_file_buf("/tmp/test-fileio-buf-nonexistent", buf, sizeof(buf), NULL) == -ENOENT);
+
+        assert_se(read_one_line_file("/proc/self/comm", &comm) >= 0);
+        assert_se(read_one_line_file_buf("/proc/self/comm", buf, sizeof(buf)) >= 0);
+        assert_se(streq(buf, comm));
+}
+
 int main(int argc, char *argv[]) {
         test_setup_logging(LOG_DEBUG);
 
@@ -710,6 +740,7 @@ int main(int argc, char *argv[]) {
         test_read_line();
         test_read_line2();
         test_read_line3();
+        test_read_full_file_buf();
 
         return 0;
 }
@@ -29,6 +29,33 @@ static void test_issue_9549(void) {
                         ));
 }
 
+static void test_json(void) {
+        _cleanup_(table_unrefp) Table *t = NULL;
+        _cleanup_(json_variant_unrefp) JsonVariant *v = NULL;
+        _cleanup_free_ char *formatted = NULL;
+
+        assert_se(t = table_new("IDX", "LINK NAME", "UP", "SPEED"));
+        assert_se(table_set_sort(t, (size_t) 0, (size_t) -1) >= 0);
+        assert_se(table_add_many(t,
+                                 TABLE_UINT32, (uint32_t) 2,
+                                 TABLE_STRING, "eth0",
+                                 TABLE_BOOLEAN, true,
+                                 TABLE_SIZE, (uint64_t) 1000) >= 0);
+        assert_se(table_add_many(t,
+                                 TABLE_UINT32, (uint32_t) 1,
+                                 TABLE_STRING, "lo",
+                                 TABLE_BOOLEAN, false,
+                                 TABLE_EMPTY) >= 0);
+
+        assert_se(table_to_json(t, &v) >= 0);
+        assert_se(json_variant_format(v, 0, &formatted) >= 0);
+        printf("%s\n", formatted);
+
+        assert_se(streq(formatted,
+                        "[{\"idx\":1,\"link_name\":\"lo\",\"up\":false,\"speed\":null},"
+                        "{\"idx\":2,\"link_name\":\"eth0\",\"up\":true,\"speed\":1000}]"));
+}
+
 int main(int argc, char *argv[]) {
 
         _cleanup_(table_unrefp) Table *t = NULL;
@@ -160,6 +187,7 @@ int main(int argc, char *argv[]) {
                         "5min           5min                     \n"));
 
         test_issue_9549();
+        test_json();
 
         return 0;
 }
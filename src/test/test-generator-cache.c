@@ -0,0 +1,78 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <stdlib.h>
+#include <sys/stat.h>
+
+#include "alloc-util.h"
+#include "fileio.h"
+#include "generator-cache.h"
+#include "rm-rf.h"
+#include "string-util.h"
+#include "strv.h"
+#include "tests.h"
+#include "tmpfile-util.h"
+
+static void test_generator_inputs_digest(void) {
+        _cleanup_(rm_rf_physical_and_freep) char *tmp = NULL;
+        _cleanup_free_ char *generator = NULL, *manifest = NULL, *input = NULL, *contents = NULL;
+        uint64_t a, b;
+        char **dirs;
+
+        assert_se(mkdtemp_malloc("/tmp/test-generator-cache-XXXXXX", &tmp) >= 0);
+        dirs = STRV_MAKE(tmp);
+
+        /* No generators at all, hence nothing that could change */
+        assert_se(generator_inputs_digest(dirs, NULL, &a) > 0);
+
+        generator = strjoin(tmp, "/foo-generator");
+        manifest = strjoin(generator, ".inputs");
+        input = strjoin(tmp, "/input");
+        assert_se(generator && manifest && input);
+
+        assert_se(write_string_file(generator, "#!/bin/sh", WRITE_STRING_FILE_CREATE) >= 0);
+        assert_se(chmod(generator, 0755) >= 0);
+
+        /* A generator without a manifest can't be cached */
+        assert_se(generator_inputs_digest(dirs, NULL, &a) == 0);
+
+        contents = strjoin("# comment\n"
+                           "\n"
+                           "env FOO\n"
+                           "cmdline foo.bar\n"
+                           "file ", input, "\n");
+        assert_se(contents);
+        assert_se(write_string_file(manifest, contents, WRITE_STRING_FILE_CREATE) >= 0);
+
+        assert_se(setenv("SYSTEMD_PROC_CMDLINE", "quiet foo.bar=1", 1) >= 0);
+
+        assert_se(generator_inputs_digest(dirs, STRV_MAKE("FOO=1"), &a) > 0);
+        assert_se(generator_inputs_digest(dirs, STRV_MAKE("FOO=1", "BAR=2"), &b) > 0);
+        assert_se(a == b);
+
+        /* Each kind of input is taken into account */
+        assert_se(generator_inputs_digest(dirs, STRV_MAKE("FOO=2"), &b) > 0);
+        assert_se(a != b);
+
+        assert_se(setenv("SYSTEMD_PROC_CMDLINE", "quiet foo.bar", 1) >= 0);
+        assert_se(generator_inputs_digest(dirs, STRV_MAKE("FOO=1"), &b) > 0);
+        assert_se(a != b);
+        assert_se(setenv("SYSTEMD_PROC_CMDLINE", "quiet foo.bar=1", 1) >= 0);
+
+        assert_se(write_string_file(input, "hello", WRITE_STRING_FILE_CREATE) >= 0);
+        assert_se(generator_inputs_digest(dirs, STRV_MAKE("FOO=1"), &b) > 0);
+        assert_se(a != b);
+
+        /* Unknown inputs can't be cached either */
+        assert_se(write_string_file(manifest, "bogus input", 0) >= 0);
+        assert_se(generator_inputs_digest(dirs, NULL, &a) == 0);
+
+        assert_se(unsetenv("SYSTEMD_PROC_CMDLINE") >= 0);
+}
+
+int main(int argc, char *argv[]) {
+        test_setup_logging(LOG_DEBUG);
+
+        test_generator_inputs_digest();
+
+        return 0;
+}
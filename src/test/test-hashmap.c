@@ -1,6 +1,10 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 
 #include "hashmap.h"
+#include "stdio-util.h"
+#include "string-util.h"
+#include "strv.h"
+#include "tests.h"
 #include "util.h"
 
 void test_hashmap_funcs(void);
@@ -147,6 +151,85 @@ static void test_path_hashmap(void) {
         assert_se(!hashmap_get(h, "/foo////bar////quux/////"));
 }
 
+static void test_hashmap_get_stats(void) {
+        _cleanup_hashmap_free_ Hashmap *h = NULL;
+        HashmapStats stats;
+        unsigned i;
+
+        log_info("%s", __func__);
+
+        hashmap_get_stats(NULL, &stats);
+        assert_se(stats.n_entries == 0);
+        assert_se(stats.n_buckets == 0);
+        assert_se(stats.max_dib == 0);
+        assert_se(stats.memory == 0);
+
+        assert_se(h = hashmap_new(NULL));
+        for (i = 1; i <= 1000; i++)
+                assert_se(hashmap_put(h, UINT_TO_PTR(i), UINT_TO_PTR(i)) == 1);
+
+        hashmap_get_stats(h, &stats);
+        assert_se(stats.n_entries == 1000);
+        assert_se(stats.n_buckets == hashmap_buckets(h));
+        assert_se(stats.memory == hashmap_memory_usage(h));
+        assert_se(stats.mean_dib >= 0 && stats.mean_dib <= stats.max_dib);
+        assert_se(stats.max_dib < stats.n_buckets);
+
+        hashmap_dump_stats(h, stdout, "\t", "test");
+}
+
+typedef struct LookupBenchmark {
+        Hashmap *h;
+        char **keys;
+        unsigned n;
+} LookupBenchmark;
+
+static void lookup_hits(void *userdata) {
+        LookupBenchmark *b = userdata;
+        unsigned i, k;
+
+        for (k = 0; k < 4; k++)
+                for (i = 0; i < b->n; i++)
+                        assert_se(hashmap_get(b->h, b->keys[i]) == UINT_TO_PTR(i + 1));
+}
+
+static void lookup_misses(void *userdata) {
+        LookupBenchmark *b = userdata;
+        unsigned i, k;
+
+        for (k = 0; k < 4; k++)
+                for (i = 0; i < b->n; i++)
+                        assert_se(!hashmap_get(b->h, b->keys[i]));
+}
+
+static void test_hashmap_lookup_benchmark(void) {
+        _cleanup_hashmap_free_ Hashmap *h = NULL;
+        _cleanup_strv_free_ char **keys = NULL, **misses = NULL;
+        unsigned n, i;
+
+        n = slow_tests_enabled() ? 1U << 20 : 1U << 12;
+
+        log_info("%s (%u entries)", __func__, n);
+
+        assert_se(keys = new0(char*, n + 1));
+        assert_se(misses = new0(char*, n + 1));
+        assert_se(h = hashmap_new(&string_hash_ops));
+
+        for (i = 0; i < n; i++) {
+                char buf[STRLEN("miss-") + DECIMAL_STR_MAX(unsigned)];
+
+                xsprintf(buf, "key-%u", i);
+                assert_se(keys[i] = strdup(buf));
+                xsprintf(buf, "miss-%u", i);
+                assert_se(misses[i] = strdup(buf));
+
+                assert_se(hashmap_put(h, keys[i], UINT_TO_PTR(i + 1)) == 1);
+        }
+
+        benchmark_run("hashmap-lookup-hit", 4 * n, lookup_hits, &(LookupBenchmark) { h, keys, n });
+        benchmark_run("hashmap-lookup-miss", 4 * n, lookup_misses, &(LookupBenchmark) { h, misses, n });
+}
+
 int main(int argc, const char *argv[]) {
         test_hashmap_funcs();
         test_ordered_hashmap_funcs();
@@ -158,6 +241,8 @@ int main(int argc, const char *argv[]) {
         test_string_compare_func();
         test_iterated_cache();
         test_path_hashmap();
+        test_hashmap_get_stats();
+        test_hashmap_lookup_benchmark();
 
         return 0;
 }
@@ -0,0 +1,76 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <errno.h>
+#include <string.h>
+
+#include "alloc-util.h"
+#include "histogram.h"
+#include "string-util.h"
+#include "tests.h"
+
+static void test_histogram_bucket(void) {
+        unsigned i;
+
+        assert_se(histogram_bucket(0) == 0);
+        assert_se(histogram_bucket(1) == 1);
+        assert_se(histogram_bucket(2) == 2);
+        assert_se(histogram_bucket(3) == 2);
+        assert_se(histogram_bucket(4) == 3);
+        assert_se(histogram_bucket(USEC_INFINITY) == HISTOGRAM_BUCKETS - 1);
+
+        for (i = 0; i < HISTOGRAM_BUCKETS - 1; i++) {
+                assert_se(histogram_bucket(histogram_bucket_max(i) - 1) == i);
+                assert_se(histogram_bucket(histogram_bucket_max(i)) == i + 1);
+        }
+
+        assert_se(histogram_bucket_max(HISTOGRAM_BUCKETS - 1) == USEC_INFINITY);
+}
+
+static void test_histogram_add_and_serialize(void) {
+        _cleanup_(histogram_freep) Histogram *h = NULL, *k = NULL;
+        _cleanup_free_ char *s = NULL, *t = NULL;
+
+        assert_se(histogram_to_string(NULL, &s) >= 0);
+        assert_se(streq(s, "0 0 0"));
+        s = mfree(s);
+
+        assert_se(histogram_add(&h, 0) >= 0);
+        assert_se(histogram_add(&h, 5) >= 0);
+        assert_se(histogram_add(&h, 6) >= 0);
+        assert_se(histogram_add(&h, 3 * USEC_PER_SEC) >= 0);
+
+        assert_se(h->n == 4);
+        assert_se(h->sum == 11 + 3 * USEC_PER_SEC);
+        assert_se(h->max == 3 * USEC_PER_SEC);
+        assert_se(h->buckets[0] == 1);
+        assert_se(h->buckets[3] == 2);
+        assert_se(h->buckets[histogram_bucket(3 * USEC_PER_SEC)] == 1);
+
+        assert_se(histogram_to_string(h, &s) >= 0);
+        log_info("%s", s);
+        assert_se(streq(s, "4 3000011 3000000 0:1 3:2 22:1"));
+
+        assert_se(histogram_from_string(s, &k) >= 0);
+        assert_se(memcmp(h, k, sizeof(Histogram)) == 0);
+        assert_se(histogram_to_string(k, &t) >= 0);
+        assert_se(streq(s, t));
+        k = histogram_free(k);
+
+        /* The counts have to add up */
+        assert_se(histogram_from_string("", &k) == -EINVAL);
+        assert_se(histogram_from_string("4 11 6", &k) == -EINVAL);
+        assert_se(histogram_from_string("1 0 0 0:2", &k) == -EINVAL);
+        assert_se(histogram_from_string("1 0 0 40:1", &k) == -ERANGE);
+        assert_se(histogram_from_string("1 0 0 0", &k) == -EINVAL);
+        assert_se(histogram_from_string("1 0 0 0:1", &k) >= 0);
+        assert_se(k->n == 1 && k->buckets[0] == 1);
+}
+
+int main(int argc, char *argv[]) {
+        test_setup_logging(LOG_INFO);
+
+        test_histogram_bucket();
+        test_histogram_add_and_serialize();
+
+        return 0;
+}
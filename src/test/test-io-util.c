@@ -33,6 +33,8 @@ static void test_sparse_write(void) {
         const char test_e[] = "test\0\0\0\0test";
         _cleanup_close_ int fd = -1;
         char fn[] = "/tmp/sparseXXXXXX";
+        char test_f[4096];
+        size_t i;
 
         fd = mkostemp(fn, O_CLOEXEC);
         assert_se(fd >= 0);
@@ -43,6 +45,11 @@ static void test_sparse_write(void) {
         test_sparse_write_one(fd, test_c, sizeof(test_c));
         test_sparse_write_one(fd, test_d, sizeof(test_d));
         test_sparse_write_one(fd, test_e, sizeof(test_e));
+
+        /* Runs of NUL bytes of all kinds of lengths between non-NUL data */
+        for (i = 0; i < sizeof(test_f); i++)
+                test_f[i] = (i * 7 / 13) % 11 == 0 || (i / 500) % 2 == 1 ? 0 : 'x' + (i % 3);
+        test_sparse_write_one(fd, test_f, sizeof(test_f));
 }
 
 int main(void) {
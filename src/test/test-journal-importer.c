@@ -5,11 +5,16 @@
 #include <fcntl.h>
 
 #include "alloc-util.h"
+#include "compress.h"
+#include "fd-util.h"
+#include "fileio.h"
+#include "fs-util.h"
 #include "log.h"
 #include "journal-importer.h"
 #include "path-util.h"
 #include "string-util.h"
 #include "tests.h"
+#include "tmpfile-util.h"
 
 static void assert_iovec_entry(const struct iovec *iovec, const char* content) {
         assert_se(strlen(content) == iovec->iov_len);
@@ -68,11 +73,110 @@ static void test_bad_input(void) {
         assert_se(journal_importer_eof(&imp));
 }
 
+static void append_binary_field(FILE *f, uint32_t *n, size_t *size, int compression, const void *data, size_t l) {
+        ExportBinaryField h = {
+                .size = htole64(l),
+                .compression = htole32(compression),
+        };
+
+        assert_se(fwrite(&h, sizeof(h), 1, f) == 1);
+        assert_se(fwrite(data, l, 1, f) == 1);
+
+        (*n)++;
+        *size += sizeof(h) + l;
+}
+
+static void test_binary_parsing(void) {
+        _cleanup_(journal_importer_cleanup) JournalImporter imp = {};
+        _cleanup_(unlink_tempfilep) char name[] = "/tmp/test-journal-importer.XXXXXX";
+        _cleanup_fclose_ FILE *f = NULL;
+        ExportBinaryEntry h = {
+                .realtime = htole64(1478389147837945),
+                .monotonic = htole64(4711),
+        };
+        char big[STRLEN("BIG=") + 1024];
+        size_t size = sizeof(h);
+        uint32_t n = 0;
+        int fd, compression = 0, r;
+
+        fd = mkostemp_safe(name);
+        assert_se(fd >= 0);
+        assert_se(f = fdopen(fd, "w+"));
+
+        /* One binary entry, with a compressed field if we can, and one text entry after it */
+        memcpy(h.signature, EXPORT_BINARY_SIGNATURE, sizeof(h.signature));
+        assert_se(fwrite(&h, sizeof(h), 1, f) == 1);
+
+        append_binary_field(f, &n, &size, 0, "MESSAGE=hello", STRLEN("MESSAGE=hello"));
+        append_binary_field(f, &n, &size, 0, "__CURSOR=x", STRLEN("__CURSOR=x"));
+
+        memcpy(big, "BIG=", STRLEN("BIG="));
+        memset(big + STRLEN("BIG="), 'x', sizeof(big) - STRLEN("BIG="));
+
+#if HAVE_COMPRESSION
+        {
+                char compressed[sizeof(big)];
+                size_t csize;
+
+                compression = HAVE_ZSTD ? OBJECT_COMPRESSED_ZSTD : HAVE_LZ4 ? OBJECT_COMPRESSED_LZ4 : OBJECT_COMPRESSED_XZ;
+                assert_se(compress_blob(compression, NULL, big, sizeof(big), compressed, sizeof(compressed) - 1, &csize) >= 0);
+                append_binary_field(f, &n, &size, compression, compressed, csize);
+        }
+#else
+        append_binary_field(f, &n, &size, 0, big, sizeof(big));
+#endif
+
+        fputs("MESSAGE=text\n\n", f);
+
+        h.n_fields = htole32(n);
+        h.size = htole64(size);
+        assert_se(fseek(f, 0, SEEK_SET) == 0);
+        assert_se(fwrite(&h, sizeof(h), 1, f) == 1);
+        assert_se(fflush_and_check(f) >= 0);
+        assert_se(fseek(f, 0, SEEK_SET) == 0);
+
+        imp.fd = fd;
+        imp.passive_fd = true;
+        assert_se(read_full_stream(f, &imp.buf, &imp.filled) >= 0);
+        imp.size = imp.filled;
+
+        do
+                r = journal_importer_process_data(&imp);
+        while (r == 0 && !journal_importer_eof(&imp));
+        assert_se(r == 1);
+
+        /* The dunder field is dropped */
+        assert_se(imp.iovw.count == 2);
+        assert_iovec_entry(&imp.iovw.iovec[0], "MESSAGE=hello");
+        assert_se(imp.iovw.iovec[1].iov_len == sizeof(big));
+        assert_se(memcmp(imp.iovw.iovec[1].iov_base, big, sizeof(big)) == 0);
+        assert_se(imp.ts.realtime == 1478389147837945);
+        assert_se(imp.ts.monotonic == 4711);
+
+        if (compression != 0) {
+                assert_se(journal_importer_payloads(&imp));
+                assert_se(imp.payloads[0].compression == 0);
+                assert_se(imp.payloads[1].compression == compression);
+        }
+
+        journal_importer_drop_iovw(&imp);
+        assert_se(!journal_importer_payloads(&imp));
+
+        do
+                r = journal_importer_process_data(&imp);
+        while (r == 0);
+        assert_se(r == 1);
+
+        assert_se(imp.iovw.count == 1);
+        assert_iovec_entry(&imp.iovw.iovec[0], "MESSAGE=text");
+}
+
 int main(int argc, char **argv) {
         test_setup_logging(LOG_DEBUG);
 
         test_basic_parsing();
         test_bad_input();
+        test_binary_parsing();
 
         return 0;
 }
@@ -11,6 +11,8 @@
 #include "json.h"
 #include "string-util.h"
 #include "strv.h"
+#include "tests.h"
+#include "time-util.h"
 #include "util.h"
 
 static void test_tokenizer(const char *data, ...) {
@@ -403,6 +405,39 @@ static void test_depth(void) {
         fputs("\n", stdout);
 }
 
+static void test_parse_benchmark(void) {
+        char timespan[FORMAT_TIMESPAN_MAX];
+        _cleanup_free_ char *text = NULL;
+        unsigned n, i;
+        size_t size;
+        usec_t start;
+        FILE *f;
+
+        n = slow_tests_enabled() ? 200000U : 2000U;
+
+        /* Something resembling image or unit metadata: objects with a couple of short and long strings, numbers and
+         * small arrays */
+        assert_se(f = open_memstream(&text, &size));
+        fputs("[", f);
+        for (i = 0; i < n; i++)
+                fprintf(f, "%s{\"name\":\"image-%u\",\"path\":\"/var/lib/machines/image-%u.raw\","
+                        "\"size\":%u,\"read_only\":%s,\"usage\":%u.5,"
+                        "\"tags\":[\"a\",\"b\",\"tag-%u\"],\"description\":\"Line one\\nline two\"}",
+                        i == 0 ? "" : ",", i, i, i * 4096, i % 2 ? "true" : "false", i, i);
+        fputs("]", f);
+        assert_se(fclose(f) == 0);
+
+        start = now(CLOCK_MONOTONIC);
+        for (i = 0; i < 4; i++) {
+                _cleanup_(json_variant_unrefp) JsonVariant *v = NULL;
+
+                assert_se(json_parse(text, &v, NULL, NULL) >= 0);
+                assert_se(json_variant_elements(v) == n);
+        }
+        log_info("Parsing %zu bytes of JSON 4 times took %s", size,
+                 format_timespan(timespan, sizeof(timespan), now(CLOCK_MONOTONIC) - start, 1));
+}
+
 int main(int argc, char *argv[]) {
 
         log_set_max_level(LOG_DEBUG);
@@ -458,5 +493,7 @@ int main(int argc, char *argv[]) {
 
         test_depth();
 
+        test_parse_benchmark();
+
         return 0;
 }
@@ -0,0 +1,241 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <sched.h>
+#include <signal.h>
+#include <sys/mount.h>
+#include <sys/prctl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "fd-util.h"
+#include "killall.h"
+#include "log.h"
+#include "missing.h"
+#include "process-util.h"
+#include "tests.h"
+#include "time-util.h"
+
+static char **saved_argv = NULL;
+
+static pid_t spawn(void (*body)(int notify_fd)) {
+        _cleanup_close_pair_ int pipe_fds[2] = { -1, -1 };
+        pid_t pid;
+        char c;
+
+        assert_se(pipe2(pipe_fds, O_CLOEXEC) >= 0);
+
+        pid = fork();
+        assert_se(pid >= 0);
+        if (pid == 0) {
+                pipe_fds[0] = safe_close(pipe_fds[0]);
+                body(pipe_fds[1]);
+                _exit(EXIT_FAILURE);
+        }
+
+        /* Wait until the process is set up, whatever signal handling it wants */
+        pipe_fds[1] = safe_close(pipe_fds[1]);
+        assert_se(read(pipe_fds[0], &c, 1) == 1);
+
+        return pid;
+}
+
+static void notify(int fd) {
+        assert_se(write(fd, "x", 1) == 1);
+        safe_close(fd);
+}
+
+static void body_default(int fd) {
+        notify(fd);
+        for (;;)
+                pause();
+}
+
+static void body_ignore_sigterm(int fd) {
+        assert_se(signal(SIGTERM, SIG_IGN) != SIG_ERR);
+        assert_se(signal(SIGHUP, SIG_IGN) != SIG_ERR);
+        notify(fd);
+        for (;;)
+                pause();
+}
+
+static volatile sig_atomic_t got_sigterm = false;
+
+static void on_sigterm(int sig) {
+        got_sigterm = true;
+}
+
+static void body_slow(int fd) {
+        /* Take a moment to exit after SIGTERM, so that a SIGCHLD for others doesn't tell that we are gone */
+        assert_se(signal(SIGTERM, on_sigterm) != SIG_ERR);
+        notify(fd);
+        while (!got_sigterm)
+                pause();
+
+        (void) usleep(200 * USEC_PER_MSEC);
+        _exit(EXIT_SUCCESS);
+}
+
+static void body_subreaper(int fd) {
+        _cleanup_close_pair_ int pipe_fds[2] = { -1, -1 };
+        pid_t grandchild;
+        char c;
+
+        /* Processes with argv[0][0] == '@' are excluded, hence this one survives, and the process below it is
+         * not a child of PID 1, and we don't get SIGCHLD for it. */
+        c = saved_argv[0][0];
+        saved_argv[0][0] = '@';
+        assert_se(prctl(PR_SET_CHILD_SUBREAPER, 1) >= 0);
+
+        assert_se(pipe2(pipe_fds, O_CLOEXEC) >= 0);
+
+        grandchild = fork();
+        assert_se(grandchild >= 0);
+        if (grandchild == 0) {
+                /* The command line is inherited, but this one shall be killed */
+                saved_argv[0][0] = c;
+                pipe_fds[0] = safe_close(pipe_fds[0]);
+                body_slow(pipe_fds[1]);
+        }
+
+        pipe_fds[1] = safe_close(pipe_fds[1]);
+        assert_se(read(pipe_fds[0], &c, 1) == 1);
+
+        /* Tell the test about the PID of our child, and reap it eventually */
+        assert_se(write(fd, &grandchild, sizeof(grandchild)) == sizeof(grandchild));
+        safe_close(fd);
+
+        for (;;)
+                (void) wait(NULL);
+}
+
+static pid_t spawn_subreaper(pid_t *ret_grandchild) {
+        _cleanup_close_pair_ int pipe_fds[2] = { -1, -1 };
+        pid_t pid;
+
+        assert_se(pipe2(pipe_fds, O_CLOEXEC) >= 0);
+
+        pid = fork();
+        assert_se(pid >= 0);
+        if (pid == 0) {
+                pipe_fds[0] = safe_close(pipe_fds[0]);
+                body_subreaper(pipe_fds[1]);
+                _exit(EXIT_FAILURE);
+        }
+
+        pipe_fds[1] = safe_close(pipe_fds[1]);
+        assert_se(read(pipe_fds[0], ret_grandchild, sizeof(*ret_grandchild)) == sizeof(*ret_grandchild));
+
+        return pid;
+}
+
+static bool process_gone(pid_t pid) {
+        siginfo_t si = {};
+
+        /* Either we reaped it already, or it's not our child and it's gone entirely */
+        if (waitid(P_PID, pid, &si, WEXITED|WNOHANG|WNOWAIT) < 0)
+                return errno == ECHILD && kill(pid, 0) < 0 && errno == ESRCH;
+
+        return si.si_pid == pid;
+}
+
+static void test_broadcast_signal(void) {
+        pid_t normal, ignoring, subreaper, below;
+        int fd;
+        usec_t t;
+
+        assert_se(getpid() == 1);
+
+        /* Without pidfds, we don't learn when processes that aren't our children exit */
+        fd = pidfd_open(getpid(), 0);
+        if (fd < 0) {
+                log_notice_errno(errno, "pidfds not supported, skipping: %m");
+                return;
+        }
+        safe_close(fd);
+
+        normal = spawn(body_default);
+        subreaper = spawn_subreaper(&below);
+
+        log_info("Spawned "PID_FMT" (normal), "PID_FMT" (excluded) with child "PID_FMT".", normal, subreaper, below);
+
+        /* SIGTERM kills everything but the excluded process. Waiting ends as soon as the process below the
+         * excluded one is gone, too, even though we get no SIGCHLD for it. */
+        t = now(CLOCK_MONOTONIC);
+        broadcast_signal(SIGTERM, true, true, 30 * USEC_PER_SEC);
+        assert_se(now(CLOCK_MONOTONIC) - t < 10 * USEC_PER_SEC);
+
+        assert_se(process_gone(normal));
+        assert_se(!process_gone(subreaper));
+
+        /* The subreaper reaps its child asynchronously */
+        for (t = now(CLOCK_MONOTONIC); !process_gone(below); )
+                assert_se(now(CLOCK_MONOTONIC) - t < 5 * USEC_PER_SEC);
+
+        /* A process ignoring SIGTERM is waited for until the timeout elapsed, and survives */
+        ignoring = spawn(body_ignore_sigterm);
+        log_info("Spawned "PID_FMT" (ignores SIGTERM).", ignoring);
+
+        t = now(CLOCK_MONOTONIC);
+        broadcast_signal(SIGTERM, true, true, USEC_PER_SEC);
+        assert_se(now(CLOCK_MONOTONIC) - t >= USEC_PER_SEC);
+        assert_se(!process_gone(ignoring));
+
+        /* SIGKILL takes care of it, and waiting ends as soon as it's gone */
+        t = now(CLOCK_MONOTONIC);
+        broadcast_signal(SIGKILL, true, false, 30 * USEC_PER_SEC);
+        assert_se(now(CLOCK_MONOTONIC) - t < 10 * USEC_PER_SEC);
+
+        assert_se(process_gone(ignoring));
+        assert_se(!process_gone(subreaper));
+
+        assert_se(kill(subreaper, SIGKILL) >= 0);
+        assert_se(wait_for_terminate(subreaper, NULL) >= 0);
+}
+
+int main(int argc, char *argv[]) {
+        pid_t pid;
+        int r;
+
+        saved_argv = argv;
+
+        test_setup_logging(LOG_DEBUG);
+
+        if (getuid() != 0)
+                return log_tests_skipped("not root");
+
+        /* broadcast_signal() signals all processes, hence run it as PID 1 of a PID namespace of our own */
+        pid = fork();
+        assert_se(pid >= 0);
+        if (pid == 0) {
+                if (unshare(CLONE_NEWPID|CLONE_NEWNS) < 0) {
+                        log_notice_errno(errno, "Failed to create PID namespace: %m");
+                        _exit(EXIT_TEST_SKIP);
+                }
+
+                pid = fork();
+                assert_se(pid >= 0);
+                if (pid == 0) {
+                        assert_se(prctl(PR_SET_PDEATHSIG, SIGKILL) >= 0);
+
+                        if (mount(NULL, "/", NULL, MS_SLAVE|MS_REC, NULL) < 0 ||
+                            mount("proc", "/proc", "proc", 0, NULL) < 0) {
+                                log_notice_errno(errno, "Failed to mount /proc for PID namespace: %m");
+                                _exit(EXIT_TEST_SKIP);
+                        }
+
+                        test_broadcast_signal();
+                        _exit(EXIT_SUCCESS);
+                }
+
+                r = wait_for_terminate_and_check("(pid1)", pid, WAIT_LOG);
+                _exit(r < 0 ? EXIT_FAILURE : r);
+        }
+
+        r = wait_for_terminate_and_check("(test-killall)", pid, WAIT_LOG);
+        assert_se(r >= 0);
+        if (r == EXIT_TEST_SKIP)
+                return log_tests_skipped("Cannot create PID namespace");
+        assert_se(r == EXIT_SUCCESS);
+
+        return 0;
+}
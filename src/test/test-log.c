@@ -70,6 +70,19 @@ int main(int argc, char* argv[]) {
                 test_long_lines();
         }
 
+        /* The same, but with messages for the journal queued if it is busy */
+        log_set_buffered(true);
+        for (target = 0; target <  _LOG_TARGET_MAX; target++) {
+                log_set_target(target);
+                log_open();
+
+                test_log_struct();
+                test_long_lines();
+                (void) log_flush_buffered();
+        }
+        log_set_buffered(false);
+        assert_se(log_flush_buffered() == 0);
+
         assert_se(log_info_errno(SYNTHETIC_ERRNO(EUCLEAN), "foo") == -EUCLEAN);
 
         return 0;
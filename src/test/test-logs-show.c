@@ -0,0 +1,147 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "sd-journal.h"
+
+#include "alloc-util.h"
+#include "fd-util.h"
+#include "fileio.h"
+#include "io-util.h"
+#include "journal-file.h"
+#include "json.h"
+#include "log.h"
+#include "logs-show.h"
+#include "rm-rf.h"
+#include "string-util.h"
+#include "tests.h"
+
+static const OutputMode json_modes[] = {
+        OUTPUT_JSON,
+        OUTPUT_JSON_SSE,
+        OUTPUT_JSON_SEQ,
+};
+
+static void append_entry(JournalFile *f, const sd_id128_t *boot_id, const struct iovec *iovec, size_t n) {
+        dual_timestamp ts;
+
+        assert_se(dual_timestamp_get(&ts));
+        assert_se(journal_file_append_entry(f, &ts, boot_id, iovec, n, NULL, NULL, NULL) == 0);
+}
+
+static char *format_entry(sd_journal *j, OutputMode mode, OutputFlags flags, bool fast) {
+        _cleanup_fclose_ FILE *f = NULL;
+        char *buf = NULL;
+        size_t size = 0;
+
+        json_fast_path_set_enabled(fast);
+        sd_journal_restart_data(j);
+
+        f = open_memstream(&buf, &size);
+        assert_se(f);
+
+        assert_se(show_journal_entry(f, j, mode, 0, flags, NULL, NULL, NULL) >= 0);
+        assert_se(fflush_and_check(f) >= 0);
+
+        /* The buffer is only final once the stream is closed */
+        f = safe_fclose(f);
+
+        return buf;
+}
+
+static void test_json_fast_path(void) {
+        static const char binary[] = "BINARY=\0\x01\xff\xfe" "after";
+        _cleanup_(sd_journal_closep) sd_journal *j = NULL;
+        _cleanup_free_ char *huge = NULL;
+        char t[] = "/tmp/journal-XXXXXX";
+        unsigned n_entries = 0;
+        sd_id128_t boot_id;
+        JournalFile *f;
+
+        log_info("/* %s */", __func__);
+
+        assert_se(mkdtemp(t));
+        assert_se(chdir(t) >= 0);
+        assert_se(sd_id128_randomize(&boot_id) >= 0);
+
+        assert_se(journal_file_open(-1, "test.journal", O_RDWR|O_CREAT, 0644, true, (uint64_t) -1, false, NULL, NULL, NULL, NULL, &f) == 0);
+
+        append_entry(f, &boot_id, &IOVEC_MAKE_STRING("MESSAGE=plain"), 1);
+
+        /* Everything that needs escaping, and UTF-8 that doesn't */
+        append_entry(f, &boot_id, (struct iovec[]) {
+                        IOVEC_MAKE_STRING("MESSAGE=\"quoted\" back\\slash /slash/ \ttab"),
+                        IOVEC_MAKE_STRING("MULTILINE=line one\nline two\n"),
+                        IOVEC_MAKE_STRING("UTF8=süß → ∞"),
+                        IOVEC_MAKE_STRING("EMPTY="),
+                }, 4);
+
+        /* Control characters and invalid UTF-8 aren't printable, hence end up as arrays of bytes */
+        append_entry(f, &boot_id, (struct iovec[]) {
+                        IOVEC_MAKE_STRING("MESSAGE=binary"),
+                        IOVEC_MAKE_STRING("CONTROL=bell\a escape\x1b"),
+                        IOVEC_MAKE_STRING("INVALID=\xc3\x28"),
+                        IOVEC_MAKE((char*) binary, sizeof(binary) - 1),
+                }, 4);
+
+        /* Repeated fields become arrays, in the order they were logged in, also when mixing strings and bytes */
+        append_entry(f, &boot_id, (struct iovec[]) {
+                        IOVEC_MAKE_STRING("MESSAGE=repeated"),
+                        IOVEC_MAKE_STRING("REPEATED=one"),
+                        IOVEC_MAKE_STRING("OTHER=between"),
+                        IOVEC_MAKE_STRING("REPEATED=two"),
+                        IOVEC_MAKE_STRING("REPEATED=\x01three"),
+                }, 5);
+
+        /* Fields beyond the threshold are shown as null, unless everything shall be shown */
+        assert_se(huge = malloc(STRLEN("HUGE=") + 8192 + 1));
+        memset(stpcpy(huge, "HUGE="), 'x', 8192);
+        huge[STRLEN("HUGE=") + 8192] = 0;
+        append_entry(f, &boot_id, (struct iovec[]) {
+                        IOVEC_MAKE_STRING("MESSAGE=huge"),
+                        IOVEC_MAKE_STRING(huge),
+                }, 2);
+
+        (void) journal_file_close(f);
+
+        assert_se(sd_journal_open_directory(&j, t, 0) >= 0);
+
+        SD_JOURNAL_FOREACH(j) {
+                size_t m;
+
+                for (m = 0; m < ELEMENTSOF(json_modes) * 2; m++) {
+                        _cleanup_(json_variant_unrefp) JsonVariant *v = NULL;
+                        _cleanup_free_ char *fast = NULL, *generic = NULL;
+                        OutputMode mode = json_modes[m / 2];
+                        OutputFlags flags = m % 2 ? OUTPUT_SHOW_ALL : 0;
+                        const char *p;
+
+                        fast = format_entry(j, mode, flags, true);
+                        generic = format_entry(j, mode, flags, false);
+
+                        assert_se(streq(fast, generic));
+
+                        /* And it's actually valid JSON, after the record prefix */
+                        p = mode == OUTPUT_JSON_SSE ? startswith(fast, "data: ") :
+                            mode == OUTPUT_JSON_SEQ ? startswith(fast, "\x1e") : fast;
+                        assert_se(p);
+                        assert_se(json_parse(p, &v, NULL, NULL) >= 0);
+                        assert_se(json_variant_is_object(v));
+                }
+
+                n_entries++;
+        }
+
+        assert_se(n_entries == 5);
+
+        assert_se(rm_rf(t, REMOVE_ROOT|REMOVE_PHYSICAL) >= 0);
+}
+
+int main(int argc, char *argv[]) {
+        test_setup_logging(LOG_DEBUG);
+
+        test_json_fast_path();
+
+        return 0;
+}
@@ -0,0 +1,197 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+/* Benchmarks the unit spine of the manager on a synthetic unit graph: loading the units, building a transaction for
+ * all of them, serializing the manager state, and a full reload, which flushes, reloads and deserializes everything.
+ * Run it via "meson test --benchmark", or directly:
+ *
+ *     test-manager-benchmark [N_UNITS [DEPENDENCIES_PER_UNIT [ROUNDS]]]
+ *
+ * The graph is generated from a fixed seed, hence it is the same on every run, and the best time of all rounds is
+ * reported for each phase. */
+
+#include <stdio.h>
+
+#include "alloc-util.h"
+#include "fd-util.h"
+#include "fdset.h"
+#include "fileio.h"
+#include "manager.h"
+#include "parse-util.h"
+#include "rm-rf.h"
+#include "serialize.h"
+#include "stdio-util.h"
+#include "string-util.h"
+#include "test-helper.h"
+#include "tests.h"
+#include "tmpfile-util.h"
+
+typedef enum BenchPhase {
+        BENCH_STARTUP,
+        BENCH_LOAD,
+        BENCH_TRANSACTION,
+        BENCH_SERIALIZE,
+        BENCH_RELOAD,
+        _BENCH_PHASE_MAX,
+} BenchPhase;
+
+static const char* const bench_phase_table[_BENCH_PHASE_MAX] = {
+        [BENCH_STARTUP]     = "startup",
+        [BENCH_LOAD]        = "load",
+        [BENCH_TRANSACTION] = "transaction",
+        [BENCH_SERIALIZE]   = "serialize",
+        [BENCH_RELOAD]      = "reload",
+};
+
+static unsigned arg_n_units = 1000;
+static unsigned arg_n_dependencies = 3;
+static unsigned arg_n_rounds = 3;
+
+static uint32_t bench_random(uint32_t *state) {
+        /* A trivial LCG is good enough here, all we want is the same graph on every run */
+        *state = *state * 1103515245U + 12345U;
+        return *state >> 16;
+}
+
+static void write_units(const char *unit_dir) {
+        uint32_t seed = 4711;
+        unsigned k, d;
+
+        /* Each unit wants and is ordered after the next one, so that all of them are pulled in by the first one, and
+         * in addition after a number of randomly chosen later ones, which keeps the graph acyclic. */
+
+        for (k = 0; k < arg_n_units; k++) {
+                _cleanup_free_ char *path = NULL, *contents = NULL;
+                char buf[DECIMAL_STR_MAX(unsigned)];
+
+                assert_se(contents = strdup("[Unit]\nDefaultDependencies=no\n"));
+
+                for (d = 0; d < arg_n_dependencies && k + 1 < arg_n_units; d++) {
+                        unsigned c;
+
+                        c = d == 0 ? k + 1 : k + 1 + bench_random(&seed) % (arg_n_units - k - 1);
+
+                        xsprintf(buf, "%u", c);
+                        assert_se(strextend(&contents,
+                                            "Wants=bench-", buf, ".service\n",
+                                            "After=bench-", buf, ".service\n", NULL));
+                }
+
+                assert_se(strextend(&contents, "[Service]\nType=oneshot\nExecStart=/bin/true\n", NULL));
+
+                assert_se(asprintf(&path, "%s/bench-%u.service", unit_dir, k) >= 0);
+                assert_se(write_string_file(path, contents, WRITE_STRING_FILE_CREATE) >= 0);
+        }
+}
+
+static int bench_round(usec_t t[static _BENCH_PHASE_MAX]) {
+        _cleanup_(sd_bus_error_free) sd_bus_error err = SD_BUS_ERROR_NULL;
+        _cleanup_(manager_freep) Manager *m = NULL;
+        _cleanup_fdset_free_ FDSet *fds = NULL;
+        _cleanup_fclose_ FILE *f = NULL;
+        usec_t start;
+        Unit *root;
+        int r;
+
+        start = now(CLOCK_MONOTONIC);
+        r = manager_new(UNIT_FILE_USER, MANAGER_TEST_RUN_MINIMAL, &m);
+        if (MANAGER_SKIP_TEST(r))
+                return log_tests_skipped_errno(r, "manager_new");
+        assert_se(r >= 0);
+        assert_se(manager_startup(m, NULL, NULL) >= 0);
+        t[BENCH_STARTUP] = now(CLOCK_MONOTONIC) - start;
+
+        start = now(CLOCK_MONOTONIC);
+        assert_se(manager_load_startable_unit_or_warn(m, "bench-0.service", NULL, &root) >= 0);
+        t[BENCH_LOAD] = now(CLOCK_MONOTONIC) - start;
+
+        start = now(CLOCK_MONOTONIC);
+        r = manager_add_job(m, JOB_START, root, JOB_REPLACE, &err, NULL);
+        if (sd_bus_error_is_set(&err))
+                log_error("error: %s: %s", err.name, err.message);
+        assert_se(r == 0);
+        t[BENCH_TRANSACTION] = now(CLOCK_MONOTONIC) - start;
+        assert_se(hashmap_size(m->jobs) == arg_n_units);
+
+        assert_se(fds = fdset_new());
+        assert_se(manager_open_serialization(m, &f) >= 0);
+
+        start = now(CLOCK_MONOTONIC);
+        serialize_begin_binary(f);
+        assert_se(manager_serialize(m, f, fds, false) >= 0);
+        serialize_end_binary(f);
+        t[BENCH_SERIALIZE] = now(CLOCK_MONOTONIC) - start;
+
+        /* Like the main loop does, so that enumeration during the reload only records device state, and
+         * coldplug applies it */
+        m->objective = MANAGER_RELOAD;
+        start = now(CLOCK_MONOTONIC);
+        assert_se(manager_reload(m) >= 0);
+        t[BENCH_RELOAD] = now(CLOCK_MONOTONIC) - start;
+        m->objective = MANAGER_OK;
+        assert_se(hashmap_size(m->jobs) == arg_n_units);
+
+        return 0;
+}
+
+static int parse_argv(int argc, char *argv[]) {
+        unsigned *args[] = { &arg_n_units, &arg_n_dependencies, &arg_n_rounds };
+        int i, r;
+
+        if (argc > 1 + (int) ELEMENTSOF(args)) {
+                log_error("Usage: %s [N_UNITS [DEPENDENCIES_PER_UNIT [ROUNDS]]]", program_invocation_short_name);
+                return -EINVAL;
+        }
+
+        for (i = 1; i < argc; i++) {
+                r = safe_atou(argv[i], args[i - 1]);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to parse argument '%s': %m", argv[i]);
+        }
+
+        if (arg_n_units < 1 || arg_n_rounds < 1) {
+                log_error("At least one unit and one round are required.");
+                return -EINVAL;
+        }
+
+        return 0;
+}
+
+int main(int argc, char *argv[]) {
+        _cleanup_(rm_rf_physical_and_freep) char *runtime_dir = NULL, *unit_dir = NULL;
+        char timespan[FORMAT_TIMESPAN_MAX];
+        usec_t best[_BENCH_PHASE_MAX];
+        BenchPhase p;
+        unsigned k;
+        int r;
+
+        test_setup_logging(LOG_INFO);
+
+        if (parse_argv(argc, argv) < 0)
+                return EXIT_FAILURE;
+
+        assert_se(runtime_dir = setup_fake_runtime_dir());
+        assert_se(mkdtemp_malloc("/tmp/test-manager-benchmark-units.XXXXXX", &unit_dir) >= 0);
+        write_units(unit_dir);
+        assert_se(set_unit_path(unit_dir) >= 0);
+
+        for (p = 0; p < _BENCH_PHASE_MAX; p++)
+                best[p] = USEC_INFINITY;
+
+        for (k = 0; k < arg_n_rounds; k++) {
+                usec_t t[_BENCH_PHASE_MAX];
+
+                r = bench_round(t);
+                if (r != 0)
+                        return r;
+
+                for (p = 0; p < _BENCH_PHASE_MAX; p++)
+                        best[p] = MIN(best[p], t[p]);
+        }
+
+        printf("%u units, %u dependencies per unit, best of %u rounds:\n", arg_n_units, arg_n_dependencies, arg_n_rounds);
+        for (p = 0; p < _BENCH_PHASE_MAX; p++)
+                printf("  %-12s %s\n", bench_phase_table[p],
+                       format_timespan(timespan, sizeof(timespan), best[p], 1));
+
+        return EXIT_SUCCESS;
+}
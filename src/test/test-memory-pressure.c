@@ -0,0 +1,183 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "sd-event.h"
+
+#include "alloc-util.h"
+#include "fd-util.h"
+#include "log.h"
+#include "memory-pressure.h"
+#include "socket-util.h"
+#include "tests.h"
+#include "time-util.h"
+
+#define N_CACHE_ENTRIES 64U
+
+typedef struct Cache {
+        char *entries[N_CACHE_ENTRIES];
+        unsigned n_entries;
+        unsigned n_calls;
+} Cache;
+
+static void cache_fill(Cache *c) {
+        for (; c->n_entries < N_CACHE_ENTRIES; c->n_entries++)
+                assert_se(c->entries[c->n_entries] = malloc(4096));
+}
+
+static void cache_shrink(Cache *c, unsigned n) {
+        for (; c->n_entries > n; c->n_entries--)
+                c->entries[c->n_entries - 1] = mfree(c->entries[c->n_entries - 1]);
+}
+
+static void handler(MemoryPressureLevel level, void *userdata) {
+        Cache *c = userdata;
+
+        log_info("Memory pressure level: %s", memory_pressure_level_to_string(level));
+        c->n_calls++;
+
+        /* Like the real users: drop half the cache on some pressure, everything on full pressure */
+        if (level == MEMORY_PRESSURE_SOME)
+                cache_shrink(c, c->n_entries / 2);
+        else if (level == MEMORY_PRESSURE_FULL)
+                cache_shrink(c, 0);
+}
+
+static int make_trigger(int *ret_fd) {
+        union sockaddr_union sa = {
+                .in.sin_family = AF_INET,
+                .in.sin_addr.s_addr = htobe32(INADDR_LOOPBACK),
+        };
+        _cleanup_close_ int listener = -1, fd = -1;
+        socklen_t salen = sizeof(sa.in);
+        int trigger;
+
+        /* PSI triggers signal EPOLLPRI, which pipes and eventfds never do, but urgent data on a stream
+         * socket does. Returns the end to watch as trigger, and the one to fire it through in ret_fd. */
+
+        listener = socket(AF_INET, SOCK_STREAM|SOCK_CLOEXEC, 0);
+        if (listener < 0)
+                return -errno;
+
+        if (bind(listener, &sa.sa, salen) < 0)
+                return -errno;
+        if (listen(listener, 1) < 0)
+                return -errno;
+        if (getsockname(listener, &sa.sa, &salen) < 0)
+                return -errno;
+
+        fd = socket(AF_INET, SOCK_STREAM|SOCK_CLOEXEC, 0);
+        if (fd < 0)
+                return -errno;
+        if (connect(fd, &sa.sa, salen) < 0)
+                return -errno;
+
+        trigger = accept4(listener, NULL, NULL, SOCK_NONBLOCK|SOCK_CLOEXEC);
+        if (trigger < 0)
+                return -errno;
+
+        *ret_fd = TAKE_FD(fd);
+        return trigger;
+}
+
+static void fire_trigger(sd_event *e, int fd, int trigger) {
+        char c;
+
+        assert_se(send(fd, "x", 1, MSG_OOB) == 1);
+        assert_se(sd_event_run(e, 5 * USEC_PER_SEC) > 0);
+
+        /* The kernel reports each event only once, hence acknowledge it */
+        assert_se(recv(trigger, &c, 1, MSG_OOB) == 1);
+}
+
+static void test_fake_triggers(void) {
+        _cleanup_(memory_pressure_freep) MemoryPressure *mp = NULL;
+        _cleanup_(sd_event_unrefp) sd_event *e = NULL;
+        _cleanup_close_ int some_fd = -1, full_fd = -1;
+        int some_trigger, full_trigger;
+        Cache a = {}, b = {};
+
+        log_info("/* %s */", __func__);
+
+        some_trigger = make_trigger(&some_fd);
+        if (some_trigger < 0) {
+                log_notice_errno(some_trigger, "Cannot create loopback sockets, skipping: %m");
+                return;
+        }
+        assert_se((full_trigger = make_trigger(&full_fd)) >= 0);
+
+        assert_se(sd_event_new(&e) >= 0);
+
+        /* The MemoryPressure object takes possession of the triggers */
+        assert_se(memory_pressure_new_from_fds(e, some_trigger, full_trigger, &mp) >= 0);
+
+        assert_se(memory_pressure_add_handler(mp, handler, &a) >= 0);
+        assert_se(memory_pressure_add_handler(mp, handler, &b) >= 0);
+
+        cache_fill(&a);
+        cache_fill(&b);
+
+        /* Nothing happens without pressure */
+        assert_se(sd_event_run(e, 0) == 0);
+        assert_se(memory_pressure_get_level(mp) == MEMORY_PRESSURE_NONE);
+        assert_se(a.n_calls == 0 && b.n_calls == 0);
+
+        /* Some pressure: every handler is called, and trims its cache */
+        fire_trigger(e, some_fd, some_trigger);
+        assert_se(memory_pressure_get_level(mp) == MEMORY_PRESSURE_SOME);
+        assert_se(a.n_calls == 1 && b.n_calls == 1);
+        assert_se(a.n_entries == N_CACHE_ENTRIES / 2 && b.n_entries == N_CACHE_ENTRIES / 2);
+
+        /* More reports of the same level while the stall goes on don't trim any further */
+        fire_trigger(e, some_fd, some_trigger);
+        assert_se(memory_pressure_get_level(mp) == MEMORY_PRESSURE_SOME);
+        assert_se(a.n_calls == 1 && b.n_calls == 1);
+        assert_se(a.n_entries == N_CACHE_ENTRIES / 2 && b.n_entries == N_CACHE_ENTRIES / 2);
+
+        /* Full pressure: everything is dropped */
+        fire_trigger(e, full_fd, full_trigger);
+        assert_se(memory_pressure_get_level(mp) == MEMORY_PRESSURE_FULL);
+        assert_se(a.n_calls == 2 && b.n_calls == 2);
+        assert_se(a.n_entries == 0 && b.n_entries == 0);
+
+        /* Some pressure on top of full pressure isn't news */
+        fire_trigger(e, some_fd, some_trigger);
+        assert_se(memory_pressure_get_level(mp) == MEMORY_PRESSURE_FULL);
+        assert_se(a.n_calls == 2 && b.n_calls == 2);
+}
+
+static void test_real_triggers(void) {
+        _cleanup_(memory_pressure_freep) MemoryPressure *mp = NULL;
+        _cleanup_(sd_event_unrefp) sd_event *e = NULL;
+        Cache c = {};
+        int r;
+
+        log_info("/* %s */", __func__);
+
+        assert_se(sd_event_new(&e) >= 0);
+
+        r = memory_pressure_new(e, &mp);
+        if (r < 0) {
+                log_notice_errno(r, "Memory pressure information not available, skipping: %m");
+                return;
+        }
+
+        assert_se(memory_pressure_add_handler(mp, handler, &c) >= 0);
+
+        /* Unless the machine is really short on memory right now, nothing happens, but if something does,
+         * the level and the handler calls agree */
+        assert_se(sd_event_run(e, 100 * USEC_PER_MSEC) >= 0);
+        assert_se((c.n_calls == 0) == (memory_pressure_get_level(mp) == MEMORY_PRESSURE_NONE));
+}
+
+int main(int argc, char *argv[]) {
+        test_setup_logging(LOG_DEBUG);
+
+        assert_se(memory_pressure_get_level(NULL) == MEMORY_PRESSURE_NONE);
+
+        test_fake_triggers();
+        test_real_triggers();
+
+        return 0;
+}
@@ -0,0 +1,151 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <sched.h>
+#include <sys/mount.h>
+#include <unistd.h>
+
+#include "alloc-util.h"
+#include "fstab-util.h"
+#include "manager.h"
+#include "mkdir.h"
+#include "mount.h"
+#include "path-util.h"
+#include "rm-rf.h"
+#include "string-util.h"
+#include "test-helper.h"
+#include "tests.h"
+#include "tmpfile-util.h"
+#include "unit-name.h"
+
+static Mount *find_mount(Manager *m, const char *where) {
+        _cleanup_free_ char *name = NULL;
+        Unit *u;
+
+        assert_se(unit_name_from_path(where, ".mount", &name) >= 0);
+
+        u = manager_get_unit(m, name);
+        return u ? MOUNT(u) : NULL;
+}
+
+static bool mount_has_options(Mount *mount, const char *option) {
+        return mount->from_proc_self_mountinfo &&
+                fstab_test_option(mount->parameters_proc_self_mountinfo.options, option);
+}
+
+static Mount *wait_for_mount(Manager *m, const char *where, bool mounted, const char *option) {
+        usec_t deadline;
+        Mount *mount;
+
+        /* Runs the event loop until the unit of the mount point is in the expected state. Units of mount points
+         * that went away might be gone, too. */
+
+        deadline = usec_add(now(CLOCK_MONOTONIC), 10 * USEC_PER_SEC);
+
+        for (;;) {
+                mount = find_mount(m, where);
+                if (mounted) {
+                        if (mount && mount->state == MOUNT_MOUNTED &&
+                            (!option || mount_has_options(mount, option)))
+                                return mount;
+                } else if (!mount || mount->state == MOUNT_DEAD)
+                        return mount;
+
+                assert_se(now(CLOCK_MONOTONIC) < deadline);
+                assert_se(sd_event_run(m->event, 100 * USEC_PER_MSEC) >= 0);
+        }
+}
+
+static void test_mountinfo_changes(Manager *m, const char *dir) {
+        _cleanup_free_ char *a = NULL, *b = NULL, *c = NULL;
+        Mount *ma, *mb;
+        unsigned k;
+
+        log_info("/* %s */", __func__);
+
+        assert_se(a = path_join(dir, "a"));
+        assert_se(b = path_join(dir, "b"));
+        assert_se(c = path_join(dir, "c"));
+        assert_se(mkdir_p(a, 0755) >= 0);
+        assert_se(mkdir_p(b, 0755) >= 0);
+        assert_se(mkdir_p(c, 0755) >= 0);
+
+        /* New mount points show up */
+        assert_se(mount("tmpfs", a, "tmpfs", 0, "mode=0755") >= 0);
+        ma = wait_for_mount(m, a, true, NULL);
+        assert_se(streq_ptr(ma->parameters_proc_self_mountinfo.what, "tmpfs"));
+        assert_se(streq_ptr(ma->parameters_proc_self_mountinfo.fstype, "tmpfs"));
+
+        /* Others are left alone */
+        assert_se(mount("tmpfs", b, "tmpfs", 0, "mode=0755") >= 0);
+        mb = wait_for_mount(m, b, true, NULL);
+        assert_se(find_mount(m, a) == ma);
+        assert_se(ma->state == MOUNT_MOUNTED);
+
+        /* Changed entries are picked up */
+        assert_se(mount(NULL, a, NULL, MS_REMOUNT|MS_RDONLY, "mode=0755") >= 0);
+        assert_se(wait_for_mount(m, a, true, "ro\0") == ma);
+        assert_se(mb->state == MOUNT_MOUNTED);
+
+        /* And removed ones, too */
+        assert_se(umount(a) >= 0);
+        (void) wait_for_mount(m, a, false, NULL);
+        assert_se(find_mount(m, b) == mb);
+        assert_se(mb->state == MOUNT_MOUNTED);
+
+        /* Mounts stacked on the same mount point: the topmost one determines the parameters, and the unit stays
+         * around until the last one is gone */
+        assert_se(mount("tmpfs", b, "tmpfs", MS_RDONLY, "mode=0755") >= 0);
+        assert_se(wait_for_mount(m, b, true, "ro\0") == mb);
+        assert_se(umount(b) >= 0);
+        assert_se(wait_for_mount(m, b, true, "rw\0") == mb);
+        assert_se(umount(b) >= 0);
+        (void) wait_for_mount(m, b, false, NULL);
+
+        /* A storm of changes is rate limited, but the end result is still picked up */
+        for (k = 0; k < 20; k++) {
+                assert_se(mount("tmpfs", c, "tmpfs", 0, "mode=0755") >= 0);
+                assert_se(sd_event_run(m->event, 0) >= 0);
+                assert_se(umount(c) >= 0);
+                assert_se(sd_event_run(m->event, 0) >= 0);
+        }
+        assert_se(m->mount_rescan_event_source);
+
+        assert_se(mount("tmpfs", c, "tmpfs", 0, "mode=0755") >= 0);
+        (void) wait_for_mount(m, c, true, NULL);
+        assert_se(umount(c) >= 0);
+        (void) wait_for_mount(m, c, false, NULL);
+}
+
+int main(int argc, char *argv[]) {
+        _cleanup_(rm_rf_physical_and_freep) char *runtime_dir = NULL, *dir = NULL;
+        _cleanup_(manager_freep) Manager *m = NULL;
+        int r;
+
+        test_setup_logging(LOG_DEBUG);
+
+        if (getuid() != 0)
+                return log_tests_skipped("not root");
+
+        /* Don't let the mounts of the test leak into the rest of the system */
+        if (unshare(CLONE_NEWNS) < 0)
+                return log_tests_skipped_errno(errno, "unshare(CLONE_NEWNS)");
+        if (mount(NULL, "/", NULL, MS_SLAVE|MS_REC, NULL) < 0)
+                return log_tests_skipped_errno(errno, "mount(MS_SLAVE|MS_REC)");
+
+        r = enter_cgroup_subroot();
+        if (r == -ENOMEDIUM)
+                return log_tests_skipped("cgroupfs not available");
+
+        assert_se(runtime_dir = setup_fake_runtime_dir());
+        assert_se(mkdtemp_malloc("/tmp/test-mount.XXXXXX", &dir) >= 0);
+
+        r = manager_new(UNIT_FILE_USER, MANAGER_TEST_RUN_BASIC, &m);
+        if (MANAGER_SKIP_TEST(r))
+                return log_tests_skipped_errno(r, "manager_new");
+        assert_se(r >= 0);
+        assert_se(manager_startup(m, NULL, NULL) >= 0);
+
+        test_mountinfo_changes(m, dir);
+
+        return 0;
+}
@@ -1,5 +1,7 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 
+#include <fcntl.h>
+#include <sched.h>
 #include <sys/socket.h>
 
 #include "alloc-util.h"
@@ -104,10 +106,56 @@ static int test_netns(void) {
         return EXIT_SUCCESS;
 }
 
+static int test_mntns(void) {
+        _cleanup_close_pair_ int s[2] = { -1, -1 };
+        struct stat host, st;
+        pid_t pid;
+        int r;
+
+        if (geteuid() > 0)
+                return log_tests_skipped("not root");
+
+        assert_se(socketpair(AF_UNIX, SOCK_DGRAM, 0, s) >= 0);
+        assert_se(stat("/proc/self/ns/mnt", &host) >= 0);
+
+        /* The first one finds nothing stored, and stores the namespace it set up */
+        pid = fork();
+        assert_se(pid >= 0);
+
+        if (pid == 0) {
+                _cleanup_close_ int fd = -1;
+
+                assert_se(mntns_storage_join(s) == 0);
+                assert_se((fd = open("/proc/self/ns", O_RDONLY|O_DIRECTORY|O_CLOEXEC)) >= 0);
+                assert_se(unshare(CLONE_NEWNS) >= 0);
+                assert_se(mntns_storage_store(s, fd) >= 0);
+                _exit(EXIT_SUCCESS);
+        }
+
+        assert_se(wait_for_terminate_and_check("mntns1", pid, WAIT_LOG) == EXIT_SUCCESS);
+
+        /* The second one joins it, even though the first one is gone by now */
+        pid = fork();
+        assert_se(pid >= 0);
+
+        if (pid == 0) {
+                assert_se(mntns_storage_join(s) == 1);
+                assert_se(stat("/proc/self/ns/mnt", &st) >= 0);
+                assert_se(st.st_ino != host.st_ino);
+                _exit(EXIT_SUCCESS);
+        }
+
+        r = wait_for_terminate_and_check("mntns2", pid, WAIT_LOG);
+        assert_se(r == EXIT_SUCCESS);
+
+        return EXIT_SUCCESS;
+}
+
 int main(int argc, char *argv[]) {
         sd_id128_t bid;
         char boot_id[SD_ID128_STRING_MAX];
         _cleanup_free_ char *x = NULL, *y = NULL, *z = NULL, *zz = NULL;
+        int r;
 
         test_setup_logging(LOG_INFO);
 
@@ -132,5 +180,9 @@ int main(int argc, char *argv[]) {
 
         test_tmpdir("sys-devices-pci0000:00-0000:00:1a.0-usb3-3\\x2d1-3\\x2d1:1.0-bluetooth-hci0.device", z, zz);
 
-        return test_netns();
+        r = test_netns();
+        if (r != EXIT_SUCCESS)
+                return r;
+
+        return test_mntns();
 }
@@ -6,6 +6,7 @@
 #include "prioq.h"
 #include "set.h"
 #include "siphash24.h"
+#include "tests.h"
 #include "util.h"
 
 #define SET_SIZE 1024*4
@@ -67,6 +68,7 @@ static void test_struct(void) {
         srand(0);
 
         assert_se(q = prioq_new((compare_func_t) test_compare));
+        assert_se(prioq_reserve(q, SET_SIZE) >= 0);
         assert_se(s = set_new(&test_hash_ops));
 
         for (i = 0; i < SET_SIZE; i++) {
@@ -81,6 +83,7 @@ static void test_struct(void) {
 
         while ((t = set_steal_first(s))) {
                 assert_se(prioq_remove(q, t, &t->idx) == 1);
+                assert_se(t->idx == PRIOQ_IDX_NULL);
                 assert_se(prioq_remove(q, t, &t->idx) == 0);
                 assert_se(prioq_remove(q, t, NULL) == 0);
 
@@ -103,10 +106,65 @@ static void test_struct(void) {
         assert_se(set_isempty(s));
 }
 
+typedef struct TimerBenchmark {
+        struct test *tests;
+        unsigned n;
+} TimerBenchmark;
+
+static void timers(void *userdata) {
+        TimerBenchmark *b = userdata;
+        _cleanup_(prioq_freep) Prioq *q = NULL;
+        unsigned i, previous = 0;
+        struct test *t;
+
+        srand(0);
+
+        assert_se(q = prioq_new((compare_func_t) test_compare));
+
+        for (i = 0; i < b->n; i++) {
+                b->tests[i].value = (unsigned) rand();
+                assert_se(prioq_put(q, b->tests + i, &b->tests[i].idx) >= 0);
+        }
+
+        for (i = 0; i < 4 * b->n; i++) {
+                assert_se(t = prioq_peek(q));
+                t->value += (unsigned) rand() % (1U << 24);
+                assert_se(prioq_reshuffle(q, t, &t->idx) == 1);
+
+                t = b->tests + (unsigned) rand() % b->n;
+                t->value = (unsigned) rand();
+                assert_se(prioq_reshuffle(q, t, &t->idx) == 1);
+        }
+
+        for (i = 0; i < b->n; i++) {
+                assert_se(t = prioq_pop(q));
+                assert_se(previous <= t->value);
+                previous = t->value;
+        }
+
+        assert_se(prioq_isempty(q));
+}
+
+static void test_benchmark(void) {
+        _cleanup_free_ struct test *tests = NULL;
+        unsigned n;
+
+        /* Something like a busy event loop: lots of timers, the earliest of which are dispatched and rearmed
+         * over and over again, while others are reconfigured in place */
+
+        n = slow_tests_enabled() ? 1U << 20 : 1U << 14;
+
+        assert_se(tests = new(struct test, n));
+
+        log_info("%s (%u items, %u reshuffles)", __func__, n, 8 * n);
+        benchmark_run("prioq-timers", 8 * n, timers, &(TimerBenchmark) { tests, n });
+}
+
 int main(int argc, char* argv[]) {
 
         test_unsigned();
         test_struct();
+        test_benchmark();
 
         return 0;
 }
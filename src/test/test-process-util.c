@@ -31,11 +31,11 @@
 static void test_get_process_comm(pid_t pid) {
         struct stat st;
         _cleanup_free_ char *a = NULL, *c = NULL, *d = NULL, *f = NULL, *i = NULL;
-        _cleanup_free_ char *env = NULL;
+        _cleanup_free_ char *env = NULL, *capeff = NULL;
         char path[STRLEN("/proc//comm") + DECIMAL_STR_MAX(pid_t)];
         pid_t e;
-        uid_t u;
-        gid_t g;
+        uid_t u, u2;
+        gid_t g, g2;
         dev_t h;
         int r;
 
@@ -75,6 +75,11 @@ static void test_get_process_comm(pid_t pid) {
         log_info("PID"PID_FMT" GID: "GID_FMT, pid, g);
         assert_se(g == 0 || pid != 1);
 
+        assert_se(get_process_status(pid, &u2, &g2, &capeff) == 0);
+        log_info("PID"PID_FMT" UID: "UID_FMT" GID: "GID_FMT" CapEff: %s", pid, u2, g2, capeff);
+        assert_se(pid == 0 || (u == u2 && g == g2));
+        assert_se(*capeff);
+
         r = get_process_environ(pid, &env);
         assert_se(r >= 0 || r == -EACCES);
         log_info("PID"PID_FMT" strlen(environ): %zi", pid, env ? (ssize_t)strlen(env) : (ssize_t)-errno);
@@ -24,6 +24,10 @@ int main(int argc, char *argv[]) {
         assert_se(procfs_tasks_get_current(&v) >= 0);
         log_info("Current number of tasks: %" PRIu64, v);
 
+        assert_se(procfs_tasks_get_runnable(&v) >= 0);
+        log_info("Current number of runnable tasks: %" PRIu64, v);
+        assert_se(v > 0);
+
         assert_se(procfs_tasks_get_limit(&v) >= 0);
         log_info("Limit of tasks: %" PRIu64, v);
         assert_se(v > 0);
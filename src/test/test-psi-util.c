@@ -0,0 +1,52 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <errno.h>
+
+#include "alloc-util.h"
+#include "fd-util.h"
+#include "fileio.h"
+#include "fs-util.h"
+#include "psi-util.h"
+#include "tests.h"
+#include "tmpfile-util.h"
+
+static void test_read_pressure_totals(void) {
+        _cleanup_(unlink_tempfilep) char path[] = "/tmp/pressurereadXXXXXX";
+        usec_t totals[_PRESSURE_TYPE_MAX];
+        _cleanup_close_ int fd = -1;
+
+        fd = mkostemp_safe(path);
+        assert_se(fd >= 0);
+
+        assert_se(read_pressure_totals("/verylikelynonexistentpath", totals) == -ENOENT);
+
+        assert_se(write_string_file(path,
+                                    "some avg10=0.22 avg60=0.17 avg300=1.11 total=58761459\n"
+                                    "full avg10=0.23 avg60=0.16 avg300=1.08 total=58464525", WRITE_STRING_FILE_CREATE) == 0);
+        assert_se(read_pressure_totals(path, totals) == 0);
+        assert_se(totals[PRESSURE_TYPE_SOME] == 58761459);
+        assert_se(totals[PRESSURE_TYPE_FULL] == 58464525);
+
+        /* Older kernels have no "full" line in cpu.pressure */
+        assert_se(write_string_file(path,
+                                    "some avg10=0.00 avg60=0.00 avg300=0.00 total=42", WRITE_STRING_FILE_CREATE) == 0);
+        assert_se(read_pressure_totals(path, totals) == 0);
+        assert_se(totals[PRESSURE_TYPE_SOME] == 42);
+        assert_se(totals[PRESSURE_TYPE_FULL] == USEC_INFINITY);
+
+        assert_se(write_string_file(path,
+                                    "some avg10=0.00 avg60=0.00 avg300=0.00\n", WRITE_STRING_FILE_CREATE) == 0);
+        assert_se(read_pressure_totals(path, totals) == -EBADMSG);
+
+        assert_se(write_string_file(path,
+                                    "some avg10=0.00 avg60=0.00 avg300=0.00 total=foo\n", WRITE_STRING_FILE_CREATE) == 0);
+        assert_se(read_pressure_totals(path, totals) == -EINVAL);
+}
+
+int main(int argc, char *argv[]) {
+        test_setup_logging(LOG_DEBUG);
+
+        test_read_pressure_totals();
+
+        return 0;
+}
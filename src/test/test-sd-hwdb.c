@@ -1,8 +1,17 @@
+#include <sys/stat.h>
+
 #include "sd-hwdb.h"
 
 #include "alloc-util.h"
 #include "errno.h"
+#include "fileio.h"
+#include "hwdb-util.h"
+#include "mkdir.h"
+#include "rm-rf.h"
+#include "string-util.h"
 #include "tests.h"
+#include "time-util.h"
+#include "tmpfile-util.h"
 
 static int test_failed_enumerate(void) {
         _cleanup_(sd_hwdb_unrefp) sd_hwdb *hwdb = NULL;
@@ -59,16 +68,101 @@ static void test_basic_enumerate(void) {
         assert_se(len1 == len2);
 }
 
+static void test_lookup_speed(void) {
+        static const char * const modaliases[] = {
+                "usb:v1D6Bp0002d0419dc09dsc00dp01ic09isc00ip00in00",
+                "pci:v00008086d00001237sv00001AF4sd00001100bc06sc00i00",
+                "acpi:PNP0A03:",
+                "input:b0011v0001p0001eAB41-e0,1,4,11,14,k71,72,73,74,75,ram4,l0,1,2,sfw",
+                DELL_MODALIAS,
+                "no-such-modalias-should-exist",
+        };
+        _cleanup_(sd_hwdb_unrefp) sd_hwdb *hwdb = NULL;
+        unsigned i, j, n = 0;
+        const char *value;
+        usec_t t;
+
+        log_info("/* %s */", __func__);
+
+        assert_se(sd_hwdb_new(&hwdb) == 0);
+
+        t = now(CLOCK_MONOTONIC);
+        for (i = 0; i < 1000; i++)
+                for (j = 0; j < ELEMENTSOF(modaliases); j++) {
+                        (void) sd_hwdb_get(hwdb, modaliases[j], "ID_VENDOR_FROM_DATABASE", &value);
+                        n++;
+                }
+        t = now(CLOCK_MONOTONIC) - t;
+
+        log_info("%u lookups in "USEC_FMT" µs, %.2f µs per lookup", n, t, (double) t / n);
+}
+
+static bool file_contains(const char *path, const char *s) {
+        _cleanup_free_ char *text = NULL;
+        size_t size;
+
+        assert_se(read_full_file(path, &text, &size) >= 0);
+        return memmem(text, size, s, strlen(s) + 1);
+}
+
+static void test_update_incremental(void) {
+        _cleanup_(rm_rf_physical_and_freep) char *t = NULL;
+        const char *a, *b, *bin;
+        struct stat st1, st2;
+
+        log_info("/* %s */", __func__);
+
+        assert_se(mkdtemp_malloc(NULL, &t) >= 0);
+        a = strjoina(t, "/etc/udev/hwdb.d/10-a.hwdb");
+        b = strjoina(t, "/etc/udev/hwdb.d/20-b.hwdb");
+        bin = strjoina(t, "/etc/udev/hwdb.bin");
+
+        assert_se(mkdir_parents(a, 0755) >= 0);
+        assert_se(write_string_file(a, "usb:v1234*\n ID_A=value-a\n ID_B=value-a-b", WRITE_STRING_FILE_CREATE) >= 0);
+        assert_se(write_string_file(b, "usb:v1234p5678*\n ID_B=value-b", WRITE_STRING_FILE_CREATE) >= 0);
+
+        assert_se(hwdb_update(t, NULL, true, false, false) >= 0);
+        assert_se(stat(bin, &st1) >= 0);
+        /* the values of both files are kept, readers pick the one of the later file */
+        assert_se(file_contains(bin, "value-a-b"));
+        assert_se(file_contains(bin, "value-b"));
+
+        /* nothing changed, hence the database is not written again */
+        assert_se(hwdb_update(t, NULL, true, false, true) >= 0);
+        assert_se(stat(bin, &st2) >= 0);
+        assert_se(st1.st_ino == st2.st_ino);
+
+        /* the values of the first file are taken from the database, the second file is parsed again */
+        assert_se(write_string_file(b, "usb:v1234p5678*\n ID_C=value-c-new", WRITE_STRING_FILE_CREATE) >= 0);
+        assert_se(hwdb_update(t, NULL, true, false, true) >= 0);
+        assert_se(stat(bin, &st2) >= 0);
+        assert_se(st1.st_ino != st2.st_ino);
+        assert_se(file_contains(bin, "value-a"));
+        assert_se(file_contains(bin, "value-a-b"));
+        assert_se(file_contains(bin, "value-c-new"));
+        assert_se(!file_contains(bin, "value-b"));
+
+        /* a database without the sources is rebuilt */
+        assert_se(hwdb_update(t, NULL, true, true, false) >= 0);
+        assert_se(unlink(a) >= 0);
+        assert_se(hwdb_update(t, NULL, true, false, true) >= 0);
+        assert_se(!file_contains(bin, "value-a"));
+        assert_se(file_contains(bin, "value-c-new"));
+}
+
 int main(int argc, char *argv[]) {
         int r;
 
         test_setup_logging(LOG_DEBUG);
 
+        test_update_incremental();
+
         r = test_failed_enumerate();
         if (r < 0)
                 return log_tests_skipped_errno(r, "cannot open hwdb");
 
         test_basic_enumerate();
+        test_lookup_speed();
 
         return 0;
 }
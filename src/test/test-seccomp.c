@@ -693,6 +693,58 @@ static void test_load_syscall_filter_set_raw(void) {
         assert_se(wait_for_terminate_and_check("syscallrawseccomp", pid, WAIT_LOG) == EXIT_SUCCESS);
 }
 
+static void test_compile_syscall_filter_set_raw(void) {
+        _cleanup_(seccomp_compiled_filter_freep) SeccompCompiledFilter *f = NULL;
+        _cleanup_hashmap_free_ Hashmap *s = NULL;
+        pid_t pid;
+
+        log_info("/* %s */", __func__);
+
+        if (!is_seccomp_available()) {
+                log_notice("Seccomp not available, skipping %s", __func__);
+                return;
+        }
+        if (geteuid() != 0) {
+                log_notice("Not root, skipping %s", __func__);
+                return;
+        }
+
+        /* An empty filter that allows everything compiles to no programs at all */
+        assert_se(seccomp_compile_syscall_filter_set_raw(SCMP_ACT_ALLOW, NULL, SCMP_ACT_KILL, true, &f) >= 0);
+        assert_se(f->n_programs == 0);
+        f = seccomp_compiled_filter_free(f);
+
+        assert_se(s = hashmap_new(NULL));
+#if SCMP_SYS(access) >= 0
+        assert_se(hashmap_put(s, UINT32_TO_PTR(__NR_access + 1), INT_TO_PTR(-1)) >= 0);
+#else
+        assert_se(hashmap_put(s, UINT32_TO_PTR(__NR_faccessat + 1), INT_TO_PTR(-1)) >= 0);
+#endif
+
+        assert_se(seccomp_compile_syscall_filter_set_raw(SCMP_ACT_ALLOW, s, SCMP_ACT_ERRNO(EUCLEAN), true, &f) >= 0);
+        assert_se(f->n_programs > 0);
+
+        /* The same compiled filter may be loaded into any number of processes */
+        for (unsigned i = 0; i < 2; i++) {
+                pid = fork();
+                assert_se(pid >= 0);
+
+                if (pid == 0) {
+                        assert_se(access("/", F_OK) >= 0);
+
+                        assert_se(seccomp_load_compiled_filter(f) >= 0);
+
+                        assert_se(access("/", F_OK) < 0);
+                        assert_se(errno == EUCLEAN);
+                        assert_se(poll(NULL, 0, 0) == 0);
+
+                        _exit(EXIT_SUCCESS);
+                }
+
+                assert_se(wait_for_terminate_and_check("compiledseccomp", pid, WAIT_LOG) == EXIT_SUCCESS);
+        }
+}
+
 static void test_lock_personality(void) {
         unsigned long current;
         pid_t pid;
@@ -762,6 +814,7 @@ int main(int argc, char *argv[]) {
         test_memory_deny_write_execute_shmat();
         test_restrict_archs();
         test_load_syscall_filter_set_raw();
+        test_compile_syscall_filter_set_raw();
         test_lock_personality();
 
         return 0;
@@ -191,6 +191,66 @@ static void test_serialize_environment(void) {
         assert_se(strv_equal(env, env2));
 }
 
+static void test_deserialize_read_line_one(bool binary) {
+        _cleanup_(unlink_tempfilep) char fn[] = "/tmp/test-serialize.XXXXXX";
+        _cleanup_fclose_ FILE *f = NULL;
+        const char *expected[] = { "a=bbb", "b=", "c=1 2", "", "foo.service", "d=x=y", "" };
+        size_t i;
+
+        assert_se(fmkostemp_safe(fn, "r+", &f) == 0);
+        log_info("/* %s(%s) (%s) */", __func__, yes_no(binary), fn);
+
+        if (binary)
+                serialize_begin_binary(f);
+
+        assert_se(serialize_item(f, "a", "bbb") == 1);
+        assert_se(serialize_item(f, "b", "") == 1);
+        assert_se(serialize_item_format(f, "c", "%i %i", 1, 2) == 1);
+        assert_se(serialize_item(f, long_string, "a") == -EINVAL);
+        assert_se(serialize_end_marker(f) >= 0);
+        assert_se(serialize_marker(f, "foo.service") >= 0);
+        assert_se(serialize_item(f, "d", "x=y") == 1);
+        assert_se(serialize_end_marker(f) >= 0);
+
+        if (binary)
+                serialize_end_binary(f);
+
+        assert_se(fflush_and_check(f) == 0);
+        rewind(f);
+
+        for (i = 0; i < ELEMENTSOF(expected); i++) {
+                _cleanup_free_ char *line = NULL;
+
+                assert_se(deserialize_read_line(f, &line) > 0);
+                assert_se(streq(line, expected[i]));
+        }
+
+        _cleanup_free_ char *line = NULL;
+        assert_se(deserialize_read_line(f, &line) == 0);
+        assert_se(!line);
+}
+
+static void test_deserialize_read_line(void) {
+        test_deserialize_read_line_one(false);
+        test_deserialize_read_line_one(true);
+}
+
+static void test_deserialize_read_line_bad_version(void) {
+        _cleanup_(unlink_tempfilep) char fn[] = "/tmp/test-serialize.XXXXXX";
+        _cleanup_fclose_ FILE *f = NULL;
+        _cleanup_free_ char *line = NULL;
+
+        assert_se(fmkostemp_safe(fn, "r+", &f) == 0);
+        log_info("/* %s (%s) */", __func__, fn);
+
+        /* A header announcing a future version of the binary format */
+        fputs("\x1f\x7f", f);
+        assert_se(fflush_and_check(f) == 0);
+        rewind(f);
+
+        assert_se(deserialize_read_line(f, &line) == -EPROTONOSUPPORT);
+}
+
 int main(int argc, char *argv[]) {
         test_setup_logging(LOG_INFO);
 
@@ -203,6 +263,8 @@ int main(int argc, char *argv[]) {
         test_serialize_strv();
         test_deserialize_environment();
         test_serialize_environment();
+        test_deserialize_read_line();
+        test_deserialize_read_line_bad_version();
 
         return EXIT_SUCCESS;
 }
@@ -1,6 +1,8 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 
 #include "siphash24.h"
+#include "stdio-util.h"
+#include "tests.h"
 #include "util.h"
 
 #define ITERATIONS 10000000ULL
@@ -85,6 +87,43 @@ static void test_short_hashes(void) {
         }
 }
 
+typedef struct HashBenchmark {
+        uint8_t buf[1024];
+        size_t size, n;
+        uint64_t x;
+} HashBenchmark;
+
+static void hashes(void *userdata) {
+        static const uint8_t key[16] = { 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+                                         0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f };
+        HashBenchmark *b = userdata;
+        size_t i;
+
+        for (i = 0; i < b->n; i++) {
+                /* Make the input depend on the previous result, so that nothing is optimized away */
+                b->buf[0] = (uint8_t) b->x;
+                b->x = siphash24(b->buf, b->size, key);
+        }
+}
+
+static void test_benchmark(void) {
+        static const size_t sizes[] = { 8, 16, 32, 64, 1024 };
+        size_t total, i;
+
+        total = slow_tests_enabled() ? 256U << 20 : 1U << 20;
+
+        for (i = 0; i < ELEMENTSOF(sizes); i++) {
+                HashBenchmark b = {
+                        .size = sizes[i],
+                        .n = total / sizes[i],
+                };
+                char name[STRLEN("siphash24-") + DECIMAL_STR_MAX(size_t)];
+
+                xsprintf(name, "siphash24-%zu", sizes[i]);
+                benchmark_run(name, b.n, hashes, &b);
+        }
+}
+
 /* see https://131002.net/siphash/siphash.pdf, Appendix A */
 int main(int argc, char *argv[]) {
         const uint8_t in[15]  = { 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
@@ -104,4 +143,5 @@ int main(int argc, char *argv[]) {
         do_test(in_buf + 4, sizeof(in), key);
 
         test_short_hashes();
+        test_benchmark();
 }
@@ -0,0 +1,46 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include "string-pool.h"
+#include "string-util.h"
+#include "tests.h"
+
+static void test_string_pool(void) {
+        _cleanup_(string_pool_freep) StringPool *p = NULL;
+        const char *a, *b, *c;
+        char buf[] = "foo@.service";
+
+        assert_se(string_pool_size(p) == 0);
+        assert_se(!string_pool_unref(p, NULL));
+
+        assert_se(string_pool_intern(&p, "foo@.service", &a) == 1);
+        assert_se(string_pool_intern(&p, buf, &b) == 0);
+        assert_se(string_pool_intern(&p, "bar.service", &c) == 1);
+
+        /* Equal strings are stored once, and are pointer-comparable */
+        assert_se(a == b);
+        assert_se(a != buf);
+        assert_se(streq(a, "foo@.service"));
+        assert_se(streq(c, "bar.service"));
+        assert_se(string_pool_size(p) == 2);
+
+        /* Only the last reference frees the string */
+        assert_se(!string_pool_unref(p, a));
+        assert_se(string_pool_size(p) == 2);
+        assert_se(streq(b, "foo@.service"));
+        assert_se(!string_pool_unref(p, b));
+        assert_se(string_pool_size(p) == 1);
+
+        /* Interning again after that allocates a new copy */
+        assert_se(string_pool_intern(&p, buf, &a) == 1);
+        assert_se(string_pool_size(p) == 2);
+
+        /* Strings still referenced are freed with the pool */
+}
+
+int main(int argc, char *argv[]) {
+        test_setup_logging(LOG_DEBUG);
+
+        test_string_pool();
+
+        return 0;
+}
@@ -18,6 +18,7 @@
 #include "log.h"
 #include "logs-show.h"
 #include "machine-image.h"
+#include "memory-pressure.h"
 #include "mount.h"
 #include "path.h"
 #include "process-util.h"
@@ -29,6 +30,7 @@
 #include "slice.h"
 #include "socket-util.h"
 #include "socket.h"
+#include "string-table.h"
 #include "swap.h"
 #include "target.h"
 #include "test-tables.h"
@@ -38,7 +40,41 @@
 #include "util.h"
 #include "virt.h"
 
+/* Large enough to be looked up through a sorted index, with holes and duplicates */
+static const char* const sample_table[] = {
+        [0] = "zero",
+        [1] = "one",
+        [3] = "three",
+        [4] = "four",
+        [5] = "five",
+        [6] = "six",
+        [7] = "one",
+        [8] = "eight",
+        [9] = "nine",
+        [11] = "eleven",
+};
+
+DEFINE_PRIVATE_STRING_TABLE_LOOKUP(sample, int);
+
+static void test_sample_table(void) {
+        int i;
+
+        for (i = 0; i < (int) ELEMENTSOF(sample_table); i++)
+                if (sample_table[i] && i != 7)
+                        assert_se(sample_from_string(sample_table[i]) == i);
+
+        assert_se(sample_from_string("one") == 1);
+        assert_se(sample_from_string("two") == -1);
+        assert_se(sample_from_string("zzz") == -1);
+        assert_se(sample_from_string("") == -1);
+        assert_se(sample_from_string(NULL) == -1);
+        assert_se(sample_to_string(7) == sample_table[7]);
+        assert_se(sample_to_string(12) == NULL);
+}
+
 int main(int argc, char **argv) {
+        test_sample_table();
+
         test_table(architecture, ARCHITECTURE);
         test_table(assert_type, CONDITION_TYPE);
         test_table(automount_result, AUTOMOUNT_RESULT);
@@ -73,6 +109,7 @@ int main(int argc, char **argv) {
         test_table(mac_policy, MACPOLICY);
         test_table(manager_state, MANAGER_STATE);
         test_table(manager_timestamp, MANAGER_TIMESTAMP);
+        test_table(memory_pressure_level, MEMORY_PRESSURE_LEVEL);
         test_table(mount_exec_command, MOUNT_EXEC_COMMAND);
         test_table(mount_result, MOUNT_RESULT);
         test_table(mount_state, MOUNT_STATE);
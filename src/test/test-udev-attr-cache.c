@@ -0,0 +1,93 @@
+/* SPDX-License-Identifier: GPL-2.0+ */
+
+#include "device-private.h"
+#include "process-util.h"
+#include "string-util.h"
+#include "tests.h"
+#include "udev-attr-cache.h"
+
+#define SYSPATH "/sys/devices/virtual/mem/null"
+
+static void check_device(const char *expected_dev) {
+        _cleanup_(sd_device_unrefp) sd_device *dev = NULL;
+        const char *value;
+
+        assert_se(sd_device_new_from_syspath(&dev, SYSPATH) >= 0);
+
+        assert_se(udev_attr_cache_get_sysattr_value(dev, "dev", &value) >= 0);
+        assert_se(streq(value, expected_dev));
+        assert_se(udev_attr_cache_get_sysattr_value(dev, "does-not-exist", &value) == -ENOENT);
+
+        /* the value ended up in the cache of the device too */
+        assert_se(device_get_cached_sysattr_value(dev, "dev", &value) >= 0);
+        assert_se(streq(value, expected_dev));
+        assert_se(device_get_cached_sysattr_value(dev, "does-not-exist", &value) >= 0);
+        assert_se(!value);
+}
+
+static void test_attr_cache(const char *expected_dev) {
+        pid_t pid;
+        int r;
+
+        assert_se(udev_attr_cache_new() >= 0);
+
+        check_device(expected_dev);
+
+        /* another process gets the same from the shared cache */
+        r = safe_fork("(attr-cache)", FORK_DEATHSIG|FORK_LOG, &pid);
+        assert_se(r >= 0);
+        if (r == 0) {
+                check_device(expected_dev);
+                _exit(EXIT_SUCCESS);
+        }
+        assert_se(wait_for_terminate_and_check("(attr-cache)", pid, WAIT_LOG) == EXIT_SUCCESS);
+
+        udev_attr_cache_invalidate(SYSPATH);
+        check_device(expected_dev);
+
+        udev_attr_cache_flush();
+        check_device(expected_dev);
+
+        udev_attr_cache_free();
+}
+
+static void test_prefetch(const char *expected_dev) {
+        _cleanup_(sd_device_unrefp) sd_device *dev = NULL;
+        const char *names[] = { "dev", "does-not-exist", "uevent" }, *value;
+
+        assert_se(udev_attr_cache_new() >= 0);
+
+        assert_se(sd_device_new_from_syspath(&dev, SYSPATH) >= 0);
+        udev_attr_cache_prefetch(dev, names, ELEMENTSOF(names));
+
+        assert_se(device_get_cached_sysattr_value(dev, "dev", &value) >= 0);
+        assert_se(streq(value, expected_dev));
+        assert_se(device_get_cached_sysattr_value(dev, "does-not-exist", &value) >= 0);
+        assert_se(!value);
+        assert_se(device_get_cached_sysattr_value(dev, "uevent", &value) >= 0);
+        assert_se(startswith(value, "MAJOR="));
+
+        /* a directory is not an attribute, and not cached */
+        names[0] = "power";
+        udev_attr_cache_prefetch(dev, names, 1);
+        assert_se(device_get_cached_sysattr_value(dev, "power", &value) == -ENOENT);
+
+        udev_attr_cache_free();
+}
+
+int main(int argc, char *argv[]) {
+        _cleanup_(sd_device_unrefp) sd_device *dev = NULL;
+        const char *expected_dev;
+
+        test_setup_logging(LOG_DEBUG);
+
+        if (sd_device_new_from_syspath(&dev, SYSPATH) < 0)
+                return log_tests_skipped("/dev/null is not in sysfs");
+
+        assert_se(sd_device_get_sysattr_value(dev, "dev", &expected_dev) >= 0);
+
+        test_attr_cache(expected_dev);
+        test_prefetch(expected_dev);
+
+        return 0;
+}
@@ -0,0 +1,131 @@
+/* SPDX-License-Identifier: GPL-2.0+ */
+
+#include "alloc-util.h"
+#include "device-private.h"
+#include "stdio-util.h"
+#include "string-util.h"
+#include "strv.h"
+#include "tests.h"
+#include "udev-event-index.h"
+
+static sd_device *make_device(uint64_t seqnum, const char *devpath, const char *subsystem,
+                              const char *devnum, int ifindex, const char *devpath_old) {
+        _cleanup_strv_free_ char **l = NULL;
+        sd_device *dev;
+
+        assert_se(strv_extendf(&l, "SEQNUM=%" PRIu64, seqnum) >= 0);
+        assert_se(strv_extendf(&l, "DEVPATH=%s", devpath) >= 0);
+        assert_se(strv_extendf(&l, "SUBSYSTEM=%s", subsystem) >= 0);
+        assert_se(strv_extend(&l, "ACTION=add") >= 0);
+
+        if (devnum) {
+                const char *colon = strchr(devnum, ':');
+
+                assert_se(colon);
+                assert_se(strv_extendf(&l, "MAJOR=%.*s", (int) (colon - devnum), devnum) >= 0);
+                assert_se(strv_extendf(&l, "MINOR=%s", colon + 1) >= 0);
+        }
+        if (ifindex > 0)
+                assert_se(strv_extendf(&l, "IFINDEX=%i", ifindex) >= 0);
+        if (devpath_old)
+                assert_se(strv_extendf(&l, "DEVPATH_OLD=%s", devpath_old) >= 0);
+
+        assert_se(device_new_from_strv(&dev, l) >= 0);
+        return dev;
+}
+
+static struct event_index_entry *add(struct event_index **index, uint64_t seqnum, const char *devpath,
+                                     const char *subsystem, const char *devnum, int ifindex, const char *devpath_old) {
+        _cleanup_(sd_device_unrefp) sd_device *dev = NULL;
+        struct event_index_entry *e;
+
+        dev = make_device(seqnum, devpath, subsystem, devnum, ifindex, devpath_old);
+        assert_se(event_index_add(index, dev, seqnum, &e) >= 0);
+
+        return e;
+}
+
+static void test_tree(void) {
+        struct event_index *index = NULL;
+        struct event_index_entry *parent, *child, *sibling, *prefix, *grandchild;
+
+        parent = add(&index, 1, "/devices/a", "usb", NULL, 0, NULL);
+        child = add(&index, 2, "/devices/a/b", "usb", NULL, 0, NULL);
+        sibling = add(&index, 3, "/devices/c", "usb", NULL, 0, NULL);
+        prefix = add(&index, 4, "/devices/ab", "usb", NULL, 0, NULL);
+        grandchild = add(&index, 5, "/devices/a/b/c", "usb", NULL, 0, NULL);
+
+        assert_se(!event_index_entry_is_blocked(parent));
+        assert_se(event_index_entry_is_blocked(child));
+        assert_se(!event_index_entry_is_blocked(sibling));
+        assert_se(!event_index_entry_is_blocked(prefix));
+        assert_se(event_index_entry_is_blocked(grandchild));
+
+        /* The grandchild still waits for the child, once the parent is done */
+        event_index_entry_free(parent);
+        assert_se(!event_index_entry_is_blocked(child));
+        assert_se(event_index_entry_is_blocked(grandchild));
+
+        event_index_entry_free(child);
+        assert_se(!event_index_entry_is_blocked(grandchild));
+
+        /* A later event for the parent waits for the earlier one of the grandchild */
+        parent = add(&index, 6, "/devices/a", "usb", NULL, 0, NULL);
+        assert_se(event_index_entry_is_blocked(parent));
+        event_index_entry_free(grandchild);
+        assert_se(!event_index_entry_is_blocked(parent));
+
+        event_index_entry_free(parent);
+        event_index_entry_free(sibling);
+        event_index_entry_free(prefix);
+        event_index_free(index);
+}
+
+static void test_identical(void) {
+        struct event_index *index = NULL;
+        struct event_index_entry *a, *b, *c, *d, *e, *f, *g;
+
+        /* The same path without a device node or interface */
+        a = add(&index, 1, "/devices/virtual/misc/x", "misc", NULL, 0, NULL);
+        b = add(&index, 2, "/devices/virtual/misc/x", "misc", NULL, 0, NULL);
+        assert_se(!event_index_entry_is_blocked(a));
+        assert_se(event_index_entry_is_blocked(b));
+
+        /* With a device node, only the device node counts, and block and char devices are different */
+        c = add(&index, 3, "/devices/virtual/block/y", "block", "7:0", 0, NULL);
+        d = add(&index, 4, "/devices/virtual/block/y", "block", "7:1", 0, NULL);
+        e = add(&index, 5, "/devices/virtual/misc/z", "misc", "7:0", 0, NULL);
+        f = add(&index, 6, "/devices/virtual/block/w", "block", "7:0", 0, NULL);
+        assert_se(!event_index_entry_is_blocked(c));
+        assert_se(!event_index_entry_is_blocked(d));
+        assert_se(!event_index_entry_is_blocked(e));
+        assert_se(event_index_entry_is_blocked(f));
+
+        /* And the same for network interfaces */
+        g = add(&index, 7, "/devices/virtual/net/eth1", "net", NULL, 2, "/devices/virtual/block/y");
+        event_index_entry_free(b);
+        b = add(&index, 8, "/devices/virtual/net/eth0", "net", NULL, 2, NULL);
+        assert_se(event_index_entry_is_blocked(g)); /* by its old name */
+        assert_se(event_index_entry_is_blocked(b)); /* by its ifindex */
+        event_index_entry_free(c);
+        assert_se(event_index_entry_is_blocked(g));
+        event_index_entry_free(d);
+        assert_se(!event_index_entry_is_blocked(g));
+        event_index_entry_free(g);
+        assert_se(!event_index_entry_is_blocked(b));
+
+        event_index_entry_free(a);
+        event_index_entry_free(b);
+        event_index_entry_free(e);
+        event_index_entry_free(f);
+        event_index_free(index);
+}
+
+int main(int argc, char *argv[]) {
+        test_setup_logging(LOG_DEBUG);
+
+        test_tree();
+        test_identical();
+
+        return 0;
+}
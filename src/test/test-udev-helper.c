@@ -0,0 +1,84 @@
+/* SPDX-License-Identifier: GPL-2.0+ */
+
+#include <sys/stat.h>
+
+#include "alloc-util.h"
+#include "device-private.h"
+#include "fileio.h"
+#include "rm-rf.h"
+#include "string-util.h"
+#include "strv.h"
+#include "tests.h"
+#include "tmpfile-util.h"
+#include "udev-helper.h"
+
+/* A helper which echoes the argument and DEVPATH= of each request, fails on "fail", and never replies to "hang" */
+static const char helper_script[] =
+        "#!/bin/sh\n"
+        "while read -r cmd; do\n"
+        "        devpath=\n"
+        "        while read -r line && [ -n \"$line\" ]; do\n"
+        "                case \"$line\" in DEVPATH=*) devpath=\"${line#DEVPATH=}\";; esac\n"
+        "        done\n"
+        "        set -- $cmd\n"
+        "        case \"$2\" in\n"
+        "        fail) printf '1\\n\\n';;\n"
+        "        hang) read -r never;;\n"
+        "        *) printf '0\\nARG=%s\\nDEVPATH=%s\\nPID=%s\\n\\n' \"$2\" \"$devpath\" \"$$\";;\n"
+        "        esac\n"
+        "done\n";
+
+static void test_helper(void) {
+        _cleanup_(rm_rf_physical_and_freep) char *t = NULL;
+        _cleanup_(sd_device_unrefp) sd_device *dev = NULL;
+        _cleanup_strv_free_ char **l = NULL;
+        _cleanup_free_ char *pid = NULL;
+        char result[1024];
+        const char *helper, *cmd, *p;
+
+        assert_se(mkdtemp_malloc(NULL, &t) >= 0);
+        helper = strjoina(t, "/helper");
+        assert_se(write_string_file(helper, helper_script, WRITE_STRING_FILE_CREATE|WRITE_STRING_FILE_AVOID_NEWLINE) >= 0);
+        assert_se(chmod(helper, 0755) >= 0);
+
+        /* device_new_from_strv() modifies the strings */
+        assert_se(l = strv_new("ACTION=add", "DEVPATH=/devices/virtual/misc/test", "SUBSYSTEM=misc", "SEQNUM=1"));
+        assert_se(device_new_from_strv(&dev, l) >= 0);
+
+        cmd = strjoina(helper, " hello");
+        assert_se(udev_helper_run(dev, cmd, USEC_INFINITY, false, result, sizeof(result)) == 0);
+        log_info("reply: %s", result);
+        assert_se(startswith(result, "ARG=hello\nDEVPATH=/devices/virtual/misc/test\nPID="));
+        p = strrchr(result, '=');
+        assert_se(pid = strdup(p + 1));
+
+        /* The same helper handles the next request, even after a failure */
+        cmd = strjoina(helper, " fail");
+        assert_se(udev_helper_run(dev, cmd, USEC_INFINITY, true, result, sizeof(result)) == -EIO);
+        assert_se(isempty(result));
+
+        cmd = strjoina(helper, " again");
+        assert_se(udev_helper_run(dev, cmd, USEC_INFINITY, false, result, sizeof(result)) == 0);
+        assert_se(startswith(result, "ARG=again\n"));
+        assert_se(streq(strrchr(result, '=') + 1, pid));
+
+        /* A helper which does not reply in time is replaced */
+        cmd = strjoina(helper, " hang");
+        assert_se(udev_helper_run(dev, cmd, usec_add(now(CLOCK_MONOTONIC), 200 * USEC_PER_MSEC), false,
+                                  result, sizeof(result)) == -ETIMEDOUT);
+
+        cmd = strjoina(helper, " last");
+        assert_se(udev_helper_run(dev, cmd, USEC_INFINITY, false, result, sizeof(result)) == 0);
+        assert_se(startswith(result, "ARG=last\n"));
+        assert_se(!streq(strrchr(result, '=') + 1, pid));
+
+        udev_helpers_free();
+}
+
+int main(int argc, char *argv[]) {
+        test_setup_logging(LOG_DEBUG);
+
+        test_helper();
+
+        return 0;
+}
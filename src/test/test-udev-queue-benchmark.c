@@ -0,0 +1,164 @@
+/* SPDX-License-Identifier: GPL-2.0+ */
+
+/* Benchmarks the scheduling of the udevd event queue on a synthetic coldplug: all events are queued first, and then
+ * dispatched in passes over the queue, like event_queue_start() does, with at most CHILDREN_MAX events running at
+ * the same time, each of which finishes before the next pass. The latency of an event is the time from the start of
+ * the first pass until it is dispatched. Run it via "meson test --benchmark", or directly:
+ *
+ *     test-udev-queue-benchmark [N_EVENTS [CHILDREN_MAX]]
+ *
+ * The device tree is generated from a fixed seed, hence it is the same on every run. */
+
+#include <stdio.h>
+
+#include "alloc-util.h"
+#include "device-private.h"
+#include "parse-util.h"
+#include "strv.h"
+#include "tests.h"
+#include "time-util.h"
+#include "udev-event-index.h"
+
+struct bench_event {
+        char *devpath;
+        sd_device *dev;
+        struct event_index_entry *entry;
+        bool done;
+};
+
+static unsigned arg_n_events = 10000;
+static unsigned arg_children_max = 64;
+
+static uint32_t bench_random(uint32_t *state) {
+        /* A trivial LCG is good enough here, all we want is the same tree on every run */
+        *state = *state * 1103515245U + 12345U;
+        return *state >> 16;
+}
+
+static void make_events(struct bench_event *events) {
+        uint32_t seed = 4711;
+        unsigned k;
+
+        /* Each device is either a controller right below /devices, or the child of a random earlier device, so
+         * that parents are queued before their children, as they are by "udevadm trigger". Some of them are
+         * block devices or network interfaces. */
+        for (k = 0; k < arg_n_events; k++) {
+                _cleanup_strv_free_ char **l = NULL;
+                unsigned parent = bench_random(&seed) % (k + 1);
+
+                if (parent == k || k < 16)
+                        assert_se(asprintf(&events[k].devpath, "/devices/pci%04u", k) >= 0);
+                else
+                        assert_se(asprintf(&events[k].devpath, "%s/dev%u", events[parent].devpath, k) >= 0);
+
+                assert_se(strv_extendf(&l, "SEQNUM=%u", k + 1) >= 0);
+                assert_se(strv_extendf(&l, "DEVPATH=%s", events[k].devpath) >= 0);
+                assert_se(strv_extend(&l, "ACTION=add") >= 0);
+
+                if (k % 4 == 1) {
+                        assert_se(strv_extend(&l, "SUBSYSTEM=block") >= 0);
+                        assert_se(strv_extendf(&l, "MAJOR=%u", 8 + k / 256) >= 0);
+                        assert_se(strv_extendf(&l, "MINOR=%u", k % 256) >= 0);
+                } else if (k % 7 == 2) {
+                        assert_se(strv_extend(&l, "SUBSYSTEM=net") >= 0);
+                        assert_se(strv_extendf(&l, "IFINDEX=%u", k) >= 0);
+                } else
+                        assert_se(strv_extend(&l, "SUBSYSTEM=pci") >= 0);
+
+                assert_se(device_new_from_strv(&events[k].dev, l) >= 0);
+        }
+}
+
+static void bench(void) {
+        _cleanup_(event_index_freep) struct event_index *index = NULL;
+        char timespan[FORMAT_TIMESPAN_MAX];
+        usec_t start, t_queue, t_schedule, latency_sum = 0, latency_max = 0;
+        _cleanup_free_ struct bench_event *events = NULL;
+        _cleanup_free_ unsigned *running = NULL;
+        unsigned k, first = 0, n_done = 0, n_passes = 0;
+
+        assert_se(events = new0(struct bench_event, arg_n_events));
+        assert_se(running = new(unsigned, arg_children_max));
+        make_events(events);
+
+        start = now(CLOCK_MONOTONIC);
+        for (k = 0; k < arg_n_events; k++)
+                assert_se(event_index_add(&index, events[k].dev, k + 1, &events[k].entry) >= 0);
+        t_queue = now(CLOCK_MONOTONIC) - start;
+
+        start = now(CLOCK_MONOTONIC);
+        while (n_done < arg_n_events) {
+                unsigned n_running = 0;
+
+                for (k = first; k < arg_n_events && n_running < arg_children_max; k++) {
+                        usec_t latency;
+
+                        if (events[k].done || event_index_entry_is_blocked(events[k].entry))
+                                continue;
+
+                        latency = now(CLOCK_MONOTONIC) - start;
+                        latency_sum += latency;
+                        latency_max = MAX(latency_max, latency);
+
+                        events[k].done = true;
+                        running[n_running++] = k;
+                }
+
+                /* Something is always runnable, as the oldest event never waits */
+                assert_se(n_running > 0);
+
+                for (k = 0; k < n_running; k++)
+                        events[running[k]].entry = event_index_entry_free(events[running[k]].entry);
+                n_done += n_running;
+                n_passes++;
+
+                while (first < arg_n_events && events[first].done)
+                        first++;
+        }
+        t_schedule = now(CLOCK_MONOTONIC) - start;
+
+        printf("%u events, at most %u running, %u passes:\n", arg_n_events, arg_children_max, n_passes);
+        printf("  %-16s %s\n", "queue", format_timespan(timespan, sizeof(timespan), t_queue, 1));
+        printf("  %-16s %s\n", "schedule", format_timespan(timespan, sizeof(timespan), t_schedule, 1));
+        printf("  %-16s %s\n", "mean latency", format_timespan(timespan, sizeof(timespan), latency_sum / arg_n_events, 1));
+        printf("  %-16s %s\n", "max latency", format_timespan(timespan, sizeof(timespan), latency_max, 1));
+
+        for (k = 0; k < arg_n_events; k++) {
+                sd_device_unref(events[k].dev);
+                free(events[k].devpath);
+        }
+}
+
+static int parse_argv(int argc, char *argv[]) {
+        unsigned *args[] = { &arg_n_events, &arg_children_max };
+        int i, r;
+
+        if (argc > 1 + (int) ELEMENTSOF(args)) {
+                log_error("Usage: %s [N_EVENTS [CHILDREN_MAX]]", program_invocation_short_name);
+                return -EINVAL;
+        }
+
+        for (i = 1; i < argc; i++) {
+                r = safe_atou(argv[i], args[i - 1]);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to parse argument '%s': %m", argv[i]);
+        }
+
+        if (arg_n_events < 1 || arg_children_max < 1) {
+                log_error("At least one event and one child are required.");
+                return -EINVAL;
+        }
+
+        return 0;
+}
+
+int main(int argc, char *argv[]) {
+        test_setup_logging(LOG_INFO);
+
+        if (parse_argv(argc, argv) < 0)
+                return EXIT_FAILURE;
+
+        bench();
+
+        return EXIT_SUCCESS;
+}
@@ -1,5 +1,8 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 
+#include <signal.h>
+#include <unistd.h>
+
 #include "alloc-util.h"
 #include "log.h"
 #include "path-util.h"
@@ -22,12 +25,13 @@ static void test_mount_points_list(const char *fname) {
         assert_se(mount_points_list_get(fname, &mp_list_head) >= 0);
 
         LIST_FOREACH(mount_point, m, mp_list_head)
-                log_debug("path=%s o=%s f=0x%lx try-ro=%s dev=%u:%u",
+                log_debug("path=%s o=%s f=0x%lx try-ro=%s dev=%u:%u id=%i parent=%i",
                           m->path,
                           strempty(m->remount_options),
                           m->remount_flags,
                           yes_no(m->try_remount_ro),
-                          major(m->devnum), minor(m->devnum));
+                          major(m->devnum), minor(m->devnum),
+                          m->mount_id, m->parent_id);
 }
 
 static void test_swap_list(const char *fname) {
@@ -52,6 +56,116 @@ static void test_swap_list(const char *fname) {
                           major(m->devnum), minor(m->devnum));
 }
 
+typedef struct FakeOperation {
+        int mount_id;
+        bool remount;
+        pid_t pid;
+} FakeOperation;
+
+static FakeOperation fake_operations[32];
+static size_t n_fake_operations = 0;
+static unsigned fake_max_running = 0;
+
+static int fake_fork(MountPoint *m, bool remount, int umount_log_level, pid_t *ret_pid) {
+        unsigned n_running = 1;
+        pid_t pid;
+        size_t i;
+
+        assert_se(n_fake_operations < ELEMENTSOF(fake_operations));
+
+        /* Child processes are only reaped when waiting for them, hence whatever is still around (running or
+         * a zombie) hasn't been dealt with yet */
+        for (i = 0; i < n_fake_operations; i++)
+                if (kill(fake_operations[i].pid, 0) >= 0)
+                        n_running++;
+        fake_max_running = MAX(fake_max_running, n_running);
+
+        pid = fork();
+        assert_se(pid >= 0);
+        if (pid == 0)
+                _exit(!remount && IN_SET(m->mount_id, 13, 15) ? EXIT_FAILURE : EXIT_SUCCESS);
+
+        log_debug("Faking %s of %s (id=%i) with PID "PID_FMT".", remount ? "remount" : "umount", m->path, m->mount_id, pid);
+
+        fake_operations[n_fake_operations++] = (FakeOperation) {
+                .mount_id = m->mount_id,
+                .remount = remount,
+                .pid = pid,
+        };
+
+        *ret_pid = pid;
+        return 0;
+}
+
+static size_t fake_umount_index(int mount_id) {
+        size_t i;
+
+        for (i = 0; i < n_fake_operations; i++)
+                if (!fake_operations[i].remount && fake_operations[i].mount_id == mount_id)
+                        return i;
+
+        assert_not_reached("Mount point not unmounted");
+}
+
+static void test_mount_points_list_umount(void) {
+        _cleanup_(mount_points_list_free) LIST_HEAD(MountPoint, mp_list_head);
+        _cleanup_free_ char *fname = NULL;
+        bool changed = false;
+        MountPoint *m;
+        size_t i;
+
+        log_info("/* %s */", __func__);
+
+        fname = path_join(get_testdata_dir(), "/test-umount/tree.mountinfo");
+        assert_se(fname);
+
+        LIST_HEAD_INIT(mp_list_head);
+        assert_se(mount_points_list_get(fname, &mp_list_head) >= 0);
+
+        /* Unmounting /home/bob and the lower /srv fails */
+        assert_se(mount_points_list_umount(&mp_list_head, &changed, LOG_DEBUG, fake_fork) == 2);
+        assert_se(changed);
+
+        /* Everything but / (ID 10) is unmounted, and remounting comes first */
+        assert_se(n_fake_operations >= 8);
+        for (i = 0; i < n_fake_operations; i++) {
+                assert_se(fake_operations[i].mount_id != 10 || fake_operations[i].remount);
+
+                if (fake_operations[i].remount)
+                        assert_se(fake_operations[i].mount_id == 10 ||
+                                  fake_umount_index(fake_operations[i].mount_id) > i);
+        }
+
+        /* Mounts on top of others are unmounted first, also on the same path, even if that fails */
+        assert_se(fake_umount_index(14) < fake_umount_index(12));
+        assert_se(fake_umount_index(12) < fake_umount_index(11));
+        assert_se(fake_umount_index(13) < fake_umount_index(11));
+        assert_se(fake_umount_index(17) < fake_umount_index(16));
+        assert_se(fake_umount_index(16) < fake_umount_index(15));
+
+        /* The leaves don't depend on anything, and are dealt with at the same time, newest first */
+        assert_se(fake_umount_index(18) == 0);
+        assert_se(fake_umount_index(17) == 1);
+        assert_se(fake_umount_index(14) == 2);
+        assert_se(fake_umount_index(13) == 3);
+        assert_se(fake_max_running >= 4);
+
+        /* Only the failures are left, and only those are looked up again for the next pass */
+        assert_se(mp_list_head && mp_list_head->mount_point_next && !mp_list_head->mount_point_next->mount_point_next);
+        LIST_FOREACH(mount_point, m, mp_list_head)
+                assert_se(IN_SET(m->mount_id, 13, 15));
+
+        assert_se(mount_points_list_refresh(fname, &mp_list_head) >= 0);
+
+        i = 0;
+        LIST_FOREACH(mount_point, m, mp_list_head) {
+                assert_se((m->mount_id == 13 && path_equal(m->path, "/home/bob")) ||
+                          (m->mount_id == 15 && path_equal(m->path, "/srv")));
+                i++;
+        }
+        assert_se(i == 2);
+}
+
 int main(int argc, char **argv) {
         test_setup_logging(LOG_DEBUG);
 
@@ -62,4 +176,6 @@ int main(int argc, char **argv) {
 
         test_swap_list(NULL);
         test_swap_list("/test-umount/example.swaps");
+
+        test_mount_points_list_umount();
 }
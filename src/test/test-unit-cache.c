@@ -0,0 +1,130 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <unistd.h>
+
+#include "alloc-util.h"
+#include "dirent-util.h"
+#include "fd-util.h"
+#include "fileio.h"
+#include "fs-util.h"
+#include "mkdir.h"
+#include "path-util.h"
+#include "rm-rf.h"
+#include "set.h"
+#include "string-util.h"
+#include "strv.h"
+#include "tests.h"
+#include "tmpfile-util.h"
+#include "unit-cache.h"
+
+static Set* build_path_cache(char **search_path) {
+        _cleanup_(set_free_freep) Set *s = NULL;
+        char **d;
+
+        s = set_new(&path_hash_ops);
+        assert_se(s);
+
+        STRV_FOREACH(d, search_path) {
+                _cleanup_closedir_ DIR *dir = NULL;
+                struct dirent *de;
+
+                dir = opendir(*d);
+                assert_se(dir);
+
+                FOREACH_DIRENT(de, dir, assert_not_reached("readdir() failed")) {
+                        char *p;
+
+                        p = path_join(NULL, *d, de->d_name);
+                        assert_se(p);
+                        assert_se(set_consume(s, p) >= 0);
+                }
+        }
+
+        return TAKE_PTR(s);
+}
+
+static void test_unit_cache(void) {
+        _cleanup_(rm_rf_physical_and_freep) char *t = NULL;
+        _cleanup_(set_free_freep) Set *path_cache = NULL;
+        _cleanup_(unit_cache_freep) UnitCache *c = NULL;
+        _cleanup_strv_free_ char **search_path = NULL;
+        _cleanup_(unit_fragment_freep) UnitFragment *f = NULL;
+        const char *a, *b, *cache, *p;
+
+        assert_se(mkdtemp_malloc("/tmp/test-unit-cache.XXXXXX", &t) >= 0);
+
+        a = strjoina(t, "/a");
+        b = strjoina(t, "/b");
+        cache = strjoina(t, "/units.bin");
+        assert_se(mkdir(a, 0755) >= 0);
+        assert_se(mkdir(b, 0755) >= 0);
+
+        search_path = strv_new(a, b, NULL);
+        assert_se(search_path);
+
+        /* a/foo.service shadows b/foo.service, and a/alias.service is a symlink to b/bar.service */
+        p = strjoina(a, "/foo.service");
+        assert_se(write_string_file(p, "[Unit]\nDescription=foo from a", WRITE_STRING_FILE_CREATE) >= 0);
+        p = strjoina(b, "/foo.service");
+        assert_se(write_string_file(p, "[Unit]\nDescription=foo from b", WRITE_STRING_FILE_CREATE) >= 0);
+        p = strjoina(b, "/bar.service");
+        assert_se(write_string_file(p, "[Unit]\nDescription=bar", WRITE_STRING_FILE_CREATE) >= 0);
+        p = strjoina(a, "/alias.service");
+        assert_se(symlink(strjoina(b, "/bar.service"), p) >= 0);
+
+        assert_se(unit_cache_write(cache, search_path) >= 0);
+
+        assert_se(unit_cache_open(cache, STRV_MAKE(a), &c) == -ESTALE);
+        assert_se(unit_cache_open(cache, search_path, &c) >= 0);
+        assert_se(unit_cache_dump(c, stdout) >= 0);
+
+        path_cache = build_path_cache(search_path);
+
+        assert_se(unit_cache_contains(c, "foo.service"));
+        assert_se(unit_cache_contains(c, "bar.service"));
+        assert_se(unit_cache_contains(c, "alias.service"));
+        assert_se(!unit_cache_contains(c, "baz.service"));
+
+        /* Without the listing of the directories, the cache is not used */
+        assert_se(unit_cache_lookup(c, "foo.service", search_path, NULL, &f) == 0);
+
+        assert_se(unit_cache_lookup(c, "foo.service", search_path, path_cache, &f) > 0);
+        assert_se(path_equal(f->filename, strjoina(a, "/foo.service")));
+        assert_se(f->size == strlen("[Unit]\nDescription=foo from a\n"));
+        assert_se(memcmp(f->data, "[Unit]\nDescription=foo from a\n", f->size) == 0);
+        assert_se(streq(f->id, "foo.service"));
+        f = unit_fragment_free(f);
+
+        assert_se(unit_cache_lookup(c, "alias.service", search_path, path_cache, &f) > 0);
+        assert_se(path_equal(f->filename, strjoina(b, "/bar.service")));
+        assert_se(set_size(f->names) == 2);
+        assert_se(set_contains(f->names, "alias.service"));
+        assert_se(set_contains(f->names, "bar.service"));
+        assert_se(streq(f->id, "bar.service"));
+        f = unit_fragment_free(f);
+
+        assert_se(unit_cache_lookup(c, "baz.service", search_path, path_cache, &f) == 0);
+
+        /* A new file earlier in the search path takes precedence */
+        p = strjoina(a, "/bar.service");
+        assert_se(set_put_strdup(path_cache, p) >= 0);
+        assert_se(unit_cache_lookup(c, "bar.service", search_path, path_cache, &f) == 0);
+        free(set_remove(path_cache, p));
+        assert_se(unit_cache_lookup(c, "bar.service", search_path, path_cache, &f) > 0);
+        f = unit_fragment_free(f);
+
+        /* A changed fragment invalidates the entries that lead to it */
+        p = strjoina(b, "/bar.service");
+        assert_se(write_string_file(p, "[Unit]\nDescription=bar, changed", WRITE_STRING_FILE_CREATE) >= 0);
+        assert_se(unit_cache_lookup(c, "alias.service", search_path, path_cache, &f) == 0);
+        assert_se(unit_cache_lookup(c, "bar.service", search_path, path_cache, &f) == 0);
+        assert_se(unit_cache_lookup(c, "foo.service", search_path, path_cache, &f) > 0);
+}
+
+int main(int argc, char *argv[]) {
+        test_setup_logging(LOG_DEBUG);
+
+        test_unit_cache();
+
+        return 0;
+}
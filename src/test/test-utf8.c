@@ -1,8 +1,11 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 
 #include "alloc-util.h"
+#include "random-util.h"
 #include "string-util.h"
 #include "strv.h"
+#include "tests.h"
+#include "time-util.h"
 #include "utf8.h"
 #include "util.h"
 
@@ -13,6 +16,94 @@ static void test_utf8_is_printable(void) {
         assert_se(utf8_is_printable("ąę", 4));
 }
 
+/* Decodes one code point at a time, as utf8_is_printable_newline() did before it learnt to skip over ASCII */
+static bool utf8_is_printable_newline_reference(const char *str, size_t length, bool newline) {
+        const char *p;
+
+        for (p = str; length;) {
+                int encoded_len, r;
+                char32_t val;
+
+                encoded_len = utf8_encoded_valid_unichar(p);
+                if (encoded_len < 0 || (size_t) encoded_len > length)
+                        return false;
+
+                r = utf8_encoded_to_unichar(p, &val);
+                if (r < 0 ||
+                    (val < ' ' && !IN_SET(val, '\t', '\n')) ||
+                    (0x7F <= val && val <= 0x9F) ||
+                    (!newline && val == '\n'))
+                        return false;
+
+                length -= encoded_len;
+                p += encoded_len;
+        }
+
+        return true;
+}
+
+static void test_utf8_is_printable_word(void) {
+        static const char alphabet[] = "abcXYZ019 ~\t\n\x7f\x1f\x01\x80\xc3\xa4\xe2\x84\xa2\xf0\x9f\x98\x80";
+        char buf[40];
+        unsigned k;
+        size_t i;
+
+        assert_se(utf8_is_printable("0123456789abcdef", 16));
+        assert_se(utf8_is_printable("0123456789abcdef\n", 17));
+        assert_se(!utf8_is_printable_newline("0123456789abcdef\n", 17, false));
+        assert_se(!utf8_is_printable("0123456\x7f" "89abcdef", 16));
+        assert_se(!utf8_is_printable("0123456\x1f" "89abcdef", 16));
+        assert_se(!utf8_is_printable("01234567\0", 9));
+        assert_se(utf8_is_printable("01234567\xc3\xa4", 10));
+        assert_se(!utf8_is_printable("01234567\xc3\xa4", 9));
+
+        /* Compare with the reference implementation on random strings that mix ASCII, invalid bytes and
+         * sequences, and characters of all lengths */
+        for (k = 0; k < 20000; k++) {
+                size_t n = random_u64() % sizeof(buf);
+
+                for (i = 0; i < n; i++)
+                        buf[i] = random_u64() % 4 == 0 ? alphabet[random_u64() % (sizeof(alphabet) - 1)] : 'a' + i % 26;
+
+                assert_se(utf8_is_printable_newline(buf, n, true) == utf8_is_printable_newline_reference(buf, n, true));
+                assert_se(utf8_is_printable_newline(buf, n, false) == utf8_is_printable_newline_reference(buf, n, false));
+        }
+}
+
+static void test_utf8_is_printable_benchmark(void) {
+        char timespan[FORMAT_TIMESPAN_MAX];
+        _cleanup_free_ char *s = NULL;
+        size_t n, i;
+        usec_t t;
+        unsigned k, reps;
+
+        n = 1024 * 1024;
+        reps = slow_tests_enabled() ? 100 : 2;
+
+        assert_se(s = new(char, n + 1));
+        for (i = 0; i < n; i++)
+                s[i] = i % 80 == 79 ? '\n' : ' ' + i % 95;
+        s[n] = 0;
+
+        t = now(CLOCK_MONOTONIC);
+        for (k = 0; k < reps; k++)
+                assert_se(utf8_is_printable(s + k % 2, n - k % 2));
+        log_info("utf8_is_printable() of %u MiB of ASCII: %s", reps,
+                 format_timespan(timespan, sizeof(timespan), now(CLOCK_MONOTONIC) - t, 1));
+
+        t = now(CLOCK_MONOTONIC);
+        for (k = 0; k < reps; k++)
+                assert_se(utf8_is_printable_newline_reference(s + k % 2, n - k % 2, true));
+        log_info("decoding each code point of %u MiB of ASCII: %s", reps,
+                 format_timespan(timespan, sizeof(timespan), now(CLOCK_MONOTONIC) - t, 1));
+
+        t = now(CLOCK_MONOTONIC);
+        for (k = 0; k < reps; k++)
+                assert_se(utf8_is_valid(s + k % 2));
+        log_info("utf8_is_valid() of %u MiB of ASCII: %s", reps,
+                 format_timespan(timespan, sizeof(timespan), now(CLOCK_MONOTONIC) - t, 1));
+}
+
 static void test_utf8_is_valid(void) {
         assert_se(utf8_is_valid("ascii is valid unicode"));
         assert_se(utf8_is_valid("\342\204\242"));
@@ -125,6 +216,8 @@ static void test_utf8_console_width(void) {
         assert_se(utf8_console_width("") == 0);
         assert_se(utf8_console_width("…👊🔪💐…") == 8);
         assert_se(utf8_console_width("\xF1") == (size_t) -1);
+        assert_se(utf8_console_width("abc\xF1") == (size_t) -1);
+        assert_se(utf8_console_width("a串b") == 4);
 }
 
 static void test_utf8_to_utf16(void) {
@@ -152,6 +245,8 @@ static void test_utf8_to_utf16(void) {
 int main(int argc, char *argv[]) {
         test_utf8_is_valid();
         test_utf8_is_printable();
+        test_utf8_is_printable_word();
+        test_utf8_is_printable_benchmark();
         test_ascii_is_valid();
         test_ascii_is_valid_n();
         test_utf8_encoded_valid_unichar();
@@ -0,0 +1,300 @@
+/* SPDX-License-Identifier: GPL-2.0+ */
+
+#include <errno.h>
+#include <sys/mman.h>
+
+#include "alloc-util.h"
+#include "device-private.h"
+#include "random-util.h"
+#include "siphash24.h"
+#include "string-util.h"
+#include "time-util.h"
+#include "udev-attr-cache.h"
+#include "util.h"
+
+/* The cache is a direct mapped table in a shared anonymous mapping, indexed by the hash of the syspath and the name
+ * of the attribute. Each slot is protected by a sequence count, which is odd while the slot is written: readers copy
+ * the slot and retry if the count changed meanwhile, writers skip a slot which is being written by someone else.
+ *
+ * The attributes of a device are only looked up here when it is the parent of the device of an event. Such events
+ * never run at the same time as an event of the parent itself, hence cached values stay valid until an event of the
+ * parent finished, at which point udevd drops them. Attributes can change without an event though, so values are
+ * only used for a short time, and everything is dropped when the event queue is empty. */
+
+#define ATTR_CACHE_SLOTS 4096U
+#define ATTR_CACHE_KEY_MAX 256U
+#define ATTR_CACHE_VALUE_MAX 128U
+#define ATTR_CACHE_TTL_USEC (2 * USEC_PER_SEC)
+#define ATTR_CACHE_PREFETCH_MAX 64U
+
+typedef struct AttrCacheSlot {
+        uint32_t seq;
+        bool exists;
+        usec_t timestamp; /* 0 if the slot is unused */
+        uint64_t syspath_hash;
+        uint64_t key_hash;
+        char key[ATTR_CACHE_KEY_MAX]; /* the syspath and the name of the attribute, both NUL terminated */
+        char value[ATTR_CACHE_VALUE_MAX];
+} AttrCacheSlot;
+
+typedef struct AttrCache {
+        uint8_t hash_key[16];
+        uint64_t n_stored;
+        AttrCacheSlot slots[ATTR_CACHE_SLOTS];
+} AttrCache;
+
+static AttrCache *cache = NULL;
+
+int udev_attr_cache_new(void) {
+        void *p;
+
+        if (cache)
+                return 0;
+
+        p = mmap(NULL, sizeof(AttrCache), PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED)
+                return -errno;
+
+        cache = p;
+        random_bytes(cache->hash_key, sizeof(cache->hash_key));
+
+        return 0;
+}
+
+void udev_attr_cache_free(void) {
+        if (cache)
+                (void) munmap(cache, sizeof(AttrCache));
+
+        cache = NULL;
+}
+
+static bool slot_lock(AttrCacheSlot *slot, uint32_t *ret_seq) {
+        uint32_t seq;
+
+        seq = __atomic_load_n(&slot->seq, __ATOMIC_RELAXED);
+        if (seq & 1)
+                return false;
+
+        if (!__atomic_compare_exchange_n(&slot->seq, &seq, seq + 1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+                return false;
+
+        *ret_seq = seq;
+        return true;
+}
+
+static void slot_unlock(AttrCacheSlot *slot, uint32_t seq) {
+        __atomic_store_n(&slot->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+void udev_attr_cache_invalidate(const char *syspath) {
+        uint64_t syspath_hash;
+        unsigned i;
+
+        assert(syspath);
+
+        if (!cache || __atomic_load_n(&cache->n_stored, __ATOMIC_RELAXED) == 0)
+                return;
+
+        syspath_hash = siphash24(syspath, strlen(syspath), cache->hash_key);
+
+        for (i = 0; i < ATTR_CACHE_SLOTS; i++) {
+                AttrCacheSlot *slot = cache->slots + i;
+                uint32_t seq;
+
+                if (slot->syspath_hash != syspath_hash || slot->timestamp == 0)
+                        continue;
+
+                if (!slot_lock(slot, &seq))
+                        continue;
+
+                slot->timestamp = 0;
+                slot_unlock(slot, seq);
+        }
+}
+
+void udev_attr_cache_flush(void) {
+        if (!cache || __atomic_load_n(&cache->n_stored, __ATOMIC_RELAXED) == 0)
+                return;
+
+        memzero(cache->slots, sizeof(cache->slots));
+        __atomic_store_n(&cache->n_stored, 0, __ATOMIC_RELAXED);
+}
+
+typedef struct AttrCacheKey {
+        char key[ATTR_CACHE_KEY_MAX];
+        size_t key_len;
+        uint64_t key_hash;
+        uint64_t syspath_hash;
+} AttrCacheKey;
+
+static int attr_cache_key(sd_device *device, const char *sysattr, AttrCacheKey *ret) {
+        const char *syspath;
+        size_t a, b;
+        int r;
+
+        r = sd_device_get_syspath(device, &syspath);
+        if (r < 0)
+                return r;
+
+        a = strlen(syspath);
+        b = strlen(sysattr);
+        if (a + 1 + b + 1 > ATTR_CACHE_KEY_MAX)
+                return -ENAMETOOLONG;
+
+        memcpy(ret->key, syspath, a + 1);
+        memcpy(ret->key + a + 1, sysattr, b + 1);
+        ret->key_len = a + 1 + b + 1;
+        ret->key_hash = siphash24(ret->key, ret->key_len, cache->hash_key);
+        ret->syspath_hash = siphash24(syspath, a, cache->hash_key);
+
+        return 0;
+}
+
+/* Returns 1 and the value, or NULL if the attribute does not exist, if it is cached, and 0 otherwise */
+static int attr_cache_lookup(const AttrCacheKey *key, char **ret_value) {
+        AttrCacheSlot *slot = cache->slots + key->key_hash % ATTR_CACHE_SLOTS;
+        AttrCacheSlot copy;
+        uint32_t seq;
+
+        seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+        if (seq & 1)
+                return 0;
+
+        memcpy(&copy, slot, sizeof(copy));
+
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&slot->seq, __ATOMIC_RELAXED) != seq)
+                return 0;
+
+        if (copy.timestamp == 0 ||
+            copy.key_hash != key->key_hash ||
+            memcmp(copy.key, key->key, key->key_len) != 0 ||
+            now(CLOCK_MONOTONIC) > usec_add(copy.timestamp, ATTR_CACHE_TTL_USEC))
+                return 0;
+
+        if (copy.exists) {
+                char *value;
+
+                value = strndup(copy.value, sizeof(copy.value) - 1);
+                if (!value)
+                        return -ENOMEM;
+
+                *ret_value = value;
+        } else
+                *ret_value = NULL;
+
+        return 1;
+}
+
+static void attr_cache_store(const AttrCacheKey *key, const char *value) {
+        AttrCacheSlot *slot = cache->slots + key->key_hash % ATTR_CACHE_SLOTS;
+        uint32_t seq;
+        size_t l = 0;
+
+        if (value) {
+                l = strlen(value);
+                if (l >= ATTR_CACHE_VALUE_MAX)
+                        return;
+        }
+
+        if (!slot_lock(slot, &seq))
+                return;
+
+        slot->exists = value;
+        slot->timestamp = now(CLOCK_MONOTONIC);
+        slot->syspath_hash = key->syspath_hash;
+        slot->key_hash = key->key_hash;
+        memcpy(slot->key, key->key, key->key_len);
+        if (value)
+                memcpy(slot->value, value, l + 1);
+
+        slot_unlock(slot, seq);
+
+        __atomic_fetch_add(&cache->n_stored, 1, __ATOMIC_RELAXED);
+}
+
+/* Adds the value from the cache to the device, returns 1 if it was cached */
+static int attr_cache_fill(sd_device *device, const char *sysattr, const AttrCacheKey *key) {
+        char *value;
+        int r;
+
+        r = attr_cache_lookup(key, &value);
+        if (r <= 0)
+                return r;
+
+        r = device_cache_sysattr_value(device, sysattr, value);
+        if (r < 0) {
+                free(value);
+                return r;
+        }
+
+        return 1;
+}
+
+int udev_attr_cache_get_sysattr_value(sd_device *device, const char *sysattr, const char **ret_value) {
+        const char *value;
+        AttrCacheKey key;
+        int r;
+
+        assert(device);
+        assert(sysattr);
+
+        if (!cache ||
+            device_get_cached_sysattr_value(device, sysattr, NULL) >= 0 ||
+            attr_cache_key(device, sysattr, &key) < 0)
+                return sd_device_get_sysattr_value(device, sysattr, ret_value);
+
+        r = attr_cache_fill(device, sysattr, &key);
+        if (r != 0)
+                return r < 0 ? r : sd_device_get_sysattr_value(device, sysattr, ret_value);
+
+        r = sd_device_get_sysattr_value(device, sysattr, &value);
+        if (r >= 0)
+                attr_cache_store(&key, value);
+        else if (r == -ENOENT)
+                attr_cache_store(&key, NULL);
+        else
+                return r;
+
+        if (ret_value && r >= 0)
+                *ret_value = value;
+
+        return r;
+}
+
+void udev_attr_cache_prefetch(sd_device *device, const char * const *sysattrs, size_t n_sysattrs) {
+        AttrCacheKey keys[ATTR_CACHE_PREFETCH_MAX];
+        bool missing[ATTR_CACHE_PREFETCH_MAX] = {};
+        size_t i;
+
+        assert(device);
+        assert(sysattrs || n_sysattrs == 0);
+
+        if (!cache)
+                goto prefetch;
+
+        n_sysattrs = MIN(n_sysattrs, ATTR_CACHE_PREFETCH_MAX);
+
+        for (i = 0; i < n_sysattrs; i++)
+                missing[i] = device_get_cached_sysattr_value(device, sysattrs[i], NULL) < 0 &&
+                        attr_cache_key(device, sysattrs[i], keys + i) >= 0 &&
+                        attr_cache_fill(device, sysattrs[i], keys + i) == 0;
+
+prefetch:
+        (void) device_prefetch_sysattrs(device, sysattrs, n_sysattrs);
+
+        if (!cache)
+                return;
+
+        for (i = 0; i < n_sysattrs; i++) {
+                const char *value;
+                int r;
+
+                if (!missing[i])
+                        continue;
+
+                r = device_get_cached_sysattr_value(device, sysattrs[i], &value);
+                if (r >= 0)
+                        attr_cache_store(keys + i, value);
+        }
+}
@@ -0,0 +1,21 @@
+/* SPDX-License-Identifier: GPL-2.0+ */
+#pragma once
+
+#include <stddef.h>
+
+#include "sd-device.h"
+
+/* A cache of the sysfs attributes of parent devices, which udevd sets up before it forks off the first worker, so
+ * that the workers processing the children of a device share the attributes they read from it. Without it, all
+ * functions fall back to the cache of the sd_device object. */
+
+int udev_attr_cache_new(void);
+void udev_attr_cache_free(void);
+
+/* Called by udevd when an event of the device finished, and hence its attributes might have changed */
+void udev_attr_cache_invalidate(const char *syspath);
+/* Called by udevd when no event is queued, and hence no worker uses the cache */
+void udev_attr_cache_flush(void);
+
+int udev_attr_cache_get_sysattr_value(sd_device *device, const char *sysattr, const char **ret_value);
+void udev_attr_cache_prefetch(sd_device *device, const char * const *sysattrs, size_t n_sysattrs);
@@ -12,7 +12,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/ioctl.h>
 #include <sys/stat.h>
+#include <linux/fs.h>
 
 #include "sd-id128.h"
 
@@ -21,81 +23,110 @@
 #include "device-util.h"
 #include "efivars.h"
 #include "fd-util.h"
+#include "fileio.h"
 #include "gpt.h"
+#include "hash-funcs.h"
 #include "parse-util.h"
+#include "path-util.h"
+#include "siphash24.h"
 #include "string-util.h"
+#include "strv.h"
 #include "strxcpyx.h"
 #include "udev-builtin.h"
 
-static void print_property(sd_device *dev, bool test, const char *name, const char *value) {
+/* Probing a device means reading from it at various offsets, which adds up on hosts with thousands of disks, in
+ * particular as a "change" event is synthesized whenever a device that was opened for writing is closed, whether
+ * anything was written or not. Hence, the names of the properties we found are stored in the database of the
+ * device, together with a hash of their values and a key describing the device: its size and how much was written
+ * to it, and to the disk it is a partition of. On a "change" event, if the key still matches and the properties in
+ * the database still have the values we found, they are used without probing again. Devices the content of which
+ * may change without being written, like removable media, loop, DM and MD devices, are always probed. */
+#define BLKID_CACHE_PROPERTY "ID_BLKID_CACHE"
+#define BLKID_CACHE_HASH_KEY SD_ID128_MAKE(5b,e5,0b,27,9a,13,4e,4f,a6,26,6a,d2,55,c6,3e,9c)
+
+typedef struct ProbeResult {
+        char *names;    /* The properties found, comma separated */
+        bool failed;    /* Remembering them failed, hence they can't be cached */
+} ProbeResult;
+
+static void add_property(sd_device *dev, bool test, ProbeResult *result, const char *key, const char *val) {
+        int r;
+
+        r = udev_builtin_add_property(dev, test, key, val);
+
+        if (result && (r < 0 || !strextend_with_separator(&result->names, ",", key, NULL)))
+                result->failed = true;
+}
+
+static void print_property(sd_device *dev, bool test, ProbeResult *result, const char *name, const char *value) {
         char s[256];
 
         s[0] = '\0';
 
         if (streq(name, "TYPE")) {
-                udev_builtin_add_property(dev, test, "ID_FS_TYPE", value);
+                add_property(dev, test, result, "ID_FS_TYPE", value);
 
         } else if (streq(name, "USAGE")) {
-                udev_builtin_add_property(dev, test, "ID_FS_USAGE", value);
+                add_property(dev, test, result, "ID_FS_USAGE", value);
 
         } else if (streq(name, "VERSION")) {
-                udev_builtin_add_property(dev, test, "ID_FS_VERSION", value);
+                add_property(dev, test, result, "ID_FS_VERSION", value);
 
         } else if (streq(name, "UUID")) {
                 blkid_safe_string(value, s, sizeof(s));
-                udev_builtin_add_property(dev, test, "ID_FS_UUID", s);
+                add_property(dev, test, result, "ID_FS_UUID", s);
                 blkid_encode_string(value, s, sizeof(s));
-                udev_builtin_add_property(dev, test, "ID_FS_UUID_ENC", s);
+                add_property(dev, test, result, "ID_FS_UUID_ENC", s);
 
         } else if (streq(name, "UUID_SUB")) {
                 blkid_safe_string(value, s, sizeof(s));
-                udev_builtin_add_property(dev, test, "ID_FS_UUID_SUB", s);
+                add_property(dev, test, result, "ID_FS_UUID_SUB", s);
                 blkid_encode_string(value, s, sizeof(s));
-                udev_builtin_add_property(dev, test, "ID_FS_UUID_SUB_ENC", s);
+                add_property(dev, test, result, "ID_FS_UUID_SUB_ENC", s);
 
         } else if (streq(name, "LABEL")) {
                 blkid_safe_string(value, s, sizeof(s));
-                udev_builtin_add_property(dev, test, "ID_FS_LABEL", s);
+                add_property(dev, test, result, "ID_FS_LABEL", s);
                 blkid_encode_string(value, s, sizeof(s));
-                udev_builtin_add_property(dev, test, "ID_FS_LABEL_ENC", s);
+                add_property(dev, test, result, "ID_FS_LABEL_ENC", s);
 
         } else if (streq(name, "PTTYPE")) {
-                udev_builtin_add_property(dev, test, "ID_PART_TABLE_TYPE", value);
+                add_property(dev, test, result, "ID_PART_TABLE_TYPE", value);
 
         } else if (streq(name, "PTUUID")) {
-                udev_builtin_add_property(dev, test, "ID_PART_TABLE_UUID", value);
+                add_property(dev, test, result, "ID_PART_TABLE_UUID", value);
 
         } else if (streq(name, "PART_ENTRY_NAME")) {
                 blkid_encode_string(value, s, sizeof(s));
-                udev_builtin_add_property(dev, test, "ID_PART_ENTRY_NAME", s);
+                add_property(dev, test, result, "ID_PART_ENTRY_NAME", s);
 
         } else if (streq(name, "PART_ENTRY_TYPE")) {
                 blkid_encode_string(value, s, sizeof(s));
-                udev_builtin_add_property(dev, test, "ID_PART_ENTRY_TYPE", s);
+                add_property(dev, test, result, "ID_PART_ENTRY_TYPE", s);
 
         } else if (startswith(name, "PART_ENTRY_")) {
                 strscpyl(s, sizeof(s), "ID_", name, NULL);
-                udev_builtin_add_property(dev, test, s, value);
+                add_property(dev, test, result, s, value);
 
         } else if (streq(name, "SYSTEM_ID")) {
                 blkid_encode_string(value, s, sizeof(s));
-                udev_builtin_add_property(dev, test, "ID_FS_SYSTEM_ID", s);
+                add_property(dev, test, result, "ID_FS_SYSTEM_ID", s);
 
         } else if (streq(name, "PUBLISHER_ID")) {
                 blkid_encode_string(value, s, sizeof(s));
-                udev_builtin_add_property(dev, test, "ID_FS_PUBLISHER_ID", s);
+                add_property(dev, test, result, "ID_FS_PUBLISHER_ID", s);
 
         } else if (streq(name, "APPLICATION_ID")) {
                 blkid_encode_string(value, s, sizeof(s));
-                udev_builtin_add_property(dev, test, "ID_FS_APPLICATION_ID", s);
+                add_property(dev, test, result, "ID_FS_APPLICATION_ID", s);
 
         } else if (streq(name, "BOOT_SYSTEM_ID")) {
                 blkid_encode_string(value, s, sizeof(s));
-                udev_builtin_add_property(dev, test, "ID_FS_BOOT_SYSTEM_ID", s);
+                add_property(dev, test, result, "ID_FS_BOOT_SYSTEM_ID", s);
         }
 }
 
-static int find_gpt_root(sd_device *dev, blkid_probe pr, bool test) {
+static int find_gpt_root(sd_device *dev, blkid_probe pr, bool test, ProbeResult *result) {
 
 #if defined(GPT_ROOT_NATIVE) && ENABLE_EFI
 
@@ -173,7 +204,7 @@ static int find_gpt_root(sd_device *dev, blkid_probe pr, bool test) {
         /* We found the ESP on this disk, and also found a root
          * partition, nice! Let's export its UUID */
         if (found_esp && root_id)
-                udev_builtin_add_property(dev, test, "ID_PART_GPT_AUTO_ROOT_UUID", root_id);
+                add_property(dev, test, result, "ID_PART_GPT_AUTO_ROOT_UUID", root_id);
 #endif
 
         return 0;
@@ -213,13 +244,217 @@ static int probe_superblocks(blkid_probe pr) {
         return blkid_do_safeprobe(pr);
 }
 
+static int hash_write_counters(sd_device *dev, struct siphash *state) {
+        _cleanup_free_ char *p = NULL, *line = NULL;
+        _cleanup_strv_free_ char **fields = NULL;
+        const char *syspath;
+        size_t n;
+        int r;
+
+        r = sd_device_get_syspath(dev, &syspath);
+        if (r < 0)
+                return r;
+
+        p = path_join(syspath, "stat");
+        if (!p)
+                return -ENOMEM;
+
+        r = read_one_line_file(p, &line);
+        if (r < 0)
+                return r;
+
+        fields = strv_split(line, WHITESPACE);
+        if (!fields)
+                return -ENOMEM;
+
+        /* Fields 7 and 14 are the number of written and of discarded sectors, see Documentation/block/stat.txt. The
+         * latter only exists since kernel 4.18. The number of write requests also counts cache flushes, which
+         * don't change anything. */
+        n = strv_length(fields);
+        if (n < 7)
+                return -EBADMSG;
+
+        string_hash_func(fields[6], state);
+        if (n >= 14)
+                string_hash_func(fields[13], state);
+
+        return 0;
+}
+
+static int probe_cache_key(sd_device *dev, int fd, int64_t offset, bool noraid, const char *root_partition, uint64_t *ret) {
+        const char *syspath, *devtype, *removable;
+        struct siphash state;
+        sd_device *disk = dev;
+        uint64_t size;
+        dev_t devnum;
+        int r;
+
+        assert(dev);
+        assert(fd >= 0);
+        assert(ret);
+
+        /* Returns 0 if the device shall always be probed. */
+
+        r = sd_device_get_syspath(dev, &syspath);
+        if (r < 0)
+                return r;
+        if (path_startswith(syspath, "/sys/devices/virtual/"))
+                return 0;
+
+        if (sd_device_get_property_value(dev, "DISK_MEDIA_CHANGE", NULL) >= 0)
+                return 0;
+
+        r = sd_device_get_devnum(dev, &devnum);
+        if (r < 0)
+                return r;
+
+        if (sd_device_get_devtype(dev, &devtype) >= 0 && streq(devtype, "partition")) {
+                r = sd_device_get_parent_with_subsystem_devtype(dev, "block", "disk", &disk);
+                if (r < 0)
+                        return r;
+        }
+
+        if (sd_device_get_sysattr_value(disk, "removable", &removable) >= 0 && streq(removable, "1"))
+                return 0;
+
+        if (ioctl(fd, BLKGETSIZE64, &size) < 0)
+                return -errno;
+
+        /* Data that is still only in the page cache is seen by the probe, but not counted as written yet. Write it
+         * out, but unlike fsync() don't flush the disk cache, which can take a while. */
+        (void) sync_file_range(fd, 0, 0, SYNC_FILE_RANGE_WAIT_BEFORE|SYNC_FILE_RANGE_WRITE|SYNC_FILE_RANGE_WAIT_AFTER);
+
+        siphash24_init(&state, BLKID_CACHE_HASH_KEY.bytes);
+        siphash24_compress(&devnum, sizeof(devnum), &state);
+        siphash24_compress(&size, sizeof(size), &state);
+        siphash24_compress(&offset, sizeof(offset), &state);
+        siphash24_compress(&noraid, sizeof(noraid), &state);
+        string_hash_func(strempty(root_partition), &state);
+
+        r = hash_write_counters(dev, &state);
+        if (r < 0)
+                return r;
+        if (disk != dev) {
+                r = hash_write_counters(disk, &state);
+                if (r < 0)
+                        return r;
+        }
+
+        *ret = siphash24_finalize(&state);
+        return 1;
+}
+
+static int hash_properties(sd_device *dev, char **names, uint64_t *ret) {
+        struct siphash state;
+        char **name;
+
+        assert(dev);
+        assert(ret);
+
+        siphash24_init(&state, BLKID_CACHE_HASH_KEY.bytes);
+
+        STRV_FOREACH(name, names) {
+                const char *value;
+
+                if (sd_device_get_property_value(dev, *name, &value) < 0)
+                        return -ENOENT;
+
+                string_hash_func(*name, &state);
+                string_hash_func(value, &state);
+        }
+
+        *ret = siphash24_finalize(&state);
+        return 0;
+}
+
+static int probe_cache_lookup(sd_device *dev, bool test, uint64_t key) {
+        _cleanup_(sd_device_unrefp) sd_device *old = NULL;
+        _cleanup_strv_free_ char **names = NULL;
+        const char *syspath, *cached, *p;
+        uint64_t cached_key, cached_hash, hash;
+        char **name;
+        int r;
+
+        assert(dev);
+
+        /* Returns > 0 if the results of the previous probe of the device were added to it. */
+
+        r = sd_device_get_syspath(dev, &syspath);
+        if (r < 0)
+                return r;
+
+        /* A new object, so that the properties are read from the database, i.e. are those of the previous event */
+        r = sd_device_new_from_syspath(&old, syspath);
+        if (r < 0)
+                return r;
+
+        if (sd_device_get_property_value(old, BLKID_CACHE_PROPERTY, &cached) < 0)
+                return 0;
+
+        if (sscanf(cached, "%16" SCNx64 ":%16" SCNx64, &cached_key, &cached_hash) != 2 || cached_key != key)
+                return 0;
+
+        p = strchr(cached, ':');
+        p = p ? strchr(p + 1, ':') : NULL;
+        if (!p)
+                return 0;
+
+        names = strv_split(p + 1, ",");
+        if (!names)
+                return -ENOMEM;
+
+        /* Some rule may have changed the properties we found, then we don't know what they were anymore */
+        if (hash_properties(old, names, &hash) < 0 || hash != cached_hash)
+                return 0;
+
+        STRV_FOREACH(name, names) {
+                const char *value;
+
+                assert_se(sd_device_get_property_value(old, *name, &value) >= 0);
+
+                r = udev_builtin_add_property(dev, test, *name, value);
+                if (r < 0)
+                        return r;
+        }
+
+        r = udev_builtin_add_property(dev, test, BLKID_CACHE_PROPERTY, cached);
+        if (r < 0)
+                return r;
+
+        return 1;
+}
+
+static int probe_cache_store(sd_device *dev, bool test, uint64_t key, const char *names) {
+        _cleanup_strv_free_ char **l = NULL;
+        _cleanup_free_ char *value = NULL;
+        uint64_t hash;
+        int r;
+
+        assert(dev);
+
+        l = strv_split(strempty(names), ",");
+        if (!l)
+                return -ENOMEM;
+
+        r = hash_properties(dev, l, &hash);
+        if (r < 0)
+                return r;
+
+        if (asprintf(&value, "%016" PRIx64 ":%016" PRIx64 ":%s", key, hash, strempty(names)) < 0)
+                return -ENOMEM;
+
+        return udev_builtin_add_property(dev, test, BLKID_CACHE_PROPERTY, value);
+}
+
 static int builtin_blkid(sd_device *dev, int argc, char *argv[], bool test) {
-        const char *devnode, *root_partition = NULL, *data, *name;
+        const char *devnode, *root_partition = NULL, *data, *name, *action;
         _cleanup_(blkid_free_probep) blkid_probe pr = NULL;
         bool noraid = false, is_gpt = false;
+        ProbeResult result = {};
         _cleanup_close_ int fd = -1;
         int64_t offset = 0;
-        int nvals, i, r;
+        uint64_t key = 0;
+        int nvals, i, r, k;
 
         static const struct option options[] = {
                 { "offset", required_argument, NULL, 'o' },
@@ -248,6 +483,31 @@ static int builtin_blkid(sd_device *dev, int argc, char *argv[], bool test) {
                 }
         }
 
+        r = sd_device_get_devname(dev, &devnode);
+        if (r < 0)
+                return log_device_debug_errno(dev, r, "Failed to get device name: %m");
+
+        fd = open(devnode, O_RDONLY|O_CLOEXEC);
+        if (fd < 0)
+                return log_device_debug_errno(dev, errno, "Failed to open block device %s: %m", devnode);
+
+        /* If the device is a partition then its parent passed the root partition UUID to the device */
+        (void) sd_device_get_property_value(dev, "ID_PART_GPT_AUTO_ROOT_UUID", &root_partition);
+
+        k = probe_cache_key(dev, fd, offset, noraid, root_partition, &key);
+        if (k < 0)
+                log_device_debug_errno(dev, k, "Failed to determine probe cache key, not caching results: %m");
+        if (k > 0 &&
+            sd_device_get_property_value(dev, "ACTION", &action) >= 0 && streq(action, "change")) {
+                r = probe_cache_lookup(dev, test, key);
+                if (r < 0)
+                        log_device_debug_errno(dev, r, "Failed to look up cached probe results, ignoring: %m");
+                if (r > 0) {
+                        log_device_debug(dev, "Device %s did not change since it was probed, using cached results.", devnode);
+                        return 0;
+                }
+        }
+
         errno = 0;
         pr = blkid_new_probe();
         if (!pr)
@@ -261,14 +521,6 @@ static int builtin_blkid(sd_device *dev, int argc, char *argv[], bool test) {
         if (noraid)
                 blkid_probe_filter_superblocks_usage(pr, BLKID_FLTR_NOTIN, BLKID_USAGE_RAID);
 
-        r = sd_device_get_devname(dev, &devnode);
-        if (r < 0)
-                return log_device_debug_errno(dev, r, "Failed to get device name: %m");
-
-        fd = open(devnode, O_RDONLY|O_CLOEXEC);
-        if (fd < 0)
-                return log_device_debug_errno(dev, errno, "Failed to open block device %s: %m", devnode);
-
         errno = 0;
         r = blkid_probe_set_device(pr, fd, offset, 0);
         if (r < 0)
@@ -280,9 +532,6 @@ static int builtin_blkid(sd_device *dev, int argc, char *argv[], bool test) {
         if (r < 0)
                 return log_device_debug_errno(dev, r, "Failed to probe superblocks: %m");
 
-        /* If the device is a partition then its parent passed the root partition UUID to the device */
-        (void) sd_device_get_property_value(dev, "ID_PART_GPT_AUTO_ROOT_UUID", &root_partition);
-
         errno = 0;
         nvals = blkid_probe_numof_values(pr);
         if (nvals < 0)
@@ -292,7 +541,7 @@ static int builtin_blkid(sd_device *dev, int argc, char *argv[], bool test) {
                 if (blkid_probe_get_value(pr, i, &name, &data, NULL) < 0)
                         continue;
 
-                print_property(dev, test, name, data);
+                print_property(dev, test, k > 0 ? &result : NULL, name, data);
 
                 /* Is this a disk with GPT partition table? */
                 if (streq(name, "PTTYPE") && streq(data, "gpt"))
@@ -301,12 +550,19 @@ static int builtin_blkid(sd_device *dev, int argc, char *argv[], bool test) {
                 /* Is this a partition that matches the root partition
                  * property inherited from the parent? */
                 if (root_partition && streq(name, "PART_ENTRY_UUID") && streq(data, root_partition))
-                        udev_builtin_add_property(dev, test, "ID_PART_GPT_AUTO_ROOT", "1");
+                        add_property(dev, test, k > 0 ? &result : NULL, "ID_PART_GPT_AUTO_ROOT", "1");
         }
 
-        if (is_gpt)
-                find_gpt_root(dev, pr, test);
+        if (is_gpt && find_gpt_root(dev, pr, test, k > 0 ? &result : NULL) < 0)
+                result.failed = true;
+
+        if (k > 0 && !result.failed) {
+                r = probe_cache_store(dev, test, key, result.names);
+                if (r < 0)
+                        log_device_debug_errno(dev, r, "Failed to store probe results in cache, ignoring: %m");
+        }
 
+        free(result.names);
         return 0;
 }
 
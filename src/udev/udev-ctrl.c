@@ -21,12 +21,16 @@
 #include "fd-util.h"
 #include "format-util.h"
 #include "io-util.h"
+#include "parse-util.h"
 #include "socket-util.h"
+#include "string-util.h"
+#include "strv.h"
 #include "strxcpyx.h"
 #include "udev-ctrl.h"
 
 /* wire protocol magic must match */
 #define UDEV_CTRL_MAGIC                                0xdead1dea
+#define UDEV_CTRL_BUF_SIZE                             256
 
 enum udev_ctrl_msg_type {
         UDEV_CTRL_UNKNOWN,
@@ -38,6 +42,8 @@ enum udev_ctrl_msg_type {
         UDEV_CTRL_SET_CHILDREN_MAX,
         UDEV_CTRL_PING,
         UDEV_CTRL_EXIT,
+        UDEV_CTRL_STATISTICS,
+        UDEV_CTRL_SETTLE,
 };
 
 struct udev_ctrl_msg_wire {
@@ -46,7 +52,7 @@ struct udev_ctrl_msg_wire {
         enum udev_ctrl_msg_type type;
         union {
                 int intval;
-                char buf[256];
+                char buf[UDEV_CTRL_BUF_SIZE];
         };
 };
 
@@ -70,6 +76,7 @@ struct udev_ctrl_connection {
         unsigned n_ref;
         struct udev_ctrl *uctrl;
         int sock;
+        enum udev_ctrl_msg_type reply_type; /* the type of the last message received */
 };
 
 struct udev_ctrl *udev_ctrl_new_from_fd(int fd) {
@@ -171,6 +178,7 @@ struct udev_ctrl_connection *udev_ctrl_get_connection(struct udev_ctrl *uctrl) {
                 return NULL;
         conn->n_ref = 1;
         conn->uctrl = uctrl;
+        conn->reply_type = UDEV_CTRL_UNKNOWN;
 
         conn->sock = accept4(uctrl->sock, NULL, NULL, SOCK_CLOEXEC|SOCK_NONBLOCK);
         if (conn->sock < 0) {
@@ -212,14 +220,47 @@ static struct udev_ctrl_connection *udev_ctrl_connection_free(struct udev_ctrl_c
 
 DEFINE_TRIVIAL_REF_UNREF_FUNC(struct udev_ctrl_connection, udev_ctrl_connection, udev_ctrl_connection_free);
 
-static int ctrl_send(struct udev_ctrl *uctrl, enum udev_ctrl_msg_type type, int intval, const char *buf, int timeout) {
+static void ctrl_msg_wire_init(struct udev_ctrl_msg_wire *ctrl_msg_wire, enum udev_ctrl_msg_type type) {
+        memzero(ctrl_msg_wire, sizeof(struct udev_ctrl_msg_wire));
+        strcpy(ctrl_msg_wire->version, "udev-" PACKAGE_VERSION);
+        ctrl_msg_wire->magic = UDEV_CTRL_MAGIC;
+        ctrl_msg_wire->type = type;
+}
+
+/* Replies are sent as messages of the same type as the request, each carrying one line of text. The end of the
+ * reply is marked by closing the connection. */
+int udev_ctrl_connection_send_reply(struct udev_ctrl_connection *conn, const char *line) {
         struct udev_ctrl_msg_wire ctrl_msg_wire;
-        int err = 0;
+        int r;
+
+        assert(conn);
+        assert(line);
 
-        memzero(&ctrl_msg_wire, sizeof(struct udev_ctrl_msg_wire));
-        strcpy(ctrl_msg_wire.version, "udev-" PACKAGE_VERSION);
-        ctrl_msg_wire.magic = UDEV_CTRL_MAGIC;
-        ctrl_msg_wire.type = type;
+        ctrl_msg_wire_init(&ctrl_msg_wire, conn->reply_type);
+        strscpy(ctrl_msg_wire.buf, sizeof(ctrl_msg_wire.buf), line);
+
+        for (;;) {
+                if (send(conn->sock, &ctrl_msg_wire, sizeof(ctrl_msg_wire), MSG_NOSIGNAL) >= 0)
+                        return 0;
+
+                if (errno == EINTR)
+                        continue;
+                if (errno != EAGAIN)
+                        return -errno;
+
+                /* the connection is non-blocking, wait a bit for the peer to catch up */
+                r = fd_wait_for_event(conn->sock, POLLOUT, 5 * USEC_PER_SEC);
+                if (r < 0)
+                        return r;
+                if (r == 0)
+                        return -ETIMEDOUT;
+        }
+}
+
+static int ctrl_send_msg(struct udev_ctrl *uctrl, enum udev_ctrl_msg_type type, int intval, const char *buf) {
+        struct udev_ctrl_msg_wire ctrl_msg_wire;
+
+        ctrl_msg_wire_init(&ctrl_msg_wire, type);
 
         if (buf)
                 strscpy(ctrl_msg_wire.buf, sizeof(ctrl_msg_wire.buf), buf);
@@ -227,16 +268,22 @@ static int ctrl_send(struct udev_ctrl *uctrl, enum udev_ctrl_msg_type type, int
                 ctrl_msg_wire.intval = intval;
 
         if (!uctrl->connected) {
-                if (connect(uctrl->sock, &uctrl->saddr.sa, uctrl->addrlen) < 0) {
-                        err = -errno;
-                        goto out;
-                }
+                if (connect(uctrl->sock, &uctrl->saddr.sa, uctrl->addrlen) < 0)
+                        return -errno;
                 uctrl->connected = true;
         }
-        if (send(uctrl->sock, &ctrl_msg_wire, sizeof(ctrl_msg_wire), 0) < 0) {
-                err = -errno;
-                goto out;
-        }
+        if (send(uctrl->sock, &ctrl_msg_wire, sizeof(ctrl_msg_wire), 0) < 0)
+                return -errno;
+
+        return 0;
+}
+
+static int ctrl_send(struct udev_ctrl *uctrl, enum udev_ctrl_msg_type type, int intval, const char *buf, int timeout) {
+        int err;
+
+        err = ctrl_send_msg(uctrl, type, intval, buf);
+        if (err < 0)
+                return err;
 
         /* wait for peer message handling or disconnect */
         for (;;) {
@@ -262,7 +309,7 @@ static int ctrl_send(struct udev_ctrl *uctrl, enum udev_ctrl_msg_type type, int
                         err = -ETIMEDOUT;
                 break;
         }
-out:
+
         return err;
 }
 
@@ -290,6 +337,108 @@ int udev_ctrl_send_set_children_max(struct udev_ctrl *uctrl, int count, int time
         return ctrl_send(uctrl, UDEV_CTRL_SET_CHILDREN_MAX, count, NULL, timeout);
 }
 
+/* Collects the reply lines, until the peer closes the connection */
+static int ctrl_receive_reply(struct udev_ctrl *uctrl, enum udev_ctrl_msg_type type, usec_t timeout_usec, char **ret) {
+        _cleanup_free_ char *text = NULL;
+        size_t allocated = 0, size = 0;
+        int r;
+
+        for (;;) {
+                struct udev_ctrl_msg_wire ctrl_msg_wire;
+                ssize_t n;
+                size_t l;
+
+                r = fd_wait_for_event(uctrl->sock, POLLIN, timeout_usec);
+                if (r < 0)
+                        return r;
+                if (r == 0)
+                        return -ETIMEDOUT;
+
+                n = recv(uctrl->sock, &ctrl_msg_wire, sizeof(ctrl_msg_wire), 0);
+                if (n < 0) {
+                        if (IN_SET(errno, EINTR, EAGAIN))
+                                continue;
+                        /* the peer closed the connection before reading all messages we sent */
+                        if (errno == ECONNRESET)
+                                break;
+                        return -errno;
+                }
+                if (n == 0)
+                        break;
+
+                if ((size_t) n != sizeof(ctrl_msg_wire) ||
+                    ctrl_msg_wire.magic != UDEV_CTRL_MAGIC ||
+                    ctrl_msg_wire.type != type)
+                        return -EBADMSG;
+
+                l = strnlen(ctrl_msg_wire.buf, sizeof(ctrl_msg_wire.buf));
+                if (!GREEDY_REALLOC(text, allocated, size + l + 2))
+                        return -ENOMEM;
+
+                memcpy(text + size, ctrl_msg_wire.buf, l);
+                size += l;
+                text[size++] = '\n';
+                text[size] = '\0';
+        }
+
+        /* older versions of udevd close the connection without a reply */
+        if (!text)
+                return -EOPNOTSUPP;
+
+        *ret = TAKE_PTR(text);
+        return 0;
+}
+
+int udev_ctrl_send_statistics(struct udev_ctrl *uctrl, char **ret, int timeout) {
+        int r;
+
+        assert(uctrl);
+        assert(ret);
+
+        r = ctrl_send(uctrl, UDEV_CTRL_STATISTICS, 0, NULL, timeout);
+        if (r < 0)
+                return r;
+
+        return ctrl_receive_reply(uctrl, UDEV_CTRL_STATISTICS, timeout * USEC_PER_SEC, ret);
+}
+
+/* The matches are sent in one message each, followed by an empty one. udevd replies with the number of events it
+ * waited for, once all of them are processed. */
+int udev_ctrl_send_settle(struct udev_ctrl *uctrl, char **matches, usec_t timeout_usec, unsigned *ret_n_events) {
+        _cleanup_free_ char *reply = NULL;
+        char **m;
+        int r;
+
+        assert(uctrl);
+
+        STRV_FOREACH(m, matches) {
+                if (isempty(*m))
+                        return -EINVAL;
+                if (strlen(*m) >= UDEV_CTRL_BUF_SIZE)
+                        return -ENAMETOOLONG;
+
+                r = ctrl_send_msg(uctrl, UDEV_CTRL_SETTLE, 0, *m);
+                if (r < 0)
+                        return r;
+        }
+
+        r = ctrl_send_msg(uctrl, UDEV_CTRL_SETTLE, 0, "");
+        if (r < 0)
+                return r;
+
+        r = ctrl_receive_reply(uctrl, UDEV_CTRL_SETTLE, timeout_usec, &reply);
+        if (r < 0)
+                return r;
+
+        if (ret_n_events) {
+                r = safe_atou(strstrip(reply), ret_n_events);
+                if (r < 0)
+                        return -EBADMSG;
+        }
+
+        return 0;
+}
+
 int udev_ctrl_send_ping(struct udev_ctrl *uctrl, int timeout) {
         return ctrl_send(uctrl, UDEV_CTRL_PING, 0, NULL, timeout);
 }
@@ -374,6 +523,8 @@ struct udev_ctrl_msg *udev_ctrl_receive_msg(struct udev_ctrl_connection *conn) {
                 goto err;
         }
 
+        conn->reply_type = uctrl_msg->ctrl_msg_wire.type;
+
         return uctrl_msg;
 err:
         udev_ctrl_msg_unref(uctrl_msg);
@@ -436,3 +587,15 @@ int udev_ctrl_get_exit(struct udev_ctrl_msg *ctrl_msg) {
                 return 1;
         return -1;
 }
+
+int udev_ctrl_get_statistics(struct udev_ctrl_msg *ctrl_msg) {
+        if (ctrl_msg->ctrl_msg_wire.type == UDEV_CTRL_STATISTICS)
+                return 1;
+        return -1;
+}
+
+const char *udev_ctrl_get_settle(struct udev_ctrl_msg *ctrl_msg) {
+        if (ctrl_msg->ctrl_msg_wire.type == UDEV_CTRL_SETTLE)
+                return ctrl_msg->ctrl_msg_wire.buf;
+        return NULL;
+}
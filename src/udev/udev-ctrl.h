@@ -2,6 +2,7 @@
 #pragma once
 
 #include "macro.h"
+#include "time-util.h"
 
 struct udev_ctrl;
 struct udev_ctrl *udev_ctrl_new(void);
@@ -18,11 +19,16 @@ int udev_ctrl_send_ping(struct udev_ctrl *uctrl, int timeout);
 int udev_ctrl_send_exit(struct udev_ctrl *uctrl, int timeout);
 int udev_ctrl_send_set_env(struct udev_ctrl *uctrl, const char *key, int timeout);
 int udev_ctrl_send_set_children_max(struct udev_ctrl *uctrl, int count, int timeout);
+int udev_ctrl_send_statistics(struct udev_ctrl *uctrl, char **ret, int timeout);
+/* Waits until the events of the matching devices, "syspath=PATH" or "subsystem=NAME", which are queued or running
+ * in udevd are processed, or all of them if there are no matches */
+int udev_ctrl_send_settle(struct udev_ctrl *uctrl, char **matches, usec_t timeout_usec, unsigned *ret_n_events);
 
 struct udev_ctrl_connection;
 struct udev_ctrl_connection *udev_ctrl_get_connection(struct udev_ctrl *uctrl);
 struct udev_ctrl_connection *udev_ctrl_connection_ref(struct udev_ctrl_connection *conn);
 struct udev_ctrl_connection *udev_ctrl_connection_unref(struct udev_ctrl_connection *conn);
+int udev_ctrl_connection_send_reply(struct udev_ctrl_connection *conn, const char *line);
 
 struct udev_ctrl_msg;
 struct udev_ctrl_msg *udev_ctrl_receive_msg(struct udev_ctrl_connection *conn);
@@ -35,6 +41,8 @@ int udev_ctrl_get_ping(struct udev_ctrl_msg *ctrl_msg);
 int udev_ctrl_get_exit(struct udev_ctrl_msg *ctrl_msg);
 const char *udev_ctrl_get_set_env(struct udev_ctrl_msg *ctrl_msg);
 int udev_ctrl_get_set_children_max(struct udev_ctrl_msg *ctrl_msg);
+int udev_ctrl_get_statistics(struct udev_ctrl_msg *ctrl_msg);
+const char *udev_ctrl_get_settle(struct udev_ctrl_msg *ctrl_msg);
 
 DEFINE_TRIVIAL_CLEANUP_FUNC(struct udev_ctrl*, udev_ctrl_unref);
 DEFINE_TRIVIAL_CLEANUP_FUNC(struct udev_ctrl_connection*, udev_ctrl_connection_unref);
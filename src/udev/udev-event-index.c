@@ -0,0 +1,320 @@
+/* SPDX-License-Identifier: GPL-2.0+ */
+
+#include <errno.h>
+#include <sys/sysmacros.h>
+
+#include "alloc-util.h"
+#include "hashmap.h"
+#include "list.h"
+#include "stdio-util.h"
+#include "string-util.h"
+#include "udev-event-index.h"
+
+/* An event has to wait for all earlier events of
+ *  - the same device node, of the same type (block or char),
+ *  - the same network interface,
+ *  - a device with its path, unless it has a device node or a network interface, as names might have been swapped,
+ *  - a device with its old path, if it was renamed,
+ *  - a device above or below it in the device tree.
+ *
+ * Hence the index keeps one bucket per device node or network interface, and one per device path, which also lists
+ * the events of all the devices below that path. As events are added in the order of their sequence numbers, the
+ * first event of each list is the oldest one, and an event is blocked iff that one is older than the event itself. */
+
+typedef enum EventLinkType {
+        EVENT_LINK_ID,          /* the device node or network interface of the event */
+        EVENT_LINK_DEVPATH,     /* the device path of the event */
+        EVENT_LINK_PARENT,      /* a device path above the device path of the event */
+} EventLinkType;
+
+struct event_bucket {
+        char *key;
+
+        /* the events with this device path, node or interface, and the events of the devices below this path */
+        LIST_HEAD(struct event_link, events);
+        LIST_HEAD(struct event_link, children);
+        struct event_link *events_tail;
+        struct event_link *children_tail;
+};
+
+struct event_link {
+        struct event_index_entry *entry;
+        struct event_bucket *bucket;
+        EventLinkType type;
+        LIST_FIELDS(struct event_link, links);
+};
+
+struct event_index {
+        Hashmap *by_id;         /* by "b8:0", "c4:64" or "n3", the same as the device ids of the udev database */
+        Hashmap *by_devpath;
+};
+
+struct event_index_entry {
+        struct event_index *index;
+        uint64_t seqnum;
+        char *devpath_old;
+        bool has_id;
+
+        size_t n_links;
+        struct event_link links[];
+};
+
+static struct event_bucket *event_bucket_free(struct event_bucket *b) {
+        if (!b)
+                return NULL;
+
+        assert(!b->events);
+        assert(!b->children);
+
+        free(b->key);
+        return mfree(b);
+}
+
+static int event_bucket_link(Hashmap **buckets, const char *key, EventLinkType type, struct event_link *link) {
+        struct event_bucket *b;
+        int r;
+
+        assert(buckets);
+        assert(key);
+        assert(link);
+
+        b = hashmap_get(*buckets, key);
+        if (!b) {
+                r = hashmap_ensure_allocated(buckets, &string_hash_ops);
+                if (r < 0)
+                        return r;
+
+                b = new0(struct event_bucket, 1);
+                if (!b)
+                        return -ENOMEM;
+
+                b->key = strdup(key);
+                if (!b->key) {
+                        free(b);
+                        return -ENOMEM;
+                }
+
+                r = hashmap_put(*buckets, b->key, b);
+                if (r < 0) {
+                        event_bucket_free(b);
+                        return r;
+                }
+        }
+
+        link->bucket = b;
+        link->type = type;
+
+        if (type == EVENT_LINK_PARENT) {
+                LIST_INSERT_AFTER(links, b->children, b->children_tail, link);
+                b->children_tail = link;
+        } else {
+                LIST_INSERT_AFTER(links, b->events, b->events_tail, link);
+                b->events_tail = link;
+        }
+
+        return 0;
+}
+
+static void event_bucket_unlink(Hashmap *buckets, struct event_link *link) {
+        struct event_bucket *b;
+
+        assert(link);
+
+        b = link->bucket;
+        if (!b)
+                return;
+
+        if (link->type == EVENT_LINK_PARENT) {
+                if (b->children_tail == link)
+                        b->children_tail = link->links_prev;
+                LIST_REMOVE(links, b->children, link);
+        } else {
+                if (b->events_tail == link)
+                        b->events_tail = link->links_prev;
+                LIST_REMOVE(links, b->events, link);
+        }
+
+        link->bucket = NULL;
+
+        if (!b->events && !b->children) {
+                assert_se(hashmap_remove(buckets, b->key) == b);
+                event_bucket_free(b);
+        }
+}
+
+static bool event_list_has_earlier(struct event_link *head, struct event_index_entry *entry) {
+        return head && head->entry->seqnum < entry->seqnum;
+}
+
+struct event_index *event_index_free(struct event_index *index) {
+        if (!index)
+                return NULL;
+
+        /* All entries must be freed first, as they refer to the buckets */
+        assert(hashmap_isempty(index->by_id));
+        assert(hashmap_isempty(index->by_devpath));
+
+        hashmap_free(index->by_id);
+        hashmap_free(index->by_devpath);
+
+        return mfree(index);
+}
+
+struct event_index_entry *event_index_entry_free(struct event_index_entry *entry) {
+        size_t i;
+
+        if (!entry)
+                return NULL;
+
+        for (i = 0; i < entry->n_links; i++)
+                event_bucket_unlink(entry->links[i].type == EVENT_LINK_ID ? entry->index->by_id : entry->index->by_devpath,
+                                    entry->links + i);
+
+        free(entry->devpath_old);
+        return mfree(entry);
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(struct event_index_entry*, event_index_entry_free);
+
+int event_index_add(struct event_index **index, sd_device *dev, uint64_t seqnum, struct event_index_entry **ret) {
+        _cleanup_(event_index_entry_freep) struct event_index_entry *entry = NULL;
+        char ids[2][DECIMAL_STR_MAX(unsigned) * 2 + 2];
+        const char *subsystem, *devpath, *devpath_old;
+        _cleanup_free_ char *path = NULL;
+        size_t n_ids = 0, n_links, i;
+        dev_t devnum;
+        int r, ifindex;
+        char *p;
+
+        assert(index);
+        assert(dev);
+        assert(ret);
+
+        r = sd_device_get_subsystem(dev, &subsystem);
+        if (r == -ENOENT)
+                subsystem = NULL;
+        else if (r < 0)
+                return r;
+
+        r = sd_device_get_devpath(dev, &devpath);
+        if (r < 0)
+                return r;
+
+        r = sd_device_get_property_value(dev, "DEVPATH_OLD", &devpath_old);
+        if (r == -ENOENT)
+                devpath_old = NULL;
+        else if (r < 0)
+                return r;
+
+        r = sd_device_get_devnum(dev, &devnum);
+        if (r >= 0 && major(devnum) != 0)
+                xsprintf(ids[n_ids++], "%c%u:%u", streq_ptr(subsystem, "block") ? 'b' : 'c', major(devnum), minor(devnum));
+        else if (r < 0 && r != -ENOENT)
+                return r;
+
+        r = sd_device_get_ifindex(dev, &ifindex);
+        if (r >= 0 && ifindex > 0)
+                xsprintf(ids[n_ids++], "n%i", ifindex);
+        else if (r < 0 && r != -ENOENT)
+                return r;
+
+        /* One link for each id, one for the device path, and one for each path above it */
+        n_links = n_ids + 1;
+        for (p = strchr(devpath + 1, '/'); p; p = strchr(p + 1, '/'))
+                n_links++;
+
+        path = strdup(devpath);
+        if (!path)
+                return -ENOMEM;
+
+        if (!*index) {
+                *index = new0(struct event_index, 1);
+                if (!*index)
+                        return -ENOMEM;
+        }
+
+        entry = malloc0(offsetof(struct event_index_entry, links) + n_links * sizeof(struct event_link));
+        if (!entry)
+                return -ENOMEM;
+
+        entry->index = *index;
+        entry->seqnum = seqnum;
+        entry->has_id = n_ids > 0;
+
+        if (devpath_old) {
+                entry->devpath_old = strdup(devpath_old);
+                if (!entry->devpath_old)
+                        return -ENOMEM;
+        }
+
+        for (i = 0; i < n_links; i++)
+                entry->links[i].entry = entry;
+
+        for (i = 0; i < n_ids; i++) {
+                r = event_bucket_link(&(*index)->by_id, ids[i], EVENT_LINK_ID, entry->links + entry->n_links);
+                if (r < 0)
+                        return r;
+                entry->n_links++;
+        }
+
+        r = event_bucket_link(&(*index)->by_devpath, path, EVENT_LINK_DEVPATH, entry->links + entry->n_links);
+        if (r < 0)
+                return r;
+        entry->n_links++;
+
+        for (p = strchr(path + 1, '/'); p; p = strchr(p + 1, '/')) {
+                *p = '\0';
+                r = event_bucket_link(&(*index)->by_devpath, path, EVENT_LINK_PARENT, entry->links + entry->n_links);
+                *p = '/';
+                if (r < 0)
+                        return r;
+                entry->n_links++;
+        }
+
+        assert(entry->n_links == n_links);
+
+        *ret = TAKE_PTR(entry);
+        return 0;
+}
+
+bool event_index_entry_is_blocked(struct event_index_entry *entry) {
+        struct event_bucket *b;
+        size_t i;
+
+        assert(entry);
+
+        for (i = 0; i < entry->n_links; i++) {
+                b = entry->links[i].bucket;
+
+                switch (entry->links[i].type) {
+
+                case EVENT_LINK_ID:
+                        if (event_list_has_earlier(b->events, entry))
+                                return true;
+                        break;
+
+                case EVENT_LINK_DEVPATH:
+                        /* Devices with a device node or network interface might have been renamed or swapped in
+                         * the meantime, hence for them only the id is relevant, not the path */
+                        if (!entry->has_id && event_list_has_earlier(b->events, entry))
+                                return true;
+
+                        if (event_list_has_earlier(b->children, entry))
+                                return true;
+                        break;
+
+                case EVENT_LINK_PARENT:
+                        if (event_list_has_earlier(b->events, entry))
+                                return true;
+                        break;
+                }
+        }
+
+        if (entry->devpath_old) {
+                b = hashmap_get(entry->index->by_devpath, entry->devpath_old);
+                if (b && event_list_has_earlier(b->events, entry))
+                        return true;
+        }
+
+        return false;
+}
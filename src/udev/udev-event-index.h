@@ -0,0 +1,24 @@
+/* SPDX-License-Identifier: GPL-2.0+ */
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "sd-device.h"
+
+#include "macro.h"
+
+/* An index of the queued and running events by the device node, network interface and device path of their
+ * devices, so that the events an event has to wait for can be found without looking at all earlier events. */
+
+struct event_index;
+struct event_index_entry;
+
+struct event_index *event_index_free(struct event_index *index);
+DEFINE_TRIVIAL_CLEANUP_FUNC(struct event_index*, event_index_free);
+
+/* Events must be added in the order of their sequence numbers */
+int event_index_add(struct event_index **index, sd_device *dev, uint64_t seqnum, struct event_index_entry **ret);
+struct event_index_entry *event_index_entry_free(struct event_index_entry *entry);
+
+bool event_index_entry_is_blocked(struct event_index_entry *entry);
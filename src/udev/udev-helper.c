@@ -0,0 +1,362 @@
+/* SPDX-License-Identifier: GPL-2.0+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "alloc-util.h"
+#include "device-util.h"
+#include "extract-word.h"
+#include "fd-util.h"
+#include "hashmap.h"
+#include "io-util.h"
+#include "parse-util.h"
+#include "path-util.h"
+#include "process-util.h"
+#include "string-util.h"
+#include "strv.h"
+#include "strxcpyx.h"
+#include "udev-helper.h"
+
+/* Helpers are programs which handle the PROGRAM{helper}= and IMPORT{helper}= keys of many events, instead of being
+ * started for each of them. A helper is started when it is needed first, once per worker process, as its plain path
+ * without any arguments, and with a socket as its stdin and stdout. It is then sent one request at a time, and has
+ * to reply to it before it gets the next one, see udev(7):
+ *
+ *   request: the command line, after the substitutions, the properties of the device as KEY=value, and an empty line
+ *   reply:   the exit status as a decimal number, the output of the program, and an empty line
+ *
+ * A helper which does not reply in time, exits or replies garbage is killed, and started again for the next request.
+ * Helpers are killed when the worker which started them exits. */
+
+#define HELPER_REPLY_MAX (64U * 1024U)
+
+typedef struct Helper {
+        char *path;
+        pid_t pid;
+        int fd;
+} Helper;
+
+static Hashmap *helpers = NULL;
+
+static Helper *helper_free(Helper *helper) {
+        if (!helper)
+                return NULL;
+
+        helper->fd = safe_close(helper->fd);
+
+        /* Helpers keep no state between requests, hence there is nothing to lose when they are killed right away,
+         * instead of waiting for them to notice the closed socket. */
+        if (helper->pid > 0) {
+                (void) kill_and_sigcont(helper->pid, SIGKILL);
+                (void) wait_for_terminate(helper->pid, NULL);
+        }
+
+        free(helper->path);
+        return mfree(helper);
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(Helper*, helper_free);
+
+void udev_helpers_free(void) {
+        helpers = hashmap_free_with_destructor(helpers, helper_free);
+}
+
+static void helper_forget(Helper *helper) {
+        assert(helper);
+
+        assert_se(hashmap_remove(helpers, helper->path) == helper);
+        helper_free(helper);
+}
+
+static int helper_start(const char *path, Helper **ret) {
+        _cleanup_(helper_freep) Helper *helper = NULL;
+        _cleanup_close_pair_ int pair[2] = { -1, -1 };
+        int r;
+
+        assert(path);
+        assert(ret);
+
+        r = hashmap_ensure_allocated(&helpers, &string_hash_ops);
+        if (r < 0)
+                return r;
+
+        helper = new(Helper, 1);
+        if (!helper)
+                return -ENOMEM;
+
+        *helper = (Helper) {
+                .fd = -1,
+        };
+
+        helper->path = strdup(path);
+        if (!helper->path)
+                return -ENOMEM;
+
+        if (socketpair(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC, 0, pair) < 0)
+                return -errno;
+
+        log_debug("Starting helper '%s'", path);
+
+        r = safe_fork("(helper)", FORK_RESET_SIGNALS|FORK_DEATHSIG|FORK_LOG, &helper->pid);
+        if (r < 0)
+                return r;
+        if (r == 0) {
+                int fd_out;
+
+                /* stderr is inherited, so that the messages of the helper end up where ours do */
+                fd_out = fcntl(pair[1], F_DUPFD_CLOEXEC, 3);
+                if (fd_out < 0)
+                        _exit(EXIT_FAILURE);
+
+                if (rearrange_stdio(pair[1], fd_out, STDERR_FILENO) < 0)
+                        _exit(EXIT_FAILURE);
+
+                (void) close_all_fds(NULL, 0);
+
+                execve(path, STRV_MAKE((char*) path), STRV_MAKE_EMPTY);
+                _exit(EXIT_FAILURE);
+        }
+
+        pair[1] = safe_close(pair[1]);
+
+        r = fd_nonblock(pair[0], true);
+        if (r < 0)
+                return r;
+
+        helper->fd = TAKE_FD(pair[0]);
+
+        r = hashmap_put(helpers, helper->path, helper);
+        if (r < 0)
+                return r;
+
+        *ret = TAKE_PTR(helper);
+        return 0;
+}
+
+static int helper_wait(Helper *helper, int event, usec_t deadline_usec) {
+        usec_t n;
+        int r;
+
+        assert(helper);
+
+        n = now(CLOCK_MONOTONIC);
+        if (deadline_usec != USEC_INFINITY && n >= deadline_usec)
+                return -ETIMEDOUT;
+
+        r = fd_wait_for_event(helper->fd, event, deadline_usec == USEC_INFINITY ? USEC_INFINITY : deadline_usec - n);
+        if (r < 0)
+                return r;
+        if (r == 0)
+                return -ETIMEDOUT;
+
+        return 0;
+}
+
+static int helper_send(Helper *helper, const char *request, size_t size, usec_t deadline_usec) {
+        ssize_t l;
+        int r;
+
+        assert(helper);
+        assert(request);
+
+        while (size > 0) {
+                l = send(helper->fd, request, size, MSG_NOSIGNAL);
+                if (l < 0) {
+                        if (errno == EINTR)
+                                continue;
+                        if (errno != EAGAIN)
+                                return -errno;
+
+                        r = helper_wait(helper, POLLOUT, deadline_usec);
+                        if (r < 0)
+                                return r;
+
+                        continue;
+                }
+
+                request += l;
+                size -= l;
+        }
+
+        return 0;
+}
+
+/* Returns the reply without its terminating empty line, and with the exit status in the first line */
+static int helper_receive(Helper *helper, usec_t deadline_usec, char **ret) {
+        _cleanup_free_ char *reply = NULL;
+        size_t allocated = 0, size = 0;
+        ssize_t l;
+        char *end;
+        int r;
+
+        assert(helper);
+        assert(ret);
+
+        for (;;) {
+                if (!GREEDY_REALLOC(reply, allocated, size + 4096 + 1))
+                        return -ENOMEM;
+
+                l = read(helper->fd, reply + size, MIN(allocated - size - 1, HELPER_REPLY_MAX - size));
+                if (l < 0) {
+                        if (errno == EINTR)
+                                continue;
+                        if (errno != EAGAIN)
+                                return -errno;
+
+                        r = helper_wait(helper, POLLIN, deadline_usec);
+                        if (r < 0)
+                                return r;
+
+                        continue;
+                }
+                if (l == 0)
+                        return -ECONNRESET;
+
+                size += l;
+                reply[size] = '\0';
+
+                end = strstr(reply, "\n\n");
+                if (end) {
+                        /* a well behaving helper does not send anything before it got the next request */
+                        if (end + 2 != reply + size)
+                                return -EBADMSG;
+
+                        end[1] = '\0';
+                        *ret = TAKE_PTR(reply);
+                        return 0;
+                }
+
+                if (size >= HELPER_REPLY_MAX)
+                        return -EMSGSIZE;
+        }
+}
+
+static int helper_request(sd_device *dev, const char *cmd, char **ret) {
+        _cleanup_free_ char *request = NULL;
+        const char *key, *value;
+        size_t allocated = 0, size = 0;
+
+        assert(dev);
+        assert(cmd);
+        assert(ret);
+
+        if (strchr(cmd, '\n'))
+                return -EINVAL;
+
+        if (!GREEDY_REALLOC(request, allocated, strlen(cmd) + 2))
+                return -ENOMEM;
+
+        size = stpcpy(stpcpy(request, cmd), "\n") - request;
+
+        FOREACH_DEVICE_PROPERTY(dev, key, value) {
+                size_t k = strlen(key), v = strlen(value);
+
+                /* properties are single lines, but let's make sure they cannot confuse the helper */
+                if (strchr(value, '\n'))
+                        continue;
+
+                if (!GREEDY_REALLOC(request, allocated, size + k + v + 3))
+                        return -ENOMEM;
+
+                memcpy(request + size, key, k);
+                size += k;
+                request[size++] = '=';
+                memcpy(request + size, value, v);
+                size += v;
+                request[size++] = '\n';
+        }
+
+        if (!GREEDY_REALLOC(request, allocated, size + 2))
+                return -ENOMEM;
+
+        request[size++] = '\n';
+        request[size] = '\0';
+
+        *ret = TAKE_PTR(request);
+        return 0;
+}
+
+int udev_helper_run(sd_device *dev, const char *cmd, usec_t deadline_usec, bool accept_failure,
+                    char *result, size_t ressize) {
+        _cleanup_free_ char *path = NULL, *request = NULL, *reply = NULL;
+        const char *p = cmd, *output;
+        Helper *helper;
+        int r, status;
+        char *nl;
+
+        assert(dev);
+        assert(cmd);
+        assert(result || ressize == 0);
+
+        r = extract_first_word(&p, &path, NULL, EXTRACT_QUOTES|EXTRACT_RELAX);
+        if (r < 0)
+                return log_error_errno(r, "Failed to parse command '%s': %m", cmd);
+        if (r == 0)
+                return log_error_errno(SYNTHETIC_ERRNO(EINVAL), "Invalid command '%s'", cmd);
+
+        /* allow programs in /usr/lib/udev/ to be called without the path */
+        if (!path_is_absolute(path)) {
+                char *program;
+
+                program = path_join(UDEVLIBEXECDIR, path);
+                if (!program)
+                        return log_oom();
+
+                free_and_replace(path, program);
+        }
+
+        r = helper_request(dev, cmd, &request);
+        if (r < 0)
+                return log_device_error_errno(dev, r, "Failed to prepare request for helper '%s': %m", path);
+
+        helper = hashmap_get(helpers, path);
+        if (!helper) {
+                r = helper_start(path, &helper);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to start helper '%s': %m", path);
+        }
+
+        log_debug("Asking helper '%s' ["PID_FMT"] to run '%s'", path, helper->pid, cmd);
+
+        r = helper_send(helper, request, strlen(request), deadline_usec);
+        if (r >= 0)
+                r = helper_receive(helper, deadline_usec, &reply);
+        if (r == -ETIMEDOUT) {
+                log_error("Helper '%s' ["PID_FMT"] timed out on '%s', killing", path, helper->pid, cmd);
+                helper_forget(helper);
+                return r;
+        }
+        if (r < 0) {
+                log_error_errno(r, "Failed to communicate with helper '%s' ["PID_FMT"], killing: %m", path, helper->pid);
+                helper_forget(helper);
+                return r;
+        }
+
+        nl = strchr(reply, '\n');
+        assert(nl);
+        *nl = '\0';
+        output = nl + 1;
+
+        r = safe_atoi(reply, &status);
+        if (r < 0 || status < 0) {
+                log_error("Helper '%s' ["PID_FMT"] sent an invalid exit status '%s', killing", path, helper->pid, reply);
+                helper_forget(helper);
+                return -EBADMSG;
+        }
+
+        if (result)
+                strscpy(result, ressize, output);
+
+        if (status != 0) {
+                log_full(accept_failure ? LOG_DEBUG : LOG_WARNING,
+                         "Helper '%s' failed on '%s' with exit code %i.", path, cmd, status);
+                return -EIO;
+        }
+
+        log_debug("Helper '%s' succeeded on '%s'.", path, cmd);
+        return 0;
+}
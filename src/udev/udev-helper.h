@@ -0,0 +1,17 @@
+/* SPDX-License-Identifier: GPL-2.0+ */
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "sd-device.h"
+
+#include "time-util.h"
+
+/* Runs cmd with the helper named by its first word, starting the helper if it is not running yet. Returns 0 if the
+ * helper reported success, -EIO if it reported a failure, and another negative errno if it could not be asked. */
+int udev_helper_run(sd_device *dev, const char *cmd, usec_t deadline_usec, bool accept_failure,
+                    char *result, size_t ressize);
+
+/* Stops all helpers */
+void udev_helpers_free(void);
@@ -6,6 +6,7 @@
 #include <stddef.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/file.h>
 #include <sys/stat.h>
 #include <unistd.h>
 
@@ -15,10 +16,12 @@
 #include "device-util.h"
 #include "dirent-util.h"
 #include "fd-util.h"
+#include "fileio.h"
 #include "format-util.h"
 #include "fs-util.h"
 #include "libudev-util.h"
 #include "mkdir.h"
+#include "parse-util.h"
 #include "path-util.h"
 #include "selinux-util.h"
 #include "smack-util.h"
@@ -105,21 +108,94 @@ static int node_symlink(sd_device *dev, const char *node, const char *slink) {
         return r;
 }
 
-/* find device node of device with highest priority */
-static int link_find_prioritized(sd_device *dev, bool add, const char *stackdir, char **ret) {
-        _cleanup_closedir_ DIR *dir = NULL;
-        _cleanup_free_ char *target = NULL;
-        struct dirent *dent;
-        int r, priority = 0;
+/* Each symlink which is claimed by devices has a stack directory /run/udev/links/<link>. It has an entry for each
+ * claiming device, named by its device id, and pointing to "<priority>:<device node>". Older versions created empty
+ * files instead, for which the priority and device node are read from the database of the device. The symlink
+ * STACK_OWNER points to the id of the device which currently owns the link, so that the owner does not need to be
+ * looked up among all the claiming devices on every event, which adds up when hundreds of devices share a link, as
+ * with multipath. All updates of a stack directory are done while holding a lock on it. */
 
-        assert(!add || dev);
-        assert(stackdir);
+#define STACK_OWNER "owner"
+
+static int stack_open(const char *dirname, bool create, int *ret) {
+        _cleanup_close_ int fd = -1;
+        struct stat st;
+        int r;
+
+        assert(dirname);
         assert(ret);
 
-        if (add) {
-                const char *devnode;
+        for (;;) {
+                if (create) {
+                        r = mkdir_parents(dirname, 0755);
+                        if (r < 0)
+                                return r;
 
-                r = device_get_devlink_priority(dev, &priority);
+                        if (mkdir(dirname, 0755) < 0 && errno != EEXIST)
+                                return -errno;
+                }
+
+                fd = open(dirname, O_RDONLY|O_DIRECTORY|O_CLOEXEC|O_NOFOLLOW);
+                if (fd < 0)
+                        return -errno;
+
+                if (flock(fd, LOCK_EX) < 0)
+                        return -errno;
+
+                if (fstat(fd, &st) < 0)
+                        return -errno;
+
+                /* the last claiming device removed the directory, while we were waiting for the lock */
+                if (st.st_nlink > 0)
+                        break;
+
+                fd = safe_close(fd);
+                if (!create)
+                        return -ENOENT;
+        }
+
+        *ret = TAKE_FD(fd);
+        return 0;
+}
+
+static int stack_write(int dirfd, const char *name, const char *value) {
+        const char *tmp;
+
+        assert(dirfd >= 0);
+        assert(name);
+        assert(value);
+
+        /* the dot hides the temporary link from older versions, which skip such entries */
+        tmp = strjoina(".tmp-", name);
+        (void) unlinkat(dirfd, tmp, 0);
+
+        if (symlinkat(value, dirfd, tmp) < 0)
+                return -errno;
+
+        if (renameat(dirfd, tmp, dirfd, name) < 0) {
+                (void) unlinkat(dirfd, tmp, 0);
+                return -errno;
+        }
+
+        return 0;
+}
+
+static int stack_read(int dirfd, const char *id, int *ret_priority, char **ret_devnode) {
+        _cleanup_free_ char *value = NULL;
+        const char *devnode;
+        char *colon;
+        int r;
+
+        assert(dirfd >= 0);
+        assert(id);
+        assert(ret_priority);
+
+        r = readlinkat_malloc(dirfd, id, &value);
+        if (r == -EINVAL) {
+                _cleanup_(sd_device_unrefp) sd_device *dev = NULL;
+
+                /* written by an older version */
+                r = sd_device_new_from_device_id(&dev, id);
                 if (r < 0)
                         return r;
 
@@ -127,70 +203,110 @@ static int link_find_prioritized(sd_device *dev, bool add, const char *stackdir,
                 if (r < 0)
                         return r;
 
-                target = strdup(devnode);
-                if (!target)
+                r = device_get_devlink_priority(dev, ret_priority);
+                if (r < 0)
+                        return r;
+
+                if (ret_devnode) {
+                        *ret_devnode = strdup(devnode);
+                        if (!*ret_devnode)
+                                return -ENOMEM;
+                }
+
+                return 0;
+        }
+        if (r < 0)
+                return r;
+
+        colon = strchr(value, ':');
+        if (!colon || !path_is_absolute(colon + 1))
+                return -EBADMSG;
+        *colon = '\0';
+
+        r = safe_atoi(value, ret_priority);
+        if (r < 0)
+                return r;
+
+        if (ret_devnode) {
+                *ret_devnode = strdup(colon + 1);
+                if (!*ret_devnode)
                         return -ENOMEM;
         }
 
-        dir = opendir(stackdir);
-        if (!dir) {
-                if (target) {
-                        *ret = TAKE_PTR(target);
-                        return 0;
-                }
+        return 0;
+}
 
-                return -errno;
+/* find the device with the highest priority among all claiming devices, preferring the given one on ties */
+static int stack_scan(sd_device *dev, int dirfd, const char *id_filename, bool add, int priority, const char *devnode,
+                      char **ret_owner, char **ret_devnode) {
+        _cleanup_free_ char *owner = NULL, *target = NULL;
+        _cleanup_closedir_ DIR *dir = NULL;
+        struct dirent *dent;
+        int r;
+
+        assert(dev);
+        assert(dirfd >= 0);
+        assert(id_filename);
+        assert(ret_owner);
+        assert(ret_devnode);
+
+        if (add) {
+                owner = strdup(id_filename);
+                target = strdup(devnode);
+                if (!owner || !target)
+                        return -ENOMEM;
         }
 
+        dir = xopendirat(dirfd, ".", 0);
+        if (!dir)
+                return -errno;
+
         FOREACH_DIRENT_ALL(dent, dir, break) {
-                _cleanup_(sd_device_unrefp) sd_device *dev_db = NULL;
-                const char *devnode, *id_filename;
-                int db_prio = 0;
+                _cleanup_free_ char *db_devnode = NULL;
+                int db_prio;
 
-                if (dent->d_name[0] == '\0')
-                        break;
                 if (dent->d_name[0] == '.')
                         continue;
-
-                log_device_debug(dev, "Found '%s' claiming '%s'", dent->d_name, stackdir);
-
-                if (device_get_id_filename(dev, &id_filename) < 0)
+                if (streq(dent->d_name, STACK_OWNER))
                         continue;
 
                 /* did we find ourself? */
                 if (streq(dent->d_name, id_filename))
                         continue;
 
-                if (sd_device_new_from_device_id(&dev_db, dent->d_name) < 0)
-                        continue;
-
-                if (sd_device_get_devname(dev_db, &devnode) < 0)
-                        continue;
+                log_device_debug(dev, "Found '%s' claiming the link", dent->d_name);
 
-                if (device_get_devlink_priority(dev_db, &db_prio) < 0)
+                if (stack_read(dirfd, dent->d_name, &db_prio, &db_devnode) < 0)
                         continue;
 
                 if (target && db_prio <= priority)
                         continue;
 
-                log_device_debug(dev_db, "Device claims priority %i for '%s'", db_prio, stackdir);
+                log_device_debug(dev, "Device '%s' claims priority %i for '%s'", dent->d_name, db_prio, db_devnode);
 
-                r = free_and_strdup(&target, devnode);
+                r = free_and_strdup(&owner, dent->d_name);
                 if (r < 0)
                         return r;
+                free_and_replace(target, db_devnode);
                 priority = db_prio;
         }
 
-        *ret = TAKE_PTR(target);
+        if (!target)
+                return -ENOENT;
+
+        *ret_owner = TAKE_PTR(owner);
+        *ret_devnode = TAKE_PTR(target);
         return 0;
 }
 
 /* manage "stack of names" with possibly specified device priorities */
 static int link_update(sd_device *dev, const char *slink, bool add) {
-        _cleanup_free_ char *target = NULL, *filename = NULL, *dirname = NULL;
+        _cleanup_free_ char *dirname = NULL, *value = NULL, *owner = NULL, *new_owner = NULL, *target = NULL;
+        _cleanup_close_ int dirfd = -1;
         char name_enc[PATH_MAX];
-        const char *id_filename;
-        int r;
+        const char *id_filename, *devnode = NULL;
+        int r, priority = 0, old_priority = 0, owner_priority;
+        bool had_entry = false;
 
         assert(dev);
         assert(slink);
@@ -203,34 +319,92 @@ static int link_update(sd_device *dev, const char *slink, bool add) {
         dirname = path_join("/run/udev/links/", name_enc);
         if (!dirname)
                 return log_oom();
-        filename = path_join(dirname, id_filename);
-        if (!filename)
-                return log_oom();
 
-        if (!add && unlink(filename) == 0)
-                (void) rmdir(dirname);
+        if (add) {
+                r = device_get_devlink_priority(dev, &priority);
+                if (r < 0)
+                        return log_device_debug_errno(dev, r, "Failed to get devlink priority: %m");
 
-        r = link_find_prioritized(dev, add, dirname, &target);
-        if (r < 0) {
-                log_device_debug(dev, "No reference left, removing '%s'", slink);
-                if (unlink(slink) == 0)
-                        (void) rmdir_parents(slink, "/");
-        } else
-                (void) node_symlink(dev, target, slink);
+                r = sd_device_get_devname(dev, &devnode);
+                if (r < 0)
+                        return log_device_debug_errno(dev, r, "Failed to get devname: %m");
 
-        if (add)
-                do {
-                        _cleanup_close_ int fd = -1;
+                if (asprintf(&value, "%i:%s", priority, devnode) < 0)
+                        return log_oom();
+        }
 
-                        r = mkdir_parents(filename, 0755);
-                        if (!IN_SET(r, 0, -ENOENT))
-                                break;
-                        fd = open(filename, O_WRONLY|O_CREAT|O_CLOEXEC|O_TRUNC|O_NOFOLLOW, 0444);
-                        if (fd < 0)
-                                r = -errno;
-                } while (r == -ENOENT);
+        r = stack_open(dirname, add, &dirfd);
+        if (r == -ENOENT && !add)
+                goto remove;
+        if (r < 0)
+                return log_device_debug_errno(dev, r, "Failed to open and lock '%s': %m", dirname);
 
-        return r;
+        had_entry = stack_read(dirfd, id_filename, &old_priority, NULL) >= 0;
+
+        if (add) {
+                r = stack_write(dirfd, id_filename, value);
+                if (r < 0)
+                        return log_device_debug_errno(dev, r, "Failed to create '%s/%s': %m", dirname, id_filename);
+        } else if (unlinkat(dirfd, id_filename, 0) < 0 && errno != ENOENT)
+                return log_device_debug_errno(dev, errno, "Failed to remove '%s/%s': %m", dirname, id_filename);
+
+        /* Only if the owner is gone, or lowered its priority, all claiming devices need to be looked at */
+        if (readlinkat_malloc(dirfd, STACK_OWNER, &owner) >= 0) {
+                _cleanup_free_ char *owner_devnode = NULL;
+                bool keep;
+
+                if (streq(owner, id_filename))
+                        keep = add && had_entry && priority >= old_priority;
+                else if (stack_read(dirfd, owner, &owner_priority, &owner_devnode) >= 0) {
+                        keep = true;
+
+                        /* like the scan below, the device with the event wins on ties */
+                        if (add && priority >= owner_priority)
+                                owner_devnode = mfree(owner_devnode);
+                } else
+                        keep = false;
+
+                if (keep) {
+                        if (owner_devnode) {
+                                new_owner = strdup(owner);
+                                target = TAKE_PTR(owner_devnode);
+                        } else {
+                                new_owner = strdup(id_filename);
+                                target = strdup(devnode);
+                        }
+                        if (!new_owner || !target)
+                                return log_oom();
+                }
+        }
+
+        if (!target) {
+                r = stack_scan(dev, dirfd, id_filename, add, priority, devnode, &new_owner, &target);
+                if (r == -ENOENT) {
+                        /* We hold the lock, so nobody else can add an entry right now. If another device with the
+                         * link is waiting for the lock, it notices the directory is gone, and creates it again. */
+                        (void) unlinkat(dirfd, STACK_OWNER, 0);
+                        (void) rmdir(dirname);
+                        goto remove;
+                }
+                if (r < 0)
+                        return log_device_debug_errno(dev, r, "Failed to find device claiming '%s': %m", slink);
+        }
+
+        if (!streq_ptr(owner, new_owner)) {
+                r = stack_write(dirfd, STACK_OWNER, new_owner);
+                if (r < 0)
+                        log_device_debug_errno(dev, r, "Failed to record the owner of '%s', ignoring: %m", slink);
+        }
+
+        (void) node_symlink(dev, target, slink);
+        return 0;
+
+remove:
+        log_device_debug(dev, "No reference left, removing '%s'", slink);
+        if (unlink(slink) == 0)
+                (void) rmdir_parents(slink, "/");
+
+        return 0;
 }
 
 int udev_node_update_old_links(sd_device *dev, sd_device *dev_old) {
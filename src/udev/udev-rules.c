@@ -10,6 +10,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <time.h>
 #include <unistd.h>
 
@@ -28,6 +29,7 @@
 #include "parse-util.h"
 #include "path-util.h"
 #include "proc-cmdline.h"
+#include "siphash24.h"
 #include "stat-util.h"
 #include "stdio-util.h"
 #include "strbuf.h"
@@ -35,13 +37,18 @@
 #include "strv.h"
 #include "strxcpyx.h"
 #include "sysctl-util.h"
+#include "tmpfile-util.h"
+#include "udev-attr-cache.h"
 #include "udev-builtin.h"
+#include "udev-helper.h"
 #include "udev.h"
 #include "user-util.h"
 #include "util.h"
 
 #define PREALLOC_TOKEN          2048
 
+#define RULES_CACHE_SIG { 'U', 'D', 'E', 'V', 'R', 'U', 'L', 'E' }
+
 struct uid_gid {
         unsigned name_off;
         union {
@@ -57,6 +64,13 @@ static const char* const rules_dirs[] = {
         NULL
 };
 
+/* the ordinals of the rules with a specific constant match key, in ascending order */
+struct rule_list {
+        unsigned *rules;
+        size_t n_rules;
+        size_t n_allocated;
+};
+
 struct udev_rules {
         usec_t dirs_ts_usec;
         ResolveNameTiming resolve_name_timing;
@@ -66,9 +80,26 @@ struct udev_rules {
         unsigned token_cur;
         unsigned token_max;
 
+        /* the index of the TK_RULE token of each rule */
+        unsigned *rule_tokens;
+        size_t n_rules;
+
+        /* the rules indexed by their SUBSYSTEM==, literal KERNEL== prefix or ACTION== key, whichever comes first,
+         * so that only the rules that might match need to be looked at for an event, see index_rules() */
+        Hashmap *rules_by_subsystem;
+        Hashmap *rules_by_kernel;
+        Hashmap *rules_by_action;
+        struct rule_list rules_unindexed;
+
         /* all key strings are copied and de-duplicated in a single continuous string buffer */
         struct strbuf *strbuf;
 
+        /* when loaded from UDEV_RULES_CACHE, the tokens and strings point into the mapped file instead */
+        void *cache_map;
+        size_t cache_size;
+        char *cache_strings;
+        uint64_t fingerprint;
+
         /* during rule parsing, uid/gid lookup results are cached */
         struct uid_gid *uids;
         unsigned uids_cur;
@@ -79,6 +110,9 @@ struct udev_rules {
 };
 
 static char *rules_str(struct udev_rules *rules, unsigned off) {
+        if (rules->cache_map)
+                return rules->cache_strings + off;
+
         return rules->strbuf->buf + off;
 }
 
@@ -143,9 +177,9 @@ enum token_type {
         TK_M_PARENTS_MAX,
 
         TK_M_TEST,                      /* val, mode_t */
-        TK_M_PROGRAM,                   /* val */
+        TK_M_PROGRAM,                   /* val, bool */
         TK_M_IMPORT_FILE,               /* val */
-        TK_M_IMPORT_PROG,               /* val */
+        TK_M_IMPORT_PROG,               /* val, bool */
         TK_M_IMPORT_BUILTIN,            /* val */
         TK_M_IMPORT_DB,                 /* val */
         TK_M_IMPORT_CMDLINE,            /* val */
@@ -179,6 +213,20 @@ enum token_type {
         TK_END,
 };
 
+/* The compiled rules in UDEV_RULES_CACHE: this header, followed by the tokens and the string buffer. The tokens are
+ * stored in their in-memory layout, hence the file is only ever picked up by the udev build that wrote it. */
+struct rules_cache_header {
+        uint8_t signature[8];
+        char tool_version[32];
+        uint32_t header_size;
+        uint32_t token_size;
+        uint32_t token_types;
+        uint32_t resolve_name_timing;
+        uint64_t fingerprint;
+        uint64_t n_tokens;
+        uint64_t strings_size;
+};
+
 /* we try to pack stuff in a way that we take only 12 bytes per token */
 struct token {
         union {
@@ -209,6 +257,7 @@ struct token {
                                 int devlink_prio;
                                 int watch;
                                 enum udev_builtin_cmd builtin_cmd;
+                                bool helper;
                         };
                 } key;
         };
@@ -323,7 +372,7 @@ static void dump_token(struct udev_rules *rules, struct token *token) {
         enum operation_type op = token->key.op;
         enum string_glob_type glob = token->key.glob;
         const char *value = rules_str(rules, token->key.value_off);
-        const char *attr = &rules->strbuf->buf[token->key.attr_off];
+        const char *attr = rules_str(rules, token->key.attr_off);
 
         switch (type) {
         case TK_RULE:
@@ -333,9 +382,9 @@ static void dump_token(struct udev_rules *rules, struct token *token) {
                         unsigned idx = (tk_ptr - tks_ptr) / sizeof(struct token);
 
                         log_debug("* RULE %s:%u, token: %u, count: %u, label: '%s'",
-                                  &rules->strbuf->buf[token->rule.filename_off], token->rule.filename_line,
+                                  rules_str(rules, token->rule.filename_off), token->rule.filename_line,
                                   idx, token->rule.token_count,
-                                  &rules->strbuf->buf[token->rule.label_off]);
+                                  rules_str(rules, token->rule.label_off));
                         break;
                 }
         case TK_M_ACTION:
@@ -432,11 +481,17 @@ static void dump_token(struct udev_rules *rules, struct token *token) {
 static void dump_rules(struct udev_rules *rules) {
         unsigned i;
 
-        log_debug("Dumping %u (%zu bytes) tokens, %zu (%zu bytes) strings",
-                  rules->token_cur,
-                  rules->token_cur * sizeof(struct token),
-                  rules->strbuf->nodes_count,
-                  rules->strbuf->len);
+        if (rules->strbuf)
+                log_debug("Dumping %u (%zu bytes) tokens, %zu (%zu bytes) strings",
+                          rules->token_cur,
+                          rules->token_cur * sizeof(struct token),
+                          rules->strbuf->nodes_count,
+                          rules->strbuf->len);
+        else
+                log_debug("Dumping %u (%zu bytes) tokens from %s",
+                          rules->token_cur,
+                          rules->token_cur * sizeof(struct token),
+                          UDEV_RULES_CACHE);
         for (i = 0; i < rules->token_cur; i++)
                 dump_token(rules, &rules->tokens[i]);
 }
@@ -640,14 +695,25 @@ static int import_file_into_properties(sd_device *dev, const char *filename) {
         return 0;
 }
 
+static int run_program(struct udev_event *event, usec_t timeout_usec, bool helper,
+                       const char *program, char *result, size_t ressize) {
+        if (helper)
+                return udev_helper_run(event->dev, program,
+                                       timeout_usec > 0 ? usec_add(event->birth_usec, timeout_usec) : USEC_INFINITY,
+                                       true, result, ressize);
+
+        return udev_event_spawn(event, timeout_usec, true, program, result, ressize);
+}
+
 static int import_program_into_properties(struct udev_event *event,
                                           usec_t timeout_usec,
+                                          bool helper,
                                           const char *program) {
         char result[UTIL_LINE_SIZE];
         char *line;
         int err;
 
-        err = udev_event_spawn(event, timeout_usec, true, program, result, sizeof(result));
+        err = run_program(event, timeout_usec, helper, program, result, sizeof(result));
         if (err < 0)
                 return err;
 
@@ -853,9 +919,7 @@ static void rule_add_key(struct rule_tmp *rule_tmp, enum token_type type,
         case TK_M_SUBSYSTEMS:
         case TK_M_DRIVERS:
         case TK_M_TAGS:
-        case TK_M_PROGRAM:
         case TK_M_IMPORT_FILE:
-        case TK_M_IMPORT_PROG:
         case TK_M_IMPORT_DB:
         case TK_M_IMPORT_CMDLINE:
         case TK_M_IMPORT_PARENT:
@@ -871,6 +935,12 @@ static void rule_add_key(struct rule_tmp *rule_tmp, enum token_type type,
         case TK_A_STATIC_NODE:
                 token->key.value_off = rules_add_string(rule_tmp->rules, value);
                 break;
+        case TK_M_PROGRAM:
+        case TK_M_IMPORT_PROG:
+                token->key.value_off = rules_add_string(rule_tmp->rules, value);
+                if (data)
+                        token->key.helper = *(bool *)data;
+                break;
         case TK_M_IMPORT_BUILTIN:
                 token->key.value_off = rules_add_string(rule_tmp->rules, value);
                 token->key.builtin_cmd = *(enum udev_builtin_cmd *)data;
@@ -1199,11 +1269,21 @@ static void add_rule(struct udev_rules *rules, char *line,
                         else
                                 rule_add_key(&rule_tmp, TK_A_TAG, op, value, NULL);
 
-                } else if (streq(key, "PROGRAM")) {
+                } else if (startswith(key, "PROGRAM")) {
+                        bool helper = false;
+
+                        attr = get_key_attribute(key + STRLEN("PROGRAM"));
+                        if (attr) {
+                                if (!streq(attr, "helper")) {
+                                        LOG_RULE_ERROR("Ignoring unknown %s{} type '%s'", "PROGRAM", attr);
+                                        continue;
+                                }
+                                helper = true;
+                        }
                         if (op == OP_REMOVE)
-                                LOG_AND_RETURN("Invalid %s operation", key);
+                                LOG_AND_RETURN("Invalid %s operation", "PROGRAM");
 
-                        rule_add_key(&rule_tmp, TK_M_PROGRAM, op, value, NULL);
+                        rule_add_key(&rule_tmp, TK_M_PROGRAM, op, value, &helper);
 
                 } else if (streq(key, "RESULT")) {
                         if (op > OP_MATCH_MAX)
@@ -1232,6 +1312,10 @@ static void add_rule(struct udev_rules *rules, char *line,
                                         }
                                 }
                                 rule_add_key(&rule_tmp, TK_M_IMPORT_PROG, op, value, NULL);
+                        } else if (streq(attr, "helper")) {
+                                const bool helper = true;
+
+                                rule_add_key(&rule_tmp, TK_M_IMPORT_PROG, op, value, &helper);
                         } else if (streq(attr, "builtin")) {
                                 const enum udev_builtin_cmd cmd = udev_builtin_lookup(value);
 
@@ -1512,10 +1596,386 @@ static int parse_file(struct udev_rules *rules, const char *filename) {
         return 0;
 }
 
+static struct rule_list *rule_list_free(struct rule_list *l) {
+        if (!l)
+                return NULL;
+
+        free(l->rules);
+        return mfree(l);
+}
+
+DEFINE_PRIVATE_HASH_OPS_FULL(rule_list_hash_ops, char, string_hash_func, string_compare_func, free,
+                             struct rule_list, rule_list_free);
+
+static int rule_list_add(struct rule_list *l, unsigned ordinal) {
+        assert(l);
+
+        /* A rule with a multi-value key is added for each value, but only once for each list */
+        if (l->n_rules > 0 && l->rules[l->n_rules - 1] == ordinal)
+                return 0;
+
+        if (!GREEDY_REALLOC(l->rules, l->n_allocated, l->n_rules + 1))
+                return -ENOMEM;
+
+        l->rules[l->n_rules++] = ordinal;
+        return 0;
+}
+
+static int rules_index_add(Hashmap **h, const char *key, unsigned ordinal) {
+        _cleanup_free_ char *k = NULL;
+        struct rule_list *l;
+        int r;
+
+        assert(h);
+        assert(key);
+
+        l = hashmap_get(*h, key);
+        if (!l) {
+                r = hashmap_ensure_allocated(h, &rule_list_hash_ops);
+                if (r < 0)
+                        return r;
+
+                k = strdup(key);
+                if (!k)
+                        return -ENOMEM;
+
+                l = new0(struct rule_list, 1);
+                if (!l)
+                        return -ENOMEM;
+
+                r = hashmap_put(*h, k, l);
+                if (r < 0) {
+                        rule_list_free(l);
+                        return r;
+                }
+                TAKE_PTR(k);
+        }
+
+        return rule_list_add(l, ordinal);
+}
+
+static int token_index_values(struct udev_rules *rules, const struct token *token, bool prefix, char ***ret) {
+        _cleanup_strv_free_ char **l = NULL;
+        const char *v;
+
+        assert(rules);
+        assert(token);
+        assert(ret);
+
+        /* Returns the values a positive match key accepts, or NULL if there are too many of them. With prefix
+         * shell globs are cut at their first special character, and all matching values start with one of the
+         * returned prefixes. */
+
+        *ret = NULL;
+
+        if (token->key.op != OP_MATCH)
+                return 0;
+        if (!IN_SET(token->key.glob, GL_PLAIN, GL_SPLIT) &&
+            !(prefix && IN_SET(token->key.glob, GL_GLOB, GL_SPLIT_GLOB)))
+                return 0;
+
+        for (v = rules_str(rules, token->key.value_off);; v++) {
+                size_t n = strcspn(v, "|");
+                char *w;
+
+                w = strndup(v, prefix ? MIN(n, strcspn(v, "*?[\\")) : n);
+                if (!w)
+                        return -ENOMEM;
+
+                if (prefix && isempty(w)) {
+                        free(w);
+                        return 0;
+                }
+
+                if (strv_consume(&l, w) < 0)
+                        return -ENOMEM;
+
+                v += n;
+                if (*v == '\0')
+                        break;
+        }
+
+        *ret = TAKE_PTR(l);
+        return 0;
+}
+
+static int index_rules(struct udev_rules *rules) {
+        unsigned i, o;
+        int r;
+
+        assert(rules);
+
+        for (i = 0; i < rules->token_cur; i++)
+                if (rules->tokens[i].type == TK_RULE)
+                        rules->n_rules++;
+        if (rules->n_rules == 0)
+                return 0;
+
+        rules->rule_tokens = new(unsigned, rules->n_rules);
+        if (!rules->rule_tokens)
+                return -ENOMEM;
+
+        for (i = 0, o = 0; i < rules->token_cur; i++) {
+                _cleanup_strv_free_ char **subsystems = NULL, **kernels = NULL, **actions = NULL;
+                struct token *rule = &rules->tokens[i], *t;
+                Hashmap **h;
+                char **values, **v;
+
+                if (rule->type != TK_RULE)
+                        continue;
+
+                rules->rule_tokens[o] = i;
+
+                /* All match keys of a rule have to match, and those sorted before SUBSYSTEM== have no side effects,
+                 * hence a rule which fails any of the keys we index by is never applied to an event. */
+                for (t = rule + 1; t < rule + rule->rule.token_count; t++) {
+                        char ***values_by_type;
+
+                        if (t->type == TK_M_SUBSYSTEM)
+                                values_by_type = &subsystems;
+                        else if (t->type == TK_M_KERNEL)
+                                values_by_type = &kernels;
+                        else if (t->type == TK_M_ACTION)
+                                values_by_type = &actions;
+                        else
+                                continue;
+
+                        if (*values_by_type) /* One key of each type is enough */
+                                continue;
+
+                        r = token_index_values(rules, t, t->type == TK_M_KERNEL, values_by_type);
+                        if (r < 0)
+                                return r;
+                }
+
+                if (subsystems) {
+                        h = &rules->rules_by_subsystem;
+                        values = subsystems;
+                } else if (kernels) {
+                        h = &rules->rules_by_kernel;
+                        values = kernels;
+                } else if (actions) {
+                        h = &rules->rules_by_action;
+                        values = actions;
+                } else {
+                        h = NULL;
+                        values = NULL;
+                }
+
+                if (h)
+                        STRV_FOREACH(v, values) {
+                                r = rules_index_add(h, *v, o);
+                                if (r < 0)
+                                        return r;
+                        }
+                else {
+                        r = rule_list_add(&rules->rules_unindexed, o);
+                        if (r < 0)
+                                return r;
+                }
+
+                o++;
+        }
+
+        log_debug("Indexed %zu rules by %u subsystems, %u kernel name prefixes, %u actions, %zu rules not indexed",
+                  rules->n_rules, hashmap_size(rules->rules_by_subsystem), hashmap_size(rules->rules_by_kernel),
+                  hashmap_size(rules->rules_by_action), rules->rules_unindexed.n_rules);
+
+        return 0;
+}
+
+static void unindex_rules(struct udev_rules *rules) {
+        assert(rules);
+
+        rules->rule_tokens = mfree(rules->rule_tokens);
+        rules->n_rules = 0;
+        rules->rules_by_subsystem = hashmap_free(rules->rules_by_subsystem);
+        rules->rules_by_kernel = hashmap_free(rules->rules_by_kernel);
+        rules->rules_by_action = hashmap_free(rules->rules_by_action);
+        rules->rules_unindexed.rules = mfree(rules->rules_unindexed.rules);
+        rules->rules_unindexed.n_rules = rules->rules_unindexed.n_allocated = 0;
+}
+
+static void fingerprint_file(const char *path, struct siphash *state) {
+        struct stat st;
+
+        siphash24_compress(path, strlen(path) + 1, state);
+
+        if (stat(path, &st) < 0) {
+                siphash24_compress_byte(0, state);
+                return;
+        }
+
+        siphash24_compress_byte(1, state);
+        siphash24_compress(&st.st_dev, sizeof(st.st_dev), state);
+        siphash24_compress(&st.st_ino, sizeof(st.st_ino), state);
+        siphash24_compress(&st.st_size, sizeof(st.st_size), state);
+        siphash24_compress(&st.st_mtim, sizeof(st.st_mtim), state);
+}
+
+static uint64_t rules_fingerprint(char **files, ResolveNameTiming resolve_name_timing) {
+        static const uint8_t hash_key[16] = {
+                0x8c, 0x2a, 0x5e, 0x71, 0x0f, 0xd3, 0x46, 0xb9,
+                0xa4, 0x17, 0x6b, 0xe2, 0x39, 0xc5, 0x90, 0x5d,
+        };
+        struct siphash state;
+        char **f;
+
+        /* The rules files that would be parsed, identified by their inode, size and mtime. This also catches
+         * files that are edited in place, which does not touch the mtime of the directories. */
+        siphash24_init(&state, hash_key);
+        siphash24_compress(&resolve_name_timing, sizeof(resolve_name_timing), &state);
+
+        STRV_FOREACH(f, files)
+                fingerprint_file(*f, &state);
+
+        /* With resolve_names=early, user and group names are resolved while parsing, hence the local databases
+         * are part of the input too. Changes in other NSS sources are not noticed, just like they are not
+         * noticed by rules that are loaded already. */
+        if (resolve_name_timing == RESOLVE_NAME_EARLY) {
+                fingerprint_file("/etc/passwd", &state);
+                fingerprint_file("/etc/group", &state);
+        }
+
+        return siphash24_finalize(&state);
+}
+
+static size_t rules_strings_size(struct udev_rules *rules) {
+        if (rules->cache_map)
+                return rules->cache_size - sizeof(struct rules_cache_header) - rules->token_cur * sizeof(struct token);
+
+        return rules->strbuf->len;
+}
+
+/* Returns 1 if the rules were loaded from the cache, 0 if the cache is out of date, negative errno otherwise */
+static int rules_load_cache(struct udev_rules *rules) {
+        static const uint8_t sig[] = RULES_CACHE_SIG;
+        const struct rules_cache_header *h;
+        _cleanup_close_ int fd = -1;
+        struct token *tokens;
+        size_t tokens_size;
+        char *strings;
+        struct stat st;
+        void *map;
+        int r;
+
+        fd = open(UDEV_RULES_CACHE, O_RDONLY|O_CLOEXEC|O_NOCTTY);
+        if (fd < 0)
+                return -errno;
+
+        if (fstat(fd, &st) < 0)
+                return -errno;
+        if (!S_ISREG(st.st_mode))
+                return -EBADMSG;
+        if (st.st_size < (off_t) sizeof(struct rules_cache_header) || (uint64_t) st.st_size > SIZE_MAX)
+                return -EBADMSG;
+
+        map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED)
+                return -errno;
+
+        h = map;
+        if (memcmp(h->signature, sig, sizeof(sig)) != 0 ||
+            strncmp(h->tool_version, PACKAGE_VERSION, sizeof(h->tool_version)) != 0 ||
+            h->header_size != sizeof(struct rules_cache_header) ||
+            h->token_size != sizeof(struct token) ||
+            h->token_types != TK_END) {
+                r = -EBADMSG;
+                goto fail;
+        }
+
+        if (h->resolve_name_timing != (uint32_t) rules->resolve_name_timing ||
+            h->fingerprint != rules->fingerprint) {
+                r = 0;
+                goto fail;
+        }
+
+        if (h->n_tokens == 0 || h->n_tokens > UINT_MAX || h->strings_size == 0) {
+                r = -EBADMSG;
+                goto fail;
+        }
+
+        tokens_size = h->n_tokens * sizeof(struct token);
+        if (sizeof(struct rules_cache_header) + tokens_size + h->strings_size != (uint64_t) st.st_size) {
+                r = -EBADMSG;
+                goto fail;
+        }
+
+        /* The last token terminates the rules, and the last string the string buffer */
+        tokens = (struct token*) ((uint8_t*) map + sizeof(struct rules_cache_header));
+        strings = (char*) tokens + tokens_size;
+        if (tokens[h->n_tokens - 1].type != TK_END || strings[h->strings_size - 1] != '\0') {
+                r = -EBADMSG;
+                goto fail;
+        }
+
+        rules->cache_map = map;
+        rules->cache_size = st.st_size;
+        rules->cache_strings = strings;
+        rules->tokens = tokens;
+        rules->token_cur = rules->token_max = h->n_tokens;
+
+        log_debug("Loaded %u tokens and %"PRIu64" bytes strings from %s",
+                  rules->token_cur, h->strings_size, UDEV_RULES_CACHE);
+        return 1;
+
+fail:
+        (void) munmap(map, st.st_size);
+        return r;
+}
+
+int udev_rules_save_cache(struct udev_rules *rules, bool create) {
+        _cleanup_(unlink_and_freep) char *temp_path = NULL;
+        _cleanup_fclose_ FILE *f = NULL;
+        struct rules_cache_header h = {
+                .signature = RULES_CACHE_SIG,
+                .header_size = sizeof(struct rules_cache_header),
+                .token_size = sizeof(struct token),
+                .token_types = TK_END,
+        };
+        int r;
+
+        assert(rules);
+
+        /* Unless asked to create it, only refresh a cache that exists already, and is out of date */
+        if (!create && (rules->cache_map || access(UDEV_RULES_CACHE, F_OK) < 0))
+                return 0;
+
+        strncpy(h.tool_version, PACKAGE_VERSION, sizeof(h.tool_version));
+        h.resolve_name_timing = rules->resolve_name_timing;
+        h.fingerprint = rules->fingerprint;
+        h.n_tokens = rules->token_cur;
+        h.strings_size = rules_strings_size(rules);
+
+        r = fopen_temporary(UDEV_RULES_CACHE, &f, &temp_path);
+        if (r < 0)
+                return log_debug_errno(r, "Failed to create temporary file for %s: %m", UDEV_RULES_CACHE);
+
+        (void) fchmod(fileno(f), 0444);
+
+        fwrite(&h, sizeof(h), 1, f);
+        fwrite(rules->tokens, sizeof(struct token), rules->token_cur, f);
+        fwrite(rules_str(rules, 0), h.strings_size, 1, f);
+
+        r = fflush_sync_and_check(f);
+        if (r < 0)
+                return log_debug_errno(r, "Failed to write %s: %m", temp_path);
+
+        if (rename(temp_path, UDEV_RULES_CACHE) < 0)
+                return log_debug_errno(errno, "Failed to rename %s to %s: %m", temp_path, UDEV_RULES_CACHE);
+
+        temp_path = mfree(temp_path);
+
+        log_debug("Wrote %u tokens and %"PRIu64" bytes strings to %s",
+                  rules->token_cur, h.strings_size, UDEV_RULES_CACHE);
+        return 1;
+}
+
 struct udev_rules *udev_rules_new(ResolveNameTiming resolve_name_timing) {
         struct udev_rules *rules;
         struct token end_token;
-        char **files, **f;
+        _cleanup_strv_free_ char **files = NULL;
+        char **f;
         int r;
 
         assert(resolve_name_timing >= 0 && resolve_name_timing < _RESOLVE_NAME_TIMING_MAX);
@@ -1528,6 +1988,24 @@ struct udev_rules *udev_rules_new(ResolveNameTiming resolve_name_timing) {
                 .resolve_name_timing = resolve_name_timing,
         };
 
+        udev_rules_check_timestamp(rules);
+
+        r = conf_files_list_strv(&files, ".rules", NULL, 0, rules_dirs);
+        if (r < 0) {
+                log_error_errno(r, "Failed to enumerate rules files: %m");
+                return udev_rules_free(rules);
+        }
+
+        /* If the rules files did not change since the cache was written, skip parsing them */
+        rules->fingerprint = rules_fingerprint(files, resolve_name_timing);
+        r = rules_load_cache(rules);
+        if (r == 0)
+                log_debug("%s is out of date, parsing rules files.", UDEV_RULES_CACHE);
+        else if (r < 0 && r != -ENOENT)
+                log_debug_errno(r, "Failed to load %s, parsing rules files: %m", UDEV_RULES_CACHE);
+        if (r > 0)
+                goto finish;
+
         /* init token array and string buffer */
         rules->tokens = malloc_multiply(PREALLOC_TOKEN, sizeof(struct token));
         if (!rules->tokens)
@@ -1538,14 +2016,6 @@ struct udev_rules *udev_rules_new(ResolveNameTiming resolve_name_timing) {
         if (!rules->strbuf)
                 return udev_rules_free(rules);
 
-        udev_rules_check_timestamp(rules);
-
-        r = conf_files_list_strv(&files, ".rules", NULL, 0, rules_dirs);
-        if (r < 0) {
-                log_error_errno(r, "Failed to enumerate rules files: %m");
-                return udev_rules_free(rules);
-        }
-
         /*
          * The offset value in the rules strct is limited; add all
          * rules file names to the beginning of the string buffer.
@@ -1556,8 +2026,6 @@ struct udev_rules *udev_rules_new(ResolveNameTiming resolve_name_timing) {
         STRV_FOREACH(f, files)
                 parse_file(rules, *f);
 
-        strv_free(files);
-
         memzero(&end_token, sizeof(struct token));
         end_token.type = TK_END;
         add_token(rules, &end_token);
@@ -1570,6 +2038,14 @@ struct udev_rules *udev_rules_new(ResolveNameTiming resolve_name_timing) {
                   rules->strbuf->dedup_count, rules->strbuf->dedup_len, rules->strbuf->nodes_count);
         strbuf_complete(rules->strbuf);
 
+finish:
+        r = index_rules(rules);
+        if (r < 0) {
+                /* This only makes rule processing slower, but not different */
+                log_warning_errno(r, "Failed to index rules, ignoring: %m");
+                unindex_rules(rules);
+        }
+
         /* cleanup uid/gid cache */
         rules->uids = mfree(rules->uids);
         rules->uids_cur = 0;
@@ -1585,7 +2061,11 @@ struct udev_rules *udev_rules_new(ResolveNameTiming resolve_name_timing) {
 struct udev_rules *udev_rules_free(struct udev_rules *rules) {
         if (!rules)
                 return NULL;
-        free(rules->tokens);
+        if (rules->cache_map)
+                (void) munmap(rules->cache_map, rules->cache_size);
+        else
+                free(rules->tokens);
+        unindex_rules(rules);
         strbuf_cleanup(rules->strbuf);
         free(rules->uids);
         free(rules->gids);
@@ -1672,6 +2152,25 @@ static int match_key(struct udev_rules *rules, struct token *token, const char *
         return -1;
 }
 
+/* Once the first ATTRS key of a sequence is reached for a device, the others are likely to be needed too, hence read
+ * all of them at once */
+static void prefetch_attrs(struct udev_rules *rules, sd_device *dev, struct udev_event *event, struct token *cur, struct token *next) {
+        const char *names[16];
+        size_t n = 0;
+
+        for (; cur < next && n < ELEMENTSOF(names); cur++)
+                if (cur->type == TK_M_ATTRS && cur->key.attrsubst == SB_NONE)
+                        names[n++] = rules_str(rules, cur->key.attr_off);
+
+        if (n <= 1)
+                return;
+
+        if (dev == event->dev)
+                (void) device_prefetch_sysattrs(dev, names, n);
+        else
+                udev_attr_cache_prefetch(dev, names, n);
+}
+
 static int match_attr(struct udev_rules *rules, sd_device *dev, struct udev_event *event, struct token *cur) {
         char nbuf[UTIL_NAME_SIZE], vbuf[UTIL_NAME_SIZE];
         const char *name, *value;
@@ -1684,7 +2183,12 @@ static int match_attr(struct udev_rules *rules, sd_device *dev, struct udev_even
                 name = nbuf;
                 _fallthrough_;
         case SB_NONE:
-                if (sd_device_get_sysattr_value(dev, name, &value) < 0)
+                /* The attributes of the device of the event might just have changed, unlike those of its parents,
+                 * see udev-attr-cache.c */
+                if (dev == event->dev) {
+                        if (sd_device_get_sysattr_value(dev, name, &value) < 0)
+                                return -1;
+                } else if (udev_attr_cache_get_sysattr_value(dev, name, &value) < 0)
                         return -1;
                 break;
         case SB_SUBSYS:
@@ -1723,6 +2227,90 @@ enum escape_type {
         ESCAPE_REPLACE,
 };
 
+struct rule_cursor {
+        const struct rule_list *list;
+        size_t pos;
+};
+
+static int rules_get_candidates(struct udev_rules *rules, sd_device *dev, const char *action,
+                                struct rule_cursor **ret, size_t *ret_n) {
+        _cleanup_free_ struct rule_cursor *c = NULL;
+        const struct rule_list *l;
+        const char *val, *prefix;
+        size_t n = 0;
+        Iterator i;
+
+        assert(rules);
+        assert(dev);
+        assert(ret);
+        assert(ret_n);
+
+        /* Collects the lists of rules that might match the device, i.e. those indexed by its subsystem, action or a
+         * prefix of its kernel name, and those not indexed at all */
+
+        c = new(struct rule_cursor, 3 + hashmap_size(rules->rules_by_kernel));
+        if (!c)
+                return -ENOMEM;
+
+        c[n++] = (struct rule_cursor) { .list = &rules->rules_unindexed };
+
+        if (sd_device_get_subsystem(dev, &val) >= 0) {
+                l = hashmap_get(rules->rules_by_subsystem, val);
+                if (l)
+                        c[n++] = (struct rule_cursor) { .list = l };
+        }
+
+        l = hashmap_get(rules->rules_by_action, action);
+        if (l)
+                c[n++] = (struct rule_cursor) { .list = l };
+
+        if (sd_device_get_sysname(dev, &val) >= 0)
+                HASHMAP_FOREACH_KEY(l, prefix, rules->rules_by_kernel, i)
+                        if (startswith(val, prefix))
+                                c[n++] = (struct rule_cursor) { .list = l };
+
+        *ret = TAKE_PTR(c);
+        *ret_n = n;
+        return 0;
+}
+
+static unsigned rules_next_candidate(struct rule_cursor *c, size_t n, unsigned ordinal) {
+        unsigned next = UINT_MAX;
+        size_t i;
+
+        /* Returns the first rule at or after the specified one that might match, or UINT_MAX. Rules are only ever
+         * processed in ascending order, GOTO jumps forward only, hence the cursors never need to move back. */
+
+        for (i = 0; i < n; i++) {
+                while (c[i].pos < c[i].list->n_rules && c[i].list->rules[c[i].pos] < ordinal)
+                        c[i].pos++;
+
+                if (c[i].pos < c[i].list->n_rules)
+                        next = MIN(next, c[i].list->rules[c[i].pos]);
+        }
+
+        return next;
+}
+
+static unsigned rule_ordinal(struct udev_rules *rules, const struct token *rule) {
+        unsigned idx = rule - rules->tokens;
+        size_t left = 0, right = rules->n_rules;
+
+        /* Looks up the ordinal of a rule from its TK_RULE token */
+
+        while (left < right) {
+                size_t mid = left + (right - left) / 2;
+
+                if (rules->rule_tokens[mid] < idx)
+                        left = mid + 1;
+                else
+                        right = mid;
+        }
+
+        assert(left < rules->n_rules && rules->rule_tokens[left] == idx);
+        return left;
+}
+
 int udev_rules_apply_to_event(
                 struct udev_rules *rules,
                 struct udev_event *event,
@@ -1730,6 +2318,9 @@ int udev_rules_apply_to_event(
                 Hashmap *properties_list) {
         sd_device *dev = event->dev;
         enum escape_type esc = ESCAPE_UNSET;
+        _cleanup_free_ struct rule_cursor *candidates = NULL;
+        size_t n_candidates = 0;
+        unsigned n_skipped = 0;
         struct token *cur, *rule;
         const char *action, *val;
         bool can_set_name;
@@ -1742,6 +2333,12 @@ int udev_rules_apply_to_event(
         if (r < 0)
                 return r;
 
+        if (rules->rule_tokens) {
+                r = rules_get_candidates(rules, dev, action, &candidates, &n_candidates);
+                if (r < 0)
+                        log_device_debug_errno(dev, r, "Failed to look up candidate rules, processing all of them: %m");
+        }
+
         can_set_name = (!streq(action, "remove") &&
                         (sd_device_get_devnum(dev, NULL) >= 0 ||
                          sd_device_get_ifindex(dev, NULL) >= 0));
@@ -1753,6 +2350,24 @@ int udev_rules_apply_to_event(
                 dump_token(rules, cur);
                 switch (cur->type) {
                 case TK_RULE:
+                        /* skip to the next rule that might match at all */
+                        if (candidates) {
+                                unsigned ordinal, next;
+
+                                ordinal = rule_ordinal(rules, cur);
+                                next = rules_next_candidate(candidates, n_candidates, ordinal);
+                                if (next != ordinal) {
+                                        if (next == UINT_MAX) {
+                                                n_skipped += rules->n_rules - ordinal;
+                                                cur = &rules->tokens[rules->token_cur - 1];
+                                        } else {
+                                                n_skipped += next - ordinal;
+                                                cur = &rules->tokens[rules->rule_tokens[next]];
+                                        }
+                                        continue;
+                                }
+                        }
+
                         /* current rule */
                         rule = cur;
                         /* possibly skip rules which want to set NAME, SYMLINK, OWNER, GROUP, MODE */
@@ -1872,6 +2487,7 @@ int udev_rules_apply_to_event(
                         /* loop over parents */
                         event->dev_parent = dev;
                         for (;;) {
+                                bool prefetched = false;
                                 struct token *key;
 
                                 /* loop over sequence of parent match keys */
@@ -1897,6 +2513,10 @@ int udev_rules_apply_to_event(
                                                         goto try_parent;
                                                 break;
                                         case TK_M_ATTRS:
+                                                if (!prefetched) {
+                                                        prefetch_attrs(rules, event->dev_parent, event, key, next);
+                                                        prefetched = true;
+                                                }
                                                 if (match_attr(rules, event->dev_parent, event, key) != 0)
                                                         goto try_parent;
                                                 break;
@@ -1963,7 +2583,7 @@ int udev_rules_apply_to_event(
                                          rules_str(rules, rule->rule.filename_off),
                                          rule->rule.filename_line);
 
-                        if (udev_event_spawn(event, timeout_usec, true, program, result, sizeof(result)) < 0) {
+                        if (run_program(event, timeout_usec, cur->key.helper, program, result, sizeof(result)) < 0) {
                                 if (cur->key.op != OP_NOMATCH)
                                         goto nomatch;
                         } else {
@@ -1999,7 +2619,7 @@ int udev_rules_apply_to_event(
                                          rules_str(rules, rule->rule.filename_off),
                                          rule->rule.filename_line);
 
-                        if (import_program_into_properties(event, timeout_usec, import) != 0)
+                        if (import_program_into_properties(event, timeout_usec, cur->key.helper, import) != 0)
                                 if (cur->key.op != OP_NOMATCH)
                                         goto nomatch;
                         break;
@@ -2436,6 +3056,9 @@ int udev_rules_apply_to_event(
                         cur = &rules->tokens[cur->key.rule_goto];
                         continue;
                 case TK_END:
+                        if (candidates)
+                                log_device_debug(dev, "Skipped %u of %zu rules that cannot match the device's SUBSYSTEM, KERNEL or ACTION",
+                                                 n_skipped, rules->n_rules);
                         return 0;
 
                 case TK_M_PARENTS_MIN:
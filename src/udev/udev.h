@@ -16,6 +16,9 @@
 #define READ_END  0
 #define WRITE_END 1
 
+/* the compiled rules, see udev_rules_save_cache() */
+#define UDEV_RULES_CACHE "/etc/udev/rules.bin"
+
 struct udev_event {
         sd_device *dev;
         sd_device *dev_parent;
@@ -50,6 +53,7 @@ struct udev_rules;
 struct udev_rules *udev_rules_new(ResolveNameTiming resolve_name_timing);
 struct udev_rules *udev_rules_free(struct udev_rules *rules);
 bool udev_rules_check_timestamp(struct udev_rules *rules);
+int udev_rules_save_cache(struct udev_rules *rules, bool create);
 int udev_rules_apply_to_event(struct udev_rules *rules, struct udev_event *event,
                               usec_t timeout_usec,
                               Hashmap *properties_list);
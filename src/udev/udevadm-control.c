@@ -23,10 +23,44 @@
 #include "process-util.h"
 #include "syslog-util.h"
 #include "time-util.h"
+#include "udev.h"
 #include "udevadm.h"
 #include "udev-ctrl.h"
 #include "util.h"
 
+static int compile_rules(void) {
+        _cleanup_(udev_rules_freep) struct udev_rules *rules = NULL;
+        ResolveNameTiming resolve_name_timing = RESOLVE_NAME_EARLY;
+        int r;
+
+        /* The compiled rules are only picked up with the same name resolution timing as the daemon's */
+        (void) udev_parse_config_full(NULL, NULL, NULL, &resolve_name_timing);
+
+        rules = udev_rules_new(resolve_name_timing);
+        if (!rules)
+                return log_oom();
+
+        r = udev_rules_save_cache(rules, true);
+        if (r < 0)
+                return log_error_errno(r, "Failed to write %s: %m", UDEV_RULES_CACHE);
+
+        return 0;
+}
+
+static int show_statistics(struct udev_ctrl *uctrl, int timeout) {
+        _cleanup_free_ char *text = NULL;
+        int r;
+
+        r = udev_ctrl_send_statistics(uctrl, &text, timeout);
+        if (r == -EOPNOTSUPP)
+                return log_error_errno(r, "The udev daemon does not support statistics.");
+        if (r < 0)
+                return log_error_errno(r, "Failed to receive statistics: %m");
+
+        fputs(text, stdout);
+        return 0;
+}
+
 static int help(void) {
         printf("%s control OPTION\n\n"
                "Control the udev daemon.\n\n"
@@ -37,8 +71,10 @@ static int help(void) {
                "  -s --stop-exec-queue     Do not execute events, queue only\n"
                "  -S --start-exec-queue    Execute events, flush queue\n"
                "  -R --reload              Reload rules and databases\n"
+               "  -c --compile-rules       Compile the rules into " UDEV_RULES_CACHE "\n"
                "  -p --property=KEY=VALUE  Set a global property for all events\n"
-               "  -m --children-max=N      Maximum number of children\n"
+               "  -m --children-max=N      Maximum number of children, 0 to adjust it automatically\n"
+               "     --statistics          Show statistics about events and workers\n"
                "  -t --timeout=SECONDS     Maximum time to block for a reply\n"
                , program_invocation_short_name);
 
@@ -50,6 +86,10 @@ int control_main(int argc, char *argv[], void *userdata) {
         int timeout = 60;
         int c, r;
 
+        enum {
+                ARG_STATISTICS = 0x100,
+        };
+
         static const struct option options[] = {
                 { "exit",             no_argument,       NULL, 'e' },
                 { "log-priority",     required_argument, NULL, 'l' },
@@ -57,9 +97,11 @@ int control_main(int argc, char *argv[], void *userdata) {
                 { "start-exec-queue", no_argument,       NULL, 'S' },
                 { "reload",           no_argument,       NULL, 'R' },
                 { "reload-rules",     no_argument,       NULL, 'R' }, /* alias for -R */
+                { "compile-rules",    no_argument,       NULL, 'c' },
                 { "property",         required_argument, NULL, 'p' },
                 { "env",              required_argument, NULL, 'p' }, /* alias for -p */
                 { "children-max",     required_argument, NULL, 'm' },
+                { "statistics",       no_argument,       NULL, ARG_STATISTICS },
                 { "timeout",          required_argument, NULL, 't' },
                 { "version",          no_argument,       NULL, 'V' },
                 { "help",             no_argument,       NULL, 'h' },
@@ -77,7 +119,7 @@ int control_main(int argc, char *argv[], void *userdata) {
         if (!uctrl)
                 return -ENOMEM;
 
-        while ((c = getopt_long(argc, argv, "el:sSRp:m:t:Vh", options, NULL)) >= 0)
+        while ((c = getopt_long(argc, argv, "el:sSRcp:m:t:Vh", options, NULL)) >= 0)
                 switch (c) {
                 case 'e':
                         r = udev_ctrl_send_exit(uctrl, timeout);
@@ -108,6 +150,11 @@ int control_main(int argc, char *argv[], void *userdata) {
                         if (r < 0)
                                 return r;
                         break;
+                case 'c':
+                        r = compile_rules();
+                        if (r < 0)
+                                return r;
+                        break;
                 case 'p':
                         if (!strchr(optarg, '=')) {
                                 log_error("expect <KEY>=<value> instead of '%s'", optarg);
@@ -129,6 +176,11 @@ int control_main(int argc, char *argv[], void *userdata) {
                                 return r;
                         break;
                 }
+                case ARG_STATISTICS:
+                        r = show_statistics(uctrl, timeout);
+                        if (r < 0)
+                                return r;
+                        break;
                 case 't': {
                         usec_t s;
 
@@ -13,6 +13,7 @@
 #include "sd-device.h"
 
 #include "alloc-util.h"
+#include "device-db.h"
 #include "device-enumerator-private.h"
 #include "device-private.h"
 #include "device-util.h"
@@ -159,6 +160,10 @@ static int export_devices(void) {
         if (r < 0)
                 return r;
 
+        r = device_enumerator_set_n_threads(e, 0);
+        if (r < 0)
+                return r;
+
         r = device_enumerator_scan_devices(e);
         if (r < 0)
                 return r;
@@ -221,6 +226,8 @@ static void cleanup_db(void) {
         dir5 = opendir("/run/udev/watch");
         if (dir5)
                 cleanup_dir(dir5, 0, 1);
+
+        device_db_binary_invalidate();
 }
 
 static int help(void) {
@@ -13,36 +13,61 @@
 #include <string.h>
 #include <unistd.h>
 
+#include "sd-device.h"
+
 #include "libudev-util.h"
+#include "string-util.h"
+#include "strv.h"
 #include "time-util.h"
 #include "udevadm.h"
+#include "udevadm-util.h"
 #include "udev-ctrl.h"
 #include "util.h"
 
 static usec_t arg_timeout = 120 * USEC_PER_SEC;
 static const char *arg_exists = NULL;
+static char **arg_matches = NULL;
 
 static int help(void) {
-        printf("%s settle [OPTIONS]\n\n"
+        printf("%s settle [OPTIONS] [DEVPATH...]\n\n"
                "Wait for pending udev events.\n\n"
-               "  -h --help                 Show this help\n"
-               "  -V --version              Show package version\n"
-               "  -t --timeout=SEC          Maximum time to wait for events\n"
-               "  -E --exit-if-exists=FILE  Stop waiting if file exists\n"
+               "  -h --help                          Show this help\n"
+               "  -V --version                       Show package version\n"
+               "  -t --timeout=SEC                   Maximum time to wait for events\n"
+               "  -E --exit-if-exists=FILE           Stop waiting if file exists\n"
+               "     --subsystem-match=SUBSYSTEM     Wait for events of devices of that subsystem\n"
                , program_invocation_short_name);
 
         return 0;
 }
 
+static int add_match(const char *key, const char *value) {
+        char *m;
+
+        m = strjoin(key, "=", value);
+        if (!m)
+                return log_oom();
+
+        if (strv_consume(&arg_matches, m) < 0)
+                return log_oom();
+
+        return 0;
+}
+
 static int parse_argv(int argc, char *argv[]) {
+        enum {
+                ARG_SUBSYSTEM_MATCH = 0x100,
+        };
+
         static const struct option options[] = {
-                { "timeout",        required_argument, NULL, 't' },
-                { "exit-if-exists", required_argument, NULL, 'E' },
-                { "version",        no_argument,       NULL, 'V' },
-                { "help",           no_argument,       NULL, 'h' },
-                { "seq-start",      required_argument, NULL, 's' }, /* removed */
-                { "seq-end",        required_argument, NULL, 'e' }, /* removed */
-                { "quiet",          no_argument,       NULL, 'q' }, /* removed */
+                { "timeout",         required_argument, NULL, 't'                 },
+                { "exit-if-exists",  required_argument, NULL, 'E'                 },
+                { "subsystem-match", required_argument, NULL, ARG_SUBSYSTEM_MATCH },
+                { "version",         no_argument,       NULL, 'V'                 },
+                { "help",            no_argument,       NULL, 'h'                 },
+                { "seq-start",       required_argument, NULL, 's'                 }, /* removed */
+                { "seq-end",         required_argument, NULL, 'e'                 }, /* removed */
+                { "quiet",           no_argument,       NULL, 'q'                 }, /* removed */
                 {}
         };
 
@@ -58,6 +83,11 @@ static int parse_argv(int argc, char *argv[]) {
                 case 'E':
                         arg_exists = optarg;
                         break;
+                case ARG_SUBSYSTEM_MATCH:
+                        r = add_match("subsystem", optarg);
+                        if (r < 0)
+                                return r;
+                        break;
                 case 'V':
                         return print_version();
                 case 'h':
@@ -75,19 +105,50 @@ static int parse_argv(int argc, char *argv[]) {
                 }
         }
 
+        for (; optind < argc; optind++) {
+                _cleanup_(sd_device_unrefp) sd_device *dev = NULL;
+                const char *syspath;
+
+                r = find_device(argv[optind], NULL, &dev);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to open the device '%s': %m", argv[optind]);
+
+                r = sd_device_get_syspath(dev, &syspath);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to get syspath of '%s': %m", argv[optind]);
+
+                r = add_match("syspath", syspath);
+                if (r < 0)
+                        return r;
+        }
+
         return 1;
 }
 
-int settle_main(int argc, char *argv[], void *userdata) {
+/* Asks udevd to reply once the events are processed, returns -EOPNOTSUPP if it does not know how to */
+static int settle_udevd(void) {
+        _cleanup_(udev_ctrl_unrefp) struct udev_ctrl *uctrl = NULL;
+        unsigned n_events;
+        int r;
+
+        uctrl = udev_ctrl_new();
+        if (!uctrl)
+                return -EOPNOTSUPP;
+
+        r = udev_ctrl_send_settle(uctrl, arg_matches, arg_timeout, &n_events);
+        if (r < 0)
+                return r;
+
+        log_debug("Waited for %u events.", n_events);
+        return 0;
+}
+
+static int settle_queue(void) {
         _cleanup_(udev_queue_unrefp) struct udev_queue *queue = NULL;
         struct pollfd pfd;
         usec_t deadline;
         int r;
 
-        r = parse_argv(argc, argv);
-        if (r <= 0)
-                return r;
-
         deadline = now(CLOCK_MONOTONIC) + arg_timeout;
 
         /* guarantee that the udev daemon isn't pre-processing */
@@ -138,3 +199,40 @@ int settle_main(int argc, char *argv[], void *userdata) {
                 }
         }
 }
+
+static int settle(void) {
+        int r;
+
+        /* The file to wait for and a timeout of zero need the queue to be watched. Otherwise udevd tells us when
+         * the events are processed, and if it cannot, we wait for the whole queue, which includes the events of
+         * the requested devices. */
+        if (getuid() == 0 && !arg_exists && arg_timeout > 0) {
+                r = settle_udevd();
+                if (r != -EOPNOTSUPP) {
+                        if (IN_SET(r, -ENOENT, -ECONNREFUSED)) {
+                                log_debug_errno(r, "Failed to connect to udev daemon.");
+                                return 0;
+                        }
+                        if (r < 0 && r != -ETIMEDOUT)
+                                return log_error_errno(r, "Failed to wait for events: %m");
+
+                        return r;
+                }
+
+                log_debug("udev daemon does not support waiting for events, watching the queue.");
+        }
+
+        return settle_queue();
+}
+
+int settle_main(int argc, char *argv[], void *userdata) {
+        int r;
+
+        r = parse_argv(argc, argv);
+        if (r > 0)
+                r = settle();
+
+        arg_matches = strv_free(arg_matches);
+
+        return r;
+}
@@ -20,6 +20,7 @@
 #include "string-util.h"
 #include "strxcpyx.h"
 #include "udev-builtin.h"
+#include "udev-helper.h"
 #include "udev.h"
 #include "udevadm.h"
 
@@ -146,5 +147,6 @@ int test_main(int argc, char *argv[], void *userdata) {
         r = 0;
 out:
         udev_builtin_exit();
+        udev_helpers_free();
         return r;
 }
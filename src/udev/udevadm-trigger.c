@@ -6,61 +6,273 @@
 #include "sd-device.h"
 #include "sd-event.h"
 
+#include "alloc-util.h"
 #include "device-enumerator-private.h"
 #include "fd-util.h"
 #include "fileio.h"
+#include "hashmap.h"
+#include "list.h"
+#include "parse-util.h"
 #include "path-util.h"
-#include "set.h"
 #include "string-util.h"
 #include "strv.h"
+#include "time-util.h"
 #include "udevadm.h"
 #include "udevadm-util.h"
 
+/* Events which did not complete in that time are not waited for anymore, e.g. because udevd is not running */
+#define TRIGGER_EVENT_TIMEOUT_USEC (60 * USEC_PER_SEC)
+
 static bool arg_verbose = false;
 static bool arg_dry_run = false;
+static bool arg_statistics = false;
+
+typedef struct TriggerStats {
+        char *subsystem;
+        unsigned n_events;
+        unsigned n_timeouts;
+        usec_t total_usec;
+        usec_t max_usec;
+} TriggerStats;
+
+typedef struct TriggerEvent TriggerEvent;
+
+struct TriggerEvent {
+        char *syspath;
+        TriggerStats *stats;
+        usec_t timestamp;
+        LIST_FIELDS(TriggerEvent, queue);
+};
+
+typedef struct Trigger {
+        sd_device_enumerator *enumerator;
+        const char *action;
+        bool started;
+        bool done;
+
+        /* The number of events which may be triggered before the previous ones completed, 0 if they are not
+         * waited for */
+        unsigned max_outstanding;
+        Hashmap *events;
+        LIST_HEAD(TriggerEvent, queue); /* oldest first */
+        TriggerEvent *queue_tail;
+        sd_event_source *timeout_source;
+
+        unsigned n_timeouts;
+
+        Hashmap *stats;
+} Trigger;
+
+static void trigger_event_free(Trigger *t, TriggerEvent *ev) {
+        assert(t);
+        assert(ev);
+
+        (void) hashmap_remove(t->events, ev->syspath);
+
+        if (t->queue_tail == ev)
+                t->queue_tail = ev->queue_prev;
+        LIST_REMOVE(queue, t->queue, ev);
+
+        free(ev->syspath);
+        free(ev);
+}
+
+static TriggerStats *trigger_stats_free(TriggerStats *s) {
+        if (!s)
+                return NULL;
+
+        free(s->subsystem);
+        return mfree(s);
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(TriggerStats*, trigger_stats_free);
+
+static void trigger_done(Trigger *t) {
+        assert(t);
+
+        while (t->queue)
+                trigger_event_free(t, t->queue);
+
+        t->events = hashmap_free(t->events);
+        t->stats = hashmap_free_with_destructor(t->stats, trigger_stats_free);
+        t->timeout_source = sd_event_source_unref(t->timeout_source);
+}
+
+static TriggerStats *trigger_get_stats(Trigger *t, const char *subsystem) {
+        _cleanup_(trigger_stats_freep) TriggerStats *s = NULL;
+        TriggerStats *found;
+
+        found = hashmap_get(t->stats, subsystem);
+        if (found)
+                return found;
+
+        if (hashmap_ensure_allocated(&t->stats, &string_hash_ops) < 0)
+                return NULL;
+
+        s = new0(TriggerStats, 1);
+        if (!s)
+                return NULL;
+
+        s->subsystem = strdup(subsystem);
+        if (!s->subsystem)
+                return NULL;
+
+        if (hashmap_put(t->stats, s->subsystem, s) < 0)
+                return NULL;
+
+        return TAKE_PTR(s);
+}
+
+static void trigger_event_complete(Trigger *t, TriggerEvent *ev, bool timed_out) {
+        usec_t usec;
+
+        assert(t);
+        assert(ev);
+
+        if (timed_out) {
+                ev->stats->n_timeouts++;
+                t->n_timeouts++;
+        } else {
+                usec = usec_sub_unsigned(now(CLOCK_MONOTONIC), ev->timestamp);
+
+                ev->stats->n_events++;
+                ev->stats->total_usec = usec_add(ev->stats->total_usec, usec);
+                ev->stats->max_usec = MAX(ev->stats->max_usec, usec);
+        }
+
+        trigger_event_free(t, ev);
+}
 
-static int exec_list(sd_device_enumerator *e, const char *action, Set *settle_set) {
-        sd_device *d;
+static int trigger_device(Trigger *t, sd_device *d) {
+        _cleanup_free_ char *filename = NULL;
+        const char *syspath, *subsystem;
+        TriggerEvent *ev;
         int r;
 
-        FOREACH_DEVICE_AND_SUBSYSTEM(e, d) {
-                _cleanup_free_ char *filename = NULL;
-                const char *syspath;
+        if (sd_device_get_syspath(d, &syspath) < 0)
+                return 0;
 
-                if (sd_device_get_syspath(d, &syspath) < 0)
-                        continue;
+        if (arg_verbose)
+                printf("%s\n", syspath);
+        if (arg_dry_run)
+                return 0;
 
-                if (arg_verbose)
-                        printf("%s\n", syspath);
-                if (arg_dry_run)
-                        continue;
+        filename = path_join(syspath, "uevent");
+        if (!filename)
+                return log_oom();
 
-                filename = path_join(syspath, "uevent");
-                if (!filename)
-                        return log_oom();
+        r = write_string_file(filename, t->action, WRITE_STRING_FILE_DISABLE_BUFFER);
+        if (r < 0) {
+                log_debug_errno(r, "Failed to write '%s' to '%s', ignoring: %m", t->action, filename);
+                return 0;
+        }
 
-                r = write_string_file(filename, action, WRITE_STRING_FILE_DISABLE_BUFFER);
-                if (r < 0) {
-                        log_debug_errno(r, "Failed to write '%s' to '%s', ignoring: %m", action, filename);
-                        continue;
-                }
+        if (t->max_outstanding == 0)
+                return 0;
 
-                if (settle_set) {
-                        r = set_put_strdup(settle_set, syspath);
-                        if (r < 0)
-                                return log_oom();
+        if (sd_device_get_subsystem(d, &subsystem) < 0)
+                subsystem = "(none)";
+
+        r = hashmap_ensure_allocated(&t->events, &string_hash_ops);
+        if (r < 0)
+                return log_oom();
+
+        ev = new0(TriggerEvent, 1);
+        if (!ev)
+                return log_oom();
+
+        ev->syspath = strdup(syspath);
+        ev->stats = trigger_get_stats(t, subsystem);
+        if (!ev->syspath || !ev->stats) {
+                free(ev->syspath);
+                free(ev);
+                return log_oom();
+        }
+
+        ev->timestamp = now(CLOCK_MONOTONIC);
+
+        r = hashmap_put(t->events, ev->syspath, ev);
+        if (r < 0) {
+                free(ev->syspath);
+                free(ev);
+                /* The same device twice, which is only waited for once */
+                return r == -EEXIST ? 0 : log_oom();
+        }
+
+        LIST_INSERT_AFTER(queue, t->queue, t->queue_tail, ev);
+        t->queue_tail = ev;
+
+        return 0;
+}
+
+static int trigger_update_timeout(Trigger *t) {
+        int r;
+
+        if (!t->timeout_source)
+                return 0;
+
+        if (!t->queue)
+                return sd_event_source_set_enabled(t->timeout_source, SD_EVENT_OFF);
+
+        r = sd_event_source_set_time(t->timeout_source, usec_add(t->queue->timestamp, TRIGGER_EVENT_TIMEOUT_USEC));
+        if (r < 0)
+                return r;
+
+        return sd_event_source_set_enabled(t->timeout_source, SD_EVENT_ONESHOT);
+}
+
+/* Triggers the next devices, as long as not too many events are outstanding */
+static int trigger_run(Trigger *t) {
+        int r;
+
+        assert(t);
+
+        while (!t->done && (t->max_outstanding == 0 || hashmap_size(t->events) < t->max_outstanding)) {
+                sd_device *d;
+
+                d = t->started ? device_enumerator_get_next(t->enumerator) : device_enumerator_get_first(t->enumerator);
+                t->started = true;
+                if (!d) {
+                        t->done = true;
+                        break;
                 }
+
+                r = trigger_device(t, d);
+                if (r < 0)
+                        return r;
         }
 
+        r = trigger_update_timeout(t);
+        if (r < 0)
+                return log_error_errno(r, "Failed to update event timeout: %m");
+
+        return 0;
+}
+
+static bool trigger_finished(Trigger *t) {
+        return t->done && hashmap_isempty(t->events);
+}
+
+static int trigger_continue(Trigger *t, sd_event *event) {
+        int r;
+
+        r = trigger_run(t);
+        if (r < 0)
+                return sd_event_exit(event, r);
+
+        if (trigger_finished(t))
+                return sd_event_exit(event, 0);
+
         return 0;
 }
 
 static int device_monitor_handler(sd_device_monitor *m, sd_device *dev, void *userdata) {
-        Set *settle_set = userdata;
+        Trigger *t = userdata;
+        TriggerEvent *ev;
         const char *syspath;
 
         assert(dev);
-        assert(settle_set);
+        assert(t);
 
         if (sd_device_get_syspath(dev, &syspath) < 0)
                 return 0;
@@ -68,11 +280,61 @@ static int device_monitor_handler(sd_device_monitor *m, sd_device *dev, void *us
         if (arg_verbose)
                 printf("settle %s\n", syspath);
 
-        if (!set_remove(settle_set, syspath))
+        ev = hashmap_get(t->events, syspath);
+        if (!ev) {
                 log_debug("Got epoll event on syspath %s not present in syspath set", syspath);
+                return 0;
+        }
 
-        if (set_isempty(settle_set))
-                return sd_event_exit(sd_device_monitor_get_event(m), 0);
+        trigger_event_complete(t, ev, false);
+
+        return trigger_continue(t, sd_device_monitor_get_event(m));
+}
+
+static int on_event_timeout(sd_event_source *s, uint64_t usec, void *userdata) {
+        Trigger *t = userdata;
+
+        assert(t);
+
+        while (t->queue && usec_add(t->queue->timestamp, TRIGGER_EVENT_TIMEOUT_USEC) <= usec) {
+                log_debug("Event of %s did not complete in time, not waiting for it anymore.", t->queue->syspath);
+                trigger_event_complete(t, t->queue, true);
+        }
+
+        return trigger_continue(t, sd_event_source_get_event(s));
+}
+
+static int stats_compare(TriggerStats * const *a, TriggerStats * const *b) {
+        return strcmp((*a)->subsystem, (*b)->subsystem);
+}
+
+static int print_statistics(Trigger *t) {
+        _cleanup_free_ TriggerStats **l = NULL;
+        TriggerStats *s;
+        size_t n = 0, i;
+        Iterator j;
+
+        l = new(TriggerStats*, hashmap_size(t->stats) + 1);
+        if (!l)
+                return log_oom();
+
+        HASHMAP_FOREACH(s, t->stats, j)
+                l[n++] = s;
+
+        typesafe_qsort(l, n, stats_compare);
+
+        printf("%-24s %8s %8s %12s %12s %12s\n", "SUBSYSTEM", "EVENTS", "TIMEOUTS", "TOTAL", "AVERAGE", "MAX");
+
+        for (i = 0; i < n; i++) {
+                char total[FORMAT_TIMESPAN_MAX], average[FORMAT_TIMESPAN_MAX], max[FORMAT_TIMESPAN_MAX];
+
+                s = l[i];
+                printf("%-24s %8u %8u %12s %12s %12s\n",
+                       s->subsystem, s->n_events, s->n_timeouts,
+                       format_timespan(total, sizeof(total), s->total_usec, 1),
+                       s->n_events > 0 ? format_timespan(average, sizeof(average), s->total_usec / s->n_events, 1) : "-",
+                       format_timespan(max, sizeof(max), s->max_usec, 1));
+        }
 
         return 0;
 }
@@ -117,6 +379,10 @@ static int help(void) {
                "     --name-match=NAME              Trigger devices with this /dev name\n"
                "  -b --parent-match=NAME            Trigger devices with that parent device\n"
                "  -w --settle                       Wait for the triggered events to complete\n"
+               "     --max-outstanding=N            Wait for events to complete before triggering\n"
+               "                                    more than N at a time, implies --settle\n"
+               "     --statistics                   Print the processing time of the events per\n"
+               "                                    subsystem, implies --settle\n"
                , program_invocation_short_name);
 
         return 0;
@@ -125,25 +391,29 @@ static int help(void) {
 int trigger_main(int argc, char *argv[], void *userdata) {
         enum {
                 ARG_NAME = 0x100,
+                ARG_MAX_OUTSTANDING,
+                ARG_STATISTICS,
         };
 
         static const struct option options[] = {
-                { "verbose",           no_argument,       NULL, 'v'      },
-                { "dry-run",           no_argument,       NULL, 'n'      },
-                { "type",              required_argument, NULL, 't'      },
-                { "action",            required_argument, NULL, 'c'      },
-                { "subsystem-match",   required_argument, NULL, 's'      },
-                { "subsystem-nomatch", required_argument, NULL, 'S'      },
-                { "attr-match",        required_argument, NULL, 'a'      },
-                { "attr-nomatch",      required_argument, NULL, 'A'      },
-                { "property-match",    required_argument, NULL, 'p'      },
-                { "tag-match",         required_argument, NULL, 'g'      },
-                { "sysname-match",     required_argument, NULL, 'y'      },
-                { "name-match",        required_argument, NULL, ARG_NAME },
-                { "parent-match",      required_argument, NULL, 'b'      },
-                { "settle",            no_argument,       NULL, 'w'      },
-                { "version",           no_argument,       NULL, 'V'      },
-                { "help",              no_argument,       NULL, 'h'      },
+                { "verbose",           no_argument,       NULL, 'v'                 },
+                { "dry-run",           no_argument,       NULL, 'n'                 },
+                { "type",              required_argument, NULL, 't'                 },
+                { "action",            required_argument, NULL, 'c'                 },
+                { "subsystem-match",   required_argument, NULL, 's'                 },
+                { "subsystem-nomatch", required_argument, NULL, 'S'                 },
+                { "attr-match",        required_argument, NULL, 'a'                 },
+                { "attr-nomatch",      required_argument, NULL, 'A'                 },
+                { "property-match",    required_argument, NULL, 'p'                 },
+                { "tag-match",         required_argument, NULL, 'g'                 },
+                { "sysname-match",     required_argument, NULL, 'y'                 },
+                { "name-match",        required_argument, NULL, ARG_NAME            },
+                { "parent-match",      required_argument, NULL, 'b'                 },
+                { "settle",            no_argument,       NULL, 'w'                 },
+                { "max-outstanding",   required_argument, NULL, ARG_MAX_OUTSTANDING },
+                { "statistics",        no_argument,       NULL, ARG_STATISTICS      },
+                { "version",           no_argument,       NULL, 'V'                 },
+                { "help",              no_argument,       NULL, 'h'                 },
                 {}
         };
         enum {
@@ -154,7 +424,8 @@ int trigger_main(int argc, char *argv[], void *userdata) {
         _cleanup_(sd_device_enumerator_unrefp) sd_device_enumerator *e = NULL;
         _cleanup_(sd_device_monitor_unrefp) sd_device_monitor *m = NULL;
         _cleanup_(sd_event_unrefp) sd_event *event = NULL;
-        _cleanup_set_free_free_ Set *settle_set = NULL;
+        _cleanup_(trigger_done) Trigger t = {};
+        unsigned max_outstanding = 0;
         bool settle = false;
         int c, r;
 
@@ -166,6 +437,10 @@ int trigger_main(int argc, char *argv[], void *userdata) {
         if (r < 0)
                 return r;
 
+        r = device_enumerator_set_n_threads(e, 0);
+        if (r < 0)
+                return r;
+
         while ((c = getopt_long(argc, argv, "vnt:c:s:S:a:A:p:g:y:b:wVh", options, NULL)) >= 0) {
                 _cleanup_free_ char *buf = NULL;
                 const char *key, *val;
@@ -256,6 +531,20 @@ int trigger_main(int argc, char *argv[], void *userdata) {
                         settle = true;
                         break;
 
+                case ARG_MAX_OUTSTANDING:
+                        r = safe_atou(optarg, &max_outstanding);
+                        if (r < 0 || max_outstanding == 0) {
+                                log_error("Invalid number of outstanding events '%s'", optarg);
+                                return -EINVAL;
+                        }
+                        settle = true;
+                        break;
+
+                case ARG_STATISTICS:
+                        arg_statistics = true;
+                        settle = true;
+                        break;
+
                 case ARG_NAME: {
                         _cleanup_(sd_device_unrefp) sd_device *dev = NULL;
 
@@ -292,10 +581,13 @@ int trigger_main(int argc, char *argv[], void *userdata) {
                         return log_error_errno(r, "Failed to add parent match '%s': %m", argv[optind]);
         }
 
+        t = (Trigger) {
+                .enumerator = e,
+                .action = action,
+        };
+
         if (settle) {
-                settle_set = set_new(&string_hash_ops);
-                if (!settle_set)
-                        return log_oom();
+                t.max_outstanding = max_outstanding > 0 ? max_outstanding : UINT_MAX;
 
                 r = sd_event_default(&event);
                 if (r < 0)
@@ -309,9 +601,14 @@ int trigger_main(int argc, char *argv[], void *userdata) {
                 if (r < 0)
                         return log_error_errno(r, "Failed to attach event to device monitor: %m");
 
-                r = sd_device_monitor_start(m, device_monitor_handler, settle_set);
+                r = sd_device_monitor_start(m, device_monitor_handler, &t);
                 if (r < 0)
                         return log_error_errno(r, "Failed to start device monitor: %m");
+
+                r = sd_event_add_time(event, &t.timeout_source, CLOCK_MONOTONIC, USEC_INFINITY, USEC_PER_SEC,
+                                      on_event_timeout, &t);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to add event timeout: %m");
         }
 
         switch (device_type) {
@@ -328,15 +625,26 @@ int trigger_main(int argc, char *argv[], void *userdata) {
         default:
                 assert_not_reached("Unknown device type");
         }
-        r = exec_list(e, action, settle_set);
+
+        r = trigger_run(&t);
         if (r < 0)
                 return r;
 
-        if (event && !set_isempty(settle_set)) {
+        if (event && !trigger_finished(&t)) {
                 r = sd_event_loop(event);
                 if (r < 0)
                         return log_error_errno(r, "Event loop failed: %m");
         }
 
+        if (t.n_timeouts > 0) {
+                char buf[FORMAT_TIMESPAN_MAX];
+
+                log_warning("%u events did not complete within %s.",
+                            t.n_timeouts, format_timespan(buf, sizeof(buf), TRIGGER_EVENT_TIMEOUT_USEC, 0));
+        }
+
+        if (arg_statistics && !arg_dry_run)
+                return print_statistics(&t);
+
         return 0;
 }
@@ -34,6 +34,7 @@
 #include "cgroup-util.h"
 #include "cpu-set-util.h"
 #include "dev-setup.h"
+#include "device-db.h"
 #include "device-monitor-private.h"
 #include "device-private.h"
 #include "device-util.h"
@@ -50,21 +51,28 @@
 #include "mkdir.h"
 #include "netlink-util.h"
 #include "parse-util.h"
+#include "path-util.h"
 #include "pretty-print.h"
 #include "proc-cmdline.h"
+#include "procfs-util.h"
 #include "process-util.h"
 #include "selinux-util.h"
 #include "signal-util.h"
 #include "socket-util.h"
+#include "stdio-util.h"
 #include "string-util.h"
 #include "strv.h"
 #include "strxcpyx.h"
 #include "syslog-util.h"
+#include "udev-attr-cache.h"
 #include "udev-builtin.h"
 #include "udev-ctrl.h"
+#include "udev-event-index.h"
+#include "udev-helper.h"
 #include "udev-util.h"
 #include "udev-watch.h"
 #include "udev.h"
+#include "usdt.h"
 #include "user-util.h"
 
 static bool arg_debug = false;
@@ -74,10 +82,15 @@ static unsigned arg_children_max = 0;
 static usec_t arg_exec_delay_usec = 0;
 static usec_t arg_event_timeout_usec = 180 * USEC_PER_SEC;
 
+struct settler;
+
 typedef struct Manager {
         sd_event *event;
         Hashmap *workers;
         LIST_HEAD(struct event, events);
+        struct event *events_tail;
+        LIST_HEAD(struct settler, settlers);
+        struct event_index *event_index;
         const char *cgroup;
         pid_t pid; /* the process that originally allocated the manager object */
 
@@ -96,9 +109,26 @@ typedef struct Manager {
         sd_event_source *uevent_event;
         sd_event_source *inotify_event;
         sd_event_source *kill_workers_event;
+        sd_event_source *db_binary_event;
 
         usec_t last_usec;
 
+        /* The number of workers is adjusted between children_max_min and children_max_max, depending on the load
+         * of the machine and on the events waiting for a worker, unless a fixed limit is configured. */
+        unsigned n_cpus;
+        unsigned children_max;
+        unsigned children_max_min;
+        unsigned children_max_max;
+        usec_t children_max_usec;
+
+        /* statistics, see "udevadm control --statistics" */
+        uint64_t n_events_dispatched;
+        uint64_t n_events_reused;       /* passed to an idle worker, instead of a newly spawned one */
+        uint64_t n_events_processed;
+        uint64_t n_workers_spawned;
+        uint64_t n_workers_killed_idle;
+
+        bool db_binary_dirty:1;         /* events were processed since the binary database was last written */
         bool stop_exec_queue:1;
         bool exit:1;
 } Manager;
@@ -118,7 +148,7 @@ struct event {
         sd_device *dev_kernel; /* clone of originally received device */
 
         uint64_t seqnum;
-        uint64_t delaying_seqnum;
+        struct event_index_entry *index_entry;
 
         sd_event_source *timeout_warning_event;
         sd_event_source *timeout_event;
@@ -126,6 +156,20 @@ struct event {
         LIST_FIELDS(struct event, event);
 };
 
+/* A client of "udevadm settle", waiting for the events which were queued or running when it asked */
+struct settler {
+        Manager *manager;
+        struct udev_ctrl_connection *conn;
+        char **matches;         /* "syspath=PATH" or "subsystem=NAME", all events if empty */
+        uint64_t seqnum_max;    /* later events are not waited for */
+        unsigned n_events;
+        unsigned n_pending;
+
+        LIST_FIELDS(struct settler, settlers);
+};
+
+#define SETTLER_MATCHES_MAX 1024U
+
 static void event_queue_cleanup(Manager *manager, enum event_state type);
 
 enum worker_state {
@@ -141,19 +185,104 @@ struct worker {
         sd_device_monitor *monitor;
         enum worker_state state;
         struct event *event;
+
+        usec_t spawn_usec;
+        usec_t event_usec;      /* when the current event was passed to the worker */
+        uint64_t n_events;
+        usec_t latency_sum;
+        usec_t latency_max;
 };
 
 /* passed from worker to main process */
 struct worker_message {
 };
 
+static void settler_free(struct settler *settler) {
+        if (!settler)
+                return;
+
+        LIST_REMOVE(settlers, settler->manager->settlers, settler);
+        udev_ctrl_connection_unref(settler->conn);
+        strv_free(settler->matches);
+        free(settler);
+}
+
+static void manager_settlers_free(Manager *manager) {
+        while (manager->settlers)
+                settler_free(manager->settlers);
+}
+
+static bool settler_match(struct settler *settler, struct event *event) {
+        char **m;
+
+        if (event->seqnum > settler->seqnum_max)
+                return false;
+
+        if (strv_isempty(settler->matches))
+                return true;
+
+        STRV_FOREACH(m, settler->matches) {
+                const char *v, *value;
+
+                if ((v = startswith(*m, "syspath="))) {
+                        if (sd_device_get_syspath(event->dev_kernel, &value) >= 0 && path_equal(value, v))
+                                return true;
+                } else if ((v = startswith(*m, "subsystem="))) {
+                        if (sd_device_get_subsystem(event->dev_kernel, &value) >= 0 && streq(value, v))
+                                return true;
+                }
+        }
+
+        return false;
+}
+
+static void settler_finish(struct settler *settler) {
+        char line[DECIMAL_STR_MAX(unsigned)];
+        int r;
+
+        xsprintf(line, "%u", settler->n_events);
+        r = udev_ctrl_connection_send_reply(settler->conn, line);
+        if (r < 0)
+                log_debug_errno(r, "Failed to reply to settle request, ignoring: %m");
+
+        settler_free(settler);
+}
+
+static void manager_settlers_event_done(Manager *manager, struct event *event) {
+        struct settler *settler, *tmp;
+
+        LIST_FOREACH_SAFE(settlers, settler, tmp, manager->settlers) {
+                if (!settler_match(settler, event))
+                        continue;
+
+                assert(settler->n_pending > 0);
+                if (--settler->n_pending == 0)
+                        settler_finish(settler);
+        }
+}
+
 static void event_free(struct event *event) {
         if (!event)
                 return;
 
         assert(event->manager);
 
+        if (event->manager->events_tail == event)
+                event->manager->events_tail = event->event_prev;
         LIST_REMOVE(event, event->manager->events, event);
+        event_index_entry_free(event->index_entry);
+
+        /* the event might have changed the attributes of its device, which its children read from the cache */
+        if (event->worker && event->manager->pid == getpid_cached()) {
+                const char *syspath;
+
+                if (sd_device_get_syspath(event->dev, &syspath) >= 0)
+                        udev_attr_cache_invalidate(syspath);
+        }
+
+        if (event->manager->pid == getpid_cached())
+                manager_settlers_event_done(event->manager, event);
+
         sd_device_unref(event->dev);
         sd_device_unref(event->dev_kernel);
 
@@ -273,6 +402,9 @@ static void worker_attach_event(struct worker *worker, struct event *event) {
 
         assert_se(sd_event_now(e, CLOCK_MONOTONIC, &usec) >= 0);
 
+        worker->event_usec = usec;
+        worker->manager->n_events_dispatched++;
+
         (void) sd_event_add_time(e, &event->timeout_warning_event, CLOCK_MONOTONIC,
                                  usec + udev_warn_timeout(arg_event_timeout_usec), USEC_PER_SEC, on_event_timeout_warning, event);
 
@@ -287,11 +419,14 @@ static void manager_clear_for_worker(Manager *manager) {
         manager->uevent_event = sd_event_source_unref(manager->uevent_event);
         manager->inotify_event = sd_event_source_unref(manager->inotify_event);
         manager->kill_workers_event = sd_event_source_unref(manager->kill_workers_event);
+        manager->db_binary_event = sd_event_source_unref(manager->db_binary_event);
 
         manager->event = sd_event_unref(manager->event);
 
+        manager_settlers_free(manager);
         manager_workers_free(manager);
         event_queue_cleanup(manager, EVENT_UNDEF);
+        manager->event_index = event_index_free(manager->event_index);
 
         manager->monitor = sd_device_monitor_unref(manager->monitor);
         manager->ctrl_conn_blocking = udev_ctrl_connection_unref(manager->ctrl_conn_blocking);
@@ -305,6 +440,8 @@ static void manager_free(Manager *manager) {
                 return;
 
         udev_builtin_exit();
+        udev_helpers_free();
+        udev_attr_cache_free();
 
         manager_clear_for_worker(manager);
 
@@ -407,6 +544,7 @@ static int worker_process_device(Manager *manager, sd_device *dev) {
                 log_device_debug_errno(dev, r, "Failed to get SEQNUM: %m");
 
         log_device_debug(dev, "Processing device (SEQNUM=%s)", seqnum);
+        USDT_PROBE(udevd, event_start, dev, seqnum);
 
         udev_event = udev_event_new(dev, arg_exec_delay_usec, manager->rtnl);
         if (!udev_event)
@@ -445,6 +583,7 @@ static int worker_device_monitor_handler(sd_device_monitor *monitor, sd_device *
         assert(manager);
 
         r = worker_process_device(manager, dev);
+        USDT_PROBE(udevd, event_finish, dev, r);
         if (r < 0)
                 log_device_warning_errno(dev, r, "Failed to process device, ignoring: %m");
 
@@ -550,13 +689,17 @@ static int worker_spawn(Manager *manager, struct event *event) {
         if (r < 0)
                 return log_error_errno(r, "Failed to create worker object: %m");
 
+        assert_se(sd_event_now(manager->event, CLOCK_MONOTONIC, &worker->spawn_usec) >= 0);
+        manager->n_workers_spawned++;
+
         worker_attach_event(worker, event);
 
         log_device_debug(event->dev, "Worker ["PID_FMT"] is forked for processing SEQNUM=%"PRIu64".", pid, event->seqnum);
         return 0;
 }
 
-static void event_run(Manager *manager, struct event *event) {
+/* Returns false if the event could not be started, as the maximum number of workers is reached */
+static bool event_run(Manager *manager, struct event *event) {
         struct worker *worker;
         Iterator i;
         int r;
@@ -577,17 +720,19 @@ static void event_run(Manager *manager, struct event *event) {
                         continue;
                 }
                 worker_attach_event(worker, event);
-                return;
+                manager->n_events_reused++;
+                return true;
         }
 
-        if (hashmap_size(manager->workers) >= arg_children_max) {
-                if (arg_children_max > 1)
+        if (hashmap_size(manager->workers) >= manager->children_max) {
+                if (manager->children_max > 1)
                         log_debug("Maximum number (%u) of children reached.", hashmap_size(manager->workers));
-                return;
+                return false;
         }
 
         /* start new worker and pass initial device */
         worker_spawn(manager, event);
+        return true;
 }
 
 static int event_queue_insert(Manager *manager, sd_device *dev) {
@@ -639,13 +784,23 @@ static int event_queue_insert(Manager *manager, sd_device *dev) {
                 .state = EVENT_QUEUED,
         };
 
+        r = event_index_add(&manager->event_index, dev, seqnum, &event->index_entry);
+        if (r < 0) {
+                sd_device_unref(event->dev);
+                sd_device_unref(event->dev_kernel);
+                free(event);
+                return r;
+        }
+
         if (LIST_IS_EMPTY(manager->events)) {
                 r = touch("/run/udev/queue");
                 if (r < 0)
                         log_warning_errno(r, "Failed to touch /run/udev/queue: %m");
         }
 
-        LIST_APPEND(event, manager->events, event);
+        /* The queue can get very long during coldplug, hence don't look for its end */
+        LIST_INSERT_AFTER(event, manager->events, manager->events_tail, event);
+        manager->events_tail = event;
 
         if (DEBUG_LOGGING) {
                 if (sd_device_get_property_value(dev, "ACTION", &val) < 0)
@@ -657,8 +812,9 @@ static int event_queue_insert(Manager *manager, sd_device *dev) {
         return 0;
 }
 
-static void manager_kill_workers(Manager *manager) {
+static unsigned manager_kill_workers(Manager *manager) {
         struct worker *worker;
+        unsigned n = 0;
         Iterator i;
 
         assert(manager);
@@ -669,122 +825,94 @@ static void manager_kill_workers(Manager *manager) {
 
                 worker->state = WORKER_KILLED;
                 (void) kill(worker->pid, SIGTERM);
+                n++;
         }
-}
-
-/* lookup event for identical, parent, child device */
-static int is_device_busy(Manager *manager, struct event *event) {
-        const char *subsystem, *devpath, *devpath_old = NULL;
-        dev_t devnum = makedev(0, 0);
-        struct event *loop_event;
-        size_t devpath_len;
-        int r, ifindex = 0;
-        bool is_block;
 
-        r = sd_device_get_subsystem(event->dev, &subsystem);
-        if (r < 0)
-                return r;
-
-        is_block = streq(subsystem, "block");
-
-        r = sd_device_get_devpath(event->dev, &devpath);
-        if (r < 0)
-                return r;
-
-        devpath_len = strlen(devpath);
-
-        r = sd_device_get_property_value(event->dev, "DEVPATH_OLD", &devpath_old);
-        if (r < 0 && r != -ENOENT)
-                return r;
+        return n;
+}
 
-        r = sd_device_get_devnum(event->dev, &devnum);
-        if (r < 0 && r != -ENOENT)
-                return r;
+static unsigned manager_count_workers(Manager *manager, enum worker_state state) {
+        struct worker *worker;
+        unsigned n = 0;
+        Iterator i;
 
-        r = sd_device_get_ifindex(event->dev, &ifindex);
-        if (r < 0 && r != -ENOENT)
-                return r;
+        assert(manager);
 
-        /* check if queue contains events we depend on */
-        LIST_FOREACH(event, loop_event, manager->events) {
-                size_t loop_devpath_len, common;
-                const char *loop_devpath;
+        /* WORKER_UNDEF counts all workers which were not killed yet */
+        HASHMAP_FOREACH(worker, manager->workers, i)
+                if (state == WORKER_UNDEF ? worker->state != WORKER_KILLED : worker->state == state)
+                        n++;
 
-                /* we already found a later event, earlier cannot block us, no need to check again */
-                if (loop_event->seqnum < event->delaying_seqnum)
-                        continue;
+        return n;
+}
 
-                /* event we checked earlier still exists, no need to check again */
-                if (loop_event->seqnum == event->delaying_seqnum)
-                        return true;
+static void manager_set_children_max(Manager *manager, unsigned n) {
+        cpu_set_t cpu_set;
+        unsigned long mem_limit;
 
-                /* found ourself, no later event can block us */
-                if (loop_event->seqnum >= event->seqnum)
-                        break;
+        assert(manager);
 
-                /* check major/minor */
-                if (major(devnum) != 0) {
-                        const char *s;
-                        dev_t d;
+        manager->n_cpus = 1;
+        if (sched_getaffinity(0, sizeof(cpu_set), &cpu_set) == 0)
+                manager->n_cpus = MAX(CPU_COUNT(&cpu_set), 1);
 
-                        if (sd_device_get_subsystem(loop_event->dev, &s) < 0)
-                                continue;
+        manager->children_max_usec = 0;
 
-                        if (sd_device_get_devnum(loop_event->dev, &d) >= 0 &&
-                            devnum == d && is_block == streq(s, "block"))
-                                return true;
-                }
+        if (n > 0) {
+                manager->children_max = manager->children_max_min = manager->children_max_max = n;
+                log_debug("Set children_max to %u", n);
+                return;
+        }
 
-                /* check network device ifindex */
-                if (ifindex > 0) {
-                        int i;
+        /* Start with the same limit as before, and let the number of workers shrink to one per CPU when the
+         * machine is busy, and grow up to 32 per CPU when events are waiting for a worker while CPUs are idle.
+         * As each worker takes some memory, their number is limited to one per 128M of RAM. */
+        mem_limit = physical_memory() / (128LU*1024*1024);
+        manager->children_max = MAX(10U, MIN(8 + manager->n_cpus * 8, mem_limit));
+        manager->children_max_min = MIN(MAX(manager->n_cpus, 2U), manager->children_max);
+        manager->children_max_max = MAX(manager->children_max, MIN(8 + manager->n_cpus * 32, mem_limit));
 
-                        if (sd_device_get_ifindex(loop_event->dev, &i) >= 0 &&
-                            ifindex == i)
-                                return true;
-                }
-
-                if (sd_device_get_devpath(loop_event->dev, &loop_devpath) < 0)
-                        continue;
+        log_debug("Set children_max to %u, adjusting it between %u and %u",
+                  manager->children_max, manager->children_max_min, manager->children_max_max);
+}
 
-                /* check our old name */
-                if (devpath_old && streq(devpath_old, loop_devpath)) {
-                        event->delaying_seqnum = loop_event->seqnum;
-                        return true;
-                }
+static void manager_adjust_children_max(Manager *manager, usec_t usec, unsigned n_starved) {
+        uint64_t runnable;
+        unsigned n;
+        int r;
 
-                loop_devpath_len = strlen(loop_devpath);
+        assert(manager);
 
-                /* compare devpath */
-                common = MIN(devpath_len, loop_devpath_len);
+        if (manager->children_max_min == manager->children_max_max)
+                return;
 
-                /* one devpath is contained in the other? */
-                if (!strneq(devpath, loop_devpath, common))
-                        continue;
+        /* check the load once per second at most */
+        if (manager->children_max_usec != 0 &&
+            usec - manager->children_max_usec < USEC_PER_SEC)
+                return;
+        manager->children_max_usec = usec;
 
-                /* identical device event found */
-                if (devpath_len == loop_devpath_len) {
-                        /* devices names might have changed/swapped in the meantime */
-                        if (major(devnum) != 0 || ifindex > 0)
-                                continue;
-                        event->delaying_seqnum = loop_event->seqnum;
-                        return true;
-                }
+        r = procfs_tasks_get_runnable(&runnable);
+        if (r < 0) {
+                log_debug_errno(r, "Failed to read the number of runnable tasks, not adjusting children_max: %m");
+                return;
+        }
 
-                /* parent device event found */
-                if (devpath[common] == '/') {
-                        event->delaying_seqnum = loop_event->seqnum;
-                        return true;
-                }
+        n = manager->children_max;
+        if (runnable > 2 * manager->n_cpus)
+                /* the CPUs are busy, more workers would only compete with each other */
+                n = MAX(n - n / 4, manager->children_max_min);
+        else if (n_starved > 0 && runnable < manager->n_cpus)
+                /* events are waiting for a worker, and there are idle CPUs to run them */
+                n = MIN(n + MIN(n_starved, n / 4 + 1), manager->children_max_max);
 
-                /* child device event found */
-                if (loop_devpath[common] == '/') {
-                        event->delaying_seqnum = loop_event->seqnum;
-                        return true;
-                }
-        }
+        if (n == manager->children_max)
+                return;
 
-        return false;
+        log_debug("%s children_max to %u (%"PRIu64" runnable tasks on %u CPUs, %u events waiting for a worker)",
+                  n > manager->children_max ? "Increasing" : "Decreasing",
+                  n, runnable, manager->n_cpus, n_starved);
+        manager->children_max = n;
 }
 
 static int on_exit_timeout(sd_event_source *s, uint64_t usec, void *userdata) {
@@ -847,7 +975,7 @@ static void manager_reload(Manager *manager) {
 
         sd_notifyf(false,
                    "READY=1\n"
-                   "STATUS=Processing with %u children at max", arg_children_max);
+                   "STATUS=Processing with %u children at max", manager->children_max);
 }
 
 static int on_kill_workers_event(sd_event_source *s, uint64_t usec, void *userdata) {
@@ -856,13 +984,35 @@ static int on_kill_workers_event(sd_event_source *s, uint64_t usec, void *userda
         assert(manager);
 
         log_debug("Cleanup idle workers");
-        manager_kill_workers(manager);
+        manager->n_workers_killed_idle += manager_kill_workers(manager);
+
+        return 1;
+}
+
+static int on_db_binary_event(sd_event_source *s, uint64_t usec, void *userdata) {
+        Manager *manager = userdata;
+        int r;
+
+        assert(manager);
+
+        r = device_db_binary_update();
+        if (IN_SET(r, -EAGAIN, -ESTALE)) {
+                log_debug("The udev database changed while writing %s, trying again later", DEVICE_DB_BINARY_PATH);
+                return 1;
+        }
+        if (r < 0)
+                log_warning_errno(r, "Failed to write %s, ignoring: %m", DEVICE_DB_BINARY_PATH);
+        else if (r > 0)
+                log_debug("Wrote %s", DEVICE_DB_BINARY_PATH);
+
+        manager->db_binary_dirty = false;
 
         return 1;
 }
 
 static void event_queue_start(Manager *manager) {
         struct event *event;
+        unsigned n_starved = 0;
         usec_t usec;
         int r;
 
@@ -887,12 +1037,18 @@ static void event_queue_start(Manager *manager) {
         if (r < 0)
                 log_warning_errno(r, "Failed to disable event source for cleaning up idle workers, ignoring: %m");
 
+        r = event_source_disable(manager->db_binary_event);
+        if (r < 0)
+                log_warning_errno(r, "Failed to disable event source for writing the binary database, ignoring: %m");
+
         udev_builtin_init();
 
         if (!manager->rules) {
                 manager->rules = udev_rules_new(arg_resolve_name_timing);
                 if (!manager->rules)
                         return;
+
+                (void) udev_rules_save_cache(manager->rules, false);
         }
 
         LIST_FOREACH(event, event, manager->events) {
@@ -900,11 +1056,14 @@ static void event_queue_start(Manager *manager) {
                         continue;
 
                 /* do not start event if parent or child event is still running */
-                if (is_device_busy(manager, event) != 0)
+                if (event_index_entry_is_blocked(event->index_entry))
                         continue;
 
-                event_run(manager, event);
+                if (!event_run(manager, event))
+                        n_starved++;
         }
+
+        manager_adjust_children_max(manager, usec, n_starved);
 }
 
 static void event_queue_cleanup(Manager *manager, enum event_state match_type) {
@@ -981,7 +1140,28 @@ static int on_worker(sd_event_source *s, int fd, uint32_t revents, void *userdat
                         worker->state = WORKER_IDLE;
 
                 /* worker returned */
+                if (worker->event) {
+                        usec_t latency;
+
+                        assert_se(sd_event_now(manager->event, CLOCK_MONOTONIC, &latency) >= 0);
+                        latency = usec_sub_unsigned(latency, worker->event_usec);
+
+                        worker->n_events++;
+                        worker->latency_sum += latency;
+                        worker->latency_max = MAX(worker->latency_max, latency);
+                        manager->n_events_processed++;
+                        manager->db_binary_dirty = true;
+                }
                 event_free(worker->event);
+
+                /* children_max was decreased, do not keep more workers around */
+                if (worker->state == WORKER_IDLE &&
+                    hashmap_size(manager->workers) > manager->children_max &&
+                    manager_count_workers(manager, WORKER_UNDEF) > manager->children_max) {
+                        log_debug("Worker ["PID_FMT"] is not needed anymore, killing it", worker->pid);
+                        worker->state = WORKER_KILLED;
+                        (void) kill(worker->pid, SIGTERM);
+                }
         }
 
         /* we have free workers, try to schedule events */
@@ -990,18 +1170,19 @@ static int on_worker(sd_event_source *s, int fd, uint32_t revents, void *userdat
         return 1;
 }
 
-static int on_uevent(sd_device_monitor *monitor, sd_device *dev, void *userdata) {
+static int on_uevents(sd_device_monitor *monitor, sd_device **devices, size_t n_devices, void *userdata) {
         Manager *manager = userdata;
+        size_t i;
         int r;
 
         assert(manager);
 
-        device_ensure_usec_initialized(dev, NULL);
+        for (i = 0; i < n_devices; i++) {
+                device_ensure_usec_initialized(devices[i], NULL);
 
-        r = event_queue_insert(manager, dev);
-        if (r < 0) {
-                log_device_error_errno(dev, r, "Failed to insert device into event queue: %m");
-                return 1;
+                r = event_queue_insert(manager, devices[i]);
+                if (r < 0)
+                        log_device_error_errno(devices[i], r, "Failed to insert device into event queue: %m");
         }
 
         /* we have fresh events, try to schedule them */
@@ -1010,6 +1191,131 @@ static int on_uevent(sd_device_monitor *monitor, sd_device *dev, void *userdata)
         return 1;
 }
 
+static int manager_send_statistics(Manager *manager, struct udev_ctrl_connection *conn) {
+        char line[256], a[FORMAT_TIMESPAN_MAX], b[FORMAT_TIMESPAN_MAX], c[FORMAT_TIMESPAN_MAX];
+        struct worker *worker;
+        struct event *event;
+        unsigned n_queued = 0;
+        Iterator i;
+        usec_t usec;
+        int r;
+
+        assert(manager);
+        assert(conn);
+
+        assert_se(sd_event_now(manager->event, CLOCK_MONOTONIC, &usec) >= 0);
+
+        LIST_FOREACH(event, event, manager->events)
+                if (event->state == EVENT_QUEUED)
+                        n_queued++;
+
+        if (manager->children_max_min == manager->children_max_max)
+                xsprintf(line, "Maximum workers: %u", manager->children_max);
+        else
+                xsprintf(line, "Maximum workers: %u (adjusted between %u and %u)",
+                         manager->children_max, manager->children_max_min, manager->children_max_max);
+        r = udev_ctrl_connection_send_reply(conn, line);
+        if (r < 0)
+                return r;
+
+        xsprintf(line, "Workers: %u (%u running, %u idle)", hashmap_size(manager->workers),
+                 manager_count_workers(manager, WORKER_RUNNING), manager_count_workers(manager, WORKER_IDLE));
+        r = udev_ctrl_connection_send_reply(conn, line);
+        if (r < 0)
+                return r;
+
+        xsprintf(line, "Workers spawned: %"PRIu64", killed when idle: %"PRIu64,
+                 manager->n_workers_spawned, manager->n_workers_killed_idle);
+        r = udev_ctrl_connection_send_reply(conn, line);
+        if (r < 0)
+                return r;
+
+        xsprintf(line, "Events: %u queued, %"PRIu64" dispatched, %"PRIu64" processed",
+                 n_queued, manager->n_events_dispatched, manager->n_events_processed);
+        r = udev_ctrl_connection_send_reply(conn, line);
+        if (r < 0)
+                return r;
+
+        xsprintf(line, "Events passed to an idle worker: %"PRIu64" (%u%%)", manager->n_events_reused,
+                 manager->n_events_dispatched > 0 ? (unsigned) (manager->n_events_reused * 100 / manager->n_events_dispatched) : 0);
+        r = udev_ctrl_connection_send_reply(conn, line);
+        if (r < 0)
+                return r;
+
+        HASHMAP_FOREACH(worker, manager->workers, i) {
+                xsprintf(line, "Worker ["PID_FMT"]: %s, up %s, %"PRIu64" events, latency %s average, %s maximum",
+                         worker->pid,
+                         worker->state == WORKER_RUNNING ? "running" :
+                         worker->state == WORKER_IDLE ? "idle" : "killed",
+                         format_timespan(a, sizeof(a), usec_sub_unsigned(usec, worker->spawn_usec), USEC_PER_SEC),
+                         worker->n_events,
+                         format_timespan(b, sizeof(b), worker->n_events > 0 ? worker->latency_sum / worker->n_events : 0, USEC_PER_MSEC),
+                         format_timespan(c, sizeof(c), worker->latency_max, USEC_PER_MSEC));
+                r = udev_ctrl_connection_send_reply(conn, line);
+                if (r < 0)
+                        return r;
+        }
+
+        return 0;
+}
+
+static int manager_add_settler(Manager *manager, struct udev_ctrl_connection *conn, const char *match) {
+        _cleanup_strv_free_ char **matches = NULL;
+        struct settler *settler;
+        struct event *event;
+
+        assert(manager);
+        assert(conn);
+        assert(match);
+
+        /* The matches follow in further messages, up to an empty one */
+        while (!isempty(match)) {
+                _cleanup_(udev_ctrl_msg_unrefp) struct udev_ctrl_msg *ctrl_msg = NULL;
+
+                if (strv_length(matches) >= SETTLER_MATCHES_MAX)
+                        return -E2BIG;
+
+                if (!startswith(match, "syspath=") && !startswith(match, "subsystem="))
+                        return -EINVAL;
+
+                if (strv_extend(&matches, match) < 0)
+                        return -ENOMEM;
+
+                ctrl_msg = udev_ctrl_receive_msg(conn);
+                if (!ctrl_msg)
+                        return -EBADMSG;
+
+                match = udev_ctrl_get_settle(ctrl_msg);
+                if (!match)
+                        return -EBADMSG;
+        }
+
+        settler = new(struct settler, 1);
+        if (!settler)
+                return -ENOMEM;
+
+        *settler = (struct settler) {
+                .manager = manager,
+                .conn = udev_ctrl_connection_ref(conn),
+                .matches = TAKE_PTR(matches),
+                .seqnum_max = manager->events_tail ? manager->events_tail->seqnum : 0,
+        };
+        LIST_PREPEND(settlers, manager->settlers, settler);
+
+        LIST_FOREACH(event, event, manager->events)
+                if (settler_match(settler, event))
+                        settler->n_pending++;
+
+        settler->n_events = settler->n_pending;
+
+        log_debug("Waiting for %u events to finish", settler->n_events);
+
+        if (settler->n_pending == 0)
+                settler_finish(settler);
+
+        return 0;
+}
+
 /* receive the udevd message from userspace */
 static int on_ctrl_msg(sd_event_source *s, int fd, uint32_t revents, void *userdata) {
         Manager *manager = userdata;
@@ -1108,11 +1414,26 @@ static int on_ctrl_msg(sd_event_source *s, int fd, uint32_t revents, void *userd
         i = udev_ctrl_get_set_children_max(ctrl_msg);
         if (i >= 0) {
                 log_debug("Receivd udev control message (SET_MAX_CHILDREN), setting children_max=%i", i);
-                arg_children_max = i;
+                manager_set_children_max(manager, i);
 
                 (void) sd_notifyf(false,
                                   "READY=1\n"
-                                  "STATUS=Processing with %u children at max", arg_children_max);
+                                  "STATUS=Processing with %u children at max", manager->children_max);
+        }
+
+        if (udev_ctrl_get_statistics(ctrl_msg) > 0) {
+                log_debug("Received udev control message (STATISTICS)");
+                r = manager_send_statistics(manager, ctrl_conn);
+                if (r < 0)
+                        log_warning_errno(r, "Failed to send statistics, ignoring: %m");
+        }
+
+        str = udev_ctrl_get_settle(ctrl_msg);
+        if (str) {
+                log_debug("Received udev control message (SETTLE)");
+                r = manager_add_settler(manager, ctrl_conn, str);
+                if (r < 0)
+                        log_warning_errno(r, "Failed to wait for events, ignoring: %m");
         }
 
         if (udev_ctrl_get_ping(ctrl_msg) > 0)
@@ -1384,7 +1705,16 @@ static int on_post(sd_event_source *s, void *userdata) {
         if (!LIST_IS_EMPTY(manager->events))
                 return 1;
 
-        /* There are no pending events. Let's cleanup idle process. */
+        /* There are no pending events, hence no worker uses the attribute cache. */
+        udev_attr_cache_flush();
+
+        /* Let's write the binary database, once nothing happened for a while. */
+        if (manager->db_binary_dirty && !manager->exit)
+                (void) event_reset_time(manager->event, &manager->db_binary_event, CLOCK_MONOTONIC,
+                                        now(CLOCK_MONOTONIC) + 3 * USEC_PER_SEC, USEC_PER_SEC,
+                                        on_db_binary_event, manager, 0, "db-binary-event", false);
+
+        /* Let's cleanup idle process. */
 
         if (!hashmap_isempty(manager->workers)) {
                 /* There are idle workers */
@@ -1604,6 +1934,7 @@ static int manager_new(Manager **ret, int fd_ctrl, int fd_uevent, const char *cg
                 .fd_inotify = -1,
                 .worker_watch = { -1, -1 },
                 .cgroup = cgroup,
+                .db_binary_dirty = true,
         };
 
         udev_builtin_init();
@@ -1612,6 +1943,14 @@ static int manager_new(Manager **ret, int fd_ctrl, int fd_uevent, const char *cg
         if (!manager->rules)
                 return log_error_errno(SYNTHETIC_ERRNO(ENOMEM), "Failed to read udev rules");
 
+        /* Refresh the compiled rules, if they are used and were out of date */
+        (void) udev_rules_save_cache(manager->rules, false);
+
+        /* before any worker is forked off, so that all of them share it */
+        r = udev_attr_cache_new();
+        if (r < 0)
+                log_warning_errno(r, "Failed to set up attribute cache, ignoring: %m");
+
         manager->ctrl = udev_ctrl_new_from_fd(fd_ctrl);
         if (!manager->ctrl)
                 return log_error_errno(SYNTHETIC_ERRNO(EINVAL), "Failed to initialize udev control socket");
@@ -1698,7 +2037,7 @@ static int manager_new(Manager **ret, int fd_ctrl, int fd_uevent, const char *cg
         if (r < 0)
                 return log_error_errno(r, "Failed to attach event to device monitor: %m");
 
-        r = sd_device_monitor_start(manager->monitor, on_uevent, manager);
+        r = device_monitor_start_batch(manager->monitor, on_uevents, manager);
         if (r < 0)
                 return log_error_errno(r, "Failed to start device monitor: %m");
 
@@ -1727,13 +2066,15 @@ static int main_loop(int fd_ctrl, int fd_uevent, const char *cgroup) {
                 goto exit;
         }
 
+        manager_set_children_max(manager, arg_children_max);
+
         r = udev_rules_apply_static_dev_perms(manager->rules);
         if (r < 0)
                 log_error_errno(r, "Failed to apply permissions on static device nodes: %m");
 
         (void) sd_notifyf(false,
                           "READY=1\n"
-                          "STATUS=Processing with %u children at max", arg_children_max);
+                          "STATUS=Processing with %u children at max", manager->children_max);
 
         r = sd_event_loop(manager->event);
         if (r < 0) {
@@ -1781,21 +2122,6 @@ static int run(int argc, char *argv[]) {
         if (r < 0)
                 return r;
 
-        if (arg_children_max == 0) {
-                cpu_set_t cpu_set;
-                unsigned long mem_limit;
-
-                arg_children_max = 8;
-
-                if (sched_getaffinity(0, sizeof(cpu_set), &cpu_set) == 0)
-                        arg_children_max += CPU_COUNT(&cpu_set) * 8;
-
-                mem_limit = physical_memory() / (128LU*1024*1024);
-                arg_children_max = MAX(10U, MIN(arg_children_max, mem_limit));
-
-                log_debug("Set children_max to %u", arg_children_max);
-        }
-
         /* set umask before creating any file/directory */
         r = chdir("/");
         if (r < 0)
@@ -71,6 +71,9 @@ a+ /var/log/journal/%m/system.journal - - - - group:wheel:r--
 
 d /var/lib/systemd 0755 root root -
 d /var/lib/systemd/coredump 0755 root root 3d
+m4_ifdef(`ENABLE_NETWORKD',
+d /var/lib/systemd/network 0755 systemd-network systemd-network -
+)m4_dnl
 
 d /var/lib/private 0700 root root -
 d /var/log/private 0700 root root -